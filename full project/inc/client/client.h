@@ -68,6 +68,7 @@ void CL_Activate(active_t active);
 void CL_UpdateUserinfo(cvar_t *var, from_t from);
 void CL_SendStatusRequest(const netadr_t *address);
 demoInfo_t *CL_GetDemoInfo(const char *path, demoInfo_t *info);
+qboolean CL_Connected(void);
 qboolean CL_CheatsOK(void);
 void CL_SetSky(void);
 
@@ -120,6 +121,23 @@ extern const uint32_t   colorTable[8];
 
 qboolean SCR_ParseColor(const char *s, color_t *color);
 
+// retained 2D spans, keyed by a hash of everything they are drawn from
+typedef enum {
+    SPAN_STATUSBAR,
+    SPAN_LAYOUT,
+    SPAN_INVENTORY,
+    SPAN_CENTER,
+    SPAN_NOTIFY,
+    SPAN_CONSOLE,
+    SPAN_MENU       // one for every menu layer
+} drawspan_id_t;
+
+#define SPAN_HASH_INIT  2166136261u
+#define SPAN_HASH(h, v) SCR_HashBlock(h, &(v), sizeof(v))
+
+unsigned SCR_HashBlock(unsigned hash, const void *data, size_t len);
+qboolean SCR_BeginSpan(drawspan_id_t span, unsigned hash);
+
 float V_CalcFov(float fov_x, float width, float height);
 
 #else // USE_CLIENT
@@ -49,6 +49,10 @@ void WAVE_FillAPI(snddmaAPI_t *api);
 void DS_FillAPI(snddmaAPI_t *api);
 #endif
 
+#if USE_ALSA
+void ALSA_FillAPI(snddmaAPI_t *api);
+#endif
+
 extern dma_t    dma;
 extern int      paintedtime;
 
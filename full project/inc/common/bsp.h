@@ -97,7 +97,7 @@ typedef struct mface_s {
     int             texnum[2];
     int             firstvert;
     int             light_s, light_t;
-    float           stylecache[MAX_LIGHTMAPS];
+    qboolean        styledirty;     // referenced style changed value
 #else
     struct surfcache_s    *cachespots[MIPLEVELS]; // surface generation data
 #endif
@@ -106,7 +106,7 @@ typedef struct mface_s {
 
 #if USE_DLIGHTS
     int             dlightframe;
-    int             dlightbits;
+    unsigned        dlightbits;
 #endif
     struct mface_s  *next;
 } mface_t;
@@ -146,7 +146,7 @@ typedef struct {
     int                 contents;
     int                 numsides;
     mbrushside_t        *firstbrushside;
-    int                 checkcount;        // to avoid repeated testings
+    float               *planes;           // sides in groups of 4 normal x, y, z, dist
 } mbrush_t;
 
 typedef struct {
@@ -214,6 +214,9 @@ typedef struct bsp_s {
 
     unsigned    checksum;
 
+    unsigned    loadtime;   // msec spent in BSP_Load
+    unsigned    numshared;  // loads answered from the cache
+
     memhunk_t   hunk;
 
     int             numbrushsides;
@@ -243,6 +246,7 @@ typedef struct bsp_s {
     int             numvisibility;
     int             visrowsize;
     dvis_t          *vis;
+    byte            *visrows;       // decompressed PVS/PHS pairs, optional
 
     int             numentitychars;
     char            *entitystring;
@@ -30,6 +30,10 @@ typedef struct {
     int         *floodnums;     // if two areas have equal floodnums,
                                 // they are connected
     qboolean    *portalopen;
+    int         floodnext;      // unused floodnum for split areas
+    byte        *areabits;      // CM_WriteAreaBits output per area,
+                                // rebuilt whenever floodnums change
+    struct fatpvs_cache_s *fatpvs;  // recent CM_ClustersPVS results
 } cm_t;
 
 void        CM_Init(void);
@@ -75,6 +79,10 @@ mleaf_t     *CM_PointLeaf(cm_t *cm, vec3_t p);
 #define CM_LeafCluster(leaf)    (leaf)->cluster
 #define CM_LeafArea(leaf)       (leaf)->area
 
+#define MAX_FAT_CLUSTERS    64
+
+int         CM_FatClusters(cm_t *cm, const vec3_t org, int *clusters);
+byte        *CM_ClustersPVS(cm_t *cm, byte *mask, const int *clusters, int count);
 byte        *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org);
 
 void        CM_SetAreaPortalState(cm_t *cm, int portalnum, qboolean open);
@@ -88,4 +96,8 @@ qboolean    CM_HeadnodeVisible(mnode_t *headnode, byte *visbits);
 void        CM_WritePortalState(cm_t *cm, qhandle_t f);
 void        CM_ReadPortalState(cm_t *cm, qhandle_t f);
 
+#if USE_TESTS
+void        CM_TraceTest_f(void);
+#endif
+
 #endif // CMODEL_H
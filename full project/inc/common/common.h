@@ -133,6 +133,7 @@ void        Com_AddConfigFile(const char *name, unsigned flags);
 #endif
 
 extern cvar_t  *z_perturb;
+extern cvar_t  *z_slabs;
 
 #ifdef _DEBUG
 extern cvar_t   *developer;
@@ -169,6 +170,27 @@ extern unsigned     time_before_game;
 extern unsigned     time_after_game;
 extern unsigned     time_before_ref;
 extern unsigned     time_after_ref;
+
+// timedemo breakdown, summed in microseconds by TD_START/TD_STOP
+typedef enum {
+    TD_PARSE,
+    TD_DELTAFRAME,
+    TD_ADDENTITIES,
+    TD_WORLD,
+    TD_ENTITIES,
+    TD_PARTICLES,
+    TD_2D,
+    TD_SWAP,
+
+    TD_NUM_SECTIONS
+} tdsection_t;
+
+extern unsigned     time_sections[TD_NUM_SECTIONS];
+
+#define TD_START(s) \
+    do { if (com_timedemo->integer) time_sections[s] -= Sys_Microseconds(); } while (0)
+#define TD_STOP(s) \
+    do { if (com_timedemo->integer) time_sections[s] += Sys_Microseconds(); } while (0)
 #endif
 
 extern const char   com_version_string[];
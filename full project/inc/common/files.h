@@ -67,10 +67,11 @@ typedef struct file_info_s {
 #define FS_SEARCH_STRIPEXT      0x00000800
 #define FS_SEARCH_DIRSONLY      0x00001000
 
-// bits 8 - 10, flag
+// bits 8 - 11, flag
 #define FS_FLAG_GZIP            0x00000100
 #define FS_FLAG_EXCL            0x00000200
 #define FS_FLAG_TEXT            0x00000400
+#define FS_FLAG_ASYNC           0x00000800  // FS_EasyOpenFile only
 
 //
 // Limit the maximum file size FS_LoadFile can handle, as a protection from
@@ -102,6 +103,15 @@ typedef struct file_info_s {
 void    FS_Init(void);
 void    FS_Shutdown(void);
 void    FS_Restart(qboolean total);
+void    FS_InvalidateIndex(void);
+
+#if USE_ZLIB
+void    FS_Prefetch(const char *path);
+void    FS_FlushPrefetch(void);
+#else
+#define FS_Prefetch(path)   (void)0
+#define FS_FlushPrefetch()  (void)0
+#endif
 
 #if USE_CLIENT
 qerror_t FS_RenameFile(const char *from, const char *to);
@@ -124,6 +134,9 @@ qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
     ((LittleLong(magic) & 0xe0ffffff) == 0x00088b1f)
 
 qerror_t FS_FilterFile(qhandle_t f);
+void    FS_ReadAhead(qhandle_t f, const char *path);
+void    FS_SuspendAsync(void);
+void    FS_ResumeAsync(void);
 
 #define FS_FileExistsEx(path, flags) \
     (FS_LoadFileEx(path, NULL, flags, TAG_FREE) != Q_ERR_NOENT)
@@ -134,6 +147,21 @@ ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t
 // a NULL buffer will just return the file length without loading
 // length < 0 indicates error
 
+// read only view of a whole file, not NUL terminated
+typedef struct {
+    void    *data;
+    size_t  len;
+    void    *base;      // start of mapping, NULL if data was loaded instead
+    size_t  maplen;
+    void    *pack;      // referenced pack that data points into, if any
+} fsmap_t;
+
+ssize_t FS_MapFile(const char *path, fsmap_t *map);
+void    FS_UnmapFile(fsmap_t *map);
+// files on disk and stored pak entries are memory mapped where supported,
+// anything else is loaded. pages not touched are never read. stored pak
+// entries point into a single mapping of the whole pack.
+
 qerror_t FS_WriteFile(const char *path, const void *data, size_t len);
 
 qboolean FS_EasyWriteFile(char *buf, size_t size, unsigned mode,
@@ -179,6 +207,20 @@ char *FS_ReplaceSeparators(char *s, int separator);
 
 void FS_File_g(const char *path, const char *ext, unsigned flags, genctx_t *ctx);
 
+#if USE_TESTS
+// lookup counters, for benchmarks
+typedef struct {
+    unsigned    lookups;        // calls to open_file_read
+    unsigned    strcmps;        // path comparisons in pak hashes
+    unsigned    diskopens;      // calls to open_from_disk
+    unsigned    reopens;        // mixed-case reopens
+    unsigned    misshits;       // missing files cache hits
+    unsigned    missadds;       // added to missing files cache
+} fs_counters_t;
+
+void FS_GetCounters(fs_counters_t *c);
+#endif
+
 extern cvar_t   *fs_game;
 
 extern char     fs_gamedir[];
@@ -35,6 +35,22 @@ void SetPlaneSignbits(cplane_t *plane);
 
 int BoxOnPlaneSide(vec3_t emins, vec3_t emaxs, cplane_t *p);
 
+// up to four planes in structure of arrays layout, for testing a box
+// against all of them at once
+typedef struct {
+    vec_t   normal[3][4];
+    vec_t   dist[4];
+} cplane4_t;
+
+void SetPlanes4(cplane4_t *out, const cplane_t *planes, int count);
+
+// bits 0-3 are set for planes the box is entirely in front of, bits 4-7
+// for planes it is entirely behind, matching BoxOnPlaneSide per plane
+#define BOX4_INFRONT(bits)  ((bits) & 15)
+#define BOX4_BEHIND(bits)   ((bits) >> 4)
+
+int BoxOnPlanes4Side(const vec3_t emins, const vec3_t emaxs, const cplane4_t *p);
+
 static inline int BoxOnPlaneSideFast(vec3_t emins, vec3_t emaxs, cplane_t *p)
 {
     // fast axial cases
@@ -77,7 +77,8 @@ typedef enum {
     MSG_ES_REMOVE       = (1 << 7)
 } msgEsFlags_t;
 
-extern sizebuf_t    msg_write;
+// per thread so server send workers can encode frames in parallel
+extern q_threadlocal sizebuf_t  msg_write;
 extern byte         msg_write_buffer[MAX_MSGLEN];
 
 extern sizebuf_t    msg_read;
@@ -143,6 +144,8 @@ void    MSG_ParseDeltaEntity(const entity_state_t *from, entity_state_t *to, int
 #if USE_CLIENT
 void    MSG_ParseDeltaPlayerstate_Default(const player_state_t *from, player_state_t *to, int flags);
 void    MSG_ParseDeltaPlayerstate_Enhanced(const player_state_t *from, player_state_t *to, int flags, int extraflags);
+void    MSG_UnpackEntity(entity_state_t *out, const entity_packed_t *in);
+void    MSG_UnpackPlayer(player_state_t *out, const player_packed_t *in);
 #endif
 void    MSG_ParseDeltaPlayerstate_Packet(const player_state_t *from, player_state_t *to, int flags);
 
@@ -40,6 +40,11 @@ typedef struct netchan_s {
     int         dropped;            // between last packet and previous
     unsigned    total_dropped;      // for statistics
     unsigned    total_received;
+    unsigned    total_retransmits;  // reliable messages sent again
+    unsigned    total_fragments_in;
+    unsigned    total_fragments_out;
+    uint64_t    total_bytes_in;     // including netchan headers
+    uint64_t    total_bytes_out;
 
     unsigned    last_received;      // for timeouts
     unsigned    last_sent;          // for retransmits
@@ -115,7 +120,11 @@ typedef struct netchan_new_s {
     sizebuf_t   fragment_in;
     byte        fragment_in_buf[MAX_MSGLEN];
 
-    sizebuf_t   fragment_out;
+// outgoing fragments are sliced from reliable_buf, or from fragment_out_buf
+// for oversize unreliable messages
+    byte        *fragment_data;
+    size_t      fragment_length;
+    size_t      fragment_offset;
     byte        fragment_out_buf[MAX_MSGLEN];
 } netchan_new_t;
 
@@ -94,6 +94,14 @@ typedef struct netadr_s {
     uint16_t port;
 } netadr_t;
 
+// one piece of a packet sent with NET_SendPacketv
+typedef struct {
+    const void  *data;
+    size_t      len;
+} netvec_t;
+
+#define MAX_NETVEC  4
+
 typedef enum netstate_e {
     NS_DISCONNECTED,// no socket opened
     NS_CONNECTING,  // connect() not yet completed
@@ -102,6 +110,22 @@ typedef enum netstate_e {
     NS_BROKEN       // fatal error has been signaled
 } netstate_t;
 
+typedef struct {
+    uint64_t    bytes_rcvd;
+    uint64_t    bytes_sent;
+    uint64_t    packets_rcvd;
+    uint64_t    packets_sent;
+    uint64_t    oob_dropped;
+} netcounters_t;
+
+// TCP listening sockets, each accepting streams on its own port
+typedef enum {
+    NL_GTV,         // MVD/GTV clients on net_tcp_port
+    NL_METRICS,     // metrics scrapes on sv_metrics_port
+
+    NL_COUNT
+} netlisten_t;
+
 typedef struct netstream_s {
     qsocket_t   socket;
     netadr_t    address;
@@ -194,23 +218,32 @@ qboolean    NET_GetAddress(netsrc_t sock, netadr_t *adr);
 void        NET_GetPackets(netsrc_t sock, void (*packet_cb)(void));
 qboolean    NET_SendPacket(netsrc_t sock, const void *data,
                            size_t len, const netadr_t *to);
+qboolean    NET_SendPacketv(netsrc_t sock, const netvec_t *vec,
+                            int count, const netadr_t *to);
+void        NET_BatchPackets(netsrc_t sock);
+void        NET_FlushPackets(netsrc_t sock);
 
 char        *NET_AdrToString(const netadr_t *a);
 qboolean    NET_StringToAdr(const char *s, netadr_t *a, int default_port);
 
 const char  *NET_ErrorString(void);
+void        NET_GetCounters(netcounters_t *c);
 
 void        NET_CloseStream(netstream_t *s);
 neterr_t    NET_Listen(qboolean listen);
 neterr_t    NET_Accept(netstream_t *s);
+neterr_t    NET_ListenPort(netlisten_t which, int port);
+neterr_t    NET_AcceptPort(netlisten_t which, netstream_t *s);
 neterr_t    NET_Connect(const netadr_t *peer, netstream_t *s);
 neterr_t    NET_RunConnect(netstream_t *s);
 neterr_t    NET_RunStream(netstream_t *s);
 void        NET_UpdateStream(netstream_t *s);
+size_t      NET_WriteStream(netstream_t *s, const void *data, size_t len);
 
 ioentry_t   *NET_AddFd(qsocket_t fd);
 void        NET_RemoveFd(qsocket_t fd);
 int         NET_Sleep(int msec);
+int         NET_SleepUntil(unsigned time);
 #if USE_AC_SERVER
 int         NET_Sleepv(int msec, ...);
 #endif
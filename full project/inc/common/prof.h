@@ -0,0 +1,59 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PROF_H
+#define PROF_H
+
+//
+// frame phase profiler, scopes may only be entered from the main thread
+//
+
+typedef enum {
+    PROF_GAME_FRAME,
+    PROF_SEND_MESSAGES,
+    PROF_BUILD_FRAME,
+    PROF_PARSE_MESSAGE,
+    PROF_RENDER_FRAME,
+    PROF_SOUND_UPDATE,
+    PROF_VCR_EFFECT,
+
+    PROF_NUM_SCOPES
+} profscope_t;
+
+typedef struct {
+    unsigned    count;      // number of times entered
+    unsigned    total;      // usec spent, averaged over recent frames
+    unsigned    max;        // longest single frame, usec
+} profstat_t;
+
+extern qboolean prof_enabled;
+
+#define PROF_Begin(scope) \
+    do { if (prof_enabled) PROF_BeginScope(scope); } while (0)
+#define PROF_End(scope) \
+    do { if (prof_enabled) PROF_EndScope(scope); } while (0)
+
+void PROF_BeginScope(profscope_t scope);
+void PROF_EndScope(profscope_t scope);
+void PROF_Frame(void);
+void PROF_GetStats(profstat_t *stats, int frames);
+const char *PROF_ScopeName(profscope_t scope);
+
+void PROF_Init(void);
+
+#endif // PROF_H
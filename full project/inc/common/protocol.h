@@ -45,7 +45,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define PROTOCOL_VERSION_Q2PRO_BEAM_ORIGIN      1017    // r1037-8
 #define PROTOCOL_VERSION_Q2PRO_SHORT_ANGLES     1018    // r1037-44
 #define PROTOCOL_VERSION_Q2PRO_SERVER_STATE     1019    // r1302
-#define PROTOCOL_VERSION_Q2PRO_CURRENT          1019    // r1302
+#define PROTOCOL_VERSION_Q2PRO_ZLIB_DICT        1020
+#define PROTOCOL_VERSION_Q2PRO_CURRENT          1020
 
 #define PROTOCOL_VERSION_MVD_MINIMUM            2009    // r168
 #define PROTOCOL_VERSION_MVD_CURRENT            2010    // r177
@@ -97,6 +98,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define MVD_MAGIC               MakeRawLong('M','V','D','2')
 
+// optional seek index following the EOF marker of uncompressed MVD2 files.
+// each entry is levelpos, framenum, filepos (32 bit), msglen (16 bit)
+// followed by snapshot data. file ends with offset of the first entry,
+// number of entries and this magic.
+#define MVD_INDEX_MAGIC         MakeRawLong('M','V','D','I')
+#define MVD_INDEX_FOOTER        12
+
 //
 // server to client
 //
@@ -133,6 +141,7 @@ typedef enum {
     svc_zdownload,
     svc_gamestate, // q2pro specific, means svc_playerupdate in r1q2
     svc_setting,
+    svc_loopframe,              // q2pro specific, in-process loopback only
 
     svc_num_types
 } svc_ops_t;
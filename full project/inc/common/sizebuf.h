@@ -25,7 +25,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define SZ_NC_SEND_NEW      MakeRawLong('n', 'c', '2', 's')
 #define SZ_NC_SEND_FRG      MakeRawLong('n', 'c', '2', 'f')
 #define SZ_NC_FRG_IN        MakeRawLong('n', 'c', '2', 'i')
-#define SZ_NC_FRG_OUT       MakeRawLong('n', 'c', '2', 'o')
 
 typedef struct {
     uint32_t    tag;
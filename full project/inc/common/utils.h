@@ -38,12 +38,18 @@ extern const char *const colorNames[10];
 qboolean Com_WildCmpEx(const char *filter, const char *string, int term, qboolean ignorecase);
 #define Com_WildCmp(filter, string)  Com_WildCmpEx(filter, string, 0, qfalse)
 
+typedef struct wildfilter_s wildfilter_t;
+
+wildfilter_t *Com_WildCompile(const char *filter);
+qboolean Com_WildMatch(const wildfilter_t *w, const char *string);
+
 #if USE_CLIENT || USE_MVD_CLIENT
 qboolean Com_ParseTimespec(const char *s, int *frames);
 #endif
 
 void Com_PlayerToEntityState(const player_state_t *ps, entity_state_t *es);
 
+unsigned Com_HashKey(const char *s);
 unsigned Com_HashString(const char *s, unsigned size);
 unsigned Com_HashStringLen(const char *s, size_t len, unsigned size);
 
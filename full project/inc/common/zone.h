@@ -54,12 +54,19 @@ void    Z_FreeTags(memtag_t tag);
 void    Z_LeakTest(memtag_t tag);
 void    Z_Check(void);
 void    Z_Stats_f(void);
+void    Z_GetTagStats(size_t *bytes, size_t *blocks);
+const char *Z_TagName(memtag_t tag);
 
 void    Z_TagReserve(size_t size, memtag_t tag);
 void    *Z_ReservedAlloc(size_t size) q_malloc;
 void    *Z_ReservedAllocz(size_t size) q_malloc;
 char    *Z_ReservedCopyString(const char *in) q_malloc;
 
+// valid until the end of the current frame
+void    *Z_FrameAlloc(size_t size) q_malloc;
+void    *Z_FrameAllocz(size_t size) q_malloc;
+void    Z_FrameReset(void);
+
 // may return pointer to static memory
 char    *Z_CvarCopyString(const char *in);
 
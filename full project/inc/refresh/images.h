@@ -82,6 +82,9 @@ typedef struct image_s {
 #if USE_REF == REF_GL
     unsigned        texnum; // gl texture binding
     float           sl, sh, tl, th;
+    unsigned        bytes; // estimated texture memory, 0 if not resident
+    int             lastframe; // last frame bound, for texture budget
+    qboolean        evicted; // deleted by texture budget, reload on bind
 #else
     byte            *pixels[4]; // mip levels
 #endif
@@ -98,6 +101,10 @@ extern int registration_sequence;
 
 extern uint32_t d_8to24table[256];
 
+// asynchronous readback slots, screenshots use the first two and the
+// frame stream the other two
+#define IMG_READBACK_SLOTS  4
+
 // these are implemented in src/refresh/images.c
 image_t *IMG_Find(const char *name, imagetype_t type);
 void IMG_FreeUnused(void);
@@ -105,6 +112,7 @@ void IMG_FreeAll(void);
 void IMG_Init(void);
 void IMG_Shutdown(void);
 void IMG_GetPalette(void);
+void IMG_CaptureFrame(void);
 
 image_t *IMG_ForHandle(qhandle_t h);
 
@@ -116,5 +124,32 @@ void IMG_MipMap(byte *out, byte *in, int width, int height);
 void IMG_Unload(image_t *image);
 void IMG_Load(image_t *image, byte *pic, int width, int height);
 byte *IMG_ReadPixels(qboolean reverse, int *width, int *height);
+qboolean IMG_BeginReadPixels(int slot, qboolean reverse);
+qboolean IMG_BeginReadYUV(int slot, int width, int height);
+byte *IMG_EndReadPixels(int slot, int *width, int *height);
+
+#if USE_REF == REF_GL
+// mipmapped 32-bit textures are uploaded in three steps: prepare and
+// finish on the main thread, process on any thread
+typedef struct {
+    byte        *levels;        // mip chain, level 0 first
+    int         width, height;  // level 0 size
+    qboolean    grayscale, luminance, lightscale, invert;
+    qboolean    hwmips;         // only level 0, driver builds the rest
+    qboolean    transparent;
+    qboolean    cache;          // store in texture cache when finished
+    uint32_t    rawlen, checksum, params;
+} imgupload_t;
+
+qboolean IMG_PrepareLoad(image_t *image, int width, int height,
+                         const byte *raw, size_t rawlen, imgupload_t *up);
+void IMG_ProcessLoad(byte *pic, int width, int height, imgupload_t *up);
+void IMG_FinishLoad(image_t *image, imgupload_t *up);
+
+// implemented in src/refresh/images.c
+void IMG_BeginRegistration(void);
+void IMG_EndRegistration(void);
+qerror_t IMG_Reload(image_t *image);
+#endif
 
 #endif // IMAGES_H
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // models.h -- common models manager
 //
 
+#include "shared/list.h"
 #include "system/hunk.h"
 #include "common/error.h"
 
@@ -46,6 +47,7 @@ typedef struct model_s {
         MOD_EMPTY
     } type;
     char name[MAX_QPATH];
+    list_t entry;
     int registration_sequence;
     memhunk_t hunk;
 
@@ -90,5 +92,8 @@ qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length);
 qerror_t MOD_LoadMD3(model_t *model, const void *rawdata, size_t length);
 #endif
 void MOD_Reference(model_t *model);
+#if USE_REF == REF_GL
+void MOD_FreeBuffers(model_t *model);
+#endif
 
 #endif // MODELS_H
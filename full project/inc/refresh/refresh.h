@@ -81,8 +81,13 @@ typedef struct entity_s {
 
     qhandle_t   skin;           // NULL for inline skin
     int         flags;
+
+    int         id;             // same across frames, 0 if none
 } entity_t;
 
+// entity ids are below this, one range of MAX_EDICTS per linked model
+#define MAX_ENTITY_IDS  (MAX_EDICTS * 4)
+
 typedef struct dlight_s {
     vec3_t  origin;
 #if USE_REF == REF_GL
@@ -204,6 +209,10 @@ void    R_EndRegistration(void);
 #define R_RegisterSkin(name)    R_RegisterImage(name, IT_SKIN, IF_NONE, NULL)
 
 void    R_RenderFrame(refdef_t *fd);
+
+// several views in their own rectangles of one frame, e.g. a CCTV wall
+#define MAX_VIEWS   9
+void    R_RenderFrames(refdef_t *fd, int count);
 void    R_LightPoint(vec3_t origin, vec3_t light);
 
 void    R_ClearColor(void);
@@ -221,6 +230,16 @@ void    R_TileClear(int x, int y, int w, int h, qhandle_t pic);
 void    R_DrawFill8(int x, int y, int w, int h, int c);
 void    R_DrawFill32(int x, int y, int w, int h, uint32_t color);
 
+// retained 2D spans. everything drawn between R_BeginSpan and R_EndSpan is
+// kept under the given version, and R_DrawSpan draws it again from the kept
+// vertices as long as version, scale and clipping match. returns qfalse if
+// the span has to be drawn anew. colors are baked in, so they are part of
+// what the version stands for.
+#define MAX_SPANS   32
+qboolean R_DrawSpan(int span, unsigned version);
+void    R_BeginSpan(int span, unsigned version);
+void    R_EndSpan(void);
+
 // video mode and refresh state management entry points
 void    R_BeginFrame(void);
 void    R_EndFrame(void);
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 extern game_export_t    mvd_ge;
 
 extern list_t mvd_gtv_list;
+extern list_t mvd_channel_list;
 
 struct client_s;
 
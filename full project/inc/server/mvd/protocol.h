@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // flags used in hello packet
 #define GTF_DEFLATE     1
 #define GTF_STRINGCMDS  2
+#define GTF_ZDICT       4   // deflate stream uses preset dictionary
 
 typedef enum {
     GTS_HELLO,
@@ -19,6 +19,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "common/cmodel.h"
+#include "common/msg.h"
 #include "common/net/net.h"
 
 typedef enum {
@@ -31,6 +33,8 @@ typedef enum {
 #if USE_ICMP
 void SV_ErrorEvent(netadr_t *from, int ee_errno, int ee_info);
 #endif
+qboolean SV_AnswerQuery(const netadr_t *from, const byte *data, size_t len,
+                        byte *reply, size_t *reply_len);
 void SV_Init(void);
 void SV_Shutdown(const char *finalmsg, error_type_t type);
 unsigned SV_Frame(unsigned msec);
@@ -43,4 +47,19 @@ void SV_SetConsoleTitle(void);
 int MVD_GetDemoPercent(qboolean *paused, int *framenum);
 #endif
 
+#if USE_CLIENT
+// frame handed to the local client when sv_loop_handoff is set
+typedef struct {
+    int             clientNum;
+    int             areabytes;
+    byte            areabits[MAX_MAP_AREA_BYTES];
+    qboolean        oldorigins;     // player old origins as game set them
+    player_packed_t ps;
+    int             num_entities;
+    entity_packed_t entities[MAX_PACKET_ENTITIES];
+} loopframe_t;
+
+qboolean SV_GetLoopFrame(int framenum, loopframe_t *frame);
+#endif
+
 #endif // SERVER_H
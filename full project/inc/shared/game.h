@@ -50,6 +50,9 @@ typedef enum {
 #define GMF_WANT_ALL_DISCONNECTS 8
 #define GMF_ENHANCED_SAVEGAMES 1024
 #define GMF_VARIABLE_FPS 2048
+#define GMF_BATCHED_TRACES 4096  // server only, game_import_t has BoxTraces
+#define GMF_PREFETCH_TRACES 8192 // server only, game_import_t has PrefetchTraces
+#define GMF_PROFILE_ZONES 16384  // server only, game_import_t has ProfileBegin/End
 
 //===============================================================
 
@@ -103,6 +106,14 @@ struct edict_s {
 
 //===============================================================
 
+// one ray submitted to BoxTraces
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;     // zero for a line trace
+    edict_t     *passent;
+    int         contentmask;
+} trace_request_t;
+
 //
 // functions provided by the main engine
 //
@@ -179,6 +190,22 @@ typedef struct {
     void (*AddCommandString)(const char *text);
 
     void (*DebugGraph)(float value, int color);
+
+    // same as calling trace for each request in order, but world clipping
+    // is done for all of them first. only present when GMF_BATCHED_TRACES
+    // is set in sv_features, older servers don't fill this in.
+    void (*BoxTraces)(const trace_request_t *requests, trace_t *results, int count);
+
+    // hints that traces like these will be requested during this frame,
+    // so the world part of them can be done ahead on several threads.
+    // passent is ignored. only present when GMF_PREFETCH_TRACES is set.
+    void (*PrefetchTraces)(const trace_request_t *requests, int count);
+
+    // time a named zone of game code for the server's 'gameprof' report.
+    // name should be a string literal, zones may nest. only present when
+    // GMF_PROFILE_ZONES is set.
+    void (*ProfileBegin)(const char *name);
+    void (*ProfileEnd)(const char *name);
 } game_import_t;
 
 //
@@ -112,6 +112,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_unused            __attribute__((unused))
 
+// number of trailing zero bits, undefined for zero
+#define q_ctz(x)            __builtin_ctz(x)
+
 #else /* __GNUC__ */
 
 #define q_printf(f, a)
@@ -133,4 +136,20 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_unused
 
+static inline int q_ctz(unsigned x)
+{
+    int i;
+
+    for (i = 0; !(x & 1); i++)
+        x >>= 1;
+
+    return i;
+}
+
 #endif /* !__GNUC__ */
+
+#ifdef _MSC_VER
+#define q_threadlocal       __declspec(thread)
+#else
+#define q_threadlocal       __thread
+#endif
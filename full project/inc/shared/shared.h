@@ -636,7 +636,6 @@ typedef struct cvar_s {
     char        *default_string;
     xchanged_t      changed;
     xgenerator_t    generator;
-    struct cvar_s   *hashNext;
 } cvar_t;
 
 #endif      // CVAR
@@ -24,9 +24,11 @@ typedef struct {
     size_t  maxsize;
     size_t  cursize;
     size_t  mapped;
+    qboolean    hugetlb;
 } memhunk_t;
 
 void    Hunk_Begin(memhunk_t *hunk, size_t maxsize);
+void    Hunk_BeginHuge(memhunk_t *hunk, size_t maxsize);
 void    *Hunk_Alloc(memhunk_t *hunk, size_t size);
 void    Hunk_End(memhunk_t *hunk);
 void    Hunk_Free(memhunk_t *hunk);
@@ -27,6 +27,7 @@ void    Sys_FreeLibrary(void *handle);
 void    *Sys_GetProcAddress(void *handle, const char *sym);
 
 unsigned    Sys_Milliseconds(void);
+unsigned    Sys_Microseconds(void);
 void    Sys_Sleep(int msec);
 
 void    Sys_Init(void);
@@ -63,4 +64,11 @@ extern cvar_t   *sys_libdir;
 extern cvar_t   *sys_homedir;
 extern cvar_t   *sys_forcegamelib;
 
+#ifndef _WIN32
+extern cvar_t   *sys_hugepages;
+extern cvar_t   *sys_numalocal;
+
+void    Sys_SpawnInstances(void);
+#endif
+
 #endif // SYSTEM_H
@@ -73,6 +73,64 @@ void AI_SetSightClient(void)
     }
 }
 
+/*
+=================
+AI_PrefetchTraces
+
+Announces the line of sight traces that monsters about to think are
+likely to do in FindTarget, ai_checkattack and M_CheckAttack, so that
+the server can clip them to the world ahead, on several threads. The
+traces themselves are still done where they always were, and give the
+same results either way.
+=================
+*/
+#define MAX_PREFETCH_TRACES     (MAX_EDICTS * 3)
+
+static void AI_AddPrefetch(trace_request_t *req, edict_t *self, edict_t *other, int mask)
+{
+    VectorCopy(self->s.origin, req->start);
+    req->start[2] += self->viewheight;
+    VectorCopy(other->s.origin, req->end);
+    req->end[2] += other->viewheight;
+    VectorClear(req->mins);
+    VectorClear(req->maxs);
+    req->passent = self;
+    req->contentmask = mask;
+}
+
+void AI_PrefetchTraces(void)
+{
+    static trace_request_t  requests[MAX_PREFETCH_TRACES];
+    edict_t *ent, *enemy;
+    int     i, count;
+
+    if (!sv_features || !(sv_features->integer & GMF_PREFETCH_TRACES))
+        return;
+
+    count = 0;
+    for (i = game.maxclients + 1, ent = &g_edicts[i]; i < globals.num_edicts; i++, ent++) {
+        if (!ent->inuse || !(ent->svflags & SVF_MONSTER) || ent->health <= 0)
+            continue;
+        if (ent->nextthink <= 0 || ent->nextthink > level.time + 0.001)
+            continue;
+
+        if (level.sight_client)
+            AI_AddPrefetch(&requests[count++], ent, level.sight_client, MASK_OPAQUE);
+
+        enemy = ent->enemy;
+        if (enemy && enemy->inuse) {
+            if (enemy != level.sight_client)
+                AI_AddPrefetch(&requests[count++], ent, enemy, MASK_OPAQUE);
+            if (enemy->health > 0)
+                AI_AddPrefetch(&requests[count++], ent, enemy,
+                               CONTENTS_SOLID | CONTENTS_MONSTER | CONTENTS_SLIME | CONTENTS_LAVA | CONTENTS_WINDOW);
+        }
+    }
+
+    if (count)
+        gi.PrefetchTraces(requests, count);
+}
+
 //============================================================================
 
 /*
@@ -263,23 +321,66 @@ int range(edict_t *self, edict_t *other)
 visible
 
 returns 1 if the entity is visible to self, even if not infront ()
+
+Results are remembered for the rest of the frame, keyed by the pair and
+both eye positions, since FindTarget, ai_checkattack and friends ask the
+same question several times per think.  Spots that are not in each
+other's PVS are rejected without tracing.
 =============
 */
+#define SIGHT_CACHE_SIZE    1024
+#define SIGHT_CACHE_MASK    (SIGHT_CACHE_SIZE - 1)
+
+typedef struct {
+    int         framenum;
+    edict_t     *self;
+    edict_t     *other;
+    vec3_t      spot1;
+    vec3_t      spot2;
+    qboolean    visible;
+} sightmemo_t;
+
+static sightmemo_t  sight_cache[SIGHT_CACHE_SIZE];
+
+void AI_ClearSightCache(void)
+{
+    memset(sight_cache, 0, sizeof(sight_cache));
+}
+
 qboolean visible(edict_t *self, edict_t *other)
 {
     vec3_t  spot1;
     vec3_t  spot2;
     trace_t trace;
+    sightmemo_t *memo;
+    unsigned    hash;
 
     VectorCopy(self->s.origin, spot1);
     spot1[2] += self->viewheight;
     VectorCopy(other->s.origin, spot2);
     spot2[2] += other->viewheight;
+
+    hash = (self - g_edicts) * 0x9e3779b1u + (other - g_edicts);
+    memo = &sight_cache[(hash ^ (hash >> 16)) & SIGHT_CACHE_MASK];
+    if (memo->framenum == level.framenum + 1 && memo->self == self && memo->other == other
+        && VectorCompare(memo->spot1, spot1) && VectorCompare(memo->spot2, spot2))
+        return memo->visible;
+
+    memo->framenum = level.framenum + 1;
+    memo->self = self;
+    memo->other = other;
+    VectorCopy(spot1, memo->spot1);
+    VectorCopy(spot2, memo->spot2);
+
+    if (!gi.inPVS(spot1, spot2)) {
+        memo->visible = qfalse;
+        return qfalse;
+    }
+
     trace = gi.trace(spot1, vec3_origin, vec3_origin, spot2, self, MASK_OPAQUE);
 
-    if (trace.fraction == 1.0)
-        return qtrue;
-    return qfalse;
+    memo->visible = (trace.fraction == 1.0);
+    return memo->visible;
 }
 
 
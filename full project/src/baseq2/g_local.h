@@ -543,6 +543,12 @@ extern  cvar_t  *sv_maplist;
 
 extern  cvar_t  *sv_features;
 
+// named timing zones for the server's 'gameprof' command
+#define G_ProfileBegin(name) \
+    do { if (sv_features && (sv_features->integer & GMF_PROFILE_ZONES)) gi.ProfileBegin(name); } while (0)
+#define G_ProfileEnd(name) \
+    do { if (sv_features && (sv_features->integer & GMF_PROFILE_ZONES)) gi.ProfileEnd(name); } while (0)
+
 #define world   (&g_edicts[0])
 
 // item spawnflags
@@ -611,6 +617,9 @@ void Touch_Item(edict_t *ent, edict_t *other, cplane_t *plane, csurface_t *surf)
 qboolean    KillBox(edict_t *ent);
 void    G_ProjectSource(const vec3_t point, const vec3_t distance, const vec3_t forward, const vec3_t right, vec3_t result);
 edict_t *G_Find(edict_t *from, int fieldofs, char *match);
+void    G_IndexEdict(edict_t *ent);
+void    G_ReindexEdicts(void);
+void    G_ClearIndices(void);
 edict_t *findradius(edict_t *from, vec3_t org, float rad);
 edict_t *G_PickTarget(char *targetname);
 void    G_UseTargets(edict_t *ent, edict_t *activator);
@@ -689,6 +698,8 @@ void BecomeExplosion1(edict_t *self);
 // g_ai.c
 //
 void AI_SetSightClient(void);
+void AI_PrefetchTraces(void);
+void AI_ClearSightCache(void);
 
 void ai_stand(edict_t *self, float dist);
 void ai_move(edict_t *self, float dist);
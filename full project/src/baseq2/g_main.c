@@ -178,6 +178,7 @@ void InitGame(void)
     game.maxentities = maxentities->value;
     clamp(game.maxentities, (int)maxclients->value + 1, MAX_EDICTS);
     g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
+    G_ClearIndices();
     globals.edicts = g_edicts;
     globals.max_edicts = game.maxentities;
 
@@ -453,6 +454,29 @@ void ExitLevel(void)
 
 }
 
+/*
+================
+G_EntityIdle
+
+Entities that would do nothing at all running this frame: no physics,
+no thinking due and nothing to update their old origin from. Most
+entities of a map are like that most of the time, so they are skipped
+without calling into physics.
+================
+*/
+static inline qboolean G_EntityIdle(edict_t *ent)
+{
+    if (ent->movetype != MOVETYPE_NONE)
+        return qfalse;
+    if (ent->prethink)
+        return qfalse;
+    if (ent->groundentity)
+        return qfalse;
+    if (ent->nextthink > 0 && ent->nextthink <= level.time + 0.001)
+        return qfalse;
+    return VectorCompare(ent->s.origin, ent->s.old_origin);
+}
+
 /*
 ================
 G_RunFrame
@@ -468,8 +492,14 @@ void G_RunFrame(void)
     level.framenum++;
     level.time = level.framenum * FRAMETIME;
 
+    // pick up search fields changed behind our back
+    G_ReindexEdicts();
+
     // choose a client for monsters to target this frame
     AI_SetSightClient();
+    G_ProfileBegin("AI_PrefetchTraces");
+    AI_PrefetchTraces();
+    G_ProfileEnd("AI_PrefetchTraces");
 
     // exit intermissions
 
@@ -487,6 +517,9 @@ void G_RunFrame(void)
         if (!ent->inuse)
             continue;
 
+        if (i > maxclients->value && G_EntityIdle(ent))
+            continue;
+
         level.current_entity = ent;
 
         VectorCopy(ent->s.origin, ent->s.old_origin);
@@ -500,11 +533,15 @@ void G_RunFrame(void)
         }
 
         if (i > 0 && i <= maxclients->value) {
+            G_ProfileBegin("ClientBeginServerFrame");
             ClientBeginServerFrame(ent);
+            G_ProfileEnd("ClientBeginServerFrame");
             continue;
         }
 
+        G_ProfileBegin("G_RunEntity");
         G_RunEntity(ent);
+        G_ProfileEnd("G_RunEntity");
     }
 
     // see if it is time to end a deathmatch
@@ -514,6 +551,8 @@ void G_RunFrame(void)
     CheckNeedPass();
 
     // build the playerstate_t structures for all players
+    G_ProfileBegin("ClientEndServerFrames");
     ClientEndServerFrames();
+    G_ProfileEnd("ClientEndServerFrames");
 }
 
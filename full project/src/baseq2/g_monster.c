@@ -329,15 +329,19 @@ void M_SetEffects(edict_t *ent)
 }
 
 
+// frame is within [first, last], with a single compare
+#define M_FrameInMove(move, frame) \
+    ((unsigned)((frame) - (move)->firstframe) <= (unsigned)((move)->lastframe - (move)->firstframe))
+
 void M_MoveFrame(edict_t *self)
 {
     mmove_t *move;
-    int     index;
+    mframe_t *frame;
 
     move = self->monsterinfo.currentmove;
     self->nextthink = level.time + FRAMETIME;
 
-    if ((self->monsterinfo.nextframe) && (self->monsterinfo.nextframe >= move->firstframe) && (self->monsterinfo.nextframe <= move->lastframe)) {
+    if (self->monsterinfo.nextframe && M_FrameInMove(move, self->monsterinfo.nextframe)) {
         self->s.frame = self->monsterinfo.nextframe;
         self->monsterinfo.nextframe = 0;
     } else {
@@ -354,7 +358,7 @@ void M_MoveFrame(edict_t *self)
             }
         }
 
-        if (self->s.frame < move->firstframe || self->s.frame > move->lastframe) {
+        if (!M_FrameInMove(move, self->s.frame)) {
             self->monsterinfo.aiflags &= ~AI_HOLD_FRAME;
             self->s.frame = move->firstframe;
         } else {
@@ -366,16 +370,16 @@ void M_MoveFrame(edict_t *self)
         }
     }
 
-    index = self->s.frame - move->firstframe;
-    if (move->frame[index].aifunc) {
+    frame = &move->frame[self->s.frame - move->firstframe];
+    if (frame->aifunc) {
         if (!(self->monsterinfo.aiflags & AI_HOLD_FRAME))
-            move->frame[index].aifunc(self, move->frame[index].dist * self->monsterinfo.scale);
+            frame->aifunc(self, frame->dist * self->monsterinfo.scale);
         else
-            move->frame[index].aifunc(self, 0);
+            frame->aifunc(self, 0);
     }
 
-    if (move->frame[index].thinkfunc)
-        move->frame[index].thinkfunc(self);
+    if (frame->thinkfunc)
+        frame->thinkfunc(self);
 }
 
 
@@ -378,19 +378,34 @@ pushed_t    pushed[MAX_EDICTS], *pushed_p;
 
 edict_t *obstacle;
 
+static edict_t  *push_list[MAX_EDICTS];
+
+static int push_cmp(const void *p1, const void *p2)
+{
+    edict_t *e1 = *(edict_t **)p1;
+    edict_t *e2 = *(edict_t **)p2;
+
+    return e1 < e2 ? -1 : e1 > e2;
+}
+
 /*
 ============
 SV_Push
 
 Objects need to be moved back on a failed push,
 otherwise riders would continue to slide.
+
+Candidates come from the area tree around the pusher's swept bounds
+instead of a scan over all edicts. Riders are always touching their
+ground entity, so they are found as well. The list is sorted to keep
+the original edict order.
 ============
 */
 qboolean SV_Push(edict_t *pusher, vec3_t move, vec3_t amove)
 {
-    int         i, e;
+    int         i, e, count;
     edict_t     *check, *block;
-    vec3_t      mins, maxs;
+    vec3_t      mins, maxs, boxmins, boxmaxs;
     pushed_t    *p;
     vec3_t      org, org2, move2, forward, right, up;
 
@@ -410,8 +425,14 @@ qboolean SV_Push(edict_t *pusher, vec3_t move, vec3_t amove)
     for (i = 0 ; i < 3 ; i++) {
         mins[i] = pusher->absmin[i] + move[i];
         maxs[i] = pusher->absmax[i] + move[i];
+        boxmins[i] = min(mins[i], pusher->absmin[i]);
+        boxmaxs[i] = max(maxs[i], pusher->absmax[i]);
     }
 
+    count = gi.BoxEdicts(boxmins, boxmaxs, push_list, MAX_EDICTS, AREA_SOLID);
+    count += gi.BoxEdicts(boxmins, boxmaxs, push_list + count, MAX_EDICTS - count, AREA_TRIGGERS);
+    qsort(push_list, count, sizeof(push_list[0]), push_cmp);
+
 // we need this for pushing things later
     VectorSubtract(vec3_origin, amove, org);
     AngleVectors(org, forward, right, up);
@@ -432,8 +453,8 @@ qboolean SV_Push(edict_t *pusher, vec3_t move, vec3_t amove)
     gi.linkentity(pusher);
 
 // see if any solid entities are inside the final position
-    check = g_edicts + 1;
-    for (e = 1; e < globals.num_edicts; e++, check++) {
+    for (e = 0; e < count; e++) {
+        check = push_list[e];
         if (!check->inuse)
             continue;
         if (check->movetype == MOVETYPE_PUSH
@@ -430,11 +430,53 @@ static const save_field_t gamefields[] = {
 
 //=========================================================
 
+// savegames are made of many tiny fields, buffer them here rather
+// than pay for a locked stdio call per field
+static struct {
+    size_t  len;
+    byte    data[0x10000];
+} write_buf;
+
+static void flush_data(FILE *f)
+{
+    if (fwrite(write_buf.data, 1, write_buf.len, f) != write_buf.len) {
+        gi.error("%s: couldn't write %"PRIz" bytes", __func__, write_buf.len);
+    }
+    write_buf.len = 0;
+}
+
 static void write_data(void *buf, size_t len, FILE *f)
 {
-    if (fwrite(buf, 1, len, f) != len) {
-        gi.error("%s: couldn't write %"PRIz" bytes", __func__, len);
+    if (len > sizeof(write_buf.data) - write_buf.len) {
+        flush_data(f);
+    }
+
+    if (len > sizeof(write_buf.data)) {
+        if (fwrite(buf, 1, len, f) != len) {
+            gi.error("%s: couldn't write %"PRIz" bytes", __func__, len);
+        }
+        return;
     }
+
+    memcpy(write_buf.data + write_buf.len, buf, len);
+    write_buf.len += len;
+}
+
+static FILE *create_file(const char *filename)
+{
+    FILE *f = fopen(filename, "wb");
+
+    if (!f)
+        gi.error("Couldn't open %s", filename);
+
+    write_buf.len = 0;
+    return f;
+}
+
+static void close_file(FILE *f)
+{
+    flush_data(f);
+    fclose(f);
 }
 
 static void write_short(FILE *f, short v)
@@ -496,9 +538,50 @@ static void write_index(FILE *f, void *p, size_t size, void *start, int max_inde
     write_int(f, (int)(diff / size));
 }
 
+#define PTR_HASH_SIZE   4096    // must be a power of two above 2 * num_save_ptrs
+
+// maps (type, ptr) to save_ptrs index + 1, built on first save
+static int      ptr_hash[PTR_HASH_SIZE];
+static qboolean ptr_hash_ready;
+
+static unsigned hash_pointer(void *p, ptr_type_t type)
+{
+    uintptr_t v = (uintptr_t)p;
+
+    v ^= v >> 16;
+    v = v * 0x45d9f3b + type;
+    return (unsigned)(v ^ (v >> 16)) & (PTR_HASH_SIZE - 1);
+}
+
+static void init_pointers(void)
+{
+    const save_ptr_t *ptr;
+    unsigned h;
+    int i, j;
+
+    if (num_save_ptrs * 2 > PTR_HASH_SIZE) {
+        gi.error("%s: too many pointers", __func__);
+    }
+
+    // keep the first index of duplicates, like a linear search would
+    for (i = 0, ptr = save_ptrs; i < num_save_ptrs; i++, ptr++) {
+        for (h = hash_pointer(ptr->ptr, ptr->type); (j = ptr_hash[h]); h = (h + 1) & (PTR_HASH_SIZE - 1)) {
+            if (save_ptrs[j - 1].type == ptr->type && save_ptrs[j - 1].ptr == ptr->ptr) {
+                break;
+            }
+        }
+        if (!j) {
+            ptr_hash[h] = i + 1;
+        }
+    }
+
+    ptr_hash_ready = qtrue;
+}
+
 static void write_pointer(FILE *f, void *p, ptr_type_t type)
 {
     const save_ptr_t *ptr;
+    unsigned h;
     int i;
 
     if (!p) {
@@ -506,9 +589,14 @@ static void write_pointer(FILE *f, void *p, ptr_type_t type)
         return;
     }
 
-    for (i = 0, ptr = save_ptrs; i < num_save_ptrs; i++, ptr++) {
+    if (!ptr_hash_ready) {
+        init_pointers();
+    }
+
+    for (h = hash_pointer(p, type); (i = ptr_hash[h]); h = (h + 1) & (PTR_HASH_SIZE - 1)) {
+        ptr = &save_ptrs[i - 1];
         if (ptr->type == type && ptr->ptr == p) {
-            write_int(f, i);
+            write_int(f, i - 1);
             return;
         }
     }
@@ -789,9 +877,7 @@ void WriteGame(const char *filename, qboolean autosave)
     if (!autosave)
         SaveClientData();
 
-    f = fopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    f = create_file(filename);
 
     write_int(f, SAVE_MAGIC1);
     write_int(f, SAVE_VERSION);
@@ -804,7 +890,7 @@ void WriteGame(const char *filename, qboolean autosave)
         write_fields(f, clientfields, &game.clients[i]);
     }
 
-    fclose(f);
+    close_file(f);
 }
 
 void ReadGame(const char *filename)
@@ -843,6 +929,7 @@ void ReadGame(const char *filename)
     }
 
     g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
+    G_ClearIndices();
     globals.edicts = g_edicts;
     globals.max_edicts = game.maxentities;
 
@@ -869,9 +956,7 @@ void WriteLevel(const char *filename)
     edict_t *ent;
     FILE    *f;
 
-    f = fopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    f = create_file(filename);
 
     write_int(f, SAVE_MAGIC2);
     write_int(f, SAVE_VERSION);
@@ -889,7 +974,7 @@ void WriteLevel(const char *filename)
     }
     write_int(f, -1);
 
-    fclose(f);
+    close_file(f);
 }
 
 
@@ -926,6 +1011,8 @@ void ReadLevel(const char *filename)
 
     // wipe all the entities
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+    G_ClearIndices();
+    AI_ClearSightCache();
     globals.num_edicts = maxclients->value + 1;
 
     i = read_int(f);
@@ -985,5 +1072,7 @@ void ReadLevel(const char *filename)
             if (strcmp(ent->classname, "target_crosslevel_target") == 0)
                 ent->nextthink = level.time + ent->delay;
     }
+
+    G_ReindexEdicts();
 }
 
@@ -520,7 +520,7 @@ All but the last will have the teamchain field set to the next one
 void G_FindTeams(void)
 {
     edict_t *e, *e2, *chain;
-    int     i, j;
+    int     i;
     int     c, c2;
 
     c = 0;
@@ -536,11 +536,7 @@ void G_FindTeams(void)
         e->teammaster = e;
         c++;
         c2++;
-        for (j = i + 1, e2 = e + 1 ; j < globals.num_edicts ; j++, e2++) {
-            if (!e2->inuse)
-                continue;
-            if (!e2->team)
-                continue;
+        for (e2 = e; (e2 = G_Find(e2, FOFS(team), e->team)) != NULL;) {
             if (e2->flags & FL_TEAMSLAVE)
                 continue;
             if (!strcmp(e->team, e2->team)) {
@@ -586,6 +582,8 @@ void SpawnEntities(const char *mapname, const char *entities, const char *spawnp
 
     memset(&level, 0, sizeof(level));
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+    G_ClearIndices();
+    AI_ClearSightCache();
 
     strncpy(level.mapname, mapname, sizeof(level.mapname) - 1);
     strncpy(game.spawnpoint, spawnpoint, sizeof(game.spawnpoint) - 1);
@@ -640,6 +638,7 @@ void SpawnEntities(const char *mapname, const char *entities, const char *spawnp
         }
 
         ED_CallSpawn(ent);
+        G_IndexEdict(ent);
     }
 
     gi.dprintf("%i entities inhibited\n", inhibit);
@@ -654,6 +653,7 @@ void SpawnEntities(const char *mapname, const char *entities, const char *spawnp
     }
 #endif
 
+    G_ReindexEdicts();
     G_FindTeams();
 
     PlayerTrail_Init();
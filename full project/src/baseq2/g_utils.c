@@ -28,6 +28,144 @@ void G_ProjectSource(const vec3_t point, const vec3_t distance, const vec3_t for
 }
 
 
+/*
+=============================================================================
+
+EDICT INDEX
+
+Hash indices over the string fields most searched by G_Find. Each hash
+chain is kept in edict order, so G_Find can walk a chain instead of all
+edicts and still return entities in the order a scan would.
+
+Edicts are indexed by G_InitEdict and G_FreeEdict, and by G_IndexEdict
+where a field changes at runtime. G_ReindexEdicts catches all other
+changes and runs at the start of every frame and after spawning a level.
+Chains are only a hint: everything found through them is checked again.
+
+Fields of a new edict are usually assigned right after G_Spawn, so edicts
+initialized since the last G_ReindexEdicts are kept in a list and indexed
+again by every G_Find, which then finds them in the same frame.
+
+=============================================================================
+*/
+
+#define INDEX_HASH_SIZE     256
+
+typedef struct {
+    int     fieldofs;
+    short   heads[INDEX_HASH_SIZE];     // edict number + 1
+    short   next[MAX_EDICTS];           // edict number + 1
+    byte    hashes[MAX_EDICTS];
+    char    *values[MAX_EDICTS];        // field value when indexed
+} edindex_t;
+
+static edindex_t    g_indices[] = {
+    { FOFS(classname) },
+    { FOFS(targetname) },
+    { FOFS(team) }
+};
+
+#define NUM_INDICES     (sizeof(g_indices) / sizeof(g_indices[0]))
+
+static short    g_pending[MAX_EDICTS];  // edicts initialized this frame
+static int      g_numpending;
+static qboolean g_ispending[MAX_EDICTS];
+
+static unsigned index_hash(const char *s)
+{
+    unsigned hash = 0;
+
+    while (*s)
+        hash = hash * 31 + Q_tolower(*s++);
+
+    return (hash ^ (hash >> 8)) & (INDEX_HASH_SIZE - 1);
+}
+
+static void index_unlink(edindex_t *x, int num)
+{
+    short *p;
+
+    for (p = &x->heads[x->hashes[num]]; *p; p = &x->next[*p - 1]) {
+        if (*p - 1 == num) {
+            *p = x->next[num];
+            break;
+        }
+    }
+    x->values[num] = NULL;
+}
+
+static void index_link(edindex_t *x, int num, char *value)
+{
+    short *p;
+
+    x->hashes[num] = index_hash(value);
+    x->values[num] = value;
+
+    for (p = &x->heads[x->hashes[num]]; *p && *p - 1 < num; p = &x->next[*p - 1])
+        ;
+    x->next[num] = *p;
+    *p = num + 1;
+}
+
+/*
+=============
+G_IndexEdict
+
+Updates indices after a searched field of the edict has changed.
+=============
+*/
+void G_IndexEdict(edict_t *ent)
+{
+    int         num = ent - g_edicts;
+    edindex_t   *x;
+    char        *value;
+
+    for (x = g_indices; x < g_indices + NUM_INDICES; x++) {
+        value = ent->inuse ? *(char **)((byte *)ent + x->fieldofs) : NULL;
+        if (value == x->values[num])
+            continue;
+        if (x->values[num])
+            index_unlink(x, num);
+        if (value)
+            index_link(x, num, value);
+    }
+}
+
+void G_ReindexEdicts(void)
+{
+    int i;
+
+    for (i = 0; i < globals.num_edicts; i++)
+        G_IndexEdict(&g_edicts[i]);
+
+    for (i = 0; i < g_numpending; i++)
+        g_ispending[g_pending[i]] = qfalse;
+    g_numpending = 0;
+}
+
+static void index_pending(void)
+{
+    int i;
+
+    for (i = 0; i < g_numpending; i++)
+        G_IndexEdict(&g_edicts[g_pending[i]]);
+}
+
+// called when all edicts have been cleared
+void G_ClearIndices(void)
+{
+    edindex_t *x;
+
+    for (x = g_indices; x < g_indices + NUM_INDICES; x++) {
+        memset(x->heads, 0, sizeof(x->heads));
+        memset(x->values, 0, sizeof(x->values));
+    }
+
+    memset(g_ispending, 0, sizeof(g_ispending));
+    g_numpending = 0;
+}
+
+
 /*
 =============
 G_Find
@@ -42,13 +180,33 @@ NULL will be returned if the end of the list is reached.
 */
 edict_t *G_Find(edict_t *from, int fieldofs, char *match)
 {
-    char    *s;
+    char        *s;
+    edindex_t   *x;
+    int         n;
 
     if (!from)
         from = g_edicts;
     else
         from++;
 
+    for (x = g_indices; x < g_indices + NUM_INDICES; x++) {
+        if (x->fieldofs != fieldofs)
+            continue;
+        index_pending();
+        for (n = x->heads[index_hash(match)]; n; n = x->next[n - 1]) {
+            if (&g_edicts[n - 1] < from)
+                continue;
+            if (n - 1 >= globals.num_edicts)
+                break;
+            if (!g_edicts[n - 1].inuse)
+                continue;
+            s = *(char **)((byte *)&g_edicts[n - 1] + fieldofs);
+            if (s && !Q_stricmp(s, match))
+                return &g_edicts[n - 1];
+        }
+        return NULL;
+    }
+
     for (; from < &g_edicts[globals.num_edicts] ; from++) {
         if (!from->inuse)
             continue;
@@ -70,27 +228,89 @@ findradius
 Returns entities that have origins within a spherical area
 
 findradius (origin, radius)
+
+The first call of a search asks the server area tree for entities touching
+the bounding box of the sphere and remembers them in edict order, so that
+following calls only test those. A call that doesn't continue the last
+search, such as a nested one, falls back to scanning all edicts. Entities
+spawned while the search is in progress are not returned.
 =================
 */
-edict_t *findradius(edict_t *from, vec3_t org, float rad)
+static struct {
+    vec3_t  org;
+    float   rad;
+    int     count;
+    int     next;
+    edict_t *list[MAX_EDICTS];
+} radius;
+
+static qboolean radius_match(edict_t *ent, vec3_t org, float rad)
 {
     vec3_t  eorg;
     int     j;
 
-    if (!from)
-        from = g_edicts;
-    else
-        from++;
-    for (; from < &g_edicts[globals.num_edicts]; from++) {
-        if (!from->inuse)
-            continue;
-        if (from->solid == SOLID_NOT)
-            continue;
-        for (j = 0 ; j < 3 ; j++)
-            eorg[j] = org[j] - (from->s.origin[j] + (from->mins[j] + from->maxs[j]) * 0.5);
-        if (VectorLength(eorg) > rad)
-            continue;
-        return from;
+    if (!ent->inuse)
+        return qfalse;
+    if (ent->solid == SOLID_NOT)
+        return qfalse;
+    for (j = 0 ; j < 3 ; j++)
+        eorg[j] = org[j] - (ent->s.origin[j] + (ent->mins[j] + ent->maxs[j]) * 0.5);
+    return DotProduct(eorg, eorg) <= rad * rad;
+}
+
+static int radius_cmp(const void *p1, const void *p2)
+{
+    edict_t *e1 = *(edict_t **)p1;
+    edict_t *e2 = *(edict_t **)p2;
+
+    return e1 < e2 ? -1 : e1 > e2;
+}
+
+static void radius_begin(vec3_t org, float rad)
+{
+    vec3_t  mins, maxs;
+    int     j, count;
+
+    for (j = 0; j < 3; j++) {
+        mins[j] = org[j] - rad;
+        maxs[j] = org[j] + rad;
+    }
+
+    // world is never linked
+    radius.list[0] = g_edicts;
+    count = 1;
+    count += gi.BoxEdicts(mins, maxs, radius.list + count, MAX_EDICTS - count, AREA_SOLID);
+    count += gi.BoxEdicts(mins, maxs, radius.list + count, MAX_EDICTS - count, AREA_TRIGGERS);
+    qsort(radius.list + 1, count - 1, sizeof(radius.list[0]), radius_cmp);
+
+    VectorCopy(org, radius.org);
+    radius.rad = rad;
+    radius.count = count;
+    radius.next = 0;
+}
+
+edict_t *findradius(edict_t *from, vec3_t org, float rad)
+{
+    edict_t *ent;
+
+    if (rad < 0)
+        return NULL;
+
+    if (!from) {
+        radius_begin(org, rad);
+    } else if (radius.next == 0 || radius.list[radius.next - 1] != from ||
+               radius.rad != rad || !VectorCompare(radius.org, org)) {
+        for (from++; from < &g_edicts[globals.num_edicts]; from++) {
+            if (radius_match(from, org, rad))
+                return from;
+        }
+        return NULL;
+    }
+
+    while (radius.next < radius.count) {
+        ent = radius.list[radius.next++];
+        if (radius_match(ent, org, rad))
+            return ent;
     }
 
     return NULL;
@@ -375,6 +595,13 @@ void G_InitEdict(edict_t *e)
     e->classname = "noclass";
     e->gravity = 1.0;
     e->s.number = e - g_edicts;
+    G_IndexEdict(e);
+
+    // fields are assigned after this, G_Find indexes them again
+    if (!g_ispending[e->s.number]) {
+        g_ispending[e->s.number] = qtrue;
+        g_pending[g_numpending++] = e->s.number;
+    }
 }
 
 /*
@@ -431,6 +658,7 @@ void G_FreeEdict(edict_t *ed)
     ed->classname = "freed";
     ed->freetime = level.time;
     ed->inuse = qfalse;
+    G_IndexEdict(ed);
 }
 
 
@@ -52,6 +52,7 @@ void SP_FixCoopSpots(edict_t *self)
             if ((!self->targetname) || Q_stricmp(self->targetname, spot->targetname) != 0) {
 //              gi.dprintf("FixCoopSpots changed %s at %s targetname from %s to %s\n", self->classname, vtos(self->s.origin), self->targetname, spot->targetname);
                 self->targetname = spot->targetname;
+                G_IndexEdict(self);
             }
             return;
         }
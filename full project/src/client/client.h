@@ -33,9 +33,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/msg.h"
 #include "common/net/chan.h"
 #include "common/net/net.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/sizebuf.h"
+#include "common/zdict.h"
 #include "common/zone.h"
 
 #include "system/system.h"
@@ -66,6 +68,11 @@ typedef struct centity_s {
     int             trailcount;         // for diminishing grenade trails
     vec3_t          lerp_origin;        // for trails (variable hz)
 
+    // current minus prev, cached on each server frame so that
+    // render frames lerp with a single multiply-add per component
+    vec3_t          origin_delta;
+    vec3_t          angle_delta;        // wrapped to shortest turn
+
 #if USE_FPS
     int             prev_frame;
     int             anim_start;
@@ -78,6 +85,21 @@ typedef struct centity_s {
 
 extern centity_t    cl_entities[MAX_EDICTS];
 
+// solid entity as seen by prediction traces
+typedef struct {
+    centity_t       *ent;
+    mnode_t         *headnode;      // NULL for bounding boxes
+    vec3_t          origin, angles;
+    vec3_t          absmin, absmax;
+} clipentity_t;
+
+// coarse XY grid over the world, each cell marks the clip entities
+// overlapping it so that prediction traces only visit nearby ones
+#define CLIP_GRID_SIZE      16
+#define CLIP_GRID_WORDS     (MAX_PACKET_ENTITIES / 32)
+
+typedef uint32_t clipmask_t[CLIP_GRID_WORDS];
+
 #define MAX_CLIENTWEAPONMODELS        20        // PGM -- upped from 16 to fit the chainfist vwep
 
 typedef struct clientinfo_s {
@@ -154,6 +176,12 @@ typedef struct client_state_s {
     usercmd_t    cmds[CMD_BACKUP];    // each mesage will send several old cmds
     unsigned     cmdNumber;
     short        predicted_origins[CMD_BACKUP][3];    // for debug comparing against server
+    pmove_state_t   predicted_states[CMD_BACKUP];   // resume point for next prediction
+    vec3_t          predicted_viewangles[CMD_BACKUP];
+    pmove_state_t   predicted_base;     // state the cached commands were run from
+    unsigned        predicted_ack;      // command the cached run starts after
+    unsigned        predicted_cmd;      // last command with a cached state
+    unsigned        predicted_clipstamp;
     client_history_t    history[CMD_BACKUP];
     int         initialSeq;
 
@@ -170,6 +198,20 @@ typedef struct client_state_s {
     centity_t       *solidEntities[MAX_PACKET_ENTITIES];
     int             numSolidEntities;
 
+    // entities present in the current frame, in ascending number order,
+    // so per frame passes walk cl_entities forward instead of hopping
+    // through the parse ring and back
+    centity_t       *activeEntities[MAX_PACKET_ENTITIES];
+    int             numActiveEntities;
+
+    // clip models and bounds of solidEntities, rebuilt by CL_BuildClipList
+    clipentity_t    clipEntities[MAX_PACKET_ENTITIES];
+    int             numClipEntities;
+    unsigned        clipstamp;  // bumped each time the list changes
+    clipmask_t      clipGrid[CLIP_GRID_SIZE][CLIP_GRID_SIZE];
+    vec2_t          clipGridOrigin;
+    vec2_t          clipGridScale;  // cells per unit
+
     entity_state_t  baselines[MAX_EDICTS];
 
     entity_state_t  entityStates[MAX_PARSE_ENTITIES];
@@ -257,6 +299,7 @@ typedef struct client_state_s {
 
     char        baseconfigstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
     char        configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
+    unsigned    csserial;       // bumped on every configstring update
     char        mapname[MAX_QPATH]; // short format - q2dm1, etc
 
 #if USE_AUTOREPLY
@@ -410,6 +453,7 @@ typedef struct client_static_s {
         int         percent;            // how much downloaded
         qhandle_t   file;               // UDP file transfer from server
         char        temp[MAX_QPATH + 4];// account 4 bytes for .tmp suffix
+        qboolean    stream;             // server sends without nextdl
         string_entry_t  *ignores;       // list of ignored paths
     } download;
 
@@ -428,8 +472,10 @@ typedef struct client_static_s {
         int         file_size;
         int         file_offset;
         int         file_percent;
+        char        name[MAX_OSPATH];   // path to demo file being played
         sizebuf_t   buffer;
         list_t      snapshots;
+        size_t      snapshots_size;     // bytes allocated for snapshot data
         qboolean    paused;
         qboolean    seeking;
         qboolean    eof;
@@ -590,7 +636,7 @@ void IN_Activate(void);
 
 void CL_RegisterInput(void);
 void CL_UpdateCmd(int msec);
-void CL_FinalizeCmd(void);
+int CL_FinalizeCmd(int subframe);
 void CL_SendCmd(void);
 
 
@@ -709,6 +755,7 @@ void CL_InitTEnts(void);
 void CL_PredictAngles(void);
 void CL_PredictMovement(void);
 void CL_CheckPredictionError(void);
+void CL_BuildClipList(void);
 
 
 //
@@ -722,8 +769,6 @@ void CL_CheckPredictionError(void);
 // ========
 
 typedef struct cparticle_s {
-    struct cparticle_s    *next;
-
     float   time;
 
     vec3_t  org;
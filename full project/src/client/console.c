@@ -22,10 +22,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define CON_TIMES       16
 #define CON_TIMES_MASK  (CON_TIMES - 1)
 
-#define CON_TOTALLINES          1024    // total lines in console scrollback
-#define CON_TOTALLINES_MASK     (CON_TOTALLINES - 1)
-
 #define CON_LINEWIDTH   100     // fixed width, do not need more
+#define CON_MAXLINE     1024    // longer lines are broken when printed
 
 typedef enum {
     CHAT_NONE,
@@ -40,22 +38,41 @@ typedef enum {
     CON_REMOTE
 } consoleMode_t;
 
+// scrollback keeps raw lines as printed, they are wrapped to the
+// current width only when drawn, and the row count is cached per line
+typedef struct {
+    unsigned        start;      // offset of text in ring, not masked
+    unsigned        time;       // cls.realtime line was started, for notify
+    unsigned short  len;
+    unsigned short  rows;       // rows when wrapped to wrapwidth
+    byte            color;
+    byte            wrapwidth;  // 0 if rows need to be recounted
+} conline_t;
+
+#define CON_LINE(n)     (&con.lines[(n) & (con.maxlines - 1)])
+
 typedef struct console_s {
     qboolean    initialized;
 
-    char    text[CON_TOTALLINES][CON_LINEWIDTH];
+    char        *buffer;        // ring of line text
+    unsigned    bufsize;        // power of two
+    unsigned    head;           // offset for next character, not masked
+    conline_t   *lines;
+    int         maxlines;       // power of two
+    int         first;          // oldest line still in scrollback
     int     current;        // line where next message will be printed
-    int     x;              // offset in current line for next print
     int     display;        // bottom of console displays this line
+    int     displayrow;     // number of its rows hidden below the bottom
     int     color;
     int     newline;
+    unsigned    serial;     // bumped on every print, for the retained span
+    int     widths[2];      // of the two bottom rows, kept with the span
+    int     notifyheight;   // of the notify lines, kept with the span
 
     int     linewidth;      // characters across screen
     int     vidWidth, vidHeight;
     float   scale;
 
-    unsigned    times[CON_TIMES];   // cls.realtime time the line was generated
-                                    // for transparent notify lines
     qboolean    skipNotify;
 
     qhandle_t   backImage;
@@ -86,6 +103,7 @@ static cvar_t   *con_font;
 static cvar_t   *con_background;
 static cvar_t   *con_scroll;
 static cvar_t   *con_history;
+static cvar_t   *con_scrollback;
 
 // ============================================================================
 
@@ -199,6 +217,134 @@ static void Con_ToggleChat2_f(void)
     toggle_console(CON_CHAT, CHAT_TEAM);
 }
 
+/*
+==============================================================================
+
+SCROLLBACK
+
+==============================================================================
+*/
+
+// copies line text out of the ring, returns its length
+static int get_line_text(const conline_t *line, char *text)
+{
+    unsigned ofs = line->start & (con.bufsize - 1);
+    unsigned part = min(line->len, con.bufsize - ofs);
+
+    memcpy(text, con.buffer + ofs, part);
+    memcpy(text + part, con.buffer, line->len - part);
+    return line->len;
+}
+
+// finds where rows start when text is wrapped to the given width, with the
+// word wrap rules printing used to apply. starts may be NULL.
+static int wrap_line(const char *text, int len, int width, int *starts)
+{
+    int i, end, col, rows;
+
+    if (starts)
+        starts[0] = 0;
+    rows = 1;
+
+    for (i = 0, end = 0, col = 0; i < len; i++, col++) {
+        // find end of word
+        if (i >= end) {
+            for (end = i; end < len && text[end] > 32; end++)
+                ;
+        }
+
+        // move rest of the word to the next row if it fits there
+        if (end - i <= width && col + end - i > width)
+            col = width;
+
+        if (col == width) {
+            if (starts)
+                starts[rows] = i;
+            rows++;
+            col = 0;
+        }
+    }
+
+    return rows;
+}
+
+// rows are drawn linewidth - 1 chars wide, leaving room for the color byte
+// line was traditionally prefixed with
+#define WRAP_WIDTH  (con.linewidth - 1)
+
+static int line_rows(conline_t *line)
+{
+    char text[CON_MAXLINE];
+    int len;
+
+    if (line->wrapwidth != con.linewidth) {
+        len = get_line_text(line, text);
+        line->rows = wrap_line(text, len, WRAP_WIDTH, NULL);
+        line->wrapwidth = con.linewidth;
+    }
+
+    return line->rows;
+}
+
+static void scroll_up(int rows)
+{
+    while (rows-- > 0) {
+        if (con.displayrow + 1 < line_rows(CON_LINE(con.display))) {
+            con.displayrow++;
+        } else if (con.display > con.first) {
+            con.display--;
+            con.displayrow = 0;
+        } else {
+            break;
+        }
+    }
+}
+
+static void scroll_down(int rows)
+{
+    while (rows-- > 0) {
+        if (con.displayrow > 0) {
+            con.displayrow--;
+        } else if (con.display < con.current) {
+            con.display++;
+            con.displayrow = line_rows(CON_LINE(con.display)) - 1;
+        } else {
+            break;
+        }
+    }
+}
+
+static void scroll_bottom(void)
+{
+    con.display = con.current;
+    con.displayrow = 0;
+}
+
+static void alloc_scrollback(void)
+{
+    unsigned size = Cvar_ClampInteger(con_scrollback, 16, 65536) * 1024;
+
+    Z_Free(con.buffer);
+    Z_Free(con.lines);
+
+    // one line index entry per 32 bytes of text is plenty
+    con.bufsize = npot32(size);
+    con.buffer = Z_Malloc(con.bufsize);
+    con.maxlines = con.bufsize / 32;
+    con.lines = Z_Mallocz(sizeof(con.lines[0]) * con.maxlines);
+
+    // scrollback starts empty, keeping current line number
+    con.first = con.current;
+    con.head = 0;
+    CON_LINE(con.current)->color = con.color;
+    scroll_bottom();
+}
+
+static void con_scrollback_changed(cvar_t *self)
+{
+    alloc_scrollback();
+}
+
 /*
 ================
 Con_Clear_f
@@ -206,8 +352,14 @@ Con_Clear_f
 */
 static void Con_Clear_f(void)
 {
-    memset(con.text, 0, sizeof(con.text));
+    conline_t *line = CON_LINE(con.current);
+
+    con.first = con.current;
+    con.head = line->start;
+    line->len = 0;
+    line->wrapwidth = 0;
     con.display = con.current;
+    con.displayrow = 0;
 }
 
 static void Con_Dump_c(genctx_t *ctx, int argnum)
@@ -226,8 +378,8 @@ Save the console contents out to a file
 */
 static void Con_Dump_f(void)
 {
-    int     l;
-    char    *line;
+    char    text[CON_MAXLINE];
+    int     l, len;
     qhandle_t f;
     char    name[MAX_OSPATH];
 
@@ -242,17 +394,10 @@ static void Con_Dump_f(void)
         return;
     }
 
-    // skip empty lines
-    for (l = con.current - CON_TOTALLINES + 1; l <= con.current; l++) {
-        if (con.text[l & CON_TOTALLINES_MASK][0]) {
-            break;
-        }
-    }
-
-    // write the remaining lines
-    for (; l <= con.current; l++) {
-        line = con.text[l & CON_TOTALLINES_MASK];
-        FS_FPrintf(f, "%s\n", line + 1);
+    // lines are written as printed, not as wrapped on screen
+    for (l = con.first; l <= con.current; l++) {
+        len = get_line_text(CON_LINE(l), text);
+        FS_FPrintf(f, "%.*s\n", len, text);
     }
 
     FS_FCloseFile(f);
@@ -270,8 +415,8 @@ void Con_ClearNotify_f(void)
 {
     int     i;
 
-    for (i = 0; i < CON_TIMES; i++)
-        con.times[i] = 0;
+    for (i = max(con.current - CON_TIMES + 1, con.first); i <= con.current; i++)
+        CON_LINE(i)->time = 0;
 }
 
 /*
@@ -366,7 +511,9 @@ static void Con_CheckResize(void)
     if (width == con.linewidth)
         return;
 
-    con.linewidth = width > CON_LINEWIDTH ? CON_LINEWIDTH : width;
+    clamp(width, 2, CON_LINEWIDTH);
+
+    con.linewidth = width;
     con.prompt.inputLine.visibleChars = con.linewidth;
     con.prompt.widthInChars = con.linewidth - 1; // account for color byte
     con.chatPrompt.inputLine.visibleChars = con.linewidth;
@@ -381,13 +528,9 @@ Make sure at least one line is visible if console is backscrolled.
 */
 static void Con_CheckTop(void)
 {
-    int top = con.current - CON_TOTALLINES + 1;
-
-    if (top < 1) {
-        top = 1;
-    }
-    if (con.display < top) {
-        con.display = top;
+    if (con.display < con.first) {
+        con.display = con.first;
+        con.displayrow = line_rows(CON_LINE(con.first)) - 1;
     }
 }
 
@@ -439,6 +582,8 @@ void Con_Init(void)
     con_background->changed = con_param_changed;
     con_scroll = Cvar_Get("con_scroll", "0", 0);
     con_history = Cvar_Get("con_history", "0", 0);
+    con_scrollback = Cvar_Get("con_scrollback", "128", 0);
+    con_scrollback->changed = con_scrollback_changed;
 
     IF_Init(&con.prompt.inputLine, 0, MAX_FIELD_TEXT - 1);
     IF_Init(&con.chatPrompt.inputLine, 0, MAX_FIELD_TEXT - 1);
@@ -451,10 +596,9 @@ void Con_Init(void)
     con.linewidth = -1;
     con.scale = 1;
     con.color = COLOR_NONE;
-    con.text[0][0] = COLOR_NONE;
-    con.x = 1;
 
     Con_CheckResize();
+    alloc_scrollback();
 
     con.initialized = qtrue;
 }
@@ -477,40 +621,69 @@ void Con_Shutdown(void)
         Prompt_SaveHistory(&con.prompt, COM_HISTORYFILE_NAME, con_history->integer);
     }
     Prompt_Clear(&con.prompt);
+
+    Z_Free(con.buffer);
+    Z_Free(con.lines);
+    con.buffer = NULL;
+    con.lines = NULL;
 }
 
 static void Con_CarriageRet(void)
 {
-    char *p;
+    conline_t *line = CON_LINE(con.current);
 
-    p = con.text[con.current & CON_TOTALLINES_MASK];
-    memset(p, 0, sizeof(con.text[0]));
-
-    // add color from last line
-    con.x = 0;
-    p[con.x++] = con.color;
+    // start over, with color from last line
+    con.head = line->start;
+    line->len = 0;
+    line->wrapwidth = 0;
+    line->color = con.color;
 
     // update time for transparent overlay
-    if (!con.skipNotify) {
-        con.times[con.current & CON_TIMES_MASK] = cls.realtime;
-    }
+    line->time = con.skipNotify ? 0 : cls.realtime;
 }
 
 static void Con_Linefeed(void)
 {
-    if (con.display == con.current)
+    if (con.display == con.current && !con.displayrow)
         con.display++;
     con.current++;
 
+    // recycle oldest line index entry
+    if (con.current - con.first >= con.maxlines)
+        con.first++;
+
+    CON_LINE(con.current)->start = con.head;
     Con_CarriageRet();
 
     if (con_scroll->integer & 2) {
-        con.display = con.current;
+        scroll_bottom();
     } else {
         Con_CheckTop();
     }
 }
 
+static void Con_PutChar(int c)
+{
+    conline_t *line = CON_LINE(con.current);
+
+    if (line->len == CON_MAXLINE) {
+        Con_Linefeed();
+        line = CON_LINE(con.current);
+    }
+
+    // make room in the ring by dropping oldest lines
+    if (con.head - CON_LINE(con.first)->start >= con.bufsize) {
+        do {
+            con.first++;
+        } while (con.head - CON_LINE(con.first)->start >= con.bufsize);
+        Con_CheckTop();
+    }
+
+    con.buffer[con.head++ & (con.bufsize - 1)] = c;
+    line->len++;
+    line->wrapwidth = 0;
+}
+
 void Con_SetColor(color_index_t color)
 {
     con.color = color;
@@ -520,19 +693,18 @@ void Con_SetColor(color_index_t color)
 ================
 Con_Print
 
-Handles cursor positioning, line wrapping, etc
+Handles line breaks, wrapping is left to drawing
 All console printing must go through this in order to be displayed on screen
 If no console is visible, the text will appear at the top of the game window
 ================
 */
 void Con_Print(const char *txt)
 {
-    char *p;
-    int l;
-
     if (!con.initialized)
         return;
 
+    con.serial++;
+
     while (*txt) {
         if (con.newline) {
             if (con.newline == '\n') {
@@ -543,27 +715,13 @@ void Con_Print(const char *txt)
             con.newline = 0;
         }
 
-        // count word length
-        for (p = (char *)txt; *p > 32; p++)
-            ;
-        l = p - txt;
-
-        // word wrap
-        if (l < con.linewidth && con.x + l > con.linewidth) {
-            Con_Linefeed();
-        }
-
         switch (*txt) {
         case '\r':
         case '\n':
             con.newline = *txt;
             break;
-        default:    // display character and advance
-            if (con.x == con.linewidth) {
-                Con_Linefeed();
-            }
-            p = con.text[con.current & CON_TOTALLINES_MASK];
-            p[con.x++] = *txt;
+        default:    // store character, wrapping is done when drawing
+            Con_PutChar(*txt);
             break;
         }
 
@@ -633,10 +791,11 @@ DRAWING
 ==============================================================================
 */
 
-static int Con_DrawLine(int v, int line, float alpha)
+// draws one row of line text
+static int Con_DrawLine(int v, const conline_t *line, const char *text,
+                        int len, float alpha)
 {
-    char *p = con.text[line & CON_TOTALLINES_MASK];
-    color_index_t c = *p;
+    color_index_t c = line->color;
     color_t color;
     int flags = 0;
 
@@ -659,8 +818,16 @@ static int Con_DrawLine(int v, int line, float alpha)
         break;
     }
 
-    return R_DrawString(CHAR_WIDTH, v, flags, con.linewidth - 1, p + 1,
-                        con.charsetImage);
+    return R_DrawString(CHAR_WIDTH, v, flags, len, text, con.charsetImage);
+}
+
+// wraps line and draws its given row
+static int Con_DrawRow(int v, const conline_t *line, const char *text,
+                       const int *starts, int rows, int row, float alpha)
+{
+    int end = row + 1 < rows ? starts[row + 1] : line->len;
+
+    return Con_DrawLine(v, line, text + starts[row], end - starts[row], alpha);
 }
 
 #define CON_PRESTEP     (10 + CHAR_HEIGHT * 2)
@@ -674,11 +841,14 @@ Draws the last few lines of output transparently over the game top
 */
 static void Con_DrawNotify(void)
 {
+    char    buffer[CON_MAXLINE];
+    int     starts[CON_MAXLINE + 1];
+    conline_t   *line;
     int     v;
     char    *text;
-    int     i, j;
-    unsigned    time;
-    int     skip;
+    int     i, j, r, rows, hidden;
+    unsigned    time, hash;
+    int     skip, first;
     float   alpha;
 
     // only draw notify in game
@@ -697,26 +867,63 @@ static void Con_DrawNotify(void)
         j = CON_TIMES;
     }
 
+    // find lines holding the last j rows
+    hidden = 0;
+    for (i = con.current, rows = 0; i >= con.first; i--) {
+        rows += line_rows(CON_LINE(i));
+        if (rows >= j) {
+            hidden = rows - j;
+            break;
+        }
+    }
+    if (j <= 0) {
+        i = con.current + 1;
+    } else if (i < con.first) {
+        i = con.first;
+    }
+
+    // lines only change with printing and fading
+    hash = SPAN_HASH_INIT;
+    hash = SPAN_HASH(hash, con.serial);
+    hash = SPAN_HASH(hash, con.vidWidth);
+    hash = SPAN_HASH(hash, con.charsetImage);
+    hash = SPAN_HASH(hash, hidden);
+    for (first = i; i <= con.current; i++) {
+        time = CON_LINE(i)->time;
+        alpha = time ? SCR_FadeAlpha(time, con_notifytime->value * 1000, 300) : 0;
+        hash = SPAN_HASH(hash, i);
+        hash = SPAN_HASH(hash, alpha);
+    }
+
+    if (!SCR_BeginSpan(SPAN_NOTIFY, hash)) {
+        goto retained;
+    }
+
     v = 0;
-    for (i = con.current - j + 1; i <= con.current; i++) {
-        if (i < 0)
-            continue;
-        time = con.times[i & CON_TIMES_MASK];
+    for (i = first; i <= con.current; i++, hidden = 0) {
+        line = CON_LINE(i);
+        time = line->time;
         if (time == 0)
             continue;
         // alpha fade the last string left on screen
         alpha = SCR_FadeAlpha(time, con_notifytime->value * 1000, 300);
         if (!alpha)
             continue;
-        if (v || i != con.current) {
-            alpha = 1;  // don't fade
-        }
-
-        Con_DrawLine(v, i, alpha);
 
-        v += CHAR_HEIGHT;
+        get_line_text(line, buffer);
+        rows = wrap_line(buffer, line->len, WRAP_WIDTH, starts);
+        for (r = hidden; r < rows; r++) {
+            Con_DrawRow(v, line, buffer, starts, rows, r,
+                        (v || i != con.current || r != rows - 1) ? 1 : alpha);
+            v += CHAR_HEIGHT;
+        }
     }
 
+    con.notifyheight = v;
+    R_EndSpan();
+
+retained:
+    v = con.notifyheight;
     R_ClearColor();
 
     if (cls.key_dest & KEY_MESSAGE) {
@@ -749,11 +956,15 @@ static void Con_DrawSolidConsole(void)
     int             rows;
     char            *text;
     int             row;
-    char            buffer[CON_LINEWIDTH];
+    char            buffer[CON_MAXLINE];
+    int             starts[CON_MAXLINE + 1];
+    conline_t       *line;
+    int             l, n;
     int             vislines;
     float           alpha;
     clipRect_t      clip;
-    int             widths[2];
+    qboolean        background;
+    unsigned        hash;
 
     vislines = con.vidHeight * con.currentHeight;
     if (vislines <= 0)
@@ -763,11 +974,13 @@ static void Con_DrawSolidConsole(void)
         vislines = con.vidHeight;
 
 // setup transparency
+    alpha = 1;
     if (cls.state == ca_active &&
         con_alpha->value &&
         (cls.key_dest & KEY_MENU) == 0) {
         alpha = 0.5f + 0.5f * (con.currentHeight / con_height->value);
-        R_SetAlpha(alpha * Cvar_ClampValue(con_alpha, 0, 1));
+        alpha *= Cvar_ClampValue(con_alpha, 0, 1);
+        R_SetAlpha(alpha);
     }
 
     clip.left = 0;
@@ -776,8 +989,29 @@ static void Con_DrawSolidConsole(void)
     clip.bottom = 0;
     R_SetClipRect(DRAW_CLIP_TOP, &clip);
 
+    background = cls.state != ca_active || (cls.key_dest & KEY_MENU) ||
+                 con_alpha->value;
+
+// background and scrollback only change with printing and scrolling
+    hash = SPAN_HASH_INIT;
+    hash = SPAN_HASH(hash, vislines);
+    hash = SPAN_HASH(hash, con.vidWidth);
+    hash = SPAN_HASH(hash, con.vidHeight);
+    hash = SPAN_HASH(hash, con.serial);
+    hash = SPAN_HASH(hash, con.first);
+    hash = SPAN_HASH(hash, con.display);
+    hash = SPAN_HASH(hash, con.displayrow);
+    hash = SPAN_HASH(hash, con.backImage);
+    hash = SPAN_HASH(hash, con.charsetImage);
+    hash = SPAN_HASH(hash, background);
+    hash = SPAN_HASH(hash, alpha);
+
+    if (!SCR_BeginSpan(SPAN_CONSOLE, hash)) {
+        goto retained;
+    }
+
 // draw the background
-    if (cls.state != ca_active || (cls.key_dest & KEY_MENU) || con_alpha->value) {
+    if (background) {
         R_DrawStretchPic(0, vislines - con.vidHeight,
                          con.vidWidth, con.vidHeight, con.backImage);
     }
@@ -792,7 +1026,7 @@ static void Con_DrawSolidConsole(void)
     rows = y / CHAR_HEIGHT + 1;     // rows of text to draw
 
 // draw arrows to show the buffer is backscrolled
-    if (con.display != con.current) {
+    if (con.display != con.current || con.displayrow) {
         R_SetColor(U32_RED);
         for (i = 1; i < con.linewidth / 2; i += 4) {
             R_DrawChar(i * CHAR_WIDTH, y, 0, '^', con.charsetImage);
@@ -804,23 +1038,27 @@ static void Con_DrawSolidConsole(void)
 
 // draw from the bottom up
     R_ClearColor();
-    row = con.display;
-    widths[0] = widths[1] = 0;
-    for (i = 0; i < rows; i++) {
-        if (row < 0)
-            break;
-        if (con.current - row > CON_TOTALLINES - 1)
-            break;      // past scrollback wrap point
+    row = con.displayrow;
+    con.widths[0] = con.widths[1] = 0;
+    for (i = 0, l = con.display; i < rows && l >= con.first; l--, row = 0) {
+        line = CON_LINE(l);
+        get_line_text(line, buffer);
+        n = wrap_line(buffer, line->len, WRAP_WIDTH, starts);
+
+        // rows hidden below the bottom may shrink after resize
+        for (row = n - 1 - min(row, n - 1); row >= 0 && i < rows; row--, i++) {
+            x = Con_DrawRow(y, line, buffer, starts, n, row, 1);
+            if (i < 2) {
+                con.widths[i] = x;
+            }
 
-        x = Con_DrawLine(y, row, 1);
-        if (i < 2) {
-            widths[i] = x;
+            y -= CHAR_HEIGHT;
         }
-
-        y -= CHAR_HEIGHT;
-        row--;
     }
 
+    R_EndSpan();
+
+retained:
     R_ClearColor();
 
 //ZOID
@@ -910,14 +1148,14 @@ static void Con_DrawSolidConsole(void)
 // draw clock
     if (con_clock->integer) {
         x = Com_Time_m(buffer, sizeof(buffer)) * CHAR_WIDTH;
-        if (widths[row] + x + CHAR_WIDTH <= con.vidWidth) {
+        if (con.widths[row] + x + CHAR_WIDTH <= con.vidWidth) {
             R_DrawString(con.vidWidth - CHAR_WIDTH - x, y - CHAR_HEIGHT,
                          UI_RIGHT, MAX_STRING_CHARS, buffer, con.charsetImage);
         }
     }
 
 // draw version
-    if (!row || widths[0] + VER_WIDTH <= con.vidWidth) {
+    if (!row || con.widths[0] + VER_WIDTH <= con.vidWidth) {
         SCR_DrawStringEx(con.vidWidth - CHAR_WIDTH, y, UI_RIGHT,
                          MAX_STRING_CHARS, APP_VERSION, con.charsetImage);
     }
@@ -1141,35 +1379,23 @@ void Key_Console(int key)
     }
 
     if (key == K_PGUP || key == K_MWHEELUP) {
-        if (Key_IsDown(K_CTRL)) {
-            con.display -= 6;
-        } else {
-            con.display -= 2;
-        }
-        Con_CheckTop();
+        scroll_up(Key_IsDown(K_CTRL) ? 6 : 2);
         return;
     }
 
     if (key == K_PGDN || key == K_MWHEELDOWN) {
-        if (Key_IsDown(K_CTRL)) {
-            con.display += 6;
-        } else {
-            con.display += 2;
-        }
-        if (con.display > con.current) {
-            con.display = con.current;
-        }
+        scroll_down(Key_IsDown(K_CTRL) ? 6 : 2);
         return;
     }
 
     if (key == K_HOME && Key_IsDown(K_CTRL)) {
-        con.display = 1;
+        con.display = con.first - 1;
         Con_CheckTop();
         return;
     }
 
     if (key == K_END && Key_IsDown(K_CTRL)) {
-        con.display = con.current;
+        scroll_bottom();
         return;
     }
 
@@ -1180,7 +1406,7 @@ void Key_Console(int key)
 
 scroll:
     if (con_scroll->integer & 1) {
-        con.display = con.current;
+        scroll_bottom();
     }
 }
 
@@ -25,8 +25,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 static byte     demo_buffer[MAX_PACKETLEN];
 
 static cvar_t   *cl_demosnaps;
+static cvar_t   *cl_demosnaps_maxsize;
 static cvar_t   *cl_demomsglen;
 static cvar_t   *cl_demowait;
+static cvar_t   *cl_demoindex;
+static cvar_t   *cl_timedemo_csv;
+
+// snapshot index file saved next to demo
+#define DEMO_INDEX_MAGIC    MakeRawLong('D','M','I','X')
+#define DEMO_INDEX_VERSION  1
 
 // =========================================================================
 
@@ -327,7 +334,7 @@ static void CL_Record_f(void)
     entity_packed_t pack;
     char            *s;
     qhandle_t       f;
-    unsigned        mode = FS_MODE_WRITE;
+    unsigned        mode = FS_MODE_WRITE | FS_FLAG_ASYNC;
     size_t          size = Cvar_ClampInteger(
                                cl_demomsglen,
                                MIN_PACKETLEN,
@@ -727,6 +734,10 @@ static void CL_PlayDemo_f(void)
     CL_Disconnect(ERR_RECONNECT);
 
     cls.demo.playback = f;
+    Q_strlcpy(cls.demo.name, name, sizeof(cls.demo.name));
+
+    // keep disk latency out of playback frames
+    FS_ReadAhead(f, name);
     cls.state = ca_connected;
     Q_strlcpy(cls.servername, COM_SkipPath(name), sizeof(cls.servername));
     cls.serverAddress.type = NA_LOOPBACK;
@@ -756,9 +767,104 @@ typedef struct {
     int framenum;
     off_t filepos;
     size_t msglen;
+    size_t datalen;     // less than msglen if compressed
     byte data[1];
 } demosnap_t;
 
+static byte     snap_buffer[MAX_MSGLEN];
+
+static void add_snapshot(int framenum, off_t filepos, const byte *data, size_t len)
+{
+    demosnap_t *snap;
+    size_t datalen = len;
+#if USE_ZLIB
+    uLongf zlen = sizeof(snap_buffer);
+
+    if (compress2(snap_buffer, &zlen, data, len, Z_BEST_SPEED) == Z_OK && zlen < len) {
+        data = snap_buffer;
+        datalen = zlen;
+    }
+#endif
+
+    snap = Z_Malloc(sizeof(*snap) + datalen - 1);
+    snap->framenum = framenum;
+    snap->filepos = filepos;
+    snap->msglen = len;
+    snap->datalen = datalen;
+    memcpy(snap->data, data, datalen);
+    List_Append(&cls.demo.snapshots, &snap->entry);
+
+    cls.demo.snapshots_size += datalen;
+}
+
+// returns uncompressed snapshot data in the given buffer, or in place
+static byte *read_snapshot(demosnap_t *snap, byte *buffer)
+{
+#if USE_ZLIB
+    uLongf len = snap->msglen;
+
+    if (snap->datalen == snap->msglen)
+        return snap->data;
+
+    if (uncompress(buffer, &len, snap->data, snap->datalen) != Z_OK || len != snap->msglen)
+        return NULL;
+
+    return buffer;
+#else
+    return snap->data;
+#endif
+}
+
+/*
+====================
+thin_snapshots
+
+Keeps snapshot data within cl_demosnaps_maxsize by dropping snapshots that
+leave the smallest gap behind, relative to their distance from the current
+frame. This keeps them dense near the playhead and sparse elsewhere. First
+and last snapshots are never dropped.
+====================
+*/
+static void thin_snapshots(void)
+{
+    demosnap_t *snap, *prev, *next, *best;
+    size_t maxsize;
+    float score, best_score;
+    int dist;
+
+    if (cl_demosnaps_maxsize->integer <= 0)
+        return;
+
+    maxsize = (size_t)cl_demosnaps_maxsize->integer << 10;
+
+    while (cls.demo.snapshots_size > maxsize) {
+        best = NULL;
+        best_score = 0;
+        LIST_FOR_EACH(demosnap_t, snap, &cls.demo.snapshots, entry) {
+            if (snap->entry.prev == &cls.demo.snapshots)
+                continue;
+            if (snap->entry.next == &cls.demo.snapshots)
+                break;
+            prev = LIST_PREV(demosnap_t, snap, entry);
+            next = LIST_NEXT(demosnap_t, snap, entry);
+            dist = abs(snap->framenum - cls.demo.frames_read);
+            score = (float)(next->framenum - prev->framenum) / (dist + 1);
+            if (!best || score < best_score) {
+                best = snap;
+                best_score = score;
+            }
+        }
+
+        if (!best)
+            break;
+
+        Com_DPrintf("[%d] dropping snap at %d\n", cls.demo.frames_read, best->framenum);
+        cls.demo.snapshots_size -= best->datalen;
+        List_Remove(&best->entry);
+        Z_Free(best);
+    }
+}
+
 /*
 ====================
 CL_EmitDemoSnapshot
@@ -769,7 +875,6 @@ state, configstrings and layouts at the given server frame.
 */
 void CL_EmitDemoSnapshot(void)
 {
-    demosnap_t *snap;
     off_t pos;
     char *from, *to;
     size_t len;
@@ -831,18 +936,15 @@ void CL_EmitDemoSnapshot(void)
     MSG_WriteByte(svc_layout);
     MSG_WriteString(cl.layout);
 
-    snap = Z_Malloc(sizeof(*snap) + msg_write.cursize - 1);
-    snap->framenum = cls.demo.frames_read;
-    snap->filepos = pos;
-    snap->msglen = msg_write.cursize;
-    memcpy(snap->data, msg_write.data, msg_write.cursize);
-    List_Append(&cls.demo.snapshots, &snap->entry);
+    add_snapshot(cls.demo.frames_read, pos, msg_write.data, msg_write.cursize);
 
     Com_DPrintf("[%d] snaplen %"PRIz"\n", cls.demo.frames_read, msg_write.cursize);
 
     SZ_Clear(&msg_write);
 
     cls.demo.last_snapshot = cls.demo.frames_read;
+
+    thin_snapshots();
 }
 
 static demosnap_t *find_snapshot(int framenum)
@@ -863,6 +965,303 @@ static demosnap_t *find_snapshot(int framenum)
     return prev;
 }
 
+static void free_snapshots(void)
+{
+    demosnap_t *snap, *next;
+    size_t total;
+
+    total = 0;
+    LIST_FOR_EACH_SAFE(demosnap_t, snap, next, &cls.demo.snapshots, entry) {
+        total += snap->datalen;
+        Z_Free(snap);
+    }
+
+    if (total)
+        Com_DPrintf("Freed %"PRIz" bytes of snaps\n", total);
+
+    List_Init(&cls.demo.snapshots);
+    cls.demo.snapshots_size = 0;
+    cls.demo.last_snapshot = INT_MIN;
+}
+
+static size_t index_path(char *buffer, size_t size)
+{
+    return Q_concat(buffer, size, cls.demo.name, ".idx", NULL);
+}
+
+/*
+====================
+load_index
+
+Reads snapshots previously saved by `demoindex' command, so that seeking
+doesn't need to play through the demo first.
+====================
+*/
+static qboolean load_index(void)
+{
+    char path[MAX_OSPATH];
+    uint32_t header[4], entry[3];
+    byte *data;
+    qhandle_t f;
+    int i, count, framenum, lastnum;
+    size_t msglen;
+
+    if (index_path(path, sizeof(path)) >= sizeof(path))
+        return qfalse;
+
+    FS_FOpenFile(path, &f, FS_MODE_READ);
+    if (!f)
+        return qfalse;
+
+    // can't use msg_read_buffer, first frame is being parsed from it
+    data = Z_Malloc(MAX_MSGLEN);
+
+    if (FS_Read(header, sizeof(header), f) != sizeof(header))
+        goto fail;
+    if (header[0] != DEMO_INDEX_MAGIC)
+        goto fail;
+    if (LittleLong(header[1]) != DEMO_INDEX_VERSION)
+        goto fail;
+    if (LittleLong(header[2]) != cls.demo.file_offset + cls.demo.file_size)
+        goto fail;  // demo file changed
+
+    count = LittleLong(header[3]);
+    lastnum = INT_MIN;
+    for (i = 0; i < count; i++) {
+        if (FS_Read(entry, sizeof(entry), f) != sizeof(entry))
+            goto fail;
+        framenum = LittleLong(entry[0]);
+        msglen = LittleLong(entry[2]);
+        if (msglen < 1 || msglen > MAX_MSGLEN)
+            goto fail;
+        if (framenum <= lastnum)
+            goto fail;
+        if (FS_Read(data, msglen, f) != msglen)
+            goto fail;
+        add_snapshot(framenum, LittleLong(entry[1]), data, msglen);
+        lastnum = framenum;
+    }
+
+    FS_FCloseFile(f);
+    Z_Free(data);
+
+    if (count) {
+        cls.demo.last_snapshot = lastnum;
+        Com_DPrintf("Loaded %d snapshots from %s\n", count, path);
+        thin_snapshots();
+    }
+    return qtrue;
+
+fail:
+    Com_WPrintf("Ignoring invalid demo index %s\n", path);
+    FS_FCloseFile(f);
+    Z_Free(data);
+    free_snapshots();
+    return qfalse;
+}
+
+static qboolean save_index(void)
+{
+    char path[MAX_OSPATH];
+    uint32_t header[4], entry[3];
+    demosnap_t *snap;
+    qhandle_t f;
+    byte *data;
+    int count;
+    ssize_t ret;
+
+    if (index_path(path, sizeof(path)) >= sizeof(path)) {
+        Com_Printf("Oversize demo index path.\n");
+        return qfalse;
+    }
+
+    FS_FOpenFile(path, &f, FS_MODE_WRITE);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for writing\n", path);
+        return qfalse;
+    }
+
+    count = 0;
+    LIST_FOR_EACH(demosnap_t, snap, &cls.demo.snapshots, entry) {
+        count++;
+    }
+
+    header[0] = DEMO_INDEX_MAGIC;
+    header[1] = LittleLong(DEMO_INDEX_VERSION);
+    header[2] = LittleLong(cls.demo.file_offset + cls.demo.file_size);
+    header[3] = LittleLong(count);
+    ret = FS_Write(header, sizeof(header), f);
+    if (ret != sizeof(header))
+        goto fail;
+
+    LIST_FOR_EACH(demosnap_t, snap, &cls.demo.snapshots, entry) {
+        entry[0] = LittleLong(snap->framenum);
+        entry[1] = LittleLong(snap->filepos);
+        entry[2] = LittleLong(snap->msglen);
+        ret = FS_Write(entry, sizeof(entry), f);
+        if (ret != sizeof(entry))
+            goto fail;
+        data = read_snapshot(snap, snap_buffer);
+        if (!data) {
+            ret = Q_ERR_INVALID_FORMAT;
+            goto fail;
+        }
+        ret = FS_Write(data, snap->msglen, f);
+        if (ret != snap->msglen)
+            goto fail;
+    }
+
+    FS_FCloseFile(f);
+
+    Com_Printf("Wrote %d snapshots to %s.\n", count, path);
+    return qtrue;
+
+fail:
+    Com_EPrintf("Couldn't write %s: %s\n", path,
+                Q_ErrorString(ret < 0 ? ret : Q_ERR_FAILURE));
+    FS_FCloseFile(f);
+    return qfalse;
+}
+
+/*
+====================
+TIMEDEMO
+
+Frame times go into a histogram of TD_BUCKET_USEC wide buckets, the last
+one collecting anything longer. Subsystem times are summed over the whole
+client frame by TD_START/TD_STOP and picked up at the start of the next.
+====================
+*/
+
+#define TD_BUCKET_USEC  10
+#define TD_NUM_BUCKETS  4096
+
+static const char *const td_names[TD_NUM_SECTIONS] = {
+    "parse", "deltaframe", "addentities", "world",
+    "entities", "particles", "2d", "swap"
+};
+
+static struct {
+    unsigned    last;       // start of the frame being timed
+    unsigned    frames;
+    unsigned    min, max;
+    uint64_t    total;
+    uint64_t    sections[TD_NUM_SECTIONS];
+    unsigned    histogram[TD_NUM_BUCKETS];
+} td;
+
+static void timedemo_begin(void)
+{
+    memset(&td, 0, sizeof(td));
+    memset(time_sections, 0, sizeof(time_sections));
+    td.min = UINT_MAX;
+    td.last = Sys_Microseconds();
+}
+
+static void timedemo_frame(void)
+{
+    unsigned now = Sys_Microseconds();
+    unsigned usec = now - td.last;
+    int i;
+
+    td.last = now;
+
+    // the first frame was only partly timed
+    if (!cls.demo.time_frames) {
+        memset(time_sections, 0, sizeof(time_sections));
+        return;
+    }
+
+    td.frames++;
+    td.total += usec;
+    td.min = min(td.min, usec);
+    td.max = max(td.max, usec);
+    td.histogram[min(usec / TD_BUCKET_USEC, TD_NUM_BUCKETS - 1)]++;
+
+    for (i = 0; i < TD_NUM_SECTIONS; i++) {
+        td.sections[i] += time_sections[i];
+        time_sections[i] = 0;
+    }
+}
+
+// upper bound of the frame time not exceeded by given fraction of frames
+static float timedemo_percentile(float frac)
+{
+    unsigned count = 0, need = td.frames * frac;
+    int i;
+
+    for (i = 0; i < TD_NUM_BUCKETS - 1; i++) {
+        count += td.histogram[i];
+        if (count >= need) {
+            return min((i + 1) * TD_BUCKET_USEC, td.max) * 0.001f;
+        }
+    }
+
+    return td.max * 0.001f;
+}
+
+static void timedemo_report(float sec, float fps)
+{
+    char buffer[MAX_OSPATH];
+    float avg[TD_NUM_SECTIONS];
+    qhandle_t f;
+    qboolean exists;
+    int i;
+
+    if (!td.frames) {
+        return;
+    }
+
+    for (i = 0; i < TD_NUM_SECTIONS; i++) {
+        avg[i] = td.sections[i] * 0.001f / td.frames;
+    }
+
+    // deltaframe is nested within parse
+    avg[TD_PARSE] = max(avg[TD_PARSE] - avg[TD_DELTAFRAME], 0);
+
+    Com_Printf("frame msec: min %.2f, avg %.2f, p99 %.2f, max %.2f\n",
+               td.min * 0.001f, td.total * 0.001f / td.frames,
+               timedemo_percentile(0.99f), td.max * 0.001f);
+    for (i = 0; i < TD_NUM_SECTIONS; i++) {
+        Com_Printf("%12s %6.3f\n", td_names[i], avg[i]);
+    }
+
+    if (!cl_timedemo_csv->string[0]) {
+        return;
+    }
+
+    Q_strlcpy(buffer, cl_timedemo_csv->string, sizeof(buffer));
+    COM_DefaultExtension(buffer, ".csv", sizeof(buffer));
+
+    exists = FS_FileExists(buffer);
+    FS_FOpenFile(buffer, &f, FS_MODE_APPEND);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for appending\n", buffer);
+        return;
+    }
+
+    if (!exists) {
+        FS_FPrintf(f, "version,demo,frames,seconds,fps,min,avg,p99,max");
+        for (i = 0; i < TD_NUM_SECTIONS; i++) {
+            FS_FPrintf(f, ",%s", td_names[i]);
+        }
+        FS_FPrintf(f, "\n");
+    }
+
+    FS_FPrintf(f, "\"%s\",\"%s\",%u,%.3f,%.1f,%.3f,%.3f,%.3f,%.3f",
+               com_version->string, cls.demo.name, td.frames, sec, fps,
+               td.min * 0.001f, td.total * 0.001f / td.frames,
+               timedemo_percentile(0.99f), td.max * 0.001f);
+    for (i = 0; i < TD_NUM_SECTIONS; i++) {
+        FS_FPrintf(f, ",%.3f", avg[i]);
+    }
+    FS_FPrintf(f, "\n");
+
+    FS_FCloseFile(f);
+
+    Com_Printf("Appended results to %s.\n", buffer);
+}
+
 /*
 ====================
 CL_FirstDemoFrame
@@ -891,60 +1290,43 @@ void CL_FirstDemoFrame(void)
     if (com_timedemo->integer) {
         cls.demo.time_frames = 0;
         cls.demo.time_start = Sys_Milliseconds();
+        timedemo_begin();
     }
 
     // force initial snapshot
     cls.demo.last_snapshot = INT_MIN;
+
+    // pick up saved snapshots, or build them right away
+    if (cls.demo.file_size && LIST_EMPTY(&cls.demo.snapshots) &&
+        cl_demoindex->integer > 0 && cl_demosnaps->integer > 0) {
+        if (!load_index() && cl_demoindex->integer > 1) {
+            Cbuf_AddText(&cmd_buffer, "demoindex\n");
+        }
+    }
 }
 
-static void CL_Seek_f(void)
+/*
+====================
+seek_demo
+
+Moves demo playback to the given frame. If `wait' is set, stops at the last
+frame of demo file, otherwise finishes playback when EOF is reached.
+====================
+*/
+static void seek_demo(int dest, qboolean wait)
 {
     demosnap_t *snap;
-    int i, j, ret, index, frames, dest, prev;
+    int i, j, ret, index, frames, prev;
     char *from, *to;
+    byte *data;
 
-    if (Cmd_Argc() < 2) {
-        Com_Printf("Usage: %s [+-]<timespec>\n", Cmd_Argv(0));
-        return;
-    }
-
-#if USE_MVD_CLIENT
-    if (sv_running->integer == ss_broadcast) {
-        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
-        return;
-    }
-#endif
-
-    if (!cls.demo.playback) {
-        Com_Printf("Not playing a demo.\n");
-        return;
-    }
-
-    to = Cmd_Argv(1);
-
-    if (*to == '-' || *to == '+') {
-        // relative to current frame
-        if (!Com_ParseTimespec(to + 1, &frames)) {
-            Com_Printf("Invalid relative timespec.\n");
-            return;
-        }
-        if (*to == '-')
-            frames = -frames;
-        dest = cls.demo.frames_read + frames;
-    } else {
-        // relative to first frame
-        if (!Com_ParseTimespec(to, &dest)) {
-            Com_Printf("Invalid absolute timespec.\n");
-            return;
-        }
-        frames = dest - cls.demo.frames_read;
-    }
+    frames = dest - cls.demo.frames_read;
 
     if (!frames)
         // already there
         return;
 
-    if (frames > 0 && cls.demo.eof && cl_demowait->integer)
+    if (frames > 0 && cls.demo.eof && wait)
         // already at end
         return;
 
@@ -966,8 +1348,15 @@ static void CL_Seek_f(void)
     if (frames < 0 || cls.demo.last_snapshot > cls.demo.frames_read) {
         snap = find_snapshot(dest);
 
-        if (snap) {
+        // going forward, only jump if that skips some frames
+        if (snap && (frames < 0 || snap->framenum > cls.demo.frames_read)) {
             Com_DPrintf("found snap at %d\n", snap->framenum);
+            data = read_snapshot(snap, msg_read_buffer);
+            if (!data) {
+                Com_EPrintf("Couldn't decompress demo snapshot\n");
+                goto done;
+            }
+
             ret = FS_Seek(cls.demo.playback, snap->filepos);
             if (ret < 0) {
                 Com_EPrintf("Couldn't seek demo: %s\n", Q_ErrorString(ret));
@@ -989,7 +1378,7 @@ static void CL_Seek_f(void)
                 strcpy(to, from);
             }
 
-            SZ_Init(&msg_read, snap->data, snap->msglen);
+            SZ_Init(&msg_read, data, snap->msglen);
             msg_read.cursize = snap->msglen;
 
             CL_SeekDemoMessage();
@@ -1004,7 +1393,7 @@ static void CL_Seek_f(void)
     // skip forward to destination frame
     while (cls.demo.frames_read < dest) {
         ret = read_next_message(cls.demo.playback);
-        if (ret == 0 && cl_demowait->integer) {
+        if (ret == 0 && wait) {
             cls.demo.eof = qtrue;
             break;
         }
@@ -1058,6 +1447,89 @@ done:
     cls.demo.seeking = qfalse;
 }
 
+static void CL_Seek_f(void)
+{
+    int frames, dest;
+    char *to;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s [+-]<timespec>\n", Cmd_Argv(0));
+        return;
+    }
+
+#if USE_MVD_CLIENT
+    if (sv_running->integer == ss_broadcast) {
+        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
+        return;
+    }
+#endif
+
+    if (!cls.demo.playback) {
+        Com_Printf("Not playing a demo.\n");
+        return;
+    }
+
+    to = Cmd_Argv(1);
+
+    if (*to == '-' || *to == '+') {
+        // relative to current frame
+        if (!Com_ParseTimespec(to + 1, &frames)) {
+            Com_Printf("Invalid relative timespec.\n");
+            return;
+        }
+        if (*to == '-')
+            frames = -frames;
+        dest = cls.demo.frames_read + frames;
+    } else {
+        // relative to first frame
+        if (!Com_ParseTimespec(to, &dest)) {
+            Com_Printf("Invalid absolute timespec.\n");
+            return;
+        }
+    }
+
+    seek_demo(dest, cl_demowait->integer);
+}
+
+/*
+====================
+CL_DemoIndex_f
+
+Plays through the rest of demo to take snapshots up to the last frame,
+saves them into index file and returns to the current position.
+====================
+*/
+static void CL_DemoIndex_f(void)
+{
+    int start;
+
+    if (!cls.demo.playback || sv_running->integer == ss_broadcast) {
+        Com_Printf("Not playing a client demo.\n");
+        return;
+    }
+
+    if (cls.state != ca_active || !cls.demo.file_size) {
+        Com_Printf("Demo is not seekable.\n");
+        return;
+    }
+
+    if (cl_demosnaps->integer <= 0) {
+        Com_Printf("Demo snapshots are disabled.\n");
+        return;
+    }
+
+    start = cls.demo.frames_read;
+
+    seek_demo(INT_MAX, qtrue);
+    if (!cls.demo.eof) {
+        return;
+    }
+
+    save_index();
+
+    seek_demo(start, qtrue);
+}
+
 static void parse_info_string(demoInfo_t *info, int clientNum, int index, const char *string)
 {
     size_t len;
@@ -1175,9 +1647,6 @@ fail:
 
 void CL_CleanupDemos(void)
 {
-    demosnap_t *snap, *next;
-    size_t total;
-
     if (cls.demo.recording) {
         CL_Stop_f();
     }
@@ -1194,18 +1663,12 @@ void CL_CleanupDemos(void)
 
                 Com_Printf("%u frames, %3.1f seconds: %3.1f fps\n",
                            cls.demo.time_frames, sec, fps);
+                timedemo_report(sec, fps);
             }
         }
     }
 
-    total = 0;
-    LIST_FOR_EACH_SAFE(demosnap_t, snap, next, &cls.demo.snapshots, entry) {
-        total += snap->msglen;
-        Z_Free(snap);
-    }
-
-    if (total)
-        Com_DPrintf("Freed %"PRIz" bytes of snaps\n", total);
+    free_snapshots();
 
     memset(&cls.demo, 0, sizeof(cls.demo));
 
@@ -1229,7 +1692,10 @@ void CL_DemoFrame(int msec)
     }
 
     if (com_timedemo->integer) {
+        timedemo_frame();
+        TD_START(TD_PARSE);
         parse_next_message(0);
+        TD_STOP(TD_PARSE);
         cl.time = cl.servertime;
         cls.demo.time_frames++;
         return;
@@ -1258,6 +1724,7 @@ static const cmdreg_t c_demo[] = {
     { "stop", CL_Stop_f },
     { "suspend", CL_Suspend_f },
     { "seek", CL_Seek_f },
+    { "demoindex", CL_DemoIndex_f },
 
     { NULL }
 };
@@ -1270,8 +1737,11 @@ CL_InitDemos
 void CL_InitDemos(void)
 {
     cl_demosnaps = Cvar_Get("cl_demosnaps", "10", 0);
+    cl_demosnaps_maxsize = Cvar_Get("cl_demosnaps_maxsize", "65536", 0);
     cl_demomsglen = Cvar_Get("cl_demomsglen", va("%d", MAX_PACKETLEN_WRITABLE_DEFAULT), 0);
     cl_demowait = Cvar_Get("cl_demowait", "0", 0);
+    cl_demoindex = Cvar_Get("cl_demoindex", "1", 0);
+    cl_timedemo_csv = Cvar_Get("cl_timedemo_csv", "", 0);
 
     Cmd_Register(c_demo);
     List_Init(&cls.demo.snapshots);
@@ -123,6 +123,9 @@ void CL_FinishDownload(dlqueue_t *q)
 
     q->state = DL_DONE;
     cls.download.pending--;
+
+    // downloaded file may have been asked for before
+    FS_InvalidateIndex();
     Com_DPrintf("%s: %s [%d]\n", __func__, q->path, cls.download.pending);
 }
 
@@ -139,6 +142,9 @@ void CL_CleanupDownloads(void)
 
     HTTP_CleanupDownloads();
 
+    // drop whatever precache checks prefetched
+    FS_FlushPrefetch();
+
     FOR_EACH_DLQ_SAFE(q, n) {
         Z_Free(q);
     }
@@ -155,6 +161,7 @@ void CL_CleanupDownloads(void)
     }
 
     cls.download.temp[0] = 0;
+    cls.download.stream = qfalse;
 }
 
 /*
@@ -234,6 +241,7 @@ static qboolean start_download(dlqueue_t *q)
     size_t len;
     qhandle_t f;
     ssize_t ret;
+    const char *stream;
 
     len = strlen(q->path);
     if (len >= MAX_QPATH) {
@@ -246,6 +254,14 @@ static qboolean start_download(dlqueue_t *q)
     memcpy(cls.download.temp, q->path, len);
     memcpy(cls.download.temp + len, ".tmp", 5);
 
+    // ask for windowed, deflated transfer where the netchan can fragment
+    // whole windows. servers that don't know about it ignore the request.
+    stream = "";
+#if USE_ZLIB
+    if (cls.netchan->type == NETCHAN_NEW)
+        stream = " stream";
+#endif
+
 //ZOID
     // check to see if we already have a tmp for this file, if so, try to resume
     // open the file if not opened yet
@@ -254,10 +270,10 @@ static qboolean start_download(dlqueue_t *q)
         cls.download.file = f;
         // give the server an offset to start the download
         Com_DPrintf("[UDP] Resuming %s\n", q->path);
-        CL_ClientCommand(va("download \"%s\" %"PRIz, q->path, ret));
+        CL_ClientCommand(va("download \"%s\" %"PRIz"%s", q->path, ret, stream));
     } else if (ret == Q_ERR_NOENT) {  // it doesn't exist
         Com_DPrintf("[UDP] Downloading %s\n", q->path);
-        CL_ClientCommand(va("download \"%s\"", q->path));
+        CL_ClientCommand(va("download \"%s\" 0%s", q->path, stream));
     } else { // error happened
         Com_EPrintf("[UDP] Couldn't open %s for appending: %s\n",
                     cls.download.temp, Q_ErrorString(ret));
@@ -343,11 +359,12 @@ void CL_HandleDownload(const byte *data, int size, int percent)
     }
 
     if (percent != 100) {
-        // request next block
+        // request next block, unless the server streams them
         // change display routines by zoid
         cls.download.percent = percent;
 
-        CL_ClientCommand("nextdl");
+        if (!cls.download.stream)
+            CL_ClientCommand("nextdl");
     } else {
         FS_FCloseFile(cls.download.file);
 
@@ -367,6 +384,7 @@ another:
         cls.download.percent = 0;
         cls.download.file = 0;
         cls.download.temp[0] = 0;
+        cls.download.stream = qfalse;
 
         if (msg) {
             Com_Printf("[UDP] %s [%s] [%d remaining file%s]\n",
@@ -441,9 +459,12 @@ static qerror_t check_file_len(const char *path, size_t len, dltype_t type)
     if (*ext != '.' || !CL_CheckDownloadExtension(ext + 1))
         return Q_ERR_INVALID_PATH;
 
-    if (FS_FileExists(buffer))
-        // it exists, no need to download
+    if (FS_FileExists(buffer)) {
+        // it exists, no need to download. let the filesystem start
+        // inflating it while other files are still being downloaded.
+        FS_Prefetch(buffer);
         return Q_ERR_EXIST;
+    }
 
     if (valid == PATH_MIXED_CASE)
         // convert to lower case to make download server happy
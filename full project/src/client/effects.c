@@ -37,6 +37,7 @@ LIGHT STYLE MANAGEMENT
 typedef struct clightstyle_s {
     list_t  entry;
     int     length;
+    qboolean    modified;   // queued for CL_AddLightStyles
     vec4_t  value;
     float   map[MAX_QPATH];
 } clightstyle_t;
@@ -45,6 +46,26 @@ static clightstyle_t    cl_lightstyles[MAX_LIGHTSTYLES];
 static LIST_DECL(cl_lightlist);
 static int          cl_lastofs;
 
+// styles whose value changed since they were last passed to the view
+static byte         cl_lightmodified[MAX_LIGHTSTYLES];
+static int          cl_nummodified;
+
+static void set_style_value(clightstyle_t *ls, float value)
+{
+    if (ls->value[3] == value)
+        return;
+
+    ls->value[0] =
+    ls->value[1] =
+    ls->value[2] =
+    ls->value[3] = value;
+
+    if (!ls->modified) {
+        ls->modified = qtrue;
+        cl_lightmodified[cl_nummodified++] = ls - cl_lightstyles;
+    }
+}
+
 void CL_ClearLightStyles(void)
 {
     int     i;
@@ -53,14 +74,17 @@ void CL_ClearLightStyles(void)
     for (i = 0, ls = cl_lightstyles; i < MAX_LIGHTSTYLES; i++, ls++) {
         List_Init(&ls->entry);
         ls->length = 0;
+        ls->modified = qtrue;
         ls->value[0] =
         ls->value[1] =
         ls->value[2] =
         ls->value[3] = 1;
+        cl_lightmodified[i] = i;
     }
 
     List_Init(&cl_lightlist);
     cl_lastofs = -1;
+    cl_nummodified = MAX_LIGHTSTYLES;
 }
 
 /*
@@ -79,10 +103,7 @@ void CL_RunLightStyles(void)
     cl_lastofs = ofs;
 
     LIST_FOR_EACH(clightstyle_t, ls, &cl_lightlist, entry) {
-        ls->value[0] =
-        ls->value[1] =
-        ls->value[2] =
-        ls->value[3] = ls->map[ofs % ls->length];
+        set_style_value(ls, ls->map[ofs % ls->length]);
     }
 }
 
@@ -111,31 +132,33 @@ void CL_SetLightStyle(int index, const char *s)
     }
 
     if (ls->length == 1) {
-        ls->value[0] =
-        ls->value[1] =
-        ls->value[2] =
-        ls->value[3] = ls->map[0];
+        set_style_value(ls, ls->map[0]);
         return;
     }
 
-    ls->value[0] =
-    ls->value[1] =
-    ls->value[2] =
-    ls->value[3] = 1;
+    set_style_value(ls, 1);
 }
 
 /*
 ================
 CL_AddLightStyles
+
+Only passes styles that changed value, the view keeps the rest.
 ================
 */
 void CL_AddLightStyles(void)
 {
-    int     i;
+    int     i, index;
     clightstyle_t   *ls;
 
-    for (i = 0, ls = cl_lightstyles; i < MAX_LIGHTSTYLES; i++, ls++)
-        V_AddLightStyle(i, ls->value);
+    for (i = 0; i < cl_nummodified; i++) {
+        index = cl_lightmodified[i];
+        ls = &cl_lightstyles[index];
+        ls->modified = qfalse;
+        V_AddLightStyle(index, ls->value);
+    }
+
+    cl_nummodified = 0;
 }
 
 #endif
@@ -828,35 +851,44 @@ PARTICLE MANAGEMENT
 ==============================================================
 */
 
-static cparticle_t  *active_particles, *free_particles;
+// live particles are kept at the start of the array, dead ones are
+// removed by moving the last live particle into their place. sized by
+// cl_maxparticles, same as the render list.
+static cparticle_t  *particles;
+static int          cl_numparticles;
+
+static cvar_t       *cl_maxparticles;
 
-static cparticle_t  particles[MAX_PARTICLES];
-static const int    cl_numparticles = MAX_PARTICLES;
+extern int          r_numparticles;
+extern int          r_maxparticles;
+extern particle_t   *r_particles;
 
 static void clear_particles(void)
 {
-    int     i;
+    cl_numparticles = 0;
+}
 
-    free_particles = &particles[0];
-    active_particles = NULL;
+static void cl_maxparticles_changed(cvar_t *self)
+{
+    int count = Cvar_ClampInteger(self, 1024, 65536);
 
-    for (i = 0; i < cl_numparticles; i++)
-        particles[i].next = &particles[i + 1];
-    particles[cl_numparticles - 1].next = NULL;
+    if (count == r_maxparticles)
+        return;
+
+    Z_Free(particles);
+    Z_Free(r_particles);
+    particles = Z_Malloc(sizeof(*particles) * count);
+    r_particles = Z_Malloc(sizeof(*r_particles) * count);
+    r_maxparticles = count;
+    cl_numparticles = r_numparticles = 0;
 }
 
 cparticle_t *CL_AllocParticle(void)
 {
-    cparticle_t *p;
-
-    if (!free_particles)
+    if (cl_numparticles == r_maxparticles)
         return NULL;
-    p = free_particles;
-    free_particles = p->next;
-    p->next = active_particles;
-    active_particles = p;
 
-    return p;
+    return &particles[cl_numparticles++];
 }
 
 /*
@@ -1777,8 +1809,6 @@ void CL_TeleportParticles(vec3_t org)
 
 
 
-extern int          r_numparticles;
-extern particle_t   r_particles[MAX_PARTICLES];
 
 /*
 ===============
@@ -1787,19 +1817,14 @@ CL_AddParticles
 */
 void CL_AddParticles(void)
 {
-    cparticle_t     *p, *next;
+    cparticle_t     *p;
     float           alpha;
     float           time = 0, time2;
-    //vec3_t            org;
-    int             color;
-    cparticle_t     *active, *tail;
+    int             i, color;
     particle_t      *part;
 
-    active = NULL;
-    tail = NULL;
-
-    for (p = active_particles; p; p = next) {
-        next = p->next;
+    for (i = 0; i < cl_numparticles; ) {
+        p = &particles[i];
 
         // PMM - added INSTANT_PARTICLE handling for heat beam
         if (p->alphavel != INSTANT_PARTICLE) {
@@ -1807,26 +1832,18 @@ void CL_AddParticles(void)
             alpha = p->alpha + time * p->alphavel;
             if (alpha <= 0) {
                 // faded out
-                p->next = free_particles;
-                free_particles = p;
+                *p = particles[--cl_numparticles];
                 continue;
             }
         } else {
             alpha = p->alpha;
         }
 
-        if (r_numparticles >= MAX_PARTICLES)
+        // out of room, the rest stay alive for the next frame
+        if (r_numparticles >= r_maxparticles)
             break;
         part = &r_particles[r_numparticles++];
 
-        p->next = NULL;
-        if (!tail)
-            active = tail = p;
-        else {
-            tail->next = p;
-            tail = p;
-        }
-
         if (alpha > 1.0)
             alpha = 1;
         color = p->color;
@@ -1847,15 +1864,14 @@ void CL_AddParticles(void)
         part->color = color;
         part->alpha = alpha;
 
-//      V_AddParticle(&part);
         // PMM
         if (p->alphavel == INSTANT_PARTICLE) {
             p->alphavel = 0.0;
             p->alpha = 0.0;
         }
-    }
 
-    active_particles = active;
+        i++;
+    }
 }
 
 
@@ -1880,5 +1896,8 @@ void CL_InitEffects(void)
     for (i = 0; i < NUMVERTEXNORMALS * 3; i++)
         avelocities[0][i] = (rand() & 255) * 0.01;
 
+    cl_maxparticles = Cvar_Get("cl_maxparticles", "4096", 0);
+    cl_maxparticles->changed = cl_maxparticles_changed;
+    cl_maxparticles_changed(cl_maxparticles);
 }
 
@@ -124,12 +124,32 @@ entity_old(centity_t *ent, const entity_state_t *state, const vec_t *origin)
     ent->prev = ent->current;
 }
 
+// precompute what LerpVector and LerpAngles would subtract every frame
+static inline void entity_deltas(centity_t *ent)
+{
+    vec_t d;
+    int i;
+
+    VectorSubtract(ent->current.origin, ent->prev.origin, ent->origin_delta);
+
+    for (i = 0; i < 3; i++) {
+        d = ent->current.angles[i] - ent->prev.angles[i];
+        if (d > 180)
+            d -= 360;
+        if (d < -180)
+            d += 360;
+        ent->angle_delta[i] = d;
+    }
+}
+
 static void entity_update(const entity_state_t *state)
 {
     centity_t *ent = &cl_entities[state->number];
     const vec_t *origin;
     vec3_t origin_v;
 
+    cl.activeEntities[cl.numActiveEntities++] = ent;
+
     // if entity is solid, decode mins/maxs and add to the list
     if (state->solid && state->number != cl.frame.clientNum + 1) {
         cl.solidEntities[cl.numSolidEntities++] = ent;
@@ -165,6 +185,8 @@ static void entity_update(const entity_state_t *state)
     if (entity_optimized(state)) {
         Com_PlayerToEntityState(&cl.frame.ps, &ent->current);
     }
+
+    entity_deltas(ent);
 }
 
 // an entity has just been parsed that has an event value
@@ -324,6 +346,8 @@ void CL_DeltaFrame(void)
     int                 i, j;
     int                 framenum;
 
+    TD_START(TD_DELTAFRAME);
+
     // getting a valid frame message ends the connection process
     if (cls.state == ca_precached)
         set_active_state();
@@ -335,7 +359,8 @@ void CL_DeltaFrame(void)
     cl.keyservertime = (framenum / cl.framediv) * BASE_FRAMETIME;
 #endif
 
-    // rebuild the list of solid entities for this frame
+    // rebuild the lists of active and solid entities for this frame
+    cl.numActiveEntities = 0;
     cl.numSolidEntities = 0;
 
     // initialize position of the player's own entity from playerstate.
@@ -343,6 +368,7 @@ void CL_DeltaFrame(void)
     // server sends an effect referencing it's origin (such as MZ_LOGIN, etc)
     ent = &cl_entities[cl.frame.clientNum + 1];
     Com_PlayerToEntityState(&cl.frame.ps, &ent->current);
+    entity_deltas(ent);
 
     for (i = 0; i < cl.frame.numEntities; i++) {
         j = (cl.frame.firstEntity + i) & PARSE_ENTITIES_MASK;
@@ -376,9 +402,12 @@ void CL_DeltaFrame(void)
         player_update(&cl.oldkeyframe, &cl.keyframe, cl.framediv);
 #endif
 
+    CL_BuildClipList();
     CL_CheckPredictionError();
 
     SCR_SetCrosshairColor();
+
+    TD_STOP(TD_DELTAFRAME);
 }
 
 #ifdef _DEBUG
@@ -443,11 +472,10 @@ static void CL_AddPacketEntities(void)
 
     memset(&ent, 0, sizeof(ent));
 
-    for (pnum = 0; pnum < cl.frame.numEntities; pnum++) {
-        i = (cl.frame.firstEntity + pnum) & PARSE_ENTITIES_MASK;
-        s1 = &cl.entityStates[i];
-
-        cent = &cl_entities[s1->number];
+    for (pnum = 0; pnum < cl.numActiveEntities; pnum++) {
+        cent = cl.activeEntities[pnum];
+        s1 = &cent->current;
+        ent.id = s1->number;
 
         effects = s1->effects;
         renderfx = s1->renderfx;
@@ -517,8 +545,8 @@ static void CL_AddPacketEntities(void)
                 VectorCopy(cl.playerEntityOrigin, ent.oldorigin);
             } else {
                 // interpolate origin
-                LerpVector(cent->prev.origin, cent->current.origin,
-                           cl.lerpfrac, ent.origin);
+                VectorMA(cent->prev.origin, cl.lerpfrac,
+                         cent->origin_delta, ent.origin);
                 VectorCopy(ent.origin, ent.oldorigin);
             }
 
@@ -623,8 +651,8 @@ static void CL_AddPacketEntities(void)
         } else if (s1->number == cl.frame.clientNum + 1) {
             VectorCopy(cl.playerEntityAngles, ent.angles);      // use predicted angles
         } else { // interpolate angles
-            LerpAngles(cent->prev.angles, cent->current.angles,
-                       cl.lerpfrac, ent.angles);
+            VectorMA(cent->prev.angles, cl.lerpfrac,
+                     cent->angle_delta, ent.angles);
 
             // mimic original ref_gl "leaning" bug (uuugly!)
             if (s1->modelindex == 255 && cl_rollhack->integer) {
@@ -739,6 +767,7 @@ static void CL_AddPacketEntities(void)
                 }
             } else
                 ent.model = cl.model_draw[s1->modelindex2];
+            ent.id = s1->number + MAX_EDICTS;
 
             // PMM - check for the defender sphere shell .. make it translucent
             // replaces the previous version which used the high bit on modelindex2 to determine transparency
@@ -757,10 +786,12 @@ static void CL_AddPacketEntities(void)
         }
         if (s1->modelindex3) {
             ent.model = cl.model_draw[s1->modelindex3];
+            ent.id = s1->number + MAX_EDICTS * 2;
             V_AddEntity(&ent);
         }
         if (s1->modelindex4) {
             ent.model = cl.model_draw[s1->modelindex4];
+            ent.id = s1->number + MAX_EDICTS * 3;
             V_AddEntity(&ent);
         }
 
@@ -1284,7 +1315,7 @@ void CL_GetEntitySoundOrigin(int entnum, vec3_t org)
     // interpolate origin
     // FIXME: what should be the sound origin point for RF_BEAM entities?
     ent = &cl_entities[entnum];
-    LerpVector(ent->prev.origin, ent->current.origin, cl.lerpfrac, org);
+    VectorMA(ent->prev.origin, cl.lerpfrac, ent->origin_delta, org);
 
     // offset the origin for BSP models
     if (ent->current.solid == PACKED_BSP) {
@@ -18,11 +18,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "client.h"
 #include <curl/curl.h>
+#if USE_ZLIB
+#include <zlib.h>
+#endif
 
 static cvar_t  *cl_http_downloads;
 static cvar_t  *cl_http_filelists;
 static cvar_t  *cl_http_max_connections;
 static cvar_t  *cl_http_proxy;
+static cvar_t  *cl_http_multiplex;
 #ifdef _DEBUG
 static cvar_t  *cl_http_debug;
 #endif
@@ -31,18 +35,41 @@ static cvar_t  *cl_http_debug;
 #define MAX_DLSIZE  0x100000    // 1 MiB
 #define MIN_DLSIZE  0x8000      // 32 KiB
 
+// upper bound for cl_http_max_connections
+#define MAX_DLHANDLES   16
+
+// HTTP/2 multiplexing needs libcurl 7.43.0
+#if LIBCURL_VERSION_NUM >= 0x072b00
+#define USE_MULTIPLEX   1
+#else
+#define USE_MULTIPLEX   0
+#endif
+
+// manifest hash size, must be power of two
+#define MANIFEST_HASH   256
+
+typedef struct manifest_s {
+    struct manifest_s *next;
+    size_t      size;
+    unsigned    crc;
+    char        path[1];
+} manifest_t;
+
 typedef struct {
     CURL        *curl;
     char        path[MAX_OSPATH];
     FILE        *file;
     dlqueue_t   *queue;
+    manifest_t  *manifest;  // written directly to final path if set
+    unsigned    crc;
     size_t      size;
     size_t      position;
     char        url[576];
     char        *buffer;
 } dlhandle_t;
 
-static dlhandle_t   download_handles[4]; //actual download handles, don't raise this!
+static dlhandle_t   download_handles[MAX_DLHANDLES]; //actual download handles
+static manifest_t   *manifest_hash[MANIFEST_HASH];   //files listed by server manifest
 static char     download_server[512];    //base url prefix to download from
 static char     download_referer[32];    //libcurl requires a static string :(
 
@@ -64,6 +91,16 @@ latency links when small files such as textures are needed.
 Since CURL natively supports gzip content encoding, any files
 on the HTTP server should ideally be gzipped to conserve
 bandwidth.
+
+Easy handles are kept between files, and all of them share the
+connection cache of the multi handle, so consecutive files reuse
+established keep-alive connections. If the server speaks HTTP/2,
+parallel transfers are multiplexed over a single connection.
+
+Besides filelists, the server may provide a manifest listing size and
+CRC of each file. Missing and outdated files it lists are queued at
+once, and any file it lists is written straight to its final location
+and checked against the manifest when done.
 */
 
 // libcurl callback to update progress info.
@@ -119,6 +156,75 @@ oversize:
     return 0;
 }
 
+// libcurl callback for files listed in the manifest.
+static size_t write_func(void *ptr, size_t size, size_t nmemb, void *stream)
+{
+    dlhandle_t *dl = (dlhandle_t *)stream;
+    size_t bytes;
+
+    if (!nmemb)
+        return 0;
+
+    if (size > SIZE_MAX / nmemb)
+        return 0;
+
+    // abort early if the file grows past what manifest says
+    bytes = size * nmemb;
+    if (bytes > dl->manifest->size - dl->position) {
+        Com_DPrintf("[HTTP] Oversize file while trying to download '%s'\n", dl->url);
+        return 0;
+    }
+
+    if (fwrite(ptr, 1, bytes, dl->file) != bytes)
+        return 0;
+
+#if USE_ZLIB
+    dl->crc = crc32(dl->crc, ptr, bytes);
+#endif
+    dl->position += bytes;
+    return bytes;
+}
+
+// Checks a downloaded file against its manifest entry. Without zlib only the
+// size is checked.
+static qboolean verify_download(dlhandle_t *dl)
+{
+    if (dl->position != dl->manifest->size)
+        return qfalse;
+
+#if USE_ZLIB
+    if (dl->crc != dl->manifest->crc)
+        return qfalse;
+#endif
+
+    return qtrue;
+}
+
+static manifest_t *find_manifest(const char *path)
+{
+    manifest_t *m;
+
+    for (m = manifest_hash[FS_HashPath(path, MANIFEST_HASH)]; m; m = m->next)
+        if (!FS_pathcmp(m->path, path))
+            return m;
+
+    return NULL;
+}
+
+static void clear_manifest(void)
+{
+    manifest_t *m, *next;
+    int i;
+
+    for (i = 0; i < MANIFEST_HASH; i++) {
+        for (m = manifest_hash[i]; m; m = next) {
+            next = m->next;
+            Z_Free(m);
+        }
+        manifest_hash[i] = NULL;
+    }
+}
+
 #ifdef _DEBUG
 static int debug_func(CURL *c, curl_infotype type, char *data, size_t size, void *ptr)
 {
@@ -209,6 +315,45 @@ static const char *http_gamedir(void)
     return BASEGAME;
 }
 
+// Creates an easy handle and sets the options that never change between
+// files. The handle stays with its slot until downloads are cleaned up.
+static qboolean init_handle(dlhandle_t *dl)
+{
+    dl->curl = curl_easy_init();
+    if (!dl->curl)
+        return qfalse;
+
+    curl_easy_setopt(dl->curl, CURLOPT_ENCODING, "");
+#ifdef _DEBUG
+    if (cl_http_debug->integer) {
+        curl_easy_setopt(dl->curl, CURLOPT_DEBUGFUNCTION, debug_func);
+        curl_easy_setopt(dl->curl, CURLOPT_VERBOSE, 1);
+    }
+#endif
+    curl_easy_setopt(dl->curl, CURLOPT_NOPROGRESS, 0);
+    curl_easy_setopt(dl->curl, CURLOPT_FAILONERROR, 1);
+    curl_easy_setopt(dl->curl, CURLOPT_FOLLOWLOCATION, 1);
+    curl_easy_setopt(dl->curl, CURLOPT_MAXREDIRS, 5);
+    curl_easy_setopt(dl->curl, CURLOPT_PROGRESSFUNCTION, progress_func);
+    curl_easy_setopt(dl->curl, CURLOPT_PROGRESSDATA, dl);
+    curl_easy_setopt(dl->curl, CURLOPT_USERAGENT, com_version->string);
+    curl_easy_setopt(dl->curl, CURLOPT_REFERER, download_referer);
+#if USE_MULTIPLEX
+    if (cl_http_multiplex->integer) {
+        // ask for HTTP/2 (h2c upgrade, or prior knowledge if set to 2) and
+        // wait for the first connection to tell if it can be multiplexed
+        // instead of opening new ones right away
+        curl_easy_setopt(dl->curl, CURLOPT_HTTP_VERSION,
+                         cl_http_multiplex->integer > 1 ?
+                         CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE :
+                         CURL_HTTP_VERSION_2_0);
+        curl_easy_setopt(dl->curl, CURLOPT_PIPEWAIT, 1);
+    }
+#endif
+
+    return qtrue;
+}
+
 // Actually starts a download by adding it to the curl multi handle.
 static void start_download(dlqueue_t *entry, dlhandle_t *dl)
 {
@@ -218,6 +363,14 @@ static void start_download(dlqueue_t *entry, dlhandle_t *dl)
     CURLMcode ret;
     qerror_t err;
 
+    dl->manifest = NULL;
+    dl->crc = 0;
+
+    if (!dl->curl && !init_handle(dl)) {
+        Com_EPrintf("[HTTP] Failed to create download handle.\n");
+        goto fail;
+    }
+
     //yet another hack to accomodate filelists, how i wish i could push :(
     //NULL file handle indicates filelist.
     if (entry->type == DL_LIST) {
@@ -226,7 +379,13 @@ static void start_download(dlqueue_t *entry, dlhandle_t *dl)
         //filelist paths are absolute
         escape_path(entry->path, escaped);
     } else {
-        len = Q_snprintf(dl->path, sizeof(dl->path), "%s/%s.tmp", fs_gamedir, entry->path);
+        //files known from the manifest can be verified, so there is no need
+        //for a temporary file. paks are never opened half written though.
+        if (entry->type != DL_PAK)
+            dl->manifest = find_manifest(entry->path);
+
+        len = Q_snprintf(dl->path, sizeof(dl->path), "%s/%s%s", fs_gamedir,
+                         entry->path, dl->manifest ? "" : ".tmp");
         if (len >= sizeof(dl->path)) {
             Com_EPrintf("[HTTP] Refusing oversize temporary file path.\n");
             goto fail;
@@ -264,32 +423,20 @@ static void start_download(dlqueue_t *entry, dlhandle_t *dl)
     dl->size = 0;
     dl->position = 0;
     dl->queue = entry;
-    if (!dl->curl)
-        dl->curl = curl_easy_init();
-
-    curl_easy_setopt(dl->curl, CURLOPT_ENCODING, "");
-#ifdef _DEBUG
-    if (cl_http_debug->integer) {
-        curl_easy_setopt(dl->curl, CURLOPT_DEBUGFUNCTION, debug_func);
-        curl_easy_setopt(dl->curl, CURLOPT_VERBOSE, 1);
-    }
+    if (dl->manifest) {
+#if USE_ZLIB
+        dl->crc = crc32(0, NULL, 0);
 #endif
-    curl_easy_setopt(dl->curl, CURLOPT_NOPROGRESS, 0);
-    if (dl->file) {
+        curl_easy_setopt(dl->curl, CURLOPT_WRITEDATA, dl);
+        curl_easy_setopt(dl->curl, CURLOPT_WRITEFUNCTION, write_func);
+    } else if (dl->file) {
         curl_easy_setopt(dl->curl, CURLOPT_WRITEDATA, dl->file);
         curl_easy_setopt(dl->curl, CURLOPT_WRITEFUNCTION, NULL);
     } else {
         curl_easy_setopt(dl->curl, CURLOPT_WRITEDATA, dl);
         curl_easy_setopt(dl->curl, CURLOPT_WRITEFUNCTION, recv_func);
     }
-    curl_easy_setopt(dl->curl, CURLOPT_FAILONERROR, 1);
     curl_easy_setopt(dl->curl, CURLOPT_PROXY, cl_http_proxy->string);
-    curl_easy_setopt(dl->curl, CURLOPT_FOLLOWLOCATION, 1);
-    curl_easy_setopt(dl->curl, CURLOPT_MAXREDIRS, 5);
-    curl_easy_setopt(dl->curl, CURLOPT_PROGRESSFUNCTION, progress_func);
-    curl_easy_setopt(dl->curl, CURLOPT_PROGRESSDATA, dl);
-    curl_easy_setopt(dl->curl, CURLOPT_USERAGENT, com_version->string);
-    curl_easy_setopt(dl->curl, CURLOPT_REFERER, download_referer);
     curl_easy_setopt(dl->curl, CURLOPT_URL, dl->url);
 
     ret = curl_multi_add_handle(curl_multi, dl->curl);
@@ -380,7 +527,7 @@ void HTTP_CleanupDownloads(void)
     download_referer[0] = 0;
     curl_handles = 0;
 
-    for (i = 0; i < 4; i++) {
+    for (i = 0; i < MAX_DLHANDLES; i++) {
         dl = &download_handles[i];
 
         if (dl->file) {
@@ -402,8 +549,11 @@ void HTTP_CleanupDownloads(void)
         }
 
         dl->queue = NULL;
+        dl->manifest = NULL;
     }
 
+    clear_manifest();
+
     if (curl_multi) {
         curl_multi_cleanup(curl_multi);
         curl_multi = NULL;
@@ -422,9 +572,9 @@ void HTTP_Init(void)
 {
     cl_http_downloads = Cvar_Get("cl_http_downloads", "1", 0);
     cl_http_filelists = Cvar_Get("cl_http_filelists", "1", 0);
-    cl_http_max_connections = Cvar_Get("cl_http_max_connections", "2", 0);
-    //cl_http_max_connections->changed = _cl_http_max_connections_changed;
+    cl_http_max_connections = Cvar_Get("cl_http_max_connections", "4", 0);
     cl_http_proxy = Cvar_Get("cl_http_proxy", "", 0);
+    cl_http_multiplex = Cvar_Get("cl_http_multiplex", "1", 0);
 #ifdef _DEBUG
     cl_http_debug = Cvar_Get("cl_http_debug", "0", 0);
 #endif
@@ -474,6 +624,13 @@ void HTTP_SetServer(const char *url)
 
     curl_multi = curl_multi_init();
 
+    // keep idle connections around for the following files
+    curl_multi_setopt(curl_multi, CURLMOPT_MAXCONNECTS, (long)MAX_DLHANDLES);
+#if USE_MULTIPLEX
+    if (cl_http_multiplex->integer)
+        curl_multi_setopt(curl_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
     Q_strlcpy(download_server, url, sizeof(download_server));
     Q_snprintf(download_referer, sizeof(download_referer),
                "quake2://%s", NET_AdrToString(&cls.serverAddress));
@@ -512,7 +669,11 @@ qerror_t HTTP_QueueDownload(const char *path, dltype_t type)
         return Q_ERR_SUCCESS;
 
     if (need_list) {
-        //grab the filelist
+        //grab the manifest, then the filelist
+        len = Q_snprintf(temp, sizeof(temp), "%s.manifest", http_gamedir());
+        if (len < sizeof(temp))
+            CL_QueueDownload(temp, DL_LIST);
+
         len = Q_snprintf(temp, sizeof(temp), "%s.filelist", http_gamedir());
         if (len < sizeof(temp))
             CL_QueueDownload(temp, DL_LIST);
@@ -537,8 +698,9 @@ qerror_t HTTP_QueueDownload(const char *path, dltype_t type)
     return Q_ERR_SUCCESS;
 }
 
-// Validate a path supplied by a filelist.
-static void check_and_queue_download(char *path)
+// Validate a path supplied by a filelist or manifest. Returns normalized path
+// with any '@' prefix stripped, or NULL if the path is not acceptable.
+static char *check_list_path(char *path, dltype_t *type_p, unsigned *flags_p)
 {
     size_t      len;
     char        *ext;
@@ -548,15 +710,15 @@ static void check_and_queue_download(char *path)
 
     len = strlen(path);
     if (len >= MAX_QPATH)
-        return;
+        return NULL;
 
     ext = strrchr(path, '.');
     if (!ext)
-        return;
+        return NULL;
 
     ext++;
     if (!ext[0])
-        return;
+        return NULL;
 
     Q_strlwr(ext);
 
@@ -567,14 +729,14 @@ static void check_and_queue_download(char *path)
         type = DL_OTHER;
         if (!CL_CheckDownloadExtension(ext)) {
             Com_WPrintf("[HTTP] Illegal file type '%s' in filelist.\n", path);
-            return;
+            return NULL;
         }
     }
 
     if (path[0] == '@') {
         if (type == DL_PAK) {
             Com_WPrintf("[HTTP] '@' prefix used on a pak file '%s' in filelist.\n", path);
-            return;
+            return NULL;
         }
         flags = FS_PATH_GAME;
         path++;
@@ -588,7 +750,7 @@ static void check_and_queue_download(char *path)
 
     len = FS_NormalizePath(path, path);
     if (len == 0)
-        return;
+        return NULL;
 
     valid = FS_ValidatePath(path);
 
@@ -599,19 +761,139 @@ static void check_and_queue_download(char *path)
         (type == DL_OTHER && !strchr(path, '/')) ||
         (type == DL_PAK && strchr(path, '/'))) {
         Com_WPrintf("[HTTP] Illegal path '%s' in filelist.\n", path);
-        return;
+        return NULL;
     }
 
+    if (valid == PATH_MIXED_CASE)
+        Q_strlwr(path);
+
+    *type_p = type;
+    *flags_p = flags;
+    return path;
+}
+
+static void check_and_queue_download(char *path)
+{
+    dltype_t    type;
+    unsigned    flags;
+
+    path = check_list_path(path, &type, &flags);
+    if (!path)
+        return;
+
     if (FS_FileExistsEx(path, flags))
         return;
 
-    if (valid == PATH_MIXED_CASE)
-        Q_strlwr(path);
+    if (CL_IgnoreDownload(path))
+        return;
+
+    CL_QueueDownload(path, type);
+}
+
+// Splits the next whitespace separated field off the line.
+static char *next_field(char **line)
+{
+    char *s = *line, *start;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    start = s;
+    while (*s && *s != ' ' && *s != '\t')
+        s++;
+    if (*s)
+        *s++ = 0;
+
+    *line = s;
+    return start;
+}
+
+// Parse one "<path> <size> <crc>" manifest line, remember the entry and queue
+// the file if it is missing or differs in size from the copy we have.
+static void check_manifest_entry(char *line)
+{
+    char        *path, *s, *end;
+    dltype_t    type;
+    unsigned    flags;
+    unsigned long size, crc;
+    ssize_t     have;
+    manifest_t  *m;
+    size_t      len;
+
+    path = next_field(&line);
+    if (!*path || *path == '#')
+        return;
+
+    s = next_field(&line);
+    size = strtoul(s, &end, 10);
+    if (!*s || *end)
+        goto bad;
+
+    s = next_field(&line);
+    crc = strtoul(s, &end, 16);
+    if (!*s || *end || *next_field(&line))
+        goto bad;
+
+    path = check_list_path(path, &type, &flags);
+    if (!path)
+        return;
+
+    if (!find_manifest(path)) {
+        len = strlen(path);
+        m = Z_Malloc(sizeof(*m) + len);
+        memcpy(m->path, path, len + 1);
+        m->size = size;
+        m->crc = crc;
+        m->next = manifest_hash[FS_HashPath(path, MANIFEST_HASH)];
+        manifest_hash[FS_HashPath(path, MANIFEST_HASH)] = m;
+    }
+
+    have = FS_LoadFileEx(path, NULL, flags, TAG_FREE);
+    if (have >= 0) {
+        if (have == size)
+            return;
+
+        //only loose files can be replaced by downloading
+        if (type == DL_PAK || FS_FileExistsEx(path, flags | FS_TYPE_PAK))
+            return;
+
+        Com_DPrintf("[HTTP] '%s' is outdated, have %"PRIz" bytes, need %lu\n",
+                    path, (size_t)have, size);
+    } else if (have != Q_ERR_NOENT) {
+        return;
+    }
 
     if (CL_IgnoreDownload(path))
         return;
 
     CL_QueueDownload(path, type);
+    return;
+
+bad:
+    Com_WPrintf("[HTTP] Malformed line for '%s' in manifest.\n", path);
+}
+
+// A manifest is in memory, diff it against the filesystem in one pass.
+static void parse_manifest(dlhandle_t *dl)
+{
+    char    *list;
+    char    *p;
+
+    if (cl_http_filelists->integer && dl->buffer) {
+        list = dl->buffer;
+        do {
+            p = strchr(list, '\n');
+            if (p) {
+                if (p > list && *(p - 1) == '\r')
+                    *(p - 1) = 0;
+                *p++ = 0;
+            }
+            check_manifest_entry(list);
+            list = p;
+        } while (list);
+    }
+
+    Z_Free(dl->buffer);
+    dl->buffer = NULL;
 }
 
 // A filelist is in memory, scan and validate it and queue up the files.
@@ -683,7 +965,7 @@ static dlhandle_t *find_handle(CURL *curl)
     size_t      i;
     dlhandle_t  *dl;
 
-    for (i = 0; i < 4; i++) {
+    for (i = 0; i < MAX_DLHANDLES; i++) {
         dl = &download_handles[i];
         if (dl->curl == curl) {
             return dl;
@@ -741,7 +1023,12 @@ static qboolean finish_download(void)
         case CURLE_OK:
             curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
             if (result == CURLE_OK && response == 200) {
-                //success
+                //success, unless it doesn't match the manifest
+                if (dl->manifest && !verify_download(dl)) {
+                    err = "size or CRC mismatch";
+                    level = PRINT_WARNING;
+                    goto fail1;
+                }
                 break;
             }
 
@@ -819,10 +1106,11 @@ fail2:
             //rename the temp file
             Q_snprintf(temp, sizeof(temp), "%s/%s", fs_gamedir, dl->queue->path);
 
-            if (rename(dl->path, temp))
+            if (!dl->manifest && rename(dl->path, temp))
                 Com_EPrintf("[HTTP] Failed to rename '%s' to '%s': %s\n",
                             dl->path, dl->queue->path, strerror(errno));
             dl->path[0] = 0;
+            FS_InvalidateIndex();
 
             //a pak file is very special...
             if (dl->queue->type == DL_PAK) {
@@ -830,7 +1118,10 @@ fail2:
                 rescan_queue();
             }
         } else if (!fatal_error) {
-            parse_file_list(dl);
+            if (COM_CompareExtension(dl->queue->path, ".manifest"))
+                parse_file_list(dl);
+            else
+                parse_manifest(dl);
         }
     } while (msgs_in_queue > 0);
 
@@ -851,7 +1142,7 @@ static dlhandle_t *get_free_handle(void)
     dlhandle_t  *dl;
     int         i;
 
-    for (i = 0; i < 4; i++) {
+    for (i = 0; i < MAX_DLHANDLES; i++) {
         dl = &download_handles[i];
         if (!dl->queue || dl->queue->state == DL_DONE)
             return dl;
@@ -860,27 +1151,75 @@ static dlhandle_t *get_free_handle(void)
     return NULL;
 }
 
-// Start another HTTP download if possible.
-static void start_next_download(void)
+// Lower values are fetched first. The map is needed before anything else can
+// be loaded, filelists may queue more files, and textures are what the player
+// sees right after spawning.
+static int download_priority(const dlqueue_t *q)
 {
-    dlqueue_t   *q;
-
-    if (!cls.download.pending || curl_handles >= cl_http_max_connections->integer) {
-        return;
+    switch (q->type) {
+    case DL_MAP:
+        return 0;
+    case DL_LIST:
+        return 1;
+    case DL_OTHER:
+        if (!Q_strncasecmp(q->path, "textures/", 9))
+            return 2;
+        return 4;
+    case DL_MODEL:
+        return 3;
+    default:
+        return 5;
     }
+}
+
+// Pick the pending queue entry to start next, earliest of the best priority.
+static dlqueue_t *next_pending(void)
+{
+    dlqueue_t   *q, *best = NULL;
+    int         prio, best_prio = INT_MAX;
 
-    //not enough downloads running, queue some more!
     FOR_EACH_DLQ(q) {
         if (q->state == DL_RUNNING) {
             if (q->type == DL_PAK)
-                break; // hack for pak file single downloading
+                return NULL; // hack for pak file single downloading
         } else if (q->state == DL_PENDING) {
-            dlhandle_t *dl = get_free_handle();
-            if (dl)
-                start_download(q, dl);
-            break;
+            prio = download_priority(q);
+            if (prio < best_prio) {
+                best_prio = prio;
+                best = q;
+            }
         }
     }
+
+    return best;
+}
+
+// Start more HTTP downloads until the connection limit is reached.
+static void start_next_download(void)
+{
+    dlqueue_t   *q;
+    dlhandle_t  *dl;
+    int         max_handles;
+
+    max_handles = Cvar_ClampInteger(cl_http_max_connections, 1, MAX_DLHANDLES);
+
+    //not enough downloads running, queue some more!
+    while (cls.download.pending && curl_handles < max_handles) {
+        q = next_pending();
+        if (!q)
+            break;
+
+        dl = get_free_handle();
+        if (!dl)
+            break;
+
+        start_download(q, dl);
+        if (q->state != DL_RUNNING)
+            break; // failed, CL_RequestNextDownload may have changed things
+
+        if (q->type == DL_PAK)
+            break;
+    }
 }
 
 /*
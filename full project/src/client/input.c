@@ -29,6 +29,7 @@ static cvar_t    *cl_showpackets;
 #endif
 static cvar_t    *cl_instantpacket;
 static cvar_t    *cl_batchcmds;
+static cvar_t    *cl_subframes;
 
 static cvar_t    *m_filter;
 static cvar_t    *m_accel;
@@ -801,6 +802,7 @@ void CL_RegisterInput(void)
 #endif
     cl_instantpacket = Cvar_Get("cl_instantpacket", "1", 0);
     cl_batchcmds = Cvar_Get("cl_batchcmds", "1", 0);
+    cl_subframes = Cvar_Get("cl_subframes", "0", 0);
 
     cl_upspeed = Cvar_Get("cl_upspeed", "200", 0);
     cl_forwardspeed = Cvar_Get("cl_forwardspeed", "200", 0);
@@ -824,17 +826,72 @@ void CL_RegisterInput(void)
     m_autosens = Cvar_Get("m_autosens", "0", 0);
 }
 
+/*
+=================
+CL_StoreCmd
+
+Saves pending command off for prediction and sending. A command spanning
+several physics frames is split into one command per frame, with view angles
+interpolated from the previous command, so that a slow rendering frame doesn't
+collapse into a single coarse move. Only done when the commands can be
+batched, otherwise some of them would never reach the server.
+=================
+*/
+static int CL_StoreCmd(int subframe)
+{
+    usercmd_t *cmd;
+    short angles[3], delta[3];
+    int i, j, count, room;
+
+    count = 1;
+    if (subframe > 0 && cl_subframes->integer > 1 &&
+        cls.serverProtocol == PROTOCOL_VERSION_Q2PRO && cl_batchcmds->integer) {
+        count = min(cl.cmd.msec / subframe, cl_subframes->integer);
+        room = MAX_PACKET_USERCMDS - 1 - (cl.cmdNumber - cl.lastTransmitCmdNumber);
+        count = min(count, room);
+    }
+
+    if (count > 1) {
+        cmd = &cl.cmds[cl.cmdNumber & CMD_MASK];
+        for (j = 0; j < 3; j++) {
+            angles[j] = cmd->angles[j];
+            delta[j] = cl.cmd.angles[j] - angles[j];
+        }
+
+        for (i = 1; i < count; i++) {
+            cl.cmdNumber++;
+            cmd = &cl.cmds[cl.cmdNumber & CMD_MASK];
+            *cmd = cl.cmd;
+            cmd->msec = subframe;
+            cmd->impulse = 0;
+            for (j = 0; j < 3; j++) {
+                cmd->angles[j] = angles[j] + delta[j] * i / count;
+            }
+        }
+
+        cl.cmd.msec -= subframe * (count - 1);
+    }
+
+    cl.cmdNumber++;
+    cl.cmds[cl.cmdNumber & CMD_MASK] = cl.cmd;
+
+    return count;
+}
+
 /*
 =================
 CL_FinalizeCmd
 
 Builds the actual movement vector for sending to server. Assumes that msec
-and angles are already set for this frame by CL_UpdateCmd.
+and angles are already set for this frame by CL_UpdateCmd. Subframe is the
+physics frame length when running asynchronous, zero otherwise. Returns the
+number of physics frames covered.
 =================
 */
-void CL_FinalizeCmd(void)
+int CL_FinalizeCmd(int subframe)
 {
     vec3_t move;
+    int count;
 
     // command buffer ticks in sync with cl_maxfps
     if (cmd_buffer.waitCount > 0) {
@@ -845,11 +902,11 @@ void CL_FinalizeCmd(void)
     }
 
     if (cls.state < ca_active) {
-        return; // not talking to a server
+        return 1; // not talking to a server
     }
 
     if (sv_paused->integer) {
-        return;
+        return 1;
     }
 
 //
@@ -912,11 +969,12 @@ void CL_FinalizeCmd(void)
     in_impulse = 0;
 
     // save this command off for prediction
-    cl.cmdNumber++;
-    cl.cmds[cl.cmdNumber & CMD_MASK] = cl.cmd;
+    count = CL_StoreCmd(subframe);
 
     // clear pending cmd
     memset(&cl.cmd, 0, sizeof(cl.cmd));
+
+    return count;
 }
 
 static inline qboolean ready_to_send(void)
@@ -2392,6 +2392,7 @@ void CL_RestartRefresh(qboolean total)
     } else if (cls_state >= ca_loading) {
         CL_LoadState(LOAD_MAP);
         CL_PrepRefresh();
+        FS_FlushPrefetch();
         CL_LoadState(LOAD_FINISH);
     }
 
@@ -2712,6 +2713,18 @@ static void CL_InitLocal(void)
     Cmd_AddMacro("cl_weaponmodel", CL_WeaponModel_m);
 }
 
+/*
+==================
+CL_Connected
+
+Renderer tools that would replace the world model check this first.
+==================
+*/
+qboolean CL_Connected(void)
+{
+    return cls.state >= ca_connected;
+}
+
 /*
 ==================
 CL_CheatsOK
@@ -3158,8 +3171,7 @@ unsigned CL_Frame(unsigned msec)
     // finalize pending cmd
     phys_frame |= cl.sendPacketNow;
     if (phys_frame) {
-        CL_FinalizeCmd();
-        phys_extra -= phys_msec;
+        phys_extra -= phys_msec * CL_FinalizeCmd(phys_msec);
         M_FRAMES++;
 
         // don't let the time go too far off
@@ -3194,7 +3206,9 @@ unsigned CL_Frame(unsigned msec)
 
 run_fx:
         // update audio after the 3D view was drawn
+        PROF_Begin(PROF_SOUND_UPDATE);
         S_Update();
+        PROF_End(PROF_SOUND_UPDATE);
 
         // advance local effects for next frame
 #if USE_DLIGHTS
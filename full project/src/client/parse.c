@@ -185,6 +185,41 @@ static void CL_ParsePacketEntities(server_frame_t *oldframe,
     }
 }
 
+// makes a parsed frame current
+static void CL_SetFrame(server_frame_t *frame)
+{
+    if (!frame->valid) {
+        cl.frame.valid = qfalse;
+#if USE_FPS
+        cl.keyframe.valid = qfalse;
+#endif
+        return; // do not change anything
+    }
+
+    if (!frame->ps.fov) {
+        // fail out early to prevent spurious errors later
+        Com_Error(ERR_DROP, "%s: bad fov", __func__);
+    }
+
+    if (cls.state < ca_precached)
+        return;
+
+    cl.oldframe = cl.frame;
+    cl.frame = *frame;
+
+#if USE_FPS
+    if (CL_FRAMESYNC) {
+        cl.oldkeyframe = cl.keyframe;
+        cl.keyframe = cl.frame;
+    }
+#endif
+
+    cls.demo.frames_read++;
+
+    if (!cls.demo.seeking)
+        CL_DeltaFrame();
+}
+
 static void CL_ParseFrame(int extrabits)
 {
     uint32_t bits, extraflags;
@@ -365,36 +400,96 @@ static void CL_ParseFrame(int extrabits)
     }
 #endif
 
-    if (!frame.valid) {
-        cl.frame.valid = qfalse;
-#if USE_FPS
-        cl.keyframe.valid = qfalse;
-#endif
-        return; // do not change anything
+    CL_SetFrame(&frame);
+}
+
+/*
+==================
+CL_ParseLoopFrame
+
+Local server hands over its frame instead of delta compressing it. Old
+origins are shuffled the way parsing an optimized Q2PRO frame would.
+==================
+*/
+static void CL_ParseLoopFrame(void)
+{
+    static loopframe_t  loop;
+    server_frame_t      frame, *oldframe;
+    entity_state_t      *state, *oldstate;
+    const entity_packed_t *ent;
+    int     i, suppressed, oldindex;
+
+    if (!cls.netchan || cls.netchan->remote_address.type != NA_LOOPBACK) {
+        Com_Error(ERR_DROP, "%s: not on loopback", __func__);
     }
 
-    if (!frame.ps.fov) {
-        // fail out early to prevent spurious errors later
-        Com_Error(ERR_DROP, "%s: bad fov", __func__);
+    memset(&frame, 0, sizeof(frame));
+
+    frame.number = MSG_ReadLong();
+    suppressed = MSG_ReadByte();
+    if (suppressed & FF_CLIENTPRED) {
+        // CLIENTDROP is implied, don't draw both
+        suppressed &= ~FF_CLIENTDROP;
     }
+    cl.frameflags = suppressed;
 
-    if (cls.state < ca_precached)
+    if (!SV_GetLoopFrame(frame.number, &loop)) {
+        // server has built too many frames since, wait for the next one
+        Com_DPrintf("%s: frame %d is gone\n", __func__, frame.number);
+        cl.frameflags |= FF_OLDFRAME;
         return;
+    }
 
-    cl.oldframe = cl.frame;
-    cl.frame = frame;
+    if (cl.frame.valid) {
+        oldframe = &cl.frame;
+        frame.delta = oldframe->number;
+    } else {
+        oldframe = NULL;
+        frame.delta = -1;
+        cl.frameflags |= FF_NODELTA;
+    }
+    frame.valid = qtrue;
 
-#if USE_FPS
-    if (CL_FRAMESYNC) {
-        cl.oldkeyframe = cl.keyframe;
-        cl.keyframe = cl.frame;
+    frame.areabytes = loop.areabytes;
+    memcpy(frame.areabits, loop.areabits, loop.areabytes);
+    MSG_UnpackPlayer(&frame.ps, &loop.ps);
+    frame.clientNum = loop.clientNum;
+
+    frame.firstEntity = cl.numEntityStates;
+    frame.numEntities = loop.num_entities;
+
+    oldindex = 0;
+    for (i = 0; i < loop.num_entities; i++) {
+        ent = &loop.entities[i];
+        state = &cl.entityStates[cl.numEntityStates & PARSE_ENTITIES_MASK];
+        cl.numEntityStates++;
+        MSG_UnpackEntity(state, ent);
+
+        // find the same entity in the previous frame
+        oldstate = NULL;
+        while (oldframe && oldindex < oldframe->numEntities) {
+            oldstate = &cl.entityStates[(oldframe->firstEntity + oldindex) & PARSE_ENTITIES_MASK];
+            if (oldstate->number >= ent->number) {
+                break;
+            }
+            oldindex++;
+            oldstate = NULL;
+        }
+        if (!oldstate || oldstate->number != ent->number) {
+            continue;   // new entities keep old_origin server gave them
+        }
+        if (state->renderfx & (RF_BEAM | RF_FRAMELERP)) {
+            continue;
+        }
+        if (loop.oldorigins && ent->number <= cl.maxclients) {
+            continue;
+        }
+        VectorCopy(oldstate->origin, state->old_origin);
     }
-#endif
 
-    cls.demo.frames_read++;
+    cl.frames[frame.number & UPDATE_MASK] = frame;
 
-    if (!cls.demo.seeking)
-        CL_DeltaFrame();
+    CL_SetFrame(&frame);
 }
 
 /*
@@ -1027,10 +1122,13 @@ static void CL_ParseInventory(void)
     }
 }
 
-static void CL_ParseDownload(void)
+static void CL_ParseDownload(int cmd)
 {
-    int size, percent;
+    int size, percent, decompressed_size;
     byte *data;
+#if USE_ZLIB
+    byte buffer[MAX_MSGLEN];
+#endif
 
     if (!cls.download.temp[0]) {
         Com_Error(ERR_DROP, "%s: no download requested", __func__);
@@ -1048,6 +1146,18 @@ static void CL_ParseDownload(void)
         Com_Error(ERR_DROP, "%s: bad size: %d", __func__, size);
     }
 
+    decompressed_size = 0;
+    if (cmd == svc_zdownload) {
+        decompressed_size = MSG_ReadShort();
+
+        // server accepted the stream request, chunks follow without nextdl
+        if (!size && !decompressed_size) {
+            if (cls.download.current)
+                cls.download.stream = qtrue;
+            return;
+        }
+    }
+
     if (msg_read.readcount + size > msg_read.cursize) {
         Com_Error(ERR_DROP, "%s: read past end of message", __func__);
     }
@@ -1055,19 +1165,38 @@ static void CL_ParseDownload(void)
     data = msg_read.data + msg_read.readcount;
     msg_read.readcount += size;
 
+    // streamed chunks are deflated one by one
+    if (cmd == svc_zdownload) {
+#if USE_ZLIB
+        if (decompressed_size < 0 || decompressed_size > MAX_MSGLEN) {
+            Com_Error(ERR_DROP, "%s: bad decompressed size: %d", __func__, decompressed_size);
+        }
+
+        inflateReset(&cls.z);
+        cls.z.next_in = data;
+        cls.z.avail_in = (uInt)size;
+        cls.z.next_out = buffer;
+        cls.z.avail_out = (uInt)decompressed_size;
+        if (inflate(&cls.z, Z_FINISH) != Z_STREAM_END || cls.z.total_out != decompressed_size) {
+            Com_Error(ERR_DROP, "%s: inflate() failed: %s", __func__, cls.z.msg);
+        }
+
+        data = buffer;
+        size = decompressed_size;
+#else
+        Com_Error(ERR_DROP, "Compressed server packet received, "
+                  "but no zlib support linked in.");
+#endif
+    }
+
     CL_HandleDownload(data, size, percent);
 }
 
-static void CL_ParseZPacket(void)
-{
 #if USE_ZLIB
-    sizebuf_t   temp;
-    byte        buffer[MAX_MSGLEN];
-    int         inlen, outlen;
-
-    if (msg_read.data != msg_read_buffer) {
-        Com_Error(ERR_DROP, "%s: recursively entered", __func__);
-    }
+// inflates one zpacket into the buffer at the given offset
+static int inflate_zpacket(byte *buffer, int offset)
+{
+    int inlen, outlen;
 
     inlen = MSG_ReadWord();
     outlen = MSG_ReadWord();
@@ -1076,15 +1205,20 @@ static void CL_ParseZPacket(void)
         Com_Error(ERR_DROP, "%s: read past end of message", __func__);
     }
 
-    if (outlen > MAX_MSGLEN) {
+    if (outlen > MAX_MSGLEN - offset) {
         Com_Error(ERR_DROP, "%s: invalid output length", __func__);
     }
 
+    // stream state and window are kept in cls.z, only reset here
     inflateReset(&cls.z);
+    if (cls.serverProtocol == PROTOCOL_VERSION_Q2PRO &&
+        cls.protocolVersion >= PROTOCOL_VERSION_Q2PRO_ZLIB_DICT) {
+        inflateSetDictionary(&cls.z, (const Bytef *)zdict_data, (uInt)zdict_size);
+    }
 
     cls.z.next_in = msg_read.data + msg_read.readcount;
     cls.z.avail_in = (uInt)inlen;
-    cls.z.next_out = buffer;
+    cls.z.next_out = buffer + offset;
     cls.z.avail_out = (uInt)outlen;
     if (inflate(&cls.z, Z_FINISH) != Z_STREAM_END) {
         Com_Error(ERR_DROP, "%s: inflate() failed: %s", __func__, cls.z.msg);
@@ -1092,9 +1226,53 @@ static void CL_ParseZPacket(void)
 
     msg_read.readcount += inlen;
 
+    return outlen;
+}
+
+// returns true if the next command is a zpacket that fits after `total'
+static qboolean next_zpacket_fits(int total)
+{
+    const byte *p = msg_read.data + msg_read.readcount;
+
+    if (msg_read.readcount + 5 > msg_read.cursize) {
+        return qfalse;
+    }
+    if (p[0] != svc_zpacket) {
+        return qfalse;
+    }
+
+    return ((p[3] | (p[4] << 8)) <= MAX_MSGLEN - total);
+}
+#endif
+
+/*
+==================
+CL_ParseZPacket
+
+Runs of consecutive zpackets, common during gamestate and in MVD streams,
+are inflated back to back and parsed as a single message.
+==================
+*/
+static void CL_ParseZPacket(void)
+{
+#if USE_ZLIB
+    static byte buffer[MAX_MSGLEN];
+    sizebuf_t   temp;
+    int         total;
+
+    if (msg_read.data != msg_read_buffer) {
+        Com_Error(ERR_DROP, "%s: recursively entered", __func__);
+    }
+
+    total = inflate_zpacket(buffer, 0);
+    while (next_zpacket_fits(total)) {
+        msg_read.readcount++;
+        total += inflate_zpacket(buffer, total);
+    }
+
     temp = msg_read;
-    SZ_Init(&msg_read, buffer, outlen);
-    msg_read.cursize = outlen;
+    SZ_Init(&msg_read, buffer, total);
+    msg_read.cursize = total;
 
     CL_ParseServerMessage();
 
@@ -1157,6 +1335,8 @@ void CL_ParseServerMessage(void)
     size_t      readcount;
     int         index, bits;
 
+    PROF_Begin(PROF_PARSE_MESSAGE);
+
 #ifdef _DEBUG
     if (cl_shownet->integer == 1) {
         Com_LPrintf(PRINT_DEVELOPER, "%"PRIz" ", msg_read.cursize);
@@ -1205,6 +1385,7 @@ badbyte:
 
         case svc_reconnect:
             CL_ParseReconnect();
+            PROF_End(PROF_PARSE_MESSAGE);
             return;
 
         case svc_print:
@@ -1254,7 +1435,14 @@ badbyte:
             break;
 
         case svc_download:
-            CL_ParseDownload();
+            CL_ParseDownload(cmd);
+            continue;
+
+        case svc_zdownload:
+            if (cls.serverProtocol < PROTOCOL_VERSION_R1Q2) {
+                goto badbyte;
+            }
+            CL_ParseDownload(cmd);
             continue;
 
         case svc_frame:
@@ -1289,6 +1477,13 @@ badbyte:
             }
             CL_ParseSetting();
             continue;
+
+        case svc_loopframe:
+            if (cls.serverProtocol != PROTOCOL_VERSION_Q2PRO) {
+                goto badbyte;
+            }
+            CL_ParseLoopFrame();
+            continue;
         }
 
         // if recording demos, copy off protocol invariant stuff
@@ -1414,4 +1609,6 @@ void CL_SeekDemoMessage(void)
 
         }
     }
+
+    PROF_End(PROF_PARSE_MESSAGE);
 }
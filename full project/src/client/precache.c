@@ -236,13 +236,30 @@ void CL_LoadState(load_state_t state)
 /*
 =================
 CL_RegisterSounds
+
+Registered last, so this also drops anything prefetched by precache checks
+and CL_PrepRefresh that wasn't used.
 =================
 */
 void CL_RegisterSounds(void)
 {
+    char    path[MAX_QPATH];
     int i;
     char    *s;
 
+    // let the filesystem start inflating them
+    for (i = 1; i < MAX_SOUNDS; i++) {
+        s = cl.configstrings[CS_SOUNDS + i];
+        if (!s[0])
+            break;
+        if (*s == '*')
+            continue;
+        if (*s == '#')
+            FS_Prefetch(s + 1);
+        else if (Q_concat(path, sizeof(path), "sound/", s, NULL) < sizeof(path))
+            FS_Prefetch(path);
+    }
+
     S_BeginRegistration();
     CL_RegisterTEntSounds();
     for (i = 1; i < MAX_SOUNDS; i++) {
@@ -252,6 +269,8 @@ void CL_RegisterSounds(void)
         cl.sound_precache[i] = S_RegisterSound(s);
     }
     S_EndRegistration();
+
+    FS_FlushPrefetch();
 }
 
 /*
@@ -356,11 +375,57 @@ void CL_SetSky(void)
     R_SetSky(cl.configstrings[CS_SKY], rotate, axis);
 }
 
+/*
+=================
+CL_PrefetchMedia
+
+Lets the filesystem start inflating files about to be registered,
+in the order CL_PrepRefresh will ask for them.
+=================
+*/
+static void CL_PrefetchMedia(void)
+{
+    char    path[MAX_QPATH];
+    char    *name;
+    int     i;
+
+    if (cl.bsp) {
+        for (i = 0; i < cl.bsp->numtexinfo; i++) {
+            if (Q_concat(path, sizeof(path), "textures/", cl.bsp->texinfo[i].name, ".wal", NULL) < sizeof(path))
+                FS_Prefetch(path);
+        }
+    }
+
+    for (i = 2; i < MAX_MODELS; i++) {
+        name = cl.configstrings[CS_MODELS + i];
+        if (!name[0]) {
+            break;
+        }
+        if (name[0] != '#' && name[0] != '*') {
+            FS_Prefetch(name);
+        }
+    }
+
+    for (i = 1; i < MAX_IMAGES; i++) {
+        name = cl.configstrings[CS_IMAGES + i];
+        if (!name[0]) {
+            break;
+        }
+        if (name[0] == '/' || name[0] == '\\') {
+            FS_Prefetch(name + 1);
+        } else if (Q_concat(path, sizeof(path), "pics/", name, NULL) < sizeof(path) &&
+                   COM_DefaultExtension(path, ".pcx", sizeof(path)) < sizeof(path)) {
+            FS_Prefetch(path);
+        }
+    }
+}
+
 /*
 =================
 CL_PrepRefresh
 
-Call before entering a new level, or after changing dlls
+Call before entering a new level, or after changing dlls. Files prefetched
+for it are kept around for CL_RegisterSounds, which flushes them.
 =================
 */
 void CL_PrepRefresh(void)
@@ -373,6 +438,8 @@ void CL_PrepRefresh(void)
     if (!cl.mapname[0])
         return;     // no map loaded
 
+    CL_PrefetchMedia();
+
     // register models, pics, and skins
     R_BeginRegistration(cl.mapname);
 
@@ -434,6 +501,9 @@ void CL_UpdateConfigstring(int index)
 {
     const char *s = cl.configstrings[index];
 
+    // retained HUD spans may show this string
+    cl.csserial++;
+
     if (index == CS_MAXCLIENTS) {
         cl.maxclients = atoi(s);
         return;
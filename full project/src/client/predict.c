@@ -75,41 +75,190 @@ void CL_CheckPredictionError(void)
     }
 }
 
+static int CL_ClipCell(vec_t v, int axis)
+{
+    v = (v - cl.clipGridOrigin[axis]) * cl.clipGridScale[axis];
+    if (v < 0)
+        return 0;
+    if (v > CLIP_GRID_SIZE - 1)
+        return CLIP_GRID_SIZE - 1;
+    return (int)v;
+}
+
+// merges masks of all cells touched by the given bounds
+static void CL_ClipGridMask(const vec3_t mins, const vec3_t maxs, clipmask_t mask)
+{
+    int x, y, w, x0, x1, y0, y1;
+
+    x0 = CL_ClipCell(mins[0], 0);
+    x1 = CL_ClipCell(maxs[0], 0);
+    y0 = CL_ClipCell(mins[1], 1);
+    y1 = CL_ClipCell(maxs[1], 1);
+
+    memset(mask, 0, sizeof(clipmask_t));
+    for (x = x0; x <= x1; x++)
+        for (y = y0; y <= y1; y++)
+            for (w = 0; w < CLIP_GRID_WORDS; w++)
+                mask[w] |= cl.clipGrid[x][y][w];
+}
+
+static void CL_BuildClipGrid(void)
+{
+    int             i, j, x, y, x0, x1, y0, y1;
+    clipentity_t    *clip;
+    vec_t           mins, maxs;
+
+    for (j = 0; j < 2; j++) {
+        if (cl.bsp && cl.bsp->nummodels) {
+            mins = cl.bsp->models[0].mins[j];
+            maxs = cl.bsp->models[0].maxs[j];
+        } else {
+            mins = -4096;
+            maxs = 4096;
+        }
+        if (maxs - mins < CLIP_GRID_SIZE)
+            maxs = mins + CLIP_GRID_SIZE;
+        cl.clipGridOrigin[j] = mins;
+        cl.clipGridScale[j] = CLIP_GRID_SIZE / (maxs - mins);
+    }
+
+    memset(cl.clipGrid, 0, sizeof(cl.clipGrid));
+
+    for (i = 0, clip = cl.clipEntities; i < cl.numClipEntities; i++, clip++) {
+        x0 = CL_ClipCell(clip->absmin[0], 0);
+        x1 = CL_ClipCell(clip->absmax[0], 0);
+        y0 = CL_ClipCell(clip->absmin[1], 1);
+        y1 = CL_ClipCell(clip->absmax[1], 1);
+        for (x = x0; x <= x1; x++)
+            for (y = y0; y <= y1; y++)
+                cl.clipGrid[x][y][i >> 5] |= 1U << (i & 31);
+    }
+}
+
 /*
 ====================
-CL_ClipMoveToEntities
+CL_BuildClipList
 
+Resolves clip models and absolute bounds of solid entities once per
+server frame, so that prediction traces can skip entities they can't touch.
 ====================
 */
-static void CL_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, trace_t *tr)
+void CL_BuildClipList(void)
 {
-    int         i;
-    trace_t     trace;
-    mnode_t     *headnode;
-    centity_t   *ent;
-    mmodel_t    *cmodel;
+    int             i, j;
+    centity_t       *ent;
+    mmodel_t        *cmodel;
+    clipentity_t    clip, *out;
+    vec_t           radius;
+    qboolean        changed;
+
+    changed = cl.numClipEntities != cl.numSolidEntities;
+    out = cl.clipEntities;
 
     for (i = 0; i < cl.numSolidEntities; i++) {
         ent = cl.solidEntities[i];
 
+        memset(&clip, 0, sizeof(clip));
+        clip.ent = ent;
+        VectorCopy(ent->current.origin, clip.origin);
+        VectorCopy(ent->current.angles, clip.angles);
+
         if (ent->current.solid == PACKED_BSP) {
             // special value for bmodel
             cmodel = cl.model_clip[ent->current.modelindex];
             if (!cmodel)
                 continue;
-            headnode = cmodel->headnode;
+            clip.headnode = cmodel->headnode;
+            VectorCopy(cmodel->mins, clip.absmin);
+            VectorCopy(cmodel->maxs, clip.absmax);
         } else {
-            headnode = CM_HeadnodeForBox(ent->mins, ent->maxs);
+            VectorCopy(ent->mins, clip.absmin);
+            VectorCopy(ent->maxs, clip.absmax);
         }
 
-        if (tr->allsolid)
-            return;
+        if (clip.angles[0] || clip.angles[1] || clip.angles[2]) {
+            radius = RadiusFromBounds(clip.absmin, clip.absmax);
+            VectorSet(clip.absmin, -radius, -radius, -radius);
+            VectorSet(clip.absmax, radius, radius, radius);
+        }
 
-        CM_TransformedBoxTrace(&trace, start, end,
-                               mins, maxs, headnode,  MASK_PLAYERSOLID,
-                               ent->current.origin, ent->current.angles);
+        for (j = 0; j < 3; j++) {
+            clip.absmin[j] += clip.origin[j] - 1;
+            clip.absmax[j] += clip.origin[j] + 1;
+        }
 
-        CM_ClipEntity(tr, &trace, (struct edict_s *)ent);
+        if (memcmp(out, &clip, sizeof(clip))) {
+            *out = clip;
+            changed = qtrue;
+        }
+        out++;
+    }
+
+    if (out - cl.clipEntities != cl.numClipEntities)
+        changed = qtrue;
+    cl.numClipEntities = out - cl.clipEntities;
+
+    if (changed) {
+        CL_BuildClipGrid();
+        cl.clipstamp++;
+    }
+}
+
+/*
+====================
+CL_ClipMoveToEntities
+
+====================
+*/
+static void CL_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, trace_t *tr)
+{
+    int             i, j, w;
+    trace_t         trace;
+    mnode_t         *headnode;
+    clipentity_t    *clip;
+    vec3_t          boxmins, boxmaxs;
+    clipmask_t      mask;
+    uint32_t        bits;
+
+    // bounds of the whole move
+    for (j = 0; j < 3; j++) {
+        if (end[j] > start[j]) {
+            boxmins[j] = start[j] + mins[j];
+            boxmaxs[j] = end[j] + maxs[j];
+        } else {
+            boxmins[j] = end[j] + mins[j];
+            boxmaxs[j] = start[j] + maxs[j];
+        }
+    }
+
+    CL_ClipGridMask(boxmins, boxmaxs, mask);
+
+    // visit candidates in list order, so results match a full scan
+    for (w = 0; w < CLIP_GRID_WORDS; w++) {
+        for (bits = mask[w], i = w << 5; bits; bits >>= 1, i++) {
+            if (!(bits & 1))
+                continue;
+
+            clip = &cl.clipEntities[i];
+
+            if (tr->allsolid)
+                return;
+
+            if (boxmins[0] > clip->absmax[0] || boxmaxs[0] < clip->absmin[0] ||
+                boxmins[1] > clip->absmax[1] || boxmaxs[1] < clip->absmin[1] ||
+                boxmins[2] > clip->absmax[2] || boxmaxs[2] < clip->absmin[2])
+                continue;
+
+            headnode = clip->headnode;
+            if (!headnode)
+                headnode = CM_HeadnodeForBox(clip->ent->mins, clip->ent->maxs);
+
+            CM_TransformedBoxTrace(&trace, start, end,
+                                   mins, maxs, headnode,  MASK_PLAYERSOLID,
+                                   clip->origin, clip->angles);
+
+            CM_ClipEntity(tr, &trace, (struct edict_s *)clip->ent);
+        }
     }
 }
 
@@ -136,32 +285,51 @@ static trace_t q_gameabi CL_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
 
 static int CL_PointContents(vec3_t point)
 {
-    int         i;
-    centity_t   *ent;
-    mmodel_t    *cmodel;
-    int         contents;
+    int             i, w;
+    clipentity_t    *clip;
+    int             contents;
+    clipmask_t      mask;
+    uint32_t        bits;
 
     contents = CM_PointContents(point, cl.bsp->nodes);
 
-    for (i = 0; i < cl.numSolidEntities; i++) {
-        ent = cl.solidEntities[i];
+    CL_ClipGridMask(point, point, mask);
 
-        if (ent->current.solid != PACKED_BSP) // special value for bmodel
-            continue;
+    for (w = 0; w < CLIP_GRID_WORDS; w++) {
+        for (bits = mask[w], i = w << 5; bits; bits >>= 1, i++) {
+            if (!(bits & 1))
+                continue;
 
-        cmodel = cl.model_clip[ent->current.modelindex];
-        if (!cmodel)
-            continue;
+            clip = &cl.clipEntities[i];
+            if (!clip->headnode) // only bmodels
+                continue;
 
-        contents |= CM_TransformedPointContents(
-                        point, cmodel->headnode,
-                        ent->current.origin,
-                        ent->current.angles);
+            if (point[0] > clip->absmax[0] || point[0] < clip->absmin[0] ||
+                point[1] > clip->absmax[1] || point[1] < clip->absmin[1] ||
+                point[2] > clip->absmax[2] || point[2] < clip->absmin[2])
+                continue;
+
+            contents |= CM_TransformedPointContents(
+                            point, clip->headnode,
+                            clip->origin,
+                            clip->angles);
+        }
     }
 
     return contents;
 }
 
+static qboolean CL_SamePmoveState(const pmove_state_t *a, const pmove_state_t *b)
+{
+    return a->pm_type == b->pm_type &&
+           VectorCompare(a->origin, b->origin) &&
+           VectorCompare(a->velocity, b->velocity) &&
+           a->pm_flags == b->pm_flags &&
+           a->pm_time == b->pm_time &&
+           a->gravity == b->gravity &&
+           VectorCompare(a->delta_angles, b->delta_angles);
+}
+
 /*
 =================
 CL_PredictMovement
@@ -178,8 +346,9 @@ void CL_PredictAngles(void)
 
 void CL_PredictMovement(void)
 {
-    unsigned    ack, current, frame;
+    unsigned    ack, current, frame, start;
     pmove_t     pm;
+    pmove_state_t   base;
     int         step, oldz;
 
     if (cls.state != ca_active) {
@@ -222,20 +391,51 @@ void CL_PredictMovement(void)
     pm.trace = CL_Trace;
     pm.pointcontents = CL_PointContents;
 
-    pm.s = cl.frame.ps.pmove;
+    base = cl.frame.ps.pmove;
 #if USE_SMOOTH_DELTA_ANGLES
-    VectorCopy(cl.delta_angles, pm.s.delta_angles);
+    VectorCopy(cl.delta_angles, base.delta_angles);
 #endif
 
+    // commands already run from the same state against the same entities
+    // don't need to be run again. this also holds for a new server frame
+    // that agrees with what was predicted for the acknowledged command.
+    if (cl.predicted_clipstamp != cl.clipstamp ||
+        cl.predicted_cmd - ack > current - ack) {
+        start = ack;
+    } else if (cl.predicted_ack == ack &&
+               CL_SamePmoveState(&cl.predicted_base, &base)) {
+        start = cl.predicted_cmd;
+    } else if (ack - cl.predicted_ack - 1 < cl.predicted_cmd - cl.predicted_ack &&
+               CL_SamePmoveState(&cl.predicted_states[ack & CMD_MASK], &base)) {
+        start = cl.predicted_cmd;
+    } else {
+        start = ack;
+    }
+
+    cl.predicted_base = base;
+    cl.predicted_ack = ack;
+    cl.predicted_clipstamp = cl.clipstamp;
+
+    if (start == ack) {
+        pm.s = base;
+    } else {
+        pm.s = cl.predicted_states[start & CMD_MASK];
+        VectorCopy(cl.predicted_viewangles[start & CMD_MASK], pm.viewangles);
+    }
+
     // run frames
-    while (++ack <= current) {
-        pm.cmd = cl.cmds[ack & CMD_MASK];
+    while (++start <= current) {
+        pm.cmd = cl.cmds[start & CMD_MASK];
         Pmove(&pm, &cl.pmp);
 
-        // save for debug checking
-        VectorCopy(pm.s.origin, cl.predicted_origins[ack & CMD_MASK]);
+        // save for resuming and debug checking
+        cl.predicted_states[start & CMD_MASK] = pm.s;
+        VectorCopy(pm.viewangles, cl.predicted_viewangles[start & CMD_MASK]);
+        VectorCopy(pm.s.origin, cl.predicted_origins[start & CMD_MASK]);
     }
 
+    cl.predicted_cmd = current;
+
     // run pending cmd
     if (cl.cmd.msec) {
         pm.cmd = cl.cmd;
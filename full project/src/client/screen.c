@@ -22,6 +22,44 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define STAT_PICS       11
 #define STAT_MINUS      (STAT_PICS - 1)  // num frame for '-' stats digit
 
+typedef enum {
+    LAYOUT_XL,
+    LAYOUT_XR,
+    LAYOUT_XV,
+    LAYOUT_YT,
+    LAYOUT_YB,
+    LAYOUT_YV,
+    LAYOUT_PIC,
+    LAYOUT_CLIENT,
+    LAYOUT_CTF,
+    LAYOUT_PICN,
+    LAYOUT_NUM,
+    LAYOUT_HNUM,
+    LAYOUT_ANUM,
+    LAYOUT_RNUM,
+    LAYOUT_STAT_STRING,
+    LAYOUT_CSTRING,
+    LAYOUT_CSTRING2,
+    LAYOUT_STRING,
+    LAYOUT_STRING2,
+    LAYOUT_IF,
+    LAYOUT_ENDIF
+} layoutop_t;
+
+typedef struct {
+    layoutop_t  op;
+    int         args[6];
+    char        *string;
+} layoutcmd_t;
+
+typedef struct {
+    char        *source;    // text the commands were compiled from
+    layoutcmd_t *cmds;
+    int         numcmds;
+    char        *strings;   // string arguments
+    unsigned    serial;     // unique for every compile
+} layoutcache_t;
+
 static struct {
     qboolean    initialized;        // ready to draw
 
@@ -46,6 +84,9 @@ static struct {
     qhandle_t   font_pic;
 
     int         hud_width, hud_height;
+
+    layoutcache_t   statusbar;
+    layoutcache_t   layout;
 } scr;
 
 static cvar_t   *scr_viewsize;
@@ -55,6 +96,7 @@ static cvar_t   *scr_showpause;
 static cvar_t   *scr_showstats;
 static cvar_t   *scr_showpmove;
 #endif
+static cvar_t   *scr_showprof;
 static cvar_t   *scr_showturtle;
 
 static cvar_t   *scr_draw2d;
@@ -201,6 +243,57 @@ float SCR_FadeAlpha(unsigned startTime, unsigned visTime, unsigned fadeTime)
     return alpha;
 }
 
+/*
+=================
+SCR_HashBlock
+
+FNV-1a, for keying retained spans
+=================
+*/
+unsigned SCR_HashBlock(unsigned hash, const void *data, size_t len)
+{
+    const byte *p = data;
+
+    while (len--) {
+        hash ^= *p++;
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+/*
+=================
+SCR_BeginSpan
+
+Draws the span kept under this hash and returns qfalse, or starts
+recording it anew and returns qtrue. In the latter case the caller
+draws the element and finishes with R_EndSpan.
+=================
+*/
+qboolean SCR_BeginSpan(drawspan_id_t span, unsigned hash)
+{
+    if (R_DrawSpan(span, hash)) {
+        return qfalse;
+    }
+
+    R_BeginSpan(span, hash);
+    return qtrue;
+}
+
+// things all HUD spans are drawn from
+static unsigned hud_span_hash(void)
+{
+    unsigned hash = SPAN_HASH_INIT;
+
+    hash = SPAN_HASH(hash, scr.hud_width);
+    hash = SPAN_HASH(hash, scr.hud_height);
+    hash = SPAN_HASH(hash, scr_alpha->value);
+    hash = SPAN_HASH(hash, cl.csserial);
+
+    return hash;
+}
+
 qboolean SCR_ParseColor(const char *s, color_t *color)
 {
     int i;
@@ -477,6 +570,7 @@ static void draw_center_string(void)
 {
     int y;
     float alpha;
+    unsigned hash;
 
     Cvar_ClampValue(scr_centertime, 0.3f, 10.0f);
 
@@ -487,10 +581,19 @@ static void draw_center_string(void)
 
     R_SetAlpha(alpha * scr_alpha->value);
 
-    y = scr.hud_height / 4 - scr_center_lines * 8 / 2;
+    // every print restarts the timer
+    hash = hud_span_hash();
+    hash = SPAN_HASH(hash, scr_centertime_start);
+    hash = SCR_HashBlock(hash, scr_centerstring, strlen(scr_centerstring));
+    hash = SPAN_HASH(hash, alpha);
+
+    if (SCR_BeginSpan(SPAN_CENTER, hash)) {
+        y = scr.hud_height / 4 - scr_center_lines * 8 / 2;
 
-    SCR_DrawStringMulti(scr.hud_width / 2, y, UI_CENTER,
-                        MAX_STRING_CHARS, scr_centerstring, scr.font_pic);
+        SCR_DrawStringMulti(scr.hud_width / 2, y, UI_CENTER,
+                            MAX_STRING_CHARS, scr_centerstring, scr.font_pic);
+        R_EndSpan();
+    }
 
     R_SetAlpha(scr_alpha->value);
 }
@@ -924,6 +1027,33 @@ static void draw_pmove(void)
 
 #endif
 
+static void draw_prof(void)
+{
+    profstat_t stats[PROF_NUM_SCOPES];
+    char buffer[MAX_QPATH];
+    int i, x, y;
+
+    x = scr.hud_width - 32 * CHAR_WIDTH;
+    y = (scr.hud_height - (PROF_NUM_SCOPES + 1) * CHAR_HEIGHT) / 2;
+
+    if (!prof_enabled) {
+        R_DrawString(x, y, 0, MAX_STRING_CHARS, "com_prof is 0", scr.font_pic);
+        return;
+    }
+
+    PROF_GetStats(stats, scr_showprof->integer);
+
+    R_DrawString(x, y, 0, MAX_STRING_CHARS,
+                 "scope           avg us  max us", scr.font_pic);
+    y += CHAR_HEIGHT;
+    for (i = 0; i < PROF_NUM_SCOPES; i++) {
+        Q_snprintf(buffer, sizeof(buffer), "%-15s %6u  %6u",
+                   PROF_ScopeName(i), stats[i].total, stats[i].max);
+        R_DrawString(x, y, 0, MAX_STRING_CHARS, buffer, scr.font_pic);
+        y += CHAR_HEIGHT;
+    }
+}
+
 //============================================================================
 
 // Sets scr_vrect, the coordinates of the rendered window
@@ -1142,10 +1272,22 @@ void SCR_ModeChanged(void)
 SCR_RegisterMedia
 ==================
 */
+static void clear_layout(layoutcache_t *cache)
+{
+    Z_Free(cache->source);
+    Z_Free(cache->cmds);
+    Z_Free(cache->strings);
+    memset(cache, 0, sizeof(*cache));
+}
+
 void SCR_RegisterMedia(void)
 {
     int     i, j;
 
+    // named pics in layouts must be registered again
+    clear_layout(&scr.statusbar);
+    clear_layout(&scr.layout);
+
     for (i = 0; i < 2; i++)
         for (j = 0; j < STAT_PICS; j++)
             scr.sb_pics[i][j] = R_RegisterPic(sb_nums[i][j]);
@@ -1235,6 +1377,7 @@ void SCR_Init(void)
     scr_showstats = Cvar_Get("scr_showstats", "0", 0);
     scr_showpmove = Cvar_Get("scr_showpmove", "0", 0);
 #endif
+    scr_showprof = Cvar_Get("scr_showprof", "0", 0);
 
     Cmd_Register(scr_cmds);
 
@@ -1244,6 +1387,8 @@ void SCR_Init(void)
 void SCR_Shutdown(void)
 {
     Cmd_Deregister(scr_cmds);
+    clear_layout(&scr.statusbar);
+    clear_layout(&scr.layout);
     scr.initialized = qfalse;
 }
 
@@ -1392,11 +1537,12 @@ static void draw_inventory(void)
     int     i;
     int     num, selected_num, item;
     int     index[MAX_ITEMS];
+    char    binds[DISPLAY_ITEMS][MAX_QPATH];
     char    string[MAX_STRING_CHARS];
     int     x, y;
-    char    *bind;
     int     selected;
-    int     top;
+    int     top, blink;
+    unsigned    hash;
 
     selected = cl.frame.ps.stats[STAT_SELECTED_ITEM];
 
@@ -1420,6 +1566,28 @@ static void draw_inventory(void)
         top = 0;
     }
 
+    blink = (cls.realtime >> 8) & 1;
+
+    hash = hud_span_hash();
+    hash = SPAN_HASH(hash, selected);
+    hash = SPAN_HASH(hash, top);
+    hash = SPAN_HASH(hash, blink);
+    hash = SPAN_HASH(hash, cl.inventory);
+
+    // search for bindings, these can change any time
+    for (i = top; i < num && i < top + DISPLAY_ITEMS; i++) {
+        item = index[i];
+        Q_concat(string, sizeof(string),
+                 "use ", cl.configstrings[CS_ITEMS + item], NULL);
+        // key names may come back in a static buffer
+        Q_strlcpy(binds[i - top], Key_GetBinding(string), MAX_QPATH);
+        hash = SCR_HashBlock(hash, binds[i - top], strlen(binds[i - top]) + 1);
+    }
+
+    if (!SCR_BeginSpan(SPAN_INVENTORY, hash)) {
+        return;
+    }
+
     x = (scr.hud_width - 256) / 2;
     y = (scr.hud_height - 240) / 2;
 
@@ -1435,206 +1603,256 @@ static void draw_inventory(void)
 
     for (i = top; i < num && i < top + DISPLAY_ITEMS; i++) {
         item = index[i];
-        // search for a binding
-        Q_concat(string, sizeof(string),
-                 "use ", cl.configstrings[CS_ITEMS + item], NULL);
-        bind = Key_GetBinding(string);
-
-        Q_snprintf(string, sizeof(string), "%6s %3i %s",
-                   bind, cl.inventory[item], cl.configstrings[CS_ITEMS + item]);
+        Q_snprintf(string, sizeof(string), "%6s %3i %s", binds[i - top],
+                   cl.inventory[item], cl.configstrings[CS_ITEMS + item]);
 
         if (item != selected) {
             HUD_DrawAltString(x, y, string);
         } else {    // draw a blinky cursor by the selected item
             HUD_DrawString(x, y, string);
-            if ((cls.realtime >> 8) & 1) {
+            if (blink) {
                 R_DrawChar(x - CHAR_WIDTH, y, 0, 15, scr.font_pic);
             }
         }
 
         y += CHAR_HEIGHT;
     }
+
+    R_EndSpan();
+}
+
+/*
+===============================================================================
+
+LAYOUT PROGRAMS
+
+Status bar and layout programs are compiled into a list of commands when
+their text changes, drawing then only walks the list. Stat and index
+arguments are still checked when executed, like the parser used to.
+
+===============================================================================
+*/
+
+typedef struct {
+    const char  *name;
+    layoutop_t  op;
+    int         numargs;
+    qboolean    string;     // last argument is a string
+} layoutsyntax_t;
+
+static const layoutsyntax_t layout_syntax[] = {
+    { "xl", LAYOUT_XL, 1 },
+    { "xr", LAYOUT_XR, 1 },
+    { "xv", LAYOUT_XV, 1 },
+    { "yt", LAYOUT_YT, 1 },
+    { "yb", LAYOUT_YB, 1 },
+    { "yv", LAYOUT_YV, 1 },
+    { "pic", LAYOUT_PIC, 1 },
+    { "client", LAYOUT_CLIENT, 6 },
+    { "ctf", LAYOUT_CTF, 5 },
+    { "picn", LAYOUT_PICN, 1, qtrue },
+    { "num", LAYOUT_NUM, 2 },
+    { "hnum", LAYOUT_HNUM, 0 },
+    { "anum", LAYOUT_ANUM, 0 },
+    { "rnum", LAYOUT_RNUM, 0 },
+    { "stat_string", LAYOUT_STAT_STRING, 1 },
+    { "cstring", LAYOUT_CSTRING, 1, qtrue },
+    { "cstring2", LAYOUT_CSTRING2, 1, qtrue },
+    { "string", LAYOUT_STRING, 1, qtrue },
+    { "string2", LAYOUT_STRING2, 1, qtrue },
+    { "if", LAYOUT_IF, 1 },
+    { "endif", LAYOUT_ENDIF, 0 },
+    { NULL }
+};
+
+static void compile_layout(layoutcache_t *cache, const char *s)
+{
+    static unsigned serial;
+    const layoutsyntax_t *syn;
+    layoutcmd_t *cmd;
+    char *token, *strings;
+    size_t len;
+    int i, j, maxcmds;
+
+    clear_layout(cache);
+
+    len = strlen(s);
+    cache->source = Z_CopyString(s);
+    cache->serial = ++serial;
+
+    // every command takes at least two characters including separator,
+    // string arguments are never longer than the text they come from
+    maxcmds = len / 2 + 1;
+    cache->cmds = Z_Malloc(sizeof(cache->cmds[0]) * maxcmds);
+    cache->strings = strings = Z_Malloc(len + 1);
+
+    while (s) {
+        token = COM_Parse(&s);
+        for (syn = layout_syntax; syn->name; syn++) {
+            if (!strcmp(token, syn->name)) {
+                break;
+            }
+        }
+        if (!syn->name) {
+            continue;   // unknown tokens are skipped
+        }
+
+        cmd = &cache->cmds[cache->numcmds++];
+        cmd->op = syn->op;
+        cmd->string = NULL;
+
+        for (i = 0; i < syn->numargs; i++) {
+            token = COM_Parse(&s);
+            if (syn->string && i == syn->numargs - 1) {
+                cmd->string = strcpy(strings, token);
+                strings += strlen(token) + 1;
+            } else {
+                cmd->args[i] = atoi(token);
+            }
+        }
+
+        // named pics are registered once
+        if (cmd->op == LAYOUT_PICN) {
+            cmd->args[0] = R_RegisterPic2(cmd->string);
+        }
+    }
+
+    // resolve where false conditions skip to
+    for (i = 0; i < cache->numcmds; i++) {
+        if (cache->cmds[i].op != LAYOUT_IF) {
+            continue;
+        }
+        for (j = i + 1; j < cache->numcmds; j++) {
+            if (cache->cmds[j].op == LAYOUT_ENDIF) {
+                break;
+            }
+        }
+        cache->cmds[i].args[1] = j;
+    }
+}
+
+static int layout_stat(int index)
+{
+    if (index < 0 || index >= MAX_STATS) {
+        Com_Error(ERR_DROP, "%s: invalid stat index", __func__);
+    }
+    return cl.frame.ps.stats[index];
 }
 
-static void draw_layout_string(const char *s)
+static void draw_layout_cmds(layoutcache_t *cache)
 {
     char    buffer[MAX_QPATH];
     int     x, y;
     int     value;
-    char    *token;
     int     width;
     int     index;
+    int     color;
+    int     i;
     clientinfo_t    *ci;
-
-    if (!s[0])
-        return;
+    layoutcmd_t     *cmd;
 
     x = 0;
     y = 0;
     width = 3;
 
-    while (s) {
-        token = COM_Parse(&s);
-        if (token[2] == 0) {
-            if (token[0] == 'x') {
-                if (token[1] == 'l') {
-                    token = COM_Parse(&s);
-                    x = atoi(token);
-                    continue;
-                }
-
-                if (token[1] == 'r') {
-                    token = COM_Parse(&s);
-                    x = scr.hud_width + atoi(token);
-                    continue;
-                }
-
-                if (token[1] == 'v') {
-                    token = COM_Parse(&s);
-                    x = scr.hud_width / 2 - 160 + atoi(token);
-                    continue;
-                }
-            }
+    for (i = 0; i < cache->numcmds; i++) {
+        cmd = &cache->cmds[i];
+        switch (cmd->op) {
+        case LAYOUT_XL:
+            x = cmd->args[0];
+            break;
 
-            if (token[0] == 'y') {
-                if (token[1] == 't') {
-                    token = COM_Parse(&s);
-                    y = atoi(token);
-                    continue;
-                }
-
-                if (token[1] == 'b') {
-                    token = COM_Parse(&s);
-                    y = scr.hud_height + atoi(token);
-                    continue;
-                }
-
-                if (token[1] == 'v') {
-                    token = COM_Parse(&s);
-                    y = scr.hud_height / 2 - 120 + atoi(token);
-                    continue;
-                }
-            }
-        }
+        case LAYOUT_XR:
+            x = scr.hud_width + cmd->args[0];
+            break;
+
+        case LAYOUT_XV:
+            x = scr.hud_width / 2 - 160 + cmd->args[0];
+            break;
 
-        if (!strcmp(token, "pic")) {
+        case LAYOUT_YT:
+            y = cmd->args[0];
+            break;
+
+        case LAYOUT_YB:
+            y = scr.hud_height + cmd->args[0];
+            break;
+
+        case LAYOUT_YV:
+            y = scr.hud_height / 2 - 120 + cmd->args[0];
+            break;
+
+        case LAYOUT_PIC:
             // draw a pic from a stat number
-            token = COM_Parse(&s);
-            value = atoi(token);
-            if (value < 0 || value >= MAX_STATS) {
-                Com_Error(ERR_DROP, "%s: invalid stat index", __func__);
-            }
-            value = cl.frame.ps.stats[value];
+            value = layout_stat(cmd->args[0]);
             if (value < 0 || value >= MAX_IMAGES) {
                 Com_Error(ERR_DROP, "%s: invalid pic index", __func__);
             }
-            token = cl.configstrings[CS_IMAGES + value];
-            if (token[0]) {
+            if (cl.configstrings[CS_IMAGES + value][0]) {
                 R_DrawPic(x, y, cl.image_precache[value]);
             }
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "client")) {
+        case LAYOUT_CLIENT:
             // draw a deathmatch client block
-            int     score, ping, time;
-
-            token = COM_Parse(&s);
-            x = scr.hud_width / 2 - 160 + atoi(token);
-            token = COM_Parse(&s);
-            y = scr.hud_height / 2 - 120 + atoi(token);
+            x = scr.hud_width / 2 - 160 + cmd->args[0];
+            y = scr.hud_height / 2 - 120 + cmd->args[1];
 
-            token = COM_Parse(&s);
-            value = atoi(token);
+            value = cmd->args[2];
             if (value < 0 || value >= MAX_CLIENTS) {
                 Com_Error(ERR_DROP, "%s: invalid client index", __func__);
             }
             ci = &cl.clientinfo[value];
 
-            token = COM_Parse(&s);
-            score = atoi(token);
-
-            token = COM_Parse(&s);
-            ping = atoi(token);
-
-            token = COM_Parse(&s);
-            time = atoi(token);
-
             HUD_DrawAltString(x + 32, y, ci->name);
             HUD_DrawString(x + 32, y + CHAR_HEIGHT, "Score: ");
-            Q_snprintf(buffer, sizeof(buffer), "%i", score);
+            Q_snprintf(buffer, sizeof(buffer), "%i", cmd->args[3]);
             HUD_DrawAltString(x + 32 + 7 * CHAR_WIDTH, y + CHAR_HEIGHT, buffer);
-            Q_snprintf(buffer, sizeof(buffer), "Ping:  %i", ping);
+            Q_snprintf(buffer, sizeof(buffer), "Ping:  %i", cmd->args[4]);
             HUD_DrawString(x + 32, y + 2 * CHAR_HEIGHT, buffer);
-            Q_snprintf(buffer, sizeof(buffer), "Time:  %i", time);
+            Q_snprintf(buffer, sizeof(buffer), "Time:  %i", cmd->args[5]);
             HUD_DrawString(x + 32, y + 3 * CHAR_HEIGHT, buffer);
 
             if (!ci->icon) {
                 ci = &cl.baseclientinfo;
             }
             R_DrawPic(x, y, ci->icon);
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "ctf")) {
+        case LAYOUT_CTF:
             // draw a ctf client block
-            int     score, ping;
+            x = scr.hud_width / 2 - 160 + cmd->args[0];
+            y = scr.hud_height / 2 - 120 + cmd->args[1];
 
-            token = COM_Parse(&s);
-            x = scr.hud_width / 2 - 160 + atoi(token);
-            token = COM_Parse(&s);
-            y = scr.hud_height / 2 - 120 + atoi(token);
-
-            token = COM_Parse(&s);
-            value = atoi(token);
+            value = cmd->args[2];
             if (value < 0 || value >= MAX_CLIENTS) {
                 Com_Error(ERR_DROP, "%s: invalid client index", __func__);
             }
             ci = &cl.clientinfo[value];
 
-            token = COM_Parse(&s);
-            score = atoi(token);
-
-            token = COM_Parse(&s);
-            ping = atoi(token);
-            if (ping > 999)
-                ping = 999;
-
             Q_snprintf(buffer, sizeof(buffer), "%3d %3d %-12.12s",
-                       score, ping, ci->name);
+                       cmd->args[3], min(cmd->args[4], 999), ci->name);
             if (value == cl.frame.clientNum) {
                 HUD_DrawAltString(x, y, buffer);
             } else {
                 HUD_DrawString(x, y, buffer);
             }
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "picn")) {
+        case LAYOUT_PICN:
             // draw a pic from a name
-            token = COM_Parse(&s);
-            R_DrawPic(x, y, R_RegisterPic2(token));
-            continue;
-        }
+            R_DrawPic(x, y, cmd->args[0]);
+            break;
 
-        if (!strcmp(token, "num")) {
+        case LAYOUT_NUM:
             // draw a number
-            token = COM_Parse(&s);
-            width = atoi(token);
-            token = COM_Parse(&s);
-            value = atoi(token);
-            if (value < 0 || value >= MAX_STATS) {
-                Com_Error(ERR_DROP, "%s: invalid stat index", __func__);
-            }
-            value = cl.frame.ps.stats[value];
+            width = cmd->args[0];
+            value = layout_stat(cmd->args[1]);
             HUD_DrawNumber(x, y, 0, width, value);
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "hnum")) {
+        case LAYOUT_HNUM:
             // health number
-            int     color;
-
             width = 3;
             value = cl.frame.ps.stats[STAT_HEALTH];
             if (value > 25)
@@ -1648,13 +1866,10 @@ static void draw_layout_string(const char *s)
                 R_DrawPic(x, y, scr.field_pic);
 
             HUD_DrawNumber(x, y, color, width, value);
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "anum")) {
+        case LAYOUT_ANUM:
             // ammo number
-            int     color;
-
             width = 3;
             value = cl.frame.ps.stats[STAT_AMMO];
             if (value > 5)
@@ -1662,23 +1877,20 @@ static void draw_layout_string(const char *s)
             else if (value >= 0)
                 color = ((cl.frame.number / CL_FRAMEDIV) >> 2) & 1;     // flash
             else
-                continue;   // negative number = don't show
+                break;      // negative number = don't show
 
             if (cl.frame.ps.stats[STAT_FLASHES] & 4)
                 R_DrawPic(x, y, scr.field_pic);
 
             HUD_DrawNumber(x, y, color, width, value);
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "rnum")) {
+        case LAYOUT_RNUM:
             // armor number
-            int     color;
-
             width = 3;
             value = cl.frame.ps.stats[STAT_ARMOR];
             if (value < 1)
-                continue;
+                break;
 
             color = 0;  // green
 
@@ -1686,67 +1898,73 @@ static void draw_layout_string(const char *s)
                 R_DrawPic(x, y, scr.field_pic);
 
             HUD_DrawNumber(x, y, color, width, value);
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "stat_string")) {
-            token = COM_Parse(&s);
-            index = atoi(token);
-            if (index < 0 || index >= MAX_STATS) {
-                Com_Error(ERR_DROP, "%s: invalid stat index", __func__);
-            }
-            index = cl.frame.ps.stats[index];
+        case LAYOUT_STAT_STRING:
+            index = layout_stat(cmd->args[0]);
             if (index < 0 || index >= MAX_CONFIGSTRINGS) {
                 Com_Error(ERR_DROP, "%s: invalid string index", __func__);
             }
             HUD_DrawString(x, y, cl.configstrings[index]);
-            continue;
-        }
+            break;
 
-        if (!strcmp(token, "cstring")) {
-            token = COM_Parse(&s);
-            HUD_DrawCenterString(x + 320 / 2, y, token);
-            continue;
-        }
+        case LAYOUT_CSTRING:
+            HUD_DrawCenterString(x + 320 / 2, y, cmd->string);
+            break;
 
-        if (!strcmp(token, "cstring2")) {
-            token = COM_Parse(&s);
-            HUD_DrawAltCenterString(x + 320 / 2, y, token);
-            continue;
-        }
+        case LAYOUT_CSTRING2:
+            HUD_DrawAltCenterString(x + 320 / 2, y, cmd->string);
+            break;
 
-        if (!strcmp(token, "string")) {
-            token = COM_Parse(&s);
-            HUD_DrawString(x, y, token);
-            continue;
-        }
+        case LAYOUT_STRING:
+            HUD_DrawString(x, y, cmd->string);
+            break;
 
-        if (!strcmp(token, "string2")) {
-            token = COM_Parse(&s);
-            HUD_DrawAltString(x, y, token);
-            continue;
-        }
+        case LAYOUT_STRING2:
+            HUD_DrawAltString(x, y, cmd->string);
+            break;
 
-        if (!strcmp(token, "if")) {
-            token = COM_Parse(&s);
-            value = atoi(token);
-            if (value < 0 || value >= MAX_STATS) {
-                Com_Error(ERR_DROP, "%s: invalid stat index", __func__);
+        case LAYOUT_IF:
+            if (!layout_stat(cmd->args[0])) {
+                i = cmd->args[1];   // skip to endif
             }
-            value = cl.frame.ps.stats[value];
-            if (!value) {   // skip to endif
-                while (strcmp(token, "endif")) {
-                    token = COM_Parse(&s);
-                    if (!s) {
-                        break;
-                    }
-                }
-            }
-            continue;
+            break;
+
+        case LAYOUT_ENDIF:
+            break;
         }
     }
 }
 
+// layouts only change with stats and strings they are drawn from, so they
+// are kept as spans between those changing
+static void draw_layout_string(layoutcache_t *cache, const char *s,
+                               drawspan_id_t span)
+{
+    unsigned hash;
+    int flash;
+
+    if (!s[0])
+        return;
+
+    if (!cache->source || strcmp(cache->source, s)) {
+        compile_layout(cache, s);
+    }
+
+    flash = ((cl.frame.number / CL_FRAMEDIV) >> 2) & 1;
+
+    hash = hud_span_hash();
+    hash = SPAN_HASH(hash, cache->serial);
+    hash = SPAN_HASH(hash, cl.frame.ps.stats);
+    hash = SPAN_HASH(hash, cl.frame.clientNum);
+    hash = SPAN_HASH(hash, flash);
+
+    if (SCR_BeginSpan(span, hash)) {
+        draw_layout_cmds(cache);
+        R_EndSpan();
+    }
+}
+
 static void draw_pause(void)
 {
     int x = (scr.hud_width - scr.pause_width) / 2;
@@ -1810,12 +2028,13 @@ static void draw_2d(void)
     R_SetAlpha(Cvar_ClampValue(scr_alpha, 0, 1));
 
     if (scr_draw2d->integer > 1) {
-        draw_layout_string(cl.configstrings[CS_STATUSBAR]);
+        draw_layout_string(&scr.statusbar, cl.configstrings[CS_STATUSBAR],
+                           SPAN_STATUSBAR);
     }
 
     if ((cl.frame.ps.stats[STAT_LAYOUTS] & 1) ||
         (cls.demo.playback && Key_IsDown(K_F1))) {
-        draw_layout_string(cl.layout);
+        draw_layout_string(&scr.layout, cl.layout, SPAN_LAYOUT);
     }
 
     if (cl.frame.ps.stats[STAT_LAYOUTS] & 2) {
@@ -1848,6 +2067,10 @@ static void draw_2d(void)
     }
 #endif
 
+    if (scr_showprof->integer) {
+        draw_prof();
+    }
+
 #if USE_REF == REF_SOFT
     R_SetClipRect(DRAW_CLIP_DISABLED, NULL);
 #else
@@ -1878,7 +2101,9 @@ static void draw_active_frame(void)
 
     // draw all 2D elements
     if (scr_draw2d->integer && !(cls.key_dest & KEY_MENU)) {
+        TD_START(TD_2D);
         draw_2d();
+        TD_STOP(TD_2D);
     }
 }
 
@@ -1947,7 +2172,9 @@ void SCR_UpdateScreen(void)
     }
 #endif
 
+    TD_START(TD_SWAP);
     R_EndFrame();
+    TD_STOP(TD_SWAP);
 
     recursive--;
 }
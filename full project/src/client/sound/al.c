@@ -23,12 +23,41 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define AL_UnpackVector(v)  -v[1],v[2],-v[0]
 #define AL_CopyVector(a,b)  ((b)[0]=-(a)[1],(b)[1]=(a)[2],(b)[2]=-(a)[0])
 
-// OpenAL implementation should support at least this number of sources
-#define MIN_CHANNELS 16
+// buffer names are generated this many at a time
+#define AL_BUFFER_BATCH     32
+#define AL_MAX_FREEBUFS     256
 
 static ALuint s_srcnums[MAX_CHANNELS];
 static int s_framecount;
 
+// what each source and the listener were last set to, so properties
+// that didn't change aren't sent to the driver again
+typedef struct {
+    ALfloat     gain;
+    ALfloat     rolloff;
+    ALint       looping;
+} alsource_t;
+
+static alsource_t s_srcstate[MAX_CHANNELS];
+
+static struct {
+    vec3_t      origin;
+    vec3_t      forward;
+    vec3_t      up;
+    ALfloat     gain;
+} s_listener;
+
+// names of freed buffers, reused by the next uploads
+static ALuint s_freebufs[AL_MAX_FREEBUFS];
+static int s_numfreebufs;
+
+static void AL_ResetSource(int i)
+{
+    s_srcstate[i].gain = -1;
+    s_srcstate[i].rolloff = -1;
+    s_srcstate[i].looping = -1;
+}
+
 void AL_SoundInfo(void)
 {
     Com_Printf("AL_VENDOR: %s\n", qalGetString(AL_VENDOR));
@@ -40,7 +69,7 @@ void AL_SoundInfo(void)
 
 qboolean AL_Init(void)
 {
-    int i;
+    int i, count;
 
     Com_DPrintf("Initializing OpenAL\n");
 
@@ -56,7 +85,8 @@ qboolean AL_Init(void)
 
     // generate source names
     qalGetError();
-    for (i = 0; i < MAX_CHANNELS; i++) {
+    count = Cvar_ClampInteger(s_channels, MIN_CHANNELS, MAX_CHANNELS);
+    for (i = 0; i < count; i++) {
         qalGenSources(1, &s_srcnums[i]);
         if (qalGetError() != AL_NO_ERROR) {
             break;
@@ -71,6 +101,18 @@ qboolean AL_Init(void)
     }
 
     s_numchannels = i;
+    s_channelsdirty = qtrue;
+
+    // these never change
+    for (i = 0; i < s_numchannels; i++) {
+        qalSourcef(s_srcnums[i], AL_REFERENCE_DISTANCE, SOUND_FULLVOLUME);
+        qalSourcef(s_srcnums[i], AL_MAX_DISTANCE, 8192);
+        AL_ResetSource(i);
+    }
+    qalDistanceModel(AL_LINEAR_DISTANCE_CLAMPED);
+
+    memset(&s_listener, 0, sizeof(s_listener));
+    s_listener.gain = -1;
 
     Com_Printf("OpenAL initialized.\n");
     return qtrue;
@@ -93,9 +135,37 @@ void AL_Shutdown(void)
         s_numchannels = 0;
     }
 
+    AL_TrimBuffers();
+
     QAL_Shutdown();
 }
 
+static void AL_FreeBuffer(ALuint name)
+{
+    if (s_numfreebufs == AL_MAX_FREEBUFS) {
+        qalDeleteBuffers(1, &name);
+        return;
+    }
+
+    s_freebufs[s_numfreebufs++] = name;
+}
+
+/*
+================
+AL_TrimBuffers
+
+Deletes pooled buffer names, which may still hold the data of sounds
+freed earlier. Called once registration has reused what it can.
+================
+*/
+void AL_TrimBuffers(void)
+{
+    if (s_numfreebufs) {
+        qalDeleteBuffers(s_numfreebufs, s_freebufs);
+        s_numfreebufs = 0;
+    }
+}
+
 sfxcache_t *AL_UploadSfx(sfx_t *s)
 {
     sfxcache_t *sc;
@@ -109,9 +179,19 @@ sfxcache_t *AL_UploadSfx(sfx_t *s)
     }
 
     qalGetError();
-    qalGenBuffers(1, &name);
+    if (!s_numfreebufs) {
+        qalGenBuffers(AL_BUFFER_BATCH, s_freebufs);
+        if (qalGetError() != AL_NO_ERROR) {
+            s->error = Q_ERR_LIBRARY_ERROR;
+            return NULL;
+        }
+        s_numfreebufs = AL_BUFFER_BATCH;
+    }
+
+    name = s_freebufs[--s_numfreebufs];
     qalBufferData(name, format, s_info.data, size, s_info.rate);
     if (qalGetError() != AL_NO_ERROR) {
+        AL_FreeBuffer(name);
         s->error = Q_ERR_LIBRARY_ERROR;
         return NULL;
     }
@@ -138,12 +218,13 @@ void AL_DeleteSfx(sfx_t *s)
     }
 
     name = sc->bufnum;
-    qalDeleteBuffers(1, &name);
+    AL_FreeBuffer(name);
 }
 
 static void AL_Spatialize(channel_t *ch)
 {
     vec3_t      origin;
+    int         priority;
 
     // anything coming from the view entity will always be full volume
     // no attenuation = no spatialization
@@ -155,7 +236,18 @@ static void AL_Spatialize(channel_t *ch)
         CL_GetEntitySoundOrigin(ch->entnum, origin);
     }
 
-    qalSource3f(ch->srcnum, AL_POSITION, AL_UnpackVector(origin));
+    if (!ch->spatialized || !VectorCompare(origin, ch->spatorigin)) {
+        qalSource3f(ch->srcnum, AL_POSITION, AL_UnpackVector(origin));
+        VectorCopy(origin, ch->spatorigin);
+        ch->spatialized = qtrue;
+    }
+
+    priority = S_SoundPriority(ch->entnum, ch->entchannel, ch->fixed_origin,
+                               ch->origin, ch->master_vol, ch->dist_mult);
+    if (ch->priority != priority) {
+        ch->priority = priority;
+        s_channelsdirty = qtrue;
+    }
 }
 
 void AL_StopChannel(channel_t *ch)
@@ -169,11 +261,15 @@ void AL_StopChannel(channel_t *ch)
     qalSourceStop(ch->srcnum);
     qalSourcei(ch->srcnum, AL_BUFFER, AL_NONE);
     memset(ch, 0, sizeof(*ch));
+    s_channelsdirty = qtrue;
 }
 
 void AL_PlayChannel(channel_t *ch)
 {
     sfxcache_t *sc = ch->sfx->cache;
+    alsource_t *src = &s_srcstate[ch - channels];
+    ALint looping = ch->autosound ? AL_TRUE : AL_FALSE;
+    ALfloat rolloff = ch->dist_mult * (8192 - SOUND_FULLVOLUME);
 
 #ifdef _DEBUG
     if (s_show->integer > 1)
@@ -184,17 +280,26 @@ void AL_PlayChannel(channel_t *ch)
     qalGetError();
     qalSourcei(ch->srcnum, AL_BUFFER, sc->bufnum);
     //qalSourcei(ch->srcnum, AL_LOOPING, sc->loopstart == -1 ? AL_FALSE : AL_TRUE);
-    qalSourcei(ch->srcnum, AL_LOOPING, ch->autosound ? AL_TRUE : AL_FALSE);
-    qalSourcef(ch->srcnum, AL_GAIN, ch->master_vol);
-    qalSourcef(ch->srcnum, AL_REFERENCE_DISTANCE, SOUND_FULLVOLUME);
-    qalSourcef(ch->srcnum, AL_MAX_DISTANCE, 8192);
-    qalSourcef(ch->srcnum, AL_ROLLOFF_FACTOR, ch->dist_mult * (8192 - SOUND_FULLVOLUME));
+    if (src->looping != looping) {
+        qalSourcei(ch->srcnum, AL_LOOPING, looping);
+        src->looping = looping;
+    }
+    if (src->gain != ch->master_vol) {
+        qalSourcef(ch->srcnum, AL_GAIN, ch->master_vol);
+        src->gain = ch->master_vol;
+    }
+    if (src->rolloff != rolloff) {
+        qalSourcef(ch->srcnum, AL_ROLLOFF_FACTOR, rolloff);
+        src->rolloff = rolloff;
+    }
 
     AL_Spatialize(ch);
 
     // play it
     qalSourcePlay(ch->srcnum);
     if (qalGetError() != AL_NO_ERROR) {
+        // don't know which call failed
+        AL_ResetSource(ch - channels);
         AL_StopChannel(ch);
     }
 }
@@ -286,7 +391,8 @@ static void AL_AddLoopSounds(void)
         }
 
         // allocate a channel
-        ch = S_PickChannel(0, 0);
+        ch = S_PickChannel(0, 0, S_SoundPriority(ent->number, 0, qfalse, NULL,
+                                                 1, SOUND_LOOPATTENUATE));
         if (!ch)
             continue;
 
@@ -315,12 +421,22 @@ void AL_Update(void)
     paintedtime = cl.time;
 
     // set listener parameters
-    qalListener3f(AL_POSITION, AL_UnpackVector(listener_origin));
-    AL_CopyVector(listener_forward, orientation);
-    AL_CopyVector(listener_up, orientation + 3);
-    qalListenerfv(AL_ORIENTATION, orientation);
-    qalListenerf(AL_GAIN, s_volume->value);
-    qalDistanceModel(AL_LINEAR_DISTANCE_CLAMPED);
+    if (!VectorCompare(listener_origin, s_listener.origin)) {
+        qalListener3f(AL_POSITION, AL_UnpackVector(listener_origin));
+        VectorCopy(listener_origin, s_listener.origin);
+    }
+    if (!VectorCompare(listener_forward, s_listener.forward) ||
+        !VectorCompare(listener_up, s_listener.up)) {
+        AL_CopyVector(listener_forward, orientation);
+        AL_CopyVector(listener_up, orientation + 3);
+        qalListenerfv(AL_ORIENTATION, orientation);
+        VectorCopy(listener_forward, s_listener.forward);
+        VectorCopy(listener_up, s_listener.up);
+    }
+    if (s_listener.gain != s_volume->value) {
+        qalListenerf(AL_GAIN, s_volume->value);
+        s_listener.gain = s_volume->value;
+    }
 
     // update spatialization for dynamic sounds
     ch = channels;
@@ -335,8 +451,14 @@ void AL_Update(void)
                 continue;
             }
         } else {
+            sfxcache_t *sc = ch->sfx->cache;
             ALenum state;
 
+            // can't have stopped before its length has played; if
+            // cl.time went backwards, ask anyway
+            if (sc && ch->end > paintedtime && ch->end - paintedtime <= sc->length)
+                goto spatialize;
+
             qalGetError();
             qalGetSourcei(ch->srcnum, AL_SOURCE_STATE, &state);
             if (qalGetError() != AL_NO_ERROR || state == AL_STOPPED) {
@@ -345,6 +467,7 @@ void AL_Update(void)
             }
         }
 
+spatialize:
 #ifdef _DEBUG
         if (s_show->integer) {
             Com_Printf("%.1f %s\n", ch->master_vol, ch->sfx->name);
@@ -18,18 +18,44 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // snd_dma.c -- main control for any streaming sound output device
 
 #include "sound.h"
+#include "system/thread.h"
+
+// how often the mixer thread tops up the buffer
+#define MIXER_MSEC  4
 
 dma_t       dma;
 
 cvar_t      *s_khz;
+cvar_t      *s_sfxcache;
+cvar_t      *s_streamsize;
 cvar_t      *s_testsound;
 #if USE_DSOUND
 static cvar_t       *s_direct;
 #endif
+#if USE_ALSA
+static cvar_t       *s_alsa;
+#endif
 static cvar_t       *s_mixahead;
+static cvar_t       *s_mixthread;
 
 static snddmaAPI_t snddma;
 
+/*
+The mixer thread owns DMA_Mix and everything it touches: the channels,
+the pending playsounds, paintedtime and the DMA buffer. The main thread
+takes the lock only to queue sounds and respatialize channels, never
+across loading, so a long frame no longer starves the device. Nested
+locking from the main thread is counted, it is the only one that nests.
+*/
+static struct {
+    qthread_t   *thread;
+    qmutex_t    *lock;
+    qboolean    quit;
+    int         depth;
+    int         overflows;
+    qboolean    stopall;
+} mixer;
+
 void DMA_SoundInfo(void)
 {
     Com_Printf("%5d channels\n", dma.channels);
@@ -47,11 +73,25 @@ qboolean DMA_Init(void)
 
     s_khz = Cvar_Get("s_khz", "22", CVAR_ARCHIVE | CVAR_SOUND);
     s_mixahead = Cvar_Get("s_mixahead", "0.2", CVAR_ARCHIVE);
+    s_mixthread = Cvar_Get("s_mixthread", "0", 0);
+    s_mixthread->modified = qtrue;
     s_testsound = Cvar_Get("s_testsound", "0", 0);
+    s_sfxcache = Cvar_Get("s_sfxcache", "4096", 0);
+    s_streamsize = Cvar_Get("s_streamsize", "1024", 0);
 
+#if USE_ALSA
+    s_alsa = Cvar_Get("s_alsa", "1", CVAR_SOUND);
+    if (s_alsa->integer) {
+        ALSA_FillAPI(&snddma);
+        ret = snddma.Init();
+        if (ret != SIS_SUCCESS) {
+            Cvar_Set("s_alsa", "0");
+        }
+    }
+#endif
 #if USE_DSOUND
     s_direct = Cvar_Get("s_direct", "1", CVAR_SOUND);
-    if (s_direct->integer) {
+    if (ret != SIS_SUCCESS && s_direct->integer) {
         DS_FillAPI(&snddma);
         ret = snddma.Init();
         if (ret != SIS_SUCCESS) {
@@ -69,15 +109,19 @@ qboolean DMA_Init(void)
 
     S_InitScaletable();
 
-    s_numchannels = MAX_CHANNELS;
+    s_numchannels = Cvar_ClampInteger(s_channels, MIN_CHANNELS, MAX_CHANNELS);
+    s_channelsdirty = qtrue;
 
     Com_Printf("sound sampling rate: %i\n", dma.speed);
 
     return qtrue;
 }
 
+static void DMA_StopMixer(void);
+
 void DMA_Shutdown(void)
 {
+    DMA_StopMixer();
     snddma.Shutdown();
     s_numchannels = 0;
 }
@@ -85,8 +129,10 @@ void DMA_Shutdown(void)
 void DMA_Activate(void)
 {
     if (snddma.Activate) {
+        DMA_LockMixer();
         S_StopAllSounds();
         snddma.Activate(s_active);
+        DMA_UnlockMixer();
     }
 }
 
@@ -139,7 +185,10 @@ static int DMA_GetTime(void)
             // time to chop things off to avoid 32 bit limits
             buffers = 0;
             paintedtime = fullsamples;
-            S_StopAllSounds();
+            if (mixer.thread)
+                mixer.stopall = qtrue;  // can't stop from here
+            else
+                S_StopAllSounds();
         }
     }
     oldsamplepos = dma.samplepos;
@@ -147,7 +196,7 @@ static int DMA_GetTime(void)
     return buffers * fullsamples + dma.samplepos / dma.channels;
 }
 
-void DMA_Update(void)
+static void DMA_Mix(void)
 {
     int soundtime, endtime;
     int samps;
@@ -162,7 +211,10 @@ void DMA_Update(void)
 
 // check to make sure that we haven't overshot
     if (paintedtime < soundtime) {
-        Com_DPrintf("S_Update_ : overflow\n");
+        if (mixer.thread)
+            mixer.overflows++;
+        else
+            Com_DPrintf("S_Update_ : overflow\n");
         paintedtime = soundtime;
     }
 
@@ -182,4 +234,86 @@ void DMA_Update(void)
     snddma.Submit();
 }
 
+/*
+=================
+MIXER THREAD
+=================
+*/
+
+static void DMA_MixerThread(void *arg)
+{
+    Sys_LockMutex(mixer.lock);
+    while (!mixer.quit) {
+        DMA_Mix();
+        Sys_UnlockMutex(mixer.lock);
+        Sys_Sleep(MIXER_MSEC);
+        Sys_LockMutex(mixer.lock);
+    }
+    Sys_UnlockMutex(mixer.lock);
+}
+
+static void DMA_StopMixer(void)
+{
+    if (!mixer.thread)
+        return;
+
+    Sys_LockMutex(mixer.lock);
+    mixer.quit = qtrue;
+    Sys_UnlockMutex(mixer.lock);
+
+    Sys_JoinThread(mixer.thread);
+    Sys_DestroyMutex(mixer.lock);
 
+    memset(&mixer, 0, sizeof(mixer));
+}
+
+static void DMA_StartMixer(void)
+{
+    mixer.lock = Sys_CreateMutex();
+    mixer.quit = qfalse;
+    mixer.thread = Sys_CreateThread(DMA_MixerThread, NULL);
+}
+
+void DMA_LockMixer(void)
+{
+    if (mixer.thread && !mixer.depth++)
+        Sys_LockMutex(mixer.lock);
+}
+
+void DMA_UnlockMixer(void)
+{
+    if (mixer.thread && !--mixer.depth)
+        Sys_UnlockMutex(mixer.lock);
+}
+
+void DMA_Update(void)
+{
+    int overflows;
+    qboolean stopall;
+
+    if (s_mixthread->modified) {
+        DMA_StopMixer();
+        if (s_mixthread->integer)
+            DMA_StartMixer();
+        s_mixthread->modified = qfalse;
+    }
+
+    if (!mixer.thread) {
+        DMA_Mix();
+        return;
+    }
+
+    // pick up what the mixer couldn't do itself
+    Sys_LockMutex(mixer.lock);
+    overflows = mixer.overflows;
+    stopall = mixer.stopall;
+    mixer.overflows = 0;
+    mixer.stopall = qfalse;
+    Sys_UnlockMutex(mixer.lock);
+
+    if (overflows)
+        Com_DPrintf("S_Update_ : %d overflows\n", overflows);
+
+    if (stopall)
+        S_StopAllSounds();
+}
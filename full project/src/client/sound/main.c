@@ -27,6 +27,7 @@ int         s_registration_sequence;
 
 channel_t   channels[MAX_CHANNELS];
 int         s_numchannels;
+qboolean    s_channelsdirty;
 
 sndstarted_t s_started;
 qboolean    s_active;
@@ -49,12 +50,16 @@ int         paintedtime;    // sample PAIRS
 static sfx_t        known_sfx[MAX_SFX];
 static int          num_sfx;
 
+#define     SFX_HASH    128
+static list_t       sfx_hash[SFX_HASH];
+
 #define     MAX_PLAYSOUNDS  128
 playsound_t s_playsounds[MAX_PLAYSOUNDS];
 playsound_t s_freeplays;
 playsound_t s_pendingplays;
 
 cvar_t      *s_volume;
+cvar_t      *s_channels;
 cvar_t      *s_ambient;
 #ifdef _DEBUG
 cvar_t      *s_show;
@@ -125,6 +130,9 @@ static const cmdreg_t c_sound[] = {
     { "stopsound", S_StopAllSounds },
     { "soundlist", S_SoundList_f },
     { "soundinfo", S_SoundInfo_f },
+#if USE_SNDDMA && USE_TESTS
+    { "mixbench", S_MixBench_f },
+#endif
 
     { NULL }
 };
@@ -145,6 +153,8 @@ S_Init
 */
 void S_Init(void)
 {
+    int i;
+
     s_enable = Cvar_Get("s_enable", "1", CVAR_SOUND);
     if (s_enable->integer <= SS_NOT) {
         Com_Printf("Sound initialization disabled.\n");
@@ -155,6 +165,7 @@ void S_Init(void)
 
     s_volume = Cvar_Get("s_volume", "0.7", CVAR_ARCHIVE);
     s_ambient = Cvar_Get("s_ambient", "1", 0);
+    s_channels = Cvar_Get("s_channels", "64", CVAR_SOUND);
 #ifdef _DEBUG
     s_show = Cvar_Get("s_show", "0", 0);
 #endif
@@ -188,6 +199,8 @@ void S_Init(void)
     s_auto_focus_changed(s_auto_focus);
 
     num_sfx = 0;
+    for (i = 0; i < SFX_HASH; i++)
+        List_Init(&sfx_hash[i]);
 
     paintedtime = 0;
 
@@ -208,11 +221,16 @@ static void S_FreeSound(sfx_t *sfx)
 #if USE_OPENAL
     if (s_started == SS_OAL)
         AL_DeleteSfx(sfx);
+#endif
+#if USE_SNDDMA
+    if (s_started == SS_DMA && sfx->cache)
+        S_CloseStream(sfx->cache);
 #endif
     if (sfx->cache)
         Z_Free(sfx->cache);
     if (sfx->truename)
         Z_Free(sfx->truename);
+    List_Remove(&sfx->entry);
     memset(sfx, 0, sizeof(*sfx));
 }
 
@@ -229,6 +247,11 @@ void S_FreeAllSounds(void)
     }
 
     num_sfx = 0;
+
+#if USE_SNDDMA
+    if (s_started == SS_DMA)
+        S_FlushSfxCache();
+#endif
 }
 
 void S_Shutdown(void)
@@ -236,8 +259,10 @@ void S_Shutdown(void)
     if (!s_started)
         return;
 
+    DMA_LockMixer();
     S_StopAllSounds();
     S_FreeAllSounds();
+    DMA_UnlockMixer();
 
 #if USE_OPENAL
     if (s_started == SS_OAL)
@@ -340,11 +365,12 @@ S_FindName
 */
 static sfx_t *S_FindName(const char *name, size_t namelen)
 {
-    int     i;
-    sfx_t   *sfx;
+    unsigned    hash;
+    sfx_t       *sfx;
 
     // see if already loaded
-    for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++) {
+    hash = FS_HashPathLen(name, namelen, SFX_HASH);
+    LIST_FOR_EACH(sfx_t, sfx, &sfx_hash[hash], entry) {
         if (!FS_pathcmp(sfx->name, name)) {
             sfx->registration_sequence = s_registration_sequence;
             return sfx;
@@ -356,6 +382,7 @@ static sfx_t *S_FindName(const char *name, size_t namelen)
     if (sfx) {
         memcpy(sfx->name, name, namelen + 1);
         sfx->registration_sequence = s_registration_sequence;
+        List_Append(&sfx_hash[hash], &sfx->entry);
     }
     return sfx;
 }
@@ -492,6 +519,7 @@ void S_EndRegistration(void)
 #endif
 
     // clear playsound list, so we don't free sfx still present there
+    DMA_LockMixer();
     S_StopAllSounds();
 
     // free any sounds not from this registration sequence
@@ -500,6 +528,10 @@ void S_EndRegistration(void)
             continue;
         if (sfx->registration_sequence != s_registration_sequence) {
             // don't need this sound
+#if USE_SNDDMA
+            if (s_started == SS_DMA)
+                S_RetireSound(sfx);
+#endif
             S_FreeSound(sfx);
             continue;
         }
@@ -516,6 +548,7 @@ void S_EndRegistration(void)
         }
 #endif
     }
+    DMA_UnlockMixer();
 
     // load everything in
     for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++) {
@@ -524,64 +557,193 @@ void S_EndRegistration(void)
         S_LoadSound(sfx);
     }
 
+#if USE_OPENAL
+    // drop buffers of freed sounds that weren't reused
+    if (s_started == SS_OAL)
+        AL_TrimBuffers();
+#endif
+
     s_registering = qfalse;
 }
 
 
 //=============================================================================
 
+/*
+=============================================================================
+
+CHANNEL STEALING
+
+Channels are kept in a binary min-heap ordered by priority, free ones
+first, then by the time they are due to end. Priorities change every
+frame as sounds are respatialized and when the mixer lets a channel run
+out, so those paths only flag the heap and it is rebuilt on the next pick.
+
+=============================================================================
+*/
+
+// above anything distance can produce, so other entities can't steal
+// sounds the listener makes
+#define PRIORITY_LOCAL  0x10000
+
+#define PRIORITY_FOR_VOLUME(vol, entchannel) \
+    (1 + (vol) * 2 + ((entchannel) != CHAN_AUTO))
+
+static int      s_heap[MAX_CHANNELS];       // channel numbers
+static int      s_heappos[MAX_CHANNELS];    // index into s_heap per channel
+
+static qboolean S_ChannelLess(int a, int b)
+{
+    const channel_t *x = &channels[a];
+    const channel_t *y = &channels[b];
+
+    if (x->priority != y->priority)
+        return x->priority < y->priority;
+    return x->end < y->end;
+}
+
+static void S_HeapSwap(int i, int j)
+{
+    int t = s_heap[i];
+
+    s_heap[i] = s_heap[j];
+    s_heap[j] = t;
+    s_heappos[s_heap[i]] = i;
+    s_heappos[s_heap[j]] = j;
+}
+
+static void S_HeapDown(int i)
+{
+    int child;
+
+    while ((child = i * 2 + 1) < s_numchannels) {
+        if (child + 1 < s_numchannels && S_ChannelLess(s_heap[child + 1], s_heap[child]))
+            child++;
+        if (!S_ChannelLess(s_heap[child], s_heap[i]))
+            break;
+        S_HeapSwap(i, child);
+        i = child;
+    }
+}
+
+static void S_HeapUp(int i)
+{
+    int parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!S_ChannelLess(s_heap[i], s_heap[parent]))
+            break;
+        S_HeapSwap(i, parent);
+        i = parent;
+    }
+}
+
+static void S_BuildChannelHeap(void)
+{
+    int i;
+
+    for (i = 0; i < s_numchannels; i++) {
+        s_heap[i] = i;
+        s_heappos[i] = i;
+    }
+
+    for (i = s_numchannels / 2 - 1; i >= 0; i--)
+        S_HeapDown(i);
+
+    s_channelsdirty = qfalse;
+}
+
+/*
+=================
+S_SoundPriority
+
+Roughly how loud the sound will be heard, ignoring stereo separation.
+Sounds on an explicit entity channel win ties over CHAN_AUTO ones.
+=================
+*/
+int S_SoundPriority(int entnum, int entchannel, qboolean fixed_origin,
+                    const vec3_t fixed, float master_vol, float dist_mult)
+{
+    vec3_t      origin;
+    vec_t       dist;
+    int         vol;
+
+    if (entnum == -1 || entnum == listener_entnum)
+        return PRIORITY_LOCAL;
+
+    if (cls.state != ca_active || !dist_mult) {
+        vol = master_vol * 255;
+    } else {
+        if (fixed_origin)
+            VectorCopy(fixed, origin);
+        else
+            CL_GetEntitySoundOrigin(entnum, origin);
+
+        dist = Distance(origin, listener_origin) - SOUND_FULLVOLUME;
+        if (dist < 0)
+            dist = 0;
+        vol = master_vol * 255 * (1.0 - dist * dist_mult);
+        clamp(vol, 0, 255);
+    }
+
+    return PRIORITY_FOR_VOLUME(vol, entchannel);
+}
+
 /*
 =================
 S_PickChannel
 
-picks a channel based on priorities, empty slots, number of channels
+Sounds on the same entity channel replace each other. Otherwise the
+least important channel is stolen, unless the new sound is even less
+important, in which case it is dropped.
 =================
 */
-channel_t *S_PickChannel(int entnum, int entchannel)
+channel_t *S_PickChannel(int entnum, int entchannel, int priority)
 {
     int         ch_idx;
-    int         first_to_die;
-    int         life_left;
     channel_t   *ch;
 
     if (entchannel < 0)
         Com_Error(ERR_DROP, "S_PickChannel: entchannel < 0");
 
-// Check for replacement sound, or find the best one to replace
-    first_to_die = -1;
-    life_left = 0x7fffffff;
-    for (ch_idx = 0; ch_idx < s_numchannels; ch_idx++) {
-        ch = &channels[ch_idx];
-        // channel 0 never overrides unless out of channels
-        if (ch->entnum == entnum && ch->entchannel == entchannel && entchannel != 0) {
-            if (entchannel == 256 && ch->sfx) {
-                return NULL; // channel 256 never overrides
+    if (s_channelsdirty)
+        S_BuildChannelHeap();
+
+// Check for replacement sound
+    // channel 0 never overrides unless out of channels
+    if (entchannel != 0) {
+        for (ch_idx = 0; ch_idx < s_numchannels; ch_idx++) {
+            ch = &channels[ch_idx];
+            if (ch->entnum == entnum && ch->entchannel == entchannel) {
+                if (entchannel == 256 && ch->sfx) {
+                    return NULL; // channel 256 never overrides
+                }
+                // always override sound from same entity
+                goto replace;
             }
-            // always override sound from same entity
-            first_to_die = ch_idx;
-            break;
-        }
-
-        // don't let monster sounds override player sounds
-        if (ch->entnum == listener_entnum && entnum != listener_entnum && ch->sfx)
-            continue;
-
-        if (ch->end - paintedtime < life_left) {
-            life_left = ch->end - paintedtime;
-            first_to_die = ch_idx;
         }
     }
 
-    if (first_to_die == -1)
+// Or steal the least important one
+    ch_idx = s_heap[0];
+    ch = &channels[ch_idx];
+    if (ch->priority > priority)
         return NULL;
 
-    ch = &channels[first_to_die];
+replace:
 #if USE_OPENAL
     if (s_started == SS_OAL && ch->sfx)
         AL_StopChannel(ch);
 #endif
     memset(ch, 0, sizeof(*ch));
 
+    // AL_StopChannel flags the heap, it is still valid apart from this one
+    s_channelsdirty = qfalse;
+    ch->priority = priority;
+    S_HeapUp(s_heappos[ch_idx]);
+    S_HeapDown(s_heappos[ch_idx]);
+
     return ch;
 }
 
@@ -645,28 +807,227 @@ static void S_SpatializeOrigin(const vec3_t origin, float master_vol, float dist
 S_Spatialize
 =================
 */
-static void S_Spatialize(channel_t *ch)
+static void S_SpatializeSource(int entnum, qboolean fixed_origin, const vec3_t fixed,
+                               float master_vol, float dist_mult, int *left_vol, int *right_vol)
 {
     vec3_t      origin;
 
     // anything coming from the view entity will always be full volume
-    if (ch->entnum == -1 || ch->entnum == listener_entnum) {
-        ch->leftvol = ch->master_vol * 255;
-        ch->rightvol = ch->master_vol * 255;
+    if (entnum == -1 || entnum == listener_entnum) {
+        *left_vol = master_vol * 255;
+        *right_vol = master_vol * 255;
         return;
     }
 
-    if (ch->fixed_origin) {
-        VectorCopy(ch->origin, origin);
+    if (fixed_origin) {
+        VectorCopy(fixed, origin);
     } else {
-        CL_GetEntitySoundOrigin(ch->entnum, origin);
+        CL_GetEntitySoundOrigin(entnum, origin);
+    }
+
+    S_SpatializeOrigin(origin, master_vol, dist_mult, left_vol, right_vol);
+}
+
+static void S_Spatialize(channel_t *ch)
+{
+    S_SpatializeSource(ch->entnum, ch->fixed_origin, ch->origin,
+                       ch->master_vol, ch->dist_mult, &ch->leftvol, &ch->rightvol);
+    ch->priority = S_SoundPriority(ch->entnum, ch->entchannel, ch->fixed_origin,
+                                   ch->origin, ch->master_vol, ch->dist_mult);
+}
+
+/*
+=================
+S_SpatializeChannels
+
+Respatializes every playing channel once a frame. The offsets of those
+that need it are gathered into flat arrays so distances and pans are
+worked out four at a time; channels that haven't moved relative to the
+listener since last frame keep their volumes.
+=================
+*/
+static struct {
+    float       x[MAX_CHANNELS];
+    float       y[MAX_CHANNELS];
+    float       z[MAX_CHANNELS];
+    float       dist[MAX_CHANNELS];
+    float       dot[MAX_CHANNELS];
+    channel_t   *ch[MAX_CHANNELS];
+    vec3_t      origin;     // listener last frame
+    vec3_t      right;
+} spat;
+
+static void S_SpatializeBatch(int count)
+{
+    int     i = 0;
+    float   length, ilength;
+
+#if USE_SSE2
+    __m128 rx = _mm_set1_ps(listener_right[0]);
+    __m128 ry = _mm_set1_ps(listener_right[1]);
+    __m128 rz = _mm_set1_ps(listener_right[2]);
+    __m128 one = _mm_set1_ps(1);
+    __m128 zero = _mm_setzero_ps();
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(spat.x + i);
+        __m128 y = _mm_loadu_ps(spat.y + i);
+        __m128 z = _mm_loadu_ps(spat.z + i);
+        __m128 len, il, dot;
+
+        // same operations in the same order as VectorNormalize
+        len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        len = _mm_sqrt_ps(len);
+        il = _mm_and_ps(_mm_div_ps(one, len), _mm_cmpgt_ps(len, zero));
+
+        dot = _mm_add_ps(_mm_mul_ps(rx, _mm_mul_ps(x, il)), _mm_mul_ps(ry, _mm_mul_ps(y, il)));
+        dot = _mm_add_ps(dot, _mm_mul_ps(rz, _mm_mul_ps(z, il)));
+
+        _mm_storeu_ps(spat.dist + i, len);
+        _mm_storeu_ps(spat.dot + i, dot);
+    }
+#elif USE_NEON && (defined __aarch64__)
+    float32x4_t one = vdupq_n_f32(1);
+
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vld1q_f32(spat.x + i);
+        float32x4_t y = vld1q_f32(spat.y + i);
+        float32x4_t z = vld1q_f32(spat.z + i);
+        float32x4_t len, il, dot;
+
+        len = vaddq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)), vmulq_f32(z, z));
+        len = vsqrtq_f32(len);
+        il = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(one, len)),
+                                             vcgtq_f32(len, vdupq_n_f32(0))));
+
+        dot = vaddq_f32(vmulq_n_f32(vmulq_f32(x, il), listener_right[0]),
+                        vmulq_n_f32(vmulq_f32(y, il), listener_right[1]));
+        dot = vaddq_f32(dot, vmulq_n_f32(vmulq_f32(z, il), listener_right[2]));
+
+        vst1q_f32(spat.dist + i, len);
+        vst1q_f32(spat.dot + i, dot);
     }
+#endif
+
+    for (; i < count; i++) {
+        length = spat.x[i] * spat.x[i] + spat.y[i] * spat.y[i] + spat.z[i] * spat.z[i];
+        length = sqrt(length);
+        ilength = length ? 1 / length : 0;
 
-    S_SpatializeOrigin(origin, ch->master_vol, ch->dist_mult, &ch->leftvol, &ch->rightvol);
+        spat.dist[i] = length;
+        spat.dot[i] = listener_right[0] * (spat.x[i] * ilength) +
+                      listener_right[1] * (spat.y[i] * ilength) +
+                      listener_right[2] * (spat.z[i] * ilength);
+    }
+}
+
+// returns true if any channel changed
+static qboolean S_SpatializeChannels(void)
+{
+    channel_t   *ch;
+    vec3_t      origin;
+    vec_t       dist, lscale, rscale, scale, master_vol;
+    qboolean    moved, changed = qfalse;
+    int         i, count = 0, vol;
+
+    moved = !VectorCompare(listener_origin, spat.origin) ||
+            !VectorCompare(listener_right, spat.right);
+    VectorCopy(listener_origin, spat.origin);
+    VectorCopy(listener_right, spat.right);
+
+    for (i = 0, ch = channels; i < s_numchannels; i++, ch++) {
+        if (!ch->sfx)
+            continue;
+
+        if (ch->autosound) {
+            // autosounds are regenerated fresh each frame
+            memset(ch, 0, sizeof(*ch));
+            changed = qtrue;
+            continue;
+        }
+
+        // these don't depend on the origin
+        if (cls.state != ca_active || ch->entnum == -1 || ch->entnum == listener_entnum) {
+            S_Spatialize(ch);
+            ch->spatialized = qfalse;
+            changed = qtrue;
+            if (!ch->leftvol && !ch->rightvol)
+                memset(ch, 0, sizeof(*ch));
+            continue;
+        }
+
+        if (ch->fixed_origin)
+            VectorCopy(ch->origin, origin);
+        else
+            CL_GetEntitySoundOrigin(ch->entnum, origin);
+
+        if (ch->spatialized && !moved && VectorCompare(origin, ch->spatorigin))
+            continue;
+
+        VectorCopy(origin, ch->spatorigin);
+        spat.x[count] = origin[0] - listener_origin[0];
+        spat.y[count] = origin[1] - listener_origin[1];
+        spat.z[count] = origin[2] - listener_origin[2];
+        spat.ch[count++] = ch;
+    }
+
+    if (!count)
+        return changed;
+
+    S_SpatializeBatch(count);
+
+    // the rest matches S_SpatializeOrigin
+    for (i = 0; i < count; i++) {
+        ch = spat.ch[i];
+
+        dist = spat.dist[i] - SOUND_FULLVOLUME;
+        if (dist < 0)
+            dist = 0;
+        dist *= ch->dist_mult;
+
+        if (dma.channels == 1 || !ch->dist_mult) {
+            rscale = 1.0;
+            lscale = 1.0;
+        } else {
+            rscale = 0.5 * (1.0 + spat.dot[i]);
+            lscale = 0.5 * (1.0 - spat.dot[i]);
+        }
+
+        master_vol = ch->master_vol * 255.0;
+
+        scale = (1.0 - dist) * rscale;
+        ch->rightvol = (int)(master_vol * scale);
+        if (ch->rightvol < 0)
+            ch->rightvol = 0;
+
+        scale = (1.0 - dist) * lscale;
+        ch->leftvol = (int)(master_vol * scale);
+        if (ch->leftvol < 0)
+            ch->leftvol = 0;
+
+        if (!ch->leftvol && !ch->rightvol) {
+            memset(ch, 0, sizeof(*ch));
+            continue;
+        }
+
+        vol = master_vol * (1.0 - dist);
+        clamp(vol, 0, 255);
+        ch->priority = PRIORITY_FOR_VOLUME(vol, ch->entchannel);
+        ch->spatialized = qtrue;
+    }
+
+    return qtrue;
 }
 
 #endif
 
+static float S_DistMult(float attenuation)
+{
+    if (attenuation == ATTN_STATIC)
+        return attenuation * 0.001;
+    return attenuation * 0.0005;
+}
+
 /*
 =================
 S_AllocPlaysound
@@ -725,29 +1086,41 @@ void S_IssuePlaysound(playsound_t *ps)
         Com_Printf("Issue %i\n", ps->begin);
 #endif
     // pick a channel to play on
-    ch = S_PickChannel(ps->entnum, ps->entchannel);
+    ch = S_PickChannel(ps->entnum, ps->entchannel, ps->priority);
     if (!ch) {
         S_FreePlaysound(ps);
         return;
     }
 
-    sc = S_LoadSound(ps->sfx);
+    // S_StartSound loaded it, and this may run on the mixer thread
+    sc = ps->sfx->cache;
     if (!sc) {
-        Com_Printf("S_IssuePlaysound: couldn't load %s\n", ps->sfx->name);
         S_FreePlaysound(ps);
         return;
     }
 
     // spatialize
-    if (ps->attenuation == ATTN_STATIC)
-        ch->dist_mult = ps->attenuation * 0.001;
-    else
-        ch->dist_mult = ps->attenuation * 0.0005;
+    ch->dist_mult = S_DistMult(ps->attenuation);
     ch->master_vol = ps->volume;
     ch->entnum = ps->entnum;
     ch->entchannel = ps->entchannel;
     ch->sfx = ps->sfx;
     VectorCopy(ps->origin, ch->origin);
+
+#if USE_SNDDMA
+    // streams have one read position, cut whoever else is playing it
+    if (s_started == SS_DMA && sc->stream) {
+        channel_t   *other;
+        int         i;
+
+        for (i = 0, other = channels; i < s_numchannels; i++, other++) {
+            if (other != ch && other->sfx == ch->sfx) {
+                memset(other, 0, sizeof(*other));
+                s_channelsdirty = qtrue;
+            }
+        }
+    }
+#endif
     ch->fixed_origin = ps->fixed_origin;
 
 #if USE_OPENAL
@@ -756,8 +1129,10 @@ void S_IssuePlaysound(playsound_t *ps)
 #endif
 
 #if USE_SNDDMA
-    if (s_started == SS_DMA)
-        S_Spatialize(ch);
+    if (s_started == SS_DMA) {
+        ch->leftvol = ps->leftvol;
+        ch->rightvol = ps->rightvol;
+    }
 #endif
 
     ch->pos = 0;
@@ -807,9 +1182,12 @@ void S_StartSound(const vec3_t origin, int entnum, int entchannel, qhandle_t hSf
         return;     // couldn't load the sound's data
 
     // make the playsound_t
+    DMA_LockMixer();
     ps = S_AllocPlaysound();
-    if (!ps)
+    if (!ps) {
+        DMA_UnlockMixer();
         return;
+    }
 
     if (origin) {
         VectorCopy(origin, ps->origin);
@@ -823,6 +1201,8 @@ void S_StartSound(const vec3_t origin, int entnum, int entchannel, qhandle_t hSf
     ps->attenuation = attenuation;
     ps->volume = vol;
     ps->sfx = sfx;
+    ps->priority = S_SoundPriority(entnum, entchannel, ps->fixed_origin, ps->origin,
+                                   vol, S_DistMult(attenuation));
 
 #if USE_OPENAL
     if (s_started == SS_OAL)
@@ -830,8 +1210,11 @@ void S_StartSound(const vec3_t origin, int entnum, int entchannel, qhandle_t hSf
 #endif
 
 #if USE_SNDDMA
-    if (s_started == SS_DMA)
+    if (s_started == SS_DMA) {
         ps->begin = DMA_DriftBeginofs(timeofs);
+        S_SpatializeSource(entnum, ps->fixed_origin, ps->origin, vol,
+                           S_DistMult(attenuation), &ps->leftvol, &ps->rightvol);
+    }
 #endif
 
     // sort into the pending sound list
@@ -843,6 +1226,7 @@ void S_StartSound(const vec3_t origin, int entnum, int entchannel, qhandle_t hSf
 
     ps->next->prev = ps;
     ps->prev->next = ps;
+    DMA_UnlockMixer();
 }
 
 void S_ParseStartSound(void)
@@ -895,6 +1279,8 @@ void S_StopAllSounds(void)
     if (!s_started)
         return;
 
+    DMA_LockMixer();
+
     // clear all the playsounds
     memset(s_playsounds, 0, sizeof(s_playsounds));
     s_freeplays.next = s_freeplays.prev = &s_freeplays;
@@ -919,6 +1305,9 @@ void S_StopAllSounds(void)
 
     // clear all the channels
     memset(channels, 0, sizeof(channels));
+    s_channelsdirty = qtrue;
+
+    DMA_UnlockMixer();
 }
 
 // =======================================================================
@@ -1009,15 +1398,16 @@ static void S_AddLoopSounds(void)
         if (left_total == 0 && right_total == 0)
             continue;       // not audible
 
-        // allocate a channel
-        ch = S_PickChannel(0, 0);
-        if (!ch)
-            return;
-
         if (left_total > 255)
             left_total = 255;
         if (right_total > 255)
             right_total = 255;
+
+        // allocate a channel
+        ch = S_PickChannel(0, 0, 1 + left_total + right_total);
+        if (!ch)
+            return;
+
         ch->leftvol = left_total;
         ch->rightvol = right_total;
         ch->autosound = qtrue;  // remove next frame
@@ -1038,7 +1428,7 @@ Called once each time through the main loop
 */
 void S_Update(void)
 {
-#if USE_SNDDMA
+#if USE_SNDDMA && (defined _DEBUG)
     int         i;
     channel_t   *ch;
 #endif
@@ -1076,30 +1466,22 @@ void S_Update(void)
 #endif
 
 #if USE_SNDDMA
+    DMA_LockMixer();
+
     // rebuild scale tables if volume is modified
     if (s_volume->modified)
         S_InitScaletable();
 
     // update spatialization for dynamic sounds
-    ch = channels;
-    for (i = 0; i < s_numchannels; i++, ch++) {
-        if (!ch->sfx)
-            continue;
-        if (ch->autosound) {
-            // autosounds are regenerated fresh each frame
-            memset(ch, 0, sizeof(*ch));
-            continue;
-        }
-        S_Spatialize(ch);         // respatialize channel
-        if (!ch->leftvol && !ch->rightvol) {
-            memset(ch, 0, sizeof(*ch));
-            continue;
-        }
-    }
+    if (S_SpatializeChannels())
+        s_channelsdirty = qtrue;
 
     // add loopsounds
     S_AddLoopSounds();
 
+    // read ahead of long sounds
+    S_UpdateStreams();
+
 #ifdef _DEBUG
     //
     // debugging output
@@ -1119,6 +1501,8 @@ void S_Update(void)
     }
 #endif
 
+    DMA_UnlockMixer();
+
 // mix some sound
     DMA_Update();
 #endif
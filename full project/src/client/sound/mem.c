@@ -50,6 +50,7 @@ static sfxcache_t *ResampleSfx(sfx_t *sfx)
     sc->length = outcount;
     sc->loopstart = s_info.loopstart == -1 ? -1 : s_info.loopstart / stepscale;
     sc->width = s_info.width;
+    sc->stream = NULL;
 
 // resample / decimate to the current source rate
 //Com_Printf("%s: %f, %d\n",sfx->name,stepscale,sc->width);
@@ -87,6 +88,335 @@ static sfxcache_t *ResampleSfx(sfx_t *sfx)
 
     return sc;
 }
+
+/*
+===============================================================================
+
+SFX CACHE
+
+Resampled sounds dropped at the end of registration are kept around, up
+to s_sfxcache kilobytes, so going back to a map doesn't resample them
+again. Entries are checked against the rate they were resampled for and
+the length of the file, which is cheap to get without reading it.
+
+===============================================================================
+*/
+
+typedef struct {
+    list_t      entry;
+    char        name[MAX_QPATH];
+    int         rate;
+    size_t      size;
+    sfxcache_t  *sc;
+} sfxretired_t;
+
+static LIST_DECL(s_retired);
+static size_t   s_retiredsize;
+
+static void DropRetired(sfxretired_t *r)
+{
+    List_Remove(&r->entry);
+    s_retiredsize -= r->size;
+    Z_Free(r->sc);
+    Z_Free(r);
+}
+
+/*
+================
+S_RetireSound
+
+Takes the cache away from a sound about to be freed.
+================
+*/
+void S_RetireSound(sfx_t *sfx)
+{
+    sfxcache_t      *sc = sfx->cache;
+    sfxretired_t    *r;
+    size_t          size, limit;
+
+    if (!sc || sc->stream)
+        return;
+
+    limit = (size_t)Cvar_ClampInteger(s_sfxcache, 0, 1024 * 1024) * 1024;
+    size = sc->length * sc->width;
+    if (size > limit)
+        return;
+
+    r = S_Malloc(sizeof(*r));
+    Q_strlcpy(r->name, sfx->truename ? sfx->truename : sfx->name, sizeof(r->name));
+    r->rate = dma.speed;
+    r->size = size;
+    r->sc = sc;
+    List_Append(&s_retired, &r->entry);
+    s_retiredsize += size;
+    sfx->cache = NULL;
+
+    // drop the oldest ones
+    while (s_retiredsize > limit)
+        DropRetired(LIST_FIRST(sfxretired_t, &s_retired, entry));
+}
+
+static sfxcache_t *FindRetired(const char *name)
+{
+    sfxretired_t    *r;
+    sfxcache_t      *sc;
+    qhandle_t       f;
+    ssize_t         len;
+
+    LIST_FOR_EACH(sfxretired_t, r, &s_retired, entry) {
+        if (FS_pathcmp(r->name, name))
+            continue;
+
+        sc = NULL;
+        if (r->rate == dma.speed) {
+            len = FS_FOpenFile(name, &f, FS_MODE_READ);
+            if (f) {
+                FS_FCloseFile(f);
+                if (len == r->sc->srclen)
+                    sc = r->sc;
+            }
+        }
+
+        if (sc) {
+            r->sc = NULL;
+            s_retiredsize -= r->size;
+            List_Remove(&r->entry);
+            Z_Free(r);
+        } else {
+            DropRetired(r);
+        }
+        return sc;
+    }
+
+    return NULL;
+}
+
+void S_FlushSfxCache(void)
+{
+    sfxretired_t    *r, *next;
+
+    LIST_FOR_EACH_SAFE(sfxretired_t, r, next, &s_retired, entry)
+        DropRetired(r);
+}
+
+/*
+===============================================================================
+
+STREAMING
+
+Long one-shot sounds aren't resampled whole. Their cache holds a ring of
+STREAM_SAMPLES resampled samples instead, refilled from the open file
+every frame just ahead of the channel playing it. A stream has a single
+read position, so it plays on one channel at a time.
+
+===============================================================================
+*/
+
+#define STREAM_SAMPLES  65536   // must be a power of two
+#define STREAM_MASK     (STREAM_SAMPLES - 1)
+#define STREAM_CHUNK    16384   // bytes read from the file at once
+
+typedef struct sndstream_s {
+    list_t      entry;
+    sfxcache_t  *sc;
+    qhandle_t   f;
+    int         dataofs;    // of the first sample in the file
+    int         fracstep;   // source samples per output sample, 8.8 fixed
+    int         srcpos;     // next source sample to read
+    byte        prev[2];    // last source sample read
+    int         start;      // first output sample in the ring
+    int         decoded;    // one past the last output sample in the ring
+    qboolean    error;
+} sndstream_t;
+
+static LIST_DECL(s_streams);
+
+#define SRC_SAMPLE(st, i)   (int)(((int64_t)(i) * (st)->fracstep) >> 8)
+
+static void DecodeStream(sfxcache_t *sc, int count)
+{
+    static byte buffer[STREAM_CHUNK];
+    sndstream_t *st = sc->stream;
+    int         width = sc->width;
+    int         out = st->decoded;
+    int         first, last, base, i, j;
+    ssize_t     ret;
+
+    first = SRC_SAMPLE(st, out);
+    last = SRC_SAMPLE(st, out + count - 1);
+
+    if (!st->error && (first < st->srcpos - 1 || first > st->srcpos + 8)) {
+        if (FS_Seek(st->f, st->dataofs + first * width)) {
+            st->error = qtrue;
+        }
+        st->srcpos = first;
+    }
+
+    // the previous sample goes in front, neighbouring output samples
+    // may come from the same source one when upsampling, and a few
+    // skipped ones are read through rather than sought over
+    base = st->srcpos - 1;
+    memcpy(buffer, st->prev, width);
+    if (last >= st->srcpos && !st->error) {
+        ret = FS_Read(buffer + width, (last - base) * width, st->f);
+        if (ret != (last - base) * width) {
+            Com_DPrintf("Couldn't read sound stream\n");
+            st->error = qtrue;
+        }
+        memcpy(st->prev, buffer + (last - base) * width, width);
+        st->srcpos = last + 1;
+    }
+
+    // silence the rest after a read error
+    if (st->error) {
+        for (i = 0; i < count; i++) {
+            j = (out + i) & STREAM_MASK;
+            if (width == 1)
+                sc->data[j] = 128;
+            else
+                ((int16_t *)sc->data)[j] = 0;
+        }
+    } else if (width == 1) {
+        for (i = 0; i < count; i++) {
+            j = (out + i) & STREAM_MASK;
+            sc->data[j] = buffer[SRC_SAMPLE(st, out + i) - base];
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            j = (out + i) & STREAM_MASK;
+            ((uint16_t *)sc->data)[j] =
+                LittleShortMem(buffer + (SRC_SAMPLE(st, out + i) - base) * 2);
+        }
+    }
+
+    st->decoded += count;
+}
+
+static void FillStream(sfxcache_t *sc, int pos)
+{
+    sndstream_t *st = sc->stream;
+    int         end, count, chunk;
+
+    // jumped somewhere else, start over from there
+    if (pos < st->start || pos > st->decoded)
+        st->decoded = pos;
+    st->start = pos;
+
+    end = min(pos + STREAM_SAMPLES, sc->length);
+
+    // enough output samples to keep the source span within the buffer
+    chunk = (STREAM_CHUNK / sc->width - 16) * 256 / max(st->fracstep, 256);
+
+    while (st->decoded < end) {
+        count = min(end - st->decoded, chunk);
+        DecodeStream(sc, count);
+    }
+}
+
+static sfxcache_t *OpenStream(sfx_t *sfx, const char *name, int dataofs)
+{
+    float       stepscale;
+    int         outcount;
+    sfxcache_t  *sc;
+    sndstream_t *st;
+    qhandle_t   f;
+
+    if (s_info.loopstart != -1 || s_streamsize->integer <= 0)
+        return NULL;
+
+    stepscale = (float)s_info.rate / dma.speed;
+    outcount = s_info.samples / stepscale;
+    if ((int64_t)outcount * s_info.width <= (int64_t)s_streamsize->integer * 1024)
+        return NULL;
+
+    // deflated pak members can't seek
+    FS_FOpenFile(name, &f, FS_MODE_READ);
+    if (!f)
+        return NULL;
+    if (FS_Seek(f, dataofs)) {
+        FS_FCloseFile(f);
+        return NULL;
+    }
+
+    sc = sfx->cache = S_Malloc(STREAM_SAMPLES * s_info.width + sizeof(sfxcache_t) - 1);
+    sc->length = outcount;
+    sc->loopstart = -1;
+    sc->width = s_info.width;
+
+    st = sc->stream = S_Malloc(sizeof(*st));
+    memset(st, 0, sizeof(*st));
+    st->sc = sc;
+    st->f = f;
+    st->dataofs = dataofs;
+    st->fracstep = stepscale * 256;
+    List_Append(&s_streams, &st->entry);
+
+    FillStream(sc, 0);
+
+    Com_DPrintf("Streaming %s\n", name);
+    return sc;
+}
+
+void S_CloseStream(sfxcache_t *sc)
+{
+    sndstream_t *st = sc->stream;
+
+    if (!st)
+        return;
+
+    FS_FCloseFile(st->f);
+    List_Remove(&st->entry);
+    Z_Free(st);
+    sc->stream = NULL;
+}
+
+/*
+================
+S_UpdateStreams
+
+Called every frame with the mixer locked. Idle streams are rewound so
+they are ready to play again.
+================
+*/
+void S_UpdateStreams(void)
+{
+    sndstream_t *st;
+    channel_t   *ch;
+    int         i, pos;
+
+    LIST_FOR_EACH(sndstream_t, st, &s_streams, entry) {
+        pos = 0;
+        for (i = 0, ch = channels; i < s_numchannels; i++, ch++) {
+            if (ch->sfx && ch->sfx->cache == st->sc) {
+                pos = ch->pos;
+                break;
+            }
+        }
+        FillStream(st->sc, pos);
+    }
+}
+
+/*
+================
+S_StreamData
+
+Returns where the mixer can read from for a channel at pos, clipping
+count to what is contiguous in the ring. NULL if it has run dry.
+================
+*/
+const byte *S_StreamData(sfxcache_t *sc, int pos, int *count)
+{
+    sndstream_t *st = sc->stream;
+    int         ofs;
+
+    if (pos < st->start || pos >= st->decoded)
+        return NULL;
+
+    ofs = pos & STREAM_MASK;
+    *count = min(*count, st->decoded - pos);
+    *count = min(*count, STREAM_SAMPLES - ofs);
+    return sc->data + ofs * sc->width;
+}
 #endif
 
 /*
@@ -331,6 +661,14 @@ sfxcache_t *S_LoadSound(sfx_t *s)
     else
         name = s->name;
 
+#if USE_SNDDMA
+    if (s_started == SS_DMA) {
+        sc = s->cache = FindRetired(name);
+        if (sc)
+            return sc;
+    }
+#endif
+
     len = FS_LoadFile(name, (void **)&data);
     if (!data) {
         s->error = len;
@@ -353,8 +691,13 @@ sfxcache_t *S_LoadSound(sfx_t *s)
 #endif
 
 #if USE_SNDDMA
-    if (s_started == SS_DMA)
-        sc = ResampleSfx(s);
+    if (s_started == SS_DMA) {
+        sc = OpenStream(s, name, s_info.data - data);
+        if (!sc)
+            sc = ResampleSfx(s);
+        if (sc)
+            sc->srclen = len;
+    }
 #endif
 
 fail:
@@ -28,7 +28,34 @@ static void WriteLinearBlast(int16_t *out, samplepair_t *samp, int count)
 {
     int i, val;
 
-    for (i = 0; i < count; i++, samp++, out += 2) {
+    i = 0;
+
+    // saturating packs do the clamping, 8 sample pairs at a time
+#if USE_SSE2
+    for (; i + 8 <= count; i += 8, samp += 8, out += 16) {
+        __m128i a = _mm_loadu_si128((__m128i *)samp + 0);
+        __m128i b = _mm_loadu_si128((__m128i *)samp + 1);
+        __m128i c = _mm_loadu_si128((__m128i *)samp + 2);
+        __m128i d = _mm_loadu_si128((__m128i *)samp + 3);
+
+        a = _mm_packs_epi32(_mm_srai_epi32(a, 8), _mm_srai_epi32(b, 8));
+        c = _mm_packs_epi32(_mm_srai_epi32(c, 8), _mm_srai_epi32(d, 8));
+        _mm_storeu_si128((__m128i *)out + 0, a);
+        _mm_storeu_si128((__m128i *)out + 1, c);
+    }
+#elif USE_NEON
+    for (; i + 8 <= count; i += 8, samp += 8, out += 16) {
+        const int32_t *p = (const int32_t *)samp;
+        int16x8_t a = vcombine_s16(vqshrn_n_s32(vld1q_s32(p + 0), 8),
+                                   vqshrn_n_s32(vld1q_s32(p + 4), 8));
+        int16x8_t c = vcombine_s16(vqshrn_n_s32(vld1q_s32(p + 8), 8),
+                                   vqshrn_n_s32(vld1q_s32(p + 12), 8));
+        vst1q_s16(out + 0, a);
+        vst1q_s16(out + 8, c);
+    }
+#endif
+
+    for (; i < count; i++, samp++, out += 2) {
         val = samp->left >> 8;
         out[0] = clamp(val, INT16_MIN, INT16_MAX);
 
@@ -125,11 +152,11 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-static void Paint8(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
+static void Paint8(channel_t *ch, const byte *data, int count, samplepair_t *samp)
 {
-    int data;
+    int val;
     int *lscale, *rscale;
-    uint8_t *sfx;
+    const uint8_t *sfx;
     int i;
 
     if (ch->leftvol > 255)
@@ -139,33 +166,155 @@ static void Paint8(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
 
     lscale = snd_scaletable[ch->leftvol >> 3];
     rscale = snd_scaletable[ch->rightvol >> 3];
-    sfx = (uint8_t *)sc->data + ch->pos;
+    sfx = data;
+
+    i = 0;
+
+    // the scale tables hold (data - 128) * scale, computed directly here
+#if USE_SSE2
+    {
+        int lvol = lscale[129], rvol = rscale[129];
+        __m128i zero = _mm_setzero_si128();
+        __m128i bias = _mm_set1_epi16(128);
+        __m128i lhi = _mm_set1_epi16(lvol >> 8);
+        __m128i rhi = _mm_set1_epi16(rvol >> 8);
+        __m128i llo = _mm_set1_epi32(256 | (lvol & 255) << 16);
+        __m128i rlo = _mm_set1_epi32(256 | (rvol & 255) << 16);
+
+        for (; i + 8 <= count; i += 8, sfx += 8, samp += 8) {
+            __m128i x = _mm_loadl_epi64((const __m128i *)sfx);
+            __m128i l, r, s0, s1, s2, s3;
+
+            x = _mm_sub_epi16(_mm_unpacklo_epi8(x, zero), bias);
+
+            // x * vol == (x * (vol >> 8)) * 256 + x * (vol & 255), both
+            // partial products fit in 16 bits for 8 bit samples
+            l = _mm_mullo_epi16(x, lhi);
+            r = _mm_mullo_epi16(x, rhi);
+
+            s0 = _mm_loadu_si128((__m128i *)samp + 0);
+            s1 = _mm_loadu_si128((__m128i *)samp + 1);
+            s2 = _mm_loadu_si128((__m128i *)samp + 2);
+            s3 = _mm_loadu_si128((__m128i *)samp + 3);
+
+            {
+                __m128i l0 = _mm_madd_epi16(_mm_unpacklo_epi16(l, x), llo);
+                __m128i l1 = _mm_madd_epi16(_mm_unpackhi_epi16(l, x), llo);
+                __m128i r0 = _mm_madd_epi16(_mm_unpacklo_epi16(r, x), rlo);
+                __m128i r1 = _mm_madd_epi16(_mm_unpackhi_epi16(r, x), rlo);
+
+                s0 = _mm_add_epi32(s0, _mm_unpacklo_epi32(l0, r0));
+                s1 = _mm_add_epi32(s1, _mm_unpackhi_epi32(l0, r0));
+                s2 = _mm_add_epi32(s2, _mm_unpacklo_epi32(l1, r1));
+                s3 = _mm_add_epi32(s3, _mm_unpackhi_epi32(l1, r1));
+            }
+
+            _mm_storeu_si128((__m128i *)samp + 0, s0);
+            _mm_storeu_si128((__m128i *)samp + 1, s1);
+            _mm_storeu_si128((__m128i *)samp + 2, s2);
+            _mm_storeu_si128((__m128i *)samp + 3, s3);
+        }
+    }
+#elif USE_NEON
+    {
+        int lvol = lscale[129], rvol = rscale[129];
+
+        for (; i + 8 <= count; i += 8, sfx += 8, samp += 8) {
+            int16x8_t x = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(sfx), vdup_n_u8(128)));
+            int32x4_t x0 = vmovl_s16(vget_low_s16(x));
+            int32x4_t x1 = vmovl_s16(vget_high_s16(x));
+            int32x4x2_t s0 = vld2q_s32(&samp[0].left);
+            int32x4x2_t s1 = vld2q_s32(&samp[4].left);
+
+            s0.val[0] = vmlaq_n_s32(s0.val[0], x0, lvol);
+            s0.val[1] = vmlaq_n_s32(s0.val[1], x0, rvol);
+            s1.val[0] = vmlaq_n_s32(s1.val[0], x1, lvol);
+            s1.val[1] = vmlaq_n_s32(s1.val[1], x1, rvol);
+
+            vst2q_s32(&samp[0].left, s0);
+            vst2q_s32(&samp[4].left, s1);
+        }
+    }
+#endif
 
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        samp->left += lscale[data];
-        samp->right += rscale[data];
+    for (; i < count; i++, samp++) {
+        val = *sfx++;
+        samp->left += lscale[val];
+        samp->right += rscale[val];
     }
 
     ch->pos += count;
 }
 
-static void Paint16(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
+static void Paint16(channel_t *ch, const byte *data, int count, samplepair_t *samp)
 {
-    int data;
+    int val;
     int left, right;
     int leftvol, rightvol;
-    int16_t *sfx;
+    const int16_t *sfx;
     int i;
 
     leftvol = ch->leftvol * snd_vol;
     rightvol = ch->rightvol * snd_vol;
-    sfx = (int16_t *)sc->data + ch->pos;
+    sfx = (const int16_t *)data;
+
+    i = 0;
+
+#if USE_SSE2
+    if (leftvol < 65536 && rightvol < 65536) {
+        // (x * vol) >> 8 == x * (vol >> 8) + ((x * (vol & 255)) >> 8),
+        // each sample is doubled up so products land as left/right pairs
+        __m128i vhi = _mm_set1_epi32((leftvol >> 8) | (rightvol >> 8) << 16);
+        __m128i vlo = _mm_set1_epi32((leftvol & 255) | (rightvol & 255) << 16);
+
+        for (; i + 8 <= count; i += 8, sfx += 8, samp += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)sfx);
+            __m128i xx[2], lo, hi, a, b;
+            int j;
 
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        left = (data * leftvol) >> 8;
-        right = (data * rightvol) >> 8;
+            xx[0] = _mm_unpacklo_epi16(x, x);
+            xx[1] = _mm_unpackhi_epi16(x, x);
+
+            for (j = 0; j < 2; j++) {
+                __m128i *out = (__m128i *)samp + j * 2;
+
+                lo = _mm_mullo_epi16(xx[j], vhi);
+                hi = _mm_mulhi_epi16(xx[j], vhi);
+                a = _mm_unpacklo_epi16(lo, hi);
+                b = _mm_unpackhi_epi16(lo, hi);
+
+                lo = _mm_mullo_epi16(xx[j], vlo);
+                hi = _mm_mulhi_epi16(xx[j], vlo);
+                a = _mm_add_epi32(a, _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8));
+                b = _mm_add_epi32(b, _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8));
+
+                _mm_storeu_si128(out + 0, _mm_add_epi32(_mm_loadu_si128(out + 0), a));
+                _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), b));
+            }
+        }
+    }
+#elif USE_NEON
+    for (; i + 8 <= count; i += 8, sfx += 8, samp += 8) {
+        int16x8_t x = vld1q_s16(sfx);
+        int32x4_t x0 = vmovl_s16(vget_low_s16(x));
+        int32x4_t x1 = vmovl_s16(vget_high_s16(x));
+        int32x4x2_t s0 = vld2q_s32(&samp[0].left);
+        int32x4x2_t s1 = vld2q_s32(&samp[4].left);
+
+        s0.val[0] = vaddq_s32(s0.val[0], vshrq_n_s32(vmulq_n_s32(x0, leftvol), 8));
+        s0.val[1] = vaddq_s32(s0.val[1], vshrq_n_s32(vmulq_n_s32(x0, rightvol), 8));
+        s1.val[0] = vaddq_s32(s1.val[0], vshrq_n_s32(vmulq_n_s32(x1, leftvol), 8));
+        s1.val[1] = vaddq_s32(s1.val[1], vshrq_n_s32(vmulq_n_s32(x1, rightvol), 8));
+
+        vst2q_s32(&samp[0].left, s0);
+        vst2q_s32(&samp[4].left, s1);
+    }
+#endif
+
+    for (; i < count; i++, samp++) {
+        val = *sfx++;
+        left = (val * leftvol) >> 8;
+        right = (val * rightvol) >> 8;
         samp->left += left;
         samp->right += right;
     }
@@ -223,16 +372,30 @@ void S_PaintChannels(int endtime)
                 if (ch->end - ltime < count)
                     count = ch->end - ltime;
 
-                sc = S_LoadSound(ch->sfx);
+                // loaded when the sound was started
+                sc = ch->sfx->cache;
                 if (!sc)
                     break;
 
                 if (count > 0 && ch->sfx) {
                     samplepair_t *samp = &paintbuffer[ltime - paintedtime];
+                    const byte *data;
+
+                    if (sc->stream) {
+                        data = S_StreamData(sc, ch->pos, &count);
+                        if (!data) {
+                            // not read in yet, hold the sound back
+                            ch->end += end - ltime;
+                            break;
+                        }
+                    } else {
+                        data = sc->data + ch->pos * sc->width;
+                    }
+
                     if (sc->width == 1)
-                        Paint8(ch, sc, count, samp);
+                        Paint8(ch, data, count, samp);
                     else
-                        Paint16(ch, sc, count, samp);
+                        Paint16(ch, data, count, samp);
 
                     ltime += count;
                 }
@@ -249,6 +412,8 @@ void S_PaintChannels(int endtime)
                     } else {
                         // channel just stopped
                         ch->sfx = NULL;
+                        ch->priority = 0;
+                        s_channelsdirty = qtrue;
                     }
                 }
             }
@@ -279,3 +444,137 @@ void S_InitScaletable(void)
     s_volume->modified = qfalse;
 }
 
+
+#if USE_TESTS
+
+#define MIXBENCH_PASSES     2000
+
+// sums are cleared this often so they stay within 32 bits
+#define MIXBENCH_CLEAR      127
+
+/*
+===============
+S_MixBench_f
+
+Times the channel painters and the stereo transfer against plain C
+loops on random data, and checks that both give the same samples.
+===============
+*/
+void S_MixBench_f(void)
+{
+    static samplepair_t buf[PAINTBUFFER_SIZE], ref[PAINTBUFFER_SIZE];
+    static int16_t out[PAINTBUFFER_SIZE * 2], refout[PAINTBUFFER_SIZE * 2];
+    sfxcache_t *sc8, *sc16;
+    channel_t ch;
+    int16_t *s16;
+    uint8_t *s8;
+    int i, j, val, leftvol, rightvol, count, passes;
+    unsigned start, simd[3], scalar[3];
+    qboolean ok = qtrue;
+
+    count = PAINTBUFFER_SIZE - 3;      // leave a tail for the C loops
+    passes = MIXBENCH_PASSES;
+
+    if (Cmd_Argc() > 1) {
+        passes = atoi(Cmd_Argv(1));
+        clamp(passes, 1, 1000000);
+    }
+
+    sc8 = Z_Malloc(sizeof(*sc8) + PAINTBUFFER_SIZE);
+    sc16 = Z_Malloc(sizeof(*sc16) + PAINTBUFFER_SIZE * 2);
+    s8 = sc8->data;
+    s16 = (int16_t *)sc16->data;
+    for (i = 0; i < PAINTBUFFER_SIZE; i++) {
+        s8[i] = rand() & 255;
+        s16[i] = (rand() & 0xffff) - 32768;
+    }
+    sc8->width = 1;
+    sc16->width = 2;
+
+    memset(&ch, 0, sizeof(ch));
+    ch.leftvol = 255;
+    ch.rightvol = 97;
+
+    // 16 bit painter
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++) {
+        if (!(j & MIXBENCH_CLEAR))
+            memset(buf, 0, sizeof(buf));
+        ch.pos = 0;
+        Paint16(&ch, sc16->data, count, buf);
+    }
+    simd[0] = Sys_Milliseconds() - start;
+
+    leftvol = ch.leftvol * snd_vol;
+    rightvol = ch.rightvol * snd_vol;
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++) {
+        if (!(j & MIXBENCH_CLEAR))
+            memset(ref, 0, sizeof(ref));
+        for (i = 0; i < count; i++) {
+            ref[i].left += (s16[i] * leftvol) >> 8;
+            ref[i].right += (s16[i] * rightvol) >> 8;
+        }
+    }
+    scalar[0] = Sys_Milliseconds() - start;
+    if (memcmp(buf, ref, sizeof(buf)))
+        ok = qfalse;
+
+    // 8 bit painter
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++) {
+        if (!(j & MIXBENCH_CLEAR))
+            memset(buf, 0, sizeof(buf));
+        ch.pos = 0;
+        Paint8(&ch, sc8->data, count, buf);
+    }
+    simd[1] = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++) {
+        if (!(j & MIXBENCH_CLEAR))
+            memset(ref, 0, sizeof(ref));
+        for (i = 0; i < count; i++) {
+            ref[i].left += snd_scaletable[ch.leftvol >> 3][s8[i]];
+            ref[i].right += snd_scaletable[ch.rightvol >> 3][s8[i]];
+        }
+    }
+    scalar[1] = Sys_Milliseconds() - start;
+    if (memcmp(buf, ref, sizeof(buf)))
+        ok = qfalse;
+
+    // transfer, with sums large enough to clip
+    for (i = 0; i < count; i++) {
+        buf[i].left = ref[i].left = (rand() - RAND_MAX / 2) * 64;
+        buf[i].right = ref[i].right = (rand() - RAND_MAX / 2) * 64;
+    }
+
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++)
+        WriteLinearBlast(out, buf, count);
+    simd[2] = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++) {
+        for (i = 0; i < count; i++) {
+            val = ref[i].left >> 8;
+            refout[i * 2 + 0] = clamp(val, INT16_MIN, INT16_MAX);
+            val = ref[i].right >> 8;
+            refout[i * 2 + 1] = clamp(val, INT16_MIN, INT16_MAX);
+        }
+    }
+    scalar[2] = Sys_Milliseconds() - start;
+    if (memcmp(out, refout, count * 2 * sizeof(out[0])))
+        ok = qfalse;
+
+    Z_Free(sc8);
+    Z_Free(sc16);
+
+    Com_Printf("%d passes of %d samples\n", passes, count);
+    Com_Printf("Paint16:          %4u ms (C %4u ms)\n", simd[0], scalar[0]);
+    Com_Printf("Paint8:           %4u ms (C %4u ms)\n", simd[1], scalar[1]);
+    Com_Printf("WriteLinearBlast: %4u ms (C %4u ms)\n", simd[2], scalar[2]);
+    Com_Printf("%s\n", ok ? "Results match" : "RESULTS DIFFER");
+}
+
+#endif // USE_TESTS
@@ -24,6 +24,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "client/sound/dma.h"
 #endif
 
+// vector paths used where the compiler targets them, the C loops
+// are kept for everything else and for the tails
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#elif (defined __ARM_NEON) || (defined __ARM_NEON__)
+#define USE_NEON    1
+#include <arm_neon.h>
+#endif
+
 // !!! if this is changed, the asm code must change !!!
 typedef struct samplepair_s {
     int         left;
@@ -37,12 +47,17 @@ typedef struct sfxcache_s {
 #if USE_OPENAL
     int         size;
     int         bufnum;
+#endif
+#if USE_SNDDMA
+    int         srclen;         // of the file, checked by the sfx cache
+    struct sndstream_s  *stream;    // if set, data is a ring buffer
 #endif
     byte        data[1];        // variable sized
 } sfxcache_t;
 
 typedef struct sfx_s {
     char        name[MAX_QPATH];
+    list_t      entry;
     int         registration_sequence;
     sfxcache_t  *cache;
     char        *truename;
@@ -62,6 +77,9 @@ typedef struct playsound_s {
     qboolean    fixed_origin;   // use origin field instead of entnum's origin
     vec3_t      origin;
     unsigned    begin;          // begin on this sample
+    int         leftvol;        // spatialized when started, so the
+    int         rightvol;       // mixer thread needn't look at entities
+    int         priority;
 } playsound_t;
 
 // !!! if this is changed, the asm code must change !!!
@@ -79,6 +97,9 @@ typedef struct channel_s {
     float       master_vol;     // 0.0-1.0 master volume
     qboolean    fixed_origin;   // use origin instead of fetching entnum's origin
     qboolean    autosound;      // from an entity->sound, cleared each frame
+    int         priority;       // 0 is free, higher is harder to steal
+    qboolean    spatialized;    // volumes are up to date for spatorigin
+    vec3_t      spatorigin;
 #if USE_OPENAL
     int         autoframe;
     int         srcnum;
@@ -110,6 +131,11 @@ void DMA_Activate(void);
 int DMA_DriftBeginofs(float timeofs);
 void DMA_ClearBuffer(void);
 void DMA_Update(void);
+void DMA_LockMixer(void);
+void DMA_UnlockMixer(void);
+#else
+#define DMA_LockMixer()     (void)0
+#define DMA_UnlockMixer()   (void)0
 #endif
 
 #if USE_OPENAL
@@ -118,6 +144,7 @@ qboolean AL_Init(void);
 void AL_Shutdown(void);
 sfxcache_t *AL_UploadSfx(sfx_t *s);
 void AL_DeleteSfx(sfx_t *s);
+void AL_TrimBuffers(void);
 void AL_StopChannel(channel_t *ch);
 void AL_PlayChannel(channel_t *ch);
 void AL_StopAllChannels(void);
@@ -144,9 +171,11 @@ typedef enum {
 extern sndstarted_t s_started;
 extern qboolean s_active;
 
-#define MAX_CHANNELS            32
+#define MIN_CHANNELS            16
+#define MAX_CHANNELS            256
 extern  channel_t   channels[MAX_CHANNELS];
 extern  int         s_numchannels;
+extern  qboolean    s_channelsdirty;    // priorities changed out of order
 
 extern  int     paintedtime;
 extern  playsound_t s_pendingplays;
@@ -160,8 +189,11 @@ extern  int         listener_entnum;
 extern  wavinfo_t   s_info;
 
 extern cvar_t   *s_volume;
+extern cvar_t   *s_channels;
 #if USE_SNDDMA
 extern cvar_t   *s_khz;
+extern cvar_t   *s_sfxcache;
+extern cvar_t   *s_streamsize;
 extern cvar_t   *s_testsound;
 #endif
 extern cvar_t   *s_ambient;
@@ -172,11 +204,23 @@ extern cvar_t   *s_show;
 
 sfx_t *S_SfxForHandle(qhandle_t hSfx);
 sfxcache_t *S_LoadSound(sfx_t *s);
-channel_t *S_PickChannel(int entnum, int entchannel);
+#if USE_SNDDMA
+void S_RetireSound(sfx_t *s);
+void S_FlushSfxCache(void);
+void S_CloseStream(sfxcache_t *sc);
+void S_UpdateStreams(void);
+const byte *S_StreamData(sfxcache_t *sc, int pos, int *count);
+#endif
+int S_SoundPriority(int entnum, int entchannel, qboolean fixed_origin,
+                    const vec3_t fixed, float master_vol, float dist_mult);
+channel_t *S_PickChannel(int entnum, int entchannel, int priority);
 void S_IssuePlaysound(playsound_t *ps);
 void S_BuildSoundList(int *sounds);
 #if USE_SNDDMA
 void S_InitScaletable(void);
 void S_PaintChannels(int endtime);
+#if USE_TESTS
+void S_MixBench_f(void);
+#endif
 #endif
 
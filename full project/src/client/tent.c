@@ -135,6 +135,86 @@ void CL_RegisterTEntModels(void)
 /*
 ==============================================================
 
+EFFECT POOLS
+
+Each kind of temporary effect lives in a pool that grows in fixed size
+blocks up to a hard limit, so element pointers stay valid as it grows.
+Live elements are kept in an unordered active list, removal swaps the
+last one into the freed slot, so frame passes only visit live effects.
+
+==============================================================
+*/
+
+#define POOL_BLOCK  32
+
+typedef struct {
+    size_t  size;           // element size
+    int     limit;          // max elements ever allocated
+    int     numitems;       // elements allocated so far
+    int     numactive;
+    int     numfree;
+    int     numblocks;
+    void    **active;
+    void    **free;
+    byte    **blocks;
+} tentpool_t;
+
+#define POOL_INIT(type, limit)  { sizeof(type), limit }
+
+static void *pool_alloc(tentpool_t *p)
+{
+    byte    *block;
+    void    *item;
+    int     i;
+
+    if (!p->numfree) {
+        if (p->numitems >= p->limit)
+            return NULL;
+
+        block = Z_Malloc(p->size * POOL_BLOCK);
+        p->blocks = Z_Realloc(p->blocks, sizeof(p->blocks[0]) * (p->numblocks + 1));
+        p->blocks[p->numblocks++] = block;
+
+        p->numitems += POOL_BLOCK;
+        p->active = Z_Realloc(p->active, sizeof(p->active[0]) * p->numitems);
+        p->free = Z_Realloc(p->free, sizeof(p->free[0]) * p->numitems);
+
+        for (i = POOL_BLOCK - 1; i >= 0; i--)
+            p->free[p->numfree++] = block + p->size * i;
+    }
+
+    item = p->free[--p->numfree];
+    memset(item, 0, p->size);
+    p->active[p->numactive++] = item;
+    return item;
+}
+
+// releases active element at given index, the last one takes its place
+static void pool_free(tentpool_t *p, int index)
+{
+    p->free[p->numfree++] = p->active[index];
+    p->active[index] = p->active[--p->numactive];
+}
+
+// returns all memory, pools start out empty again on next allocation
+static void pool_clear(tentpool_t *p)
+{
+    int i;
+
+    for (i = 0; i < p->numblocks; i++)
+        Z_Free(p->blocks[i]);
+    Z_Free(p->blocks);
+    Z_Free(p->active);
+    Z_Free(p->free);
+
+    p->numitems = p->numactive = p->numfree = p->numblocks = 0;
+    p->active = p->free = NULL;
+    p->blocks = NULL;
+}
+
+/*
+==============================================================
+
 EXPLOSION MANAGEMENT
 
 ==============================================================
@@ -160,14 +240,9 @@ typedef struct {
     int         baseframe;
 } explosion_t;
 
-#define MAX_EXPLOSIONS  32
-
-static explosion_t cl_explosions[MAX_EXPLOSIONS];
+#define MAX_EXPLOSIONS  MAX_ENTITIES
 
-static void clear_explosions(void)
-{
-    memset(cl_explosions, 0, sizeof(cl_explosions));
-}
+static tentpool_t   cl_explosions = POOL_INIT(explosion_t, MAX_EXPLOSIONS);
 
 static explosion_t *alloc_explosion(void)
 {
@@ -175,17 +250,16 @@ static explosion_t *alloc_explosion(void)
     int     i;
     int     time;
 
-    for (i = 0, e = cl_explosions; i < MAX_EXPLOSIONS; i++, e++) {
-        if (e->type == ex_free) {
-            memset(e, 0, sizeof(*e));
-            return e;
-        }
-    }
+    e = pool_alloc(&cl_explosions);
+    if (e)
+        return e;
+
 // find the oldest explosion
     time = cl.time;
-    oldest = cl_explosions;
+    oldest = cl_explosions.active[0];
 
-    for (i = 0, e = cl_explosions; i < MAX_EXPLOSIONS; i++, e++) {
+    for (i = 0; i < cl_explosions.numactive; i++) {
+        e = cl_explosions.active[i];
         if (e->start < time) {
             time = e->start;
             oldest = e;
@@ -254,11 +328,8 @@ static void CL_AddExplosions(void)
     float       frac;
     int         f;
 
-    memset(&ent, 0, sizeof(ent));
-
-    for (i = 0, ex = cl_explosions; i < MAX_EXPLOSIONS; i++, ex++) {
-        if (ex->type == ex_free)
-            continue;
+    for (i = 0; i < cl_explosions.numactive;) {
+        ex = cl_explosions.active[i];
         frac = (cl.time - ex->start) * BASE_1_FRAMETIME;
         f = floor(frac);
 
@@ -318,8 +389,10 @@ static void CL_AddExplosions(void)
             break;
         }
 
-        if (ex->type == ex_free)
+        if (ex->type == ex_free) {
+            pool_free(&cl_explosions, i);
             continue;
+        }
         if (ex->light) {
             V_AddLight(ent->origin, ex->light * ent->alpha,
                        ex->lightcolor[0], ex->lightcolor[1], ex->lightcolor[2]);
@@ -336,6 +409,7 @@ static void CL_AddExplosions(void)
 
             V_AddEntity(ent);
         }
+        i++;
     }
 }
 
@@ -356,29 +430,19 @@ typedef struct {
     int         lifetime, starttime;
 } laser_t;
 
-#define MAX_LASERS  32
-
-static laser_t     cl_lasers[MAX_LASERS];
+#define MAX_LASERS  MAX_ENTITIES
 
-static void clear_lasers(void)
-{
-    memset(cl_lasers, 0, sizeof(cl_lasers));
-}
+static tentpool_t   cl_lasers = POOL_INIT(laser_t, MAX_LASERS);
 
 static laser_t *alloc_laser(void)
 {
     laser_t *l;
-    int i;
 
-    for (i = 0, l = cl_lasers; i < MAX_LASERS; i++, l++) {
-        if (cl.time - l->starttime >= l->lifetime) {
-            memset(l, 0, sizeof(*l));
-            l->starttime = cl.time;
-            return l;
-        }
-    }
+    l = pool_alloc(&cl_lasers);
+    if (l)
+        l->starttime = cl.time;
 
-    return NULL;
+    return l;
 }
 
 static void CL_AddLasers(void)
@@ -390,9 +454,11 @@ static void CL_AddLasers(void)
 
     memset(&ent, 0, sizeof(ent));
 
-    for (i = 0, l = cl_lasers; i < MAX_LASERS; i++, l++) {
+    for (i = 0; i < cl_lasers.numactive;) {
+        l = cl_lasers.active[i];
         time = l->lifetime - (cl.time - l->starttime);
         if (time < 0) {
+            pool_free(&cl_lasers, i);
             continue;
         }
 
@@ -413,6 +479,7 @@ static void CL_AddLasers(void)
         ent.frame = l->width;
 
         V_AddEntity(&ent);
+        i++;
     }
 }
 
@@ -453,19 +520,13 @@ typedef struct {
     vec3_t  start, end;
 } beam_t;
 
-#define MAX_BEAMS   32
+#define MAX_BEAMS   (MAX_ENTITIES / 2)
 
-static beam_t      cl_beams[MAX_BEAMS];
+static tentpool_t   cl_beams = POOL_INIT(beam_t, MAX_BEAMS);
 
 //PMM - added this for player-linked beams.
 //Currently only used by the plasma beam
-static beam_t      cl_playerbeams[MAX_BEAMS];
-
-static void clear_beams(void)
-{
-    memset(cl_beams, 0, sizeof(cl_beams));
-    memset(cl_playerbeams, 0, sizeof(cl_playerbeams));
-}
+static tentpool_t   cl_playerbeams = POOL_INIT(beam_t, MAX_BEAMS);
 
 static void CL_ParseBeam(qhandle_t model)
 {
@@ -473,24 +534,25 @@ static void CL_ParseBeam(qhandle_t model)
     int     i;
 
 // override any beam with the same source AND destination entities
-    for (i = 0, b = cl_beams; i < MAX_BEAMS; i++, b++)
+    for (i = 0; i < cl_beams.numactive; i++) {
+        b = cl_beams.active[i];
         if (b->entity == te.entity1 && b->dest_entity == te.entity2)
             goto override;
+    }
 
 // find a free beam
-    for (i = 0, b = cl_beams; i < MAX_BEAMS; i++, b++) {
-        if (!b->model || b->endtime < cl.time) {
+    b = pool_alloc(&cl_beams);
+    if (!b)
+        return;
+
 override:
-            b->entity = te.entity1;
-            b->dest_entity = te.entity2;
-            b->model = model;
-            b->endtime = cl.time + 200;
-            VectorCopy(te.pos1, b->start);
-            VectorCopy(te.pos2, b->end);
-            VectorCopy(te.offset, b->offset);
-            return;
-        }
-    }
+    b->entity = te.entity1;
+    b->dest_entity = te.entity2;
+    b->model = model;
+    b->endtime = cl.time + 200;
+    VectorCopy(te.pos1, b->start);
+    VectorCopy(te.pos2, b->end);
+    VectorCopy(te.offset, b->offset);
 }
 
 // ROGUE
@@ -501,7 +563,8 @@ static void CL_ParsePlayerBeam(qhandle_t model)
 
 // override any beam with the same entity
 // PMM - For player beams, we only want one per player (entity) so..
-    for (i = 0, b = cl_playerbeams; i < MAX_BEAMS; i++, b++) {
+    for (i = 0; i < cl_playerbeams.numactive; i++) {
+        b = cl_playerbeams.active[i];
         if (b->entity == te.entity1) {
             b->entity = te.entity1;
             b->model = model;
@@ -514,18 +577,16 @@ static void CL_ParsePlayerBeam(qhandle_t model)
     }
 
 // find a free beam
-    for (i = 0, b = cl_playerbeams; i < MAX_BEAMS; i++, b++) {
-        if (!b->model || b->endtime < cl.time) {
-            b->entity = te.entity1;
-            b->model = model;
-            b->endtime = cl.time + 100;     // PMM - this needs to be 100 to prevent multiple heatbeams
-            VectorCopy(te.pos1, b->start);
-            VectorCopy(te.pos2, b->end);
-            VectorCopy(te.offset, b->offset);
-            return;
-        }
-    }
+    b = pool_alloc(&cl_playerbeams);
+    if (!b)
+        return;
 
+    b->entity = te.entity1;
+    b->model = model;
+    b->endtime = cl.time + 100;     // PMM - this needs to be 100 to prevent multiple heatbeams
+    VectorCopy(te.pos1, b->start);
+    VectorCopy(te.pos2, b->end);
+    VectorCopy(te.offset, b->offset);
 }
 //rogue
 
@@ -547,9 +608,12 @@ static void CL_AddBeams(void)
     float       model_length;
 
 // update beams
-    for (i = 0, b = cl_beams; i < MAX_BEAMS; i++, b++) {
-        if (!b->model || b->endtime < cl.time)
+    for (i = 0; i < cl_beams.numactive;) {
+        b = cl_beams.active[i];
+        if (!b->model || b->endtime < cl.time) {
+            pool_free(&cl_beams, i);
             continue;
+        }
 
         // if coming from the player, update the start position
         if (b->entity == cl.frame.clientNum + 1) { // entity 0 is the world
@@ -636,6 +700,7 @@ static void CL_AddBeams(void)
                 org[j] += dist[j] * len;
             d -= model_length;
         }
+        i++;
     }
 }
 
@@ -672,10 +737,13 @@ static void CL_AddPlayerBeams(void)
 //PMM
 
 // update beams
-    for (i = 0, b = cl_playerbeams; i < MAX_BEAMS; i++, b++) {
+    for (i = 0; i < cl_playerbeams.numactive;) {
         vec3_t      f, r, u;
-        if (!b->model || b->endtime < cl.time)
+        b = cl_playerbeams.active[i];
+        if (!b->model || b->endtime < cl.time) {
+            pool_free(&cl_playerbeams, i);
             continue;
+        }
 
         if (cl_mod_heatbeam && (b->model == cl_mod_heatbeam)) {
 
@@ -847,6 +915,7 @@ static void CL_AddPlayerBeams(void)
                 org[j] += dist[j] * len;
             d -= model_length;
         }
+        i++;
     }
 }
 
@@ -860,26 +929,13 @@ SUSTAIN MANAGEMENT
 ==============================================================
 */
 
-#define MAX_SUSTAINS        32
+#define MAX_SUSTAINS        128
 
-static cl_sustain_t    cl_sustains[MAX_SUSTAINS];
-
-static void clear_sustains(void)
-{
-    memset(cl_sustains, 0, sizeof(cl_sustains));
-}
+static tentpool_t   cl_sustains = POOL_INIT(cl_sustain_t, MAX_SUSTAINS);
 
 static cl_sustain_t *alloc_sustain(void)
 {
-    int     i;
-    cl_sustain_t    *s;
-
-    for (i = 0, s = cl_sustains; i < MAX_SUSTAINS; i++, s++) {
-        if (s->id == 0) {
-            return s;
-        }
-    }
-    return NULL;
+    return pool_alloc(&cl_sustains);
 }
 
 static void CL_ProcessSustain(void)
@@ -887,13 +943,15 @@ static void CL_ProcessSustain(void)
     cl_sustain_t    *s;
     int             i;
 
-    for (i = 0, s = cl_sustains; i < MAX_SUSTAINS; i++, s++) {
-        if (s->id) {
-            if ((s->endtime >= cl.time) && (cl.time >= s->nextthink))
-                s->think(s);
-            else if (s->endtime < cl.time)
-                s->id = 0;
+    for (i = 0; i < cl_sustains.numactive;) {
+        s = cl_sustains.active[i];
+        if (s->endtime < cl.time) {
+            pool_free(&cl_sustains, i);
+            continue;
         }
+        if (cl.time >= s->nextthink)
+            s->think(s);
+        i++;
     }
 }
 
@@ -1462,12 +1520,13 @@ CL_ClearTEnts
 */
 void CL_ClearTEnts(void)
 {
-    clear_beams();
-    clear_explosions();
-    clear_lasers();
+    pool_clear(&cl_beams);
+    pool_clear(&cl_playerbeams);
+    pool_clear(&cl_explosions);
+    pool_clear(&cl_lasers);
 
 //ROGUE
-    clear_sustains();
+    pool_clear(&cl_sustains);
 //ROGUE
 }
 
@@ -18,7 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "ui.h"
 #include "common/files.h"
-#include "common/mdfour.h"
+#include "system/system.h"
 
 /*
 =======================================================================
@@ -46,18 +46,39 @@ DEMOS MENU
 #define COL_POV     4
 #define COL_MAX     5
 
+#define DEMO_CACHE_HEADER   "democache 2\n"
+#define DEMO_CACHE_HASH     256
+
+// time spent reading demo headers each frame
+#define DEMO_SCAN_MSEC      10
+
 typedef struct {
     unsigned type;
     size_t size;
     time_t mtime;
+    qboolean pending;   // map and pov not known yet
     char name[1];
 } demoEntry_t;
 
+typedef struct demoCache_s {
+    struct demoCache_s  *next;
+    size_t      size;
+    time_t      mtime;
+    qboolean    seen;   // listed in current directory
+    char        map[MAX_QPATH];
+    char        pov[MAX_CLIENT_NAME];
+    char        path[1];
+} demoCache_t;
+
 typedef struct m_demos_s {
     menuFrameWork_t menu;
     menuList_t      list;
     int             numDirs;
-    uint8_t         hash[16];
+    int             numPending;
+    int             scan;
+    demoCache_t     *cache[DEMO_CACHE_HASH];
+    qboolean        cacheLoaded;
+    qboolean        cacheDirty;
     char    browse[MAX_OSPATH];
     int     selection;
     int     year;
@@ -71,44 +92,201 @@ static m_demos_t    m_demos;
 static cvar_t       *ui_sortdemos;
 static cvar_t       *ui_listalldemos;
 
-static void BuildName(const file_info_t *info, char **cache)
+/*
+Map and POV of every demo seen are kept in a single index file in the game
+directory, one line per demo with its path, size and modification time.
+Only demos that are new or changed since then are opened, a few at a time
+each frame after the list has been shown.
+*/
+
+static demoCache_t *FindCache(const char *path)
 {
-    char buffer[MAX_OSPATH];
-    char date[MAX_QPATH];
-    demoInfo_t demo;
-    demoEntry_t *e;
-    struct tm *tm;
+    demoCache_t *c;
+    unsigned hash = Com_HashString(path, DEMO_CACHE_HASH);
+
+    for (c = m_demos.cache[hash]; c; c = c->next) {
+        if (!strcmp(c->path, path)) {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+static demoCache_t *AddCache(const char *path)
+{
+    demoCache_t *c;
+    unsigned hash;
     size_t len;
 
-    memset(&demo, 0, sizeof(demo));
-    strcpy(demo.map, "???");
-    strcpy(demo.pov, "???");
+    c = FindCache(path);
+    if (c) {
+        return c;
+    }
 
-    if (cache) {
-        char *s = *cache;
-        char *p = strchr(s, '\\');
+    len = strlen(path);
+    c = UI_Mallocz(sizeof(*c) + len);
+    memcpy(c->path, path, len + 1);
+
+    hash = Com_HashString(path, DEMO_CACHE_HASH);
+    c->next = m_demos.cache[hash];
+    m_demos.cache[hash] = c;
+    return c;
+}
+
+// separators and line breaks can't be stored
+static void CopyCacheField(char *dst, const char *src, size_t size)
+{
+    char *p;
+
+    Q_strlcpy(dst, src, size);
+    for (p = dst; *p; p++) {
+        if (*p == '\\' || *p == '\n' || *p == '\r') {
+            *p = '?';
+        }
+    }
+}
+
+static void LoadCache(void)
+{
+    char *data, *s, *p, *line;
+    char *fields[5];
+    demoCache_t *c;
+    int i;
+
+    m_demos.cacheLoaded = qtrue;
+
+    FS_LoadFileEx(COM_DEMOCACHE_NAME, (void **)&data,
+                  FS_TYPE_REAL | FS_PATH_GAME, TAG_FILESYSTEM);
+    if (!data) {
+        return;
+    }
+
+    // files in older formats are silently replaced
+    if (strncmp(data, DEMO_CACHE_HEADER, strlen(DEMO_CACHE_HEADER))) {
+        goto done;
+    }
+
+    s = data + strlen(DEMO_CACHE_HEADER);
+    while (*s) {
+        line = s;
+        p = strchr(s, '\n');
         if (p) {
             *p = 0;
-            Q_strlcpy(demo.map, s, sizeof(demo.map));
             s = p + 1;
-            p = strchr(s, '\\');
-            if (p) {
-                *p = 0;
-                Q_strlcpy(demo.pov, s, sizeof(demo.pov));
-                s = p + 1;
+        } else {
+            s += strlen(s);
+        }
+
+        // path\size\mtime\map\pov
+        for (i = 0; i < 4; i++) {
+            fields[i] = line;
+            p = strchr(line, '\\');
+            if (!p) {
+                break;
             }
+            *p = 0;
+            line = p + 1;
         }
-        *cache = s;
-    } else {
-        Q_concat(buffer, sizeof(buffer), m_demos.browse, "/", info->name, NULL);
-        CL_GetDemoInfo(buffer, &demo);
-        if (demo.mvd) {
-            strcpy(demo.pov, DEMO_MVD_POV);
+        if (i < 4 || !*fields[0]) {
+            continue;
         }
+        fields[4] = line;
+
+        c = AddCache(fields[0]);
+        c->size = strtoul(fields[1], NULL, 10);
+        c->mtime = strtoul(fields[2], NULL, 10);
+        Q_strlcpy(c->map, fields[3], sizeof(c->map));
+        Q_strlcpy(c->pov, fields[4], sizeof(c->pov));
     }
 
+    Com_DPrintf("%s: loaded demo cache\n", __func__);
+
+done:
+    FS_FreeFile(data);
+}
+
+static void WriteCache(void)
+{
+    demoCache_t *c;
+    qhandle_t f;
+    int i;
+
+    if (!m_demos.cacheDirty) {
+        return;
+    }
+
+    m_demos.cacheDirty = qfalse;
+
+    FS_FOpenFile(COM_DEMOCACHE_NAME, &f, FS_MODE_WRITE);
+    if (!f) {
+        return;
+    }
+
+    FS_FPrintf(f, "%s", DEMO_CACHE_HEADER);
+    for (i = 0; i < DEMO_CACHE_HASH; i++) {
+        for (c = m_demos.cache[i]; c; c = c->next) {
+            FS_FPrintf(f, "%s\\%lu\\%lu\\%s\\%s\n", c->path,
+                       (unsigned long)c->size, (unsigned long)c->mtime,
+                       c->map, c->pov);
+        }
+    }
+    FS_FCloseFile(f);
+}
+
+static void FreeCache(void)
+{
+    demoCache_t *c, *next;
+    int i;
+
+    for (i = 0; i < DEMO_CACHE_HASH; i++) {
+        for (c = m_demos.cache[i]; c; c = next) {
+            next = c->next;
+            Z_Free(c);
+        }
+        m_demos.cache[i] = NULL;
+    }
+
+    m_demos.cacheLoaded = qfalse;
+    m_demos.cacheDirty = qfalse;
+}
+
+// forget demos that were removed from the current directory
+static void PruneCache(void)
+{
+    demoCache_t *c, **back;
+    size_t len = strlen(m_demos.browse);
+    char *p;
+    int i;
+
+    for (i = 0; i < DEMO_CACHE_HASH; i++) {
+        back = &m_demos.cache[i];
+        while ((c = *back) != NULL) {
+            p = strrchr(c->path, '/');
+            if (!c->seen && p && (size_t)(p - c->path) == len &&
+                !strncmp(c->path, m_demos.browse, len)) {
+                *back = c->next;
+                Z_Free(c);
+                m_demos.cacheDirty = qtrue;
+                continue;
+            }
+            c->seen = qfalse;
+            back = &c->next;
+        }
+    }
+}
+
+static demoEntry_t *BuildEntry(const char *name, size_t size, time_t mtime,
+                               const char *map, const char *pov)
+{
+    char buffer[MAX_QPATH];
+    char date[MAX_QPATH];
+    demoEntry_t *e;
+    struct tm *tm;
+    size_t len;
+
     // resize columns
-    len = strlen(demo.map);
+    len = strlen(map);
     if (len > 8) {
         len = 8;
     }
@@ -116,13 +294,13 @@ static void BuildName(const file_info_t *info, char **cache)
         m_demos.widest_map = len;
     }
 
-    len = strlen(demo.pov);
+    len = strlen(pov);
     if (len > m_demos.widest_pov) {
         m_demos.widest_pov = len;
     }
 
     // format date
-    if ((tm = localtime(&info->mtime)) != NULL) {
+    if ((tm = localtime(&mtime)) != NULL) {
         if (tm->tm_year == m_demos.year) {
             strftime(date, sizeof(date), "%b %d %H:%M", tm);
         } else {
@@ -132,120 +310,82 @@ static void BuildName(const file_info_t *info, char **cache)
         strcpy(date, "???");
     }
 
-    Com_FormatSize(buffer, sizeof(buffer), info->size);
+    Com_FormatSize(buffer, sizeof(buffer), size);
 
     e = UI_FormatColumns(DEMO_EXTRASIZE,
-                         info->name, date, buffer, demo.map, demo.pov, NULL);
+                         name, date, buffer, map, pov, NULL);
     e->type = ENTRY_DEMO;
-    e->size = info->size;
-    e->mtime = info->mtime;
+    e->size = size;
+    e->mtime = mtime;
+    e->pending = qfalse;
 
-    m_demos.total_bytes += info->size;
-
-    m_demos.list.items[m_demos.list.numItems++] = e;
+    return e;
 }
 
-static void BuildDir(const char *name, int type)
+static void BuildName(const file_info_t *info)
 {
-    demoEntry_t *e = UI_FormatColumns(DEMO_EXTRASIZE, name, "-", DEMO_DIR_SIZE, "-", "-", NULL);
-
-    e->type = type;
-    e->size = 0;
-    e->mtime = 0;
-
-    m_demos.list.items[m_demos.list.numItems++] = e;
-}
-
-static char *LoadCache(void **list)
-{
-    char buffer[MAX_OSPATH], *cache;
-    int i;
-    size_t len;
-    uint8_t hash[16];
-
-    len = Q_concat(buffer, sizeof(buffer), m_demos.browse, "/" COM_DEMOCACHE_NAME, NULL);
-    if (len >= sizeof(buffer)) {
-        return NULL;
-    }
-    len = FS_LoadFileEx(buffer, (void **)&cache, FS_TYPE_REAL | FS_PATH_GAME, TAG_FILESYSTEM);
-    if (!cache) {
-        return NULL;
-    }
-    if (len < 33) {
-        goto fail;
-    }
-
-    for (i = 0; i < 16; i++) {
-        int c1 = Q_charhex(cache[i * 2 + 0]);
-        int c2 = Q_charhex(cache[i * 2 + 1]);
-        hash[i] = (c1 << 4) | c2;
-    }
+    char buffer[MAX_OSPATH];
+    demoCache_t *c;
+    demoEntry_t *e;
 
-    if (cache[32] != '\\') {
-        goto fail;
-    }
+    Q_concat(buffer, sizeof(buffer), m_demos.browse, "/", info->name, NULL);
 
-    if (memcmp(hash, m_demos.hash, 16)) {
-        goto fail;
+    c = FindCache(buffer);
+    if (c && c->size == info->size && c->mtime == info->mtime) {
+        e = BuildEntry(info->name, info->size, info->mtime, c->map, c->pov);
+        c->seen = qtrue;
+    } else {
+        e = BuildEntry(info->name, info->size, info->mtime, "???", "???");
+        e->pending = qtrue;
+        m_demos.numPending++;
     }
 
-    Com_DPrintf("%s: loading from cache\n", __func__);
-    return cache;
+    m_demos.total_bytes += info->size;
 
-fail:
-    FS_FreeFile(cache);
-    return NULL;
+    m_demos.list.items[m_demos.list.numItems++] = e;
 }
 
-static void WriteCache(void)
+static void ScanEntry(int index)
 {
     char buffer[MAX_OSPATH];
-    qhandle_t f;
-    int i;
-    char *map, *pov;
-    demoEntry_t *e;
-    size_t len;
+    demoEntry_t *e = m_demos.list.items[index];
+    demoInfo_t demo;
+    demoCache_t *c;
 
-    if (m_demos.list.numItems == m_demos.numDirs) {
-        return;
-    }
+    memset(&demo, 0, sizeof(demo));
+    strcpy(demo.map, "???");
+    strcpy(demo.pov, "???");
 
-    len = Q_concat(buffer, sizeof(buffer), m_demos.browse, "/" COM_DEMOCACHE_NAME, NULL);
-    if (len >= sizeof(buffer)) {
-        return;
-    }
-    FS_FOpenFile(buffer, &f, FS_MODE_WRITE);
-    if (!f) {
-        return;
+    Q_concat(buffer, sizeof(buffer), m_demos.browse, "/", e->name, NULL);
+    CL_GetDemoInfo(buffer, &demo);
+    if (demo.mvd) {
+        strcpy(demo.pov, DEMO_MVD_POV);
     }
 
-    for (i = 0; i < 16; i++) {
-        FS_FPrintf(f, "%02x", m_demos.hash[i]);
-    }
-    FS_FPrintf(f, "\\");
+    c = AddCache(buffer);
+    c->size = e->size;
+    c->mtime = e->mtime;
+    c->seen = qtrue;
+    CopyCacheField(c->map, demo.map, sizeof(c->map));
+    CopyCacheField(c->pov, demo.pov, sizeof(c->pov));
+    m_demos.cacheDirty = qtrue;
 
-    for (i = m_demos.numDirs; i < m_demos.list.numItems; i++) {
-        e = m_demos.list.items[i];
-        map = UI_GetColumn(e->name, COL_MAP);
-        pov = UI_GetColumn(e->name, COL_POV);
-        FS_FPrintf(f, "%s\\%s\\", map, pov);
-    }
-    FS_FCloseFile(f);
+    m_demos.list.items[index] =
+        BuildEntry(e->name, e->size, e->mtime, c->map, c->pov);
+    m_demos.numPending--;
+    Z_Free(e);
 }
 
-static void CalcHash(void **list)
+static void BuildDir(const char *name, int type)
 {
-    struct mdfour md;
-    file_info_t *info;
-    size_t len;
+    demoEntry_t *e = UI_FormatColumns(DEMO_EXTRASIZE, name, "-", DEMO_DIR_SIZE, "-", "-", NULL);
 
-    mdfour_begin(&md);
-    while (*list) {
-        info = *list++;
-        len = sizeof(*info) + strlen(info->name) - 1;
-        mdfour_update(&md, (uint8_t *)info, len);
-    }
-    mdfour_result(&md, m_demos.hash);
+    e->type = type;
+    e->size = 0;
+    e->mtime = 0;
+    e->pending = qfalse;
+
+    m_demos.list.items[m_demos.list.numItems++] = e;
 }
 
 static menuSound_t Change(menuCommon_t *self)
@@ -267,7 +407,6 @@ static void BuildList(void)
 {
     int numDirs, numDemos;
     void **dirlist, **demolist;
-    char *cache, *p;
     unsigned flags;
     size_t len;
     int i;
@@ -293,6 +432,7 @@ static void BuildList(void)
     m_demos.widest_map = 3;
     m_demos.widest_pov = 3;
     m_demos.total_bytes = 0;
+    m_demos.numPending = 0;
 
     // start with minimum size
     m_demos.menu.size(&m_demos.menu);
@@ -311,28 +451,16 @@ static void BuildList(void)
 
     m_demos.numDirs = m_demos.list.numItems;
 
-    // add demos
+    // add demos, unknown ones are read later
     if (demolist) {
-        CalcHash(demolist);
-        if ((cache = LoadCache(demolist)) != NULL) {
-            p = cache + 32 + 1;
-            for (i = 0; i < numDemos; i++) {
-                BuildName(demolist[i], &p);
-            }
-            FS_FreeFile(cache);
-        } else {
-            for (i = 0; i < numDemos; i++) {
-                BuildName(demolist[i], NULL);
-                if ((i & 7) == 0) {
-                    m_demos.menu.size(&m_demos.menu);
-                    SCR_UpdateScreen();
-                }
-            }
+        for (i = 0; i < numDemos; i++) {
+            BuildName(demolist[i]);
         }
-        WriteCache();
         FS_FreeList(demolist);
     }
 
+    PruneCache();
+
     // update status line and sort
     if (m_demos.list.numItems) {
         Change(&m_demos.list.generic);
@@ -341,6 +469,8 @@ static void BuildList(void)
         }
     }
 
+    m_demos.scan = m_demos.numDirs;
+
     // resize columns
     m_demos.menu.size(&m_demos.menu);
 
@@ -366,6 +496,8 @@ static void FreeList(void)
         m_demos.list.items = NULL;
         m_demos.list.numItems = 0;
     }
+
+    m_demos.numPending = 0;
 }
 
 static void LeaveDirectory(void)
@@ -489,6 +621,9 @@ static menuSound_t Sort(menuList_t *self)
         break;
     }
 
+    // entries moved, look for unread ones from the start
+    m_demos.scan = m_demos.numDirs;
+
     return QMS_SILENT;
 }
 
@@ -532,12 +667,57 @@ static menuSound_t Keydown(menuFrameWork_t *self, int key)
     return QMS_NOTHANDLED;
 }
 
+static void Frame(menuFrameWork_t *self, int msec)
+{
+    unsigned start;
+    int widest_map, widest_pov;
+    demoEntry_t *e;
+
+    if (!m_demos.numPending) {
+        return;
+    }
+
+    start = Sys_Milliseconds();
+    widest_map = m_demos.widest_map;
+    widest_pov = m_demos.widest_pov;
+
+    while (m_demos.scan < m_demos.list.numItems) {
+        e = m_demos.list.items[m_demos.scan++];
+        if (!e->pending) {
+            continue;
+        }
+        ScanEntry(m_demos.scan - 1);
+        if (Sys_Milliseconds() - start >= DEMO_SCAN_MSEC) {
+            break;
+        }
+    }
+
+    if (m_demos.scan >= m_demos.list.numItems) {
+        m_demos.scan = m_demos.numDirs;
+    }
+
+    if (!m_demos.numPending) {
+        // map and pov columns are complete now
+        if (m_demos.list.sortdir && (m_demos.list.sortcol == COL_MAP ||
+                                     m_demos.list.sortcol == COL_POV)) {
+            m_demos.list.sort(&m_demos.list);
+        }
+        WriteCache();
+    }
+
+    if (m_demos.widest_map != widest_map || m_demos.widest_pov != widest_pov) {
+        m_demos.menu.size(&m_demos.menu);
+    }
+}
+
 static void Draw(menuFrameWork_t *self)
 {
     Menu_Draw(self);
     if (uis.width >= 640) {
-        UI_DrawString(uis.width, uis.height - CHAR_HEIGHT,
-                      UI_RIGHT, m_demos.status);
+        UI_DrawString(uis.width, uis.height - CHAR_HEIGHT, UI_RIGHT,
+                      m_demos.numPending ? va("Reading %d demo%s...",
+                      m_demos.numPending, m_demos.numPending == 1 ? "" : "s") :
+                      m_demos.status);
     }
 }
 
@@ -546,6 +726,8 @@ static void Pop(menuFrameWork_t *self)
     // save previous position
     m_demos.selection = m_demos.list.curvalue;
     FreeList();
+    WriteCache();
+    FreeCache();
 }
 
 static void Expose(menuFrameWork_t *self)
@@ -557,6 +739,10 @@ static void Expose(menuFrameWork_t *self)
         m_demos.year = tm->tm_year;
     }
 
+    if (!m_demos.cacheLoaded) {
+        LoadCache();
+    }
+
     BuildList();
     // move cursor to previous position
     MenuList_SetValue(&m_demos.list, m_demos.selection);
@@ -564,6 +750,8 @@ static void Expose(menuFrameWork_t *self)
 
 static void Free(menuFrameWork_t *self)
 {
+    FreeList();
+    FreeCache();
     memset(&m_demos, 0, sizeof(m_demos));
 }
 
@@ -603,6 +791,7 @@ void M_Menu_Demos(void)
     strcpy(m_demos.browse, "/demos");
 
     m_demos.menu.draw       = Draw;
+    m_demos.menu.frame      = Frame;
     m_demos.menu.expose     = Expose;
     m_demos.menu.pop        = Pop;
     m_demos.menu.size       = Size;
@@ -1373,6 +1373,66 @@ void MenuList_Sort(menuList_t *l, int offset, int (*cmpfunc)(const void *, const
         MenuList_AdjustPrestep(l);
 }
 
+/*
+=================
+MenuList_Resort
+
+Moves a single changed item into place, the rest of the list must
+already be sorted with the same function.
+=================
+*/
+void MenuList_Resort(menuList_t *l, int index, int (*cmpfunc)(const void *, const void *))
+{
+    void *item, *n;
+    int lo, hi, mid;
+
+    if (!l->items)
+        return;
+
+    if (index < 0 || index >= l->numItems)
+        return;
+
+    if (l->sortcol < 0 || l->sortcol >= l->numcolumns)
+        return;
+
+    if (l->curvalue < 0 || l->curvalue >= l->numItems)
+        n = NULL;
+    else
+        n = l->items[l->curvalue];
+
+    item = l->items[index];
+    memmove(l->items + index, l->items + index + 1,
+            (l->numItems - index - 1) * sizeof(void *));
+
+    lo = 0;
+    hi = l->numItems - 1;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cmpfunc(&l->items[mid], &item) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    memmove(l->items + lo + 1, l->items + lo,
+            (l->numItems - lo - 1) * sizeof(void *));
+    l->items[lo] = item;
+
+    if (!n)
+        return;
+
+    if (n == item) {
+        l->curvalue = lo;
+    } else {
+        if (l->curvalue > index)
+            l->curvalue--;
+        if (l->curvalue >= lo)
+            l->curvalue++;
+    }
+
+    MenuList_AdjustPrestep(l);
+}
+
 /*
 ===================================================================
 
@@ -1868,11 +1928,38 @@ menuSound_t Menu_AdjustCursor(menuFrameWork_t *m, int dir)
 Menu_Draw
 =================
 */
-void Menu_Draw(menuFrameWork_t *menu)
+// background, title and pics only change with the menu itself
+static void Menu_DrawFrame(menuFrameWork_t *menu)
 {
-    void *item;
+    unsigned hash;
     int i;
 
+    for (i = 0; i < uis.menuDepth; i++) {
+        if (uis.layers[i] == menu) {
+            break;
+        }
+    }
+
+    hash = SPAN_HASH_INIT;
+    hash = SPAN_HASH(hash, menu);
+    hash = SPAN_HASH(hash, uis.width);
+    hash = SPAN_HASH(hash, uis.height);
+    hash = SPAN_HASH(hash, menu->y1);
+    hash = SPAN_HASH(hash, menu->y2);
+    hash = SPAN_HASH(hash, menu->image);
+    hash = SPAN_HASH(hash, menu->color);
+    hash = SPAN_HASH(hash, menu->title);
+    hash = SPAN_HASH(hash, menu->banner);
+    hash = SPAN_HASH(hash, menu->banner_rc);
+    hash = SPAN_HASH(hash, menu->plaque);
+    hash = SPAN_HASH(hash, menu->plaque_rc);
+    hash = SPAN_HASH(hash, menu->logo);
+    hash = SPAN_HASH(hash, menu->logo_rc);
+
+    if (i < uis.menuDepth && !SCR_BeginSpan(SPAN_MENU + i, hash)) {
+        return;
+    }
+
 //
 // draw background
 //
@@ -1905,6 +1992,18 @@ void Menu_Draw(menuFrameWork_t *menu)
         R_DrawPic(menu->logo_rc.x, menu->logo_rc.y, menu->logo);
     }
 
+    if (i < uis.menuDepth) {
+        R_EndSpan();
+    }
+}
+
+void Menu_Draw(menuFrameWork_t *menu)
+{
+    void *item;
+    int i;
+
+    Menu_DrawFrame(menu);
+
 //
 // draw contents
 //
@@ -59,6 +59,7 @@ typedef struct {
     int         numPlayers;
     char        *players[MAX_STATUS_PLAYERS];
     unsigned    timestamp;
+    qboolean    stale;      // showing results of a previous refresh
     char        name[1];
 } serverslot_t;
 
@@ -69,6 +70,8 @@ typedef struct {
     menuList_t      players;
     void            *names[MAX_STATUS_SERVERS];
     char            *args;
+    char            *cache;     // args the kept list was built from
+    netadr_t        broadcast;
     unsigned        timestamp;
     int             pingstage;
     int             pingindex;
@@ -82,6 +85,7 @@ static m_servers_t  m_servers;
 
 static cvar_t   *ui_sortservers;
 static cvar_t   *ui_pingrate;
+static cvar_t   *ui_pingbatch;
 
 static void UpdateSelection(void)
 {
@@ -180,6 +184,90 @@ static serverslot_t *FindSlot(const netadr_t *search, int *index_p)
     return found;
 }
 
+static int statuscmp(serverslot_t *s1, serverslot_t *s2)
+{
+    if (s1->status == s2->status)
+        return 0;
+    if (s1->status != SLOT_VALID && s2->status == SLOT_VALID)
+        return 1;
+    if (s2->status != SLOT_VALID && s1->status == SLOT_VALID)
+        return -1;
+    return 0;
+}
+
+static int namecmp(serverslot_t *s1, serverslot_t *s2, int col)
+{
+    char *n1 = UI_GetColumn(s1->name, col);
+    char *n2 = UI_GetColumn(s2->name, col);
+
+    return Q_stricmp(n1, n2) * m_servers.list.sortdir;
+}
+
+static int pingcmp(serverslot_t *s1, serverslot_t *s2)
+{
+    int n1 = atoi(UI_GetColumn(s1->name, COL_RTT));
+    int n2 = atoi(UI_GetColumn(s2->name, COL_RTT));
+
+    return (n1 - n2) * m_servers.list.sortdir;
+}
+
+static int playercmp(serverslot_t *s1, serverslot_t *s2)
+{
+    return (s2->numPlayers - s1->numPlayers) * m_servers.list.sortdir;
+}
+
+static int addresscmp(serverslot_t *s1, serverslot_t *s2)
+{
+    if (s1->address.ip.u32 > s2->address.ip.u32)
+        return 1;
+    if (s1->address.ip.u32 < s2->address.ip.u32)
+        return -1;
+    if (s1->address.port > s2->address.port)
+        return 1;
+    if (s1->address.port < s2->address.port)
+        return -1;
+    return 0;
+}
+
+static int slotcmp(const void *p1, const void *p2)
+{
+    serverslot_t *s1 = *(serverslot_t **)p1;
+    serverslot_t *s2 = *(serverslot_t **)p2;
+    int r;
+
+    // sort by validity
+    r = statuscmp(s1, s2);
+    if (r)
+        return r;
+
+    // sort by primary column
+    switch (m_servers.list.sortcol) {
+    case COL_NAME:
+        break;
+    case COL_MOD:
+        r = namecmp(s1, s2, COL_MOD);
+        break;
+    case COL_MAP:
+        r = namecmp(s1, s2, COL_MAP);
+        break;
+    case COL_PLAYERS:
+        r = playercmp(s1, s2);
+        break;
+    case COL_RTT:
+        r = pingcmp(s1, s2);
+        break;
+    }
+    if (r)
+        return r;
+
+    // stabilize sort
+    r = namecmp(s1, s2, COL_NAME);
+    if (r)
+        return r;
+
+    return addresscmp(s1, s2);
+}
+
 /*
 =================
 UI_StatusEvent
@@ -195,7 +283,7 @@ void UI_StatusEvent(const serverStatus_t *status)
     const char *info = status->infostring;
     char key[MAX_INFO_STRING];
     char value[MAX_INFO_STRING];
-    int i;
+    int i, index;
 
     // ignore unless menu is up
     if (!m_servers.args) {
@@ -203,7 +291,7 @@ void UI_StatusEvent(const serverStatus_t *status)
     }
 
     // see if already added
-    slot = FindSlot(&net_from, &i);
+    slot = FindSlot(&net_from, &index);
     if (!slot) {
         // reply to broadcast, create new slot
         if (m_servers.list.numItems >= MAX_STATUS_SERVERS) {
@@ -253,8 +341,9 @@ void UI_StatusEvent(const serverStatus_t *status)
     slot->status = SLOT_VALID;
     slot->address = net_from;
     slot->hostname = hostname;
+    slot->stale = qfalse;
 
-    m_servers.list.items[i] = slot;
+    m_servers.list.items[index] = slot;
 
     slot->numRules = 0;
     while (slot->numRules < MAX_STATUS_RULES) {
@@ -284,9 +373,10 @@ void UI_StatusEvent(const serverStatus_t *status)
 
     slot->timestamp = timestamp;
 
-    // don't sort when manually refreshing
+    // don't sort when manually refreshing, the rest of
+    // the list is already sorted so only move this slot
     if (m_servers.pingstage)
-        m_servers.list.sort(&m_servers.list);
+        MenuList_Resort(&m_servers.list, index, slotcmp);
 
     UpdateStatus();
     UpdateSelection();
@@ -316,7 +406,7 @@ void UI_ErrorEvent(netadr_t *from)
         return;
 
     // only mark unreplied slots as invalid
-    if (slot->status != SLOT_PENDING)
+    if (slot->status != SLOT_PENDING && !slot->stale)
         return;
 
     address = slot->address;
@@ -339,8 +429,15 @@ void UI_ErrorEvent(netadr_t *from)
     slot->numRules = 0;
     slot->numPlayers = 0;
     slot->timestamp = timestamp;
+    slot->stale = qfalse;
 
     m_servers.list.items[i] = slot;
+
+    if (m_servers.pingstage)
+        MenuList_Resort(&m_servers.list, i, slotcmp);
+
+    UpdateStatus();
+    UpdateSelection();
 }
 
 static menuSound_t SetRconAddress(void)
@@ -399,6 +496,7 @@ static menuSound_t PingSelected(void)
     slot->numRules = 0;
     slot->numPlayers = 0;
     slot->timestamp = com_eventTime;
+    slot->stale = qfalse;
 
     m_servers.list.items[m_servers.list.curvalue] = slot;
 
@@ -451,6 +549,7 @@ static void AddServer(const netadr_t *address, const char *hostname)
     slot->numRules = 0;
     slot->numPlayers = 0;
     slot->timestamp = com_eventTime;
+    slot->stale = qfalse;
 
     m_servers.list.items[m_servers.list.numItems++] = slot;
 }
@@ -641,31 +740,17 @@ static void CalcPingRate(void)
     m_servers.pingtime = (1000 * PING_STAGES) / (rate * m_servers.pingstage);
 }
 
-/*
-=================
-UI_Frame
-
-=================
-*/
-void UI_Frame(int msec)
+static qboolean PingNext(void)
 {
     serverslot_t *slot;
 
-    if (!m_servers.pingstage)
-        return;
-
-    m_servers.pingextra += msec;
-    if (m_servers.pingextra < m_servers.pingtime)
-        return;
-
-    m_servers.pingextra -= m_servers.pingtime;
-
     // send out next status packet
     while (m_servers.pingindex < m_servers.list.numItems) {
         slot = m_servers.list.items[m_servers.pingindex++];
-        if (slot->status > SLOT_PENDING)
+        if (slot->status > SLOT_PENDING && !slot->stale)
             continue;
-        slot->status = SLOT_PENDING;
+        if (!slot->stale)
+            slot->status = SLOT_PENDING;
         slot->timestamp = com_eventTime;
         CL_SendStatusRequest(&slot->address);
         break;
@@ -673,17 +758,58 @@ void UI_Frame(int msec)
 
     if (m_servers.pingindex == m_servers.list.numItems) {
         m_servers.pingindex = 0;
-        if (--m_servers.pingstage == 0)
+        if (--m_servers.pingstage == 0) {
             FinishPingStage();
-        else
-            CalcPingRate();
+            return qfalse;
+        }
+        CalcPingRate();
     }
+
+    return qtrue;
 }
 
-static void PingServers(void)
+/*
+=================
+Frame
+
+Sends as many status packets as the ping rate allows since the last frame,
+but no more than ui_pingbatch at once.
+=================
+*/
+static void Frame(menuFrameWork_t *self, int msec)
+{
+    int count;
+
+    if (!m_servers.pingstage)
+        return;
+
+    count = Cvar_ClampInteger(ui_pingbatch, 1, 64);
+
+    m_servers.pingextra += msec;
+    while (m_servers.pingextra >= m_servers.pingtime && count--) {
+        m_servers.pingextra -= m_servers.pingtime;
+        if (!PingNext())
+            return;
+    }
+
+    // don't carry a burst over from a long frame
+    if (m_servers.pingextra > m_servers.pingtime)
+        m_servers.pingextra = m_servers.pingtime;
+}
+
+static void BeginPingStage(void)
 {
-    netadr_t broadcast;
+    // keep the list sorted while replies come in
+    m_servers.list.sort(&m_servers.list);
 
+    m_servers.pingstage = PING_STAGES;
+    m_servers.pingindex = 0;
+    m_servers.pingextra = 0;
+    CalcPingRate();
+}
+
+static void PingServers(void)
+{
     S_StopAllSounds();
 
     ClearServers();
@@ -695,14 +821,14 @@ static void PingServers(void)
     SCR_UpdateScreen();
 
     // fetch and resolve servers
-    memset(&broadcast, 0, sizeof(broadcast));
-    ParseMasterArgs(&broadcast);
+    memset(&m_servers.broadcast, 0, sizeof(m_servers.broadcast));
+    ParseMasterArgs(&m_servers.broadcast);
 
     m_servers.timestamp = Sys_Milliseconds();
 
     // optionally ping broadcast
-    if (broadcast.type)
-        CL_SendStatusRequest(&broadcast);
+    if (m_servers.broadcast.type)
+        CL_SendStatusRequest(&m_servers.broadcast);
 
     if (!m_servers.list.numItems) {
         FinishPingStage();
@@ -710,94 +836,36 @@ static void PingServers(void)
     }
 
     // begin pinging servers
-    m_servers.pingstage = PING_STAGES;
-    m_servers.pingindex = 0;
-    m_servers.pingextra = 0;
-    CalcPingRate();
-}
-
-static int statuscmp(serverslot_t *s1, serverslot_t *s2)
-{
-    if (s1->status == s2->status)
-        return 0;
-    if (s1->status != SLOT_VALID && s2->status == SLOT_VALID)
-        return 1;
-    if (s2->status != SLOT_VALID && s1->status == SLOT_VALID)
-        return -1;
-    return 0;
+    BeginPingStage();
 }
 
-static int namecmp(serverslot_t *s1, serverslot_t *s2, int col)
-{
-    char *n1 = UI_GetColumn(s1->name, col);
-    char *n2 = UI_GetColumn(s2->name, col);
-
-    return Q_stricmp(n1, n2) * m_servers.list.sortdir;
-}
-
-static int pingcmp(serverslot_t *s1, serverslot_t *s2)
-{
-    int n1 = atoi(UI_GetColumn(s1->name, COL_RTT));
-    int n2 = atoi(UI_GetColumn(s2->name, COL_RTT));
-
-    return (n1 - n2) * m_servers.list.sortdir;
-}
-
-static int playercmp(serverslot_t *s1, serverslot_t *s2)
-{
-    return (s2->numPlayers - s1->numPlayers) * m_servers.list.sortdir;
-}
+/*
+=================
+RefreshServers
 
-static int addresscmp(serverslot_t *s1, serverslot_t *s2)
+Pings the servers kept from the last time the menu was up, keeping their
+last known results until they reply. Master lists are not fetched again.
+=================
+*/
+static void RefreshServers(void)
 {
-    if (s1->address.ip.u32 > s2->address.ip.u32)
-        return 1;
-    if (s1->address.ip.u32 < s2->address.ip.u32)
-        return -1;
-    if (s1->address.port > s2->address.port)
-        return 1;
-    if (s1->address.port < s2->address.port)
-        return -1;
-    return 0;
-}
+    serverslot_t *slot;
+    int i;
 
-static int slotcmp(const void *p1, const void *p2)
-{
-    serverslot_t *s1 = *(serverslot_t **)p1;
-    serverslot_t *s2 = *(serverslot_t **)p2;
-    int r;
+    for (i = 0; i < m_servers.list.numItems; i++) {
+        slot = m_servers.list.items[i];
+        slot->stale = qtrue;
+    }
 
-    // sort by validity
-    r = statuscmp(s1, s2);
-    if (r)
-        return r;
+    m_servers.timestamp = Sys_Milliseconds();
 
-    // sort by primary column
-    switch (m_servers.list.sortcol) {
-    case COL_NAME:
-        break;
-    case COL_MOD:
-        r = namecmp(s1, s2, COL_MOD);
-        break;
-    case COL_MAP:
-        r = namecmp(s1, s2, COL_MAP);
-        break;
-    case COL_PLAYERS:
-        r = playercmp(s1, s2);
-        break;
-    case COL_RTT:
-        r = pingcmp(s1, s2);
-        break;
-    }
-    if (r)
-        return r;
+    if (m_servers.broadcast.type)
+        CL_SendStatusRequest(&m_servers.broadcast);
 
-    // stabilize sort
-    r = namecmp(s1, s2, COL_NAME);
-    if (r)
-        return r;
+    BeginPingStage();
 
-    return addresscmp(s1, s2);
+    UpdateStatus();
+    UpdateSelection();
 }
 
 static menuSound_t Sort(menuList_t *self)
@@ -1007,27 +1075,38 @@ static void Draw(menuFrameWork_t *self)
 static qboolean Push(menuFrameWork_t *self)
 {
     // save our arguments for refreshing
+    Z_Free(m_servers.args);
     m_servers.args = UI_CopyString(Cmd_RawArgsFrom(2));
     return qtrue;
 }
 
 static void Pop(menuFrameWork_t *self)
 {
-    ClearServers();
-    if (m_servers.args) {
-        Z_Free(m_servers.args);
-        m_servers.args = NULL;
-    }
+    // keep the list so that it shows up instantly next time
+    m_servers.pingstage = 0;
+    Z_Free(m_servers.cache);
+    m_servers.cache = m_servers.args;
+    m_servers.args = NULL;
 }
 
 static void Expose(menuFrameWork_t *self)
 {
-    PingServers();
+    if (m_servers.cache && !strcmp(m_servers.cache, m_servers.args) &&
+        m_servers.list.numItems) {
+        RefreshServers();
+    } else {
+        PingServers();
+    }
+    Z_Free(m_servers.cache);
+    m_servers.cache = NULL;
     ui_sortservers_changed(ui_sortservers);
 }
 
 static void Free(menuFrameWork_t *self)
 {
+    ClearServers();
+    Z_Free(m_servers.args);
+    Z_Free(m_servers.cache);
     memset(&m_servers, 0, sizeof(m_servers));
 }
 
@@ -1036,11 +1115,13 @@ void M_Menu_Servers(void)
     ui_sortservers = Cvar_Get("ui_sortservers", "0", 0);
     ui_sortservers->changed = ui_sortservers_changed;
     ui_pingrate = Cvar_Get("ui_pingrate", "0", 0);
+    ui_pingbatch = Cvar_Get("ui_pingbatch", "8", 0);
 
     m_servers.menu.name     = "servers";
     m_servers.menu.title    = "Server Browser";
 
     m_servers.menu.draw         = Draw;
+    m_servers.menu.frame        = Frame;
     m_servers.menu.expose       = Expose;
     m_servers.menu.push         = Push;
     m_servers.menu.pop          = Pop;
@@ -489,6 +489,26 @@ void UI_Draw(int realtime)
     R_ClearColor();
 }
 
+/*
+=================
+UI_Frame
+
+Runs background work of menus on the stack.
+=================
+*/
+void UI_Frame(int msec)
+{
+    menuFrameWork_t *menu;
+    int i;
+
+    for (i = 0; i < uis.menuDepth; i++) {
+        menu = uis.layers[i];
+        if (menu->frame) {
+            menu->frame(menu, msec);
+        }
+    }
+}
+
 void UI_StartSound(menuSound_t sound)
 {
     switch (sound) {
@@ -119,6 +119,7 @@ typedef struct menuFrameWork_s {
     void (*draw)(struct menuFrameWork_s *);
     void (*size)(struct menuFrameWork_s *);
     void (*free)(struct menuFrameWork_s *);
+    void (*frame)(struct menuFrameWork_s *, int);
     menuSound_t (*keydown)(struct menuFrameWork_s *, int);
 } menuFrameWork_t;
 
@@ -336,6 +337,8 @@ void        MenuList_Init(menuList_t *l);
 void        MenuList_SetValue(menuList_t *l, int value);
 void        MenuList_Sort(menuList_t *l, int offset,
                           int (*cmpfunc)(const void *, const void *));
+void        MenuList_Resort(menuList_t *l, int index,
+                            int (*cmpfunc)(const void *, const void *));
 void SpinControl_Init(menuSpinControl_t *s);
 qboolean    Menu_Push(menuFrameWork_t *menu);
 void        Menu_Pop(menuFrameWork_t *menu);
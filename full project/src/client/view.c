@@ -48,6 +48,19 @@ static cvar_t   *cl_stats;
 
 static cvar_t   *cl_adjustfov;
 
+static cvar_t   *cl_cctv;
+static cvar_t   *cl_cctv_fov;
+
+typedef struct {
+    qboolean    inuse;
+    vec3_t      origin;
+    vec3_t      angles;
+} cctv_camera_t;
+
+static cctv_camera_t    cctv_cameras[MAX_VIEWS];
+static refdef_t         cctv_views[MAX_VIEWS];
+static entity_t         cctv_entities[MAX_ENTITIES];
+
 #if USE_DLIGHTS
 int         r_numdlights;
 dlight_t    r_dlights[MAX_DLIGHTS];
@@ -56,8 +69,10 @@ dlight_t    r_dlights[MAX_DLIGHTS];
 int         r_numentities;
 entity_t    r_entities[MAX_ENTITIES];
 
+// allocated by cl_maxparticles in effects.c
 int         r_numparticles;
-particle_t  r_particles[MAX_PARTICLES];
+int         r_maxparticles;
+particle_t  *r_particles;
 
 #if USE_LIGHTSTYLES
 lightstyle_t    r_lightstyles[MAX_LIGHTSTYLES];
@@ -103,7 +118,7 @@ V_AddParticle
 */
 void V_AddParticle(particle_t *p)
 {
-    if (r_numparticles >= MAX_PARTICLES)
+    if (r_numparticles >= r_maxparticles)
         return;
     r_particles[r_numparticles++] = *p;
 }
@@ -178,7 +193,7 @@ static void V_TestParticles(void)
     int         i, j;
     float       d, r, u;
 
-    r_numparticles = MAX_PARTICLES;
+    r_numparticles = min(r_maxparticles, MAX_PARTICLES);
     for (i = 0; i < r_numparticles; i++) {
         d = i * 0.25;
         r = 4 * ((i & 7) - 3.5);
@@ -377,6 +392,65 @@ float V_CalcFov(float fov_x, float width, float height)
 }
 
 
+/*
+==================
+V_RenderWall
+
+Splits the view rectangle into a grid with one tile per CCTV camera
+and renders all of them in one frame.
+==================
+*/
+static qboolean V_RenderWall(void)
+{
+    refdef_t *fd;
+    int i, numviews, numentities, cols, rows;
+
+    if (!cl_cctv->integer || (cl.refdef.rdflags & RDF_NOWORLDMODEL))
+        return qfalse;
+
+    // the view weapon belongs to the player only
+    numentities = 0;
+    for (i = 0; i < cl.refdef.num_entities; i++) {
+        if (!(cl.refdef.entities[i].flags & RF_WEAPONMODEL))
+            cctv_entities[numentities++] = cl.refdef.entities[i];
+    }
+
+    numviews = 0;
+    for (i = 0; i < MAX_VIEWS; i++) {
+        if (!cctv_cameras[i].inuse)
+            continue;
+
+        fd = &cctv_views[numviews++];
+        *fd = cl.refdef;
+        VectorCopy(cctv_cameras[i].origin, fd->vieworg);
+        VectorCopy(cctv_cameras[i].angles, fd->viewangles);
+        fd->entities = cctv_entities;
+        fd->num_entities = numentities;
+        fd->areabits = NULL;    // cameras see into other areas
+        fd->rdflags = 0;
+        Vector4Clear(fd->blend);
+    }
+
+    if (!numviews)
+        return qfalse;
+
+    cols = numviews > 4 ? 3 : numviews > 1 ? 2 : 1;
+    rows = (numviews + cols - 1) / cols;
+
+    for (i = 0; i < numviews; i++) {
+        fd = &cctv_views[i];
+        fd->x = scr_vrect.x + scr_vrect.width * (i % cols) / cols;
+        fd->y = scr_vrect.y + scr_vrect.height * (i / cols) / rows;
+        fd->width = scr_vrect.x + scr_vrect.width * (i % cols + 1) / cols - fd->x;
+        fd->height = scr_vrect.y + scr_vrect.height * (i / cols + 1) / rows - fd->y;
+        fd->fov_x = Cvar_ClampValue(cl_cctv_fov, 10, 170);
+        fd->fov_y = V_CalcFov(fd->fov_x, fd->width, fd->height);
+    }
+
+    R_RenderFrames(cctv_views, numviews);
+    return qtrue;
+}
+
 /*
 ==================
 V_RenderView
@@ -393,7 +467,9 @@ void V_RenderView(void)
         // build a refresh entity list and calc cl.sim*
         // this also calls CL_CalcViewValues which loads
         // v_forward, etc.
+        TD_START(TD_ADDENTITIES);
         CL_AddEntities();
+        TD_STOP(TD_ADDENTITIES);
 
 #ifdef _DEBUG
         if (cl_testparticles->integer)
@@ -470,7 +546,11 @@ void V_RenderView(void)
         qsort(cl.refdef.entities, cl.refdef.num_entities, sizeof(cl.refdef.entities[0]), entitycmpfnc);
     }
 
-    R_RenderFrame(&cl.refdef);
+    if (!V_RenderWall()) {
+        PROF_Begin(PROF_RENDER_FRAME);
+        R_RenderFrame(&cl.refdef);
+        PROF_End(PROF_RENDER_FRAME);
+    }
 #ifdef _DEBUG
     if (cl_stats->integer)
 #if USE_DLIGHTS
@@ -496,11 +576,54 @@ static void V_Viewpos_f(void)
                (int)cl.refdef.viewangles[YAW]);
 }
 
+/*
+=============
+V_Camera_f
+=============
+*/
+static void V_Camera_f(void)
+{
+    cctv_camera_t *cam;
+    int i, n;
+
+    if (Cmd_Argc() != 2 && Cmd_Argc() != 7) {
+        Com_Printf("Usage: %s <1-%d> [x y z pitch yaw]\n", Cmd_Argv(0), MAX_VIEWS);
+        return;
+    }
+
+    n = atoi(Cmd_Argv(1));
+    if (n < 1 || n > MAX_VIEWS) {
+        Com_Printf("Bad camera number: %s\n", Cmd_Argv(1));
+        return;
+    }
+
+    cam = &cctv_cameras[n - 1];
+    if (Cmd_Argc() == 2) {
+        // place at the current view
+        VectorCopy(cl.refdef.vieworg, cam->origin);
+        VectorCopy(cl.refdef.viewangles, cam->angles);
+    } else {
+        for (i = 0; i < 3; i++)
+            cam->origin[i] = atof(Cmd_Argv(2 + i));
+        cam->angles[PITCH] = atof(Cmd_Argv(5));
+        cam->angles[YAW] = atof(Cmd_Argv(6));
+        cam->angles[ROLL] = 0;
+    }
+    cam->inuse = qtrue;
+}
+
+static void V_ClearCameras_f(void)
+{
+    memset(cctv_cameras, 0, sizeof(cctv_cameras));
+}
+
 static const cmdreg_t v_cmds[] = {
     { "gun_next", V_Gun_Next_f },
     { "gun_prev", V_Gun_Prev_f },
     { "gun_model", V_Gun_Model_f },
     { "viewpos", V_Viewpos_f },
+    { "cctv_camera", V_Camera_f },
+    { "cctv_clear", V_ClearCameras_f },
     { NULL }
 };
 
@@ -538,6 +661,9 @@ void V_Init(void)
     cl_add_blend->changed = cl_add_blend_changed;
 
     cl_adjustfov = Cvar_Get("cl_adjustfov", "0", 0);
+
+    cl_cctv = Cvar_Get("cl_cctv", "0", 0);
+    cl_cctv_fov = Cvar_Get("cl_cctv_fov", "90", 0);
 }
 
 void V_Shutdown(void)
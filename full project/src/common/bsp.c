@@ -30,10 +30,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/utils.h"
 #include "common/mdfour.h"
 #include "system/hunk.h"
+#include "system/system.h"
 
 extern mtexinfo_t nulltexinfo;
 
 static cvar_t *map_visibility_patch;
+static cvar_t *map_vis_cache;
+
+static void BSP_BuildVisRows(bsp_t *bsp);
 
 /*
 ===============================================================================
@@ -218,16 +222,49 @@ LOAD(BrushSides)
     return Q_ERR_SUCCESS;
 }
 
+// brush side planes are also stored as structure of arrays, padded to
+// a multiple of 4 sides with zero planes. sides of well formed maps are
+// not shared, so this fits in BRUSH_PLANES bytes.
+#define BRUSH_PLANES(numsides, numbrushes) \
+    (((numsides) + (numbrushes) * 3) * sizeof(float) * 4)
+
+static void BSP_BrushPlanes(mbrush_t *brush, float *planes)
+{
+    cplane_t    *plane;
+    int         i, j;
+
+    for (i = 0; i < brush->numsides; i++) {
+        plane = brush->firstbrushside[i].plane;
+        j = (i & ~3) * 4 + (i & 3);
+        planes[j +  0] = plane->normal[0];
+        planes[j +  4] = plane->normal[1];
+        planes[j +  8] = plane->normal[2];
+        planes[j + 12] = plane->dist;
+    }
+
+    for (; i & 3; i++) {
+        j = (i & ~3) * 4 + (i & 3);
+        planes[j + 0] = planes[j + 4] = planes[j + 8] = planes[j + 12] = 0;
+    }
+
+    brush->planes = planes;
+}
+
 LOAD(Brushes)
 {
     dbrush_t    *in;
     mbrush_t    *out;
     int         i;
     uint32_t    firstside, numsides, lastside;
+    float       *planes;
+    size_t      left, size;
 
     bsp->numbrushes = count;
     bsp->brushes = ALLOC(sizeof(*out) * count);
 
+    left = BRUSH_PLANES(bsp->numbrushsides, count) / sizeof(float);
+    planes = left ? ALLOC(left * sizeof(float)) : NULL;
+
     in = base;
     out = bsp->brushes;
     for (i = 0; i < count; i++, out++, in++) {
@@ -241,7 +278,15 @@ LOAD(Brushes)
         out->firstbrushside = bsp->brushsides + firstside;
         out->numsides = numsides;
         out->contents = LittleLong(in->contents);
-        out->checkcount = 0;
+        out->planes = NULL;
+
+        // odd maps sharing sides fall back to the per side path
+        size = ((numsides + 3) & ~3) * 4;
+        if (numsides && size <= left) {
+            BSP_BrushPlanes(out, planes);
+            planes += size;
+            left -= size;
+        }
     }
 
     return Q_ERR_SUCCESS;
@@ -789,7 +834,8 @@ static list_t   bsp_cache;
 static void BSP_List_f(void)
 {
     bsp_t *bsp;
-    size_t bytes;
+    size_t bytes, saved;
+    unsigned msec;
 
     if (LIST_EMPTY(&bsp_cache)) {
         Com_Printf("BSP cache is empty\n");
@@ -799,12 +845,26 @@ static void BSP_List_f(void)
     Com_Printf("------------------\n");
     bytes = 0;
 
+    saved = 0;
+    msec = 0;
+
     LIST_FOR_EACH(bsp_t, bsp, &bsp_cache, entry) {
-        Com_Printf("%8"PRIz" : %s (%d refs)\n",
-                   bsp->hunk.mapped, bsp->name, bsp->refcount);
-        bytes += bsp->hunk.mapped;
+        size_t size = bsp->hunk.mapped;
+
+        if (bsp->visrows)
+            size += (size_t)bsp->vis->numclusters * 2 * bsp->visrowsize;
+
+        Com_Printf("%8"PRIz" : %s (%d refs, %u shared, %u msec%s)\n", size,
+                   bsp->name, bsp->refcount, bsp->numshared, bsp->loadtime,
+                   bsp->visrows ? ", vis cached" : "");
+        bytes += size;
+
+        // every shared load would have been a copy of its own
+        saved += size * bsp->numshared;
+        msec += bsp->loadtime * bsp->numshared;
     }
     Com_Printf("Total resident: %"PRIz"\n", bytes);
+    Com_Printf("Saved by sharing: %"PRIz" bytes, %u msec\n", saved, msec);
 }
 
 static bsp_t *BSP_Find(const char *name)
@@ -934,6 +994,7 @@ void BSP_Free(bsp_t *bsp)
         Com_Error(ERR_FATAL, "%s: negative refcount", __func__);
     }
     if (--bsp->refcount == 0) {
+        Z_Free(bsp->visrows);
         Hunk_Free(&bsp->hunk);
         List_Remove(&bsp->entry);
         Z_Free(bsp);
@@ -952,6 +1013,7 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
 {
     bsp_t           *bsp;
     byte            *buf;
+    fsmap_t         map;
     dheader_t       *header;
     const lump_info_t *info;
     size_t          filelen, ofs, len, end, count;
@@ -959,6 +1021,7 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
     byte            *lumpdata[HEADER_LUMPS];
     size_t          lumpcount[HEADER_LUMPS];
     size_t          memsize;
+    unsigned        start;
 
     if (!name || !bsp_p)
         Com_Error(ERR_FATAL, "%s: NULL", __func__);
@@ -971,19 +1034,30 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
     if ((bsp = BSP_Find(name)) != NULL) {
         Com_PageInMemory(bsp->hunk.base, bsp->hunk.cursize);
         bsp->refcount++;
+        bsp->numshared++;
+        Com_DPrintf("%s: %s shared (%d refs)\n", __func__, name, bsp->refcount);
         *bsp_p = bsp;
         return Q_ERR_SUCCESS;
     }
 
+    start = Sys_Milliseconds();
+
     //
-    // load the file
+    // map the file, lumps not used by this build are never read except
+    // for the checksum
     //
-    filelen = FS_LoadFile(name, (void **)&buf);
-    if (!buf) {
-        return filelen;
+    ret = FS_MapFile(name, &map);
+    if (ret < 0) {
+        return ret;
     }
+    buf = map.data;
+    filelen = map.len;
 
     // byte swap and validate the header
+    if (filelen < sizeof(*header)) {
+        ret = Q_ERR_FILE_TOO_SMALL;
+        goto fail2;
+    }
     header = (dheader_t *)buf;
     if (LittleLong(header->ident) != IDBSPHEADER) {
         ret = Q_ERR_UNKNOWN_FORMAT;
@@ -1020,6 +1094,8 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
         memsize += count * info->memsize;
     }
 
+    memsize += BRUSH_PLANES(lumpcount[LUMP_BRUSHSIDES], lumpcount[LUMP_BRUSHES]);
+
     // load into hunk
     len = strlen(name);
     bsp = Z_Mallocz(sizeof(*bsp) + len);
@@ -1027,7 +1103,7 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
     bsp->refcount = 1;
 
     // add an extra page for cacheline alignment overhead
-    Hunk_Begin(&bsp->hunk, memsize + 4096);
+    Hunk_BeginHuge(&bsp->hunk, memsize + 4096);
 
     // calculate the checksum
     bsp->checksum = LittleLong(Com_BlockChecksum(buf, filelen));
@@ -1052,9 +1128,13 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
 
     Hunk_End(&bsp->hunk);
 
+    BSP_BuildVisRows(bsp);
+
     List_Append(&bsp_cache, &bsp->entry);
 
-    FS_FreeFile(buf);
+    bsp->loadtime = Sys_Milliseconds() - start;
+
+    FS_UnmapFile(&map);
 
     *bsp_p = bsp;
     return Q_ERR_SUCCESS;
@@ -1063,7 +1143,7 @@ fail1:
     Hunk_Free(&bsp->hunk);
     Z_Free(bsp);
 fail2:
-    FS_FreeFile(buf);
+    FS_UnmapFile(&map);
     return ret;
 }
 
@@ -1187,22 +1267,11 @@ void BSP_TransformedLightPoint(lightpoint_t *point, vec3_t start, vec3_t end,
 
 #endif
 
-byte *BSP_ClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis)
+static void BSP_DecompressVis(bsp_t *bsp, byte *mask, int cluster, int vis)
 {
     byte    *in, *out, *in_end, *out_end;
     int     c;
 
-    if (!bsp || !bsp->vis) {
-        return memset(mask, 0xff, VIS_MAX_BYTES);
-    }
-    if (cluster == -1) {
-        return memset(mask, 0, bsp->visrowsize);
-    }
-    if (cluster < 0 || cluster >= bsp->vis->numclusters) {
-        Com_Error(ERR_DROP, "%s: bad cluster", __func__);
-    }
-
-    // decompress vis
     in_end = (byte *)bsp->vis + bsp->numvisibility;
     in = (byte *)bsp->vis + bsp->vis->bitofs[cluster][vis];
     out_end = mask + bsp->visrowsize;
@@ -1229,6 +1298,26 @@ overrun:
             *out++ = 0;
         }
     } while (out < out_end);
+}
+
+byte *BSP_ClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis)
+{
+    if (!bsp || !bsp->vis) {
+        return memset(mask, 0xff, VIS_MAX_BYTES);
+    }
+    if (cluster == -1) {
+        return memset(mask, 0, bsp->visrowsize);
+    }
+    if (cluster < 0 || cluster >= bsp->vis->numclusters) {
+        Com_Error(ERR_DROP, "%s: bad cluster", __func__);
+    }
+
+    if (bsp->visrows) {
+        memcpy(mask, bsp->visrows + (cluster * 2 + vis) * bsp->visrowsize,
+               bsp->visrowsize);
+    } else {
+        BSP_DecompressVis(bsp, mask, cluster, vis);
+    }
 
     // apply our ugly PVS patches
     if (map_visibility_patch->integer) {
@@ -1305,9 +1394,38 @@ mmodel_t *BSP_InlineModel(bsp_t *bsp, const char *name)
     return &bsp->models[num];
 }
 
+/*
+==================
+BSP_BuildVisRows
+
+Decompresses all PVS and PHS rows once, if they fit in map_vis_cache
+kilobytes. Patches are still applied by BSP_ClusterVis on each call.
+==================
+*/
+static void BSP_BuildVisRows(bsp_t *bsp)
+{
+    size_t size;
+    int i;
+
+    if (!bsp->vis) {
+        return;
+    }
+
+    size = (size_t)bsp->vis->numclusters * 2 * bsp->visrowsize;
+    if (!size || size > (size_t)Cvar_ClampInteger(map_vis_cache, 0, 1 << 20) * 1024) {
+        return;
+    }
+
+    bsp->visrows = Z_TagMalloc(size, TAG_CMODEL);
+    for (i = 0; i < bsp->vis->numclusters * 2; i++) {
+        BSP_DecompressVis(bsp, bsp->visrows + i * bsp->visrowsize, i >> 1, i & 1);
+    }
+}
+
 void BSP_Init(void)
 {
     map_visibility_patch = Cvar_Get("map_visibility_patch", "1", 0);
+    map_vis_cache = Cvar_Get("map_vis_cache", "4096", 0);
 
     Cmd_AddCommand("bsplist", BSP_List_f);
 
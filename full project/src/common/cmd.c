@@ -218,6 +218,7 @@ typedef struct cmdalias_s {
     list_t  hashEntry;
     list_t  listEntry;
     char    *value;
+    qboolean    literal;    // value can be inserted without expansion
     char    name[1];
 } cmdalias_t;
 
@@ -229,12 +230,11 @@ static list_t   cmd_aliasHash[ALIAS_HASH_SIZE];
 Cmd_AliasFind
 ===============
 */
-static cmdalias_t *Cmd_AliasFind(const char *name)
+static cmdalias_t *Cmd_AliasFindHash(const char *name, unsigned hash)
 {
-    unsigned hash;
     cmdalias_t *alias;
 
-    hash = Com_HashString(name, ALIAS_HASH_SIZE);
+    hash &= ALIAS_HASH_SIZE - 1;
     FOR_EACH_ALIAS_HASH(alias, hash) {
         if (!strcmp(name, alias->name)) {
             return alias;
@@ -244,6 +244,11 @@ static cmdalias_t *Cmd_AliasFind(const char *name)
     return NULL;
 }
 
+static cmdalias_t *Cmd_AliasFind(const char *name)
+{
+    return Cmd_AliasFindHash(name, Com_HashKey(name));
+}
+
 char *Cmd_AliasCommand(const char *name)
 {
     cmdalias_t *a;
@@ -256,6 +261,25 @@ char *Cmd_AliasCommand(const char *name)
     return a->value;
 }
 
+// aliases without positional parameters or unmatched quotes would come
+// out of Cmd_MacroExpandString unchanged, so don't run it on every call
+static qboolean alias_literal(const char *value)
+{
+    qboolean inquote = qfalse;
+    size_t len;
+
+    for (len = 0; value[len]; len++) {
+        if (value[len] == '$') {
+            return qfalse;
+        }
+        if (value[len] == '"') {
+            inquote ^= 1;
+        }
+    }
+
+    return !inquote && len < MAX_STRING_CHARS;
+}
+
 void Cmd_AliasSet(const char *name, const char *cmd)
 {
     cmdalias_t  *a;
@@ -267,6 +291,7 @@ void Cmd_AliasSet(const char *name, const char *cmd)
     if (a) {
         Z_Free(a->value);
         a->value = Cmd_CopyString(cmd);
+        a->literal = alias_literal(cmd);
         return;
     }
 
@@ -274,10 +299,11 @@ void Cmd_AliasSet(const char *name, const char *cmd)
     a = Cmd_Malloc(sizeof(cmdalias_t) + len);
     memcpy(a->name, name, len + 1);
     a->value = Cmd_CopyString(cmd);
+    a->literal = alias_literal(cmd);
 
     List_Append(&cmd_alias, &a->listEntry);
 
-    hash = Com_HashString(name, ALIAS_HASH_SIZE);
+    hash = Com_HashKey(name) & (ALIAS_HASH_SIZE - 1);
     List_Append(&cmd_aliasHash[hash], &a->hashEntry);
 }
 
@@ -442,6 +468,7 @@ typedef struct {
     list_t  entry;
     char    *match;
     char    *command;
+    wildfilter_t    *filter;    // compiled match, NULL if it has macros
 } cmd_trigger_t;
 
 static list_t    cmd_triggers;
@@ -515,6 +542,7 @@ static void Cmd_Trigger_f(void)
     trigger->match = trigger->command + cmdlen;
     memcpy(trigger->command, command, cmdlen);
     memcpy(trigger->match, match, matchlen);
+    trigger->filter = strchr(match, '$') ? NULL : Com_WildCompile(match);
     List_Append(&cmd_triggers, &trigger->entry);
 }
 
@@ -538,6 +566,7 @@ static void Cmd_UnTrigger_f(void)
             int count = 0;
 
             FOR_EACH_TRIGGER_SAFE(trigger, next) {
+                Z_Free(trigger->filter);
                 Z_Free(trigger);
                 count++;
             }
@@ -561,6 +590,7 @@ static void Cmd_UnTrigger_f(void)
     }
 
     List_Remove(&trigger->entry);
+    Z_Free(trigger->filter);
     Z_Free(trigger);
 }
 
@@ -576,11 +606,18 @@ void Cmd_ExecTrigger(const char *string)
 
     // execute matching triggers
     FOR_EACH_TRIGGER(trigger) {
-        match = Cmd_MacroExpandString(trigger->match, qfalse);
-        if (match && Com_WildCmp(match, string)) {
-            Cbuf_AddText(&cmd_buffer, trigger->command);
-            Cbuf_AddText(&cmd_buffer, "\n");
+        if (trigger->filter) {
+            if (!Com_WildMatch(trigger->filter, string)) {
+                continue;
+            }
+        } else {
+            match = Cmd_MacroExpandString(trigger->match, qfalse);
+            if (!match || !Com_WildCmp(match, string)) {
+                continue;
+            }
         }
+        Cbuf_AddText(&cmd_buffer, trigger->command);
+        Cbuf_AddText(&cmd_buffer, "\n");
     }
 }
 
@@ -770,16 +807,16 @@ void Cmd_AddMacro(const char *name, xmacro_t function)
 =============================================================================
 */
 
-#define CMD_HASH_SIZE    128
+// commands live in an open addressing table with linear probing, kept
+// at most half full. removal shifts following entries back into place.
+#define CMD_TABLE_MIN   256
 
-#define FOR_EACH_CMD_HASH(cmd, hash) \
-    LIST_FOR_EACH(cmd_function_t, cmd, &cmd_hash[hash], hashEntry)
 #define FOR_EACH_CMD(cmd) \
     LIST_FOR_EACH(cmd_function_t, cmd, &cmd_functions, listEntry)
 
 typedef struct cmd_function_s {
-    list_t          hashEntry;
     list_t          listEntry;
+    unsigned        hash;
 
     xcommand_t      function;
     xcompleter_t    completer;
@@ -787,7 +824,10 @@ typedef struct cmd_function_s {
 } cmd_function_t;
 
 static  list_t  cmd_functions;        // possible commands to execute
-static  list_t  cmd_hash[CMD_HASH_SIZE];
+
+static  cmd_function_t  **cmd_table;
+static  unsigned        cmd_tablesize;  // power of two
+static  unsigned        cmd_count;
 
 static  int     cmd_argc;
 static  char    *cmd_argv[MAX_STRING_TOKENS]; // pointers to cmd_data[]
@@ -1458,17 +1498,21 @@ void Cmd_TokenizeString(const char *text, qboolean macroExpand)
 
 /*
 ============
-Cmd_Find
+Cmd_FindHash
 ============
 */
-static cmd_function_t *Cmd_Find(const char *name)
+static cmd_function_t *Cmd_FindHash(const char *name, unsigned hash)
 {
     cmd_function_t *cmd;
-    unsigned hash;
+    unsigned i, mask;
+
+    if (!cmd_tablesize) {
+        return NULL;
+    }
 
-    hash = Com_HashString(name, CMD_HASH_SIZE);
-    FOR_EACH_CMD_HASH(cmd, hash) {
-        if (!strcmp(cmd->name, name)) {
+    mask = cmd_tablesize - 1;
+    for (i = hash & mask; (cmd = cmd_table[i]) != NULL; i = (i + 1) & mask) {
+        if (cmd->hash == hash && !strcmp(cmd->name, name)) {
             return cmd;
         }
     }
@@ -1476,10 +1520,73 @@ static cmd_function_t *Cmd_Find(const char *name)
     return NULL;
 }
 
+static cmd_function_t *Cmd_Find(const char *name)
+{
+    return Cmd_FindHash(name, Com_HashKey(name));
+}
+
+static void insert_cmd(cmd_function_t **table, unsigned size, cmd_function_t *cmd)
+{
+    unsigned i;
+
+    for (i = cmd->hash & (size - 1); table[i]; i = (i + 1) & (size - 1))
+        ;
+
+    table[i] = cmd;
+}
+
+static void link_cmd(cmd_function_t *cmd, const char *name)
+{
+    cmd_function_t **table;
+    unsigned i, size;
+
+    if ((cmd_count + 1) * 2 > cmd_tablesize) {
+        size = cmd_tablesize ? cmd_tablesize * 2 : CMD_TABLE_MIN;
+        table = Z_TagMallocz(sizeof(*table) * size, TAG_CMD);
+        for (i = 0; i < cmd_tablesize; i++) {
+            if (cmd_table[i]) {
+                insert_cmd(table, size, cmd_table[i]);
+            }
+        }
+        Z_Free(cmd_table);
+        cmd_table = table;
+        cmd_tablesize = size;
+    }
+
+    cmd->hash = Com_HashKey(name);
+    insert_cmd(cmd_table, cmd_tablesize, cmd);
+    cmd_count++;
+
+    List_Append(&cmd_functions, &cmd->listEntry);
+}
+
+static void unlink_cmd(cmd_function_t *cmd)
+{
+    unsigned i, j, k, mask = cmd_tablesize - 1;
+
+    List_Delete(&cmd->listEntry);
+
+    for (i = cmd->hash & mask; cmd_table[i] != cmd; i = (i + 1) & mask)
+        ;
+
+    // move back any entries that would become unreachable
+    cmd_table[i] = NULL;
+    for (j = (i + 1) & mask; cmd_table[j]; j = (j + 1) & mask) {
+        k = cmd_table[j]->hash & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+            continue;
+        }
+        cmd_table[i] = cmd_table[j];
+        cmd_table[j] = NULL;
+        i = j;
+    }
+
+    cmd_count--;
+}
+
 static void Cmd_RegCommand(const cmdreg_t *reg)
 {
     cmd_function_t *cmd;
-    unsigned hash;
 
 // fail if the command is a variable name
     if (Cvar_Exists(reg->name, qfalse)) {
@@ -1504,10 +1611,7 @@ static void Cmd_RegCommand(const cmdreg_t *reg)
     cmd->function = reg->function;
     cmd->completer = reg->completer;
 
-    List_Append(&cmd_functions, &cmd->listEntry);
-
-    hash = Com_HashString(reg->name, CMD_HASH_SIZE);
-    List_Append(&cmd_hash[hash], &cmd->hashEntry);
+    link_cmd(cmd, reg->name);
 }
 
 /*
@@ -1556,8 +1660,7 @@ void Cmd_RemoveCommand(const char *name)
         return;
     }
 
-    List_Delete(&cmd->listEntry);
-    List_Delete(&cmd->hashEntry);
+    unlink_cmd(cmd);
     Z_Free(cmd);
 }
 
@@ -1604,9 +1707,13 @@ void Cmd_ExecuteCommand(cmdbuf_t *buf)
     cmdalias_t      *a;
     cvar_t          *v;
     char            *text;
+    unsigned        hash;
+
+    // hash once for all tables
+    hash = Com_HashKey(cmd_argv[0]);
 
     // check functions
-    cmd = Cmd_Find(cmd_argv[0]);
+    cmd = Cmd_FindHash(cmd_argv[0], hash);
     if (cmd) {
         if (cmd->function) {
             cmd->function();
@@ -1617,13 +1724,17 @@ void Cmd_ExecuteCommand(cmdbuf_t *buf)
     }
 
     // check aliases
-    a = Cmd_AliasFind(cmd_argv[0]);
+    a = Cmd_AliasFindHash(cmd_argv[0], hash);
     if (a) {
         if (buf->aliasCount >= ALIAS_LOOP_COUNT) {
             Com_WPrintf("Runaway alias loop\n");
             return;
         }
-        text = Cmd_MacroExpandString(a->value, qtrue);
+        if (a->literal) {
+            text = a->value;
+        } else {
+            text = Cmd_MacroExpandString(a->value, qtrue);
+        }
         if (text) {
             buf->aliasCount++;
             Cbuf_InsertText(buf, text);
@@ -1632,7 +1743,7 @@ void Cmd_ExecuteCommand(cmdbuf_t *buf)
     }
 
     // check variables
-    v = Cvar_FindVar(cmd_argv[0]);
+    v = Cvar_FindVarHash(cmd_argv[0], hash);
     if (v) {
         Cvar_Command(v);
         return;
@@ -1939,7 +2050,6 @@ static void Cmd_Complete_f(void)
 {
     cmd_function_t *cmd;
     char *name;
-    unsigned hash;
     size_t len;
 
     if (cmd_argc < 2) {
@@ -1969,10 +2079,7 @@ static void Cmd_Complete_f(void)
     cmd->function = NULL;
     cmd->completer = NULL;
 
-    List_Append(&cmd_functions, &cmd->listEntry);
-
-    hash = Com_HashString(name, CMD_HASH_SIZE);
-    List_Append(&cmd_hash[hash], &cmd->hashEntry);
+    link_cmd(cmd, name);
 }
 
 static const cmdreg_t c_cmd[] = {
@@ -2003,9 +2110,6 @@ void Cmd_Init(void)
     int i;
 
     List_Init(&cmd_functions);
-    for (i = 0; i < CMD_HASH_SIZE; i++) {
-        List_Init(&cmd_hash[i]);
-    }
 
     List_Init(&cmd_alias);
     for (i = 0; i < ALIAS_HASH_SIZE; i++) {
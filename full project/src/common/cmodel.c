@@ -26,19 +26,76 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/math.h"
 #include "common/zone.h"
 #include "system/hunk.h"
+#include "system/thread.h"
+#if USE_TESTS
+#include "system/system.h"
+#endif
+
+// vector path used where the compiler targets it
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#elif (defined __ARM_NEON) || (defined __ARM_NEON__)
+#define USE_NEON    1
+#include <arm_neon.h>
+#endif
 
 mtexinfo_t nulltexinfo;
 
 static mleaf_t      nullleaf;
 
 static int          floodvalid;
-static int          checkcount;
 
 static cvar_t       *map_noareas;
 static cvar_t       *map_allsolid_bug;
+static cvar_t       *map_fatpvs_cache;
+
+// union of PVS rows is a function of the sorted cluster set only
+#define FATPVS_HASH     256     // must be power of two
+#define FATPVS_MAX      4096
+
+typedef struct {
+    unsigned    hash;
+    qboolean    referenced;     // since the clock hand last passed
+    int         next;           // hash chain, -1 terminates
+    int         numclusters;
+    int         clusters[MAX_FAT_CLUSTERS];
+} fatpvs_t;
+
+// send workers look up rows concurrently, everything below is guarded
+// by the lock
+typedef struct fatpvs_cache_s {
+    qmutex_t    *lock;
+    int         numentries;
+    int         numused;        // slots below are taken
+    int         hand;           // clock hand for replacement
+    size_t      rowsize;
+    int         hashtable[FATPVS_HASH];
+    fatpvs_t    *entries;
+    byte        *rows;
+} fatpvs_cache_t;
+
+static fatpvs_cache_t *AllocFatPVSCache(cm_t *cm);
+static void FreeFatPVSCache(fatpvs_cache_t *fc);
 
 static void    FloodAreaConnections(cm_t *cm);
 
+#if USE_TESTS
+// recent traces replayed by CM_TraceTest_f
+#define TRACE_RECORDS   4096
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    mnode_t     *headnode;
+    int         brushmask;
+} tracerecord_t;
+
+static tracerecord_t    trace_records[TRACE_RECORDS];
+static unsigned         trace_numrecords;
+static qboolean         trace_replaying;
+#endif
+
 /*
 ==================
 CM_FreeMap
@@ -49,8 +106,14 @@ void CM_FreeMap(cm_t *cm)
     if (cm->floodnums) {
         Z_Free(cm->floodnums);
     }
+    FreeFatPVSCache(cm->fatpvs);
     BSP_Free(cm->cache);
 
+#if USE_TESTS
+    // recorded headnodes may point into this map
+    trace_numrecords = 0;
+#endif
+
     memset(cm, 0, sizeof(*cm));
 }
 
@@ -65,16 +128,23 @@ qerror_t CM_LoadMap(cm_t *cm, const char *name)
 {
     bsp_t *cache;
     qerror_t ret;
+    int numareas, bytes;
 
     ret = BSP_Load(name, &cache);
     if (!cache) {
         return ret;
     }
 
+    numareas = cache->numareas;
+    bytes = (numareas + 7) >> 3;
+
     cm->cache = cache;
-    cm->floodnums = Z_TagMallocz(sizeof(int) * cm->cache->numareas +
-                                 sizeof(qboolean) * (cm->cache->lastareaportal + 1), TAG_CMODEL);
-    cm->portalopen = (qboolean *)(cm->floodnums + cm->cache->numareas);
+    cm->floodnums = Z_TagMallocz(sizeof(int) * numareas +
+                                 sizeof(qboolean) * (cache->lastareaportal + 1) +
+                                 bytes * numareas, TAG_CMODEL);
+    cm->portalopen = (qboolean *)(cm->floodnums + numareas);
+    cm->areabits = (byte *)(cm->portalopen + cache->lastareaportal + 1);
+    cm->fatpvs = AllocFatPVSCache(cm);
     FloodAreaConnections(cm);
 
     return Q_ERR_SUCCESS;
@@ -109,14 +179,15 @@ mleaf_t *CM_LeafNum(cm_t *cm, int number)
 
 //=======================================================================
 
-static cplane_t box_planes[12];
-static mnode_t  box_nodes[6];
-static mnode_t  *box_headnode;
-static mbrush_t box_brush;
-static mbrush_t *box_leafbrush;
-static mbrushside_t box_brushsides[6];
-static mleaf_t  box_leaf;
-static mleaf_t  box_emptyleaf;
+// per thread, CM_HeadnodeForBox rewrites the planes for every entity
+static q_threadlocal cplane_t box_planes[12];
+static q_threadlocal mnode_t  box_nodes[6];
+static q_threadlocal mnode_t  *box_headnode;
+static q_threadlocal mbrush_t box_brush;
+static q_threadlocal mbrush_t *box_leafbrush;
+static q_threadlocal mbrushside_t box_brushsides[6];
+static q_threadlocal mleaf_t  box_leaf;
+static q_threadlocal mleaf_t  box_emptyleaf;
 
 /*
 ===================
@@ -124,6 +195,7 @@ CM_InitBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
+Done by CM_Init for the main thread, and on first use for others.
 ===================
 */
 static void CM_InitBoxHull(void)
@@ -189,6 +261,9 @@ BSP trees instead of being compared directly.
 */
 mnode_t *CM_HeadnodeForBox(vec3_t mins, vec3_t maxs)
 {
+    if (!box_headnode)
+        CM_InitBoxHull();
+
     box_planes[0].dist = maxs[0];
     box_planes[1].dist = -maxs[0];
     box_planes[2].dist = mins[0];
@@ -221,53 +296,56 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-static int      leaf_count, leaf_maxcount;
-static mleaf_t  **leaf_list;
-static float    *leaf_mins, *leaf_maxs;
-static mnode_t  *leaf_topnode;
-
-static void CM_BoxLeafs_r(mnode_t *node)
+typedef struct {
+    int         count, maxcount;
+    mleaf_t     **list;
+    float       *mins, *maxs;
+    mnode_t     *topnode;
+} leafwork_t;
+
+static void CM_BoxLeafs_r(leafwork_t *lw, mnode_t *node)
 {
     int     s;
 
     while (node->plane) {
-        s = BoxOnPlaneSideFast(leaf_mins, leaf_maxs, node->plane);
+        s = BoxOnPlaneSideFast(lw->mins, lw->maxs, node->plane);
         if (s == 1) {
             node = node->children[0];
         } else if (s == 2) {
             node = node->children[1];
         } else {
             // go down both
-            if (!leaf_topnode) {
-                leaf_topnode = node;
+            if (!lw->topnode) {
+                lw->topnode = node;
             }
-            CM_BoxLeafs_r(node->children[0]);
+            CM_BoxLeafs_r(lw, node->children[0]);
             node = node->children[1];
         }
     }
 
-    if (leaf_count < leaf_maxcount) {
-        leaf_list[leaf_count++] = (mleaf_t *)node;
+    if (lw->count < lw->maxcount) {
+        lw->list[lw->count++] = (mleaf_t *)node;
     }
 }
 
 static int CM_BoxLeafs_headnode(vec3_t mins, vec3_t maxs, mleaf_t **list, int listsize,
                                 mnode_t *headnode, mnode_t **topnode)
 {
-    leaf_list = list;
-    leaf_count = 0;
-    leaf_maxcount = listsize;
-    leaf_mins = mins;
-    leaf_maxs = maxs;
+    leafwork_t  lw;
 
-    leaf_topnode = NULL;
+    lw.list = list;
+    lw.count = 0;
+    lw.maxcount = listsize;
+    lw.mins = mins;
+    lw.maxs = maxs;
+    lw.topnode = NULL;
 
-    CM_BoxLeafs_r(headnode);
+    CM_BoxLeafs_r(&lw, headnode);
 
     if (topnode)
-        *topnode = leaf_topnode;
+        *topnode = lw.topnode;
 
-    return leaf_count;
+    return lw.count;
 }
 
 int CM_BoxLeafs(cm_t *cm, vec3_t mins, vec3_t maxs, mleaf_t **list, int listsize, mnode_t **topnode)
@@ -349,55 +427,187 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON    (0.03125)
 
-static vec3_t   trace_start, trace_end;
-static vec3_t   trace_mins, trace_maxs;
-static vec3_t   trace_extents;
+// brushes remembered as already clipped by one trace
+#define TRACE_CHECKED   64
+
+// state of one trace, kept on the stack so traces may run concurrently
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    vec3_t      extents;
+
+    trace_t     *trace;
+    int         contents;
+    qboolean    ispoint;        // optimized case
 
-static trace_t  *trace_trace;
-static int      trace_contents;
-static qboolean trace_ispoint;      // optimized case
+    mbrush_t    *checked[TRACE_CHECKED];
+} tracework_t;
 
 /*
 ================
-CM_ClipBoxToBrush
+CM_BrushChecked
+
+A brush may be reached from several leafs along the trace. Clipping it
+again gives the same result, so losing an entry to a collision is only
+wasted work.
 ================
 */
-static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
-                              trace_t *trace, mbrush_t *brush)
+static inline qboolean CM_BrushChecked(tracework_t *tw, mbrush_t *brush)
+{
+    mbrush_t **slot = &tw->checked[((uintptr_t)brush / sizeof(*brush)) & (TRACE_CHECKED - 1)];
+
+    if (*slot == brush)
+        return qtrue;
+
+    *slot = brush;
+    return qfalse;
+}
+
+#if USE_TESTS
+static qboolean trace_scalar;       // ignore brush->planes
+
+static void CM_RecordTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+                           mnode_t *headnode, int brushmask)
+{
+    tracerecord_t *rec;
+
+    // box hull planes are rewritten for every entity
+    if (trace_replaying || !headnode || headnode == box_headnode)
+        return;
+
+    rec = &trace_records[trace_numrecords++ % TRACE_RECORDS];
+    VectorCopy(start, rec->start);
+    VectorCopy(end, rec->end);
+    VectorCopy(mins, rec->mins);
+    VectorCopy(maxs, rec->maxs);
+    rec->headnode = headnode;
+    rec->brushmask = brushmask;
+}
+#endif
+
+/*
+================
+CM_BrushSideDists
+
+Computes distances of p1 and p2 (if given) from four sides of the brush
+starting at first, with the planes pushed out for mins/maxs unless this
+is a point trace. Sides past the end of the brush come out as 0, which
+never clips anything.
+================
+*/
+static void CM_BrushSideDists(mbrush_t *brush, int first, qboolean ispoint,
+                              vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+                              float *d1, float *d2)
 {
     int         i, j;
-    cplane_t    *plane, *clipplane;
+    cplane_t    *plane;
     float       dist;
-    float       enterfrac, leavefrac;
     vec3_t      ofs;
-    float       d1, d2;
-    qboolean    getout, startout;
-    float       f;
-    mbrushside_t    *side, *leadside;
-
-    enterfrac = -1;
-    leavefrac = 1;
-    clipplane = NULL;
+    const float *p;
+
+#if USE_TESTS
+    if (trace_scalar)
+        goto scalar;
+#endif
+
+    p = brush->planes;
+    if (!p)
+        goto scalar;
+    p += first * 4;
+
+#if USE_SSE2
+    {
+        __m128 nx = _mm_load_ps(p + 0);
+        __m128 ny = _mm_load_ps(p + 4);
+        __m128 nz = _mm_load_ps(p + 8);
+        __m128 d = _mm_load_ps(p + 12);
+        __m128 zero = _mm_setzero_ps();
+        __m128 m, ox, oy, oz;
+
+        if (!ispoint) {
+            // pick maxs where the normal is negative, mins elsewhere
+            m = _mm_cmplt_ps(nx, zero);
+            ox = _mm_or_ps(_mm_and_ps(m, _mm_set1_ps(maxs[0])), _mm_andnot_ps(m, _mm_set1_ps(mins[0])));
+            m = _mm_cmplt_ps(ny, zero);
+            oy = _mm_or_ps(_mm_and_ps(m, _mm_set1_ps(maxs[1])), _mm_andnot_ps(m, _mm_set1_ps(mins[1])));
+            m = _mm_cmplt_ps(nz, zero);
+            oz = _mm_or_ps(_mm_and_ps(m, _mm_set1_ps(maxs[2])), _mm_andnot_ps(m, _mm_set1_ps(mins[2])));
+            d = _mm_sub_ps(d, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx), _mm_mul_ps(oy, ny)), _mm_mul_ps(oz, nz)));
+        }
 
-    if (!brush->numsides)
-        return;
+        m = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p1[0]), nx),
+                                  _mm_mul_ps(_mm_set1_ps(p1[1]), ny)),
+                       _mm_mul_ps(_mm_set1_ps(p1[2]), nz));
+        _mm_storeu_ps(d1, _mm_sub_ps(m, d));
+        if (p2) {
+            m = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p2[0]), nx),
+                                      _mm_mul_ps(_mm_set1_ps(p2[1]), ny)),
+                           _mm_mul_ps(_mm_set1_ps(p2[2]), nz));
+            _mm_storeu_ps(d2, _mm_sub_ps(m, d));
+        }
+    }
+    return;
+#elif USE_NEON
+    {
+        float32x4_t nx = vld1q_f32(p + 0);
+        float32x4_t ny = vld1q_f32(p + 4);
+        float32x4_t nz = vld1q_f32(p + 8);
+        float32x4_t d = vld1q_f32(p + 12);
+        float32x4_t zero = vdupq_n_f32(0);
+        float32x4_t ox, oy, oz, m;
+
+        if (!ispoint) {
+            ox = vbslq_f32(vcltq_f32(nx, zero), vdupq_n_f32(maxs[0]), vdupq_n_f32(mins[0]));
+            oy = vbslq_f32(vcltq_f32(ny, zero), vdupq_n_f32(maxs[1]), vdupq_n_f32(mins[1]));
+            oz = vbslq_f32(vcltq_f32(nz, zero), vdupq_n_f32(maxs[2]), vdupq_n_f32(mins[2]));
+            d = vsubq_f32(d, vaddq_f32(vaddq_f32(vmulq_f32(ox, nx), vmulq_f32(oy, ny)), vmulq_f32(oz, nz)));
+        }
 
-    getout = qfalse;
-    startout = qfalse;
-    leadside = NULL;
+        m = vaddq_f32(vaddq_f32(vmulq_n_f32(nx, p1[0]), vmulq_n_f32(ny, p1[1])), vmulq_n_f32(nz, p1[2]));
+        vst1q_f32(d1, vsubq_f32(m, d));
+        if (p2) {
+            m = vaddq_f32(vaddq_f32(vmulq_n_f32(nx, p2[0]), vmulq_n_f32(ny, p2[1])), vmulq_n_f32(nz, p2[2]));
+            vst1q_f32(d2, vsubq_f32(m, d));
+        }
+    }
+    return;
+#else
+    for (i = 0; i < 4; i++, p++) {
+        if (!ispoint) {
+            for (j = 0; j < 3; j++) {
+                if (p[j * 4] < 0)
+                    ofs[j] = maxs[j];
+                else
+                    ofs[j] = mins[j];
+            }
+            dist = p[12] - (ofs[0] * p[0] + ofs[1] * p[4] + ofs[2] * p[8]);
+        } else {
+            dist = p[12];
+        }
+        d1[i] = p1[0] * p[0] + p1[1] * p[4] + p1[2] * p[8] - dist;
+        if (p2)
+            d2[i] = p2[0] * p[0] + p2[1] * p[4] + p2[2] * p[8] - dist;
+    }
+    return;
+#endif
+
+scalar:
+    for (i = 0; i < 4; i++, first++) {
+        if (first >= brush->numsides) {
+            d1[i] = 0;
+            if (p2)
+                d2[i] = 0;
+            continue;
+        }
 
-    side = brush->firstbrushside;
-    for (i = 0; i < brush->numsides; i++, side++) {
-        plane = side->plane;
+        plane = brush->firstbrushside[first].plane;
 
         // FIXME: special case for axial
 
-        if (!trace_ispoint) {
+        if (!ispoint) {
             // general box case
 
             // push the plane out apropriately for mins/maxs
-
-            // FIXME: use signbits into 8 way lookup for each mins/maxs
             for (j = 0; j < 3; j++) {
                 if (plane->normal[j] < 0)
                     ofs[j] = maxs[j];
@@ -411,35 +621,70 @@ static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
             dist = plane->dist;
         }
 
-        d1 = DotProduct(p1, plane->normal) - dist;
-        d2 = DotProduct(p2, plane->normal) - dist;
+        d1[i] = DotProduct(p1, plane->normal) - dist;
+        if (p2)
+            d2[i] = DotProduct(p2, plane->normal) - dist;
+    }
+}
 
-        if (d2 > 0)
-            getout = qtrue; // endpoint is not in solid
-        if (d1 > 0)
-            startout = qtrue;
+/*
+================
+CM_ClipBoxToBrush
+================
+*/
+static void CM_ClipBoxToBrush(tracework_t *tw, trace_t *trace, mbrush_t *brush)
+{
+    int         i, j;
+    cplane_t    *clipplane;
+    float       enterfrac, leavefrac;
+    float       d1[4], d2[4];
+    qboolean    getout, startout;
+    float       f;
+    mbrushside_t    *leadside;
 
-        // if completely in front of face, no intersection
-        if (d1 > 0 && d2 >= d1)
-            return;
+    enterfrac = -1;
+    leavefrac = 1;
+    clipplane = NULL;
 
-        if (d1 <= 0 && d2 <= 0)
-            continue;
+    if (!brush->numsides)
+        return;
+
+    getout = qfalse;
+    startout = qfalse;
+    leadside = NULL;
 
-        // crosses face
-        if (d1 > d2) {
-            // enter
-            f = (d1 - DIST_EPSILON) / (d1 - d2);
-            if (f > enterfrac) {
-                enterfrac = f;
-                clipplane = plane;
-                leadside = side;
+    for (i = 0; i < brush->numsides; i += 4) {
+        CM_BrushSideDists(brush, i, tw->ispoint, tw->mins, tw->maxs,
+                          tw->start, tw->end, d1, d2);
+
+        for (j = 0; j < 4; j++) {
+            if (d2[j] > 0)
+                getout = qtrue; // endpoint is not in solid
+            if (d1[j] > 0)
+                startout = qtrue;
+
+            // if completely in front of face, no intersection
+            if (d1[j] > 0 && d2[j] >= d1[j])
+                return;
+
+            if (d1[j] <= 0 && d2[j] <= 0)
+                continue;
+
+            // crosses face
+            if (d1[j] > d2[j]) {
+                // enter
+                f = (d1[j] - DIST_EPSILON) / (d1[j] - d2[j]);
+                if (f > enterfrac) {
+                    enterfrac = f;
+                    leadside = brush->firstbrushside + i + j;
+                    clipplane = leadside->plane;
+                }
+            } else {
+                // leave
+                f = (d1[j] + DIST_EPSILON) / (d1[j] - d2[j]);
+                if (f < leavefrac)
+                    leavefrac = f;
             }
-        } else {
-            // leave
-            f = (d1 + DIST_EPSILON) / (d1 - d2);
-            if (f < leavefrac)
-                leavefrac = f;
         }
     }
 
@@ -473,45 +718,22 @@ static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 CM_TestBoxInBrush
 ================
 */
-static void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
-                              trace_t *trace, mbrush_t *brush)
+static void CM_TestBoxInBrush(tracework_t *tw, trace_t *trace, mbrush_t *brush)
 {
     int         i, j;
-    cplane_t    *plane;
-    float       dist;
-    vec3_t      ofs;
-    float       d1;
-    mbrushside_t    *side;
+    float       d1[4];
 
     if (!brush->numsides)
         return;
 
-    side = brush->firstbrushside;
-    for (i = 0; i < brush->numsides; i++, side++) {
-        plane = side->plane;
-
-        // FIXME: special case for axial
-
-        // general box case
-
-        // push the plane out apropriately for mins/maxs
-
-        // FIXME: use signbits into 8 way lookup for each mins/maxs
-        for (j = 0; j < 3; j++) {
-            if (plane->normal[j] < 0)
-                ofs[j] = maxs[j];
-            else
-                ofs[j] = mins[j];
-        }
-        dist = DotProduct(ofs, plane->normal);
-        dist = plane->dist - dist;
-
-        d1 = DotProduct(p1, plane->normal) - dist;
+    for (i = 0; i < brush->numsides; i += 4) {
+        CM_BrushSideDists(brush, i, qfalse, tw->mins, tw->maxs,
+                          tw->start, NULL, d1, NULL);
 
         // if completely in front of face, no intersection
-        if (d1 > 0)
-            return;
-
+        for (j = 0; j < 4; j++)
+            if (d1[j] > 0)
+                return;
     }
 
     // inside this brush
@@ -526,25 +748,24 @@ static void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf(mleaf_t *leaf)
+static void CM_TraceToLeaf(tracework_t *tw, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & tw->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_BrushChecked(tw, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tw->contents))
             continue;
-        CM_ClipBoxToBrush(trace_mins, trace_maxs, trace_start, trace_end, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_ClipBoxToBrush(tw, tw->trace, b);
+        if (!tw->trace->fraction)
             return;
     }
 
@@ -556,25 +777,24 @@ static void CM_TraceToLeaf(mleaf_t *leaf)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf(mleaf_t *leaf)
+static void CM_TestInLeaf(tracework_t *tw, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & tw->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_BrushChecked(tw, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tw->contents))
             continue;
-        CM_TestBoxInBrush(trace_mins, trace_maxs, trace_start, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_TestBoxInBrush(tw, tw->trace, b);
+        if (!tw->trace->fraction)
             return;
     }
 
@@ -587,7 +807,8 @@ CM_RecursiveHullCheck
 
 ==================
 */
-static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, vec3_t p1, vec3_t p2)
+static void CM_RecursiveHullCheck(tracework_t *tw, mnode_t *node,
+                                  float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
     cplane_t    *plane;
     float       t1, t2, offset;
@@ -597,14 +818,14 @@ static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, vec3_t p1
     int         side;
     float       midf;
 
-    if (trace_trace->fraction <= p1f)
+    if (tw->trace->fraction <= p1f)
         return;     // already hit something nearer
 
 recheck:
     // if plane is NULL, we are in a leaf node
     plane = node->plane;
     if (!plane) {
-        CM_TraceToLeaf((mleaf_t *)node);
+        CM_TraceToLeaf(tw, (mleaf_t *)node);
         return;
     }
 
@@ -615,16 +836,16 @@ recheck:
     if (plane->type < 3) {
         t1 = p1[plane->type] - plane->dist;
         t2 = p2[plane->type] - plane->dist;
-        offset = trace_extents[plane->type];
+        offset = tw->extents[plane->type];
     } else {
         t1 = PlaneDiff(p1, plane);
         t2 = PlaneDiff(p2, plane);
-        if (trace_ispoint)
+        if (tw->ispoint)
             offset = 0;
         else
-            offset = fabs(trace_extents[0] * plane->normal[0]) +
-                     fabs(trace_extents[1] * plane->normal[1]) +
-                     fabs(trace_extents[2] * plane->normal[2]);
+            offset = fabs(tw->extents[0] * plane->normal[0]) +
+                     fabs(tw->extents[1] * plane->normal[1]) +
+                     fabs(tw->extents[2] * plane->normal[2]);
     }
 
     // see which sides we need to consider
@@ -660,7 +881,7 @@ recheck:
     midf = p1f + (p2f - p1f) * frac;
     LerpVector(p1, p2, frac, mid);
 
-    CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+    CM_RecursiveHullCheck(tw, node->children[side], p1f, midf, p1, mid);
 
     // go past the node
     clamp(frac2, 0, 1);
@@ -668,7 +889,7 @@ recheck:
     midf = p1f + (p2f - p1f) * frac2;
     LerpVector(p1, p2, frac2, mid);
 
-    CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+    CM_RecursiveHullCheck(tw, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
 
@@ -684,23 +905,28 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
                  vec3_t mins, vec3_t maxs,
                  mnode_t *headnode, int brushmask)
 {
-    checkcount++;       // for multi-check avoidance
+    tracework_t tw;
+
+#if USE_TESTS
+    CM_RecordTrace(start, end, mins, maxs, headnode, brushmask);
+#endif
 
     // fill in a default trace
-    trace_trace = trace;
-    memset(trace_trace, 0, sizeof(*trace_trace));
-    trace_trace->fraction = 1;
-    trace_trace->surface = &(nulltexinfo.c);
+    memset(trace, 0, sizeof(*trace));
+    trace->fraction = 1;
+    trace->surface = &(nulltexinfo.c);
 
     if (!headnode) {
         return;
     }
 
-    trace_contents = brushmask;
-    VectorCopy(start, trace_start);
-    VectorCopy(end, trace_end);
-    VectorCopy(mins, trace_mins);
-    VectorCopy(maxs, trace_maxs);
+    tw.trace = trace;
+    tw.contents = brushmask;
+    VectorCopy(start, tw.start);
+    VectorCopy(end, tw.end);
+    VectorCopy(mins, tw.mins);
+    VectorCopy(maxs, tw.maxs);
+    memset(tw.checked, 0, sizeof(tw.checked));
 
     //
     // check for position test special case
@@ -719,11 +945,11 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
 
         numleafs = CM_BoxLeafs_headnode(c1, c2, leafs, 1024, headnode, NULL);
         for (i = 0; i < numleafs; i++) {
-            CM_TestInLeaf(leafs[i]);
-            if (trace_trace->allsolid)
+            CM_TestInLeaf(&tw, leafs[i]);
+            if (trace->allsolid)
                 break;
         }
-        VectorCopy(start, trace_trace->endpos);
+        VectorCopy(start, trace->endpos);
         return;
     }
 
@@ -732,24 +958,24 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
     //
     if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
         && maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0) {
-        trace_ispoint = qtrue;
-        VectorClear(trace_extents);
+        tw.ispoint = qtrue;
+        VectorClear(tw.extents);
     } else {
-        trace_ispoint = qfalse;
-        trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-        trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-        trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+        tw.ispoint = qfalse;
+        tw.extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+        tw.extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+        tw.extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
     }
 
     //
     // general sweeping through world
     //
-    CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+    CM_RecursiveHullCheck(&tw, headnode, 0, 1, start, end);
 
-    if (trace_trace->fraction == 1)
-        VectorCopy(end, trace_trace->endpos);
+    if (trace->fraction == 1)
+        VectorCopy(end, trace->endpos);
     else
-        LerpVector(start, end, trace_trace->fraction, trace_trace->endpos);
+        LerpVector(start, end, trace->fraction, trace->endpos);
 }
 
 
@@ -846,6 +1072,44 @@ static void FloodArea_r(cm_t *cm, int number, int floodnum)
     }
 }
 
+/*
+=================
+UpdateAreaBits
+
+Builds bits of connected areas for every area after floods have changed.
+Done right away on the main thread, so that send workers calling
+CM_WriteAreaBits only ever copy.
+=================
+*/
+static void UpdateAreaBits(cm_t *cm)
+{
+    int leaders[MAX_MAP_AREAS];
+    int i, j, numareas, bytes;
+
+    numareas = cm->cache->numareas;
+    bytes = (numareas + 7) >> 3;
+
+    memset(cm->areabits, 0, bytes * numareas);
+
+    // collect each flood in the row of its first area
+    for (i = 1; i < numareas; i++) {
+        for (j = 1; j < i; j++) {
+            if (cm->floodnums[j] == cm->floodnums[i]) {
+                break;
+            }
+        }
+        leaders[i] = j;
+        Q_SetBit(cm->areabits + leaders[i] * bytes, i);
+    }
+
+    // and copy it to the other areas of the flood
+    for (i = 1; i < numareas; i++) {
+        if (leaders[i] != i) {
+            memcpy(cm->areabits + i * bytes, cm->areabits + leaders[i] * bytes, bytes);
+        }
+    }
+}
+
 static void FloodAreaConnections(cm_t *cm)
 {
     int     i;
@@ -864,6 +1128,96 @@ static void FloodAreaConnections(cm_t *cm)
         floodnum++;
         FloodArea_r(cm, i, floodnum);
     }
+
+    cm->floodnext = floodnum + 1;
+    UpdateAreaBits(cm);
+}
+
+// gives floodnum 'to' to every area connected to start that has 'from',
+// which is the whole component start was in before a single portal changed
+static void RelabelArea(cm_t *cm, int start, int from, int to)
+{
+    int stack[MAX_MAP_AREAS];
+    int i, count, other;
+    mareaportal_t *p;
+    marea_t *area;
+
+    cm->floodnums[start] = to;
+    stack[0] = start;
+    count = 1;
+
+    while (count) {
+        area = &cm->cache->areas[stack[--count]];
+        p = area->firstareaportal;
+        for (i = 0; i < area->numareaportals; i++, p++) {
+            other = p->otherarea;
+            if (cm->portalopen[p->portalnum] && cm->floodnums[other] == from) {
+                cm->floodnums[other] = to;
+                stack[count++] = other;
+            }
+        }
+    }
+}
+
+/*
+=================
+UpdateAreaConnections
+
+Opening a portal merges the components on its sides, closing one splits
+at most the component it was in. Either way only areas touching the
+changed portal need to be flooded from, rather than the whole map.
+=================
+*/
+#define MAX_PORTAL_ENDS 16
+
+static void UpdateAreaConnections(cm_t *cm, int portalnum)
+{
+    bsp_t *cache = cm->cache;
+    int ends[MAX_PORTAL_ENDS], from[MAX_PORTAL_ENDS];
+    int i, j, count, a, b;
+    mareaportal_t *p;
+    marea_t *area;
+
+    // find areas on either side of the portal
+    count = 0;
+    for (i = 1; i < cache->numareas; i++) {
+        area = &cache->areas[i];
+        p = area->firstareaportal;
+        for (j = 0; j < area->numareaportals; j++, p++) {
+            if (p->portalnum != portalnum) {
+                continue;
+            }
+            if (count + 2 > MAX_PORTAL_ENDS) {
+                FloodAreaConnections(cm);
+                return;
+            }
+            ends[count++] = i;
+            ends[count++] = p->otherarea;
+        }
+    }
+
+    if (cm->portalopen[portalnum]) {
+        for (i = 0; i < count; i += 2) {
+            a = cm->floodnums[ends[i]];
+            b = cm->floodnums[ends[i + 1]];
+            if (a != b) {
+                RelabelArea(cm, ends[i + 1], b, a);
+            }
+        }
+    } else {
+        // each part left contains one of the ends, already relabeled
+        // ones were reached from another end
+        for (i = 0; i < count; i++) {
+            from[i] = cm->floodnums[ends[i]];
+        }
+        for (i = 0; i < count; i++) {
+            if (cm->floodnums[ends[i]] == from[i]) {
+                RelabelArea(cm, ends[i], from[i], cm->floodnext++);
+            }
+        }
+    }
+
+    UpdateAreaBits(cm);
 }
 
 void CM_SetAreaPortalState(cm_t *cm, int portalnum, qboolean open)
@@ -883,8 +1237,13 @@ void CM_SetAreaPortalState(cm_t *cm, int portalnum, qboolean open)
         return;
     }
 
+    open = !!open;
+    if (cm->portalopen[portalnum] == open) {
+        return;
+    }
+
     cm->portalopen[portalnum] = open;
-    FloodAreaConnections(cm);
+    UpdateAreaConnections(cm, portalnum);
 }
 
 qboolean CM_AreasConnected(cm_t *cm, int area1, int area2)
@@ -925,8 +1284,6 @@ This is used by the client refreshes to cull visibility
 int CM_WriteAreaBits(cm_t *cm, byte *buffer, int area)
 {
     bsp_t   *cache = cm->cache;
-    int     i;
-    int     floodnum;
     int     bytes;
 
     if (!cache) {
@@ -935,20 +1292,14 @@ int CM_WriteAreaBits(cm_t *cm, byte *buffer, int area)
 
     bytes = (cache->numareas + 7) >> 3;
 
-    if (map_noareas->integer || !area) {
+    if (map_noareas->integer || !area || area >= cache->numareas) {
         // for debugging, send everything
         memset(buffer, 255, bytes);
-    } else {
-        memset(buffer, 0, bytes);
-
-        floodnum = cm->floodnums[area];
-        for (i = 0; i < cache->numareas; i++) {
-            if (cm->floodnums[i] == floodnum) {
-                Q_SetBit(buffer, i);
-            }
-        }
+        return bytes;
     }
 
+    // rebuilt only after floods change, not for every client frame
+    memcpy(buffer, cm->areabits + area * bytes, bytes);
     return bytes;
 }
 
@@ -1036,26 +1387,20 @@ qboolean CM_HeadnodeVisible(mnode_t *node, byte *visbits)
 
 /*
 ============
-CM_FatPVS
+CM_FatClusters
 
-The client will interpolate the view position,
-so we can't use a single PVS point
-===========
+Returns the sorted set of clusters touched by a small box around the view
+position. Two positions with equal sets have equal fat PVS.
+============
 */
-byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org)
+int CM_FatClusters(cm_t *cm, const vec3_t org, int *clusters)
 {
-    byte    temp[VIS_MAX_BYTES];
-    mleaf_t *leafs[64];
-    int     clusters[64];
-    int     i, j, count, longs;
-    uint_fast32_t *src, *dst;
+    mleaf_t *leafs[MAX_FAT_CLUSTERS];
+    int     i, j, c, count, numclusters;
     vec3_t  mins, maxs;
 
     if (!cm->cache) {   // map not loaded
-        return memset(mask, 0, VIS_MAX_BYTES);
-    }
-    if (!cm->cache->vis) {
-        return memset(mask, 0xff, VIS_MAX_BYTES);
+        return 0;
     }
 
     for (i = 0; i < 3; i++) {
@@ -1063,37 +1408,213 @@ byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org)
         maxs[i] = org[i] + 8;
     }
 
-    count = CM_BoxLeafs(cm, mins, maxs, leafs, 64, NULL);
+    count = CM_BoxLeafs(cm, mins, maxs, leafs, MAX_FAT_CLUSTERS, NULL);
     if (count < 1)
         Com_Error(ERR_DROP, "CM_FatPVS: leaf count < 1");
-    longs = VIS_FAST_LONGS(cm->cache);
 
-    // convert leafs to clusters
+    // insertion sort, dropping duplicates
+    numclusters = 0;
     for (i = 0; i < count; i++) {
-        clusters[i] = leafs[i]->cluster;
+        c = leafs[i]->cluster;
+        for (j = numclusters; j > 0 && clusters[j - 1] > c; j--)
+            ;
+        if (j > 0 && clusters[j - 1] == c)
+            continue;   // already have the cluster we want
+        memmove(clusters + j + 1, clusters + j, sizeof(clusters[0]) * (numclusters - j));
+        clusters[j] = c;
+        numclusters++;
     }
 
-    BSP_ClusterVis(cm->cache, mask, clusters[0], DVIS_PVS);
+    return numclusters;
+}
 
-    // or in all the other leaf bits
+static void ClustersPVS(bsp_t *bsp, byte *mask, const int *clusters, int count)
+{
+    byte    temp[VIS_MAX_BYTES];
+    int     i, j, longs;
+    uint_fast32_t *src, *dst;
+
+    longs = VIS_FAST_LONGS(bsp);
+
+    memset(mask, 0, longs * sizeof(*dst));
+    BSP_ClusterVis(bsp, mask, clusters[0], DVIS_PVS);
+
+    // or in all the other cluster bits, a machine word at a time
     for (i = 1; i < count; i++) {
-        for (j = 0; j < i; j++) {
-            if (clusters[i] == clusters[j]) {
-                goto nextleaf; // already have the cluster we want
-            }
-        }
-        src = (uint_fast32_t *)BSP_ClusterVis(cm->cache, temp, clusters[i], DVIS_PVS);
+        src = (uint_fast32_t *)BSP_ClusterVis(bsp, temp, clusters[i], DVIS_PVS);
         dst = (uint_fast32_t *)mask;
         for (j = 0; j < longs; j++) {
             *dst++ |= *src++;
         }
+    }
+}
+
+// sized by map_fatpvs_cache kilobytes, allocated with the map so that
+// workers never race to create it
+static fatpvs_cache_t *AllocFatPVSCache(cm_t *cm)
+{
+    fatpvs_cache_t *fc;
+    size_t rowsize, count;
 
-nextleaf:;
+    if (!cm->cache->vis) {
+        return NULL;
+    }
+
+    rowsize = VIS_FAST_LONGS(cm->cache) * sizeof(uint_fast32_t);
+    count = (size_t)max(map_fatpvs_cache->integer, 0) * 1024 /
+            (sizeof(fatpvs_t) + rowsize);
+    if (count < 16) {
+        return NULL;
     }
+    count = min(count, FATPVS_MAX);
+
+    fc = Z_TagMallocz(sizeof(*fc) + (sizeof(fatpvs_t) + rowsize) * count, TAG_CMODEL);
+    fc->lock = Sys_CreateMutex();
+    fc->numentries = count;
+    fc->rowsize = rowsize;
+    fc->entries = (fatpvs_t *)(fc + 1);
+    fc->rows = (byte *)(fc->entries + count);
+    memset(fc->hashtable, -1, sizeof(fc->hashtable));
+
+    return fc;
+}
+
+static void FreeFatPVSCache(fatpvs_cache_t *fc)
+{
+    if (fc) {
+        Sys_DestroyMutex(fc->lock);
+        Z_Free(fc);
+    }
+}
+
+static void UnlinkFatPVS(fatpvs_cache_t *fc, int index)
+{
+    int *link = &fc->hashtable[fc->entries[index].hash & (FATPVS_HASH - 1)];
+
+    while (*link != index) {
+        link = &fc->entries[*link].next;
+    }
+    *link = fc->entries[index].next;
+}
+
+static int FindFatPVS(fatpvs_cache_t *fc, unsigned hash, const int *clusters, int count)
+{
+    fatpvs_t *e;
+    int index;
+
+    for (index = fc->hashtable[hash & (FATPVS_HASH - 1)]; index != -1; index = e->next) {
+        e = &fc->entries[index];
+        if (e->hash == hash && e->numclusters == count &&
+            !memcmp(e->clusters, clusters, sizeof(clusters[0]) * count)) {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+// takes a free slot, or the first one not referenced since the clock
+// hand last passed it
+static int ReplaceFatPVS(fatpvs_cache_t *fc)
+{
+    int index;
+
+    if (fc->numused < fc->numentries) {
+        return fc->numused++;
+    }
+
+    while (fc->entries[fc->hand].referenced) {
+        fc->entries[fc->hand].referenced = qfalse;
+        fc->hand = (fc->hand + 1) % fc->numentries;
+    }
+
+    index = fc->hand;
+    fc->hand = (fc->hand + 1) % fc->numentries;
+    UnlinkFatPVS(fc, index);
+    return index;
+}
+
+/*
+============
+CM_ClustersPVS
+
+Combines PVS of all clusters returned by CM_FatClusters. Nearby viewers
+touch the same clusters, so recent unions are kept per map. Rows are
+combined outside of the lock, only lookup and copying hold it.
+============
+*/
+byte *CM_ClustersPVS(cm_t *cm, byte *mask, const int *clusters, int count)
+{
+    fatpvs_cache_t *fc;
+    fatpvs_t *e;
+    unsigned hash;
+    int i, index;
+
+    if (!cm->cache) {   // map not loaded
+        return memset(mask, 0, VIS_MAX_BYTES);
+    }
+    if (!cm->cache->vis) {
+        return memset(mask, 0xff, VIS_MAX_BYTES);
+    }
+
+    fc = cm->fatpvs;
+    if (!fc || count > MAX_FAT_CLUSTERS) {
+        ClustersPVS(cm->cache, mask, clusters, count);
+        return mask;
+    }
+
+    hash = count;
+    for (i = 0; i < count; i++) {
+        hash = hash * 31 + clusters[i];
+    }
+
+    Sys_LockMutex(fc->lock);
+    index = FindFatPVS(fc, hash, clusters, count);
+    if (index != -1) {
+        fc->entries[index].referenced = qtrue;
+        memcpy(mask, fc->rows + index * fc->rowsize, fc->rowsize);
+        Sys_UnlockMutex(fc->lock);
+        return mask;
+    }
+    Sys_UnlockMutex(fc->lock);
+
+    ClustersPVS(cm->cache, mask, clusters, count);
+
+    // another thread may have added it meanwhile
+    Sys_LockMutex(fc->lock);
+    if (FindFatPVS(fc, hash, clusters, count) == -1) {
+        index = ReplaceFatPVS(fc);
+        e = &fc->entries[index];
+        e->hash = hash;
+        e->referenced = qtrue;
+        e->numclusters = count;
+        memcpy(e->clusters, clusters, sizeof(clusters[0]) * count);
+        e->next = fc->hashtable[hash & (FATPVS_HASH - 1)];
+        fc->hashtable[hash & (FATPVS_HASH - 1)] = index;
+        memcpy(fc->rows + index * fc->rowsize, mask, fc->rowsize);
+    }
+    Sys_UnlockMutex(fc->lock);
 
     return mask;
 }
 
+/*
+============
+CM_FatPVS
+
+The client will interpolate the view position,
+so we can't use a single PVS point
+===========
+*/
+byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org)
+{
+    int     clusters[MAX_FAT_CLUSTERS];
+    int     count;
+
+    count = CM_FatClusters(cm, org, clusters);
+    return CM_ClustersPVS(cm, mask, clusters, count);
+}
+
 /*
 =============
 CM_Init
@@ -1107,5 +1628,90 @@ void CM_Init(void)
 
     map_noareas = Cvar_Get("map_noareas", "0", 0);
     map_allsolid_bug = Cvar_Get("map_allsolid_bug", "1", 0);
+    map_fatpvs_cache = Cvar_Get("map_fatpvs_cache", "1024", 0);
+}
+
+#if USE_TESTS
+
+static qboolean traces_equal(const trace_t *a, const trace_t *b)
+{
+    return a->allsolid == b->allsolid
+        && a->startsolid == b->startsolid
+        && a->fraction == b->fraction
+        && VectorCompare(a->endpos, b->endpos)
+        && VectorCompare(a->plane.normal, b->plane.normal)
+        && a->plane.dist == b->plane.dist
+        && a->surface == b->surface
+        && a->contents == b->contents;
+}
+
+/*
+=============
+CM_TraceTest_f
+
+Replays recently recorded traces through the vectorized brush side path
+and the scalar one, and checks that both give the same results.
+=============
+*/
+void CM_TraceTest_f(void)
+{
+    tracerecord_t *rec;
+    trace_t tr[2];
+    int i, j, num, passes, errors;
+    unsigned start, vector, scalar;
+
+    num = min(trace_numrecords, TRACE_RECORDS);
+    if (!num) {
+        Com_Printf("No traces recorded\n");
+        return;
+    }
+
+    passes = 20;
+    if (Cmd_Argc() > 1) {
+        passes = atoi(Cmd_Argv(1));
+        clamp(passes, 1, 10000);
+    }
+
+    trace_replaying = qtrue;
+
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++) {
+        for (i = 0, rec = trace_records; i < num; i++, rec++) {
+            CM_BoxTrace(&tr[0], rec->start, rec->end, rec->mins, rec->maxs,
+                        rec->headnode, rec->brushmask);
+        }
+    }
+    vector = Sys_Milliseconds() - start;
+
+    trace_scalar = qtrue;
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++) {
+        for (i = 0, rec = trace_records; i < num; i++, rec++) {
+            CM_BoxTrace(&tr[1], rec->start, rec->end, rec->mins, rec->maxs,
+                        rec->headnode, rec->brushmask);
+        }
+    }
+    scalar = Sys_Milliseconds() - start;
+
+    errors = 0;
+    for (i = 0, rec = trace_records; i < num; i++, rec++) {
+        trace_scalar = qfalse;
+        CM_BoxTrace(&tr[0], rec->start, rec->end, rec->mins, rec->maxs,
+                    rec->headnode, rec->brushmask);
+        trace_scalar = qtrue;
+        CM_BoxTrace(&tr[1], rec->start, rec->end, rec->mins, rec->maxs,
+                    rec->headnode, rec->brushmask);
+        if (!traces_equal(&tr[0], &tr[1])) {
+            errors++;
+        }
+    }
+
+    trace_scalar = qfalse;
+    trace_replaying = qfalse;
+
+    Com_Printf("%d traces, %d passes\n", num, passes);
+    Com_Printf("%u msec vector, %u msec scalar, %d failures\n",
+               vector, scalar, errors);
 }
 
+#endif // USE_TESTS
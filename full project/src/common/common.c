@@ -37,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/net.h"
 #include "common/net/chan.h"
 #include "common/pmove.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/tests.h"
@@ -65,6 +66,7 @@ static char     **com_argv;
 static int      com_argc;
 
 cvar_t  *z_perturb;
+cvar_t  *z_slabs;
 
 #ifdef _DEBUG
 cvar_t  *developer;
@@ -121,6 +123,9 @@ unsigned    time_before_game;
 unsigned    time_after_game;
 unsigned    time_before_ref;
 unsigned    time_after_ref;
+
+// timedemo breakdown
+unsigned    time_sections[TD_NUM_SECTIONS];
 #endif
 
 /*
@@ -215,6 +220,10 @@ static void logfile_open(void)
         } else {
             mode |= FS_BUF_LINE;
         }
+    } else {
+        // written behind by the async thread, Com_Error drains it. flushed
+        // modes write directly, so that lines before a crash reach the disk
+        mode |= FS_FLAG_ASYNC;
     }
 
     f = FS_EasyOpenFile(buffer, sizeof(buffer), mode | FS_FLAG_TEXT,
@@ -890,6 +899,7 @@ void Qcommon_Init(int argc, char **argv)
     // init commands and vars
     //
     z_perturb = Cvar_Get("z_perturb", "0", 0);
+    z_slabs = Cvar_Get("z_slabs", "1", 0);
 #if USE_CLIENT
     host_speeds = Cvar_Get("host_speeds", "0", 0);
 #endif
@@ -990,6 +1000,7 @@ void Qcommon_Init(int argc, char **argv)
 
     srand(Sys_Milliseconds());
 
+    PROF_Init();
     Netchan_Init();
     NET_Init();
     BSP_Init();
@@ -998,6 +1009,13 @@ void Qcommon_Init(int argc, char **argv)
     CL_Init();
     TST_Init();
 
+#ifndef _WIN32
+    // fork server instances sharing everything loaded so far
+    if (COM_DEDICATED) {
+        Sys_SpawnInstances();
+    }
+#endif
+
     Sys_RunConsole();
 
     // add + commands from command line
@@ -1061,7 +1079,9 @@ void Qcommon_Frame(void)
 
     // sleep on network sockets when running a dedicated server
     // still do a select(), but don't sleep when running a client!
-    NET_Sleep(remaining);
+    NET_SleepUntil(com_eventTime + remaining);
+
+    PROF_Frame();
 
     // calculate time spent running last frame and sleeping
     oldtime = com_eventTime;
@@ -1143,5 +1163,8 @@ void Qcommon_Frame(void)
                    all, ev, sv, gm, cl, rf);
     }
 #endif
+
+    // all transient allocations of this frame are dead now
+    Z_FrameReset();
 }
 
@@ -33,31 +33,89 @@ int     cvar_modified;
 
 #define Cvar_Malloc(size)   Z_TagMalloc(size, TAG_CVAR)
 
-#define CVARHASH_SIZE    256
+// open addressing table with linear probing, cvars are never removed,
+// so the table only ever grows. kept at most half full.
+#define CVAR_TABLE_MIN  512
 
-static cvar_t *cvarHash[CVARHASH_SIZE];
+typedef struct {
+    unsigned    hash;
+    cvar_t      *var;
+} cvarslot_t;
+
+static cvarslot_t   *cvar_slots;
+static unsigned     cvar_tablesize;     // power of two
+static unsigned     cvar_count;
+
+static void insert_slot(cvarslot_t *slots, unsigned size, unsigned hash, cvar_t *var)
+{
+    unsigned i;
+
+    for (i = hash & (size - 1); slots[i].var; i = (i + 1) & (size - 1))
+        ;
+
+    slots[i].hash = hash;
+    slots[i].var = var;
+}
+
+static void link_var(cvar_t *var, unsigned hash)
+{
+    cvarslot_t *slots;
+    unsigned i, size;
+
+    if ((cvar_count + 1) * 2 > cvar_tablesize) {
+        size = cvar_tablesize ? cvar_tablesize * 2 : CVAR_TABLE_MIN;
+        slots = Z_TagMallocz(sizeof(*slots) * size, TAG_CVAR);
+        for (i = 0; i < cvar_tablesize; i++) {
+            if (cvar_slots[i].var) {
+                insert_slot(slots, size, cvar_slots[i].hash, cvar_slots[i].var);
+            }
+        }
+        Z_Free(cvar_slots);
+        cvar_slots = slots;
+        cvar_tablesize = size;
+    }
+
+    insert_slot(cvar_slots, cvar_tablesize, hash, var);
+    cvar_count++;
+}
 
 /*
 ============
-Cvar_FindVar
+Cvar_FindVarHash
+
+Looks the variable up by the name already hashed with Com_HashKey, which
+lets the command interpreter hash each token only once.
 ============
 */
-cvar_t *Cvar_FindVar(const char *var_name)
+cvar_t *Cvar_FindVarHash(const char *var_name, unsigned hash)
 {
-    cvar_t *var;
-    unsigned hash;
+    cvarslot_t *slot;
+    unsigned i, mask;
 
-    hash = Com_HashString(var_name, CVARHASH_SIZE);
+    if (!cvar_tablesize) {
+        return NULL;
+    }
 
-    for (var = cvarHash[hash]; var; var = var->hashNext) {
-        if (!strcmp(var_name, var->name)) {
-            return var;
+    mask = cvar_tablesize - 1;
+    for (i = hash & mask; (slot = &cvar_slots[i])->var; i = (i + 1) & mask) {
+        if (slot->hash == hash && !strcmp(var_name, slot->var->name)) {
+            return slot->var;
         }
     }
 
     return NULL;
 }
 
+/*
+============
+Cvar_FindVar
+============
+*/
+cvar_t *Cvar_FindVar(const char *var_name)
+{
+    return Cvar_FindVarHash(var_name, Com_HashKey(var_name));
+}
+
 xgenerator_t Cvar_FindGenerator(const char *var_name)
 {
     cvar_t *var = Cvar_FindVar(var_name);
@@ -276,7 +334,8 @@ cvar_t *Cvar_Get(const char *var_name, const char *var_value, int flags)
         }
     }
 
-    var = Cvar_FindVar(var_name);
+    hash = Com_HashKey(var_name);
+    var = Cvar_FindVarHash(var_name, hash);
     if (var) {
         if (!(flags & (CVAR_WEAK | CVAR_CUSTOM))) {
             get_engine_cvar(var, var_value, flags);
@@ -309,9 +368,7 @@ cvar_t *Cvar_Get(const char *var_name, const char *var_value, int flags)
     *p = var;
 
     // link the variable in
-    hash = Com_HashString(var_name, CVARHASH_SIZE);
-    var->hashNext = cvarHash[hash];
-    cvarHash[hash] = var;
+    link_var(var, hash);
 
     return var;
 }
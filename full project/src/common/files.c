@@ -22,12 +22,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cvar.h"
 #include "common/error.h"
 #include "common/files.h"
+#include "common/mdfour.h"
 #include "common/prompt.h"
 #include "system/system.h"
+#include "system/thread.h"
 #include "client/client.h"
 #include "format/pak.h"
 
 #include <fcntl.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #if USE_ZLIB
 #include <zlib.h>
@@ -126,15 +132,66 @@ typedef struct {
     unsigned    hash_size;
     char        *names;
     char        *filename;
+    size_t      filesize;   // identify the pack in PACK CACHE
+    time_t      mtime;
+#ifndef _WIN32
+    void        *mapbase;   // whole pack mapped on first FS_MapFile
+    size_t      maplen;
+    qboolean    mapfailed;
+#endif
 } pack_t;
 
+// see LOOKUP INDEX below
+typedef struct {
+    time_t      mtime;
+    char        path[1];    // relative to search path, empty for the root
+} loosedir_t;
+
+typedef struct {
+    char        **files;    // relative to search path, as found on disk
+    size_t      *namelens;
+    unsigned    num_files;
+    loosedir_t  **dirs;
+    unsigned    num_dirs;
+    time_t      scantime;   // when the scan started
+    time_t      scanend;    // when it finished
+    qboolean    complete;   // false if the tree was too large to index
+} dircache_t;
+
 typedef struct searchpath_s {
     struct searchpath_s *next;
     unsigned    mode;
     pack_t      *pack;        // only one of filename / pack will be used
+    dircache_t  *cache;       // loose files, built on first lookup
     char        filename[1];
 } searchpath_t;
 
+typedef struct fsindex_s {
+    struct fsindex_s *next; // next location of the same hash, in search order
+    searchpath_t    *search;
+    packfile_t      *entry; // NULL for loose files
+    const char      *name;
+    size_t          namelen;
+    unsigned        order;  // position of search in the search path
+} fsindex_t;
+
+// see ASYNC WRITES below
+typedef struct {
+    byte        *data;
+    size_t      size;
+    size_t      head;       // total bytes submitted (consumed if reading)
+    size_t      tail;       // total bytes written (read if reading)
+    off_t       base;       // file position at head == 0
+    qerror_t    error;      // set by the writer thread
+    qboolean    reading;    // read ahead instead of writing behind
+    qboolean    eof;        // set by the thread when reading
+    qboolean    busy;       // thread is using the file, unlocked
+    size_t      peak;       // maximum bytes buffered
+    unsigned    stalls;     // number of writes (reads) that blocked
+    unsigned    stall_msec; // total time spent blocked
+    char        path[MAX_OSPATH];
+} asyncbuf_t;
+
 typedef struct {
     filetype_t  type;
     unsigned    mode;
@@ -142,6 +199,7 @@ typedef struct {
 #if USE_ZLIB
     void        *zfp;       // gzFile for FS_GZ or zipstream_t for FS_ZIP
 #endif
+    asyncbuf_t  *async;     // written or read by the async thread
     packfile_t  *entry;     // pack entry this handle is tied to
     pack_t      *pack;      // points to the pack entry is from
     qboolean    unique;     // if true, then pack must be freed on close
@@ -170,26 +228,37 @@ static list_t       fs_soft_links;
 
 static file_t       fs_files[MAX_FILE_HANDLES];
 
-#ifdef _DEBUG
+#if (defined _DEBUG) || USE_TESTS
 static int          fs_count_read;
 static int          fs_count_open;
 static int          fs_count_strcmp;
 static int          fs_count_strlwr;
+static int          fs_count_misshit;
+static int          fs_count_missadd;
 #define FS_COUNT_READ       fs_count_read++
 #define FS_COUNT_OPEN       fs_count_open++
 #define FS_COUNT_STRCMP     fs_count_strcmp++
 #define FS_COUNT_STRLWR     fs_count_strlwr++
+#define FS_COUNT_MISSHIT    fs_count_misshit++
+#define FS_COUNT_MISSADD    fs_count_missadd++
 #else
 #define FS_COUNT_READ       (void)0
 #define FS_COUNT_OPEN       (void)0
 #define FS_COUNT_STRCMP     (void)0
 #define FS_COUNT_STRLWR     (void)0
+#define FS_COUNT_MISSHIT    (void)0
+#define FS_COUNT_MISSADD    (void)0
 #endif
 
 #ifdef _DEBUG
 static cvar_t       *fs_debug;
 #endif
 
+static cvar_t       *fs_async_write;
+static cvar_t       *fs_async_read;
+static cvar_t       *fs_index;
+static cvar_t       *fs_pakcache;
+
 cvar_t              *fs_game;
 
 #if USE_ZLIB
@@ -202,6 +271,10 @@ static ssize_t tell_zip_file(file_t *file);
 static ssize_t read_zip_file(file_t *file, void *buf, size_t len);
 #endif
 
+static qerror_t drain_async(file_t *file);
+static qerror_t seek_async(file_t *file, off_t offset);
+static ssize_t read_async(file_t *file, void *buf, size_t len);
+
 // for tracking users of pack_t instance
 // allows FS to be restarted while reading something from pack
 static pack_t *pack_get(pack_t *pack);
@@ -499,6 +572,10 @@ ssize_t FS_Tell(qhandle_t f)
     if (!file)
         return Q_ERR_BADF;
 
+    // only the main thread moves head
+    if (file->async)
+        return file->async->base + file->async->head;
+
     switch (file->type) {
     case FS_REAL:
         ret = ftell(file->fp);
@@ -543,6 +620,28 @@ static qerror_t seek_pak_file(file_t *file, off_t offset)
     return Q_ERR_SUCCESS;
 }
 
+static qerror_t seek_file(file_t *file, off_t offset)
+{
+    switch (file->type) {
+    case FS_REAL:
+        if (fseek(file->fp, (long)offset, SEEK_SET) == -1) {
+            return Q_Errno();
+        }
+        return Q_ERR_SUCCESS;
+    case FS_PAK:
+        return seek_pak_file(file, offset);
+#if USE_ZLIB
+    case FS_GZ:
+        if (gzseek(file->zfp, (z_off_t)offset, SEEK_SET) == -1) {
+            return Q_Errno();
+        }
+        return Q_ERR_SUCCESS;
+#endif
+    default:
+        return Q_ERR_NOSYS;
+    }
+}
+
 /*
 ============
 FS_Seek
@@ -563,24 +662,17 @@ qerror_t FS_Seek(qhandle_t f, off_t offset)
     if (offset < 0)
         offset = 0;
 
-    switch (file->type) {
-    case FS_REAL:
-        if (fseek(file->fp, (long)offset, SEEK_SET) == -1) {
-            return Q_Errno();
-        }
-        return Q_ERR_SUCCESS;
-    case FS_PAK:
-        return seek_pak_file(file, offset);
-#if USE_ZLIB
-    case FS_GZ:
-        if (gzseek(file->zfp, (z_off_t)offset, SEEK_SET) == -1) {
-            return Q_Errno();
-        }
-        return Q_ERR_SUCCESS;
-#endif
-    default:
-        return Q_ERR_NOSYS;
+    if (file->async) {
+        qerror_t ret;
+        if (file->async->reading)
+            return seek_async(file, offset);
+        ret = drain_async(file);
+        if (ret)
+            return ret;
+        file->async->base = offset - file->async->head;
     }
+
+    return seek_file(file, offset);
 }
 
 /*
@@ -661,6 +753,10 @@ qerror_t FS_FilterFile(qhandle_t f)
     if (!file)
         return Q_ERR_BADF;
 
+    // too late once the async thread is using the file
+    if (file->async)
+        return Q_ERR_INVAL;
+
     switch (file->type) {
     case FS_GZ:
         return Q_ERR_SUCCESS;
@@ -740,1113 +836,2803 @@ qerror_t FS_FilterFile(qhandle_t f)
 }
 
 
-/*
-==============
-FS_FCloseFile
-==============
-*/
-void FS_FCloseFile(qhandle_t f)
-{
-    file_t *file = file_for_handle(f);
-
-    if (!file)
-        return;
+static ssize_t read_file(file_t *file, void *buf, size_t len);
 
+static qerror_t write_file(file_t *file, const void *buf, size_t len)
+{
     switch (file->type) {
     case FS_REAL:
-        fclose(file->fp);
-        break;
-    case FS_PAK:
-        if (file->unique) {
-            fclose(file->fp);
-            pack_put(file->pack);
+        if (fwrite(buf, 1, len, file->fp) != len) {
+            return FS_ERR_WRITE(file->fp);
         }
-        break;
+        return Q_ERR_SUCCESS;
 #if USE_ZLIB
     case FS_GZ:
-        gzclose(file->zfp);
-        fclose(file->fp);
-        break;
-    case FS_ZIP:
-        if (file->unique) {
-            close_zip_file(file);
-            pack_put(file->pack);
+        if (gzwrite(file->zfp, buf, len) == 0) {
+            return Q_ERR_LIBRARY_ERROR;
         }
-        break;
+        return Q_ERR_SUCCESS;
 #endif
     default:
-        break;
+        return Q_ERR_NOSYS;
     }
-
-    memset(file, 0, sizeof(*file));
 }
 
-static qerror_t get_path_info(const char *path, file_info_t *info)
-{
-    Q_STATBUF st;
+/*
+============================================================================
 
-    if (os_stat(path, &st) == -1)
-        return Q_Errno();
+ASYNC WRITES
 
-    if (Q_ISDIR(st.st_mode))
-        return Q_ERR_ISDIR;
+Files opened by FS_EasyOpenFile with FS_FLAG_ASYNC are written through a
+ring buffer drained by a single writer thread, which thus also does the
+gzip compression of FS_GZ files. FS_Write only copies data into the ring,
+and blocks when it is full rather than drop anything. Time spent blocked
+is accounted per file, so it is visible when disk is falling behind.
 
-    if (!Q_ISREG(st.st_mode))
-        return Q_ERR_FILE_NOT_REGULAR;
+The writer thread only calls write_file on files that have data pending.
+Everything else, including opening, flushing and closing, stays on the
+main thread, which drains the ring first.
 
-    if (info) {
-        info->size = st.st_size;
-        info->ctime = st.st_ctime;
-        info->mtime = st.st_mtime;
-    }
+FS_ReadAhead runs the same machinery backwards for files that are read
+sequentially, such as demos being played back: the thread keeps the ring
+filled ahead of FS_Read, which blocks only if the disk falls behind. The
+thread marks the file busy while it reads from it unlocked, and FS_Seek
+and FS_FCloseFile wait for that before touching the file themselves.
 
-    return Q_ERR_SUCCESS;
+============================================================================
+*/
+
+static struct {
+    qthread_t   *thread;
+    qmutex_t    *lock;
+    qcond_t     *work;      // signaled when data is submitted or consumed
+    qcond_t     *done;      // signaled when data is written or read
+    qboolean    quit;
+    int         next;       // handle to look at first, for fairness
+
+    // totals of closed files
+    unsigned    files;
+    uint64_t    bytes;
+    unsigned    stalls;
+    unsigned    stall_msec;
+} fs_async;
+
+// keeps the reader responsive to what is being consumed
+#define ASYNC_READ_CHUNK    0x10000
+
+static qboolean async_pending(asyncbuf_t *a)
+{
+    if (!a || a->error)
+        return qfalse;
+
+    if (a->reading)
+        return !a->eof && a->tail - a->head < a->size;
+
+    return a->head != a->tail;
 }
 
-static qerror_t get_fp_info(FILE *fp, file_info_t *info)
+static void async_thread(void *arg)
 {
-    Q_STATBUF st;
-    int fd;
+    file_t *file;
+    asyncbuf_t *a;
+    size_t pos, len;
+    ssize_t nread;
+    qerror_t ret;
+    int i;
 
-    fd = os_fileno(fp);
-    if (fd == -1)
-        return Q_Errno();
+    Sys_LockMutex(fs_async.lock);
+    while (1) {
+        for (i = 0; i < MAX_FILE_HANDLES; i++) {
+            file = &fs_files[(fs_async.next + i) % MAX_FILE_HANDLES];
+            a = file->async;
+            if (async_pending(a)) {
+                break;
+            }
+        }
 
-    if (os_fstat(fd, &st) == -1)
-        return Q_Errno();
+        if (i == MAX_FILE_HANDLES) {
+            if (fs_async.quit) {
+                break;
+            }
+            Sys_WaitCond(fs_async.work, fs_async.lock);
+            continue;
+        }
 
-    if (Q_ISDIR(st.st_mode))
-        return Q_ERR_ISDIR;
+        fs_async.next = (fs_async.next + i + 1) % MAX_FILE_HANDLES;
+
+        if (a->reading) {
+            // the consumer never looks past tail
+            pos = a->tail % a->size;
+            len = a->size - (a->tail - a->head);
+            len = min(len, a->size - pos);
+            len = min(len, ASYNC_READ_CHUNK);
+            a->busy = qtrue;
+            Sys_UnlockMutex(fs_async.lock);
+
+            nread = read_file(file, a->data + pos, len);
+
+            Sys_LockMutex(fs_async.lock);
+            a->busy = qfalse;
+            if (nread < 0) {
+                a->error = nread;
+            } else if (nread == 0) {
+                a->eof = qtrue;
+            } else {
+                a->tail += nread;
+                a->peak = max(a->peak, a->tail - a->head);
+                // short reads set the error, report it after the data
+                a->error = file->error;
+            }
+            Sys_BroadcastCond(fs_async.done);
+            continue;
+        }
 
-    if (!Q_ISREG(st.st_mode))
-        return Q_ERR_FILE_NOT_REGULAR;
+        pos = a->tail % a->size;
+        len = min(a->head - a->tail, a->size - pos);
+        Sys_UnlockMutex(fs_async.lock);
 
-    if (info) {
-        info->size = st.st_size;
-        info->ctime = st.st_ctime;
-        info->mtime = st.st_mtime;
+        ret = write_file(file, a->data + pos, len);
+
+        Sys_LockMutex(fs_async.lock);
+        if (ret) {
+            a->error = ret;
+        } else {
+            a->tail += len;
+        }
+        Sys_BroadcastCond(fs_async.done);
     }
+    Sys_UnlockMutex(fs_async.lock);
+}
 
-    return Q_ERR_SUCCESS;
+static void start_async(void)
+{
+    if (!fs_async.thread) {
+        fs_async.lock = Sys_CreateMutex();
+        fs_async.work = Sys_CreateCond();
+        fs_async.done = Sys_CreateCond();
+        fs_async.quit = qfalse;
+        fs_async.thread = Sys_CreateThread(async_thread, NULL);
+    }
 }
 
-static inline FILE *fopen_hack(const char *path, const char *mode)
+static void open_async(file_t *file, const char *path)
 {
-#ifndef _GNU_SOURCE
-    if (mode[0] == 'w' && mode[1] == 'x') {
-#ifdef _WIN32
-        int flags = _O_WRONLY | _O_CREAT | _O_EXCL | _S_IREAD | _S_IWRITE;
-        int fd;
-        FILE *fp;
+    asyncbuf_t *a;
+    ssize_t pos;
+    int size;
 
-        if (mode[2] == 'b')
-            flags |= _O_BINARY;
+    size = Cvar_ClampInteger(fs_async_write, 0, 65536);
+    if (!size) {
+        return;
+    }
 
-        fd = _open(path, flags);
-        if (fd == -1)
-            return NULL;
+    switch (file->type) {
+    case FS_REAL:
+        pos = ftell(file->fp);
+        break;
+#if USE_ZLIB
+    case FS_GZ:
+        pos = gztell(file->zfp);
+        break;
+#endif
+    default:
+        return;
+    }
 
-        fp = _fdopen(fd, (flags & _O_BINARY) ? "wb" : "w");
-        if (fp == NULL)
-            _close(fd);
+    if (pos < 0) {
+        return;
+    }
 
-        return fp;
-#else
-        int flags = O_WRONLY | O_CREAT | O_EXCL;
-        int perm = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
-        int fd;
-        FILE *fp;
+    start_async();
 
-        fd = open(path, flags, perm);
-        if (fd == -1)
-            return NULL;
+    a = FS_Mallocz(sizeof(*a));
+    a->size = (size_t)size << 10;
+    a->data = FS_Malloc(a->size);
+    a->base = pos;
+    Q_strlcpy(a->path, path, sizeof(a->path));
 
-        fp = fdopen(fd, "wb");
-        if (fp == NULL)
-            close(fd);
+    Sys_LockMutex(fs_async.lock);
+    file->async = a;
+    Sys_UnlockMutex(fs_async.lock);
+}
 
-        return fp;
-#endif
+static ssize_t write_async(file_t *file, const void *buf, size_t len)
+{
+    asyncbuf_t *a = file->async;
+    const byte *data = buf;
+    size_t rest = len, pos, n;
+    unsigned start = 0;
+
+    Sys_LockMutex(fs_async.lock);
+    while (rest && !a->error) {
+        n = a->size - (a->head - a->tail);
+        if (!n) {
+            if (!start) {
+                start = Sys_Milliseconds();
+                a->stalls++;
+            }
+            Sys_WaitCond(fs_async.done, fs_async.lock);
+            continue;
+        }
+
+        pos = a->head % a->size;
+        n = min(n, rest);
+        n = min(n, a->size - pos);
+
+        // the writer never looks past head
+        Sys_UnlockMutex(fs_async.lock);
+        memcpy(a->data + pos, data, n);
+        Sys_LockMutex(fs_async.lock);
+
+        a->head += n;
+        a->peak = max(a->peak, a->head - a->tail);
+        data += n;
+        rest -= n;
+        Sys_SignalCond(fs_async.work);
     }
-#endif // _GNU_SOURCE
+    if (start) {
+        a->stall_msec += Sys_Milliseconds() - start;
+    }
+    file->error = a->error;
+    Sys_UnlockMutex(fs_async.lock);
 
-    return fopen(path, mode);
+    return file->error ? file->error : len;
 }
 
-static ssize_t open_file_write(file_t *file, const char *name)
+static qerror_t drain_async(file_t *file)
 {
-    char normalized[MAX_OSPATH], fullpath[MAX_OSPATH];
-    FILE *fp;
-    char mode_str[8];
-    unsigned mode;
-    size_t len;
-    long pos;
+    asyncbuf_t *a = file->async;
     qerror_t ret;
 
-    // normalize the path
-    len = FS_NormalizePathBuffer(normalized, name, sizeof(normalized));
-    if (len >= sizeof(normalized)) {
-        return Q_ERR_NAMETOOLONG;
-    }
+    // nothing to drain when reading ahead
+    if (a->reading)
+        return Q_ERR_SUCCESS;
 
-    // reject empty paths
-    if (len == 0) {
-        return Q_ERR_NAMETOOSHORT;
+    Sys_LockMutex(fs_async.lock);
+    while (a->head != a->tail && !a->error) {
+        Sys_WaitCond(fs_async.done, fs_async.lock);
     }
+    ret = a->error;
+    Sys_UnlockMutex(fs_async.lock);
 
-    // check for bad characters
-    if (!FS_ValidatePath(normalized)) {
-        ret = Q_ERR_INVALID_PATH;
-        goto fail1;
-    }
+    return ret;
+}
 
-    // expand the path
-    if ((file->mode & FS_PATH_MASK) == FS_PATH_BASE) {
-        if (sys_homedir->string[0]) {
-            len = Q_concat(fullpath, sizeof(fullpath),
-                           sys_homedir->string, "/" BASEGAME "/", normalized, NULL);
-        } else {
-            len = Q_concat(fullpath, sizeof(fullpath),
-                           sys_basedir->string, "/" BASEGAME "/", normalized, NULL);
-        }
-    } else {
-        len = Q_concat(fullpath, sizeof(fullpath),
-                       fs_gamedir, "/", normalized, NULL);
-    }
-    if (len >= sizeof(fullpath)) {
-        ret = Q_ERR_NAMETOOLONG;
-        goto fail1;
-    }
+/*
+============
+FS_ReadAhead
 
-    mode = file->mode & FS_MODE_MASK;
-    switch (mode) {
-    case FS_MODE_APPEND:
-        strcpy(mode_str, "a");
-        break;
-    case FS_MODE_WRITE:
-        strcpy(mode_str, "w");
-        if (file->mode & FS_FLAG_EXCL)
-            strcat(mode_str, "x");
-        break;
-    case FS_MODE_RDWR:
-        // this mode is only used by client downloading code
-        // similar to FS_MODE_APPEND, but does not create
-        // the file if it does not exist
-        strcpy(mode_str, "r+");
-        break;
-    default:
-        ret = Q_ERR_INVAL;
-        goto fail1;
-    }
+Makes the async thread read the file ahead of FS_Read from the current
+position. Must be called after FS_FilterFile, if any. Silently does
+nothing for handles that can't be read ahead. Path is only informative.
+============
+*/
+void FS_ReadAhead(qhandle_t f, const char *path)
+{
+    file_t *file = file_for_handle(f);
+    asyncbuf_t *a;
+    ssize_t pos;
+    int size;
 
-    // open in binary mode by default
-    if (!(file->mode & FS_FLAG_TEXT))
-        strcat(mode_str, "b");
+    if (!file || file->async || file->error)
+        return;
 
-    ret = FS_CreatePath(fullpath);
-    if (ret) {
-        goto fail1;
-    }
+    if ((file->mode & FS_MODE_MASK) != FS_MODE_READ)
+        return;
 
-    fp = fopen_hack(fullpath, mode_str);
-    if (!fp) {
-        ret = Q_Errno();
-        goto fail1;
-    }
+    size = Cvar_ClampInteger(fs_async_read, 0, 65536);
+    if (!size)
+        return;
 
-#ifndef _WIN32
-    // check if this is a regular file
-    ret = get_fp_info(fp, NULL);
-    if (ret) {
-        goto fail2;
-    }
+    switch (file->type) {
+    case FS_REAL:
+#if USE_ZLIB
+    case FS_GZ:
 #endif
-
-    switch (file->mode & FS_BUF_MASK) {
-    case FS_BUF_NONE:
-        // make it unbuffered
-        setvbuf(fp, NULL, _IONBF, BUFSIZ);
-        break;
-    case FS_BUF_LINE:
-        // make it line buffered
-        setvbuf(fp, NULL, _IOLBF, BUFSIZ);
-        break;
-    case FS_BUF_FULL:
-        // make it fully buffered
-        setvbuf(fp, NULL, _IOFBF, BUFSIZ);
         break;
+    case FS_PAK:
+#if USE_ZLIB
+    case FS_ZIP:
+#endif
+        // shared handles are repositioned by other reads
+        if (file->unique)
+            break;
     default:
-        // use default mode (normally fully buffered)
-        break;
-    }
-
-    if (mode == FS_MODE_RDWR) {
-        // seek to the end of file for appending
-        if (fseek(fp, 0, SEEK_END) == -1) {
-            ret = Q_Errno();
-            goto fail2;
-        }
-    }
-
-    // return current position (non-zero for appending modes)
-    pos = ftell(fp);
-    if (pos == -1) {
-        ret = Q_Errno();
-        goto fail2;
+        return;
     }
 
-    FS_DPrintf("%s: %s: %lu bytes\n", __func__, fullpath, pos);
+    pos = FS_Tell(f);
+    if (pos < 0)
+        return;
 
-    file->type = FS_REAL;
-    file->fp = fp;
-    file->unique = qtrue;
-    file->error = Q_ERR_SUCCESS;
-    file->length = 0;
+    start_async();
 
-    return pos;
+    a = FS_Mallocz(sizeof(*a));
+    a->size = (size_t)size << 10;
+    a->data = FS_Malloc(a->size);
+    a->base = pos;
+    a->reading = qtrue;
+    Q_strlcpy(a->path, path, sizeof(a->path));
 
-fail2:
-    fclose(fp);
-fail1:
-    FS_DPrintf("%s: %s: %s\n", __func__, normalized, Q_ErrorString(ret));
-    return ret;
+    Sys_LockMutex(fs_async.lock);
+    file->async = a;
+    Sys_BroadcastCond(fs_async.work);
+    Sys_UnlockMutex(fs_async.lock);
 }
 
-#if USE_ZLIB
-
-static qerror_t check_header_coherency(FILE *fp, packfile_t *entry)
+static ssize_t read_async(file_t *file, void *buf, size_t len)
 {
-    unsigned flags, comp_mtd;
-    size_t comp_len, file_len;
-    size_t name_size, xtra_size;
-    byte header[ZIP_SIZELOCALHEADER];
-    size_t ofs;
-
-    if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1)
-        return Q_Errno();
-    if (fread(header, 1, sizeof(header), fp) != sizeof(header))
-        return FS_ERR_READ(fp);
+    asyncbuf_t *a = file->async;
+    byte *data = buf;
+    size_t rest = len, pos, n;
+    unsigned start = 0;
+    ssize_t ret;
 
-    // check the magic
-    if (LittleLongMem(&header[0]) != ZIP_LOCALHEADERMAGIC)
-        return Q_ERR_NOT_COHERENT;
+    Sys_LockMutex(fs_async.lock);
+    while (rest) {
+        n = a->tail - a->head;
+        if (!n) {
+            if (a->eof || a->error) {
+                break;
+            }
+            if (!start) {
+                start = Sys_Milliseconds();
+                a->stalls++;
+            }
+            Sys_WaitCond(fs_async.done, fs_async.lock);
+            continue;
+        }
 
-    flags = LittleShortMem(&header[6]);
-    comp_mtd = LittleShortMem(&header[8]);
-    comp_len = LittleLongMem(&header[18]);
-    file_len = LittleLongMem(&header[22]);
-    name_size = LittleShortMem(&header[26]);
-    xtra_size = LittleShortMem(&header[28]);
+        pos = a->head % a->size;
+        n = min(n, rest);
+        n = min(n, a->size - pos);
 
-    if (comp_mtd != entry->compmtd)
-        return Q_ERR_NOT_COHERENT;
+        // the reader never looks past head + size
+        Sys_UnlockMutex(fs_async.lock);
+        memcpy(data, a->data + pos, n);
+        Sys_LockMutex(fs_async.lock);
 
-    // bit 3 tells that file lengths were not known
-    // at the time local header was written, so don't check them
-    if ((flags & 8) == 0) {
-        if (comp_len != entry->complen)
-            return Q_ERR_NOT_COHERENT;
-        if (file_len != entry->filelen)
-            return Q_ERR_NOT_COHERENT;
+        a->head += n;
+        data += n;
+        rest -= n;
+        Sys_SignalCond(fs_async.work);
     }
-
-    ofs = ZIP_SIZELOCALHEADER + name_size + xtra_size;
-    if (entry->filepos > LONG_MAX - ofs) {
-        return Q_ERR_SPIPE;
+    if (start) {
+        a->stall_msec += Sys_Milliseconds() - start;
     }
+    ret = len - rest;
+    if (!ret && a->error) {
+        ret = a->error;
+    }
+    Sys_UnlockMutex(fs_async.lock);
 
-    entry->filepos += ofs;
-    entry->coherent = qtrue;
-    return Q_ERR_SUCCESS;
+    return ret;
 }
 
-static voidpf FS_zalloc(voidpf opaque, uInt items, uInt size)
+// waits for the thread to let go of the file, called with lock held
+static void wait_async(asyncbuf_t *a)
 {
-    return FS_Malloc(items * size);
+    while (a->busy) {
+        Sys_WaitCond(fs_async.done, fs_async.lock);
+    }
 }
 
-static void FS_zfree(voidpf opaque, voidpf address)
+static qerror_t seek_async(file_t *file, off_t offset)
 {
-    Z_Free(address);
+    asyncbuf_t *a = file->async;
+    qerror_t ret;
+
+    Sys_LockMutex(fs_async.lock);
+
+    // seeking within buffered data just skips it
+    if (offset >= a->base + (off_t)a->head &&
+        offset <= a->base + (off_t)a->tail) {
+        a->head = offset - a->base;
+        Sys_SignalCond(fs_async.work);
+        Sys_UnlockMutex(fs_async.lock);
+        return Q_ERR_SUCCESS;
+    }
+
+    wait_async(a);
+    ret = seek_file(file, offset);
+    a->head = a->tail = 0;
+    a->base = offset;
+    a->eof = qfalse;
+    a->error = ret;
+    Sys_SignalCond(fs_async.work);
+
+    Sys_UnlockMutex(fs_async.lock);
+    return ret;
 }
 
-static void open_zip_file(file_t *file)
+static void close_async(file_t *file)
 {
-    zipstream_t *s;
-    z_streamp z;
+    asyncbuf_t *a = file->async;
+    qerror_t ret;
 
-    if (file->unique) {
-        s = FS_Malloc(sizeof(*s));
-        memset(&s->stream, 0, sizeof(s->stream));
-    } else {
-        s = &fs_zipstream;
+    if (a->reading) {
+        Sys_LockMutex(fs_async.lock);
+        wait_async(a);
+        file->async = NULL;
+        Sys_UnlockMutex(fs_async.lock);
+
+        Z_Free(a->data);
+        Z_Free(a);
+        return;
     }
 
-    z = &s->stream;
-    if (z->state) {
-        // already initialized, just reset
-        inflateReset(z);
-    } else {
-        z->zalloc = FS_zalloc;
-        z->zfree = FS_zfree;
-        if (inflateInit2(z, -MAX_WBITS) != Z_OK) {
-            Com_Error(ERR_FATAL, "%s: inflateInit2() failed", __func__);
-        }
+    ret = drain_async(file);
+
+    Sys_LockMutex(fs_async.lock);
+    file->async = NULL;
+    Sys_UnlockMutex(fs_async.lock);
+
+    // write errors are reported by FS_Write
+    if (!ret && a->stalls) {
+        Com_WPrintf("Writing %s blocked %u times for %u ms, "
+                    "consider increasing fs_async_write.\n",
+                    a->path, a->stalls, a->stall_msec);
     }
 
-    z->avail_in = z->avail_out = 0;
-    z->total_in = z->total_out = 0;
-    z->next_in = z->next_out = NULL;
+    fs_async.files++;
+    fs_async.bytes += a->head;
+    fs_async.stalls += a->stalls;
+    fs_async.stall_msec += a->stall_msec;
 
-    s->rest_in = file->entry->complen;
-    file->zfp = s;
+    Z_Free(a->data);
+    Z_Free(a);
 }
 
-// only called for unique handles
-static void close_zip_file(file_t *file)
+static void shutdown_async(void)
 {
-    zipstream_t *s = file->zfp;
+    if (!fs_async.thread) {
+        return;
+    }
 
-    inflateEnd(&s->stream);
-    Z_Free(s);
+    Sys_LockMutex(fs_async.lock);
+    fs_async.quit = qtrue;
+    Sys_BroadcastCond(fs_async.work);
+    Sys_UnlockMutex(fs_async.lock);
 
-    fclose(file->fp);
+    Sys_JoinThread(fs_async.thread);
+    Sys_DestroyCond(fs_async.done);
+    Sys_DestroyCond(fs_async.work);
+    Sys_DestroyMutex(fs_async.lock);
+    fs_async.thread = NULL;
 }
 
-static ssize_t tell_zip_file(file_t *file)
-{
-    zipstream_t *s = file->zfp;
+static asyncbuf_t *fs_suspended[MAX_FILE_HANDLES];
 
-    return s->stream.total_out;
-}
+/*
+============
+FS_SuspendAsync
 
-static ssize_t read_zip_file(file_t *file, void *buf, size_t len)
+Threads don't survive fork(), so the async thread is stopped before it
+and started again in each process by FS_ResumeAsync. Pending writes are
+drained first and read ahead data is dropped.
+============
+*/
+void FS_SuspendAsync(void)
 {
-    zipstream_t *s = file->zfp;
-    z_streamp z = &s->stream;
-    size_t block, result;
-    int ret;
+    file_t *file;
+    asyncbuf_t *a;
+    int i;
 
-    if (len > file->rest_out) {
-        len = file->rest_out;
-    }
-    if (!len) {
-        return 0;
+    if (!fs_async.thread) {
+        return;
     }
 
-    z->next_out = buf;
-    z->avail_out = (uInt)len;
-
-    do {
-        if (!z->avail_in) {
-            if (!s->rest_in) {
-                break;
-            }
-
-            // fill in the temp buffer
-            block = ZIP_BUFSIZE;
-            if (block > s->rest_in) {
-                block = s->rest_in;
-            }
+    for (i = 0; i < MAX_FILE_HANDLES; i++) {
+        file = &fs_files[i];
+        a = file->async;
+        if (!a) {
+            continue;
+        }
 
-            result = fread(s->buffer, 1, block, file->fp);
-            if (result != block) {
-                file->error = FS_ERR_READ(file->fp);
-                if (!result) {
-                    break;
-                }
-            }
+        if (a->reading) {
+            Sys_LockMutex(fs_async.lock);
+            wait_async(a);
+            file->async = NULL;
+            Sys_UnlockMutex(fs_async.lock);
 
-            s->rest_in -= result;
-            z->next_in = s->buffer;
-            z->avail_in = result;
+            // continue from what was consumed
+            seek_file(file, a->base + a->head);
+            Z_Free(a->data);
+            Z_Free(a);
+            continue;
         }
 
-        ret = inflate(z, Z_SYNC_FLUSH);
-        if (ret == Z_STREAM_END) {
-            break;
-        }
-        if (ret != Z_OK) {
-            file->error = Q_ERR_INFLATE_FAILED;
-            break;
-        }
-        if (file->error) {
-            break;
-        }
-    } while (z->avail_out);
+        drain_async(file);
 
-    len -= z->avail_out;
-    file->rest_out -= len;
+        Sys_LockMutex(fs_async.lock);
+        file->async = NULL;
+        Sys_UnlockMutex(fs_async.lock);
 
-    if (file->error && len == 0) {
-        return file->error;
+        fs_suspended[i] = a;
     }
 
-    return len;
+    shutdown_async();
 }
 
-#endif
-
-// open a new file on the pakfile
-static ssize_t open_from_pak(file_t *file, pack_t *pack, packfile_t *entry, qboolean unique)
+void FS_ResumeAsync(void)
 {
-    FILE *fp;
-    qerror_t ret;
+    int i;
 
-    if (unique) {
-        fp = fopen(pack->filename, "rb");
-        if (!fp) {
-            ret = Q_Errno();
-            goto fail1;
+    for (i = 0; i < MAX_FILE_HANDLES; i++) {
+        if (!fs_suspended[i]) {
+            continue;
         }
-    } else {
-        fp = pack->fp;
-        clearerr(fp);
+
+        start_async();
+
+        Sys_LockMutex(fs_async.lock);
+        fs_files[i].async = fs_suspended[i];
+        Sys_UnlockMutex(fs_async.lock);
+
+        fs_suspended[i] = NULL;
     }
+}
 
-#if USE_ZLIB
-    if (pack->type == FS_ZIP && !entry->coherent) {
-        ret = check_header_coherency(fp, entry);
-        if (ret) {
-            goto fail2;
+static void FS_AsyncStats_f(void)
+{
+    asyncbuf_t *a;
+    int i;
+
+    Com_Printf("Buffered   Peak  Size Stalls   Msec Name\n"
+               "-------- ------ ----- ------ ------ ----\n");
+    for (i = 0; i < MAX_FILE_HANDLES; i++) {
+        if (!(a = fs_files[i].async)) {
+            continue;
         }
-    }
-#endif
+        Sys_LockMutex(fs_async.lock);
+        Com_Printf("%7"PRIz"K %5"PRIz"K %4"PRIz"K %6u %6u %s%s%s\n",
+                   (a->reading ? a->tail - a->head : a->head - a->tail) >> 10,
+                   a->peak >> 10, a->size >> 10,
+                   a->stalls, a->stall_msec, a->path,
+                   a->reading ? " (reading)" : "",
+                   a->error ? " (error)" : "");
+        Sys_UnlockMutex(fs_async.lock);
+    }
+
+    Com_Printf("%u closed files, %llu bytes, blocked %u times for %u ms\n",
+               fs_async.files, (unsigned long long)fs_async.bytes,
+               fs_async.stalls, fs_async.stall_msec);
+}
 
-    if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1) {
-        ret = Q_Errno();
-        goto fail2;
-    }
+/*
+==============
+FS_FCloseFile
+==============
+*/
+void FS_FCloseFile(qhandle_t f)
+{
+    file_t *file = file_for_handle(f);
 
-    file->type = pack->type;
-    file->fp = fp;
-    file->entry = entry;
-    file->pack = pack;
-    file->unique = unique;
-    file->error = Q_ERR_SUCCESS;
-    file->rest_out = entry->filelen;
-    file->length = entry->filelen;
+    if (!file)
+        return;
 
+    if (file->async)
+        close_async(file);
+
+    switch (file->type) {
+    case FS_REAL:
+        fclose(file->fp);
+        break;
+    case FS_PAK:
+        if (file->unique) {
+            fclose(file->fp);
+            pack_put(file->pack);
+        }
+        break;
 #if USE_ZLIB
-    if (pack->type == FS_ZIP) {
-        if (entry->compmtd) {
-            open_zip_file(file);
-        } else {
-            // stored, just pretend it's a packfile
-            file->type = FS_PAK;
+    case FS_GZ:
+        gzclose(file->zfp);
+        fclose(file->fp);
+        break;
+    case FS_ZIP:
+        if (file->unique) {
+            close_zip_file(file);
+            pack_put(file->pack);
         }
-    }
+        break;
 #endif
-
-    if (unique) {
-        // reference source pak
-        pack_get(pack);
+    default:
+        break;
     }
 
-    FS_DPrintf("%s: %s/%s: %"PRIz" bytes\n",
-               __func__, pack->filename, entry->name, entry->filelen);
+    memset(file, 0, sizeof(*file));
+}
 
-    return entry->filelen;
+static qerror_t get_path_info(const char *path, file_info_t *info)
+{
+    Q_STATBUF st;
 
-fail2:
-    if (unique) {
-        fclose(fp);
+    if (os_stat(path, &st) == -1)
+        return Q_Errno();
+
+    if (Q_ISDIR(st.st_mode))
+        return Q_ERR_ISDIR;
+
+    if (!Q_ISREG(st.st_mode))
+        return Q_ERR_FILE_NOT_REGULAR;
+
+    if (info) {
+        info->size = st.st_size;
+        info->ctime = st.st_ctime;
+        info->mtime = st.st_mtime;
     }
-fail1:
-    FS_DPrintf("%s: %s/%s: %s\n", __func__, pack->filename, entry->name, Q_ErrorString(ret));
-    return ret;
+
+    return Q_ERR_SUCCESS;
 }
 
-static ssize_t open_from_disk(file_t *file, const char *fullpath)
+static qerror_t get_fp_info(FILE *fp, file_info_t *info)
 {
-    FILE *fp;
-    file_info_t info;
-    qerror_t ret;
+    Q_STATBUF st;
+    int fd;
 
-    FS_COUNT_OPEN;
+    fd = os_fileno(fp);
+    if (fd == -1)
+        return Q_Errno();
 
-    fp = fopen(fullpath, "rb");
-    if (!fp) {
-        ret = Q_Errno();
-        goto fail;
-    }
+    if (os_fstat(fd, &st) == -1)
+        return Q_Errno();
 
-    ret = get_fp_info(fp, &info);
-    if (ret) {
-        fclose(fp);
-        goto fail;
+    if (Q_ISDIR(st.st_mode))
+        return Q_ERR_ISDIR;
+
+    if (!Q_ISREG(st.st_mode))
+        return Q_ERR_FILE_NOT_REGULAR;
+
+    if (info) {
+        info->size = st.st_size;
+        info->ctime = st.st_ctime;
+        info->mtime = st.st_mtime;
     }
 
-    file->type = FS_REAL;
-    file->fp = fp;
-    file->unique = qtrue;
-    file->error = Q_ERR_SUCCESS;
-    file->length = info.size;
+    return Q_ERR_SUCCESS;
+}
 
-    FS_DPrintf("%s: %s: %"PRIz" bytes\n", __func__, fullpath, info.size);
-    return info.size;
+static inline FILE *fopen_hack(const char *path, const char *mode)
+{
+#ifndef _GNU_SOURCE
+    if (mode[0] == 'w' && mode[1] == 'x') {
+#ifdef _WIN32
+        int flags = _O_WRONLY | _O_CREAT | _O_EXCL | _S_IREAD | _S_IWRITE;
+        int fd;
+        FILE *fp;
 
-fail:
-    FS_DPrintf("%s: %s: %s\n", __func__, fullpath, Q_ErrorString(ret));
-    return ret;
+        if (mode[2] == 'b')
+            flags |= _O_BINARY;
+
+        fd = _open(path, flags);
+        if (fd == -1)
+            return NULL;
+
+        fp = _fdopen(fd, (flags & _O_BINARY) ? "wb" : "w");
+        if (fp == NULL)
+            _close(fd);
+
+        return fp;
+#else
+        int flags = O_WRONLY | O_CREAT | O_EXCL;
+        int perm = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+        int fd;
+        FILE *fp;
+
+        fd = open(path, flags, perm);
+        if (fd == -1)
+            return NULL;
+
+        fp = fdopen(fd, "wb");
+        if (fp == NULL)
+            close(fd);
+
+        return fp;
+#endif
+    }
+#endif // _GNU_SOURCE
+
+    return fopen(path, mode);
 }
 
-// Finds the file in the search path.
-// Fills file_t and returns file length.
-// Used for streaming data out of either a pak file or a seperate file.
-static ssize_t open_file_read(file_t *file, const char *normalized, size_t namelen, qboolean unique)
+static ssize_t open_file_write(file_t *file, const char *name)
 {
-    char            fullpath[MAX_OSPATH];
-    searchpath_t    *search;
-    pack_t          *pak;
-    unsigned        hash;
-    packfile_t      *entry;
-    ssize_t         ret;
-    int             valid;
-    size_t          len;
+    char normalized[MAX_OSPATH], fullpath[MAX_OSPATH];
+    FILE *fp;
+    char mode_str[8];
+    unsigned mode;
+    size_t len;
+    long pos;
+    qerror_t ret;
 
-    FS_COUNT_READ;
+    // normalize the path
+    len = FS_NormalizePathBuffer(normalized, name, sizeof(normalized));
+    if (len >= sizeof(normalized)) {
+        return Q_ERR_NAMETOOLONG;
+    }
 
-    hash = FS_HashPath(normalized, 0);
+    // reject empty paths
+    if (len == 0) {
+        return Q_ERR_NAMETOOSHORT;
+    }
 
-    valid = PATH_NOT_CHECKED;
+    // check for bad characters
+    if (!FS_ValidatePath(normalized)) {
+        ret = Q_ERR_INVALID_PATH;
+        goto fail1;
+    }
 
-// search through the path, one element at a time
-    for (search = fs_searchpaths; search; search = search->next) {
-        if (file->mode & FS_PATH_MASK) {
-            if ((file->mode & search->mode & FS_PATH_MASK) == 0) {
-                continue;
-            }
+    // expand the path
+    if ((file->mode & FS_PATH_MASK) == FS_PATH_BASE) {
+        if (sys_homedir->string[0]) {
+            len = Q_concat(fullpath, sizeof(fullpath),
+                           sys_homedir->string, "/" BASEGAME "/", normalized, NULL);
+        } else {
+            len = Q_concat(fullpath, sizeof(fullpath),
+                           sys_basedir->string, "/" BASEGAME "/", normalized, NULL);
         }
+    } else {
+        len = Q_concat(fullpath, sizeof(fullpath),
+                       fs_gamedir, "/", normalized, NULL);
+    }
+    if (len >= sizeof(fullpath)) {
+        ret = Q_ERR_NAMETOOLONG;
+        goto fail1;
+    }
 
-        // is the element a pak file?
-        if (search->pack) {
-            if ((file->mode & FS_TYPE_MASK) == FS_TYPE_REAL) {
-                continue;
+    mode = file->mode & FS_MODE_MASK;
+    switch (mode) {
+    case FS_MODE_APPEND:
+        strcpy(mode_str, "a");
+        break;
+    case FS_MODE_WRITE:
+        strcpy(mode_str, "w");
+        if (file->mode & FS_FLAG_EXCL)
+            strcat(mode_str, "x");
+        break;
+    case FS_MODE_RDWR:
+        // this mode is only used by client downloading code
+        // similar to FS_MODE_APPEND, but does not create
+        // the file if it does not exist
+        strcpy(mode_str, "r+");
+        break;
+    default:
+        ret = Q_ERR_INVAL;
+        goto fail1;
+    }
+
+    // open in binary mode by default
+    if (!(file->mode & FS_FLAG_TEXT))
+        strcat(mode_str, "b");
+
+    ret = FS_CreatePath(fullpath);
+    if (ret) {
+        goto fail1;
+    }
+
+    fp = fopen_hack(fullpath, mode_str);
+    if (!fp) {
+        ret = Q_Errno();
+        goto fail1;
+    }
+
+#ifndef _WIN32
+    // check if this is a regular file
+    ret = get_fp_info(fp, NULL);
+    if (ret) {
+        goto fail2;
+    }
+#endif
+
+    switch (file->mode & FS_BUF_MASK) {
+    case FS_BUF_NONE:
+        // make it unbuffered
+        setvbuf(fp, NULL, _IONBF, BUFSIZ);
+        break;
+    case FS_BUF_LINE:
+        // make it line buffered
+        setvbuf(fp, NULL, _IOLBF, BUFSIZ);
+        break;
+    case FS_BUF_FULL:
+        // make it fully buffered
+        setvbuf(fp, NULL, _IOFBF, BUFSIZ);
+        break;
+    default:
+        // use default mode (normally fully buffered)
+        break;
+    }
+
+    if (mode == FS_MODE_RDWR) {
+        // seek to the end of file for appending
+        if (fseek(fp, 0, SEEK_END) == -1) {
+            ret = Q_Errno();
+            goto fail2;
+        }
+    }
+
+    // return current position (non-zero for appending modes)
+    pos = ftell(fp);
+    if (pos == -1) {
+        ret = Q_Errno();
+        goto fail2;
+    }
+
+    FS_DPrintf("%s: %s: %lu bytes\n", __func__, fullpath, pos);
+
+    // file may have been created
+    FS_InvalidateIndex();
+
+    file->type = FS_REAL;
+    file->fp = fp;
+    file->unique = qtrue;
+    file->error = Q_ERR_SUCCESS;
+    file->length = 0;
+
+    return pos;
+
+fail2:
+    fclose(fp);
+fail1:
+    FS_DPrintf("%s: %s: %s\n", __func__, normalized, Q_ErrorString(ret));
+    return ret;
+}
+
+#if USE_ZLIB
+
+static qerror_t check_header_coherency(FILE *fp, packfile_t *entry)
+{
+    unsigned flags, comp_mtd;
+    size_t comp_len, file_len;
+    size_t name_size, xtra_size;
+    byte header[ZIP_SIZELOCALHEADER];
+    size_t ofs;
+
+    if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1)
+        return Q_Errno();
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header))
+        return FS_ERR_READ(fp);
+
+    // check the magic
+    if (LittleLongMem(&header[0]) != ZIP_LOCALHEADERMAGIC)
+        return Q_ERR_NOT_COHERENT;
+
+    flags = LittleShortMem(&header[6]);
+    comp_mtd = LittleShortMem(&header[8]);
+    comp_len = LittleLongMem(&header[18]);
+    file_len = LittleLongMem(&header[22]);
+    name_size = LittleShortMem(&header[26]);
+    xtra_size = LittleShortMem(&header[28]);
+
+    if (comp_mtd != entry->compmtd)
+        return Q_ERR_NOT_COHERENT;
+
+    // bit 3 tells that file lengths were not known
+    // at the time local header was written, so don't check them
+    if ((flags & 8) == 0) {
+        if (comp_len != entry->complen)
+            return Q_ERR_NOT_COHERENT;
+        if (file_len != entry->filelen)
+            return Q_ERR_NOT_COHERENT;
+    }
+
+    ofs = ZIP_SIZELOCALHEADER + name_size + xtra_size;
+    if (entry->filepos > LONG_MAX - ofs) {
+        return Q_ERR_SPIPE;
+    }
+
+    entry->filepos += ofs;
+    entry->coherent = qtrue;
+    return Q_ERR_SUCCESS;
+}
+
+static voidpf FS_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    return FS_Malloc(items * size);
+}
+
+static void FS_zfree(voidpf opaque, voidpf address)
+{
+    Z_Free(address);
+}
+
+static void open_zip_file(file_t *file)
+{
+    zipstream_t *s;
+    z_streamp z;
+
+    if (file->unique) {
+        s = FS_Malloc(sizeof(*s));
+        memset(&s->stream, 0, sizeof(s->stream));
+    } else {
+        s = &fs_zipstream;
+    }
+
+    z = &s->stream;
+    if (z->state) {
+        // already initialized, just reset
+        inflateReset(z);
+    } else {
+        z->zalloc = FS_zalloc;
+        z->zfree = FS_zfree;
+        if (inflateInit2(z, -MAX_WBITS) != Z_OK) {
+            Com_Error(ERR_FATAL, "%s: inflateInit2() failed", __func__);
+        }
+    }
+
+    z->avail_in = z->avail_out = 0;
+    z->total_in = z->total_out = 0;
+    z->next_in = z->next_out = NULL;
+
+    s->rest_in = file->entry->complen;
+    file->zfp = s;
+}
+
+// only called for unique handles
+static void close_zip_file(file_t *file)
+{
+    zipstream_t *s = file->zfp;
+
+    inflateEnd(&s->stream);
+    Z_Free(s);
+
+    fclose(file->fp);
+}
+
+static ssize_t tell_zip_file(file_t *file)
+{
+    zipstream_t *s = file->zfp;
+
+    return s->stream.total_out;
+}
+
+static ssize_t read_zip_file(file_t *file, void *buf, size_t len)
+{
+    zipstream_t *s = file->zfp;
+    z_streamp z = &s->stream;
+    size_t block, result;
+    int ret;
+
+    if (len > file->rest_out) {
+        len = file->rest_out;
+    }
+    if (!len) {
+        return 0;
+    }
+
+    z->next_out = buf;
+    z->avail_out = (uInt)len;
+
+    do {
+        if (!z->avail_in) {
+            if (!s->rest_in) {
+                break;
             }
-            // don't bother searching in paks if length exceedes MAX_QPATH
-            if (namelen >= MAX_QPATH) {
-                continue;
+
+            // fill in the temp buffer
+            block = ZIP_BUFSIZE;
+            if (block > s->rest_in) {
+                block = s->rest_in;
             }
-            // look through all the pak file elements
-            pak = search->pack;
-            entry = pak->file_hash[hash & (pak->hash_size - 1)];
-            for (; entry; entry = entry->hash_next) {
-                if (entry->namelen != namelen) {
-                    continue;
-                }
-                FS_COUNT_STRCMP;
-                if (!FS_pathcmp(entry->name, normalized)) {
-                    // found it!
-                    return open_from_pak(file, pak, entry, unique);
+
+            result = fread(s->buffer, 1, block, file->fp);
+            if (result != block) {
+                file->error = FS_ERR_READ(file->fp);
+                if (!result) {
+                    break;
                 }
             }
-        } else {
-            if ((file->mode & FS_TYPE_MASK) == FS_TYPE_PAK) {
-                continue;
-            }
-            // don't error out immediately if the path is found to be invalid,
-            // just stop looking for it in directory tree but continue to search
-            // for it in packs, to give broken maps or mods a chance to work
-            if (valid == PATH_NOT_CHECKED) {
-                valid = FS_ValidatePath(normalized);
-            }
-            if (valid == PATH_INVALID) {
+
+            s->rest_in -= result;
+            z->next_in = s->buffer;
+            z->avail_in = result;
+        }
+
+        ret = inflate(z, Z_SYNC_FLUSH);
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+        if (ret != Z_OK) {
+            file->error = Q_ERR_INFLATE_FAILED;
+            break;
+        }
+        if (file->error) {
+            break;
+        }
+    } while (z->avail_out);
+
+    len -= z->avail_out;
+    file->rest_out -= len;
+
+    if (file->error && len == 0) {
+        return file->error;
+    }
+
+    return len;
+}
+
+#endif
+
+// open a new file on the pakfile
+static ssize_t open_from_pak(file_t *file, pack_t *pack, packfile_t *entry, qboolean unique)
+{
+    FILE *fp;
+    qerror_t ret;
+
+    if (unique) {
+        fp = fopen(pack->filename, "rb");
+        if (!fp) {
+            ret = Q_Errno();
+            goto fail1;
+        }
+    } else {
+        fp = pack->fp;
+        clearerr(fp);
+    }
+
+#if USE_ZLIB
+    if (pack->type == FS_ZIP && !entry->coherent) {
+        ret = check_header_coherency(fp, entry);
+        if (ret) {
+            goto fail2;
+        }
+    }
+#endif
+
+    if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1) {
+        ret = Q_Errno();
+        goto fail2;
+    }
+
+    file->type = pack->type;
+    file->fp = fp;
+    file->entry = entry;
+    file->pack = pack;
+    file->unique = unique;
+    file->error = Q_ERR_SUCCESS;
+    file->rest_out = entry->filelen;
+    file->length = entry->filelen;
+
+#if USE_ZLIB
+    if (pack->type == FS_ZIP) {
+        if (entry->compmtd) {
+            open_zip_file(file);
+        } else {
+            // stored, just pretend it's a packfile
+            file->type = FS_PAK;
+        }
+    }
+#endif
+
+    if (unique) {
+        // reference source pak
+        pack_get(pack);
+    }
+
+    FS_DPrintf("%s: %s/%s: %"PRIz" bytes\n",
+               __func__, pack->filename, entry->name, entry->filelen);
+
+    return entry->filelen;
+
+fail2:
+    if (unique) {
+        fclose(fp);
+    }
+fail1:
+    FS_DPrintf("%s: %s/%s: %s\n", __func__, pack->filename, entry->name, Q_ErrorString(ret));
+    return ret;
+}
+
+static ssize_t open_from_disk(file_t *file, const char *fullpath)
+{
+    FILE *fp;
+    file_info_t info;
+    qerror_t ret;
+
+    FS_COUNT_OPEN;
+
+    fp = fopen(fullpath, "rb");
+    if (!fp) {
+        ret = Q_Errno();
+        goto fail;
+    }
+
+    ret = get_fp_info(fp, &info);
+    if (ret) {
+        fclose(fp);
+        goto fail;
+    }
+
+    file->type = FS_REAL;
+    file->fp = fp;
+    file->unique = qtrue;
+    file->error = Q_ERR_SUCCESS;
+    file->length = info.size;
+
+    FS_DPrintf("%s: %s: %"PRIz" bytes\n", __func__, fullpath, info.size);
+    return info.size;
+
+fail:
+    FS_DPrintf("%s: %s: %s\n", __func__, fullpath, Q_ErrorString(ret));
+    return ret;
+}
+
+static inline qboolean search_allowed(const file_t *file, const searchpath_t *search)
+{
+    if (file->mode & FS_PATH_MASK) {
+        if ((file->mode & search->mode & FS_PATH_MASK) == 0) {
+            return qfalse;
+        }
+    }
+
+    if (search->pack) {
+        return (file->mode & FS_TYPE_MASK) != FS_TYPE_REAL;
+    }
+
+    return (file->mode & FS_TYPE_MASK) != FS_TYPE_PAK;
+}
+
+// Looks for the file in a single search path element.
+static ssize_t open_from_path(file_t *file, searchpath_t *search, const char *normalized,
+                              size_t namelen, unsigned hash, qboolean unique, int *valid)
+{
+    char            fullpath[MAX_OSPATH];
+    pack_t          *pak;
+    packfile_t      *entry;
+    ssize_t         ret;
+    size_t          len;
+
+    // is the element a pak file?
+    if (search->pack) {
+        // don't bother searching in paks if length exceedes MAX_QPATH
+        if (namelen >= MAX_QPATH) {
+            return Q_ERR_NOENT;
+        }
+        // look through all the pak file elements
+        pak = search->pack;
+        entry = pak->file_hash[hash & (pak->hash_size - 1)];
+        for (; entry; entry = entry->hash_next) {
+            if (entry->namelen != namelen) {
                 continue;
             }
-            // check a file in the directory tree
-            len = Q_concat(fullpath, sizeof(fullpath),
-                           search->filename, "/", normalized, NULL);
-            if (len >= sizeof(fullpath)) {
-                ret = Q_ERR_NAMETOOLONG;
-                goto fail;
+            FS_COUNT_STRCMP;
+            if (!FS_pathcmp(entry->name, normalized)) {
+                // found it!
+                return open_from_pak(file, pak, entry, unique);
             }
+        }
+        return Q_ERR_NOENT;
+    }
+
+    // don't error out immediately if the path is found to be invalid,
+    // just stop looking for it in directory tree but continue to search
+    // for it in packs, to give broken maps or mods a chance to work
+    if (*valid == PATH_NOT_CHECKED) {
+        *valid = FS_ValidatePath(normalized);
+    }
+    if (*valid == PATH_INVALID) {
+        return Q_ERR_NOENT;
+    }
+    // check a file in the directory tree
+    len = Q_concat(fullpath, sizeof(fullpath),
+                   search->filename, "/", normalized, NULL);
+    if (len >= sizeof(fullpath)) {
+        return Q_ERR_NAMETOOLONG;
+    }
+
+    ret = open_from_disk(file, fullpath);
+    if (ret != Q_ERR_NOENT)
+        return ret;
+
+#ifndef _WIN32
+    if (*valid == PATH_MIXED_CASE) {
+        // convert to lower case and retry
+        FS_COUNT_STRLWR;
+        Q_strlwr(fullpath + strlen(search->filename) + 1);
+        ret = open_from_disk(file, fullpath);
+    }
+#endif
+
+    return ret;
+}
+
+/*
+=============================================================================
+
+MISSING FILES CACHE
+
+Lookups that found nothing are remembered, so that fallback chains asking
+for the same missing files over and over don't search the path each time.
+Names are cached after link expansion, so links don't affect it. Forgotten
+whenever the search path or the index changes, when files are written, and
+once a second for lookups that bypass the index and so wouldn't notice files
+appearing on disk.
+
+=============================================================================
+*/
+
+#define MISSING_HASH_SIZE   256
+#define MISSING_MAX_FILES   4096
+
+typedef struct missing_s {
+    struct missing_s *next;
+    unsigned    hash;
+    unsigned    mode;
+    size_t      namelen;
+    char        name[1];
+} missing_t;
+
+static struct {
+    missing_t   *hash[MISSING_HASH_SIZE];
+    unsigned    count;
+    unsigned    cleartime;
+} fs_missing;
+
+static void flush_missing(void)
+{
+    missing_t *m, *next;
+    int i;
+
+    for (i = 0; i < MISSING_HASH_SIZE; i++) {
+        for (m = fs_missing.hash[i]; m; m = next) {
+            next = m->next;
+            Z_Free(m);
+        }
+        fs_missing.hash[i] = NULL;
+    }
+
+    fs_missing.count = 0;
+    fs_missing.cleartime = Sys_Milliseconds();
+}
+
+static qboolean find_missing(const file_t *file, const char *normalized, size_t namelen, unsigned hash)
+{
+    unsigned mode = file->mode & (FS_PATH_MASK | FS_TYPE_MASK);
+    missing_t *m;
+
+    for (m = fs_missing.hash[hash & (MISSING_HASH_SIZE - 1)]; m; m = m->next) {
+        if (m->hash == hash && m->mode == mode && m->namelen == namelen &&
+            !strcmp(m->name, normalized)) {
+            FS_COUNT_MISSHIT;
+            return qtrue;
+        }
+    }
+
+    return qfalse;
+}
+
+static void add_missing(const file_t *file, const char *normalized, size_t namelen, unsigned hash)
+{
+    missing_t *m;
+
+    if (fs_missing.count >= MISSING_MAX_FILES) {
+        flush_missing();
+    }
+
+    m = FS_Malloc(sizeof(*m) + namelen);
+    m->hash = hash;
+    m->mode = file->mode & (FS_PATH_MASK | FS_TYPE_MASK);
+    m->namelen = namelen;
+    memcpy(m->name, normalized, namelen + 1);
+    m->next = fs_missing.hash[hash & (MISSING_HASH_SIZE - 1)];
+    fs_missing.hash[hash & (MISSING_HASH_SIZE - 1)] = m;
+    fs_missing.count++;
+
+    FS_COUNT_MISSADD;
+}
+
+/*
+=============================================================================
+
+LOOKUP INDEX
+
+Every file in every pack and loose directory tree of the search path is put
+into a single hash, in search order, so finding (or not finding) a file takes
+one hash probe instead of a probe per pack plus a failed open per directory.
+Directory trees are scanned once and rescanned when the modification time of
+one of their directories changes, which is checked at most once a second, or
+right after the filesystem itself has written a file. Trees too large to scan
+fall back to probing the disk, in their proper place in the search order.
+
+=============================================================================
+*/
+
+#define INDEX_RECHECK_MSEC  1000
+#define INDEX_MAX_DIRS      4096
+#define INDEX_MAX_FILES     0x40000
+
+static struct {
+    fsindex_t   **hash;
+    unsigned    hash_size;
+    fsindex_t   *entries;
+    unsigned    num_entries;
+    fsindex_t   *probes;        // unindexed directories, terminated by NULL search
+    unsigned    dir_modes;      // search modes of all directories
+    qboolean    stale;          // search path or directory caches changed
+    unsigned    checktime;      // last time directories were checked for changes
+} fs_lookup;
+
+static void free_dir_cache(dircache_t *cache)
+{
+    unsigned i;
+
+    if (!cache) {
+        return;
+    }
+
+    for (i = 0; i < cache->num_files; i++) {
+        Z_Free(cache->files[i]);
+    }
+    for (i = 0; i < cache->num_dirs; i++) {
+        Z_Free(cache->dirs[i]);
+    }
+    Z_Free(cache->files);
+    Z_Free(cache->namelens);
+    Z_Free(cache->dirs);
+    Z_Free(cache);
+}
+
+static time_t dir_mtime(const char *root, const char *path)
+{
+    char        fullpath[MAX_OSPATH];
+    Q_STATBUF   st;
+
+    if (Q_concat(fullpath, sizeof(fullpath), root, *path ? "/" : "", path, NULL) >= sizeof(fullpath))
+        return 0;
+
+    if (os_stat(fullpath, &st) == -1 || !Q_ISDIR(st.st_mode))
+        return 0;
+
+    return st.st_mtime;
+}
+
+static void add_cached_dir(dircache_t *cache, const char *path, time_t mtime)
+{
+    loosedir_t *dir;
+    size_t len;
+
+    if (!(cache->num_dirs & 63)) {
+        cache->dirs = Z_Realloc(cache->dirs, (cache->num_dirs + 64) * sizeof(cache->dirs[0]));
+    }
+
+    len = strlen(path);
+    dir = FS_Malloc(sizeof(*dir) + len);
+    dir->mtime = mtime;
+    memcpy(dir->path, path, len + 1);
+    cache->dirs[cache->num_dirs++] = dir;
+}
+
+static void add_cached_file(dircache_t *cache, const char *path, size_t len)
+{
+    if (!(cache->num_files & 1023)) {
+        cache->files = Z_Realloc(cache->files, (cache->num_files + 1024) * sizeof(cache->files[0]));
+        cache->namelens = Z_Realloc(cache->namelens, (cache->num_files + 1024) * sizeof(cache->namelens[0]));
+    }
+
+    cache->files[cache->num_files] = FS_CopyString(path);
+    cache->namelens[cache->num_files] = len;
+    cache->num_files++;
+}
+
+// Returns false if the tree can't be indexed completely.
+static qboolean scan_dir_r(dircache_t *cache, const char *root, const char *path, time_t mtime, int depth)
+{
+    void        *list[MAX_LISTED_FILES];
+    char        fullpath[MAX_OSPATH], name[MAX_OSPATH];
+    file_info_t *info;
+    int         i, count, pass;
+    size_t      len;
+    qboolean    ok = qtrue;
+
+    if (cache->num_dirs >= INDEX_MAX_DIRS) {
+        return qfalse;
+    }
+
+    if (Q_concat(fullpath, sizeof(fullpath), root, *path ? "/" : "", path, NULL) >= sizeof(fullpath)) {
+        return qfalse;
+    }
+
+    add_cached_dir(cache, path, mtime);
+
+    // files first, then subdirectories
+    for (pass = 0; pass < 2 && ok; pass++) {
+        count = 0;
+        Sys_ListFiles_r(fullpath, NULL, pass ? FS_SEARCH_DIRSONLY | FS_SEARCH_EXTRAINFO :
+                        FS_SEARCH_EXTRAINFO, 0, &count, list, 0);
+        if (count >= MAX_LISTED_FILES) {
+            ok = qfalse;
+        } else if (pass && count && depth >= MAX_LISTED_DEPTH) {
+            ok = qfalse;
+        }
+
+        for (i = 0; i < count; i++) {
+            info = list[i];
+            if (ok) {
+                len = Q_concat(name, sizeof(name), path, *path ? "/" : "", info->name, NULL);
+                if (len >= sizeof(name)) {
+                    // can't be opened by the path anyway
+                } else if (pass) {
+                    ok = scan_dir_r(cache, root, name, info->mtime, depth + 1);
+                } else if (cache->num_files >= INDEX_MAX_FILES) {
+                    ok = qfalse;
+                } else {
+                    add_cached_file(cache, name, len);
+                }
+            }
+            Z_Free(info);
+        }
+    }
+
+    return ok;
+}
+
+static dircache_t *scan_dir(const char *root)
+{
+    dircache_t *cache;
+
+    cache = FS_Mallocz(sizeof(*cache));
+    cache->scantime = time(NULL);
+    cache->complete = scan_dir_r(cache, root, "", dir_mtime(root, ""), 0);
+    cache->scanend = time(NULL);
+
+    FS_DPrintf("%s: %s: %u files, %u directories%s\n", __func__, root,
+               cache->num_files, cache->num_dirs, cache->complete ? "" : ", incomplete");
+
+    // don't keep partial lists around
+    if (!cache->complete) {
+        free_dir_cache(cache);
+        cache = FS_Mallocz(sizeof(*cache));
+    }
+
+    return cache;
+}
+
+// Directories with mtime falling within the scan count as changed, since
+// mtime can't tell if they were changed again later in the same second.
+static qboolean dir_cache_changed(const searchpath_t *search)
+{
+    const dircache_t *cache = search->cache;
+    const loosedir_t *dir;
+    unsigned i;
+
+    // incomplete trees are probed anyway
+    if (!cache->complete) {
+        return qfalse;
+    }
+
+    for (i = 0; i < cache->num_dirs; i++) {
+        dir = cache->dirs[i];
+        if (dir->mtime >= cache->scantime && dir->mtime <= cache->scanend) {
+            return qtrue;
+        }
+        if (dir_mtime(search->filename, dir->path) != dir->mtime) {
+            return qtrue;
+        }
+    }
+
+    return qfalse;
+}
+
+static void check_dir_caches(void)
+{
+    searchpath_t *search;
+    unsigned now = Sys_Milliseconds();
+
+    // new search path elements need scanning right away
+    if (!fs_lookup.stale && fs_lookup.checktime && now - fs_lookup.checktime < INDEX_RECHECK_MSEC) {
+        return;
+    }
+
+    for (search = fs_searchpaths; search; search = search->next) {
+        if (search->pack) {
+            continue;
+        }
+        if (search->cache && !dir_cache_changed(search)) {
+            continue;
+        }
+        free_dir_cache(search->cache);
+        search->cache = scan_dir(search->filename);
+        fs_lookup.stale = qtrue;
+    }
+
+    fs_lookup.checktime = Sys_Milliseconds();
+    if (!fs_lookup.checktime) {
+        fs_lookup.checktime = 1;
+    }
+}
+
+static void free_index(void)
+{
+    Z_Free(fs_lookup.hash);
+    Z_Free(fs_lookup.entries);
+    Z_Free(fs_lookup.probes);
+    fs_lookup.hash = NULL;
+    fs_lookup.entries = NULL;
+    fs_lookup.probes = NULL;
+    fs_lookup.hash_size = 0;
+    fs_lookup.num_entries = 0;
+}
+
+static void build_index(void)
+{
+    searchpath_t    *search;
+    fsindex_t       *idx, *probe;
+    unsigned        i, order, count, num_probes, hash;
+
+    free_index();
+
+    count = num_probes = 0;
+    for (search = fs_searchpaths; search; search = search->next) {
+        if (search->pack) {
+            count += search->pack->num_files;
+        } else if (search->cache->complete) {
+            count += search->cache->num_files;
+        } else {
+            num_probes++;
+        }
+    }
+
+    fs_lookup.hash_size = npot32(count / 2 + 1);
+    fs_lookup.hash = FS_Mallocz(fs_lookup.hash_size * sizeof(fs_lookup.hash[0]));
+    fs_lookup.entries = FS_Malloc((count + 1) * sizeof(fs_lookup.entries[0]));
+    fs_lookup.probes = FS_Mallocz((num_probes + 1) * sizeof(fs_lookup.probes[0]));
+    fs_lookup.dir_modes = 0;
+
+    idx = fs_lookup.entries;
+    probe = fs_lookup.probes;
+    for (search = fs_searchpaths, order = 0; search; search = search->next, order++) {
+        if (search->pack) {
+            for (i = 0; i < search->pack->num_files; i++, idx++) {
+                idx->search = search;
+                idx->entry = &search->pack->files[i];
+                idx->name = idx->entry->name;
+                idx->namelen = idx->entry->namelen;
+                idx->order = order;
+            }
+            continue;
+        }
+
+        fs_lookup.dir_modes |= search->mode;
+        if (search->cache->complete) {
+            for (i = 0; i < search->cache->num_files; i++, idx++) {
+                idx->search = search;
+                idx->entry = NULL;
+                idx->name = search->cache->files[i];
+                idx->namelen = search->cache->namelens[i];
+                idx->order = order;
+            }
+        } else {
+            probe->search = search;
+            probe->order = order;
+            probe++;
+        }
+    }
+
+    // link backwards so that chains are in search order
+    fs_lookup.num_entries = count;
+    for (i = count; i > 0; i--) {
+        idx = &fs_lookup.entries[i - 1];
+        hash = FS_HashPath(idx->name, fs_lookup.hash_size);
+        idx->next = fs_lookup.hash[hash];
+        fs_lookup.hash[hash] = idx;
+    }
+
+    fs_lookup.stale = qfalse;
+    flush_missing();
+
+    FS_DPrintf("%s: %u files, %u unindexed directories\n", __func__, count, num_probes);
+}
+
+#ifndef _WIN32
+// loose files are only found by exact name, or by lower case name
+// if the path is mixed case, same as when opening them directly.
+static qboolean loose_match(const char *name, const char *normalized, int valid)
+{
+    if (!strcmp(name, normalized)) {
+        return qtrue;
+    }
+
+    if (valid != PATH_MIXED_CASE) {
+        return qfalse;
+    }
+
+    FS_COUNT_STRLWR;
+    for (; *name; name++, normalized++) {
+        if (*name != Q_tolower(*normalized)) {
+            return qfalse;
+        }
+    }
+
+    return qtrue;
+}
+#endif
+
+static ssize_t open_from_index(file_t *file, const char *normalized, size_t namelen, unsigned hash, qboolean unique)
+{
+    char            fullpath[MAX_OSPATH];
+    fsindex_t       *idx, *probe;
+    ssize_t         ret;
+    int             valid;
+    size_t          len;
+
+    valid = PATH_NOT_CHECKED;
+
+    idx = fs_lookup.hash[hash & (fs_lookup.hash_size - 1)];
+    probe = fs_lookup.probes;
+    for (;;) {
+        // find the next location that has this file
+        for (; idx; idx = idx->next) {
+            if (idx->namelen != namelen) {
+                continue;
+            }
+            if (!search_allowed(file, idx->search)) {
+                continue;
+            }
+            FS_COUNT_STRCMP;
+            if (!FS_pathcmp(idx->name, normalized)) {
+                break;
+            }
+        }
+
+        // probe unindexed directories that come before it
+        for (; probe->search && (!idx || probe->order < idx->order); probe++) {
+            if (!search_allowed(file, probe->search)) {
+                continue;
+            }
+            ret = open_from_path(file, probe->search, normalized, namelen, hash, unique, &valid);
+            if (ret != Q_ERR_NOENT) {
+                return ret;
+            }
+        }
+
+        if (!idx) {
+            break;
+        }
+
+        if (idx->entry) {
+            return open_from_pak(file, idx->search->pack, idx->entry, unique);
+        }
+
+        if (valid == PATH_NOT_CHECKED) {
+            valid = FS_ValidatePath(normalized);
+        }
+#ifndef _WIN32
+        if (valid != PATH_INVALID && loose_match(idx->name, normalized, valid)) {
+#else
+        if (valid != PATH_INVALID) {
+#endif
+            len = Q_concat(fullpath, sizeof(fullpath),
+                           idx->search->filename, "/", idx->name, NULL);
+            if (len >= sizeof(fullpath)) {
+                ret = Q_ERR_NAMETOOLONG;
+                goto fail;
+            }
+            // may be gone already if it was removed behind our back
+            ret = open_from_disk(file, fullpath);
+            if (ret != Q_ERR_NOENT) {
+                return ret;
+            }
+        }
+
+        idx = idx->next;
+    }
+
+    // same error as searching directories one by one would give
+    if (valid == PATH_NOT_CHECKED && fs_lookup.dir_modes && (file->mode & FS_TYPE_MASK) != FS_TYPE_PAK) {
+        if (!(file->mode & FS_PATH_MASK) || (file->mode & fs_lookup.dir_modes & FS_PATH_MASK)) {
+            valid = FS_ValidatePath(normalized);
+        }
+    }
+
+    ret = valid ? Q_ERR_NOENT : Q_ERR_INVALID_PATH;
+
+fail:
+    FS_DPrintf("%s: %s: %s\n", __func__, normalized, Q_ErrorString(ret));
+    return ret;
+}
+
+/*
+================
+FS_InvalidateIndex
+
+Makes the next lookup check directories for changes and forgets missing
+files. Called after files were written or renamed, including by code outside
+of the filesystem.
+================
+*/
+void FS_InvalidateIndex(void)
+{
+    fs_lookup.checktime = 0;
+    flush_missing();
+}
+
+// Searches the path one element at a time.
+static ssize_t open_from_paths(file_t *file, const char *normalized, size_t namelen, unsigned hash, qboolean unique)
+{
+    searchpath_t    *search;
+    ssize_t         ret;
+    int             valid;
+
+    valid = PATH_NOT_CHECKED;
+
+    for (search = fs_searchpaths; search; search = search->next) {
+        if (!search_allowed(file, search)) {
+            continue;
+        }
+        ret = open_from_path(file, search, normalized, namelen, hash, unique, &valid);
+        if (ret != Q_ERR_NOENT) {
+            if (ret == Q_ERR_NAMETOOLONG) {
+                goto fail;
+            }
+            return ret;
+        }
+    }
+
+    // return error if path was checked and found to be invalid
+    ret = valid ? Q_ERR_NOENT : Q_ERR_INVALID_PATH;
+
+fail:
+    FS_DPrintf("%s: %s: %s\n", __func__, normalized, Q_ErrorString(ret));
+    return ret;
+}
+
+// Finds the file in the search path.
+// Fills file_t and returns file length.
+// Used for streaming data out of either a pak file or a seperate file.
+static ssize_t open_file_read(file_t *file, const char *normalized, size_t namelen, qboolean unique)
+{
+    unsigned        hash;
+    ssize_t         ret;
+    qboolean        indexed;
+
+    FS_COUNT_READ;
+
+    hash = FS_HashPath(normalized, 0);
+
+    // paths with dot components can't be indexed, since directory
+    // listings skip dotfiles
+    indexed = fs_index->integer
+#ifndef _WIN32
+              && *normalized != '.' && !strstr(normalized, "/.")
+#endif
+              ;
+
+    if (indexed) {
+        check_dir_caches();
+        if (fs_lookup.stale) {
+            build_index();
+        }
+    } else if (Sys_Milliseconds() - fs_missing.cleartime >= INDEX_RECHECK_MSEC) {
+        flush_missing();
+    }
+
+    if (find_missing(file, normalized, namelen, hash)) {
+        return Q_ERR_NOENT;
+    }
+
+    if (indexed) {
+        ret = open_from_index(file, normalized, namelen, hash, unique);
+    } else {
+        ret = open_from_paths(file, normalized, namelen, hash, unique);
+    }
+
+    if (ret == Q_ERR_NOENT) {
+        add_missing(file, normalized, namelen, hash);
+    }
+
+    return ret;
+}
+
+// Normalizes quake path, expands symlinks
+static ssize_t expand_open_file_read(file_t *file, const char *name, qboolean unique)
+{
+    char        normalized[MAX_OSPATH];
+    ssize_t     ret;
+    size_t      namelen;
+
+// normalize path
+    namelen = FS_NormalizePathBuffer(normalized, name, MAX_OSPATH);
+    if (namelen >= MAX_OSPATH) {
+        return Q_ERR_NAMETOOLONG;
+    }
+
+// expand hard symlinks
+    if (expand_links(&fs_hard_links, normalized, &namelen) && namelen >= MAX_OSPATH) {
+        return Q_ERR_NAMETOOLONG;
+    }
+
+// reject empty paths
+    if (namelen == 0) {
+        return Q_ERR_NAMETOOSHORT;
+    }
+
+    ret = open_file_read(file, normalized, namelen, unique);
+    if (ret == Q_ERR_NOENT) {
+// expand soft symlinks
+        if (expand_links(&fs_soft_links, normalized, &namelen)) {
+            if (namelen >= MAX_OSPATH) {
+                return Q_ERR_NAMETOOLONG;
+            }
+            ret = open_file_read(file, normalized, namelen, unique);
+        }
+    }
+
+    return ret;
+}
+
+static ssize_t read_pak_file(file_t *file, void *buf, size_t len)
+{
+    size_t result;
+
+    if (len > file->rest_out) {
+        len = file->rest_out;
+    }
+    if (!len) {
+        return 0;
+    }
+
+    result = fread(buf, 1, len, file->fp);
+    if (result != len) {
+        file->error = FS_ERR_READ(file->fp);
+        if (!result) {
+            return file->error;
+        }
+    }
+
+    file->rest_out -= result;
+    return result;
+}
+
+static ssize_t read_phys_file(file_t *file, void *buf, size_t len)
+{
+    size_t result;
+
+    result = fread(buf, 1, len, file->fp);
+    if (result != len && ferror(file->fp)) {
+        file->error = Q_Errno();
+        if (!result) {
+            return file->error;
+        }
+    }
+
+    return result;
+}
+
+/*
+=================
+FS_Read
+=================
+*/
+ssize_t FS_Read(void *buf, size_t len, qhandle_t f)
+{
+    file_t *file = file_for_handle(f);
+
+    if (!file)
+        return Q_ERR_BADF;
+
+    if ((file->mode & FS_MODE_MASK) != FS_MODE_READ)
+        return Q_ERR_INVAL;
+
+    if (len > SSIZE_MAX)
+        return Q_ERR_INVAL;
+
+    // the async thread owns the file and its error indicator
+    if (file->async)
+        return len ? read_async(file, buf, len) : 0;
+
+    // can't continue after error
+    if (file->error)
+        return file->error;
+
+    if (len == 0)
+        return 0;
+
+    return read_file(file, buf, len);
+}
+
+static ssize_t read_file(file_t *file, void *buf, size_t len)
+{
+#if USE_ZLIB
+    int ret;
+#endif
+
+    switch (file->type) {
+    case FS_REAL:
+        return read_phys_file(file, buf, len);
+    case FS_PAK:
+        return read_pak_file(file, buf, len);
+#if USE_ZLIB
+    case FS_GZ:
+        ret = gzread(file->zfp, buf, len);
+        if (ret < 0) {
+            return Q_ERR_LIBRARY_ERROR;
+        }
+        return ret;
+    case FS_ZIP:
+        return read_zip_file(file, buf, len);
+#endif
+    default:
+        return Q_ERR_NOSYS;
+    }
+}
+
+ssize_t FS_ReadLine(qhandle_t f, char *buffer, size_t size)
+{
+    file_t *file = file_for_handle(f);
+    char *s;
+    size_t len;
+
+    if (!file)
+        return Q_ERR_BADF;
+
+    if ((file->mode & FS_MODE_MASK) != FS_MODE_READ)
+        return Q_ERR_INVAL;
+
+    if (file->type != FS_REAL || file->async)
+        return Q_ERR_NOSYS;
+
+    do {
+        s = fgets(buffer, size, file->fp);
+        if (!s) {
+            return ferror(file->fp) ? Q_Errno() : 0;
+        }
+        len = strlen(s);
+    } while (len < 2);
+
+    s[len - 1] = 0;
+    return len - 1;
+}
+
+void FS_Flush(qhandle_t f)
+{
+    file_t *file = file_for_handle(f);
+
+    if (!file)
+        return;
+
+    if (file->async) {
+        if (file->async->reading)
+            return;
+        drain_async(file);
+    }
+
+    switch (file->type) {
+    case FS_REAL:
+        fflush(file->fp);
+        break;
+#if USE_ZLIB
+    case FS_GZ:
+        gzflush(file->zfp, Z_SYNC_FLUSH);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+/*
+=================
+FS_Write
+=================
+*/
+ssize_t FS_Write(const void *buf, size_t len, qhandle_t f)
+{
+    file_t  *file = file_for_handle(f);
+    qerror_t ret;
+
+    if (!file)
+        return Q_ERR_BADF;
+
+    if ((file->mode & FS_MODE_MASK) == FS_MODE_READ)
+        return Q_ERR_INVAL;
+
+    // can't continue after error
+    if (file->error)
+        return file->error;
+
+    if (len > SSIZE_MAX)
+        return Q_ERR_INVAL;
+
+    if (len == 0)
+        return 0;
+
+    if (file->async)
+        return write_async(file, buf, len);
+
+    ret = write_file(file, buf, len);
+    if (ret == Q_ERR_NOSYS)
+        Com_Error(ERR_FATAL, "%s: bad file type", __func__);
+    if (ret) {
+        file->error = ret;
+        return ret;
+    }
+
+    return len;
+}
+
+/*
+============
+FS_FOpenFile
+============
+*/
+ssize_t FS_FOpenFile(const char *name, qhandle_t *f, unsigned mode)
+{
+    file_t *file;
+    qhandle_t handle;
+    ssize_t ret;
+
+    if (!name || !f) {
+        Com_Error(ERR_FATAL, "%s: NULL", __func__);
+    }
+
+    *f = 0;
+
+    if (!fs_searchpaths) {
+        return Q_ERR_AGAIN; // not yet initialized
+    }
+
+    // allocate new file handle
+    file = alloc_handle(&handle);
+    if (!file) {
+        return Q_ERR_MFILE;
+    }
+
+    file->mode = mode;
+
+    if ((mode & FS_MODE_MASK) == FS_MODE_READ) {
+        ret = expand_open_file_read(file, name, qtrue);
+    } else {
+        ret = open_file_write(file, name);
+    }
+
+    if (ret >= 0) {
+        *f = handle;
+    }
+
+    return ret;
+}
+
+// reading from outside of source directory is allowed, extension is optional
+static qhandle_t easy_open_read(char *buf, size_t size, unsigned mode,
+                                const char *dir, const char *name, const char *ext)
+{
+    ssize_t len;
+    qhandle_t f;
+
+    if (*name == '/') {
+        // full path is given, ignore directory and extension
+        len = Q_strlcpy(buf, name + 1, size);
+    } else {
+        // first try without extension
+        len = Q_concat(buf, size, dir, name, NULL);
+        if (len >= size) {
+            Q_PrintError("open", Q_ERR_NAMETOOLONG);
+            return 0;
+        }
+
+        // print normalized path in case of error
+        FS_NormalizePath(buf, buf);
+
+        len = FS_FOpenFile(buf, &f, mode);
+        if (f) {
+            return f; // succeeded
+        }
+        if (len != Q_ERR_NOENT) {
+            goto fail; // fatal error
+        }
+        if (!COM_CompareExtension(buf, ext)) {
+            goto fail; // name already has the extension
+        }
 
-            ret = open_from_disk(file, fullpath);
-            if (ret != Q_ERR_NOENT)
-                return ret;
+        // now try to append extension
+        len = Q_strlcat(buf, ext, size);
+    }
 
-#ifndef _WIN32
-            if (valid == PATH_MIXED_CASE) {
-                // convert to lower case and retry
-                FS_COUNT_STRLWR;
-                Q_strlwr(fullpath + strlen(search->filename) + 1);
-                ret = open_from_disk(file, fullpath);
-                if (ret != Q_ERR_NOENT)
-                    return ret;
-            }
-#endif
-        }
+    if (len >= size) {
+        Q_PrintError("open", Q_ERR_NAMETOOLONG);
+        return 0;
     }
 
-    // return error if path was checked and found to be invalid
-    ret = valid ? Q_ERR_NOENT : Q_ERR_INVALID_PATH;
+    len = FS_FOpenFile(buf, &f, mode);
+    if (f) {
+        return f;
+    }
 
 fail:
-    FS_DPrintf("%s: %s: %s\n", __func__, normalized, Q_ErrorString(ret));
-    return ret;
+    Com_Printf("Couldn't open %s: %s\n", buf, Q_ErrorString(len));
+    return 0;
 }
 
-// Normalizes quake path, expands symlinks
-static ssize_t expand_open_file_read(file_t *file, const char *name, qboolean unique)
+// writing to outside of destination directory is disallowed, extension is forced
+static qhandle_t easy_open_write(char *buf, size_t size, unsigned mode,
+                                 const char *dir, const char *name, const char *ext)
 {
-    char        normalized[MAX_OSPATH];
-    ssize_t     ret;
-    size_t      namelen;
+    char normalized[MAX_OSPATH];
+    ssize_t len;
+    qhandle_t f;
 
-// normalize path
-    namelen = FS_NormalizePathBuffer(normalized, name, MAX_OSPATH);
-    if (namelen >= MAX_OSPATH) {
-        return Q_ERR_NAMETOOLONG;
+    // make it impossible to escape the destination directory when writing files
+    len = FS_NormalizePathBuffer(normalized, name, sizeof(normalized));
+    if (len >= sizeof(normalized)) {
+        Q_PrintError("open", Q_ERR_NAMETOOLONG);
+        return 0;
     }
 
-// expand hard symlinks
-    if (expand_links(&fs_hard_links, normalized, &namelen) && namelen >= MAX_OSPATH) {
-        return Q_ERR_NAMETOOLONG;
+    // reject empty filenames
+    if (len == 0) {
+        Q_PrintError("open", Q_ERR_NAMETOOSHORT);
+        return 0;
     }
 
-// reject empty paths
-    if (namelen == 0) {
-        return Q_ERR_NAMETOOSHORT;
-    }
+    // replace any bad characters with underscores to make automatic commands happy
+    cleanup_path(normalized);
 
-    ret = open_file_read(file, normalized, namelen, unique);
-    if (ret == Q_ERR_NOENT) {
-// expand soft symlinks
-        if (expand_links(&fs_soft_links, normalized, &namelen)) {
-            if (namelen >= MAX_OSPATH) {
-                return Q_ERR_NAMETOOLONG;
-            }
-            ret = open_file_read(file, normalized, namelen, unique);
-        }
+    // don't append the extension if name already has it
+    if (!COM_CompareExtension(normalized, ext)) {
+        ext = (mode & FS_FLAG_GZIP) ? "" : NULL;
     }
 
-    return ret;
-}
-
-static ssize_t read_pak_file(file_t *file, void *buf, size_t len)
-{
-    size_t result;
-
-    if (len > file->rest_out) {
-        len = file->rest_out;
-    }
-    if (!len) {
+    len = Q_concat(buf, size, dir, normalized, ext,
+                   (mode & FS_FLAG_GZIP) ? ".gz" : NULL, NULL);
+    if (len >= size) {
+        Q_PrintError("open", Q_ERR_NAMETOOLONG);
         return 0;
     }
 
-    result = fread(buf, 1, len, file->fp);
-    if (result != len) {
-        file->error = FS_ERR_READ(file->fp);
-        if (!result) {
-            return file->error;
+    len = FS_FOpenFile(buf, &f, mode);
+    if (!f) {
+        goto fail1;
+    }
+
+    if (mode & FS_FLAG_GZIP) {
+        len = FS_FilterFile(f);
+        if (len) {
+            goto fail2;
         }
     }
 
-    file->rest_out -= result;
-    return result;
+    if (mode & FS_FLAG_ASYNC) {
+        open_async(file_for_handle(f), buf);
+    }
+
+    return f;
+
+fail2:
+    FS_FCloseFile(f);
+fail1:
+    Com_EPrintf("Couldn't open %s: %s\n", buf, Q_ErrorString(len));
+    return 0;
 }
 
-static ssize_t read_phys_file(file_t *file, void *buf, size_t len)
-{
-    size_t result;
+/*
+============
+FS_EasyOpenFile
 
-    result = fread(buf, 1, len, file->fp);
-    if (result != len && ferror(file->fp)) {
-        file->error = Q_Errno();
-        if (!result) {
-            return file->error;
-        }
+Helper function for various console commands. Concatenates
+the arguments, checks for path buffer overflow, and attempts
+to open the file, printing an error message in case of failure.
+============
+*/
+qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
+                          const char *dir, const char *name, const char *ext)
+{
+    if ((mode & FS_MODE_MASK) == FS_MODE_READ) {
+        return easy_open_read(buf, size, mode, dir, name, ext);
     }
 
-    return result;
+    return easy_open_write(buf, size, mode, dir, name, ext);
 }
 
+#if USE_ZLIB
+
 /*
-=================
-FS_Read
-=================
+=============================================================================
+
+PREFETCH
+
+Compressed pkz entries the client is about to register are inflated ahead
+of time by a pool of worker threads, in the order they were asked for, so
+that loading doesn't wait for inflate. The main thread resolves paths and
+allocates buffers, workers only read and inflate. Total size of buffers is
+bounded, more entries get buffers as finished ones are taken.
+
+=============================================================================
 */
-ssize_t FS_Read(void *buf, size_t len, qhandle_t f)
+
+#define PREFETCH_THREADS    2
+
+typedef enum {
+    PF_WAITING,     // no buffer yet
+    PF_QUEUED,
+    PF_BUSY,
+    PF_DONE
+} pfstate_t;
+
+typedef struct {
+    list_t      entry;
+    pfstate_t   state;
+    pack_t      *pack;      // referenced
+    packfile_t  *file;
+    byte        *data;
+    qerror_t    error;
+} prefetch_t;
+
+static struct {
+    qthread_t   *threads[PREFETCH_THREADS];
+    qmutex_t    *lock;
+    qcond_t     *work;      // signaled when entries are queued
+    qcond_t     *done;      // signaled when an entry is inflated
+    qboolean    quit;
+    list_t      jobs;       // in the order they were asked for
+    size_t      bytes;      // total size of allocated buffers
+    unsigned    num_jobs;
+
+    unsigned    hits;
+    unsigned    misses;
+} fs_prefetch;
+
+static cvar_t   *fs_prefetch_size;
+
+// runs on a worker thread
+static qerror_t inflate_prefetch(prefetch_t *job)
 {
-    file_t *file = file_for_handle(f);
-#if USE_ZLIB
-    int ret;
-#endif
+    byte        buf[0x4000];
+    z_stream    z;
+    FILE        *fp;
+    size_t      rest, len;
+    qerror_t    ret;
+    int         err;
 
-    if (!file)
-        return Q_ERR_BADF;
+    fp = fopen(job->pack->filename, "rb");
+    if (!fp) {
+        return Q_Errno();
+    }
 
-    if ((file->mode & FS_MODE_MASK) != FS_MODE_READ)
-        return Q_ERR_INVAL;
+    if (fseek(fp, (long)job->file->filepos, SEEK_SET) == -1) {
+        ret = Q_Errno();
+        fclose(fp);
+        return ret;
+    }
 
-    // can't continue after error
-    if (file->error)
-        return file->error;
+    // default allocators, the stream is short lived
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -MAX_WBITS) != Z_OK) {
+        fclose(fp);
+        return Q_ERR_INFLATE_FAILED;
+    }
 
-    if (len > SSIZE_MAX)
-        return Q_ERR_INVAL;
+    z.next_out = job->data;
+    z.avail_out = job->file->filelen;
+    rest = job->file->complen;
+    ret = Q_ERR_SUCCESS;
 
-    if (len == 0)
-        return 0;
+    while (z.avail_out) {
+        if (!z.avail_in) {
+            len = min(rest, sizeof(buf));
+            if (!len) {
+                ret = Q_ERR_UNEXPECTED_EOF;
+                break;
+            }
+            if (fread(buf, 1, len, fp) != len) {
+                ret = FS_ERR_READ(fp);
+                break;
+            }
+            z.next_in = buf;
+            z.avail_in = len;
+            rest -= len;
+        }
 
-    switch (file->type) {
-    case FS_REAL:
-        return read_phys_file(file, buf, len);
-    case FS_PAK:
-        return read_pak_file(file, buf, len);
-#if USE_ZLIB
-    case FS_GZ:
-        ret = gzread(file->zfp, buf, len);
-        if (ret < 0) {
-            return Q_ERR_LIBRARY_ERROR;
+        err = inflate(&z, Z_SYNC_FLUSH);
+        if (err == Z_STREAM_END) {
+            break;
         }
-        return ret;
-    case FS_ZIP:
-        return read_zip_file(file, buf, len);
-#endif
-    default:
-        return Q_ERR_NOSYS;
+        if (err != Z_OK) {
+            ret = Q_ERR_INFLATE_FAILED;
+            break;
+        }
+    }
+
+    if (!ret && z.total_out != job->file->filelen) {
+        ret = Q_ERR_UNEXPECTED_EOF;
     }
+
+    inflateEnd(&z);
+    fclose(fp);
+    return ret;
 }
 
-ssize_t FS_ReadLine(qhandle_t f, char *buffer, size_t size)
+static void prefetch_thread(void *arg)
 {
-    file_t *file = file_for_handle(f);
-    char *s;
-    size_t len;
+    prefetch_t *job;
+    qerror_t ret;
 
-    if (!file)
-        return Q_ERR_BADF;
+    Sys_LockMutex(fs_prefetch.lock);
+    while (1) {
+        LIST_FOR_EACH(prefetch_t, job, &fs_prefetch.jobs, entry) {
+            if (job->state == PF_QUEUED) {
+                goto found;
+            }
+        }
 
-    if ((file->mode & FS_MODE_MASK) != FS_MODE_READ)
-        return Q_ERR_INVAL;
+        if (fs_prefetch.quit) {
+            break;
+        }
+        Sys_WaitCond(fs_prefetch.work, fs_prefetch.lock);
+        continue;
 
-    if (file->type != FS_REAL)
-        return Q_ERR_NOSYS;
+found:
+        job->state = PF_BUSY;
+        Sys_UnlockMutex(fs_prefetch.lock);
 
-    do {
-        s = fgets(buffer, size, file->fp);
-        if (!s) {
-            return ferror(file->fp) ? Q_Errno() : 0;
-        }
-        len = strlen(s);
-    } while (len < 2);
+        ret = inflate_prefetch(job);
 
-    s[len - 1] = 0;
-    return len - 1;
+        Sys_LockMutex(fs_prefetch.lock);
+        job->error = ret;
+        job->state = PF_DONE;
+        Sys_BroadcastCond(fs_prefetch.done);
+    }
+    Sys_UnlockMutex(fs_prefetch.lock);
 }
 
-void FS_Flush(qhandle_t f)
+// gives buffers to waiting entries while under the limit.
+// called with lock held.
+static void fill_prefetch(void)
 {
-    file_t *file = file_for_handle(f);
+    size_t limit = (size_t)Cvar_ClampInteger(fs_prefetch_size, 0, 1048576) << 10;
+    prefetch_t *job;
+    qboolean queued = qfalse;
 
-    if (!file)
-        return;
+    LIST_FOR_EACH(prefetch_t, job, &fs_prefetch.jobs, entry) {
+        if (job->state != PF_WAITING) {
+            continue;
+        }
+        if (fs_prefetch.bytes + job->file->filelen > limit) {
+            break;
+        }
+        job->data = FS_Malloc(job->file->filelen + 1);
+        job->state = PF_QUEUED;
+        fs_prefetch.bytes += job->file->filelen;
+        queued = qtrue;
+    }
 
-    switch (file->type) {
-    case FS_REAL:
-        fflush(file->fp);
-        break;
-#if USE_ZLIB
-    case FS_GZ:
-        gzflush(file->zfp, Z_SYNC_FLUSH);
-        break;
-#endif
-    default:
-        break;
+    if (queued) {
+        Sys_BroadcastCond(fs_prefetch.work);
     }
 }
 
-/*
-=================
-FS_Write
-=================
+// called with lock held, entry must not be busy
+static void free_prefetch(prefetch_t *job)
+{
+    List_Remove(&job->entry);
+    if (job->data) {
+        Z_Free(job->data);
+        fs_prefetch.bytes -= job->file->filelen;
+    }
+    pack_put(job->pack);
+    Z_Free(job);
+    fs_prefetch.num_jobs--;
+}
+
+/*
+================
+FS_Prefetch
+
+Starts inflating the file in background if it's compressed in a pkz.
+Must be followed by FS_FlushPrefetch once loading is done.
+================
 */
-ssize_t FS_Write(const void *buf, size_t len, qhandle_t f)
+void FS_Prefetch(const char *path)
 {
-    file_t  *file = file_for_handle(f);
-    size_t  result;
+    prefetch_t *job;
+    file_t *file;
+    qhandle_t f;
+    ssize_t len;
+    int i;
 
-    if (!file)
-        return Q_ERR_BADF;
+    if (!fs_searchpaths || !fs_prefetch_size->integer) {
+        return;
+    }
 
-    if ((file->mode & FS_MODE_MASK) == FS_MODE_READ)
-        return Q_ERR_INVAL;
+    file = alloc_handle(&f);
+    if (!file) {
+        return;
+    }
 
-    // can't continue after error
-    if (file->error)
-        return file->error;
+    file->mode = FS_MODE_READ;
 
-    if (len > SSIZE_MAX)
-        return Q_ERR_INVAL;
+    len = expand_open_file_read(file, path, qfalse);
+    if (len < 0) {
+        return;
+    }
 
-    if (len == 0)
-        return 0;
+    if (file->type != FS_ZIP || !len || len > MAX_LOADFILE) {
+        goto done;
+    }
 
-    switch (file->type) {
-    case FS_REAL:
-        result = fwrite(buf, 1, len, file->fp);
-        if (result != len) {
-            file->error = FS_ERR_WRITE(file->fp);
-            return file->error;
+    if (!fs_prefetch.lock) {
+        List_Init(&fs_prefetch.jobs);
+        fs_prefetch.lock = Sys_CreateMutex();
+        fs_prefetch.work = Sys_CreateCond();
+        fs_prefetch.done = Sys_CreateCond();
+        fs_prefetch.quit = qfalse;
+        for (i = 0; i < PREFETCH_THREADS; i++) {
+            fs_prefetch.threads[i] = Sys_CreateThread(prefetch_thread, NULL);
         }
-        break;
-#if USE_ZLIB
-    case FS_GZ:
-        if (gzwrite(file->zfp, buf, len) == 0) {
-            file->error = Q_ERR_LIBRARY_ERROR;
-            return file->error;
+    }
+
+    Sys_LockMutex(fs_prefetch.lock);
+
+    // already asked for?
+    LIST_FOR_EACH(prefetch_t, job, &fs_prefetch.jobs, entry) {
+        if (job->file == file->entry) {
+            goto unlock;
         }
-        break;
-#endif
-    default:
-        Com_Error(ERR_FATAL, "%s: bad file type", __func__);
     }
 
-    return len;
+    job = FS_Mallocz(sizeof(*job));
+    job->state = PF_WAITING;
+    job->pack = pack_get(file->pack);
+    job->file = file->entry;
+    List_Append(&fs_prefetch.jobs, &job->entry);
+    fs_prefetch.num_jobs++;
+
+    fill_prefetch();
+
+unlock:
+    Sys_UnlockMutex(fs_prefetch.lock);
+done:
+    FS_FCloseFile(f);
 }
 
-/*
-============
-FS_FOpenFile
-============
-*/
-ssize_t FS_FOpenFile(const char *name, qhandle_t *f, unsigned mode)
+// returns inflated contents of entry opened in file, if it was prefetched
+static byte *take_prefetch(file_t *file)
 {
-    file_t *file;
-    qhandle_t handle;
-    ssize_t ret;
+    prefetch_t *job;
+    byte *data = NULL;
 
-    if (!name || !f) {
-        Com_Error(ERR_FATAL, "%s: NULL", __func__);
+    if (!fs_prefetch.num_jobs) {
+        return NULL;
     }
 
-    *f = 0;
+    Sys_LockMutex(fs_prefetch.lock);
 
-    if (!fs_searchpaths) {
-        return Q_ERR_AGAIN; // not yet initialized
+    LIST_FOR_EACH(prefetch_t, job, &fs_prefetch.jobs, entry) {
+        if (job->file == file->entry) {
+            goto found;
+        }
     }
 
-    // allocate new file handle
-    file = alloc_handle(&handle);
-    if (!file) {
-        return Q_ERR_MFILE;
+    Sys_UnlockMutex(fs_prefetch.lock);
+    return NULL;
+
+found:
+    // workers haven't got to it yet, do it here
+    if (job->state == PF_QUEUED) {
+        job->state = PF_BUSY;
+        Sys_UnlockMutex(fs_prefetch.lock);
+        job->error = inflate_prefetch(job);
+        Sys_LockMutex(fs_prefetch.lock);
+        job->state = PF_DONE;
     }
 
-    file->mode = mode;
+    while (job->state == PF_BUSY) {
+        Sys_WaitCond(fs_prefetch.done, fs_prefetch.lock);
+    }
 
-    if ((mode & FS_MODE_MASK) == FS_MODE_READ) {
-        ret = expand_open_file_read(file, name, qtrue);
+    if (job->state == PF_DONE && !job->error) {
+        data = job->data;
+        data[job->file->filelen] = 0;
+        job->data = NULL;
+        fs_prefetch.bytes -= job->file->filelen;
+        fs_prefetch.hits++;
     } else {
-        ret = open_file_write(file, name);
+        fs_prefetch.misses++;
     }
 
-    if (ret >= 0) {
-        *f = handle;
-    }
+    free_prefetch(job);
+    fill_prefetch();
 
-    return ret;
+    Sys_UnlockMutex(fs_prefetch.lock);
+    return data;
 }
 
-// reading from outside of source directory is allowed, extension is optional
-static qhandle_t easy_open_read(char *buf, size_t size, unsigned mode,
-                                const char *dir, const char *name, const char *ext)
+/*
+================
+FS_FlushPrefetch
+
+Drops everything prefetched that wasn't used.
+================
+*/
+void FS_FlushPrefetch(void)
 {
-    ssize_t len;
-    qhandle_t f;
+    prefetch_t *job, *next;
 
-    if (*name == '/') {
-        // full path is given, ignore directory and extension
-        len = Q_strlcpy(buf, name + 1, size);
-    } else {
-        // first try without extension
-        len = Q_concat(buf, size, dir, name, NULL);
-        if (len >= size) {
-            Q_PrintError("open", Q_ERR_NAMETOOLONG);
-            return 0;
-        }
+    if (!fs_prefetch.num_jobs) {
+        return;
+    }
 
-        // print normalized path in case of error
-        FS_NormalizePath(buf, buf);
+    Sys_LockMutex(fs_prefetch.lock);
 
-        len = FS_FOpenFile(buf, &f, mode);
-        if (f) {
-            return f; // succeeded
-        }
-        if (len != Q_ERR_NOENT) {
-            goto fail; // fatal error
-        }
-        if (!COM_CompareExtension(buf, ext)) {
-            goto fail; // name already has the extension
+    FS_DPrintf("%s: %u used, %u missed, %u unused\n", __func__,
+               fs_prefetch.hits, fs_prefetch.misses, fs_prefetch.num_jobs);
+
+    // keep workers from starting anything new
+    LIST_FOR_EACH(prefetch_t, job, &fs_prefetch.jobs, entry) {
+        if (job->state == PF_QUEUED) {
+            job->state = PF_DONE;
         }
+    }
 
-        // now try to append extension
-        len = Q_strlcat(buf, ext, size);
+    LIST_FOR_EACH_SAFE(prefetch_t, job, next, &fs_prefetch.jobs, entry) {
+        while (job->state == PF_BUSY) {
+            Sys_WaitCond(fs_prefetch.done, fs_prefetch.lock);
+        }
+        free_prefetch(job);
     }
 
-    if (len >= size) {
-        Q_PrintError("open", Q_ERR_NAMETOOLONG);
-        return 0;
+    fs_prefetch.hits = fs_prefetch.misses = 0;
+
+    Sys_UnlockMutex(fs_prefetch.lock);
+}
+
+static void shutdown_prefetch(void)
+{
+    int i;
+
+    if (!fs_prefetch.lock) {
+        return;
     }
 
-    len = FS_FOpenFile(buf, &f, mode);
-    if (f) {
-        return f;
+    FS_FlushPrefetch();
+
+    Sys_LockMutex(fs_prefetch.lock);
+    fs_prefetch.quit = qtrue;
+    Sys_BroadcastCond(fs_prefetch.work);
+    Sys_UnlockMutex(fs_prefetch.lock);
+
+    for (i = 0; i < PREFETCH_THREADS; i++) {
+        if (fs_prefetch.threads[i]) {
+            Sys_JoinThread(fs_prefetch.threads[i]);
+            fs_prefetch.threads[i] = NULL;
+        }
     }
 
-fail:
-    Com_Printf("Couldn't open %s: %s\n", buf, Q_ErrorString(len));
-    return 0;
+    Sys_DestroyCond(fs_prefetch.done);
+    Sys_DestroyCond(fs_prefetch.work);
+    Sys_DestroyMutex(fs_prefetch.lock);
+    fs_prefetch.lock = NULL;
 }
 
-// writing to outside of destination directory is disallowed, extension is forced
-static qhandle_t easy_open_write(char *buf, size_t size, unsigned mode,
-                                 const char *dir, const char *name, const char *ext)
+#endif // USE_ZLIB
+
+/*
+============
+FS_LoadFile
+
+opens non-unique file handle as an optimization
+a NULL buffer will just return the file length without loading
+============
+*/
+ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
 {
-    char normalized[MAX_OSPATH];
-    ssize_t len;
+    file_t *file;
     qhandle_t f;
+    byte *buf;
+    ssize_t len, read;
 
-    // make it impossible to escape the destination directory when writing files
-    len = FS_NormalizePathBuffer(normalized, name, sizeof(normalized));
-    if (len >= sizeof(normalized)) {
-        Q_PrintError("open", Q_ERR_NAMETOOLONG);
-        return 0;
+    if (!path) {
+        Com_Error(ERR_FATAL, "%s: NULL", __func__);
     }
 
-    // reject empty filenames
-    if (len == 0) {
-        Q_PrintError("open", Q_ERR_NAMETOOSHORT);
-        return 0;
+    if (buffer) {
+        *buffer = NULL;
     }
 
-    // replace any bad characters with underscores to make automatic commands happy
-    cleanup_path(normalized);
+    if (!fs_searchpaths) {
+        return Q_ERR_AGAIN; // not yet initialized
+    }
 
-    // don't append the extension if name already has it
-    if (!COM_CompareExtension(normalized, ext)) {
-        ext = (mode & FS_FLAG_GZIP) ? "" : NULL;
+    // allocate new file handle
+    file = alloc_handle(&f);
+    if (!file) {
+        return Q_ERR_MFILE;
     }
 
-    len = Q_concat(buf, size, dir, normalized, ext,
-                   (mode & FS_FLAG_GZIP) ? ".gz" : NULL, NULL);
-    if (len >= size) {
-        Q_PrintError("open", Q_ERR_NAMETOOLONG);
-        return 0;
+    file->mode = (flags & ~FS_MODE_MASK) | FS_MODE_READ;
+
+    // look for it in the filesystem or pack files
+    len = expand_open_file_read(file, path, qfalse);
+    if (len < 0) {
+        return len;
     }
 
-    len = FS_FOpenFile(buf, &f, mode);
-    if (!f) {
-        goto fail1;
+    // NULL buffer just checks for file existence
+    if (!buffer) {
+        goto done;
     }
 
-    if (mode & FS_FLAG_GZIP) {
-        len = FS_FilterFile(f);
-        if (len) {
-            goto fail2;
+    // sanity check file size
+    if (len > MAX_LOADFILE) {
+        len = Q_ERR_FBIG;
+        goto done;
+    }
+
+#if USE_ZLIB
+    // already inflated in background?
+    if (file->type == FS_ZIP && (buf = take_prefetch(file))) {
+        if (tag != TAG_FILESYSTEM) {
+            *buffer = Z_TagMalloc(len + 1, tag);
+            memcpy(*buffer, buf, len + 1);
+            Z_Free(buf);
+        } else {
+            *buffer = buf;
         }
+        goto done;
     }
+#endif
 
-    return f;
+    // allocate chunk of memory, +1 for NUL
+    buf = Z_TagMalloc(len + 1, tag);
 
-fail2:
+    // read entire file
+    read = FS_Read(buf, len, f);
+    if (read != len) {
+        len = read < 0 ? read : Q_ERR_UNEXPECTED_EOF;
+        Z_Free(buf);
+        goto done;
+    }
+
+    *buffer = buf;
+    buf[len] = 0;
+
+done:
     FS_FCloseFile(f);
-fail1:
-    Com_EPrintf("Couldn't open %s: %s\n", buf, Q_ErrorString(len));
-    return 0;
+    return len;
 }
 
-/*
-============
-FS_EasyOpenFile
-
-Helper function for various console commands. Concatenates
-the arguments, checks for path buffer overflow, and attempts
-to open the file, printing an error message in case of failure.
-============
-*/
-qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
-                          const char *dir, const char *name, const char *ext)
+#ifndef _WIN32
+// maps the whole pack once, so that entries can be handed out without
+// a system call each. gives up for good if that fails, e.g. for lack of
+// address space.
+static qboolean map_pack(pack_t *pack)
 {
-    if ((mode & FS_MODE_MASK) == FS_MODE_READ) {
-        return easy_open_read(buf, size, mode, dir, name, ext);
+    Q_STATBUF st;
+    void *base;
+
+    if (pack->mapbase) {
+        return qtrue;
+    }
+
+    if (pack->mapfailed) {
+        return qfalse;
+    }
+
+    pack->mapfailed = qtrue;
+
+    if (os_fstat(os_fileno(pack->fp), &st) == -1 || st.st_size <= 0) {
+        return qfalse;
     }
 
-    return easy_open_write(buf, size, mode, dir, name, ext);
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, os_fileno(pack->fp), 0);
+    if (base == MAP_FAILED) {
+        FS_DPrintf("%s: %s: %s\n", __func__, pack->filename, strerror(errno));
+        return qfalse;
+    }
+
+    pack->mapbase = base;
+    pack->maplen = st.st_size;
+    pack->mapfailed = qfalse;
+    return qtrue;
 }
+#endif
 
 /*
-============
-FS_LoadFile
-
-opens non-unique file handle as an optimization
-a NULL buffer will just return the file length without loading
-============
+================
+FS_MapFile
+================
 */
-ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
+ssize_t FS_MapFile(const char *path, fsmap_t *map)
 {
     file_t *file;
     qhandle_t f;
-    byte *buf;
     ssize_t len, read;
+#ifndef _WIN32
+    size_t pos, ofs;
+    void *base;
+#endif
 
-    if (!path) {
+    if (!path || !map) {
         Com_Error(ERR_FATAL, "%s: NULL", __func__);
     }
 
-    if (buffer) {
-        *buffer = NULL;
-    }
+    memset(map, 0, sizeof(*map));
 
     if (!fs_searchpaths) {
         return Q_ERR_AGAIN; // not yet initialized
     }
 
-    // allocate new file handle
     file = alloc_handle(&f);
     if (!file) {
         return Q_ERR_MFILE;
     }
 
-    file->mode = (flags & ~FS_MODE_MASK) | FS_MODE_READ;
+    file->mode = FS_MODE_READ;
 
-    // look for it in the filesystem or pack files
     len = expand_open_file_read(file, path, qfalse);
     if (len < 0) {
         return len;
     }
 
-    // NULL buffer just checks for file existence
-    if (!buffer) {
+    if (len > MAX_LOADFILE) {
+        len = Q_ERR_FBIG;
         goto done;
     }
 
-    // sanity check file size
-    if (len > MAX_LOADFILE) {
-        len = Q_ERR_FBIG;
+#ifndef _WIN32
+    // stored pak entries point straight into the mapped pack, which is
+    // referenced until the file is unmapped
+    if (len && file->type == FS_PAK && map_pack(file->pack) &&
+        file->entry->filepos + len <= file->pack->maplen) {
+        map->data = (byte *)file->pack->mapbase + file->entry->filepos;
+        map->len = len;
+        map->pack = pack_get(file->pack);
         goto done;
     }
 
-    // allocate chunk of memory, +1 for NUL
-    buf = Z_TagMalloc(len + 1, tag);
+    // plain files and anything else stored can be mapped at their offset
+    if (len && (file->type == FS_REAL || file->type == FS_PAK)) {
+        pos = file->type == FS_PAK ? file->entry->filepos : 0;
+        ofs = pos & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+        base = mmap(NULL, len + pos - ofs, PROT_READ, MAP_PRIVATE,
+                    os_fileno(file->fp), ofs);
+        if (base != MAP_FAILED) {
+            map->base = base;
+            map->maplen = len + pos - ofs;
+            map->data = (byte *)base + pos - ofs;
+            map->len = len;
+            goto done;
+        }
+        FS_DPrintf("%s: %s: mmap failed, loading instead\n", __func__, path);
+    }
+#endif
 
-    // read entire file
-    read = FS_Read(buf, len, f);
+#if USE_ZLIB
+    if (file->type == FS_ZIP && (map->data = take_prefetch(file))) {
+        map->len = len;
+        goto done;
+    }
+#endif
+
+    map->data = FS_Malloc(len + 1);
+    read = FS_Read(map->data, len, f);
     if (read != len) {
         len = read < 0 ? read : Q_ERR_UNEXPECTED_EOF;
-        Z_Free(buf);
+        Z_Free(map->data);
+        map->data = NULL;
         goto done;
     }
-
-    *buffer = buf;
-    buf[len] = 0;
+    map->len = len;
 
 done:
     FS_FCloseFile(f);
     return len;
 }
 
+void FS_UnmapFile(fsmap_t *map)
+{
+#ifndef _WIN32
+    if (map->pack) {
+        pack_put(map->pack);
+    } else if (map->base) {
+        munmap(map->base, map->maplen);
+    } else
+#endif
+    {
+        Z_Free(map->data);
+    }
+
+    memset(map, 0, sizeof(*map));
+}
+
 /*
 ================
 FS_WriteFile
@@ -1949,6 +3735,8 @@ qerror_t FS_RenameFile(const char *from, const char *to)
     if (rename(frompath, topath))
         return Q_Errno();
 
+    FS_InvalidateIndex();
+
     return Q_ERR_SUCCESS;
 }
 
@@ -1994,6 +3782,11 @@ static void pack_put(pack_t *pack)
     }
     if (!--pack->refcount) {
         FS_DPrintf("Freeing packfile %s\n", pack->filename);
+#ifndef _WIN32
+        if (pack->mapbase) {
+            munmap(pack->mapbase, pack->maplen);
+        }
+#endif
         fclose(pack->fp);
         Z_Free(pack);
     }
@@ -2017,6 +3810,13 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     pack->type = type;
     pack->refcount = 0;
     pack->fp = fp;
+    pack->filesize = 0;
+    pack->mtime = 0;
+#ifndef _WIN32
+    pack->mapbase = NULL;
+    pack->maplen = 0;
+    pack->mapfailed = qfalse;
+#endif
     pack->num_files = num_files;
     pack->hash_size = hash_size;
     pack->files = (packfile_t *)(pack + 1);
@@ -2041,6 +3841,434 @@ static void pack_hash_file(pack_t *pack, packfile_t *file)
     pack->file_hash[hash] = file;
 }
 
+/*
+============================================================================
+
+PACK CACHE
+
+Directories of all loaded packs are saved into a single file in the
+writable root directory, so that subsequent startups and restarts don't
+need to parse every pak and pkz again. Packs are identified by path, size
+and modification time. The cache is mapped while search paths are being
+set up, and is rewritten afterwards if any pack was not found in it.
+
+All numbers are in host byte order; a cache from a different machine
+simply fails to validate and is rebuilt.
+
+============================================================================
+*/
+
+#define PAKCACHE_IDENT      MakeRawLong('P','K','C','1')
+#define PAKCACHE_VERSION    1
+#define PAKCACHE_NAME       "pakcache.bin"
+
+typedef struct {
+    uint32_t    ident;
+    uint32_t    version;
+    uint32_t    num_packs;
+    uint32_t    filelen;        // of the whole cache
+    uint32_t    checksum;       // of everything after the header
+    uint32_t    pad;
+} pchheader_t;
+
+typedef struct {
+    uint32_t    reclen;         // of the whole record, multiple of 8
+    uint32_t    type;
+    uint64_t    filesize;
+    int64_t     mtime;
+    uint32_t    num_files;
+    uint32_t    names_len;
+    uint32_t    path_len;       // not including trailing NUL
+    uint32_t    pad;
+    // followed by num_files pchfile_t, path and names
+} pchrecord_t;
+
+typedef struct {
+    uint32_t    filepos;
+    uint32_t    filelen;
+    uint32_t    complen;
+    uint16_t    compmtd;
+    uint16_t    coherent;       // filepos already points past local header
+} pchfile_t;
+
+static struct {
+    qboolean    loaded;     // tried to load this setup
+    byte        *data;
+    size_t      mapsize;
+    size_t      size;       // zero if data failed to validate
+    size_t      next;       // offset of record to look at first
+    unsigned    hits;
+    unsigned    misses;
+} fs_pakcache_state;
+
+static size_t pakcache_path(char *buf, size_t size)
+{
+    const char *root = sys_homedir->string[0] ?
+        sys_homedir->string : sys_basedir->string;
+
+    return Q_concat(buf, size, root, "/" PAKCACHE_NAME, NULL);
+}
+
+// basic sanity check of the whole cache, records are checked when used
+static qboolean validate_pakcache(const byte *data, size_t size)
+{
+    const pchheader_t *header = (const pchheader_t *)data;
+    const pchrecord_t *rec;
+    size_t ofs;
+    unsigned i;
+
+    if (size < sizeof(*header))
+        return qfalse;
+    if (header->ident != PAKCACHE_IDENT || header->version != PAKCACHE_VERSION)
+        return qfalse;
+    if (header->filelen != size)
+        return qfalse;
+    if (header->checksum != Com_BlockChecksum((byte *)data + sizeof(*header),
+                                              size - sizeof(*header)))
+        return qfalse;
+
+    ofs = sizeof(*header);
+    for (i = 0; i < header->num_packs; i++) {
+        if (size - ofs < sizeof(*rec))
+            return qfalse;
+        rec = (const pchrecord_t *)(data + ofs);
+        if (rec->reclen < sizeof(*rec) || rec->reclen > size - ofs || rec->reclen & 7)
+            return qfalse;
+        if (rec->num_files > (rec->reclen - sizeof(*rec)) / sizeof(pchfile_t))
+            return qfalse;
+        if (rec->path_len > MAX_OSPATH || rec->names_len > rec->reclen)
+            return qfalse;
+        if (sizeof(*rec) + rec->num_files * sizeof(pchfile_t) +
+            rec->path_len + 1 + rec->names_len > rec->reclen)
+            return qfalse;
+        ofs += rec->reclen;
+    }
+
+    return ofs == size;
+}
+
+static void open_pakcache(void)
+{
+    char path[MAX_OSPATH];
+    file_info_t info;
+    byte *data;
+    FILE *fp;
+
+    fs_pakcache_state.loaded = qtrue;
+
+    if (!fs_pakcache->integer)
+        return;
+    if (pakcache_path(path, sizeof(path)) >= sizeof(path))
+        return;
+
+    fp = fopen(path, "rb");
+    if (!fp)
+        return;
+
+    if (get_fp_info(fp, &info) || info.size < sizeof(pchheader_t) || info.size > INT_MAX)
+        goto fail;
+
+#ifdef _WIN32
+    data = FS_Malloc(info.size);
+    if (fread(data, 1, info.size, fp) != info.size) {
+        Z_Free(data);
+        goto fail;
+    }
+#else
+    data = mmap(NULL, info.size, PROT_READ, MAP_PRIVATE, os_fileno(fp), 0);
+    if (data == MAP_FAILED)
+        goto fail;
+#endif
+
+    fs_pakcache_state.data = data;
+    fs_pakcache_state.mapsize = info.size;
+    fs_pakcache_state.size = info.size;
+    fs_pakcache_state.next = sizeof(pchheader_t);
+
+    if (!validate_pakcache(data, info.size)) {
+        FS_DPrintf("%s: %s is invalid\n", __func__, path);
+        fs_pakcache_state.size = 0;
+    }
+
+fail:
+    fclose(fp);
+}
+
+static void free_pakcache(void)
+{
+    if (fs_pakcache_state.data) {
+#ifdef _WIN32
+        Z_Free(fs_pakcache_state.data);
+#else
+        munmap(fs_pakcache_state.data, fs_pakcache_state.mapsize);
+#endif
+    }
+    memset(&fs_pakcache_state, 0, sizeof(fs_pakcache_state));
+}
+
+static const pchrecord_t *find_pakcache(const char *packfile, filetype_t type,
+                                        const file_info_t *info)
+{
+    const pchheader_t *header;
+    const pchrecord_t *rec;
+    size_t ofs, len = strlen(packfile);
+    unsigned i;
+
+    if (!fs_pakcache_state.loaded)
+        open_pakcache();
+
+    if (!fs_pakcache_state.size)
+        return NULL;
+
+    // packs are usually loaded in the same order they were saved
+    header = (const pchheader_t *)fs_pakcache_state.data;
+    ofs = fs_pakcache_state.next;
+    for (i = 0; i < header->num_packs; i++) {
+        if (ofs >= fs_pakcache_state.size)
+            ofs = sizeof(*header);
+        rec = (const pchrecord_t *)(fs_pakcache_state.data + ofs);
+        ofs += rec->reclen;
+
+        if (rec->path_len != len)
+            continue;
+        if (memcmp((const char *)rec + sizeof(*rec) +
+                   rec->num_files * sizeof(pchfile_t), packfile, len))
+            continue;
+
+        fs_pakcache_state.next = ofs;
+        if (rec->type != type || rec->filesize != info->size ||
+            rec->mtime != (int64_t)info->mtime)
+            return NULL;
+        return rec;
+    }
+
+    return NULL;
+}
+
+// builds the pack from cached directory, returns NULL if cache doesn't match
+static pack_t *load_pakcache(FILE *fp, filetype_t type, const char *packfile)
+{
+    const pchrecord_t *rec;
+    const pchfile_t *cfile;
+    const char *names, *end, *nul;
+    file_info_t info;
+    packfile_t *file;
+    pack_t *pack;
+    char *name;
+    size_t len, stored;
+    unsigned i;
+
+    if (!fs_pakcache->integer)
+        return NULL;
+    if (get_fp_info(fp, &info))
+        return NULL;
+
+    rec = find_pakcache(packfile, type, &info);
+    if (!rec || !rec->num_files) {
+        fs_pakcache_state.misses++;
+        return NULL;
+    }
+
+    cfile = (const pchfile_t *)(rec + 1);
+    names = (const char *)(cfile + rec->num_files) + rec->path_len + 1;
+    end = names + rec->names_len;
+
+    pack = pack_alloc(fp, type, packfile, rec->num_files, rec->names_len);
+    pack->filesize = info.size;
+    pack->mtime = info.mtime;
+
+    file = pack->files;
+    name = pack->names;
+    for (i = 0; i < rec->num_files; i++, cfile++, file++) {
+        nul = memchr(names, 0, end - names);
+        if (!nul)
+            goto fail;
+        len = nul - names;
+        stored = type == FS_ZIP ? cfile->complen : cfile->filelen;
+        if (len >= MAX_QPATH || stored > info.size || cfile->filepos > info.size - stored)
+            goto fail;
+
+        file->name = memcpy(name, names, len + 1);
+        name += len + 1;
+        names += len + 1;
+
+        file->filepos = cfile->filepos;
+        file->filelen = cfile->filelen;
+#if USE_ZLIB
+        file->complen = cfile->complen;
+        file->compmtd = cfile->compmtd;
+        file->coherent = type == FS_PAK || cfile->coherent;
+        if (type == FS_ZIP && cfile->compmtd != 0 && cfile->compmtd != Z_DEFLATED)
+            goto fail;
+#endif
+
+        pack_hash_file(pack, file);
+    }
+
+    fs_pakcache_state.hits++;
+    FS_DPrintf("%s: %u files from cache\n", packfile, pack->num_files);
+    return pack;
+
+fail:
+    FS_DPrintf("%s: bad cache record for %s\n", __func__, packfile);
+    Z_Free(pack);
+    fs_pakcache_state.misses++;
+    return NULL;
+}
+
+// remembers identity of a freshly parsed pack for write_pakcache
+static void set_pack_info(pack_t *pack)
+{
+    file_info_t info;
+
+    if (!get_fp_info(pack->fp, &info)) {
+        pack->filesize = info.size;
+        pack->mtime = info.mtime;
+    }
+}
+
+static size_t pakcache_reclen(const pack_t *pack)
+{
+    size_t len;
+    unsigned i;
+
+    len = sizeof(pchrecord_t) + pack->num_files * sizeof(pchfile_t) +
+          strlen(pack->filename) + 1;
+    for (i = 0; i < pack->num_files; i++)
+        len += pack->files[i].namelen + 1;
+
+    return (len + 7) & ~7;
+}
+
+static byte *write_pakrecord(byte *data, const pack_t *pack)
+{
+    pchrecord_t *rec = (pchrecord_t *)data;
+    pchfile_t *cfile = (pchfile_t *)(rec + 1);
+    const packfile_t *file;
+    char *name;
+    unsigned i;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->reclen = pakcache_reclen(pack);
+    rec->type = pack->type;
+    rec->filesize = pack->filesize;
+    rec->mtime = pack->mtime;
+    rec->num_files = pack->num_files;
+    rec->path_len = strlen(pack->filename);
+
+    for (i = 0, file = pack->files; i < pack->num_files; i++, file++, cfile++) {
+        cfile->filepos = file->filepos;
+        cfile->filelen = file->filelen;
+#if USE_ZLIB
+        cfile->complen = file->complen;
+        cfile->compmtd = file->compmtd;
+        cfile->coherent = file->coherent;
+#else
+        cfile->complen = file->filelen;
+        cfile->compmtd = 0;
+        cfile->coherent = 1;
+#endif
+    }
+
+    name = (char *)cfile;
+    memcpy(name, pack->filename, rec->path_len + 1);
+    name += rec->path_len + 1;
+
+    for (i = 0, file = pack->files; i < pack->num_files; i++, file++) {
+        memcpy(name, file->name, file->namelen + 1);
+        name += file->namelen + 1;
+        rec->names_len += file->namelen + 1;
+    }
+
+    // zero the padding
+    memset(name, 0, data + rec->reclen - (byte *)name);
+    return data + rec->reclen;
+}
+
+static void write_pakcache(void)
+{
+    char path[MAX_OSPATH], temp[MAX_OSPATH];
+    searchpath_t *search;
+    pchheader_t *header;
+    byte *data, *p;
+    size_t total;
+    FILE *fp;
+    int ret;
+
+    if (pakcache_path(path, sizeof(path)) >= sizeof(path))
+        return;
+    if (Q_concat(temp, sizeof(temp), path, ".tmp", NULL) >= sizeof(temp))
+        return;
+
+    total = sizeof(*header);
+    for (search = fs_searchpaths; search; search = search->next) {
+        if (search->pack && search->pack->filesize)
+            total += pakcache_reclen(search->pack);
+    }
+    if (total > INT_MAX)
+        return;
+
+    data = FS_Malloc(total);
+    header = (pchheader_t *)data;
+    header->ident = PAKCACHE_IDENT;
+    header->version = PAKCACHE_VERSION;
+    header->num_packs = 0;
+    header->filelen = total;
+
+    p = data + sizeof(*header);
+    for (search = fs_searchpaths; search; search = search->next) {
+        if (search->pack && search->pack->filesize) {
+            p = write_pakrecord(p, search->pack);
+            header->num_packs++;
+        }
+    }
+
+    header->checksum = Com_BlockChecksum(data + sizeof(*header), total - sizeof(*header));
+
+    fp = fopen(temp, "wb");
+    if (!fp) {
+        FS_DPrintf("%s: couldn't open %s: %s\n", __func__, temp, strerror(errno));
+        Z_Free(data);
+        return;
+    }
+
+    ret = fwrite(data, 1, total, fp) != total;
+    if (fclose(fp))
+        ret = 1;
+    Z_Free(data);
+    if (ret) {
+        FS_DPrintf("%s: couldn't write %s\n", __func__, temp);
+        os_unlink(temp);
+        return;
+    }
+
+#ifdef _WIN32
+    os_unlink(path);
+#endif
+    if (rename(temp, path)) {
+        FS_DPrintf("%s: couldn't rename %s: %s\n", __func__, temp, strerror(errno));
+        os_unlink(temp);
+        return;
+    }
+
+    FS_DPrintf("%s: saved %"PRIz" bytes\n", __func__, total);
+}
+
+// called once search paths are set up
+static void close_pakcache(void)
+{
+    unsigned misses = fs_pakcache_state.misses;
+
+    FS_DPrintf("%s: %u hits, %u misses\n", __func__,
+               fs_pakcache_state.hits, misses);
+
+    // the cache file is mapped, so release it before replacing
+    free_pakcache();
+
+    if (misses && fs_pakcache->integer)
+        write_pakcache();
+}
+
 // Loads the header and directory, adding the files at the beginning
 // of the list so they override previous pack files.
 static pack_t *load_pak_file(const char *packfile)
@@ -2061,6 +4289,9 @@ static pack_t *load_pak_file(const char *packfile)
         return NULL;
     }
 
+    if ((pack = load_pakcache(fp, FS_PAK, packfile)))
+        return pack;
+
     if (fread(&header, 1, sizeof(header), fp) != sizeof(header)) {
         Com_Printf("Reading header failed on %s\n", packfile);
         goto fail;
@@ -2115,6 +4346,7 @@ static pack_t *load_pak_file(const char *packfile)
 
 // allocate the pack
     pack = pack_alloc(fp, FS_PAK, packfile, num_files, names_len);
+    set_pack_info(pack);
 
 // parse the directory
     file = pack->files;
@@ -2288,6 +4520,9 @@ static pack_t *load_zip_file(const char *packfile)
         return NULL;
     }
 
+    if ((pack = load_pakcache(fp, FS_ZIP, packfile)))
+        return pack;
+
     header_pos = search_central_header(fp);
     if (!header_pos) {
         Com_Printf("No central header found in %s\n", packfile);
@@ -2359,6 +4594,7 @@ static pack_t *load_zip_file(const char *packfile)
 
 // allocate the pack
     pack = pack_alloc(fp, FS_ZIP, packfile, num_files, names_len);
+    set_pack_info(pack);
 
 // parse the directory
     file = pack->files;
@@ -2463,9 +4699,12 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
     search = FS_Malloc(sizeof(searchpath_t) + len);
     search->mode = mode;
     search->pack = NULL;
+    search->cache = NULL;
     memcpy(search->filename, fs_gamedir, len + 1);
     search->next = fs_searchpaths;
     fs_searchpaths = search;
+    fs_lookup.stale = qtrue;
+    flush_missing();
 
 #if USE_ZLIB
 #define PAK_EXT  ".pak;.pkz"
@@ -2501,6 +4740,7 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
         search->mode = mode;
         search->filename[0] = 0;
         search->pack = pack_get(pack);
+        search->cache = NULL;
         search->next = fs_searchpaths;
         fs_searchpaths = search;
     }
@@ -3147,6 +5387,18 @@ static void FS_Path_f(void)
 #endif
 }
 
+#if USE_TESTS
+void FS_GetCounters(fs_counters_t *c)
+{
+    c->lookups = fs_count_read;
+    c->strcmps = fs_count_strcmp;
+    c->diskopens = fs_count_open;
+    c->reopens = fs_count_strlwr;
+    c->misshits = fs_count_misshit;
+    c->missadds = fs_count_missadd;
+}
+#endif
+
 #ifdef _DEBUG
 /*
 ================
@@ -3190,6 +5442,10 @@ static void FS_Stats_f(void)
     Com_Printf("Total path comparsions: %d\n", fs_count_strcmp);
     Com_Printf("Total calls to open_from_disk: %d\n", fs_count_open);
     Com_Printf("Total mixed-case reopens: %d\n", fs_count_strlwr);
+    Com_Printf("Lookup index has %u files in %u slots\n",
+               fs_lookup.num_entries, fs_lookup.hash_size);
+    Com_Printf("Missing files cache: %d hits, %d added, %u cached\n",
+               fs_count_misshit, fs_count_missadd, fs_missing.count);
 
     if (!totalHashSize) {
         Com_Printf("No stats to display\n");
@@ -3363,7 +5619,10 @@ update:
 static void free_search_path(searchpath_t *path)
 {
     pack_put(path->pack);
+    free_dir_cache(path->cache);
     Z_Free(path);
+    fs_lookup.stale = qtrue;
+    flush_missing();
 }
 
 static void free_all_paths(void)
@@ -3438,6 +5697,8 @@ static void setup_game_paths(void)
 
     // this var is used by the game library to find it's home directory
     Cvar_FullSet("fs_gamedir", fs_gamedir, CVAR_ROM, FROM_CODE);
+
+    close_pakcache();
 }
 
 /*
@@ -3492,6 +5753,7 @@ static const cmdreg_t c_fs[] = {
     { "softlink", FS_Link_f, FS_Link_c },
     { "softunlink", FS_UnLink_f, FS_Link_c },
     { "fs_restart", FS_Restart_f },
+    { "fs_async_stats", FS_AsyncStats_f },
 
     { NULL }
 };
@@ -3518,12 +5780,18 @@ void FS_Shutdown(void)
         }
     }
 
+    shutdown_async();
+#if USE_ZLIB
+    shutdown_prefetch();
+#endif
+
     // free symbolic links
     free_all_links(&fs_hard_links);
     free_all_links(&fs_soft_links);
 
     // free search paths
     free_all_paths();
+    free_index();
 
 #if USE_ZLIB
     inflateEnd(&fs_zipstream.stream);
@@ -3599,6 +5867,14 @@ void FS_Init(void)
     fs_debug = Cvar_Get("fs_debug", "0", 0);
 #endif
 
+    fs_async_write = Cvar_Get("fs_async_write", "1024", 0);
+    fs_async_read = Cvar_Get("fs_async_read", "256", 0);
+    fs_index = Cvar_Get("fs_index", "1", 0);
+    fs_pakcache = Cvar_Get("fs_pakcache", "1", 0);
+#if USE_ZLIB
+    fs_prefetch_size = Cvar_Get("fs_prefetch", "32768", 0);
+#endif
+
     // get the game cvar and start the filesystem
     fs_game = Cvar_Get("game", DEFGAME, CVAR_LATCH | CVAR_SERVERINFO);
     fs_game->changed = fs_game_changed;
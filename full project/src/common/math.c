@@ -19,6 +19,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "common/math.h"
 
+// vector path used where the compiler targets it
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#elif (defined __ARM_NEON) || (defined __ARM_NEON__)
+#define USE_NEON    1
+#include <arm_neon.h>
+#endif
+
 const vec3_t bytedirs[NUMVERTEXNORMALS] = {
     {-0.525731, 0.000000, 0.850651}, 
     {-0.442863, 0.238856, 0.864188}, 
@@ -288,4 +297,93 @@ int BoxOnPlaneSide(vec3_t emins, vec3_t emaxs, cplane_t *p)
 }
 #endif // USE_ASM
 
+/*
+==================
+SetPlanes4
+
+Unused lanes get a plane every box is in front of.
+==================
+*/
+void SetPlanes4(cplane4_t *out, const cplane_t *planes, int count)
+{
+    int i, j;
+
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 3; j++) {
+            out->normal[j][i] = i < count ? planes[i].normal[j] : 0;
+        }
+        out->dist[i] = i < count ? planes[i].dist : -1;
+    }
+}
+
+/*
+==================
+BoxOnPlanes4Side
+
+Same as BoxOnPlaneSide against four planes at once. Nearest and farthest
+corners are picked per lane by min/max instead of signbits.
+==================
+*/
+int BoxOnPlanes4Side(const vec3_t emins, const vec3_t emaxs, const cplane4_t *p)
+{
+#if USE_SSE2
+    __m128 n, a, b, dist1, dist2, d;
+    int i;
+
+    dist1 = dist2 = _mm_setzero_ps();
+    for (i = 0; i < 3; i++) {
+        n = _mm_loadu_ps(p->normal[i]);
+        a = _mm_mul_ps(n, _mm_set1_ps(emins[i]));
+        b = _mm_mul_ps(n, _mm_set1_ps(emaxs[i]));
+        dist1 = _mm_add_ps(dist1, _mm_max_ps(a, b));
+        dist2 = _mm_add_ps(dist2, _mm_min_ps(a, b));
+    }
+
+    d = _mm_loadu_ps(p->dist);
+    return _mm_movemask_ps(_mm_cmpge_ps(dist2, d)) |
+           _mm_movemask_ps(_mm_cmplt_ps(dist1, d)) << 4;
+#elif USE_NEON
+    static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+    float32x4_t n, a, b, dist1, dist2, d;
+    uint32x4_t bit, m;
+    uint32x2_t r;
+    int i;
+
+    dist1 = dist2 = vdupq_n_f32(0);
+    for (i = 0; i < 3; i++) {
+        n = vld1q_f32(p->normal[i]);
+        a = vmulq_n_f32(n, emins[i]);
+        b = vmulq_n_f32(n, emaxs[i]);
+        dist1 = vaddq_f32(dist1, vmaxq_f32(a, b));
+        dist2 = vaddq_f32(dist2, vminq_f32(a, b));
+    }
+
+    d = vld1q_f32(p->dist);
+    bit = vld1q_u32(lanes);
+    m = vorrq_u32(vandq_u32(vcgeq_f32(dist2, d), bit),
+                  vandq_u32(vcltq_f32(dist1, d), vshlq_n_u32(bit, 4)));
+    r = vorr_u32(vget_low_u32(m), vget_high_u32(m));
+    return vget_lane_u32(r, 0) | vget_lane_u32(r, 1);
+#else
+    vec_t a, b, dist1, dist2;
+    int i, j, bits = 0;
+
+    for (i = 0; i < 4; i++) {
+        dist1 = dist2 = 0;
+        for (j = 0; j < 3; j++) {
+            a = p->normal[j][i] * emins[j];
+            b = p->normal[j][i] * emaxs[j];
+            dist1 += max(a, b);
+            dist2 += min(a, b);
+        }
+        if (dist2 >= p->dist[i])
+            bits |= 1 << i;
+        if (dist1 < p->dist[i])
+            bits |= 16 << i;
+    }
+
+    return bits;
+#endif
+}
+
 
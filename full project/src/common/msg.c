@@ -22,6 +22,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/sizebuf.h"
 #include "common/math.h"
 
+// vector path used where the compiler targets it
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#endif
+
 /*
 ==============================================================================
 
@@ -31,7 +37,7 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-sizebuf_t   msg_write;
+q_threadlocal sizebuf_t msg_write;
 byte        msg_write_buffer[MAX_MSGLEN];
 
 sizebuf_t   msg_read;
@@ -216,6 +222,35 @@ void MSG_WriteAngle(float f)
     MSG_WriteByte(ANGLE2BYTE(f));
 }
 
+/*
+=============
+put_short, put_long
+
+Delta encoders assemble each entity or player state on the stack using
+plain stores and append it to msg_write at once, doing one bounds check
+instead of one per field.
+=============
+*/
+
+#define MAX_DELTA_ENTITY    48      // all U_* bits set
+#define MAX_DELTA_PLAYER    128     // all PS_* bits and stats set
+
+static inline byte *put_short(byte *p, int c)
+{
+    p[0] = c & 0xff;
+    p[1] = (c >> 8) & 0xff;
+    return p + 2;
+}
+
+static inline byte *put_long(byte *p, int c)
+{
+    p[0] = c & 0xff;
+    p[1] = (c >> 8) & 0xff;
+    p[2] = (c >> 16) & 0xff;
+    p[3] = c >> 24;
+    return p + 4;
+}
+
 #if USE_CLIENT
 
 /*
@@ -317,8 +352,11 @@ MSG_WriteBits
 */
 void MSG_WriteBits(int value, int bits)
 {
-    int i;
     size_t bitpos;
+    uint64_t v;
+    uint32_t w;
+    byte *p;
+    int shift;
 
     if (bits == 0 || bits < -31 || bits > 32) {
         Com_Error(ERR_FATAL, "MSG_WriteBits: bad bits: %d", bits);
@@ -349,13 +387,22 @@ void MSG_WriteBits(int value, int bits)
             break;
         }
     }
-    for (i = 0; i < bits; i++, bitpos++) {
-        if ((bitpos & 7) == 0) {
-            msg_write.data[bitpos >> 3] = 0;
-        }
-        msg_write.data[bitpos >> 3] |= (value & 1) << (bitpos & 7);
-        value >>= 1;
+
+    // merge with the partial byte and store the whole run at once. at most
+    // 39 bits starting at cursize - 1 are touched, which the overflow check
+    // above leaves room for.
+    p = msg_write.data + (bitpos >> 3);
+    shift = bitpos & 7;
+    v = (uint64_t)((uint32_t)value & (0xffffffffU >> (32 - bits))) << shift;
+    v |= p[0] & ((1U << shift) - 1);
+
+    w = LittleLong((uint32_t)v);
+    memcpy(p, &w, 4);
+    if (shift + bits > 32) {
+        p[4] = v >> 32;
     }
+
+    bitpos += bits;
     msg_write.bitpos = bitpos;
     msg_write.cursize = (bitpos + 7) >> 3;
 }
@@ -502,11 +549,73 @@ void MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, qboolean sho
     out->event = in->event;
 }
 
+/*
+==================
+entity_diff
+
+Returns a mask with bit N set if byte N of the packed states differs.
+Bits are tested against ES_BYTES of each field, so the mask doesn't
+depend on the exact layout.
+==================
+*/
+
+#define ES_BYTES(f) \
+    (((UINT64_C(1) << sizeof(((entity_packed_t *)0)->f)) - 1) << q_offsetof(entity_packed_t, f))
+
+// fields delta compressed into U_* bits
+#define ES_DELTA \
+    (ES_BYTES(origin) | ES_BYTES(angles) | ES_BYTES(old_origin) | \
+     ES_BYTES(modelindex) | ES_BYTES(modelindex2) | ES_BYTES(modelindex3) | \
+     ES_BYTES(modelindex4) | ES_BYTES(skinnum) | ES_BYTES(effects) | \
+     ES_BYTES(renderfx) | ES_BYTES(solid) | ES_BYTES(frame) | ES_BYTES(sound))
+
+static inline uint64_t entity_diff(const entity_packed_t *a, const entity_packed_t *b)
+{
+    const byte *p = (const byte *)a;
+    const byte *q = (const byte *)b;
+    uint64_t diff = 0;
+    size_t i;
+
+#if USE_SSE2
+    // three overlapping loads cover the 44 byte struct
+    for (i = 0; i < sizeof(*a); i += 16) {
+        size_t ofs = min(i, sizeof(*a) - 16);
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + ofs)),
+                                    _mm_loadu_si128((const __m128i *)(q + ofs)));
+        diff |= (uint64_t)(~_mm_movemask_epi8(eq) & 0xffff) << ofs;
+    }
+#else
+    for (i = 0; i < sizeof(*a); i += 8) {
+        size_t ofs = min(i, sizeof(*a) - 8);
+        uint64_t x, y;
+
+        memcpy(&x, p + ofs, 8);
+        memcpy(&y, q + ofs, 8);
+        x ^= y;
+
+        // fold each byte into its low bit, then gather the low bits
+        x |= x >> 4;
+        x |= x >> 2;
+        x |= x >> 1;
+        x &= UINT64_C(0x0101010101010101);
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+        diff |= ((x * UINT64_C(0x0102040810204080)) >> 56) << ofs;
+#else
+        diff |= ((x * UINT64_C(0x8040201008040201)) >> 56) << ofs;
+#endif
+    }
+#endif
+
+    return diff;
+}
+
 void MSG_WriteDeltaEntity(const entity_packed_t *from,
                           const entity_packed_t *to,
                           msgEsFlags_t          flags)
 {
     uint32_t    bits, mask;
+    uint64_t    diff;
+    byte        buffer[MAX_DELTA_ENTITY], *p = buffer;
 
     if (!to) {
         if (!from)
@@ -538,29 +647,39 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
         from = &nullEntityState;
 
 // send an update
+    diff = entity_diff(from, to);
+
+    // most entities don't change between frames
+    if (!(diff & ES_DELTA) && !to->event && !(flags & MSG_ES_NEWENTITY) &&
+        !(to->renderfx & (RF_FRAMELERP | RF_BEAM))) {
+        if (!(flags & MSG_ES_FORCE))
+            return;
+        diff = 0;
+    }
+
     bits = 0;
 
     if (!(flags & MSG_ES_FIRSTPERSON)) {
-        if (to->origin[0] != from->origin[0])
+        if (diff & ES_BYTES(origin[0]))
             bits |= U_ORIGIN1;
-        if (to->origin[1] != from->origin[1])
+        if (diff & ES_BYTES(origin[1]))
             bits |= U_ORIGIN2;
-        if (to->origin[2] != from->origin[2])
+        if (diff & ES_BYTES(origin[2]))
             bits |= U_ORIGIN3;
 
         if (flags & MSG_ES_SHORTANGLES) {
-            if (to->angles[0] != from->angles[0])
+            if (diff & ES_BYTES(angles[0]))
                 bits |= U_ANGLE1 | U_ANGLE16;
-            if (to->angles[1] != from->angles[1])
+            if (diff & ES_BYTES(angles[1]))
                 bits |= U_ANGLE2 | U_ANGLE16;
-            if (to->angles[2] != from->angles[2])
+            if (diff & ES_BYTES(angles[2]))
                 bits |= U_ANGLE3 | U_ANGLE16;
         } else {
-            if (to->angles[0] != from->angles[0])
+            if (diff & ES_BYTES(angles[0]))
                 bits |= U_ANGLE1;
-            if (to->angles[1] != from->angles[1])
+            if (diff & ES_BYTES(angles[1]))
                 bits |= U_ANGLE2;
-            if (to->angles[2] != from->angles[2])
+            if (diff & ES_BYTES(angles[2]))
                 bits |= U_ANGLE3;
         }
 
@@ -577,7 +696,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else
         mask = 0xffff8000;  // don't confuse old clients
 
-    if (to->skinnum != from->skinnum) {
+    if (diff & ES_BYTES(skinnum)) {
         if (to->skinnum & mask)
             bits |= U_SKIN8 | U_SKIN16;
         else if (to->skinnum & 0x0000ff00)
@@ -586,14 +705,14 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_SKIN8;
     }
 
-    if (to->frame != from->frame) {
+    if (diff & ES_BYTES(frame)) {
         if (to->frame & 0xff00)
             bits |= U_FRAME16;
         else
             bits |= U_FRAME8;
     }
 
-    if (to->effects != from->effects) {
+    if (diff & ES_BYTES(effects)) {
         if (to->effects & mask)
             bits |= U_EFFECTS8 | U_EFFECTS16;
         else if (to->effects & 0x0000ff00)
@@ -602,7 +721,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_EFFECTS8;
     }
 
-    if (to->renderfx != from->renderfx) {
+    if (diff & ES_BYTES(renderfx)) {
         if (to->renderfx & mask)
             bits |= U_RENDERFX8 | U_RENDERFX16;
         else if (to->renderfx & 0x0000ff00)
@@ -611,23 +730,23 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_RENDERFX8;
     }
 
-    if (to->solid != from->solid)
+    if (diff & ES_BYTES(solid))
         bits |= U_SOLID;
 
     // event is not delta compressed, just 0 compressed
     if (to->event)
         bits |= U_EVENT;
 
-    if (to->modelindex != from->modelindex)
+    if (diff & ES_BYTES(modelindex))
         bits |= U_MODEL;
-    if (to->modelindex2 != from->modelindex2)
+    if (diff & ES_BYTES(modelindex2))
         bits |= U_MODEL2;
-    if (to->modelindex3 != from->modelindex3)
+    if (diff & ES_BYTES(modelindex3))
         bits |= U_MODEL3;
-    if (to->modelindex4 != from->modelindex4)
+    if (diff & ES_BYTES(modelindex4))
         bits |= U_MODEL4;
 
-    if (to->sound != from->sound)
+    if (diff & ES_BYTES(sound))
         bits |= U_SOUND;
 
     if (to->renderfx & RF_FRAMELERP) {
@@ -664,100 +783,102 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else if (bits & 0x0000ff00)
         bits |= U_MOREBITS1;
 
-    MSG_WriteByte(bits & 255);
+    *p++ = bits & 255;
 
     if (bits & 0xff000000) {
-        MSG_WriteByte((bits >> 8) & 255);
-        MSG_WriteByte((bits >> 16) & 255);
-        MSG_WriteByte((bits >> 24) & 255);
+        *p++ = (bits >> 8) & 255;
+        *p++ = (bits >> 16) & 255;
+        *p++ = (bits >> 24) & 255;
     } else if (bits & 0x00ff0000) {
-        MSG_WriteByte((bits >> 8) & 255);
-        MSG_WriteByte((bits >> 16) & 255);
+        *p++ = (bits >> 8) & 255;
+        *p++ = (bits >> 16) & 255;
     } else if (bits & 0x0000ff00) {
-        MSG_WriteByte((bits >> 8) & 255);
+        *p++ = (bits >> 8) & 255;
     }
 
     //----------
 
     if (bits & U_NUMBER16)
-        MSG_WriteShort(to->number);
+        p = put_short(p, to->number);
     else
-        MSG_WriteByte(to->number);
+        *p++ = to->number;
 
     if (bits & U_MODEL)
-        MSG_WriteByte(to->modelindex);
+        *p++ = to->modelindex;
     if (bits & U_MODEL2)
-        MSG_WriteByte(to->modelindex2);
+        *p++ = to->modelindex2;
     if (bits & U_MODEL3)
-        MSG_WriteByte(to->modelindex3);
+        *p++ = to->modelindex3;
     if (bits & U_MODEL4)
-        MSG_WriteByte(to->modelindex4);
+        *p++ = to->modelindex4;
 
     if (bits & U_FRAME8)
-        MSG_WriteByte(to->frame);
+        *p++ = to->frame;
     else if (bits & U_FRAME16)
-        MSG_WriteShort(to->frame);
+        p = put_short(p, to->frame);
 
     if ((bits & (U_SKIN8 | U_SKIN16)) == (U_SKIN8 | U_SKIN16))  //used for laser colors
-        MSG_WriteLong(to->skinnum);
+        p = put_long(p, to->skinnum);
     else if (bits & U_SKIN8)
-        MSG_WriteByte(to->skinnum);
+        *p++ = to->skinnum;
     else if (bits & U_SKIN16)
-        MSG_WriteShort(to->skinnum);
+        p = put_short(p, to->skinnum);
 
     if ((bits & (U_EFFECTS8 | U_EFFECTS16)) == (U_EFFECTS8 | U_EFFECTS16))
-        MSG_WriteLong(to->effects);
+        p = put_long(p, to->effects);
     else if (bits & U_EFFECTS8)
-        MSG_WriteByte(to->effects);
+        *p++ = to->effects;
     else if (bits & U_EFFECTS16)
-        MSG_WriteShort(to->effects);
+        p = put_short(p, to->effects);
 
     if ((bits & (U_RENDERFX8 | U_RENDERFX16)) == (U_RENDERFX8 | U_RENDERFX16))
-        MSG_WriteLong(to->renderfx);
+        p = put_long(p, to->renderfx);
     else if (bits & U_RENDERFX8)
-        MSG_WriteByte(to->renderfx);
+        *p++ = to->renderfx;
     else if (bits & U_RENDERFX16)
-        MSG_WriteShort(to->renderfx);
+        p = put_short(p, to->renderfx);
 
     if (bits & U_ORIGIN1)
-        MSG_WriteShort(to->origin[0]);
+        p = put_short(p, to->origin[0]);
     if (bits & U_ORIGIN2)
-        MSG_WriteShort(to->origin[1]);
+        p = put_short(p, to->origin[1]);
     if (bits & U_ORIGIN3)
-        MSG_WriteShort(to->origin[2]);
+        p = put_short(p, to->origin[2]);
 
     if ((flags & MSG_ES_SHORTANGLES) && (bits & U_ANGLE16)) {
         if (bits & U_ANGLE1)
-            MSG_WriteShort(to->angles[0]);
+            p = put_short(p, to->angles[0]);
         if (bits & U_ANGLE2)
-            MSG_WriteShort(to->angles[1]);
+            p = put_short(p, to->angles[1]);
         if (bits & U_ANGLE3)
-            MSG_WriteShort(to->angles[2]);
+            p = put_short(p, to->angles[2]);
     } else {
         if (bits & U_ANGLE1)
-            MSG_WriteByte(to->angles[0] >> 8);
+            *p++ = to->angles[0] >> 8;
         if (bits & U_ANGLE2)
-            MSG_WriteByte(to->angles[1] >> 8);
+            *p++ = to->angles[1] >> 8;
         if (bits & U_ANGLE3)
-            MSG_WriteByte(to->angles[2] >> 8);
+            *p++ = to->angles[2] >> 8;
     }
 
     if (bits & U_OLDORIGIN) {
-        MSG_WriteShort(to->old_origin[0]);
-        MSG_WriteShort(to->old_origin[1]);
-        MSG_WriteShort(to->old_origin[2]);
+        p = put_short(p, to->old_origin[0]);
+        p = put_short(p, to->old_origin[1]);
+        p = put_short(p, to->old_origin[2]);
     }
 
     if (bits & U_SOUND)
-        MSG_WriteByte(to->sound);
+        *p++ = to->sound;
     if (bits & U_EVENT)
-        MSG_WriteByte(to->event);
+        *p++ = to->event;
     if (bits & U_SOLID) {
         if (flags & MSG_ES_LONGSOLID)
-            MSG_WriteLong(to->solid);
+            p = put_long(p, to->solid);
         else
-            MSG_WriteShort(to->solid);
+            p = put_short(p, to->solid);
     }
+
+    MSG_WriteData(buffer, p - buffer);
 }
 
 void MSG_PackPlayer(player_packed_t *out, const player_state_t *in)
@@ -797,6 +918,7 @@ void MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player
     int     i;
     int     pflags;
     int     statbits;
+    byte    buffer[MAX_DELTA_PLAYER], *p = buffer;
 
     if (!to)
         Com_Error(ERR_DROP, "%s: NULL", __func__);
@@ -878,87 +1000,87 @@ void MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player
     //
     // write it
     //
-    MSG_WriteShort(pflags);
+    p = put_short(p, pflags);
 
     //
     // write the pmove_state_t
     //
     if (pflags & PS_M_TYPE)
-        MSG_WriteByte(to->pmove.pm_type);
+        *p++ = to->pmove.pm_type;
 
     if (pflags & PS_M_ORIGIN) {
-        MSG_WriteShort(to->pmove.origin[0]);
-        MSG_WriteShort(to->pmove.origin[1]);
-        MSG_WriteShort(to->pmove.origin[2]);
+        p = put_short(p, to->pmove.origin[0]);
+        p = put_short(p, to->pmove.origin[1]);
+        p = put_short(p, to->pmove.origin[2]);
     }
 
     if (pflags & PS_M_VELOCITY) {
-        MSG_WriteShort(to->pmove.velocity[0]);
-        MSG_WriteShort(to->pmove.velocity[1]);
-        MSG_WriteShort(to->pmove.velocity[2]);
+        p = put_short(p, to->pmove.velocity[0]);
+        p = put_short(p, to->pmove.velocity[1]);
+        p = put_short(p, to->pmove.velocity[2]);
     }
 
     if (pflags & PS_M_TIME)
-        MSG_WriteByte(to->pmove.pm_time);
+        *p++ = to->pmove.pm_time;
 
     if (pflags & PS_M_FLAGS)
-        MSG_WriteByte(to->pmove.pm_flags);
+        *p++ = to->pmove.pm_flags;
 
     if (pflags & PS_M_GRAVITY)
-        MSG_WriteShort(to->pmove.gravity);
+        p = put_short(p, to->pmove.gravity);
 
     if (pflags & PS_M_DELTA_ANGLES) {
-        MSG_WriteShort(to->pmove.delta_angles[0]);
-        MSG_WriteShort(to->pmove.delta_angles[1]);
-        MSG_WriteShort(to->pmove.delta_angles[2]);
+        p = put_short(p, to->pmove.delta_angles[0]);
+        p = put_short(p, to->pmove.delta_angles[1]);
+        p = put_short(p, to->pmove.delta_angles[2]);
     }
 
     //
     // write the rest of the player_state_t
     //
     if (pflags & PS_VIEWOFFSET) {
-        MSG_WriteChar(to->viewoffset[0]);
-        MSG_WriteChar(to->viewoffset[1]);
-        MSG_WriteChar(to->viewoffset[2]);
+        *p++ = to->viewoffset[0];
+        *p++ = to->viewoffset[1];
+        *p++ = to->viewoffset[2];
     }
 
     if (pflags & PS_VIEWANGLES) {
-        MSG_WriteShort(to->viewangles[0]);
-        MSG_WriteShort(to->viewangles[1]);
-        MSG_WriteShort(to->viewangles[2]);
+        p = put_short(p, to->viewangles[0]);
+        p = put_short(p, to->viewangles[1]);
+        p = put_short(p, to->viewangles[2]);
     }
 
     if (pflags & PS_KICKANGLES) {
-        MSG_WriteChar(to->kick_angles[0]);
-        MSG_WriteChar(to->kick_angles[1]);
-        MSG_WriteChar(to->kick_angles[2]);
+        *p++ = to->kick_angles[0];
+        *p++ = to->kick_angles[1];
+        *p++ = to->kick_angles[2];
     }
 
     if (pflags & PS_WEAPONINDEX)
-        MSG_WriteByte(to->gunindex);
+        *p++ = to->gunindex;
 
     if (pflags & PS_WEAPONFRAME) {
-        MSG_WriteByte(to->gunframe);
-        MSG_WriteChar(to->gunoffset[0]);
-        MSG_WriteChar(to->gunoffset[1]);
-        MSG_WriteChar(to->gunoffset[2]);
-        MSG_WriteChar(to->gunangles[0]);
-        MSG_WriteChar(to->gunangles[1]);
-        MSG_WriteChar(to->gunangles[2]);
+        *p++ = to->gunframe;
+        *p++ = to->gunoffset[0];
+        *p++ = to->gunoffset[1];
+        *p++ = to->gunoffset[2];
+        *p++ = to->gunangles[0];
+        *p++ = to->gunangles[1];
+        *p++ = to->gunangles[2];
     }
 
     if (pflags & PS_BLEND) {
-        MSG_WriteByte(to->blend[0]);
-        MSG_WriteByte(to->blend[1]);
-        MSG_WriteByte(to->blend[2]);
-        MSG_WriteByte(to->blend[3]);
+        *p++ = to->blend[0];
+        *p++ = to->blend[1];
+        *p++ = to->blend[2];
+        *p++ = to->blend[3];
     }
 
     if (pflags & PS_FOV)
-        MSG_WriteByte(to->fov);
+        *p++ = to->fov;
 
     if (pflags & PS_RDFLAGS)
-        MSG_WriteByte(to->rdflags);
+        *p++ = to->rdflags;
 
     // send stats
     statbits = 0;
@@ -966,10 +1088,12 @@ void MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player
         if (to->stats[i] != from->stats[i])
             statbits |= 1 << i;
 
-    MSG_WriteLong(statbits);
+    p = put_long(p, statbits);
     for (i = 0; i < MAX_STATS; i++)
         if (statbits & (1 << i))
-            MSG_WriteShort(to->stats[i]);
+            p = put_short(p, to->stats[i]);
+
+    MSG_WriteData(buffer, p - buffer);
 }
 
 int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
@@ -979,6 +1103,7 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
     int     i;
     int     pflags, eflags;
     int     statbits;
+    byte    buffer[MAX_DELTA_PLAYER], *p = buffer;
 
     if (!to)
         Com_Error(ERR_DROP, "%s: NULL", __func__);
@@ -1125,107 +1250,109 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
     //
     // write it
     //
-    MSG_WriteShort(pflags);
+    p = put_short(p, pflags);
 
     //
     // write the pmove_state_t
     //
     if (pflags & PS_M_TYPE)
-        MSG_WriteByte(to->pmove.pm_type);
+        *p++ = to->pmove.pm_type;
 
     if (pflags & PS_M_ORIGIN) {
-        MSG_WriteShort(to->pmove.origin[0]);
-        MSG_WriteShort(to->pmove.origin[1]);
+        p = put_short(p, to->pmove.origin[0]);
+        p = put_short(p, to->pmove.origin[1]);
     }
 
     if (eflags & EPS_M_ORIGIN2)
-        MSG_WriteShort(to->pmove.origin[2]);
+        p = put_short(p, to->pmove.origin[2]);
 
     if (pflags & PS_M_VELOCITY) {
-        MSG_WriteShort(to->pmove.velocity[0]);
-        MSG_WriteShort(to->pmove.velocity[1]);
+        p = put_short(p, to->pmove.velocity[0]);
+        p = put_short(p, to->pmove.velocity[1]);
     }
 
     if (eflags & EPS_M_VELOCITY2)
-        MSG_WriteShort(to->pmove.velocity[2]);
+        p = put_short(p, to->pmove.velocity[2]);
 
     if (pflags & PS_M_TIME)
-        MSG_WriteByte(to->pmove.pm_time);
+        *p++ = to->pmove.pm_time;
 
     if (pflags & PS_M_FLAGS)
-        MSG_WriteByte(to->pmove.pm_flags);
+        *p++ = to->pmove.pm_flags;
 
     if (pflags & PS_M_GRAVITY)
-        MSG_WriteShort(to->pmove.gravity);
+        p = put_short(p, to->pmove.gravity);
 
     if (pflags & PS_M_DELTA_ANGLES) {
-        MSG_WriteShort(to->pmove.delta_angles[0]);
-        MSG_WriteShort(to->pmove.delta_angles[1]);
-        MSG_WriteShort(to->pmove.delta_angles[2]);
+        p = put_short(p, to->pmove.delta_angles[0]);
+        p = put_short(p, to->pmove.delta_angles[1]);
+        p = put_short(p, to->pmove.delta_angles[2]);
     }
 
     //
     // write the rest of the player_state_t
     //
     if (pflags & PS_VIEWOFFSET) {
-        MSG_WriteChar(to->viewoffset[0]);
-        MSG_WriteChar(to->viewoffset[1]);
-        MSG_WriteChar(to->viewoffset[2]);
+        *p++ = to->viewoffset[0];
+        *p++ = to->viewoffset[1];
+        *p++ = to->viewoffset[2];
     }
 
     if (pflags & PS_VIEWANGLES) {
-        MSG_WriteShort(to->viewangles[0]);
-        MSG_WriteShort(to->viewangles[1]);
+        p = put_short(p, to->viewangles[0]);
+        p = put_short(p, to->viewangles[1]);
     }
 
     if (eflags & EPS_VIEWANGLE2)
-        MSG_WriteShort(to->viewangles[2]);
+        p = put_short(p, to->viewangles[2]);
 
     if (pflags & PS_KICKANGLES) {
-        MSG_WriteChar(to->kick_angles[0]);
-        MSG_WriteChar(to->kick_angles[1]);
-        MSG_WriteChar(to->kick_angles[2]);
+        *p++ = to->kick_angles[0];
+        *p++ = to->kick_angles[1];
+        *p++ = to->kick_angles[2];
     }
 
     if (pflags & PS_WEAPONINDEX)
-        MSG_WriteByte(to->gunindex);
+        *p++ = to->gunindex;
 
     if (pflags & PS_WEAPONFRAME)
-        MSG_WriteByte(to->gunframe);
+        *p++ = to->gunframe;
 
     if (eflags & EPS_GUNOFFSET) {
-        MSG_WriteChar(to->gunoffset[0]);
-        MSG_WriteChar(to->gunoffset[1]);
-        MSG_WriteChar(to->gunoffset[2]);
+        *p++ = to->gunoffset[0];
+        *p++ = to->gunoffset[1];
+        *p++ = to->gunoffset[2];
     }
 
     if (eflags & EPS_GUNANGLES) {
-        MSG_WriteChar(to->gunangles[0]);
-        MSG_WriteChar(to->gunangles[1]);
-        MSG_WriteChar(to->gunangles[2]);
+        *p++ = to->gunangles[0];
+        *p++ = to->gunangles[1];
+        *p++ = to->gunangles[2];
     }
 
     if (pflags & PS_BLEND) {
-        MSG_WriteByte(to->blend[0]);
-        MSG_WriteByte(to->blend[1]);
-        MSG_WriteByte(to->blend[2]);
-        MSG_WriteByte(to->blend[3]);
+        *p++ = to->blend[0];
+        *p++ = to->blend[1];
+        *p++ = to->blend[2];
+        *p++ = to->blend[3];
     }
 
     if (pflags & PS_FOV)
-        MSG_WriteByte(to->fov);
+        *p++ = to->fov;
 
     if (pflags & PS_RDFLAGS)
-        MSG_WriteByte(to->rdflags);
+        *p++ = to->rdflags;
 
     // send stats
     if (eflags & EPS_STATS) {
-        MSG_WriteLong(statbits);
+        p = put_long(p, statbits);
         for (i = 0; i < MAX_STATS; i++)
             if (statbits & (1 << i))
-                MSG_WriteShort(to->stats[i]);
+                p = put_short(p, to->stats[i]);
     }
 
+    MSG_WriteData(buffer, p - buffer);
+
     return eflags;
 }
 
@@ -1247,6 +1374,7 @@ void MSG_WriteDeltaPlayerstate_Packet(const player_packed_t *from,
     int     i;
     int     pflags;
     int     statbits;
+    byte    buffer[MAX_DELTA_PLAYER], *p = buffer;
 
     if (number < 0 || number >= MAX_CLIENTS)
         Com_Error(ERR_DROP, "%s: bad number: %d", __func__, number);
@@ -1343,84 +1471,86 @@ void MSG_WriteDeltaPlayerstate_Packet(const player_packed_t *from,
     //
     // write it
     //
-    MSG_WriteByte(number);
-    MSG_WriteShort(pflags);
+    *p++ = number;
+    p = put_short(p, pflags);
 
     //
     // write some part of the pmove_state_t
     //
     if (pflags & PPS_M_TYPE)
-        MSG_WriteByte(to->pmove.pm_type);
+        *p++ = to->pmove.pm_type;
 
     if (pflags & PPS_M_ORIGIN) {
-        MSG_WriteShort(to->pmove.origin[0]);
-        MSG_WriteShort(to->pmove.origin[1]);
+        p = put_short(p, to->pmove.origin[0]);
+        p = put_short(p, to->pmove.origin[1]);
     }
 
     if (pflags & PPS_M_ORIGIN2)
-        MSG_WriteShort(to->pmove.origin[2]);
+        p = put_short(p, to->pmove.origin[2]);
 
     //
     // write the rest of the player_state_t
     //
     if (pflags & PPS_VIEWOFFSET) {
-        MSG_WriteChar(to->viewoffset[0]);
-        MSG_WriteChar(to->viewoffset[1]);
-        MSG_WriteChar(to->viewoffset[2]);
+        *p++ = to->viewoffset[0];
+        *p++ = to->viewoffset[1];
+        *p++ = to->viewoffset[2];
     }
 
     if (pflags & PPS_VIEWANGLES) {
-        MSG_WriteShort(to->viewangles[0]);
-        MSG_WriteShort(to->viewangles[1]);
+        p = put_short(p, to->viewangles[0]);
+        p = put_short(p, to->viewangles[1]);
     }
 
     if (pflags & PPS_VIEWANGLE2)
-        MSG_WriteShort(to->viewangles[2]);
+        p = put_short(p, to->viewangles[2]);
 
     if (pflags & PPS_KICKANGLES) {
-        MSG_WriteChar(to->kick_angles[0]);
-        MSG_WriteChar(to->kick_angles[1]);
-        MSG_WriteChar(to->kick_angles[2]);
+        *p++ = to->kick_angles[0];
+        *p++ = to->kick_angles[1];
+        *p++ = to->kick_angles[2];
     }
 
     if (pflags & PPS_WEAPONINDEX)
-        MSG_WriteByte(to->gunindex);
+        *p++ = to->gunindex;
 
     if (pflags & PPS_WEAPONFRAME)
-        MSG_WriteByte(to->gunframe);
+        *p++ = to->gunframe;
 
     if (pflags & PPS_GUNOFFSET) {
-        MSG_WriteChar(to->gunoffset[0]);
-        MSG_WriteChar(to->gunoffset[1]);
-        MSG_WriteChar(to->gunoffset[2]);
+        *p++ = to->gunoffset[0];
+        *p++ = to->gunoffset[1];
+        *p++ = to->gunoffset[2];
     }
 
     if (pflags & PPS_GUNANGLES) {
-        MSG_WriteChar(to->gunangles[0]);
-        MSG_WriteChar(to->gunangles[1]);
-        MSG_WriteChar(to->gunangles[2]);
+        *p++ = to->gunangles[0];
+        *p++ = to->gunangles[1];
+        *p++ = to->gunangles[2];
     }
 
     if (pflags & PPS_BLEND) {
-        MSG_WriteByte(to->blend[0]);
-        MSG_WriteByte(to->blend[1]);
-        MSG_WriteByte(to->blend[2]);
-        MSG_WriteByte(to->blend[3]);
+        *p++ = to->blend[0];
+        *p++ = to->blend[1];
+        *p++ = to->blend[2];
+        *p++ = to->blend[3];
     }
 
     if (pflags & PPS_FOV)
-        MSG_WriteByte(to->fov);
+        *p++ = to->fov;
 
     if (pflags & PPS_RDFLAGS)
-        MSG_WriteByte(to->rdflags);
+        *p++ = to->rdflags;
 
     // send stats
     if (pflags & PPS_STATS) {
-        MSG_WriteLong(statbits);
+        p = put_long(p, statbits);
         for (i = 0; i < MAX_STATS; i++)
             if (statbits & (1 << i))
-                MSG_WriteShort(to->stats[i]);
+                p = put_short(p, to->stats[i]);
     }
+
+    MSG_WriteData(buffer, p - buffer);
 }
 
 #endif // USE_MVD_SERVER || USE_MVD_CLIENT
@@ -1722,10 +1852,12 @@ void MSG_ReadDeltaUsercmd_Hacked(const usercmd_t *from, usercmd_t *to)
 
 int MSG_ReadBits(int bits)
 {
-    int i, get;
     size_t bitpos;
     qboolean sgn;
-    int value;
+    int value, shift, i;
+    uint64_t v;
+    uint32_t w;
+    byte *p;
 
     if (bits == 0 || bits < -31 || bits > 32) {
         Com_Error(ERR_FATAL, "MSG_ReadBits: bad bits: %d", bits);
@@ -1758,11 +1890,22 @@ int MSG_ReadBits(int bits)
         sgn = qtrue;
     }
 
-    value = 0;
-    for (i = 0; i < bits; i++, bitpos++) {
-        get = (msg_read.data[bitpos >> 3] >> (bitpos & 7)) & 1;
-        value |= get << i;
+    // fetch up to 5 bytes covering the bits in one go, falling back to
+    // single bytes only near the very end of the buffer
+    p = msg_read.data + (bitpos >> 3);
+    shift = bitpos & 7;
+    if (msg_read.maxsize - (bitpos >> 3) >= 5) {
+        memcpy(&w, p, 4);
+        v = LittleLong(w) | (uint64_t)p[4] << 32;
+    } else {
+        v = 0;
+        for (i = 0; i < (shift + bits + 7) >> 3; i++) {
+            v |= (uint64_t)p[i] << (i * 8);
+        }
     }
+    value = (v >> shift) & (0xffffffffU >> (32 - bits));
+
+    bitpos += bits;
     msg_read.bitpos = bitpos;
     msg_read.readcount = (bitpos + 7) >> 3;
 
@@ -2248,6 +2391,66 @@ void MSG_ParseDeltaPlayerstate_Enhanced(const player_state_t    *from,
 
 }
 
+/*
+===================
+MSG_UnpackEntity
+
+Inverse of MSG_PackEntity, gives the same values parsing a full delta would.
+Packed byte angles are kept shifted up, so both precisions unpack alike.
+===================
+*/
+void MSG_UnpackEntity(entity_state_t *out, const entity_packed_t *in)
+{
+    int i;
+
+    out->number = in->number;
+    for (i = 0; i < 3; i++) {
+        out->origin[i] = SHORT2COORD(in->origin[i]);
+        out->angles[i] = SHORT2ANGLE(in->angles[i]);
+        out->old_origin[i] = SHORT2COORD(in->old_origin[i]);
+    }
+    out->modelindex = in->modelindex;
+    out->modelindex2 = in->modelindex2;
+    out->modelindex3 = in->modelindex3;
+    out->modelindex4 = in->modelindex4;
+    out->skinnum = in->skinnum;
+    out->effects = in->effects;
+    out->renderfx = in->renderfx;
+    out->solid = in->solid;
+    out->frame = in->frame;
+    out->sound = in->sound;
+    out->event = in->event;
+}
+
+/*
+===================
+MSG_UnpackPlayer
+
+Inverse of MSG_PackPlayer.
+===================
+*/
+void MSG_UnpackPlayer(player_state_t *out, const player_packed_t *in)
+{
+    int i;
+
+    out->pmove = in->pmove;
+    for (i = 0; i < 3; i++) {
+        out->viewangles[i] = SHORT2ANGLE(in->viewangles[i]);
+        out->viewoffset[i] = in->viewoffset[i] * 0.25f;
+        out->kick_angles[i] = in->kick_angles[i] * 0.25f;
+        out->gunoffset[i] = in->gunoffset[i] * 0.25f;
+        out->gunangles[i] = in->gunangles[i] * 0.25f;
+    }
+    out->gunindex = in->gunindex;
+    out->gunframe = in->gunframe;
+    for (i = 0; i < 4; i++)
+        out->blend[i] = in->blend[i] / 255.0f;
+    out->fov = in->fov;
+    out->rdflags = in->rdflags;
+    for (i = 0; i < MAX_STATS; i++)
+        out->stats[i] = in->stats[i];
+}
+
 #endif // USE_CLIENT
 
 #if USE_MVD_CLIENT
@@ -2546,6 +2749,8 @@ const char *MSG_ServerCommandString(int cmd)
         S(zpacket)
         S(zdownload)
         S(gamestate)
+        S(setting)
+        S(loopframe)
 #undef S
     }
 }
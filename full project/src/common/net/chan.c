@@ -204,6 +204,7 @@ static size_t NetchanOld_Transmit(netchan_t *netchan, size_t length, const void
     if (netchan->incoming_acknowledged > chan->last_reliable_sequence &&
         chan->incoming_reliable_acknowledged != chan->reliable_sequence) {
         send_reliable = qtrue;
+        netchan->total_retransmits++;
     }
 
 // if the reliable transmit buffer is empty, copy the current message out
@@ -270,6 +271,7 @@ static size_t NetchanOld_Transmit(netchan_t *netchan, size_t length, const void
     netchan->outgoing_sequence++;
     netchan->reliable_ack_pending = qfalse;
     netchan->last_sent = com_localTime;
+    netchan->total_bytes_out += send.cursize * numpackets;
 
     return send.cursize * numpackets;
 }
@@ -290,6 +292,7 @@ static qboolean NetchanOld_Process(netchan_t *netchan)
 
 // get sequence numbers
     MSG_BeginReading();
+    netchan->total_bytes_in += msg_read.cursize;
     sequence = MSG_ReadLong();
     sequence_ack = MSG_ReadLong();
 
@@ -438,7 +441,8 @@ static size_t NetchanNew_TransmitNextFragment(netchan_t *netchan)
 {
     netchan_new_t *chan = (netchan_new_t *)netchan;
     sizebuf_t   send;
-    byte        send_buf[MAX_PACKETLEN];
+    byte        send_buf[16];
+    netvec_t    vec[2];
     qboolean    send_reliable;
     uint32_t    w1, w2;
     uint16_t    offset;
@@ -465,54 +469,57 @@ static size_t NetchanNew_TransmitNextFragment(netchan_t *netchan)
     }
 #endif
 
-    fragment_length = chan->fragment_out.cursize - chan->fragment_out.readcount;
+    fragment_length = chan->fragment_length - chan->fragment_offset;
     if (fragment_length > netchan->maxpacketlen) {
         fragment_length = netchan->maxpacketlen;
     }
 
     more_fragments = qtrue;
-    if (chan->fragment_out.readcount + fragment_length ==
-        chan->fragment_out.cursize) {
+    if (chan->fragment_offset + fragment_length == chan->fragment_length) {
         more_fragments = qfalse;
     }
 
     // write fragment offset
-    offset = (chan->fragment_out.readcount & 0x7FFF) |
-             (more_fragments << 15);
+    offset = (chan->fragment_offset & 0x7FFF) | (more_fragments << 15);
     SZ_WriteShort(&send, offset);
 
-    // write fragment contents
-    SZ_Write(&send, chan->fragment_out.data + chan->fragment_out.readcount,
-             fragment_length);
+    // fragment contents are sent right out of the buffer
+    vec[0].data = send.data;
+    vec[0].len = send.cursize;
+    vec[1].data = chan->fragment_data + chan->fragment_offset;
+    vec[1].len = fragment_length;
 
     SHOWPACKET("send %4"PRIz" : s=%d ack=%d rack=%d "
                "fragment_offset=%"PRIz" more_fragments=%d",
-               send.cursize,
+               send.cursize + fragment_length,
                netchan->outgoing_sequence,
                netchan->incoming_sequence,
                chan->incoming_reliable_sequence,
-               chan->fragment_out.readcount,
+               chan->fragment_offset,
                more_fragments);
     if (send_reliable) {
         SHOWPACKET(" reliable=%i ", chan->reliable_sequence);
     }
     SHOWPACKET("\n");
 
-    chan->fragment_out.readcount += fragment_length;
+    chan->fragment_offset += fragment_length;
     netchan->fragment_pending = more_fragments;
+    netchan->total_bytes_out += send.cursize + fragment_length;
+    netchan->total_fragments_out++;
 
-    // if the message has been sent completely, clear the fragment buffer
+    // if the message has been sent completely, clear the fragment state.
+    // the data itself stays intact until the next message.
     if (!netchan->fragment_pending) {
         netchan->outgoing_sequence++;
         netchan->last_sent = com_localTime;
-        SZ_Clear(&chan->fragment_out);
+        chan->fragment_length = 0;
+        chan->fragment_offset = 0;
     }
 
     // send the datagram
-    NET_SendPacket(netchan->sock, send.data, send.cursize,
-                   &netchan->remote_address);
+    NET_SendPacketv(netchan->sock, vec, 2, &netchan->remote_address);
 
-    return send.cursize;
+    return send.cursize + fragment_length;
 }
 
 /*
@@ -547,6 +554,7 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
     if (netchan->incoming_acknowledged > chan->last_reliable_sequence &&
         chan->incoming_reliable_acknowledged != chan->reliable_sequence) {
         send_reliable = qtrue;
+        netchan->total_retransmits++;
     }
 
 // if the reliable transmit buffer is empty, copy the current message out
@@ -561,17 +569,26 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
 
     if (length > netchan->maxpacketlen || (send_reliable &&
                                            (netchan->reliable_length + length > netchan->maxpacketlen))) {
+        // fragment the reliable message in place. reliable_buf doesn't
+        // change until the last fragment is out, and only reliable_length
+        // bytes of it are ever resent, so the unreliable part can go after.
         if (send_reliable) {
             chan->last_reliable_sequence = netchan->outgoing_sequence;
-            SZ_Write(&chan->fragment_out, chan->reliable_buf,
-                     netchan->reliable_length);
+            chan->fragment_data = chan->reliable_buf;
+            chan->fragment_length = netchan->reliable_length;
+        } else {
+            chan->fragment_data = chan->fragment_out_buf;
+            chan->fragment_length = 0;
         }
         // add the unreliable part if space is available
-        if (chan->fragment_out.maxsize - chan->fragment_out.cursize >= length)
-            SZ_Write(&chan->fragment_out, data, length);
-        else
+        if (MAX_MSGLEN - chan->fragment_length >= length) {
+            memcpy(chan->fragment_data + chan->fragment_length, data, length);
+            chan->fragment_length += length;
+        } else {
             Com_WPrintf("%s: dumped unreliable\n",
                         NET_AdrToString(&netchan->remote_address));
+        }
+        chan->fragment_offset = 0;
         return NetchanNew_TransmitNextFragment(netchan);
     }
 
@@ -620,6 +637,7 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
     netchan->outgoing_sequence++;
     netchan->reliable_ack_pending = qfalse;
     netchan->last_sent = com_localTime;
+    netchan->total_bytes_out += send.cursize * numpackets;
 
     return send.cursize * numpackets;
 }
@@ -639,6 +657,7 @@ static qboolean NetchanNew_Process(netchan_t *netchan)
 
 // get sequence numbers
     MSG_BeginReading();
+    netchan->total_bytes_in += msg_read.cursize;
     sequence = MSG_ReadLong();
     sequence_ack = MSG_ReadLong();
 
@@ -735,16 +754,24 @@ static qboolean NetchanNew_Process(netchan_t *netchan)
             return qfalse;
         }
 
-        SZ_Write(&chan->fragment_in, msg_read.data +
-                 msg_read.readcount, length);
+        netchan->total_fragments_in++;
+
         if (more_fragments) {
+            SZ_Write(&chan->fragment_in, msg_read.data +
+                     msg_read.readcount, length);
             return qfalse;
         }
 
-        // message has been sucessfully assembled
+        // message has been sucessfully assembled. the last fragment is
+        // moved into place right in the read buffer instead of going
+        // through fragment_in.
+        memmove(msg_read.data + chan->fragment_in.cursize,
+                msg_read.data + msg_read.readcount, length);
+        memcpy(msg_read.data, chan->fragment_in.data,
+               chan->fragment_in.cursize);
+        length += chan->fragment_in.cursize;
         SZ_Clear(&msg_read);
-        SZ_Write(&msg_read, chan->fragment_in.data,
-                 chan->fragment_in.cursize);
+        msg_read.cursize = length;
         SZ_Clear(&chan->fragment_in);
     }
 
@@ -781,7 +808,7 @@ static qboolean NetchanNew_ShouldUpdate(netchan_t *netchan)
 
     if (netchan->message.cursize ||
         netchan->reliable_ack_pending ||
-        chan->fragment_out.cursize ||
+        chan->fragment_length ||
         com_localTime - netchan->last_sent > 1000) {
         return qtrue;
     }
@@ -821,8 +848,6 @@ static netchan_t *NetchanNew_Setup(netsrc_t sock, const netadr_t *adr,
             sizeof(chan->message_buf));
     SZ_TagInit(&chan->fragment_in, chan->fragment_in_buf,
                sizeof(chan->fragment_in_buf), SZ_NC_FRG_IN);
-    SZ_TagInit(&chan->fragment_out, chan->fragment_out_buf,
-               sizeof(chan->fragment_out_buf), SZ_NC_FRG_OUT);
 
     return netchan;
 }
@@ -20,6 +20,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // net.c
 //
 
+#ifdef __linux__
+#define _GNU_SOURCE     // for sendmmsg() and recvmmsg()
+#endif
+
 #include "shared/shared.h"
 #include "common/common.h"
 #include "common/cvar.h"
@@ -34,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "client/client.h"
 #include "server/server.h"
 #include "system/system.h"
+#include "system/thread.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -47,6 +52,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <netdb.h>
 #include <sys/param.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #ifdef __linux__
 #include <linux/types.h>
@@ -60,6 +66,42 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // prevents infinite retry loops caused by broken TCP/IP stacks
 #define MAX_ERROR_RETRIES   64
 
+// move several UDP packets per system call where supported
+#if (defined __linux__) && (defined MSG_WAITFORONE)
+#define USE_MMSG    1
+#define MAX_UDP_BATCH   32
+
+typedef struct {
+    byte                data[MAX_UDP_BATCH][MAX_PACKETLEN];
+    struct sockaddr_in  addrs[MAX_UDP_BATCH];
+    netadr_t            to[MAX_UDP_BATCH];
+    struct iovec        iov[MAX_UDP_BATCH];
+    struct mmsghdr      msgs[MAX_UDP_BATCH];
+    int                 count;
+} udpbatch_t;
+#else
+#define USE_MMSG    0
+#endif
+
+// share the server port between several sockets, each read by its own thread
+#if (defined __linux__) && (defined SO_REUSEPORT)
+#define USE_RECV_THREADS    1
+#define MAX_RECV_THREADS    8
+#define RECV_QUEUE_SIZE     256     // must be a power of two
+
+typedef struct {
+    netadr_t    from;
+    size_t      len;
+    byte        data[MAX_PACKETLEN];
+} recvpacket_t;
+#else
+#define USE_RECV_THREADS    0
+#endif
+
+// UDP_OpenSocket flags
+#define UDP_REUSEPORT   1   // join the port's SO_REUSEPORT group
+#define UDP_NOERRQUEUE  2   // nobody drains ICMP errors on this socket
+
 #if USE_CLIENT
 
 #define MAX_LOOPBACK    4
@@ -103,11 +145,23 @@ static cvar_t   *net_tcp_backlog;
 static cvar_t   *net_ignore_icmp;
 #endif
 
+#if USE_MMSG
+static cvar_t   *net_batch;
+#endif
+
+#if USE_RECV_THREADS
+static cvar_t   *net_recv_threads;
+#endif
+
+static cvar_t   *net_oob_limit;
+static cvar_t   *net_oob_burst;
+
 static netflag_t    net_active;
 static int          net_error;
 
 static qsocket_t    udp_sockets[NS_COUNT] = { -1, -1 };
-static qsocket_t    tcp_socket = -1;
+static qsocket_t    tcp_sockets[NL_COUNT] = { -1, -1 };
+static int          tcp_ports[NL_COUNT];
 
 #ifdef _DEBUG
 static qhandle_t    net_logFile;
@@ -116,6 +170,27 @@ static qhandle_t    net_logFile;
 static ioentry_t    io_entries[FD_SETSIZE];
 static int          io_numfds;
 
+#if USE_MMSG
+static udpbatch_t   recv_batch;
+static udpbatch_t   send_batch;
+static netsrc_t     send_batch_sock;
+static qboolean     send_batching;
+#endif
+
+#if USE_RECV_THREADS
+static struct {
+    qthread_t       *threads[MAX_RECV_THREADS];
+    qsocket_t       sockets[MAX_RECV_THREADS];
+    int             numthreads;
+    volatile qboolean   quit;
+    qmutex_t        *lock;
+    recvpacket_t    *queue;     // [RECV_QUEUE_SIZE]
+    unsigned        head;
+    unsigned        tail;
+    int             wake[2];    // written when the queue becomes non-empty
+} rt;
+#endif
+
 // current rate measurement
 static unsigned     net_rate_time;
 static size_t       net_rate_rcvd;
@@ -133,6 +208,8 @@ static uint64_t     net_bytes_rcvd;
 static uint64_t     net_bytes_sent;
 static uint64_t     net_packets_rcvd;
 static uint64_t     net_packets_sent;
+static uint64_t     net_oob_dropped;
+static uint64_t     net_oob_floods;
 
 //=============================================================================
 
@@ -310,6 +387,8 @@ static void logfile_open(void)
         } else {
             mode |= FS_BUF_LINE;
         }
+    } else {
+        mode |= FS_FLAG_ASYNC;  // flushed modes must survive a crash
     }
 
     f = FS_EasyOpenFile(buffer, sizeof(buffer), mode | FS_FLAG_TEXT,
@@ -347,8 +426,10 @@ NET_LogPacket
 static void NET_LogPacket(const netadr_t *address, const char *prefix,
                           const byte *data, size_t length)
 {
-    int numRows;
-    int i, j, c;
+    static const char hex[16] = "0123456789abcdef";
+    char buffer[4096], *p;
+    size_t i, j;
+    int c;
 
     if (!net_logFile) {
         return;
@@ -357,29 +438,41 @@ static void NET_LogPacket(const netadr_t *address, const char *prefix,
     FS_FPrintf(net_logFile, "%u : %s : %s : %"PRIz" bytes\n",
                com_localTime, prefix, NET_AdrToString(address), length);
 
-    numRows = (length + 15) / 16;
-    for (i = 0; i < numRows; i++) {
-        FS_FPrintf(net_logFile, "%04x : ", i * 16);
+    // rows are formatted in batches and written in one go
+    p = buffer;
+    for (i = 0; i < length; i += 16) {
+        p += Q_scnprintf(p, 16, "%04x : ", (unsigned)i);
         for (j = 0; j < 16; j++) {
-            if (i * 16 + j < length) {
-                FS_FPrintf(net_logFile, "%02x ", data[i * 16 + j]);
+            if (i + j < length) {
+                c = data[i + j];
+                *p++ = hex[c >> 4];
+                *p++ = hex[c & 15];
             } else {
-                FS_FPrintf(net_logFile, "   ");
+                *p++ = ' ';
+                *p++ = ' ';
             }
+            *p++ = ' ';
         }
-        FS_FPrintf(net_logFile, ": ");
+        *p++ = ':';
+        *p++ = ' ';
         for (j = 0; j < 16; j++) {
-            if (i * 16 + j < length) {
-                c = data[i * 16 + j];
-                FS_FPrintf(net_logFile, "%c", Q_isprint(c) ? c : '.');
+            if (i + j < length) {
+                c = data[i + j];
+                *p++ = Q_isprint(c) ? c : '.';
             } else {
-                FS_FPrintf(net_logFile, " ");
+                *p++ = ' ';
             }
         }
-        FS_FPrintf(net_logFile, "\n");
+        *p++ = '\n';
+
+        if (p - buffer > sizeof(buffer) - 128) {
+            FS_Write(buffer, p - buffer, net_logFile);
+            p = buffer;
+        }
     }
+    *p++ = '\n';
 
-    FS_FPrintf(net_logFile, "\n");
+    FS_Write(buffer, p - buffer, net_logFile);
 }
 
 #endif
@@ -442,10 +535,22 @@ static void NET_Stats_f(void)
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64" (send/recv)\n",
                net_send_errors, net_recv_errors);
 #endif
+    Com_Printf("Connectionless packets dropped: %"PRIu64" (%"PRIu64" floods)\n",
+               net_oob_dropped, net_oob_floods);
     Com_Printf("Current upload rate: %"PRIz" bytes/sec\n", net_rate_up);
     Com_Printf("Current download rate: %"PRIz" bytes/sec\n", net_rate_dn);
 }
 
+// lifetime statistics for external reporting
+void NET_GetCounters(netcounters_t *c)
+{
+    c->bytes_rcvd = net_bytes_rcvd;
+    c->bytes_sent = net_bytes_sent;
+    c->packets_rcvd = net_packets_rcvd;
+    c->packets_sent = net_packets_sent;
+    c->oob_dropped = net_oob_dropped;
+}
+
 static size_t NET_UpRate_m(char *buffer, size_t size)
 {
     return Q_scnprintf(buffer, size, "%"PRIz, net_rate_up);
@@ -458,6 +563,16 @@ static size_t NET_DnRate_m(char *buffer, size_t size)
 
 //=============================================================================
 
+static void NET_GatherPacket(byte *buf, const netvec_t *vec, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        memcpy(buf, vec[i].data, vec[i].len);
+        buf += vec[i].len;
+    }
+}
+
 #if USE_CLIENT
 
 static void NET_GetLoopPackets(netsrc_t sock, void (*packet_cb)(void))
@@ -493,8 +608,8 @@ static void NET_GetLoopPackets(netsrc_t sock, void (*packet_cb)(void))
     }
 }
 
-static qboolean NET_SendLoopPacket(netsrc_t sock, const void *data,
-                                   size_t len, const netadr_t *to)
+static qboolean NET_SendLoopPacket(netsrc_t sock, const netvec_t *vec,
+                                   int count, size_t len, const netadr_t *to)
 {
     loopback_t *loop;
     loopmsg_t *msg;
@@ -508,12 +623,12 @@ static qboolean NET_SendLoopPacket(netsrc_t sock, const void *data,
     msg = &loop->msgs[loop->send & (MAX_LOOPBACK - 1)];
     loop->send++;
 
-    memcpy(msg->data, data, len);
+    NET_GatherPacket(msg->data, vec, count);
     msg->datalen = len;
 
 #ifdef _DEBUG
     if (net_log_enable->integer > 1) {
-        NET_LogPacket(to, "LP send", data, len);
+        NET_LogPacket(to, "LP send", msg->data, len);
     }
 #endif
     if (sock == NS_CLIENT) {
@@ -616,14 +731,14 @@ void NET_RemoveFd(qsocket_t fd)
 
 /*
 =============
-NET_Sleep
+NET_Wait
 
-Sleeps msec or until some file descriptor is ready. Implementation is not
+Sleeps usec or until some file descriptor is ready. Implementation is not
 terribly efficient, but that's fine for a small number of descriptors we
 typically have.
 =============
 */
-int NET_Sleep(int msec)
+static int NET_Wait(unsigned usec)
 {
     struct timeval tv;
     fd_set rfds, wfds, efds;
@@ -633,7 +748,7 @@ int NET_Sleep(int msec)
 
     if (!io_numfds) {
         // don't bother with select()
-        Sys_Sleep(msec);
+        Sys_Sleep((usec + 999) / 1000);
         return 0;
     }
 
@@ -654,8 +769,8 @@ int NET_Sleep(int msec)
         if (e->wantexcept) FD_SET(fd, &efds);
     }
 
-    tv.tv_sec = msec / 1000;
-    tv.tv_usec = (msec % 1000) * 1000;
+    tv.tv_sec = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
 
     ret = os_select(io_numfds, &rfds, &wfds, &efds, &tv);
     if (ret == -1) {
@@ -680,6 +795,51 @@ int NET_Sleep(int msec)
     return ret;
 }
 
+/*
+=============
+NET_Sleep
+
+Sleeps msec or until some file descriptor is ready.
+=============
+*/
+int NET_Sleep(int msec)
+{
+    return NET_Wait(msec * 1000);
+}
+
+// granularity of waiting out the last millisecond before a deadline
+#define SLEEP_STEP_USEC     200
+
+/*
+=============
+NET_SleepUntil
+
+Sleeps until Sys_Milliseconds reaches the given time or some file descriptor
+is ready, checking descriptors at least once. Whole millisecond timeouts
+overshoot by up to a millisecond, since the phase of the millisecond clock
+is unknown, so the last millisecond is waited out in short steps.
+=============
+*/
+int NET_SleepUntil(unsigned time)
+{
+    unsigned usec;
+    int ret, left;
+
+    while (1) {
+        left = (int)(time - Sys_Milliseconds());
+        if (left > 1)
+            usec = (left - 1) * 1000;
+        else if (left > 0)
+            usec = SLEEP_STEP_USEC;
+        else
+            usec = 0;
+
+        ret = NET_Wait(usec);
+        if (ret || left <= 0)
+            return ret;
+    }
+}
+
 #if USE_AC_SERVER
 
 /*
@@ -756,6 +916,143 @@ int NET_Sleepv(int msec, ...)
 
 //=============================================================================
 
+/*
+Connectionless packets arriving on the server socket pass a token bucket
+kept per source address in a fixed size hash table, before anything looks
+at their contents. A few flooding addresses are then dropped for the cost
+of a table lookup instead of being tokenized and parsed. Colliding sources
+take over the slot with a full bucket, which only makes the filter more
+lenient.
+*/
+
+#define OOB_FILTER_BITS     12
+#define OOB_FILTER_SIZE     (1 << OOB_FILTER_BITS)
+
+typedef struct {
+    uint32_t    addr;
+    unsigned    time;       // of the last packet, 0 if slot is free
+    unsigned    credit;     // in 1/1000 of a packet
+    qboolean    flooding;   // dropped since the bucket was last full
+} oobsource_t;
+
+static oobsource_t  oob_sources[OOB_FILTER_SIZE];
+
+static qboolean NET_OobFlooded(const netadr_t *from, const byte *data, size_t len)
+{
+    oobsource_t *s;
+    unsigned now, cap, rate;
+    uint64_t credit;
+    qboolean ret;
+
+    if (net_oob_limit->integer <= 0)
+        return qfalse;
+
+    if (len < 4 || *(int *)data != -1)
+        return qfalse;
+
+    rate = net_oob_limit->integer;
+    cap = max(net_oob_burst->integer, 1) * 1000U;
+    now = Sys_Milliseconds();
+    if (!now)
+        now = 1;
+
+#if USE_RECV_THREADS
+    if (rt.lock)
+        Sys_LockMutex(rt.lock);
+#endif
+
+    s = &oob_sources[(from->ip.u32 * 0x9e3779b1U) >> (32 - OOB_FILTER_BITS)];
+    if (s->addr != from->ip.u32 || !s->time) {
+        s->addr = from->ip.u32;
+        s->credit = cap;
+        s->flooding = qfalse;
+    } else {
+        credit = s->credit + (uint64_t)(now - s->time) * rate;
+        s->credit = min(credit, cap);
+    }
+    s->time = now;
+
+    // a flood is over once the source lets its bucket fill up again
+    if (s->credit == cap)
+        s->flooding = qfalse;
+
+    if (s->credit >= 1000) {
+        s->credit -= 1000;
+        ret = qfalse;
+    } else {
+        if (!s->flooding)
+            net_oob_floods++;
+        s->flooding = qtrue;
+        net_oob_dropped++;
+        ret = qtrue;
+    }
+
+#if USE_RECV_THREADS
+    if (rt.lock)
+        Sys_UnlockMutex(rt.lock);
+#endif
+
+    return ret;
+}
+
+static void NET_ReadPacket(void (*packet_cb)(void), size_t len)
+{
+#ifdef _DEBUG
+    if (net_log_enable->integer)
+        NET_LogPacket(&net_from, "UDP recv", msg_read_buffer, len);
+#endif
+
+    net_rate_rcvd += len;
+    net_bytes_rcvd += len;
+    net_packets_rcvd++;
+
+    SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
+    msg_read.cursize = len;
+
+    (*packet_cb)();
+}
+
+#if USE_MMSG
+// returns qfalse once the socket is drained, qtrue if an error
+// has to be dealt with by the single packet path
+static qboolean NET_GetUdpBatches(netsrc_t sock, void (*packet_cb)(void))
+{
+    udpbatch_t *b = &recv_batch;
+    int i, ret;
+
+    while (1) {
+        for (i = 0; i < MAX_UDP_BATCH; i++) {
+            memset(&b->msgs[i], 0, sizeof(b->msgs[i]));
+            b->iov[i].iov_base = b->data[i];
+            b->iov[i].iov_len = MAX_PACKETLEN;
+            b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+            b->msgs[i].msg_hdr.msg_iovlen = 1;
+            b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+            b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+        }
+
+        ret = os_udp_recvv(sock, b->msgs, MAX_UDP_BATCH);
+        if (ret == NET_AGAIN)
+            return qfalse;
+        if (ret == NET_ERROR)
+            return qtrue;
+
+        for (i = 0; i < ret; i++) {
+            NET_SockadrToNetadr(&b->addrs[i], &net_from);
+            if (sock == NS_SERVER &&
+                NET_OobFlooded(&net_from, b->data[i], b->msgs[i].msg_len))
+                continue;
+            memcpy(msg_read_buffer, b->data[i], b->msgs[i].msg_len);
+            NET_ReadPacket(packet_cb, b->msgs[i].msg_len);
+        }
+    }
+}
+#endif
+
+#if USE_RECV_THREADS
+static void NET_GetQueuedPackets(void (*packet_cb)(void));
+#endif
+
 static void NET_GetUdpPackets(netsrc_t sock, void (*packet_cb)(void))
 {
     ioentry_t *e;
@@ -768,6 +1065,13 @@ static void NET_GetUdpPackets(netsrc_t sock, void (*packet_cb)(void))
     if (!e->canread)
         return;
 
+#if USE_MMSG
+    if (net_batch->integer && !NET_GetUdpBatches(sock, packet_cb)) {
+        e->canread = qfalse;
+        return;
+    }
+#endif
+
     while (1) {
         ret = os_udp_recv(sock, msg_read_buffer, MAX_PACKETLEN, &net_from);
         if (ret == NET_AGAIN) {
@@ -782,19 +1086,10 @@ static void NET_GetUdpPackets(netsrc_t sock, void (*packet_cb)(void))
             break;
         }
 
-#ifdef _DEBUG
-        if (net_log_enable->integer)
-            NET_LogPacket(&net_from, "UDP recv", msg_read_buffer, ret);
-#endif
-
-        net_rate_rcvd += ret;
-        net_bytes_rcvd += ret;
-        net_packets_rcvd++;
-
-        SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
-        msg_read.cursize = ret;
+        if (sock == NS_SERVER && NET_OobFlooded(&net_from, msg_read_buffer, ret))
+            continue;
 
-        (*packet_cb)();
+        NET_ReadPacket(packet_cb, ret);
     }
 }
 
@@ -818,6 +1113,146 @@ void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
 
     // process UDP packets
     NET_GetUdpPackets(sock, packet_cb);
+
+#if USE_RECV_THREADS
+    // process packets received by other threads
+    if (sock == NS_SERVER)
+        NET_GetQueuedPackets(packet_cb);
+#endif
+}
+
+static void NET_SentPacket(const netadr_t *to, const netvec_t *vec,
+                           int count, size_t len, ssize_t ret)
+{
+    if (ret < len)
+        Com_WPrintf("NET_SendPacket: short send to %s\n",
+                    NET_AdrToString(to));
+
+#ifdef _DEBUG
+    if (net_log_enable->integer) {
+        byte buf[MAX_PACKETLEN];
+
+        NET_GatherPacket(buf, vec, count);
+        NET_LogPacket(to, "UDP send", buf, ret);
+    }
+#endif
+
+    net_rate_sent += ret;
+    net_bytes_sent += ret;
+    net_packets_sent++;
+}
+
+static qboolean NET_SendUdpPacket(netsrc_t sock, const netvec_t *vec,
+                                  int count, size_t len, const netadr_t *to)
+{
+    ssize_t ret;
+
+    ret = os_udp_send(sock, vec, count, to);
+    if (ret == NET_AGAIN)
+        return qfalse;
+
+    if (ret == NET_ERROR) {
+        Com_DPrintf("NET_SendPacket: %s to %s\n",
+                    NET_ErrorString(), NET_AdrToString(to));
+        net_send_errors++;
+        return qfalse;
+    }
+
+    NET_SentPacket(to, vec, count, len, ret);
+    return qtrue;
+}
+
+#if USE_MMSG
+static void NET_QueuePacket(const netvec_t *vec, int count, size_t len,
+                            const netadr_t *to)
+{
+    udpbatch_t *b = &send_batch;
+    int i;
+
+    if (b->count == MAX_UDP_BATCH) {
+        NET_FlushPackets(send_batch_sock);
+    }
+
+    i = b->count++;
+    NET_GatherPacket(b->data[i], vec, count);
+    b->to[i] = *to;
+    NET_NetadrToSockadr(to, &b->addrs[i]);
+
+    memset(&b->msgs[i], 0, sizeof(b->msgs[i]));
+    b->iov[i].iov_base = b->data[i];
+    b->iov[i].iov_len = len;
+    b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+    b->msgs[i].msg_hdr.msg_iovlen = 1;
+    b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+    b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+}
+#endif
+
+/*
+=============
+NET_BatchPackets
+
+Queues UDP packets sent on this socket until NET_FlushPackets is called.
+Does nothing where batched sends are not supported.
+=============
+*/
+void NET_BatchPackets(netsrc_t sock)
+{
+#if USE_MMSG
+    if (send_batching) {
+        NET_FlushPackets(send_batch_sock);
+    }
+    if (net_batch->integer) {
+        send_batch_sock = sock;
+        send_batching = qtrue;
+    }
+#endif
+}
+
+/*
+=============
+NET_FlushPackets
+
+Sends queued packets and stops queueing.
+=============
+*/
+void NET_FlushPackets(netsrc_t sock)
+{
+#if USE_MMSG
+    udpbatch_t *b = &send_batch;
+    netvec_t vec;
+    int i, j, ret;
+
+    if (!send_batching || sock != send_batch_sock) {
+        return;
+    }
+
+    send_batching = qfalse;
+
+    for (i = 0; i < b->count && udp_sockets[sock] != -1; ) {
+        ret = os_udp_sendv(sock, b->msgs + i, b->count - i);
+        if (ret == NET_AGAIN)
+            break;
+
+        if (ret == NET_ERROR) {
+            // let the single packet path sort out ICMP errors
+            vec.data = b->data[i];
+            vec.len = b->iov[i].iov_len;
+            NET_SendUdpPacket(sock, &vec, 1, vec.len, &b->to[i]);
+            i++;
+            continue;
+        }
+
+        for (j = i; j < i + ret; j++) {
+            vec.data = b->data[j];
+            vec.len = b->iov[j].iov_len;
+            NET_SentPacket(&b->to[j], &vec, 1, vec.len, b->msgs[j].msg_len);
+        }
+        i += ret;
+    }
+
+    b->count = 0;
+#endif
 }
 
 /*
@@ -829,7 +1264,34 @@ NET_SendPacket
 qboolean NET_SendPacket(netsrc_t sock, const void *data,
                         size_t len, const netadr_t *to)
 {
-    ssize_t ret;
+    netvec_t vec;
+
+    vec.data = data;
+    vec.len = len;
+    return NET_SendPacketv(sock, &vec, 1, to);
+}
+
+/*
+=============
+NET_SendPacketv
+
+Sends a packet gathered from up to MAX_NETVEC pieces, so that callers
+can send a header and a slice of a larger buffer without copying them
+together first.
+=============
+*/
+qboolean NET_SendPacketv(netsrc_t sock, const netvec_t *vec,
+                         int count, const netadr_t *to)
+{
+    size_t len;
+    int i;
+
+    if (count < 1 || count > MAX_NETVEC) {
+        Com_Error(ERR_FATAL, "%s: bad count: %d", __func__, count);
+    }
+
+    for (i = 0, len = 0; i < count; i++)
+        len += vec[i].len;
 
     if (len == 0)
         return qfalse;
@@ -842,42 +1304,190 @@ qboolean NET_SendPacket(netsrc_t sock, const void *data,
 
 #if USE_CLIENT
     if (to->type == NA_LOOPBACK)
-        return NET_SendLoopPacket(sock, data, len, to);
+        return NET_SendLoopPacket(sock, vec, count, len, to);
 #endif
 
     if (udp_sockets[sock] == -1)
         return qfalse;
 
-    ret = os_udp_send(sock, data, len, to);
-    if (ret == NET_AGAIN)
-        return qfalse;
+#if USE_MMSG
+    if (send_batching && sock == send_batch_sock) {
+        NET_QueuePacket(vec, count, len, to);
+        return qtrue;
+    }
+#endif
 
-    if (ret == NET_ERROR) {
-        Com_DPrintf("%s: %s to %s\n", __func__,
-                    NET_ErrorString(), NET_AdrToString(to));
-        net_send_errors++;
-        return qfalse;
+    return NET_SendUdpPacket(sock, vec, count, len, to);
+}
+
+//=============================================================================
+
+static qsocket_t UDP_OpenSocket(const char *iface, int port, int flags);
+
+#if USE_RECV_THREADS
+
+/*
+Extra sockets bound to the server port with SO_REUSEPORT. The kernel spreads
+incoming flows over them and the main socket. Each extra socket has a thread
+that answers server browser queries through SV_AnswerQuery and queues
+everything else for the main thread, which picks it up along with packets
+from the main socket.
+*/
+
+static void NET_RecvThread(void *arg)
+{
+    qsocket_t s = *(qsocket_t *)arg;
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    byte data[MAX_PACKETLEN];
+    byte reply[MAX_PACKETLEN];
+    netadr_t from;
+    recvpacket_t *p;
+    size_t len;
+    ssize_t ret;
+
+    while (!rt.quit) {
+        memset(&addr, 0, sizeof(addr));
+        addrlen = sizeof(addr);
+        ret = recvfrom(s, data, sizeof(data), 0,
+                       (struct sockaddr *)&addr, &addrlen);
+        if (ret < 4) {
+            continue;   // timed out, or nothing worth looking at
+        }
+
+        NET_SockadrToNetadr(&addr, &from);
+
+        if (NET_OobFlooded(&from, data, ret)) {
+            continue;
+        }
+
+        if (*(int *)data == -1 && SV_AnswerQuery(&from, data, ret, reply, &len)) {
+            if (len) {
+                sendto(s, reply, len, 0, (struct sockaddr *)&addr, addrlen);
+            }
+            continue;
+        }
+
+        Sys_LockMutex(rt.lock);
+        if (rt.head - rt.tail < RECV_QUEUE_SIZE) {
+            p = &rt.queue[rt.head++ & (RECV_QUEUE_SIZE - 1)];
+            p->from = from;
+            p->len = ret;
+            memcpy(p->data, data, ret);
+            if (rt.head - rt.tail == 1 && write(rt.wake[1], "", 1) < 0) {
+                // pipe is full, main thread will wake up anyway
+            }
+        }
+        Sys_UnlockMutex(rt.lock);
     }
+}
 
-    if (ret < len)
-        Com_WPrintf("%s: short send to %s\n", __func__,
-                    NET_AdrToString(to));
+static void NET_StopRecvThreads(void)
+{
+    int i;
 
-#ifdef _DEBUG
-    if (net_log_enable->integer)
-        NET_LogPacket(to, "UDP send", data, ret);
-#endif
+    if (!rt.numthreads) {
+        return;
+    }
 
-    net_rate_sent += ret;
-    net_bytes_sent += ret;
-    net_packets_sent++;
+    rt.quit = qtrue;
+    for (i = 0; i < rt.numthreads; i++) {
+        Sys_JoinThread(rt.threads[i]);
+        os_closesocket(rt.sockets[i]);
+    }
 
-    return qtrue;
+    NET_RemoveFd(rt.wake[0]);
+    close(rt.wake[0]);
+    close(rt.wake[1]);
+    Sys_DestroyMutex(rt.lock);
+    Z_Free(rt.queue);
+
+    memset(&rt, 0, sizeof(rt));
 }
 
-//=============================================================================
+static void NET_StartRecvThreads(int count)
+{
+    struct timeval tv = { 0, 100 * 1000 };
+    ioentry_t *e;
+    qsocket_t s;
+    int i;
 
-static qsocket_t UDP_OpenSocket(const char *iface, int port)
+    if (pipe(rt.wake)) {
+        Com_EPrintf("%s: can't create pipe: %s\n", __func__, strerror(errno));
+        return;
+    }
+    os_make_nonblock(rt.wake[0], 1);
+    os_make_nonblock(rt.wake[1], 1);
+
+    rt.lock = Sys_CreateMutex();
+    rt.queue = Z_Malloc(sizeof(recvpacket_t) * RECV_QUEUE_SIZE);
+    rt.head = rt.tail = 0;
+    rt.quit = qfalse;
+
+    e = NET_AddFd(rt.wake[0]);
+    e->wantread = qtrue;
+
+    for (i = 0; i < count; i++) {
+        s = UDP_OpenSocket(net_ip->string, net_port->integer,
+                           UDP_REUSEPORT | UDP_NOERRQUEUE);
+        if (s == -1) {
+            break;
+        }
+
+        // threads block in recvfrom(), waking up now and then to check
+        // if they should quit
+        os_make_nonblock(s, 0);
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        rt.sockets[i] = s;
+        rt.threads[i] = Sys_CreateThread(NET_RecvThread, &rt.sockets[i]);
+        rt.numthreads++;
+    }
+
+    if (!rt.numthreads) {
+        NET_RemoveFd(rt.wake[0]);
+        close(rt.wake[0]);
+        close(rt.wake[1]);
+        Sys_DestroyMutex(rt.lock);
+        Z_Free(rt.queue);
+        memset(&rt, 0, sizeof(rt));
+    }
+}
+
+static void NET_GetQueuedPackets(void (*packet_cb)(void))
+{
+    char buffer[64];
+    recvpacket_t *p;
+    size_t len;
+
+    if (!rt.numthreads) {
+        return;
+    }
+
+    while (read(rt.wake[0], buffer, sizeof(buffer)) > 0)
+        ;
+
+    Sys_LockMutex(rt.lock);
+    while (rt.tail != rt.head) {
+        p = &rt.queue[rt.tail++ & (RECV_QUEUE_SIZE - 1)];
+        net_from = p->from;
+        len = p->len;
+        memcpy(msg_read_buffer, p->data, len);
+        Sys_UnlockMutex(rt.lock);
+
+        NET_ReadPacket(packet_cb, len);
+
+        if (!rt.numthreads) {
+            return;     // callback shut down the network
+        }
+        Sys_LockMutex(rt.lock);
+    }
+    Sys_UnlockMutex(rt.lock);
+}
+
+#endif // USE_RECV_THREADS
+
+static qsocket_t UDP_OpenSocket(const char *iface, int port, int flags)
 {
     struct sockaddr_in  sadr;
     int     s;
@@ -922,7 +1532,7 @@ static qsocket_t UDP_OpenSocket(const char *iface, int port)
 
 #if USE_ICMP
     // enable ICMP error queue
-    if (net_ignore_icmp->integer <= 0) {
+    if (net_ignore_icmp->integer <= 0 && !(flags & UDP_NOERRQUEUE)) {
         if (os_setsockopt(s, IPPROTO_IP, IP_RECVERR, 1)) {
             Com_WPrintf("%s: %s:%d: can't enable ICMP error queue: %s\n",
                         __func__, iface, port, NET_ErrorString());
@@ -951,6 +1561,16 @@ static qsocket_t UDP_OpenSocket(const char *iface, int port)
     }
 #endif // __linux__
 
+#if USE_RECV_THREADS
+    if (flags & UDP_REUSEPORT) {
+        if (os_setsockopt(s, SOL_SOCKET, SO_REUSEPORT, 1)) {
+            Com_EPrintf("%s: %s:%d: can't share port: %s\n",
+                        __func__, iface, port, NET_ErrorString());
+            goto fail;
+        }
+    }
+#endif
+
     if (os_bind(s, (struct sockaddr *)&sadr, sizeof(sadr))) {
         Com_EPrintf("%s: %s:%d: can't bind socket: %s\n",
                     __func__, iface, port, NET_ErrorString());
@@ -1018,13 +1638,25 @@ static void NET_OpenServer(void)
     static int saved_port;
     ioentry_t *e;
     qsocket_t s;
+    int flags = 0;
+
+#if USE_RECV_THREADS
+    if (Cvar_ClampInteger(net_recv_threads, 0, MAX_RECV_THREADS)) {
+        flags |= UDP_REUSEPORT;
+    }
+#endif
 
-    s = UDP_OpenSocket(net_ip->string, net_port->integer);
+    s = UDP_OpenSocket(net_ip->string, net_port->integer, flags);
     if (s != -1) {
         saved_port = net_port->integer;
         udp_sockets[NS_SERVER] = s;
         e = NET_AddFd(s);
         e->wantread = qtrue;
+#if USE_RECV_THREADS
+        if (flags & UDP_REUSEPORT) {
+            NET_StartRecvThreads(net_recv_threads->integer);
+        }
+#endif
         return;
     }
 
@@ -1052,11 +1684,11 @@ static void NET_OpenClient(void)
     qsocket_t s;
     netadr_t adr;
 
-    s = UDP_OpenSocket(net_ip->string, net_clientport->integer);
+    s = UDP_OpenSocket(net_ip->string, net_clientport->integer, 0);
     if (s == -1) {
         // now try with random port
         if (net_clientport->integer != PORT_ANY)
-            s = UDP_OpenSocket(net_ip->string, PORT_ANY);
+            s = UDP_OpenSocket(net_ip->string, PORT_ANY, 0);
 
         if (s == -1) {
             Com_WPrintf("Couldn't open client UDP port.\n");
@@ -1093,6 +1725,9 @@ void NET_Config(netflag_t flag)
     }
 
     if (flag == NET_NONE) {
+#if USE_RECV_THREADS
+        NET_StopRecvThreads();
+#endif
         // shut down any existing sockets
         for (sock = 0; sock < NS_COUNT; sock++) {
             if (udp_sockets[sock] != -1) {
@@ -1148,27 +1783,28 @@ void NET_CloseStream(netstream_t *s)
     s->state = NS_DISCONNECTED;
 }
 
-neterr_t NET_Listen(qboolean arg)
+// opens listening socket on the given port, or closes it if port is 0
+neterr_t NET_ListenPort(netlisten_t which, int port)
 {
     qsocket_t s;
     ioentry_t *e;
     neterr_t ret;
 
-    if (!arg) {
-        if (tcp_socket != -1) {
-            NET_RemoveFd(tcp_socket);
-            os_closesocket(tcp_socket);
-            tcp_socket = -1;
+    if (tcp_sockets[which] != -1) {
+        if (port == tcp_ports[which]) {
+            return NET_OK;
         }
-        return NET_OK;
+        NET_RemoveFd(tcp_sockets[which]);
+        os_closesocket(tcp_sockets[which]);
+        tcp_sockets[which] = -1;
+        tcp_ports[which] = 0;
     }
 
-    if (tcp_socket != -1) {
+    if (!port) {
         return NET_OK;
     }
 
-    s = TCP_OpenSocket(net_tcp_ip->string,
-                       net_tcp_port->integer, NS_SERVER);
+    s = TCP_OpenSocket(net_tcp_ip->string, port, NS_SERVER);
     if (s == -1) {
         return NET_ERROR;
     }
@@ -1179,7 +1815,8 @@ neterr_t NET_Listen(qboolean arg)
         return ret;
     }
 
-    tcp_socket = s;
+    tcp_sockets[which] = s;
+    tcp_ports[which] = port;
 
     // initialize io entry
     e = NET_AddFd(s);
@@ -1188,23 +1825,28 @@ neterr_t NET_Listen(qboolean arg)
     return NET_OK;
 }
 
+neterr_t NET_Listen(qboolean arg)
+{
+    return NET_ListenPort(NL_GTV, arg ? net_tcp_port->integer : 0);
+}
+
 // net_from variable receives source address
-neterr_t NET_Accept(netstream_t *s)
+neterr_t NET_AcceptPort(netlisten_t which, netstream_t *s)
 {
     ioentry_t *e;
     qsocket_t newsocket;
     neterr_t ret;
 
-    if (tcp_socket == -1) {
+    if (tcp_sockets[which] == -1) {
         return NET_AGAIN;
     }
 
-    e = os_get_io(tcp_socket);
+    e = os_get_io(tcp_sockets[which]);
     if (!e->canread) {
         return NET_AGAIN;
     }
 
-    ret = os_accept(tcp_socket, &newsocket, &net_from);
+    ret = os_accept(tcp_sockets[which], &newsocket, &net_from);
     if (ret) {
         e->canread = qfalse;
         return ret;
@@ -1231,6 +1873,11 @@ neterr_t NET_Accept(netstream_t *s)
     return NET_OK;
 }
 
+neterr_t NET_Accept(netstream_t *s)
+{
+    return NET_AcceptPort(NL_GTV, s);
+}
+
 neterr_t NET_Connect(const netadr_t *peer, netstream_t *s)
 {
     qsocket_t socket;
@@ -1331,6 +1978,38 @@ void NET_UpdateStream(netstream_t *s)
     e->wantwrite = len ? qtrue : qfalse;
 }
 
+/*
+==============
+NET_WriteStream
+
+Sends data straight from the caller's buffer when nothing is queued,
+whatever the socket doesn't take is queued. Returns number of bytes
+sent or queued, less than len means the send buffer overflowed.
+==============
+*/
+size_t NET_WriteStream(netstream_t *s, const void *data, size_t len)
+{
+    ssize_t ret;
+    size_t sent = 0;
+
+    if (s->state == NS_CONNECTED && len && !FIFO_Usage(&s->send)) {
+        // errors are left for NET_RunStream to find
+        ret = os_send(s->socket, data, len, 0);
+        if (ret > 0) {
+#if _DEBUG
+            if (net_log_enable->integer) {
+                NET_LogPacket(&s->address, "TCP send", data, ret);
+            }
+#endif
+            net_rate_sent += ret;
+            net_bytes_sent += ret;
+            sent = ret;
+        }
+    }
+
+    return sent + FIFO_Write(&s->send, (const byte *)data + sent, len - sent);
+}
+
 // returns NET_OK only when there was some data read
 neterr_t NET_RunStream(netstream_t *s)
 {
@@ -1381,10 +2060,14 @@ neterr_t NET_RunStream(netstream_t *s)
     }
 
     if (e->wantwrite && e->canwrite) {
-        // write as much as we can
+        // write as much as we can, both parts of the buffer at once
         data = FIFO_Peek(&s->send, &len);
         if (len) {
-            ret = os_send(s->socket, data, len, 0);
+            if (s->send.bs) {
+                ret = os_send2(s->socket, data, len, s->send.data, s->send.bs);
+            } else {
+                ret = os_send(s->socket, data, len, 0);
+            }
             if (!ret) {
                 goto closed;
             }
@@ -1395,12 +2078,20 @@ neterr_t NET_RunStream(netstream_t *s)
                 // wouldblock is silent
                 e->canwrite = qfalse;
             } else {
-                FIFO_Decommit(&s->send, ret);
 #if _DEBUG
                 if (net_log_enable->integer) {
-                    NET_LogPacket(&s->address, "TCP send", data, ret);
+                    NET_LogPacket(&s->address, "TCP send", data, min(ret, len));
+                    if (ret > len) {
+                        NET_LogPacket(&s->address, "TCP send", s->send.data, ret - len);
+                    }
                 }
 #endif
+                if (ret > len) {
+                    FIFO_Decommit(&s->send, len);
+                    FIFO_Decommit(&s->send, ret - len);
+                } else {
+                    FIFO_Decommit(&s->send, ret);
+                }
                 net_rate_sent += ret;
                 net_bytes_sent += ret;
 
@@ -1493,7 +2184,8 @@ static void NET_ShowIP_f(void)
     // dump listening sockets
     dump_socket(udp_sockets[NS_CLIENT], "Client", "UDP");
     dump_socket(udp_sockets[NS_SERVER], "Server", "UDP");
-    dump_socket(tcp_socket, "Server", "TCP");
+    dump_socket(tcp_sockets[NL_GTV], "Server", "TCP");
+    dump_socket(tcp_sockets[NL_METRICS], "Metrics", "TCP");
 }
 
 /*
@@ -1533,6 +2225,33 @@ static void NET_Dns_f(void)
     dump_hostent(h);
 }
 
+static void close_listeners(int *ports)
+{
+    int i;
+
+    for (i = 0; i < NL_COUNT; i++) {
+        ports[i] = tcp_ports[i];
+        NET_ListenPort(i, 0);
+    }
+}
+
+static void reopen_listeners(const int *ports)
+{
+    int i;
+
+    for (i = 0; i < NL_COUNT; i++) {
+        if (!ports[i]) {
+            continue;
+        }
+        // GTV port may have just followed net_port
+        if (i == NL_GTV) {
+            NET_Listen(qtrue);
+        } else {
+            NET_ListenPort(i, ports[i]);
+        }
+    }
+}
+
 /*
 ====================
 NET_Restart_f
@@ -1541,18 +2260,14 @@ NET_Restart_f
 static void NET_Restart_f(void)
 {
     netflag_t flag = net_active;
-    qboolean listen = tcp_socket != -1;
+    int ports[NL_COUNT];
 
     Com_DPrintf("%s\n", __func__);
 
-    if (listen) {
-        NET_Listen(qfalse);
-    }
+    close_listeners(ports);
     NET_Config(NET_NONE);
     NET_Config(flag);
-    if (listen) {
-        NET_Listen(qtrue);
-    }
+    reopen_listeners(ports);
 
 #if USE_SYSCON
     SV_SetConsoleTitle();
@@ -1574,10 +2289,10 @@ static void net_udp_param_changed(cvar_t *self)
 
 static void net_tcp_param_changed(cvar_t *self)
 {
-    if (tcp_socket != -1) {
-        NET_Listen(qfalse);
-        NET_Listen(qtrue);
-    }
+    int ports[NL_COUNT];
+
+    close_listeners(ports);
+    reopen_listeners(ports);
 }
 
 /*
@@ -1609,6 +2324,15 @@ void NET_Init(void)
 #if USE_ICMP
     net_ignore_icmp = Cvar_Get("net_ignore_icmp", "0", 0);
 #endif
+#if USE_MMSG
+    net_batch = Cvar_Get("net_batch", "1", 0);
+#endif
+#if USE_RECV_THREADS
+    net_recv_threads = Cvar_Get("net_recv_threads", "0", 0);
+    net_recv_threads->changed = net_udp_param_changed;
+#endif
+    net_oob_limit = Cvar_Get("net_oob_limit", "0", 0);
+    net_oob_burst = Cvar_Get("net_oob_burst", "10", 0);
     net_tcp_ip = Cvar_Get("net_tcp_ip", net_ip->string, 0);
     net_tcp_ip->changed = net_tcp_param_changed;
     net_tcp_port = Cvar_Get("net_tcp_port", net_port->string, 0);
@@ -1642,6 +2366,7 @@ void NET_Shutdown(void)
 #endif
 
     NET_Listen(qfalse);
+    NET_ListenPort(NL_METRICS, 0);
     NET_Config(NET_NONE);
     os_net_shutdown();
 
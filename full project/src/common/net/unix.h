@@ -155,20 +155,33 @@ static ssize_t os_udp_recv(netsrc_t sock, void *data,
     return NET_ERROR;
 }
 
-static ssize_t os_udp_send(netsrc_t sock, const void *data,
-                           size_t len, const netadr_t *to)
+static ssize_t os_udp_send(netsrc_t sock, const netvec_t *vec,
+                           int count, const netadr_t *to)
 {
     struct sockaddr_in addr;
+    struct iovec iov[MAX_NETVEC];
+    struct msghdr msg;
     ssize_t ret;
+    int i;
 
     NET_NetadrToSockadr(to, &addr);
 
+    for (i = 0; i < count; i++) {
+        iov[i].iov_base = (void *)vec[i].data;
+        iov[i].iov_len = vec[i].len;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
 #if USE_ICMP && (defined __linux__)
     int tries;
     for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
 #endif
-        ret = sendto(udp_sockets[sock], data, len, 0,
-                     (struct sockaddr *)&addr, sizeof(addr));
+        ret = sendmsg(udp_sockets[sock], &msg, 0);
         if (ret >= 0)
             return ret;
 
@@ -204,6 +217,44 @@ static ssize_t os_udp_send(netsrc_t sock, const void *data,
     return NET_ERROR;
 }
 
+#if USE_MMSG
+
+static int os_udp_recvv(netsrc_t sock, struct mmsghdr *msgs, int count)
+{
+    int ret;
+
+    ret = recvmmsg(udp_sockets[sock], msgs, count, 0, NULL);
+    if (ret >= 0)
+        return ret;
+
+    net_error = errno;
+
+    // wouldblock is silent
+    if (net_error == EWOULDBLOCK)
+        return NET_AGAIN;
+
+    return NET_ERROR;
+}
+
+static int os_udp_sendv(netsrc_t sock, struct mmsghdr *msgs, int count)
+{
+    int ret;
+
+    ret = sendmmsg(udp_sockets[sock], msgs, count, 0);
+    if (ret >= 0)
+        return ret;
+
+    net_error = errno;
+
+    // wouldblock is silent
+    if (net_error == EWOULDBLOCK)
+        return NET_AGAIN;
+
+    return NET_ERROR;
+}
+
+#endif // USE_MMSG
+
 static neterr_t os_get_error(void)
 {
     net_error = errno;
@@ -233,6 +284,24 @@ static ssize_t os_send(qsocket_t sock, const void *data, size_t len, int flags)
     return ret;
 }
 
+static ssize_t os_send2(qsocket_t sock, const void *data1, size_t len1,
+                        const void *data2, size_t len2)
+{
+    struct iovec iov[2];
+    ssize_t ret;
+
+    iov[0].iov_base = (void *)data1;
+    iov[0].iov_len = len1;
+    iov[1].iov_base = (void *)data2;
+    iov[1].iov_len = len2;
+
+    ret = writev(sock, iov, 2);
+    if (ret == -1)
+        return os_get_error();
+
+    return ret;
+}
+
 static neterr_t os_listen(qsocket_t sock, int backlog)
 {
     if (listen(sock, backlog) == -1) {
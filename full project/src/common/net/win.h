@@ -142,19 +142,26 @@ static ssize_t os_udp_recv(netsrc_t sock, void *data,
     return NET_ERROR;
 }
 
-static ssize_t os_udp_send(netsrc_t sock, const void *data,
-                           size_t len, const netadr_t *to)
+static ssize_t os_udp_send(netsrc_t sock, const netvec_t *vec,
+                           int count, const netadr_t *to)
 {
     struct sockaddr_in addr;
-    int ret;
+    WSABUF bufs[MAX_NETVEC];
+    DWORD sent;
+    int i, ret;
 
     NET_NetadrToSockadr(to, &addr);
 
-    ret = sendto(udp_sockets[sock], data, len, 0,
-                 (struct sockaddr *)&addr, sizeof(addr));
+    for (i = 0; i < count; i++) {
+        bufs[i].buf = (CHAR *)vec[i].data;
+        bufs[i].len = vec[i].len;
+    }
+
+    ret = WSASendTo(udp_sockets[sock], bufs, count, &sent, 0,
+                    (struct sockaddr *)&addr, sizeof(addr), NULL, NULL);
 
     if (ret != SOCKET_ERROR)
-        return ret;
+        return sent;
 
     net_error = WSAGetLastError();
 
@@ -198,6 +205,23 @@ static ssize_t os_send(qsocket_t sock, const void *data, size_t len, int flags)
     return ret;
 }
 
+static ssize_t os_send2(qsocket_t sock, const void *data1, size_t len1,
+                        const void *data2, size_t len2)
+{
+    WSABUF buf[2];
+    DWORD sent;
+
+    buf[0].buf = (char *)data1;
+    buf[0].len = len1;
+    buf[1].buf = (char *)data2;
+    buf[1].len = len2;
+
+    if (WSASend(sock, buf, 2, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+        return os_get_error();
+
+    return sent;
+}
+
 static neterr_t os_listen(qsocket_t sock, int backlog)
 {
     if (listen(sock, backlog) == SOCKET_ERROR) {
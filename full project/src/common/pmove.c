@@ -41,10 +41,11 @@ typedef struct {
     qboolean    ladder;
 } pml_t;
 
-static pmove_t      *pm;
-static pml_t        pml;
+// per thread, the server may run player movement ahead on workers
+static q_threadlocal pmove_t       *pm;
+static q_threadlocal pml_t         pml;
 
-static pmoveParams_t    *pmp;
+static q_threadlocal pmoveParams_t *pmp;
 
 // movement parameters
 static const float  pm_stopspeed = 100;
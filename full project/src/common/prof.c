@@ -0,0 +1,310 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// prof.c -- frame phase profiler
+//
+// Scopes around the main phases of server and client frames are timed into
+// a ring of recent frames while com_prof is set. Each frame keeps per scope
+// totals and, up to a limit, the individual scope entries in order, which is
+// what the Chrome trace written by profdump is made of.
+//
+
+#include "shared/shared.h"
+#include "common/cmd.h"
+#include "common/common.h"
+#include "common/cvar.h"
+#include "common/files.h"
+#include "common/prof.h"
+#include "common/zone.h"
+#include "system/system.h"
+
+#define PROF_FRAMES     256     // must be power of two
+#define PROF_EVENTS     128     // scope entries recorded per frame
+
+typedef struct {
+    byte        scope;
+    byte        depth;
+    unsigned    start;
+    unsigned    length;
+} profevent_t;
+
+typedef struct {
+    unsigned    start;
+    unsigned    length;
+    unsigned    times[PROF_NUM_SCOPES];
+    unsigned    counts[PROF_NUM_SCOPES];
+    int         numevents;
+    profevent_t events[PROF_EVENTS];
+} profframe_t;
+
+static const char *const prof_names[PROF_NUM_SCOPES] = {
+    "game frame",
+    "send messages",
+    "build frame",
+    "parse message",
+    "render frame",
+    "sound update",
+    "vcr effect"
+};
+
+static struct {
+    profframe_t *frames;
+    unsigned    current;    // frame being recorded
+    unsigned    numframes;  // completed frames in ring
+    unsigned    starts[PROF_NUM_SCOPES];
+    unsigned    active;     // bit mask of entered scopes
+    int         depth;
+} prof;
+
+qboolean prof_enabled;
+
+static cvar_t   *com_prof;
+
+void PROF_BeginScope(profscope_t scope)
+{
+    prof.starts[scope] = Sys_Microseconds();
+    prof.active |= 1 << scope;
+    prof.depth++;
+}
+
+void PROF_EndScope(profscope_t scope)
+{
+    profframe_t *f;
+    profevent_t *e;
+    unsigned length;
+
+    // scope was entered before profiler was enabled
+    if (!(prof.active & (1 << scope)))
+        return;
+
+    length = Sys_Microseconds() - prof.starts[scope];
+    prof.active &= ~(1 << scope);
+    prof.depth--;
+
+    f = &prof.frames[prof.current & (PROF_FRAMES - 1)];
+    f->times[scope] += length;
+    f->counts[scope]++;
+
+    if (f->numevents < PROF_EVENTS) {
+        e = &f->events[f->numevents++];
+        e->scope = scope;
+        e->depth = prof.depth;
+        e->start = prof.starts[scope];
+        e->length = length;
+    }
+}
+
+static void start_frame(unsigned time)
+{
+    profframe_t *f = &prof.frames[prof.current & (PROF_FRAMES - 1)];
+
+    memset(f, 0, q_offsetof(profframe_t, events));
+    f->start = time;
+}
+
+/*
+=============
+PROF_Frame
+
+Called at the start of each main loop frame, after sleeping.
+=============
+*/
+void PROF_Frame(void)
+{
+    profframe_t *f;
+    unsigned time;
+
+    if (!prof_enabled)
+        return;
+
+    time = Sys_Microseconds();
+
+    f = &prof.frames[prof.current & (PROF_FRAMES - 1)];
+    f->length = time - f->start;
+
+    prof.current++;
+    if (prof.numframes < PROF_FRAMES - 1)
+        prof.numframes++;
+
+    // scopes never span frames, forget any left open by an error
+    prof.active = 0;
+    prof.depth = 0;
+
+    start_frame(time);
+}
+
+/*
+=============
+PROF_GetStats
+
+Fills in per scope stats for the given number of most recent frames.
+=============
+*/
+void PROF_GetStats(profstat_t *stats, int frames)
+{
+    profframe_t *f;
+    unsigned total[PROF_NUM_SCOPES];
+    int i, j;
+
+    memset(stats, 0, sizeof(*stats) * PROF_NUM_SCOPES);
+    memset(total, 0, sizeof(total));
+
+    if (!prof_enabled)
+        return;
+
+    clamp(frames, 1, prof.numframes);
+    if (!frames)
+        return;
+
+    for (i = 1; i <= frames; i++) {
+        f = &prof.frames[(prof.current - i) & (PROF_FRAMES - 1)];
+        for (j = 0; j < PROF_NUM_SCOPES; j++) {
+            total[j] += f->times[j];
+            stats[j].count += f->counts[j];
+            stats[j].max = max(stats[j].max, f->times[j]);
+        }
+    }
+
+    for (j = 0; j < PROF_NUM_SCOPES; j++) {
+        stats[j].total = total[j] / frames;
+    }
+}
+
+const char *PROF_ScopeName(profscope_t scope)
+{
+    return prof_names[scope];
+}
+
+static void PROF_Stats_f(void)
+{
+    profstat_t stats[PROF_NUM_SCOPES];
+    int i, frames;
+
+    if (!prof_enabled || !prof.numframes) {
+        Com_Printf("No frames recorded, set com_prof to 1 first.\n");
+        return;
+    }
+
+    frames = prof.numframes;
+    if (Cmd_Argc() > 1) {
+        frames = atoi(Cmd_Argv(1));
+    }
+    clamp(frames, 1, prof.numframes);
+
+    PROF_GetStats(stats, frames);
+
+    Com_Printf("Last %d frames:\n"
+               "scope           count  avg usec  max usec\n"
+               "--------------- ----- --------- ---------\n", frames);
+    for (i = 0; i < PROF_NUM_SCOPES; i++) {
+        Com_Printf("%-15s %5u %9u %9u\n", prof_names[i],
+                   stats[i].count, stats[i].total, stats[i].max);
+    }
+}
+
+/*
+=============
+PROF_Dump_f
+
+Writes recent frames as Chrome trace event JSON, which chrome://tracing
+and compatible viewers load directly.
+=============
+*/
+static void PROF_Dump_f(void)
+{
+    char buffer[MAX_OSPATH];
+    profframe_t *f;
+    profevent_t *e;
+    unsigned base;
+    int i, j, frames, events;
+    qhandle_t h;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <filename> [frames]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (!prof_enabled || !prof.numframes) {
+        Com_Printf("No frames recorded, set com_prof to 1 first.\n");
+        return;
+    }
+
+    frames = prof.numframes;
+    if (Cmd_Argc() > 2) {
+        frames = atoi(Cmd_Argv(2));
+    }
+    clamp(frames, 1, prof.numframes);
+
+    h = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE,
+                        "prof/", Cmd_Argv(1), ".json");
+    if (!h) {
+        return;
+    }
+
+    base = prof.frames[(prof.current - frames) & (PROF_FRAMES - 1)].start;
+    events = 0;
+
+    FS_FPrintf(h, "{\"traceEvents\":[\n");
+    for (i = frames; i > 0; i--) {
+        f = &prof.frames[(prof.current - i) & (PROF_FRAMES - 1)];
+        FS_FPrintf(h, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                   "\"ts\":%u,\"dur\":%u}", events ? ",\n" : "",
+                   f->start - base, f->length);
+        events++;
+        for (j = 0; j < f->numevents; j++) {
+            e = &f->events[j];
+            FS_FPrintf(h, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                       "\"ts\":%u,\"dur\":%u}", prof_names[e->scope],
+                       e->start - base, e->length);
+            events++;
+        }
+    }
+    FS_FPrintf(h, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    FS_FCloseFile(h);
+
+    Com_Printf("Wrote %d frames (%d events) to %s.\n", frames, events, buffer);
+}
+
+static void com_prof_changed(cvar_t *self)
+{
+    if (self->integer && !prof.frames) {
+        prof.frames = Z_Malloc(sizeof(*prof.frames) * PROF_FRAMES);
+        prof.current = 0;
+        prof.numframes = 0;
+        prof.active = 0;
+        prof.depth = 0;
+        start_frame(Sys_Microseconds());
+        prof_enabled = qtrue;
+    } else if (!self->integer && prof.frames) {
+        prof_enabled = qfalse;
+        Z_Free(prof.frames);
+        prof.frames = NULL;
+    }
+}
+
+void PROF_Init(void)
+{
+    com_prof = Cvar_Get("com_prof", "0", 0);
+    com_prof->changed = com_prof_changed;
+    com_prof_changed(com_prof);
+
+    Cmd_AddCommand("profstats", PROF_Stats_f);
+    Cmd_AddCommand("profdump", PROF_Dump_f);
+}
@@ -19,10 +19,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
+#include "common/cmodel.h"
 #include "common/common.h"
+#include "common/cvar.h"
 #include "common/files.h"
+#include "common/math.h"
+#include "common/msg.h"
 #include "common/tests.h"
 #include "system/system.h"
+#include "system/thread.h"
 
 // test error shutdown procedures
 static void Com_Error_f(void)
@@ -177,6 +182,11 @@ static const wildtest_t wildtests[] = {
     { "\\",             "\\",               0 },
     { "foo*bar\\*baz",  "foo*abcbar*baz",   1 },
     { "\\a\\b\\c",      "abc",              1 },
+    { "*entered*",      "foo entered the game", 1 },
+    { "*ab",            "abab",             1 },
+    { "*ab*ab",         "abab",             0 },
+    { "a**b*",          "axxbyy",           1 },
+    { "foo*bar*baz",    "foobarbazbar",     0 },
 };
 
 static const int numwildtests = q_countof(wildtests);
@@ -184,6 +194,7 @@ static const int numwildtests = q_countof(wildtests);
 static void Com_TestWild_f(void)
 {
     const wildtest_t *w;
+    wildfilter_t *filter;
     qboolean match;
     int i, errors;
 
@@ -197,6 +208,19 @@ static void Com_TestWild_f(void)
                 w->filter, w->string, match, w->result);
             errors++;
         }
+
+        // compiled filters must agree where they can be made
+        filter = Com_WildCompile(w->filter);
+        if (filter) {
+            match = Com_WildMatch(filter, w->string);
+            if (match != w->result) {
+                Com_EPrintf(
+                    "Com_WildMatch( \"%s\", \"%s\" ) == %d, expected %d\n",
+                    w->filter, w->string, match, w->result);
+                errors++;
+            }
+            Z_Free(filter);
+        }
     }
 
     Com_Printf("%d failures, %d patterns tested\n",
@@ -491,6 +515,729 @@ static void Com_TestSnprintf_f(void)
     Com_Printf("%d failures, %d strings tested\n", errors, num_snprintf_tests * 2);
 }
 
+#if USE_CLIENT
+
+// reference bit-at-a-time packing the MSG_*Bits functions must match
+static void ref_write_bits(byte *data, size_t *bitpos, int value, int bits)
+{
+    int i;
+
+    if (bits < 0)
+        bits = -bits;
+
+    for (i = 0; i < bits; i++, (*bitpos)++) {
+        if ((*bitpos & 7) == 0)
+            data[*bitpos >> 3] = 0;
+        data[*bitpos >> 3] |= (value & 1) << (*bitpos & 7);
+        value >>= 1;
+    }
+}
+
+static int ref_read_bits(const byte *data, size_t *bitpos, int bits)
+{
+    qboolean sgn = qfalse;
+    int i, value = 0;
+
+    if (bits < 0) {
+        bits = -bits;
+        sgn = qtrue;
+    }
+
+    for (i = 0; i < bits; i++, (*bitpos)++)
+        value |= ((data[*bitpos >> 3] >> (*bitpos & 7)) & 1) << i;
+
+    if (sgn && (value & (1 << (bits - 1))))
+        value |= -1 ^ ((1 << bits) - 1);
+
+    return value;
+}
+
+static int random_bits(void)
+{
+    int bits = 1 + rand() % 32;
+
+    if (bits < 32 && (rand() & 1))
+        bits = -bits;
+
+    return bits;
+}
+
+// fuzz MSG_WriteBits/MSG_ReadBits against the reference implementation
+static void Com_TestBits_f(void)
+{
+    sizebuf_t   save_write, save_read;
+    byte        ref[1024], buf[1024];
+    int         sizes[128], values[128];
+    int         i, j, n, count, errors, value, expect;
+    size_t      bitpos;
+
+    count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 10000;
+
+    save_write = msg_write;
+    save_read = msg_read;
+
+    errors = 0;
+    for (i = 0; i < count && errors < 10; i++) {
+        n = 1 + rand() % q_countof(sizes);
+
+        // garbage in the buffer must not leak into the stream
+        for (j = 0; j < sizeof(buf); j++)
+            buf[j] = rand();
+
+        SZ_Init(&msg_write, buf, sizeof(buf));
+        bitpos = 0;
+        for (j = 0; j < n; j++) {
+            sizes[j] = random_bits();
+            values[j] = (rand() << 16) ^ rand();
+            if (rand() & 1)
+                values[j] = -values[j];
+            MSG_WriteBits(values[j], sizes[j]);
+            ref_write_bits(ref, &bitpos, values[j], sizes[j]);
+        }
+
+        if (msg_write.bitpos != bitpos || msg_write.cursize != (bitpos + 7) >> 3 ||
+            memcmp(buf, ref, msg_write.cursize)) {
+            Com_EPrintf("MSG_WriteBits: run %d: stream mismatch\n", i);
+            errors++;
+            continue;
+        }
+
+        SZ_Init(&msg_read, buf, msg_write.cursize);
+        msg_read.cursize = msg_write.cursize;
+        bitpos = 0;
+        for (j = 0; j < n; j++) {
+            value = MSG_ReadBits(sizes[j]);
+            expect = ref_read_bits(ref, &bitpos, sizes[j]);
+            if (value != expect) {
+                Com_EPrintf("MSG_ReadBits( %d ) == %#x, expected %#x\n",
+                            sizes[j], value, expect);
+                errors++;
+                break;
+            }
+        }
+    }
+
+    msg_write = save_write;
+    msg_read = save_read;
+
+    Com_Printf("%d failures, %d streams tested\n", errors, i);
+}
+
+#endif // USE_CLIENT
+
+static void random_plane(cplane_t *p)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+        p->normal[i] = crand();
+
+    // axial and diagonal planes hit the exact comparisons
+    if (rand() & 1)
+        p->normal[rand() % 3] = 0;
+
+    VectorNormalize(p->normal);
+    p->dist = (rand() % 2048 - 1024) * (rand() & 1 ? 1 : 0.25f);
+    SetPlaneType(p);
+    SetPlaneSignbits(p);
+}
+
+static void Com_TestBoxPlanes_f(void)
+{
+    cplane_t    planes[4];
+    cplane4_t   planes4;
+    vec3_t      mins, maxs;
+    int         i, j, count, errors, bits, expect;
+
+    count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+
+    errors = 0;
+    for (i = 0; i < count && errors < 10; i++) {
+        for (j = 0; j < 4; j++)
+            random_plane(&planes[j]);
+        SetPlanes4(&planes4, planes, 1 + rand() % 4);
+
+        for (j = 0; j < 3; j++) {
+            mins[j] = rand() % 2048 - 1024;
+            maxs[j] = mins[j] + rand() % 512;
+        }
+
+        expect = 0;
+        for (j = 0; j < 4; j++) {
+            if (planes4.dist[j] == -1 && !planes4.normal[0][j] &&
+                !planes4.normal[1][j] && !planes4.normal[2][j]) {
+                expect |= 1 << j;   // unused lane
+                continue;
+            }
+            bits = BoxOnPlaneSide(mins, maxs, &planes[j]);
+            if (bits == BOX_INFRONT)
+                expect |= 1 << j;
+            if (bits == BOX_BEHIND)
+                expect |= 16 << j;
+        }
+
+        bits = BoxOnPlanes4Side(mins, maxs, &planes4);
+        if (bits != expect) {
+            Com_EPrintf("BoxOnPlanes4Side: run %d: %#x, expected %#x\n",
+                        i, bits, expect);
+            errors++;
+        }
+    }
+
+    Com_Printf("%d failures, %d boxes tested\n", errors, i);
+}
+
+#define ZONE_TEST_THREADS   4
+#define ZONE_TEST_BLOCKS    1024
+#define ZONE_TEST_FRAMES    40
+#define ZONE_TEST_FRAMESIZE 50000
+
+typedef struct {
+    byte        *blocks[ZONE_TEST_BLOCKS];
+    size_t      sizes[ZONE_TEST_BLOCKS];
+    unsigned    seed;
+    int         errors;
+    qboolean    release;    // free blocks instead of allocating
+} zonetest_t;
+
+static unsigned zone_test_rand(zonetest_t *t)
+{
+    t->seed = t->seed * 1103515245 + 12345;
+    return t->seed >> 16;
+}
+
+static qboolean zone_test_check(const byte *data, size_t size, byte fill)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        if (data[i] != fill)
+            return qfalse;
+
+    return qtrue;
+}
+
+static void zone_test_thread(void *arg)
+{
+    zonetest_t *t = arg;
+    size_t size;
+    int i, j;
+
+    if (t->release) {
+        for (i = 0; i < ZONE_TEST_BLOCKS; i++) {
+            if (!zone_test_check(t->blocks[i], t->sizes[i], i))
+                t->errors++;
+            Z_Free(t->blocks[i]);
+        }
+        return;
+    }
+
+    for (i = 0; i < ZONE_TEST_BLOCKS; i++) {
+        size = 1 + zone_test_rand(t) % 512;
+        t->blocks[i] = Z_TagMalloc(size, TAG_MAX + 1);
+        t->sizes[i] = size;
+        memset(t->blocks[i], i, size);
+    }
+
+    // shuffle some blocks around, and leave some for Z_FreeTags
+    for (i = 0; i < ZONE_TEST_BLOCKS * 4; i++) {
+        j = zone_test_rand(t) % ZONE_TEST_BLOCKS;
+        if (!zone_test_check(t->blocks[j], t->sizes[j], j))
+            t->errors++;
+        size = 1 + zone_test_rand(t) % 2048;
+        t->blocks[j] = Z_Realloc(t->blocks[j], size);
+        t->sizes[j] = size;
+        memset(t->blocks[j], j, size);
+        Z_TagMalloc(16, TAG_MAX + 2);
+    }
+}
+
+// hammer zone from several threads at once, freeing everything that was
+// allocated on one thread from another one. there should be no leaks.
+static void Com_TestZone_f(void)
+{
+    zonetest_t *tests;
+    qthread_t *threads[ZONE_TEST_THREADS];
+    byte *frames[ZONE_TEST_FRAMES];
+    int i, errors;
+
+    tests = Z_Mallocz(sizeof(*tests) * ZONE_TEST_THREADS);
+    for (i = 0; i < ZONE_TEST_THREADS; i++) {
+        tests[i].seed = i + 1;
+        threads[i] = Sys_CreateThread(zone_test_thread, &tests[i]);
+    }
+    for (i = 0; i < ZONE_TEST_THREADS; i++)
+        Sys_JoinThread(threads[i]);
+
+    // free blocks of the previous thread
+    for (i = 0; i < ZONE_TEST_THREADS; i++) {
+        tests[i].release = qtrue;
+        threads[i] = Sys_CreateThread(zone_test_thread,
+                                      &tests[(i + 1) % ZONE_TEST_THREADS]);
+    }
+    for (i = 0; i < ZONE_TEST_THREADS; i++)
+        Sys_JoinThread(threads[i]);
+
+    // overflow the frame arena, blocks must not overlap
+    errors = 0;
+    for (i = 0; i < ZONE_TEST_FRAMES; i++) {
+        frames[i] = Z_FrameAlloc(ZONE_TEST_FRAMESIZE);
+        memset(frames[i], i, ZONE_TEST_FRAMESIZE);
+    }
+    for (i = 0; i < ZONE_TEST_FRAMES; i++)
+        if (!zone_test_check(frames[i], ZONE_TEST_FRAMESIZE, i))
+            errors++;
+    Z_FrameReset();
+
+    Z_FreeTags(TAG_MAX + 2);
+    Z_LeakTest(TAG_MAX + 1);
+    Z_LeakTest(TAG_MAX + 2);
+    Z_Check();
+
+    for (i = 0; i < ZONE_TEST_THREADS; i++)
+        errors += tests[i].errors;
+    Z_Free(tests);
+
+    Com_Printf("%d failures, %d threads tested\n", errors, ZONE_TEST_THREADS);
+}
+
+#define CMD_TEST_COUNT  3000
+
+static void Com_TestCmd_Dummy_f(void)
+{
+}
+
+// fill command table well past its initial size, then remove commands
+// in an interleaved order. every remaining command must still be found.
+static void Com_TestCmd_f(void)
+{
+    char **names;
+    cvar_t *var;
+    int i, errors, numvars;
+
+    names = Z_Malloc(sizeof(*names) * CMD_TEST_COUNT);
+    for (i = 0; i < CMD_TEST_COUNT; i++) {
+        names[i] = Z_CopyString(va("__cmdtest%d", i));
+        Cmd_AddCommand(names[i], Com_TestCmd_Dummy_f);
+    }
+
+    errors = 0;
+    for (i = 0; i < CMD_TEST_COUNT; i++)
+        if (!Cmd_Exists(names[i]))
+            errors++;
+
+    for (i = 0; i < CMD_TEST_COUNT; i += 3)
+        Cmd_RemoveCommand(names[i]);
+
+    for (i = 0; i < CMD_TEST_COUNT; i++)
+        if (Cmd_Exists(names[i]) != (i % 3 != 0))
+            errors++;
+
+    for (i = 0; i < CMD_TEST_COUNT; i++)
+        if (i % 3)
+            Cmd_RemoveCommand(names[i]);
+
+    for (i = 0; i < CMD_TEST_COUNT; i++) {
+        if (Cmd_Exists(names[i]))
+            errors++;
+        Z_Free(names[i]);
+    }
+    Z_Free(names);
+
+    // every variable must be found by name
+    numvars = 0;
+    for (var = cvar_vars; var; var = var->next, numvars++)
+        if (Cvar_FindVar(var->name) != var)
+            errors++;
+
+    if (Cvar_FindVar("__cmdtest"))
+        errors++;
+
+    Com_Printf("%d failures, %d commands and %d cvars tested\n",
+               errors, CMD_TEST_COUNT, numvars);
+}
+
+#define COLLBENCH_BATCH     64
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      origin, angles;
+    mnode_t     *headnode;
+} collinput_t;
+
+typedef void (*collfunc_t)(collinput_t *in);
+
+static const vec3_t coll_mins = { -16, -16, -24 };
+static const vec3_t coll_maxs = { 16, 16, 32 };
+
+static mnode_t  *coll_world;
+static trace_t  coll_trace;
+static int      coll_contents;
+
+static void coll_point_trace(collinput_t *in)
+{
+    CM_BoxTrace(&coll_trace, in->start, in->end, vec3_origin, vec3_origin,
+                coll_world, MASK_SHOT);
+}
+
+static void coll_box_trace(collinput_t *in)
+{
+    CM_BoxTrace(&coll_trace, in->start, in->end, (float *)coll_mins,
+                (float *)coll_maxs, coll_world, MASK_PLAYERSOLID);
+}
+
+static void coll_transformed_trace(collinput_t *in)
+{
+    CM_TransformedBoxTrace(&coll_trace, in->start, in->end, (float *)coll_mins,
+                           (float *)coll_maxs, in->headnode, MASK_PLAYERSOLID,
+                           in->origin, in->angles);
+}
+
+static void coll_point_contents(collinput_t *in)
+{
+    coll_contents |= CM_PointContents(in->start, coll_world);
+}
+
+static int coll_cmp(const void *p1, const void *p2)
+{
+    unsigned a = *(const unsigned *)p1;
+    unsigned b = *(const unsigned *)p2;
+
+    return a < b ? -1 : a > b;
+}
+
+// runs the workload in batches, timing each one to get percentiles
+static void coll_run(const char *name, collfunc_t func,
+                     collinput_t *inputs, int count, unsigned *times)
+{
+    unsigned start, total;
+    int i, j, batches;
+
+    batches = count / COLLBENCH_BATCH;
+    total = 0;
+    for (i = 0; i < batches; i++) {
+        start = Sys_Microseconds();
+        for (j = 0; j < COLLBENCH_BATCH; j++) {
+            func(&inputs[i * COLLBENCH_BATCH + j]);
+        }
+        times[i] = Sys_Microseconds() - start;
+        total += times[i];
+    }
+
+    qsort(times, batches, sizeof(times[0]), coll_cmp);
+
+#define NS(t)   ((t) * 1000 / COLLBENCH_BATCH)
+    Com_Printf("%-20s %7u %7u %7u %7u\n", name,
+               NS(total / batches), NS(times[batches / 2]),
+               NS(times[batches * 9 / 10]), NS(times[batches * 99 / 100]));
+#undef NS
+}
+
+/*
+=============
+Com_CollBench_f
+
+Loads a map and runs a synthetic collision workload through the trace and
+contents functions. Same seed gives the same workload, so results of two
+builds can be compared directly.
+=============
+*/
+static void Com_CollBench_f(void)
+{
+    char name[MAX_QPATH];
+    cm_t cm;
+    mmodel_t *world, *model;
+    collinput_t *inputs, *in;
+    unsigned *times;
+    vec3_t dir, center, axis[3];
+    int i, j, count, seed;
+    qerror_t ret;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [count] [seed]\n", Cmd_Argv(0));
+        return;
+    }
+
+    count = 65536;
+    if (Cmd_Argc() > 2) {
+        count = atoi(Cmd_Argv(2));
+        clamp(count, COLLBENCH_BATCH, 16 * 1024 * 1024);
+    }
+    count &= ~(COLLBENCH_BATCH - 1);
+
+    seed = 1;
+    if (Cmd_Argc() > 3) {
+        seed = atoi(Cmd_Argv(3));
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp", NULL) >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    ret = CM_LoadMap(&cm, name);
+    if (ret) {
+        Com_EPrintf("Couldn't load %s: %s\n", name, Q_ErrorString(ret));
+        return;
+    }
+
+    inputs = Z_Malloc(sizeof(*inputs) * count);
+    times = Z_Malloc(sizeof(*times) * (count / COLLBENCH_BATCH));
+
+    world = &cm.cache->models[0];
+    coll_world = world->headnode;
+
+    // random segments up to 512 units long inside world bounds, each
+    // also paired with a random inline model rotated around its center
+    srand(seed);
+    for (i = 0, in = inputs; i < count; i++, in++) {
+        for (j = 0; j < 3; j++) {
+            in->start[j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+            dir[j] = crand();
+        }
+        VectorNormalize(dir);
+        VectorMA(in->start, frand() * 512, dir, in->end);
+
+        if (cm.cache->nummodels < 2) {
+            in->headnode = coll_world;
+            VectorClear(in->origin);
+            VectorClear(in->angles);
+            continue;
+        }
+
+        model = &cm.cache->models[1 + rand() % (cm.cache->nummodels - 1)];
+        in->headnode = model->headnode;
+        VectorSet(in->angles, 0, frand() * 360, 0);
+
+        // origin that makes the model spin in place
+        VectorAvg(model->mins, model->maxs, center);
+        AnglesToAxis(in->angles, axis);
+        TransposeAxis(axis);
+        VectorCopy(center, in->origin);
+        RotatePoint(in->origin, axis);
+        VectorSubtract(center, in->origin, in->origin);
+
+        for (j = 0; j < 3; j++) {
+            in->start[j] = center[j] + crand() * (model->maxs[j] - model->mins[j]);
+        }
+        VectorMA(in->start, frand() * 128, dir, in->end);
+    }
+
+    Com_Printf("%s, %d ops per test, seed %d\n"
+               "test                 avg ns  p50 ns  p90 ns  p99 ns\n"
+               "-------------------- ------- ------- ------- -------\n",
+               name, count, seed);
+    coll_run("point trace", coll_point_trace, inputs, count, times);
+    coll_run("box trace", coll_box_trace, inputs, count, times);
+    coll_run("transformed trace", coll_transformed_trace, inputs, count, times);
+    coll_run("point contents", coll_point_contents, inputs, count, times);
+
+    Z_Free(inputs);
+    Z_Free(times);
+    CM_FreeMap(&cm);
+}
+
+/*
+=============
+Com_TestFlood_f
+
+Toggles random area portals and checks incrementally updated area
+connections against a full flood of the same portal states.
+=============
+*/
+static void Com_TestFlood_f(void)
+{
+    char name[MAX_QPATH];
+    byte portalbits[MAX_MAP_PORTAL_BYTES];
+    byte bits1[MAX_MAP_AREA_BYTES], bits2[MAX_MAP_AREA_BYTES];
+    cm_t cm1, cm2;
+    int i, j, count, seed, numportals, bytes, errors;
+    qerror_t ret;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [count] [seed]\n", Cmd_Argv(0));
+        return;
+    }
+
+    count = 1000;
+    if (Cmd_Argc() > 2) {
+        count = atoi(Cmd_Argv(2));
+        clamp(count, 1, 1000000);
+    }
+
+    seed = 1;
+    if (Cmd_Argc() > 3) {
+        seed = atoi(Cmd_Argv(3));
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp", NULL) >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    ret = CM_LoadMap(&cm1, name);
+    if (ret) {
+        Com_EPrintf("Couldn't load %s: %s\n", name, Q_ErrorString(ret));
+        return;
+    }
+
+    ret = CM_LoadMap(&cm2, name);
+    if (ret) {
+        Com_EPrintf("Couldn't load %s: %s\n", name, Q_ErrorString(ret));
+        CM_FreeMap(&cm1);
+        return;
+    }
+
+    numportals = min(cm1.cache->lastareaportal + 1, MAX_MAP_AREAS);
+    errors = 0;
+
+    srand(seed);
+    for (i = 0; i < count && numportals > 1; i++) {
+        CM_SetAreaPortalState(&cm1, 1 + rand() % (numportals - 1), rand() & 1);
+
+        bytes = CM_WritePortalBits(&cm1, portalbits);
+        CM_SetPortalStates(&cm2, portalbits, bytes);
+
+        for (j = 1; j < cm1.cache->numareas; j++) {
+            bytes = CM_WriteAreaBits(&cm1, bits1, j);
+            CM_WriteAreaBits(&cm2, bits2, j);
+            if (memcmp(bits1, bits2, bytes)) {
+                Com_EPrintf("Area %d connections differ after %d toggles\n", j, i + 1);
+                errors++;
+                break;
+            }
+        }
+        if (errors) {
+            break;
+        }
+    }
+
+    Com_Printf("%d failures, %d toggles, %d areas, %d portals\n",
+               errors, i, cm1.cache->numareas, numportals);
+
+    CM_FreeMap(&cm1);
+    CM_FreeMap(&cm2);
+}
+
+/*
+=============
+Com_TestFatPVS_f
+
+Checks cached fat PVS rows against ones combined with the cache off, at
+random positions that keep coming back to the same few spots.
+=============
+*/
+static void Com_TestFatPVS_f(void)
+{
+    char name[MAX_QPATH], cache[MAX_QPATH];
+    byte mask1[VIS_MAX_BYTES], mask2[VIS_MAX_BYTES];
+    vec3_t spots[64];
+    cm_t cm1, cm2;
+    mmodel_t *world;
+    int i, j, count, errors;
+    qerror_t ret;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [count]\n", Cmd_Argv(0));
+        return;
+    }
+
+    count = 10000;
+    if (Cmd_Argc() > 2) {
+        count = atoi(Cmd_Argv(2));
+        clamp(count, 1, 1000000);
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp", NULL) >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    ret = CM_LoadMap(&cm1, name);
+    if (ret) {
+        Com_EPrintf("Couldn't load %s: %s\n", name, Q_ErrorString(ret));
+        return;
+    }
+
+    // cache is sized on load, keep it off for the reference map
+    Q_strlcpy(cache, Cvar_VariableString("map_fatpvs_cache"), sizeof(cache));
+    Cvar_Set("map_fatpvs_cache", "0");
+    ret = CM_LoadMap(&cm2, name);
+    Cvar_Set("map_fatpvs_cache", cache);
+    if (ret) {
+        Com_EPrintf("Couldn't load %s: %s\n", name, Q_ErrorString(ret));
+        CM_FreeMap(&cm1);
+        return;
+    }
+
+    world = &cm1.cache->models[0];
+    srand(1);
+    for (i = 0; i < q_countof(spots); i++) {
+        for (j = 0; j < 3; j++) {
+            spots[i][j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+        }
+    }
+
+    errors = 0;
+    for (i = 0; i < count; i++) {
+        if (rand() & 1) {
+            for (j = 0; j < 3; j++) {
+                spots[i % q_countof(spots)][j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+            }
+        }
+        j = rand() % q_countof(spots);
+        CM_FatPVS(&cm1, mask1, spots[j]);
+        CM_FatPVS(&cm2, mask2, spots[j]);
+        if (memcmp(mask1, mask2, cm1.cache->visrowsize)) {
+            errors++;
+        }
+    }
+
+    Com_Printf("%d failures, %d positions\n", errors, count);
+
+    CM_FreeMap(&cm1);
+    CM_FreeMap(&cm2);
+}
+
+#if USE_ZLIB
+
+// load files listed on command line through background prefetch and
+// check they come out the same as loading them directly
+static void Com_TestPrefetch_f(void)
+{
+    void    *data, *ref;
+    ssize_t len, reflen;
+    int     i, errors;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <file> [...]\n", Cmd_Argv(0));
+        return;
+    }
+
+    for (i = 1; i < Cmd_Argc(); i++)
+        FS_Prefetch(Cmd_Argv(i));
+
+    errors = 0;
+    for (i = 1; i < Cmd_Argc(); i++) {
+        len = FS_LoadFile(Cmd_Argv(i), &data);
+        reflen = FS_LoadFile(Cmd_Argv(i), &ref);
+        if (len != reflen || (data && memcmp(data, ref, len))) {
+            Com_EPrintf("%s: prefetched contents differ\n", Cmd_Argv(i));
+            errors++;
+        }
+        if (data)
+            FS_FreeFile(data);
+        if (ref)
+            FS_FreeFile(ref);
+    }
+
+    FS_FlushPrefetch();
+
+    Com_Printf("%d failures, %d files tested\n", errors, Cmd_Argc() - 1);
+}
+
+#endif // USE_ZLIB
+
 void TST_Init(void)
 {
     Cmd_AddCommand("error", Com_Error_f);
@@ -499,9 +1246,22 @@ void TST_Init(void)
     Cmd_AddCommand("crash", Com_Crash_f);
     Cmd_AddCommand("printjunk", Com_PrintJunk_f);
     Cmd_AddCommand("bsptest", BSP_Test_f);
+    Cmd_AddCommand("tracetest", CM_TraceTest_f);
+    Cmd_AddCommand("collbench", Com_CollBench_f);
+    Cmd_AddCommand("floodtest", Com_TestFlood_f);
+    Cmd_AddCommand("fatpvstest", Com_TestFatPVS_f);
     Cmd_AddCommand("wildtest", Com_TestWild_f);
     Cmd_AddCommand("normtest", Com_TestNorm_f);
     Cmd_AddCommand("infotest", Com_TestInfo_f);
     Cmd_AddCommand("snprintftest", Com_TestSnprintf_f);
+    Cmd_AddCommand("boxtest", Com_TestBoxPlanes_f);
+#if USE_CLIENT
+    Cmd_AddCommand("bitstest", Com_TestBits_f);
+#endif
+    Cmd_AddCommand("zonetest", Com_TestZone_f);
+    Cmd_AddCommand("cmdtest", Com_TestCmd_f);
+#if USE_ZLIB
+    Cmd_AddCommand("prefetchtest", Com_TestPrefetch_f);
+#endif
 }
 
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "shared/shared.h"
 #include "common/utils.h"
+#include "common/zone.h"
 
 /*
 ==============================================================================
@@ -179,6 +180,102 @@ qboolean Com_WildCmpEx(const char *filter, const char *string,
     return !*string;
 }
 
+/*
+=================
+Com_WildCompile
+
+Prepares filter for matching against many strings with Com_WildMatch.
+Only filters made of literal parts and '*' wildcards can be compiled,
+returns NULL for anything else. Free the result with Z_Free.
+=================
+*/
+struct wildfilter_s {
+    size_t  minlen;     // sum of literal part lengths
+    int     numparts;   // parts after the first follow a wildcard
+    char    parts[1];   // NUL separated, empty last part matches anything
+};
+
+wildfilter_t *Com_WildCompile(const char *filter)
+{
+    wildfilter_t *w;
+    const char *s;
+    char *p;
+
+    if (strpbrk(filter, "?\\")) {
+        return NULL;
+    }
+
+    w = Z_Malloc(sizeof(*w) + strlen(filter));
+    w->minlen = 0;
+    w->numparts = 1;
+
+    // consecutive wildcards are the same as one
+    for (s = filter, p = w->parts; *s; s++) {
+        if (*s == '*') {
+            if (s > filter && s[-1] == '*') {
+                continue;
+            }
+            *p++ = 0;
+            w->numparts++;
+        } else {
+            *p++ = *s;
+            w->minlen++;
+        }
+    }
+    *p = 0;
+
+    return w;
+}
+
+/*
+=================
+Com_WildMatch
+
+Same result as Com_WildCmp with the filter given to Com_WildCompile.
+=================
+*/
+qboolean Com_WildMatch(const wildfilter_t *w, const char *string)
+{
+    const char *part = w->parts, *s;
+    size_t len;
+    int i;
+
+    if (strlen(string) < w->minlen) {
+        return qfalse;
+    }
+
+    // literal prefix up to the first wildcard
+    len = strlen(part);
+    if (strncmp(string, part, len)) {
+        return qfalse;
+    }
+    string += len;
+    part += len + 1;
+
+    for (i = 1; i < w->numparts; i++) {
+        len = strlen(part);
+
+        // wildcard at the end matches everything
+        if (!len) {
+            return qtrue;
+        }
+
+        // match the longest possible part
+        s = strstr(string, part);
+        if (!s) {
+            return qfalse;
+        }
+        do {
+            string = s + len;
+        } while ((s = strstr(string, part)));
+
+        part += len + 1;
+    }
+
+    // match NUL at the end
+    return !*string;
+}
+
 /*
 ==============================================================================
 
@@ -331,6 +428,26 @@ qboolean Com_ParseTimespec(const char *s, int *frames)
 }
 #endif
 
+/*
+================
+Com_HashKey
+
+Returns full 32-bit FNV-1a hash of the string, for open addressing tables
+that mask it to their current size themselves.
+================
+*/
+unsigned Com_HashKey(const char *s)
+{
+    unsigned hash = 2166136261U;
+
+    while (*s) {
+        hash ^= (byte)*s++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
 /*
 ================
 Com_HashString
@@ -0,0 +1,642 @@
+/*
+Copyright (C) 2003-2012 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "common/zdict.h"
+
+/*
+Preset dictionary for gamestate packets and GTV streams. Most configstrings
+name the same models, sounds and icons of the stock game on every server,
+so the deflater is primed with them and the first copy sent is already a
+back reference.
+
+Entries are the strings found in baseq2 sources that end up in configstrings,
+NUL terminated like on the wire, ordered by how often they occur with the most
+common last, as zlib favours the end of the dictionary. The deathmatch status
+bar goes at the very end.
+
+Both sides must use exactly the same bytes. Changing this needs a new minor
+protocol version and a new GTV hello flag.
+*/
+const char zdict_data[] =
+    "#a_grenades.md2\0"
+    "#w_bfg.md2\0"
+    "#w_blaster.md2\0"
+    "#w_chaingun.md2\0"
+    "#w_glauncher.md2\0"
+    "#w_hyperblaster.md2\0"
+    "#w_machinegun.md2\0"
+    "#w_railgun.md2\0"
+    "#w_rlauncher.md2\0"
+    "#w_shotgun.md2\0"
+    "#w_sshotgun.md2\0"
+    "%s.wav\0"
+    "*death%i.wav\0"
+    "*death1.wav\0"
+    "*death2.wav\0"
+    "*death3.wav\0"
+    "*death4.wav\0"
+    "*fall1.wav\0"
+    "*fall2.wav\0"
+    "*pain%i_%i.wav\0"
+    "*pain100_1.wav\0"
+    "*pain100_2.wav\0"
+    "*pain25_1.wav\0"
+    "*pain25_2.wav\0"
+    "*pain50_1.wav\0"
+    "*pain50_2.wav\0"
+    "*pain75_1.wav\0"
+    "*pain75_2.wav\0"
+    ".wav\0"
+    "Adrenaline\0"
+    "Airstrike Marker\0"
+    "Ammo Pack\0"
+    "Ancient Head\0"
+    "Armor Shard\0"
+    "BFG10K\0"
+    "Bandolier\0"
+    "Blaster\0"
+    "Blue Key\0"
+    "Chaingun\0"
+    "Data CD\0"
+    "Data Spinner\0"
+    "Environment Suit\0"
+    "Grenade Launcher\0"
+    "HyperBlaster\0"
+    "Invulnerability\0"
+    "Machinegun\0"
+    "Power Cube\0"
+    "Pyramid Key\0"
+    "Quad Damage\0"
+    "Railgun\0"
+    "Rebreather\0"
+    "Red Key\0"
+    "Rocket Launcher\0"
+    "Security Pass\0"
+    "Shotgun\0"
+    "Silencer\0"
+    "Super Shotgun\0"
+    "a_bullets\0"
+    "a_cells\0"
+    "a_grenades\0"
+    "a_rockets\0"
+    "a_shells\0"
+    "a_slugs\0"
+    "ammo_bullets\0"
+    "ammo_cells\0"
+    "ammo_grenades\0"
+    "ammo_rockets\0"
+    "ammo_shells\0"
+    "ammo_slugs\0"
+    "berserk/attack.wav\0"
+    "berserk/berdeth2.wav\0"
+    "berserk/beridle1.wav\0"
+    "berserk/berpain2.wav\0"
+    "berserk/bersrch1.wav\0"
+    "berserk/sight.wav\0"
+    "blaster\0"
+    "boss3/bs3atck1.wav\0"
+    "boss3/bs3atck2.wav\0"
+    "boss3/bs3deth1.wav\0"
+    "boss3/bs3idle1.wav\0"
+    "boss3/bs3pain1.wav\0"
+    "boss3/bs3pain2.wav\0"
+    "boss3/bs3pain3.wav\0"
+    "boss3/bs3srch1.wav\0"
+    "boss3/bs3srch2.wav\0"
+    "boss3/bs3srch3.wav\0"
+    "boss3/d_hit.wav\0"
+    "boss3/step1.wav\0"
+    "boss3/step2.wav\0"
+    "boss3/w_loop.wav\0"
+    "boss3/xfire.wav\0"
+    "bosshovr/bhvdeth1.wav\0"
+    "bosshovr/bhvengn1.wav\0"
+    "bosshovr/bhvpain1.wav\0"
+    "bosshovr/bhvpain2.wav\0"
+    "bosshovr/bhvpain3.wav\0"
+    "bosshovr/bhvunqv1.wav\0"
+    "bosstank/btkdeth1.wav\0"
+    "bosstank/btkpain1.wav\0"
+    "bosstank/btkpain2.wav\0"
+    "bosstank/btkpain3.wav\0"
+    "bosstank/btkunqv1.wav\0"
+    "bosstank/btkunqv2.wav\0"
+    "brain/brnatck1.wav\0"
+    "brain/brnatck2.wav\0"
+    "brain/brnatck3.wav\0"
+    "brain/brndeth1.wav\0"
+    "brain/brnidle1.wav\0"
+    "brain/brnidle2.wav\0"
+    "brain/brnlens1.wav\0"
+    "brain/brnpain1.wav\0"
+    "brain/brnpain2.wav\0"
+    "brain/brnsght1.wav\0"
+    "brain/brnsrch1.wav\0"
+    "brain/melee1.wav\0"
+    "brain/melee2.wav\0"
+    "brain/melee3.wav\0"
+    "cells\0"
+    "chick/chkatck1.wav\0"
+    "chick/chkatck2.wav\0"
+    "chick/chkatck3.wav\0"
+    "chick/chkatck4.wav\0"
+    "chick/chkatck5.wav\0"
+    "chick/chkdeth1.wav\0"
+    "chick/chkdeth2.wav\0"
+    "chick/chkfall1.wav\0"
+    "chick/chkidle1.wav\0"
+    "chick/chkidle2.wav\0"
+    "chick/chkpain1.wav\0"
+    "chick/chkpain2.wav\0"
+    "chick/chkpain3.wav\0"
+    "chick/chksght1.wav\0"
+    "chick/chksrch1.wav\0"
+    "doors/hydro1.wav\0"
+    "flipper/flpatck1.wav\0"
+    "flipper/flpatck2.wav\0"
+    "flipper/flpdeth1.wav\0"
+    "flipper/flpidle1.wav\0"
+    "flipper/flppain1.wav\0"
+    "flipper/flppain2.wav\0"
+    "flipper/flpsght1.wav\0"
+    "flipper/flpsrch1.wav\0"
+    "floater/fltatck1.wav\0"
+    "floater/fltatck2.wav\0"
+    "floater/fltatck3.wav\0"
+    "floater/fltdeth1.wav\0"
+    "floater/fltidle1.wav\0"
+    "floater/fltpain1.wav\0"
+    "floater/fltpain2.wav\0"
+    "floater/fltsght1.wav\0"
+    "floater/fltsrch1.wav\0"
+    "flyer/flyatck1.wav\0"
+    "flyer/flyatck2.wav\0"
+    "flyer/flyatck3.wav\0"
+    "flyer/flydeth1.wav\0"
+    "flyer/flyidle1.wav\0"
+    "flyer/flypain1.wav\0"
+    "flyer/flypain2.wav\0"
+    "flyer/flysght1.wav\0"
+    "flyer/flysrch1.wav\0"
+    "gladiator/glddeth2.wav\0"
+    "gladiator/gldidle1.wav\0"
+    "gladiator/gldpain2.wav\0"
+    "gladiator/gldsrch1.wav\0"
+    "gladiator/melee1.wav\0"
+    "gladiator/melee2.wav\0"
+    "gladiator/melee3.wav\0"
+    "gladiator/pain.wav\0"
+    "gladiator/railgun.wav\0"
+    "gladiator/sight.wav\0"
+    "grenades\0"
+    "gunner/death1.wav\0"
+    "gunner/gunatck1.wav\0"
+    "gunner/gunatck2.wav\0"
+    "gunner/gunatck3.wav\0"
+    "gunner/gunidle1.wav\0"
+    "gunner/gunpain1.wav\0"
+    "gunner/gunpain2.wav\0"
+    "gunner/gunsrch1.wav\0"
+    "gunner/sight1.wav\0"
+    "hover/hovatck1.wav\0"
+    "hover/hovdeth1.wav\0"
+    "hover/hovdeth2.wav\0"
+    "hover/hovidle1.wav\0"
+    "hover/hovpain1.wav\0"
+    "hover/hovpain2.wav\0"
+    "hover/hovsght1.wav\0"
+    "hover/hovsrch1.wav\0"
+    "hover/hovsrch2.wav\0"
+    "i_airstrike\0"
+    "i_bodyarmor\0"
+    "i_combatarmor\0"
+    "i_fixme\0"
+    "i_health\0"
+    "i_pack\0"
+    "i_powerscreen\0"
+    "i_powershield\0"
+    "infantry/infatck1.wav\0"
+    "infantry/infatck2.wav\0"
+    "infantry/infdeth1.wav\0"
+    "infantry/infdeth2.wav\0"
+    "infantry/infidle1.wav\0"
+    "infantry/infpain1.wav\0"
+    "infantry/infpain2.wav\0"
+    "infantry/infsght1.wav\0"
+    "infantry/infsrch1.wav\0"
+    "infantry/melee2.wav\0"
+    "insane/insane1.wav\0"
+    "insane/insane10.wav\0"
+    "insane/insane11.wav\0"
+    "insane/insane2.wav\0"
+    "insane/insane3.wav\0"
+    "insane/insane4.wav\0"
+    "insane/insane5.wav\0"
+    "insane/insane6.wav\0"
+    "insane/insane7.wav\0"
+    "insane/insane8.wav\0"
+    "insane/insane9.wav\0"
+    "item_adrenaline\0"
+    "item_ancient_head\0"
+    "item_armor_body\0"
+    "item_armor_combat\0"
+    "item_armor_jacket\0"
+    "item_armor_shard\0"
+    "item_bandolier\0"
+    "item_breather\0"
+    "item_enviro\0"
+    "item_invulnerability\0"
+    "item_pack\0"
+    "item_power_screen\0"
+    "item_power_shield\0"
+    "item_quad\0"
+    "item_silencer\0"
+    "items/damage.wav items/damage2.wav items/damage3.wav\0"
+    "items/protect.wav items/protect2.wav items/protect4.wav\0"
+    "items/respawn1.wav\0"
+    "items/s_health.wav items/n_health.wav items/l_health.wav "
+    "items/m_health.wav\0"
+    "k_bluekey\0"
+    "k_comhead\0"
+    "k_datacd\0"
+    "k_dataspin\0"
+    "k_powercube\0"
+    "k_pyramid\0"
+    "k_redkey\0"
+    "k_security\0"
+    "key_airstrike_target\0"
+    "key_blue_key\0"
+    "key_commander_head\0"
+    "key_data_cd\0"
+    "key_data_spinner\0"
+    "key_pass\0"
+    "key_pyramid\0"
+    "key_red_key\0"
+    "makron/bfg_fire.wav\0"
+    "makron/bhit.wav\0"
+    "makron/brain1.wav\0"
+    "makron/death.wav\0"
+    "makron/pain1.wav\0"
+    "makron/pain2.wav\0"
+    "makron/pain3.wav\0"
+    "makron/popup.wav\0"
+    "makron/rail_up.wav\0"
+    "makron/spine.wav\0"
+    "makron/step1.wav\0"
+    "makron/step2.wav\0"
+    "makron/voice.wav\0"
+    "makron/voice3.wav\0"
+    "makron/voice4.wav\0"
+    "md2\0"
+    "medic/idle.wav\0"
+    "medic/medatck1.wav\0"
+    "medic/medatck2.wav\0"
+    "medic/medatck3.wav\0"
+    "medic/medatck4.wav\0"
+    "medic/medatck5.wav\0"
+    "medic/meddeth1.wav\0"
+    "medic/medpain1.wav\0"
+    "medic/medpain2.wav\0"
+    "medic/medsght1.wav\0"
+    "medic/medsrch1.wav\0"
+    "misc/ar2_pkup.wav\0"
+    "misc/bigtele.wav\0"
+    "misc/fhit3.wav\0"
+    "misc/power2.wav misc/power1.wav\0"
+    "misc/trigger1.wav\0"
+    "misc/windfly.wav\0"
+    "models/deadbods/dude/tris.md2\0"
+    "models/items/adrenal/tris.md2\0"
+    "models/items/ammo/bullets/medium/tris.md2\0"
+    "models/items/ammo/cells/medium/tris.md2\0"
+    "models/items/ammo/grenades/medium/tris.md2\0"
+    "models/items/ammo/rockets/medium/tris.md2\0"
+    "models/items/ammo/shells/medium/tris.md2\0"
+    "models/items/ammo/slugs/medium/tris.md2\0"
+    "models/items/armor/body/tris.md2\0"
+    "models/items/armor/combat/tris.md2\0"
+    "models/items/armor/jacket/tris.md2\0"
+    "models/items/armor/screen/tris.md2\0"
+    "models/items/armor/shard/tris.md2\0"
+    "models/items/armor/shield/tris.md2\0"
+    "models/items/band/tris.md2\0"
+    "models/items/breather/tris.md2\0"
+    "models/items/c_head/tris.md2\0"
+    "models/items/enviro/tris.md2\0"
+    "models/items/healing/large/tris.md2\0"
+    "models/items/healing/medium/tris.md2\0"
+    "models/items/healing/stimpack/tris.md2\0"
+    "models/items/invulner/tris.md2\0"
+    "models/items/keys/data_cd/tris.md2\0"
+    "models/items/keys/key/tris.md2\0"
+    "models/items/keys/pass/tris.md2\0"
+    "models/items/keys/power/tris.md2\0"
+    "models/items/keys/pyramid/tris.md2\0"
+    "models/items/keys/red_key/tris.md2\0"
+    "models/items/keys/spinner/tris.md2\0"
+    "models/items/keys/target/tris.md2\0"
+    "models/items/mega_h/tris.md2\0"
+    "models/items/pack/tris.md2\0"
+    "models/items/quaddama/tris.md2\0"
+    "models/items/silencer/tris.md2\0"
+    "models/monsters/berserk/tris.md2\0"
+    "models/monsters/boss1/tris.md2\0"
+    "models/monsters/boss2/tris.md2\0"
+    "models/monsters/boss3/jorg/tris.md2\0"
+    "models/monsters/brain/tris.md2\0"
+    "models/monsters/commandr/head/tris.md2\0"
+    "models/monsters/commandr/tris.md2\0"
+    "models/monsters/flipper/tris.md2\0"
+    "models/monsters/float/tris.md2\0"
+    "models/monsters/flyer/tris.md2\0"
+    "models/monsters/gladiatr/tris.md2\0"
+    "models/monsters/gunner/tris.md2\0"
+    "models/monsters/hover/tris.md2\0"
+    "models/monsters/insane/tris.md2\0"
+    "models/monsters/medic/tris.md2\0"
+    "models/monsters/mutant/tris.md2\0"
+    "models/monsters/parasite/tris.md2\0"
+    "models/monsters/soldier/tris.md2\0"
+    "models/objects/barrels/tris.md2\0"
+    "models/objects/black/tris.md2\0"
+    "models/objects/bomb/tris.md2\0"
+    "models/objects/gibs/bone2/tris.md2\0"
+    "models/objects/gibs/head/tris.md2\0"
+    "models/objects/gibs/leg/tris.md2\0"
+    "models/objects/grenade/tris.md2 weapons/grenlf1a.wav "
+    "weapons/grenlr1b.wav weapons/grenlb1b.wav\0"
+    "models/objects/grenade2/tris.md2\0"
+    "models/objects/minelite/light1/tris.md2\0"
+    "models/objects/minelite/light2/tris.md2\0"
+    "models/objects/rocket/tris.md2 weapons/rockfly.wav "
+    "weapons/rocklf1a.wav weapons/rocklr1b.wav "
+    "models/objects/debris2/tris.md2\0"
+    "models/objects/satellite/tris.md2\0"
+    "models/ships/bigviper/tris.md2\0"
+    "models/ships/strogg1/tris.md2\0"
+    "models/ships/viper/tris.md2\0"
+    "models/weapons/g_bfg/tris.md2\0"
+    "models/weapons/g_chain/tris.md2\0"
+    "models/weapons/g_hyperb/tris.md2\0"
+    "models/weapons/g_launch/tris.md2\0"
+    "models/weapons/g_machn/tris.md2\0"
+    "models/weapons/g_rail/tris.md2\0"
+    "models/weapons/g_rocket/tris.md2\0"
+    "models/weapons/g_shotg/tris.md2\0"
+    "models/weapons/g_shotg2/tris.md2\0"
+    "models/weapons/v_bfg/tris.md2\0"
+    "models/weapons/v_blast/tris.md2\0"
+    "models/weapons/v_chain/tris.md2\0"
+    "models/weapons/v_handgr/tris.md2\0"
+    "models/weapons/v_hyperb/tris.md2\0"
+    "models/weapons/v_launch/tris.md2\0"
+    "models/weapons/v_machn/tris.md2\0"
+    "models/weapons/v_rail/tris.md2\0"
+    "models/weapons/v_rocket/tris.md2\0"
+    "models/weapons/v_shotg/tris.md2\0"
+    "models/weapons/v_shotg2/tris.md2\0"
+    "mutant/mutatck1.wav\0"
+    "mutant/mutatck2.wav\0"
+    "mutant/mutatck3.wav\0"
+    "mutant/mutdeth1.wav\0"
+    "mutant/mutidle1.wav\0"
+    "mutant/mutpain1.wav\0"
+    "mutant/mutpain2.wav\0"
+    "mutant/mutsght1.wav\0"
+    "mutant/mutsrch1.wav\0"
+    "mutant/step1.wav\0"
+    "mutant/step2.wav\0"
+    "mutant/step3.wav\0"
+    "mutant/thud1.wav\0"
+    "p_adrenaline\0"
+    "p_bandolier\0"
+    "p_envirosuit\0"
+    "p_invulnerability\0"
+    "p_quad\0"
+    "p_rebreather\0"
+    "p_silencer\0"
+    "parasite/paratck1.wav\0"
+    "parasite/paratck2.wav\0"
+    "parasite/paratck3.wav\0"
+    "parasite/paratck4.wav\0"
+    "parasite/pardeth1.wav\0"
+    "parasite/paridle1.wav\0"
+    "parasite/paridle2.wav\0"
+    "parasite/parpain1.wav\0"
+    "parasite/parpain2.wav\0"
+    "parasite/parsght1.wav\0"
+    "parasite/parsrch1.wav\0"
+    "pcx\0"
+    "plats/pt1_end.wav\0"
+    "plats/pt1_mid.wav\0"
+    "plats/pt1_strt.wav\0"
+    "player/burn1.wav\0"
+    "player/burn2.wav\0"
+    "player/drown1.wav\0"
+    "player/fry.wav\0"
+    "player/lava_in.wav\0"
+    "player/male/death%i.wav\0"
+    "player/male/jump1.wav\0"
+    "player/male/pain%i_%i.wav\0"
+    "soldier/solatck1.wav\0"
+    "soldier/solatck2.wav\0"
+    "soldier/solatck3.wav\0"
+    "soldier/soldeth1.wav\0"
+    "soldier/soldeth2.wav\0"
+    "soldier/soldeth3.wav\0"
+    "soldier/solidle1.wav\0"
+    "soldier/solpain1.wav\0"
+    "soldier/solpain2.wav\0"
+    "soldier/solpain3.wav\0"
+    "soldier/solsght1.wav\0"
+    "soldier/solsrch1.wav\0"
+    "sp2\0"
+    "sprites/s_bfg1.sp2 sprites/s_bfg2.sp2 sprites/s_bfg3.sp2 "
+    "weapons/bfg__f1y.wav weapons/bfg__l1a.wav weapons/bfg__x1b.wav "
+    "weapons/bfg_hum.wav\0"
+    "sprites/s_bfg2.sp2\0"
+    "switches/butn2.wav\0"
+    "tank/death.wav\0"
+    "tank/sight1.wav\0"
+    "tank/step.wav\0"
+    "tank/tnkatck1.wav\0"
+    "tank/tnkatck3.wav\0"
+    "tank/tnkatck4.wav\0"
+    "tank/tnkatck5.wav\0"
+    "tank/tnkatk2a.wav\0"
+    "tank/tnkatk2b.wav\0"
+    "tank/tnkatk2c.wav\0"
+    "tank/tnkatk2d.wav\0"
+    "tank/tnkatk2e.wav\0"
+    "tank/tnkdeth2.wav\0"
+    "tank/tnkidle1.wav\0"
+    "tank/tnkpain2.wav\0"
+    "w_bfg\0"
+    "w_blaster\0"
+    "w_chaingun\0"
+    "w_glauncher\0"
+    "w_hyperblaster\0"
+    "w_machinegun\0"
+    "w_railgun\0"
+    "w_rlauncher\0"
+    "w_shotgun\0"
+    "w_sshotgun\0"
+    "wav\0"
+    "weapons/bfg__f1y.wav\0"
+    "weapons/blastf1a.wav\0"
+    "weapons/blastf1a.wav misc/lasfly.wav\0"
+    "weapons/chngnu1a.wav weapons/chngnl1a.wav weapons/machgf3b.wav` "
+    "weapons/chngnd1a.wav\0"
+    "weapons/grenlf1a.wav\0"
+    "weapons/grenlr1b.wav\0"
+    "weapons/hyprbf1a.wav\0"
+    "weapons/hyprbu1a.wav\0"
+    "weapons/hyprbu1a.wav weapons/hyprbl1a.wav weapons/hyprbf1a.wav "
+    "weapons/hyprbd1a.wav misc/lasfly.wav\0"
+    "weapons/laser2.wav\0"
+    "weapons/machgf1b.wav\0"
+    "weapons/machgf1b.wav weapons/machgf2b.wav weapons/machgf3b.wav "
+    "weapons/machgf4b.wav weapons/machgf5b.wav\0"
+    "weapons/machgf2b.wav\0"
+    "weapons/machgf3b.wav\0"
+    "weapons/machgf3b.wav`\0"
+    "weapons/machgf4b.wav\0"
+    "weapons/machgf5b.wav\0"
+    "weapons/rocklr1b.wav\0"
+    "weapons/shotgf1b.wav\0"
+    "weapons/shotgf1b.wav weapons/shotgr1b.wav\0"
+    "weapons/shotgr1b.wav\0"
+    "world/amb10.wav\0"
+    "world/electro.wav\0"
+    "world/quake.wav\0"
+    "*gurp1.wav\0"
+    "*gurp2.wav\0"
+    "*jump1.wav\0"
+    "Body Armor\0"
+    "Combat Armor\0"
+    "Jacket Armor\0"
+    "Power Screen\0"
+    "Power Shield\0"
+    "bosstank/btkengn1.wav\0"
+    "i_jacketarmor\0"
+    "infantry/infatck3.wav\0"
+    "infantry/inflies1.wav\0"
+    "items/damage2.wav\0"
+    "items/damage3.wav\0"
+    "items/protect2.wav\0"
+    "misc/ar3_pkup.wav\0"
+    "misc/keytry.wav\0"
+    "misc/keyuse.wav\0"
+    "misc/pc_up.wav\0"
+    "misc/power1.wav\0"
+    "models/monsters/infantry/tris.md2\0"
+    "models/monsters/tank/tris.md2\0"
+    "models/objects/banner/tris.md2\0"
+    "models/objects/dmspot/tris.md2\0"
+    "models/objects/gibs/arm/tris.md2\0"
+    "models/objects/gibs/skull/tris.md2\0"
+    "models/objects/grenade/tris.md2\0"
+    "models/objects/laser/tris.md2\0"
+    "models/objects/rocket/tris.md2\0"
+    "player/gasp1.wav\0"
+    "player/gasp2.wav\0"
+    "player/lava1.wav\0"
+    "player/lava2.wav\0"
+    "player/u_breath1.wav\0"
+    "player/u_breath2.wav\0"
+    "player/watr_un.wav\0"
+    "players/male/tris.md2\0"
+    "sprites/s_bfg1.sp2\0"
+    "sprites/s_bfg3.sp2\0"
+    "tank/pain.wav\0"
+    "tank/thud.wav\0"
+    "weapons/bfg__l1a.wav\0"
+    "weapons/bfg__x1b.wav\0"
+    "weapons/bfg_hum.wav\0"
+    "weapons/chngnd1a.wav\0"
+    "weapons/chngnl1a.wav\0"
+    "weapons/chngnu1a.wav\0"
+    "weapons/grenlb1b.wav\0"
+    "weapons/hgrena1b.wav\0"
+    "weapons/hgrenb1a.wav\0"
+    "weapons/hgrenb2a.wav\0"
+    "weapons/hgrent1a.wav\0"
+    "weapons/hyprbd1a.wav\0"
+    "weapons/hyprbl1a.wav\0"
+    "weapons/rockfly.wav\0"
+    "weapons/rocklf1a.wav\0"
+    "weapons/sshotf1b.wav\0"
+    "world/land.wav\0"
+    "world/mov_watr.wav\0"
+    "world/stp_watr.wav\0"
+    "Grenades\0"
+    "Rockets\0"
+    "Slugs\0"
+    "doors/dr1_end.wav\0"
+    "doors/dr1_mid.wav\0"
+    "doors/dr1_strt.wav\0"
+    "items/l_health.wav\0"
+    "items/m_health.wav\0"
+    "items/n_health.wav\0"
+    "items/protect.wav\0"
+    "items/protect4.wav\0"
+    "items/s_health.wav\0"
+    "misc/ar1_pkup.wav\0"
+    "misc/h2ohit1.wav\0"
+    "misc/power2.wav\0"
+    "misc/secret.wav\0"
+    "models/monsters/bitch/tris.md2\0"
+    "models/objects/gibs/gear/tris.md2\0"
+    "models/objects/gibs/sm_metal/tris.md2\0"
+    "player/watr_out.wav\0"
+    "weapons/hgrenc1b.wav\0"
+    "weapons/rg_hum.wav\0"
+    "Cells\0"
+    "key_power_cube\0"
+    "misc/lasfly.wav\0"
+    "misc/talk.wav\0"
+    "models/objects/gibs/chest/tris.md2\0"
+    "Bullets\0"
+    "Health\0"
+    "Shells\0"
+    "misc/talk1.wav\0"
+    "models/monsters/boss3/rider/tris.md2\0"
+    "models/objects/debris1/tris.md2\0"
+    "models/objects/debris3/tris.md2\0"
+    "player/watr_in.wav\0"
+    "items/airout.wav\0"
+    "items/damage.wav\0"
+    "misc/am_pkup.wav\0"
+    "weapons/noammo.wav\0"
+    "misc/w_pkup.wav\0"
+    "models/objects/debris2/tris.md2\0"
+    "models/objects/gibs/bone/tris.md2\0"
+    "models/objects/gibs/head2/tris.md2\0"
+    "items/pkup.wav\0"
+    "misc/udeath.wav\0"
+    "models/objects/gibs/sm_meat/tris.md2\0"
+    "yb -24 xv 0 hnum xv 50 pic 0 if 2    xv  100    anum    xv  150    "
+    "pic 2 endif if 4    xv  200    rnum    xv  250    pic 4 endif if 6    "
+    "xv  296    pic 6 endif yb -50 if 7    xv  0    pic 7    xv  26    yb  "
+    "-42    stat_string 8    yb  -50 endif if 9    xv  246    num 2   10   "
+    " xv  296    pic 9 endif if 11    xv  148    pic 11 endif xr -50 yt 2 "
+    "num 3 14 if 17 xv 0 yb -58 string2 \"SPECTATOR MODE\" endif if 16 xv 0 "
+    "yb -68 string \"Chasing\" xv 64 stat_string 16 endif \0";
+
+const size_t zdict_size = sizeof(zdict_data) - 1;
@@ -19,44 +19,152 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "common/common.h"
 #include "common/zone.h"
+#include "system/thread.h"
+#include "system/hunk.h"
+
+//
+// Every thread allocates into its own arena, which has its own chain of
+// blocks, statistics and lock. The lock is normally taken only by the
+// owning thread, so it is never contended, and no counters are shared
+// between threads. Blocks remember their arena, so they can be freed or
+// reallocated by any thread. Walking the whole zone (Z_FreeTags, Z_LeakTest,
+// Z_Stats_f) visits all arenas in turn.
+//
+// Threads beyond Z_MAX_ARENAS share arenas, which is still correct.
+//
+// Z_TagReserve and friends remain main thread only.
+//
+// Each arena also has a linear frame arena for transient allocations, see
+// Z_FrameAlloc.
+//
 
 #define Z_MAGIC     0x1d0d
+#define Z_SLABMAGIC 0x1d5b
 #define Z_TAIL      0x5b7b
 
 #define Z_TAIL_F(z) \
     *(uint16_t *)((byte *)(z) + (z)->size - sizeof(uint16_t))
 
-#define Z_FOR_EACH(z) \
-    for ((z) = z_chain.next; (z) != &z_chain; (z) = (z)->next)
+#define Z_FOR_EACH(z, a) \
+    for ((z) = (a)->chain.next; (z) != &(a)->chain; (z) = (z)->next)
+
+#define Z_FOR_EACH_SAFE(z, n, a) \
+    for ((z) = (a)->chain.next; (z) != &(a)->chain; (z) = (n))
+
+#define Z_MAX_ARENAS    8
+
+// address space reserved for each frame arena, pages are committed on use
+#define Z_FRAME_SIZE    0x100000
+
+//
+// Allocations of up to Z_SLAB_MAX bytes are carved out of Z_PAGE_SIZE pages
+// of fixed size blocks, one list of pages per size class, instead of being
+// malloc'ed one by one. Slab blocks have only a ztrail_t in front of them
+// and no tail. Pages with free blocks are kept at the front of their list,
+// and a page is released when it becomes empty, unless it is the last one.
+//
+// Every block, slab or not, has a ztrail_t immediately before its data,
+// so Z_Free can tell the two apart by the magic.
+//
+#define Z_SLAB_MAX      256
+#define Z_SLAB_CLASSES  10
+#define Z_PAGE_SIZE     0x4000
+
+static const uint16_t z_slabsizes[Z_SLAB_CLASSES] = {
+    8, 16, 24, 32, 48, 64, 96, 128, 192, 256
+};
 
-#define Z_FOR_EACH_SAFE(z, n) \
-    for ((z) = z_chain.next; (z) != &z_chain; (z) = (n))
+// indexed by (size + 7) >> 3
+static byte z_slabclass[(Z_SLAB_MAX >> 3) + 1];
 
-typedef struct zhead_s {
-    uint16_t    magic;
+struct zarena_s;
+
+typedef struct {
+    uint32_t    offset;         // of slab block within its page
     uint16_t    tag;            // for group free
+    uint16_t    magic;
+} ztrail_t;
+
+typedef struct zhead_s {
     size_t      size;
 #ifdef _DEBUG
     void        *addr;
     time_t      time;
 #endif
     struct zhead_s  *prev, *next;
+    struct zarena_s *arena;     // chain this block is linked into
+    // followed by ztrail_t
 } zhead_t;
 
+typedef struct zpage_s {
+    struct zpage_s  *prev, *next;
+    struct zarena_s *arena;
+    ztrail_t        *free;      // linked through block data
+    unsigned        used;
+    unsigned        cls;
+} zpage_t;
+
 // number of overhead bytes
-#define Z_EXTRA (sizeof(zhead_t) + sizeof(uint16_t))
+#define Z_EXTRA (sizeof(zhead_t) + sizeof(ztrail_t) + sizeof(uint16_t))
+
+#define Z_PAGE_HEADER   ((sizeof(zpage_t) + 7) & ~7)
+
+#define Z_SLAB_STRIDE(cls)  (sizeof(ztrail_t) + z_slabsizes[cls])
 
-static zhead_t      z_chain;
+#define Z_TRAIL(z)      ((ztrail_t *)((z) + 1))
+#define Z_HEAD(t)       ((zhead_t *)((byte *)(t) - sizeof(zhead_t)))
+#define Z_PAGE(t)       ((zpage_t *)((byte *)(t) - (t)->offset))
+#define Z_PAGE_SLOT(p, i) \
+    ((ztrail_t *)((byte *)(p) + Z_PAGE_HEADER + (i) * Z_SLAB_STRIDE((p)->cls)))
+#define Z_PAGE_SLOTS(cls) \
+    ((Z_PAGE_SIZE - Z_PAGE_HEADER) / Z_SLAB_STRIDE(cls))
+
+typedef struct {
+    size_t count;
+    size_t bytes;
+} zstats_t;
+
+// heap block for a frame allocation that didn't fit into the hunk
+typedef struct zspill_s {
+    struct zspill_s *next;
+    size_t          pad;
+} zspill_t;
+
+typedef struct zarena_s {
+    qmutex_t    *lock;
+    zhead_t     chain;
+    zpage_t     slabs[Z_SLAB_CLASSES];  // list heads
+    unsigned    numpages;
+    zstats_t    stats[TAG_MAX];
+    memhunk_t   frame;
+    size_t      framepeak;
+    zspill_t    *spills;
+    unsigned    numspills;
+} zarena_t;
+
+static zarena_t     z_arenas[Z_MAX_ARENAS];
+static unsigned     z_numarenas;
+static qmutex_t     *z_arenalock;       // protects z_numarenas
+
+static q_threadlocal zarena_t   *z_arena;   // of the calling thread
 
 typedef struct {
     zhead_t     z;
+    ztrail_t    t;
     char        data[2];
     uint16_t    tail;
 } zstatic_t;
 
 static const zstatic_t z_static[] = {
+#ifdef _DEBUG
+#define Z_STATIC(x) \
+    { { q_offsetof(zstatic_t, tail) + sizeof(uint16_t), NULL, 0 }, \
+      { 0, TAG_STATIC, Z_MAGIC }, x, Z_TAIL }
+#else
 #define Z_STATIC(x) \
-    { { Z_MAGIC, TAG_STATIC, q_offsetof(zstatic_t, tail) + sizeof(uint16_t) }, x, Z_TAIL }
+    { { q_offsetof(zstatic_t, tail) + sizeof(uint16_t) }, \
+      { 0, TAG_STATIC, Z_MAGIC }, x, Z_TAIL }
+#endif
 
     Z_STATIC("0"),
     Z_STATIC("1"),
@@ -73,13 +181,6 @@ static const zstatic_t z_static[] = {
 #undef Z_STATIC
 };
 
-typedef struct {
-    size_t count;
-    size_t bytes;
-} zstats_t;
-
-static zstats_t z_stats[TAG_MAX];
-
 static const char z_tagnames[TAG_MAX][8] = {
     "game",
     "static",
@@ -95,39 +196,201 @@ static const char z_tagnames[TAG_MAX][8] = {
     "cmodel"
 };
 
-static inline void Z_Validate(zhead_t *z, const char *func)
+// assigns an arena to the calling thread on its first allocation
+static zarena_t *Z_GetArena(void)
+{
+    if (!z_arena) {
+        Sys_LockMutex(z_arenalock);
+        z_arena = &z_arenas[z_numarenas % Z_MAX_ARENAS];
+        z_numarenas++;
+        Sys_UnlockMutex(z_arenalock);
+    }
+    return z_arena;
+}
+
+static inline zstats_t *Z_Stats(zarena_t *a, unsigned tag)
+{
+    return &a->stats[tag < TAG_MAX ? tag : TAG_FREE];
+}
+
+static inline void Z_Fail(zarena_t *locked, const char *func, const char *what)
+{
+    if (locked) {
+        Sys_UnlockMutex(locked->lock);
+    }
+    Com_Error(ERR_FATAL, "%s: bad %s", func, what);
+}
+
+// locked arena, if any, is released before erroring out
+static inline void Z_Validate(zhead_t *z, zarena_t *locked, const char *func)
+{
+    ztrail_t *t = Z_TRAIL(z);
+
+    if (t->magic != Z_MAGIC) {
+        Z_Fail(locked, func, "magic");
+    } else if (Z_TAIL_F(z) != Z_TAIL) {
+        Z_Fail(locked, func, "tail");
+    } else if (t->tag == TAG_FREE) {
+        Z_Fail(locked, func, "tag");
+    }
+}
+
+// free slab blocks are valid too
+static inline void Z_ValidateSlab(ztrail_t *t, zarena_t *locked, const char *func)
+{
+    if (t->magic != Z_SLABMAGIC) {
+        Z_Fail(locked, func, "magic");
+    }
+}
+
+#define Z_FOR_EACH_PAGE(p, a, cls) \
+    for ((p) = (a)->slabs[cls].next; (p) != &(a)->slabs[cls]; (p) = (p)->next)
+
+static inline void Z_UnlinkPage(zpage_t *p)
 {
-    if (z->magic != Z_MAGIC) {
-        Com_Error(ERR_FATAL, "%s: bad magic", func);
+    p->prev->next = p->next;
+    p->next->prev = p->prev;
+}
+
+static inline void Z_LinkPage(zpage_t *p, zpage_t *after)
+{
+    p->prev = after;
+    p->next = after->next;
+    after->next->prev = p;
+    after->next = p;
+}
+
+// called with arena lock held
+static ztrail_t *Z_SlabAlloc(zarena_t *a, unsigned cls, memtag_t tag)
+{
+    zpage_t *head = &a->slabs[cls];
+    zpage_t *p = head->next;
+    ztrail_t *t;
+    unsigned i, count;
+
+    if (p == head || !p->free) {
+        p = malloc(Z_PAGE_SIZE);
+        if (!p) {
+            Sys_UnlockMutex(a->lock);
+            Com_Error(ERR_FATAL, "%s: couldn't allocate %d bytes", __func__, Z_PAGE_SIZE);
+        }
+        p->arena = a;
+        p->used = 0;
+        p->cls = cls;
+        p->free = NULL;
+        count = Z_PAGE_SLOTS(cls);
+        for (i = count; i > 0; i--) {
+            t = Z_PAGE_SLOT(p, i - 1);
+            t->offset = (byte *)t - (byte *)p;
+            t->tag = TAG_FREE;
+            t->magic = Z_SLABMAGIC;
+            *(ztrail_t **)(t + 1) = p->free;
+            p->free = t;
+        }
+        Z_LinkPage(p, head);
+        a->numpages++;
     }
-    if (Z_TAIL_F(z) != Z_TAIL) {
-        Com_Error(ERR_FATAL, "%s: bad tail", func);
+
+    t = p->free;
+    p->free = *(ztrail_t **)(t + 1);
+    p->used++;
+    t->tag = tag;
+
+    // keep pages with free blocks at the front
+    if (!p->free) {
+        Z_UnlinkPage(p);
+        Z_LinkPage(p, head->prev);
     }
-    if (z->tag == TAG_FREE) {
-        Com_Error(ERR_FATAL, "%s: bad tag", func);
+
+    return t;
+}
+
+// called with arena lock held, returns qtrue if the page was released
+static qboolean Z_SlabFreeLocked(ztrail_t *t)
+{
+    zpage_t *p = Z_PAGE(t);
+    zpage_t *head = &p->arena->slabs[p->cls];
+    zstats_t *s = Z_Stats(p->arena, t->tag);
+    qboolean full = !p->free;
+
+    s->count--;
+    s->bytes -= Z_SLAB_STRIDE(p->cls);
+
+    t->tag = TAG_FREE;
+    *(ztrail_t **)(t + 1) = p->free;
+    p->free = t;
+
+    if (!--p->used && (head->next != p || p->next != head)) {
+        Z_UnlinkPage(p);
+        p->arena->numpages--;
+        free(p);
+        return qtrue;
     }
+
+    if (full) {
+        Z_UnlinkPage(p);
+        Z_LinkPage(p, head);
+    }
+
+    return qfalse;
 }
 
 void Z_Check(void)
 {
+    zarena_t *a;
     zhead_t *z;
+    zpage_t *p;
+    int i, j, k, n;
 
-    Z_FOR_EACH(z) {
-        Z_Validate(z, __func__);
+    for (i = 0, a = z_arenas; i < Z_MAX_ARENAS; i++, a++) {
+        Sys_LockMutex(a->lock);
+        Z_FOR_EACH(z, a) {
+            Z_Validate(z, a, __func__);
+        }
+        for (j = 0; j < Z_SLAB_CLASSES; j++) {
+            n = Z_PAGE_SLOTS(j);
+            Z_FOR_EACH_PAGE(p, a, j) {
+                for (k = 0; k < n; k++) {
+                    Z_ValidateSlab(Z_PAGE_SLOT(p, k), a, __func__);
+                }
+            }
+        }
+        Sys_UnlockMutex(a->lock);
     }
 }
 
 void Z_LeakTest(memtag_t tag)
 {
+    zarena_t *a;
     zhead_t *z;
+    zpage_t *p;
+    ztrail_t *t;
     size_t numLeaks = 0, numBytes = 0;
-
-    Z_FOR_EACH(z) {
-        Z_Validate(z, __func__);
-        if (z->tag == tag) {
-            numLeaks++;
-            numBytes += z->size;
+    int i, j, k, n;
+
+    for (i = 0, a = z_arenas; i < Z_MAX_ARENAS; i++, a++) {
+        Sys_LockMutex(a->lock);
+        Z_FOR_EACH(z, a) {
+            Z_Validate(z, a, __func__);
+            if (Z_TRAIL(z)->tag == tag) {
+                numLeaks++;
+                numBytes += z->size;
+            }
         }
+        for (j = 0; j < Z_SLAB_CLASSES; j++) {
+            n = Z_PAGE_SLOTS(j);
+            Z_FOR_EACH_PAGE(p, a, j) {
+                for (k = 0; k < n; k++) {
+                    t = Z_PAGE_SLOT(p, k);
+                    Z_ValidateSlab(t, a, __func__);
+                    if (t->tag == tag) {
+                        numLeaks++;
+                        numBytes += Z_SLAB_STRIDE(j);
+                    }
+                }
+            }
+        }
+        Sys_UnlockMutex(a->lock);
     }
 
     if (numLeaks) {
@@ -139,6 +402,22 @@ void Z_LeakTest(memtag_t tag)
     }
 }
 
+// unlinks and frees the block, called with arena lock held
+static void Z_FreeLocked(zhead_t *z)
+{
+    ztrail_t *t = Z_TRAIL(z);
+    zstats_t *s = Z_Stats(z->arena, t->tag);
+
+    s->count--;
+    s->bytes -= z->size;
+
+    z->prev->next = z->next;
+    z->next->prev = z->prev;
+    t->magic = 0xdead;
+    t->tag = TAG_FREE;
+    free(z);
+}
+
 /*
 ========================
 Z_Free
@@ -146,6 +425,8 @@ Z_Free
 */
 void Z_Free(void *ptr)
 {
+    zarena_t *a;
+    ztrail_t *t;
     zhead_t *z;
     zstats_t *s;
 
@@ -153,21 +434,38 @@ void Z_Free(void *ptr)
         return;
     }
 
-    z = (zhead_t *)ptr - 1;
+    t = (ztrail_t *)ptr - 1;
+
+    if (t->magic == Z_SLABMAGIC) {
+        if (t->tag == TAG_FREE) {
+            Z_Fail(NULL, __func__, "tag");
+        }
+        a = Z_PAGE(t)->arena;
+        Sys_LockMutex(a->lock);
+        Z_SlabFreeLocked(t);
+        Sys_UnlockMutex(a->lock);
+        return;
+    }
 
-    Z_Validate(z, __func__);
+    z = Z_HEAD(t);
 
-    s = &z_stats[z->tag < TAG_MAX ? z->tag : TAG_FREE];
-    s->count--;
-    s->bytes -= z->size;
+    Z_Validate(z, NULL, __func__);
 
-    if (z->tag != TAG_STATIC) {
-        z->prev->next = z->next;
-        z->next->prev = z->prev;
-        z->magic = 0xdead;
-        z->tag = TAG_FREE;
-        free(z);
+    // static blocks are shared, account them to the caller
+    if (t->tag == TAG_STATIC) {
+        a = Z_GetArena();
+        Sys_LockMutex(a->lock);
+        s = Z_Stats(a, TAG_STATIC);
+        s->count--;
+        s->bytes -= z->size;
+        Sys_UnlockMutex(a->lock);
+        return;
     }
+
+    a = z->arena;
+    Sys_LockMutex(a->lock);
+    Z_FreeLocked(z);
+    Sys_UnlockMutex(a->lock);
 }
 
 /*
@@ -177,8 +475,12 @@ Z_Realloc
 */
 void *Z_Realloc(void *ptr, size_t size)
 {
+    zarena_t *a;
+    ztrail_t *t;
     zhead_t *z;
     zstats_t *s;
+    void *copy;
+    size_t len;
 
     if (!ptr) {
         return Z_Malloc(size);
@@ -189,24 +491,47 @@ void *Z_Realloc(void *ptr, size_t size)
         return NULL;
     }
 
-    z = (zhead_t *)ptr - 1;
+    t = (ztrail_t *)ptr - 1;
 
-    Z_Validate(z, __func__);
+    // slab blocks are moved unless the size class stays the same
+    if (t->magic == Z_SLABMAGIC) {
+        if (t->tag == TAG_FREE) {
+            Z_Fail(NULL, __func__, "tag");
+        }
+        len = z_slabsizes[Z_PAGE(t)->cls];
+        if (size <= len && size > len / 2) {
+            return ptr;
+        }
+        copy = Z_TagMalloc(size, t->tag);
+        memcpy(copy, ptr, min(size, len));
+        Z_Free(ptr);
+        return copy;
+    }
 
-    if (z->tag == TAG_STATIC) {
+    z = Z_HEAD(t);
+
+    Z_Validate(z, NULL, __func__);
+
+    if (t->tag == TAG_STATIC) {
         Com_Error(ERR_FATAL, "%s: couldn't realloc static memory", __func__);
     }
 
-    s = &z_stats[z->tag < TAG_MAX ? z->tag : TAG_FREE];
-    s->bytes -= z->size;
-
     if (size > SIZE_MAX - Z_EXTRA - 3) {
         Com_Error(ERR_FATAL, "%s: bad size", __func__);
     }
 
     size = (size + Z_EXTRA + 3) & ~3;
+
+    // neighbours in the chain are fixed up, so hold the lock throughout
+    a = z->arena;
+    Sys_LockMutex(a->lock);
+
+    s = Z_Stats(a, t->tag);
+    s->bytes -= z->size;
+
     z = realloc(z, size);
     if (!z) {
+        Sys_UnlockMutex(a->lock);
         Com_Error(ERR_FATAL, "%s: couldn't realloc %"PRIz" bytes", __func__, size);
     }
 
@@ -216,9 +541,40 @@ void *Z_Realloc(void *ptr, size_t size)
 
     s->bytes += size;
 
+    Sys_UnlockMutex(a->lock);
+
     Z_TAIL_F(z) = Z_TAIL;
 
-    return z + 1;
+    return Z_TRAIL(z) + 1;
+}
+
+/*
+========================
+Z_GetTagStats
+
+Fills in bytes and blocks in use per tag, both indexed by memtag_t.
+========================
+*/
+void Z_GetTagStats(size_t *bytes, size_t *blocks)
+{
+    zarena_t *a;
+    int i, j;
+
+    memset(bytes, 0, sizeof(*bytes) * TAG_MAX);
+    memset(blocks, 0, sizeof(*blocks) * TAG_MAX);
+    for (i = 0, a = z_arenas; i < Z_MAX_ARENAS; i++, a++) {
+        Sys_LockMutex(a->lock);
+        for (j = 0; j < TAG_MAX; j++) {
+            blocks[j] += a->stats[j].count;
+            bytes[j] += a->stats[j].bytes;
+        }
+        Sys_UnlockMutex(a->lock);
+    }
+}
+
+const char *Z_TagName(memtag_t tag)
+{
+    return z_tagnames[tag < TAG_MAX ? tag : TAG_FREE];
 }
 
 /*
@@ -229,13 +585,31 @@ Z_Stats_f
 void Z_Stats_f(void)
 {
     size_t bytes = 0, count = 0;
-    zstats_t *s;
-    int i;
+    zstats_t stats[TAG_MAX], *s;
+    unsigned numpages = 0, numspills = 0;
+    size_t framepeak = 0;
+    zarena_t *a;
+    int i, j;
+
+    // static blocks freed by another thread can make a single arena go
+    // negative, but these are unsigned and the sum comes out right
+    memset(stats, 0, sizeof(stats));
+    for (i = 0, a = z_arenas; i < Z_MAX_ARENAS; i++, a++) {
+        Sys_LockMutex(a->lock);
+        for (j = 0; j < TAG_MAX; j++) {
+            stats[j].count += a->stats[j].count;
+            stats[j].bytes += a->stats[j].bytes;
+        }
+        numpages += a->numpages;
+        framepeak += a->framepeak;
+        numspills += a->numspills;
+        Sys_UnlockMutex(a->lock);
+    }
 
     Com_Printf("    bytes blocks name\n"
                "--------- ------ -------\n");
 
-    for (i = 0, s = z_stats; i < TAG_MAX; i++, s++) {
+    for (i = 0, s = stats; i < TAG_MAX; i++, s++) {
         if (!s->count) {
             continue;
         }
@@ -247,6 +621,15 @@ void Z_Stats_f(void)
     Com_Printf("--------- ------ -------\n"
                "%9"PRIz" %6"PRIz" total\n",
                bytes, count);
+
+    if (numpages) {
+        Com_Printf("%u slab pages, %u KB\n", numpages, numpages * (Z_PAGE_SIZE >> 10));
+    }
+
+    if (framepeak) {
+        Com_Printf("frame arenas peak %"PRIz" KB, %u spills\n",
+                   framepeak >> 10, numspills);
+    }
 }
 
 /*
@@ -256,14 +639,36 @@ Z_FreeTags
 */
 void Z_FreeTags(memtag_t tag)
 {
+    zarena_t *a;
     zhead_t *z, *n;
-
-    Z_FOR_EACH_SAFE(z, n) {
-        Z_Validate(z, __func__);
-        n = z->next;
-        if (z->tag == tag) {
-            Z_Free(z + 1);
+    zpage_t *p, *next;
+    ztrail_t *t;
+    int i, j, k, count;
+
+    for (i = 0, a = z_arenas; i < Z_MAX_ARENAS; i++, a++) {
+        Sys_LockMutex(a->lock);
+        Z_FOR_EACH_SAFE(z, n, a) {
+            Z_Validate(z, a, __func__);
+            n = z->next;
+            if (Z_TRAIL(z)->tag == tag) {
+                Z_FreeLocked(z);
+            }
+        }
+        for (j = 0; j < Z_SLAB_CLASSES; j++) {
+            count = Z_PAGE_SLOTS(j);
+            for (p = a->slabs[j].next; p != &a->slabs[j]; p = next) {
+                next = p->next;
+                for (k = 0; k < count; k++) {
+                    t = Z_PAGE_SLOT(p, k);
+                    Z_ValidateSlab(t, a, __func__);
+                    // stop once the page itself is gone
+                    if (t->tag == tag && Z_SlabFreeLocked(t)) {
+                        break;
+                    }
+                }
+            }
         }
+        Sys_UnlockMutex(a->lock);
     }
 }
 
@@ -274,8 +679,11 @@ Z_TagMalloc
 */
 void *Z_TagMalloc(size_t size, memtag_t tag)
 {
+    zarena_t *a;
     zhead_t *z;
+    ztrail_t *t;
     zstats_t *s;
+    unsigned cls;
 
     if (!size) {
         return NULL;
@@ -285,6 +693,24 @@ void *Z_TagMalloc(size_t size, memtag_t tag)
         Com_Error(ERR_FATAL, "%s: bad tag", __func__);
     }
 
+    if (size <= Z_SLAB_MAX && (!z_slabs || z_slabs->integer)) {
+        cls = z_slabclass[(size + 7) >> 3];
+        a = Z_GetArena();
+
+        Sys_LockMutex(a->lock);
+        t = Z_SlabAlloc(a, cls, tag);
+        s = Z_Stats(a, tag);
+        s->count++;
+        s->bytes += Z_SLAB_STRIDE(cls);
+        Sys_UnlockMutex(a->lock);
+
+        if (z_perturb && z_perturb->integer) {
+            memset(t + 1, z_perturb->integer, z_slabsizes[cls]);
+        }
+
+        return t + 1;
+    }
+
     if (size > SIZE_MAX - Z_EXTRA - 3) {
         Com_Error(ERR_FATAL, "%s: bad size", __func__);
     }
@@ -294,8 +720,10 @@ void *Z_TagMalloc(size_t size, memtag_t tag)
     if (!z) {
         Com_Error(ERR_FATAL, "%s: couldn't allocate %"PRIz" bytes", __func__, size);
     }
-    z->magic = Z_MAGIC;
-    z->tag = tag;
+    t = Z_TRAIL(z);
+    t->offset = 0;
+    t->tag = tag;
+    t->magic = Z_MAGIC;
     z->size = size;
 
 #ifdef _DEBUG
@@ -309,22 +737,27 @@ void *Z_TagMalloc(size_t size, memtag_t tag)
     z->time = time(NULL);
 #endif
 
-    z->next = z_chain.next;
-    z->prev = &z_chain;
-    z_chain.next->prev = z;
-    z_chain.next = z;
-
     if (z_perturb && z_perturb->integer) {
-        memset(z + 1, z_perturb->integer, size - Z_EXTRA);
+        memset(t + 1, z_perturb->integer, size - Z_EXTRA);
     }
 
     Z_TAIL_F(z) = Z_TAIL;
 
-    s = &z_stats[tag < TAG_MAX ? tag : TAG_FREE];
+    a = Z_GetArena();
+    z->arena = a;
+
+    Sys_LockMutex(a->lock);
+    z->next = a->chain.next;
+    z->prev = &a->chain;
+    a->chain.next->prev = z;
+    a->chain.next = z;
+
+    s = Z_Stats(a, tag);
     s->count++;
     s->bytes += size;
+    Sys_UnlockMutex(a->lock);
 
-    return z + 1;
+    return t + 1;
 }
 
 void *Z_TagMallocz(size_t size, memtag_t tag)
@@ -384,6 +817,91 @@ char *Z_ReservedCopyString(const char *in)
     return memcpy(Z_ReservedAlloc(len), in, len);
 }
 
+/*
+========================
+Z_FrameAlloc
+
+Returns memory that stays valid until the end of the current frame, when
+Z_FrameReset takes it all back at once. Safe to call from any thread, as
+long as the memory isn't used after the frame ends. Allocations are carved
+linearly out of a hunk reserved by the arena on first use. Should the hunk
+run out, the block is spilled to the zone and freed on reset, so running
+out costs speed only.
+========================
+*/
+void *Z_FrameAlloc(size_t size)
+{
+    zarena_t *a = Z_GetArena();
+    zspill_t *s;
+    void *ptr = NULL;
+    size_t left;
+
+    Sys_LockMutex(a->lock);
+    if (!a->frame.base) {
+        Hunk_Begin(&a->frame, Z_FRAME_SIZE);
+    }
+    // Hunk_Alloc rounds up to cacheline
+    left = a->frame.maxsize - a->frame.cursize;
+    if (left > 63 && size <= left - 63) {
+        ptr = Hunk_Alloc(&a->frame, size);
+        if (a->framepeak < a->frame.cursize) {
+            a->framepeak = a->frame.cursize;
+        }
+    }
+    Sys_UnlockMutex(a->lock);
+
+    if (ptr) {
+        return ptr;
+    }
+
+    if (size > SIZE_MAX - sizeof(*s)) {
+        Com_Error(ERR_FATAL, "%s: size > SIZE_MAX", __func__);
+    }
+
+    s = Z_TagMalloc(sizeof(*s) + size, TAG_GENERAL);
+
+    Sys_LockMutex(a->lock);
+    s->next = a->spills;
+    a->spills = s;
+    a->numspills++;
+    Sys_UnlockMutex(a->lock);
+
+    return s + 1;
+}
+
+void *Z_FrameAllocz(size_t size)
+{
+    return memset(Z_FrameAlloc(size), 0, size);
+}
+
+/*
+========================
+Z_FrameReset
+
+Called by the main thread at the end of each frame, when no other thread
+may be holding frame memory.
+========================
+*/
+void Z_FrameReset(void)
+{
+    zarena_t *a;
+    zspill_t *s, *next;
+    int i;
+
+    for (i = 0, a = z_arenas; i < Z_MAX_ARENAS; i++, a++) {
+        Sys_LockMutex(a->lock);
+        a->frame.cursize = 0;
+        s = a->spills;
+        a->spills = NULL;
+        Sys_UnlockMutex(a->lock);
+
+        for (; s; s = next) {
+            next = s->next;
+            Z_Free(s);
+        }
+    }
+}
+
 /*
 ========================
 Z_Init
@@ -391,7 +909,27 @@ Z_Init
 */
 void Z_Init(void)
 {
-    z_chain.next = z_chain.prev = &z_chain;
+    zarena_t *a;
+    int i, j;
+
+    for (i = 0, a = z_arenas; i < Z_MAX_ARENAS; i++, a++) {
+        a->lock = Sys_CreateMutex();
+        a->chain.next = a->chain.prev = &a->chain;
+        for (j = 0; j < Z_SLAB_CLASSES; j++) {
+            a->slabs[j].next = a->slabs[j].prev = &a->slabs[j];
+        }
+    }
+    z_arenalock = Sys_CreateMutex();
+
+    for (i = 0, j = 0; i <= Z_SLAB_MAX >> 3; i++) {
+        while (z_slabsizes[j] < i << 3) {
+            j++;
+        }
+        z_slabclass[i] = j;
+    }
+
+    // main thread gets the first arena
+    Z_GetArena();
 }
 
 /*
@@ -420,6 +958,7 @@ char *Z_CvarCopyString(const char *in)
 {
     size_t len;
     zstatic_t *z;
+    zarena_t *a;
     zstats_t *s;
     int i;
 
@@ -438,9 +977,12 @@ char *Z_CvarCopyString(const char *in)
 
     // return static storage
     z = (zstatic_t *)&z_static[i];
-    s = &z_stats[TAG_STATIC];
+    a = Z_GetArena();
+    Sys_LockMutex(a->lock);
+    s = Z_Stats(a, TAG_STATIC);
     s->count++;
     s->bytes += z->z.size;
+    Sys_UnlockMutex(a->lock);
     return z->data;
 }
 
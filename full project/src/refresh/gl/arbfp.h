@@ -15,3 +15,199 @@ static const char gl_prog_warp[] =
     "END\n"
 ;
 
+
+// single pass VCR composite, see vcr_effect.c for parameter layout
+static const char gl_prog_vcr[] =
+    "!!ARBfp1.0\n"
+    "OPTION ARB_precision_hint_fastest;\n"
+
+    "PARAM desat = program.local[0];\n"
+    "PARAM grain = program.local[1];\n"
+    "PARAM dots = program.local[2];\n"
+    "PARAM lines = program.local[3];\n"
+    "PARAM band = program.local[4];\n"
+    "PARAM luma = { 0.299, 0.587, 0.114, 0 };\n"
+    "PARAM hash = { 2.0673909, 12.451169, 6.2831853, 43758.5453 };\n"
+    "PARAM tint = { 0.3, 0.2, 0.1, 0.5 };\n"
+    "PARAM misc = { 0.7, 0.3, 0.1, 1 };\n"
+
+    "TEMP color, coord, gray, rnd, mask, tmp;\n"
+
+    // chromatic split: red from the left, blue from the right
+    "TEX color, fragment.texcoord[0], texture[0], 2D;\n"
+    "MOV coord, fragment.texcoord[0];\n"
+    "SUB coord.x, coord.x, band.w;\n"
+    "TEX tmp, coord, texture[0], 2D;\n"
+    "MOV color.x, tmp.x;\n"
+    "ADD coord.x, fragment.texcoord[0].x, band.w;\n"
+    "TEX tmp, coord, texture[0], 2D;\n"
+    "MOV color.z, tmp.z;\n"
+
+    // desaturate, darken, wash out and tint
+    "DP3 gray, color, luma;\n"
+    "LRP color.xyz, desat.x, gray, color;\n"
+    "MUL color.xyz, color, desat.y;\n"
+    "LRP color.xyz, desat.z, tint.w, color;\n"
+    "LRP color.xyz, desat.w, tint, color;\n"
+
+    // film grain, one hash per pixel
+    "MUL tmp.xy, fragment.position, hash;\n"
+    "ADD tmp.x, tmp.x, tmp.y;\n"
+    "ADD tmp.x, tmp.x, grain.w;\n"
+    "FRC tmp.x, tmp.x;\n"
+    "MUL tmp.x, tmp.x, hash.z;\n"
+    "SIN rnd.x, tmp.x;\n"
+    "MUL rnd.x, rnd.x, hash.w;\n"
+    "FRC rnd.x, rnd.x;\n"
+    "SGE mask.x, rnd.x, grain.x;\n"
+    "SUB tmp.y, rnd.x, grain.x;\n"
+    "MUL_SAT tmp.y, tmp.y, grain.y;\n"
+    "MAD tmp.z, tmp.y, misc.x, misc.y;\n"
+    "MUL tmp.z, tmp.z, grain.z;\n"
+    "MUL tmp.z, tmp.z, mask.x;\n"
+    "SGE tmp.w, tmp.y, tint.w;\n"
+    "LRP color.xyz, tmp.z, tmp.w, color;\n"
+
+    // noise dots, one hash per 2x2 cell
+    "MUL tmp.xy, fragment.position, tint.w;\n"
+    "FLR tmp.xy, tmp;\n"
+    "MUL tmp.xy, tmp, hash;\n"
+    "ADD tmp.x, tmp.x, tmp.y;\n"
+    "ADD tmp.x, tmp.x, dots.w;\n"
+    "FRC tmp.x, tmp.x;\n"
+    "MUL tmp.x, tmp.x, hash.z;\n"
+    "SIN rnd.y, tmp.x;\n"
+    "MUL rnd.y, rnd.y, hash.w;\n"
+    "FRC rnd.y, rnd.y;\n"
+    "SGE mask.y, rnd.y, dots.x;\n"
+    "MUL mask.y, mask.y, dots.y;\n"
+    "LRP color.xyz, mask.y, dots.z, color;\n"
+
+    // scanlines
+    "MAD tmp.x, fragment.position.y, lines.x, lines.z;\n"
+    "FRC tmp.x, tmp.x;\n"
+    "SLT mask.z, tmp.x, lines.x;\n"
+    "MAD mask.z, -mask.z, lines.y, misc.w;\n"
+    "MUL color.xyz, color, mask.z;\n"
+
+    // tracking band
+    "SGE mask.x, fragment.position.y, band.x;\n"
+    "SLT mask.y, fragment.position.y, band.y;\n"
+    "MUL mask.x, mask.x, mask.y;\n"
+    "MUL mask.x, mask.x, band.z;\n"
+    "LRP color.xyz, mask.x, misc.z, color;\n"
+
+    "MOV result.color.xyz, color;\n"
+    "MOV result.color.w, misc.w;\n"
+    "END\n"
+;
+
+
+// four consecutive Y, U or V samples packed per texel, see state.c for
+// parameter layout
+static const char gl_prog_yuv[] =
+    "!!ARBfp1.0\n"
+
+    "PARAM coef = program.local[0];\n"
+    "PARAM step = program.local[1];\n"
+
+    "TEMP coord, tap, plane;\n"
+
+    "MOV coord, fragment.texcoord[0];\n"
+    "TEX tap, coord, texture[0], 2D;\n"
+    "DP3 plane.x, tap, coef;\n"
+    "ADD coord, coord, step;\n"
+    "TEX tap, coord, texture[0], 2D;\n"
+    "DP3 plane.y, tap, coef;\n"
+    "ADD coord, coord, step;\n"
+    "TEX tap, coord, texture[0], 2D;\n"
+    "DP3 plane.z, tap, coef;\n"
+    "ADD coord, coord, step;\n"
+    "TEX tap, coord, texture[0], 2D;\n"
+    "DP3 plane.w, tap, coef;\n"
+    "ADD result.color, plane, coef.w;\n"
+    "END\n"
+;
+
+
+// alias model frame interpolation, see mesh.c for parameter layout
+static const char gl_prog_lerp[] =
+    "!!ARBvp1.0\n"
+
+    "PARAM mvp[4] = { state.matrix.mvp };\n"
+    "PARAM oldscale = program.local[0];\n"
+    "PARAM newscale = program.local[1];\n"
+    "PARAM translate = program.local[2];\n"
+    "PARAM shadedir = program.local[3];\n"
+    "PARAM color = program.local[4];\n"
+    "PARAM lerp = program.local[5];\n"
+    "PARAM misc = { 0.3, 0, 1, 0 };\n"
+
+    "ATTRIB oldpos = vertex.attrib[6];\n"
+    "ATTRIB oldnorm = vertex.attrib[7];\n"
+
+    "TEMP pos, norm, tmp;\n"
+
+    // blend and renormalize
+    "MUL norm, oldnorm, lerp.x;\n"
+    "MAD norm, vertex.normal, lerp.y, norm;\n"
+    "DP3 tmp.x, norm, norm;\n"
+    "RSQ tmp.x, tmp.x;\n"
+    "MUL norm.xyz, norm, tmp.x;\n"
+
+    // scales already have lerp fractions folded in
+    "MUL pos, oldpos, oldscale;\n"
+    "MAD pos, vertex.position, newscale, pos;\n"
+    "ADD pos, pos, translate;\n"
+    "MAD pos.xyz, norm, lerp.z, pos;\n"
+    "MOV pos.w, misc.z;\n"
+
+    "DP4 result.position.x, mvp[0], pos;\n"
+    "DP4 result.position.y, mvp[1], pos;\n"
+    "DP4 result.position.z, mvp[2], pos;\n"
+    "DP4 result.position.w, mvp[3], pos;\n"
+
+    // matches the anormtab.h precalculations, zero shadedir disables
+    "DP3 tmp.x, norm, shadedir;\n"
+    "MIN tmp.y, tmp.x, misc.y;\n"
+    "MAX tmp.x, tmp.x, misc.y;\n"
+    "MAD tmp.x, tmp.y, misc.x, tmp.x;\n"
+    "ADD tmp.x, tmp.x, misc.z;\n"
+    "MUL result.color.xyz, color, tmp.x;\n"
+    "MOV result.color.w, color.w;\n"
+
+    "MOV result.texcoord[0], vertex.texcoord[0];\n"
+    "END\n"
+;
+
+// point sprite size for particles, matching the triangles GL_DrawParticles
+// builds on the CPU: scale grows with distance past 20 units
+static const char gl_prog_particle[] =
+    "!!ARBvp1.0\n"
+
+    "PARAM mvp[4] = { state.matrix.mvp };\n"
+    "PARAM vieworg = program.local[0];\n"
+    "PARAM viewaxis = program.local[1];\n"
+    "PARAM scale = program.local[2];\n"   // partscale, 0.01, 20, pixels
+    "PARAM misc = { 1, 0, 0, 0 };\n"
+
+    "TEMP tmp;\n"
+
+    "DP4 result.position.x, mvp[0], vertex.position;\n"
+    "DP4 result.position.y, mvp[1], vertex.position;\n"
+    "DP4 result.position.z, mvp[2], vertex.position;\n"
+    "DP4 result.position.w, mvp[3], vertex.position;\n"
+
+    "SUB tmp, vertex.position, vieworg;\n"
+    "DP3 tmp.x, tmp, viewaxis;\n"
+    "SLT tmp.y, scale.z, tmp.x;\n"
+    "MUL tmp.y, tmp.y, tmp.x;\n"
+    "MAD tmp.y, tmp.y, scale.y, scale.x;\n"
+    "MAX tmp.x, tmp.x, misc.x;\n"
+    "RCP tmp.x, tmp.x;\n"
+    "MUL tmp.y, tmp.y, tmp.x;\n"
+    "MUL result.pointsize.x, tmp.y, scale.w;\n"
+
+    "MOV result.color, vertex.color;\n"
+    "END\n"
+;
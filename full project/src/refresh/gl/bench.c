@@ -0,0 +1,458 @@
+/*
+Copyright (C) 2003-2006 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// bench.c -- deterministic renderer benchmark
+//
+// Camera flies a closed spline through the spawn points of the world, with
+// brush entities and a particle cloud in view, and every frame is drawn
+// once with the VCR effect and once without. Passes are separated with
+// glFinish, so that time spent on the GPU is charged to the pass that
+// caused it rather than to the swap.
+//
+
+#include "gl.h"
+#include "vcr_effect.h"
+
+#define BENCH_POINTS    64
+#define BENCH_PARTICLES 1024
+#define BENCH_FRAMES    1000
+#define BENCH_CSV       "benchmark.csv"
+
+int gl_bench;
+
+static const char *const bench_names[BENCH_NUM_PASSES] = {
+    "world", "entities", "particles", "alpha", "2d", "vcr"
+};
+
+typedef struct {
+    vec3_t      origin;
+    float       yaw;
+} benchpoint_t;
+
+static struct {
+    unsigned    last;       // time of the previous pass mark
+    unsigned    passes[BENCH_NUM_PASSES];
+
+    benchpoint_t    points[BENCH_POINTS];
+    int             numpoints;
+    entity_t        entities[MAX_ENTITIES];
+    int             numentities;
+    particle_t      particles[BENCH_PARTICLES];
+    lightstyle_t    lightstyles[MAX_LIGHTSTYLES];
+} bench;
+
+typedef struct {
+    unsigned    *frames;    // usec per frame, sorted by report
+    uint64_t    passes[BENCH_NUM_PASSES];
+} benchrun_t;
+
+void GL_BenchPass(benchpass_t pass)
+{
+    unsigned now;
+
+    qglFinish();
+    now = Sys_Microseconds();
+    bench.passes[pass] += now - bench.last;
+    bench.last = now;
+}
+
+static void add_point(const vec3_t origin, float yaw)
+{
+    benchpoint_t *p;
+
+    if (bench.numpoints == BENCH_POINTS) {
+        return;
+    }
+
+    p = &bench.points[bench.numpoints++];
+    VectorCopy(origin, p->origin);
+    p->origin[2] += 22;     // eye height above spawn origin
+    p->yaw = yaw;
+}
+
+static void add_entity(const char *model, const vec3_t origin)
+{
+    bsp_t *bsp = gl_static.world.cache;
+    entity_t *ent;
+    int index;
+
+    if (*model != '*' || bench.numentities == MAX_ENTITIES) {
+        return;
+    }
+
+    index = atoi(model + 1);
+    if (index < 1 || index >= bsp->nummodels) {
+        return;
+    }
+
+    ent = &bench.entities[bench.numentities++];
+    memset(ent, 0, sizeof(*ent));
+    ent->model = ~index;
+    VectorCopy(origin, ent->origin);
+    VectorCopy(origin, ent->oldorigin);
+    ent->alpha = 1;
+}
+
+// collects spawn points for the camera path and brush models for the
+// entity pass, the way the game would have placed them
+static void parse_entities(const char *data)
+{
+    char classname[MAX_QPATH], model[MAX_QPATH];
+    vec3_t origin;
+    float yaw;
+    char *key, *value;
+
+    while (1) {
+        if (COM_Parse(&data)[0] != '{') {
+            break;
+        }
+
+        classname[0] = model[0] = 0;
+        VectorClear(origin);
+        yaw = 0;
+
+        while (1) {
+            key = COM_Parse(&data);
+            if (!data || key[0] == '}') {
+                break;
+            }
+            value = COM_Parse(&data);
+            if (!data) {
+                break;
+            }
+            if (!strcmp(key, "classname")) {
+                Q_strlcpy(classname, value, sizeof(classname));
+            } else if (!strcmp(key, "model")) {
+                Q_strlcpy(model, value, sizeof(model));
+            } else if (!strcmp(key, "origin")) {
+                sscanf(value, "%f %f %f", &origin[0], &origin[1], &origin[2]);
+            } else if (!strcmp(key, "angle")) {
+                yaw = atof(value);
+            }
+        }
+
+        if (!Q_strncasecmp(classname, "info_player_", 12)) {
+            add_point(origin, yaw);
+        } else if (model[0]) {
+            add_entity(model, origin);
+        }
+
+        if (!data) {
+            break;
+        }
+    }
+}
+
+static void setup_scene(void)
+{
+    bsp_t *bsp = gl_static.world.cache;
+    vec3_t center, origin;
+    float radius;
+    int i;
+
+    bench.numpoints = 0;
+    bench.numentities = 0;
+
+    parse_entities(bsp->entitystring);
+
+    // no usable spawn points, orbit the middle of the world instead
+    if (bench.numpoints < 2) {
+        bench.numpoints = 0;
+        VectorAvg(bsp->nodes[0].mins, bsp->nodes[0].maxs, center);
+        radius = (bsp->nodes[0].maxs[0] - bsp->nodes[0].mins[0]) * 0.25f;
+        for (i = 0; i < 8; i++) {
+            origin[0] = center[0] + cos(i * M_PI / 4) * radius;
+            origin[1] = center[1] + sin(i * M_PI / 4) * radius;
+            origin[2] = center[2];
+            add_point(origin, i * 45 + 90);
+        }
+    }
+
+    for (i = 0; i < MAX_LIGHTSTYLES; i++) {
+        bench.lightstyles[i].white = 1;
+        VectorSet(bench.lightstyles[i].rgb, 1, 1, 1);
+    }
+}
+
+static float catmull_rom(float p0, float p1, float p2, float p3, float t)
+{
+    return 0.5f * (2 * p1 + (p2 - p0) * t +
+                   (2 * p0 - 5 * p1 + 4 * p2 - p3) * t * t +
+                   (3 * p1 - p0 - 3 * p2 + p3) * t * t * t);
+}
+
+// camera position at the given fraction of the closed spline
+static void spline_point(float frac, vec3_t out)
+{
+    int n = bench.numpoints;
+    float s = frac * n;
+    int i = (int)s % n;
+    float t = s - (int)s;
+    const float *p0 = bench.points[(i + n - 1) % n].origin;
+    const float *p1 = bench.points[i].origin;
+    const float *p2 = bench.points[(i + 1) % n].origin;
+    const float *p3 = bench.points[(i + 2) % n].origin;
+    int j;
+
+    for (j = 0; j < 3; j++) {
+        out[j] = catmull_rom(p0[j], p1[j], p2[j], p3[j], t);
+    }
+}
+
+// particle cloud ahead of the camera, from a fixed seed per frame
+static void setup_particles(int frame, const vec3_t center)
+{
+    uint32_t seed = 0x9e3779b9 ^ frame;
+    particle_t *p;
+    int i, j;
+
+    for (i = 0, p = bench.particles; i < BENCH_PARTICLES; i++, p++) {
+        for (j = 0; j < 3; j++) {
+            seed = seed * 1664525 + 1013904223;
+            p->origin[j] = center[j] + (int)(seed >> 24) - 128;
+        }
+        p->color = 0xe0 + (i & 7);
+        p->alpha = 1;
+    }
+}
+
+static void setup_view(refdef_t *fd, int frame, int frames)
+{
+    vec3_t dir, next, ahead;
+    float frac = (float)frame / frames;
+    float len;
+
+    memset(fd, 0, sizeof(*fd));
+    fd->width = r_config.width;
+    fd->height = r_config.height;
+    fd->fov_x = 90;
+    fd->fov_y = V_CalcFov(fd->fov_x, fd->width, fd->height);
+    fd->time = frame * 0.1f;
+
+    // look along the path, or the way the spawn point faces when the
+    // path doesn't move between samples
+    spline_point(frac, fd->vieworg);
+    spline_point(frac + 0.5f / frames, next);
+    VectorSubtract(next, fd->vieworg, dir);
+    len = VectorLength(dir);
+    if (len > 0.1f) {
+        fd->viewangles[YAW] = atan2(dir[1], dir[0]) * 180 / M_PI;
+        fd->viewangles[PITCH] = -atan2(dir[2], sqrt(dir[0] * dir[0] + dir[1] * dir[1])) * 180 / M_PI;
+        clamp(fd->viewangles[PITCH], -30, 30);
+    } else {
+        fd->viewangles[YAW] = bench.points[(int)(frac * bench.numpoints) % bench.numpoints].yaw;
+    }
+
+    AngleVectors(fd->viewangles, dir, NULL, NULL);
+    VectorMA(fd->vieworg, 256, dir, ahead);
+    setup_particles(frame, ahead);
+
+    fd->lightstyles = bench.lightstyles;
+    fd->num_entities = bench.numentities;
+    fd->entities = bench.entities;
+    fd->num_particles = BENCH_PARTICLES;
+    fd->particles = bench.particles;
+}
+
+static void run_frames(benchrun_t *run, int frames, qhandle_t font)
+{
+    char buffer[MAX_QPATH];
+    refdef_t fd;
+    unsigned start;
+    int i;
+
+    memset(bench.passes, 0, sizeof(bench.passes));
+
+    for (i = 0; i < frames; i++) {
+        start = Sys_Microseconds();
+
+        setup_view(&fd, i, frames);
+
+        R_BeginFrame();
+        qglFinish();
+        bench.last = Sys_Microseconds();
+
+        R_RenderFrame(&fd);
+
+        Q_snprintf(buffer, sizeof(buffer), "%d/%d", i + 1, frames);
+        R_DrawString(8, 8, UI_DROPSHADOW, MAX_STRING_CHARS, buffer, font);
+        GL_Flush2D();
+        GL_BenchPass(BENCH_2D);
+
+        R_EndFrame();
+
+        run->frames[i] = Sys_Microseconds() - start;
+    }
+
+    for (i = 0; i < BENCH_NUM_PASSES; i++) {
+        run->passes[i] = bench.passes[i];
+    }
+}
+
+static int frametimecmp(const void *p1, const void *p2)
+{
+    unsigned a = *(const unsigned *)p1;
+    unsigned b = *(const unsigned *)p2;
+
+    return a < b ? -1 : a > b;
+}
+
+static void report_run(benchrun_t *run, int frames, qboolean vcr, qhandle_t f)
+{
+    uint64_t total = 0;
+    float avg[BENCH_NUM_PASSES];
+    float p50, p90, p99;
+    int i;
+
+    qsort(run->frames, frames, sizeof(run->frames[0]), frametimecmp);
+    for (i = 0; i < frames; i++) {
+        total += run->frames[i];
+    }
+    for (i = 0; i < BENCH_NUM_PASSES; i++) {
+        avg[i] = run->passes[i] * 0.001f / frames;
+    }
+
+    p50 = run->frames[frames / 2] * 0.001f;
+    p90 = run->frames[frames * 9 / 10] * 0.001f;
+    p99 = run->frames[frames * 99 / 100] * 0.001f;
+
+    Com_Printf("%s VCR effect: avg %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f msec\n",
+               vcr ? "with" : "without", total * 0.001f / frames,
+               p50, p90, p99, run->frames[frames - 1] * 0.001f);
+    for (i = 0; i < BENCH_NUM_PASSES; i++) {
+        Com_Printf("%12s %6.3f\n", bench_names[i], avg[i]);
+    }
+
+    if (!f) {
+        return;
+    }
+
+    FS_FPrintf(f, "\"%s\",\"%s\",\"%s\",%d,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f",
+               com_version->string, qglGetString(GL_RENDERER),
+               gl_static.world.cache->name, r_config.width, r_config.height,
+               vcr, vcr_quality->integer, frames, total * 0.001f / frames,
+               p50, p90, p99, run->frames[frames - 1] * 0.001f);
+    for (i = 0; i < BENCH_NUM_PASSES; i++) {
+        FS_FPrintf(f, ",%.3f", avg[i]);
+    }
+    FS_FPrintf(f, "\n");
+}
+
+static qhandle_t open_csv(void)
+{
+    qboolean exists;
+    qhandle_t f;
+    int i;
+
+    exists = FS_FileExists(BENCH_CSV);
+    FS_FOpenFile(BENCH_CSV, &f, FS_MODE_APPEND);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for appending\n", BENCH_CSV);
+        return 0;
+    }
+
+    if (!exists) {
+        FS_FPrintf(f, "version,renderer,map,width,height,vcr,vcr_quality,"
+                   "frames,avg,p50,p90,p99,max");
+        for (i = 0; i < BENCH_NUM_PASSES; i++) {
+            FS_FPrintf(f, ",%s", bench_names[i]);
+        }
+        FS_FPrintf(f, "\n");
+    }
+
+    return f;
+}
+
+/*
+=============
+GL_Benchmark_f
+
+benchmark [map] [frames]
+=============
+*/
+static void GL_Benchmark_f(void)
+{
+    char fullname[MAX_QPATH];
+    benchrun_t runs[2];
+    qhandle_t font, f;
+    int frames;
+
+    if (Cmd_Argc() > 1) {
+        Q_concat(fullname, sizeof(fullname), "maps/", Cmd_Argv(1), ".bsp", NULL);
+        if (!gl_static.world.cache || Q_stricmp(gl_static.world.cache->name, fullname)) {
+            if (CL_Connected()) {
+                Com_Printf("Can't load another map while connected.\n");
+                return;
+            }
+            if (!FS_FileExists(fullname)) {
+                Com_Printf("Couldn't find %s.\n", fullname);
+                return;
+            }
+            R_BeginRegistration(Cmd_Argv(1));
+            R_EndRegistration();
+        }
+    }
+
+    if (!gl_static.world.cache) {
+        Com_Printf("Usage: %s <map> [frames]\n", Cmd_Argv(0));
+        return;
+    }
+
+    frames = BENCH_FRAMES;
+    if (Cmd_Argc() > 2) {
+        frames = atoi(Cmd_Argv(2));
+        clamp(frames, 10, 100000);
+    }
+
+    setup_scene();
+    font = R_RegisterFont("conchars");
+
+    Com_Printf("Running %d frames over %d path points, %d entities\n",
+               frames, bench.numpoints, bench.numentities);
+
+    runs[0].frames = Z_Malloc(sizeof(runs[0].frames[0]) * frames);
+    runs[1].frames = Z_Malloc(sizeof(runs[1].frames[0]) * frames);
+
+    gl_bench = GL_BENCH_ACTIVE;
+    run_frames(&runs[0], frames, font);
+    gl_bench = GL_BENCH_ACTIVE | GL_BENCH_NOVCR;
+    run_frames(&runs[1], frames, font);
+    gl_bench = 0;
+
+    f = open_csv();
+    report_run(&runs[0], frames, qtrue, f);
+    report_run(&runs[1], frames, qfalse, f);
+    if (f) {
+        FS_FCloseFile(f);
+        Com_Printf("Appended results to %s.\n", BENCH_CSV);
+    }
+
+    Z_Free(runs[0].frames);
+    Z_Free(runs[1].frames);
+}
+
+void GL_InitBench(void)
+{
+    Cmd_AddCommand("benchmark", GL_Benchmark_f);
+}
+
+void GL_ShutdownBench(void)
+{
+    Cmd_RemoveCommand("benchmark");
+}
@@ -17,26 +17,38 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "vcr_effect.h"
 
 drawStatic_t draw;
 
-static inline void _GL_StretchPic(
+#define U32_ALPHA   MakeColor(0, 0, 0, 255)
+
+// picks blending state of the 2D batch
+static inline void batch_flags(int flags, uint32_t color)
+{
+    if (flags & IF_TRANSPARENT) {
+        if ((flags & IF_PALETTED) && draw.scale == 1) {
+            tess.flags |= 1;
+        } else {
+            tess.flags |= 2;
+        }
+    }
+
+    if ((color & U32_ALPHA) != U32_ALPHA) {
+        tess.flags |= 2;
+    }
+}
+
+// appends a quad to the 2D batch, caller makes sure there is room
+static inline void batch_quad(
     float x, float y, float w, float h,
     float s1, float t1, float s2, float t2,
-    uint32_t color, int texnum, int flags)
+    uint32_t color)
 {
     vec_t *dst_vert;
     uint32_t *dst_color;
     int *dst_indices;
 
-    if (tess.numverts + 4 > TESS_MAX_VERTICES ||
-        tess.numindices + 6 > TESS_MAX_INDICES ||
-        (tess.numverts && tess.texnum[0] != texnum)) {
-        GL_Flush2D();
-    }
-
-    tess.texnum[0] = texnum;
-
     dst_vert = tess.vertices + tess.numverts * 4;
     Vector4Set(dst_vert,      x,     y,     s1, t1);
     Vector4Set(dst_vert +  4, x + w, y,     s2, t1);
@@ -57,22 +69,26 @@ static inline void _GL_StretchPic(
     dst_indices[4] = tess.numverts + 1;
     dst_indices[5] = tess.numverts + 2;
 
-    if (flags & IF_TRANSPARENT) {
-        if ((flags & IF_PALETTED) && draw.scale == 1) {
-            tess.flags |= 1;
-        } else {
-            tess.flags |= 2;
-        }
-    }
+    tess.numverts += 4;
+    tess.numindices += 6;
+}
 
-#define U32_ALPHA   MakeColor(0, 0, 0, 255)
+#define BATCH_FULL() \
+    (tess.numverts + 4 > TESS_MAX_VERTICES || tess.numindices + 6 > TESS_MAX_INDICES)
 
-    if ((color & U32_ALPHA) != U32_ALPHA) {
-        tess.flags |= 2;
+static inline void _GL_StretchPic(
+    float x, float y, float w, float h,
+    float s1, float t1, float s2, float t2,
+    uint32_t color, int texnum, int flags)
+{
+    if (BATCH_FULL() || (tess.numverts && tess.texnum[0] != texnum)) {
+        GL_Flush2D();
     }
 
-    tess.numverts += 4;
-    tess.numindices += 6;
+    tess.texnum[0] = texnum;
+
+    batch_quad(x, y, w, h, s1, t1, s2, t2, color);
+    batch_flags(flags, color);
 }
 
 #define GL_StretchPic(x,y,w,h,s1,t1,s2,t2,color,image) \
@@ -91,6 +107,13 @@ void GL_Blend(void)
                    color.u32, TEXNUM_WHITE, 0);
 }
 
+// queues an untextured quad in the 2D batch, for effects that need
+// subpixel coordinates
+void GL_DrawFill(float x, float y, float w, float h, uint32_t color)
+{
+    _GL_StretchPic(x, y, w, h, 0, 0, 1, 1, color, TEXNUM_WHITE, 0);
+}
+
 void R_ClearColor(void)
 {
     draw.colors[0].u32 = U32_WHITE;
@@ -120,6 +143,9 @@ void R_SetClipRect(int flags, const clipRect_t *clip)
 
     GL_Flush2D();
 
+    // spans are replayed under a single clip state
+    draw.recording = NULL;
+
     if (flags == DRAW_CLIP_DISABLED) {
         qglDisable(GL_SCISSOR_TEST);
         draw.flags &= ~DRAW_CLIP_MASK;
@@ -181,6 +207,9 @@ void R_SetScale(float *scale)
 
     GL_Flush2D();
 
+    // spans are replayed under a single scale
+    draw.recording = NULL;
+
     qglMatrixMode(GL_PROJECTION);
     qglLoadIdentity();
 
@@ -228,31 +257,40 @@ void R_DrawFill32(int x, int y, int w, int h, uint32_t color)
     _GL_StretchPic(x, y, w, h, 0, 0, 1, 1, color, TEXNUM_WHITE, 0);
 }
 
+// charsets may be placed onto the scrap, so characters are
+// addressed within the image texture coordinates
+#define CHAR_S(image, c)    ((image)->sl + ((c) & 15) * CHAR_DS(image))
+#define CHAR_T(image, c)    ((image)->tl + ((c) >> 4) * CHAR_DT(image))
+#define CHAR_DS(image)      (((image)->sh - (image)->sl) * 0.0625f)
+#define CHAR_DT(image)      (((image)->th - (image)->tl) * 0.0625f)
+
 static inline void draw_char(int x, int y, int c, qboolean alt, image_t *image)
 {
-    float s, t;
+    float s, t, ds, dt;
 
     if ((c & 127) == 32) {
         return;
     }
 
     c |= alt << 7;
-    s = (c & 15) * 0.0625f;
-    t = (c >> 4) * 0.0625f;
+    s = CHAR_S(image, c);
+    t = CHAR_T(image, c);
+    ds = CHAR_DS(image);
+    dt = CHAR_DT(image);
 
     if (gl_fontshadow->integer > 0) {
         uint32_t black = MakeColor(0, 0, 0, draw.colors[0].u8[3]);
 
         GL_StretchPic(x + 1, y + 1, CHAR_WIDTH, CHAR_HEIGHT, s, t,
-                      s + 0.0625f, t + 0.0625f, black, image);
+                      s + ds, t + dt, black, image);
 
         if (gl_fontshadow->integer > 1)
             GL_StretchPic(x + 2, y + 2, CHAR_WIDTH, CHAR_HEIGHT, s, t,
-                          s + 0.0625f, t + 0.0625f, black, image);
+                          s + ds, t + dt, black, image);
     }
 
     GL_StretchPic(x, y, CHAR_WIDTH, CHAR_HEIGHT, s, t,
-                  s + 0.0625f, t + 0.0625f, draw.colors[alt].u32, image);
+                  s + ds, t + dt, draw.colors[alt].u32, image);
 }
 
 void R_DrawChar(int x, int y, int flags, int c, qhandle_t font)
@@ -261,20 +299,223 @@ void R_DrawChar(int x, int y, int flags, int c, qhandle_t font)
     draw_char(x, y, c & 255, alt, IMG_ForHandle(font));
 }
 
-int R_DrawString(int x, int y, int flags, size_t maxlen, const char *s, qhandle_t font)
+// lays out a whole string into the 2D batch in one color. texture and
+// blending state are set up once, and again only if the batch fills up.
+static int batch_string(int x, int y, int alt, size_t maxlen, const char *s,
+                        uint32_t color, image_t *image)
 {
-    image_t *image = IMG_ForHandle(font);
-    qboolean alt = (flags & UI_ALTCOLOR) ? qtrue : qfalse;
+    float ds = CHAR_DS(image);
+    float dt = CHAR_DT(image);
+    float cs, ct;
+    int c;
+
+    if (tess.numverts && tess.texnum[0] != image->texnum) {
+        GL_Flush2D();
+    }
+
+    tess.texnum[0] = image->texnum;
+    batch_flags(image->flags, color);
 
     while (maxlen-- && *s) {
-        byte c = *s++;
-        draw_char(x, y, c, alt, image);
+        c = *(byte *)s++;
+        if ((c & 127) != 32) {
+            if (BATCH_FULL()) {
+                GL_Flush2D();
+                tess.texnum[0] = image->texnum;
+                batch_flags(image->flags, color);
+            }
+
+            c |= alt << 7;
+            cs = CHAR_S(image, c);
+            ct = CHAR_T(image, c);
+            batch_quad(x, y, CHAR_WIDTH, CHAR_HEIGHT,
+                       cs, ct, cs + ds, ct + dt, color);
+        }
         x += CHAR_WIDTH;
     }
 
     return x;
 }
 
+int R_DrawString(int x, int y, int flags, size_t maxlen, const char *s, qhandle_t font)
+{
+    image_t *image = IMG_ForHandle(font);
+    int alt = (flags & UI_ALTCOLOR) ? 1 : 0;
+
+    // shadows of consecutive glyphs never cover the glyphs themselves, so
+    // the whole shadow string can go first without changing the result
+    if (gl_fontshadow->integer > 0) {
+        uint32_t black = MakeColor(0, 0, 0, draw.colors[0].u8[3]);
+
+        batch_string(x + 1, y + 1, alt, maxlen, s, black, image);
+
+        if (gl_fontshadow->integer > 1)
+            batch_string(x + 2, y + 2, alt, maxlen, s, black, image);
+    }
+
+    return batch_string(x, y, alt, maxlen, s, draw.colors[alt].u32, image);
+}
+
+/*
+=============================================================================
+
+RETAINED SPANS
+
+2D batches flushed while a span is recorded are also copied into it,
+together with texture and blending state. Later frames draw the span from
+its own arrays until the caller passes a different version. Texnums kept
+in spans become stale when images are freed, so spans are dropped then.
+
+=============================================================================
+*/
+
+#define MAX_SPAN_VERTS  0x10000
+
+static void *span_grow(void *ptr, int *maxcount, int count, size_t size)
+{
+    if (count > *maxcount) {
+        *maxcount = max(count, *maxcount * 2);
+        ptr = Z_Realloc(ptr, *maxcount * size);
+    }
+    return ptr;
+}
+
+// copies the 2D batch about to be flushed into the span being recorded
+void GL_RecordSpan(void)
+{
+    drawspan_t *span = draw.recording;
+    spanrun_t *run;
+    int i, count, *dst;
+
+    if (span->numverts + tess.numverts > MAX_SPAN_VERTS) {
+        // too big to be worth keeping
+        draw.recording = NULL;
+        return;
+    }
+
+    count = span->numverts + tess.numverts;
+    if (count > span->maxverts) {
+        span->maxverts = max(count, span->maxverts * 2);
+        span->vertices = Z_Realloc(span->vertices, span->maxverts * sizeof(vec_t) * 4);
+        span->colors = Z_Realloc(span->colors, span->maxverts * sizeof(uint32_t));
+    }
+    span->indices = span_grow(span->indices, &span->maxindices,
+                              span->numindices + tess.numindices, sizeof(int));
+    span->runs = span_grow(span->runs, &span->maxruns,
+                           span->numruns + 1, sizeof(spanrun_t));
+
+    memcpy(span->vertices + span->numverts * 4, tess.vertices,
+           tess.numverts * sizeof(vec_t) * 4);
+    memcpy(span->colors + span->numverts, tess.colors,
+           tess.numverts * sizeof(uint32_t));
+
+    dst = span->indices + span->numindices;
+    for (i = 0; i < tess.numindices; i++) {
+        dst[i] = tess.indices[i] + span->numverts;
+    }
+
+    run = &span->runs[span->numruns++];
+    run->texnum = tess.texnum[0];
+    run->flags = tess.flags;
+    run->firstindex = span->numindices;
+    run->numindices = tess.numindices;
+
+    span->numverts += tess.numverts;
+    span->numindices += tess.numindices;
+}
+
+qboolean R_DrawSpan(int index, unsigned version)
+{
+    drawspan_t *span;
+    spanrun_t *run;
+    int i;
+
+    if (index < 0 || index >= MAX_SPANS || !gl_retain2d->integer) {
+        return qfalse;
+    }
+
+    span = &draw.spans[index];
+    if (!span->valid || span->version != version || span->scale != draw.scale ||
+        span->clip != (draw.flags & DRAW_CLIP_MASK)) {
+        return qfalse;
+    }
+
+    GL_Flush2D();
+
+    for (i = 0, run = span->runs; i < span->numruns; i++, run++) {
+        GL_DrawTriangles2D(run->texnum, run->flags, span->vertices, span->colors,
+                           span->indices + run->firstindex,
+                           span->numverts, run->numindices);
+    }
+
+    return qtrue;
+}
+
+void R_BeginSpan(int index, unsigned version)
+{
+    drawspan_t *span;
+
+    if (index < 0 || index >= MAX_SPANS || !gl_retain2d->integer) {
+        return;
+    }
+
+    // earlier batches don't belong to the span
+    GL_Flush2D();
+
+    span = &draw.spans[index];
+    span->valid = qfalse;
+    span->version = version;
+    span->scale = draw.scale;
+    span->clip = draw.flags & DRAW_CLIP_MASK;
+    span->numverts = 0;
+    span->numindices = 0;
+    span->numruns = 0;
+
+    draw.recording = span;
+}
+
+void R_EndSpan(void)
+{
+    drawspan_t *span = draw.recording;
+
+    if (!span) {
+        return;
+    }
+
+    GL_Flush2D();
+
+    // might have been dropped while flushing
+    if (draw.recording) {
+        span->valid = qtrue;
+        draw.recording = NULL;
+    }
+}
+
+void GL_InvalidateSpans(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_SPANS; i++) {
+        draw.spans[i].valid = qfalse;
+    }
+    draw.recording = NULL;
+}
+
+void GL_ShutdownSpans(void)
+{
+    drawspan_t *span;
+    int i;
+
+    for (i = 0, span = draw.spans; i < MAX_SPANS; i++, span++) {
+        Z_Free(span->vertices);
+        Z_Free(span->colors);
+        Z_Free(span->indices);
+        Z_Free(span->runs);
+        memset(span, 0, sizeof(*span));
+    }
+    draw.recording = NULL;
+}
+
 #ifdef _DEBUG
 
 image_t *r_charset;
@@ -295,11 +536,12 @@ void Draw_Stringf(int x, int y, const char *fmt, ...)
     while (*string) {
         c = *string++;
 
-        s = (c & 15) * 0.0625f;
-        t = (c >> 4) * 0.0625f;
+        s = CHAR_S(r_charset, c);
+        t = CHAR_T(r_charset, c);
 
         GL_StretchPic(x, y, CHAR_WIDTH, CHAR_HEIGHT, s, t,
-                      s + 0.0625f, t + 0.0625f, U32_WHITE, r_charset);
+                      s + CHAR_DS(r_charset), t + CHAR_DT(r_charset),
+                      U32_WHITE, r_charset);
         x += CHAR_WIDTH;
     }
 }
@@ -337,6 +579,12 @@ void Draw_Stats(void)
     if (c.texUploads) {
         Draw_Stringf(x, y, "Tex uploads  : %i", c.texUploads); y += 10;
     }
+    if (c.texReloads) {
+        Draw_Stringf(x, y, "Tex reloads  : %i", c.texReloads); y += 10;
+    }
+    if (c.lightmapBytes) {
+        Draw_Stringf(x, y, "LM bytes     : %i", c.lightmapBytes); y += 10;
+    }
     if (c.batchesDrawn) {
         Draw_Stringf(x, y, "Batches drawn: %i", c.batchesDrawn); y += 10;
         Draw_Stringf(x, y, "Faces / batch: %i", c.facesDrawn / c.batchesDrawn);
@@ -345,6 +593,19 @@ void Draw_Stats(void)
         y += 10;
     }
     Draw_Stringf(x, y, "2D batches   : %i", c.batchesDrawn2D); y += 10;
+    if (c.entsOccluded) {
+        Draw_Stringf(x, y, "Ents occluded: %i", c.entsOccluded); y += 10;
+    }
+
+    if (vcr_profile && vcr_profile->integer) {
+        const char *name;
+        float msec;
+        int i;
+
+        for (i = 0; VCR_LayerStats(i, &name, &msec); i++) {
+            Draw_Stringf(x, y, "VCR %-9s: %.3f ms", name, msec); y += 10;
+        }
+    }
 }
 
 void Draw_Lightmaps(void)
@@ -361,8 +622,12 @@ void Draw_Lightmaps(void)
 
 void Draw_Scrap(void)
 {
-    _GL_StretchPic(0, 0, 256, 256,
-                   0, 0, 1, 1, U32_WHITE, TEXNUM_SCRAP, IF_PALETTED | IF_TRANSPARENT);
+    int i;
+
+    for (i = 0; i < SCRAP_MAX_PAGES; i++) {
+        _GL_StretchPic(256 * (i & 1), 256 * (i >> 1), 256, 256, 0, 0, 1, 1,
+                       U32_WHITE, TEXNUM_SCRAP + i, IF_PALETTED | IF_TRANSPARENT);
+    }
 }
 
 #endif
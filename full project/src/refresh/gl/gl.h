@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "refresh/images.h"
 #include "refresh/models.h"
 #include "system/hunk.h"
+#include "system/system.h"
 #include "qgl.h"
 
 /*
@@ -45,10 +46,23 @@ typedef struct {
         memhunk_t hunk;
         vec_t *vertices;
         GLuint bufnum;
+        GLuint indexnum;
         float add, modulate, scale;
         vec_t size;
     } world;
     GLuint prognum_warp;
+    GLuint prognum_vcr;
+    GLuint prognum_yuv;
+    GLuint prognum_lerp;
+    GLuint prognum_particle;
+    GLuint readbufs[IMG_READBACK_SLOTS];
+    int readbuf_width[IMG_READBACK_SLOTS];
+    int readbuf_height[IMG_READBACK_SLOTS];
+    size_t readbuf_size[IMG_READBACK_SLOTS];
+    GLuint yuv_fbo;
+    int yuv_source_width, yuv_source_height;    // allocated (power of two) sizes
+    int yuv_planes_width, yuv_planes_height;
+    qboolean yuv_failed;
     GLbitfield stencil_buffer_bit;
     float entity_modulate;
     float inverse_intensity;
@@ -57,6 +71,7 @@ typedef struct {
 #define TAB_COS(x) gl_static.sintab[((x) + 64) & 255]
     byte latlngtab[NUMVERTEXNORMALS][2];
     byte lightstylemap[MAX_LIGHTSTYLES];
+    int texframe;   // frames drawn, for texture budget
 } glStatic_t;
 
 typedef struct {
@@ -71,11 +86,13 @@ typedef struct {
     int viewcluster1;
     int viewcluster2;
     cplane_t frustumPlanes[4];
+    cplane4_t frustum4;
     entity_t    *ent;
     qboolean    entrotated;
     vec3_t      entaxis[3];
     GLfloat     entmatrix[16];
     lightpoint_t lightpoint;
+    entity_t    *beams[MAX_ENTITIES];
     int     num_beams;
 } glRefdef_t;
 
@@ -107,6 +124,8 @@ typedef struct {
     int facesDrawn;
     int texSwitches;
     int texUploads;
+    int texReloads;
+    int lightmapBytes;
     int trisDrawn;
     int batchesDrawn;
     int nodesCulled;
@@ -115,6 +134,7 @@ typedef struct {
     int spheresCulled;
     int rotatedBoxesCulled;
     int batchesDrawn2D;
+    int entsOccluded;
 } statCounters_t;
 
 extern statCounters_t c;
@@ -122,6 +142,7 @@ extern statCounters_t c;
 // regular variables
 extern cvar_t *gl_partscale;
 extern cvar_t *gl_partstyle;
+extern cvar_t *gl_partsprites;
 extern cvar_t *gl_celshading;
 extern cvar_t *gl_dotshading;
 extern cvar_t *gl_shadows;
@@ -130,17 +151,27 @@ extern cvar_t *gl_modulate_world;
 extern cvar_t *gl_coloredlightmaps;
 extern cvar_t *gl_brightness;
 extern cvar_t *gl_dynamic;
+extern cvar_t *gl_lightmap_budget;
+extern cvar_t *gl_lightmap_size;
+extern cvar_t *gl_lightgrid;
 #if USE_DLIGHTS
 extern cvar_t *gl_dlight_falloff;
 #endif
 extern cvar_t *gl_modulate_entities;
 extern cvar_t *gl_doublelight_entities;
 extern cvar_t *gl_fragment_program;
+extern cvar_t *gl_vertex_program;
+extern cvar_t *gl_model_cache;
 extern cvar_t *gl_fontshadow;
+extern cvar_t *gl_retain2d;
+extern cvar_t *gl_world_indices;
+extern cvar_t *gl_world_threads;
 
 // development variables
 extern cvar_t *gl_znear;
 extern cvar_t *gl_drawsky;
+extern cvar_t *gl_skycubemap;
+extern cvar_t *gl_occlusion;
 extern cvar_t *gl_showtris;
 #ifdef _DEBUG
 extern cvar_t *gl_nobind;
@@ -148,6 +179,7 @@ extern cvar_t *gl_test;
 #endif
 extern cvar_t *gl_cull_nodes;
 extern cvar_t *gl_hash_faces;
+extern cvar_t *gl_cull_cache;
 extern cvar_t *gl_clear;
 extern cvar_t *gl_novis;
 extern cvar_t *gl_lockpvs;
@@ -163,6 +195,7 @@ typedef enum {
 glCullResult_t GL_CullBox(vec3_t bounds[2]);
 glCullResult_t GL_CullSphere(const vec3_t origin, float radius);
 glCullResult_t GL_CullLocalBox(const vec3_t origin, vec3_t bounds[2]);
+qboolean GL_OccludeEntity(const vec3_t origin, vec3_t bounds[2], vec_t radius);
 
 //void GL_DrawBox(const vec3_t origin, vec3_t bounds[2]);
 
@@ -189,6 +222,12 @@ typedef struct maliasvert_s {
     byte norm[2]; // lat, lng
 } maliasvert_t;
 
+// frame vertex as kept in array buffer for the lerp program
+typedef struct maliasbufvert_s {
+    short pos[4];
+    signed char norm[4];
+} maliasbufvert_t;
+
 typedef struct maliasframe_s {
     vec3_t scale;
     vec3_t translate;
@@ -205,6 +244,7 @@ typedef struct maliasmesh_s {
     maliastc_t *tcoords;
     image_t *skins[MAX_ALIAS_SKINS];
     int numskins;
+    GLuint bufnum; // all frames, if lerping on the card
 } maliasmesh_t;
 
 // xyz[3] + st[2] + lmst[2]
@@ -221,16 +261,37 @@ typedef struct maliasmesh_s {
     &glr.fd.lightstyles[gl_static.lightstylemap[(surf)->styles[i]]]
 
 #define LM_MAX_LIGHTMAPS    32
-#define LM_BLOCK_WIDTH      256
-#define LM_BLOCK_HEIGHT     256
+#define LM_MIN_BLOCK_SIZE   256
+#define LM_MAX_BLOCK_SIZE   2048
+
+typedef struct {
+    int left, top, right, bottom;
+} lm_rect_t;
 
 typedef struct {
-    int inuse[LM_BLOCK_WIDTH];
-    byte buffer[LM_BLOCK_WIDTH * LM_BLOCK_HEIGHT * 4];
+    int inuse[LM_MAX_BLOCK_SIZE];
+    int blocksize;  // width and height of lightmap pages, set at load time
     qboolean dirty;
     int comp;
     int nummaps;
     int highwater;
+
+    // system memory copies of uploaded blocks, dynamic updates are
+    // accumulated here and flushed once per block by GL_EndLights
+    byte *blocks[LM_MAX_LIGHTMAPS];
+    lm_rect_t rects[LM_MAX_LIGHTMAPS];
+    unsigned dirtymask;
+
+    // rebuild after parameter change, spread over several frames
+    qboolean rebuilding;
+    int rebuildface;
+    int texcomp;    // format the textures were created with
+
+    // lightmapped surfaces grouped by the styles they reference, so that
+    // only surfaces of styles that changed value get marked for relighting
+    mface_t **stylefaces;
+    int stylefirst[MAX_LIGHTSTYLES + 1];
+    float stylevalues[MAX_LIGHTSTYLES];
 } lightmap_builder_t;
 
 extern lightmap_builder_t lm;
@@ -241,6 +302,7 @@ void GL_EndLights(void);
 void GL_PushLights(mface_t *surf);
 
 void LM_RebuildSurfaces(void);
+void LM_UpdateStyles(void);
 
 void GL_LoadWorld(const char *name);
 void GL_FreeWorld(void);
@@ -293,15 +355,40 @@ void GL_EnableWarp(void);
 void GL_DisableWarp(void);
 void GL_EnableOutlines(void);
 void GL_DisableOutlines(void);
+void GL_ShutdownReadPixels(void);
 
 /*
  * gl_draw.c
  *
  */
+// one 2D batch of a span, with the state it was flushed with
+typedef struct {
+    int         texnum;
+    int         flags;
+    int         firstindex;
+    int         numindices;
+} spanrun_t;
+
+typedef struct {
+    unsigned    version;
+    qboolean    valid;
+    float       scale;
+    int         clip;       // DRAW_CLIP_* flags it was recorded with
+    vec_t       *vertices;
+    uint32_t    *colors;
+    int         *indices;   // absolute into span vertices
+    spanrun_t   *runs;
+    int         numverts, maxverts;
+    int         numindices, maxindices;
+    int         numruns, maxruns;
+} drawspan_t;
+
 typedef struct {
     color_t colors[2]; // 0 - actual color, 1 - transparency (for text drawing)
     int flags;
     float scale;
+    drawspan_t  spans[MAX_SPANS];
+    drawspan_t  *recording;
 } drawStatic_t;
 
 extern drawStatic_t draw;
@@ -314,6 +401,10 @@ void Draw_Scrap(void);
 #endif
 
 void GL_Blend(void);
+void GL_DrawFill(float x, float y, float w, float h, uint32_t color);
+void GL_RecordSpan(void);
+void GL_InvalidateSpans(void);
+void GL_ShutdownSpans(void);
 
 
 /*
@@ -321,14 +412,26 @@ void GL_Blend(void);
  *
  */
 
+#define SCRAP_MAX_PAGES     4
+
 // auto textures
 enum {
     TEXNUM_DEFAULT = MAX_RIMAGES,
     TEXNUM_SCRAP,
-    TEXNUM_PARTICLE,
+    TEXNUM_PARTICLE = TEXNUM_SCRAP + SCRAP_MAX_PAGES,
     TEXNUM_BEAM,
     TEXNUM_WHITE,
     TEXNUM_BLACK,
+    TEXNUM_VCR_SCREEN,
+    TEXNUM_VCR_GRAIN,
+    TEXNUM_VCR_DOTS,
+    TEXNUM_VCR_STATIC,
+    TEXNUM_VCR_OVERLAY,
+    TEXNUM_VCR_REWIND,
+    TEXNUM_VCR_GHOST,
+    TEXNUM_YUV_SOURCE = TEXNUM_VCR_GHOST + 2,
+    TEXNUM_YUV_PLANES,
+    TEXNUM_SKYCUBE,
     TEXNUM_LIGHTMAP // must be the last one
 };
 
@@ -340,6 +443,8 @@ void Scrap_Upload(void);
 
 void GL_InitImages(void);
 void GL_ShutdownImages(void);
+void GL_EnforceTextureBudget(void);
+void GL_RestoreImage(image_t *image);
 
 
 /*
@@ -358,11 +463,18 @@ typedef struct {
     int numverts;
     int numindices;
     int flags;
+    // index ranges into the static world element buffer
+    GLsizei counts[TESS_MAX_FACES];
+    const GLvoid *offsets[TESS_MAX_FACES];
+    int numranges;
 } tesselator_t;
 
 extern tesselator_t tess;
 
 void GL_Flush2D(void);
+void GL_DrawTriangles2D(int texnum, int flags, const vec_t *vertices,
+                        const uint32_t *colors, const int *indices,
+                        int numverts, int numindices);
 void GL_DrawParticles(void);
 void GL_DrawBeams(void);
 
@@ -377,7 +489,12 @@ void GL_DrawSolidFaces(void);
  */
 void GL_DrawBspModel(mmodel_t *model);
 void GL_DrawWorld(void);
+void GL_FreeWorldJobs(void);
+void GL_FreeViewCaches(void);
+void GL_ShutdownWorldThreads(void);
 void GL_LightPoint(vec3_t origin, vec3_t color);
+void GL_BuildLightGrid(void);
+void GL_FreeLightGrid(void);
 
 /*
  * gl_sky.c
@@ -393,4 +510,32 @@ void R_SetSky(const char *name, float rotate, vec3_t axis);
  *
  */
 void GL_DrawAliasModel(model_t *model);
+void GL_DrawShadows(void);
+
+
+/*
+ * gl_bench.c
+ *
+ */
+typedef enum {
+    BENCH_WORLD,
+    BENCH_ENTITIES,
+    BENCH_PARTICLES,
+    BENCH_ALPHA,
+    BENCH_2D,
+    BENCH_VCR,
+
+    BENCH_NUM_PASSES
+} benchpass_t;
+
+#define GL_BENCH_ACTIVE     1
+#define GL_BENCH_NOVCR      2
+
+extern int gl_bench;
+
+#define GL_BENCH_PASS(pass) \
+    do { if (gl_bench) GL_BenchPass(pass); } while (0)
 
+void GL_BenchPass(benchpass_t pass);
+void GL_InitBench(void);
+void GL_ShutdownBench(void);
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "common/mdfour.h"
 #include "common/prompt.h"
 
 static int gl_filter_min;
@@ -47,8 +48,12 @@ static cvar_t *gl_saturation;
 static cvar_t *gl_intensity;
 static cvar_t *gl_gamma;
 static cvar_t *gl_invert;
+static cvar_t *gl_texture_budget;
+static cvar_t *gl_texture_npot;
+static cvar_t *gl_generate_mipmaps;
 
 static qboolean GL_Upload8(byte *data, int width, int height, qboolean mipmap);
+static void GL_UploadDefaultTexture(void);
 
 typedef struct {
     const char *name;
@@ -119,7 +124,8 @@ static void gl_texturemode_changed(cvar_t *self)
 
     // change all the existing mipmap texture objects
     for (i = 0, image = r_images; i < r_numImages; i++, image++) {
-        if (image->type == IT_WALL || image->type == IT_SKIN) {
+        if ((image->type == IT_WALL || image->type == IT_SKIN) &&
+            !image->evicted) {
             GL_BindTexture(image->texnum);
             qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
                              gl_filter_min);
@@ -154,7 +160,8 @@ static void gl_anisotropy_changed(cvar_t *self)
 
     // change all the existing mipmap texture objects
     for (i = 0, image = r_images; i < r_numImages; i++, image++) {
-        if (image->type == IT_WALL || image->type == IT_SKIN) {
+        if ((image->type == IT_WALL || image->type == IT_SKIN) &&
+            !image->evicted) {
             GL_BindTexture(image->texnum);
             qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
                              gl_filter_anisotropy);
@@ -170,7 +177,8 @@ static void gl_bilerp_chars_changed(cvar_t *self)
 
     // change all the existing charset texture objects
     for (i = 0, image = r_images; i < r_numImages; i++, image++) {
-        if (image->type == IT_FONT) {
+        if (image->type == IT_FONT && !(image->flags & IF_SCRAP) &&
+            !image->evicted) {
             GL_BindTexture(image->texnum);
             qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
             qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param);
@@ -186,19 +194,21 @@ static void gl_bilerp_pics_changed(cvar_t *self)
 
     // change all the existing pic texture objects
     for (i = 0, image = r_images; i < r_numImages; i++, image++) {
-        if (image->type == IT_PIC) {
+        if (image->type == IT_PIC && !image->evicted) {
             GL_BindTexture(image->texnum);
             qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
             qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param);
         }
     }
 
-    // change scrap texture object
+    // change scrap texture objects
     if (!gl_noscrap->integer) {
         param = self->integer > 1 ? GL_LINEAR : GL_NEAREST;
-        GL_BindTexture(TEXNUM_SCRAP);
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param);
+        for (i = 0; i < SCRAP_MAX_PAGES; i++) {
+            GL_BindTexture(TEXNUM_SCRAP + i);
+            qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
+            qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param);
+        }
     }
 }
 
@@ -272,8 +282,8 @@ static void gl_texturesolidmode_g(genctx_t *ctx)
 
   SCRAP ALLOCATION
 
-  Allocate all the little status bar objects into a single texture
-  to crutch up inefficient hardware / drivers
+  Allocate all the status bar objects and charsets into a few pages
+  of texture, so that 2D batches are not broken by texture binds
 
 =============================================================================
 */
@@ -281,37 +291,87 @@ static void gl_texturesolidmode_g(genctx_t *ctx)
 #define SCRAP_BLOCK_WIDTH       256
 #define SCRAP_BLOCK_HEIGHT      256
 
-static int scrap_inuse[SCRAP_BLOCK_WIDTH];
-static byte scrap_data[SCRAP_BLOCK_WIDTH * SCRAP_BLOCK_HEIGHT];
-static qboolean scrap_dirty;
+// largest pic that goes into the scrap, enough for a charset
+#define SCRAP_MAX_PIC           128
 
-#define Scrap_AllocBlock(w, h, s, t) \
-    GL_AllocBlock(SCRAP_BLOCK_WIDTH, SCRAP_BLOCK_HEIGHT, scrap_inuse, w, h, s, t)
+typedef struct {
+    int     inuse[SCRAP_BLOCK_WIDTH];
+    byte    data[SCRAP_BLOCK_WIDTH * SCRAP_BLOCK_HEIGHT];
+} scrap_t;
+
+static scrap_t  scrap_pages[SCRAP_MAX_PAGES];
+static unsigned scrap_dirty;    // bit per page
+
+static int Scrap_AllocBlock(int w, int h, int *s, int *t)
+{
+    int i;
+
+    for (i = 0; i < SCRAP_MAX_PAGES; i++) {
+        if (GL_AllocBlock(SCRAP_BLOCK_WIDTH, SCRAP_BLOCK_HEIGHT,
+                          scrap_pages[i].inuse, w, h, s, t)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// pics drawn with texture coordinates outside of 0-1 can't be placed
+// into the scrap, neither can charsets that need different filtering
+static qboolean Scrap_Allowed(image_t *image, int width, int height)
+{
+    if (gl_noscrap->integer) {
+        return qfalse;
+    }
+    if (!(image->flags & IF_PALETTED)) {
+        return qfalse;
+    }
+    if (width > SCRAP_MAX_PIC || height > SCRAP_MAX_PIC) {
+        return qfalse;
+    }
+    if (image->type == IT_FONT) {
+        return !gl_bilerp_chars->integer && gl_bilerp_pics->integer <= 1;
+    }
+    if (image->type == IT_PIC) {
+        return !Q_stristr(image->name, "backtile"); // hack for backtile
+    }
+    return qfalse;
+}
 
 static void Scrap_Init(void)
 {
+    int i;
+
     // make scrap texture initially transparent
-    memset(scrap_data, 255, sizeof(scrap_data));
+    for (i = 0; i < SCRAP_MAX_PAGES; i++) {
+        memset(scrap_pages[i].data, 255, sizeof(scrap_pages[i].data));
+    }
 }
 
 static void Scrap_Shutdown(void)
 {
     int i;
 
-    for (i = 0; i < SCRAP_BLOCK_WIDTH; i++) {
-        scrap_inuse[i] = 0;
+    for (i = 0; i < SCRAP_MAX_PAGES; i++) {
+        memset(scrap_pages[i].inuse, 0, sizeof(scrap_pages[i].inuse));
     }
-    scrap_dirty = qfalse;
+    scrap_dirty = 0;
 }
 
 void Scrap_Upload(void)
 {
+    int i;
+
     if (!scrap_dirty) {
         return;
     }
-    GL_BindTexture(TEXNUM_SCRAP);
-    GL_Upload8(scrap_data, SCRAP_BLOCK_WIDTH, SCRAP_BLOCK_HEIGHT, qfalse);
-    scrap_dirty = qfalse;
+    for (i = 0; i < SCRAP_MAX_PAGES; i++) {
+        if (scrap_dirty & (1U << i)) {
+            GL_BindTexture(TEXNUM_SCRAP + i);
+            GL_Upload8(scrap_pages[i].data, SCRAP_BLOCK_WIDTH, SCRAP_BLOCK_HEIGHT, qfalse);
+        }
+    }
+    scrap_dirty = 0;
 }
 
 /*
@@ -474,11 +534,14 @@ static void GL_ColorInvertTexture(byte *in, int inwidth, int inheight)
     }
 }
 
+#define IS_SCRAP(texnum) \
+    ((texnum) >= TEXNUM_SCRAP && (texnum) < TEXNUM_SCRAP + SCRAP_MAX_PAGES)
+
 // returns true if image should not be bilinear filtered
 // (useful for small images in scarp, charsets, etc)
 static inline qboolean is_nearest(void)
 {
-    if (gls.texnum[gls.tmu] == TEXNUM_SCRAP && gl_bilerp_pics->integer <= 1) {
+    if (IS_SCRAP(gls.texnum[gls.tmu]) && gl_bilerp_pics->integer <= 1) {
         return qtrue; // hack for scrap texture
     }
     if (!upload_image) {
@@ -523,7 +586,7 @@ static inline qboolean is_downsample(void)
 
 static inline qboolean is_clamp(void)
 {
-    if (gls.texnum[gls.tmu] == TEXNUM_SCRAP) {
+    if (IS_SCRAP(gls.texnum[gls.tmu])) {
         return qtrue; // hack for scrap texture
     }
     if (!upload_image) {
@@ -554,25 +617,35 @@ static inline qboolean is_alpha(byte *data, int width, int height)
     return qfalse;
 }
 
-/*
-===============
-GL_Upload32
-===============
-*/
-static qboolean GL_Upload32(byte *data, int width, int height, qboolean mipmap)
+static inline qboolean is_hwmips(void)
+{
+    return gl_generate_mipmaps->integer &&
+        (gl_config.ext_enabled & QGL_SGIS_generate_mipmap);
+}
+
+// CPU mipmapping only handles power of two sizes
+static inline qboolean is_npot(qboolean mipmap)
+{
+    return gl_texture_npot->integer &&
+        (gl_config.ext_enabled & QGL_ARB_texture_non_power_of_two) &&
+        (!mipmap || is_hwmips());
+}
+
+// finds upload size after power of two and picmip
+static void GL_ScaleDimensions(int width, int height, qboolean mipmap,
+                               int *width_p, int *height_p)
 {
-    byte        *scaled;
     int         scaled_width, scaled_height;
-    int         comp;
-    qboolean    isalpha, picmip;
     int         maxsize;
 
-    // find the next-highest power of two
-    scaled_width = npot32(width);
-    scaled_height = npot32(height);
-
-    // save the flag indicating if costly resampling can be avoided
-    picmip = scaled_width == width && scaled_height == height;
+    if (is_npot(mipmap)) {
+        scaled_width = width;
+        scaled_height = height;
+    } else {
+        // find the next-highest power of two
+        scaled_width = npot32(width);
+        scaled_height = npot32(height);
+    }
 
     maxsize = gl_config.maxTextureSize;
 
@@ -608,6 +681,54 @@ static qboolean GL_Upload32(byte *data, int width, int height, qboolean mipmap)
     if (scaled_height < 1)
         scaled_height = 1;
 
+    *width_p = scaled_width;
+    *height_p = scaled_height;
+}
+
+static void GL_SetFilterAndRepeat(qboolean mipmap)
+{
+    if (mipmap) {
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
+    } else if (is_nearest()) {
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    if (!mipmap && is_clamp()) {
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    } else {
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+
+    if (mipmap && gl_config.maxAnisotropy >= 2) {
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+                         gl_filter_anisotropy);
+    }
+}
+
+/*
+===============
+GL_Upload32
+===============
+*/
+static qboolean GL_Upload32(byte *data, int width, int height, qboolean mipmap)
+{
+    byte        *scaled;
+    int         scaled_width, scaled_height;
+    int         comp;
+    qboolean    isalpha, picmip, hwmips;
+
+    GL_ScaleDimensions(width, height, mipmap, &scaled_width, &scaled_height);
+
+    // save the flag indicating if costly resampling can be avoided
+    picmip = npot32(width) == width && npot32(height) == height;
+
     upload_width = scaled_width;
     upload_height = scaled_height;
 
@@ -652,12 +773,18 @@ static qboolean GL_Upload32(byte *data, int width, int height, qboolean mipmap)
         comp = gl_tex_alpha_format;
     }
 
+    // let the driver build the mip chain if possible
+    hwmips = mipmap && is_hwmips();
+    if (hwmips) {
+        qglTexParameterf(GL_TEXTURE_2D, GL_GENERATE_MIPMAP_SGIS, GL_TRUE);
+    }
+
     qglTexImage2D(GL_TEXTURE_2D, 0, comp, scaled_width, scaled_height, 0,
                   GL_RGBA, GL_UNSIGNED_BYTE, scaled);
 
     c.texUploads++;
 
-    if (mipmap) {
+    if (mipmap && !hwmips) {
         int miplevel = 0;
 
         while (scaled_width > 1 || scaled_height > 1) {
@@ -674,29 +801,7 @@ static qboolean GL_Upload32(byte *data, int width, int height, qboolean mipmap)
         }
     }
 
-    if (mipmap) {
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min);
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
-    } else if (is_nearest()) {
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    } else {
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    }
-
-    if (!mipmap && is_clamp()) {
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-    } else {
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    }
-
-    if (mipmap && gl_config.maxAnisotropy >= 2) {
-        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
-                         gl_filter_anisotropy);
-    }
+    GL_SetFilterAndRepeat(mipmap);
 
     if (scaled != data) {
         FS_FreeTempMem(scaled);
@@ -757,6 +862,415 @@ static qboolean GL_Upload8(byte *data, int width, int height, qboolean mipmap)
 
 }
 
+/*
+=========================================================
+
+TEXTURE CACHE
+
+Mip chains of 32-bit textures are uploaded S3TC compressed and read back
+from the driver into texcache/ under the game directory. A cache file is
+valid as long as the source file and upload settings stay the same. It
+is only meant for this machine, so everything is in native byte order.
+
+=========================================================
+*/
+
+#define TEXCACHE_IDENT      (('C' << 24) + ('X' << 16) + ('E' << 8) + 'T')
+#define TEXCACHE_VERSION    1
+
+typedef struct {
+    uint32_t    ident;
+    uint32_t    version;
+    uint32_t    rawlen, checksum;   // of source file
+    uint32_t    params;             // of upload settings
+    uint32_t    upload_width, upload_height;
+    uint32_t    format;
+} texcache_t;
+
+static cvar_t *gl_texture_cache;
+
+static inline qboolean is_cached(void)
+{
+    return gl_texture_cache->integer &&
+        (gl_config.ext_enabled & QGL_EXT_texture_compression_s3tc);
+}
+
+static size_t GL_CompressedSize(int width, int height, GLenum format)
+{
+    size_t size = ((width + 3) >> 2) * ((height + 3) >> 2);
+
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? size * 8 : size * 16;
+}
+
+static size_t GL_CompressedChainSize(int width, int height, GLenum format)
+{
+    size_t size = GL_CompressedSize(width, height, format);
+
+    while (width > 1 || height > 1) {
+        width = max(width >> 1, 1);
+        height = max(height >> 1, 1);
+        size += GL_CompressedSize(width, height, format);
+    }
+
+    return size;
+}
+
+// estimated size of an uncompressed texture
+static unsigned GL_TextureBytes(int width, int height, qboolean mipmap, int bpp)
+{
+    unsigned size = width * height * bpp;
+
+    return mipmap ? size + size / 3 : size;
+}
+
+static uint32_t GL_UploadParams(const image_t *image, const imgupload_t *up)
+{
+    struct {
+        int     type;
+        int     grayscale, luminance, lightscale, invert, hwmips;
+        float   colorscale;
+        byte    gamma[256];
+    } p;
+
+    memset(&p, 0, sizeof(p));
+    p.type = image->type;
+    p.grayscale = up->grayscale;
+    p.luminance = up->luminance;
+    p.lightscale = up->lightscale;
+    p.invert = up->invert;
+    p.hwmips = up->hwmips;
+    if (up->grayscale) {
+        p.colorscale = colorscale;
+    }
+    if (up->lightscale) {
+        memcpy(p.gamma, gammaintensitytable, sizeof(p.gamma));
+    }
+
+    return Com_BlockChecksum(&p, sizeof(p));
+}
+
+static qboolean GL_CachePath(char *buffer, const image_t *image)
+{
+    size_t len;
+
+    len = Q_concat(buffer, MAX_QPATH, "texcache/", image->name, ".dxt", NULL);
+    return len < MAX_QPATH;
+}
+
+static qboolean GL_LoadCache(image_t *image, const imgupload_t *up)
+{
+    char path[MAX_QPATH];
+    texcache_t *tc;
+    ssize_t len;
+    byte *data;
+    size_t size;
+    int w, h, level;
+
+    if (!GL_CachePath(path, image)) {
+        return qfalse;
+    }
+
+    len = FS_LoadFile(path, (void **)&tc);
+    if (!tc) {
+        return qfalse;
+    }
+
+    if (len < sizeof(*tc) ||
+        tc->ident != TEXCACHE_IDENT ||
+        tc->version != TEXCACHE_VERSION ||
+        tc->rawlen != up->rawlen ||
+        tc->checksum != up->checksum ||
+        tc->params != up->params ||
+        tc->upload_width != up->width || tc->upload_height != up->height) {
+        goto fail;
+    }
+
+    if (tc->format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT &&
+        tc->format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+        goto fail;
+    }
+
+    if (len - sizeof(*tc) != GL_CompressedChainSize(up->width, up->height, tc->format)) {
+        goto fail;
+    }
+
+    GL_BindTexture(image->texnum);
+
+    data = (byte *)(tc + 1);
+    w = up->width;
+    h = up->height;
+    for (level = 0; ; level++) {
+        size = GL_CompressedSize(w, h, tc->format);
+        qglCompressedTexImage2DARB(GL_TEXTURE_2D, level, tc->format,
+                                   w, h, 0, size, data);
+        if (w == 1 && h == 1) {
+            break;
+        }
+        data += size;
+        w = max(w >> 1, 1);
+        h = max(h >> 1, 1);
+    }
+
+    c.texUploads++;
+
+    GL_SetFilterAndRepeat(qtrue);
+
+    if (tc->format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+        image->flags |= IF_TRANSPARENT;
+    }
+    image->upload_width = up->width;
+    image->upload_height = up->height;
+    image->bytes = len - sizeof(*tc);
+    image->sl = 0;
+    image->sh = 1;
+    image->tl = 0;
+    image->th = 1;
+
+    FS_FreeFile(tc);
+    return qtrue;
+
+fail:
+    Com_DPrintf("%s: %s is stale\n", __func__, path);
+    FS_FreeFile(tc);
+    return qfalse;
+}
+
+// reads back the currently bound compressed texture
+static void GL_SaveCache(image_t *image, const imgupload_t *up, GLenum format)
+{
+    char path[MAX_QPATH];
+    texcache_t *tc;
+    size_t len;
+    byte *data;
+    int w, h, level;
+    qerror_t ret;
+
+    if (!GL_CachePath(path, image)) {
+        return;
+    }
+
+    len = sizeof(*tc) + GL_CompressedChainSize(up->width, up->height, format);
+    tc = FS_AllocTempMem(len);
+    tc->ident = TEXCACHE_IDENT;
+    tc->version = TEXCACHE_VERSION;
+    tc->rawlen = up->rawlen;
+    tc->checksum = up->checksum;
+    tc->params = up->params;
+    tc->upload_width = up->width;
+    tc->upload_height = up->height;
+    tc->format = format;
+
+    data = (byte *)(tc + 1);
+    w = up->width;
+    h = up->height;
+    for (level = 0; ; level++) {
+        qglGetCompressedTexImageARB(GL_TEXTURE_2D, level, data);
+        if (w == 1 && h == 1) {
+            break;
+        }
+        data += GL_CompressedSize(w, h, format);
+        w = max(w >> 1, 1);
+        h = max(h >> 1, 1);
+    }
+
+    ret = FS_WriteFile(path, tc, len);
+    if (ret < 0) {
+        Com_DPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+    }
+
+    FS_FreeTempMem(tc);
+}
+
+/*
+================
+IMG_PrepareLoad
+
+Snapshots everything GL_Upload32 would look at for a mipmapped texture
+and reserves its texture name, so that surfaces can refer to it before
+the data arrives. Returns true if the texture was loaded from the cache,
+otherwise allocates space for the whole mip chain.
+================
+*/
+qboolean IMG_PrepareLoad(image_t *image, int width, int height,
+                         const byte *raw, size_t rawlen, imgupload_t *up)
+{
+    int w, h, size;
+
+    upload_image = image;
+
+    GL_ScaleDimensions(width, height, qtrue, &up->width, &up->height);
+
+    up->grayscale = is_wall() && colorscale != 1;
+    up->luminance = up->grayscale && colorscale == 0;
+    up->lightscale = !(r_config.flags & QVF_GAMMARAMP);
+    up->invert = is_wall() && gl_invert->integer;
+    up->hwmips = is_hwmips();
+    up->transparent = qfalse;
+
+    upload_image = NULL;
+
+    image->texnum = (image - r_images);
+
+    up->cache = is_cached();
+    if (up->cache) {
+        up->rawlen = rawlen;
+        up->checksum = Com_BlockChecksum((void *)raw, rawlen);
+        up->params = GL_UploadParams(image, up);
+        if (GL_LoadCache(image, up)) {
+            return qtrue;
+        }
+    }
+
+    w = up->width;
+    h = up->height;
+    size = w * h * 4;
+    while (!up->hwmips && (w > 1 || h > 1)) {
+        w = max(w >> 1, 1);
+        h = max(h >> 1, 1);
+        size += w * h * 4;
+    }
+    up->levels = FS_AllocTempMem(size);
+
+    return qfalse;
+}
+
+/*
+================
+IMG_ProcessLoad
+
+Does the CPU side of GL_Upload32. Safe to call from any thread, since
+it only touches pic and up.
+================
+*/
+void IMG_ProcessLoad(byte *pic, int width, int height, imgupload_t *up)
+{
+    byte *out = up->levels;
+    int w = up->width;
+    int h = up->height;
+
+    if (up->grayscale) {
+        GL_GrayScaleTexture(pic, width, height);
+    }
+    if (up->lightscale) {
+        GL_LightScaleTexture(pic, width, height, qtrue);
+    }
+    if (up->invert) {
+        GL_ColorInvertTexture(pic, width, height);
+    }
+
+    if (w == width && h == height) {
+        memcpy(out, pic, w * h * 4);
+    } else if (npot32(width) == width && npot32(height) == height) {
+        while (width > w || height > h) {
+            IMG_MipMap(pic, pic, width, height);
+            width >>= 1;
+            height >>= 1;
+        }
+        memcpy(out, pic, w * h * 4);
+    } else {
+        IMG_ResampleTexture(pic, width, height, out, w, h);
+    }
+
+    up->transparent = is_alpha(out, w, h);
+
+    if (up->hwmips) {
+        return;
+    }
+
+    while (w > 1 || h > 1) {
+        width = max(w >> 1, 1);
+        height = max(h >> 1, 1);
+        if (w > 1 && h > 1) {
+            IMG_MipMap(out + w * h * 4, out, w, h);
+        } else {
+            IMG_ResampleTexture(out, w, h, out + w * h * 4, width, height);
+        }
+        out += w * h * 4;
+        w = width;
+        h = height;
+    }
+}
+
+/*
+================
+IMG_FinishLoad
+
+Uploads the mip chain built by IMG_ProcessLoad and frees it. If decoding
+failed the caller clears up->levels and the default texture is used.
+================
+*/
+void IMG_FinishLoad(image_t *image, imgupload_t *up)
+{
+    byte *data = up->levels;
+    int w = up->width;
+    int h = up->height;
+    int comp, level;
+
+    image->texnum = (image - r_images);
+    GL_BindTexture(image->texnum);
+
+    if (!data) {
+        GL_UploadDefaultTexture();
+        image->upload_width = upload_width;
+        image->upload_height = upload_height;
+        image->bytes = upload_width * upload_height * 4;
+        goto done;
+    }
+
+    if (up->cache) {
+        comp = up->transparent ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT :
+            GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    } else if (up->transparent) {
+        comp = gl_tex_alpha_format;
+    } else if (up->luminance) {
+        comp = GL_LUMINANCE;
+    } else {
+        comp = gl_tex_solid_format;
+    }
+
+    if (up->hwmips) {
+        qglTexParameterf(GL_TEXTURE_2D, GL_GENERATE_MIPMAP_SGIS, GL_TRUE);
+    }
+
+    for (level = 0; ; level++) {
+        qglTexImage2D(GL_TEXTURE_2D, level, comp, w, h, 0,
+                      GL_RGBA, GL_UNSIGNED_BYTE, data);
+        if (up->hwmips || (w == 1 && h == 1)) {
+            break;
+        }
+        data += w * h * 4;
+        w = max(w >> 1, 1);
+        h = max(h >> 1, 1);
+    }
+
+    c.texUploads++;
+
+    GL_SetFilterAndRepeat(qtrue);
+
+    if (up->transparent) {
+        image->flags |= IF_TRANSPARENT;
+    }
+    image->upload_width = up->width;
+    image->upload_height = up->height;
+
+    if (up->cache) {
+        image->bytes = GL_CompressedChainSize(up->width, up->height, comp);
+        GL_SaveCache(image, up, comp);
+    } else {
+        image->bytes = GL_TextureBytes(up->width, up->height, qtrue,
+                                       up->luminance ? 1 : 4);
+    }
+
+    FS_FreeTempMem(up->levels);
+    up->levels = NULL;
+
+done:
+    image->sl = 0;
+    image->sh = 1;
+    image->tl = 0;
+    image->th = 1;
+}
+
 /*
 ================
 IMG_Load
@@ -766,7 +1280,7 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
 {
     qboolean mipmap, transparent;
     byte *src, *dst, *ptr;
-    int i, j, s, t;
+    int i, j, s, t, page;
 
     if (!pic) {
         Com_Error(ERR_FATAL, "%s: NULL", __func__);
@@ -774,12 +1288,11 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
 
     upload_image = image;
 
-    // load small 8-bit pics onto the scrap
-    if (image->type == IT_PIC && (image->flags & IF_PALETTED) &&
-        width < 64 && height < 64 && !gl_noscrap->integer &&
-        Scrap_AllocBlock(width, height, &s, &t)) {
+    // load 8-bit pics and charsets onto the scrap
+    if (Scrap_Allowed(image, width, height) &&
+        (page = Scrap_AllocBlock(width, height, &s, &t)) != -1) {
         src = pic;
-        dst = &scrap_data[t * SCRAP_BLOCK_WIDTH + s];
+        dst = &scrap_pages[page].data[t * SCRAP_BLOCK_WIDTH + s];
         for (i = 0; i < height; i++) {
             ptr = dst;
             for (j = 0; j < width; j++) {
@@ -788,7 +1301,7 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
             dst += SCRAP_BLOCK_WIDTH;
         }
 
-        image->texnum = TEXNUM_SCRAP;
+        image->texnum = TEXNUM_SCRAP + page;
         image->upload_width = width;
         image->upload_height = height;
         image->flags |= IF_SCRAP | IF_TRANSPARENT;
@@ -797,7 +1310,7 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
         image->tl = (t + 0.01f) / (float)SCRAP_BLOCK_HEIGHT;
         image->th = (t + height - 0.01f) / (float)SCRAP_BLOCK_HEIGHT;
 
-        scrap_dirty = qtrue;
+        scrap_dirty |= 1U << page;
         if (!gl_static.registering) {
             Scrap_Upload();
         }
@@ -822,6 +1335,7 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
     }
     image->upload_width = upload_width;     // after power of 2 and scales
     image->upload_height = upload_height;
+    image->bytes = GL_TextureBytes(upload_width, upload_height, mipmap, 4);
     image->sl = 0;
     image->sh = 1;
     image->tl = 0;
@@ -837,9 +1351,191 @@ void IMG_Unload(image_t *image)
             gls.texnum[gls.tmu] = 0;
         qglDeleteTextures(1, &image->texnum);
         image->texnum = 0;
+        image->bytes = 0;
     }
 }
 
+/*
+=========================================================
+
+TEXTURE BUDGET
+
+When gl_texture_budget is set, textures not bound for a while are deleted
+least recently used first to keep the estimated texture memory below the
+budget. They keep their texture names, which surfaces and skins refer to
+directly, and are read back from disk by GL_BindTexture when needed again.
+
+=========================================================
+*/
+
+#define BUDGET_GRACE_FRAMES 100     // never evict textures bound this recently
+#define BUDGET_CHECK_FRAMES 16      // how often to check the budget
+
+static image_t  *budget_images[MAX_RIMAGES];
+
+static qboolean can_evict(const image_t *image)
+{
+    if (!image->registration_sequence || image->evicted) {
+        return qfalse;
+    }
+    if (image->texnum != image - r_images || !image->bytes) {
+        return qfalse;  // scrap or not uploaded
+    }
+    // pics and fonts are small and are drawn from the UI at any time
+    if (image->type == IT_PIC || image->type == IT_FONT) {
+        return qfalse;
+    }
+    return gl_static.texframe - image->lastframe > BUDGET_GRACE_FRAMES;
+}
+
+static int lastframecmp(const void *p1, const void *p2)
+{
+    const image_t *a = *(const image_t **)p1;
+    const image_t *b = *(const image_t **)p2;
+
+    return a->lastframe - b->lastframe;
+}
+
+static void evict_image(image_t *image)
+{
+    int i;
+
+    for (i = 0; i < MAX_TMUS; i++) {
+        if (gls.texnum[i] == image->texnum) {
+            gls.texnum[i] = 0;
+        }
+    }
+    qglDeleteTextures(1, &image->texnum);
+
+    image->bytes = 0;
+    image->evicted = qtrue;
+}
+
+/*
+================
+GL_EnforceTextureBudget
+
+Called at the start of each frame.
+================
+*/
+void GL_EnforceTextureBudget(void)
+{
+    size_t budget, total;
+    image_t *image;
+    int i, count, evicted;
+
+    gl_static.texframe++;
+
+    if (gl_texture_budget->integer <= 0 || gl_static.registering) {
+        return;
+    }
+    if (gl_static.texframe % BUDGET_CHECK_FRAMES) {
+        return;
+    }
+
+    budget = (size_t)gl_texture_budget->integer << 20;
+    total = count = 0;
+    for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
+        total += image->bytes;
+        if (can_evict(image)) {
+            budget_images[count++] = image;
+        }
+    }
+
+    if (total <= budget || !count) {
+        return;
+    }
+
+    qsort(budget_images, count, sizeof(budget_images[0]), lastframecmp);
+
+    // evict a bit more than needed so this doesn't run every check
+    budget -= budget / 8;
+    for (i = evicted = 0; i < count && total > budget; i++, evicted++) {
+        total -= budget_images[i]->bytes;
+        evict_image(budget_images[i]);
+    }
+
+    Com_DDPrintf("%s: %d textures evicted\n", __func__, evicted);
+}
+
+/*
+================
+GL_RestoreImage
+
+Called by GL_BindTexture for evicted images.
+================
+*/
+void GL_RestoreImage(image_t *image)
+{
+    bsp_t *bsp = gl_static.world.cache;
+    mtexinfo_t *info;
+    qerror_t ret;
+    int i;
+
+    image->evicted = qfalse;
+
+    // sky and liquid surfaces are uploaded differently
+    if (image->type == IT_WALL && bsp) {
+        for (i = 0, info = bsp->texinfo; i < bsp->numtexinfo; i++, info++) {
+            if (info->image == image) {
+                upload_texinfo = info;
+                break;
+            }
+        }
+    }
+
+    ret = IMG_Reload(image);
+    upload_texinfo = NULL;
+    if (ret < 0) {
+        Com_EPrintf("Couldn't reload %s: %s\n", image->name, Q_ErrorString(ret));
+        GL_BindTexture(image->texnum);
+        GL_UploadDefaultTexture();
+    }
+
+    c.texReloads++;
+}
+
+static void GL_ImageStats_f(void)
+{
+    static const char *const types[IT_MAX] = {
+        "pic", "font", "skin", "sprite", "wall", "sky"
+    };
+    size_t bytes[IT_MAX], total;
+    int resident[IT_MAX], evicted[IT_MAX];
+    image_t *image;
+    int i;
+
+    memset(bytes, 0, sizeof(bytes));
+    memset(resident, 0, sizeof(resident));
+    memset(evicted, 0, sizeof(evicted));
+
+    for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
+        if (!image->registration_sequence || image->type >= IT_MAX) {
+            continue;
+        }
+        if (image->evicted) {
+            evicted[image->type]++;
+        } else if (image->bytes) {
+            resident[image->type]++;
+            bytes[image->type] += image->bytes;
+        }
+    }
+
+    Com_Printf("type   resident evicted       KiB\n"
+               "------ -------- ------- ---------\n");
+    total = 0;
+    for (i = 0; i < IT_MAX; i++) {
+        Com_Printf("%-6s %8d %7d %9"PRIz"\n", types[i],
+                   resident[i], evicted[i], bytes[i] >> 10);
+        total += bytes[i];
+    }
+    Com_Printf("Total resident: %"PRIz" KiB", total >> 10);
+    if (gl_texture_budget->integer > 0) {
+        Com_Printf(" (budget %d MiB)", gl_texture_budget->integer);
+    }
+    Com_Printf("\n");
+}
+
 static void GL_BuildIntensityTable(void)
 {
     int i, j;
@@ -895,12 +1591,12 @@ static const byte dottexture[8][8] = {
     {0, 0, 0, 0, 0, 0, 0, 0},
 };
 
-static void GL_InitDefaultTexture(void)
+// uploads the dot pattern to the currently bound texture
+static void GL_UploadDefaultTexture(void)
 {
     int i, j;
     byte pixels[8 * 8 * 4];
     byte *dst;
-    image_t *ntx;
 
     dst = pixels;
     for (i = 0; i < 8; i++) {
@@ -913,8 +1609,15 @@ static void GL_InitDefaultTexture(void)
         }
     }
 
-    GL_BindTexture(TEXNUM_DEFAULT);
     GL_Upload32(pixels, 8, 8, qtrue);
+}
+
+static void GL_InitDefaultTexture(void)
+{
+    image_t *ntx;
+
+    GL_BindTexture(TEXNUM_DEFAULT);
+    GL_UploadDefaultTexture();
 
     // fill in notexture image
     ntx = R_NOTEXTURE;
@@ -1032,6 +1735,10 @@ void GL_InitImages(void)
     gl_saturation = Cvar_Get("gl_saturation", "1", CVAR_FILES);
     gl_intensity = Cvar_Get("intensity", "1", CVAR_FILES);
     gl_invert = Cvar_Get("gl_invert", "0", CVAR_FILES);
+    gl_texture_cache = Cvar_Get("gl_texture_cache", "1", CVAR_FILES);
+    gl_texture_budget = Cvar_Get("gl_texture_budget", "0", 0);
+    gl_texture_npot = Cvar_Get("gl_texture_npot", "1", CVAR_FILES);
+    gl_generate_mipmaps = Cvar_Get("gl_generate_mipmaps", "1", CVAR_FILES);
     if (r_config.flags & QVF_GAMMARAMP) {
         gl_gamma = Cvar_Get("vid_gamma", "1", CVAR_ARCHIVE);
         gl_gamma->changed = gl_gamma_changed;
@@ -1072,6 +1779,8 @@ void GL_InitImages(void)
     GL_InitParticleTexture();
     GL_InitWhiteImage();
     GL_InitBeamTexture();
+
+    Cmd_AddCommand("imagestats", GL_ImageStats_f);
 }
 
 #ifdef _DEBUG
@@ -1097,6 +1806,8 @@ void GL_ShutdownImages(void)
     gl_anisotropy->changed = NULL;
     gl_gamma->changed = NULL;
 
+    Cmd_RemoveCommand("imagestats");
+
     // delete auto textures
     j = TEXNUM_LIGHTMAP + lm.highwater - TEXNUM_DEFAULT;
     for (i = 0; i < j; i++) {
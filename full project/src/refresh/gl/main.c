@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
  */
 
 #include "gl.h"
+#include "common/prof.h"
 #include "vcr_effect.h"
 
 glRefdef_t glr;
@@ -36,6 +37,7 @@ int registration_sequence;
 // regular variables
 cvar_t *gl_partscale;
 cvar_t *gl_partstyle;
+cvar_t *gl_partsprites;
 cvar_t *gl_celshading;
 cvar_t *gl_dotshading;
 cvar_t *gl_shadows;
@@ -44,20 +46,30 @@ cvar_t *gl_modulate_world;
 cvar_t *gl_coloredlightmaps;
 cvar_t *gl_brightness;
 cvar_t *gl_dynamic;
+cvar_t *gl_lightmap_budget;
+cvar_t *gl_lightmap_size;
+cvar_t *gl_lightgrid;
 #if USE_DLIGHTS
 cvar_t *gl_dlight_falloff;
 #endif
 cvar_t *gl_modulate_entities;
 cvar_t *gl_doublelight_entities;
 cvar_t *gl_fragment_program;
+cvar_t *gl_vertex_program;
+cvar_t *gl_model_cache;
 cvar_t *gl_vertex_buffer_object;
+cvar_t *gl_world_indices;
+cvar_t *gl_world_threads;
 cvar_t *gl_fontshadow;
+cvar_t *gl_retain2d;
 
 // development variables
 cvar_t *gl_znear;
 cvar_t *gl_drawworld;
 cvar_t *gl_drawentities;
 cvar_t *gl_drawsky;
+cvar_t *gl_skycubemap;
+cvar_t *gl_occlusion;
 cvar_t *gl_showtris;
 cvar_t *gl_showorigins;
 cvar_t *gl_showtearing;
@@ -73,6 +85,7 @@ cvar_t *gl_cull_models;
 cvar_t *gl_clear;
 cvar_t *gl_finish;
 cvar_t *gl_hash_faces;
+cvar_t *gl_cull_cache;
 cvar_t *gl_novis;
 cvar_t *gl_lockpvs;
 cvar_t *gl_lightmap;
@@ -80,11 +93,14 @@ cvar_t *gl_fullbright;
 cvar_t *gl_polyblend;
 cvar_t *gl_showerrors;
 
-// VCR Effect Cvars
-cvar_t *eng_vcr_enabled;
-cvar_t *eng_vcr_mode;
-cvar_t *eng_vcr_quality;
-cvar_t *eng_vcr_debug;
+// VCR effect is composited once per displayed frame, over views
+// rendered since R_BeginFrame
+static struct {
+    qboolean    pending;
+    int         numtiles;
+    vrect_t     tiles[MAX_VIEWS];
+    int         width, height;  // of the wall tiles are laid out in
+} vcrframe;
 
 // ==============================================================================
 
@@ -122,29 +138,28 @@ static void GL_SetupFrustum(void)
         p->type = PLANE_NON_AXIAL;
         SetPlaneSignbits(p);
     }
+
+    SetPlanes4(&glr.frustum4, glr.frustumPlanes, 4);
 }
 
-glCullResult_t GL_CullBox(vec3_t bounds[2])
+static inline glCullResult_t box_cull_result(int bits)
 {
-    int i, bits;
-    glCullResult_t cull;
+    if (BOX4_BEHIND(bits)) {
+        return CULL_OUT;
+    }
+    if (BOX4_INFRONT(bits) != 15) {
+        return CULL_CLIP;
+    }
+    return CULL_IN;
+}
 
+glCullResult_t GL_CullBox(vec3_t bounds[2])
+{
     if (!gl_cull_models->integer) {
         return CULL_IN;
     }
 
-    cull = CULL_IN;
-    for (i = 0; i < 4; i++) {
-        bits = BoxOnPlaneSide(bounds[0], bounds[1], &glr.frustumPlanes[i]);
-        if (bits == BOX_BEHIND) {
-            return CULL_OUT;
-        }
-        if (bits != BOX_INFRONT) {
-            cull = CULL_CLIP;
-        }
-    }
-
-    return cull;
+    return box_cull_result(BoxOnPlanes4Side(bounds[0], bounds[1], &glr.frustum4));
 }
 
 glCullResult_t GL_CullSphere(const vec3_t origin, float radius)
@@ -189,42 +204,23 @@ static inline void make_box_points(const vec3_t    origin,
 
 glCullResult_t GL_CullLocalBox(const vec3_t origin, vec3_t bounds[2])
 {
-    vec3_t points[8];
+    cplane4_t local;
     cplane_t *p;
     int i, j;
-    vec_t dot;
-    qboolean infront;
-    glCullResult_t cull;
 
     if (!gl_cull_models->integer) {
         return CULL_IN;
     }
 
-    make_box_points(origin, bounds, points);
-
-    cull = CULL_IN;
+    // move the frustum into entity space rather than the box out of it
     for (i = 0, p = glr.frustumPlanes; i < 4; i++, p++) {
-        infront = qfalse;
-        for (j = 0; j < 8; j++) {
-            dot = DotProduct(points[j], p->normal);
-            if (dot >= p->dist) {
-                infront = qtrue;
-                if (cull == CULL_CLIP) {
-                    break;
-                }
-            } else {
-                cull = CULL_CLIP;
-                if (infront) {
-                    break;
-                }
-            }
-        }
-        if (!infront) {
-            return CULL_OUT;
+        for (j = 0; j < 3; j++) {
+            local.normal[j][i] = DotProduct(glr.entaxis[j], p->normal);
         }
+        local.dist[i] = p->dist - DotProduct(origin, p->normal);
     }
 
-    return cull;
+    return box_cull_result(BoxOnPlanes4Side(bounds[0], bounds[1], &local));
 }
 
 #if 0
@@ -253,6 +249,158 @@ void GL_DrawBox(const vec3_t origin, vec3_t bounds[2])
 }
 #endif
 
+/*
+=============================================================================
+
+OCCLUSION QUERIES
+
+Entities with an id get their bounding box tested against the depth
+buffer. Results are read back one frame later without waiting for them,
+an entity is skipped while the last result says no samples passed.
+
+=============================================================================
+*/
+
+typedef struct {
+    GLuint  query;
+    int     issued;     // frame query was issued on, 0 if none pending
+    int     seen;       // last frame entity was tested on
+    qboolean    occluded;
+} occlusion_t;
+
+static occlusion_t  gl_occlusions[MAX_ENTITY_IDS];
+
+static void GL_DrawOcclusionBox(vec3_t mins, vec3_t maxs)
+{
+    static const GLuint indices[36] = {
+        0, 1, 3, 0, 3, 2,   4, 6, 7, 4, 7, 5,
+        0, 4, 5, 0, 5, 1,   2, 3, 7, 2, 7, 6,
+        0, 2, 6, 0, 6, 4,   1, 5, 7, 1, 7, 3
+    };
+    glCullFace_t cull = gls.cull;
+    vec3_t points[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        points[i][0] = (i & 4) ? maxs[0] : mins[0];
+        points[i][1] = (i & 2) ? maxs[1] : mins[1];
+        points[i][2] = (i & 1) ? maxs[2] : mins[2];
+    }
+
+    GL_Bits(GLS_DEPTHMASK_FALSE);
+    GL_CullFace(GLS_CULL_DISABLE);
+    qglColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    qglVertexPointer(3, GL_FLOAT, 0, points);
+    qglDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, indices);
+
+    qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    qglColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    GL_CullFace(cull);
+}
+
+/*
+=================
+GL_OccludeEntity
+
+Returns true if current entity should be skipped. Bounds are local to
+the entity, radius is used instead of them for rotated entities.
+=================
+*/
+qboolean GL_OccludeEntity(const vec3_t origin, vec3_t bounds[2], vec_t radius)
+{
+    entity_t *ent = glr.ent;
+    occlusion_t *occ;
+    vec3_t mins, maxs;
+    GLint result;
+    int i;
+
+    if (!gl_occlusion->integer) {
+        return qfalse;
+    }
+    if (!(gl_config.ext_enabled & QGL_ARB_occlusion_query)) {
+        return qfalse;
+    }
+    if (ent->id <= 0 || ent->id >= MAX_ENTITY_IDS) {
+        return qfalse;
+    }
+    if (ent->flags & (RF_TRANSLUCENT | RF_VIEWERMODEL | RF_WEAPONMODEL | RF_DEPTHHACK)) {
+        return qfalse;
+    }
+
+    occ = &gl_occlusions[ent->id];
+
+    // results are stale if entity wasn't around on the previous frame
+    if (occ->seen != glr.drawframe - 1) {
+        occ->occluded = qfalse;
+    }
+    occ->seen = glr.drawframe;
+
+    if (occ->issued) {
+        qglGetQueryObjectivARB(occ->query, GL_QUERY_RESULT_AVAILABLE_ARB, &result);
+        if (result) {
+            qglGetQueryObjectivARB(occ->query, GL_QUERY_RESULT_ARB, &result);
+            if (glr.drawframe - occ->issued <= 2) {
+                occ->occluded = !result;
+            }
+            occ->issued = 0;
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (glr.entrotated) {
+            mins[i] = origin[i] - radius;
+            maxs[i] = origin[i] + radius;
+        } else {
+            mins[i] = origin[i] + bounds[0][i];
+            maxs[i] = origin[i] + bounds[1][i];
+        }
+    }
+
+    // box would be clipped by the near plane, assume visible
+    for (i = 0; i < 3; i++) {
+        if (glr.fd.vieworg[i] < mins[i] - 8 || glr.fd.vieworg[i] > maxs[i] + 8) {
+            break;
+        }
+    }
+    if (i == 3) {
+        occ->occluded = qfalse;
+        return qfalse;
+    }
+
+    if (!occ->issued) {
+        if (!occ->query) {
+            qglGenQueriesARB(1, &occ->query);
+        }
+        qglBeginQueryARB(GL_SAMPLES_PASSED_ARB, occ->query);
+        GL_DrawOcclusionBox(mins, maxs);
+        qglEndQueryARB(GL_SAMPLES_PASSED_ARB);
+        occ->issued = glr.drawframe;
+    }
+
+    if (occ->occluded) {
+        c.entsOccluded++;
+        return qtrue;
+    }
+
+    return qfalse;
+}
+
+static void GL_ShutdownOcclusion(void)
+{
+    occlusion_t *occ;
+    int i;
+
+    for (i = 0, occ = gl_occlusions; i < MAX_ENTITY_IDS; i++, occ++) {
+        if (occ->query) {
+            qglDeleteQueriesARB(1, &occ->query);
+        }
+    }
+
+    memset(gl_occlusions, 0, sizeof(gl_occlusions));
+}
+
 // shared between lightmap and scrap allocators
 qboolean GL_AllocBlock(int width, int height, int *inuse,
                        int w, int h, int *s, int *t)
@@ -266,6 +414,8 @@ qboolean GL_AllocBlock(int width, int height, int *inuse,
         for (j = 0; j < w; j++) {
             k = inuse[i + j];
             if (k >= min_inuse) {
+                // no better position overlaps this column either
+                i += j;
                 break;
             }
             if (max_inuse < k) {
@@ -411,80 +561,142 @@ static void GL_DrawNullModel(void)
     qglEnable(GL_TEXTURE_2D);
 }
 
-static void GL_DrawEntities(int mask)
+typedef struct {
+    entity_t    *ent;
+    vec_t       dist;
+} entsort_t;
+
+// opaque entities are sorted to group the same model and skin together,
+// which saves texture and vertex program state changes
+static int entcmp_opaque(const void *p1, const void *p2)
+{
+    const entity_t *e1 = ((const entsort_t *)p1)->ent;
+    const entity_t *e2 = ((const entsort_t *)p2)->ent;
+
+    if (e1->model != e2->model)
+        return e1->model < e2->model ? -1 : 1;
+    if (e1->skin != e2->skin)
+        return e1->skin < e2->skin ? -1 : 1;
+    if (e1->skinnum != e2->skinnum)
+        return e1->skinnum < e2->skinnum ? -1 : 1;
+
+    // keep list order otherwise
+    return e1 < e2 ? -1 : 1;
+}
+
+// translucent entities are drawn back to front
+static int entcmp_alpha(const void *p1, const void *p2)
+{
+    const entsort_t *s1 = p1;
+    const entsort_t *s2 = p2;
+
+    if (s1->dist != s2->dist)
+        return s1->dist > s2->dist ? -1 : 1;
+
+    return s1->ent < s2->ent ? -1 : 1;
+}
+
+static void GL_DrawEntity(entity_t *ent)
 {
-    entity_t *ent, *last;
     model_t *model;
 
-    if (!gl_drawentities->integer) {
-        return;
+    glr.ent = ent;
+
+    // convert angles to axis
+    if (VectorEmpty(ent->angles)) {
+        glr.entrotated = qfalse;
+        VectorSet(glr.entaxis[0], 1, 0, 0);
+        VectorSet(glr.entaxis[1], 0, 1, 0);
+        VectorSet(glr.entaxis[2], 0, 0, 1);
+    } else {
+        glr.entrotated = qtrue;
+        AnglesToAxis(ent->angles, glr.entaxis);
     }
 
-    last = glr.fd.entities + glr.fd.num_entities;
-    for (ent = glr.fd.entities; ent != last; ent++) {
-        if (ent->flags & RF_BEAM) {
-            // beams are drawn elsewhere in single batch
-            glr.num_beams++;
-            continue;
+    // inline BSP model
+    if (ent->model & 0x80000000) {
+        bsp_t *bsp = gl_static.world.cache;
+        int index = ~ent->model;
+
+        if (glr.fd.rdflags & RDF_NOWORLDMODEL) {
+            Com_Error(ERR_DROP, "%s: inline model without world",
+                      __func__);
         }
-        if ((ent->flags & RF_TRANSLUCENT) != mask) {
-            continue;
+
+        if (index < 1 || index >= bsp->nummodels) {
+            Com_Error(ERR_DROP, "%s: inline model %d out of range",
+                      __func__, index);
         }
 
-        glr.ent = ent;
+        GL_DrawBspModel(&bsp->models[index]);
+        return;
+    }
 
-        // convert angles to axis
-        if (VectorEmpty(ent->angles)) {
-            glr.entrotated = qfalse;
-            VectorSet(glr.entaxis[0], 1, 0, 0);
-            VectorSet(glr.entaxis[1], 0, 1, 0);
-            VectorSet(glr.entaxis[2], 0, 0, 1);
-        } else {
-            glr.entrotated = qtrue;
-            AnglesToAxis(ent->angles, glr.entaxis);
-        }
+    model = MOD_ForHandle(ent->model);
+    if (!model) {
+        GL_DrawNullModel();
+        return;
+    }
 
-        // inline BSP model
-        if (ent->model & 0x80000000) {
-            bsp_t *bsp = gl_static.world.cache;
-            int index = ~ent->model;
+    switch (model->type) {
+    case MOD_ALIAS:
+        GL_DrawAliasModel(model);
+        break;
+    case MOD_SPRITE:
+        GL_DrawSpriteModel(model);
+        break;
+    case MOD_EMPTY:
+        break;
+    default:
+        Com_Error(ERR_FATAL, "%s: bad model type", __func__);
+    }
 
-            if (glr.fd.rdflags & RDF_NOWORLDMODEL) {
-                Com_Error(ERR_DROP, "%s: inline model without world",
-                          __func__);
-            }
+    if (gl_showorigins->integer) {
+        GL_DrawNullModel();
+    }
+}
 
-            if (index < 1 || index >= bsp->nummodels) {
-                Com_Error(ERR_DROP, "%s: inline model %d out of range",
-                          __func__, index);
-            }
+static void GL_DrawEntities(int mask)
+{
+    entsort_t *sorted;
+    entity_t *ent, *last;
+    vec3_t dir;
+    int i, count;
+
+    if (!gl_drawentities->integer || !glr.fd.num_entities) {
+        return;
+    }
 
-            GL_DrawBspModel(&bsp->models[index]);
+    sorted = Z_FrameAlloc(sizeof(sorted[0]) * glr.fd.num_entities);
+
+    count = 0;
+    last = glr.fd.entities + glr.fd.num_entities;
+    for (ent = glr.fd.entities; ent != last; ent++) {
+        if (ent->flags & RF_BEAM) {
+            // beams are drawn elsewhere in single batch
+            if (!mask) {
+                glr.beams[glr.num_beams++] = ent;
+            }
             continue;
         }
-
-        model = MOD_ForHandle(ent->model);
-        if (!model) {
-            GL_DrawNullModel();
+        if ((ent->flags & RF_TRANSLUCENT) != mask) {
             continue;
         }
-
-        switch (model->type) {
-        case MOD_ALIAS:
-            GL_DrawAliasModel(model);
-            break;
-        case MOD_SPRITE:
-            GL_DrawSpriteModel(model);
-            break;
-        case MOD_EMPTY:
-            break;
-        default:
-            Com_Error(ERR_FATAL, "%s: bad model type", __func__);
+        sorted[count].ent = ent;
+        if (mask) {
+            VectorSubtract(ent->origin, glr.fd.vieworg, dir);
+            sorted[count].dist = DotProduct(dir, glr.viewaxis[0]);
         }
+        count++;
+    }
 
-        if (gl_showorigins->integer) {
-            GL_DrawNullModel();
-        }
+    if (count > 1) {
+        qsort(sorted, count, sizeof(sorted[0]),
+              mask ? entcmp_alpha : entcmp_opaque);
+    }
+
+    for (i = 0; i < count; i++) {
+        GL_DrawEntity(sorted[i].ent);
     }
 }
 
@@ -571,7 +783,7 @@ qboolean GL_ShowErrors(const char *func)
     return qtrue;
 }
 
-void R_RenderFrame(refdef_t *fd)
+static void GL_RenderView(refdef_t *fd)
 {
     GL_Flush2D();
 
@@ -590,9 +802,12 @@ void R_RenderFrame(refdef_t *fd)
     }
 #endif
 
-    if (lm.dirty) {
+    if (lm.dirty || lm.rebuilding) {
         LM_RebuildSurfaces();
-        lm.dirty = qfalse;
+    }
+
+    if (gl_dynamic->integer && !(glr.fd.rdflags & RDF_NOWORLDMODEL)) {
+        LM_UpdateStyles();
     }
 
     GL_Setup3D();
@@ -601,38 +816,82 @@ void R_RenderFrame(refdef_t *fd)
         GL_SetupFrustum();
     }
 
+    TD_START(TD_WORLD);
     if (!(glr.fd.rdflags & RDF_NOWORLDMODEL) && gl_drawworld->integer) {
         GL_DrawWorld();
     }
+    TD_STOP(TD_WORLD);
+    GL_BENCH_PASS(BENCH_WORLD);
 
+    TD_START(TD_ENTITIES);
     GL_DrawEntities(0);
+    GL_DrawShadows();
 
     GL_DrawBeams();
+    TD_STOP(TD_ENTITIES);
+    GL_BENCH_PASS(BENCH_ENTITIES);
 
+    TD_START(TD_PARTICLES);
     GL_DrawParticles();
+    TD_STOP(TD_PARTICLES);
+    GL_BENCH_PASS(BENCH_PARTICLES);
 
+    TD_START(TD_ENTITIES);
     GL_DrawEntities(RF_TRANSLUCENT);
+    GL_DrawShadows();
+    TD_STOP(TD_ENTITIES);
+    GL_BENCH_PASS(BENCH_ENTITIES);
 
+    TD_START(TD_WORLD);
     if (!(glr.fd.rdflags & RDF_NOWORLDMODEL)) {
         GL_DrawAlphaFaces();
     }
+    TD_STOP(TD_WORLD);
+    GL_BENCH_PASS(BENCH_ALPHA);
 
     // go back into 2D mode
     GL_Setup2D();
-    
-    // VCR EFFECT
-    if (glr.fd.time) {
-        // Sync Cvars to VCR Internal State
-        if (eng_vcr_enabled && eng_vcr_enabled->integer) VCR_Enable(); else VCR_Disable();
-        if (eng_vcr_mode) VCR_SetMode(eng_vcr_mode->integer);
-        if (eng_vcr_quality) VCR_SetQuality(eng_vcr_quality->integer);
-        if (eng_vcr_debug) { /* Hack: poke internal debug var if exposed */ }
-
-        // Pass time in SECONDS (Using Real Time so effect runs in console/pause)
-        VCR_DrawEffect(glr.fd.width, glr.fd.height, com_localTime / 1000.0f);
-    } else {
-        // Fallback
-        VCR_DrawEffect(glr.fd.width, glr.fd.height, com_localTime / 1000.0f);
+}
+
+/*
+=============
+GL_DrawVCR
+
+Runs the effect over the whole screen, including 2D drawn on top of the
+views, then per tile overlays of a view wall. Called from R_EndFrame, so
+the cost is paid once per displayed frame however many views are drawn.
+=============
+*/
+static void GL_DrawVCR(void)
+{
+    if (!vcrframe.pending || (gl_bench & GL_BENCH_NOVCR)) {
+        return;
+    }
+
+    GL_Flush2D();
+
+    TD_START(TD_2D);
+    // time is in seconds of real time, so effect runs in console/pause
+    PROF_Begin(PROF_VCR_EFFECT);
+    VCR_DrawEffect(r_config.width, r_config.height, com_localTime / 1000.0f);
+    if (vcrframe.numtiles) {
+        VCR_DrawTiles(vcrframe.width, vcrframe.height, vcrframe.tiles,
+                      vcrframe.numtiles, com_localTime / 1000.0f);
+    }
+    PROF_End(PROF_VCR_EFFECT);
+    TD_STOP(TD_2D);
+    GL_BENCH_PASS(BENCH_VCR);
+
+    GL_Setup2D();
+}
+
+void R_RenderFrame(refdef_t *fd)
+{
+    GL_RenderView(fd);
+
+    // model previews in menus don't turn on the effect
+    if (!(fd->rdflags & RDF_NOWORLDMODEL)) {
+        vcrframe.pending = qtrue;
     }
 
     if (gl_polyblend->integer && glr.fd.blend[3] != 0) {
@@ -648,6 +907,62 @@ void R_RenderFrame(refdef_t *fd)
     GL_ShowErrors(__func__);
 }
 
+static int GL_ViewCluster(refdef_t *fd)
+{
+    bsp_t *bsp = gl_static.world.cache;
+
+    if (!bsp || (fd->rdflags & RDF_NOWORLDMODEL)) {
+        return -1;
+    }
+
+    return BSP_PointLeaf(bsp->nodes, fd->vieworg)->cluster;
+}
+
+void R_RenderFrames(refdef_t *fd, int count)
+{
+    refdef_t *order[MAX_VIEWS];
+    int cluster[MAX_VIEWS];
+    int i, j, c, width, height;
+
+    if (count > MAX_VIEWS) {
+        count = MAX_VIEWS;
+    }
+
+    // views sharing a cluster go back to back, so GL_MarkLeaves
+    // finds the PVS unchanged and skips marking
+    for (i = 0; i < count; i++) {
+        c = GL_ViewCluster(&fd[i]);
+        for (j = i; j > 0 && cluster[j - 1] > c; j--) {
+            order[j] = order[j - 1];
+            cluster[j] = cluster[j - 1];
+        }
+        order[j] = &fd[i];
+        cluster[j] = c;
+    }
+
+    width = height = 0;
+    for (i = 0; i < count; i++) {
+        GL_RenderView(order[i]);
+
+        vcrframe.tiles[i].x = fd[i].x;
+        vcrframe.tiles[i].y = fd[i].y;
+        vcrframe.tiles[i].width = fd[i].width;
+        vcrframe.tiles[i].height = fd[i].height;
+        width = max(width, fd[i].x + fd[i].width);
+        height = max(height, fd[i].y + fd[i].height);
+    }
+
+    // one effect pass over the screen, then per tile overlays
+    if (count) {
+        vcrframe.pending = qtrue;
+        vcrframe.numtiles = count;
+        vcrframe.width = width;
+        vcrframe.height = height;
+    }
+
+    GL_ShowErrors(__func__);
+}
+
 void R_BeginFrame(void)
 {
 #ifdef _DEBUG
@@ -657,6 +972,12 @@ void R_BeginFrame(void)
 #endif
 
     memset(&c, 0, sizeof(c));
+    memset(&vcrframe, 0, sizeof(vcrframe));
+
+    // don't keep recording into a span left open last frame
+    draw.recording = NULL;
+
+    GL_EnforceTextureBudget();
 
     if (gl_finish->integer) {
         qglFinish();
@@ -673,6 +994,8 @@ void R_BeginFrame(void)
 
 void R_EndFrame(void)
 {
+    GL_DrawVCR();
+
 #ifdef _DEBUG
     if (gl_showstats->integer) {
         GL_Flush2D();
@@ -688,11 +1011,15 @@ void R_EndFrame(void)
         GL_DrawTearing();
     }
 
-    // enable/disable fragment programs on the fly
-    if (gl_fragment_program->modified) {
+    // read back the finished frame before it is swapped away
+    IMG_CaptureFrame();
+
+    // enable/disable fragment and vertex programs on the fly
+    if (gl_fragment_program->modified || gl_vertex_program->modified) {
         GL_ShutdownPrograms();
         GL_InitPrograms();
         gl_fragment_program->modified = qfalse;
+        gl_vertex_program->modified = qfalse;
     }
 
     GL_ShowErrors(__func__);
@@ -744,6 +1071,11 @@ static void gl_modulate_changed(cvar_t *self)
     gl_modulate_entities_changed(self);
 }
 
+static void gl_lightgrid_changed(cvar_t *self)
+{
+    GL_BuildLightGrid();
+}
+
 // ugly hack to reset sky
 static void gl_drawsky_changed(cvar_t *self)
 {
@@ -756,11 +1088,17 @@ static void gl_novis_changed(cvar_t *self)
     glr.viewcluster1 = glr.viewcluster2 = -2;
 }
 
+static void gl_retain2d_changed(cvar_t *self)
+{
+    GL_InvalidateSpans();
+}
+
 static void GL_Register(void)
 {
     // regular variables
     gl_partscale = Cvar_Get("gl_partscale", "2", 0);
     gl_partstyle = Cvar_Get("gl_partstyle", "0", 0);
+    gl_partsprites = Cvar_Get("gl_partsprites", "1", 0);
     gl_celshading = Cvar_Get("gl_celshading", "0", 0);
     gl_dotshading = Cvar_Get("gl_dotshading", "1", 0);
     gl_shadows = Cvar_Get("gl_shadows", "0", CVAR_ARCHIVE);
@@ -774,6 +1112,10 @@ static void GL_Register(void)
     gl_brightness->changed = gl_lightmap_changed;
     gl_dynamic = Cvar_Get("gl_dynamic", "2", 0);
     gl_dynamic->changed = gl_lightmap_changed;
+    gl_lightmap_budget = Cvar_Get("gl_lightmap_budget", "65536", 0);
+    gl_lightmap_size = Cvar_Get("gl_lightmap_size", "1024", CVAR_FILES);
+    gl_lightgrid = Cvar_Get("gl_lightgrid", "1", 0);
+    gl_lightgrid->changed = gl_lightgrid_changed;
 #if USE_DLIGHTS
     gl_dlight_falloff = Cvar_Get("gl_dlight_falloff", "1", 0);
 #endif
@@ -781,15 +1123,17 @@ static void GL_Register(void)
     gl_modulate_entities->changed = gl_modulate_entities_changed;
     gl_doublelight_entities = Cvar_Get("gl_doublelight_entities", "1", 0);
     gl_fragment_program = Cvar_Get("gl_fragment_program", "1", 0);
+    gl_vertex_program = Cvar_Get("gl_vertex_program", "1", CVAR_FILES);
+    gl_model_cache = Cvar_Get("gl_model_cache", "1", 0);
     gl_vertex_buffer_object = Cvar_Get("gl_vertex_buffer_object", "1", CVAR_FILES);
     gl_vertex_buffer_object->modified = qtrue;
+    gl_world_indices = Cvar_Get("gl_world_indices", "1", CVAR_FILES);
+    gl_world_threads = Cvar_Get("gl_world_threads", "0", 0);
+    gl_world_threads->modified = qtrue;
     gl_fontshadow = Cvar_Get("gl_fontshadow", "0", 0);
-
-    // VCR Effect Registration
-    eng_vcr_enabled = Cvar_Get("vcr_enabled", "1", CVAR_ARCHIVE);
-    eng_vcr_mode = Cvar_Get("vcr_mode", "0", CVAR_ARCHIVE);
-    eng_vcr_quality = Cvar_Get("vcr_quality", "2", CVAR_ARCHIVE);
-    eng_vcr_debug = Cvar_Get("vcr_debug", "0", 0);
+    gl_fontshadow->changed = gl_retain2d_changed;
+    gl_retain2d = Cvar_Get("gl_retain2d", "1", 0);
+    gl_retain2d->changed = gl_retain2d_changed;
 
     // development variables
     gl_znear = Cvar_Get("gl_znear", "2", CVAR_CHEAT);
@@ -797,6 +1141,9 @@ static void GL_Register(void)
     gl_drawentities = Cvar_Get("gl_drawentities", "1", CVAR_CHEAT);
     gl_drawsky = Cvar_Get("gl_drawsky", "1", 0);
     gl_drawsky->changed = gl_drawsky_changed;
+    gl_skycubemap = Cvar_Get("gl_skycubemap", "1", 0);
+    gl_skycubemap->changed = gl_drawsky_changed;
+    gl_occlusion = Cvar_Get("gl_occlusion", "0", 0);
     gl_showtris = Cvar_Get("gl_showtris", "0", CVAR_CHEAT);
     gl_showorigins = Cvar_Get("gl_showorigins", "0", CVAR_CHEAT);
     gl_showtearing = Cvar_Get("gl_showtearing", "0", 0);
@@ -810,6 +1157,7 @@ static void GL_Register(void)
     gl_cull_nodes = Cvar_Get("gl_cull_nodes", "1", 0);
     gl_cull_models = Cvar_Get("gl_cull_models", "1", 0);
     gl_hash_faces = Cvar_Get("gl_hash_faces", "1", 0);
+    gl_cull_cache = Cvar_Get("gl_cull_cache", "1", 0);
     gl_clear = Cvar_Get("gl_clear", "0", 0);
     gl_finish = Cvar_Get("gl_finish", "0", 0);
     gl_novis = Cvar_Get("gl_novis", "0", 0);
@@ -832,11 +1180,15 @@ static void GL_Register(void)
 
     Cmd_AddCommand("strings", GL_Strings_f);
     Cmd_AddMacro("gl_viewcluster", GL_ViewCluster_m);
+
+    GL_InitBench();
 }
 
 static void GL_Unregister(void)
 {
     Cmd_RemoveCommand("strings");
+
+    GL_ShutdownBench();
 }
 
 static qboolean GL_SetupConfig(void)
@@ -886,6 +1238,70 @@ static qboolean GL_SetupConfig(void)
         Com_Printf("GL_EXT_compiled_vertex_array not found\n");
     }
 
+    if (gl_config.ext_supported & QGL_EXT_timer_query) {
+        Com_Printf("...enabling GL_EXT_timer_query\n");
+        gl_config.ext_enabled |= QGL_EXT_timer_query;
+    } else {
+        Com_Printf("GL_EXT_timer_query not found\n");
+    }
+
+    if (gl_config.ext_supported & QGL_EXT_multi_draw_arrays) {
+        Com_Printf("...enabling GL_EXT_multi_draw_arrays\n");
+        gl_config.ext_enabled |= QGL_EXT_multi_draw_arrays;
+    } else {
+        Com_Printf("GL_EXT_multi_draw_arrays not found\n");
+    }
+
+    if ((gl_config.ext_supported & QGL_ARB_texture_compression) &&
+        (gl_config.ext_supported & QGL_EXT_texture_compression_s3tc)) {
+        Com_Printf("...enabling GL_EXT_texture_compression_s3tc\n");
+        gl_config.ext_enabled |= QGL_ARB_texture_compression |
+                                 QGL_EXT_texture_compression_s3tc;
+    } else {
+        Com_Printf("GL_EXT_texture_compression_s3tc not found\n");
+    }
+
+    if (gl_config.ext_supported & QGL_ARB_occlusion_query) {
+        Com_Printf("...enabling GL_ARB_occlusion_query\n");
+        gl_config.ext_enabled |= QGL_ARB_occlusion_query;
+    } else {
+        Com_Printf("GL_ARB_occlusion_query not found\n");
+    }
+
+    if (gl_config.ext_supported & QGL_ARB_texture_cube_map) {
+        Com_Printf("...enabling GL_ARB_texture_cube_map\n");
+        gl_config.ext_enabled |= QGL_ARB_texture_cube_map;
+    } else {
+        Com_Printf("GL_ARB_texture_cube_map not found\n");
+    }
+
+    if (gl_config.ext_supported & QGL_EXT_framebuffer_object) {
+        Com_Printf("...enabling GL_EXT_framebuffer_object\n");
+        gl_config.ext_enabled |= QGL_EXT_framebuffer_object;
+    } else {
+        Com_Printf("GL_EXT_framebuffer_object not found\n");
+    }
+
+    // both are core since OpenGL 2.0
+    if (gl_config.version_major >= 2) {
+        gl_config.ext_supported |= QGL_ARB_texture_non_power_of_two |
+                                   QGL_SGIS_generate_mipmap;
+    }
+
+    if (gl_config.ext_supported & QGL_ARB_texture_non_power_of_two) {
+        Com_Printf("...enabling GL_ARB_texture_non_power_of_two\n");
+        gl_config.ext_enabled |= QGL_ARB_texture_non_power_of_two;
+    } else {
+        Com_Printf("GL_ARB_texture_non_power_of_two not found\n");
+    }
+
+    if (gl_config.ext_supported & QGL_SGIS_generate_mipmap) {
+        Com_Printf("...enabling GL_SGIS_generate_mipmap\n");
+        gl_config.ext_enabled |= QGL_SGIS_generate_mipmap;
+    } else {
+        Com_Printf("GL_SGIS_generate_mipmap not found\n");
+    }
+
     gl_config.numTextureUnits = 1;
     if (gl_config.ext_supported & QGL_ARB_multitexture) {
         qglGetIntegerv(GL_MAX_TEXTURE_UNITS_ARB, &integer);
@@ -990,6 +1406,9 @@ static void GL_PostInit(void)
                 Com_Printf("...enabling GL_ARB_vertex_buffer_object\n");
                 QGL_InitExtensions(QGL_ARB_vertex_buffer_object);
                 gl_config.ext_enabled |= QGL_ARB_vertex_buffer_object;
+                if (gl_config.ext_supported & QGL_ARB_pixel_buffer_object) {
+                    Com_Printf("...enabling GL_ARB_pixel_buffer_object\n");
+                }
             } else {
                 Com_Printf("...ignoring GL_ARB_vertex_buffer_object\n");
             }
@@ -1054,6 +1473,7 @@ qboolean R_Init(qboolean total)
 
     GL_InitPrograms();
     gl_fragment_program->modified = qfalse;
+    gl_vertex_program->modified = qfalse;
 
     GL_InitTables();
     
@@ -1080,7 +1500,10 @@ void R_Shutdown(qboolean total)
     Com_DPrintf("GL_Shutdown( %i )\n", total);
 
     GL_FreeWorld();
+    GL_ShutdownSpans();
     GL_ShutdownImages();
+    GL_ShutdownReadPixels();
+    GL_ShutdownOcclusion();
     MOD_Shutdown();
 
     if (gl_vertex_buffer_object->modified) {
@@ -1093,6 +1516,11 @@ void R_Shutdown(qboolean total)
         return;
     }
 
+    // needs the context for its query objects
+    VCR_Shutdown();
+
+    GL_ShutdownWorldThreads();
+
     GL_ShutdownPrograms();
 
     // shut down OS specific OpenGL stuff like contexts, etc.
@@ -1102,8 +1530,6 @@ void R_Shutdown(qboolean total)
     QGL_Shutdown();
 
     GL_Unregister();
-    
-    VCR_Shutdown();
 
     memset(&gl_static, 0, sizeof(gl_static));
     memset(&gl_config, 0, sizeof(gl_config));
@@ -1124,6 +1550,8 @@ void R_BeginRegistration(const char *name)
     memset(&glr, 0, sizeof(glr));
     glr.viewcluster1 = glr.viewcluster2 = -2;
 
+    IMG_BeginRegistration();
+
     Q_concat(fullname, sizeof(fullname), "maps/", name, ".bsp", NULL);
     GL_LoadWorld(fullname);
 }
@@ -1135,7 +1563,9 @@ R_EndRegistration
 */
 void R_EndRegistration(void)
 {
+    IMG_EndRegistration();
     IMG_FreeUnused();
+    GL_InvalidateSpans();
     MOD_FreeUnused();
     Scrap_Upload();
     gl_static.registering = qfalse;
@@ -18,6 +18,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "gl.h"
 
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#endif
+
 typedef void (*tessfunc_t)(const maliasmesh_t *);
 
 static int      oldframenum;
@@ -39,6 +44,21 @@ static float    celscale;
 
 static GLfloat  shadowmatrix[16];
 
+// planar shadows of all entities are projected into world space on CPU
+// from the lerped vertices, and drawn together by GL_DrawShadows
+#define SHADOW_MAX_VERTS    8192
+#define SHADOW_MAX_INDICES  (6 * SHADOW_MAX_VERTS)
+
+static struct {
+    vec_t       vertices[4 * SHADOW_MAX_VERTS];
+    uint32_t    colors[SHADOW_MAX_VERTS];
+    int         indices[SHADOW_MAX_INDICES];
+    int         numverts;
+    int         numindices;
+} shadows;
+
+static qboolean lerpprog;
+
 static void setup_dotshading(void)
 {
     float cp, cy, sp, sy;
@@ -89,11 +109,69 @@ static inline vec_t *get_static_normal(vec_t *normal, const maliasvert_t *vert)
     return normal;
 }
 
+#if USE_SSE2
+
+// maliasvert_t is 8 bytes, so one vertex loads straight into a register.
+// the normal bytes end up in the 4th lane, which scale vectors zero out.
+static inline __m128 load_pos(const maliasvert_t *vert)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *)vert);
+
+    v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    return _mm_cvtepi32_ps(v);
+}
+
+static inline __m128 load_vec3(const vec_t *v)
+{
+    return _mm_setr_ps(v[0], v[1], v[2], 0);
+}
+
+static inline __m128 load_normal(const maliasvert_t *vert)
+{
+    vec3_t normal;
+
+    return load_vec3(get_static_normal(normal, vert));
+}
+
+static inline __m128 lerp_normal(const maliasvert_t *oldvert,
+                                 const maliasvert_t *newvert,
+                                 __m128 back, __m128 front)
+{
+    __m128 n, d;
+
+    n = _mm_add_ps(_mm_mul_ps(load_normal(oldvert), back),
+                   _mm_mul_ps(load_normal(newvert), front));
+
+    // horizontal sum of squares into every lane
+    d = _mm_mul_ps(n, n);
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    return _mm_div_ps(n, _mm_sqrt_ps(d));
+}
+
+#endif
+
 static void tess_static_shell(const maliasmesh_t *mesh)
 {
     maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
+#if USE_SSE2
+    __m128 scale = load_vec3(newscale);
+    __m128 move = load_vec3(translate);
+    __m128 shell = _mm_set1_ps(shellscale);
+    __m128 pos;
+
+    while (count--) {
+        pos = _mm_add_ps(_mm_mul_ps(load_pos(src_vert), scale), move);
+        pos = _mm_add_ps(_mm_mul_ps(load_normal(src_vert), shell), pos);
+        _mm_storeu_ps(dst_vert, pos);
+        dst_vert += 4;
+
+        src_vert++;
+    }
+#else
     vec3_t normal;
 
     while (count--) {
@@ -109,6 +187,7 @@ static void tess_static_shell(const maliasmesh_t *mesh)
 
         src_vert++;
     }
+#endif
 }
 
 static void tess_static_shade(const maliasmesh_t *mesh)
@@ -118,7 +197,24 @@ static void tess_static_shade(const maliasmesh_t *mesh)
     int count = mesh->numverts;
     vec3_t normal;
     vec_t d;
+#if USE_SSE2
+    __m128 scale = load_vec3(newscale);
+    __m128 move = load_vec3(translate);
+
+    while (count--) {
+        d = shadedot(get_static_normal(normal, src_vert));
+
+        // color overwrites the 4th lane
+        _mm_storeu_ps(dst_vert, _mm_add_ps(_mm_mul_ps(load_pos(src_vert), scale), move));
+        dst_vert[3] = shadelight[0] * d;
+        dst_vert[4] = shadelight[1] * d;
+        dst_vert[5] = shadelight[2] * d;
+        dst_vert[6] = shadelight[3];
+        dst_vert += VERTEX_SIZE;
 
+        src_vert++;
+    }
+#else
     while (count--) {
         d = shadedot(get_static_normal(normal, src_vert));
 
@@ -133,6 +229,7 @@ static void tess_static_shade(const maliasmesh_t *mesh)
 
         src_vert++;
     }
+#endif
 }
 
 static void tess_static_plain(const maliasmesh_t *mesh)
@@ -140,7 +237,17 @@ static void tess_static_plain(const maliasmesh_t *mesh)
     maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
+#if USE_SSE2
+    __m128 scale = load_vec3(newscale);
+    __m128 move = load_vec3(translate);
+
+    while (count--) {
+        _mm_storeu_ps(dst_vert, _mm_add_ps(_mm_mul_ps(load_pos(src_vert), scale), move));
+        dst_vert += 4;
 
+        src_vert++;
+    }
+#else
     while (count--) {
         dst_vert[0] = src_vert->pos[0] * newscale[0] + translate[0];
         dst_vert[1] = src_vert->pos[1] * newscale[1] + translate[1];
@@ -149,8 +256,10 @@ static void tess_static_plain(const maliasmesh_t *mesh)
 
         src_vert++;
     }
+#endif
 }
 
+#if !USE_SSE2
 static inline vec_t *get_lerped_normal(vec_t *normal,
                                        const maliasvert_t *oldvert,
                                        const maliasvert_t *newvert)
@@ -169,6 +278,7 @@ static inline vec_t *get_lerped_normal(vec_t *normal,
 
     return normal;
 }
+#endif
 
 static void tess_lerped_shell(const maliasmesh_t *mesh)
 {
@@ -176,6 +286,28 @@ static void tess_lerped_shell(const maliasmesh_t *mesh)
     maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
+#if USE_SSE2
+    __m128 olds = load_vec3(oldscale);
+    __m128 news = load_vec3(newscale);
+    __m128 move = load_vec3(translate);
+    __m128 back = _mm_set1_ps(backlerp);
+    __m128 front = _mm_set1_ps(frontlerp);
+    __m128 shell = _mm_set1_ps(shellscale);
+    __m128 pos;
+
+    while (count--) {
+        pos = _mm_add_ps(_mm_mul_ps(load_pos(src_oldvert), olds),
+                         _mm_mul_ps(load_pos(src_newvert), news));
+        pos = _mm_add_ps(pos, move);
+        pos = _mm_add_ps(_mm_mul_ps(lerp_normal(src_oldvert, src_newvert,
+                                                back, front), shell), pos);
+        _mm_storeu_ps(dst_vert, pos);
+        dst_vert += 4;
+
+        src_oldvert++;
+        src_newvert++;
+    }
+#else
     vec3_t normal;
 
     while (count--) {
@@ -195,6 +327,7 @@ static void tess_lerped_shell(const maliasmesh_t *mesh)
         src_oldvert++;
         src_newvert++;
     }
+#endif
 }
 
 static void tess_lerped_shade(const maliasmesh_t *mesh)
@@ -203,8 +336,35 @@ static void tess_lerped_shade(const maliasmesh_t *mesh)
     maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
-    vec3_t normal;
     vec_t d;
+#if USE_SSE2
+    __m128 olds = load_vec3(oldscale);
+    __m128 news = load_vec3(newscale);
+    __m128 move = load_vec3(translate);
+    __m128 back = _mm_set1_ps(backlerp);
+    __m128 front = _mm_set1_ps(frontlerp);
+    __m128 pos;
+    vec4_t normal;
+
+    while (count--) {
+        _mm_storeu_ps(normal, lerp_normal(src_oldvert, src_newvert, back, front));
+        d = shadedot(normal);
+
+        // color overwrites the 4th lane
+        pos = _mm_add_ps(_mm_mul_ps(load_pos(src_oldvert), olds),
+                         _mm_mul_ps(load_pos(src_newvert), news));
+        _mm_storeu_ps(dst_vert, _mm_add_ps(pos, move));
+        dst_vert[3] = shadelight[0] * d;
+        dst_vert[4] = shadelight[1] * d;
+        dst_vert[5] = shadelight[2] * d;
+        dst_vert[6] = shadelight[3];
+        dst_vert += VERTEX_SIZE;
+
+        src_oldvert++;
+        src_newvert++;
+    }
+#else
+    vec3_t normal;
 
     while (count--) {
         d = shadedot(get_lerped_normal(normal, src_oldvert, src_newvert));
@@ -227,6 +387,7 @@ static void tess_lerped_shade(const maliasmesh_t *mesh)
         src_oldvert++;
         src_newvert++;
     }
+#endif
 }
 
 static void tess_lerped_plain(const maliasmesh_t *mesh)
@@ -235,7 +396,22 @@ static void tess_lerped_plain(const maliasmesh_t *mesh)
     maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
+#if USE_SSE2
+    __m128 olds = load_vec3(oldscale);
+    __m128 news = load_vec3(newscale);
+    __m128 move = load_vec3(translate);
+    __m128 pos;
 
+    while (count--) {
+        pos = _mm_add_ps(_mm_mul_ps(load_pos(src_oldvert), olds),
+                         _mm_mul_ps(load_pos(src_newvert), news));
+        _mm_storeu_ps(dst_vert, _mm_add_ps(pos, move));
+        dst_vert += 4;
+
+        src_oldvert++;
+        src_newvert++;
+    }
+#else
     while (count--) {
         dst_vert[0] =
             src_oldvert->pos[0] * oldscale[0] +
@@ -251,6 +427,7 @@ static void tess_lerped_plain(const maliasmesh_t *mesh)
         src_oldvert++;
         src_newvert++;
     }
+#endif
 }
 
 static glCullResult_t cull_static_model(model_t *model)
@@ -447,11 +624,62 @@ static void draw_celshading(maliasmesh_t *mesh)
     qglEnable(GL_TEXTURE_2D);
 }
 
-static void setup_shadow(void)
+/*
+=============
+GL_DrawShadows
+
+Draws planar shadows batched since the last call with the view matrix.
+=============
+*/
+void GL_DrawShadows(void)
+{
+    if (!shadows.numindices)
+        return;
+
+    qglLoadMatrixf(glr.viewmatrix);
+
+    // eliminate z-fighting by utilizing stencil buffer, if available
+    if (gl_config.stencilbits) {
+        qglEnable(GL_STENCIL_TEST);
+        qglStencilFunc(GL_EQUAL, 0, 0xff);
+        qglStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    }
+
+    GL_Bits(GLS_BLEND_BLEND);
+    GL_TexEnv(GL_MODULATE);
+    GL_BindTexture(TEXNUM_WHITE);
+
+    qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    qglEnableClientState(GL_COLOR_ARRAY);
+    qglVertexPointer(3, GL_FLOAT, 4 * 4, shadows.vertices);
+    qglColorPointer(4, GL_UNSIGNED_BYTE, 0, shadows.colors);
+
+    qglEnable(GL_POLYGON_OFFSET_FILL);
+    qglPolygonOffset(-1.0f, -2.0f);
+    qglDrawElements(GL_TRIANGLES, shadows.numindices, GL_UNSIGNED_INT,
+                    shadows.indices);
+    qglDisable(GL_POLYGON_OFFSET_FILL);
+
+    qglDisableClientState(GL_COLOR_ARRAY);
+    qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    // once we have drawn something to stencil buffer, continue to clear it for
+    // the lifetime of OpenGL context. leaving stencil buffer "dirty" and
+    // clearing just depth is slower (verified for Nvidia and ATI drivers).
+    if (gl_config.stencilbits) {
+        qglDisable(GL_STENCIL_TEST);
+        gl_static.stencil_buffer_bit |= GL_STENCIL_BUFFER_BIT;
+    }
+
+    shadows.numverts = shadows.numindices = 0;
+}
+
+static void setup_shadow(const model_t *model)
 {
     GLfloat matrix[16], tmp[16];
     cplane_t *plane;
     vec3_t dir;
+    int i, numverts, numindices;
 
     shadowmatrix[15] = 0;
 
@@ -493,7 +721,22 @@ static void setup_shadow(void)
     matrix[11] = 0;
     matrix[15] = DotProduct(plane->normal, dir);
 
-    GL_MultMatrix(tmp, glr.viewmatrix, matrix);
+    if (matrix[15] < 0.1f)
+        return;
+
+    // make room for the whole model, called before its arrays are set up
+    numverts = numindices = 0;
+    for (i = 0; i < model->nummeshes; i++) {
+        numverts += model->meshes[i].numverts;
+        numindices += model->meshes[i].numindices;
+    }
+    if (numverts > SHADOW_MAX_VERTS || numindices > SHADOW_MAX_INDICES)
+        return;
+    if (shadows.numverts + numverts > SHADOW_MAX_VERTS ||
+        shadows.numindices + numindices > SHADOW_MAX_INDICES)
+        GL_DrawShadows();
+
+    memcpy(tmp, matrix, sizeof(tmp));
 
     // rotate for entity
     matrix[0] = glr.entaxis[0][0];
@@ -519,51 +762,47 @@ static void setup_shadow(void)
     GL_MultMatrix(shadowmatrix, tmp, matrix);
 }
 
-static void draw_shadow(maliasmesh_t *mesh)
+// projects the mesh just tessellated onto ground plane, matrix has constant
+// w, since projection is along a fixed direction
+static void add_shadow(const maliasmesh_t *mesh)
 {
+    const GLfloat *m = shadowmatrix;
+    const vec_t *src_vert = tess.vertices;
+    vec_t *dst_vert;
+    uint32_t *dst_color;
+    int *dst_indices;
+    int i, stride;
+    color_t shade;
+    vec_t w;
+
     if (shadowmatrix[15] < 0.1f)
         return;
 
-    // load shadow projection matrix
-    qglLoadMatrixf(shadowmatrix);
-
-    // eliminate z-fighting by utilizing stencil buffer, if available
-    if (gl_config.stencilbits) {
-        qglEnable(GL_STENCIL_TEST);
-        qglStencilFunc(GL_EQUAL, 0, 0xff);
-        qglStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    stride = shadelight ? VERTEX_SIZE : 4;
+    w = 1 / m[15];
+
+    shade.u8[0] = shade.u8[1] = shade.u8[2] = 0;
+    shade.u8[3] = color[3] * 0.5f * 255;
+
+    dst_vert = shadows.vertices + shadows.numverts * 4;
+    dst_color = shadows.colors + shadows.numverts;
+    for (i = 0; i < mesh->numverts; i++, src_vert += stride, dst_vert += 4) {
+        dst_vert[0] = (m[0] * src_vert[0] + m[4] * src_vert[1] +
+                       m[8] * src_vert[2] + m[12]) * w;
+        dst_vert[1] = (m[1] * src_vert[0] + m[5] * src_vert[1] +
+                       m[9] * src_vert[2] + m[13]) * w;
+        dst_vert[2] = (m[2] * src_vert[0] + m[6] * src_vert[1] +
+                       m[10] * src_vert[2] + m[14]) * w;
+        *dst_color++ = shade.u32;
     }
 
-    GL_Bits(GLS_BLEND_BLEND);
-    GL_TexEnv(GL_MODULATE);
-    GL_BindTexture(TEXNUM_WHITE);
-
-    qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    if (shadelight)
-        qglDisableClientState(GL_COLOR_ARRAY);
-
-    qglEnable(GL_POLYGON_OFFSET_FILL);
-    qglPolygonOffset(-1.0f, -2.0f);
-    qglColor4f(0, 0, 0, color[3] * 0.5f);
-    qglDrawElements(GL_TRIANGLES, mesh->numindices, GL_UNSIGNED_INT,
-                    mesh->indices);
-    qglColor4fv(color);
-    qglDisable(GL_POLYGON_OFFSET_FILL);
-
-    if (shadelight)
-        qglEnableClientState(GL_COLOR_ARRAY);
-    qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
-
-    // once we have drawn something to stencil buffer, continue to clear it for
-    // the lifetime of OpenGL context. leaving stencil buffer "dirty" and
-    // clearing just depth is slower (verified for Nvidia and ATI drivers).
-    if (gl_config.stencilbits) {
-        qglDisable(GL_STENCIL_TEST);
-        gl_static.stencil_buffer_bit |= GL_STENCIL_BUFFER_BIT;
+    dst_indices = shadows.indices + shadows.numindices;
+    for (i = 0; i < mesh->numindices; i++) {
+        dst_indices[i] = shadows.numverts + mesh->indices[i];
     }
 
-    // fall back to entity matrix
-    qglLoadMatrixf(glr.entmatrix);
+    shadows.numverts += mesh->numverts;
+    shadows.numindices += mesh->numindices;
 }
 
 static int texnum_for_mesh(maliasmesh_t *mesh)
@@ -590,6 +829,98 @@ static int texnum_for_mesh(maliasmesh_t *mesh)
     return mesh->skins[ent->skinnum]->texnum;
 }
 
+// celshading, shadows and outlines redraw the CPU tessellated vertices
+static qboolean use_lerp_program(const model_t *model)
+{
+    int i;
+
+    if (!gl_static.prognum_lerp)
+        return qfalse;
+
+    if (gl_showtris->integer)
+        return qfalse;
+
+    if (celscale >= 0.01f && celscale <= 1)
+        return qfalse;
+
+    if (shadowmatrix[15] >= 0.1f)
+        return qfalse;
+
+    for (i = 0; i < model->nummeshes; i++)
+        if (!model->meshes[i].bufnum)
+            return qfalse;
+
+    return qtrue;
+}
+
+static void setup_lerp_program(void)
+{
+    vec4_t param;
+
+    qglEnable(GL_VERTEX_PROGRAM_ARB);
+    qglBindProgramARB(GL_VERTEX_PROGRAM_ARB, gl_static.prognum_lerp);
+
+    // static case has full scale in newscale only
+    if (newframenum == oldframenum)
+        VectorClear(param);
+    else
+        VectorCopy(oldscale, param);
+    param[3] = 0;
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 0, param);
+
+    VectorCopy(newscale, param);
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 1, param);
+
+    VectorCopy(translate, param);
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 2, param);
+
+    if (shadelight)
+        VectorCopy(shadedir, param);
+    else
+        VectorClear(param);
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 3, param);
+
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 4, color);
+
+    param[0] = backlerp;
+    param[1] = frontlerp;
+    param[2] = (glr.ent->flags & RF_SHELL_MASK) ? shellscale : 0;
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 5, param);
+
+    qglEnableClientState(GL_NORMAL_ARRAY);
+    qglEnableVertexAttribArrayARB(6);
+    qglEnableVertexAttribArrayARB(7);
+}
+
+static void shutdown_lerp_program(void)
+{
+    qglDisableVertexAttribArrayARB(7);
+    qglDisableVertexAttribArrayARB(6);
+    qglDisableClientState(GL_NORMAL_ARRAY);
+
+    qglBindProgramARB(GL_VERTEX_PROGRAM_ARB, 0);
+    qglDisable(GL_VERTEX_PROGRAM_ARB);
+}
+
+static void bind_mesh_frames(const maliasmesh_t *mesh)
+{
+    size_t size = mesh->numverts * sizeof(maliasbufvert_t);
+    size_t newofs = newframenum * size;
+    size_t oldofs = oldframenum * size;
+    size_t normofs = q_offsetof(maliasbufvert_t, norm);
+
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->bufnum);
+    qglVertexPointer(3, GL_SHORT, sizeof(maliasbufvert_t),
+                     (GLvoid *)newofs);
+    qglNormalPointer(GL_BYTE, sizeof(maliasbufvert_t),
+                     (GLvoid *)(newofs + normofs));
+    qglVertexAttribPointerARB(6, 3, GL_SHORT, GL_FALSE,
+                              sizeof(maliasbufvert_t), (GLvoid *)oldofs);
+    qglVertexAttribPointerARB(7, 3, GL_BYTE, GL_TRUE,
+                              sizeof(maliasbufvert_t), (GLvoid *)(oldofs + normofs));
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
 static void draw_alias_mesh(maliasmesh_t *mesh)
 {
     if (glr.ent->flags & RF_TRANSLUCENT)
@@ -600,11 +931,19 @@ static void draw_alias_mesh(maliasmesh_t *mesh)
     GL_TexEnv(GL_MODULATE);
     GL_BindTexture(texnum_for_mesh(mesh));
 
+    qglTexCoordPointer(2, GL_FLOAT, 0, mesh->tcoords);
+
+    if (lerpprog) {
+        bind_mesh_frames(mesh);
+        c.trisDrawn += mesh->numverts;
+        qglDrawElements(GL_TRIANGLES, mesh->numindices, GL_UNSIGNED_INT,
+                        mesh->indices);
+        return;
+    }
+
     (*tessfunc)(mesh);
     c.trisDrawn += mesh->numverts;
 
-    qglTexCoordPointer(2, GL_FLOAT, 0, mesh->tcoords);
-
     if (qglLockArraysEXT)
         qglLockArraysEXT(0, mesh->numverts);
 
@@ -620,8 +959,7 @@ static void draw_alias_mesh(maliasmesh_t *mesh)
         GL_DisableOutlines();
     }
 
-    // FIXME: unlock arrays before changing matrix?
-    draw_shadow(mesh);
+    add_shadow(mesh);
 
     if (qglUnlockArraysEXT)
         qglUnlockArraysEXT();
@@ -667,11 +1005,21 @@ void GL_DrawAliasModel(model_t *model)
     if (cull == CULL_OUT)
         return;
 
+    if (gl_occlusion->integer) {
+        maliasframe_t *newframe = &model->frames[newframenum];
+        maliasframe_t *oldframe = &model->frames[oldframenum];
+        vec3_t bounds[2];
+
+        UnionBounds(newframe->bounds, oldframe->bounds, bounds);
+        if (GL_OccludeEntity(origin, bounds, max(newframe->radius, oldframe->radius)))
+            return;
+    }
+
     // setup parameters common for all meshes
     setup_color();
     setup_celshading();
     setup_dotshading();
-    setup_shadow();
+    setup_shadow(model);
 
     // select proper tessfunc
     if (ent->flags & RF_SHELL_MASK) {
@@ -701,7 +1049,11 @@ void GL_DrawAliasModel(model_t *model)
     if (ent->flags & RF_DEPTHHACK)
         qglDepthRange(0, 0.25f);
 
-    if (shadelight) {
+    lerpprog = use_lerp_program(model);
+
+    if (lerpprog) {
+        setup_lerp_program();
+    } else if (shadelight) {
         qglVertexPointer(3, GL_FLOAT, 4 * VERTEX_SIZE, tess.vertices);
         qglColorPointer(4, GL_FLOAT, 4 * VERTEX_SIZE, tess.vertices + 3);
         qglEnableClientState(GL_COLOR_ARRAY);
@@ -715,7 +1067,9 @@ void GL_DrawAliasModel(model_t *model)
     for (mesh = model->meshes; mesh != last; mesh++)
         draw_alias_mesh(mesh);
 
-    if (shadelight)
+    if (lerpprog)
+        shutdown_lerp_program();
+    else if (shadelight)
         qglDisableClientState(GL_COLOR_ARRAY);
 
     if (ent->flags & RF_DEPTHHACK)
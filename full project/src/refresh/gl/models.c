@@ -17,10 +17,351 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "common/mdfour.h"
 #include "format/md2.h"
 #include "format/md3.h"
 #include "format/sp2.h"
 
+// uploads all frames once so that vertex program can blend them
+static void MOD_LoadBuffers(model_t *model)
+{
+    qboolean enabled = gl_vertex_program->integer && qglBindBufferARB &&
+        (gl_config.ext_supported & QGL_ARB_vertex_program);
+    maliasmesh_t *mesh;
+    maliasvert_t *src;
+    maliasbufvert_t *data, *dst;
+    unsigned lat, lng;
+    size_t size;
+    int i, count;
+
+    for (i = 0, mesh = model->meshes; i < model->nummeshes; i++, mesh++) {
+        mesh->bufnum = 0;
+        if (!enabled) {
+            continue;
+        }
+
+        count = mesh->numverts * model->numframes;
+        size = count * sizeof(*data);
+        data = FS_AllocTempMem(size);
+
+        for (src = mesh->verts, dst = data; count; count--, src++, dst++) {
+            lat = src->norm[0];
+            lng = src->norm[1];
+            dst->pos[0] = src->pos[0];
+            dst->pos[1] = src->pos[1];
+            dst->pos[2] = src->pos[2];
+            dst->pos[3] = 0;
+            dst->norm[0] = TAB_SIN(lat) * TAB_COS(lng) * 127;
+            dst->norm[1] = TAB_SIN(lat) * TAB_SIN(lng) * 127;
+            dst->norm[2] = TAB_COS(lat) * 127;
+            dst->norm[3] = 0;
+        }
+
+        GL_ClearErrors();
+        qglGenBuffersARB(1, &mesh->bufnum);
+        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->bufnum);
+        qglBufferDataARB(GL_ARRAY_BUFFER_ARB, size, data, GL_STATIC_DRAW_ARB);
+        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+        // fall back to lerping on the CPU
+        if (GL_ShowErrors("Failed to upload alias model frames")) {
+            qglDeleteBuffersARB(1, &mesh->bufnum);
+            mesh->bufnum = 0;
+        }
+
+        FS_FreeTempMem(data);
+    }
+}
+
+/*
+=========================================================
+
+MODEL CACHE
+
+Alias models converted into meshes are stored in modelcache/ under the
+game directory, as a blob laid out as it is kept in the model hunk. A
+cache file is valid as long as the source file and converter version
+stay the same. It is only meant for this machine, so everything is in
+native byte order.
+
+=========================================================
+*/
+
+#define MODCACHE_IDENT      (('C' << 24) + ('D' << 16) + ('O' << 8) + 'M')
+#define MODCACHE_VERSION    1
+
+#define MODCACHE_MAX_SKINS  (MD3_MAX_MESHES * MAX_ALIAS_SKINS)
+
+// catches in-memory layout differences between builds
+#define MODCACHE_LAYOUT \
+    (sizeof(maliasframe_t) | (sizeof(maliasvert_t) << 8) | (sizeof(maliastc_t) << 16))
+
+typedef struct {
+    uint32_t    ident;
+    uint32_t    version;
+    uint32_t    rawlen, checksum;   // of source file
+    uint32_t    layout;
+    uint32_t    numframes, nummeshes, numskins;
+    uint32_t    datasize;           // frames, then arrays of each mesh
+} modcache_t;
+
+typedef struct {
+    uint32_t    numverts, numtris, numindices, numskins;
+} modcachemesh_t;
+
+// skin names collected by the loaders for MOD_SaveCache
+static struct {
+    qboolean    enabled;
+    uint32_t    checksum;
+    int         numskins;
+    char        skins[MODCACHE_MAX_SKINS][MAX_QPATH];
+} modcache;
+
+static qboolean MOD_CachePath(char *buffer, const model_t *model)
+{
+    size_t len;
+
+    len = Q_concat(buffer, MAX_QPATH, "modelcache/", model->name, ".mdc", NULL);
+    return len < MAX_QPATH;
+}
+
+static size_t MOD_MeshDataSize(const modcachemesh_t *m, int numframes)
+{
+    return sizeof(uint32_t) * m->numindices +
+        sizeof(maliasvert_t) * m->numverts * numframes +
+        sizeof(maliastc_t) * m->numverts;
+}
+
+static qboolean MOD_ReadCache(model_t *model, qhandle_t f, const modcache_t *mc)
+{
+    modcachemesh_t meshes[MD3_MAX_MESHES], *m;
+    maliasmesh_t *mesh;
+    char (*skins)[MAX_QPATH];
+    size_t size, total;
+    byte *data;
+    int i, j, skin;
+
+    if (FS_Read(meshes, sizeof(meshes[0]) * mc->nummeshes, f) !=
+        sizeof(meshes[0]) * mc->nummeshes) {
+        return qfalse;
+    }
+
+    total = sizeof(maliasframe_t) * mc->numframes;
+    skin = 0;
+    for (i = 0, m = meshes; i < mc->nummeshes; i++, m++) {
+        if (m->numverts < 1 || m->numverts > TESS_MAX_VERTICES)
+            return qfalse;
+        if (m->numtris < 1 || m->numindices != m->numtris * 3 ||
+            m->numindices > TESS_MAX_INDICES)
+            return qfalse;
+        if (m->numskins > MAX_ALIAS_SKINS)
+            return qfalse;
+        total += MOD_MeshDataSize(m, mc->numframes);
+        skin += m->numskins;
+    }
+    if (total != mc->datasize || skin != mc->numskins)
+        return qfalse;
+
+    size = sizeof(skins[0]) * mc->numskins;
+    skins = FS_AllocTempMem(size + 1);
+    if (FS_Read(skins, size, f) != size) {
+        FS_FreeTempMem(skins);
+        return qfalse;
+    }
+
+    // everything else is read straight into the hunk
+    Hunk_Begin(&model->hunk, sizeof(*mesh) * mc->nummeshes + mc->datasize + 128);
+    model->meshes = MOD_Malloc(sizeof(*mesh) * mc->nummeshes);
+    data = MOD_Malloc(mc->datasize);
+    if (FS_Read(data, mc->datasize, f) != mc->datasize) {
+        Hunk_Free(&model->hunk);
+        FS_FreeTempMem(skins);
+        return qfalse;
+    }
+
+    model->type = MOD_ALIAS;
+    model->numframes = mc->numframes;
+    model->nummeshes = mc->nummeshes;
+    model->frames = (maliasframe_t *)data;
+    data += sizeof(maliasframe_t) * mc->numframes;
+
+    skin = 0;
+    for (i = 0, m = meshes, mesh = model->meshes; i < mc->nummeshes; i++, m++, mesh++) {
+        mesh->numverts = m->numverts;
+        mesh->numtris = m->numtris;
+        mesh->numindices = m->numindices;
+        mesh->indices = (uint32_t *)data;
+        data += sizeof(uint32_t) * m->numindices;
+        mesh->verts = (maliasvert_t *)data;
+        data += sizeof(maliasvert_t) * m->numverts * mc->numframes;
+        mesh->tcoords = (maliastc_t *)data;
+        data += sizeof(maliastc_t) * m->numverts;
+
+        for (j = 0; j < m->numindices; j++) {
+            if (mesh->indices[j] >= m->numverts) {
+                Hunk_Free(&model->hunk);
+                FS_FreeTempMem(skins);
+                return qfalse;
+            }
+        }
+
+        for (j = 0; j < m->numskins; j++, skin++) {
+            skins[skin][MAX_QPATH - 1] = 0;
+            mesh->skins[j] = IMG_Find(skins[skin], IT_SKIN);
+        }
+        mesh->numskins = m->numskins;
+    }
+
+    FS_FreeTempMem(skins);
+
+    MOD_LoadBuffers(model);
+
+    Hunk_End(&model->hunk);
+    return qtrue;
+}
+
+/*
+================
+MOD_LoadCache
+
+Called by the loaders once the source header checks out. Returns true if
+the model was loaded from cache, otherwise prepares for MOD_SaveCache.
+================
+*/
+static qboolean MOD_LoadCache(model_t *model, const void *rawdata, size_t length)
+{
+    char path[MAX_QPATH];
+    modcache_t mc;
+    qhandle_t f;
+    ssize_t len;
+    qboolean ret;
+
+    modcache.enabled = qfalse;
+    modcache.numskins = 0;
+
+    if (!gl_model_cache->integer)
+        return qfalse;
+
+    if (!MOD_CachePath(path, model))
+        return qfalse;
+
+    modcache.enabled = qtrue;
+    modcache.checksum = Com_BlockChecksum((void *)rawdata, length);
+
+    len = FS_FOpenFile(path, &f, FS_MODE_READ);
+    if (!f)
+        return qfalse;
+
+    ret = qfalse;
+    if (len < sizeof(mc) || FS_Read(&mc, sizeof(mc), f) != sizeof(mc))
+        goto done;
+
+    if (mc.ident != MODCACHE_IDENT ||
+        mc.version != MODCACHE_VERSION ||
+        mc.layout != MODCACHE_LAYOUT ||
+        mc.rawlen != length ||
+        mc.checksum != modcache.checksum)
+        goto done;
+
+    if (mc.numframes < 1 || mc.numframes > max(MD2_MAX_FRAMES, MD3_MAX_FRAMES) ||
+        mc.nummeshes < 1 || mc.nummeshes > MD3_MAX_MESHES ||
+        mc.numskins > MODCACHE_MAX_SKINS)
+        goto done;
+
+    if (len != sizeof(mc) + sizeof(modcachemesh_t) * mc.nummeshes +
+        MAX_QPATH * mc.numskins + mc.datasize)
+        goto done;
+
+    ret = MOD_ReadCache(model, f, &mc);
+
+done:
+    if (!ret)
+        Com_DPrintf("%s: %s is stale\n", __func__, path);
+    FS_FCloseFile(f);
+    return ret;
+}
+
+static void MOD_CacheSkin(const char *name)
+{
+    if (modcache.enabled && modcache.numskins < MODCACHE_MAX_SKINS)
+        Q_strlcpy(modcache.skins[modcache.numskins++], name, MAX_QPATH);
+}
+
+static void MOD_SaveCache(const model_t *model, size_t length)
+{
+    char path[MAX_QPATH];
+    modcache_t *mc;
+    modcachemesh_t *m;
+    maliasmesh_t *mesh;
+    size_t size, len;
+    byte *data;
+    int i, skins;
+    qerror_t ret;
+
+    if (!modcache.enabled)
+        return;
+
+    if (!MOD_CachePath(path, model))
+        return;
+
+    skins = 0;
+    size = sizeof(maliasframe_t) * model->numframes;
+    for (i = 0, mesh = model->meshes; i < model->nummeshes; i++, mesh++) {
+        size += sizeof(uint32_t) * mesh->numindices +
+            sizeof(maliasvert_t) * mesh->numverts * model->numframes +
+            sizeof(maliastc_t) * mesh->numverts;
+        skins += mesh->numskins;
+    }
+    if (skins != modcache.numskins)
+        return;
+
+    len = sizeof(*mc) + sizeof(*m) * model->nummeshes + MAX_QPATH * skins + size;
+    mc = FS_AllocTempMem(len);
+    mc->ident = MODCACHE_IDENT;
+    mc->version = MODCACHE_VERSION;
+    mc->rawlen = length;
+    mc->checksum = modcache.checksum;
+    mc->layout = MODCACHE_LAYOUT;
+    mc->numframes = model->numframes;
+    mc->nummeshes = model->nummeshes;
+    mc->numskins = skins;
+    mc->datasize = size;
+
+    m = (modcachemesh_t *)(mc + 1);
+    for (i = 0, mesh = model->meshes; i < model->nummeshes; i++, mesh++, m++) {
+        m->numverts = mesh->numverts;
+        m->numtris = mesh->numtris;
+        m->numindices = mesh->numindices;
+        m->numskins = mesh->numskins;
+    }
+
+    data = (byte *)m;
+    memcpy(data, modcache.skins, MAX_QPATH * skins);
+    data += MAX_QPATH * skins;
+
+    memcpy(data, model->frames, sizeof(maliasframe_t) * model->numframes);
+    data += sizeof(maliasframe_t) * model->numframes;
+
+    for (i = 0, mesh = model->meshes; i < model->nummeshes; i++, mesh++) {
+        size = sizeof(uint32_t) * mesh->numindices;
+        memcpy(data, mesh->indices, size);
+        data += size;
+        size = sizeof(maliasvert_t) * mesh->numverts * model->numframes;
+        memcpy(data, mesh->verts, size);
+        data += size;
+        size = sizeof(maliastc_t) * mesh->numverts;
+        memcpy(data, mesh->tcoords, size);
+        data += size;
+    }
+
+    ret = FS_WriteFile(path, mc, len);
+    if (ret < 0) {
+        Com_DPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+    }
+
+    FS_FreeTempMem(mc);
+}
+
 qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length)
 {
     dmd2header_t header;
@@ -66,6 +407,10 @@ qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length)
         return ret;
     }
 
+    if (MOD_LoadCache(model, rawdata, length)) {
+        return Q_ERR_SUCCESS;
+    }
+
     Hunk_Begin(&model->hunk, 0x400000);
     model->type = MOD_ALIAS;
 
@@ -137,6 +482,7 @@ qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length)
         }
         FS_NormalizePath(skinname, skinname);
         dst_mesh->skins[i] = IMG_Find(skinname, IT_SKIN);
+        MOD_CacheSkin(skinname);
         src_skin += MD2_MAX_SKINNAME;
     }
     dst_mesh->numskins = header.num_skins;
@@ -206,6 +552,9 @@ qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length)
         dst_frame++;
     }
 
+    MOD_SaveCache(model, length);
+    MOD_LoadBuffers(model);
+
     Hunk_End(&model->hunk);
     return Q_ERR_SUCCESS;
 
@@ -260,6 +609,9 @@ qerror_t MOD_LoadMD3(model_t *model, const void *rawdata, size_t length)
     if (header.num_meshes > MD3_MAX_MESHES)
         return Q_ERR_TOO_MANY;
 
+    if (MOD_LoadCache(model, rawdata, length))
+        return Q_ERR_SUCCESS;
+
     Hunk_Begin(&model->hunk, 0x400000);
     model->type = MOD_ALIAS;
     model->numframes = header.num_frames;
@@ -342,6 +694,7 @@ qerror_t MOD_LoadMD3(model_t *model, const void *rawdata, size_t length)
             }
             FS_NormalizePath(skinname, skinname);
             dst_mesh->skins[j] = IMG_Find(skinname, IT_SKIN);
+            MOD_CacheSkin(skinname);
         }
         dst_mesh->numskins = numskins;
 
@@ -403,6 +756,9 @@ qerror_t MOD_LoadMD3(model_t *model, const void *rawdata, size_t length)
         dst_mesh++;
     }
 
+    MOD_SaveCache(model, length);
+    MOD_LoadBuffers(model);
+
     Hunk_End(&model->hunk);
     return Q_ERR_SUCCESS;
 
@@ -412,6 +768,23 @@ fail:
 }
 #endif
 
+void MOD_FreeBuffers(model_t *model)
+{
+    maliasmesh_t *mesh;
+    int i;
+
+    if (model->type != MOD_ALIAS || !qglDeleteBuffersARB) {
+        return;
+    }
+
+    for (i = 0, mesh = model->meshes; i < model->nummeshes; i++, mesh++) {
+        if (mesh->bufnum) {
+            qglDeleteBuffersARB(1, &mesh->bufnum);
+            mesh->bufnum = 0;
+        }
+    }
+}
+
 void MOD_Reference(model_t *model)
 {
     int i, j;
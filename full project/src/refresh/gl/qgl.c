@@ -29,6 +29,11 @@ QGL_ARB_fragment_program_IMP
 QGL_ARB_multitexture_IMP
 QGL_ARB_vertex_buffer_object_IMP
 QGL_EXT_compiled_vertex_array_IMP
+QGL_EXT_timer_query_IMP
+QGL_EXT_multi_draw_arrays_IMP
+QGL_ARB_vertex_program_IMP
+QGL_ARB_texture_compression_IMP
+QGL_EXT_framebuffer_object_IMP
 #undef QGL
 
 // ==========================================================
@@ -43,6 +48,11 @@ QGL_ARB_fragment_program_IMP
 QGL_ARB_multitexture_IMP
 QGL_ARB_vertex_buffer_object_IMP
 QGL_EXT_compiled_vertex_array_IMP
+QGL_EXT_timer_query_IMP
+QGL_EXT_multi_draw_arrays_IMP
+QGL_ARB_vertex_program_IMP
+QGL_ARB_texture_compression_IMP
+QGL_EXT_framebuffer_object_IMP
 #undef QGL
 
 #define SIG(x) fprintf(log_fp, "%s\n", x)
@@ -258,6 +268,12 @@ static const GLubyte * APIENTRY logGetString(GLenum name)
     return dllGetString(name);
 }
 
+static void APIENTRY logGetTexImage(GLenum target, GLint level, GLenum format, GLenum type, GLvoid *pixels)
+{
+    SIG("glGetTexImage");
+    dllGetTexImage(target, level, format, type, pixels);
+}
+
 static void APIENTRY logHint(GLenum target, GLenum mode)
 {
     SIGf("%s( %#x, %#x )\n", "glHint", target, mode);
@@ -556,6 +572,11 @@ void QGL_Shutdown(void)
     QGL_ARB_multitexture_IMP
     QGL_ARB_vertex_buffer_object_IMP
     QGL_EXT_compiled_vertex_array_IMP
+    QGL_EXT_timer_query_IMP
+    QGL_EXT_multi_draw_arrays_IMP
+    QGL_ARB_vertex_program_IMP
+    QGL_ARB_texture_compression_IMP
+    QGL_EXT_framebuffer_object_IMP
 }
 
 void QGL_ShutdownExtensions(unsigned mask)
@@ -575,6 +596,26 @@ void QGL_ShutdownExtensions(unsigned mask)
     if (mask & QGL_EXT_compiled_vertex_array) {
         QGL_EXT_compiled_vertex_array_IMP
     }
+
+    if (mask & (QGL_EXT_timer_query | QGL_ARB_occlusion_query)) {
+        QGL_EXT_timer_query_IMP
+    }
+
+    if (mask & QGL_EXT_multi_draw_arrays) {
+        QGL_EXT_multi_draw_arrays_IMP
+    }
+
+    if (mask & QGL_ARB_vertex_program) {
+        QGL_ARB_vertex_program_IMP
+    }
+
+    if (mask & QGL_ARB_texture_compression) {
+        QGL_ARB_texture_compression_IMP
+    }
+
+    if (mask & QGL_EXT_framebuffer_object) {
+        QGL_EXT_framebuffer_object_IMP
+    }
 #undef QGL
 }
 
@@ -614,6 +655,26 @@ void QGL_InitExtensions(unsigned mask)
     if (mask & QGL_EXT_compiled_vertex_array) {
         QGL_EXT_compiled_vertex_array_IMP
     }
+
+    if (mask & (QGL_EXT_timer_query | QGL_ARB_occlusion_query)) {
+        QGL_EXT_timer_query_IMP
+    }
+
+    if (mask & QGL_EXT_multi_draw_arrays) {
+        QGL_EXT_multi_draw_arrays_IMP
+    }
+
+    if (mask & QGL_ARB_vertex_program) {
+        QGL_ARB_vertex_program_IMP
+    }
+
+    if (mask & QGL_ARB_texture_compression) {
+        QGL_ARB_texture_compression_IMP
+    }
+
+    if (mask & QGL_EXT_framebuffer_object) {
+        QGL_EXT_framebuffer_object_IMP
+    }
 #undef QGL
 }
 
@@ -626,6 +687,18 @@ unsigned QGL_ParseExtensionString(const char *s)
         "GL_ARB_vertex_buffer_object",
         "GL_EXT_compiled_vertex_array",
         "GL_EXT_texture_filter_anisotropic",
+        "GL_EXT_timer_query",
+        "GL_ARB_pixel_buffer_object",
+        "GL_EXT_multi_draw_arrays",
+        "GL_ARB_vertex_program",
+        "GL_ARB_texture_compression",
+        "GL_EXT_texture_compression_s3tc",
+        "GL_ARB_point_sprite",
+        "GL_ARB_texture_cube_map",
+        "GL_ARB_occlusion_query",
+        "GL_ARB_texture_non_power_of_two",
+        "GL_SGIS_generate_mipmap",
+        "GL_EXT_framebuffer_object",
         NULL
     };
 
@@ -675,6 +748,21 @@ void QGL_EnableLogging(unsigned mask)
     if (mask & QGL_EXT_compiled_vertex_array) {
         QGL_EXT_compiled_vertex_array_IMP
     }
+
+    if (mask & (QGL_EXT_timer_query | QGL_ARB_occlusion_query)) {
+    }
+
+    if (mask & QGL_EXT_multi_draw_arrays) {
+    }
+
+    if (mask & QGL_ARB_vertex_program) {
+    }
+
+    if (mask & QGL_ARB_texture_compression) {
+    }
+
+    if (mask & QGL_EXT_framebuffer_object) {
+    }
 #undef QGL
 }
 
@@ -703,6 +791,26 @@ void QGL_DisableLogging(unsigned mask)
     if (mask & QGL_EXT_compiled_vertex_array) {
         QGL_EXT_compiled_vertex_array_IMP
     }
+
+    if (mask & (QGL_EXT_timer_query | QGL_ARB_occlusion_query)) {
+        QGL_EXT_timer_query_IMP
+    }
+
+    if (mask & QGL_EXT_multi_draw_arrays) {
+        QGL_EXT_multi_draw_arrays_IMP
+    }
+
+    if (mask & QGL_ARB_vertex_program) {
+        QGL_ARB_vertex_program_IMP
+    }
+
+    if (mask & QGL_ARB_texture_compression) {
+        QGL_ARB_texture_compression_IMP
+    }
+
+    if (mask & QGL_EXT_framebuffer_object) {
+        QGL_EXT_framebuffer_object_IMP
+    }
 #undef QGL
 }
 
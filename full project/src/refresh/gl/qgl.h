@@ -72,6 +72,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
     QGL(GetFloatv); \
     QGL(GetIntegerv); \
     QGL(GetString); \
+    QGL(GetTexImage); \
     QGL(Hint); \
     QGL(IsEnabled); \
     QGL(IsTexture); \
@@ -154,11 +155,56 @@ with this program; if not, write to the Free Software Foundation, Inc.,
     QGL(LockArraysEXT); \
     QGL(UnlockArraysEXT);
 
+// GL_EXT_timer_query (query objects from GL_ARB_occlusion_query)
+#define QGL_EXT_timer_query_IMP \
+    QGL(GenQueriesARB); \
+    QGL(DeleteQueriesARB); \
+    QGL(BeginQueryARB); \
+    QGL(EndQueryARB); \
+    QGL(GetQueryObjectivARB); \
+    QGL(GetQueryObjectui64vEXT);
+
+// GL_EXT_multi_draw_arrays
+#define QGL_EXT_multi_draw_arrays_IMP \
+    QGL(MultiDrawElementsEXT);
+
+// GL_ARB_vertex_program (program object functions are shared with
+// GL_ARB_fragment_program)
+#define QGL_ARB_vertex_program_IMP \
+    QGL(VertexAttribPointerARB); \
+    QGL(EnableVertexAttribArrayARB); \
+    QGL(DisableVertexAttribArrayARB);
+
+// GL_ARB_texture_compression
+#define QGL_ARB_texture_compression_IMP \
+    QGL(CompressedTexImage2DARB); \
+    QGL(GetCompressedTexImageARB);
+
+// GL_EXT_framebuffer_object
+#define QGL_EXT_framebuffer_object_IMP \
+    QGL(GenFramebuffersEXT); \
+    QGL(DeleteFramebuffersEXT); \
+    QGL(BindFramebufferEXT); \
+    QGL(FramebufferTexture2DEXT); \
+    QGL(CheckFramebufferStatusEXT);
+
 #define QGL_ARB_fragment_program            (1 << 0)
 #define QGL_ARB_multitexture                (1 << 1)
 #define QGL_ARB_vertex_buffer_object        (1 << 2)
 #define QGL_EXT_compiled_vertex_array       (1 << 3)
 #define QGL_EXT_texture_filter_anisotropic  (1 << 4)
+#define QGL_EXT_timer_query                 (1 << 5)
+#define QGL_ARB_pixel_buffer_object         (1 << 6)   // uses buffer object functions
+#define QGL_EXT_multi_draw_arrays           (1 << 7)
+#define QGL_ARB_vertex_program              (1 << 8)
+#define QGL_ARB_texture_compression         (1 << 9)
+#define QGL_EXT_texture_compression_s3tc    (1 << 10)  // no functions
+#define QGL_ARB_point_sprite                (1 << 11)  // no functions
+#define QGL_ARB_texture_cube_map            (1 << 12)  // no functions
+#define QGL_ARB_occlusion_query             (1 << 13)  // uses timer query functions
+#define QGL_ARB_texture_non_power_of_two    (1 << 14)  // no functions
+#define QGL_SGIS_generate_mipmap            (1 << 15)  // no functions
+#define QGL_EXT_framebuffer_object          (1 << 16)
 
 // ==========================================================
 
@@ -198,6 +244,7 @@ typedef GLenum (APIENTRY * qglGetError_t)(void);
 typedef void (APIENTRY * qglGetFloatv_t)(GLenum pname, GLfloat *params);
 typedef void (APIENTRY * qglGetIntegerv_t)(GLenum pname, GLint *params);
 typedef const GLubyte * (APIENTRY * qglGetString_t)(GLenum name);
+typedef void (APIENTRY * qglGetTexImage_t)(GLenum target, GLint level, GLenum format, GLenum type, GLvoid *pixels);
 typedef void (APIENTRY * qglHint_t)(GLenum target, GLenum mode);
 typedef GLboolean (APIENTRY * qglIsEnabled_t)(GLenum cap);
 typedef GLboolean (APIENTRY * qglIsTexture_t)(GLuint texture);
@@ -276,6 +323,100 @@ typedef void (APIENTRY * qglGetBufferPointervARB_t)(GLenum target, GLenum pname,
 typedef void (APIENTRY * qglLockArraysEXT_t)(GLint first, GLsizei count);
 typedef void (APIENTRY * qglUnlockArraysEXT_t)(void);
 
+// GL_EXT_timer_query
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT                 0x88BF
+#endif
+#ifndef GL_SAMPLES_PASSED_ARB
+#define GL_SAMPLES_PASSED_ARB               0x8914
+#endif
+#ifndef GL_QUERY_RESULT_ARB
+#define GL_QUERY_RESULT_ARB                 0x8866
+#define GL_QUERY_RESULT_AVAILABLE_ARB       0x8867
+#endif
+
+typedef void (APIENTRY * qglGenQueriesARB_t)(GLsizei n, GLuint *ids);
+typedef void (APIENTRY * qglDeleteQueriesARB_t)(GLsizei n, const GLuint *ids);
+typedef void (APIENTRY * qglBeginQueryARB_t)(GLenum target, GLuint id);
+typedef void (APIENTRY * qglEndQueryARB_t)(GLenum target);
+typedef void (APIENTRY * qglGetQueryObjectivARB_t)(GLuint id, GLenum pname, GLint *params);
+typedef void (APIENTRY * qglGetQueryObjectui64vEXT_t)(GLuint id, GLenum pname, uint64_t *params);
+
+// GL_ARB_pixel_buffer_object
+#ifndef GL_PIXEL_PACK_BUFFER_ARB
+#define GL_PIXEL_PACK_BUFFER_ARB            0x88EB
+#endif
+#ifndef GL_STREAM_READ_ARB
+#define GL_STREAM_READ_ARB                  0x88E1
+#endif
+#ifndef GL_READ_ONLY_ARB
+#define GL_READ_ONLY_ARB                    0x88B8
+#endif
+
+// GL_EXT_multi_draw_arrays
+typedef void (APIENTRY * qglMultiDrawElementsEXT_t)(GLenum mode, const GLsizei *count, GLenum type, const GLvoid **indices, GLsizei primcount);
+
+// GL_ARB_vertex_program
+typedef void (APIENTRY * qglVertexAttribPointerARB_t)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
+typedef void (APIENTRY * qglEnableVertexAttribArrayARB_t)(GLuint index);
+typedef void (APIENTRY * qglDisableVertexAttribArrayARB_t)(GLuint index);
+
+// GL_ARB_texture_compression
+typedef void (APIENTRY * qglCompressedTexImage2DARB_t)(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data);
+typedef void (APIENTRY * qglGetCompressedTexImageARB_t)(GLenum target, GLint level, GLvoid *img);
+
+// GL_ARB_point_sprite
+#ifndef GL_POINT_SPRITE_ARB
+#define GL_POINT_SPRITE_ARB                 0x8861
+#endif
+#ifndef GL_COORD_REPLACE_ARB
+#define GL_COORD_REPLACE_ARB                0x8862
+#endif
+#ifndef GL_VERTEX_PROGRAM_POINT_SIZE_ARB
+#define GL_VERTEX_PROGRAM_POINT_SIZE_ARB    0x8642
+#endif
+
+// GL_ARB_texture_cube_map
+#ifndef GL_TEXTURE_CUBE_MAP_ARB
+#define GL_TEXTURE_CUBE_MAP_ARB             0x8513
+#endif
+#ifndef GL_TEXTURE_CUBE_MAP_POSITIVE_X_ARB
+#define GL_TEXTURE_CUBE_MAP_POSITIVE_X_ARB  0x8515
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE                    0x812F
+#endif
+
+// GL_EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT     0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT    0x83F3
+#endif
+
+// GL_SGIS_generate_mipmap
+#ifndef GL_GENERATE_MIPMAP_SGIS
+#define GL_GENERATE_MIPMAP_SGIS             0x8191
+#endif
+
+// GL_EXT_framebuffer_object
+#ifndef GL_FRAMEBUFFER_EXT
+#define GL_FRAMEBUFFER_EXT                  0x8D40
+#endif
+#ifndef GL_COLOR_ATTACHMENT0_EXT
+#define GL_COLOR_ATTACHMENT0_EXT            0x8CE0
+#endif
+#ifndef GL_FRAMEBUFFER_COMPLETE_EXT
+#define GL_FRAMEBUFFER_COMPLETE_EXT         0x8CD5
+#endif
+
+typedef void (APIENTRY * qglGenFramebuffersEXT_t)(GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRY * qglDeleteFramebuffersEXT_t)(GLsizei n, const GLuint *framebuffers);
+typedef void (APIENTRY * qglBindFramebufferEXT_t)(GLenum target, GLuint framebuffer);
+typedef void (APIENTRY * qglFramebufferTexture2DEXT_t)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+typedef GLenum (APIENTRY * qglCheckFramebufferStatusEXT_t)(GLenum target);
+
 // ==========================================================
 
 void QGL_Init(void);
@@ -297,6 +438,11 @@ QGL_ARB_fragment_program_IMP
 QGL_ARB_multitexture_IMP
 QGL_ARB_vertex_buffer_object_IMP
 QGL_EXT_compiled_vertex_array_IMP
+QGL_EXT_timer_query_IMP
+QGL_EXT_multi_draw_arrays_IMP
+QGL_ARB_vertex_program_IMP
+QGL_ARB_texture_compression_IMP
+QGL_EXT_framebuffer_object_IMP
 #undef QGL
 
 #endif
@@ -21,6 +21,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 static float    skyrotate;
 static vec3_t   skyaxis;
 static int      sky_images[6];
+static qboolean sky_cubemap;
+
+// with cubemap sky, visible sky faces are drawn as they are and textured
+// by direction from the view origin, no clipping is needed
+#define MAX_SKY_VERTS   8192
+#define MAX_SKY_INDICES (MAX_SKY_VERTS * 3)
+
+static vec3_t       skyverts[MAX_SKY_VERTS];
+static GLuint       skyindices[MAX_SKY_INDICES];
+static int          numskyverts, numskyindices;
 
 static const vec3_t skyclip[6] = {
     { 1, 1, 0 },
@@ -230,6 +240,23 @@ void R_AddSkySurface(mface_t *fa)
         Com_Error(ERR_DROP, "%s: too many verts", __func__);
     }
 
+    if (sky_cubemap &&
+        numskyverts + fa->numsurfedges <= MAX_SKY_VERTS &&
+        numskyindices + (fa->numsurfedges - 2) * 3 <= MAX_SKY_INDICES) {
+        surfedge = fa->firstsurfedge;
+        for (i = 0; i < fa->numsurfedges; i++, surfedge++) {
+            vert = surfedge->edge->v[surfedge->vert];
+            VectorCopy(vert->point, skyverts[numskyverts + i]);
+        }
+        for (i = 2; i < fa->numsurfedges; i++) {
+            skyindices[numskyindices++] = numskyverts;
+            skyindices[numskyindices++] = numskyverts + i - 1;
+            skyindices[numskyindices++] = numskyverts + i;
+        }
+        numskyverts += fa->numsurfedges;
+        return;
+    }
+
     // calculate vertex values for sky box
     surfedge = fa->firstsurfedge;
     for (i = 0; i < fa->numsurfedges; i++, surfedge++) {
@@ -256,6 +283,7 @@ void R_ClearSkyBox(void)
     }
 
     skyfaces = 0;
+    numskyverts = numskyindices = 0;
 }
 
 static void MakeSkyVec(float s, float t, int axis, vec_t *v)
@@ -292,6 +320,44 @@ static void MakeSkyVec(float s, float t, int axis, vec_t *v)
     v[4] = 1.0 - t;
 }
 
+static void R_DrawSkyCubemap(void)
+{
+    // sky box axes to cube map axes, see R_BuildSkyCubemap
+    static const GLfloat skymatrix[16] = {
+        1, 0, 0, 0,
+        0, 0, 1, 0,
+        0, 1, 0, 0,
+        0, 0, 0, 1
+    };
+
+    qglMatrixMode(GL_TEXTURE);
+    qglLoadMatrixf(skymatrix);
+    if (skyrotate) {
+        qglRotatef(-glr.fd.time * skyrotate, skyaxis[0], skyaxis[1], skyaxis[2]);
+    }
+    qglTranslatef(-glr.fd.vieworg[0], -glr.fd.vieworg[1], -glr.fd.vieworg[2]);
+    qglMatrixMode(GL_MODELVIEW);
+
+    GL_TexEnv(GL_REPLACE);
+    GL_Bits(GLS_DEFAULT);
+
+    qglDisable(GL_TEXTURE_2D);
+    qglEnable(GL_TEXTURE_CUBE_MAP_ARB);
+    qglBindTexture(GL_TEXTURE_CUBE_MAP_ARB, TEXNUM_SKYCUBE);
+
+    qglVertexPointer(3, GL_FLOAT, 0, skyverts);
+    qglTexCoordPointer(3, GL_FLOAT, 0, skyverts);
+    qglDrawElements(GL_TRIANGLES, numskyindices, GL_UNSIGNED_INT, skyindices);
+
+    qglBindTexture(GL_TEXTURE_CUBE_MAP_ARB, 0);
+    qglDisable(GL_TEXTURE_CUBE_MAP_ARB);
+    qglEnable(GL_TEXTURE_2D);
+
+    qglMatrixMode(GL_TEXTURE);
+    qglLoadIdentity();
+    qglMatrixMode(GL_MODELVIEW);
+}
+
 #define SKY_VISIBLE(side) \
     (skymins[0][side] < skymaxs[0][side] && \
      skymins[1][side] < skymaxs[1][side])
@@ -307,6 +373,10 @@ void R_DrawSkyBox(void)
     vec5_t verts[4];
     int i;
 
+    if (numskyindices) {
+        R_DrawSkyCubemap();
+    }
+
     // check for no sky at all
     if (!skyfaces)
         return; // nothing visible
@@ -350,10 +420,75 @@ void R_DrawSkyBox(void)
     qglPopMatrix();
 }
 
+/*
+============
+R_BuildSkyCubemap
+
+Copies the six sky box images into a cube map. Sky box axes are mapped
+to cube map axes by swapping Y and Z, which lines up the four side faces
+as they are. Top and bottom faces need to be rotated.
+============
+*/
+static qboolean R_BuildSkyCubemap(image_t **images)
+{
+    // cube map face order is +X, -X, +Y, -Y, +Z, -Z
+    static const int faceorder[6] = { 0, 2, 4, 5, 1, 3 };
+    byte *src, *dst;
+    uint32_t *in, *out;
+    int i, x, y, size;
+
+    size = images[0]->upload_width;
+    for (i = 0; i < 6; i++) {
+        if (images[i]->upload_width != size ||
+            images[i]->upload_height != size) {
+            return qfalse;
+        }
+    }
+
+    src = FS_AllocTempMem(size * size * 4);
+    dst = FS_AllocTempMem(size * size * 4);
+
+    qglBindTexture(GL_TEXTURE_CUBE_MAP_ARB, TEXNUM_SKYCUBE);
+
+    for (i = 0; i < 6; i++) {
+        GL_BindTexture(images[faceorder[i]]->texnum);
+        qglGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, src);
+
+        in = (uint32_t *)src;
+        out = (uint32_t *)dst;
+        for (y = 0; y < size; y++) {
+            for (x = 0; x < size; x++) {
+                if (i == 2) {
+                    *out++ = in[x * size + size - 1 - y];
+                } else if (i == 3) {
+                    *out++ = in[(size - 1 - x) * size + y];
+                } else {
+                    *out++ = in[y * size + x];
+                }
+            }
+        }
+
+        qglTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X_ARB + i, 0, GL_RGB,
+                      size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+    }
+
+    qglTexParameterf(GL_TEXTURE_CUBE_MAP_ARB, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    qglTexParameterf(GL_TEXTURE_CUBE_MAP_ARB, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    qglTexParameterf(GL_TEXTURE_CUBE_MAP_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    qglTexParameterf(GL_TEXTURE_CUBE_MAP_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    qglBindTexture(GL_TEXTURE_CUBE_MAP_ARB, 0);
+
+    FS_FreeTempMem(dst);
+    FS_FreeTempMem(src);
+
+    return qtrue;
+}
+
 static void R_UnsetSky(void)
 {
     int i;
 
+    sky_cubemap = qfalse;
     skyrotate = 0;
     for (i = 0; i < 6; i++) {
         sky_images[i] = TEXNUM_BLACK;
@@ -369,7 +504,7 @@ void R_SetSky(const char *name, float rotate, vec3_t axis)
 {
     int     i;
     char    pathname[MAX_QPATH];
-    image_t *image;
+    image_t *images[6];
     size_t  len;
     // 3dstudio environment map names
     static const char suf[6][3] = { "rt", "bk", "lf", "ft", "up", "dn" };
@@ -381,6 +516,7 @@ void R_SetSky(const char *name, float rotate, vec3_t axis)
 
     skyrotate = rotate;
     VectorCopy(axis, skyaxis);
+    sky_cubemap = qfalse;
 
     for (i = 0; i < 6; i++) {
         len = Q_concat(pathname, sizeof(pathname),
@@ -390,12 +526,17 @@ void R_SetSky(const char *name, float rotate, vec3_t axis)
             return;
         }
         FS_NormalizePath(pathname, pathname);
-        image = IMG_Find(pathname, IT_SKY);
-        if (image->texnum == TEXNUM_DEFAULT) {
+        images[i] = IMG_Find(pathname, IT_SKY);
+        if (images[i]->texnum == TEXNUM_DEFAULT) {
             R_UnsetSky();
             return;
         }
-        sky_images[i] = image->texnum;
+        sky_images[i] = images[i]->texnum;
+    }
+
+    if (gl_skycubemap->integer &&
+        (gl_config.ext_enabled & QGL_ARB_texture_cube_map)) {
+        sky_cubemap = R_BuildSkyCubemap(images);
     }
 }
 
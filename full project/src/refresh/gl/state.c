@@ -29,6 +29,15 @@ void GL_BindTexture(int texnum)
     }
 #endif
 
+    if (texnum < MAX_RIMAGES) {
+        image_t *image = &r_images[texnum];
+
+        image->lastframe = gl_static.texframe;
+        if (q_unlikely(image->evicted)) {
+            GL_RestoreImage(image);
+        }
+    }
+
     if (gls.texnum[gls.tmu] == texnum) {
         return;
     }
@@ -285,6 +294,277 @@ byte *IMG_ReadPixels(qboolean reverse, int *width, int *height)
     return pixels;
 }
 
+/*
+=============
+IMG_BeginReadPixels
+
+Starts an asynchronous read of the back buffer into pixel buffer object
+in the given slot. Returns false if PBOs are not available, in which case
+the caller should fall back to IMG_ReadPixels.
+=============
+*/
+qboolean IMG_BeginReadPixels(int slot, qboolean reverse)
+{
+    size_t size = r_config.width * r_config.height * 3;
+
+    if (!(gl_config.ext_supported & QGL_ARB_pixel_buffer_object)) {
+        return qfalse;
+    }
+    if (!qglBindBufferARB) {
+        return qfalse;
+    }
+
+    if (!gl_static.readbufs[slot]) {
+        qglGenBuffersARB(1, &gl_static.readbufs[slot]);
+    }
+
+    qglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, gl_static.readbufs[slot]);
+    qglBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ_ARB);
+    qglReadPixels(0, 0, r_config.width, r_config.height,
+                  reverse ? GL_BGR : GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    qglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    gl_static.readbuf_width[slot] = r_config.width;
+    gl_static.readbuf_height[slot] = r_config.height;
+    gl_static.readbuf_size[slot] = size;
+
+    return qtrue;
+}
+
+// sizes a conversion texture for w x h, returns true if it was (re)allocated
+static qboolean yuv_target(int texnum, int *tex_w, int *tex_h, int w, int h,
+                           GLenum format, GLfloat filter)
+{
+    if (!qglIsTexture(texnum)) {
+        *tex_w = *tex_h = 0;
+    }
+
+    GL_BindTexture(texnum);
+
+    if (*tex_w >= w && *tex_h >= h) {
+        return qfalse;
+    }
+
+    *tex_w = npot32(w);
+    *tex_h = npot32(h);
+
+    qglTexImage2D(GL_TEXTURE_2D, 0, format, *tex_w, *tex_h, 0,
+                  format, GL_UNSIGNED_BYTE, NULL);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return qtrue;
+}
+
+// quad in output texels, texture coordinates in source pixels
+static void yuv_quad(float x0, float y0, float x1, float y1,
+                     float s0, float t0, float s1, float t1)
+{
+    float sw = gl_static.yuv_source_width;
+    float sh = gl_static.yuv_source_height;
+    float verts[16];
+
+    Vector4Set(verts,      x0, y0, s0 / sw, t0 / sh);
+    Vector4Set(verts +  4, x1, y0, s1 / sw, t0 / sh);
+    Vector4Set(verts +  8, x1, y1, s1 / sw, t1 / sh);
+    Vector4Set(verts + 12, x0, y1, s0 / sw, t1 / sh);
+
+    qglTexCoordPointer(2, GL_FLOAT, 16, verts + 2);
+    qglVertexPointer(2, GL_FLOAT, 16, verts);
+    qglDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+/*
+=============
+IMG_BeginReadYUV
+
+Converts the top left width x height of the back buffer to I420 and starts
+an asynchronous read of the planes, which is half the size of an RGB read.
+Width must be a multiple of 8 and height a multiple of 4. Returns false if
+framebuffer objects, pixel buffer objects or fragment programs are not
+available.
+
+The planes are rendered by gl_prog_yuv into a width/4 x height*3/2 RGBA
+target, each texel holding four consecutive samples, so every row is
+width bytes and the target reads back as the Y plane followed by U and V.
+A chroma plane row is half as wide, so each target row holds an even one
+on the left and the following odd one on the right; their samples fall
+between four source pixels, which bilinear filtering averages. Program
+locals:
+
+  local[0]  red, green and blue weights, bias
+  local[1]  texture coordinate step between the four samples
+=============
+*/
+qboolean IMG_BeginReadYUV(int slot, int width, int height)
+{
+    static const vec4_t coefs[3] = {
+        {  0.257f,  0.504f,  0.098f,  16 / 255.0f },
+        { -0.148f, -0.291f,  0.439f, 128 / 255.0f },
+        {  0.439f, -0.368f, -0.071f, 128 / 255.0f }
+    };
+    int pw = width / 4;
+    int ph = height * 3 / 2;
+    float cw = width / 8;
+    float ch = height / 4;
+    float w = width;
+    float h = r_config.height;
+    size_t size = width * height * 3 / 2;
+    qboolean attach;
+    vec4_t step;
+    float y;
+    int i;
+
+    if (!gl_static.prognum_yuv || gl_static.yuv_failed || !qglBindBufferARB) {
+        return qfalse;
+    }
+    if (!(gl_config.ext_supported & QGL_ARB_pixel_buffer_object)) {
+        return qfalse;
+    }
+    if (!(gl_config.ext_enabled & QGL_EXT_framebuffer_object)) {
+        return qfalse;
+    }
+    if ((width & 7) || (height & 3) || width < 8 || height < 4 ||
+        width > r_config.width || height > r_config.height) {
+        return qfalse;
+    }
+    if (npot32(r_config.width) > gl_config.maxTextureSize ||
+        npot32(r_config.height) > gl_config.maxTextureSize ||
+        npot32(ph) > gl_config.maxTextureSize) {
+        return qfalse;
+    }
+
+    // copy of the finished frame
+    yuv_target(TEXNUM_YUV_SOURCE, &gl_static.yuv_source_width,
+               &gl_static.yuv_source_height, r_config.width, r_config.height,
+               GL_RGB, GL_LINEAR);
+    qglCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0,
+                         r_config.width, r_config.height);
+
+    attach = yuv_target(TEXNUM_YUV_PLANES, &gl_static.yuv_planes_width,
+                        &gl_static.yuv_planes_height, pw, ph,
+                        GL_RGBA, GL_NEAREST);
+    if (!gl_static.yuv_fbo) {
+        qglGenFramebuffersEXT(1, &gl_static.yuv_fbo);
+        attach = qtrue;
+    }
+
+    qglBindFramebufferEXT(GL_FRAMEBUFFER_EXT, gl_static.yuv_fbo);
+    if (attach) {
+        qglFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                                   GL_TEXTURE_2D, TEXNUM_YUV_PLANES, 0);
+        if (qglCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) !=
+            GL_FRAMEBUFFER_COMPLETE_EXT) {
+            Com_WPrintf("YUV conversion framebuffer incomplete, "
+                        "converting on the CPU\n");
+            qglBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+            gl_static.yuv_failed = qtrue;
+            return qfalse;
+        }
+    }
+
+    qglViewport(0, 0, pw, ph);
+    qglMatrixMode(GL_PROJECTION);
+    qglPushMatrix();
+    qglLoadIdentity();
+    qglOrtho(0, pw, 0, ph, -1, 1);
+    qglMatrixMode(GL_MODELVIEW);
+
+    GL_BindTexture(TEXNUM_YUV_SOURCE);
+    GL_Bits(GLS_DEPTHTEST_DISABLE);
+    qglEnable(GL_FRAGMENT_PROGRAM_ARB);
+    qglBindProgramARB(GL_FRAGMENT_PROGRAM_ARB, gl_static.prognum_yuv);
+
+    // luma, rows counted from the top of the screen
+    Vector4Set(step, 1.0f / gl_static.yuv_source_width, 0, 0, 0);
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 0, coefs[0]);
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 1, step);
+    yuv_quad(0, 0, pw, height, -1.5f, h, w - 1.5f, h - height);
+
+    // chroma, even rows on the left and odd rows on the right
+    Vector4Set(step, 2.0f / gl_static.yuv_source_width, 0, 0, 0);
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 1, step);
+    for (i = 1; i < 3; i++) {
+        y = height + (i - 1) * ch;
+        qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 0, coefs[i]);
+        yuv_quad(0, y, cw, y + ch, -3, h + 1, w - 3, h + 1 - 4 * ch);
+        yuv_quad(cw, y, pw, y + ch, -3, h - 1, w - 3, h - 1 - 4 * ch);
+    }
+
+    qglBindProgramARB(GL_FRAGMENT_PROGRAM_ARB, 0);
+    qglDisable(GL_FRAGMENT_PROGRAM_ARB);
+
+    if (!gl_static.readbufs[slot]) {
+        qglGenBuffersARB(1, &gl_static.readbufs[slot]);
+    }
+
+    qglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, gl_static.readbufs[slot]);
+    qglBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ_ARB);
+    qglReadPixels(0, 0, pw, ph, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    qglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    qglBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    qglMatrixMode(GL_PROJECTION);
+    qglPopMatrix();
+    qglMatrixMode(GL_MODELVIEW);
+    qglViewport(0, 0, r_config.width, r_config.height);
+
+    gl_static.readbuf_width[slot] = width;
+    gl_static.readbuf_height[slot] = height;
+    gl_static.readbuf_size[slot] = size;
+
+    return qtrue;
+}
+
+// returns pixels started by IMG_BeginReadPixels, or NULL on failure
+byte *IMG_EndReadPixels(int slot, int *width, int *height)
+{
+    size_t size = gl_static.readbuf_size[slot];
+    byte *pixels, *data;
+
+    if (!qglBindBufferARB || !gl_static.readbufs[slot]) {
+        return NULL;
+    }
+
+    qglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, gl_static.readbufs[slot]);
+    data = qglMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+    if (data) {
+        pixels = FS_AllocTempMem(size);
+        memcpy(pixels, data, size);
+        qglUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+    } else {
+        pixels = NULL;
+    }
+    qglBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    *width = gl_static.readbuf_width[slot];
+    *height = gl_static.readbuf_height[slot];
+
+    return pixels;
+}
+
+void GL_ShutdownReadPixels(void)
+{
+    int i;
+
+    for (i = 0; i < IMG_READBACK_SLOTS; i++) {
+        if (gl_static.readbufs[i] && qglDeleteBuffersARB) {
+            qglDeleteBuffersARB(1, &gl_static.readbufs[i]);
+        }
+        gl_static.readbufs[i] = 0;
+    }
+
+    // conversion textures are deleted by GL_ShutdownImages
+    if (gl_static.yuv_fbo && qglDeleteFramebuffersEXT) {
+        qglDeleteFramebuffersEXT(1, &gl_static.yuv_fbo);
+    }
+    gl_static.yuv_fbo = 0;
+    gl_static.yuv_source_width = gl_static.yuv_source_height = 0;
+    gl_static.yuv_planes_width = gl_static.yuv_planes_height = 0;
+    gl_static.yuv_failed = qfalse;
+}
+
 void GL_EnableOutlines(void)
 {
     if (gls.fp_enabled) {
@@ -328,10 +608,27 @@ void GL_DisableWarp(void)
     gls.fp_enabled = qfalse;
 }
 
-void GL_InitPrograms(void)
+static GLuint GL_CompileProgram(GLenum target, const char *string, size_t length, const char *what)
 {
     GLuint prog;
 
+    GL_ClearErrors();
+    qglGenProgramsARB(1, &prog);
+    qglBindProgramARB(target, prog);
+    qglProgramStringARB(target, GL_PROGRAM_FORMAT_ASCII_ARB, length, string);
+
+    if (GL_ShowErrors(what)) {
+        qglBindProgramARB(target, 0);
+        qglDeleteProgramsARB(1, &prog);
+        return 0;
+    }
+
+    qglBindProgramARB(target, 0);
+    return prog;
+}
+
+void GL_InitPrograms(void)
+{
     if (gl_config.ext_supported & QGL_ARB_fragment_program) {
         if (gl_fragment_program->integer) {
             Com_Printf("...enabling GL_ARB_fragment_program\n");
@@ -345,24 +642,43 @@ void GL_InitPrograms(void)
         Cvar_Set("gl_fragment_program", "0");
     }
 
-    if (!qglProgramStringARB) {
-        return;
+    // needs array buffers to keep alias model frames on the card
+    if ((gl_config.ext_supported & QGL_ARB_vertex_program) && qglBindBufferARB) {
+        if (gl_vertex_program->integer) {
+            Com_Printf("...enabling GL_ARB_vertex_program\n");
+            // program object functions come with the fragment program set
+            QGL_InitExtensions(QGL_ARB_vertex_program | QGL_ARB_fragment_program);
+            gl_config.ext_enabled |= QGL_ARB_vertex_program;
+        } else {
+            Com_Printf("...ignoring GL_ARB_vertex_program\n");
+        }
+    } else if (gl_vertex_program->integer) {
+        Com_Printf("GL_ARB_vertex_program not found\n");
+        Cvar_Set("gl_vertex_program", "0");
     }
 
-    GL_ClearErrors();
-    qglGenProgramsARB(1, &prog);
-    qglBindProgramARB(GL_FRAGMENT_PROGRAM_ARB, prog);
-    qglProgramStringARB(GL_FRAGMENT_PROGRAM_ARB, GL_PROGRAM_FORMAT_ASCII_ARB,
-                        sizeof(gl_prog_warp) - 1, gl_prog_warp);
-
-    if (GL_ShowErrors("Failed to initialize fragment program")) {
-        qglBindProgramARB(GL_FRAGMENT_PROGRAM_ARB, 0);
-        qglDeleteProgramsARB(1, &prog);
-        return;
+    if (gl_config.ext_enabled & QGL_ARB_fragment_program) {
+        gl_static.prognum_warp = GL_CompileProgram(GL_FRAGMENT_PROGRAM_ARB,
+            gl_prog_warp, sizeof(gl_prog_warp) - 1,
+            "Failed to initialize warp program");
+        gl_static.prognum_vcr = GL_CompileProgram(GL_FRAGMENT_PROGRAM_ARB,
+            gl_prog_vcr, sizeof(gl_prog_vcr) - 1,
+            "Failed to initialize VCR program");
+        gl_static.prognum_yuv = GL_CompileProgram(GL_FRAGMENT_PROGRAM_ARB,
+            gl_prog_yuv, sizeof(gl_prog_yuv) - 1,
+            "Failed to initialize YUV program");
     }
 
-    qglBindProgramARB(GL_FRAGMENT_PROGRAM_ARB, 0);
-    gl_static.prognum_warp = prog;
+    if (gl_config.ext_enabled & QGL_ARB_vertex_program) {
+        gl_static.prognum_lerp = GL_CompileProgram(GL_VERTEX_PROGRAM_ARB,
+            gl_prog_lerp, sizeof(gl_prog_lerp) - 1,
+            "Failed to initialize lerp program");
+        if (gl_config.ext_supported & QGL_ARB_point_sprite) {
+            gl_static.prognum_particle = GL_CompileProgram(GL_VERTEX_PROGRAM_ARB,
+                gl_prog_particle, sizeof(gl_prog_particle) - 1,
+                "Failed to initialize particle program");
+        }
+    }
 }
 
 void GL_ShutdownPrograms(void)
@@ -376,7 +692,26 @@ void GL_ShutdownPrograms(void)
         gl_static.prognum_warp = 0;
     }
 
-    QGL_ShutdownExtensions(QGL_ARB_fragment_program);
-    gl_config.ext_enabled &= ~QGL_ARB_fragment_program;
-}
+    if (gl_static.prognum_vcr) {
+        qglDeleteProgramsARB(1, &gl_static.prognum_vcr);
+        gl_static.prognum_vcr = 0;
+    }
 
+    if (gl_static.prognum_yuv) {
+        qglDeleteProgramsARB(1, &gl_static.prognum_yuv);
+        gl_static.prognum_yuv = 0;
+    }
+
+    if (gl_static.prognum_lerp) {
+        qglDeleteProgramsARB(1, &gl_static.prognum_lerp);
+        gl_static.prognum_lerp = 0;
+    }
+
+    if (gl_static.prognum_particle) {
+        qglDeleteProgramsARB(1, &gl_static.prognum_particle);
+        gl_static.prognum_particle = 0;
+    }
+
+    QGL_ShutdownExtensions(QGL_ARB_fragment_program | QGL_ARB_vertex_program);
+    gl_config.ext_enabled &= ~(QGL_ARB_fragment_program | QGL_ARB_vertex_program);
+}
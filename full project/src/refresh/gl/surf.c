@@ -120,8 +120,9 @@ static void add_dynamic_lights(mface_t *surf)
     int local[2];
     vec_t dist, radius, scale, f;
     float *bl;
+    unsigned bits;
     int smax, tmax, s, t, sd, td;
-    int i, j, k;
+    int j, k;
 
     smax = S_MAX(surf);
     tmax = T_MAX(surf);
@@ -129,12 +130,9 @@ static void add_dynamic_lights(mface_t *surf)
     k = !!gl_dlight_falloff->integer;
     scale = 1 + 0.1f * k;
 
-    for (i = 0; i < glr.fd.num_dlights; i++) {
-        if (!(surf->dlightbits & (1 << i))) {
-            continue;
-        }
-
-        light = &glr.fd.dlights[i];
+    // only visit lights binned to this surface by GL_MarkLights
+    for (bits = surf->dlightbits; bits; bits &= bits - 1) {
+        light = &glr.fd.dlights[q_ctz(bits)];
         plane = surf->plane;
         dist = PlaneDiffFast(light->transformed, plane);
         radius = light->intensity * scale - fabs(dist);
@@ -183,6 +181,8 @@ static void add_light_styles(mface_t *surf, int size)
     float *bl;
     int i, j;
 
+    surf->styledirty = qfalse;
+
     if (!surf->numstyles) {
         // should this ever happen?
         memset(blocklights, 0, sizeof(blocklights[0]) * size * 3);
@@ -212,8 +212,6 @@ static void add_light_styles(mface_t *surf, int size)
         }
     }
 
-    surf->stylecache[0] = style->white;
-
     // add remaining lightmaps
     for (i = 1; i < surf->numstyles; i++) {
         style = LIGHT_STYLE(surf, i);
@@ -226,23 +224,58 @@ static void add_light_styles(mface_t *surf, int size)
 
             bl += 3; src += 3;
         }
-
-        surf->stylecache[i] = style->white;
     }
 }
 
-static void update_dynamic_lightmap(mface_t *surf)
+// puts blocklights into system memory copy of the block
+static void store_lightmap(mface_t *surf, int block)
 {
-    byte temp[MAX_BLOCKLIGHTS * 4], *dst;
-    int smax, tmax, size, i;
+    byte *ptr, *dst;
+    int smax, tmax, i, j;
+    lm_rect_t *rect;
     float *bl;
 
     smax = S_MAX(surf);
     tmax = T_MAX(surf);
-    size = smax * tmax;
+
+    // put into texture format
+    bl = blocklights;
+    dst = &lm.blocks[block][(surf->light_t * lm.blocksize + surf->light_s) << 2];
+    for (i = 0; i < tmax; i++) {
+        ptr = dst;
+        for (j = 0; j < smax; j++) {
+            adjust_color_ub(ptr, bl);
+            bl += 3; ptr += 4;
+        }
+        dst += lm.blocksize * 4;
+    }
+
+    // grow the dirty region of this block
+    rect = &lm.rects[block];
+    if (lm.dirtymask & (1U << block)) {
+        rect->left = min(rect->left, surf->light_s);
+        rect->top = min(rect->top, surf->light_t);
+        rect->right = max(rect->right, surf->light_s + smax);
+        rect->bottom = max(rect->bottom, surf->light_t + tmax);
+    } else {
+        rect->left = surf->light_s;
+        rect->top = surf->light_t;
+        rect->right = surf->light_s + smax;
+        rect->bottom = surf->light_t + tmax;
+        lm.dirtymask |= 1U << block;
+    }
+}
+
+static void update_dynamic_lightmap(mface_t *surf)
+{
+    int block = surf->texnum[1] - TEXNUM_LIGHTMAP;
+
+    if (!lm.blocks[block]) {
+        return;
+    }
 
     // add all the lightmaps
-    add_light_styles(surf, size);
+    add_light_styles(surf, S_MAX(surf) * T_MAX(surf));
 
 #if USE_DLIGHTS
     // add all the dynamic lights
@@ -253,21 +286,42 @@ static void update_dynamic_lightmap(mface_t *surf)
     }
 #endif
 
-    // put into texture format
-    bl = blocklights;
-    dst = temp;
-    for (i = 0; i < size; i++) {
-        adjust_color_ub(dst, bl);
-        bl += 3; dst += 4;
+    store_lightmap(surf, block);
+}
+
+// uploads dirty region of each block with a single call
+static void flush_dynamic_lightmaps(void)
+{
+    lm_rect_t *rect;
+    int i, w, h;
+
+    if (!lm.dirtymask) {
+        return;
+    }
+
+    qglPixelStorei(GL_UNPACK_ROW_LENGTH, lm.blocksize);
+
+    for (i = 0; i < lm.nummaps; i++) {
+        if (!(lm.dirtymask & (1U << i))) {
+            continue;
+        }
+
+        rect = &lm.rects[i];
+        w = rect->right - rect->left;
+        h = rect->bottom - rect->top;
+
+        GL_BindTexture(TEXNUM_LIGHTMAP + i);
+        qglTexSubImage2D(GL_TEXTURE_2D, 0, rect->left, rect->top, w, h,
+                         GL_RGBA, GL_UNSIGNED_BYTE,
+                         &lm.blocks[i][(rect->top * lm.blocksize + rect->left) << 2]);
+
+        c.texUploads++;
+        c.lightmapBytes += w * h * 4;
     }
 
-    // upload lightmap subimage
-    GL_BindTexture(surf->texnum[1]);
-    qglTexSubImage2D(GL_TEXTURE_2D, 0,
-                     surf->light_s, surf->light_t, smax, tmax,
-                     GL_RGBA, GL_UNSIGNED_BYTE, temp);
+    qglPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
-    c.texUploads++;
+    lm.dirtymask = 0;
 }
 
 void GL_BeginLights(void)
@@ -278,15 +332,14 @@ void GL_BeginLights(void)
 
 void GL_EndLights(void)
 {
+    flush_dynamic_lightmaps();
+
     qglActiveTextureARB(GL_TEXTURE0_ARB);
     gls.tmu = 0;
 }
 
 void GL_PushLights(mface_t *surf)
 {
-    lightstyle_t *style;
-    int i;
-
 #if USE_DLIGHTS
     // dynamic this frame or dynamic previously
     if (surf->dlightframe) {
@@ -295,14 +348,91 @@ void GL_PushLights(mface_t *surf)
     }
 #endif
 
-    // check for light style updates
-    for (i = 0; i < surf->numstyles; i++) {
-        style = LIGHT_STYLE(surf, i);
-        if (style->white != surf->stylecache[i]) {
-            update_dynamic_lightmap(surf);
-            return;
+    // marked by LM_UpdateStyles
+    if (surf->styledirty) {
+        update_dynamic_lightmap(surf);
+    }
+}
+
+/*
+=============
+LM_UpdateStyles
+
+Called once per view before drawing the world. Compares each style as
+surfaces will see it through the style map with the value lightmaps were
+last built from, and marks the surfaces referencing changed styles.
+=============
+*/
+void LM_UpdateStyles(void)
+{
+    lightstyle_t *style;
+    int i, j;
+
+    if (!lm.stylefaces || !glr.fd.lightstyles) {
+        return;
+    }
+
+    for (i = 0; i < MAX_LIGHTSTYLES; i++) {
+        style = &glr.fd.lightstyles[gl_static.lightstylemap[i]];
+        if (style->white == lm.stylevalues[i]) {
+            continue;
+        }
+        lm.stylevalues[i] = style->white;
+
+        for (j = lm.stylefirst[i]; j < lm.stylefirst[i + 1]; j++) {
+            lm.stylefaces[j]->styledirty = qtrue;
+        }
+    }
+}
+
+// builds inverted style to surface index once all lightmaps are in place
+static void LM_BuildStyleIndex(bsp_t *bsp)
+{
+    mface_t *surf;
+    int i, j, total;
+
+    memset(lm.stylefirst, 0, sizeof(lm.stylefirst));
+    total = 0;
+
+    // count surfaces per style, shifted by one slot
+    for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
+        if (!surf->lightmap || !surf->texnum[1]) {
+            continue;
+        }
+        for (j = 0; j < surf->numstyles; j++) {
+            lm.stylefirst[surf->styles[j] + 1]++;
+            total++;
+        }
+    }
+
+    // turn counts into starting offsets
+    for (i = 0; i < MAX_LIGHTSTYLES; i++) {
+        lm.stylefirst[i + 1] += lm.stylefirst[i];
+    }
+
+    lm.stylefaces = Z_TagMalloc(sizeof(lm.stylefaces[0]) * (total + 1), TAG_RENDERER);
+
+    // fill in, using stylefirst as insertion cursors and restoring it after
+    for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
+        if (!surf->lightmap || !surf->texnum[1]) {
+            continue;
+        }
+        for (j = 0; j < surf->numstyles; j++) {
+            lm.stylefaces[lm.stylefirst[surf->styles[j]]++] = surf;
         }
     }
+
+    for (i = MAX_LIGHTSTYLES; i > 0; i--) {
+        lm.stylefirst[i] = lm.stylefirst[i - 1];
+    }
+    lm.stylefirst[0] = 0;
+
+    // lightmaps were built with fullbright styles
+    for (i = 0; i < MAX_LIGHTSTYLES; i++) {
+        lm.stylevalues[i] = 1;
+    }
+
+    Com_DPrintf("%s: %d style references\n", __func__, total);
 }
 
 /*
@@ -314,19 +444,29 @@ LIGHTMAPS BUILDING
 */
 
 #define LM_AllocBlock(w, h, s, t) \
-    GL_AllocBlock(LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, lm.inuse, w, h, s, t)
+    GL_AllocBlock(lm.blocksize, lm.blocksize, lm.inuse, w, h, s, t)
 
 static void LM_InitBlock(void)
 {
     int i;
 
-    for (i = 0; i < LM_BLOCK_WIDTH; i++) {
+    for (i = 0; i < lm.blocksize; i++) {
         lm.inuse[i] = 0;
     }
 
     lm.dirty = qfalse;
 }
 
+// blocks are built directly into the system memory copy,
+// which is kept for dynamic updates
+static byte *LM_CurrentBlock(void)
+{
+    if (!lm.blocks[lm.nummaps]) {
+        lm.blocks[lm.nummaps] = R_Mallocz(lm.blocksize * lm.blocksize * 4);
+    }
+    return lm.blocks[lm.nummaps];
+}
+
 static void LM_UploadBlock(void)
 {
     if (!lm.dirty) {
@@ -335,11 +475,13 @@ static void LM_UploadBlock(void)
 
     // bypassing our state tracker here, be careful to reset TMU1 afterwards!
     qglBindTexture(GL_TEXTURE_2D, TEXNUM_LIGHTMAP + lm.nummaps);
-    qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp, LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, 0,
-                  GL_RGBA, GL_UNSIGNED_BYTE, lm.buffer);
+    qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp, lm.blocksize, lm.blocksize, 0,
+                  GL_RGBA, GL_UNSIGNED_BYTE, lm.blocks[lm.nummaps]);
     qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    lm.dirty = qfalse;
+
     if (lm.highwater < ++lm.nummaps) {
         lm.highwater = lm.nummaps;
     }
@@ -374,8 +516,25 @@ static void build_style_map(int dynamic)
     }
 }
 
+// picks page size, fewer larger pages mean fewer lightmap binds and
+// longer batches of surfaces sharing a lightmap
+static int LM_BlockSize(void)
+{
+    int size = Cvar_ClampInteger(gl_lightmap_size,
+                                 LM_MIN_BLOCK_SIZE, LM_MAX_BLOCK_SIZE);
+
+    size = npot32(size);
+    while (size > LM_MIN_BLOCK_SIZE && size > gl_config.maxTextureSize) {
+        size >>= 1;
+    }
+
+    return size;
+}
+
 static void LM_BeginBuilding(void)
 {
+    lm.blocksize = LM_BlockSize();
+
     qglActiveTextureARB(GL_TEXTURE1_ARB);
     LM_InitBlock();
 
@@ -395,15 +554,29 @@ static void LM_EndBuilding(void)
     // their idea of what is bound to TMU1 needs to be reset
     gls.texnum[1] = 0;
 
+    lm.texcomp = lm.comp;
+
     // now build the real lightstyle map
     build_style_map(gl_dynamic->integer);
 }
 
 static void LM_FreeLightmaps(void)
 {
+    int i;
+
     // lightmap textures are not deleted from memory when changing maps,
     // they are merely reused
     lm.nummaps = 0;
+    lm.dirtymask = 0;
+    lm.rebuilding = qfalse;
+
+    for (i = 0; i < LM_MAX_LIGHTMAPS; i++) {
+        Z_Free(lm.blocks[i]);
+        lm.blocks[i] = NULL;
+    }
+
+    Z_Free(lm.stylefaces);
+    lm.stylefaces = NULL;
 }
 
 static void build_primary_lightmap(mface_t *surf)
@@ -425,7 +598,7 @@ static void build_primary_lightmap(mface_t *surf)
 
     // put into texture format
     bl = blocklights;
-    dst = &lm.buffer[(surf->light_t * LM_BLOCK_WIDTH + surf->light_s) << 2];
+    dst = &LM_CurrentBlock()[(surf->light_t * lm.blocksize + surf->light_s) << 2];
     for (i = 0; i < tmax; i++) {
         ptr = dst;
         for (j = 0; j < smax; j++) {
@@ -433,7 +606,7 @@ static void build_primary_lightmap(mface_t *surf)
             bl += 3; ptr += 4;
         }
 
-        dst += LM_BLOCK_WIDTH * 4;
+        dst += lm.blocksize * 4;
     }
 }
 
@@ -502,36 +675,62 @@ static qboolean LM_BuildSurface(mface_t *surf, vec_t *vbo)
     for (i = 0; i < surf->numsurfedges; i++) {
         vbo[5] += s;
         vbo[6] += t;
-        vbo[5] /= LM_BLOCK_WIDTH * 16;
-        vbo[6] /= LM_BLOCK_HEIGHT * 16;
+        vbo[5] /= lm.blocksize * 16;
+        vbo[6] /= lm.blocksize * 16;
         vbo += VERTEX_SIZE;
     }
 
     return qtrue;
 }
 
-// called from the main loop whenever lightmap parameters change
+// called from the main loop whenever lightmap parameters change, and then
+// on following frames until gl_lightmap_budget texels per frame have
+// relit all surfaces. uploads go through the dynamic lightmap path.
 void LM_RebuildSurfaces(void)
 {
     bsp_t *bsp = gl_static.world.cache;
     mface_t *surf;
-    int i, texnum;
+    int i, size, block, budget;
 
     if (!bsp) {
+        lm.dirty = qfalse;
+        lm.rebuilding = qfalse;
         return;
     }
 
-    build_style_map(gl_dynamic->integer);
+    if (lm.dirty) {
+        build_style_map(gl_dynamic->integer);
+        lm.dirty = qfalse;
+        lm.rebuilding = !!lm.nummaps;
+        lm.rebuildface = 0;
+
+        // texture format can't change with partial uploads, so
+        // respecify the blocks with their current contents first
+        if (lm.texcomp != lm.comp) {
+            for (i = 0; i < lm.nummaps; i++) {
+                GL_BindTexture(TEXNUM_LIGHTMAP + i);
+                qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp,
+                              lm.blocksize, lm.blocksize, 0,
+                              GL_RGBA, GL_UNSIGNED_BYTE, lm.blocks[i]);
+                c.texUploads++;
+            }
+            lm.texcomp = lm.comp;
+        }
+    }
 
-    if (!lm.nummaps) {
+    if (!lm.rebuilding) {
         return;
     }
 
-    qglActiveTextureARB(GL_TEXTURE1_ARB);
-    qglBindTexture(GL_TEXTURE_2D, TEXNUM_LIGHTMAP);
-    texnum = TEXNUM_LIGHTMAP;
+    budget = gl_lightmap_budget->integer;
+    if (budget <= 0) {
+        budget = INT_MAX;
+    }
 
-    for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
+    for (i = lm.rebuildface, surf = bsp->faces + i; i < bsp->numfaces; i++, surf++) {
+        if (budget <= 0) {
+            break;
+        }
         if (!surf->lightmap) {
             continue;
         }
@@ -542,32 +741,28 @@ void LM_RebuildSurfaces(void)
             continue;
         }
 
-        if (surf->texnum[1] != texnum) {
-            // done with previous lightmap
-            qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp,
-                          LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, 0,
-                          GL_RGBA, GL_UNSIGNED_BYTE, lm.buffer);
-            qglBindTexture(GL_TEXTURE_2D, surf->texnum[1]);
-            texnum = surf->texnum[1];
-
-            c.texUploads++;
+        block = surf->texnum[1] - TEXNUM_LIGHTMAP;
+        if (!lm.blocks[block]) {
+            continue;
         }
 
-        build_primary_lightmap(surf);
+        size = S_MAX(surf) * T_MAX(surf);
+        add_light_styles(surf, size);
+#if USE_DLIGHTS
+        surf->dlightframe = 0;
+#endif
+        store_lightmap(surf, block);
+        budget -= size;
     }
 
-    // upload the last lightmap
-    qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp,
-                  LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, 0,
-                  GL_RGBA, GL_UNSIGNED_BYTE, lm.buffer);
-
-    c.texUploads++;
+    lm.rebuildface = i;
+    if (i == bsp->numfaces) {
+        lm.rebuilding = qfalse;
+    }
 
-    qglActiveTextureARB(GL_TEXTURE0_ARB);
-    gls.texnum[1] = 0;
+    flush_dynamic_lightmaps();
 }
 
-
 /*
 =============================================================================
 
@@ -664,9 +859,15 @@ void GL_FreeWorld(void)
         Hunk_Free(&gl_static.world.hunk);
     } else if (qglDeleteBuffersARB) {
         qglDeleteBuffersARB(1, &gl_static.world.bufnum);
+        if (gl_static.world.indexnum) {
+            qglDeleteBuffersARB(1, &gl_static.world.indexnum);
+        }
     }
 
     LM_FreeLightmaps();
+    GL_FreeLightGrid();
+    GL_FreeWorldJobs();
+    GL_FreeViewCaches();
 
     memset(&gl_static.world, 0, sizeof(gl_static.world));
 }
@@ -702,6 +903,61 @@ fail:
     return NULL;
 }
 
+// builds element buffer with a fan for each face, laid out at 3 indices per
+// vertex so that faces adjacent in the vertex buffer are also adjacent here.
+// leftover slots are filled with degenerate triangles.
+static void create_index_buffer(bsp_t *bsp, int numverts)
+{
+    mface_t *surf;
+    GLuint buf, *dst;
+    int i, j, k, size;
+
+    size = numverts * 3 * sizeof(GLuint);
+
+    GL_ClearErrors();
+    qglGenBuffersARB(1, &buf);
+    qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, buf);
+    qglBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, size, NULL, GL_STATIC_DRAW_ARB);
+    if (GL_ShowErrors("Failed to create world model index buffer")) {
+        goto fail;
+    }
+
+    dst = qglMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+    if (!dst) {
+        goto fail;
+    }
+
+    for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
+        if (surf->drawflags & SURF_SKY) {
+            continue;
+        }
+
+        k = surf->firstvert;
+        for (j = 2; j < surf->numsurfedges; j++) {
+            *dst++ = k;
+            *dst++ = k + (j - 1);
+            *dst++ = k + j;
+        }
+        for (j = 0; j < 6; j++) {
+            *dst++ = k;
+        }
+    }
+
+    if (!qglUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB)) {
+        goto fail;
+    }
+
+    qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+
+    Com_DPrintf("%s: %d bytes of index data\n", __func__, size);
+    gl_static.world.indexnum = buf;
+    return;
+
+fail:
+    qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    qglDeleteBuffersARB(1, &buf);
+}
+
 // silence GCC warning
 extern void gl_lightmap_changed(cvar_t *self);
 
@@ -844,6 +1100,10 @@ void GL_LoadWorld(const char *name)
     LM_EndBuilding();
     Com_DPrintf("%s: %d lightmaps built\n", __func__, lm.nummaps);
 
+    LM_BuildStyleIndex(bsp);
+
+    GL_BuildLightGrid();
+
     // unmap our VBO
     if (qglBindBufferARB && !gl_static.world.vertices) {
         qglBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_static.world.bufnum);
@@ -853,5 +1113,10 @@ void GL_LoadWorld(const char *name)
         qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
     }
 
+    // draw faces with index ranges rather than building indices each frame
+    if (qglBindBufferARB && !gl_static.world.vertices && gl_world_indices->integer) {
+        create_index_buffer(bsp, count);
+    }
+
 }
 
@@ -28,43 +28,43 @@ tesselator_t tess;
 #define FACE_HASH(a,b) \
     (((a)^((a)>>FACE_HASH_BITS)^((b)>>FACE_HASH_BITS*2))&FACE_HASH_MASK)
 
-static mface_t *faces_alpha, *faces_warp, *faces_alpha_warp;
+static mface_t *faces_alpha, *faces_alpha_warp;
 static mface_t *faces_hash[FACE_HASH_SIZE];
+static mface_t *faces_warp[FACE_HASH_SIZE];
 
-void GL_Flush2D(void)
+// draws 2D triangles with the blending state of batch flags
+void GL_DrawTriangles2D(int texnum, int flags, const vec_t *vertices,
+                        const uint32_t *colors, const int *indices,
+                        int numverts, int numindices)
 {
     glStateBits_t bits;
 
-    if (!tess.numverts) {
-        return;
-    }
-
     bits = GLS_DEPTHTEST_DISABLE;
-    if (tess.flags & 2) {
+    if (flags & 2) {
         bits |= GLS_BLEND_BLEND;
-    } else if (tess.flags & 1) {
+    } else if (flags & 1) {
         bits |= GLS_ALPHATEST_ENABLE;
     }
 
-    GL_BindTexture(tess.texnum[0]);
+    GL_BindTexture(texnum);
     GL_TexEnv(GL_MODULATE);
     GL_Bits(bits);
 
     qglEnableClientState(GL_COLOR_ARRAY);
 
-    qglColorPointer(4, GL_UNSIGNED_BYTE, 0, tess.colors);
-    qglTexCoordPointer(2, GL_FLOAT, 16, tess.vertices + 2);
-    qglVertexPointer(2, GL_FLOAT, 16, tess.vertices);
+    qglColorPointer(4, GL_UNSIGNED_BYTE, 0, colors);
+    qglTexCoordPointer(2, GL_FLOAT, 16, vertices + 2);
+    qglVertexPointer(2, GL_FLOAT, 16, vertices);
 
     if (qglLockArraysEXT) {
-        qglLockArraysEXT(0, tess.numverts);
+        qglLockArraysEXT(0, numverts);
     }
 
-    qglDrawElements(GL_TRIANGLES, tess.numindices, GL_UNSIGNED_INT, tess.indices);
+    qglDrawElements(GL_TRIANGLES, numindices, GL_UNSIGNED_INT, indices);
 
     if (gl_showtris->integer) {
         GL_EnableOutlines();
-        qglDrawElements(GL_TRIANGLES, tess.numindices, GL_UNSIGNED_INT, tess.indices);
+        qglDrawElements(GL_TRIANGLES, numindices, GL_UNSIGNED_INT, indices);
         GL_DisableOutlines();
     }
 
@@ -75,6 +75,21 @@ void GL_Flush2D(void)
     qglDisableClientState(GL_COLOR_ARRAY);
 
     c.batchesDrawn2D++;
+}
+
+void GL_Flush2D(void)
+{
+    if (!tess.numverts) {
+        return;
+    }
+
+    if (draw.recording) {
+        GL_RecordSpan();
+    }
+
+    GL_DrawTriangles2D(tess.texnum[0], tess.flags, tess.vertices,
+                       (uint32_t *)tess.colors, tess.indices,
+                       tess.numverts, tess.numindices);
 
     tess.numindices = 0;
     tess.numverts = 0;
@@ -82,6 +97,84 @@ void GL_Flush2D(void)
     tess.flags = 0;
 }
 
+#define PARTICLE_SIZE   (1+M_SQRT1_2)
+#define PARTICLE_SCALE  (1/(2*PARTICLE_SIZE))
+
+static inline uint32_t particle_color(const particle_t *p)
+{
+    color_t color;
+
+    if (p->color == -1) {
+        color.u32 = p->rgba.u32;
+    } else {
+        color.u32 = d_8to24table[p->color & 0xff];
+        color.u8[3] = 255 * p->alpha;
+    }
+
+    return color.u32;
+}
+
+// one vertex per particle, sized by the vertex program
+static void draw_particle_sprites(void)
+{
+    const particle_t *p;
+    vec4_t param;
+    vec_t *dst_vert;
+    uint32_t *dst_color;
+    int i, numverts;
+
+    qglEnable(GL_VERTEX_PROGRAM_ARB);
+    qglBindProgramARB(GL_VERTEX_PROGRAM_ARB, gl_static.prognum_particle);
+
+    VectorCopy(glr.fd.vieworg, param);
+    param[3] = 0;
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 0, param);
+
+    VectorCopy(glr.viewaxis[0], param);
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 1, param);
+
+    // sprite covers the part of the texture the triangle has the dot in
+    param[0] = gl_partscale->value;
+    param[1] = 0.01f;
+    param[2] = 20;
+    param[3] = glr.fd.height / (2 * tan(glr.fd.fov_y * (M_PI / 360)) * PARTICLE_SIZE);
+    qglProgramLocalParameter4fvARB(GL_VERTEX_PROGRAM_ARB, 2, param);
+
+    qglEnable(GL_VERTEX_PROGRAM_POINT_SIZE_ARB);
+    qglEnable(GL_POINT_SPRITE_ARB);
+    qglTexEnvf(GL_POINT_SPRITE_ARB, GL_COORD_REPLACE_ARB, GL_TRUE);
+
+    qglEnableClientState(GL_COLOR_ARRAY);
+    qglColorPointer(4, GL_UNSIGNED_BYTE, 0, tess.colors);
+    qglVertexPointer(3, GL_FLOAT, 0, tess.vertices);
+
+    numverts = 0;
+    for (i = 0, p = glr.fd.particles; i < glr.fd.num_particles; i++, p++) {
+        if (numverts == TESS_MAX_VERTICES) {
+            qglDrawArrays(GL_POINTS, 0, numverts);
+            numverts = 0;
+        }
+
+        dst_vert = tess.vertices + numverts * 3;
+        VectorCopy(p->origin, dst_vert);
+
+        dst_color = (uint32_t *)tess.colors + numverts;
+        *dst_color = particle_color(p);
+
+        numverts++;
+    }
+
+    qglDrawArrays(GL_POINTS, 0, numverts);
+    qglDisableClientState(GL_COLOR_ARRAY);
+
+    qglTexEnvf(GL_POINT_SPRITE_ARB, GL_COORD_REPLACE_ARB, GL_FALSE);
+    qglDisable(GL_POINT_SPRITE_ARB);
+    qglDisable(GL_VERTEX_PROGRAM_POINT_SIZE_ARB);
+
+    qglBindProgramARB(GL_VERTEX_PROGRAM_ARB, 0);
+    qglDisable(GL_VERTEX_PROGRAM_ARB);
+}
+
 void GL_DrawParticles(void)
 {
     particle_t *p;
@@ -107,14 +200,17 @@ void GL_DrawParticles(void)
     GL_TexEnv(GL_MODULATE);
     GL_Bits(blend | GLS_DEPTHMASK_FALSE);
 
+    if (gl_static.prognum_particle && gl_partsprites->integer &&
+        !gl_showtris->integer) {
+        draw_particle_sprites();
+        return;
+    }
+
     qglEnableClientState(GL_COLOR_ARRAY);
     qglColorPointer(4, GL_UNSIGNED_BYTE, 0, tess.colors);
     qglTexCoordPointer(2, GL_FLOAT, 20, tess.vertices + 3);
     qglVertexPointer(3, GL_FLOAT, 20, tess.vertices);
 
-#define PARTICLE_SIZE   (1+M_SQRT1_2)
-#define PARTICLE_SCALE  (1/(2*PARTICLE_SIZE))
-
     numverts = 0;
     for (i = 0, p = glr.fd.particles; i < glr.fd.num_particles; i++, p++) {
         VectorSubtract(p->origin, glr.fd.vieworg, transformed);
@@ -125,12 +221,7 @@ void GL_DrawParticles(void)
             scale += dist * 0.01f;
         }
 
-        if (p->color == -1) {
-            color.u32 = p->rgba.u32;
-        } else {
-            color.u32 = d_8to24table[p->color & 0xff];
-            color.u8[3] = 255 * p->alpha;
-        }
+        color.u32 = particle_color(p);
 
         if (numverts + 3 > TESS_MAX_VERTICES) {
             qglDrawArrays(GL_TRIANGLES, 0, numverts);
@@ -201,11 +292,8 @@ void GL_DrawBeams(void)
     qglVertexPointer(3, GL_FLOAT, 20, tess.vertices);
 
     numverts = numindices = 0;
-    for (i = 0, ent = glr.fd.entities; i < glr.fd.num_entities; i++, ent++) {
-        if (!(ent->flags & RF_BEAM)) {
-            continue;
-        }
-
+    for (i = 0; i < glr.num_beams; i++) {
+        ent = glr.beams[i];
         start = ent->origin;
         end = ent->oldorigin;
         VectorSubtract(end, start, d1);
@@ -284,10 +372,17 @@ static void GL_BindArrays(void)
     qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
     qglTexCoordPointer(2, GL_FLOAT, 4 * VERTEX_SIZE, ptr + 5);
     qglClientActiveTextureARB(GL_TEXTURE0_ARB);
+
+    if (gl_static.world.indexnum) {
+        qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_static.world.indexnum);
+    }
 }
 
 static void GL_UnbindArrays(void)
 {
+    if (gl_static.world.indexnum) {
+        qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    }
     if (!gl_static.world.vertices) {
         qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
     }
@@ -296,6 +391,22 @@ static void GL_UnbindArrays(void)
     qglClientActiveTextureARB(GL_TEXTURE0_ARB);
 }
 
+static void GL_DrawIndices(void)
+{
+    int i;
+
+    if (!tess.numranges) {
+        qglDrawElements(GL_TRIANGLES, tess.numindices, GL_UNSIGNED_INT, tess.indices);
+    } else if (qglMultiDrawElementsEXT) {
+        qglMultiDrawElementsEXT(GL_TRIANGLES, tess.counts, GL_UNSIGNED_INT,
+                                tess.offsets, tess.numranges);
+    } else {
+        for (i = 0; i < tess.numranges; i++) {
+            qglDrawElements(GL_TRIANGLES, tess.counts[i], GL_UNSIGNED_INT, tess.offsets[i]);
+        }
+    }
+}
+
 static void GL_Flush3D(void)
 {
     if (!tess.numindices) {
@@ -347,7 +458,7 @@ static void GL_Flush3D(void)
         qglLockArraysEXT(0, tess.numverts);
     }
 
-    qglDrawElements(GL_TRIANGLES, tess.numindices, GL_UNSIGNED_INT, tess.indices);
+    GL_DrawIndices();
 
     if (tess.texnum[1]) {
         qglDisable(GL_TEXTURE_2D);
@@ -356,7 +467,7 @@ static void GL_Flush3D(void)
 
     if (gl_showtris->integer) {
         GL_EnableOutlines();
-        qglDrawElements(GL_TRIANGLES, tess.numindices, GL_UNSIGNED_INT, tess.indices);
+        GL_DrawIndices();
         GL_DisableOutlines();
     }
 
@@ -374,9 +485,29 @@ static void GL_Flush3D(void)
     tess.texnum[0] = tess.texnum[1] = 0;
     tess.numindices = 0;
     tess.numverts = 0;
+    tess.numranges = 0;
     tess.flags = 0;
 }
 
+// appends face to the index ranges, merging with the previous range
+// when the face immediately follows it in the element buffer
+static void GL_AddRange(mface_t *surf)
+{
+    GLsizei count = surf->numsurfedges * 3;
+    const GLuint *first = (const GLuint *)NULL + surf->firstvert * 3;
+    int i = tess.numranges - 1;
+
+    if (i >= 0 && (const GLuint *)tess.offsets[i] + tess.counts[i] == first) {
+        tess.counts[i] += count;
+    } else {
+        tess.offsets[++i] = first;
+        tess.counts[i] = count;
+        tess.numranges++;
+    }
+
+    tess.numindices += count;
+}
+
 static int GL_CopyVerts(mface_t *surf)
 {
     void *src, *dst;
@@ -427,7 +558,8 @@ static void GL_DrawFace(mface_t *surf)
     if (tess.texnum[0] != texnum ||
         tess.texnum[1] != surf->texnum[1] ||
         (diff & SURF_FLUSH_MASK) ||
-        tess.numindices + numindices > TESS_MAX_INDICES) {
+        (!gl_static.world.indexnum && tess.numindices + numindices > TESS_MAX_INDICES) ||
+        tess.numranges == TESS_MAX_FACES) {
         GL_Flush3D();
     }
 
@@ -447,6 +579,12 @@ static void GL_DrawFace(mface_t *surf)
 
     tess.flags = surf->drawflags;
 
+    if (gl_static.world.indexnum) {
+        GL_AddRange(surf);
+        c.trisDrawn += numtris;
+        return;
+    }
+
     dst_indices = tess.indices + tess.numindices;
     for (i = 0; i < numtris; i++) {
         dst_indices[0] = j;
@@ -469,29 +607,64 @@ static inline void GL_DrawChain(mface_t **head)
     *head = NULL;
 }
 
-void GL_DrawSolidFaces(void)
+static void GL_HashFace(mface_t **hash, mface_t *face)
+{
+    if (gl_hash_faces->integer) {
+        unsigned i = FACE_HASH(face->texnum[0], face->texnum[1]);
+        face->next = hash[i];
+        hash[i] = face;
+    } else {
+        // preserve front-to-back ordering
+        face->next = NULL;
+        if (hash[1])
+            hash[1]->next = face;
+        else
+            hash[0] = face;
+        hash[1] = face;
+    }
+}
+
+static void GL_DrawHash(mface_t **hash)
+{
+    int i;
+
+    if (gl_hash_faces->integer) {
+        for (i = 0; i < FACE_HASH_SIZE; i++) {
+            GL_DrawChain(&hash[i]);
+        }
+    } else {
+        GL_DrawChain(&hash[0]);
+        hash[1] = NULL;
+    }
+}
+
+static qboolean GL_HashEmpty(mface_t **hash)
 {
     int i;
 
+    for (i = 0; i < FACE_HASH_SIZE; i++) {
+        if (hash[i]) {
+            return qfalse;
+        }
+    }
+
+    return qtrue;
+}
+
+void GL_DrawSolidFaces(void)
+{
     GL_BindArrays();
 
     GL_Bits(GLS_DEFAULT);
 
-    if (faces_warp) {
+    if (!GL_HashEmpty(faces_warp)) {
         GL_EnableWarp();
-        GL_DrawChain(&faces_warp);
+        GL_DrawHash(faces_warp);
         GL_Flush3D();
         GL_DisableWarp();
     }
 
-    if (gl_hash_faces->integer) {
-        for (i = 0; i < FACE_HASH_SIZE; i++) {
-            GL_DrawChain(&faces_hash[i]);
-        }
-    } else {
-        GL_DrawChain(&faces_hash[0]);
-        faces_hash[1] = NULL;
-    }
+    GL_DrawHash(faces_hash);
 
     GL_Flush3D();
     GL_UnbindArrays();
@@ -519,22 +692,10 @@ void GL_DrawAlphaFaces(void)
 void GL_AddSolidFace(mface_t *face)
 {
     if ((face->drawflags & SURF_WARP) && gl_static.prognum_warp) {
-        face->next = faces_warp;
-        faces_warp = face;
+        // hashed by texture like the rest, so water batches stay large
+        GL_HashFace(faces_warp, face);
     } else {
-        if (gl_hash_faces->integer) {
-            unsigned i = FACE_HASH(face->texnum[0], face->texnum[1]);
-            face->next = faces_hash[i];
-            faces_hash[i] = face;
-        } else {
-            // preserve front-to-back ordering
-            face->next = NULL;
-            if (faces_hash[1])
-                faces_hash[1]->next = face;
-            else
-                faces_hash[0] = face;
-            faces_hash[1] = face;
-        }
+        GL_HashFace(faces_hash, face);
 
         if (face->lightmap && !(face->drawflags & SURF_NOLM_MASK) && gl_dynamic->integer) {
             GL_PushLights(face);
@@ -23,9 +23,12 @@
  *   - Night vision mode (green tint)
  *   - Battery indicator
  *   - Chromatic aberration
+ *   - Tape ghosting trail (framebuffer object feedback)
  * 
  * Technical:
  *   - Uses OpenGL fixed-function pipeline (no shaders required)
+ *   - Single-pass ARB fragment program composite where available
+ *     (vcr_shader 1), blend-only layers as the fallback
  *   - Procedural noise generation (no texture dependencies)
  *   - Minimal memory footprint (stack allocations only)
  *   - Clean loop without memory leaks
@@ -52,6 +55,7 @@
 /* ========== Q2PRO ENGINE ========== */
 /* For Q2Pro, uncomment ONE of these based on your version: */
 #include "gl.h"      /* Q2Pro unified renderer - newer versions */
+#include "system/system.h"   /* Sys_Milliseconds for vcr_profile */
 /* #include "refresh/gl.h" */   /* Q2Pro - some versions */
 /* #include "client/client.h" */ /* For cl.time access */
 
@@ -85,7 +89,97 @@ cvar_t *vcr_tracking_lines;
 cvar_t *vcr_rec_indicator;
 cvar_t *vcr_timestamp;
 cvar_t *vcr_static_bursts;
+cvar_t *vcr_ghosting;
 cvar_t *vcr_debug;
+cvar_t *vcr_shader;
+cvar_t *vcr_offscreen;
+cvar_t *vcr_profile;
+cvar_t *vcr_autoquality;
+cvar_t *vcr_target_fps;
+cvar_t *vcr_timeline;
+
+/* Scanline cache size, enough for 4096 rows at the default spacing */
+#define VCR_MAX_SCANLINES   2048
+
+/* Tiling noise textures, cropped to the preset size on upload */
+#define VCR_NOISE_SIZE      256
+
+typedef enum {
+    VCR_NOISE_GRAIN,
+    VCR_NOISE_DOTS,
+    VCR_NOISE_STATIC,
+
+    VCR_NOISE_MAX
+} vcr_noise_t;
+
+/* Fraction of texels that carry noise, the per-frame density is selected
+   among them with the alpha test */
+static const float vcr_noise_density[VCR_NOISE_MAX] = {
+    1.0f / 1024, 1.0f / 128, 1.0f
+};
+
+/* Quads in one overlay batch (timestamp, REC label, camera wall) */
+#define VCR_MAX_BATCH_RECTS 256
+
+typedef struct {
+    float   verts[VCR_MAX_BATCH_RECTS * 8];
+    byte    colors[VCR_MAX_BATCH_RECTS * 16];
+    int     numrects;
+} vcr_batch_t;
+
+/* Longest step the animation takes in one frame, so hitches and
+   pauses don't teleport moving elements */
+#define VCR_MAX_FRAME_TIME  0.1f
+
+/* Rewind ring: downscaled frames in a grid of atlas cells */
+#define VCR_REWIND_CELL_W   128
+#define VCR_REWIND_CELL_H   96
+#define VCR_REWIND_COLS     8
+#define VCR_REWIND_ROWS     10
+#define VCR_REWIND_FRAMES   (VCR_REWIND_COLS * VCR_REWIND_ROWS)
+#define VCR_REWIND_FPS      15.0f
+#define VCR_REWIND_SPEED    3.0f    /* Playback is this much faster */
+
+/* Ghosting feedback targets, at a fraction of the screen size */
+#define VCR_GHOST_DIVISOR   2
+#define VCR_GHOST_SHIFT     1.5f    /* Trail drift per 60 Hz frame, pixels */
+#define VCR_GHOST_ALPHA     0.4f    /* Weight of the trail over the scene */
+
+/* Frames averaged by the quality governor */
+#define VCR_GOVERNOR_SAMPLES 32
+
+/* Parameters driven by the event timeline */
+typedef enum {
+    VCR_EVENT_TRACKING,
+    VCR_EVENT_JITTER,
+    VCR_EVENT_DOTS,
+    VCR_EVENT_DESATURATE,
+
+    VCR_EVENT_MAX
+} vcr_event_t;
+
+/* Parameter value from this time on, an event makes two of these */
+typedef struct {
+    float       time;
+    vcr_event_t event;
+    float       value;
+    qboolean    start;                  /* Leading edge of an event */
+} vcr_keyframe_t;
+
+#define VCR_MAX_KEYFRAMES   256
+
+typedef struct {
+    vcr_keyframe_t  keys[VCR_MAX_KEYFRAMES];    /* Sorted by time */
+    int             numkeys;
+    float           length;                     /* Loop length, seconds */
+    float           base[VCR_EVENT_MAX];        /* Values outside events */
+    
+    /* Playback */
+    int             cursor;                     /* Next key to apply */
+    float           last_time;
+    float           values[VCR_EVENT_MAX];
+    unsigned        started;                    /* Events begun this frame */
+} vcr_timeline_t;
 
 /* Macros to access cvar values safely */
 #define CVAR_VALUE(cv) ((cv) ? (cv)->value : 0.0f)
@@ -108,6 +202,18 @@ typedef struct {
     float       last_distort_time;
     float       cctv_start_time;
     float       current_time;
+    float       frame_time;             /* Seconds since previous frame */
+    
+    /* Quality governor (vcr_autoquality) */
+    float       gov_samples[VCR_GOVERNOR_SAMPLES]; /* Raw frame times, msec */
+    int         gov_head;
+    float       gov_hold_until;         /* No steps before this time */
+    float       gov_good_since;         /* Within budget since this time */
+    float       gov_up_delay;           /* Backs off when steps up fail */
+    float       gov_last_up;
+    
+    /* Compiled event sequence */
+    vcr_timeline_t timeline;
     
     /* Found footage state */
     float       static_start_time;      /* When static burst started */
@@ -141,8 +247,53 @@ typedef struct {
     /* Quality multipliers */
     float       quality_mult;
     
-    /* Screen capture texture for desaturation */
+    /* Screen capture texture for the fragment program composite */
     unsigned int screen_tex;
+    int         capture_width;      /* Allocated (power of two) size */
+    int         capture_height;
+    
+    /* Reduced resolution noise layer target */
+    int         overlay_width;      /* Allocated (power of two) size */
+    int         overlay_height;
+    int         overlay_region_w;   /* Region rendered this frame */
+    int         overlay_region_h;
+    
+    /* Rewind ring in TEXNUM_VCR_REWIND */
+    int         rewind_width;       /* Allocated (power of two) size */
+    int         rewind_height;
+    int         rewind_head;        /* Next cell to write */
+    int         rewind_count;       /* Cells holding frames */
+    float       rewind_next;        /* Time of next capture */
+    float       rewind_start;       /* Playback start, < 0 when idle */
+    int         rewind_frames;      /* Frames being played back */
+    
+    /* Ghosting feedback pair in TEXNUM_VCR_GHOST */
+    unsigned int ghost_fbo[2];
+    int         ghost_width[2];     /* Allocated (power of two) size */
+    int         ghost_height[2];
+    int         ghost_last;         /* Target holding the latest result */
+    qboolean    ghost_valid;        /* Latest result is usable */
+    qboolean    ghost_failed;       /* Framebuffer incomplete, stay off */
+    
+    /* Cached scanline geometry, rebuilt when size or spacing changes */
+    float       scanline_verts[VCR_MAX_SCANLINES * 4];
+    int         scanline_count;
+    int         scanline_width;
+    int         scanline_height;
+    int         scanline_skip;
+    
+    /* Overlay batches, rebuilt only when their contents change */
+    vcr_batch_t timestamp_batch;
+    time_t      timestamp_time;
+    int         timestamp_width;
+    int         timestamp_height;
+    vcr_batch_t rec_batch;
+    vcr_batch_t tile_batch;             /* Rebuilt every frame */
+    float       rec_alpha;
+    
+    /* Random texel field generated once, and the uploaded tile size */
+    uint32_t    *noise_data;
+    int         noise_size;
     
     /* Generation counter - incremented on VCR_Init to detect context resets */
     int         tex_generation;
@@ -168,15 +319,18 @@ typedef struct {
     qboolean rec_indicator;
     qboolean timestamp;
     qboolean static_bursts;
+    int noise_size;
+    int overlay_divisor;    /* Noise layer resolution divisor, 1 = full */
+    float ghosting;         /* Trail kept per 60 Hz frame, 0 = off */
 } vcr_quality_preset_t;
 
 static const vcr_quality_preset_t quality_presets[3] = {
     /* LOW */
-    { 0.25f, 0.0f, 4, 40, qfalse, qfalse, qfalse, qtrue, qfalse, qfalse },
+    { 0.25f, 0.0f, 4, 40, qfalse, qfalse, qfalse, qtrue, qfalse, qfalse, 64, 4, 0.0f },
     /* MEDIUM */
-    { 0.6f, 0.5f, 2, 30, qtrue, qtrue, qfalse, qtrue, qtrue, qtrue },
+    { 0.6f, 0.5f, 2, 30, qtrue, qtrue, qfalse, qtrue, qtrue, qtrue, 128, 2, 0.5f },
     /* HIGH */
-    { 1.0f, 1.0f, 2, 20, qtrue, qtrue, qtrue, qtrue, qtrue, qtrue }
+    { 1.0f, 1.0f, 2, 20, qtrue, qtrue, qtrue, qtrue, qtrue, qtrue, 256, 1, 0.6f }
 };
 
 
@@ -216,52 +370,477 @@ static void vcr_rand_seed(unsigned seed)
 
 /*
  * =============================================================================
- *  OPENGL HELPERS
+ *  PROFILING
  * =============================================================================
+ *
+ * With vcr_profile 1 every layer is bracketed by a GL_EXT_timer_query
+ * query, read back VCR_PROFILE_LATENCY frames later so the driver never
+ * stalls. Without timer queries the CPU submission time is measured with
+ * Sys_Milliseconds instead. Pending 2D batches are flushed at layer
+ * boundaries so each layer is charged for its own quads.
  */
 
-static void vcr_gl_begin_2d(int width, int height)
+typedef enum {
+    VCR_LAYER_GHOSTING,
+    VCR_LAYER_COMPOSITE,
+    VCR_LAYER_OFFSCREEN,
+    VCR_LAYER_DESATURATE,
+    VCR_LAYER_NOISE,
+    VCR_LAYER_SCANLINES,
+    VCR_LAYER_TRACKING,
+    VCR_LAYER_MODE,
+    VCR_LAYER_DAMAGE,
+    VCR_LAYER_OVERLAYS,
+    VCR_LAYER_CHROMA,
+
+    VCR_LAYER_MAX
+} vcr_layer_t;
+
+static const char *const vcr_layer_names[VCR_LAYER_MAX] = {
+    "ghosting",
+    "composite",
+    "offscreen",
+    "desaturate",
+    "noise",
+    "scanlines",
+    "tracking",
+    "mode",
+    "damage",
+    "overlays",
+    "chroma"
+};
+
+#define VCR_PROFILE_LATENCY 4       /* Frames before a query is read */
+#define VCR_PROFILE_WINDOW  60      /* Frames per reported average */
+
+typedef struct {
+    qboolean    active;             /* Measuring this frame */
+    qboolean    gpu;
+    GLuint      queries[VCR_PROFILE_LATENCY][VCR_LAYER_MAX];
+    qboolean    issued[VCR_PROFILE_LATENCY][VCR_LAYER_MAX];
+    int         slot;
+    unsigned    cpu_start;
+    double      total[VCR_LAYER_MAX];   /* Milliseconds this window */
+    int         frames;
+    float       average[VCR_LAYER_MAX]; /* Last complete window */
+} vcr_profile_t;
+
+static vcr_profile_t vcr_prof;
+
+static void vcr_profile_shutdown(void)
+{
+    if (vcr_prof.gpu && qglDeleteQueriesARB) {
+        qglDeleteQueriesARB(VCR_PROFILE_LATENCY * VCR_LAYER_MAX,
+                            &vcr_prof.queries[0][0]);
+    }
+    memset(&vcr_prof, 0, sizeof(vcr_prof));
+}
+
+static void vcr_profile_frame(void)
+{
+    int i;
+
+    if (!CVAR_INT(vcr_profile)) {
+        if (vcr_prof.gpu || vcr_prof.frames) {
+            vcr_profile_shutdown();
+        }
+        vcr_prof.active = qfalse;
+        return;
+    }
+
+    if (!vcr_prof.gpu && !vcr_prof.frames &&
+        (gl_config.ext_enabled & QGL_EXT_timer_query)) {
+        qglGenQueriesARB(VCR_PROFILE_LATENCY * VCR_LAYER_MAX,
+                         &vcr_prof.queries[0][0]);
+        vcr_prof.gpu = qtrue;
+    }
+
+    /* Collect the oldest slot before reusing it */
+    vcr_prof.slot = (vcr_prof.slot + 1) % VCR_PROFILE_LATENCY;
+
+    for (i = 0; i < VCR_LAYER_MAX; i++) {
+        GLuint query = vcr_prof.queries[vcr_prof.slot][i];
+        GLint available = 0;
+        uint64_t nsec = 0;
+
+        if (!vcr_prof.issued[vcr_prof.slot][i]) {
+            continue;
+        }
+        vcr_prof.issued[vcr_prof.slot][i] = qfalse;
+
+        qglGetQueryObjectivARB(query, GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+        if (!available) {
+            continue;
+        }
+        qglGetQueryObjectui64vEXT(query, GL_QUERY_RESULT_ARB, &nsec);
+        vcr_prof.total[i] += nsec * 1e-6;
+    }
+
+    if (++vcr_prof.frames >= VCR_PROFILE_WINDOW) {
+        for (i = 0; i < VCR_LAYER_MAX; i++) {
+            vcr_prof.average[i] = vcr_prof.total[i] / vcr_prof.frames;
+            vcr_prof.total[i] = 0;
+        }
+        vcr_prof.frames = 1;
+    }
+
+    vcr_prof.active = qtrue;
+}
+
+static void vcr_profile_begin(vcr_layer_t layer)
+{
+    if (!vcr_prof.active) {
+        return;
+    }
+
+    GL_Flush2D();
+
+    if (vcr_prof.gpu) {
+        qglBeginQueryARB(GL_TIME_ELAPSED_EXT, vcr_prof.queries[vcr_prof.slot][layer]);
+    } else {
+        vcr_prof.cpu_start = Sys_Milliseconds();
+    }
+}
+
+static void vcr_profile_end(vcr_layer_t layer)
+{
+    if (!vcr_prof.active) {
+        return;
+    }
+
+    GL_Flush2D();
+
+    if (vcr_prof.gpu) {
+        qglEndQueryARB(GL_TIME_ELAPSED_EXT);
+        vcr_prof.issued[vcr_prof.slot][layer] = qtrue;
+    } else {
+        vcr_prof.total[layer] += Sys_Milliseconds() - vcr_prof.cpu_start;
+    }
+}
+
+static void vcr_stats_f(void)
+{
+    int i;
+
+    if (!vcr_prof.active) {
+        Com_Printf("Set vcr_profile 1 to measure VCR layers.\n");
+        return;
+    }
+
+    Com_Printf("VCR layer costs (%s, msec per frame):\n",
+               vcr_prof.gpu ? "GPU timer query" : "CPU");
+    for (i = 0; i < VCR_LAYER_MAX; i++) {
+        Com_Printf("%-12s %7.3f\n", vcr_layer_names[i], vcr_prof.average[i]);
+    }
+}
+
+
+/*
+ * =============================================================================
+ *  NOISE TEXTURES
+ * =============================================================================
+ */
+
+static void vcr_init_noise(void)
 {
-    glPushAttrib(GL_ALL_ATTRIB_BITS);
+    unsigned saved = vcr.rng_state;
+    int i;
     
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_TEXTURE_2D);
-    glDisable(GL_LIGHTING);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (!vcr.noise_data) {
+        vcr.noise_data = Z_TagMalloc(VCR_NOISE_SIZE * VCR_NOISE_SIZE *
+                                     sizeof(uint32_t), TAG_RENDERER);
+    }
     
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0, width, height, 0, -1, 1);
+    /* Fixed seed so the pattern is the same on every restart */
+    vcr_rand_seed(0x5eed1234);
+    for (i = 0; i < VCR_NOISE_SIZE * VCR_NOISE_SIZE; i++) {
+        vcr.noise_data[i] = vcr_rand_next();
+    }
     
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
+    vcr.rng_state = saved;
+    vcr.noise_size = 0;
 }
 
-static void vcr_gl_end_2d(void)
+static void vcr_upload_noise(vcr_noise_t type, int size)
+{
+    unsigned limit = (unsigned)(vcr_noise_density[type] * 65535);
+    byte *pixels, *dst;
+    int x, y;
+    
+    pixels = FS_AllocTempMem(size * size * 2);
+    dst = pixels;
+    
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++, dst += 2) {
+            uint32_t r = vcr.noise_data[y * VCR_NOISE_SIZE + x];
+            int b = (r >> 24) & 255;
+            
+            if ((r & 0xFFFF) > limit) {
+                dst[0] = dst[1] = 0;
+                continue;
+            }
+            
+            switch (type) {
+            case VCR_NOISE_GRAIN:
+                dst[0] = b > 127 ? 255 : 0;
+                break;
+            case VCR_NOISE_DOTS:
+                dst[0] = 178 + b * 77 / 255;
+                break;
+            default:
+                dst[0] = b;
+                break;
+            }
+            
+            /* Never zero, so empty texels always fail the alpha test */
+            dst[1] = 1 + ((r >> 16) & 255) * 254 / 255;
+        }
+    }
+    
+    GL_BindTexture(TEXNUM_VCR_GRAIN + type);
+    qglTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, size, size, 0,
+                  GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, pixels);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    
+    FS_FreeTempMem(pixels);
+}
+
+/* Quality presets select the tile size. Textures are lost on every
+   image subsystem restart, so check before use. */
+static void vcr_update_noise(int size)
 {
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+    int i;
+    
+    if (!vcr.noise_data) {
+        return;
+    }
+    
+    if (vcr.noise_size == size && qglIsTexture(TEXNUM_VCR_GRAIN)) {
+        return;
+    }
+    
+    for (i = 0; i < VCR_NOISE_MAX; i++) {
+        vcr_upload_noise(i, size);
+    }
     
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
+    vcr.noise_size = size;
+}
+
+
+/*
+ * =============================================================================
+ *  OPENGL HELPERS
+ * =============================================================================
+ */
+
+/*
+ * The effect runs right after GL_Setup2D and goes through the renderer
+ * state cache. Untextured layers bind TEXNUM_WHITE like R_DrawFill, and
+ * rectangles are queued into the 2D tess batch. Only the modelview matrix
+ * is touched, GL_Setup2D leaves it as identity.
+ */
+static void vcr_gl_begin_2d(int width, int height)
+{
+    GL_Flush2D();
     
-    glPopAttrib();
+    /* Overlay is laid out in refdef units over the whole screen */
+    qglLoadIdentity();
+    if (width != r_config.width || height != r_config.height) {
+        qglScalef((float)r_config.width / width,
+                  (float)r_config.height / height, 1);
+    }
+}
+
+static void vcr_gl_end_2d(void)
+{
+    GL_Flush2D();
+    qglLoadIdentity();
+}
+
+static void vcr_gl_state(int texnum, glStateBits_t bits)
+{
+    GL_BindTexture(texnum);
+    GL_TexEnv(GL_MODULATE);
+    GL_Bits(GLS_DEPTHTEST_DISABLE | bits);
+}
+
+/* Binds a color buffer copy target, (re)allocating it when it is too
+   small for w x h or was lost on an image restart */
+static qboolean vcr_bind_target(int texnum, int *tex_w, int *tex_h,
+                                int w, int h, GLfloat filter)
+{
+    if (!qglIsTexture(texnum)) {
+        *tex_w = *tex_h = 0;
+    }
+
+    GL_BindTexture(texnum);
+
+    if (*tex_w < w || *tex_h < h) {
+        int tw = npot32(w);
+        int th = npot32(h);
+
+        if (tw > gl_config.maxTextureSize || th > gl_config.maxTextureSize) {
+            return qfalse;
+        }
+
+        qglTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tw, th, 0,
+                      GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+
+        *tex_w = tw;
+        *tex_h = th;
+    }
+
+    return qtrue;
 }
 
 static void vcr_draw_rect(float x, float y, float w, float h, 
                           float r, float g, float b, float a)
 {
-    glColor4f(r, g, b, a);
-    glBegin(GL_QUADS);
-    glVertex2f(x, y);
-    glVertex2f(x + w, y);
-    glVertex2f(x + w, y + h);
-    glVertex2f(x, y + h);
-    glEnd();
+    color_t color;
+    
+    color.u8[0] = (byte)(r * 255);
+    color.u8[1] = (byte)(g * 255);
+    color.u8[2] = (byte)(b * 255);
+    color.u8[3] = (byte)(clamp(a, 0, 1) * 255);
+    
+    GL_DrawFill(x, y, w, h, color.u32);
+}
+
+/*
+ * Point and line layers are submitted as client arrays. Randomized points
+ * stream through the tess arrays (2D batches are flushed first), static
+ * scanlines are drawn from a cached array.
+ */
+static void vcr_draw_arrays(GLenum mode, const float *verts,
+                            const byte *colors, int count)
+{
+    vcr_gl_state(TEXNUM_WHITE, GLS_BLEND_BLEND);
+    
+    qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (colors) {
+        qglEnableClientState(GL_COLOR_ARRAY);
+        qglColorPointer(4, GL_UNSIGNED_BYTE, 0, colors);
+    }
+    qglVertexPointer(2, GL_FLOAT, 0, verts);
+
+    qglDrawArrays(mode, 0, count);
+
+    if (colors) {
+        qglDisableClientState(GL_COLOR_ARRAY);
+    }
+    qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+static void vcr_begin_points(float size)
+{
+    GL_Flush2D();
+    qglPointSize(size);
+}
+
+static void vcr_flush_points(void)
+{
+    if (tess.numverts) {
+        vcr_draw_arrays(GL_POINTS, tess.vertices, tess.colors, tess.numverts);
+        tess.numverts = 0;
+    }
+}
+
+static void vcr_add_point(float x, float y, float r, float g, float b, float a)
+{
+    float *dst_vert;
+    byte *dst_color;
+
+    if (tess.numverts == TESS_MAX_VERTICES) {
+        vcr_flush_points();
+    }
+
+    dst_vert = tess.vertices + tess.numverts * 2;
+    dst_color = tess.colors + tess.numverts * 4;
+    dst_vert[0] = x;
+    dst_vert[1] = y;
+    dst_color[0] = (byte)(r * 255);
+    dst_color[1] = (byte)(g * 255);
+    dst_color[2] = (byte)(b * 255);
+    dst_color[3] = (byte)(clamp(a, 0, 1) * 255);
+    tess.numverts++;
+}
+
+static void vcr_batch_rect(vcr_batch_t *batch, float x, float y, float w, float h,
+                           float r, float g, float b, float a)
+{
+    float *dst_vert;
+    uint32_t *dst_color;
+    color_t color;
+
+    if (batch->numrects == VCR_MAX_BATCH_RECTS) {
+        return;
+    }
+
+    color.u8[0] = (byte)(r * 255);
+    color.u8[1] = (byte)(g * 255);
+    color.u8[2] = (byte)(b * 255);
+    color.u8[3] = (byte)(a * 255);
+
+    dst_vert = batch->verts + batch->numrects * 8;
+    dst_color = (uint32_t *)batch->colors + batch->numrects * 4;
+    Vector4Set(dst_vert,     x,     y,     x + w, y);
+    Vector4Set(dst_vert + 4, x + w, y + h, x,     y + h);
+    dst_color[0] = dst_color[1] = dst_color[2] = dst_color[3] = color.u32;
+    batch->numrects++;
+}
+
+static void vcr_batch_draw(const vcr_batch_t *batch)
+{
+    if (batch->numrects) {
+        GL_Flush2D();
+        vcr_draw_arrays(GL_QUADS, batch->verts, batch->colors, batch->numrects * 4);
+    }
+}
+
+/*
+ * Draws one noise texture over the screen at a random offset. Density is
+ * the fraction of texel sized cells that should light up; it is selected
+ * with the alpha test among the texels that carry noise.
+ */
+static void vcr_draw_noise_layer(vcr_noise_t type, float texel_size,
+                                 float density, float r, float g, float b, float a)
+{
+    float frac, tile, s, t;
+    float verts[16];
+    
+    if (!vcr.noise_size || a <= 0.0f) return;
+    
+    frac = density / vcr_noise_density[type];
+    if (frac <= 0.0f) return;
+    if (frac > 1.0f) frac = 1.0f;
+    
+    tile = vcr.noise_size * texel_size;
+    s = vcr_rand_float();
+    t = vcr_rand_float();
+    
+    Vector4Set(verts,      0,                0,                 s,                       t);
+    Vector4Set(verts +  4, (float)vcr.width, 0,                 s + vcr.width / tile,    t);
+    Vector4Set(verts +  8, (float)vcr.width, (float)vcr.height, s + vcr.width / tile,    t + vcr.height / tile);
+    Vector4Set(verts + 12, 0,                (float)vcr.height, s,                       t + vcr.height / tile);
+    
+    GL_Flush2D();
+    vcr_gl_state(TEXNUM_VCR_GRAIN + type, GLS_BLEND_BLEND | GLS_ALPHATEST_ENABLE);
+    qglAlphaFunc(GL_GREATER, (1.0f - frac) * a);
+    qglColor4f(r, g, b, a);
+    
+    qglTexCoordPointer(2, GL_FLOAT, 16, verts + 2);
+    qglVertexPointer(2, GL_FLOAT, 16, verts);
+    qglDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    
+    /* Back to the reference value set by GL_SetDefaultState */
+    qglAlphaFunc(GL_GREATER, 0.666f);
 }
 
 /* Simple bitmap font rendering for REC and timestamp */
@@ -273,13 +852,7 @@ static void vcr_draw_char(float x, float y, char c, float size, float r, float g
     };
     
     /* For now, draw a simple rectangle per character */
-    glColor4f(r, g, b, a);
-    glBegin(GL_QUADS);
-    glVertex2f(x, y);
-    glVertex2f(x + size * 0.6f, y);
-    glVertex2f(x + size * 0.6f, y + size);
-    glVertex2f(x, y + size);
-    glEnd();
+    vcr_draw_rect(x, y, size * 0.6f, size, r, g, b, a);
 }
 
 static void vcr_draw_text(float x, float y, const char *text, float size, 
@@ -316,7 +889,7 @@ static void vcr_draw_desaturation(float intensity, float sepia_tint)
        This approach is compatible with all drivers and won't corrupt console text.
        
        Method: 
-       1. Darken image with MULTIPLY blend (reduces brightness)
+       1. Darken image (black at 1 - level alpha, same as a multiply by level)
        2. Add grey overlay to reduce color saturation perception
     */
     
@@ -324,116 +897,86 @@ static void vcr_draw_desaturation(float intensity, float sepia_tint)
     
     if (intensity <= 0.01f) return;
     
-    glDisable(GL_TEXTURE_2D);
-    
-    /* Step 1: Darken with MULTIPLY */
+    /* Step 1: Darken */
     /* At 50% intensity (normal): darken to 0.9 (90% brightness) */
     /* At 100% intensity (spike): darken to 0.5 (50% brightness) */
     darken_level = 1.0f - (intensity * 0.5f);
     if (darken_level < 0.5f) darken_level = 0.5f;
     
-    glBlendFunc(GL_DST_COLOR, GL_ZERO);
-    glColor4f(darken_level, darken_level, darken_level, 1.0f);
-    
-    glBegin(GL_QUADS);
-    glVertex2f(0.0f, 0.0f);
-    glVertex2f((float)vcr.width, 0.0f);
-    glVertex2f((float)vcr.width, (float)vcr.height);
-    glVertex2f(0.0f, (float)vcr.height);
-    glEnd();
+    vcr_draw_rect(0, 0, (float)vcr.width, (float)vcr.height,
+                  0.0f, 0.0f, 0.0f, 1.0f - darken_level);
     
     /* Step 2: Grey overlay to wash out colors */
     /* At 50% intensity (normal): 10% grey overlay */
     /* At 100% intensity (spike): 30% grey overlay */
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glColor4f(0.5f, 0.5f, 0.5f, intensity * 0.3f);
-    
-    glBegin(GL_QUADS);
-    glVertex2f(0.0f, 0.0f);
-    glVertex2f((float)vcr.width, 0.0f);
-    glVertex2f((float)vcr.width, (float)vcr.height);
-    glVertex2f(0.0f, (float)vcr.height);
-    glEnd();
+    vcr_draw_rect(0, 0, (float)vcr.width, (float)vcr.height,
+                  0.5f, 0.5f, 0.5f, intensity * 0.3f);
     
     /* Step 3: Add slight sepia/warmth if requested */
     if (sepia_tint > 0.01f) {
-        glColor4f(0.3f, 0.2f, 0.1f, sepia_tint * intensity * 0.2f);
-        
-        glBegin(GL_QUADS);
-        glVertex2f(0.0f, 0.0f);
-        glVertex2f((float)vcr.width, 0.0f);
-        glVertex2f((float)vcr.width, (float)vcr.height);
-        glVertex2f(0.0f, (float)vcr.height);
-        glEnd();
+        vcr_draw_rect(0, 0, (float)vcr.width, (float)vcr.height,
+                      0.3f, 0.2f, 0.1f, sepia_tint * intensity * 0.2f);
     }
 }
 
 static void vcr_draw_film_grain(float intensity, float quality_mult)
 {
-    int i;
-    int grain_count;
-    
     if (quality_mult <= 0.0f) return;
     
-    grain_count = (int)((vcr.width * vcr.height) / 2000 * quality_mult);
-    
-    glPointSize(1.0f);
-    glBegin(GL_POINTS);
-    
-    for (i = 0; i < grain_count; i++) {
-        float x = vcr_rand_float() * vcr.width;
-        float y = vcr_rand_float() * vcr.height;
-        float brightness = vcr_rand_float();
-        float alpha = intensity * (0.3f + brightness * 0.7f);
-        
-        if (brightness > 0.5f) {
-            glColor4f(1.0f, 1.0f, 1.0f, alpha);
-        } else {
-            glColor4f(0.0f, 0.0f, 0.0f, alpha);
-        }
-        glVertex2f(x, y);
+    /* One grain per 2000 pixels at full quality */
+    vcr_draw_noise_layer(VCR_NOISE_GRAIN, 1.0f, quality_mult / 2000.0f,
+                         1.0f, 1.0f, 1.0f, intensity);
+}
+
+static void vcr_build_scanlines(int skip)
+{
+    float *v = vcr.scanline_verts;
+    int y, count = 0;
+    
+    for (y = 0; y < vcr.height && count < VCR_MAX_SCANLINES; y += skip) {
+        v[0] = 0;
+        v[1] = (float)y;
+        v[2] = (float)vcr.width;
+        v[3] = (float)y;
+        v += 4;
+        count++;
     }
     
-    glEnd();
+    vcr.scanline_count = count;
+    vcr.scanline_width = vcr.width;
+    vcr.scanline_height = vcr.height;
+    vcr.scanline_skip = skip;
 }
 
 static void vcr_draw_scanlines(float alpha, int skip)
 {
-    int y;
-    
     if (skip < 1) skip = 2;
     
-    glColor4f(0.0f, 0.0f, 0.0f, alpha);
-    glBegin(GL_LINES);
-    
-    for (y = 0; y < vcr.height; y += skip) {
-        glVertex2f(0, (float)y);
-        glVertex2f((float)vcr.width, (float)y);
+    if (vcr.scanline_width != vcr.width || vcr.scanline_height != vcr.height ||
+        vcr.scanline_skip != skip) {
+        vcr_build_scanlines(skip);
     }
     
-    glEnd();
+    GL_Flush2D();
+    qglColor4f(0.0f, 0.0f, 0.0f, alpha);
+    vcr_draw_arrays(GL_LINES, vcr.scanline_verts, NULL, vcr.scanline_count * 2);
 }
 
 static void vcr_draw_noise_dots(int count, float base_alpha)
 {
-    int i;
+    float density;
     
     if (count <= 0) return;
     
-    glPointSize(2.0f);
-    glBegin(GL_POINTS);
-    
-    for (i = 0; i < count; i++) {
-        float x = vcr_rand_float() * vcr.width;
-        float y = vcr_rand_float() * vcr.height;
-        float brightness = 0.7f + vcr_rand_float() * 0.3f;
-        float alpha = base_alpha * (0.5f + vcr_rand_float() * 0.5f);
-        
-        glColor4f(brightness, brightness, brightness, alpha);
-        glVertex2f(x, y);
+    /* Dots are 2x2 pixels; keep at least one alpha step so low counts
+       don't vanish at high resolutions */
+    density = count / (vcr.width * vcr.height * 0.25f);
+    if (density < vcr_noise_density[VCR_NOISE_DOTS] / 255) {
+        density = vcr_noise_density[VCR_NOISE_DOTS] / 255;
     }
     
-    glEnd();
+    vcr_draw_noise_layer(VCR_NOISE_DOTS, 2.0f, density,
+                         1.0f, 1.0f, 1.0f, base_alpha);
 }
 
 static void vcr_draw_tracking_lines(float time)
@@ -441,7 +984,7 @@ static void vcr_draw_tracking_lines(float time)
     float band_height = VCR_TRACKING_LINE_HEIGHT;
     float y;
     
-    vcr.tracking_line_y += VCR_TRACKING_LINE_SPEED * 0.016f;
+    vcr.tracking_line_y += VCR_TRACKING_LINE_SPEED * vcr.frame_time;
     if (vcr.tracking_line_y > vcr.height + band_height) {
         vcr.tracking_line_y = -band_height;
     }
@@ -458,8 +1001,8 @@ static void vcr_apply_jitter(float intensity)
     float jitter_x = (vcr_rand_float() - 0.5f) * 2.0f * intensity;
     float jitter_y = (vcr_rand_float() - 0.5f) * 0.5f * intensity;
     
-    glMatrixMode(GL_MODELVIEW);
-    glTranslatef(jitter_x, jitter_y, 0);
+    GL_Flush2D();
+    qglTranslatef(jitter_x, jitter_y, 0);
 }
 
 static void vcr_draw_flicker(float intensity, float time)
@@ -501,7 +1044,6 @@ static void vcr_draw_cctv_overlay(float intensity, float time)
     max_dist = (float)sqrt(cx * cx + cy * cy);
     step = (int)preset->vignette_step;
     
-    glBegin(GL_QUADS);
     for (y = 0; y < vcr.height; y += step) {
         for (x = 0; x < vcr.width; x += step) {
             float fx = (float)x - cx;
@@ -509,14 +1051,10 @@ static void vcr_draw_cctv_overlay(float intensity, float time)
             dist = (float)sqrt(fx * fx + fy * fy) / max_dist;
             vignette_val = dist * dist * VCR_CCTV_VIGNETTE * intensity;
             
-            glColor4f(0.0f, 0.0f, 0.0f, vignette_val);
-            glVertex2f((float)x, (float)y);
-            glVertex2f((float)(x + step), (float)y);
-            glVertex2f((float)(x + step), (float)(y + step));
-            glVertex2f((float)x, (float)(y + step));
+            vcr_draw_rect((float)x, (float)y, (float)step, (float)step,
+                          0.0f, 0.0f, 0.0f, vignette_val);
         }
     }
-    glEnd();
     
     vcr_draw_noise_dots((int)(VCR_CCTV_NOISE_DOTS * preset->noise_mult), 0.8f);
 }
@@ -537,45 +1075,58 @@ static void vcr_draw_rec_indicator(float time)
     float x = 20.0f;
     float y = 20.0f;
     float dot_size = 8.0f;
+    vcr_batch_t *batch = &vcr.rec_batch;
+    static float dot_verts[18 * 2];
     
-    /* Red recording dot */
-    glColor4f(1.0f, 0.0f, 0.0f, alpha);
-    glBegin(GL_TRIANGLE_FAN);
-    {
+    /* Red recording dot, fan is built once */
+    if (!dot_verts[0]) {
         int i;
-        glVertex2f(x + dot_size/2, y + dot_size/2);
+        dot_verts[0] = x + dot_size/2;
+        dot_verts[1] = y + dot_size/2;
         for (i = 0; i <= 16; i++) {
             float angle = (float)i * 3.14159f * 2.0f / 16.0f;
-            glVertex2f(x + dot_size/2 + (float)cos(angle) * dot_size/2,
-                      y + dot_size/2 + (float)sin(angle) * dot_size/2);
+            dot_verts[i*2+2] = x + dot_size/2 + (float)cos(angle) * dot_size/2;
+            dot_verts[i*2+3] = y + dot_size/2 + (float)sin(angle) * dot_size/2;
         }
     }
-    glEnd();
+    GL_Flush2D();
+    qglColor4f(1.0f, 0.0f, 0.0f, alpha);
+    vcr_draw_arrays(GL_TRIANGLE_FAN, dot_verts, NULL, 18);
+    
+    /* REC label only changes when the blink state flips */
+    if (batch->numrects && vcr.rec_alpha == alpha) {
+        vcr_batch_draw(batch);
+        return;
+    }
+    
+    batch->numrects = 0;
+    vcr.rec_alpha = alpha;
     
     /* REC text */
-    vcr_draw_rect(x + 15, y, 30, 12, 1.0f, 0.0f, 0.0f, alpha * 0.8f);
-    vcr_draw_rect(x + 17, y + 2, 26, 8, 0.0f, 0.0f, 0.0f, 1.0f);
+    vcr_batch_rect(batch, x + 15, y, 30, 12, 1.0f, 0.0f, 0.0f, alpha * 0.8f);
+    vcr_batch_rect(batch, x + 17, y + 2, 26, 8, 0.0f, 0.0f, 0.0f, 1.0f);
     
     /* Simple "REC" letters - properly formed */
-    glColor4f(1.0f, 1.0f, 1.0f, alpha);
     
     /* R letter */
-    vcr_draw_rect(x + 19, y + 3, 2, 6, 1.0f, 1.0f, 1.0f, alpha); /* Left vertical */
-    vcr_draw_rect(x + 19, y + 3, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Top horizontal */
-    vcr_draw_rect(x + 23, y + 3, 1, 3, 1.0f, 1.0f, 1.0f, alpha); /* Right top vertical */
-    vcr_draw_rect(x + 19, y + 5, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Middle horizontal */
-    vcr_draw_rect(x + 22, y + 6, 2, 3, 1.0f, 1.0f, 1.0f, alpha); /* Diagonal leg (right bottom) */
+    vcr_batch_rect(batch, x + 19, y + 3, 2, 6, 1.0f, 1.0f, 1.0f, alpha); /* Left vertical */
+    vcr_batch_rect(batch, x + 19, y + 3, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Top horizontal */
+    vcr_batch_rect(batch, x + 23, y + 3, 1, 3, 1.0f, 1.0f, 1.0f, alpha); /* Right top vertical */
+    vcr_batch_rect(batch, x + 19, y + 5, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Middle horizontal */
+    vcr_batch_rect(batch, x + 22, y + 6, 2, 3, 1.0f, 1.0f, 1.0f, alpha); /* Diagonal leg (right bottom) */
     
     /* E letter */
-    vcr_draw_rect(x + 26, y + 3, 2, 6, 1.0f, 1.0f, 1.0f, alpha); /* Left vertical */
-    vcr_draw_rect(x + 26, y + 3, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Top horizontal */
-    vcr_draw_rect(x + 26, y + 5, 4, 1, 1.0f, 1.0f, 1.0f, alpha); /* Middle horizontal */
-    vcr_draw_rect(x + 26, y + 8, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Bottom horizontal */
+    vcr_batch_rect(batch, x + 26, y + 3, 2, 6, 1.0f, 1.0f, 1.0f, alpha); /* Left vertical */
+    vcr_batch_rect(batch, x + 26, y + 3, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Top horizontal */
+    vcr_batch_rect(batch, x + 26, y + 5, 4, 1, 1.0f, 1.0f, 1.0f, alpha); /* Middle horizontal */
+    vcr_batch_rect(batch, x + 26, y + 8, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Bottom horizontal */
     
     /* C letter */
-    vcr_draw_rect(x + 33, y + 3, 2, 6, 1.0f, 1.0f, 1.0f, alpha); /* Left vertical */
-    vcr_draw_rect(x + 33, y + 3, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Top horizontal */
-    vcr_draw_rect(x + 33, y + 8, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Bottom horizontal */
+    vcr_batch_rect(batch, x + 33, y + 3, 2, 6, 1.0f, 1.0f, 1.0f, alpha); /* Left vertical */
+    vcr_batch_rect(batch, x + 33, y + 3, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Top horizontal */
+    vcr_batch_rect(batch, x + 33, y + 8, 5, 1, 1.0f, 1.0f, 1.0f, alpha); /* Bottom horizontal */
+    
+    vcr_batch_draw(batch);
 }
 
 /*
@@ -585,7 +1136,7 @@ static void vcr_draw_rec_indicator(float time)
  */
 
 /* Draw a digit using simple segments (like a digital clock or VCR OSD) */
-static void vcr_draw_digit(float x, float y, float size, int digit)
+static void vcr_draw_digit(vcr_batch_t *batch, float x, float y, float size, int digit)
 {
     /* 
      * Segment Map:
@@ -615,13 +1166,13 @@ static void vcr_draw_digit(float x, float y, float size, int digit)
         case 9: segA=1; segB=1; segC=1; segD=1; segF=1; segG=1; break;
     }
     
-    if (segA) vcr_draw_rect(x, y, w, t, 1,1,1,0.9f);
-    if (segB) vcr_draw_rect(x+w-t, y, t, h/2, 1,1,1,0.9f);
-    if (segC) vcr_draw_rect(x+w-t, y+h/2, t, h/2, 1,1,1,0.9f);
-    if (segD) vcr_draw_rect(x, y+h-t, w, t, 1,1,1,0.9f);
-    if (segE) vcr_draw_rect(x, y+h/2, t, h/2, 1,1,1,0.9f);
-    if (segF) vcr_draw_rect(x, y, t, h/2, 1,1,1,0.9f);
-    if (segG) vcr_draw_rect(x, y+h/2-t/2, w, t, 1,1,1,0.9f);
+    if (segA) vcr_batch_rect(batch, x, y, w, t, 1,1,1,0.9f);
+    if (segB) vcr_batch_rect(batch, x+w-t, y, t, h/2, 1,1,1,0.9f);
+    if (segC) vcr_batch_rect(batch, x+w-t, y+h/2, t, h/2, 1,1,1,0.9f);
+    if (segD) vcr_batch_rect(batch, x, y+h-t, w, t, 1,1,1,0.9f);
+    if (segE) vcr_batch_rect(batch, x, y+h/2, t, h/2, 1,1,1,0.9f);
+    if (segF) vcr_batch_rect(batch, x, y, t, h/2, 1,1,1,0.9f);
+    if (segG) vcr_batch_rect(batch, x, y+h/2-t/2, w, t, 1,1,1,0.9f);
 }
 
 /* VHS timestamp overlay */
@@ -630,14 +1181,28 @@ static void vcr_draw_timestamp(float time_unused)
     /* Position at bottom-right */
     float x = vcr.width - 240.0f;
     float y = vcr.height - 30.0f;
+    vcr_batch_t *batch = &vcr.timestamp_batch;
     time_t rawtime;
     struct tm * t;
     
+    /* Displayed text only changes once a second */
     time(&rawtime);
+    if (batch->numrects && rawtime == vcr.timestamp_time &&
+        vcr.width == vcr.timestamp_width && vcr.height == vcr.timestamp_height) {
+        vcr_batch_draw(batch);
+        return;
+    }
+    
     t = localtime(&rawtime);
+    if (!t) return;
+    
+    batch->numrects = 0;
+    vcr.timestamp_time = rawtime;
+    vcr.timestamp_width = vcr.width;
+    vcr.timestamp_height = vcr.height;
     
     /* Background */
-    vcr_draw_rect(x - 5, y - 5, 235, 24, 0.0f, 0.0f, 0.0f, 0.5f);
+    vcr_batch_rect(batch, x - 5, y - 5, 235, 24, 0.0f, 0.0f, 0.0f, 0.5f);
     
     /* Draw Date: MM-DD-2007 (Force 2007) */
     /* Using segment digits. Digit size 12. */
@@ -647,56 +1212,46 @@ static void vcr_draw_timestamp(float time_unused)
     
     /* Month */
     int mon = t->tm_mon + 1;
-    vcr_draw_digit(dx, dy, ds, mon / 10); dx += 10;
-    vcr_draw_digit(dx, dy, ds, mon % 10); dx += 10;
-    vcr_draw_rect(dx+2, dy+5, 4, 2, 1,1,1,0.9f); dx += 10; /* Dash */
+    vcr_draw_digit(batch, dx, dy, ds, mon / 10); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, mon % 10); dx += 10;
+    vcr_batch_rect(batch, dx+2, dy+5, 4, 2, 1,1,1,0.9f); dx += 10; /* Dash */
     
     /* Day */
-    vcr_draw_digit(dx, dy, ds, t->tm_mday / 10); dx += 10;
-    vcr_draw_digit(dx, dy, ds, t->tm_mday % 10); dx += 10;
-    vcr_draw_rect(dx+2, dy+5, 4, 2, 1,1,1,0.9f); dx += 10; /* Dash */
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_mday / 10); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_mday % 10); dx += 10;
+    vcr_batch_rect(batch, dx+2, dy+5, 4, 2, 1,1,1,0.9f); dx += 10; /* Dash */
     
     /* Year (Fixed 2007) */
-    vcr_draw_digit(dx, dy, ds, 2); dx += 10;
-    vcr_draw_digit(dx, dy, ds, 0); dx += 10;
-    vcr_draw_digit(dx, dy, ds, 0); dx += 10;
-    vcr_draw_digit(dx, dy, ds, 7); dx += 20; /* Space */
+    vcr_draw_digit(batch, dx, dy, ds, 2); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, 0); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, 0); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, 7); dx += 20; /* Space */
     
     /* Time: HH:MM:SS */
-    vcr_draw_digit(dx, dy, ds, t->tm_hour / 10); dx += 10;
-    vcr_draw_digit(dx, dy, ds, t->tm_hour % 10); dx += 10;
-    vcr_draw_rect(dx+2, dy+3, 2, 2, 1,1,1,0.9f); /* Colon dots */
-    vcr_draw_rect(dx+2, dy+8, 2, 2, 1,1,1,0.9f); dx += 8;
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_hour / 10); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_hour % 10); dx += 10;
+    vcr_batch_rect(batch, dx+2, dy+3, 2, 2, 1,1,1,0.9f); /* Colon dots */
+    vcr_batch_rect(batch, dx+2, dy+8, 2, 2, 1,1,1,0.9f); dx += 8;
+    
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_min / 10); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_min % 10); dx += 10;
+    vcr_batch_rect(batch, dx+2, dy+3, 2, 2, 1,1,1,0.9f);
+    vcr_batch_rect(batch, dx+2, dy+8, 2, 2, 1,1,1,0.9f); dx += 8;
     
-    vcr_draw_digit(dx, dy, ds, t->tm_min / 10); dx += 10;
-    vcr_draw_digit(dx, dy, ds, t->tm_min % 10); dx += 10;
-    vcr_draw_rect(dx+2, dy+3, 2, 2, 1,1,1,0.9f);
-    vcr_draw_rect(dx+2, dy+8, 2, 2, 1,1,1,0.9f); dx += 8;
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_sec / 10); dx += 10;
+    vcr_draw_digit(batch, dx, dy, ds, t->tm_sec % 10);
     
-    vcr_draw_digit(dx, dy, ds, t->tm_sec / 10); dx += 10;
-    vcr_draw_digit(dx, dy, ds, t->tm_sec % 10);
+    vcr_batch_draw(batch);
 }
 
 /* Full-screen static burst */
 static void vcr_draw_static_burst(float intensity)
 {
     int i;
-    int static_count = (vcr.width * vcr.height) / 50;
-    
-    /* Heavy noise */
-    glPointSize(2.0f);
-    glBegin(GL_POINTS);
-    
-    for (i = 0; i < static_count; i++) {
-        float x = vcr_rand_float() * vcr.width;
-        float y = vcr_rand_float() * vcr.height;
-        float brightness = vcr_rand_float();
-        
-        glColor4f(brightness, brightness, brightness, intensity);
-        glVertex2f(x, y);
-    }
     
-    glEnd();
+    /* Heavy noise, one 2x2 dot per 50 pixels */
+    vcr_draw_noise_layer(VCR_NOISE_STATIC, 2.0f, 4.0f / 50.0f,
+                         1.0f, 1.0f, 1.0f, intensity);
     
     /* Horizontal tear lines */
     for (i = 0; i < 5; i++) {
@@ -722,16 +1277,14 @@ static void vcr_draw_tape_damage(float intensity)
         /* Random noise in band */
         int dots = 20 + vcr_rand_int(30);
         int j;
-        glPointSize(1.0f);
-        glBegin(GL_POINTS);
+        vcr_begin_points(1.0f);
         for (j = 0; j < dots; j++) {
             float dx = vcr_rand_float() * vcr.width;
             float dy = y + vcr_rand_float() * corrupt_height;
             float b = vcr_rand_float();
-            glColor4f(b, b, b, intensity);
-            glVertex2f(dx, dy);
+            vcr_add_point(dx, dy, b, b, b, intensity);
         }
-        glEnd();
+        vcr_flush_points();
         
         /* Color fringe */
         vcr_draw_rect(vcr_rand_float() * 5, y - 1, (float)vcr.width, 1, 
@@ -740,7 +1293,7 @@ static void vcr_draw_tape_damage(float intensity)
                       0.0f, 1.0f, 1.0f, intensity * 0.3f);
         
         /* Move damage line */
-        vcr.damage_line_y[i] += 30.0f * 0.016f;
+        vcr.damage_line_y[i] += 30.0f * vcr.frame_time;
         if (vcr.damage_line_y[i] > vcr.height + 10) {
             vcr.damage_line_y[i] = -10 - vcr_rand_float() * 50;
         }
@@ -799,74 +1352,1395 @@ static void vcr_draw_chromatic_aberration(float intensity)
 
 /*
  * =============================================================================
- *  PUBLIC API
+ *  REDUCED RESOLUTION NOISE LAYERS
  * =============================================================================
+ *
+ * Without a fragment program the grain and dot layers are full-screen
+ * blended passes. With vcr_offscreen they are drawn into the bottom-left
+ * 1/divisor corner of the back buffer over a 50% grey clear, copied into
+ * TEXNUM_VCR_OVERLAY and applied with one bilinear quad using a 2x
+ * modulate blend (grey leaves the scene unchanged). The scene under the
+ * corner is saved to vcr.screen_tex first and put back afterwards.
  */
 
-void VCR_Init(void)
+static int vcr_overlay_divisor(const vcr_quality_preset_t *preset)
 {
-    int i;
-    
-    memset(&vcr, 0, sizeof(vcr));
-    
-    vcr.initialized = qtrue;
-    vcr.cctv_start_time = -1.0f;
-    vcr.static_start_time = -1.0f;
-    vcr.tape_damage_start = -1.0f;
-    vcr.frame_drop_start = -1.0f;
-    vcr.battery_level = 0.75f;  /* 75% per client request */
-    vcr.tracking_line_y = 0.0f;
-    
-    /* Initialize tape damage line positions */
-    for (i = 0; i < 10; i++) {
-        vcr.damage_line_y[i] = -50 - (float)i * 30;
+    if (!CVAR_INT(vcr_offscreen)) {
+        return 1;
     }
-    
-    vcr_rand_seed((unsigned)(size_t)&vcr ^ 0x12345678);
-
-    /* REGISTER CVARS WITH ENGINE */
-    vcr_enabled = Cvar_Get("vcr_enabled", "1", CVAR_ARCHIVE);
-    vcr_quality = Cvar_Get("vcr_quality", "2", CVAR_ARCHIVE); // High default
-    vcr_mode = Cvar_Get("vcr_mode", "0", CVAR_ARCHIVE);
-    
-    // Feature toggles
-    vcr_rec_indicator = Cvar_Get("vcr_rec_indicator", "1", CVAR_ARCHIVE);
-    vcr_timestamp = Cvar_Get("vcr_timestamp", "1", CVAR_ARCHIVE);
-    vcr_tracking_lines = Cvar_Get("vcr_tracking_lines", "1", CVAR_ARCHIVE);
-    vcr_static_bursts = Cvar_Get("vcr_static_bursts", "1", CVAR_ARCHIVE);
-    vcr_debug = Cvar_Get("vcr_debug", "0", 0);
+    return preset->overlay_divisor;
+}
 
-    // Advanced tuning (non-archive by default to reset on restart)
-    // Default 0.5 per user requirement (50% B&W)
-    vcr_desaturation = Cvar_Get("vcr_desaturation", "0.5", 0);
-    vcr_noise_dots = Cvar_Get("vcr_noise_dots", "1.0", 0);
-    vcr_grain_intensity = Cvar_Get("vcr_grain_intensity", "1.0", 0);
-    vcr_scanline_alpha = Cvar_Get("vcr_scanline_alpha", "1.0", 0);
-    vcr_distortion_interval = Cvar_Get("vcr_distortion_interval", "20.0", 0);
-    vcr_distortion_duration = Cvar_Get("vcr_distortion_duration", "1.5", 0);
-    vcr_cctv_chance = Cvar_Get("vcr_cctv_chance", "0.3", 0);
-    
-    /* Create texture for B&W capture */
-    glGenTextures(1, &vcr.screen_tex);
-    glBindTexture(GL_TEXTURE_2D, vcr.screen_tex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    /* Increment generation counter to signal desaturation function to reset its cache */
-    vcr.tex_generation++;
-    
-    Com_Printf("VCR Effect Initialized. Type 'vcr_mode 1' for CCTV.\n");
+/* Quad over the corner region, in overlay units */
+static void vcr_draw_region(float s, float t)
+{
+    float sx = (float)vcr.width / r_config.width;
+    float sy = (float)vcr.height / r_config.height;
+    float x1 = vcr.overlay_region_w * sx;
+    float y0 = (r_config.height - vcr.overlay_region_h) * sy;
+    float y1 = (float)vcr.height;
+    float verts[16];
+
+    Vector4Set(verts,      0,  y0, 0, t);
+    Vector4Set(verts +  4, x1, y0, s, t);
+    Vector4Set(verts +  8, x1, y1, s, 0);
+    Vector4Set(verts + 12, 0,  y1, 0, 0);
+
+    qglTexCoordPointer(2, GL_FLOAT, 16, verts + 2);
+    qglVertexPointer(2, GL_FLOAT, 16, verts);
+    qglDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
-void VCR_Shutdown(void)
+static qboolean vcr_begin_offscreen(int divisor)
 {
-    if (vcr.screen_tex) {
-        glDeleteTextures(1, &vcr.screen_tex);
-        vcr.screen_tex = 0;
+    int w = r_config.width / divisor;
+    int h = r_config.height / divisor;
+
+    if (divisor < 2 || w < 1 || h < 1) {
+        return qfalse;
+    }
+
+    if (!vcr_bind_target(TEXNUM_VCR_OVERLAY, &vcr.overlay_width,
+                         &vcr.overlay_height, w, h, GL_LINEAR)) {
+        return qfalse;
+    }
+
+    GL_Flush2D();
+
+    /* Save the scene under the corner */
+    if (!vcr_bind_target(vcr.screen_tex, &vcr.capture_width,
+                         &vcr.capture_height, w, h, GL_NEAREST)) {
+        return qfalse;
+    }
+    qglCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+
+    vcr.overlay_region_w = w;
+    vcr.overlay_region_h = h;
+
+    /* Neutral grey for the 2x modulate composite */
+    qglEnable(GL_SCISSOR_TEST);
+    qglScissor(0, 0, w, h);
+    qglClearColor(0.5f, 0.5f, 0.5f, 1);
+    qglClear(GL_COLOR_BUFFER_BIT);
+    qglClearColor(0, 0, 0, 1);
+    qglDisable(GL_SCISSOR_TEST);
+
+    /* Same projection, squeezed into the corner */
+    qglViewport(0, 0, w, h);
+    return qtrue;
+}
+
+static void vcr_end_offscreen(void)
+{
+    int w = vcr.overlay_region_w;
+    int h = vcr.overlay_region_h;
+
+    GL_Flush2D();
+
+    GL_BindTexture(TEXNUM_VCR_OVERLAY);
+    qglCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+
+    qglViewport(0, 0, r_config.width, r_config.height);
+
+    /* Put the scene back */
+    vcr_gl_state(vcr.screen_tex, 0);
+    qglColor4f(1, 1, 1, 1);
+    vcr_draw_region((float)w / vcr.capture_width, (float)h / vcr.capture_height);
+}
+
+static void vcr_draw_offscreen(void)
+{
+    float s = (float)vcr.overlay_region_w / vcr.overlay_width;
+    float t = (float)vcr.overlay_region_h / vcr.overlay_height;
+    float verts[16];
+
+    Vector4Set(verts,      0,                0,                 0, t);
+    Vector4Set(verts +  4, (float)vcr.width, 0,                 s, t);
+    Vector4Set(verts +  8, (float)vcr.width, (float)vcr.height, s, 0);
+    Vector4Set(verts + 12, 0,                (float)vcr.height, 0, 0);
+
+    GL_Flush2D();
+    vcr_gl_state(TEXNUM_VCR_OVERLAY, GLS_BLEND_BLEND);
+    qglBlendFunc(GL_DST_COLOR, GL_SRC_COLOR);
+    qglColor4f(1, 1, 1, 1);
+
+    qglTexCoordPointer(2, GL_FLOAT, 16, verts + 2);
+    qglVertexPointer(2, GL_FLOAT, 16, verts);
+    qglDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    /* Back to what GL_Bits set for GLS_BLEND_BLEND */
+    qglBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+
+/*
+ * =============================================================================
+ *  FRAGMENT PROGRAM COMPOSITE
+ * =============================================================================
+ *
+ * All full-screen layers (desaturation, grain, noise dots, scanlines,
+ * tracking band and chromatic split) are evaluated by gl_prog_vcr in a
+ * single pass over a copy of the color buffer. Program locals:
+ *
+ *   local[0]  desaturation, darken, grey wash alpha, sepia alpha
+ *   local[1]  grain threshold, 1 / grain density, grain alpha, seed
+ *   local[2]  dot threshold, dot alpha, dot brightness, seed
+ *   local[3]  1 / scanline period, scanline alpha, scanline phase
+ *   local[4]  band bottom, band top (window pixels), band alpha,
+ *             chromatic shift (texcoord units)
+ */
+
+typedef struct {
+    float desaturation;
+    float grain_alpha;
+    float grain_density;    /* Fraction of pixels hit by grain */
+    int   dots;
+    int   scanline_skip;
+    float scanline_alpha;
+    float band_y;           /* Top of tracking band in overlay units */
+    float band_alpha;
+    float jitter;           /* Horizontal jitter in pixels */
+    float chroma;           /* Chromatic split, fraction of screen width */
+} vcr_composite_t;
+
+static qboolean vcr_use_program(void)
+{
+    if (!gl_static.prognum_vcr) {
+        return qfalse;
+    }
+    return CVAR_INT(vcr_shader) != 0;
+}
+
+static qboolean vcr_capture_screen(void)
+{
+    int w = r_config.width;
+    int h = r_config.height;
+
+    if (!vcr_bind_target(vcr.screen_tex, &vcr.capture_width,
+                         &vcr.capture_height, w, h, GL_NEAREST)) {
+        return qfalse;
+    }
+
+    qglCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+    return qtrue;
+}
+
+static void vcr_draw_composite(const vcr_composite_t *cp)
+{
+    float w = (float)r_config.width;
+    float h = (float)r_config.height;
+    float s = w / vcr.capture_width;
+    float t = h / vcr.capture_height;
+    float scale_y = h / vcr.height;
+    float js = 0, jt = 0;
+    float verts[16];
+    float density, param[4];
+
+    if (cp->jitter > 0.0f) {
+        js = (vcr_rand_float() - 0.5f) * 2.0f * cp->jitter / vcr.capture_width;
+        jt = (vcr_rand_float() - 0.5f) * 0.5f * cp->jitter / vcr.capture_height;
+    }
+
+    /* Top-left of the overlay samples the top of the captured buffer */
+    Vector4Set(verts,      0, 0, js,     t + jt);
+    Vector4Set(verts +  4, w, 0, s + js, t + jt);
+    Vector4Set(verts +  8, w, h, s + js, jt);
+    Vector4Set(verts + 12, 0, h, js,     jt);
+
+    qglEnable(GL_FRAGMENT_PROGRAM_ARB);
+    qglBindProgramARB(GL_FRAGMENT_PROGRAM_ARB, gl_static.prognum_vcr);
+
+    param[0] = cp->desaturation;
+    param[1] = 1.0f - cp->desaturation * 0.5f;
+    if (param[1] < 0.5f) param[1] = 0.5f;
+    param[2] = cp->desaturation * 0.3f;
+    param[3] = VCR_SEPIA_TINT * cp->desaturation * 0.2f;
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 0, param);
+
+    density = cp->grain_density;
+    if (density > 0.0f) {
+        param[0] = 1.0f - density;
+        param[1] = 1.0f / density;
+    } else {
+        param[0] = 2.0f;
+        param[1] = 0.0f;
+    }
+    param[2] = cp->grain_alpha;
+    param[3] = vcr_rand_float();
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 1, param);
+
+    /* Dots are 2x2 pixels, so density is per 2x2 cell */
+    density = cp->dots / (w * h * 0.25f);
+    param[0] = density > 0.0f ? 1.0f - density : 2.0f;
+    param[1] = 0.375f;
+    param[2] = 0.85f;
+    param[3] = vcr_rand_float();
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 2, param);
+
+    param[0] = 1.0f / (cp->scanline_skip * scale_y);
+    param[1] = cp->scanline_alpha;
+    param[2] = (0.5f - h) * param[0] + param[0] * 0.5f;
+    param[3] = 0;
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 3, param);
+
+    param[0] = h - (cp->band_y + VCR_TRACKING_LINE_HEIGHT) * scale_y;
+    param[1] = h - cp->band_y * scale_y;
+    param[2] = cp->band_alpha;
+    param[3] = cp->chroma * s;
+    qglProgramLocalParameter4fvARB(GL_FRAGMENT_PROGRAM_ARB, 4, param);
+
+    GL_TexEnv(GL_REPLACE);
+    GL_Bits(GLS_DEPTHTEST_DISABLE);
+    qglColor4f(1, 1, 1, 1);
+
+    qglTexCoordPointer(2, GL_FLOAT, 16, verts + 2);
+    qglVertexPointer(2, GL_FLOAT, 16, verts);
+    qglDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    qglBindProgramARB(GL_FRAGMENT_PROGRAM_ARB, 0);
+    qglDisable(GL_FRAGMENT_PROGRAM_ARB);
+}
+
+
+/*
+ * =============================================================================
+ *  REWIND RING
+ * =============================================================================
+ *
+ * VCR_REWIND_FPS times a second the clean scene is copied to
+ * vcr.screen_tex, drawn squeezed into the bottom-left corner of the back
+ * buffer and copied into the next cell of TEXNUM_VCR_REWIND, after which
+ * the corner is put back. Frames never leave the GPU. vcr_rewind plays
+ * the ring backwards over the scene, under the usual effect layers.
+ */
+
+/* Textured quad in window pixels, t runs up like the color buffer */
+static void vcr_draw_window_quad(float x0, float y0, float x1, float y1,
+                                 float s0, float t0, float s1, float t1)
+{
+    float verts[16];
+
+    Vector4Set(verts,      x0, y0, s0, t1);
+    Vector4Set(verts +  4, x1, y0, s1, t1);
+    Vector4Set(verts +  8, x1, y1, s1, t0);
+    Vector4Set(verts + 12, x0, y1, s0, t0);
+
+    qglTexCoordPointer(2, GL_FLOAT, 16, verts + 2);
+    qglVertexPointer(2, GL_FLOAT, 16, verts);
+    qglDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+static void vcr_rewind_capture(float time)
+{
+    float w = (float)r_config.width;
+    float h = (float)r_config.height;
+    int cw = VCR_REWIND_CELL_W;
+    int ch = VCR_REWIND_CELL_H;
+    int cell = vcr.rewind_head;
+
+    if (time < vcr.rewind_next) {
+        return;
+    }
+    vcr.rewind_next = time + 1.0f / VCR_REWIND_FPS;
+
+    if (r_config.width < cw || r_config.height < ch) {
+        return;
+    }
+
+    /* Lost with the textures on vid_restart */
+    if (!qglIsTexture(TEXNUM_VCR_REWIND)) {
+        vcr.rewind_count = 0;
+    }
+    if (!vcr_bind_target(TEXNUM_VCR_REWIND, &vcr.rewind_width, &vcr.rewind_height,
+                         cw * VCR_REWIND_COLS, ch * VCR_REWIND_ROWS, GL_LINEAR)) {
+        return;
+    }
+
+    GL_Flush2D();
+    if (!vcr_capture_screen()) {
+        return;
+    }
+
+    /* Whole scene into the corner, filtered */
+    vcr_gl_state(vcr.screen_tex, 0);
+    qglColor4f(1, 1, 1, 1);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    qglViewport(0, 0, cw, ch);
+    vcr_draw_window_quad(0, 0, w, h, 0, 0,
+                         w / vcr.capture_width, h / vcr.capture_height);
+    qglViewport(0, 0, r_config.width, r_config.height);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    GL_BindTexture(TEXNUM_VCR_REWIND);
+    qglCopyTexSubImage2D(GL_TEXTURE_2D, 0, (cell % VCR_REWIND_COLS) * cw,
+                         (cell / VCR_REWIND_COLS) * ch, 0, 0, cw, ch);
+
+    /* Put the corner back */
+    GL_BindTexture(vcr.screen_tex);
+    vcr_draw_window_quad(0, h - ch, (float)cw, h, 0, 0,
+                         (float)cw / vcr.capture_width, (float)ch / vcr.capture_height);
+
+    vcr.rewind_head = (cell + 1) % VCR_REWIND_FRAMES;
+    if (vcr.rewind_count < VCR_REWIND_FRAMES) {
+        vcr.rewind_count++;
+    }
+}
+
+/* Replaces the scene with the current rewind frame, if playing */
+static qboolean vcr_rewind_draw(float time)
+{
+    int frame, cell;
+    float s0, t0, s1, t1;
+
+    if (vcr.rewind_start < 0) {
+        return qfalse;
+    }
+
+    frame = (int)((time - vcr.rewind_start) * VCR_REWIND_FPS * VCR_REWIND_SPEED);
+    if (frame < 0 || frame >= vcr.rewind_frames || !qglIsTexture(TEXNUM_VCR_REWIND)) {
+        /* Frames recorded after the rewind point are gone */
+        vcr.rewind_start = -1;
+        vcr.rewind_count = 0;
+        return qfalse;
+    }
+
+    cell = (vcr.rewind_head - 1 - frame + VCR_REWIND_FRAMES) % VCR_REWIND_FRAMES;
+    s0 = (float)(cell % VCR_REWIND_COLS) * VCR_REWIND_CELL_W / vcr.rewind_width;
+    t0 = (float)(cell / VCR_REWIND_COLS) * VCR_REWIND_CELL_H / vcr.rewind_height;
+    s1 = s0 + (float)VCR_REWIND_CELL_W / vcr.rewind_width;
+    t1 = t0 + (float)VCR_REWIND_CELL_H / vcr.rewind_height;
+
+    GL_Flush2D();
+    vcr_gl_state(TEXNUM_VCR_REWIND, 0);
+    qglColor4f(1, 1, 1, 1);
+    vcr_draw_window_quad(0, 0, (float)r_config.width, (float)r_config.height,
+                         s0, t0, s1, t1);
+    return qtrue;
+}
+
+static void vcr_rewind_f(void)
+{
+    float seconds = VCR_REWIND_FRAMES / VCR_REWIND_FPS;
+    int frames;
+
+    if (Cmd_Argc() > 1) {
+        seconds = atof(Cmd_Argv(1));
+    }
+
+    frames = (int)(seconds * VCR_REWIND_FPS);
+    if (frames > vcr.rewind_count) {
+        frames = vcr.rewind_count;
+    }
+    if (frames < 1) {
+        Com_Printf("Nothing recorded to rewind.\n");
+        return;
+    }
+
+    vcr.rewind_frames = frames;
+    vcr.rewind_start = vcr.current_time;
+}
+
+
+/*
+ * =============================================================================
+ *  TAPE GHOSTING
+ * =============================================================================
+ *
+ * Two framebuffer objects at 1/VCR_GHOST_DIVISOR of the screen size take
+ * turns as render target. Each frame the clean scene copy is drawn into
+ * one and the other, holding the previous result, is blended over it
+ * drifting right, so old frames fade out as a smeared trail. The result is
+ * then blended over the back buffer under the other layers. Everything
+ * stays on the GPU; without GL_EXT_framebuffer_object the layer is off.
+ */
+
+static qboolean vcr_ghost_available(const vcr_quality_preset_t *preset)
+{
+    if (preset->ghosting <= 0 || !CVAR_INT(vcr_ghosting) || vcr.ghost_failed) {
+        return qfalse;
+    }
+    return (gl_config.ext_enabled & QGL_EXT_framebuffer_object) != 0;
+}
+
+/* Sizes target i for w x h, attaching it again when (re)allocated */
+static qboolean vcr_ghost_target(int i, int w, int h)
+{
+    int texnum = TEXNUM_VCR_GHOST + i;
+    int tex_w = vcr.ghost_width[i];
+    int tex_h = vcr.ghost_height[i];
+    qboolean lost = !qglIsTexture(texnum);
+    GLenum status;
+
+    if (!vcr_bind_target(texnum, &vcr.ghost_width[i], &vcr.ghost_height[i],
+                         w, h, GL_LINEAR)) {
+        return qfalse;
+    }
+
+    if (!lost && vcr.ghost_fbo[i] && vcr.ghost_width[i] == tex_w &&
+        vcr.ghost_height[i] == tex_h) {
+        return qtrue;
+    }
+
+    if (!vcr.ghost_fbo[i]) {
+        qglGenFramebuffersEXT(1, &vcr.ghost_fbo[i]);
+    }
+    qglBindFramebufferEXT(GL_FRAMEBUFFER_EXT, vcr.ghost_fbo[i]);
+    qglFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                               GL_TEXTURE_2D, texnum, 0);
+    status = qglCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+    qglBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE_EXT) {
+        Com_WPrintf("VCR ghosting disabled, framebuffer status 0x%x\n", status);
+        vcr.ghost_failed = qtrue;
+        return qfalse;
+    }
+
+    /* Contents are undefined until written */
+    vcr.ghost_valid = qfalse;
+    return qtrue;
+}
+
+/* Renders this frame's trail into the other target */
+static qboolean vcr_ghost_update(const vcr_quality_preset_t *preset)
+{
+    float w = (float)r_config.width;
+    float h = (float)r_config.height;
+    int gw = r_config.width / VCR_GHOST_DIVISOR;
+    int gh = r_config.height / VCR_GHOST_DIVISOR;
+    int last = vcr.ghost_last;
+    int next = last ^ 1;
+    float keep = preset->ghosting;
+    float shift = VCR_GHOST_SHIFT;
+
+    if (!vcr_ghost_available(preset)) {
+        vcr.ghost_valid = qfalse;
+        return qfalse;
+    }
+
+    if (gw < 1 || gh < 1 || !vcr_ghost_target(next, gw, gh) ||
+        !vcr_ghost_target(last, gw, gh)) {
+        return qfalse;
+    }
+
+    GL_Flush2D();
+    if (!vcr_capture_screen()) {
+        return qfalse;
+    }
+
+    /* Same fade and drift per second at any frame rate */
+    if (vcr.frame_time > 0) {
+        keep = (float)pow(keep, vcr.frame_time * 60.0f);
+        shift *= vcr.frame_time * 60.0f;
+    }
+
+    qglBindFramebufferEXT(GL_FRAMEBUFFER_EXT, vcr.ghost_fbo[next]);
+    qglViewport(0, 0, gw, gh);
+
+    /* Clean scene, filtered down */
+    vcr_gl_state(vcr.screen_tex, 0);
+    qglColor4f(1, 1, 1, 1);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    vcr_draw_window_quad(0, 0, w, h, 0, 0,
+                         w / vcr.capture_width, h / vcr.capture_height);
+    qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    /* Previous result over it */
+    if (vcr.ghost_valid) {
+        vcr_gl_state(TEXNUM_VCR_GHOST + last, GLS_BLEND_BLEND);
+        qglColor4f(1, 1, 1, keep);
+        vcr_draw_window_quad(shift, 0, w + shift, h, 0, 0,
+                             (float)gw / vcr.ghost_width[last],
+                             (float)gh / vcr.ghost_height[last]);
+    }
+
+    qglBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    qglViewport(0, 0, r_config.width, r_config.height);
+
+    vcr.ghost_last = next;
+    vcr.ghost_valid = qtrue;
+    return qtrue;
+}
+
+static void vcr_ghost_draw(void)
+{
+    int last = vcr.ghost_last;
+    float s = (float)(r_config.width / VCR_GHOST_DIVISOR) / vcr.ghost_width[last];
+    float t = (float)(r_config.height / VCR_GHOST_DIVISOR) / vcr.ghost_height[last];
+
+    vcr_gl_state(TEXNUM_VCR_GHOST + last, GLS_BLEND_BLEND);
+    qglColor4f(1, 1, 1, VCR_GHOST_ALPHA);
+    vcr_draw_window_quad(0, 0, (float)r_config.width, (float)r_config.height,
+                         0, 0, s, t);
+}
+
+static void vcr_ghost_shutdown(void)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (vcr.ghost_fbo[i] && qglDeleteFramebuffersEXT) {
+            qglDeleteFramebuffersEXT(1, &vcr.ghost_fbo[i]);
+        }
+        vcr.ghost_fbo[i] = 0;
+        vcr.ghost_width[i] = vcr.ghost_height[i] = 0;
+    }
+    vcr.ghost_valid = qfalse;
+}
+
+/*
+ * =============================================================================
+ *  LAYER PIPELINE
+ * =============================================================================
+ *
+ * Which layers run only depends on mode, quality preset and the feature
+ * cvars, so the ordered list of layer functions is compiled when one of
+ * them changes (the governor stepping quality included) and each frame
+ * just runs it. Window stages draw before the 2D setup, overlay stages
+ * after it. Modes are declared as the layers they add on top of the
+ * common tape look. If the fragment program can't capture the screen,
+ * the pipeline is rebuilt with the blended layers instead.
+ */
+
+#define VCR_FEATURE_REC         1   /* REC light and battery */
+#define VCR_FEATURE_TIMESTAMP   2
+#define VCR_FEATURE_CCTV        4   /* Dim, vignetted security camera */
+#define VCR_FEATURE_DAMAGE      8   /* Static bursts and tape damage */
+#define VCR_FEATURE_NIGHT       16  /* Green phosphor image */
+
+static const int vcr_mode_features[4] = {
+    /* VCR */
+    VCR_FEATURE_REC | VCR_FEATURE_TIMESTAMP,
+    /* CCTV */
+    VCR_FEATURE_CCTV | VCR_FEATURE_TIMESTAMP,
+    /* FOUND FOOTAGE */
+    VCR_FEATURE_REC | VCR_FEATURE_TIMESTAMP | VCR_FEATURE_DAMAGE,
+    /* NIGHT VISION */
+    VCR_FEATURE_REC | VCR_FEATURE_NIGHT
+};
+
+/* Values of this frame shared by the stages */
+typedef struct {
+    float       time;
+    float       desaturation;
+    float       grain_alpha;
+    float       jitter;
+    int         dots;
+    qboolean    tracking;           /* Band is on screen */
+    qboolean    offscreen;          /* Noise layers were rendered reduced */
+} vcr_frame_t;
+
+typedef struct {
+    vcr_layer_t layer;              /* Profiling bucket, MAX if none */
+    void        (*draw)(vcr_frame_t *fr);
+} vcr_stage_t;
+
+#define VCR_MAX_STAGES  16
+
+typedef struct {
+    qboolean    dirty;
+    qboolean    program_failed;     /* Screen capture failed, stay blended */
+    
+    const vcr_quality_preset_t *preset;
+    float       min_desaturation;
+    float       scanline_alpha;
+    int         scanline_skip;
+    int         divisor;            /* Noise layer resolution divisor */
+    qboolean    tracking;
+    
+    vcr_stage_t window[VCR_MAX_STAGES];
+    int         numwindow;
+    vcr_stage_t overlay[VCR_MAX_STAGES];
+    int         numoverlay;
+} vcr_pipeline_t;
+
+static vcr_pipeline_t vcr_pipe;
+
+/* Chances in vcr_effect.h are per 60 Hz frame */
+static qboolean vcr_chance(float chance)
+{
+    return vcr_rand_float() < chance * vcr.frame_time * 60.0f;
+}
+
+static void vcr_stage_ghosting(vcr_frame_t *fr)
+{
+    if (vcr_ghost_update(vcr_pipe.preset)) {
+        vcr_ghost_draw();
+    }
+}
+
+/* Full-screen layers in one program pass */
+static void vcr_stage_composite(vcr_frame_t *fr)
+{
+    vcr_composite_t cp;
+    
+    if (!vcr_capture_screen()) {
+        vcr_pipe.program_failed = qtrue;
+        vcr_pipe.dirty = qtrue;
+        return;
+    }
+    
+    cp.desaturation = fr->desaturation;
+    cp.grain_alpha = fr->grain_alpha;
+    cp.grain_density = vcr_pipe.preset->grain_mult * 0.5f / 2000.0f;
+    cp.dots = fr->dots;
+    cp.scanline_skip = vcr_pipe.scanline_skip;
+    cp.scanline_alpha = vcr_pipe.scanline_alpha;
+    cp.band_y = vcr.tracking_line_y;
+    cp.band_alpha = vcr_pipe.tracking && fr->tracking ? 0.3f : 0.0f;
+    cp.jitter = VCR_SPIKE_JITTER_MAX * fr->jitter;
+    cp.chroma = vcr_pipe.preset->color_shift ? VCR_SPIKE_COLOR_SHIFT * fr->jitter : 0.0f;
+    
+    vcr_draw_composite(&cp);
+}
+
+/* Grain and noise dots at reduced resolution, applied in place later */
+static void vcr_stage_offscreen(vcr_frame_t *fr)
+{
+    if (vcr_begin_offscreen(vcr_pipe.divisor)) {
+        vcr_draw_film_grain(fr->grain_alpha, vcr_pipe.preset->grain_mult * 0.5f);
+        vcr_draw_noise_dots(fr->dots, 0.5f);
+        vcr_end_offscreen();
+        fr->offscreen = qtrue;
+    }
+}
+
+/* Shakes all blended layers after it */
+static void vcr_stage_jitter(vcr_frame_t *fr)
+{
+    if (fr->jitter > 0.0f) {
+        vcr_apply_jitter(VCR_SPIKE_JITTER_MAX * fr->jitter);
+    }
+}
+
+static void vcr_stage_desaturate(vcr_frame_t *fr)
+{
+    vcr_draw_desaturation(fr->desaturation, VCR_SEPIA_TINT);
+}
+
+static void vcr_stage_noise(vcr_frame_t *fr)
+{
+    if (fr->offscreen) {
+        vcr_draw_offscreen();
+        return;
+    }
+    vcr_draw_film_grain(fr->grain_alpha, vcr_pipe.preset->grain_mult * 0.5f);
+    vcr_draw_noise_dots(fr->dots, 0.5f);
+}
+
+/* Full resolution, thinner than a reduced texel */
+static void vcr_stage_scanlines(vcr_frame_t *fr)
+{
+    vcr_draw_scanlines(vcr_pipe.scanline_alpha, vcr_pipe.scanline_skip);
+}
+
+/* One line scrolling down while the timeline event lasts */
+static void vcr_stage_tracking(vcr_frame_t *fr)
+{
+    float y = vcr.tracking_line_y;
+    float h = VCR_TRACKING_LINE_HEIGHT;
+    
+    if (!fr->tracking) {
+        return;
+    }
+    
+    vcr_draw_rect(0, y, (float)vcr.width, h, 0.1f, 0.1f, 0.1f, 0.3f);
+    vcr_draw_rect(0, y - 1, (float)vcr.width, 1, 1.0f, 0.0f, 0.0f, 0.1f);
+    vcr_draw_rect(0, y + h, (float)vcr.width, 1, 0.0f, 1.0f, 1.0f, 0.1f);
+}
+
+static void vcr_stage_cctv(vcr_frame_t *fr)
+{
+    vcr_draw_cctv_overlay(1.0f, fr->time);
+}
+
+/* Multiplies the already grey scene by the tint, then adds glow */
+static void vcr_stage_night_vision(vcr_frame_t *fr)
+{
+    float w = (float)vcr.width;
+    float h = (float)vcr.height;
+    float verts[8];
+    
+    Vector4Set(verts, 0, 0, w, 0);
+    Vector4Set(verts + 4, w, h, 0, h);
+    
+    GL_Flush2D();
+    vcr_gl_state(TEXNUM_WHITE, GLS_BLEND_BLEND);
+    qglBlendFunc(GL_ZERO, GL_SRC_COLOR);
+    qglColor4f(VCR_NIGHT_VISION_TINT_R, VCR_NIGHT_VISION_TINT_G,
+               VCR_NIGHT_VISION_TINT_B, 1.0f);
+    vcr_draw_arrays(GL_TRIANGLE_FAN, verts, NULL, 4);
+    qglBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    vcr_draw_rect(0, 0, w, h, VCR_NIGHT_VISION_TINT_R, VCR_NIGHT_VISION_TINT_G,
+                  VCR_NIGHT_VISION_TINT_B, VCR_NIGHT_VISION_BLOOM);
+    vcr_draw_noise_dots((int)(VCR_NIGHT_VISION_NOISE * vcr_pipe.preset->noise_mult), 0.6f);
+    
+    if (vcr_pipe.preset->flicker) {
+        vcr_draw_flicker(0.5f, fr->time);
+    }
+}
+
+static void vcr_stage_tape_damage(vcr_frame_t *fr)
+{
+    float t = fr->time - vcr.tape_damage_start;
+    int i;
+    
+    if (vcr.tape_damage_start < 0 || t < 0 || t > VCR_TAPE_DAMAGE_DURATION) {
+        if (!vcr.force_tape_damage && !vcr_chance(VCR_TAPE_DAMAGE_CHANCE)) {
+            return;
+        }
+        vcr.force_tape_damage = qfalse;
+        vcr.tape_damage_start = fr->time;
+        for (i = 0; i < VCR_TAPE_DAMAGE_LINES; i++) {
+            vcr.damage_line_y[i] = vcr_rand_float() * vcr.height;
+        }
+        t = 0;
+    }
+    
+    vcr_draw_tape_damage(1.0f - t / VCR_TAPE_DAMAGE_DURATION);
+}
+
+static void vcr_stage_static_burst(vcr_frame_t *fr)
+{
+    float t = fr->time - vcr.static_start_time;
+    
+    if (vcr.static_start_time < 0 || t < 0 || t > VCR_STATIC_DURATION) {
+        if (!vcr.force_static && !vcr_chance(VCR_STATIC_CHANCE)) {
+            return;
+        }
+        vcr.force_static = qfalse;
+        vcr.static_start_time = fr->time;
+        t = 0;
+    }
+    
+    vcr_draw_static_burst(VCR_STATIC_INTENSITY * (1.0f - t / VCR_STATIC_DURATION));
+}
+
+static void vcr_stage_rec(vcr_frame_t *fr)
+{
+    vcr_draw_rec_indicator(fr->time);
+}
+
+static void vcr_stage_battery(vcr_frame_t *fr)
+{
+    vcr_draw_battery_indicator(fr->time);
+}
+
+static void vcr_stage_timestamp(vcr_frame_t *fr)
+{
+    vcr_draw_timestamp(fr->time);
+}
+
+/* Blended split on distortion, the program does a real one */
+static void vcr_stage_chroma(vcr_frame_t *fr)
+{
+    if (fr->jitter > 0.0f) {
+        vcr_draw_chromatic_aberration(fr->jitter);
+    }
+}
+
+static void vcr_add_stage(vcr_stage_t *list, int *count, vcr_layer_t layer,
+                          void (*draw)(vcr_frame_t *))
+{
+    if (*count < VCR_MAX_STAGES) {
+        list[*count].layer = layer;
+        list[*count].draw = draw;
+        (*count)++;
+    }
+}
+
+#define WINDOW(layer, draw) \
+    vcr_add_stage(vcr_pipe.window, &vcr_pipe.numwindow, layer, draw)
+#define OVERLAY(layer, draw) \
+    vcr_add_stage(vcr_pipe.overlay, &vcr_pipe.numoverlay, layer, draw)
+
+static void vcr_build_pipeline(void)
+{
+    const vcr_quality_preset_t *preset = vcr_get_preset();
+    int features = vcr_mode_features[Cvar_ClampInteger(vcr_mode, 0, 3)];
+    qboolean program = vcr_use_program() && !vcr_pipe.program_failed;
+    
+    vcr_pipe.dirty = qfalse;
+    vcr_pipe.preset = preset;
+    vcr_pipe.min_desaturation = (features & VCR_FEATURE_NIGHT) ? 1.0f : 0.0f;
+    vcr_pipe.scanline_alpha = VCR_SCANLINE_ALPHA * CVAR_VALUE(vcr_scanline_alpha);
+    vcr_pipe.scanline_skip = (int)preset->scanline_skip;
+    vcr_pipe.divisor = vcr_overlay_divisor(preset);
+    vcr_pipe.tracking = CVAR_INT(vcr_tracking_lines) != 0;
+    vcr_pipe.numwindow = 0;
+    vcr_pipe.numoverlay = 0;
+    
+    /* Trail of previous frames, under everything else */
+    if (vcr_ghost_available(preset)) {
+        WINDOW(VCR_LAYER_GHOSTING, vcr_stage_ghosting);
+    } else {
+        vcr.ghost_valid = qfalse;
+    }
+    
+    if (program) {
+        WINDOW(VCR_LAYER_COMPOSITE, vcr_stage_composite);
+    } else {
+        if (vcr_pipe.divisor > 1) {
+            OVERLAY(VCR_LAYER_OFFSCREEN, vcr_stage_offscreen);
+        }
+        OVERLAY(VCR_LAYER_MAX, vcr_stage_jitter);
+        OVERLAY(VCR_LAYER_DESATURATE, vcr_stage_desaturate);
+        OVERLAY(VCR_LAYER_NOISE, vcr_stage_noise);
+        OVERLAY(VCR_LAYER_SCANLINES, vcr_stage_scanlines);
+        if (vcr_pipe.tracking) {
+            OVERLAY(VCR_LAYER_TRACKING, vcr_stage_tracking);
+        }
+    }
+    
+    /* Look of the mode, under the on-screen display */
+    if (features & VCR_FEATURE_CCTV) {
+        OVERLAY(VCR_LAYER_MODE, vcr_stage_cctv);
+    }
+    if (features & VCR_FEATURE_NIGHT) {
+        OVERLAY(VCR_LAYER_MODE, vcr_stage_night_vision);
+    }
+    if ((features & VCR_FEATURE_DAMAGE) && preset->static_bursts) {
+        OVERLAY(VCR_LAYER_DAMAGE, vcr_stage_tape_damage);
+        if (CVAR_INT(vcr_static_bursts)) {
+            OVERLAY(VCR_LAYER_DAMAGE, vcr_stage_static_burst);
+        }
+    }
+    
+    if (features & VCR_FEATURE_REC) {
+        if (preset->rec_indicator && CVAR_INT(vcr_rec_indicator)) {
+            OVERLAY(VCR_LAYER_OVERLAYS, vcr_stage_rec);
+        }
+        OVERLAY(VCR_LAYER_OVERLAYS, vcr_stage_battery);
+    }
+    if ((features & VCR_FEATURE_TIMESTAMP) && CVAR_INT(vcr_timestamp)) {
+        OVERLAY(VCR_LAYER_OVERLAYS, vcr_stage_timestamp);
     }
+    
+    if (!program && preset->color_shift) {
+        OVERLAY(VCR_LAYER_CHROMA, vcr_stage_chroma);
+    }
+}
+
+#undef WINDOW
+#undef OVERLAY
+
+/* Consecutive stages of one bucket are measured together */
+static void vcr_run_stages(const vcr_stage_t *stage, int count, vcr_frame_t *fr)
+{
+    vcr_layer_t layer = VCR_LAYER_MAX;
+    
+    for (; count > 0; count--, stage++) {
+        if (stage->layer != layer) {
+            if (layer != VCR_LAYER_MAX) {
+                vcr_profile_end(layer);
+            }
+            layer = stage->layer;
+            if (layer != VCR_LAYER_MAX) {
+                vcr_profile_begin(layer);
+            }
+        }
+        stage->draw(fr);
+    }
+    
+    if (layer != VCR_LAYER_MAX) {
+        vcr_profile_end(layer);
+    }
+}
+
+/* Any cvar the pipeline is compiled from */
+static void vcr_pipeline_changed(cvar_t *self)
+{
+    vcr_pipe.dirty = qtrue;
+}
+
+static void vcr_shader_changed(cvar_t *self)
+{
+    vcr_pipe.program_failed = qfalse;
+    vcr_pipe.dirty = qtrue;
+}
+
+
+
+/*
+ * =============================================================================
+ *  EVENT TIMELINE
+ * =============================================================================
+ *
+ * The looping sequence is read from the file named by vcr_timeline, one
+ * directive per line:
+ *
+ *   length <seconds>                       loop length
+ *   base <event> <value>                   value outside of events
+ *   <start> <duration> <event> [value]     hold value for duration
+ *
+ * Events are tracking, jitter, dots and desaturate. Each one compiles
+ * into a pair of keyframes sorted by time, which playback applies with a
+ * cursor that only moves forward and rewinds when the loop wraps.
+ */
+
+static const char *const vcr_event_names[VCR_EVENT_MAX] = {
+    "tracking", "jitter", "dots", "desaturate"
+};
+
+/* Value used when an event line leaves it out */
+static const float vcr_event_defaults[VCR_EVENT_MAX] = {
+    1.0f, 1.0f, 120.0f, 0.5f
+};
+
+/* Used when the file can't be found */
+static const char vcr_default_timeline[] =
+    "length 50\n"
+    "base desaturate 0.08\n"
+    "base dots 20\n"
+    "10 20 tracking\n"      /* generous time for the line to pass */
+    "20 2 jitter 1\n"
+    "30 2 dots 120\n"
+    "40 2 desaturate 0.5\n";
+
+static int vcr_find_event(const char *name)
+{
+    int i;
+
+    for (i = 0; i < VCR_EVENT_MAX; i++) {
+        if (!Q_stricmp(name, vcr_event_names[i])) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int vcr_keyframe_cmp(const void *p1, const void *p2)
+{
+    const vcr_keyframe_t *k1 = p1;
+    const vcr_keyframe_t *k2 = p2;
+
+    if (k1->time != k2->time) {
+        return k1->time < k2->time ? -1 : 1;
+    }
+
+    /* An event ending where the next one starts must not cancel it */
+    return k1->start - k2->start;
+}
+
+static void vcr_timeline_rewind(vcr_timeline_t *tl)
+{
+    memcpy(tl->values, tl->base, sizeof(tl->values));
+    tl->cursor = 0;
+    tl->last_time = 0;
+}
+
+static void vcr_timeline_add(vcr_timeline_t *tl, float time, int event,
+                             float value, qboolean start)
+{
+    vcr_keyframe_t *key = &tl->keys[tl->numkeys++];
+
+    key->time = time;
+    key->event = event;
+    key->value = value;
+    key->start = start;
+}
+
+static void vcr_timeline_parse(vcr_timeline_t *tl, const char *data,
+                               const char *path)
+{
+    char buffer[MAX_STRING_CHARS];
+    const char *s, *p;
+    float start, duration, value;
+    int line, argc, event;
+    size_t len;
+
+    memset(tl, 0, sizeof(*tl));
+    tl->length = 50;
+    for (event = 0; event < VCR_EVENT_MAX; event++) {
+        tl->base[event] = vcr_event_defaults[event];
+    }
+    tl->base[VCR_EVENT_TRACKING] = 0;
+    tl->base[VCR_EVENT_JITTER] = 0;
+
+    s = data;
+    line = 0;
+    while (*s) {
+        p = strchr(s, '\n');
+        len = p ? p - s : strlen(s);
+        if (len >= sizeof(buffer)) {
+            len = sizeof(buffer) - 1;
+        }
+        memcpy(buffer, s, len);
+        buffer[len] = 0;
+
+        Cmd_TokenizeString(buffer, qfalse);
+        line++;
+
+        argc = Cmd_Argc();
+        if (argc == 0 || Cmd_Argv(0)[0] == '#' ||
+            !strncmp(Cmd_Argv(0), "//", 2)) {
+            // empty line or comment
+        } else if (!Q_stricmp(Cmd_Argv(0), "length")) {
+            value = atof(Cmd_Argv(1));
+            if (value > 0) {
+                tl->length = value;
+            } else {
+                Com_WPrintf("Bad length on line %i in %s\n", line, path);
+            }
+        } else if (argc < 3) {
+            Com_WPrintf("Line %i is incomplete in %s\n", line, path);
+        } else if (!Q_stricmp(Cmd_Argv(0), "base")) {
+            event = vcr_find_event(Cmd_Argv(1));
+            if (event < 0) {
+                Com_WPrintf("Unknown event '%s' on line %i in %s\n",
+                            Cmd_Argv(1), line, path);
+            } else {
+                tl->base[event] = atof(Cmd_Argv(2));
+            }
+        } else if ((event = vcr_find_event(Cmd_Argv(2))) < 0) {
+            Com_WPrintf("Unknown event '%s' on line %i in %s\n",
+                        Cmd_Argv(2), line, path);
+        } else if (tl->numkeys > VCR_MAX_KEYFRAMES - 2) {
+            Com_WPrintf("Too many events in %s\n", path);
+            break;
+        } else {
+            start = atof(Cmd_Argv(0));
+            duration = atof(Cmd_Argv(1));
+            value = argc > 3 ? atof(Cmd_Argv(3)) : vcr_event_defaults[event];
+            if (start < 0 || duration <= 0) {
+                Com_WPrintf("Bad event time on line %i in %s\n", line, path);
+            } else {
+                vcr_timeline_add(tl, start, event, value, qtrue);
+                vcr_timeline_add(tl, start + duration, event, 0, qfalse);
+            }
+        }
+
+        if (!p) {
+            break;
+        }
+
+        s = p + 1;
+    }
+
+    qsort(tl->keys, tl->numkeys, sizeof(tl->keys[0]), vcr_keyframe_cmp);
+
+    vcr_timeline_rewind(tl);
+}
+
+static void vcr_load_timeline(void)
+{
+    const char *path = vcr_timeline->string;
+    char *buffer;
+    qerror_t ret;
+
+    buffer = NULL;
+    ret = Q_ERR_NOENT;
+    if (*path) {
+        ret = FS_LoadFile(path, (void **)&buffer);
+    }
+
+    if (!buffer) {
+        if (ret != Q_ERR_NOENT) {
+            Com_EPrintf("Couldn't load %s: %s\n", path, Q_ErrorString(ret));
+        }
+        vcr_timeline_parse(&vcr.timeline, vcr_default_timeline, "default timeline");
+        return;
+    }
+
+    vcr_timeline_parse(&vcr.timeline, buffer, path);
+    Com_DPrintf("Loaded %i keyframes from %s\n", vcr.timeline.numkeys, path);
+
+    FS_FreeFile(buffer);
+}
+
+static void vcr_timeline_changed(cvar_t *self)
+{
+    vcr_load_timeline();
+}
+
+/* Settings are kept in range when they change, not polled per frame */
+static void vcr_mode_changed(cvar_t *self)
+{
+    Cvar_ClampInteger(self, VCR_MODE_VCR, VCR_MODE_NIGHT_VISION);
+    vcr_pipe.dirty = qtrue;
+}
+
+static void vcr_quality_changed(cvar_t *self)
+{
+    Cvar_ClampInteger(self, 0, 2);
+    vcr_pipe.dirty = qtrue;
+}
+
+/* Bring parameter values up to loop position time */
+static void vcr_timeline_advance(vcr_timeline_t *tl, float time)
+{
+    const vcr_keyframe_t *key;
+
+    tl->started = 0;
+
+    if (time < tl->last_time) {
+        vcr_timeline_rewind(tl);
+    }
+    tl->last_time = time;
+
+    while (tl->cursor < tl->numkeys) {
+        key = &tl->keys[tl->cursor];
+        if (key->time > time) {
+            break;
+        }
+        if (key->start) {
+            tl->values[key->event] = key->value;
+            tl->started |= 1 << key->event;
+        } else {
+            tl->values[key->event] = tl->base[key->event];
+        }
+        tl->cursor++;
+    }
+}
+
+
+/*
+ * =============================================================================
+ *  QUALITY GOVERNOR
+ * =============================================================================
+ *
+ * With vcr_autoquality 1 the average of the last VCR_GOVERNOR_SAMPLES
+ * frame times is compared against vcr_target_fps. Quality drops one step
+ * as soon as the average is 10% over budget, and rises one step only
+ * after it has stayed within budget for gov_up_delay seconds. A step up
+ * that has to be undone within 10 seconds doubles that delay (5s .. 80s),
+ * so a machine sitting on the edge doesn't oscillate.
+ */
+
+#define VCR_GOVERNOR_UP_DELAY       5.0f
+#define VCR_GOVERNOR_UP_DELAY_MAX   80.0f
+
+static void vcr_update_governor(float time, float delta)
+{
+    float avg, budget;
+    int i, level;
+
+    if (!CVAR_INT(vcr_autoquality) || CVAR_VALUE(vcr_target_fps) <= 0) {
+        vcr.gov_head = 0;
+        return;
+    }
+
+    if (delta <= 0) {
+        return;
+    }
+
+    vcr.gov_samples[vcr.gov_head % VCR_GOVERNOR_SAMPLES] = delta * 1000;
+    vcr.gov_head++;
+    if (vcr.gov_head < VCR_GOVERNOR_SAMPLES || time < vcr.gov_hold_until) {
+        return;
+    }
+
+    if (!vcr.gov_up_delay) {
+        vcr.gov_up_delay = VCR_GOVERNOR_UP_DELAY;
+    }
+
+    for (i = 0, avg = 0; i < VCR_GOVERNOR_SAMPLES; i++) {
+        avg += vcr.gov_samples[i];
+    }
+    avg /= VCR_GOVERNOR_SAMPLES;
+    budget = 1000 / CVAR_VALUE(vcr_target_fps);
+    level = VCR_GetQuality();
+
+    if (avg > budget * 1.1f) {
+        if (level > 0) {
+            if (time - vcr.gov_last_up < 10.0f) {
+                vcr.gov_up_delay *= 2;
+                if (vcr.gov_up_delay > VCR_GOVERNOR_UP_DELAY_MAX) {
+                    vcr.gov_up_delay = VCR_GOVERNOR_UP_DELAY_MAX;
+                }
+            }
+            VCR_SetQuality(level - 1);
+            /* Let the new level fill the history before judging it */
+            vcr.gov_head = 0;
+            vcr.gov_hold_until = time + 1.0f;
+        }
+        vcr.gov_good_since = time;
+        return;
+    }
+
+    if (avg > budget * 1.02f) {
+        vcr.gov_good_since = time;
+        return;
+    }
+
+    if (level < 2 && time - vcr.gov_good_since >= vcr.gov_up_delay) {
+        VCR_SetQuality(level + 1);
+        vcr.gov_last_up = time;
+        vcr.gov_good_since = time;
+        vcr.gov_head = 0;
+        vcr.gov_hold_until = time + 1.0f;
+    }
+}
+
+
+/*
+ * =============================================================================
+ *  PUBLIC API
+ * =============================================================================
+ */
+
+void VCR_Init(void)
+{
+    int i;
+    
+    if (vcr.noise_data) {
+        Z_Free(vcr.noise_data);
+    }
+    memset(&vcr, 0, sizeof(vcr));
+    
+    vcr.initialized = qtrue;
+    vcr.cctv_start_time = -1.0f;
+    vcr.static_start_time = -1.0f;
+    vcr.tape_damage_start = -1.0f;
+    vcr.frame_drop_start = -1.0f;
+    vcr.rewind_start = -1.0f;
+    vcr.battery_level = 0.75f;  /* 75% per client request */
+    vcr.tracking_line_y = 0.0f;
+    
+    /* Initialize tape damage line positions */
+    for (i = 0; i < 10; i++) {
+        vcr.damage_line_y[i] = -50 - (float)i * 30;
+    }
+    
+    vcr_init_noise();
+    vcr_rand_seed((unsigned)(size_t)&vcr ^ 0x12345678);
+
+    /* REGISTER CVARS WITH ENGINE */
+    vcr_enabled = Cvar_Get("vcr_enabled", "1", CVAR_ARCHIVE);
+    vcr_quality = Cvar_Get("vcr_quality", "2", CVAR_ARCHIVE); // High default
+    vcr_mode = Cvar_Get("vcr_mode", "0", CVAR_ARCHIVE);
+    vcr_quality->changed = vcr_quality_changed;
+    vcr_quality_changed(vcr_quality);
+    vcr_mode->changed = vcr_mode_changed;
+    vcr_mode_changed(vcr_mode);
+    
+    // Feature toggles
+    vcr_rec_indicator = Cvar_Get("vcr_rec_indicator", "1", CVAR_ARCHIVE);
+    vcr_timestamp = Cvar_Get("vcr_timestamp", "1", CVAR_ARCHIVE);
+    vcr_tracking_lines = Cvar_Get("vcr_tracking_lines", "1", CVAR_ARCHIVE);
+    vcr_static_bursts = Cvar_Get("vcr_static_bursts", "1", CVAR_ARCHIVE);
+    vcr_ghosting = Cvar_Get("vcr_ghosting", "1", CVAR_ARCHIVE);
+    vcr_debug = Cvar_Get("vcr_debug", "0", 0);
+    vcr_shader = Cvar_Get("vcr_shader", "1", CVAR_ARCHIVE);
+    vcr_offscreen = Cvar_Get("vcr_offscreen", "1", CVAR_ARCHIVE);
+    vcr_profile = Cvar_Get("vcr_profile", "0", 0);
+    vcr_autoquality = Cvar_Get("vcr_autoquality", "0", CVAR_ARCHIVE);
+    vcr_target_fps = Cvar_Get("vcr_target_fps", "60", CVAR_ARCHIVE);
+    vcr_timeline = Cvar_Get("vcr_timeline", "vcr/timeline.txt", 0);
+    vcr_timeline->changed = vcr_timeline_changed;
+    vcr_rec_indicator->changed = vcr_pipeline_changed;
+    vcr_timestamp->changed = vcr_pipeline_changed;
+    vcr_tracking_lines->changed = vcr_pipeline_changed;
+    vcr_static_bursts->changed = vcr_pipeline_changed;
+    vcr_ghosting->changed = vcr_pipeline_changed;
+    vcr_offscreen->changed = vcr_pipeline_changed;
+    vcr_shader->changed = vcr_shader_changed;
+    
+    Cmd_AddCommand("vcr_stats", vcr_stats_f);
+    Cmd_AddCommand("vcr_rewind", vcr_rewind_f);
+    
+    vcr_load_timeline();
+
+    // Advanced tuning (non-archive by default to reset on restart)
+    // Default 0.5 per user requirement (50% B&W)
+    vcr_desaturation = Cvar_Get("vcr_desaturation", "0.5", 0);
+    vcr_noise_dots = Cvar_Get("vcr_noise_dots", "1.0", 0);
+    vcr_grain_intensity = Cvar_Get("vcr_grain_intensity", "1.0", 0);
+    vcr_scanline_alpha = Cvar_Get("vcr_scanline_alpha", "1.0", 0);
+    vcr_scanline_alpha->changed = vcr_pipeline_changed;
+    vcr_distortion_interval = Cvar_Get("vcr_distortion_interval", "20.0", 0);
+    vcr_distortion_duration = Cvar_Get("vcr_distortion_duration", "1.5", 0);
+    vcr_cctv_chance = Cvar_Get("vcr_cctv_chance", "0.3", 0);
+    
+    /* Screen capture uses a reserved engine texture number, so it can't
+       collide with image texnums and is freed with the other auto textures */
+    vcr.screen_tex = TEXNUM_VCR_SCREEN;
+    
+    /* Increment generation counter to signal desaturation function to reset its cache */
+    vcr.tex_generation++;
+    
+    /* Program and extensions may differ after a restart */
+    memset(&vcr_pipe, 0, sizeof(vcr_pipe));
+    vcr_pipe.dirty = qtrue;
+    
+    Com_Printf("VCR Effect Initialized. Type 'vcr_mode 1' for CCTV.\n");
+}
+
+void VCR_Shutdown(void)
+{
+    vcr_profile_shutdown();
+    vcr_ghost_shutdown();
+    Cmd_RemoveCommand("vcr_stats");
+    Cmd_RemoveCommand("vcr_rewind");
+    vcr_timeline->changed = NULL;
+    vcr_quality->changed = NULL;
+    vcr_mode->changed = NULL;
+    vcr_rec_indicator->changed = NULL;
+    vcr_timestamp->changed = NULL;
+    vcr_tracking_lines->changed = NULL;
+    vcr_static_bursts->changed = NULL;
+    vcr_ghosting->changed = NULL;
+    vcr_offscreen->changed = NULL;
+    vcr_shader->changed = NULL;
+    vcr_scanline_alpha->changed = NULL;
+    
+    /* Texture itself is deleted by GL_ShutdownImages */
+    vcr.screen_tex = 0;
+    vcr.capture_width = vcr.capture_height = 0;
+    vcr.overlay_width = vcr.overlay_height = 0;
+    vcr.rewind_width = vcr.rewind_height = 0;
+    vcr.rewind_count = 0;
+    vcr.rewind_start = -1.0f;
+    if (vcr.noise_data) {
+        Z_Free(vcr.noise_data);
+        vcr.noise_data = NULL;
+    }
+    vcr.noise_size = 0;
     vcr.initialized = qfalse;
 }
 
+void VCR_DrawTiles(int screen_width, int screen_height,
+                   const vrect_t *tiles, int count, float time)
+{
+    vcr_batch_t *batch = &vcr.tile_batch;
+    float x, y, w, h, rec;
+    int i, cam;
+    
+    if (!vcr.initialized || !VCR_IsEnabled()) return;
+    
+    /* All cameras blink together */
+    rec = (float)fmod(time, 1.0f) < 0.5f ? 1.0f : 0.2f;
+    
+    batch->numrects = 0;
+    for (i = 0; i < count; i++) {
+        x = (float)tiles[i].x;
+        y = (float)tiles[i].y;
+        w = (float)tiles[i].width;
+        h = (float)tiles[i].height;
+        cam = (i + 1) % 100;
+        
+        /* Seams between feeds */
+        vcr_batch_rect(batch, x, y, w, 2, 0.0f, 0.0f, 0.0f, 0.9f);
+        vcr_batch_rect(batch, x, y + h - 2, w, 2, 0.0f, 0.0f, 0.0f, 0.9f);
+        vcr_batch_rect(batch, x, y + 2, 2, h - 4, 0.0f, 0.0f, 0.0f, 0.9f);
+        vcr_batch_rect(batch, x + w - 2, y + 2, 2, h - 4, 0.0f, 0.0f, 0.0f, 0.9f);
+        
+        /* Camera number */
+        vcr_batch_rect(batch, x + 6, y + 6, 28, 20, 0.0f, 0.0f, 0.0f, 0.5f);
+        vcr_draw_digit(batch, x + 10, y + 10, 12.0f, cam / 10);
+        vcr_draw_digit(batch, x + 20, y + 10, 12.0f, cam % 10);
+        
+        /* REC light */
+        vcr_batch_rect(batch, x + w - 16, y + 8, 8, 8, 1.0f, 0.0f, 0.0f, rec);
+    }
+    
+    vcr_gl_begin_2d(screen_width, screen_height);
+    vcr_batch_draw(batch);
+    vcr_gl_end_2d();
+}
+
 void VCR_Enable(void)
 {
     if (vcr_enabled) Cvar_SetValue(vcr_enabled, 1.0f, 0);
@@ -897,6 +2771,7 @@ void VCR_Reset(void)
     vcr.tape_damage_start = -1.0f;
     vcr.frame_count = 0;
     vcr.tracking_line_y = -50.0f;
+    vcr_timeline_rewind(&vcr.timeline);
     vcr.force_distortion = qfalse;
     vcr.force_cctv = qfalse;
     vcr.force_static = qfalse;
@@ -905,8 +2780,8 @@ void VCR_Reset(void)
 
 void VCR_SetMode(int mode)
 {
-    if (mode < 0) mode = 0;
-    if (mode > 3) mode = 3;
+    if (mode < VCR_MODE_VCR) mode = VCR_MODE_VCR;
+    if (mode > VCR_MODE_NIGHT_VISION) mode = VCR_MODE_NIGHT_VISION;
     CVAR_SET_INT(vcr_mode, mode);
 }
 
@@ -939,6 +2814,17 @@ void VCR_SetBattery(float level)
     vcr.battery_level = level;
 }
 
+int VCR_LayerStats(int layer, const char **name, float *msec)
+{
+    if (layer < 0 || layer >= VCR_LAYER_MAX) {
+        return 0;
+    }
+    
+    *name = vcr_layer_names[layer];
+    *msec = vcr_prof.average[layer];
+    return 1;
+}
+
 
 /*
  * VCR_DrawEffect - Main rendering function
@@ -946,58 +2832,60 @@ void VCR_SetBattery(float level)
 void VCR_DrawEffect(int screen_width, int screen_height, float time)
 {
     const vcr_quality_preset_t *preset;
-    int   mode;
     float elapsed;
     float loop_time;
     
-    /* Effect State Variables (Default: Constant state) */
-    float current_desaturation = 0.08f; /* 1. Constant: 8% B&W (Updated) */
-    int   current_dots = 20;            /* 1. Constant: 20 Dots (Updated) */
-    float current_jitter = 0.0f;
-    float grain_alpha = VCR_NORMAL_GRAIN;
+    const vcr_timeline_t *tl = &vcr.timeline;
+    vcr_frame_t fr;
     qboolean show_tracking = qfalse;
     
     /* Early out */
     if (!vcr.initialized || !VCR_IsEnabled()) return;
     
-    /* Robustness check */
-    if (vcr.screen_tex != 0 && !glIsTexture(vcr.screen_tex)) {
-        glGenTextures(1, &vcr.screen_tex);
-        glBindTexture(GL_TEXTURE_2D, vcr.screen_tex);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0); 
-    }
-    
-    glPushAttrib(GL_ALL_ATTRIB_BITS);
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
+    vcr_profile_frame();
     
-    preset = vcr_get_preset();
-    mode = CVAR_INT(vcr_mode);
     vcr.width = screen_width;
     vcr.height = screen_height;
+    
+    /* Animation advances by real frame time */
+    if (vcr.current_time > 0 && time > vcr.current_time) {
+        vcr.frame_time = time - vcr.current_time;
+        vcr_update_governor(time, vcr.frame_time);
+        if (vcr.frame_time > VCR_MAX_FRAME_TIME) {
+            vcr.frame_time = VCR_MAX_FRAME_TIME;
+        }
+    } else {
+        vcr.frame_time = 0;
+    }
     vcr.current_time = time;
     
+    /* Governor may have changed quality */
+    if (vcr_pipe.dirty) {
+        vcr_build_pipeline();
+    }
+    preset = vcr_pipe.preset;
+    
     if (vcr.effect_start_time < 0) {
         vcr.effect_start_time = time;
         vcr.tracking_line_y = -50.0f; /* Start off-screen */
     }
     
     elapsed = time - vcr.effect_start_time;
-    loop_time = (float)fmod(elapsed, 50.0f); /* 6. Loop: 50s cycle */
-    
-    /* 
-     * SEQUENCE LOGIC
-     * 1. Constant: 8% B&W, 20 Dots (Defaults set above)
-     */
-    
-    /* 2. Event 1 (at 10s): Tracking line down screen ONCE */
-    if (loop_time >= 10.0f && loop_time < 30.0f) { /* Give it generous time to pass */
+    loop_time = (float)fmod(elapsed, tl->length);
+    
+    /* SEQUENCE LOGIC */
+    vcr_timeline_advance(&vcr.timeline, loop_time);
+    fr.time = time;
+    fr.desaturation = max(tl->values[VCR_EVENT_DESATURATE], vcr_pipe.min_desaturation);
+    fr.dots = (int)(tl->values[VCR_EVENT_DOTS] * preset->noise_mult);
+    fr.jitter = tl->values[VCR_EVENT_JITTER];
+    fr.grain_alpha = VCR_NORMAL_GRAIN;
+    fr.offscreen = qfalse;
+    
+    /* Tracking line runs down the screen ONCE per event */
+    if (tl->values[VCR_EVENT_TRACKING]) {
         /* If we just started this phase, reset line to top */
-        if (loop_time < 10.1f) {
+        if (tl->started & (1 << VCR_EVENT_TRACKING)) {
              /* Reset to top */
              if (vcr.tracking_line_y > screen_height) {
                  vcr.tracking_line_y = -VCR_TRACKING_LINE_HEIGHT;
@@ -1007,7 +2895,7 @@ void VCR_DrawEffect(int screen_width, int screen_height, float time)
         /* Only move if not finished */
         if (vcr.tracking_line_y <= screen_height + VCR_TRACKING_LINE_HEIGHT + 200.0f) { /* Adjusted for 2nd line */
             float speed = screen_height / 5.0f; /* Traverse in ~5 seconds */
-            vcr.tracking_line_y += speed * 0.016f; /* dt approx */
+            vcr.tracking_line_y += speed * vcr.frame_time;
             show_tracking = qtrue;
         }
     } else {
@@ -1015,93 +2903,31 @@ void VCR_DrawEffect(int screen_width, int screen_height, float time)
         vcr.tracking_line_y = screen_height + 500.0f;
     }
     
-    /* 3. Event 2 (at 20s): Screen shake (2s) */
-    if (loop_time >= 20.0f && loop_time < 22.0f) {
-        current_jitter = 1.0f;
-    }
     
-    /* 4. Event 3 (at 30s): More white dots (2s) */
-    if (loop_time >= 30.0f && loop_time < 32.0f) {
-        /* "More white dots" - increased to ensure visibility */
-        current_dots += 100;
-    }
+    /* RENDER PHASES */
     
-    /* 5. Event 4 (at 40s): 40% B&W effect (2s) -> Updated to 50% */
-    if (loop_time >= 40.0f && loop_time < 42.0f) {
-        current_desaturation = 0.50f;
+    /* Rewind plays under all layers, with the tracking band racing */
+    if (vcr_rewind_draw(time)) {
+        fr.jitter = 1.0f;
+        vcr.tracking_line_y = (float)fmod((time - vcr.rewind_start) * screen_height * 1.5f,
+                                          screen_height);
+        show_tracking = qtrue;
+    } else {
+        vcr_rewind_capture(time);
     }
-    
-    
-    /* RENDER PHASES */
+    fr.tracking = show_tracking;
     
     /* Reseed RNG */
     vcr.frame_count++;
     vcr_rand_seed(vcr.rng_state ^ (unsigned)vcr.frame_count ^ (unsigned)(time * 1000));
     
-    /* Begin Drawing */
-    vcr_gl_begin_2d(screen_width, screen_height);
-    
-    /* Apply Jitter */
-    if (current_jitter > 0.0f) {
-        vcr_apply_jitter(VCR_SPIKE_JITTER_MAX * current_jitter);
-    }
-    
-    /* Draw Effect Layers (Unified VCR/CCTV Logic) */
-    
-    /* 1. Desaturation */
-    vcr_draw_desaturation(current_desaturation, VCR_SEPIA_TINT);
-    
-    /* 2. Grain (Constant small amount) */
-    vcr_draw_film_grain(grain_alpha, preset->grain_mult * 0.5f);
+    /* Ghosting and program composite, in window coordinates */
+    vcr_run_stages(vcr_pipe.window, vcr_pipe.numwindow, &fr);
     
-    /* 3. Noise Dots - Ensure int cast doesn't truncate to 0 too easily */
-    vcr_draw_noise_dots((int)(current_dots * preset->noise_mult), 0.5f);
-    
-    /* 4. Tracking Line (if active) - 1 LINE scrolling down for 5 seconds */
-    if (show_tracking && CVAR_INT(vcr_tracking_lines)) {
-        float y = vcr.tracking_line_y;
-        float h = VCR_TRACKING_LINE_HEIGHT;
-        
-        /* Single tracking line */
-        vcr_draw_rect(0, y, (float)vcr.width, h, 0.1f, 0.1f, 0.1f, 0.3f);
-        vcr_draw_rect(0, y - 1, (float)vcr.width, 1, 1.0f, 0.0f, 0.0f, 0.1f);
-        vcr_draw_rect(0, y + h, (float)vcr.width, 1, 0.0f, 1.0f, 1.0f, 0.1f);
-    }
-    
-    /* 5. Overlays (Mode Specific UI) */
-    /* VCR Mode: REC + Battery + Timestamp */
-    /* CCTV Mode: Timestamp ONLY */
-    
-    if (mode == VCR_MODE_VCR) {
-        if (preset->rec_indicator && CVAR_INT(vcr_rec_indicator)) {
-            vcr_draw_rec_indicator(time);
-        }
-        vcr_draw_battery_indicator(time);
-    }
-    
-    /* Timestamp - Unified */
-    if (CVAR_INT(vcr_timestamp)) {
-        if (mode == VCR_MODE_VCR || mode == VCR_MODE_CCTV) {
-            vcr_draw_timestamp(time);
-        }
-    }
-    
-    /* Chromatic aberration on distortion */
-    if (current_jitter > 0.0f && preset->color_shift) {
-        vcr_draw_chromatic_aberration(current_jitter);
-    }
+    /* Noise layers are textured, upload them for the current preset */
+    vcr_update_noise(preset->noise_size);
     
+    vcr_gl_begin_2d(screen_width, screen_height);
+    vcr_run_stages(vcr_pipe.overlay, vcr_pipe.numoverlay, &fr);
     vcr_gl_end_2d();
-    
-    /* Restore OpenGL state */
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
-    /* Explicitly reset critical states to ensure console text renders correctly */
-    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-    glDisable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    
-    glPopAttrib();
 }
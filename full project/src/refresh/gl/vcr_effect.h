@@ -7,7 +7,7 @@
  * 
  * Integration:
  *   - Call VCR_Init() in your renderer initialization
- *   - Call VCR_DrawEffect() after scene rendering, before UI
+ *   - Call VCR_DrawEffect() once per displayed frame, after 2D drawing
  *   - Call VCR_Shutdown() in your renderer shutdown
  * 
  * Toggle: Use cvar "vcr_enabled" (0=off, 1=on)
@@ -30,6 +30,8 @@ extern "C" {
 
 #define VCR_MODE_VCR            0   /* Classic VCR tape look */
 #define VCR_MODE_CCTV           1   /* Security camera style */
+#define VCR_MODE_FOUND_FOOTAGE  2   /* Horror camcorder, static and tape damage */
+#define VCR_MODE_NIGHT_VISION   3   /* Green phosphor camcorder night mode */
 
 /*
  * =============================================================================
@@ -148,7 +150,7 @@ void VCR_Shutdown(void);
  * VCR_DrawEffect
  * 
  * Render the VCR/CCTV effect overlay.
- * Call after scene rendering, before UI rendering.
+ * Call once per displayed frame, after all views and 2D are drawn.
  * 
  * Parameters:
  *   screen_width  - Current viewport width in pixels
@@ -157,6 +159,23 @@ void VCR_Shutdown(void);
  */
 void VCR_DrawEffect(int screen_width, int screen_height, float time);
 
+/*
+ * VCR_DrawTiles
+ * 
+ * Draw per-camera overlays (border, camera number, REC light) for a wall
+ * of views, in one batch. Call after VCR_DrawEffect for the whole wall.
+ * 
+ * Parameters:
+ *   screen_width  - Wall width in pixels
+ *   screen_height - Wall height in pixels
+ *   tiles         - View rectangles, in wall pixels
+ *   count         - Number of tiles
+ *   time          - Current client time in seconds
+ */
+struct vrect_s;
+void VCR_DrawTiles(int screen_width, int screen_height,
+                   const struct vrect_s *tiles, int count, float time);
+
 /*
  * VCR_Enable / VCR_Disable / VCR_Toggle
  * 
@@ -261,6 +280,15 @@ int VCR_GetQuality(void);
  */
 void VCR_SetBattery(float level);
 
+/*
+ * VCR_LayerStats
+ * 
+ * Average per-frame cost of one effect layer in milliseconds, measured
+ * while vcr_profile is set (GPU time where timer queries exist, CPU
+ * submission time otherwise). Returns 0 when layer is out of range.
+ */
+int VCR_LayerStats(int layer, const char **name, float *msec);
+
 
 /*
  * =============================================================================
@@ -292,9 +320,16 @@ extern struct cvar_s *vcr_tracking_lines;    /* cvar_t* - Enable tracking lines
 extern struct cvar_s *vcr_rec_indicator;     /* cvar_t* - Show REC indicator (0 or 1) */
 extern struct cvar_s *vcr_timestamp;         /* cvar_t* - Show timestamp (0 or 1) */
 extern struct cvar_s *vcr_static_bursts;     /* cvar_t* - Enable random static (0 or 1) */
+extern struct cvar_s *vcr_ghosting;          /* cvar_t* - Tape ghosting feedback (0 or 1) */
 
 /* Debug controls */
 extern struct cvar_s *vcr_debug;             /* cvar_t* - Show debug info (0 or 1) */
+extern struct cvar_s *vcr_shader;            /* cvar_t* - Use fragment program composite (0 or 1) */
+extern struct cvar_s *vcr_offscreen;         /* cvar_t* - Reduced resolution noise layers (0 or 1) */
+extern struct cvar_s *vcr_profile;           /* cvar_t* - Per-layer timing (0 or 1) */
+extern struct cvar_s *vcr_autoquality;       /* cvar_t* - Adjust quality to hold vcr_target_fps (0 or 1) */
+extern struct cvar_s *vcr_target_fps;        /* cvar_t* - Frame rate the governor aims for */
+extern struct cvar_s *vcr_timeline;          /* cvar_t* - Event timeline script */
 
 
 #ifdef __cplusplus
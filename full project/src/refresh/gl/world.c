@@ -17,37 +17,81 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "system/thread.h"
 
-static qboolean GL_SmoothLightPoint(vec3_t start, vec3_t color)
+#define LIGHT_TRACE_LENGTH  8192
+
+// samples every lightmap style of the surface with bilinear filtering
+static void GL_SampleLightmap(const lightpoint_t *pt, byte rgb[MAX_LIGHTMAPS][3])
 {
-    bsp_t           *bsp;
-    mface_t         *surf;
-    int             s, t, i, index;
+    mface_t         *surf = pt->surf;
+    int             s, t, i;
     byte            *lightmap;
     byte            *b1, *b2, *b3, *b4;
     int             fracu, fracv;
     int             w1, w2, w3, w4;
-    byte            temp[3];
     int             smax, tmax, size;
+
+    fracu = pt->s & 15;
+    fracv = pt->t & 15;
+
+    // compute weights of lightmap blocks
+    w1 = (16 - fracu) * (16 - fracv);
+    w2 = fracu * (16 - fracv);
+    w3 = fracu * fracv;
+    w4 = (16 - fracu) * fracv;
+
+    s = pt->s >> 4;
+    t = pt->t >> 4;
+
+    smax = S_MAX(surf);
+    tmax = T_MAX(surf);
+    size = smax * tmax * 3;
+
+    lightmap = surf->lightmap;
+    for (i = 0; i < surf->numstyles; i++) {
+        b1 = &lightmap[3 * ((t + 0) * smax + (s + 0))];
+        b2 = &lightmap[3 * ((t + 0) * smax + (s + 1))];
+        b3 = &lightmap[3 * ((t + 1) * smax + (s + 1))];
+        b4 = &lightmap[3 * ((t + 1) * smax + (s + 0))];
+
+        rgb[i][0] = (w1 * b1[0] + w2 * b2[0] + w3 * b3[0] + w4 * b4[0]) >> 8;
+        rgb[i][1] = (w1 * b1[1] + w2 * b2[1] + w3 * b3[1] + w4 * b4[1]) >> 8;
+        rgb[i][2] = (w1 * b1[2] + w2 * b2[2] + w3 * b3[2] + w4 * b4[2]) >> 8;
+
+        lightmap += size;
+    }
+}
+
+static void GL_LightFromSurface(const lightpoint_t *pt, vec3_t color)
+{
+    byte            rgb[MAX_LIGHTMAPS][3];
     lightstyle_t    *style;
+    int             i;
+
+    GL_SampleLightmap(pt, rgb);
+
+    // add all the lightmaps
+    VectorClear(color);
+    for (i = 0; i < pt->surf->numstyles; i++) {
+        style = LIGHT_STYLE(pt->surf, i);
+        color[0] += rgb[i][0] * style->rgb[0];
+        color[1] += rgb[i][1] * style->rgb[1];
+        color[2] += rgb[i][2] * style->rgb[2];
+    }
+}
+
+// replaces the lightpoint if some BSP model is hit closer
+static void GL_TraceBspModels(vec3_t start, vec3_t end, lightpoint_t *best)
+{
+    bsp_t           *bsp = gl_static.world.cache;
+    int             i, index;
     lightpoint_t    pt;
-    vec3_t          end, mins, maxs;
+    vec3_t          mins, maxs;
     entity_t        *ent;
     mmodel_t        *model;
     vec_t           *angles;
 
-    bsp = gl_static.world.cache;
-    if (!bsp || !bsp->lightmap)
-        return qfalse;
-
-    end[0] = start[0];
-    end[1] = start[1];
-    end[2] = start[2] - 8192;
-
-    // get base lightpoint from world
-    BSP_LightPoint(&glr.lightpoint, start, end, bsp->nodes);
-
-    // trace to other BSP models
     for (i = 0; i < glr.fd.num_entities; i++) {
         ent = &glr.fd.entities[i];
         index = ent->model;
@@ -82,106 +126,323 @@ static qboolean GL_SmoothLightPoint(vec3_t start, vec3_t color)
         BSP_TransformedLightPoint(&pt, start, end, model->headnode,
                                   ent->origin, angles);
 
-        if (pt.fraction < glr.lightpoint.fraction)
-            glr.lightpoint = pt;
+        if (pt.fraction < best->fraction)
+            *best = pt;
     }
+}
+
+static qboolean GL_SmoothLightPoint(vec3_t start, vec3_t color)
+{
+    bsp_t           *bsp;
+    vec3_t          end;
 
-    surf = glr.lightpoint.surf;
-    if (!surf)
+    bsp = gl_static.world.cache;
+    if (!bsp || !bsp->lightmap)
         return qfalse;
 
-    fracu = glr.lightpoint.s & 15;
-    fracv = glr.lightpoint.t & 15;
+    end[0] = start[0];
+    end[1] = start[1];
+    end[2] = start[2] - LIGHT_TRACE_LENGTH;
 
-    // compute weights of lightmap blocks
-    w1 = (16 - fracu) * (16 - fracv);
-    w2 = fracu * (16 - fracv);
-    w3 = fracu * fracv;
-    w4 = (16 - fracu) * fracv;
+    // get base lightpoint from world
+    BSP_LightPoint(&glr.lightpoint, start, end, bsp->nodes);
 
-    s = glr.lightpoint.s >> 4;
-    t = glr.lightpoint.t >> 4;
+    // trace to other BSP models
+    GL_TraceBspModels(start, end, &glr.lightpoint);
 
-    smax = S_MAX(surf);
-    tmax = T_MAX(surf);
-    size = smax * tmax * 3;
+    if (!glr.lightpoint.surf)
+        return qfalse;
 
-    VectorClear(color);
+    GL_LightFromSurface(&glr.lightpoint, color);
+    GL_AdjustColor(color);
 
-    // add all the lightmaps with bilinear filtering
-    lightmap = surf->lightmap;
-    for (i = 0; i < surf->numstyles; i++) {
-        b1 = &lightmap[3 * ((t + 0) * smax + (s + 0))];
-        b2 = &lightmap[3 * ((t + 0) * smax + (s + 1))];
-        b3 = &lightmap[3 * ((t + 1) * smax + (s + 1))];
-        b4 = &lightmap[3 * ((t + 1) * smax + (s + 0))];
+    return qtrue;
+}
 
-        temp[0] = (w1 * b1[0] + w2 * b2[0] + w3 * b3[0] + w4 * b4[0]) >> 8;
-        temp[1] = (w1 * b1[1] + w2 * b2[1] + w3 * b3[1] + w4 * b4[1]) >> 8;
-        temp[2] = (w1 * b1[2] + w2 * b2[2] + w3 * b3[2] + w4 * b4[2]) >> 8;
+/*
+=============================================================================
 
-        style = LIGHT_STYLE(surf, i);
+LIGHT GRID
 
-        color[0] += temp[0] * style->rgb[0];
-        color[1] += temp[1] * style->rgb[1];
-        color[2] += temp[2] * style->rgb[2];
+Lightmap samples of the world surface below each point of a coarse lattice
+are baked when the world is loaded, per light style so that animated styles
+keep working. Entity lighting then blends the eight surrounding points
+instead of tracing down the BSP tree.
 
-        lightmap += size;
+=============================================================================
+*/
+
+#define GRID_CELL_XY    32
+#define GRID_CELL_Z     64
+#define GRID_MAX_POINTS 0x40000
+
+typedef struct {
+    byte    styles[MAX_LIGHTMAPS];  // 255 terminates, first is 255 if empty
+    byte    rgb[MAX_LIGHTMAPS][3];
+    float   floorz;                 // height of the sampled surface
+} lightgridpoint_t;
+
+static struct {
+    lightgridpoint_t    *points;
+    vec3_t  mins;
+    vec3_t  cell, inverse;
+    int     size[3];
+} lightgrid;
+
+void GL_FreeLightGrid(void)
+{
+    Z_Free(lightgrid.points);
+    memset(&lightgrid, 0, sizeof(lightgrid));
+}
+
+static void bake_grid_point(bsp_t *bsp, vec3_t point, lightgridpoint_t *p)
+{
+    lightpoint_t    pt;
+    mleaf_t         *leaf;
+    vec3_t          end;
+    int             i;
+
+    memset(p->styles, 255, sizeof(p->styles));
+
+    leaf = BSP_PointLeaf(bsp->nodes, point);
+    if (leaf->contents & CONTENTS_SOLID)
+        return;
+
+    VectorSet(end, point[0], point[1], point[2] - LIGHT_TRACE_LENGTH);
+    BSP_LightPoint(&pt, point, end, bsp->nodes);
+    if (!pt.surf)
+        return;
+
+    GL_SampleLightmap(&pt, p->rgb);
+    for (i = 0; i < pt.surf->numstyles; i++)
+        p->styles[i] = pt.surf->styles[i];
+
+    p->floorz = point[2] - pt.fraction * LIGHT_TRACE_LENGTH;
+}
+
+void GL_BuildLightGrid(void)
+{
+    bsp_t   *bsp = gl_static.world.cache;
+    mmodel_t *world;
+    lightgridpoint_t *p;
+    vec3_t  point;
+    int     i, x, y, z, count;
+
+    GL_FreeLightGrid();
+
+    if (!gl_lightgrid->integer || !bsp || !bsp->lightmap || !bsp->nummodels)
+        return;
+
+    world = &bsp->models[0];
+    VectorSet(lightgrid.cell, GRID_CELL_XY, GRID_CELL_XY, GRID_CELL_Z);
+
+    // coarsen until it fits
+    while (1) {
+        for (i = 0, count = 1; i < 3; i++) {
+            lightgrid.size[i] = (int)ceil((world->maxs[i] - world->mins[i]) /
+                                          lightgrid.cell[i]) + 1;
+            count *= lightgrid.size[i];
+        }
+        if (count <= GRID_MAX_POINTS)
+            break;
+        VectorScale(lightgrid.cell, 2, lightgrid.cell);
+    }
+
+    VectorCopy(world->mins, lightgrid.mins);
+    for (i = 0; i < 3; i++)
+        lightgrid.inverse[i] = 1.0f / lightgrid.cell[i];
+
+    lightgrid.points = p = R_Malloc(sizeof(*p) * count);
+    for (z = 0; z < lightgrid.size[2]; z++) {
+        point[2] = lightgrid.mins[2] + z * lightgrid.cell[2];
+        for (y = 0; y < lightgrid.size[1]; y++) {
+            point[1] = lightgrid.mins[1] + y * lightgrid.cell[1];
+            for (x = 0; x < lightgrid.size[0]; x++, p++) {
+                point[0] = lightgrid.mins[0] + x * lightgrid.cell[0];
+                bake_grid_point(bsp, point, p);
+            }
+        }
     }
 
+    Com_DPrintf("%s: %dx%dx%d points, %d bytes\n", __func__,
+                lightgrid.size[0], lightgrid.size[1], lightgrid.size[2],
+                (int)(sizeof(*p) * count));
+}
+
+// trilinear blend of the surrounding grid points, empty ones are skipped
+static qboolean GL_GridLightPoint(vec3_t start, vec3_t color)
+{
+    lightgridpoint_t *p;
+    lightstyle_t    *style;
+    lightpoint_t    pt;
+    vec3_t          end, c;
+    vec_t           f, w, total, floorz, frac[3];
+    int             i, j, pos[3], ofs[3];
+
+    if (!lightgrid.points || !gl_lightgrid->integer)
+        return qfalse;
+
+    // shadows need the exact surface below
+    if (gl_shadows->integer)
+        return qfalse;
+
+    for (i = 0; i < 3; i++) {
+        f = (start[i] - lightgrid.mins[i]) * lightgrid.inverse[i];
+        clamp(f, 0, lightgrid.size[i] - 1);
+        pos[i] = (int)f;
+        if (pos[i] > lightgrid.size[i] - 2)
+            pos[i] = max(lightgrid.size[i] - 2, 0);
+        frac[i] = f - pos[i];
+    }
+
+    VectorClear(color);
+    total = floorz = 0;
+
+    for (i = 0; i < 8; i++) {
+        w = 1;
+        for (j = 0; j < 3; j++) {
+            ofs[j] = (i >> j) & 1;
+            if (pos[j] + ofs[j] >= lightgrid.size[j])
+                ofs[j] = 0;
+            w *= (i >> j) & 1 ? frac[j] : 1 - frac[j];
+        }
+        if (w <= 0)
+            continue;
+
+        p = &lightgrid.points[((pos[2] + ofs[2]) * lightgrid.size[1] +
+                               (pos[1] + ofs[1])) * lightgrid.size[0] +
+                              (pos[0] + ofs[0])];
+        if (p->styles[0] == 255)
+            continue;
+
+        VectorClear(c);
+        for (j = 0; j < MAX_LIGHTMAPS && p->styles[j] != 255; j++) {
+            style = &glr.fd.lightstyles[gl_static.lightstylemap[p->styles[j]]];
+            c[0] += p->rgb[j][0] * style->rgb[0];
+            c[1] += p->rgb[j][1] * style->rgb[1];
+            c[2] += p->rgb[j][2] * style->rgb[2];
+        }
+
+        VectorMA(color, w, c, color);
+        floorz += w * p->floorz;
+        total += w;
+    }
+
+    if (total < 0.001f)
+        return qfalse;
+
+    f = 1 / total;
+    VectorScale(color, f, color);
+    floorz *= f;
+
+    // BSP models standing above the world floor still win
+    end[0] = start[0];
+    end[1] = start[1];
+    end[2] = start[2] - LIGHT_TRACE_LENGTH;
+
+    pt.surf = NULL;
+    pt.fraction = (start[2] - floorz) / LIGHT_TRACE_LENGTH;
+    GL_TraceBspModels(start, end, &pt);
+    if (pt.surf)
+        GL_LightFromSurface(&pt, color);
+
     GL_AdjustColor(color);
 
     return qtrue;
 }
 
 #if USE_DLIGHTS
-static void GL_MarkLights_r(mnode_t *node, dlight_t *light, int lightbit)
+/*
+=============
+GL_MarkLights_r
+
+Pushes all dynamic lights down the tree in a single walk. Each node gets the
+mask of lights whose sphere reaches it, split by the node plane for children,
+and faces on the node get the lights the plane cuts through. When `vis' is
+set, nodes outside of the current PVS are skipped since their faces won't be
+drawn this frame anyway.
+=============
+*/
+static void GL_MarkLights_r(mnode_t *node, unsigned lightbits, qboolean vis)
 {
-    vec_t dot;
-    int count;
+    unsigned bits, front, back, cross;
+    dlight_t *light;
+    vec_t dot, radius;
+    int i, count;
     mface_t *face;
 
     while (node->plane) {
-        dot = PlaneDiffFast(light->transformed, node->plane);
-        if (dot > light->intensity - DLIGHT_CUTOFF) {
-            node = node->children[0];
-            continue;
+        if (vis && node->visframe != glr.visframe) {
+            return;
         }
-        if (dot < -light->intensity + DLIGHT_CUTOFF) {
-            node = node->children[1];
-            continue;
+
+        front = back = 0;
+        for (bits = lightbits; bits; bits &= bits - 1) {
+            i = q_ctz(bits);
+            light = &glr.fd.dlights[i];
+            dot = PlaneDiffFast(light->transformed, node->plane);
+            radius = light->intensity - DLIGHT_CUTOFF;
+            if (dot > -radius) {
+                front |= 1U << i;
+            }
+            if (dot < radius) {
+                back |= 1U << i;
+            }
         }
 
-        face = node->firstface;
-        count = node->numfaces;
-        while (count--) {
-            if (!(face->drawflags & SURF_NOLM_MASK)) {
-                if (face->dlightframe != glr.dlightframe) {
-                    face->dlightframe = glr.dlightframe;
-                    face->dlightbits = 0;
+        cross = front & back;
+        if (cross) {
+            face = node->firstface;
+            count = node->numfaces;
+            while (count--) {
+                if (!(face->drawflags & SURF_NOLM_MASK)) {
+                    if (face->dlightframe != glr.dlightframe) {
+                        face->dlightframe = glr.dlightframe;
+                        face->dlightbits = 0;
+                    }
+
+                    face->dlightbits |= cross;
                 }
 
-                face->dlightbits |= lightbit;
+                face++;
             }
-
-            face++;
         }
 
-        GL_MarkLights_r(node->children[0], light, lightbit);
-
-        node = node->children[1];
+        if (!back) {
+            if (!front) {
+                break;
+            }
+            node = node->children[0];
+            lightbits = front;
+        } else {
+            if (front) {
+                GL_MarkLights_r(node->children[0], front, vis);
+            }
+            node = node->children[1];
+            lightbits = back;
+        }
     }
 }
 
+static unsigned GL_LightBits(void)
+{
+    return glr.fd.num_dlights >= 32 ? ~0U : (1U << glr.fd.num_dlights) - 1;
+}
+
 static void GL_MarkLights(void)
 {
     int i;
     dlight_t *light;
 
+    if (!glr.fd.num_dlights) {
+        return;
+    }
+
     for (i = 0, light = glr.fd.dlights; i < glr.fd.num_dlights; i++, light++) {
         VectorCopy(light->origin, light->transformed);
-        GL_MarkLights_r(gl_static.world.cache->nodes, light, 1 << i);
     }
+
+    GL_MarkLights_r(gl_static.world.cache->nodes, GL_LightBits(), qtrue);
 }
 
 static void GL_TransformLights(mmodel_t *model)
@@ -190,7 +451,7 @@ static void GL_TransformLights(mmodel_t *model)
     dlight_t *light;
     vec3_t temp;
 
-    if (!model->headnode) {
+    if (!model->headnode || !glr.fd.num_dlights) {
         return;
     }
 
@@ -199,8 +460,9 @@ static void GL_TransformLights(mmodel_t *model)
         light->transformed[0] = DotProduct(temp, glr.entaxis[0]);
         light->transformed[1] = DotProduct(temp, glr.entaxis[1]);
         light->transformed[2] = DotProduct(temp, glr.entaxis[2]);
-        GL_MarkLights_r(model->headnode, light, 1 << i);
     }
+
+    GL_MarkLights_r(model->headnode, GL_LightBits(), qfalse);
 }
 
 static void GL_AddLights(vec3_t origin, vec3_t color)
@@ -229,7 +491,8 @@ void GL_LightPoint(vec3_t origin, vec3_t color)
     }
 
     // get lighting from world
-    if (!GL_SmoothLightPoint(origin, color)) {
+    if (!GL_GridLightPoint(origin, color) &&
+        !GL_SmoothLightPoint(origin, color)) {
         VectorSet(color, 1, 1, 1);
     }
 
@@ -396,6 +659,14 @@ void GL_DrawBspModel(mmodel_t *model)
         }
     }
 
+    if (gl_occlusion->integer) {
+        VectorCopy(model->mins, bounds[0]);
+        VectorCopy(model->maxs, bounds[1]);
+        if (GL_OccludeEntity(ent->origin, bounds, model->radius)) {
+            return;
+        }
+    }
+
     // protect against infinite loop if the same inline model
     // with alpha faces is referenced by multiple entities
     model->drawframe = glr.drawframe;
@@ -441,29 +712,198 @@ void GL_DrawBspModel(mmodel_t *model)
     qglPopMatrix();
 }
 
+/*
+=============================================================================
+
+VIEW CACHE
+
+Node clip results are kept per view, keyed by the exact frustum, and
+reused while the view doesn't change. Several views are kept so that
+the CCTV wall stays cached. When neither the view, the visible clusters
+nor the area bits changed, the faces collected by the previous
+traversal are added again without walking the tree at all.
+
+=============================================================================
+*/
+
+#define MAX_VIEW_CACHES     (MAX_VIEWS + 1)
+
+#define CLIP_CACHED     0x80
+#define CLIP_CULLED     0x40
+#define CLIP_FLAGS      0x0f
+
+typedef struct {
+    float       key[4 * 4 + 3];
+    int         cull;
+    unsigned    lastused;
+
+    byte        *clipmasks;     // nodes followed by leafs
+
+    // faces added by the last full traversal
+    mface_t     **faces;
+    int         numfaces;
+    qboolean    valid;
+    int         cluster1, cluster2;
+    int         novis;
+    qboolean    hasareas;
+    byte        areabits[MAX_MAP_AREAS / 8];
+} viewcache_t;
+
+static struct {
+    viewcache_t caches[MAX_VIEW_CACHES];
+    viewcache_t *current;       // clip masks used by GL_ClipNode
+    viewcache_t *recording;     // face list filled by GL_AddFace
+    unsigned    sequence;
+    bsp_t       *bsp;
+} vc;
+
+void GL_FreeViewCaches(void)
+{
+    viewcache_t *cache;
+    int i;
+
+    for (i = 0, cache = vc.caches; i < MAX_VIEW_CACHES; i++, cache++) {
+        Z_Free(cache->clipmasks);
+        Z_Free(cache->faces);
+    }
+
+    memset(&vc, 0, sizeof(vc));
+}
+
+static viewcache_t *GL_FindViewCache(int cull)
+{
+    bsp_t *bsp = gl_static.world.cache;
+    viewcache_t *cache, *oldest;
+    float key[4 * 4 + 3];
+    int i;
+
+    if (vc.bsp != bsp) {
+        GL_FreeViewCaches();
+        vc.bsp = bsp;
+    }
+
+    for (i = 0; i < 4; i++) {
+        VectorCopy(glr.frustumPlanes[i].normal, &key[i * 4]);
+        key[i * 4 + 3] = glr.frustumPlanes[i].dist;
+    }
+    VectorCopy(glr.fd.vieworg, &key[4 * 4]);
+
+    vc.sequence++;
+
+    oldest = vc.caches;
+    for (i = 0, cache = vc.caches; i < MAX_VIEW_CACHES; i++, cache++) {
+        if (cache->clipmasks && cache->cull == cull &&
+            !memcmp(cache->key, key, sizeof(key))) {
+            cache->lastused = vc.sequence;
+            return cache;
+        }
+        if (cache->lastused < oldest->lastused) {
+            oldest = cache;
+        }
+    }
+
+    // reuse the least recently used one
+    cache = oldest;
+    if (!cache->clipmasks) {
+        cache->clipmasks = Z_TagMalloc(bsp->numnodes + bsp->numleafs, TAG_RENDERER);
+        cache->faces = Z_TagMalloc(sizeof(cache->faces[0]) * bsp->numfaces, TAG_RENDERER);
+    }
+    memset(cache->clipmasks, 0, bsp->numnodes + bsp->numleafs);
+    memcpy(cache->key, key, sizeof(key));
+    cache->cull = cull;
+    cache->lastused = vc.sequence;
+    cache->valid = qfalse;
+
+    return cache;
+}
+
+static qboolean GL_ViewUnchanged(viewcache_t *cache)
+{
+    if (!cache->valid) {
+        return qfalse;
+    }
+    if (cache->cluster1 != glr.viewcluster1 || cache->cluster2 != glr.viewcluster2) {
+        return qfalse;
+    }
+    if (cache->novis != gl_novis->integer) {
+        return qfalse;
+    }
+    if (cache->hasareas != !!glr.fd.areabits) {
+        return qfalse;
+    }
+    if (glr.fd.areabits && memcmp(cache->areabits, glr.fd.areabits, sizeof(cache->areabits))) {
+        return qfalse;
+    }
+    return qtrue;
+}
+
+static void GL_BeginRecording(viewcache_t *cache)
+{
+    cache->numfaces = 0;
+    cache->cluster1 = glr.viewcluster1;
+    cache->cluster2 = glr.viewcluster2;
+    cache->novis = gl_novis->integer;
+    cache->hasareas = !!glr.fd.areabits;
+    if (glr.fd.areabits) {
+        memcpy(cache->areabits, glr.fd.areabits, sizeof(cache->areabits));
+    }
+    vc.recording = cache;
+}
+
+static void GL_EndRecording(void)
+{
+    vc.recording->valid = qtrue;
+    vc.recording = NULL;
+}
+
+static inline byte *GL_ClipMask(mnode_t *node)
+{
+    bsp_t *bsp = vc.bsp;
+
+    if (node->plane) {
+        return &vc.current->clipmasks[node - bsp->nodes];
+    }
+    return &vc.current->clipmasks[bsp->numnodes + ((mleaf_t *)node - bsp->leafs)];
+}
+
 #define NODE_CLIPPED    0
 #define NODE_UNCLIPPED  15
 
 static inline qboolean GL_ClipNode(mnode_t *node, int *clipflags)
 {
     int flags = *clipflags;
-    int i, bits, mask;
+    int bits;
+    byte *cached = NULL;
 
     if (flags == NODE_UNCLIPPED) {
         return qtrue;
     }
-    for (i = 0, mask = 1; i < 4; i++, mask <<= 1) {
-        if (flags & mask) {
-            continue;
-        }
-        bits = BoxOnPlaneSide(node->mins, node->maxs,
-                              &glr.frustumPlanes[i]);
-        if (bits == BOX_BEHIND) {
-            return qfalse;
+
+    // incoming flags only depend on the frustum, so the result can be
+    // reused as long as the frustum is the same
+    if (vc.current) {
+        cached = GL_ClipMask(node);
+        if (*cached & CLIP_CACHED) {
+            if (*cached & CLIP_CULLED) {
+                return qfalse;
+            }
+            *clipflags = *cached & CLIP_FLAGS;
+            return qtrue;
         }
-        if (bits == BOX_INFRONT) {
-            flags |= mask;
+    }
+
+    // all four planes at once, those already passed are masked out
+    bits = BoxOnPlanes4Side(node->mins, node->maxs, &glr.frustum4);
+    if (BOX4_BEHIND(bits) & ~flags) {
+        if (cached) {
+            *cached = CLIP_CACHED | CLIP_CULLED;
         }
+        return qfalse;
+    }
+    flags |= BOX4_INFRONT(bits);
+
+    if (cached) {
+        *cached = CLIP_CACHED | flags;
     }
 
     *clipflags = flags;
@@ -471,15 +911,16 @@ static inline qboolean GL_ClipNode(mnode_t *node, int *clipflags)
     return qtrue;
 }
 
-static inline void GL_DrawLeaf(mleaf_t *leaf)
+// safe to call from worker threads
+static inline qboolean GL_MarkLeaf(mleaf_t *leaf)
 {
     mface_t **face, **last;
 
     if (leaf->contents == CONTENTS_SOLID) {
-        return; // solid leaf
+        return qfalse; // solid leaf
     }
     if (glr.fd.areabits && !Q_IsBitSet(glr.fd.areabits, leaf->area)) {
-        return; // door blocks sight
+        return qfalse; // door blocks sight
     }
 
     last = leaf->firstleafface + leaf->numleaffaces;
@@ -487,7 +928,33 @@ static inline void GL_DrawLeaf(mleaf_t *leaf)
         (*face)->drawframe = glr.drawframe;
     }
 
-    c.leavesDrawn++;
+    return qtrue;
+}
+
+static inline void GL_DrawLeaf(mleaf_t *leaf)
+{
+    if (GL_MarkLeaf(leaf)) {
+        c.leavesDrawn++;
+    }
+}
+
+static inline void GL_AddFace(mface_t *face)
+{
+    if (vc.recording) {
+        vc.recording->faces[vc.recording->numfaces++] = face;
+    }
+
+    if (face->drawflags & SURF_SKY) {
+        R_AddSkySurface(face);
+        return;
+    }
+
+    if (face->drawflags & (SURF_TRANS33 | SURF_TRANS66)) {
+        GL_AddAlphaFace(face);
+        return;
+    }
+
+    GL_AddSolidFace(face);
 }
 
 static inline void GL_DrawNode(mnode_t *node)
@@ -495,28 +962,244 @@ static inline void GL_DrawNode(mnode_t *node)
     mface_t *face, *last = node->firstface + node->numfaces;
 
     for (face = node->firstface; face < last; face++) {
-        if (face->drawframe != glr.drawframe) {
-            continue;
+        if (face->drawframe == glr.drawframe) {
+            GL_AddFace(face);
         }
+    }
 
-        if (face->drawflags & SURF_SKY) {
-            R_AddSkySurface(face);
-            continue;
+    c.nodesDrawn++;
+}
+
+static void GL_WorldNode_r(mnode_t *node, int clipflags)
+{
+    int side;
+    vec_t dot;
+
+    while (node->visframe == glr.visframe) {
+        if (!GL_ClipNode(node, &clipflags)) {
+            c.nodesCulled++;
+            break;
         }
 
-        if (face->drawflags & (SURF_TRANS33 | SURF_TRANS66)) {
-            GL_AddAlphaFace(face);
-            continue;
+        if (!node->plane) {
+            GL_DrawLeaf((mleaf_t *)node);
+            break;
         }
 
-        GL_AddSolidFace(face);
+        dot = PlaneDiffFast(glr.fd.vieworg, node->plane);
+        side = dot < 0;
+
+        GL_WorldNode_r(node->children[side], clipflags);
+
+        GL_DrawNode(node);
+
+        node = node->children[side ^ 1];
     }
+}
 
-    c.nodesDrawn++;
+/*
+=============================================================================
+
+PARALLEL TRAVERSAL
+
+The tree is walked on the main thread down to a fixed depth. Subtrees
+below that depth become jobs that worker threads cull and collect faces
+from, each into its own slice of a per-world face buffer. Faces are then
+added on the main thread in the same front to back order the serial
+traversal would produce, since adding a face may upload lightmaps.
+
+=============================================================================
+*/
+
+#define WORLD_SPLIT_DEPTH   5
+#define MAX_WORLD_JOBS      (1 << WORLD_SPLIT_DEPTH)
+#define MAX_WORLD_ITEMS     (MAX_WORLD_JOBS * 2)
+#define MAX_WORLD_THREADS   8
+
+typedef struct {
+    mnode_t     *node;
+    int         clipflags;
+    mface_t     **faces;
+    int         numfaces;
+    int         nodesCulled;
+    int         nodesDrawn;
+    int         leavesDrawn;
+} worldjob_t;
+
+// either a job or faces of a node above the split depth
+typedef struct {
+    mnode_t     *node;
+    worldjob_t  *job;
+} worlditem_t;
+
+static struct {
+    qthread_t   *threads[MAX_WORLD_THREADS];
+    int         numthreads;
+    qmutex_t    *lock;
+    qcond_t     *wake;
+    qcond_t     *done;
+    qboolean    quit;
+
+    worldjob_t  jobs[MAX_WORLD_JOBS];
+    int         numplanned;
+    int         numjobs;
+    int         nextjob;
+    int         finished;
+
+    worlditem_t items[MAX_WORLD_ITEMS];
+    int         numitems;
+
+    // face buffer slices, indexed by node number
+    bsp_t       *bsp;
+    int         *bases;
+    mface_t     **faces;
+} wt;
+
+static void GL_JobNode_r(worldjob_t *job, mnode_t *node, int clipflags)
+{
+    mface_t *face, *last;
+    int side;
+    vec_t dot;
+
+    while (node->visframe == glr.visframe) {
+        if (!GL_ClipNode(node, &clipflags)) {
+            job->nodesCulled++;
+            break;
+        }
+
+        if (!node->plane) {
+            if (GL_MarkLeaf((mleaf_t *)node)) {
+                job->leavesDrawn++;
+            }
+            break;
+        }
+
+        dot = PlaneDiffFast(glr.fd.vieworg, node->plane);
+        side = dot < 0;
+
+        GL_JobNode_r(job, node->children[side], clipflags);
+
+        last = node->firstface + node->numfaces;
+        for (face = node->firstface; face < last; face++) {
+            if (face->drawframe == glr.drawframe) {
+                job->faces[job->numfaces++] = face;
+            }
+        }
+        job->nodesDrawn++;
+
+        node = node->children[side ^ 1];
+    }
 }
 
-static void GL_WorldNode_r(mnode_t *node, int clipflags)
+// called with the lock held, returns with it held
+static void GL_RunJobs(void)
 {
+    worldjob_t *job;
+
+    while (wt.nextjob < wt.numjobs) {
+        job = &wt.jobs[wt.nextjob++];
+        Sys_UnlockMutex(wt.lock);
+
+        GL_JobNode_r(job, job->node, job->clipflags);
+
+        Sys_LockMutex(wt.lock);
+        if (++wt.finished == wt.numjobs) {
+            Sys_SignalCond(wt.done);
+        }
+    }
+}
+
+static void GL_WorldThread(void *arg)
+{
+    Sys_LockMutex(wt.lock);
+    while (1) {
+        while (!wt.quit && wt.nextjob >= wt.numjobs) {
+            Sys_WaitCond(wt.wake, wt.lock);
+        }
+        if (wt.quit) {
+            break;
+        }
+        GL_RunJobs();
+    }
+    Sys_UnlockMutex(wt.lock);
+}
+
+void GL_ShutdownWorldThreads(void)
+{
+    int i;
+
+    if (!wt.numthreads) {
+        return;
+    }
+
+    Sys_LockMutex(wt.lock);
+    wt.quit = qtrue;
+    Sys_BroadcastCond(wt.wake);
+    Sys_UnlockMutex(wt.lock);
+
+    for (i = 0; i < wt.numthreads; i++) {
+        Sys_JoinThread(wt.threads[i]);
+    }
+
+    Sys_DestroyCond(wt.done);
+    Sys_DestroyCond(wt.wake);
+    Sys_DestroyMutex(wt.lock);
+
+    wt.numthreads = 0;
+    gl_world_threads->modified = qtrue;
+}
+
+static qboolean GL_InitWorldThreads(void)
+{
+    int i, count;
+
+    if (gl_world_threads->modified) {
+        GL_ShutdownWorldThreads();
+        gl_world_threads->modified = qfalse;
+
+        count = Cvar_ClampInteger(gl_world_threads, 0, MAX_WORLD_THREADS);
+        if (count) {
+            wt.lock = Sys_CreateMutex();
+            wt.wake = Sys_CreateCond();
+            wt.done = Sys_CreateCond();
+            wt.quit = qfalse;
+            wt.numjobs = wt.nextjob = wt.finished = 0;
+            for (i = 0; i < count; i++) {
+                wt.threads[i] = Sys_CreateThread(GL_WorldThread, NULL);
+            }
+            wt.numthreads = count;
+        }
+    }
+
+    return wt.numthreads > 0;
+}
+
+void GL_FreeWorldJobs(void)
+{
+    Z_Free(wt.bases);
+    Z_Free(wt.faces);
+    wt.bases = NULL;
+    wt.faces = NULL;
+    wt.bsp = NULL;
+}
+
+// gives each node a slice of the face buffer large enough for its subtree
+static int GL_AssignSlices_r(mnode_t *node, int base)
+{
+    if (!node->plane) {
+        return base;
+    }
+
+    wt.bases[node - wt.bsp->nodes] = base;
+    base += node->numfaces;
+    base = GL_AssignSlices_r(node->children[0], base);
+    base = GL_AssignSlices_r(node->children[1], base);
+    return base;
+}
+
+static void GL_PlanNode_r(mnode_t *node, int clipflags, int depth)
+{
+    worldjob_t *job;
     int side;
     vec_t dot;
 
@@ -531,19 +1214,89 @@ static void GL_WorldNode_r(mnode_t *node, int clipflags)
             break;
         }
 
+        if (depth == WORLD_SPLIT_DEPTH) {
+            job = &wt.jobs[wt.numplanned++];
+            job->node = node;
+            job->clipflags = clipflags;
+            job->faces = wt.faces + wt.bases[node - wt.bsp->nodes];
+            job->numfaces = 0;
+            job->nodesCulled = job->nodesDrawn = job->leavesDrawn = 0;
+
+            wt.items[wt.numitems].node = NULL;
+            wt.items[wt.numitems].job = job;
+            wt.numitems++;
+            break;
+        }
+
         dot = PlaneDiffFast(glr.fd.vieworg, node->plane);
         side = dot < 0;
 
-        GL_WorldNode_r(node->children[side], clipflags);
+        GL_PlanNode_r(node->children[side], clipflags, depth + 1);
 
-        GL_DrawNode(node);
+        wt.items[wt.numitems].node = node;
+        wt.items[wt.numitems].job = NULL;
+        wt.numitems++;
 
         node = node->children[side ^ 1];
+        depth++;
+    }
+}
+
+static void GL_WorldThreaded(mnode_t *root, int clipflags)
+{
+    bsp_t *bsp = gl_static.world.cache;
+    worlditem_t *item;
+    worldjob_t *job;
+    int i, j;
+
+    if (wt.bsp != bsp) {
+        GL_FreeWorldJobs();
+        wt.bsp = bsp;
+        wt.bases = Z_TagMalloc(sizeof(wt.bases[0]) * bsp->numnodes, TAG_RENDERER);
+        wt.faces = Z_TagMalloc(sizeof(wt.faces[0]) * bsp->numfaces, TAG_RENDERER);
+        GL_AssignSlices_r(bsp->nodes, 0);
+    }
+
+    // leaves and nodes above the split are handled here, in order
+    wt.numplanned = 0;
+    wt.numitems = 0;
+    GL_PlanNode_r(root, clipflags, 0);
+
+    // help the workers, then wait for stragglers
+    Sys_LockMutex(wt.lock);
+    wt.numjobs = wt.numplanned;
+    wt.nextjob = wt.finished = 0;
+    if (wt.numjobs) {
+        Sys_BroadcastCond(wt.wake);
+        GL_RunJobs();
+        while (wt.finished < wt.numjobs) {
+            Sys_WaitCond(wt.done, wt.lock);
+        }
+    }
+    Sys_UnlockMutex(wt.lock);
+
+    for (i = 0, item = wt.items; i < wt.numitems; i++, item++) {
+        job = item->job;
+        if (!job) {
+            GL_DrawNode(item->node);
+            continue;
+        }
+
+        for (j = 0; j < job->numfaces; j++) {
+            GL_AddFace(job->faces[j]);
+        }
+        c.nodesCulled += job->nodesCulled;
+        c.nodesDrawn += job->nodesDrawn;
+        c.leavesDrawn += job->leavesDrawn;
     }
 }
 
 void GL_DrawWorld(void)
 {
+    int clipflags = gl_cull_nodes->integer ? NODE_CLIPPED : NODE_UNCLIPPED;
+    viewcache_t *cache = NULL;
+    int i;
+
     GL_MarkLeaves();
 
 #if USE_DLIGHTS
@@ -559,8 +1312,32 @@ void GL_DrawWorld(void)
         GL_BeginLights();
     }
 
-    GL_WorldNode_r(gl_static.world.cache->nodes,
-                   gl_cull_nodes->integer ? NODE_CLIPPED : NODE_UNCLIPPED);
+    if (gl_cull_cache->integer) {
+        cache = GL_FindViewCache(clipflags);
+    }
+
+    if (cache && GL_ViewUnchanged(cache)) {
+        // nothing moved, add the same faces again
+        for (i = 0; i < cache->numfaces; i++) {
+            GL_AddFace(cache->faces[i]);
+        }
+    } else {
+        if (cache) {
+            vc.current = cache;
+            GL_BeginRecording(cache);
+        }
+
+        if (GL_InitWorldThreads()) {
+            GL_WorldThreaded(gl_static.world.cache->nodes, clipflags);
+        } else {
+            GL_WorldNode_r(gl_static.world.cache->nodes, clipflags);
+        }
+
+        if (cache) {
+            GL_EndRecording();
+            vc.current = NULL;
+        }
+    }
 
     if (gl_dynamic->integer) {
         GL_EndLights();
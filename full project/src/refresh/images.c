@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cvar.h"
 #include "common/files.h"
 #include "refresh/images.h"
+#include "system/thread.h"
 #include "format/pcx.h"
 #include "format/wal.h"
 
@@ -44,6 +45,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <setjmp.h>
 #endif
 
+// 32-bit loaders can also decode on a registration worker. in that case
+// filename is NULL and nothing is printed, and *pic on entry points to a
+// buffer for *width by *height pixels, as found by probe_image().
 #define IMG_LOAD(x) \
     static qerror_t IMG_Load##x(byte *rawdata, size_t rawlen, \
         const char *filename, byte **pic, int *width, int *height)
@@ -431,7 +435,7 @@ break_out:
 IMG_LOAD(TGA)
 {
     size_t offset;
-    byte *pixels;
+    byte *pixels, *dest = *pic;
     unsigned w, h, id_length, image_type, pixel_size, attributes, bpp;
     tga_decode_t decode;
     qerror_t ret;
@@ -460,12 +464,18 @@ IMG_LOAD(TGA)
     } else if (pixel_size == 24) {
         bpp = 3;
     } else {
-        Com_DPrintf("%s: %s: only 32 and 24 bit targa RGB images supported\n", __func__, filename);
+        if (filename)
+            Com_DPrintf("%s: %s: only 32 and 24 bit targa RGB images supported\n", __func__, filename);
         return Q_ERR_INVALID_FORMAT;
     }
 
     if (w < 1 || h < 1 || w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE) {
-        Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        if (filename)
+            Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        return Q_ERR_INVALID_FORMAT;
+    }
+
+    if (dest && (w != *width || h != *height)) {
         return Q_ERR_INVALID_FORMAT;
     }
 
@@ -488,7 +498,8 @@ IMG_LOAD(TGA)
         }
     } else if (image_type == 10) {
         if (attributes & 32) {
-            Com_DPrintf("%s: %s: vertically flipped, RLE encoded images are not supported\n", __func__, filename);
+            if (filename)
+                Com_DPrintf("%s: %s: vertically flipped, RLE encoded images are not supported\n", __func__, filename);
             return Q_ERR_INVALID_FORMAT;
         }
         if (pixel_size == 32) {
@@ -497,14 +508,16 @@ IMG_LOAD(TGA)
             decode = tga_decode_bgr_rle;
         }
     } else {
-        Com_DPrintf("%s: %s: only type 2 and 10 targa RGB images supported\n", __func__, filename);
+        if (filename)
+            Com_DPrintf("%s: %s: only type 2 and 10 targa RGB images supported\n", __func__, filename);
         return Q_ERR_INVALID_FORMAT;
     }
 
-    pixels = IMG_AllocPixels(w * h * 4);
+    pixels = dest ? dest : IMG_AllocPixels(w * h * 4);
     ret = decode(rawdata + offset, pixels, w, h, rawdata + rawlen);
     if (ret < 0) {
-        IMG_FreePixels(pixels);
+        if (!dest)
+            IMG_FreePixels(pixels);
         return ret;
     }
 
@@ -569,9 +582,13 @@ METHODDEF(void) my_output_message(j_common_ptr cinfo)
 
     (*cinfo->err->format_message)(cinfo, buffer);
 
-    Com_EPrintf("libjpeg: %s: %s\n", jerr->filename, buffer);
+    if (jerr->filename)
+        Com_EPrintf("libjpeg: %s: %s\n", jerr->filename, buffer);
 }
 
+// errors are reported by the caller
+METHODDEF(void) my_silent_message(j_common_ptr cinfo) { }
+
 METHODDEF(void) my_error_exit(j_common_ptr cinfo)
 {
     my_error_ptr jerr = (my_error_ptr)cinfo->err;
@@ -639,7 +656,7 @@ IMG_LOAD(JPG)
     struct my_error_mgr jerr;
     JSAMPROW row_pointer;
     byte buffer[MAX_TEXTURE_SIZE * 3];
-    byte *pixels;
+    byte *pixels, *dest = *pic;
     byte *in, *out;
     int i;
     qerror_t ret;
@@ -663,7 +680,8 @@ IMG_LOAD(JPG)
     jpeg_read_header(&cinfo, TRUE);
 
     if (cinfo.out_color_space != JCS_RGB && cinfo.out_color_space != JCS_GRAYSCALE) {
-        Com_DPrintf("%s: %s: invalid image color space\n", __func__, filename);
+        if (filename)
+            Com_DPrintf("%s: %s: invalid image color space\n", __func__, filename);
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
@@ -671,22 +689,30 @@ IMG_LOAD(JPG)
     jpeg_start_decompress(&cinfo);
 
     if (cinfo.output_components != 3 && cinfo.output_components != 1) {
-        Com_DPrintf("%s: %s: invalid number of color components\n", __func__, filename);
+        if (filename)
+            Com_DPrintf("%s: %s: invalid number of color components\n", __func__, filename);
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
 
     if (cinfo.output_width > MAX_TEXTURE_SIZE || cinfo.output_height > MAX_TEXTURE_SIZE) {
-        Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        if (filename)
+            Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        ret = Q_ERR_INVALID_FORMAT;
+        goto fail;
+    }
+
+    if (dest && (cinfo.output_width != *width || cinfo.output_height != *height)) {
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
 
-    pixels = out = IMG_AllocPixels(cinfo.output_height * cinfo.output_width * 4);
+    pixels = out = dest ? dest : IMG_AllocPixels(cinfo.output_height * cinfo.output_width * 4);
     row_pointer = (JSAMPROW)buffer;
 
     if (setjmp(jerr.setjmp_buffer)) {
-        IMG_FreePixels(pixels);
+        if (!dest)
+            IMG_FreePixels(pixels);
         ret = jerr.error;
         goto fail;
     }
@@ -802,19 +828,20 @@ IMG_SAVE(JPG)
 {
     struct jpeg_compress_struct cinfo;
     struct my_error_mgr jerr;
-    JSAMPARRAY row_pointers;
+    JSAMPROW row_pointer;
     int row_stride;
     qerror_t ret;
     int i;
 
     cinfo.err = jpeg_std_error(&jerr.pub);
     jerr.pub.error_exit = my_error_exit;
+    jerr.pub.output_message = my_silent_message;
     jerr.filename = filename;
     jerr.error = Q_ERR_FAILURE;
 
     if (setjmp(jerr.setjmp_buffer)) {
         ret = jerr.error;
-        goto fail1;
+        goto fail;
     }
 
     jpeg_create_compress(&cinfo);
@@ -831,27 +858,20 @@ IMG_SAVE(JPG)
 
     jpeg_start_compress(&cinfo, TRUE);
 
-    row_pointers = FS_AllocTempMem(sizeof(JSAMPROW) * height);
     row_stride = width * 3;    // JSAMPLEs per row in image_buffer
 
+    // rows are fed one at a time so that no zone memory is needed,
+    // this runs on the screenshot thread
     for (i = 0; i < height; i++) {
-        row_pointers[i] = (JSAMPROW)(pic + (height - i - 1) * row_stride);
-    }
-
-    if (setjmp(jerr.setjmp_buffer)) {
-        ret = jerr.error;
-        goto fail2;
+        row_pointer = (JSAMPROW)(pic + (height - i - 1) * row_stride);
+        jpeg_write_scanlines(&cinfo, &row_pointer, 1);
     }
 
-    jpeg_write_scanlines(&cinfo, row_pointers, height);
-
     jpeg_finish_compress(&cinfo);
 
     ret = Q_ERR_SUCCESS;
 
-fail2:
-    FS_FreeTempMem(row_pointers);
-fail1:
+fail:
     jpeg_destroy_compress(&cinfo);
     return ret;
 }
@@ -898,7 +918,7 @@ static void my_png_error_fn(png_structp png_ptr, png_const_charp error_msg)
 {
     my_png_error *err = png_get_error_ptr(png_ptr);
 
-    if (err->error == Q_ERR_LIBRARY_ERROR) {
+    if (err->error == Q_ERR_LIBRARY_ERROR && err->filename) {
         Com_EPrintf("libpng: %s: %s\n", err->filename, error_msg);
     }
     longjmp(png_jmpbuf(png_ptr), -1);
@@ -908,12 +928,13 @@ static void my_png_warning_fn(png_structp png_ptr, png_const_charp warning_msg)
 {
     my_png_error *err = png_get_error_ptr(png_ptr);
 
-    Com_WPrintf("libpng: %s: %s\n", err->filename, warning_msg);
+    if (err->filename)
+        Com_WPrintf("libpng: %s: %s\n", err->filename, warning_msg);
 }
 
 IMG_LOAD(PNG)
 {
-    byte *pixels;
+    byte *pixels, *dest = *pic;
     png_bytep row_pointers[MAX_TEXTURE_SIZE];
     png_uint_32 w, h, rowbytes, row;
     int bitdepth, colortype;
@@ -957,7 +978,8 @@ IMG_LOAD(PNG)
     }
 
     if (w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE) {
-        Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        if (filename)
+            Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
@@ -993,14 +1015,21 @@ IMG_LOAD(PNG)
     png_read_update_info(png_ptr, info_ptr);
 
     rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    pixels = IMG_AllocPixels(h * rowbytes);
+
+    if (dest && (w != *width || h != *height || rowbytes != w * 4)) {
+        ret = Q_ERR_INVALID_FORMAT;
+        goto fail;
+    }
+
+    pixels = dest ? dest : IMG_AllocPixels(h * rowbytes);
 
     for (row = 0; row < h; row++) {
         row_pointers[row] = pixels + row * rowbytes;
     }
 
     if (setjmp(png_jmpbuf(png_ptr))) {
-        IMG_FreePixels(pixels);
+        if (!dest)
+            IMG_FreePixels(pixels);
         ret = my_err.error;
         goto fail;
     }
@@ -1033,11 +1062,18 @@ static void my_png_write_fn(png_structp png_ptr, png_bytep buf, png_size_t size)
 
 static void my_png_flush_fn(png_structp png_ptr) { }
 
+// errors are reported by the caller
+static void my_png_write_error_fn(png_structp png_ptr, png_const_charp error_msg)
+{
+    longjmp(png_jmpbuf(png_ptr), -1);
+}
+
+static void my_png_write_warning_fn(png_structp png_ptr, png_const_charp warning_msg) { }
+
 IMG_SAVE(PNG)
 {
     png_structp png_ptr;
     png_infop info_ptr;
-    png_bytepp row_pointers;
     int i, row_stride;
     my_png_error my_err;
     qerror_t ret;
@@ -1046,7 +1082,7 @@ IMG_SAVE(PNG)
     my_err.error = Q_ERR_LIBRARY_ERROR;
 
     png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-                                      (png_voidp)&my_err, my_png_error_fn, my_png_warning_fn);
+                                      (png_voidp)&my_err, my_png_write_error_fn, my_png_write_warning_fn);
     if (!png_ptr) {
         return Q_ERR_LIBRARY_ERROR;
     }
@@ -1054,12 +1090,12 @@ IMG_SAVE(PNG)
     info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) {
         ret = Q_ERR_LIBRARY_ERROR;
-        goto fail1;
+        goto fail;
     }
 
     if (setjmp(png_jmpbuf(png_ptr))) {
         ret = my_err.error;
-        goto fail1;
+        goto fail;
     }
 
     png_set_write_fn(png_ptr, (png_voidp)&f,
@@ -1073,27 +1109,20 @@ IMG_SAVE(PNG)
                               clamp(param, Z_NO_COMPRESSION, Z_BEST_COMPRESSION));
 #endif
 
-    row_pointers = FS_AllocTempMem(sizeof(png_bytep) * height);
-    row_stride = width * 3;
+    png_write_info(png_ptr, info_ptr);
 
+    // rows are written one at a time so that no zone memory is needed,
+    // this runs on the screenshot thread
+    row_stride = width * 3;
     for (i = 0; i < height; i++) {
-        row_pointers[i] = (png_bytep)pic + (height - i - 1) * row_stride;
-    }
-
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        ret = my_err.error;
-        goto fail2;
+        png_write_row(png_ptr, (png_bytep)pic + (height - i - 1) * row_stride);
     }
 
-    png_set_rows(png_ptr, info_ptr, row_pointers);
-
-    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+    png_write_end(png_ptr, info_ptr);
 
     ret = Q_ERR_SUCCESS;
 
-fail2:
-    FS_FreeTempMem(row_pointers);
-fail1:
+fail:
     png_destroy_write_struct(&png_ptr, &info_ptr);
     return ret;
 }
@@ -1150,33 +1179,622 @@ static qhandle_t create_screenshot(char *buffer, size_t size,
     return 0;
 }
 
+/*
+Screenshots are encoded and written on a worker thread. The main thread
+reads the pixels back, opens the file and later closes it, reports the
+result and frees the memory, so the worker never touches the zone or the
+console. With pixel buffer objects the readback itself is also deferred
+until the next frame, so the GPU is never stalled waiting for it.
+*/
+
+#define MAX_SCREENSHOT_JOBS     8
+#define MAX_READBACK_SLOTS      2
+
+typedef qerror_t (*screenshot_save_t)(qhandle_t, const char *, const byte *, int, int, int);
+
+typedef struct {
+    list_t              entry;
+    char                filename[MAX_OSPATH];
+    qhandle_t           f;
+    screenshot_save_t   save;
+    qboolean            reverse;
+    int                 param;
+    byte                *pixels;
+    int                 width, height;
+    qerror_t            ret;
+    qboolean            quiet;
+    qboolean            stream;     // frame for the stream, f is unused
+} screenshot_t;
+
+static struct {
+    qthread_t       *thread;
+    qmutex_t        *lock;
+    qcond_t         *cond;
+    list_t          pending;    // waiting for the worker
+    list_t          done;       // waiting to be retired by the main thread
+    int             numjobs;    // submitted but not yet retired
+    qboolean        quit;
+
+    screenshot_t    *readback[MAX_READBACK_SLOTS];
+    unsigned        readback_frame[MAX_READBACK_SLOTS];
+    unsigned        framenum;
+
+    // continuous frame dump
+    qboolean            dumping;
+    char                dump_name[MAX_QPATH];
+    const char          *dump_ext;
+    screenshot_save_t   dump_save;
+    qboolean            dump_reverse;
+    int                 dump_param;
+    int                 dump_frames;
+
+    // raw I420 frame stream, the file is only written by the worker
+    FILE                *stream_fp;
+    char                stream_path[MAX_OSPATH];
+    int                 stream_width, stream_height;
+    byte                *stream_buf;    // worker's conversion buffer
+    screenshot_t        *stream_read[MAX_READBACK_SLOTS];
+    unsigned            stream_frame[MAX_READBACK_SLOTS];
+    int                 stream_frames;
+    int                 stream_dropped;
+    qerror_t            stream_error;
+} shots;
+
+static void screenshot_thread(void *arg)
+{
+    screenshot_t *s;
+
+    Sys_LockMutex(shots.lock);
+    while (1) {
+        while (!shots.quit && LIST_EMPTY(&shots.pending)) {
+            Sys_WaitCond(shots.cond, shots.lock);
+        }
+        if (LIST_EMPTY(&shots.pending)) {
+            break;
+        }
+
+        s = LIST_FIRST(screenshot_t, &shots.pending, entry);
+        List_Remove(&s->entry);
+        Sys_UnlockMutex(shots.lock);
+
+        s->ret = s->save(s->f, s->filename, s->pixels, s->width, s->height, s->param);
+
+        Sys_LockMutex(shots.lock);
+        List_Append(&shots.done, &s->entry);
+        Sys_BroadcastCond(shots.cond);
+    }
+    Sys_UnlockMutex(shots.lock);
+}
+
+// retire finished jobs, waiting until no more than `keep' are outstanding
+static void retire_screenshots(int keep)
+{
+    screenshot_t *s, *next;
+    list_t done;
+
+    Sys_LockMutex(shots.lock);
+    while (shots.numjobs > keep && LIST_EMPTY(&shots.done)) {
+        Sys_WaitCond(shots.cond, shots.lock);
+    }
+    if (LIST_EMPTY(&shots.done)) {
+        List_Init(&done);
+    } else {
+        done = shots.done;
+        done.next->prev = &done;
+        done.prev->next = &done;
+        List_Init(&shots.done);
+    }
+    Sys_UnlockMutex(shots.lock);
+
+    LIST_FOR_EACH_SAFE(screenshot_t, s, next, &done, entry) {
+        FS_FCloseFile(s->f);
+        if (s->stream) {
+            if (s->ret < 0 && !shots.stream_error) {
+                shots.stream_error = s->ret;
+            }
+        } else if (s->ret < 0) {
+            Com_EPrintf("Couldn't write %s: %s\n", s->filename, Q_ErrorString(s->ret));
+        } else if (!s->quiet) {
+            Com_Printf("Wrote %s\n", s->filename);
+        }
+        FS_FreeTempMem(s->pixels);
+        Z_Free(s);
+        shots.numjobs--;
+    }
+
+    if (shots.numjobs > keep) {
+        retire_screenshots(keep);
+    }
+}
+
+static void submit_screenshot(screenshot_t *s)
+{
+    // block rather than drop frames when the worker falls behind
+    retire_screenshots(MAX_SCREENSHOT_JOBS - 1);
+
+    Sys_LockMutex(shots.lock);
+    List_Append(&shots.pending, &s->entry);
+    Sys_SignalCond(shots.cond);
+    Sys_UnlockMutex(shots.lock);
+
+    shots.numjobs++;
+}
+
+static void finish_capture(int slot)
+{
+    screenshot_t *s = shots.readback[slot];
+
+    shots.readback[slot] = NULL;
+
+    s->pixels = IMG_EndReadPixels(slot, &s->width, &s->height);
+    if (!s->pixels) {
+        // mapping failed, read synchronously instead
+        s->pixels = IMG_ReadPixels(s->reverse, &s->width, &s->height);
+    }
+
+    submit_screenshot(s);
+}
+
+static void start_capture(screenshot_t *s)
+{
+    int i, oldest = 0;
+
+    for (i = 0; i < MAX_READBACK_SLOTS; i++) {
+        if (!shots.readback[i]) {
+            break;
+        }
+        if (shots.readback_frame[i] < shots.readback_frame[oldest]) {
+            oldest = i;
+        }
+    }
+
+    if (i == MAX_READBACK_SLOTS) {
+        finish_capture(oldest);
+        i = oldest;
+    }
+
+    if (IMG_BeginReadPixels(i, s->reverse)) {
+        shots.readback[i] = s;
+        shots.readback_frame[i] = shots.framenum;
+        return;
+    }
+
+    s->pixels = IMG_ReadPixels(s->reverse, &s->width, &s->height);
+    submit_screenshot(s);
+}
+
+static void finish_all_captures(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_READBACK_SLOTS; i++) {
+        if (shots.readback[i]) {
+            finish_capture(i);
+        }
+    }
+}
+
+static screenshot_t *alloc_screenshot(screenshot_save_t save, qboolean reverse, int param)
+{
+    screenshot_t *s = Z_Mallocz(sizeof(*s));
+
+    s->save = save;
+    s->reverse = reverse;
+    s->param = param;
+
+    return s;
+}
+
 static void make_screenshot(const char *name, const char *ext,
-                            qerror_t (*save)(qhandle_t, const char *, const byte *, int, int, int),
-                            qboolean reverse, int param)
+                            screenshot_save_t save, qboolean reverse, int param)
 {
-    char        buffer[MAX_OSPATH];
-    byte        *pixels;
-    qerror_t    ret;
-    qhandle_t   f;
-    int         w, h;
+    screenshot_t *s;
+    qhandle_t f;
+
+    if (!shots.thread) {
+        return;
+    }
+
+    s = alloc_screenshot(save, reverse, param);
 
-    f = create_screenshot(buffer, sizeof(buffer), name, ext);
+    f = create_screenshot(s->filename, sizeof(s->filename), name, ext);
     if (!f) {
+        Z_Free(s);
         return;
     }
 
-    pixels = IMG_ReadPixels(reverse, &w, &h);
-    ret = save(f, buffer, pixels, w, h, param);
-    FS_FreeTempMem(pixels);
+    s->f = f;
+    start_capture(s);
+}
 
-    FS_FCloseFile(f);
+static void dump_frame(void)
+{
+    screenshot_t *s;
+    qerror_t ret;
 
-    if (ret < 0) {
-        Com_EPrintf("Couldn't write %s: %s\n", buffer, Q_ErrorString(ret));
+    s = alloc_screenshot(shots.dump_save, shots.dump_reverse, shots.dump_param);
+    s->quiet = qtrue;
+
+    Q_snprintf(s->filename, sizeof(s->filename), "screenshots/%s/%06d%s",
+               shots.dump_name, shots.dump_frames, shots.dump_ext);
+
+    ret = FS_FOpenFile(s->filename, &s->f, FS_MODE_WRITE);
+    if (!s->f) {
+        Com_EPrintf("Couldn't open %s for writing: %s\n",
+                    s->filename, Q_ErrorString(ret));
+        Z_Free(s);
+        shots.dumping = qfalse;
+        return;
+    }
+
+    shots.dump_frames++;
+    start_capture(s);
+}
+
+static void stop_framedump(void)
+{
+    if (!shots.dumping) {
+        return;
+    }
+
+    shots.dumping = qfalse;
+    Com_Printf("Dumped %d frames to screenshots/%s/\n",
+               shots.dump_frames, shots.dump_name);
+}
+
+/*
+==================
+IMG_FrameDump_f
+
+Captures every frame into a numbered sequence until stopped.
+==================
+*/
+static void IMG_FrameDump_f(void)
+{
+#if USE_JPG || USE_PNG
+    const char *s;
+#endif
+
+    if (shots.dumping) {
+        stop_framedump();
+        return;
+    }
+
+    if (Cmd_Argc() > 2) {
+        Com_Printf("Usage: %s [name]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (Cmd_Argc() > 1) {
+        if (!COM_IsPath(Cmd_Argv(1))) {
+            Com_Printf("Bad frame dump name.\n");
+            return;
+        }
+        Q_strlcpy(shots.dump_name, Cmd_Argv(1), sizeof(shots.dump_name));
     } else {
-        Com_Printf("Wrote %s\n", buffer);
+        Q_strlcpy(shots.dump_name, "framedump", sizeof(shots.dump_name));
+    }
+
+#if USE_TGA
+    shots.dump_ext = ".tga";
+    shots.dump_save = IMG_SaveTGA;
+    shots.dump_reverse = qtrue;
+    shots.dump_param = 0;
+#else
+    shots.dump_ext = NULL;
+#endif
+
+#if USE_JPG || USE_PNG
+    s = r_screenshot_format->string;
+#if USE_JPG
+    if (*s == 'j') {
+        shots.dump_ext = ".jpg";
+        shots.dump_save = IMG_SaveJPG;
+        shots.dump_reverse = qfalse;
+        shots.dump_param = r_screenshot_quality->integer;
+    }
+#endif
+#if USE_PNG
+    if (*s == 'p') {
+        shots.dump_ext = ".png";
+        shots.dump_save = IMG_SavePNG;
+        shots.dump_reverse = qfalse;
+        shots.dump_param = r_screenshot_compression->integer;
+    }
+#endif
+#endif // USE_JPG || USE_PNG
+
+    if (!shots.dump_ext) {
+        Com_Printf("Can't dump frames, TGA format not available.\n");
+        return;
+    }
+
+    shots.dump_frames = 0;
+    shots.dumping = qtrue;
+    Com_Printf("Dumping frames to screenshots/%s/\n", shots.dump_name);
+}
+
+/*
+The stream writes the finished frames as raw I420 (BT.601, limited range)
+to a named pipe or file for an external encoder, cropped to a multiple of
+8x4 pixels. The renderer converts them on the GPU and reads back only the
+planes where it can, otherwise RGB pixels are converted by the worker.
+Frames are dropped rather than stalling the game when the reader falls
+behind.
+*/
+
+// renderer slots after the screenshot ones, IMG_READBACK_SLOTS has both
+#define STREAM_SLOT     MAX_READBACK_SLOTS
+
+static void rgb_to_i420(byte *out, const byte *in, int inwidth, int inheight,
+                        int width, int height)
+{
+    byte *y = out;
+    byte *u = y + width * height;
+    byte *v = u + width * height / 4;
+    int i, j, r, g, b, stride = inwidth * 3;
+    const byte *row, *p;
+
+    // input rows run bottom up
+    for (i = 0; i < height; i++) {
+        row = in + (inheight - 1 - i) * stride;
+        for (j = 0, p = row; j < width; j++, p += 3) {
+            *y++ = ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16;
+        }
+    }
+
+    for (i = 0; i < height; i += 2) {
+        row = in + (inheight - 1 - i) * stride;
+        for (j = 0, p = row; j < width; j += 2, p += 6) {
+            r = p[0] + p[3] + p[-stride + 0] + p[-stride + 3];
+            g = p[1] + p[4] + p[-stride + 1] + p[-stride + 4];
+            b = p[2] + p[5] + p[-stride + 2] + p[-stride + 5];
+            *u++ = ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+            *v++ = ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+        }
+    }
+}
+
+// runs on the worker, param is set when pixels are already I420
+static qerror_t write_stream_frame(qhandle_t f, const char *filename,
+                                   const byte *pixels, int width, int height,
+                                   int param)
+{
+    size_t size = shots.stream_width * shots.stream_height * 3 / 2;
+    const byte *data = pixels;
+
+    if (!param) {
+        rgb_to_i420(shots.stream_buf, pixels, width, height,
+                    shots.stream_width, shots.stream_height);
+        data = shots.stream_buf;
+    }
+
+    if (fwrite(data, 1, size, shots.stream_fp) != size || fflush(shots.stream_fp)) {
+        return Q_ERR(errno);
+    }
+
+    return Q_ERR_SUCCESS;
+}
+
+static void submit_stream_frame(screenshot_t *s)
+{
+    int w = shots.stream_width;
+    int h = shots.stream_height;
+
+    if (!s->pixels) {
+        Z_Free(s);
+        shots.stream_dropped++;
+        return;
+    }
+
+    // resolution changed under the stream
+    if (s->param ? s->width != w || s->height != h : s->width < w || s->height < h) {
+        FS_FreeTempMem(s->pixels);
+        Z_Free(s);
+        shots.stream_dropped++;
+        return;
+    }
+
+    submit_screenshot(s);
+    shots.stream_frames++;
+}
+
+static void finish_stream_read(int i)
+{
+    screenshot_t *s = shots.stream_read[i];
+
+    shots.stream_read[i] = NULL;
+    s->pixels = IMG_EndReadPixels(STREAM_SLOT + i, &s->width, &s->height);
+    submit_stream_frame(s);
+}
+
+static void stream_frame(void)
+{
+    screenshot_t *s;
+    int i = shots.framenum % MAX_READBACK_SLOTS;
+
+    // never block on the worker, the reader may be slow
+    if (shots.numjobs >= MAX_SCREENSHOT_JOBS - 1 || shots.stream_read[i]) {
+        shots.stream_dropped++;
+        return;
+    }
+
+    s = alloc_screenshot(write_stream_frame, qfalse, 1);
+    s->quiet = qtrue;
+    s->stream = qtrue;
+
+    if (IMG_BeginReadYUV(STREAM_SLOT + i, shots.stream_width, shots.stream_height)) {
+        shots.stream_read[i] = s;
+        shots.stream_frame[i] = shots.framenum;
+        return;
+    }
+
+    s->param = 0;
+    if (IMG_BeginReadPixels(STREAM_SLOT + i, qfalse)) {
+        shots.stream_read[i] = s;
+        shots.stream_frame[i] = shots.framenum;
+        return;
+    }
+
+    s->pixels = IMG_ReadPixels(qfalse, &s->width, &s->height);
+    submit_stream_frame(s);
+}
+
+static void stop_stream(void)
+{
+    int i;
+
+    if (!shots.stream_fp) {
+        return;
+    }
+
+    for (i = 0; i < MAX_READBACK_SLOTS; i++) {
+        if (shots.stream_read[i]) {
+            finish_stream_read(i);
+        }
+    }
+    retire_screenshots(0);
+
+    if (shots.stream_error) {
+        Com_EPrintf("Couldn't write to %s: %s\n", shots.stream_path,
+                    Q_ErrorString(shots.stream_error));
+    }
+    Com_Printf("Streamed %d frames (%d dropped) to %s\n", shots.stream_frames,
+               shots.stream_dropped, shots.stream_path);
+
+    fclose(shots.stream_fp);
+    shots.stream_fp = NULL;
+    Z_Free(shots.stream_buf);
+    shots.stream_buf = NULL;
+}
+
+/*
+==================
+IMG_StreamOut_f
+
+Starts writing every frame to a named pipe or file, or stops if running.
+==================
+*/
+static void IMG_StreamOut_f(void)
+{
+    const char *path;
+    int w, h;
+
+    if (shots.stream_fp) {
+        stop_stream();
+        return;
+    }
+
+    if (Cmd_Argc() != 2) {
+        Com_Printf("Usage: %s <path>\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (!shots.thread) {
+        return;
+    }
+
+    w = r_config.width & ~7;
+    h = r_config.height & ~3;
+    if (w < 8 || h < 4) {
+        Com_Printf("Screen is too small to stream.\n");
+        return;
+    }
+
+    // blocks until the reader of a named pipe opens it
+    path = Cmd_Argv(1);
+    shots.stream_fp = fopen(path, "wb");
+    if (!shots.stream_fp) {
+        Com_EPrintf("Couldn't open %s for writing: %s\n", path,
+                    Q_ErrorString(Q_ERR(errno)));
+        return;
+    }
+
+    Q_strlcpy(shots.stream_path, path, sizeof(shots.stream_path));
+    shots.stream_width = w;
+    shots.stream_height = h;
+    shots.stream_buf = Z_Malloc(w * h * 3 / 2);
+    shots.stream_frames = 0;
+    shots.stream_dropped = 0;
+    shots.stream_error = Q_ERR_SUCCESS;
+    Com_Printf("Streaming %dx%d I420 frames to %s\n", w, h, path);
+}
+
+/*
+==================
+IMG_CaptureFrame
+
+Called at the end of each frame, before buffers are swapped.
+==================
+*/
+void IMG_CaptureFrame(void)
+{
+    int i;
+
+    if (!shots.thread) {
+        return;
+    }
+
+    if (shots.dumping) {
+        dump_frame();
+    }
+
+    if (shots.stream_fp) {
+        stream_frame();
+    }
+
+    // complete readbacks started on earlier frames
+    for (i = 0; i < MAX_READBACK_SLOTS; i++) {
+        if (shots.readback[i] && shots.readback_frame[i] != shots.framenum) {
+            finish_capture(i);
+        }
+        if (shots.stream_read[i] && shots.stream_frame[i] != shots.framenum) {
+            finish_stream_read(i);
+        }
+    }
+
+    retire_screenshots(shots.numjobs);
+
+    if (shots.stream_error) {
+        stop_stream();
+    }
+
+    shots.framenum++;
+}
+
+static void init_screenshots(void)
+{
+    List_Init(&shots.pending);
+    List_Init(&shots.done);
+    shots.quit = qfalse;
+    shots.lock = Sys_CreateMutex();
+    shots.cond = Sys_CreateCond();
+    shots.thread = Sys_CreateThread(screenshot_thread, NULL);
+}
+
+static void shutdown_screenshots(void)
+{
+    if (!shots.thread) {
+        return;
     }
+
+    stop_framedump();
+    stop_stream();
+    finish_all_captures();
+    retire_screenshots(0);
+
+    Sys_LockMutex(shots.lock);
+    shots.quit = qtrue;
+    Sys_BroadcastCond(shots.cond);
+    Sys_UnlockMutex(shots.lock);
+
+    Sys_JoinThread(shots.thread);
+    Sys_DestroyCond(shots.cond);
+    Sys_DestroyMutex(shots.lock);
+    shots.thread = NULL;
 }
+#else
+void IMG_CaptureFrame(void) { }
 #endif // USE_TGA || USE_JPG || USE_PNG || USE_REF == REF_SOFT
 
 /*
@@ -1482,6 +2100,353 @@ static image_t *lookup_image(const char *name,
     return NULL;
 }
 
+#if USE_REF == REF_GL && (USE_PNG || USE_JPG || USE_TGA)
+
+/*
+=========================================================
+
+DEFERRED LOADING
+
+32-bit wall and skin textures are read from disk on the main thread and
+looked up in the texture cache. During map registration cache misses are
+decoded and mipmapped on a pool of workers. The GL uploads happen on the
+main thread as the jobs complete, and the pool is drained before
+registration ends.
+
+=========================================================
+*/
+
+#define USE_DEFERRED_LOAD   1
+
+#define MAX_LOAD_THREADS    8
+#define MAX_LOAD_JOBS       16
+
+typedef struct {
+    list_t              entry;
+    image_t             *image;
+    const imageloader_t *ldr;
+    byte                *raw;
+    size_t              rawlen;
+    byte                *pic;
+    int                 width, height;
+    imgupload_t         up;
+    qerror_t            ret;
+} loadjob_t;
+
+static struct {
+    qthread_t   *threads[MAX_LOAD_THREADS];
+    int         numthreads;
+    qmutex_t    *lock;
+    qcond_t     *cond;
+    list_t      pending;    // waiting for a worker
+    list_t      done;       // waiting to be uploaded by the main thread
+    int         numjobs;    // submitted but not yet uploaded
+    qboolean    quit;
+
+    qboolean    registering;
+    qboolean    defer;      // set by find_or_load_image for current image
+
+    // file found by try_image_format, handed over to the job
+    byte        *raw;
+    size_t      rawlen;
+    int         width, height;
+} loads;
+
+static cvar_t   *r_texture_threads;
+
+#if USE_JPG
+static qboolean probe_jpg(const byte *raw, size_t len, int *width, int *height)
+{
+    size_t pos = 2;
+    int marker;
+
+    if (len < 4 || raw[0] != 0xFF || raw[1] != 0xD8) {
+        return qfalse;
+    }
+
+    while (pos + 4 <= len) {
+        if (raw[pos] != 0xFF) {
+            return qfalse;
+        }
+        marker = raw[pos + 1];
+        if (marker == 0xFF) {
+            pos++;  // fill byte
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            pos += 2;   // standalone marker
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {
+            return qfalse;  // no frame header before scan data
+        }
+        if (marker >= 0xC0 && marker <= 0xCF &&
+            marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (pos + 9 > len) {
+                return qfalse;
+            }
+            *height = (raw[pos + 5] << 8) | raw[pos + 6];
+            *width = (raw[pos + 7] << 8) | raw[pos + 8];
+            return qtrue;
+        }
+        pos += 2 + ((raw[pos + 2] << 8) | raw[pos + 3]);
+    }
+
+    return qfalse;
+}
+#endif
+
+// finds out image dimensions without decoding it
+static qboolean probe_image(imageformat_t fmt, const byte *raw, size_t len,
+                            int *width, int *height)
+{
+    int w, h;
+
+    switch (fmt) {
+#if USE_TGA
+    case IM_TGA:
+        if (len < TARGA_HEADER_SIZE) {
+            return qfalse;
+        }
+        w = LittleShortMem(&raw[12]);
+        h = LittleShortMem(&raw[14]);
+        break;
+#endif
+#if USE_JPG
+    case IM_JPG:
+        if (!probe_jpg(raw, len, &w, &h)) {
+            return qfalse;
+        }
+        break;
+#endif
+#if USE_PNG
+    case IM_PNG:
+        if (len < 24 || memcmp(raw + 12, "IHDR", 4)) {
+            return qfalse;
+        }
+        w = (raw[16] << 24) | (raw[17] << 16) | (raw[18] << 8) | raw[19];
+        h = (raw[20] << 24) | (raw[21] << 16) | (raw[22] << 8) | raw[23];
+        break;
+#endif
+    default:
+        return qfalse;
+    }
+
+    if (w < 1 || h < 1 || w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE) {
+        return qfalse;
+    }
+
+    *width = w;
+    *height = h;
+    return qtrue;
+}
+
+static void decode_job(loadjob_t *job, const char *filename)
+{
+    byte *pic = job->pic;
+
+    // decode into the buffer allocated by the main thread
+    job->ret = job->ldr->load(job->raw, job->rawlen, filename,
+                              &pic, &job->width, &job->height);
+    if (job->ret >= 0) {
+        IMG_ProcessLoad(job->pic, job->width, job->height, &job->up);
+    }
+}
+
+static void finish_job(loadjob_t *job)
+{
+    if (job->ret < 0) {
+        Com_EPrintf("Couldn't load %s: %s\n",
+                    job->image->name, Q_ErrorString(job->ret));
+        FS_FreeTempMem(job->up.levels);
+        job->up.levels = NULL;
+    }
+    IMG_FinishLoad(job->image, &job->up);
+    FS_FreeFile(job->raw);
+    IMG_FreePixels(job->pic);
+    Z_Free(job);
+}
+
+static void load_thread(void *arg)
+{
+    loadjob_t *job;
+
+    Sys_LockMutex(loads.lock);
+    while (1) {
+        while (!loads.quit && LIST_EMPTY(&loads.pending)) {
+            Sys_WaitCond(loads.cond, loads.lock);
+        }
+        if (LIST_EMPTY(&loads.pending)) {
+            break;
+        }
+
+        job = LIST_FIRST(loadjob_t, &loads.pending, entry);
+        List_Remove(&job->entry);
+        Sys_UnlockMutex(loads.lock);
+
+        decode_job(job, NULL);
+
+        Sys_LockMutex(loads.lock);
+        List_Append(&loads.done, &job->entry);
+        Sys_BroadcastCond(loads.cond);
+    }
+    Sys_UnlockMutex(loads.lock);
+}
+
+// upload finished jobs, waiting until no more than `keep' are outstanding
+static void retire_loads(int keep)
+{
+    loadjob_t *job, *next;
+    list_t done;
+
+    while (loads.numjobs > keep) {
+        Sys_LockMutex(loads.lock);
+        while (LIST_EMPTY(&loads.done)) {
+            Sys_WaitCond(loads.cond, loads.lock);
+        }
+        done = loads.done;
+        done.next->prev = &done;
+        done.prev->next = &done;
+        List_Init(&loads.done);
+        Sys_UnlockMutex(loads.lock);
+
+        LIST_FOR_EACH_SAFE(loadjob_t, job, next, &done, entry) {
+            finish_job(job);
+            loads.numjobs--;
+        }
+    }
+}
+
+// loads the file found by try_image_format, from the texture
+// cache if possible, otherwise on a worker while registering
+static void load_image(image_t *image, const imageloader_t *ldr)
+{
+    loadjob_t *job;
+    byte *raw = loads.raw;
+
+    loads.raw = NULL;
+
+    job = Z_Mallocz(sizeof(*job));
+    if (IMG_PrepareLoad(image, loads.width, loads.height,
+                        raw, loads.rawlen, &job->up)) {
+        FS_FreeFile(raw);
+        Z_Free(job);
+        return;
+    }
+
+    job->image = image;
+    job->ldr = ldr;
+    job->raw = raw;
+    job->rawlen = loads.rawlen;
+    job->width = loads.width;
+    job->height = loads.height;
+    job->pic = IMG_AllocPixels(job->width * job->height * 4);
+
+    if (!loads.registering) {
+        decode_job(job, image->name);
+        finish_job(job);
+        return;
+    }
+
+    // don't keep too many decoded textures around at once
+    retire_loads(MAX_LOAD_JOBS - 1);
+
+    Sys_LockMutex(loads.lock);
+    List_Append(&loads.pending, &job->entry);
+    Sys_SignalCond(loads.cond);
+    Sys_UnlockMutex(loads.lock);
+
+    loads.numjobs++;
+}
+
+static void shutdown_loads(void)
+{
+    int i;
+
+    if (!loads.numthreads) {
+        return;
+    }
+
+    retire_loads(0);
+
+    Sys_LockMutex(loads.lock);
+    loads.quit = qtrue;
+    Sys_BroadcastCond(loads.cond);
+    Sys_UnlockMutex(loads.lock);
+
+    for (i = 0; i < loads.numthreads; i++) {
+        Sys_JoinThread(loads.threads[i]);
+        loads.threads[i] = NULL;
+    }
+    Sys_DestroyCond(loads.cond);
+    Sys_DestroyMutex(loads.lock);
+    loads.numthreads = 0;
+    loads.registering = qfalse;
+}
+
+static void init_loads(int count)
+{
+    int i;
+
+    List_Init(&loads.pending);
+    List_Init(&loads.done);
+    loads.quit = qfalse;
+    loads.lock = Sys_CreateMutex();
+    loads.cond = Sys_CreateCond();
+    for (i = 0; i < count; i++) {
+        loads.threads[i] = Sys_CreateThread(load_thread, NULL);
+    }
+    loads.numthreads = count;
+}
+
+/*
+===============
+IMG_BeginRegistration
+
+Starts deferring texture loads. Worker count is picked up here.
+===============
+*/
+void IMG_BeginRegistration(void)
+{
+    int count = Cvar_ClampInteger(r_texture_threads, 0, MAX_LOAD_THREADS);
+
+    if (count != loads.numthreads) {
+        shutdown_loads();
+        if (count) {
+            init_loads(count);
+        }
+    } else {
+        // left over from aborted registration
+        retire_loads(0);
+    }
+
+    loads.registering = !!loads.numthreads;
+}
+
+/*
+===============
+IMG_EndRegistration
+
+Waits for all deferred textures to be uploaded.
+===============
+*/
+void IMG_EndRegistration(void)
+{
+    retire_loads(0);
+    loads.registering = qfalse;
+}
+
+#else
+
+#define USE_DEFERRED_LOAD   0
+
+#if USE_REF == REF_GL
+void IMG_BeginRegistration(void) { }
+void IMG_EndRegistration(void) { }
+#endif
+
+#endif // USE_REF == REF_GL && (USE_PNG || USE_JPG || USE_TGA)
+
 static imageformat_t try_image_format(const imageloader_t *ldr,
                                       const char *filename, byte **pic,
                                       byte **tmp, int *width, int *height)
@@ -1496,6 +2461,20 @@ static imageformat_t try_image_format(const imageloader_t *ldr,
         return len;
     }
 
+#if USE_DEFERRED_LOAD
+    // leave decompression to load_image if possible
+    ret = ldr - img_loaders;
+    if (loads.defer && ret > IM_WAL &&
+        probe_image(ret, data, len, &loads.width, &loads.height)) {
+        loads.raw = data;
+        loads.rawlen = len;
+        *pic = *tmp = NULL;
+        *width = loads.width;
+        *height = loads.height;
+        return ret;
+    }
+#endif
+
     // decompress the image
     ret = ldr->load(data, len, filename, pic, width, height);
     if (ret < 0) {
@@ -1684,6 +2663,9 @@ static qerror_t find_or_load_image(const char *name, size_t len,
 
     // load the pic from disk
     pic = tmp = NULL;
+#if USE_DEFERRED_LOAD
+    loads.defer = (type == IT_WALL || type == IT_SKIN);
+#endif
 #if USE_PNG || USE_JPG || USE_TGA
     if (fmt == IM_MAX) {
         // unknown extension, but give it a chance to load anyway
@@ -1713,6 +2695,10 @@ static qerror_t find_or_load_image(const char *name, size_t len,
     ret = try_image_format(ldr, buffer, &pic, &tmp, &width, &height);
 #endif
 
+#if USE_DEFERRED_LOAD
+    loads.defer = qfalse;
+#endif
+
     if (ret < 0) {
         return ret;
     }
@@ -1720,6 +2706,12 @@ static qerror_t find_or_load_image(const char *name, size_t len,
     // allocate image slot
     image = alloc_image();
     if (!image) {
+#if USE_DEFERRED_LOAD
+        if (!pic) {
+            pic = loads.raw;
+            loads.raw = NULL;
+        }
+#endif
         FS_FreeFile(tmp ? tmp : pic);
         return Q_ERR_OUT_OF_SLOTS;
     }
@@ -1748,6 +2740,15 @@ static qerror_t find_or_load_image(const char *name, size_t len,
     }
 #endif
 
+#if USE_DEFERRED_LOAD
+    if (!pic) {
+        // decoding was deferred
+        load_image(image, &img_loaders[ret]);
+        *image_p = image;
+        return Q_ERR_SUCCESS;
+    }
+#endif
+
     // upload the image to card
     IMG_Load(image, pic, width, height);
 
@@ -1766,6 +2767,64 @@ static qerror_t find_or_load_image(const char *name, size_t len,
     return Q_ERR_SUCCESS;
 }
 
+#if USE_REF == REF_GL
+/*
+===============
+IMG_Reload
+
+Reads the image back from disk into its existing slot and texture name,
+keeping the original dimensions. Used to bring back textures deleted by
+the texture budget.
+===============
+*/
+qerror_t IMG_Reload(image_t *image)
+{
+    const imageloader_t *ldr;
+    imageformat_t fmt;
+    byte *pic, *tmp;
+    int width, height;
+    qerror_t ret;
+
+    // name is the file that was actually loaded
+    for (fmt = 0; fmt < IM_MAX; fmt++) {
+        ldr = &img_loaders[fmt];
+        if (!Q_stricmp(image->name + image->baselen + 1, ldr->ext)) {
+            break;
+        }
+    }
+    if (fmt == IM_MAX) {
+        return Q_ERR_INVALID_PATH;
+    }
+
+    pic = tmp = NULL;
+#if USE_DEFERRED_LOAD
+    loads.defer = (image->type == IT_WALL || image->type == IT_SKIN);
+#endif
+    ret = try_image_format(ldr, image->name, &pic, &tmp, &width, &height);
+#if USE_DEFERRED_LOAD
+    loads.defer = qfalse;
+#endif
+
+    if (ret < 0) {
+        return ret;
+    }
+
+#if USE_DEFERRED_LOAD
+    if (!pic) {
+        // goes through the texture cache
+        load_image(image, ldr);
+        return Q_ERR_SUCCESS;
+    }
+#endif
+
+    IMG_Load(image, pic, width, height);
+
+    FS_FreeFile(tmp ? tmp : pic);
+
+    return Q_ERR_SUCCESS;
+}
+#endif
+
 image_t *IMG_Find(const char *name, imagetype_t type)
 {
     image_t *image;
@@ -1935,6 +2994,10 @@ void IMG_FreeAll(void)
     image_t *image;
     int i, count = 0;
 
+#if USE_DEFERRED_LOAD
+    retire_loads(0);
+#endif
+
     for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
         if (!image->registration_sequence)
             continue;        // free image_t slot
@@ -2010,6 +3073,10 @@ static const cmdreg_t img_cmd[] = {
 #if USE_PNG
     { "screenshotpng", IMG_ScreenShotPNG_f },
 #endif
+#if USE_TGA || USE_JPG || USE_PNG || USE_REF == REF_SOFT
+    { "framedump", IMG_FrameDump_f },
+    { "streamout", IMG_StreamOut_f },
+#endif
 
     { NULL }
 };
@@ -2039,6 +3106,10 @@ void IMG_Init(void)
     r_texture_formats->changed = r_texture_formats_changed;
     r_texture_formats_changed(r_texture_formats);
 
+#if USE_REF == REF_GL
+    r_texture_threads = Cvar_Get("r_texture_threads", "2", 0);
+#endif
+
 #if USE_JPG
     r_screenshot_format = Cvar_Get("gl_screenshot_format", "jpg", 0);
 #elif USE_PNG
@@ -2054,6 +3125,10 @@ void IMG_Init(void)
 
     Cmd_Register(img_cmd);
 
+#if USE_TGA || USE_JPG || USE_PNG || USE_REF == REF_SOFT
+    init_screenshots();
+#endif
+
     for (i = 0; i < RIMAGES_HASH; i++) {
         List_Init(&r_imageHash[i]);
     }
@@ -2064,6 +3139,12 @@ void IMG_Init(void)
 
 void IMG_Shutdown(void)
 {
+#if USE_DEFERRED_LOAD
+    shutdown_loads();
+#endif
+#if USE_TGA || USE_JPG || USE_PNG || USE_REF == REF_SOFT
+    shutdown_screenshots();
+#endif
     Cmd_Deregister(img_cmd);
     r_numImages = 0;
 }
@@ -35,8 +35,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // we are sure we won't need it.
 #define MAX_RMODELS     (MAX_MODELS * 2)
 
+#define RMODELS_HASH    64
+
 static model_t      r_models[MAX_RMODELS];
 static int          r_numModels;
+static list_t       r_modelHash[RMODELS_HASH];
 
 static model_t *MOD_Alloc(void)
 {
@@ -59,15 +62,11 @@ static model_t *MOD_Alloc(void)
     return model;
 }
 
-static model_t *MOD_Find(const char *name)
+static model_t *MOD_Find(const char *name, unsigned hash)
 {
     model_t *model;
-    int i;
 
-    for (i = 0, model = r_models; i < r_numModels; i++, model++) {
-        if (!model->type) {
-            continue;
-        }
+    LIST_FOR_EACH(model_t, model, &r_modelHash[hash], entry) {
         if (!FS_pathcmp(model->name, name)) {
             return model;
         }
@@ -76,6 +75,16 @@ static model_t *MOD_Find(const char *name)
     return NULL;
 }
 
+static void MOD_Free(model_t *model)
+{
+    List_Remove(&model->entry);
+#if USE_REF == REF_GL
+    MOD_FreeBuffers(model);
+#endif
+    Hunk_Free(&model->hunk);
+    memset(model, 0, sizeof(*model));
+}
+
 static void MOD_List_f(void)
 {
     static const char types[4] = "FASE";
@@ -113,8 +122,7 @@ void MOD_FreeUnused(void)
             Com_PageInMemory(model->hunk.base, model->hunk.cursize);
         } else {
             // don't need this model
-            Hunk_Free(&model->hunk);
-            memset(model, 0, sizeof(*model));
+            MOD_Free(model);
         }
     }
 }
@@ -129,8 +137,7 @@ void MOD_FreeAll(void)
             continue;
         }
 
-        Hunk_Free(&model->hunk);
-        memset(model, 0, sizeof(*model));
+        MOD_Free(model);
     }
 
     r_numModels = 0;
@@ -287,9 +294,10 @@ qhandle_t R_RegisterModel(const char *name)
     size_t namelen;
     ssize_t filelen;
     model_t *model;
-    byte *rawdata;
+    fsmap_t map;
     uint32_t ident;
     mod_load_t load;
+    unsigned hash;
     qerror_t ret;
 
     // empty names are legal, silently ignore them
@@ -316,14 +324,15 @@ qhandle_t R_RegisterModel(const char *name)
     }
 
     // see if it's already loaded
-    model = MOD_Find(normalized);
+    hash = FS_HashPath(normalized, RMODELS_HASH);
+    model = MOD_Find(normalized, hash);
     if (model) {
         MOD_Reference(model);
         goto done;
     }
 
-    filelen = FS_LoadFile(normalized, (void **)&rawdata);
-    if (!rawdata) {
+    filelen = FS_MapFile(normalized, &map);
+    if (!map.data) {
         // don't spam about missing models
         if (filelen == Q_ERR_NOENT) {
             return 0;
@@ -339,7 +348,7 @@ qhandle_t R_RegisterModel(const char *name)
     }
 
     // check ident
-    ident = LittleLong(*(uint32_t *)rawdata);
+    ident = LittleLong(*(uint32_t *)map.data);
     switch (ident) {
     case MD2_IDENT:
         load = MOD_LoadMD2;
@@ -366,21 +375,23 @@ qhandle_t R_RegisterModel(const char *name)
     memcpy(model->name, normalized, namelen + 1);
     model->registration_sequence = registration_sequence;
 
-    ret = load(model, rawdata, filelen);
+    ret = load(model, map.data, filelen);
 
-    FS_FreeFile(rawdata);
+    FS_UnmapFile(&map);
 
     if (ret) {
         memset(model, 0, sizeof(*model));
         goto fail1;
     }
 
+    List_Append(&r_modelHash[hash], &model->entry);
+
 done:
     index = (model - r_models) + 1;
     return index;
 
 fail2:
-    FS_FreeFile(rawdata);
+    FS_UnmapFile(&map);
 fail1:
     Com_EPrintf("Couldn't load %s: %s\n", normalized, Q_ErrorString(ret));
     return 0;
@@ -408,10 +419,16 @@ model_t *MOD_ForHandle(qhandle_t h)
 
 void MOD_Init(void)
 {
+    int i;
+
     if (r_numModels) {
         Com_Error(ERR_FATAL, "%s: %d models not freed", __func__, r_numModels);
     }
 
+    for (i = 0; i < RMODELS_HASH; i++) {
+        List_Init(&r_modelHash[i]);
+    }
+
     Cmd_AddCommand("modellist", MOD_List_f);
 }
 
@@ -4,7 +4,10 @@ static void BLOCK_FUNC(void)
 {
     int     lightleft[3], lightright[3];
     int     lightleftstep[3], lightrightstep[3];
-    int     v, i, b, lightstep[3], light[3];
+    int     v, i, lightstep[3], light[3];
+#if !USE_LIGHTROW
+    int     b;
+#endif
     byte    *psource, *prowdest;
 
     psource = pbasesource;
@@ -31,6 +34,13 @@ static void BLOCK_FUNC(void)
             lightstep[1] = (lightleft[1] - lightright[1]) >> BLOCK_SHIFT;
             lightstep[2] = (lightleft[2] - lightright[2]) >> BLOCK_SHIFT;
 
+#if USE_LIGHTROW
+            light[0] = lightright[0] + (BLOCK_SIZE - 1) * lightstep[0];
+            light[1] = lightright[1] + (BLOCK_SIZE - 1) * lightstep[1];
+            light[2] = lightright[2] + (BLOCK_SIZE - 1) * lightstep[2];
+
+            R_LightRow(prowdest, psource, light, lightstep, BLOCK_SIZE);
+#else
             light[0] = lightright[0];
             light[1] = lightright[1];
             light[2] = lightright[2];
@@ -43,6 +53,7 @@ static void BLOCK_FUNC(void)
                 light[1] += lightstep[1];
                 light[2] += lightstep[2];
             }
+#endif
 
             psource += sourcetstep;
             lightright[0] += lightrightstep[0];
@@ -403,44 +403,20 @@ R_RecursiveWorldNode
 */
 void R_RecursiveWorldNode(mnode_t *node, int clipflags)
 {
-    int         i, c, side, *pindex;
-    vec3_t      acceptpt, rejectpt;
+    int         c, side, bits;
     cplane_t    *plane;
     mface_t     *surf, **mark;
-    float       d, dot;
+    float       dot;
     mleaf_t     *pleaf;
 
     while (node->visframe == r_visframecount) {
         // cull the clipping planes if not trivial accept
-        // FIXME: the compiler is doing a lousy job of optimizing here; it could be
-        //  twice as fast in ASM
         if (clipflags) {
-            for (i = 0; i < 4; i++) {
-                if (!(clipflags & (1 << i)))
-                    continue;   // don't need to clip against it
-
-                // generate accept and reject points
-                // FIXME: do with fast look-ups or integer tests based on the sign bit
-                // of the floating point values
-
-                pindex = pfrustum_indexes[i];
-
-                rejectpt[0] = (float)node->minmaxs[pindex[0]];
-                rejectpt[1] = (float)node->minmaxs[pindex[1]];
-                rejectpt[2] = (float)node->minmaxs[pindex[2]];
-
-                d = PlaneDiff(rejectpt, &view_clipplanes[i]);
-                if (d <= 0)
-                    return;
-
-                acceptpt[0] = (float)node->minmaxs[pindex[3 + 0]];
-                acceptpt[1] = (float)node->minmaxs[pindex[3 + 1]];
-                acceptpt[2] = (float)node->minmaxs[pindex[3 + 2]];
-
-                d = PlaneDiff(acceptpt, &view_clipplanes[i]);
-                if (d >= 0)
-                    clipflags &= ~(1 << i); // node is entirely on screen
-            }
+            bits = BoxOnPlanes4Side(node->minmaxs, node->minmaxs + 3,
+                                    &view_clipplanes4);
+            if (BOX4_BEHIND(bits) & clipflags)
+                return;
+            clipflags &= ~BOX4_INFRONT(bits);   // node is entirely on screen
         }
 
         c_drawnode++;
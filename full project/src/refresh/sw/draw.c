@@ -102,6 +102,20 @@ void R_SetScale(float *scale)
     }
 }
 
+// everything goes straight into the frame buffer, nothing is retained
+qboolean R_DrawSpan(int span, unsigned version)
+{
+    return qfalse;
+}
+
+void R_BeginSpan(int span, unsigned version)
+{
+}
+
+void R_EndSpan(void)
+{
+}
+
 void R_InitDraw(void)
 {
     memset(&draw, 0, sizeof(draw));
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // r_edge.c
 
 #include "sw.h"
+#include "system/thread.h"
 
 #if !USE_ASM
 void R_SurfacePatch(void)
@@ -729,13 +730,12 @@ D_FlatFillSurface
 Simple single color fill with no texture mapping
 ==============
 */
-void D_FlatFillSurface(surf_t *surf, uint32_t color)
+static void D_FlatFillSpans(espan_t *span, uint32_t color)
 {
-    espan_t *span;
     byte    *pdest;
     int     count;
 
-    for (span = surf->spans; span; span = span->pnext) {
+    for (; span; span = span->pnext) {
         pdest = (byte *)d_viewbuffer + d_scantable[span->v] + span->u * VID_BYTES;
         count = span->count;
         do {
@@ -747,6 +747,338 @@ void D_FlatFillSurface(surf_t *surf, uint32_t color)
     }
 }
 
+void D_FlatFillSurface(surf_t *surf, uint32_t color)
+{
+    D_FlatFillSpans(surf->spans, color);
+}
+
+
+/*
+=========================================================================
+
+BANDED DRAWING
+
+With sw_threads set, the surface functions below still pick mip levels,
+build surface caches and set up gradients on the main thread, but instead
+of rasterizing they record the span state into a command list. The list
+is then drawn by a pool of workers, each owning a band of screen rows, so
+no two workers ever touch the same pixels. Commands are flushed before
+the surface cache wraps, since that may evict a block still referenced.
+
+=========================================================================
+*/
+
+#if USE_BANDS
+
+#define MAX_BAND_CMDS       4096
+#define MAX_BAND_THREADS    8
+#define MIN_BAND_HEIGHT     8
+#define BAND_SPAN_BATCH     256
+
+typedef enum {
+    BAND_SPANS,
+    BAND_TURB,
+    BAND_FLAT,
+    BAND_Z
+} bandkind_t;
+
+typedef struct {
+    espan_t     *spans;
+    bandkind_t  kind;
+    int         *warptable;
+    uint32_t    color;
+    float       sdivzstepu, tdivzstepu, zistepu;
+    float       sdivzstepv, tdivzstepv, zistepv;
+    float       sdivzorigin, tdivzorigin, ziorigin;
+    fixed16_t   sadjust, tadjust, bbextents, bbextentt;
+    pixel_t     *cacheblock;
+    int         cachewidth;
+} bandcmd_t;
+
+static struct {
+    qthread_t   *threads[MAX_BAND_THREADS];
+    int         numthreads;
+    qmutex_t    *lock;
+    qcond_t     *wake;
+    qcond_t     *done;
+    qboolean    quit;
+
+    bandcmd_t   cmds[MAX_BAND_CMDS];
+    int         numcmds;
+    qboolean    active;
+
+    int         top, height;
+    int         numjobs;
+    int         nextjob;
+    int         finished;
+} bt;
+
+static void D_RunCommand(const bandcmd_t *cmd, espan_t *first, espan_t *last)
+{
+    last->pnext = NULL;
+
+    switch (cmd->kind) {
+    case BAND_SPANS:
+        D_DrawSpans16(first);
+        break;
+    case BAND_TURB:
+        D_DrawTurbulent16(first, cmd->warptable);
+        break;
+    case BAND_FLAT:
+        D_FlatFillSpans(first, cmd->color);
+        break;
+    case BAND_Z:
+        D_DrawZSpans(first);
+        break;
+    }
+}
+
+// draws the part of each command that falls into rows [top, bottom)
+static void D_DrawBand(int top, int bottom)
+{
+    espan_t batch[BAND_SPAN_BATCH];
+    const bandcmd_t *cmd, *end;
+    espan_t *span;
+    int count;
+
+    for (cmd = bt.cmds, end = cmd + bt.numcmds; cmd < end; cmd++) {
+        d_sdivzstepu = cmd->sdivzstepu;
+        d_tdivzstepu = cmd->tdivzstepu;
+        d_zistepu = cmd->zistepu;
+        d_sdivzstepv = cmd->sdivzstepv;
+        d_tdivzstepv = cmd->tdivzstepv;
+        d_zistepv = cmd->zistepv;
+        d_sdivzorigin = cmd->sdivzorigin;
+        d_tdivzorigin = cmd->tdivzorigin;
+        d_ziorigin = cmd->ziorigin;
+        sadjust = cmd->sadjust;
+        tadjust = cmd->tadjust;
+        bbextents = cmd->bbextents;
+        bbextentt = cmd->bbextentt;
+        cacheblock = cmd->cacheblock;
+        cachewidth = cmd->cachewidth;
+
+        // relink copies of the spans in this band, the shared list
+        // is left untouched for the other workers
+        count = 0;
+        for (span = cmd->spans; span; span = span->pnext) {
+            if (span->v < top || span->v >= bottom) {
+                continue;
+            }
+            batch[count] = *span;
+            if (count) {
+                batch[count - 1].pnext = &batch[count];
+            }
+            if (++count == BAND_SPAN_BATCH) {
+                D_RunCommand(cmd, batch, &batch[count - 1]);
+                count = 0;
+            }
+        }
+        if (count) {
+            D_RunCommand(cmd, batch, &batch[count - 1]);
+        }
+    }
+}
+
+// called with the lock held, returns with it held
+static void D_RunBands(void)
+{
+    int top;
+
+    while (bt.nextjob < bt.numjobs) {
+        top = bt.top + bt.height * bt.nextjob++;
+        Sys_UnlockMutex(bt.lock);
+
+        D_DrawBand(top, top + bt.height);
+
+        Sys_LockMutex(bt.lock);
+        if (++bt.finished == bt.numjobs) {
+            Sys_SignalCond(bt.done);
+        }
+    }
+}
+
+static void D_BandThread(void *arg)
+{
+    Sys_LockMutex(bt.lock);
+    while (1) {
+        while (!bt.quit && bt.nextjob >= bt.numjobs) {
+            Sys_WaitCond(bt.wake, bt.lock);
+        }
+        if (bt.quit) {
+            break;
+        }
+        D_RunBands();
+    }
+    Sys_UnlockMutex(bt.lock);
+}
+
+void D_ShutdownBands(void)
+{
+    int i;
+
+    if (!bt.numthreads) {
+        return;
+    }
+
+    Sys_LockMutex(bt.lock);
+    bt.quit = qtrue;
+    Sys_BroadcastCond(bt.wake);
+    Sys_UnlockMutex(bt.lock);
+
+    for (i = 0; i < bt.numthreads; i++) {
+        Sys_JoinThread(bt.threads[i]);
+    }
+
+    Sys_DestroyCond(bt.done);
+    Sys_DestroyCond(bt.wake);
+    Sys_DestroyMutex(bt.lock);
+
+    bt.numthreads = 0;
+    sw_threads->modified = qtrue;
+}
+
+static qboolean D_InitBands(void)
+{
+    int i, count;
+
+    if (sw_threads->modified) {
+        D_ShutdownBands();
+        sw_threads->modified = qfalse;
+
+        count = Cvar_ClampInteger(sw_threads, 0, MAX_BAND_THREADS);
+        if (count) {
+            bt.lock = Sys_CreateMutex();
+            bt.wake = Sys_CreateCond();
+            bt.done = Sys_CreateCond();
+            bt.quit = qfalse;
+            bt.numjobs = bt.nextjob = bt.finished = 0;
+            for (i = 0; i < count; i++) {
+                bt.threads[i] = Sys_CreateThread(D_BandThread, NULL);
+            }
+            bt.numthreads = count;
+        }
+    }
+
+    return bt.numthreads > 0;
+}
+
+/*
+=============
+D_FinishBands
+
+Draws all recorded commands and waits for the workers.
+=============
+*/
+void D_FinishBands(void)
+{
+    int rows, bands;
+
+    if (!bt.numcmds) {
+        return;
+    }
+
+    // a few bands per thread so uneven rows even out
+    rows = r_refdef.vrectbottom - r_refdef.vrect.y;
+    bands = (bt.numthreads + 1) * 4;
+    bt.height = max(MIN_BAND_HEIGHT, (rows + bands - 1) / bands);
+
+    // help the workers, then wait for stragglers
+    Sys_LockMutex(bt.lock);
+    bt.top = r_refdef.vrect.y;
+    bt.numjobs = (rows + bt.height - 1) / bt.height;
+    bt.nextjob = bt.finished = 0;
+    Sys_BroadcastCond(bt.wake);
+    D_RunBands();
+    while (bt.finished < bt.numjobs) {
+        Sys_WaitCond(bt.done, bt.lock);
+    }
+    Sys_UnlockMutex(bt.lock);
+
+    bt.numcmds = 0;
+}
+
+static void D_EmitCommand(bandkind_t kind, espan_t *spans)
+{
+    bandcmd_t *cmd;
+
+    if (bt.numcmds == MAX_BAND_CMDS) {
+        D_FinishBands();
+    }
+
+    cmd = &bt.cmds[bt.numcmds++];
+    cmd->spans = spans;
+    cmd->kind = kind;
+    cmd->sdivzstepu = d_sdivzstepu;
+    cmd->tdivzstepu = d_tdivzstepu;
+    cmd->zistepu = d_zistepu;
+    cmd->sdivzstepv = d_sdivzstepv;
+    cmd->tdivzstepv = d_tdivzstepv;
+    cmd->zistepv = d_zistepv;
+    cmd->sdivzorigin = d_sdivzorigin;
+    cmd->tdivzorigin = d_tdivzorigin;
+    cmd->ziorigin = d_ziorigin;
+    cmd->sadjust = sadjust;
+    cmd->tadjust = tadjust;
+    cmd->bbextents = bbextents;
+    cmd->bbextentt = bbextentt;
+    cmd->cacheblock = cacheblock;
+    cmd->cachewidth = cachewidth;
+}
+
+static void D_EmitSpans(espan_t *spans)
+{
+    if (bt.active)
+        D_EmitCommand(BAND_SPANS, spans);
+    else
+        D_DrawSpans16(spans);
+}
+
+static void D_EmitTurbulent(espan_t *spans, int *warptable)
+{
+    if (bt.active) {
+        D_EmitCommand(BAND_TURB, spans);
+        bt.cmds[bt.numcmds - 1].warptable = warptable;
+    } else {
+        D_DrawTurbulent16(spans, warptable);
+    }
+}
+
+static void D_EmitFlat(espan_t *spans, uint32_t color)
+{
+    if (bt.active) {
+        D_EmitCommand(BAND_FLAT, spans);
+        bt.cmds[bt.numcmds - 1].color = color;
+    } else {
+        D_FlatFillSpans(spans, color);
+    }
+}
+
+static void D_EmitZSpans(espan_t *spans)
+{
+    if (bt.active)
+        D_EmitCommand(BAND_Z, spans);
+    else
+        D_DrawZSpans(spans);
+}
+
+#else
+
+void D_FinishBands(void)
+{
+}
+
+void D_ShutdownBands(void)
+{
+}
+
+#define D_EmitSpans(spans)              D_DrawSpans16(spans)
+#define D_EmitTurbulent(spans, table)   D_DrawTurbulent16(spans, table)
+#define D_EmitFlat(spans, color)        D_FlatFillSpans(spans, color)
+#define D_EmitZSpans(spans)             D_DrawZSpans(spans)
+
+#endif // USE_BANDS
+
 
 /*
 ==============
@@ -820,8 +1152,8 @@ void D_BackgroundSurf(surf_t *s)
     d_zistepv = 0;
     d_ziorigin = -0.9;
 
-    D_FlatFillSurface(s, sw_clearcolor->integer & 0xFF);
-    D_DrawZSpans(s->spans);
+    D_EmitFlat(s->spans, sw_clearcolor->integer & 0xFF);
+    D_EmitZSpans(s->spans);
 }
 
 /*
@@ -857,11 +1189,11 @@ void D_TurbulentSurf(surf_t *s)
 
     // textures that aren't warping are just flowing. Use blanktable instead.
     if (!(pface->texinfo->c.flags & SURF_WARP))
-        D_DrawTurbulent16(s->spans, blanktable);
+        D_EmitTurbulent(s->spans, blanktable);
     else
-        D_DrawTurbulent16(s->spans, sintable);
+        D_EmitTurbulent(s->spans, sintable);
 
-    D_DrawZSpans(s->spans);
+    D_EmitZSpans(s->spans);
 
     if (s->insubmodel) {
         //
@@ -894,14 +1226,14 @@ void D_SkySurf(surf_t *s)
     d_ziorigin = s->d_ziorigin;
 
     if (!pface->texinfo->image) {
-        D_FlatFillSurface(s, 0);
+        D_EmitFlat(s->spans, 0);
     } else {
         cacheblock = pface->texinfo->image->pixels[0];
         cachewidth = 256 * TEX_BYTES;
 
         D_CalcGradients(pface);
 
-        D_DrawSpans16(s->spans);
+        D_EmitSpans(s->spans);
     }
 
 // set up a gradient for the background surface that places it
@@ -910,7 +1242,7 @@ void D_SkySurf(surf_t *s)
     d_zistepv = 0;
     d_ziorigin = -0.9;
 
-    D_DrawZSpans(s->spans);
+    D_EmitZSpans(s->spans);
 }
 
 /*
@@ -952,9 +1284,9 @@ void D_SolidSurf(surf_t *s)
 
     D_CalcGradients(pface);
 
-    D_DrawSpans16(s->spans);
+    D_EmitSpans(s->spans);
 
-    D_DrawZSpans(s->spans);
+    D_EmitZSpans(s->spans);
 
     if (s->insubmodel) {
         //
@@ -1042,6 +1374,9 @@ void D_DrawSurfaces(void)
     } else if (sw_drawflat->integer) {
         D_DrawflatSurfaces();
     } else {
+#if USE_BANDS
+        bt.active = D_InitBands();
+#endif
         for (s = &surfaces[1]; s < surface_p; s++) {
             if (!s->spans)
                 continue;
@@ -1057,6 +1392,11 @@ void D_DrawSurfaces(void)
             else
                 D_SolidSurf(s);
         }
+#if USE_BANDS
+        // the span buffer is reused after we return
+        D_FinishBands();
+        bt.active = qfalse;
+#endif
     }
 
     currententity = NULL;   //&r_worldentity;
@@ -79,8 +79,6 @@ int     r_polycount;
 int     r_drawnpolycount;
 int     r_wholepolycount;
 
-int         *pfrustum_indexes[4];
-int         r_frustum_indexes[4 * 6];
 
 mleaf_t     *r_viewleaf;
 int         r_viewcluster, r_oldviewcluster;
@@ -101,9 +99,11 @@ cvar_t  *sw_reportedgeout;
 cvar_t  *sw_reportsurfout;
 cvar_t  *sw_stipplealpha;
 cvar_t  *sw_surfcacheoverride;
+cvar_t  *sw_surfcache_stats;
 cvar_t  *sw_waterwarp;
 cvar_t  *sw_dynamic;
 cvar_t  *sw_modulate;
+cvar_t  *sw_threads;
 
 //Start Added by Lewey
 // These flags allow you to turn SIRDS on and
@@ -142,14 +142,14 @@ void            *d_pcolormap;
 // FIXME: make into one big structure, like cl or sv
 // FIXME: do separately for refresh engine and driver
 
-float   d_sdivzstepu, d_tdivzstepu, d_zistepu;
-float   d_sdivzstepv, d_tdivzstepv, d_zistepv;
-float   d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+sw_threadlocal float d_sdivzstepu, d_tdivzstepu, d_zistepu;
+sw_threadlocal float d_sdivzstepv, d_tdivzstepv, d_zistepv;
+sw_threadlocal float d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-fixed16_t   sadjust, tadjust, bbextents, bbextentt;
+sw_threadlocal fixed16_t sadjust, tadjust, bbextents, bbextentt;
 
-pixel_t         *cacheblock;
-int             cachewidth;
+sw_threadlocal pixel_t   *cacheblock;
+sw_threadlocal int       cachewidth;
 pixel_t         *d_viewbuffer;
 short           *d_pzbuffer;
 unsigned int    d_zrowbytes;
@@ -196,11 +196,18 @@ void R_Register(void)
     sw_waterwarp = Cvar_Get("sw_waterwarp", "1", 0);
     sw_dynamic = Cvar_Get("sw_dynamic", "1", 0);
     sw_modulate = Cvar_Get("sw_modulate", "1", 0);
+    sw_threads = Cvar_Get("sw_threads", "0", 0);
+    sw_surfcache_stats = Cvar_Get("sw_surfcache_stats", "0", 0);
 
     //Start Added by Lewey
     sw_drawsird = Cvar_Get("sw_drawsird", "0", 0);
     //End Added by Lewey
 
+    vcr_enabled = Cvar_Get("vcr_enabled", "1", CVAR_ARCHIVE);
+    vcr_desaturation = Cvar_Get("vcr_desaturation", "0.5", 0);
+    vcr_grain_intensity = Cvar_Get("vcr_grain_intensity", "1.0", 0);
+    vcr_scanline_alpha = Cvar_Get("vcr_scanline_alpha", "1.0", 0);
+
     r_speeds = Cvar_Get("r_speeds", "0", 0);
     r_fullbright = Cvar_Get("r_fullbright", "0", CVAR_CHEAT);
     r_drawentities = Cvar_Get("r_drawentities", "1", 0);
@@ -236,6 +243,7 @@ void R_ModeChanged(int width, int height, int flags, int rowbytes, void *pixels)
     r_config.flags = flags;
 
     sw_surfcacheoverride = Cvar_Get("sw_surfcacheoverride", "0", 0);
+    sw_surfcacheoverride->modified = qfalse;
 
     D_FlushCaches();
 
@@ -320,6 +328,8 @@ void R_Shutdown(qboolean total)
 
     D_FlushCaches();
 
+    D_ShutdownBands();
+
     MOD_Shutdown();
 
     R_ShutdownImages();
@@ -543,41 +553,13 @@ R_BmodelCheckBBox
 */
 int R_BmodelCheckBBox(float *minmaxs)
 {
-    int         i, *pindex, clipflags;
-    vec3_t      acceptpt, rejectpt;
-    float       d;
-
-    clipflags = 0;
-
-    for (i = 0; i < 4; i++) {
-        // generate accept and reject points
-        // FIXME: do with fast look-ups or integer tests based on the sign bit
-        // of the floating point values
-
-        pindex = pfrustum_indexes[i];
-
-        rejectpt[0] = minmaxs[pindex[0]];
-        rejectpt[1] = minmaxs[pindex[1]];
-        rejectpt[2] = minmaxs[pindex[2]];
-
-        d = DotProduct(rejectpt, view_clipplanes[i].normal);
-        d -= view_clipplanes[i].dist;
-
-        if (d <= 0)
-            return BMODEL_FULLY_CLIPPED;
-
-        acceptpt[0] = minmaxs[pindex[3 + 0]];
-        acceptpt[1] = minmaxs[pindex[3 + 1]];
-        acceptpt[2] = minmaxs[pindex[3 + 2]];
+    int bits = BoxOnPlanes4Side(minmaxs, minmaxs + 3, &view_clipplanes4);
 
-        d = DotProduct(acceptpt, view_clipplanes[i].normal);
-        d -= view_clipplanes[i].dist;
+    if (BOX4_BEHIND(bits))
+        return BMODEL_FULLY_CLIPPED;
 
-        if (d <= 0)
-            clipflags |= (1 << i);
-    }
-
-    return clipflags;
+    // clip against the planes the box is not entirely in front of
+    return ~BOX4_INFRONT(bits) & 15;
 }
 
 
@@ -855,6 +837,22 @@ byte *IMG_ReadPixels(qboolean reverse, int *width, int *height)
     return pixels;
 }
 
+// framebuffer is in system memory, there is nothing to overlap with
+qboolean IMG_BeginReadPixels(int slot, qboolean reverse)
+{
+    return qfalse;
+}
+
+qboolean IMG_BeginReadYUV(int slot, int width, int height)
+{
+    return qfalse;
+}
+
+byte *IMG_EndReadPixels(int slot, int *width, int *height)
+{
+    return NULL;
+}
+
 //=======================================================================
 
 /*
@@ -876,6 +874,14 @@ void R_RenderFrame(refdef_t *fd)
     if (!sw_dynamic->integer)
         r_newrefdef.num_dlights = 0;
 
+    // resize the surface cache without a mode change
+    if (sw_surfcacheoverride->modified) {
+        sw_surfcacheoverride->modified = qfalse;
+        D_FlushCaches();
+        R_FreeCaches();
+        R_InitCaches();
+    }
+
     if (r_speeds->integer || r_dspeeds->integer)
         r_time1 = Sys_Milliseconds();
 
@@ -886,26 +892,34 @@ void R_RenderFrame(refdef_t *fd)
     if (r_worldmodel)
         R_PushDlights(r_worldmodel->nodes);
 
+    TD_START(TD_WORLD);
     R_EdgeDrawing();
+    TD_STOP(TD_WORLD);
 
     if (r_dspeeds->integer) {
         se_time2 = Sys_Milliseconds();
         de_time1 = se_time2;
     }
 
+    TD_START(TD_ENTITIES);
     R_DrawEntitiesOnList();
+    TD_STOP(TD_ENTITIES);
 
     if (r_dspeeds->integer) {
         de_time2 = Sys_Milliseconds();
         dp_time1 = Sys_Milliseconds();
     }
 
+    TD_START(TD_PARTICLES);
     R_DrawParticles();
+    TD_STOP(TD_PARTICLES);
 
     if (r_dspeeds->integer)
         dp_time2 = Sys_Milliseconds();
 
+    TD_START(TD_WORLD);
     R_DrawAlphaSurfaces();
+    TD_STOP(TD_WORLD);
 
     //Start Replaced by Lewey
     if (sw_drawsird->integer && !(r_newrefdef.rdflags & RDF_NOWORLDMODEL)) {
@@ -918,6 +932,10 @@ void R_RenderFrame(refdef_t *fd)
     }
     //End Replaced by Lewey
 
+    TD_START(TD_2D);
+    R_VCRScreen();
+    TD_STOP(TD_2D);
+
     if (r_dspeeds->integer)
         da_time1 = Sys_Milliseconds();
 
@@ -930,6 +948,9 @@ void R_RenderFrame(refdef_t *fd)
     if (r_speeds->integer)
         R_PrintTimes();
 
+    if (sw_surfcache_stats->integer)
+        D_PrintCacheStats();
+
     if (r_dspeeds->integer)
         R_PrintDSpeeds();
 
@@ -940,6 +961,23 @@ void R_RenderFrame(refdef_t *fd)
         Com_Printf("Short roughly %d edges\n", r_outofedges * 2 / 3);
 }
 
+/*
+@@@@@@@@@@@@@@@@
+R_RenderFrames
+
+@@@@@@@@@@@@@@@@
+*/
+void R_RenderFrames(refdef_t *fd, int count)
+{
+    int i;
+
+    if (count > MAX_VIEWS)
+        count = MAX_VIEWS;
+
+    for (i = 0; i < count; i++)
+        R_RenderFrame(&fd[i]);
+}
+
 /*
 ** R_BeginFrame
 */
@@ -950,6 +988,7 @@ void R_BeginFrame(void)
 
 void R_EndFrame(void)
 {
+    IMG_CaptureFrame();
     VID_EndFrame();
 }
 
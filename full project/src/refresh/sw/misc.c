@@ -187,6 +187,11 @@ void R_TransformFrustum(void)
         VectorCopy(v2, view_clipplanes[i].normal);
 
         view_clipplanes[i].dist = DotProduct(modelorg, v2);
+
+        view_clipplanes4.normal[0][i] = v2[0];
+        view_clipplanes4.normal[1][i] = v2[1];
+        view_clipplanes4.normal[2][i] = v2[2];
+        view_clipplanes4.dist[i] = view_clipplanes[i].dist;
     }
 }
 
@@ -219,34 +224,6 @@ void R_TransformPlane(cplane_t *p, float *normal, float *dist)
 }
 
 
-/*
-===============
-R_SetUpFrustumIndexes
-===============
-*/
-void R_SetUpFrustumIndexes(void)
-{
-    int     i, j, *pindex;
-
-    pindex = r_frustum_indexes;
-
-    for (i = 0; i < 4; i++) {
-        for (j = 0; j < 3; j++) {
-            if (view_clipplanes[i].normal[j] < 0) {
-                pindex[j] = j;
-                pindex[j + 3] = j + 3;
-            } else {
-                pindex[j] = j + 3;
-                pindex[j + 3] = j;
-            }
-        }
-
-        // FIXME: do just once at start
-        pfrustum_indexes[i] = pindex;
-        pindex += 6;
-    }
-}
-
 /*
 ===============
 R_ViewChanged
@@ -403,7 +380,6 @@ void R_SetupFrame(void)
 
 // start off with just the four screen edge clip planes
     R_TransformFrustum();
-    R_SetUpFrustumIndexes();
 
 // save base values
     VectorCopy(vpn, base_vpn);
@@ -21,6 +21,34 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "sw.h"
 
+#if (USE_SSE2 || USE_NEON) && VID_BYTES == 4
+#define USE_TEXELS4 1
+
+// writes four texels to the view buffer, swapping red and blue
+static inline void D_StoreTexels4(byte *dst, uint32_t c0, uint32_t c1,
+                                  uint32_t c2, uint32_t c3)
+{
+#if USE_SSE2
+    __m128i v = _mm_setr_epi32(c0, c1, c2, c3);
+    __m128i mask = _mm_set1_epi32(0xff);
+    __m128i g = _mm_and_si128(v, _mm_set1_epi32(0xff00));
+    __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+    __m128i b = _mm_slli_epi32(_mm_and_si128(v, mask), 16);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_or_si128(g, r), b));
+#else
+    uint32_t c[4] = { c0, c1, c2, c3 };
+    uint32x4_t v = vld1q_u32(c);
+    uint32x4_t mask = vdupq_n_u32(0xff);
+    uint32x4_t g = vandq_u32(v, vdupq_n_u32(0xff00));
+    uint32x4_t r = vandq_u32(vshrq_n_u32(v, 16), mask);
+    uint32x4_t b = vshlq_n_u32(vandq_u32(v, mask), 16);
+
+    vst1q_u8(dst, vreinterpretq_u8_u32(vorrq_u32(vorrq_u32(g, r), b)));
+#endif
+}
+#endif
+
 /*
 =============
 D_WarpScreen
@@ -88,7 +116,6 @@ void D_DrawTurbulent16(espan_t *pspan, int *warptable)
     float           sdivz, tdivz, zi, z, du, dv, spancountminus1;
     float           sdivz16stepu, tdivz16stepu, zi16stepu;
     int             *turb;
-    int             turb_s, turb_t;
 
     turb = warptable + ((int)(r_newrefdef.time * SPEED) & (CYCLE - 1));
 
@@ -194,17 +221,36 @@ void D_DrawTurbulent16(espan_t *pspan, int *warptable)
             s = s & ((CYCLE << 16) - 1);
             t = t & ((CYCLE << 16) - 1);
 
-            do {
-                turb_s = ((s + turb[(t >> 16) & (CYCLE - 1)]) >> 16) & 63;
-                turb_t = ((t + turb[(s >> 16) & (CYCLE - 1)]) >> 16) & 63;
-                ptex = pbase + (turb_t * 64 * TEX_BYTES) + turb_s * TEX_BYTES;
+#define TURB_TEXEL(s, t) \
+    (pbase + ((((t) + turb[((s) >> 16) & (CYCLE - 1)]) >> 16) & 63) * 64 * TEX_BYTES + \
+             ((((s) + turb[((t) >> 16) & (CYCLE - 1)]) >> 16) & 63) * TEX_BYTES)
+
+#if USE_TEXELS4
+            for (; spancount >= 4; spancount -= 4) {
+                uint32_t c[4];
+                int i;
+
+                for (i = 0; i < 4; i++) {
+                    c[i] = *(uint32_t *)TURB_TEXEL(s, t);
+                    s += sstep;
+                    t += tstep;
+                }
+                D_StoreTexels4(pdest, c[0], c[1], c[2], c[3]);
+                pdest += 4 * VID_BYTES;
+            }
+#endif
+
+            for (; spancount > 0; spancount--) {
+                ptex = TURB_TEXEL(s, t);
                 pdest[0] = ptex[2];
                 pdest[1] = ptex[1];
                 pdest[2] = ptex[0];
                 pdest += VID_BYTES;
                 s += sstep;
                 t += tstep;
-            } while (--spancount > 0);
+            }
+
+#undef TURB_TEXEL
 
             s = snext;
             t = tnext;
@@ -328,15 +374,35 @@ void D_DrawSpans16(espan_t *pspan)
                 }
             }
 
-            do {
-                ptex = pbase + (s >> 16) * TEX_BYTES + (t >> 16) * cachewidth;
+#define SPAN_TEXEL(s, t) \
+    (pbase + ((s) >> 16) * TEX_BYTES + ((t) >> 16) * cachewidth)
+
+#if USE_TEXELS4
+            for (; spancount >= 4; spancount -= 4) {
+                uint32_t c[4];
+                int i;
+
+                for (i = 0; i < 4; i++) {
+                    c[i] = *(uint32_t *)SPAN_TEXEL(s, t);
+                    s += sstep;
+                    t += tstep;
+                }
+                D_StoreTexels4(pdest, c[0], c[1], c[2], c[3]);
+                pdest += 4 * VID_BYTES;
+            }
+#endif
+
+            for (; spancount > 0; spancount--) {
+                ptex = SPAN_TEXEL(s, t);
                 pdest[0] = ptex[2];
                 pdest[1] = ptex[1];
                 pdest[2] = ptex[0];
                 pdest += VID_BYTES;
                 s += sstep;
                 t += tstep;
-            } while (--spancount > 0);
+            }
+
+#undef SPAN_TEXEL
 
             s = snext;
             t = tnext;
@@ -145,6 +145,57 @@ void R_DrawSurface(void)
 //=============================================================================
 #if !USE_ASM
 
+#if USE_SSE2 || USE_NEON
+#define USE_LIGHTROW 1
+
+// lights a row of texels, two per iteration. light is for the first
+// texel and decreases by step for each next one. light values are
+// clamped to 16 bits by R_BuildLightMap, so 16 bit lanes are enough
+// and (texel * light) >> 16 is the high half of their product.
+static inline void R_LightRow(byte *dst, const byte *src,
+                              const int *light, const int *step, int count)
+{
+    int b;
+#if USE_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i vlight = _mm_setr_epi16(light[0], light[1], light[2], 0,
+                                    light[0] - step[0], light[1] - step[1],
+                                    light[2] - step[2], 0);
+    __m128i vstep = _mm_setr_epi16(-2 * step[0], -2 * step[1], -2 * step[2], 0,
+                                   -2 * step[0], -2 * step[1], -2 * step[2], 0);
+
+    for (b = 0; b < count; b += 2) {
+        __m128i pix = _mm_loadl_epi64((const __m128i *)(src + b * TEX_BYTES));
+
+        pix = _mm_mulhi_epu16(_mm_unpacklo_epi8(pix, zero), vlight);
+        _mm_storel_epi64((__m128i *)(dst + b * TEX_BYTES), _mm_packus_epi16(pix, pix));
+        vlight = _mm_add_epi16(vlight, vstep);
+    }
+#else
+    const uint16_t l[8] = {
+        light[0], light[1], light[2], 0,
+        light[0] - step[0], light[1] - step[1], light[2] - step[2], 0
+    };
+    const uint16_t s[8] = {
+        -2 * step[0], -2 * step[1], -2 * step[2], 0,
+        -2 * step[0], -2 * step[1], -2 * step[2], 0
+    };
+    uint16x8_t vlight = vld1q_u16(l);
+    uint16x8_t vstep = vld1q_u16(s);
+
+    for (b = 0; b < count; b += 2) {
+        uint16x8_t pix = vmovl_u8(vld1_u8(src + b * TEX_BYTES));
+        uint32x4_t lo = vmull_u16(vget_low_u16(pix), vget_low_u16(vlight));
+        uint32x4_t hi = vmull_u16(vget_high_u16(pix), vget_high_u16(vlight));
+
+        pix = vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+        vst1_u8(dst + b * TEX_BYTES, vmovn_u16(pix));
+        vlight = vaddq_u16(vlight, vstep);
+    }
+#endif
+}
+#endif
+
 #define BLOCK_FUNC R_DrawSurfaceBlock8_mip0
 #define BLOCK_SHIFT 4
 #include "block.h"
@@ -167,6 +218,23 @@ void R_DrawSurface(void)
 //============================================================================
 
 
+// largest cache sw_surfcacheoverride may ask for
+#define SURFCACHE_SIZE_MAX      (256 * 1024 * 1024)
+
+// blocks drawn this recently are skipped by the rover while any colder
+// block can still be reclaimed
+#define SURFCACHE_HOT_FRAMES    2
+
+static struct {
+    int     hits;           // reused as is
+    int     rebuilds;       // relit or animated in place
+    int     allocs;         // built into a fresh block
+    int     evictions;      // blocks that lost their owner
+    int     hotevictions;   // of those, ones still in use
+    int     skipped;        // hot blocks stepped over by the rover
+    int     wraps;
+} sc_stats;
+
 /*
 ================
 R_InitCaches
@@ -180,13 +248,14 @@ void R_InitCaches(void)
 
     // calculate size to allocate
     if (sw_surfcacheoverride->integer) {
-        size = sw_surfcacheoverride->integer;
+        size = Cvar_ClampInteger(sw_surfcacheoverride, 65536, SURFCACHE_SIZE_MAX);
     } else {
-        size = SURFCACHE_SIZE_AT_320X240;
+        // the original sizing assumed a byte per texel
+        size = SURFCACHE_SIZE_AT_320X240 * TEX_BYTES;
 
         pix = vid.width * vid.height;
         if (pix > 64000)
-            size += (pix - 64000) * 3;
+            size += (pix - 64000) * 3 * TEX_BYTES;
     }
 
     // round up to page size
@@ -238,14 +307,36 @@ void D_FlushCaches(void)
     sc_base->size = sc_size;
 }
 
+static inline qboolean D_SCHot(surfcache_t *c)
+{
+    return c->owner && c->lastframe > r_framecount - SURFCACHE_HOT_FRAMES;
+}
+
+static void D_SCEvict(surfcache_t *c)
+{
+    if (c->owner) {
+        *c->owner = NULL;
+        c->owner = NULL;
+        sc_stats.evictions++;
+        if (c->lastframe > r_framecount - SURFCACHE_HOT_FRAMES)
+            sc_stats.hotevictions++;
+    }
+}
+
 /*
 =================
 D_SCAlloc
+
+Blocks are reclaimed in address order behind a rover, which alone is
+FIFO. Blocks drawn in the last few frames are stepped over instead, the
+clock approximation of LRU, until a whole lap has been scanned. Only
+then is the hot set evicted, which means the cache is too small.
 =================
 */
 surfcache_t     *D_SCAlloc(int width, int size)
 {
     surfcache_t             *new;
+    int                     scanned;
 
     if ((width < 0) || (width > 256))
         Com_Error(ERR_FATAL, "D_SCAlloc: bad cache width %d\n", width);
@@ -258,23 +349,43 @@ surfcache_t     *D_SCAlloc(int width, int size)
     if (size > sc_size)
         Com_Error(ERR_FATAL, "D_SCAlloc: %i > cache size of %i", size, sc_size);
 
+    scanned = 0;
+
+restart:
 // if there is not size bytes after the rover, reset to the start
     if (!sc_rover || (byte *)sc_rover - (byte *)sc_base > sc_size - size) {
+        // pending band commands may point into blocks about to be reused
+        D_FinishBands();
         sc_rover = sc_base;
+        sc_stats.wraps++;
+    }
+
+    if (scanned < sc_size && D_SCHot(sc_rover)) {
+        sc_stats.skipped++;
+        scanned += sc_rover->size;
+        sc_rover = sc_rover->next;
+        goto restart;
     }
 
 // colect and free surfcache_t blocks until the rover block is large enough
     new = sc_rover;
-    if (sc_rover->owner)
-        *sc_rover->owner = NULL;
+    D_SCEvict(new);
 
     while (new->size < size) {
         // free another
         sc_rover = sc_rover->next;
         if (!sc_rover)
             Com_Error(ERR_FATAL, "D_SCAlloc: hit the end of memory");
-        if (sc_rover->owner)
-            *sc_rover->owner = NULL;
+
+        if (scanned < sc_size && D_SCHot(sc_rover)) {
+            // leave the merged cold blocks free and look past this one
+            sc_stats.skipped++;
+            scanned += new->size + sc_rover->size;
+            new->width = 0;
+            sc_rover = sc_rover->next;
+            goto restart;
+        }
+        D_SCEvict(sc_rover);
 
         new->size += sc_rover->size;
         new->next = sc_rover->next;
@@ -298,6 +409,7 @@ surfcache_t     *D_SCAlloc(int width, int size)
         new->height = (size - sizeof(*new) + sizeof(new->data)) / width;
 
     new->owner = NULL;              // should be set properly after return
+    new->lastframe = r_framecount;
 
     return new;
 }
@@ -320,6 +432,38 @@ void D_SCDump_f(void)
     }
 }
 
+/*
+=================
+D_PrintCacheStats
+
+One line per frame, the counters are reset after printing. A cache that
+is large enough shows no hot evictions once the view settles.
+=================
+*/
+void D_PrintCacheStats(void)
+{
+    surfcache_t     *c;
+    int             used, hot;
+
+    used = hot = 0;
+    for (c = sc_base; c; c = c->next) {
+        if (!c->owner)
+            continue;
+        used += c->size;
+        if (D_SCHot(c))
+            hot += c->size;
+    }
+
+    Com_Printf("%5ik cache %5ik used %5ik hot | %4i hit %3i rebuild %3i alloc "
+               "%3i evict %3i hot evict %3i skip %i wrap\n",
+               sc_size / 1024, used / 1024, hot / 1024,
+               sc_stats.hits, sc_stats.rebuilds, sc_stats.allocs,
+               sc_stats.evictions, sc_stats.hotevictions, sc_stats.skipped,
+               sc_stats.wraps);
+
+    memset(&sc_stats, 0, sizeof(sc_stats));
+}
+
 //=============================================================================
 
 /*
@@ -351,8 +495,11 @@ surfcache_t *D_CacheSurface(mface_t *surface, int miplevel)
         && cache->lightadj[0] == r_drawsurf.lightadj[0]
         && cache->lightadj[1] == r_drawsurf.lightadj[1]
         && cache->lightadj[2] == r_drawsurf.lightadj[2]
-        && cache->lightadj[3] == r_drawsurf.lightadj[3])
+        && cache->lightadj[3] == r_drawsurf.lightadj[3]) {
+        cache->lastframe = r_framecount;
+        sc_stats.hits++;
         return cache;
+    }
 
 //
 // determine shape of surface
@@ -372,6 +519,10 @@ surfcache_t *D_CacheSurface(mface_t *surface, int miplevel)
         surface->cachespots[miplevel] = cache;
         cache->owner = &surface->cachespots[miplevel];
         cache->mipscale = surfscale;
+        sc_stats.allocs++;
+    } else {
+        cache->lastframe = r_framecount;
+        sc_stats.rebuilds++;
     }
 
     if (surface->dlightframe == r_framecount)
@@ -32,6 +32,26 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define REF_VERSION     "SOFT 0.01"
 
+// vector paths used where the compiler targets them, the C loops
+// are kept for everything else
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#elif (defined __ARM_NEON) || (defined __ARM_NEON__)
+#define USE_NEON    1
+#include <arm_neon.h>
+#endif
+
+// span drawing state is private to each band worker, the assembly
+// paths share it with the rest of the renderer and draw serially
+#if USE_ASM
+#define USE_BANDS   0
+#define sw_threadlocal
+#else
+#define USE_BANDS   1
+#define sw_threadlocal  q_threadlocal
+#endif
+
 //===================================================================
 
 typedef unsigned char pixel_t;
@@ -281,6 +301,7 @@ typedef struct surfcache_s {
     unsigned                height;         // DEBUG only needed for debug
     float                   mipscale;
     image_t                 *image;
+    int                     lastframe;      // r_framecount when last drawn
     byte                    data[4];        // width*height elements
 } surfcache_t;
 
@@ -397,12 +418,12 @@ extern byte             r_warpbuffer[WARP_WIDTH * WARP_HEIGHT * VID_BYTES];
 
 extern float    scale_for_mip;
 
-extern float    d_sdivzstepu, d_tdivzstepu, d_zistepu;
-extern float    d_sdivzstepv, d_tdivzstepv, d_zistepv;
-extern float    d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+extern sw_threadlocal float  d_sdivzstepu, d_tdivzstepu, d_zistepu;
+extern sw_threadlocal float  d_sdivzstepv, d_tdivzstepv, d_zistepv;
+extern sw_threadlocal float  d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-extern fixed16_t    sadjust, tadjust;
-extern fixed16_t    bbextents, bbextentt;
+extern sw_threadlocal fixed16_t  sadjust, tadjust;
+extern sw_threadlocal fixed16_t  bbextents, bbextentt;
 
 void D_DrawTurbulent16(espan_t *pspan, int *warptable);
 void D_DrawSpans16(espan_t *pspans);
@@ -425,8 +446,8 @@ extern float    d_scalemip[3];
 
 //===================================================================
 
-extern int      cachewidth;
-extern pixel_t  *cacheblock;
+extern sw_threadlocal int        cachewidth;
+extern sw_threadlocal pixel_t    *cacheblock;
 extern int      r_screenrowbytes;
 
 extern int      r_drawnpolycount;
@@ -479,10 +500,17 @@ extern cvar_t   *sw_reportsurfout;
 extern cvar_t   *sw_reportedgeout;
 extern cvar_t   *sw_stipplealpha;
 extern cvar_t   *sw_surfcacheoverride;
+extern cvar_t   *sw_surfcache_stats;
 extern cvar_t   *sw_waterwarp;
 extern cvar_t   *sw_drawsird;
 extern cvar_t   *sw_dynamic;
 extern cvar_t   *sw_modulate;
+extern cvar_t   *sw_threads;
+
+extern cvar_t   *vcr_enabled;
+extern cvar_t   *vcr_desaturation;
+extern cvar_t   *vcr_grain_intensity;
+extern cvar_t   *vcr_scanline_alpha;
 
 extern cvar_t   *r_fullbright;
 extern cvar_t   *r_drawentities;
@@ -497,7 +525,7 @@ extern cvar_t   *vid_gamma;
 
 
 extern clipplane_t  view_clipplanes[4];
-extern int          *pfrustum_indexes[4];
+extern cplane4_t    view_clipplanes4;   // same planes, for box tests
 
 
 //=============================================================================
@@ -556,6 +584,8 @@ void R_AliasDrawModel(void);
 void R_BeginEdgeFrame(void);
 void R_ScanEdges(void);
 void D_DrawSurfaces(void);
+void D_FinishBands(void);
+void D_ShutdownBands(void);
 void R_InsertNewEdges(edge_t *edgestoadd, edge_t *edgelist);
 void R_StepActiveU(edge_t *pedge);
 void R_RemoveEdges(edge_t *pedge);
@@ -576,9 +606,6 @@ extern int      r_wholepolycount;
 
 extern int          ubasestep, errorterm, erroradjustup, erroradjustdown;
 
-extern fixed16_t    sadjust, tadjust;
-extern fixed16_t    bbextents, bbextentt;
-
 extern mvertex_t    *r_ptverts, *r_ptvertsmax;
 
 extern float        entity_rotation[3][3];
@@ -630,7 +657,6 @@ extern float    r_time1;
 extern float    da_time1, da_time2;
 extern float    dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
 extern float    se_time1, se_time2, de_time1, de_time2, dv_time1, dv_time2;
-extern int      r_frustum_indexes[4 * 6];
 extern int      r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
 extern qboolean r_surfsonstack;
 
@@ -677,10 +703,12 @@ void R_Shutdown(qboolean total);
 void R_InitCaches(void);
 void R_FreeCaches(void);
 void D_FlushCaches(void);
+void D_PrintCacheStats(void);
 
 qhandle_t R_RegisterModel(const char *name);
 
 void    R_RenderFrame(refdef_t *fd);
+void    R_RenderFrames(refdef_t *fd, int count);
 
 void     R_BeginFrame(void);
 
@@ -698,6 +726,8 @@ void    R_EmitSkyBox(void);
 
 void R_ApplySIRDAlgorithum(void);
 
+void R_VCRScreen(void);
+
 void R_IMFlatShadedQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, color_t color, float alpha);
 
 void R_InitDraw(void);
@@ -0,0 +1,154 @@
+/*
+Copyright (C) 2003-2011 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// vcr.c -- VCR look for the software renderer
+//
+// Desaturation, scanlines and noise applied in place to the 3D view
+// after it has been rendered. Pixels are processed in 8 bit fixed
+// point, four at a time with SSE2 when the compiler targets it.
+//
+
+#include "sw.h"
+
+#define VCR_SCANLINE_DARKEN     0.08f   // every other row
+#define VCR_GRAIN_CHANCE        25      // one in N pixels
+#define VCR_GRAIN_MAX           40
+#define VCR_DOT_CHANCE          2000
+
+// rows read from a random offset into this table
+#define VCR_NOISE_OFFSETS       1024
+#define VCR_NOISE_WIDTH         (MAXWIDTH + VCR_NOISE_OFFSETS)
+
+cvar_t  *vcr_enabled;
+cvar_t  *vcr_desaturation;
+cvar_t  *vcr_grain_intensity;
+cvar_t  *vcr_scanline_alpha;
+
+static byte     vcr_noise[VCR_NOISE_WIDTH * VID_BYTES];
+static float    vcr_noise_intensity = -1;
+
+static void R_VCRMakeNoise(float intensity)
+{
+    byte    *dst = vcr_noise;
+    int     i, v;
+
+    for (i = 0; i < VCR_NOISE_WIDTH; i++, dst += VID_BYTES) {
+        if (rand() % VCR_DOT_CHANCE == 0) {
+            v = 255;
+        } else if (rand() % VCR_GRAIN_CHANCE == 0) {
+            v = (rand() % VCR_GRAIN_MAX) * intensity;
+        } else {
+            v = 0;
+        }
+        v = v > 255 ? 255 : v;
+        dst[0] = dst[1] = dst[2] = v;
+        dst[3] = 0;
+    }
+
+    vcr_noise_intensity = intensity;
+}
+
+// desat is 0..128, scale is 0..256
+static void R_VCRRow(byte *dst, const byte *noise, int count, int desat, int scale)
+{
+    int     i, c, gray;
+
+#if USE_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i luma = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+    __m128i vdesat = _mm_set1_epi16(desat);
+    __m128i vscale = _mm_set1_epi16(scale);
+
+    for (; count >= 4; count -= 4, dst += 16, noise += 16) {
+        __m128i pix = _mm_loadu_si128((const __m128i *)dst);
+        __m128i lo = _mm_unpacklo_epi8(pix, zero);
+        __m128i hi = _mm_unpackhi_epi8(pix, zero);
+        __m128i glo, ghi;
+
+        // sum each pixel's weighted channels, then spread it over them
+        glo = _mm_madd_epi16(lo, luma);
+        ghi = _mm_madd_epi16(hi, luma);
+        glo = _mm_add_epi32(glo, _mm_shuffle_epi32(glo, _MM_SHUFFLE(2, 3, 0, 1)));
+        ghi = _mm_add_epi32(ghi, _mm_shuffle_epi32(ghi, _MM_SHUFFLE(2, 3, 0, 1)));
+        glo = _mm_srli_epi32(glo, 8);
+        ghi = _mm_srli_epi32(ghi, 8);
+        glo = _mm_packs_epi32(glo, glo);
+        ghi = _mm_packs_epi32(ghi, ghi);
+        glo = _mm_unpacklo_epi16(glo, glo);
+        ghi = _mm_unpacklo_epi16(ghi, ghi);
+
+        // c += (gray - c) * desat
+        glo = _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(glo, lo), vdesat), 7);
+        ghi = _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(ghi, hi), vdesat), 7);
+        lo = _mm_add_epi16(lo, glo);
+        hi = _mm_add_epi16(hi, ghi);
+
+        // darken, stays within 16 bits unsigned
+        lo = _mm_srli_epi16(_mm_mullo_epi16(lo, vscale), 8);
+        hi = _mm_srli_epi16(_mm_mullo_epi16(hi, vscale), 8);
+
+        pix = _mm_packus_epi16(lo, hi);
+        pix = _mm_adds_epu8(pix, _mm_loadu_si128((const __m128i *)noise));
+        _mm_storeu_si128((__m128i *)dst, pix);
+    }
+#endif
+
+    for (; count > 0; count--, dst += VID_BYTES, noise += VID_BYTES) {
+        gray = (dst[0] * 29 + dst[1] * 150 + dst[2] * 77) >> 8;
+        for (i = 0; i < 3; i++) {
+            c = dst[i] + (((gray - dst[i]) * desat) >> 7);
+            c = ((c * scale) >> 8) + noise[i];
+            dst[i] = c > 255 ? 255 : c;
+        }
+    }
+}
+
+/*
+=============
+R_VCRScreen
+
+Applies the effect to the 3D view in vid.buffer.
+=============
+*/
+void R_VCRScreen(void)
+{
+    byte    *dest;
+    float   d, dark, lines;
+    int     v, desat, scale, offset;
+
+    if (!vcr_enabled->integer)
+        return;
+
+    if (vcr_grain_intensity->value != vcr_noise_intensity)
+        R_VCRMakeNoise(Cvar_ClampValue(vcr_grain_intensity, 0, 4));
+
+    d = Cvar_ClampValue(vcr_desaturation, 0, 1);
+    dark = 1 - d * 0.5f;
+    desat = d * 128;
+    scale = dark * 256;
+    lines = 1 - VCR_SCANLINE_DARKEN * Cvar_ClampValue(vcr_scanline_alpha, 0, 10);
+
+    dest = vid.buffer + r_newrefdef.y * vid.rowbytes + r_newrefdef.x * VID_BYTES;
+
+    for (v = 0; v < r_newrefdef.height; v++, dest += vid.rowbytes) {
+        offset = (rand() % VCR_NOISE_OFFSETS) * VID_BYTES;
+        R_VCRRow(dest, vcr_noise + offset, r_newrefdef.width, desat,
+                 (v & 1) ? scale * lines : scale);
+    }
+}
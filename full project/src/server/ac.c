@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 //
 
 #include "server.h"
+#include "system/thread.h"
 
 typedef enum {
     ACS_BAD,
@@ -69,8 +70,11 @@ typedef enum {
     AC_CLIENT_Q2PRO = 0x10
 } ac_client_t;
 
+#define AC_HASH_SIZE    256
+
 typedef struct ac_file_s {
     struct ac_file_s *next;
+    struct ac_file_s *hash_next;
     byte hash[20];
     int flags;
     char path[1];
@@ -84,6 +88,38 @@ typedef struct ac_cvar_s {
     char *def, *name;
 } ac_cvar_t;
 
+typedef struct ac_token_s {
+    struct ac_token_s *next;
+    struct ac_token_s *hash_next;
+    char string[1];
+} ac_token_t;
+
+// raw check file, read on the main thread before parsing
+typedef struct ac_source_s {
+    struct ac_source_s *next;
+    char *data;
+    qerror_t ret;
+    char path[1];
+} ac_source_t;
+
+typedef struct {
+    ac_file_t *files;
+    ac_file_t *filehash[AC_HASH_SIZE];
+    int num_files;
+
+    ac_cvar_t *cvars;
+    int num_cvars;
+
+    ac_token_t *tokens;
+    ac_token_t *tokenhash[AC_HASH_SIZE];
+
+    char hashlist_name[MAX_QPATH];
+
+    // parser input and output, only used while loading
+    ac_source_t *sources;
+    string_entry_t *warnings, **warnings_tail;
+} ac_checks_t;
+
 typedef struct {
     qboolean connected;
     qboolean ready;
@@ -97,15 +133,13 @@ typedef struct {
     time_t retry_time;
     int retry_backoff;
 
-    ac_file_t *files;
-    int num_files;
+    ac_checks_t checks;
 
-    ac_cvar_t *cvars;
-    int num_cvars;
-
-    string_entry_t *tokens;
-
-    char hashlist_name[MAX_QPATH];
+    // background `svacupdate'
+    qthread_t *reload_thread;
+    qmutex_t *reload_lock;
+    qboolean reload_done;
+    ac_checks_t *reload;
 } ac_static_t;
 
 #define ACP_BLOCKPLAY   (1 << 0)
@@ -171,7 +205,7 @@ FILE PARSING
 
 #define AC_MAX_INCLUDES 16
 
-typedef void (*ac_parse_t)(char *, int, const char *);
+typedef void (*ac_parse_t)(ac_checks_t *, char *, int, const char *);
 
 typedef struct {
     char str[4];
@@ -193,6 +227,29 @@ static const ac_cvarop_t ac_cvarops[] = {
     { "" }
 };
 
+// parsing may run on a worker thread, warnings are printed when done
+static void q_printf(2, 3) AC_Warn(ac_checks_t *ch, const char *fmt, ...)
+{
+    char buffer[MAX_STRING_CHARS];
+    string_entry_t *entry;
+    va_list argptr;
+    size_t len;
+
+    va_start(argptr, fmt);
+    len = Q_vsnprintf(buffer, sizeof(buffer), fmt, argptr);
+    va_end(argptr);
+
+    if (len >= sizeof(buffer)) {
+        len = sizeof(buffer) - 1;
+    }
+
+    entry = SV_Malloc(sizeof(*entry) + len);
+    memcpy(entry->string, buffer, len + 1);
+    entry->next = NULL;
+    *ch->warnings_tail = entry;
+    ch->warnings_tail = &entry->next;
+}
+
 static char *AC_SimpleParse(char **data_p, size_t *len_p)
 {
     char *data, *p;
@@ -220,7 +277,7 @@ static char *AC_SimpleParse(char **data_p, size_t *len_p)
     return data;
 }
 
-static void AC_ParseHash(char *data, int linenum, const char *path)
+static void AC_ParseHash(ac_checks_t *ch, char *data, int linenum, const char *path)
 {
     char *pstr, *hstr;
     size_t pathlen, hashlen;
@@ -230,29 +287,29 @@ static void AC_ParseHash(char *data, int linenum, const char *path)
     int i;
 
     if (*data == '!') {
-        Q_strlcpy(acs.hashlist_name, data + 1, sizeof(acs.hashlist_name));
+        Q_strlcpy(ch->hashlist_name, data + 1, sizeof(ch->hashlist_name));
         return;
     }
 
     pstr = AC_SimpleParse(&data, &pathlen);
     if (!data) {
-        Com_WPrintf("ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
         return;
     }
     hstr = AC_SimpleParse(&data, &hashlen);
 
     if (pathlen < 1 || pathlen >= MAX_QPATH) {
-        Com_WPrintf("ANTICHEAT: Invalid quake path length on line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Invalid quake path length on line %d in %s\n", linenum, path);
         return;
     }
     if (strchr(pstr, '\\') || !Q_isalnum(pstr[0])) {
-        Com_WPrintf("ANTICHEAT: Malformed quake path on line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Malformed quake path on line %d in %s\n", linenum, path);
         return;
     }
 
     if (hashlen != 40) {
 badhash:
-        Com_WPrintf("ANTICHEAT: Malformed hash on line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Malformed hash on line %d in %s\n", linenum, path);
         return;
     }
 
@@ -280,44 +337,49 @@ badhash:
     memcpy(file->hash, hash, sizeof(file->hash));
     memcpy(file->path, pstr, pathlen + 1);
     file->flags = flags;
-    file->next = acs.files;
-    acs.files = file;
-    acs.num_files++;
+    file->next = ch->files;
+    ch->files = file;
+    ch->num_files++;
+
+    i = Com_HashString(file->path, AC_HASH_SIZE);
+    file->hash_next = ch->filehash[i];
+    ch->filehash[i] = file;
 }
 
-static void AC_ParseCvar(char *data, int linenum, const char *path)
+static void AC_ParseCvar(ac_checks_t *ch, char *data, int linenum, const char *path)
 {
     char *values[256], *p;
     byte lengths[256];
     char *name, *opstr, *val, *def;
-    size_t len, namelen, vallen, deflen;
+    size_t len, namelen, vallen, deflen, total;
     ac_cvar_t *cvar;
+    char *store;
     const ac_cvarop_t *op;
     int i, num_values;
 
     name = AC_SimpleParse(&data, &namelen);
     if (!data) {
-        Com_WPrintf("ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
         return;
     }
     opstr = AC_SimpleParse(&data, NULL);
     if (!data) {
-        Com_WPrintf("ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
         return;
     }
     val = AC_SimpleParse(&data, &vallen);
     if (!data) {
-        Com_WPrintf("ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Incomplete line %d in %s\n", linenum, path);
         return;
     }
     def = AC_SimpleParse(&data, &deflen);
 
     if (namelen < 1 || namelen >= 64) {
-        Com_WPrintf("ANTICHEAT: Invalid cvar name length on line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Invalid cvar name length on line %d in %s\n", linenum, path);
         return;
     }
     if (deflen < 1 || deflen >= 64) {
-        Com_WPrintf("ANTICHEAT: Invalid default value length on line %d in %s\n", linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Invalid default value length on line %d in %s\n", linenum, path);
         return;
     }
 
@@ -327,18 +389,18 @@ static void AC_ParseCvar(char *data, int linenum, const char *path)
         }
     }
     if (!op->str[0]) {
-        Com_WPrintf("ANTICHEAT: Unknown opcode '%s' on line %d in %s\n", opstr, linenum, path);
+        AC_Warn(ch, "ANTICHEAT: Unknown opcode '%s' on line %d in %s\n", opstr, linenum, path);
         return;
     }
 
     num_values = 0;
     while (1) {
         if (num_values == op->max_values) {
-            Com_WPrintf("ANTICHEAT: Too many values for opcode '%s' on line %d in %s\n", opstr, linenum, path);
+            AC_Warn(ch, "ANTICHEAT: Too many values for opcode '%s' on line %d in %s\n", opstr, linenum, path);
             return;
         }
         if (!val[0]) {
-            Com_WPrintf("ANTICHEAT: Empty value on line %d in %s\n", linenum, path);
+            AC_Warn(ch, "ANTICHEAT: Empty value on line %d in %s\n", linenum, path);
             return;
         }
         p = strchr(val, ',');
@@ -347,7 +409,7 @@ static void AC_ParseCvar(char *data, int linenum, const char *path)
         }
         len = strlen(val);
         if (len >= 64) {
-            Com_WPrintf("ANTICHEAT: Too long value on line %d in %s\n", linenum, path);
+            AC_Warn(ch, "ANTICHEAT: Too long value on line %d in %s\n", linenum, path);
             return;
         }
         values[num_values] = val;
@@ -358,51 +420,125 @@ static void AC_ParseCvar(char *data, int linenum, const char *path)
         val = p + 1;
     }
 
-    Z_TagReserve(sizeof(*cvar) + num_values * sizeof(char *) +
-                 namelen + 1 + deflen + 1 + vallen + 1, TAG_SERVER);
-    cvar = Z_ReservedAlloc(sizeof(*cvar));
-    cvar->values = Z_ReservedAlloc(num_values * sizeof(char *));
-    cvar->name = Z_ReservedAlloc(namelen + 1);
+    // single block, Z_TagReserve is main thread only
+    total = sizeof(*cvar) + num_values * sizeof(char *) + namelen + 1 + deflen + 1;
+    for (i = 0; i < num_values; i++) {
+        total += lengths[i];
+    }
+    cvar = SV_Malloc(total);
+    cvar->values = (char **)(cvar + 1);
+    store = (char *)(cvar->values + num_values);
+    cvar->name = store;
     memcpy(cvar->name, name, namelen + 1);
-    cvar->def = Z_ReservedAlloc(deflen + 1);
+    store += namelen + 1;
+    cvar->def = store;
     memcpy(cvar->def, def, deflen + 1);
+    store += deflen + 1;
     cvar->num_values = num_values;
     for (i = 0; i < num_values; i++) {
-        cvar->values[i] = Z_ReservedAlloc(lengths[i]);
+        cvar->values[i] = store;
         memcpy(cvar->values[i], values[i], lengths[i]);
+        store += lengths[i];
     }
     cvar->op = op->code;
-    cvar->next = acs.cvars;
-    acs.cvars = cvar;
-    acs.num_cvars++;
+    cvar->next = ch->cvars;
+    ch->cvars = cvar;
+    ch->num_cvars++;
 }
 
-static void AC_ParseToken(char *data, int linenum, const char *path)
+static void AC_ParseToken(ac_checks_t *ch, char *data, int linenum, const char *path)
 {
-    string_entry_t *tok;
+    ac_token_t *tok;
     size_t len = strlen(data);
+    unsigned hash;
 
     tok = SV_Malloc(sizeof(*tok) + len);
     memcpy(tok->string, data, len + 1);
-    tok->next = acs.tokens;
-    acs.tokens = tok;
+    tok->next = ch->tokens;
+    ch->tokens = tok;
+
+    hash = Com_HashString(tok->string, AC_HASH_SIZE);
+    tok->hash_next = ch->tokenhash[hash];
+    ch->tokenhash[hash] = tok;
+}
+
+static ac_source_t *AC_FindSource(ac_checks_t *ch, const char *path)
+{
+    ac_source_t *src;
+
+    for (src = ch->sources; src; src = src->next) {
+        if (!strcmp(src->path, path)) {
+            return src;
+        }
+    }
+
+    return NULL;
 }
 
-static qboolean AC_ParseFile(const char *path, ac_parse_t parse, int depth)
+// loads the file and everything it includes, each path once
+static void AC_ReadSource(ac_checks_t *ch, const char *path)
+{
+    char name[MAX_QPATH], *data, *p;
+    ac_source_t *src;
+    size_t len;
+
+    if (AC_FindSource(ch, path)) {
+        return;
+    }
+
+    len = strlen(path);
+    src = SV_Malloc(sizeof(*src) + len);
+    memcpy(src->path, path, len + 1);
+    src->ret = FS_LoadFile(path, (void **)&src->data);
+    src->next = ch->sources;
+    ch->sources = src;
+
+    for (data = src->data; data; data = p ? p + 1 : NULL) {
+        p = strchr(data, '\n');
+        if (strncmp(data, "\\include ", 9)) {
+            continue;
+        }
+        data += 9;
+        len = p ? p - data : strlen(data);
+        if (len && data[len - 1] == '\r') {
+            len--;
+        }
+        if (len >= sizeof(name)) {
+            continue;   // can't exist, reported by the parser
+        }
+        memcpy(name, data, len);
+        name[len] = 0;
+        AC_ReadSource(ch, name);
+    }
+}
+
+static void AC_ReadSources(ac_checks_t *ch)
+{
+    AC_ReadSource(ch, AC_HASHES_NAME);
+    AC_ReadSource(ch, AC_CVARS_NAME);
+    AC_ReadSource(ch, AC_TOKENS_NAME);
+}
+
+static qboolean AC_ParseFile(ac_checks_t *ch, const char *path, ac_parse_t parse, int depth)
 {
     char *raw, *data, *p;
     int linenum = 1;
-    qerror_t ret;
+    ac_source_t *src;
+
+    src = AC_FindSource(ch, path);
+    if (!src || !src->data) {
+        qerror_t ret = src ? src->ret : Q_ERR_NAMETOOLONG;
 
-    ret = FS_LoadFile(path, (void **)&raw);
-    if (!raw) {
         if (ret != Q_ERR_NOENT || depth) {
-            Com_WPrintf("ANTICHEAT: Could not %s %s: %s\n",
-                        depth ? "include" : "load", path, Q_ErrorString(ret));
+            AC_Warn(ch, "ANTICHEAT: Could not %s %s: %s\n",
+                    depth ? "include" : "load", path, Q_ErrorString(ret));
         }
         return qfalse;
     }
 
+    // the same file may be included more than once
+    raw = SV_CopyString(src->data);
+
     data = raw;
     while (*data) {
         p = strchr(data, '\n');
@@ -421,16 +557,16 @@ static qboolean AC_ParseFile(const char *path, ac_parse_t parse, int depth)
         case '\\':
             if (!strncmp(data + 1, "include ", 8)) {
                 if (depth == AC_MAX_INCLUDES) {
-                    Com_WPrintf("ANTICHEAT: Includes too deeply nested.\n");
+                    AC_Warn(ch, "ANTICHEAT: Includes too deeply nested.\n");
                 } else {
-                    AC_ParseFile(data + 9, parse, depth + 1);
+                    AC_ParseFile(ch, data + 9, parse, depth + 1);
                 }
             } else {
-                Com_WPrintf("ANTICHEAT: Unknown directive %s on line %d in %s\n", data + 1, linenum, path);
+                AC_Warn(ch, "ANTICHEAT: Unknown directive %s on line %d in %s\n", data + 1, linenum, path);
             }
             break;
         default:
-            parse(data, linenum, path);
+            parse(ch, data, linenum, path);
             break;
         }
 
@@ -442,64 +578,175 @@ static qboolean AC_ParseFile(const char *path, ac_parse_t parse, int depth)
         data = p + 1;
     }
 
-    FS_FreeFile(raw);
+    Z_Free(raw);
 
     return qtrue;
 }
 
-static void AC_LoadChecks(void)
+// doesn't touch the console, safe to call on a worker thread
+static void AC_ParseChecks(ac_checks_t *ch)
 {
-    if (!AC_ParseFile(AC_HASHES_NAME, AC_ParseHash, 0)) {
-        Com_Printf("ANTICHEAT: Missing " AC_HASHES_NAME ", "
-                   "not using any file checks.\n");
-        strcpy(acs.hashlist_name, "none");
-    } else if (!acs.num_files) {
-        Com_Printf("ANTICHEAT: No file hashes were loaded, "
-                   "please check the " AC_HASHES_NAME ".\n");
-        strcpy(acs.hashlist_name, "none");
-    } else if (!acs.hashlist_name[0]) {
-        Q_snprintf(acs.hashlist_name, MAX_QPATH, "unknown (%d %s)",
-                   acs.num_files, acs.num_files == 1 ? "entry" : "entries");
+    ac_source_t *src, *next;
+
+    ch->warnings_tail = &ch->warnings;
+
+    if (!AC_ParseFile(ch, AC_HASHES_NAME, AC_ParseHash, 0)) {
+        strcpy(ch->hashlist_name, "none");
+        ch->num_files = -1;
     }
 
-    if (!AC_ParseFile(AC_CVARS_NAME, AC_ParseCvar, 0)) {
-        Com_Printf("ANTICHEAT: Missing " AC_CVARS_NAME ", "
-                   "not using any cvar checks.\n");
-    } else if (!acs.num_cvars) {
-        Com_Printf("ANTICHEAT: No cvar checks were loaded, "
-                   "please check the " AC_CVARS_NAME ".\n");
+    if (!AC_ParseFile(ch, AC_CVARS_NAME, AC_ParseCvar, 0)) {
+        ch->num_cvars = -1;
     }
 
-    AC_ParseFile("anticheat-tokens.txt", AC_ParseToken, 0);
+    AC_ParseFile(ch, AC_TOKENS_NAME, AC_ParseToken, 0);
+
+    for (src = ch->sources; src; src = next) {
+        next = src->next;
+        FS_FreeFile(src->data);
+        Z_Free(src);
+    }
+    ch->sources = NULL;
 }
 
 static void AC_FreeChecks(void)
 {
     ac_file_t *f, *fn;
     ac_cvar_t *c, *cn;
-    string_entry_t *t, *tn;
+    ac_token_t *t, *tn;
 
-    for (f = acs.files; f; f = fn) {
+    for (f = acs.checks.files; f; f = fn) {
         fn = f->next;
         Z_Free(f);
     }
-    acs.files = NULL;
 
-    for (c = acs.cvars; c; c = cn) {
+    for (c = acs.checks.cvars; c; c = cn) {
         cn = c->next;
         Z_Free(c);
     }
-    acs.cvars = NULL;
 
-    for (t = acs.tokens; t; t = tn) {
+    for (t = acs.checks.tokens; t; t = tn) {
         tn = t->next;
         Z_Free(t);
     }
-    acs.tokens = NULL;
 
-    acs.hashlist_name[0] = 0;
-    acs.num_files = 0;
-    acs.num_cvars = 0;
+    memset(&acs.checks, 0, sizeof(acs.checks));
+}
+
+// replaces the checks in use with freshly parsed ones
+static void AC_InstallChecks(ac_checks_t *ch)
+{
+    string_entry_t *w, *wn;
+    client_t *cl;
+
+    for (w = ch->warnings; w; w = wn) {
+        wn = w->next;
+        Com_WPrintf("%s", w->string);
+        Z_Free(w);
+    }
+    ch->warnings = NULL;
+    ch->warnings_tail = NULL;
+
+    // tokens in use are about to be freed
+    if (svs.initialized) {
+        FOR_EACH_CLIENT(cl) {
+            cl->ac_token = NULL;
+        }
+    }
+
+    AC_FreeChecks();
+    acs.checks = *ch;
+
+    if (acs.checks.num_files == -1) {
+        Com_Printf("ANTICHEAT: Missing " AC_HASHES_NAME ", "
+                   "not using any file checks.\n");
+        acs.checks.num_files = 0;
+    } else if (!acs.checks.num_files) {
+        Com_Printf("ANTICHEAT: No file hashes were loaded, "
+                   "please check the " AC_HASHES_NAME ".\n");
+        strcpy(acs.checks.hashlist_name, "none");
+    } else if (!acs.checks.hashlist_name[0]) {
+        Q_snprintf(acs.checks.hashlist_name, MAX_QPATH, "unknown (%d %s)",
+                   acs.checks.num_files, acs.checks.num_files == 1 ? "entry" : "entries");
+    }
+
+    if (acs.checks.num_cvars == -1) {
+        Com_Printf("ANTICHEAT: Missing " AC_CVARS_NAME ", "
+                   "not using any cvar checks.\n");
+        acs.checks.num_cvars = 0;
+    } else if (!acs.checks.num_cvars) {
+        Com_Printf("ANTICHEAT: No cvar checks were loaded, "
+                   "please check the " AC_CVARS_NAME ".\n");
+    }
+}
+
+static void AC_LoadChecks(void)
+{
+    ac_checks_t ch;
+
+    memset(&ch, 0, sizeof(ch));
+    AC_ReadSources(&ch);
+    AC_ParseChecks(&ch);
+    AC_InstallChecks(&ch);
+}
+
+static void AC_SendChecks(void);
+
+static void reload_thread(void *arg)
+{
+    AC_ParseChecks(acs.reload);
+
+    Sys_LockMutex(acs.reload_lock);
+    acs.reload_done = qtrue;
+    Sys_UnlockMutex(acs.reload_lock);
+}
+
+/*
+Reading the files stays on the main thread as the filesystem is not thread
+safe; parsing and indexing happen on the worker. Unless `wait' is set,
+returns immediately if the worker is still busy.
+*/
+static void AC_FinishReload(qboolean wait)
+{
+    qboolean done;
+
+    if (!acs.reload_thread) {
+        return;
+    }
+
+    if (!wait) {
+        Sys_LockMutex(acs.reload_lock);
+        done = acs.reload_done;
+        Sys_UnlockMutex(acs.reload_lock);
+        if (!done) {
+            return;
+        }
+    }
+
+    Sys_JoinThread(acs.reload_thread);
+    Sys_DestroyMutex(acs.reload_lock);
+    acs.reload_thread = NULL;
+    acs.reload_lock = NULL;
+
+    AC_InstallChecks(acs.reload);
+    Z_Free(acs.reload);
+    acs.reload = NULL;
+
+    if (ac.connected) {
+        AC_SendChecks();
+    }
+
+    Com_Printf("Anticheat configuration updated.\n");
+}
+
+static void AC_SubmitReload(void)
+{
+    acs.reload = SV_Mallocz(sizeof(*acs.reload));
+    AC_ReadSources(acs.reload);
+
+    acs.reload_done = qfalse;
+    acs.reload_lock = Sys_CreateMutex();
+    acs.reload_thread = Sys_CreateThread(reload_thread, NULL);
 }
 
 /*
@@ -768,7 +1015,8 @@ static void AC_ParseFileViolation(void)
     cl->ac_file_failures++;
 
     action = ac_badfile_action->integer;
-    for (f = acs.files; f; f = f->next) {
+    f = acs.checks.filehash[Com_HashString(path, AC_HASH_SIZE)];
+    for (; f; f = f->hash_next) {
         if (!strcmp(f->path, path)) {
             if (f->flags & ACH_REQUIRED) {
                 action = 0;
@@ -1142,14 +1390,15 @@ void AC_ClientDisconnect(client_t *cl)
 
 void AC_ClientToken(client_t *cl, const char *token)
 {
-    string_entry_t *tok;
+    ac_token_t *tok;
     client_t *other;
 
     if (!ac_required->integer) {
         return; // anticheat is not in use
     }
 
-    for (tok = acs.tokens; tok; tok = tok->next) {
+    tok = acs.checks.tokenhash[Com_HashString(token, AC_HASH_SIZE)];
+    for (; tok; tok = tok->hash_next) {
         if (!strcmp(tok->string, token)) {
             break;
         }
@@ -1248,11 +1497,11 @@ static void AC_SendChecks(void)
 
     MSG_WriteShort(9);
     MSG_WriteByte(ACC_UPDATECHECKS);
-    MSG_WriteLong(acs.num_files);
-    MSG_WriteLong(acs.num_cvars);
+    MSG_WriteLong(acs.checks.num_files);
+    MSG_WriteLong(acs.checks.num_cvars);
     AC_Flush();
 
-    for (f = acs.files, p = NULL; f; p = f, f = f->next) {
+    for (f = acs.checks.files, p = NULL; f; p = f, f = f->next) {
         MSG_WriteData(f->hash, sizeof(f->hash));
         MSG_WriteByte(f->flags);
         if (p && !strcmp(f->path, p->path)) {
@@ -1263,7 +1512,7 @@ static void AC_SendChecks(void)
         AC_Flush();
     }
 
-    for (c = acs.cvars; c; c = c->next) {
+    for (c = acs.checks.cvars; c; c = c->next) {
         AC_WriteString(c->name);
         MSG_WriteByte(c->op);
         MSG_WriteByte(c->num_values);
@@ -1390,6 +1639,8 @@ void AC_Run(void)
     neterr_t ret = NET_AGAIN;
     time_t clock;
 
+    AC_FinishReload(qfalse);
+
     if (acs.retry_time) {
         clock = time(NULL);
         if (acs.retry_time < clock) {
@@ -1478,6 +1729,8 @@ void AC_Connect(unsigned mvd_spawn)
 
 void AC_Disconnect(void)
 {
+    AC_FinishReload(qtrue);
+
     NET_CloseStream(&ac.stream);
 
     AC_FreeChecks();
@@ -1537,7 +1790,7 @@ void AC_List_f(void)
     Com_Printf("+----------------+--------+-----+------+\n");
 
     if (ac.ready) {
-        Com_Printf("File check list in use: %s\n", acs.hashlist_name);
+        Com_Printf("File check list in use: %s\n", acs.checks.hashlist_name);
     }
 
     Com_Printf(
@@ -1642,8 +1895,6 @@ static void AC_Invalidate_f(void)
 
 static void AC_Update_f(void)
 {
-    client_t    *cl;
-
     if (!svs.initialized) {
         Com_Printf("No server running.\n");
         return;
@@ -1653,19 +1904,13 @@ static void AC_Update_f(void)
         return;
     }
 
-    AC_FreeChecks();
-    AC_LoadChecks();
-
-    if (ac.connected) {
-        AC_SendChecks();
-    }
-
-    // reset all tokens
-    FOR_EACH_CLIENT(cl) {
-        cl->ac_token = NULL;
+    if (acs.reload_thread) {
+        Com_Printf("Anticheat configuration update already in progress.\n");
+        return;
     }
 
-    Com_Printf("Anticheat configuration updated.\n");
+    // finishes in AC_Run
+    AC_SubmitReload();
 }
 
 static void AC_AddException_f(void)
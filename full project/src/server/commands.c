@@ -503,6 +503,7 @@ static void SV_Kick_f(void)
             match->time = 0;
             match->comment[0] = 0;
             List_Append(&sv_banlist, &match->entry);
+            SV_AddressListChanged(&sv_banlist);
         }
     }
 
@@ -633,6 +634,80 @@ static void dump_lag(void)
     }
 }
 
+static void dump_netstats(void)
+{
+    client_t    *cl;
+    netchan_t   *nc;
+
+    Com_Printf(
+        "num name            KBin    KBout   frgin frgout drops  choke  resent\n"
+        "--- --------------- ------- ------- ----- ------ ------ ------ ------\n");
+
+    FOR_EACH_CLIENT(cl) {
+        nc = cl->netchan;
+        Com_Printf("%3i %-15.15s %7u %7u %5u %6u %6u %6u %6u\n",
+                   cl->number, cl->name,
+                   (unsigned)(nc->total_bytes_in >> 10),
+                   (unsigned)(nc->total_bytes_out >> 10),
+                   nc->total_fragments_in, nc->total_fragments_out,
+                   nc->total_dropped, cl->total_suppressed,
+                   nc->total_retransmits);
+    }
+}
+
+static size_t format_buckets(char *buf, size_t size, const char *key,
+                             const unsigned *buckets, int count)
+{
+    size_t len;
+    int i;
+
+    len = Q_scnprintf(buf, size, " %s=", key);
+    for (i = 0; i < count; i++)
+        len += Q_scnprintf(buf + len, size - len, i ? ",%u" : "%u", buckets[i]);
+
+    return len;
+}
+
+// one line of key=value pairs per client, for scripts
+static void dump_raw(void)
+{
+    char        buf[MAX_STRING_CHARS];
+    client_t    *cl;
+    netchan_t   *nc;
+    latstats_t  *ls;
+    size_t      len;
+
+    format_buckets(buf, sizeof(buf), "latency_bounds",
+                   sv_latency_bounds, LATENCY_BUCKETS - 1);
+    Com_Printf("%s\n", buf + 1);
+
+    FOR_EACH_CLIENT(cl) {
+        nc = cl->netchan;
+        len = Q_scnprintf(buf, sizeof(buf),
+                          "num=%d addr=%s ping=%d bytes_in=%"PRIu64" bytes_out=%"PRIu64
+                          " packets_in=%u drops=%u frags_in=%u frags_out=%u"
+                          " choke=%u resent=%u frames_sent=%u frames_acked=%u"
+                          " rate=%"PRIz" cc_rate=%"PRIz" cc_interval=%d cc_backoffs=%u"
+                          " truncated=%u deferred=%u",
+                          cl->number, NET_AdrToString(&nc->remote_address), cl->ping,
+                          nc->total_bytes_in, nc->total_bytes_out,
+                          nc->total_received - nc->total_dropped, nc->total_dropped,
+                          nc->total_fragments_in, nc->total_fragments_out,
+                          cl->total_suppressed, nc->total_retransmits,
+                          cl->frames_sent, cl->frames_acked,
+                          cl->rate, cl->cc.rate, cl->cc.interval, cl->cc.backoffs,
+                          cl->total_truncated, cl->total_deferred);
+        ls = SV_LatencyStats(cl);
+        if (ls) {
+            len += format_buckets(buf + len, sizeof(buf) - len, "latency_1s",
+                                  ls->last, LATENCY_BUCKETS);
+            len += format_buckets(buf + len, sizeof(buf) - len, "latency_total",
+                                  ls->total, LATENCY_BUCKETS);
+        }
+        Com_Printf("%s name=\"%s\"\n", buf, cl->name);
+    }
+}
+
 static void dump_protocols(void)
 {
     client_t    *cl;
@@ -699,8 +774,11 @@ static void SV_Status_f(void)
             case 't': dump_time(); break;
             case 'd': dump_downloads(); break;
             case 'l': dump_lag(); break;
+            case 'n': dump_netstats(); break;
+            case 'r': dump_raw(); break;
             case 'p': dump_protocols(); break;
             case 's': dump_settings(); break;
+            case 'm': SV_MessagePoolStatus(); break;
             default: dump_versions(); break;
             }
         } else {
@@ -1085,6 +1163,7 @@ void SV_AddMatch_f(list_t *list)
     match->time = 0;
     memcpy(match->comment, s, len + 1);
     List_Append(list, &match->entry);
+    SV_AddressListChanged(list);
 }
 
 void SV_DelMatch_f(list_t *list)
@@ -1110,6 +1189,7 @@ void SV_DelMatch_f(list_t *list)
             Z_Free(match);
         }
         List_Init(list);
+        SV_AddressListChanged(list);
         return;
     }
 
@@ -1137,6 +1217,7 @@ void SV_DelMatch_f(list_t *list)
 remove:
             List_Remove(&match->entry);
             Z_Free(match);
+            SV_AddressListChanged(list);
             return;
         }
     }
@@ -1514,6 +1595,217 @@ static void SV_Stop_f(void)
 
 //===========================================================
 
+#if USE_TESTS
+
+#define GAMEBENCH_FRAMES    1000
+
+/*
+==================
+SV_GameBench_f
+
+Runs game frames back to back and reports the average cost, mostly of
+movers and monsters on the current map. Game time advances with it.
+The checksum of entity positions allows comparing game libraries.
+==================
+*/
+static void SV_GameBench_f(void)
+{
+    unsigned start, msec, hash;
+    const byte *p;
+    edict_t *ent;
+    int i, j, frames;
+
+    if (sv.state != ss_game) {
+        Com_Printf("No map loaded\n");
+        return;
+    }
+
+    frames = GAMEBENCH_FRAMES;
+    if (Cmd_Argc() > 1) {
+        frames = atoi(Cmd_Argv(1));
+        clamp(frames, 1, 100000);
+    }
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < frames; i++) {
+        ge->RunFrame();
+        Z_FrameReset();
+    }
+    msec = Sys_Milliseconds() - start;
+
+    hash = 2166136261u;
+    for (i = 1; i < ge->num_edicts; i++) {
+        ent = EDICT_NUM(i);
+        if (!ent->inuse) {
+            continue;
+        }
+        for (j = 0, p = (const byte *)ent->s.origin; j < sizeof(vec3_t); j++) {
+            hash = (hash ^ p[j]) * 16777619u;
+        }
+    }
+
+    Com_Printf("%d frames, %d edicts, checksum %08x\n", frames, ge->num_edicts, hash);
+    Com_Printf("%u msec, %.1f usec/frame\n", msec, msec * 1000.0f / frames);
+}
+
+#define FSBENCH_NAMES   (MAX_MODELS + MAX_SOUNDS + MAX_IMAGES)
+
+typedef struct {
+    char    name[MAX_QPATH];
+    int     numexts;        // alternatives tried until one is found
+    char    exts[4][8];
+} fsbench_name_t;
+
+// same fallback order the renderer uses when overriding textures
+static const char *const fsbench_image_exts[] = { ".png", ".jpg", ".tga", ".pcx" };
+
+static int fsbench_list(fsbench_name_t *list)
+{
+    fsbench_name_t *n = list;
+    const char *s;
+    int i, j;
+
+    for (i = 1; i < MAX_MODELS; i++) {
+        s = sv.configstrings[CS_MODELS + i];
+        if (!*s) {
+            break;
+        }
+        if (*s == '*' || *s == '#') {
+            continue;   // inline models and view weapons
+        }
+        Q_strlcpy(n->name, s, sizeof(n->name));
+        n->numexts = 1;
+        n->exts[0][0] = 0;
+        n++;
+    }
+
+    for (i = 1; i < MAX_SOUNDS; i++) {
+        s = sv.configstrings[CS_SOUNDS + i];
+        if (!*s) {
+            break;
+        }
+        if (*s == '*') {
+            continue;   // per player sounds
+        }
+        Q_concat(n->name, sizeof(n->name), "sound/", s, NULL);
+        n->numexts = 1;
+        n->exts[0][0] = 0;
+        n++;
+    }
+
+    for (i = 1; i < MAX_IMAGES; i++) {
+        s = sv.configstrings[CS_IMAGES + i];
+        if (!*s) {
+            break;
+        }
+        if (*s == '/' || *s == '\\') {
+            Q_strlcpy(n->name, s + 1, sizeof(n->name));
+        } else {
+            Q_concat(n->name, sizeof(n->name), "pics/", s, NULL);
+        }
+        COM_StripExtension(n->name, n->name, sizeof(n->name));
+        n->numexts = q_countof(fsbench_image_exts);
+        for (j = 0; j < n->numexts; j++) {
+            Q_strlcpy(n->exts[j], fsbench_image_exts[j], sizeof(n->exts[j]));
+        }
+        n++;
+    }
+
+    return n - list;
+}
+
+static void fsbench_run(const char *what, fsbench_name_t *list, int count,
+                        int passes, qboolean load)
+{
+    char buffer[MAX_QPATH];
+    fs_counters_t c1, c2;
+    fsbench_name_t *n;
+    unsigned start, usec;
+    int i, j, k, probes, misses;
+    qhandle_t f;
+    ssize_t ret;
+    void *data;
+
+    probes = misses = 0;
+    FS_GetCounters(&c1);
+    start = Sys_Microseconds();
+    for (k = 0; k < passes; k++) {
+        for (i = 0, n = list; i < count; i++, n++) {
+            for (j = 0; j < n->numexts; j++) {
+                if (Q_concat(buffer, sizeof(buffer), n->name, n->exts[j], NULL) >= sizeof(buffer)) {
+                    continue;
+                }
+                probes++;
+                if (load) {
+                    ret = FS_LoadFileEx(buffer, &data, 0, TAG_FILESYSTEM);
+                    if (data) {
+                        FS_FreeFile(data);
+                    }
+                } else {
+                    ret = FS_FOpenFile(buffer, &f, FS_MODE_READ);
+                    if (f) {
+                        FS_FCloseFile(f);
+                    }
+                }
+                if (ret >= 0) {
+                    break;
+                }
+            }
+            if (j == n->numexts) {
+                misses++;
+            }
+        }
+    }
+    usec = Sys_Microseconds() - start;
+    FS_GetCounters(&c2);
+
+    Com_Printf("%s: %d probes, %d misses, %u usec, %.1f usec/probe\n",
+               what, probes, misses, usec, (float)usec / max(probes, 1));
+    Com_Printf("  %u lookups, %u path compares, %u disk opens, %u reopens, "
+               "%u miss cache hits, %u miss cache adds\n",
+               c2.lookups - c1.lookups, c2.strcmps - c1.strcmps,
+               c2.diskopens - c1.diskopens, c2.reopens - c1.reopens,
+               c2.misshits - c1.misshits, c2.missadds - c1.missadds);
+}
+
+/*
+==================
+SV_FSBench_f
+
+Replays the precache list of the current map through the filesystem,
+trying image extensions in the order the renderer does, and reports
+lookup counts and time spent. Misses are what the client would have to
+download or fail to load.
+==================
+*/
+static void SV_FSBench_f(void)
+{
+    fsbench_name_t *list;
+    int count, passes;
+
+    if (sv.state != ss_game) {
+        Com_Printf("No map loaded\n");
+        return;
+    }
+
+    passes = 1;
+    if (Cmd_Argc() > 1) {
+        passes = atoi(Cmd_Argv(1));
+        clamp(passes, 1, 1000);
+    }
+
+    list = Z_Malloc(sizeof(*list) * FSBENCH_NAMES);
+    count = fsbench_list(list);
+
+    Com_Printf("%d precached files, %d passes\n", count, passes);
+    fsbench_run("FS_LoadFileEx", list, count, passes, qtrue);
+    fsbench_run("FS_FOpenFile", list, count, passes, qfalse);
+
+    Z_Free(list);
+}
+
+#endif
+
 static const cmdreg_t c_server[] = {
     { "heartbeat", SV_Heartbeat_f },
     { "kick", SV_Kick_f, SV_SetPlayer_c },
@@ -1545,6 +1837,7 @@ static const cmdreg_t c_server[] = {
     { "addfiltercmd", SV_AddFilterCmd_f, SV_AddFilterCmd_c },
     { "delfiltercmd", SV_DelFilterCmd_f, SV_DelFilterCmd_c },
     { "listfiltercmds", SV_ListFilterCmds_f },
+    { "areastats", SV_AreaStats_f },
 #if USE_CLIENT
     { "savegame", SV_Savegame_f },
     { "loadgame", SV_Loadgame_f },
@@ -1553,6 +1846,15 @@ static const cmdreg_t c_server[] = {
     { "mvdrecord", SV_Record_f, SV_Record_c },
     { "mvdstop", SV_Stop_f },
 #endif
+#if USE_TESTS
+    { "visbench", SV_VisBench_f },
+    { "tracebench", SV_TraceBench_f },
+    { "areabench", SV_AreaBench_f },
+    { "gamebench", SV_GameBench_f },
+    { "fsbench", SV_FSBench_f },
+    { "matchtest", SV_MatchTest_f },
+#endif
+    { "gameprof", SV_GameProf_f },
 
     { NULL }
 };
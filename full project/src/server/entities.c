@@ -30,11 +30,334 @@ Encode a client frame onto the network channel
 #define Q2PRO_OPTIMIZE(c) \
     ((c)->protocol == PROTOCOL_VERSION_Q2PRO && !(c)->settings[CLS_RECORDING])
 
+/*
+Entity deltas depend on nothing but the two states and the flags, and most
+clients see the same ones each frame: new entities sent from the baseline,
+projectiles and movers deltaed from where they were. Each thread remembers
+the last encoding for every entity number, one slot for forced updates
+from the baseline and one for plain deltas, and copies it out on a match.
+*/
+#define DELTA_CACHE_BYTES   64
+
+typedef struct {
+    entity_packed_t from;
+    entity_packed_t to;
+    msgEsFlags_t    flags;
+    int             len;    // -1 if slot is empty
+    byte            data[DELTA_CACHE_BYTES];
+} deltaslot_t;
+
+/*
+Spectators chasing the same player get identical frames: same player state,
+same entities, and usually the same frame to delta from. The cache also
+keeps the last few frame bodies encoded during the current server frame,
+and a client whose old and new frames, baselines and encoding parameters
+all match one of them gets a copy of its bytes. Entries point at the frames
+of the client that produced them, these stay put until the next frame.
+*/
+#define FRAME_CACHE_SIZE    8
+#define FRAME_CACHE_BYTES   4096
+
+typedef struct {
+    int             protocol;
+    int             version;
+    int             maxclients;
+    qboolean        optimize;
+    msgEsFlags_t    esFlags;
+    msgPsFlags_t    psFlags;
+    int             clientEntityNum;
+    edict_pool_t    *pool;
+} frameparams_t;
+
+typedef struct {
+    unsigned        generation;
+    frameparams_t   params;
+    client_t        *client;
+    client_frame_t  *from, *to;
+    uint32_t        extraflags;
+    size_t          len;
+    byte            data[FRAME_CACHE_BYTES];
+} frameslot_t;
+
+struct deltacache_s {
+    deltaslot_t     slots[MAX_EDICTS * 2];
+    frameslot_t     frames[FRAME_CACHE_SIZE];
+    unsigned        nextframe;
+};
+
+static unsigned                     frame_generation;
+static q_threadlocal deltacache_t   *delta_cache;
+
+deltacache_t *SV_CreateDeltaCache(void)
+{
+    deltacache_t *cache = SV_Malloc(sizeof(*cache));
+    int i;
+
+    for (i = 0; i < MAX_EDICTS * 2; i++) {
+        cache->slots[i].len = -1;
+    }
+    for (i = 0; i < FRAME_CACHE_SIZE; i++) {
+        cache->frames[i].generation = 0;
+    }
+    cache->nextframe = 0;
+
+    return cache;
+}
+
+/*
+=============
+SV_InvalidateFrameCache
+
+Called before writing frames, cached frames refer to the previous ones.
+=============
+*/
+void SV_InvalidateFrameCache(void)
+{
+    frame_generation++;
+}
+
+/*
+=============
+SV_SetDeltaCache
+
+Selects the cache used for entity deltas written by the calling thread.
+=============
+*/
+void SV_SetDeltaCache(deltacache_t *cache)
+{
+    delta_cache = cache;
+}
+
+static void write_delta_entity(const entity_packed_t *from,
+                               const entity_packed_t *to,
+                               msgEsFlags_t flags)
+{
+    deltaslot_t *slot;
+    size_t start, len;
+
+    if (!delta_cache) {
+        MSG_WriteDeltaEntity(from, to, flags);
+        return;
+    }
+
+    slot = &delta_cache->slots[to->number * 2 + !!(flags & MSG_ES_FORCE)];
+    if (slot->len >= 0 && slot->flags == flags &&
+        !memcmp(&slot->to, to, sizeof(*to)) &&
+        !memcmp(&slot->from, from, sizeof(*from))) {
+        MSG_WriteData(slot->data, slot->len);
+        return;
+    }
+
+    start = msg_write.cursize;
+    MSG_WriteDeltaEntity(from, to, flags);
+    len = msg_write.cursize - start;
+
+    if (len > DELTA_CACHE_BYTES) {
+        slot->len = -1;
+        return;
+    }
+
+    slot->from = *from;
+    slot->to = *to;
+    slot->flags = flags;
+    slot->len = len;
+    memcpy(slot->data, msg_write.data + start, len);
+}
+
+static const entity_packed_t *get_baseline(client_t *client, int num)
+{
+    const entity_packed_t *base = client->baselines[num >> SV_BASELINES_SHIFT];
+
+    return base ? base + (num & SV_BASELINES_MASK) : &nullEntityState;
+}
+
+static inline entity_packed_t *frame_entity(const client_frame_t *frame, unsigned index)
+{
+    return &svs.entities[(frame->first_entity + index) % svs.num_entities];
+}
+
+static qboolean same_entities(const client_frame_t *a, const client_frame_t *b)
+{
+    unsigned i;
+
+    if (a->num_entities != b->num_entities) {
+        return qfalse;
+    }
+
+    for (i = 0; i < a->num_entities; i++) {
+        if (memcmp(frame_entity(a, i), frame_entity(b, i), sizeof(entity_packed_t))) {
+            return qfalse;
+        }
+    }
+
+    return qtrue;
+}
+
+static qboolean same_frames(const client_frame_t *a, const client_frame_t *b)
+{
+    if (!a || !b) {
+        return a == b;
+    }
+
+    return a->clientNum == b->clientNum && a->areabytes == b->areabytes &&
+        !memcmp(a->areabits, b->areabits, a->areabytes) &&
+        !memcmp(&a->ps, &b->ps, sizeof(a->ps)) && same_entities(a, b);
+}
+
+// entities missing from the old frame are sent from the baseline, which
+// depends on when the client has received the gamestate
+static qboolean same_baselines(client_t *a, client_t *b,
+                               const client_frame_t *from,
+                               const client_frame_t *to)
+{
+    unsigned oldindex, newindex, from_num_entities;
+    int oldnum, newnum;
+
+    if (a->baselines == b->baselines) {
+        return qtrue;
+    }
+
+    from_num_entities = from ? from->num_entities : 0;
+    oldindex = 0;
+    for (newindex = 0; newindex < to->num_entities; newindex++) {
+        newnum = frame_entity(to, newindex)->number;
+        oldnum = 9999;
+        while (oldindex < from_num_entities) {
+            oldnum = frame_entity(from, oldindex)->number;
+            if (oldnum >= newnum) {
+                break;
+            }
+            oldindex++;
+        }
+        if (oldnum != newnum &&
+            memcmp(get_baseline(a, newnum), get_baseline(b, newnum), sizeof(entity_packed_t))) {
+            return qfalse;
+        }
+    }
+
+    return qtrue;
+}
+
+// first person entity keeps its old origin and angles, these are not sent
+static void fix_first_person(client_t *client, client_frame_t *from,
+                             client_frame_t *to, int clientEntityNum)
+{
+    const entity_packed_t *oldent;
+    entity_packed_t *newent;
+    unsigned i;
+
+    for (i = 0; i < to->num_entities; i++) {
+        newent = frame_entity(to, i);
+        if (newent->number == clientEntityNum) {
+            break;
+        }
+    }
+    if (i == to->num_entities) {
+        return;
+    }
+
+    oldent = get_baseline(client, clientEntityNum);
+    for (i = 0; from && i < from->num_entities; i++) {
+        if (frame_entity(from, i)->number == clientEntityNum) {
+            oldent = frame_entity(from, i);
+            break;
+        }
+    }
+
+    VectorCopy(oldent->origin, newent->origin);
+    VectorCopy(oldent->angles, newent->angles);
+}
+
+static void init_frame_params(frameparams_t *params, client_t *client,
+                              msgPsFlags_t psFlags, int clientEntityNum)
+{
+    memset(params, 0, sizeof(*params));
+    params->protocol = client->protocol;
+    params->version = client->version;
+    params->maxclients = client->maxclients;
+    params->optimize = Q2PRO_OPTIMIZE(client);
+    params->esFlags = client->esFlags;
+    params->psFlags = psFlags;
+    params->clientEntityNum = clientEntityNum;
+    params->pool = client->pool;
+}
+
+static qboolean write_cached_frame(client_t *client, client_frame_t *from,
+                                   client_frame_t *to, const frameparams_t *params,
+                                   size_t limit, uint32_t *extraflags)
+{
+    frameslot_t *slot;
+    int i;
+
+    if (!delta_cache) {
+        return qfalse;
+    }
+
+    for (i = 0, slot = delta_cache->frames; i < FRAME_CACHE_SIZE; i++, slot++) {
+        if (slot->generation == frame_generation &&
+            (!limit || msg_write.cursize + slot->len <= limit) &&
+            !memcmp(&slot->params, params, sizeof(*params)) &&
+            same_frames(slot->to, to) && same_frames(slot->from, from) &&
+            same_baselines(slot->client, client, from, to)) {
+            MSG_WriteData(slot->data, slot->len);
+            *extraflags = slot->extraflags;
+            return qtrue;
+        }
+    }
+
+    return qfalse;
+}
+
+static void cache_frame(client_t *client, client_frame_t *from,
+                        client_frame_t *to, const frameparams_t *params,
+                        size_t start, uint32_t extraflags)
+{
+    frameslot_t *slot;
+    size_t len = msg_write.cursize - start;
+
+    if (!delta_cache || msg_write.overflowed || len > FRAME_CACHE_BYTES) {
+        return;
+    }
+
+    slot = &delta_cache->frames[delta_cache->nextframe++ % FRAME_CACHE_SIZE];
+    slot->generation = frame_generation;
+    slot->params = *params;
+    slot->client = client;
+    slot->from = from;
+    slot->to = to;
+    slot->extraflags = extraflags;
+    slot->len = len;
+    memcpy(slot->data, msg_write.data + start, len);
+}
+
+static msgEsFlags_t entity_flags(client_t *client, int number,
+                                 int clientEntityNum, qboolean newentity)
+{
+    msgEsFlags_t flags = client->esFlags;
+
+    if (newentity) {
+        flags |= MSG_ES_FORCE | MSG_ES_NEWENTITY;
+    } else if (number <= client->maxclients && !Q2PRO_OPTIMIZE(client)) {
+        // note that players are always 'newentities' in compatibility mode,
+        // this updates their oldorigin always and prevents warping
+        flags |= MSG_ES_NEWENTITY;
+    }
+    if (number == clientEntityNum) {
+        flags |= MSG_ES_FIRSTPERSON;
+    }
+    if (Q2PRO_SHORTANGLES(client, number)) {
+        flags |= MSG_ES_SHORTANGLES;
+    }
+
+    return flags;
+}
+
 /*
 =============
 SV_EmitPacketEntities
 
 Writes a delta update of an entity_packed_t list to the message.
+First person entity must already be fixed up with fix_first_person().
 =============
 */
 static void SV_EmitPacketEntities(client_t         *client,
@@ -46,7 +369,6 @@ static void SV_EmitPacketEntities(client_t         *client,
     const entity_packed_t *oldent;
     unsigned i, oldindex, newindex, from_num_entities;
     int oldnum, newnum;
-    msgEsFlags_t flags;
 
     if (!from)
         from_num_entities = 0;
@@ -77,21 +399,8 @@ static void SV_EmitPacketEntities(client_t         *client,
             // delta update from old position
             // because the force parm is false, this will not result
             // in any bytes being emited if the entity has not changed at all
-            // note that players are always 'newentities' in compatibility mode,
-            // this updates their oldorigin always and prevents warping
-            flags = client->esFlags;
-            if (newnum <= client->maxclients && !Q2PRO_OPTIMIZE(client)) {
-                flags |= MSG_ES_NEWENTITY;
-            }
-            if (newnum == clientEntityNum) {
-                flags |= MSG_ES_FIRSTPERSON;
-                VectorCopy(oldent->origin, newent->origin);
-                VectorCopy(oldent->angles, newent->angles);
-            }
-            if (Q2PRO_SHORTANGLES(client, newnum)) {
-                flags |= MSG_ES_SHORTANGLES;
-            }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            write_delta_entity(oldent, newent,
+                               entity_flags(client, newnum, clientEntityNum, qfalse));
             oldindex++;
             newindex++;
             continue;
@@ -99,22 +408,9 @@ static void SV_EmitPacketEntities(client_t         *client,
 
         if (newnum < oldnum) {
             // this is a new entity, send it from the baseline
-            flags = client->esFlags | MSG_ES_FORCE | MSG_ES_NEWENTITY;
-            oldent = client->baselines[newnum >> SV_BASELINES_SHIFT];
-            if (oldent) {
-                oldent += (newnum & SV_BASELINES_MASK);
-            } else {
-                oldent = &nullEntityState;
-            }
-            if (newnum == clientEntityNum) {
-                flags |= MSG_ES_FIRSTPERSON;
-                VectorCopy(oldent->origin, newent->origin);
-                VectorCopy(oldent->angles, newent->angles);
-            }
-            if (Q2PRO_SHORTANGLES(client, newnum)) {
-                flags |= MSG_ES_SHORTANGLES;
-            }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            oldent = get_baseline(client, newnum);
+            write_delta_entity(oldent, newent,
+                               entity_flags(client, newnum, clientEntityNum, qtrue));
             newindex++;
             continue;
         }
@@ -130,7 +426,237 @@ static void SV_EmitPacketEntities(client_t         *client,
     MSG_WriteShort(0);      // end of packetentities
 }
 
-static client_frame_t *get_last_frame(client_t *client)
+/*
+=============================================================================
+
+Entity priority
+
+When a frame doesn't fit the packet, entity updates are ranked and those that
+don't fit are deferred. A deferred update keeps the old state in the new frame
+and a deferred new entity is left out, so the next frame delta encodes them
+again against what the client really has. Removals and the client's own
+entity always go out.
+
+=============================================================================
+*/
+
+typedef struct {
+    unsigned    index;      // in the new frame
+    unsigned    cost;       // encoded bytes
+    int         score;
+    const entity_packed_t *oldent;  // NULL for new entities
+} entprio_t;
+
+#define PRIO_TIER       0x10000
+#define PRIO_AGE        0x800
+
+#define PROJECTILE_EFFECTS \
+    (EF_BLASTER | EF_ROCKET | EF_GRENADE | EF_HYPERBLASTER | EF_BFG | \
+     EF_IONRIPPER | EF_BLUEHYPERBLASTER | EF_PLASMA | EF_TRACKER)
+
+static int entity_score(client_t *client, const client_frame_t *to,
+                        const entity_packed_t *ent)
+{
+    int i, d, dist, score;
+
+    // players first, then projectiles and entities playing events
+    if (ent->number <= client->maxclients)
+        score = 3 * PRIO_TIER;
+    else if (ent->event || (ent->effects & PROJECTILE_EFFECTS))
+        score = 2 * PRIO_TIER;
+    else
+        score = PRIO_TIER;
+
+    // entities that were put off before catch up, so none starves
+    score += client->entity_deferred[ent->number] * PRIO_AGE;
+
+    // closer is more important, both are in 1/8 units
+    dist = 0;
+    for (i = 0; i < 3; i++) {
+        d = ent->origin[i] - to->ps.pmove.origin[i];
+        dist = max(dist, abs(d));
+    }
+
+    return score - (dist >> 3);
+}
+
+static int entprio_cmp(const void *p1, const void *p2)
+{
+    const entprio_t *a = p1, *b = p2;
+
+    if (a->score != b->score)
+        return b->score - a->score;
+    return a->index - b->index;
+}
+
+static unsigned measure_delta_entity(const entity_packed_t *from,
+                                     const entity_packed_t *to,
+                                     msgEsFlags_t flags)
+{
+    size_t start = msg_write.cursize;
+    unsigned cost;
+
+    write_delta_entity(from, to, flags);
+    cost = msg_write.cursize - start;
+    msg_write.cursize = start;
+
+    return cost;
+}
+
+/*
+=============
+truncate_packet_entities
+
+Rewinds the message to the start of packetentities and thins the new frame
+until its entities fit before limit. Returns qfalse if everything must be sent
+anyway.
+=============
+*/
+static qboolean truncate_packet_entities(client_t         *client,
+                                         client_frame_t   *from,
+                                         client_frame_t   *to,
+                                         int              clientEntityNum,
+                                         size_t           start,
+                                         size_t           limit)
+{
+    entprio_t prio[MAX_PACKET_ENTITIES], *p;
+    byte deferred[MAX_PACKET_ENTITIES];
+    entity_packed_t *newent;
+    const entity_packed_t *oldent;
+    unsigned i, j, count, cost, oldindex, newindex, from_num_entities;
+    int oldnum, newnum, ownnum;
+    size_t used;
+
+    if (msg_write.overflowed || to->num_entities > MAX_PACKET_ENTITIES) {
+        return qfalse;
+    }
+
+    msg_write.cursize = start;
+
+    // entity updates are independent of each other, so the frame costs the
+    // sum of its parts plus the end marker
+    ownnum = clientEntityNum ? clientEntityNum : to->clientNum + 1;
+    from_num_entities = from ? from->num_entities : 0;
+    used = 2;
+    count = 0;
+    oldindex = 0;
+    for (newindex = 0; newindex < to->num_entities; newindex++) {
+        newent = frame_entity(to, newindex);
+        newnum = newent->number;
+        oldent = NULL;
+        while (oldindex < from_num_entities) {
+            oldent = frame_entity(from, oldindex);
+            oldnum = oldent->number;
+            if (oldnum >= newnum) {
+                break;
+            }
+            used += measure_delta_entity(oldent, NULL, MSG_ES_FORCE);
+            oldindex++;
+            oldent = NULL;
+        }
+        if (oldent && oldent->number == newnum) {
+            cost = measure_delta_entity(oldent, newent,
+                                        entity_flags(client, newnum, clientEntityNum, qfalse));
+            oldindex++;
+            if (!cost) {
+                continue;
+            }
+        } else {
+            oldent = NULL;
+            cost = measure_delta_entity(get_baseline(client, newnum), newent,
+                                        entity_flags(client, newnum, clientEntityNum, qtrue));
+        }
+        if (newnum == ownnum) {
+            used += cost;
+            continue;
+        }
+        p = &prio[count++];
+        p->index = newindex;
+        p->cost = cost;
+        p->score = entity_score(client, to, newent);
+        p->oldent = oldent;
+    }
+    for (; oldindex < from_num_entities; oldindex++) {
+        used += measure_delta_entity(frame_entity(from, oldindex), NULL, MSG_ES_FORCE);
+    }
+
+    if (start + used > limit) {
+        return qfalse;
+    }
+
+    // pick the most important updates that fit
+    qsort(prio, count, sizeof(prio[0]), entprio_cmp);
+    memset(deferred, 0, sizeof(deferred));
+    for (i = 0, p = prio; i < count; i++, p++) {
+        newent = frame_entity(to, p->index);
+        if (start + used + p->cost <= limit) {
+            used += p->cost;
+            client->entity_deferred[newent->number] = 0;
+            continue;
+        }
+        if (p->oldent) {
+            *newent = *p->oldent;
+        } else {
+            deferred[p->index] = 1;
+        }
+        if (client->entity_deferred[newent->number] < 255) {
+            client->entity_deferred[newent->number]++;
+        }
+        client->total_deferred++;
+    }
+
+    // drop deferred new entities from the frame
+    for (i = j = 0; i < to->num_entities; i++) {
+        if (deferred[i]) {
+            continue;
+        }
+        if (i != j) {
+            *frame_entity(to, j) = *frame_entity(to, i);
+        }
+        j++;
+    }
+    to->num_entities = j;
+
+    client->total_truncated++;
+    return qtrue;
+}
+
+/*
+=============
+write_packet_entities
+
+Emits packetentities, thinning the frame if it ends up past limit (0 means
+no limit).
+=============
+*/
+static void write_packet_entities(client_t         *client,
+                                      client_frame_t   *from,
+                                      client_frame_t   *to,
+                                      int              clientEntityNum,
+                                      size_t           limit)
+{
+    size_t start = msg_write.cursize;
+
+    SV_EmitPacketEntities(client, from, to, clientEntityNum);
+
+    if (!limit || msg_write.cursize <= limit) {
+        return;
+    }
+
+    if (truncate_packet_entities(client, from, to, clientEntityNum, start, limit)) {
+        SV_EmitPacketEntities(client, from, to, clientEntityNum);
+    }
+}
+
+/*
+==================
+SV_GetLastFrame
+
+Returns the frame to delta from, or NULL if the client needs a full update.
+Must be called after entity states for the new frame have been allocated.
+==================
+*/
+client_frame_t *SV_GetLastFrame(client_t *client)
 {
     client_frame_t *frame;
 
@@ -170,17 +696,20 @@ static client_frame_t *get_last_frame(client_t *client)
 SV_WriteFrameToClient_Default
 ==================
 */
-void SV_WriteFrameToClient_Default(client_t *client)
+void SV_WriteFrameToClient_Default(client_t *client, client_frame_t *oldframe)
 {
-    client_frame_t  *frame, *oldframe;
+    client_frame_t  *frame;
     player_packed_t *oldstate;
     int             lastframe;
+    frameparams_t   params;
+    uint32_t        extraflags;
+    size_t          start, limit;
 
     // this is the frame we are creating
     frame = &client->frames[client->framenum & UPDATE_MASK];
+    limit = SV_FrameBudget(client);
 
     // this is the frame we are delta'ing from
-    oldframe = get_last_frame(client);
     if (oldframe) {
         oldstate = &oldframe->ps;
         lastframe = client->lastframe;
@@ -196,6 +725,13 @@ void SV_WriteFrameToClient_Default(client_t *client)
     client->suppress_count = 0;
     client->frameflags = 0;
 
+    // the rest is shared by clients receiving the same frame
+    init_frame_params(&params, client, 0, 0);
+    if (write_cached_frame(client, oldframe, frame, &params, limit, &extraflags)) {
+        return;
+    }
+    start = msg_write.cursize;
+
     // send over the areabits
     MSG_WriteByte(frame->areabytes);
     MSG_WriteData(frame->areabits, frame->areabytes);
@@ -206,7 +742,9 @@ void SV_WriteFrameToClient_Default(client_t *client)
 
     // delta encode the entities
     MSG_WriteByte(svc_packetentities);
-    SV_EmitPacketEntities(client, oldframe, frame, 0);
+    write_packet_entities(client, oldframe, frame, 0, limit);
+
+    cache_frame(client, oldframe, frame, &params, start, 0);
 }
 
 /*
@@ -214,21 +752,23 @@ void SV_WriteFrameToClient_Default(client_t *client)
 SV_WriteFrameToClient_Enhanced
 ==================
 */
-void SV_WriteFrameToClient_Enhanced(client_t *client)
+void SV_WriteFrameToClient_Enhanced(client_t *client, client_frame_t *oldframe)
 {
-    client_frame_t  *frame, *oldframe;
+    client_frame_t  *frame;
     player_packed_t *oldstate;
     uint32_t        extraflags;
     int             delta, suppressed;
     byte            *b1, *b2;
     msgPsFlags_t    psFlags;
     int             clientEntityNum;
+    frameparams_t   params;
+    size_t          start, limit;
 
     // this is the frame we are creating
     frame = &client->frames[client->framenum & UPDATE_MASK];
+    limit = SV_FrameBudget(client);
 
     // this is the frame we are delta'ing from
-    oldframe = get_last_frame(client);
     if (oldframe) {
         oldstate = &oldframe->ps;
         delta = client->framenum - client->lastframe;
@@ -245,10 +785,6 @@ void SV_WriteFrameToClient_Enhanced(client_t *client)
     // second byte to be patched
     b2 = SZ_GetSpace(&msg_write, 1);
 
-    // send over the areabits
-    MSG_WriteByte(frame->areabytes);
-    MSG_WriteData(frame->areabits, frame->areabytes);
-
     // ignore some parts of playerstate if not recording demo
     psFlags = 0;
     if (!client->settings[CLS_RECORDING]) {
@@ -284,6 +820,21 @@ void SV_WriteFrameToClient_Enhanced(client_t *client)
         suppressed = client->suppress_count;
     }
 
+    if (clientEntityNum) {
+        fix_first_person(client, oldframe, frame, clientEntityNum);
+    }
+
+    // the rest is shared by clients receiving the same frame
+    init_frame_params(&params, client, psFlags, clientEntityNum);
+    if (write_cached_frame(client, oldframe, frame, &params, limit, &extraflags)) {
+        goto patch;
+    }
+    start = msg_write.cursize;
+
+    // send over the areabits
+    MSG_WriteByte(frame->areabytes);
+    MSG_WriteData(frame->areabits, frame->areabytes);
+
     // delta encode the playerstate
     extraflags = MSG_WriteDeltaPlayerstate_Enhanced(oldstate, &frame->ps, psFlags);
 
@@ -303,6 +854,12 @@ void SV_WriteFrameToClient_Enhanced(client_t *client)
         }
     }
 
+    // delta encode the entities
+    write_packet_entities(client, oldframe, frame, clientEntityNum, limit);
+
+    cache_frame(client, oldframe, frame, &params, start, extraflags);
+
+patch:
     // save 3 high bits of extraflags
     *b1 = svc_frame | (((extraflags & 0x70) << 1));
 
@@ -312,11 +869,80 @@ void SV_WriteFrameToClient_Enhanced(client_t *client)
 
     client->suppress_count = 0;
     client->frameflags = 0;
+}
 
-    // delta encode the entities
-    SV_EmitPacketEntities(client, oldframe, frame, clientEntityNum);
+#if USE_CLIENT
+/*
+==================
+SV_WriteFrameToClient_Loop
+
+The local client takes the frame straight out of client->frames with
+SV_GetLoopFrame, so only the frame number goes through the loopback queue.
+==================
+*/
+void SV_WriteFrameToClient_Loop(client_t *client, client_frame_t *oldframe)
+{
+    MSG_WriteByte(svc_loopframe);
+    MSG_WriteLong(client->framenum);
+    MSG_WriteByte(client->frameflags & SUPPRESSCOUNT_MASK);
+
+    client->suppress_count = 0;
+    client->frameflags = 0;
 }
 
+static client_t *loop_client(void)
+{
+    client_t *client;
+
+    FOR_EACH_CLIENT(client) {
+        if (client->WriteFrame == SV_WriteFrameToClient_Loop) {
+            return client;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+==================
+SV_GetLoopFrame
+
+Copies out a frame built for the local client. Returns qfalse if it has
+already been overwritten, loopback queue can hold several frames.
+==================
+*/
+qboolean SV_GetLoopFrame(int framenum, loopframe_t *out)
+{
+    client_t        *client = loop_client();
+    client_frame_t  *frame;
+    unsigned        i;
+
+    if (!client) {
+        return qfalse;
+    }
+
+    frame = &client->frames[framenum & UPDATE_MASK];
+    if (frame->number != framenum) {
+        return qfalse;
+    }
+    if (svs.next_entity - frame->first_entity > svs.num_entities) {
+        return qfalse;
+    }
+
+    out->clientNum = frame->clientNum;
+    out->areabytes = frame->areabytes;
+    memcpy(out->areabits, frame->areabits, frame->areabytes);
+    out->oldorigins = !Q2PRO_OPTIMIZE(client);
+    out->ps = frame->ps;
+    out->num_entities = min(frame->num_entities, MAX_PACKET_ENTITIES);
+    for (i = 0; i < out->num_entities; i++) {
+        out->entities[i] = *frame_entity(frame, i);
+    }
+
+    return qtrue;
+}
+#endif
+
 /*
 =============================================================================
 
@@ -370,15 +996,238 @@ fix_old_origin(client_t *client, entity_packed_t *state, edict_t *ent, int e)
 }
 #endif
 
+static inline qboolean entity_sendable(edict_t *ent)
+{
+    // ignore entities not in use
+    if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE))
+        return qfalse;
+
+    // ignore ents without visible models
+    if (ent->svflags & SVF_NOCLIENT)
+        return qfalse;
+
+    // ignore ents without visible models unless they have an effect
+    return ES_INUSE(&ent->s);
+}
+
+/*
+Clients at the same viewpoint (spectators chasing or camping the same spot)
+see the same entities. Remember which ones passed the area and PVS/PHS tests
+for each distinct viewpoint during a frame. Kept per thread so that send
+workers don't need locking, the serial path shares a single memo.
+*/
+#define VIS_MEMO_SIZE   16
+
+typedef struct {
+    unsigned        generation;
+    cm_t            *cm;
+    edict_pool_t    *pool;
+    int             area, cluster;
+    int             numclusters;
+    int             clusters[MAX_FAT_CLUSTERS];
+    byte            visible[MAX_EDICTS >> 3];
+} vismemo_t;
+
+static unsigned                 vis_generation;
+static q_threadlocal vismemo_t  vis_memo[VIS_MEMO_SIZE];
+static q_threadlocal unsigned   vis_memo_next;
+
+/*
+=============
+SV_InvalidateVisMemo
+
+Called before building frames, entities may have changed since the last time.
+=============
+*/
+void SV_InvalidateVisMemo(void)
+{
+    vis_generation++;
+}
+
+/*
+=============
+SV_RefreshEdictVis
+
+Summarizes what visible_entities needs to know about each edict of the
+client's pool into its edict_vis_t array, once per frame and array.
+Must be called from the main thread before the client's frame is built.
+Slot 0 belongs to the world, which is never sent, and remembers the
+generation the array was refreshed for.
+=============
+*/
+void SV_RefreshEdictVis(client_t *client)
+{
+    edict_vis_t *vis = client->entvis;
+    edict_t     *ent;
+    unsigned    flags;
+    int         e;
+
+    if (vis[0].generation == vis_generation)
+        return;
+
+    vis[0].generation = vis_generation;
+
+    for (e = 1, vis++; e < client->pool->num_edicts; e++, vis++) {
+        ent = EDICT_POOL(client, e);
+
+        flags = EVIS_VALID;
+        if (entity_sendable(ent))
+            flags |= EVIS_SENDABLE;
+        if (ent->s.renderfx & RF_BEAM)
+            flags |= EVIS_BEAM;
+
+        // the game may have touched these behind SV_LinkEdict's back
+        if (vis->num_clusters != ent->num_clusters ||
+            vis->cluster != ent->clusternums[0] ||
+            vis->areanum != ent->areanum || vis->areanum2 != ent->areanum2)
+            flags = 0;
+
+        vis->flags = flags;
+    }
+}
+
+// same as below, for edicts that SV_RefreshEdictVis couldn't summarize
+static qboolean edict_visible(client_t *client, edict_t *ent, int e, int area,
+                              const byte *clientpvs, const byte *clientphs)
+{
+    if (!entity_sendable(ent))
+        return qfalse;
+
+    if (sv_novis->integer)
+        return qtrue;
+
+    // check area
+    if (!CM_AreasConnected(client->cm, area, ent->areanum)) {
+        // doors can legally straddle two areas, so
+        // we may need to check another one
+        if (!CM_AreasConnected(client->cm, area, ent->areanum2)) {
+            return qfalse;        // blocked by a door
+        }
+    }
+
+    // beams just check one point for PHS
+    if (ent->s.renderfx & RF_BEAM)
+        return Q_IsBitSet(clientphs, ent->clusternums[0]);
+
+    return SV_EdictIsVisible(client->cm, ent, &client->entvis[e], (byte *)clientpvs);
+}
+
+static vismemo_t *find_vis_memo(client_t *client, int area, int cluster,
+                                const int *clusters, int numclusters)
+{
+    vismemo_t *memo;
+    int i;
+
+    for (i = 0, memo = vis_memo; i < VIS_MEMO_SIZE; i++, memo++) {
+        if (memo->generation == vis_generation &&
+            memo->cm == client->cm && memo->pool == client->pool &&
+            memo->area == area && memo->cluster == cluster &&
+            memo->numclusters == numclusters &&
+            !memcmp(memo->clusters, clusters, sizeof(clusters[0]) * numclusters)) {
+            return memo;
+        }
+    }
+
+    return NULL;
+}
+
+static const byte *visible_entities(client_t *client, const vec3_t org,
+                                    int area, int cluster)
+{
+    int         clusters[MAX_FAT_CLUSTERS];
+    int         e, numclusters;
+    byte        *clientphs;
+    byte        *clientpvs;
+    size_t      rowsize;
+    vismemo_t   *memo;
+    edict_t     *ent;
+    const edict_vis_t *vis;
+    qboolean    valid;
+
+    numclusters = CM_FatClusters(client->cm, org, clusters);
+
+    memo = find_vis_memo(client, area, cluster, clusters, numclusters);
+    if (memo) {
+        return memo->visible;
+    }
+
+    memo = &vis_memo[vis_memo_next++ % VIS_MEMO_SIZE];
+    memo->generation = vis_generation;
+    memo->cm = client->cm;
+    memo->pool = client->pool;
+    memo->area = area;
+    memo->cluster = cluster;
+    memo->numclusters = numclusters;
+    memcpy(memo->clusters, clusters, sizeof(clusters[0]) * numclusters);
+    memset(memo->visible, 0, sizeof(memo->visible));
+
+    // only a row of the loaded map is touched, except when it has no vis
+    if (client->cm->cache && client->cm->cache->vis) {
+        rowsize = VIS_FAST_LONGS(client->cm->cache) * sizeof(uint_fast32_t);
+    } else {
+        rowsize = VIS_MAX_BYTES;
+    }
+    clientpvs = Z_FrameAlloc(rowsize);
+    clientphs = Z_FrameAlloc(rowsize);
+
+    CM_ClustersPVS(client->cm, clientpvs, clusters, numclusters);
+    BSP_ClusterVis(client->cm->cache, clientphs, cluster, DVIS_PHS);
+
+    // most entities are rejected by looking at their edict_vis_t only
+    valid = client->entvis[0].generation == vis_generation;
+
+    for (e = 1, vis = client->entvis + 1; e < client->pool->num_edicts; e++, vis++) {
+        if (!valid || !(vis->flags & EVIS_VALID)) {
+            ent = EDICT_POOL(client, e);
+            if (edict_visible(client, ent, e, area, clientpvs, clientphs))
+                Q_SetBit(memo->visible, e);
+            continue;
+        }
+
+        if (!(vis->flags & EVIS_SENDABLE))
+            continue;
+
+        // ignore if not touching a PV leaf
+        if (!sv_novis->integer) {
+            // check area
+            if (!CM_AreasConnected(client->cm, area, vis->areanum)) {
+                // doors can legally straddle two areas, so
+                // we may need to check another one
+                if (!CM_AreasConnected(client->cm, area, vis->areanum2)) {
+                    continue;        // blocked by a door
+                }
+            }
+
+            // beams just check one point for PHS
+            if (vis->flags & EVIS_BEAM) {
+                if (!Q_IsBitSet(clientphs, vis->cluster))
+                    continue;
+            } else if (vis->base != -1) {
+                if (!SV_EdictWindowVisible(vis, clientpvs))
+                    continue;
+            } else {
+                ent = EDICT_POOL(client, e);
+                if (!SV_EdictIsVisible(client->cm, ent, vis, clientpvs))
+                    continue;
+            }
+        }
+
+        Q_SetBit(memo->visible, e);
+    }
+
+    return memo->visible;
+}
+
 /*
 =============
 SV_BuildClientFrame
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+copies off the playerstat and areabits. Entity states are stored at
+first_entity onwards, returns the number of states used.
 =============
 */
-void SV_BuildClientFrame(client_t *client)
+unsigned SV_BuildClientFrame(client_t *client, unsigned first_entity)
 {
     int         e;
     vec3_t      org;
@@ -387,15 +1236,13 @@ void SV_BuildClientFrame(client_t *client)
     client_frame_t  *frame;
     entity_packed_t *state;
     player_state_t  *ps;
-    int         l;
     int         clientarea, clientcluster;
     mleaf_t     *leaf;
-    byte        clientphs[VIS_MAX_BYTES];
-    byte        clientpvs[VIS_MAX_BYTES];
+    const byte  *visible;
 
     clent = client->edict;
     if (!clent->client)
-        return;        // not in game yet
+        return 0;      // not in game yet
 
     // this is the frame we are creating
     frame = &client->frames[client->framenum & UPDATE_MASK];
@@ -430,71 +1277,42 @@ void SV_BuildClientFrame(client_t *client)
         frame->clientNum = client->number;
     }
 
-    CM_FatPVS(client->cm, clientpvs, org);
-    BSP_ClusterVis(client->cm->cache, clientphs, clientcluster, DVIS_PHS);
+    visible = visible_entities(client, org, clientarea, clientcluster);
 
     // build up the list of visible entities
     frame->num_entities = 0;
-    frame->first_entity = svs.next_entity;
+    frame->first_entity = first_entity;
 
     for (e = 1; e < client->pool->num_edicts; e++) {
         ent = EDICT_POOL(client, e);
 
-        // ignore entities not in use
-        if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE)) {
+        if (ent == clent) {
+            // player's own entity is always visible
+            if (!entity_sendable(ent))
+                continue;
+        } else if (!Q_IsBitSet(visible, e)) {
             continue;
         }
 
-        // ignore ents without visible models
-        if (ent->svflags & SVF_NOCLIENT)
+        if (ent->s.event == EV_FOOTSTEP && client->settings[CLS_NOFOOTSTEPS] &&
+            !ent->s.modelindex && !ent->s.effects && !ent->s.sound) {
             continue;
-
-        // ignore ents without visible models unless they have an effect
-        if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound) {
-            if (!ent->s.event) {
-                continue;
-            }
-            if (ent->s.event == EV_FOOTSTEP && client->settings[CLS_NOFOOTSTEPS]) {
-                continue;
-            }
         }
 
         if ((ent->s.effects & EF_GIB) && client->settings[CLS_NOGIBS]) {
             continue;
         }
 
-        // ignore if not touching a PV leaf
-        if (ent != clent && !sv_novis->integer) {
-            // check area
-            if (!CM_AreasConnected(client->cm, clientarea, ent->areanum)) {
-                // doors can legally straddle two areas, so
-                // we may need to check another one
-                if (!CM_AreasConnected(client->cm, clientarea, ent->areanum2)) {
-                    continue;        // blocked by a door
-                }
-            }
+        // don't send sounds if they will be attenuated away
+        if (ent != clent && !sv_novis->integer && !ent->s.modelindex &&
+            !(ent->s.renderfx & RF_BEAM)) {
+            vec3_t    delta;
+            float    len;
 
-            // beams just check one point for PHS
-            if (ent->s.renderfx & RF_BEAM) {
-                l = ent->clusternums[0];
-                if (!Q_IsBitSet(clientphs, l))
-                    continue;
-            } else {
-                if (!SV_EdictIsVisible(client->cm, ent, clientpvs)) {
-                    continue;
-                }
-
-                if (!ent->s.modelindex) {
-                    // don't send sounds if they will be attenuated away
-                    vec3_t    delta;
-                    float    len;
-
-                    VectorSubtract(org, ent->s.origin, delta);
-                    len = VectorLength(delta);
-                    if (len > 400)
-                        continue;
-                }
-            }
+            VectorSubtract(org, ent->s.origin, delta);
+            len = VectorLength(delta);
+            if (len > 400)
+                continue;
         }
 
         if (ent->s.number != e) {
@@ -504,7 +1322,7 @@ void SV_BuildClientFrame(client_t *client)
         }
 
         // add it to the circular client_entities array
-        state = &svs.entities[svs.next_entity % svs.num_entities];
+        state = &svs.entities[(first_entity + frame->num_entities) % svs.num_entities];
         MSG_PackEntity(state, &ent->s, Q2PRO_SHORTANGLES(client, e));
 
 #if USE_FPS
@@ -539,11 +1357,38 @@ void SV_BuildClientFrame(client_t *client)
             state->solid = sv.entities[e].solid32;
         }
 
-        svs.next_entity++;
-
         if (++frame->num_entities == MAX_PACKET_ENTITIES) {
             break;
         }
     }
+
+    return frame->num_entities;
+}
+
+/*
+=============
+SV_FixEntityNumbers
+
+SV_BuildClientFrame does this for visible entities, but it can't print
+when running on a send worker. Fix up all of them in advance instead.
+=============
+*/
+void SV_FixEntityNumbers(edict_pool_t *pool)
+{
+    edict_t *ent;
+    int     e;
+
+    for (e = 1; e < pool->num_edicts; e++) {
+        ent = (edict_t *)((byte *)pool->edicts + pool->edict_size * e);
+
+        if (!entity_sendable(ent))
+            continue;
+
+        if (ent->s.number != e) {
+            Com_WPrintf("%s: fixing ent->s.number: %d to %d\n",
+                        __func__, ent->s.number, e);
+            ent->s.number = e;
+        }
+    }
 }
 
@@ -87,6 +87,10 @@ static void PF_Unicast(edict_t *ent, qboolean reliable)
         goto clear;
     }
 
+    if (reliable) {
+        SV_FlushConfigstrings();
+    }
+
     clientNum = NUM_FOR_EDICT(ent) - 1;
     if (clientNum < 0 || clientNum >= sv_maxclients->integer) {
         Com_WPrintf("%s to a non-client %d\n", __func__, clientNum);
@@ -333,14 +337,13 @@ static void PF_setmodel(edict_t *ent, const char *name)
 ===============
 PF_configstring
 
-If game is actively running, broadcasts configstring change.
+If game is actively running, queues configstring change for broadcast.
 Archived in MVD stream.
 ===============
 */
 static void PF_configstring(int index, const char *val)
 {
     size_t len, maxlen;
-    client_t *client;
     char *dst;
 
     if (index < 0 || index >= MAX_CONFIGSTRINGS)
@@ -385,22 +388,153 @@ static void PF_configstring(int index, const char *val)
         return;
     }
 
-    SV_MvdConfigstring(index, val, len);
+    // sent with the last value at the end of the frame
+    if (!Q_IsBitSet(sv.pendingcs, index)) {
+        Q_SetBit(sv.pendingcs, index);
+        sv.numpendingcs++;
+    }
+}
+
+/*
+Pending configstring changes go out as one batch of svc_configstring
+commands, split to fit each client's packet length. Clients that support
+compression get the batch as a single zpacket when that is smaller; it is
+deflated at most once per dictionary setting.
+*/
 
-    // send the update to everyone
-    MSG_WriteByte(svc_configstring);
-    MSG_WriteShort(index);
-    MSG_WriteData(val, len);
-    MSG_WriteByte(0);
+#define CS_BATCH_SIZE   4096
+#define CS_BATCH_MAX    (CS_BATCH_SIZE + MAX_QPATH * (CS_AIRACCEL - CS_STATUSBAR) + 4)
 
-    FOR_EACH_CLIENT(client) {
-        if (client->state < cs_primed) {
-            continue;
+static byte     cs_batch[CS_BATCH_MAX];
+static size_t   cs_offsets[CS_BATCH_SIZE / 4 + 2];
+
+#if USE_ZLIB
+static byte     cs_zbatch[2][CS_BATCH_MAX + 64];
+static size_t   cs_zbatchlen[2];
+static qboolean cs_zdone[2];
+
+// returns the zpacket for the batch, or 0 if compression failed
+static size_t deflate_batch(size_t len, qboolean zdict)
+{
+    byte *out = cs_zbatch[zdict];
+    size_t outlen;
+
+    if (cs_zdone[zdict]) {
+        return cs_zbatchlen[zdict];
+    }
+    cs_zdone[zdict] = qtrue;
+    cs_zbatchlen[zdict] = 0;
+
+    deflateReset(&svs.z);
+    if (zdict) {
+        deflateSetDictionary(&svs.z, (const Bytef *)zdict_data, (uInt)zdict_size);
+    }
+    svs.z.next_in = cs_batch;
+    svs.z.avail_in = (uInt)len;
+    svs.z.next_out = out + 5;
+    svs.z.avail_out = (uInt)(sizeof(cs_zbatch[0]) - 5);
+    if (deflate(&svs.z, Z_FINISH) != Z_STREAM_END) {
+        return 0;
+    }
+
+    outlen = svs.z.total_out;
+    out[0] = svc_zpacket;
+    out[1] = outlen & 255;
+    out[2] = (outlen >> 8) & 255;
+    out[3] = len & 255;
+    out[4] = (len >> 8) & 255;
+
+    cs_zbatchlen[zdict] = outlen + 5;
+    return outlen + 5;
+}
+#endif
+
+static void send_batch(client_t *client, int count)
+{
+    size_t maxlen = client->netchan->maxpacketlen;
+    int start, end;
+
+#if USE_ZLIB
+    if (client->has_zlib && count > 1) {
+        qboolean zdict = client->protocol == PROTOCOL_VERSION_Q2PRO &&
+            client->version >= PROTOCOL_VERSION_Q2PRO_ZLIB_DICT;
+        size_t len = deflate_batch(cs_offsets[count], zdict);
+
+        if (len && len < cs_offsets[count] && len <= maxlen) {
+            client->AddMessage(client, cs_zbatch[zdict], len, qtrue);
+            return;
         }
-        SV_ClientAddMessage(client, MSG_RELIABLE);
     }
+#endif
 
-    SZ_Clear(&msg_write);
+    for (start = 0; start < count; start = end) {
+        end = start + 1;
+        while (end < count && cs_offsets[end + 1] - cs_offsets[start] <= maxlen) {
+            end++;
+        }
+        client->AddMessage(client, cs_batch + cs_offsets[start],
+                           cs_offsets[end] - cs_offsets[start], qtrue);
+    }
+}
+
+/*
+===============
+SV_FlushConfigstrings
+
+Broadcasts configstring changes queued since the last call. Called at the
+end of the game frame and before reliable game messages, which may refer
+to new indices.
+===============
+*/
+void SV_FlushConfigstrings(void)
+{
+    client_t *client;
+    sizebuf_t batch;
+    size_t len;
+    char *string;
+    int i, count;
+
+    for (i = 0; sv.numpendingcs > 0; ) {
+        SZ_Init(&batch, cs_batch, sizeof(cs_batch));
+        count = 0;
+
+        for (; i < MAX_CONFIGSTRINGS && batch.cursize < CS_BATCH_SIZE; i++) {
+            if (!Q_IsBitSet(sv.pendingcs, i)) {
+                continue;
+            }
+            Q_ClearBit(sv.pendingcs, i);
+            sv.numpendingcs--;
+
+            string = sv.configstrings[i];
+            len = strlen(string);
+
+            SV_MvdConfigstring(i, string, len);
+
+            cs_offsets[count++] = batch.cursize;
+            SZ_WriteByte(&batch, svc_configstring);
+            SZ_WriteShort(&batch, i);
+            SZ_Write(&batch, string, len);
+            SZ_WriteByte(&batch, 0);
+        }
+        cs_offsets[count] = batch.cursize;
+
+        if (!count) {
+            // counter out of sync with the bits, can't happen
+            sv.numpendingcs = 0;
+            break;
+        }
+
+#if USE_ZLIB
+        cs_zdone[0] = cs_zdone[1] = qfalse;
+#endif
+
+        FOR_EACH_CLIENT(client) {
+            if (client->state < cs_primed) {
+                continue;
+            }
+            send_batch(client, count);
+        }
+    }
 }
 
 static void PF_WriteFloat(float f)
@@ -558,7 +692,7 @@ static void PF_StartSound(edict_t *edict, int channel,
                 }
             }
             BSP_ClusterVis(sv.cm.cache, mask, leaf->cluster, DVIS_PHS);
-            if (!SV_EdictIsVisible(&sv.cm, edict, mask)) {
+            if (!SV_EdictIsVisible(&sv.cm, edict, &sv.entvis[NUM_FOR_EDICT(edict)], mask)) {
                 continue; // not in PHS
             }
         }
@@ -592,7 +726,8 @@ static void PF_StartSound(edict_t *edict, int channel,
             continue;
         }
 
-        if (LIST_EMPTY(&client->msg_free_list)) {
+        msg = SV_AllocSoundPacket(client);
+        if (!msg) {
             Com_WPrintf("%s: %s: out of message slots\n",
                         __func__, client->name);
             continue;
@@ -608,8 +743,6 @@ static void PF_StartSound(edict_t *edict, int channel,
             flags |= SND_POS;
         }
 
-        msg = LIST_FIRST(message_packet_t, &client->msg_free_list, entry);
-
         msg->cursize = 0;
         msg->flags = flags;
         msg->index = soundindex;
@@ -621,7 +754,6 @@ static void PF_StartSound(edict_t *edict, int channel,
             msg->pos[i] = origin[i] * 8;
         }
 
-        List_Remove(&msg->entry);
         List_Append(&client->msg_unreliable_list, &msg->entry);
         client->msg_unreliable_bytes += MAX_SOUND_PACKET;
 
@@ -689,13 +821,70 @@ static void PF_PositionedSound(vec3_t origin, edict_t *entity, int channel,
 }
 
 
+// set while PF_PmoveMask asks the game how it traces
+static struct {
+    qboolean    active;
+    int         count;
+    edict_t     *passent;
+    int         contentmask;
+} pm_learn;
+
+static trace_t q_gameabi PF_trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
+                                  edict_t *passedict, int contentmask)
+{
+    if (pm_learn.active) {
+        pm_learn.count++;
+        pm_learn.passent = passedict;
+        pm_learn.contentmask = contentmask;
+    }
+    return SV_Trace(start, mins, maxs, end, passedict, contentmask);
+}
+
+/*
+===============
+PF_PmoveMask
+
+Makes the game trace callback clip a point in place to learn the content
+mask it passes to gi.trace. Moves can only be run ahead if the callback
+does nothing more than that, with the player as the entity to skip.
+Returns 0 if that doesn't seem to be the case.
+===============
+*/
+static int PF_PmoveMask(pmove_t *pm)
+{
+    vec3_t origin, size;
+
+    if (pm->pointcontents != SV_PointContents || !pm->trace)
+        return 0;
+
+    VectorScale(pm->s.origin, 0.125f, origin);
+    VectorClear(size);
+
+    pm_learn.active = qtrue;
+    pm_learn.count = 0;
+    pm->trace(origin, size, size, origin);
+    pm_learn.active = qfalse;
+
+    if (pm_learn.count != 1 || pm_learn.passent != sv_player)
+        return 0;
+
+    return pm_learn.contentmask;
+}
+
 void PF_Pmove(pmove_t *pm)
 {
-    if (sv_client) {
-        Pmove(pm, &sv_client->pmp);
-    } else {
+    if (!sv_client) {
         Pmove(pm, &sv_pmp);
+        return;
     }
+
+    if (sv_parallel_pmove->integer) {
+        sv_client->pmove_mask = PF_PmoveMask(pm);
+        if (SV_ReplayPmove(pm, sv_client->pmove_mask))
+            return;
+    }
+
+    Pmove(pm, &sv_client->pmp);
 }
 
 static cvar_t *PF_cvar(const char *name, const char *value, int flags)
@@ -757,6 +946,190 @@ static void PF_DebugGraph(float value, int color)
 
 //==============================================
 
+/*
+===============================================================================
+
+GAME PROFILER
+
+Named zones timed by the game through ProfileBegin/ProfileEnd, and by the
+server around calls into the game. Totals are kept over sv_gameprof frames,
+the last complete window is reported by 'gameprof'. Zone names are copied,
+since the game library may go away while the table is still around.
+
+===============================================================================
+*/
+
+#define MAX_PROF_ZONES  64
+#define MAX_PROF_DEPTH  16
+
+typedef struct {
+    const char  *key;
+    char        name[32];
+    unsigned    calls;
+    unsigned    maxusec;
+    uint64_t    usec;
+} profzone_t;
+
+static struct {
+    profzone_t  zones[MAX_PROF_ZONES];
+    int         numzones;
+    int         frames;
+
+    profzone_t  last[MAX_PROF_ZONES];
+    int         numlast;
+    int         lastframes;
+
+    struct {
+        profzone_t  *zone;
+        unsigned    start;
+    } stack[MAX_PROF_DEPTH];
+    int         depth;
+} prof;
+
+static profzone_t *find_zone(const char *name)
+{
+    profzone_t *z;
+    int i;
+
+    for (i = 0, z = prof.zones; i < prof.numzones; i++, z++)
+        if (z->key == name)
+            return z;
+
+    for (i = 0, z = prof.zones; i < prof.numzones; i++, z++) {
+        if (!strcmp(z->name, name)) {
+            z->key = name;
+            return z;
+        }
+    }
+
+    if (prof.numzones == MAX_PROF_ZONES)
+        return NULL;
+
+    z = &prof.zones[prof.numzones++];
+    z->key = name;
+    Q_strlcpy(z->name, name, sizeof(z->name));
+    return z;
+}
+
+void SV_ProfileBegin(const char *name)
+{
+    if (!sv_gameprof->integer || !name)
+        return;
+
+    if (prof.depth == MAX_PROF_DEPTH) {
+        Com_DPrintf("%s: %s: too deep\n", __func__, name);
+        return;
+    }
+
+    prof.stack[prof.depth].zone = find_zone(name);
+    prof.stack[prof.depth].start = Sys_Microseconds();
+    prof.depth++;
+}
+
+void SV_ProfileEnd(const char *name)
+{
+    profzone_t *z;
+    unsigned usec;
+
+    if (!sv_gameprof->integer || !name || !prof.depth)
+        return;
+
+    z = prof.stack[prof.depth - 1].zone;
+    if (z && z->key != name && strcmp(z->name, name)) {
+        Com_DPrintf("%s: %s: doesn't match %s\n", __func__, name, z->name);
+        return;
+    }
+
+    prof.depth--;
+    if (!z)
+        return;
+
+    usec = Sys_Microseconds() - prof.stack[prof.depth].start;
+    z->calls++;
+    z->usec += usec;
+    z->maxusec = max(z->maxusec, usec);
+}
+
+/*
+===============
+SV_ProfileFrame
+
+Called after each game frame to close the window when it is full.
+===============
+*/
+void SV_ProfileFrame(void)
+{
+    int i;
+
+    if (!sv_gameprof->integer)
+        return;
+
+    if (prof.depth) {
+        Com_DPrintf("%s: %d zones left open\n", __func__, prof.depth);
+        prof.depth = 0;
+    }
+
+    if (++prof.frames < sv_gameprof->integer)
+        return;
+
+    memcpy(prof.last, prof.zones, sizeof(prof.last));
+    prof.numlast = prof.numzones;
+    prof.lastframes = prof.frames;
+
+    for (i = 0; i < prof.numzones; i++) {
+        prof.zones[i].calls = 0;
+        prof.zones[i].usec = 0;
+        prof.zones[i].maxusec = 0;
+    }
+    prof.frames = 0;
+}
+
+static void SV_ClearProfile(void)
+{
+    memset(&prof, 0, sizeof(prof));
+}
+
+static int zonecmp(const void *p1, const void *p2)
+{
+    const profzone_t *z1 = p1;
+    const profzone_t *z2 = p2;
+
+    return z1->usec < z2->usec ? 1 : z1->usec > z2->usec ? -1 : 0;
+}
+
+void SV_GameProf_f(void)
+{
+    profzone_t zones[MAX_PROF_ZONES], *z;
+    int i;
+
+    if (!sv_gameprof->integer) {
+        Com_Printf("Game profiler is disabled, set sv_gameprof to enable.\n");
+        return;
+    }
+
+    if (!prof.lastframes) {
+        Com_Printf("No complete window of %d frames yet.\n", sv_gameprof->integer);
+        return;
+    }
+
+    memcpy(zones, prof.last, sizeof(zones[0]) * prof.numlast);
+    qsort(zones, prof.numlast, sizeof(zones[0]), zonecmp);
+
+    Com_Printf("Last %d frames:\n"
+               "zone                              calls  usec/frame  usec/call    max\n"
+               "-------------------------------- ------- ---------- ---------- ------\n",
+               prof.lastframes);
+    for (i = 0, z = zones; i < prof.numlast; i++, z++) {
+        if (!z->calls)
+            continue;
+        Com_Printf("%-32s %7u %10.1f %10.1f %6u\n", z->name, z->calls,
+                   (double)z->usec / prof.lastframes,
+                   (double)z->usec / z->calls, z->maxusec);
+    }
+}
+
+//==============================================
+
 static void *game_library;
 
 /*
@@ -778,6 +1151,7 @@ void SV_ShutdownGameProgs(void)
         game_library = NULL;
     }
     Cvar_Set("g_features", "0");
+    SV_ClearProfile();
 }
 
 static void *_SV_LoadGameLibrary(const char *path)
@@ -864,7 +1238,11 @@ void SV_InitGameProgs(void)
     import.linkentity = PF_LinkEdict;
     import.unlinkentity = PF_UnlinkEdict;
     import.BoxEdicts = SV_AreaEdicts;
-    import.trace = SV_Trace;
+    import.trace = PF_trace;
+    import.BoxTraces = SV_BoxTraces;
+    import.PrefetchTraces = SV_PrefetchTraces;
+    import.ProfileBegin = SV_ProfileBegin;
+    import.ProfileEnd = SV_ProfileEnd;
     import.pointcontents = SV_PointContents;
     import.setmodel = PF_setmodel;
     import.inPVS = PF_inPVS;
@@ -35,6 +35,8 @@ void SV_ClientReset(client_t *client)
     client->send_delta = 0;
     client->suppress_count = 0;
     memset(&client->lastcmd, 0, sizeof(client->lastcmd));
+
+    SV_ScheduleAsync(client);
 }
 
 #if USE_FPS
@@ -163,6 +165,7 @@ void SV_SpawnServer(cm_t *cm, const char *server, const char *spawnpoint)
     memset(&sv, 0, sizeof(sv));
     sv.spawncount = (rand() | (rand() << 16)) ^ Sys_Milliseconds();
     sv.spawncount &= 0x7FFFFFFF;
+    SV_InvalidateMulticast();
 
     // set legacy spawncounts
     FOR_EACH_CLIENT(client) {
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "server.h"
 #include "client/input.h"
+#include "system/thread.h"
 
 pmoveParams_t   sv_pmp;
 
@@ -51,6 +52,12 @@ cvar_t  *sv_show_name_changes;
 cvar_t  *sv_airaccelerate;
 cvar_t  *sv_qwmod;              // atu QW Physics modificator
 cvar_t  *sv_novis;
+cvar_t  *sv_area_depth;
+cvar_t  *sv_trace_cache;
+cvar_t  *sv_send_threads;
+cvar_t  *sv_trace_threads;
+cvar_t  *sv_parallel_pmove;
+cvar_t  *sv_gameprof;
 
 cvar_t  *sv_maxclients;
 cvar_t  *sv_reserved_slots;
@@ -68,6 +75,16 @@ cvar_t  *sv_pad_packets;
 #endif
 cvar_t  *sv_lan_force_rate;
 cvar_t  *sv_calcpings_method;
+cvar_t  *sv_latency_stats;
+cvar_t  *sv_adaptive_rate;
+#if USE_ZLIB
+cvar_t  *sv_download_window;
+#endif
+cvar_t  *sv_spectator_snapdiv;
+cvar_t  *sv_entity_priority;
+#if USE_CLIENT
+cvar_t  *sv_loop_handoff;
+#endif
 cvar_t  *sv_changemapcmd;
 
 cvar_t  *sv_strafejump_hack;
@@ -99,7 +116,7 @@ qboolean sv_registered;
 
 void SV_RemoveClient(client_t *client)
 {
-    if (client->msg_pool) {
+    if (client->msg_active) {
         SV_ShutdownClientSend(client);
     }
 
@@ -111,6 +128,7 @@ void SV_RemoveClient(client_t *client)
     // unlink them from active client list, but don't clear the list entry
     // itself to make code that traverses client list in a loop happy!
     List_Remove(&client->entry);
+    SV_InvalidateMulticast();
 
 #if USE_MVD_CLIENT
     // unlink them from MVD client list
@@ -153,6 +171,11 @@ void SV_CleanClient(client_t *client)
             client->baselines[i] = NULL;
         }
     }
+
+    if (client->latstats) {
+        Z_Free(client->latstats);
+        client->latstats = NULL;
+    }
 }
 
 static void print_drop_reason(client_t *client, const char *reason, clstate_t oldstate)
@@ -212,6 +235,7 @@ void SV_DropClient(client_t *client, const char *reason)
     oldstate = client->state;
     client->state = cs_zombie;        // become free in a few seconds
     client->lastmessage = svs.realtime;
+    client->num_pending_moves = 0;
 
     // print the reason
     if (reason)
@@ -255,10 +279,10 @@ Implements simple token bucket filter. Inspired by xt_limit.c from the Linux
 kernel. Returns true if limit is exceeded.
 ===============
 */
-qboolean SV_RateLimited(ratelimit_t *r)
+static qboolean rate_limited(ratelimit_t *r, unsigned time)
 {
-    r->credit += (svs.realtime - r->time) * CREDITS_PER_MSEC;
-    r->time = svs.realtime;
+    r->credit += (time - r->time) * CREDITS_PER_MSEC;
+    r->time = time;
     if (r->credit > r->credit_cap)
         r->credit = r->credit_cap;
 
@@ -270,6 +294,11 @@ qboolean SV_RateLimited(ratelimit_t *r)
     return qtrue;
 }
 
+qboolean SV_RateLimited(ratelimit_t *r)
+{
+    return rate_limited(r, svs.realtime);
+}
+
 /*
 ===============
 SV_RateRecharge
@@ -360,21 +389,324 @@ void SV_RateInit(ratelimit_t *r, const char *s)
     r->cost = rate2credits(rate);
 }
 
-addrmatch_t *SV_MatchAddress(list_t *list, netadr_t *addr)
+/*
+==============================================================================
+
+ADDRESS MATCHING
+
+Address lists are matched through a path compressed binary trie of their
+prefixes, rebuilt on the first lookup after the list has changed. Each node
+remembers the earliest list entry with exactly its prefix, and lookup picks
+the earliest of all prefixes covering the address, so the entry found is
+the same a linear scan would find. Keys are host order IPv4 addresses, a
+wider key type extends this to IPv6.
+
+==============================================================================
+*/
+
+#define MAX_ADDR_TRIES  8
+
+typedef struct {
+    uint32_t    key;        // prefix bits, rest zero
+    int         bits;       // prefix length
+    int         index;      // list position of match
+    addrmatch_t *match;     // NULL for nodes that only split
+    int         child[2];   // node indices, 0 for none
+} addrnode_t;
+
+typedef struct {
+    list_t      *list;
+    qboolean    dirty;
+    addrnode_t  *nodes;     // nodes[0] is unused, root is nodes[1]
+    int         numnodes;
+} addrtrie_t;
+
+static addrtrie_t   addr_tries[MAX_ADDR_TRIES];
+
+#define PREFIX_MASK(bits)   ((bits) ? 0xffffffffU << (32 - (bits)) : 0)
+#define KEY_BIT(key, i)     (((key) >> (31 - (i))) & 1)
+
+static int common_bits(uint32_t a, uint32_t b, int bits)
+{
+    int i;
+
+    for (i = 0; i < bits; i++)
+        if (KEY_BIT(a, i) != KEY_BIT(b, i))
+            break;
+
+    return i;
+}
+
+static int new_addr_node(addrtrie_t *t, uint32_t key, int bits)
+{
+    addrnode_t *n = &t->nodes[t->numnodes];
+
+    n->key = key & PREFIX_MASK(bits);
+    n->bits = bits;
+    n->index = 0;
+    n->match = NULL;
+    n->child[0] = n->child[1] = 0;
+    return t->numnodes++;
+}
+
+// returns node with exactly this prefix, adding nodes as needed
+static int insert_addr_node(addrtrie_t *t, uint32_t key, int bits)
+{
+    int *link = &t->nodes[0].child[0];  // unused node 0 holds the root link
+    addrnode_t *n;
+    int common, split, node;
+
+    while (*link) {
+        n = &t->nodes[*link];
+        common = common_bits(key, n->key, min(bits, n->bits));
+
+        if (common == n->bits) {
+            if (n->bits == bits)
+                return *link;
+            link = &n->child[KEY_BIT(key, n->bits)];
+            continue;
+        }
+
+        // key diverges inside this node, insert above it
+        node = *link;
+        if (common == bits) {
+            split = new_addr_node(t, key, bits);
+            t->nodes[split].child[KEY_BIT(t->nodes[node].key, bits)] = node;
+            *link = split;
+            return split;
+        }
+
+        split = new_addr_node(t, key, common);
+        t->nodes[split].child[KEY_BIT(t->nodes[node].key, common)] = node;
+        *link = split;
+        link = &t->nodes[split].child[KEY_BIT(key, common)];
+        break;
+    }
+
+    *link = new_addr_node(t, key, bits);
+    return *link;
+}
+
+static void build_addr_trie(addrtrie_t *t)
+{
+    addrmatch_t *match;
+    addrnode_t *n;
+    int count, index, bits;
+
+    Z_Free(t->nodes);
+    t->nodes = NULL;
+    t->numnodes = 0;
+    t->dirty = qfalse;
+
+    count = 0;
+    LIST_FOR_EACH(addrmatch_t, match, t->list, entry)
+        count++;
+
+    if (!count)
+        return;
+
+    // every entry adds at most a leaf and a split node
+    t->nodes = Z_Malloc(sizeof(t->nodes[0]) * (count * 2 + 1));
+    new_addr_node(t, 0, 0);
+
+    index = 0;
+    LIST_FOR_EACH(addrmatch_t, match, t->list, entry) {
+        bits = common_bits(BigLong(match->mask), 0xffffffffU, 32);
+        n = &t->nodes[insert_addr_node(t, BigLong(match->addr.u32), bits)];
+        if (!n->match) {
+            n->match = match;
+            n->index = index;
+        }
+        index++;
+    }
+}
+
+static addrtrie_t *find_addr_trie(list_t *list)
+{
+    addrtrie_t *t;
+    int i;
+
+    for (i = 0, t = addr_tries; i < MAX_ADDR_TRIES; i++, t++) {
+        if (t->list == list)
+            return t;
+        if (!t->list) {
+            t->list = list;
+            t->dirty = qtrue;
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+==================
+SV_AddressListChanged
+
+Must be called after entries are added to or removed from an address list.
+==================
+*/
+void SV_AddressListChanged(list_t *list)
+{
+    addrtrie_t *t = find_addr_trie(list);
+
+    if (t)
+        t->dirty = qtrue;
+}
+
+static addrmatch_t *match_address_linear(list_t *list, uint32_t addr)
 {
     addrmatch_t *match;
 
     LIST_FOR_EACH(addrmatch_t, match, list, entry) {
-        if ((addr->ip.u32 & match->mask) == (match->addr.u32 & match->mask)) {
-            match->hits++;
-            match->time = time(NULL);
+        if ((addr & match->mask) == (match->addr.u32 & match->mask))
             return match;
-        }
     }
 
     return NULL;
 }
 
+static addrmatch_t *match_address(list_t *list, uint32_t addr)
+{
+    addrtrie_t *t;
+    addrnode_t *n, *best;
+    uint32_t key;
+    int node;
+
+    if (LIST_EMPTY(list))
+        return NULL;
+
+    t = find_addr_trie(list);
+    if (!t)
+        return match_address_linear(list, addr);
+
+    if (t->dirty)
+        build_addr_trie(t);
+
+    if (!t->nodes)
+        return NULL;
+
+    key = BigLong(addr);
+    best = NULL;
+    node = t->nodes[0].child[0];
+    while (node) {
+        n = &t->nodes[node];
+        if ((key ^ n->key) & PREFIX_MASK(n->bits))
+            break;
+        if (n->match && (!best || n->index < best->index))
+            best = n;
+        if (n->bits == 32)
+            break;
+        node = n->child[KEY_BIT(key, n->bits)];
+    }
+
+    return best ? best->match : NULL;
+}
+
+addrmatch_t *SV_MatchAddress(list_t *list, netadr_t *addr)
+{
+    addrmatch_t *match;
+
+    match = match_address(list, addr->ip.u32);
+    if (match) {
+        match->hits++;
+        match->time = time(NULL);
+    }
+
+    return match;
+}
+
+#if USE_TESTS
+
+#define MATCHTEST_ENTRIES   20000
+#define MATCHTEST_LOOKUPS   200000
+
+static void release_addr_trie(list_t *list)
+{
+    addrtrie_t *t = find_addr_trie(list);
+    int i;
+
+    if (!t)
+        return;
+
+    Z_Free(t->nodes);
+
+    // keep slots packed, find_addr_trie stops at the first free one
+    for (i = MAX_ADDR_TRIES - 1; i > 0 && !addr_tries[i].list; i--)
+        ;
+    *t = addr_tries[i];
+    memset(&addr_tries[i], 0, sizeof(addr_tries[i]));
+}
+
+static uint32_t random_addr(void)
+{
+    // a few /8s keep prefixes overlapping
+    return BigLong(((rand() % 4 + 10) << 24) | ((rand() & 0xfff) << 12) | (rand() & 0xfff));
+}
+
+/*
+==================
+SV_MatchTest_f
+
+Checks trie lookups against a linear scan of a random list.
+==================
+*/
+void SV_MatchTest_f(void)
+{
+    LIST_DECL(list);
+    addrmatch_t *match, *next;
+    unsigned start, build, trie, linear;
+    uint32_t *addrs;
+    int i, bits, entries, hits, errors;
+
+    entries = MATCHTEST_ENTRIES;
+    if (Cmd_Argc() > 1) {
+        entries = atoi(Cmd_Argv(1));
+        clamp(entries, 1, 1000000);
+    }
+
+    for (i = 0; i < entries; i++) {
+        bits = 16 + rand() % 17;
+        match = Z_Mallocz(sizeof(*match));
+        match->mask = BigLong(PREFIX_MASK(bits));
+        match->addr.u32 = random_addr();
+        List_Append(&list, &match->entry);
+    }
+    SV_AddressListChanged(&list);
+
+    addrs = Z_Malloc(sizeof(addrs[0]) * MATCHTEST_LOOKUPS);
+    for (i = 0; i < MATCHTEST_LOOKUPS; i++)
+        addrs[i] = random_addr();
+
+    start = Sys_Milliseconds();
+    match_address(&list, 0);
+    build = Sys_Milliseconds() - start;
+
+    hits = 0;
+    start = Sys_Milliseconds();
+    for (i = 0; i < MATCHTEST_LOOKUPS; i++)
+        hits += !!match_address(&list, addrs[i]);
+    trie = Sys_Milliseconds() - start;
+
+    // linear scan is far too slow for all of them, check a sample
+    errors = 0;
+    start = Sys_Milliseconds();
+    for (i = 0; i < MATCHTEST_LOOKUPS / 100; i++)
+        errors += match_address_linear(&list, addrs[i]) != match_address(&list, addrs[i]);
+    linear = (Sys_Milliseconds() - start) * 100;
+
+    Com_Printf("%d entries, %d lookups, %d hits, %d failures in %d checked\n",
+               entries, MATCHTEST_LOOKUPS, hits, errors, MATCHTEST_LOOKUPS / 100);
+    Com_Printf("%u msec build, %u msec trie, ~%u msec linear\n", build, trie, linear);
+
+    release_addr_trie(&list);
+    LIST_FOR_EACH_SAFE(addrmatch_t, match, next, &list, entry)
+        Z_Free(match);
+    Z_Free(addrs);
+}
+
+#endif
+
 /*
 ==============================================================================
 
@@ -452,6 +784,219 @@ static size_t SV_StatusString(char *status)
     return total;
 }
 
+/*
+Status replies are kept until serverinfo changes, or anything else that goes
+into them: reserved slots, uptime, and the name, frags and ping of listed
+players. A fingerprint of the latter is cheap compared to formatting.
+*/
+static struct {
+    char        data[MAX_PACKETLEN_DEFAULT];
+    size_t      len;
+    unsigned    key;
+    qboolean    valid;
+} status_cache;
+
+static unsigned status_key(void)
+{
+    client_t *cl;
+    const char *s;
+    unsigned key;
+
+    key = sv_status_show->integer * 31 + sv_reserved_slots->integer;
+
+    if (sv_uptime->integer > 0) {
+        key = key * 31 + (unsigned)time(NULL);
+    }
+
+    if (sv_status_show->integer > 1) {
+        FOR_EACH_CLIENT(cl) {
+            if (cl->state == cs_zombie) {
+                continue;
+            }
+            key = key * 31 + cl->edict->client->ps.stats[STAT_FRAGS];
+            key = key * 31 + cl->ping;
+            for (s = cl->name; *s; s++) {
+                key = key * 31 + *s;
+            }
+            key = key * 31 + cl->number;
+        }
+    }
+
+    return key;
+}
+
+// returns the whole packet, header included
+static const char *SV_StatusReply(size_t *len)
+{
+    unsigned key = status_key();
+
+    if (cvar_modified & CVAR_SERVERINFO) {
+        cvar_modified &= ~CVAR_SERVERINFO;
+        status_cache.valid = qfalse;
+    }
+
+    if (!status_cache.valid || status_cache.key != key) {
+        memcpy(status_cache.data, "\xff\xff\xff\xffprint\n", 10);
+        status_cache.len = 10 + SV_StatusString(status_cache.data + 10);
+        status_cache.key = key;
+        status_cache.valid = qtrue;
+    }
+
+    *len = status_cache.len;
+    return status_cache.data;
+}
+
+/*
+==============================================================================
+
+THREADED QUERIES
+
+Network receive threads answer status, info and ping queries from replies
+built here. Replies are rebuilt at most once a frame, and only while they
+are being asked for. Until then, or once they are a second old, queries
+are handed to the main thread as usual.
+
+==============================================================================
+*/
+
+#define QUERY_CACHE_TIME    1000
+
+static struct {
+    qmutex_t    *lock;
+    qboolean    valid;
+    qboolean    wanted;     // replies were asked for since last rebuild
+    unsigned    realtime;
+    unsigned    built;
+    char        status[MAX_PACKETLEN_DEFAULT];
+    size_t      status_len; // zero if status replies are disabled
+    char        info[MAX_QPATH + 10];
+    size_t      info_len;   // zero in single player
+} sq;
+
+// shared by the main and receive threads
+static qboolean status_rate_limited(unsigned time)
+{
+    qboolean ret;
+
+    Sys_LockMutex(sq.lock);
+    ret = rate_limited(&svs.ratelimit_status, time);
+    Sys_UnlockMutex(sq.lock);
+
+    return ret;
+}
+
+static size_t SV_InfoString(char *buffer, size_t size);
+
+static void SV_UpdateQueryCache(void)
+{
+    const char  *status = NULL;
+    char        info[MAX_QPATH + 10];
+    size_t      status_len = 0, info_len = 0;
+    qboolean    wanted, valid;
+
+    Sys_LockMutex(sq.lock);
+    sq.realtime = svs.realtime;
+    wanted = sq.wanted;
+    sq.wanted = qfalse;
+    Sys_UnlockMutex(sq.lock);
+
+    if (!wanted) {
+        return;
+    }
+
+    // blackholed addresses can only be matched here
+    valid = svs.initialized && LIST_EMPTY(&sv_blacklist);
+    if (valid) {
+        if (sv_status_show->integer) {
+            status = SV_StatusReply(&status_len);
+        }
+        if (sv_maxclients->integer > 1) {
+            info_len = SV_InfoString(info, sizeof(info));
+        }
+    }
+
+    Sys_LockMutex(sq.lock);
+    sq.valid = valid;
+    sq.built = svs.realtime;
+    if (status_len) {
+        memcpy(sq.status, status, status_len);
+    }
+    sq.status_len = status_len;
+    memcpy(sq.info, info, info_len);
+    sq.info_len = info_len;
+    Sys_UnlockMutex(sq.lock);
+}
+
+/*
+================
+SV_AnswerQuery
+
+Called from network receive threads with a connectionless packet. Returns
+qfalse if the packet should go through the main thread instead, otherwise
+fills in the reply, which may be empty.
+================
+*/
+qboolean SV_AnswerQuery(const netadr_t *from, const byte *data, size_t len,
+                        byte *reply, size_t *reply_len)
+{
+    char    string[MAX_QPATH];
+    char    *s, *args;
+    int     version;
+    size_t  n;
+
+    if (!sq.lock) {
+        return qfalse;
+    }
+
+    // the same first line SV_ConnectionlessPacket would look at
+    len = min(len - 4, sizeof(string) - 1);
+    memcpy(string, data + 4, len);
+    string[len] = 0;
+    if ((s = strchr(string, '\n')) != NULL) {
+        *s = 0;
+    }
+    for (s = string; *s && *s <= ' '; s++)
+        ;
+    for (n = 0; s[n] > ' '; n++)
+        ;
+    args = s + n;
+    if (strchr(args, '"')) {
+        return qfalse;  // leave quoting to the real tokenizer
+    }
+
+    Sys_LockMutex(sq.lock);
+
+    sq.wanted = qtrue;
+    if (!sq.valid || sq.realtime - sq.built > QUERY_CACHE_TIME) {
+        Sys_UnlockMutex(sq.lock);
+        return qfalse;
+    }
+
+    *reply_len = 0;
+    if (n == 6 && !strncmp(s, "status", 6)) {
+        if (sq.status_len && !rate_limited(&svs.ratelimit_status, sq.realtime)) {
+            memcpy(reply, sq.status, sq.status_len);
+            *reply_len = sq.status_len;
+        }
+    } else if (n == 4 && !strncmp(s, "info", 4)) {
+        version = atoi(args);
+        if (sq.info_len && version >= PROTOCOL_VERSION_DEFAULT &&
+            version <= PROTOCOL_VERSION_Q2PRO) {
+            memcpy(reply, sq.info, sq.info_len);
+            *reply_len = sq.info_len;
+        }
+    } else if (n == 4 && !strncmp(s, "ping", 4)) {
+        memcpy(reply, "\xff\xff\xff\xff" "ack", 7);
+        *reply_len = 7;
+    } else {
+        Sys_UnlockMutex(sq.lock);
+        return qfalse;
+    }
+
+    Sys_UnlockMutex(sq.lock);
+    return qtrue;
+}
+
 /*
 ================
 SVC_Status
@@ -461,27 +1006,23 @@ Responds with all the info that qplug or qspy can see
 */
 static void SVC_Status(void)
 {
-    char    buffer[MAX_PACKETLEN_DEFAULT];
-    size_t  len;
+    const char  *reply;
+    size_t      len;
 
     if (!sv_status_show->integer) {
         return;
     }
 
-    if (SV_RateLimited(&svs.ratelimit_status)) {
+    if (status_rate_limited(svs.realtime)) {
         Com_DPrintf("Dropping status request from %s\n",
                     NET_AdrToString(&net_from));
         return;
     }
 
-    // write the packet header
-    memcpy(buffer, "\xff\xff\xff\xffprint\n", 10);
-    len = 10;
-
-    len += SV_StatusString(buffer + len);
+    reply = SV_StatusReply(&len);
 
     // send the datagram
-    NET_SendPacket(NS_SERVER, buffer, len, &net_from);
+    NET_SendPacket(NS_SERVER, reply, len, &net_from);
 }
 
 /*
@@ -515,6 +1056,14 @@ Responds with short info for broadcast scans
 The second parameter should be the current protocol version number.
 ================
 */
+static size_t SV_InfoString(char *buffer, size_t size)
+{
+    return Q_scnprintf(buffer, size,
+                       "\xff\xff\xff\xffinfo\n%16s %8s %2i/%2i\n",
+                       sv_hostname->string, sv.name, SV_CountClients(),
+                       sv_maxclients->integer - sv_reserved_slots->integer);
+}
+
 static void SVC_Info(void)
 {
     char    buffer[MAX_QPATH+10];
@@ -528,10 +1077,7 @@ static void SVC_Info(void)
     if (version < PROTOCOL_VERSION_DEFAULT || version > PROTOCOL_VERSION_Q2PRO)
         return; // ignore invalid versions
 
-    len = Q_scnprintf(buffer, sizeof(buffer),
-                      "\xff\xff\xff\xffinfo\n%16s %8s %2i/%2i\n",
-                      sv_hostname->string, sv.name, SV_CountClients(),
-                      sv_maxclients->integer - sv_reserved_slots->integer);
+    len = SV_InfoString(buffer, sizeof(buffer));
 
     NET_SendPacket(NS_SERVER, buffer, len, &net_from);
 }
@@ -1031,6 +1577,7 @@ static void SVC_DirectConnect(void)
     newcl->mapname = sv.name;
     newcl->configstrings = (char *)sv.configstrings;
     newcl->pool = (edict_pool_t *)&ge->edicts;
+    newcl->entvis = sv.entvis;
     newcl->cm = &sv.cm;
     newcl->spawncount = sv.spawncount;
     newcl->maxclients = sv_maxclients->integer;
@@ -1082,6 +1629,14 @@ static void SVC_DirectConnect(void)
     } else {
         newcl->WriteFrame = SV_WriteFrameToClient_Enhanced;
     }
+#if USE_CLIENT
+    // local client in this process can read frames directly
+    if (sv_loop_handoff->integer && net_from.type == NA_LOOPBACK &&
+        newcl->protocol == PROTOCOL_VERSION_Q2PRO &&
+        newcl->version == PROTOCOL_VERSION_Q2PRO_CURRENT) {
+        newcl->WriteFrame = SV_WriteFrameToClient_Loop;
+    }
+#endif
 
     // loopback client doesn't need to reconnect
     if (NET_IsLocalAddress(&net_from)) {
@@ -1090,6 +1645,7 @@ static void SVC_DirectConnect(void)
 
     // add them to the linked list of connected clients
     List_SeqAdd(&sv_clientlist, &newcl->entry);
+    SV_InvalidateMulticast();
 
     Com_DPrintf("Going from cs_free to cs_assigned for %s\n", newcl->name);
     newcl->state = cs_assigned;
@@ -1274,6 +1830,82 @@ static int ping_avg(client_t *cl)
     return count ? total / count : 0;
 }
 
+/*
+===================
+SV_AddLatency
+
+Counts a frame round trip time into the client latency histogram.
+Does nothing unless sv_latency_stats is set.
+===================
+*/
+
+// upper bounds of all but the last bucket, in milliseconds
+const unsigned sv_latency_bounds[LATENCY_BUCKETS - 1] = {
+    5, 10, 20, 30, 50, 75, 100, 150, 200, 300, 500
+};
+
+static void latency_advance(latstats_t *s)
+{
+    unsigned delta = svs.realtime - s->time;
+
+    if (delta < 1000)
+        return;
+
+    // keep the last full second only if it directly precedes this one
+    if (delta < 2000)
+        memcpy(s->last, s->cur, sizeof(s->last));
+    else
+        memset(s->last, 0, sizeof(s->last));
+    memset(s->cur, 0, sizeof(s->cur));
+    s->time = svs.realtime - delta % 1000;
+}
+
+void SV_AddLatency(client_t *client, unsigned latency)
+{
+    latstats_t *s = client->latstats;
+    int i;
+
+    if (!sv_latency_stats->integer)
+        return;
+
+    if (!s) {
+        s = client->latstats = SV_Mallocz(sizeof(*s));
+        s->time = svs.realtime;
+    }
+
+    latency_advance(s);
+
+    for (i = 0; i < LATENCY_BUCKETS - 1; i++)
+        if (latency < sv_latency_bounds[i])
+            break;
+
+    s->cur[i]++;
+    s->total[i]++;
+}
+
+latstats_t *SV_LatencyStats(client_t *client)
+{
+    if (client->latstats)
+        latency_advance(client->latstats);
+
+    return client->latstats;
+}
+
+static void sv_latency_stats_changed(cvar_t *self)
+{
+    client_t *client;
+
+    if (self->integer)
+        return;
+
+    FOR_EACH_CLIENT(client) {
+        if (client->latstats) {
+            Z_Free(client->latstats);
+            client->latstats = NULL;
+        }
+    }
+}
+
 /*
 ===================
 SV_CalcPings
@@ -1640,7 +2272,12 @@ static void SV_RunGameFrame(void)
     X86_PUSH_FPCW;
     X86_SINGLE_FPCW;
 
+    PROF_Begin(PROF_GAME_FRAME);
+    SV_ProfileBegin("RunFrame");
     ge->RunFrame();
+    SV_ProfileEnd("RunFrame");
+    PROF_End(PROF_GAME_FRAME);
+    SV_ProfileFrame();
 
     X86_POP_FPCW;
 
@@ -1656,6 +2293,9 @@ static void SV_RunGameFrame(void)
         SZ_Clear(&msg_write);
     }
 
+    // broadcast configstrings changed during the frame
+    SV_FlushConfigstrings();
+
     // save the entire world state if recording a serverdemo
     SV_MvdEndFrame();
 }
@@ -1763,9 +2403,23 @@ unsigned SV_Frame(unsigned msec)
     MVD_Frame();
 #endif
 
+#if USE_CLIENT
+    // rename savegame files once written
+    SV_FinishSavegame(qfalse);
+#endif
+
     // read packets from UDP clients
     NET_GetPackets(NS_SERVER, SV_PacketEvent);
 
+    // run moves queued while reading them
+    SV_RunPendingMoves();
+
+    // refresh replies given out by network threads
+    SV_UpdateQueryCache();
+
+    // serve metrics scrapes
+    SV_MetricsRun();
+
     if (svs.initialized) {
         // run connection to the anticheat server
         AC_Run();
@@ -1784,6 +2438,8 @@ unsigned SV_Frame(unsigned msec)
     }
 
     if (svs.initialized && !check_paused()) {
+        unsigned start = Sys_Microseconds();
+
         // check timeouts
         SV_CheckTimeouts();
 
@@ -1805,6 +2461,8 @@ unsigned SV_Frame(unsigned msec)
         // clear teleport flags, etc for next frame
         SV_PrepWorldFrame();
 
+        SV_MetricsFrame(Sys_Microseconds() - start);
+
         // advance for next frame
         sv.framenum++;
     }
@@ -1980,6 +2638,8 @@ Only called at quake2.exe startup, not for each game
 */
 void SV_Init(void)
 {
+    sq.lock = Sys_CreateMutex();
+
     SV_InitOperatorCommands();
 
     SV_MvdRegister();
@@ -1990,6 +2650,8 @@ void SV_Init(void)
 
     AC_Register();
 
+    SV_MetricsInit();
+
     Cvar_Get("protocol", va("%i", PROTOCOL_VERSION_DEFAULT), CVAR_SERVERINFO | CVAR_ROM);
 
     Cvar_Get("skill", "1", CVAR_LATCH);
@@ -2025,6 +2687,14 @@ void SV_Init(void)
     sv_reserved_password = Cvar_Get("sv_reserved_password", "", CVAR_PRIVATE);
     sv_locked = Cvar_Get("sv_locked", "0", 0);
     sv_novis = Cvar_Get("sv_novis", "0", 0);
+    sv_area_depth = Cvar_Get("sv_area_depth", "0", 0);
+    sv_trace_cache = Cvar_Get("sv_trace_cache", "1", 0);
+    sv_send_threads = Cvar_Get("sv_send_threads", "0", 0);
+    sv_send_threads->modified = qtrue;
+    sv_trace_threads = Cvar_Get("sv_trace_threads", "0", 0);
+    sv_trace_threads->modified = qtrue;
+    sv_parallel_pmove = Cvar_Get("sv_parallel_pmove", "0", 0);
+    sv_gameprof = Cvar_Get("sv_gameprof", "0", 0);
     sv_downloadserver = Cvar_Get("sv_downloadserver", "", 0);
     sv_redirect_address = Cvar_Get("sv_redirect_address", "", 0);
 
@@ -2034,6 +2704,17 @@ void SV_Init(void)
 #endif
     sv_lan_force_rate = Cvar_Get("sv_lan_force_rate", "0", CVAR_LATCH);
     sv_calcpings_method = Cvar_Get("sv_calcpings_method", "2", 0);
+    sv_latency_stats = Cvar_Get("sv_latency_stats", "0", 0);
+    sv_latency_stats->changed = sv_latency_stats_changed;
+    sv_adaptive_rate = Cvar_Get("sv_adaptive_rate", "0", 0);
+#if USE_ZLIB
+    sv_download_window = Cvar_Get("sv_download_window", "16384", 0);
+#endif
+    sv_spectator_snapdiv = Cvar_Get("sv_spectator_snapdiv", "1", 0);
+    sv_entity_priority = Cvar_Get("sv_entity_priority", "1", 0);
+#if USE_CLIENT
+    sv_loop_handoff = Cvar_Get("sv_loop_handoff", "0", 0);
+#endif
     sv_changemapcmd = Cvar_Get("sv_changemapcmd", "", 0);
 
     sv_strafejump_hack = Cvar_Get("sv_strafejump_hack", "1", CVAR_LATCH);
@@ -2164,6 +2845,10 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     if (!sv_registered)
         return;
 
+#if USE_CLIENT
+    SV_FinishSavegame(qtrue);
+#endif
+
 #if USE_MVD_CLIENT
     if (ge != &mvd_ge && !(type & MVD_SPAWN_INTERNAL)) {
         // shutdown MVD client now if not already running the built-in MVD game module
@@ -2179,6 +2864,9 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 
     SV_FinalMessage(finalmsg, type);
     SV_MasterShutdown();
+    SV_ShutdownSendThreads();
+    SV_ShutdownTraceThreads();
+    SV_ShutdownMessagePool();
     SV_ShutdownGameProgs();
 
     // free current level
@@ -2191,6 +2879,7 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     Z_Free(svs.entities);
 #if USE_ZLIB
     deflateEnd(&svs.z);
+    SV_FreeGamestateCache();
 #endif
     memset(&svs, 0, sizeof(svs));
 
@@ -0,0 +1,445 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// metrics.c -- HTTP endpoint serving server counters
+//
+// When sv_metrics_port is set, server listens on that TCP port and answers
+// each HTTP GET request with counters in Prometheus text format, then closes
+// the connection. Requests are served from the main loop like GTV streams,
+// so scraping costs nothing between scrapes.
+//
+
+#include "server.h"
+
+#define METRICS_CONNS       8
+#define METRICS_REQUEST     1024
+#define METRICS_HEADER      256     // room reserved in front of body
+#define METRICS_RESPONSE    0x40000
+#define METRICS_TIMEOUT     5000
+#define METRICS_SAMPLES     256     // must be power of two
+
+typedef struct {
+    netstream_t stream;
+    unsigned    lastmessage;
+    qboolean    responded;
+    byte        request[METRICS_REQUEST];
+    char        *response;
+} metricsconn_t;
+
+static struct {
+    metricsconn_t   conns[METRICS_CONNS];
+    unsigned        samples[METRICS_SAMPLES];   // frame times, usec
+    unsigned        framecount;
+    uint64_t        frametotal;
+    size_t          cursize;
+    qboolean        overflowed;
+} metrics;
+
+static cvar_t   *sv_metrics_port;
+
+/*
+==============
+SV_MetricsFrame
+
+Records processing time of a server frame.
+==============
+*/
+void SV_MetricsFrame(unsigned usec)
+{
+    metrics.samples[metrics.framecount & (METRICS_SAMPLES - 1)] = usec;
+    metrics.framecount++;
+    metrics.frametotal += usec;
+}
+
+static void close_conn(metricsconn_t *conn)
+{
+    NET_CloseStream(&conn->stream);
+    Z_Free(conn->response);
+    memset(conn, 0, sizeof(*conn));
+}
+
+static void q_printf(2, 3) emit(metricsconn_t *conn, const char *fmt, ...)
+{
+    va_list argptr;
+    size_t len;
+
+    if (metrics.overflowed) {
+        return;
+    }
+
+    va_start(argptr, fmt);
+    len = Q_vscnprintf(conn->response + METRICS_HEADER + metrics.cursize,
+                       METRICS_RESPONSE - METRICS_HEADER - metrics.cursize,
+                       fmt, argptr);
+    va_end(argptr);
+
+    metrics.cursize += len;
+    if (metrics.cursize >= METRICS_RESPONSE - METRICS_HEADER - 1) {
+        metrics.overflowed = qtrue;
+    }
+}
+
+// label values are quoted strings with backslash escapes
+static char *escape_label(const char *s)
+{
+    static char buffer[MAX_CLIENT_NAME * 2];
+    char *p = buffer;
+
+    while (*s && p < buffer + sizeof(buffer) - 2) {
+        if (*s == '\\' || *s == '"') {
+            *p++ = '\\';
+            *p++ = *s++;
+        } else if (Q_isprint(*s)) {
+            *p++ = *s++;
+        } else {
+            s++;
+        }
+    }
+    *p = 0;
+
+    return buffer;
+}
+
+static int sample_cmp(const void *p1, const void *p2)
+{
+    unsigned a = *(const unsigned *)p1;
+    unsigned b = *(const unsigned *)p2;
+
+    return a < b ? -1 : a > b;
+}
+
+static void emit_frametimes(metricsconn_t *conn)
+{
+    static const int quantiles[] = { 50, 90, 99, 100 };
+    unsigned sorted[METRICS_SAMPLES];
+    int i, count;
+
+    count = min(metrics.framecount, METRICS_SAMPLES);
+
+    emit(conn, "# HELP q2pro_frame_seconds Server frame processing time, "
+         "quantiles over the last %d frames.\n"
+         "# TYPE q2pro_frame_seconds summary\n", METRICS_SAMPLES);
+
+    if (count) {
+        memcpy(sorted, metrics.samples, sizeof(sorted[0]) * count);
+        qsort(sorted, count, sizeof(sorted[0]), sample_cmp);
+        for (i = 0; i < q_countof(quantiles); i++) {
+            emit(conn, "q2pro_frame_seconds{quantile=\"%.2f\"} %.6f\n",
+                 quantiles[i] / 100.0f,
+                 sorted[(count - 1) * quantiles[i] / 100] * 1e-6);
+        }
+    }
+
+    emit(conn, "q2pro_frame_seconds_sum %.6f\n"
+         "q2pro_frame_seconds_count %u\n",
+         metrics.frametotal * 1e-6, metrics.framecount);
+}
+
+static void emit_clients(metricsconn_t *conn)
+{
+    static const char *const states[] = {
+        "free", "zombie", "assigned", "connected", "primed", "spawned"
+    };
+    int counts[q_countof(states)];
+    client_t *cl;
+    char *name;
+    int i;
+
+    memset(counts, 0, sizeof(counts));
+    if (svs.initialized) {
+        for (i = 0; i < sv_maxclients->integer; i++) {
+            cl = &svs.client_pool[i];
+            if (cl->state >= cs_free && cl->state <= cs_spawned) {
+                counts[cl->state]++;
+            }
+        }
+    }
+
+    emit(conn, "# HELP q2pro_clients Client slots by connection state.\n"
+         "# TYPE q2pro_clients gauge\n");
+    for (i = 1; i < q_countof(states); i++) {
+        emit(conn, "q2pro_clients{state=\"%s\"} %d\n", states[i], counts[i]);
+    }
+    emit(conn, "# TYPE q2pro_maxclients gauge\n"
+         "q2pro_maxclients %d\n", svs.initialized ? sv_maxclients->integer : 0);
+
+    if (!svs.initialized) {
+        return;
+    }
+
+    emit(conn, "# HELP q2pro_client_ping_ms Average ping of each client.\n"
+         "# TYPE q2pro_client_ping_ms gauge\n");
+    FOR_EACH_CLIENT(cl) {
+        name = escape_label(cl->name);
+        emit(conn, "q2pro_client_ping_ms{slot=\"%d\",name=\"%s\"} %d\n",
+             cl->number, name, AVG_PING(cl));
+    }
+
+    emit(conn, "# HELP q2pro_client_loss_percent Packet loss of each client.\n"
+         "# TYPE q2pro_client_loss_percent gauge\n");
+    FOR_EACH_CLIENT(cl) {
+        name = escape_label(cl->name);
+        emit(conn, "q2pro_client_loss_percent{slot=\"%d\",name=\"%s\",dir=\"s2c\"} %.2f\n",
+             cl->number, name, PL_S2C(cl));
+        emit(conn, "q2pro_client_loss_percent{slot=\"%d\",name=\"%s\",dir=\"c2s\"} %.2f\n",
+             cl->number, name, PL_C2S(cl));
+    }
+
+    emit(conn, "# HELP q2pro_client_choked_total Frames held back from each "
+         "client by rate limit.\n"
+         "# TYPE q2pro_client_choked_total counter\n");
+    FOR_EACH_CLIENT(cl) {
+        name = escape_label(cl->name);
+        emit(conn, "q2pro_client_choked_total{slot=\"%d\",name=\"%s\"} %u\n",
+             cl->number, name, cl->total_suppressed);
+    }
+}
+
+static void emit_network(metricsconn_t *conn)
+{
+    netcounters_t c;
+
+    NET_GetCounters(&c);
+
+    emit(conn, "# TYPE q2pro_net_received_bytes_total counter\n"
+         "q2pro_net_received_bytes_total %"PRIu64"\n"
+         "# TYPE q2pro_net_sent_bytes_total counter\n"
+         "q2pro_net_sent_bytes_total %"PRIu64"\n"
+         "# TYPE q2pro_net_received_packets_total counter\n"
+         "q2pro_net_received_packets_total %"PRIu64"\n"
+         "# TYPE q2pro_net_sent_packets_total counter\n"
+         "q2pro_net_sent_packets_total %"PRIu64"\n"
+         "# TYPE q2pro_net_oob_dropped_total counter\n"
+         "q2pro_net_oob_dropped_total %"PRIu64"\n",
+         c.bytes_rcvd, c.bytes_sent, c.packets_rcvd, c.packets_sent,
+         c.oob_dropped);
+}
+
+static void emit_memory(metricsconn_t *conn)
+{
+    size_t bytes[TAG_MAX], blocks[TAG_MAX];
+    int i;
+
+    Z_GetTagStats(bytes, blocks);
+
+    emit(conn, "# HELP q2pro_zone_bytes Zone memory in use by tag.\n"
+         "# TYPE q2pro_zone_bytes gauge\n");
+    for (i = 0; i < TAG_MAX; i++) {
+        if (blocks[i]) {
+            emit(conn, "q2pro_zone_bytes{tag=\"%s\"} %"PRIz"\n",
+                 Z_TagName(i), bytes[i]);
+        }
+    }
+
+    emit(conn, "# TYPE q2pro_zone_blocks gauge\n");
+    for (i = 0; i < TAG_MAX; i++) {
+        if (blocks[i]) {
+            emit(conn, "q2pro_zone_blocks{tag=\"%s\"} %"PRIz"\n",
+                 Z_TagName(i), blocks[i]);
+        }
+    }
+}
+
+static void emit_mvd(metricsconn_t *conn)
+{
+    emit(conn, "# HELP q2pro_gtv_clients GTV clients streaming from this server.\n"
+         "# TYPE q2pro_gtv_clients gauge\n"
+         "q2pro_gtv_clients %d\n", SV_MvdClientCount());
+#if USE_MVD_CLIENT
+    emit(conn, "# HELP q2pro_gtv_connections Connections to upstream GTV servers.\n"
+         "# TYPE q2pro_gtv_connections gauge\n"
+         "q2pro_gtv_connections %d\n"
+         "# TYPE q2pro_mvd_channels gauge\n"
+         "q2pro_mvd_channels %d\n",
+         List_Count(&mvd_gtv_list), List_Count(&mvd_channel_list));
+#endif
+}
+
+static void respond(metricsconn_t *conn, const char *status, qboolean body)
+{
+    char header[METRICS_HEADER];
+    size_t len;
+
+    conn->response = SV_Malloc(METRICS_RESPONSE);
+    metrics.cursize = 0;
+    metrics.overflowed = qfalse;
+
+    if (body) {
+        emit(conn, "# TYPE q2pro_uptime_seconds counter\n"
+             "q2pro_uptime_seconds %u\n", svs.realtime / 1000);
+        emit_frametimes(conn);
+        emit_clients(conn);
+        emit_network(conn);
+        emit_memory(conn);
+        emit_mvd(conn);
+    } else {
+        emit(conn, "%s\n", status);
+    }
+
+    if (metrics.overflowed) {
+        Com_WPrintf("Metrics response truncated at %"PRIz" bytes\n", metrics.cursize);
+    }
+
+    len = Q_scnprintf(header, sizeof(header),
+                      "HTTP/1.0 %s\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: %"PRIz"\r\n"
+                      "Connection: close\r\n\r\n",
+                      status, metrics.cursize);
+
+    // header goes right in front of the body, the stream sends
+    // straight from the response buffer
+    memcpy(conn->response + METRICS_HEADER - len, header, len);
+
+    conn->stream.send.data = (byte *)conn->response + METRICS_HEADER - len;
+    conn->stream.send.size = len + metrics.cursize;
+    FIFO_Clear(&conn->stream.send);
+    FIFO_Commit(&conn->stream.send, len + metrics.cursize);
+    NET_UpdateStream(&conn->stream);
+
+    conn->responded = qtrue;
+}
+
+// returns qfalse until full request header has arrived
+static qboolean parse_request(metricsconn_t *conn)
+{
+    char *data, *end;
+    size_t len;
+
+    data = (char *)conn->stream.recv.data;
+    len = FIFO_Usage(&conn->stream.recv);
+    data[len] = 0;
+
+    if (!strstr(data, "\r\n\r\n") && !strstr(data, "\n\n")) {
+        if (len == METRICS_REQUEST - 1) {
+            respond(conn, "431 Request Header Fields Too Large", qfalse);
+            return qtrue;
+        }
+        return qfalse;
+    }
+
+    end = strpbrk(data, "\r\n");
+    if (end) {
+        *end = 0;
+    }
+
+    if (strncmp(data, "GET ", 4)) {
+        respond(conn, "405 Method Not Allowed", qfalse);
+    } else if (!strncmp(data + 4, "/metrics ", 9) || !strncmp(data + 4, "/ ", 2)) {
+        respond(conn, "200 OK", qtrue);
+    } else {
+        respond(conn, "404 Not Found", qfalse);
+    }
+
+    return qtrue;
+}
+
+static void accept_conn(netstream_t *stream)
+{
+    metricsconn_t *conn;
+    int i;
+
+    for (i = 0, conn = metrics.conns; i < METRICS_CONNS; i++, conn++) {
+        if (!conn->stream.state) {
+            break;
+        }
+    }
+    if (i == METRICS_CONNS) {
+        Com_DPrintf("Metrics client [%s] rejected: no free slots\n",
+                    NET_AdrToString(&stream->address));
+        NET_CloseStream(stream);
+        return;
+    }
+
+    // the request is read into the last byte short of full,
+    // which leaves room for terminating it
+    conn->stream = *stream;
+    conn->stream.recv.data = conn->request;
+    conn->stream.recv.size = METRICS_REQUEST - 1;
+    conn->lastmessage = svs.realtime;
+    conn->responded = qfalse;
+}
+
+/*
+==============
+SV_MetricsRun
+
+Accepts and serves metrics connections.
+==============
+*/
+void SV_MetricsRun(void)
+{
+    metricsconn_t *conn;
+    netstream_t stream;
+    neterr_t ret;
+    int i;
+
+    if (NET_AcceptPort(NL_METRICS, &stream) == NET_OK) {
+        accept_conn(&stream);
+    }
+
+    for (i = 0, conn = metrics.conns; i < METRICS_CONNS; i++, conn++) {
+        if (!conn->stream.state) {
+            continue;
+        }
+
+        if (svs.realtime - conn->lastmessage > METRICS_TIMEOUT) {
+            close_conn(conn);
+            continue;
+        }
+
+        ret = NET_RunStream(&conn->stream);
+        if (ret == NET_CLOSED || ret == NET_ERROR) {
+            close_conn(conn);
+            continue;
+        }
+
+        if (conn->responded) {
+            // close once everything is sent
+            if (!FIFO_Usage(&conn->stream.send)) {
+                close_conn(conn);
+            }
+            continue;
+        }
+
+        if (ret == NET_OK && parse_request(conn)) {
+            // ignore anything else client sends
+            FIFO_Clear(&conn->stream.recv);
+            NET_RunStream(&conn->stream);
+        }
+    }
+}
+
+static void sv_metrics_port_changed(cvar_t *self)
+{
+    neterr_t ret;
+
+    ret = NET_ListenPort(NL_METRICS, Cvar_ClampInteger(self, 0, 65535));
+    if (ret != NET_OK) {
+        Com_EPrintf("%s while opening metrics TCP port %d.\n",
+                    NET_ErrorString(), self->integer);
+    }
+}
+
+void SV_MetricsInit(void)
+{
+    sv_metrics_port = Cvar_Get("sv_metrics_port", "0", 0);
+    sv_metrics_port->changed = sv_metrics_port_changed;
+    sv_metrics_port_changed(sv_metrics_port);
+}
@@ -29,6 +29,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FOR_EACH_ACTIVE_GTV(client) \
     LIST_FOR_EACH(gtv_client_t, client, &gtv_active_list, active)
 
+// frames between full flushes of the shared stream, when waiting
+// clients can switch over to it
+#define GTV_JOIN_FRAMES     10
+
 typedef struct {
     list_t      entry;
     list_t      active;
@@ -36,6 +40,7 @@ typedef struct {
     netstream_t stream;
 #if USE_ZLIB
     z_stream    z;
+    qboolean    shared; // frames come from the shared stream
 #endif
     unsigned    msglen;
     unsigned    lastmessage;
@@ -51,6 +56,16 @@ typedef struct {
     char        version[MAX_QPATH];
 } gtv_client_t;
 
+// seek index snapshot, kept in memory until recording stops
+typedef struct {
+    list_t      entry;
+    uint32_t    levelpos;
+    uint32_t    framenum;
+    uint32_t    filepos;
+    size_t      msglen;
+    byte        data[1];
+} rec_snap_t;
+
 typedef struct {
     qboolean        active;
     client_t        *dummy;
@@ -73,8 +88,30 @@ typedef struct {
     int             numlevels; // stop after that many levels
     int             numframes; // stop after that many frames
 
+    // seek index of local recording
+    qboolean        recindex;
+    off_t           reclevel;   // offset of the last gamestate
+    int             recframes;  // frames parsed since that gamestate
+    int             recsnap;    // frame of the last snapshot
+    byte            recdcs[CS_BITMAP_BYTES]; // changed since gamestate
+    list_t          recsnaps;
+
     // TCP client pool
     gtv_client_t    *clients; // [sv_mvd_maxclients]
+
+#if USE_ZLIB
+    // frames are deflated once into a raw stream which is copied to all
+    // clients that joined it at a full flush point. each frame ends with
+    // a sync flush, so clients can leave it between frames.
+    z_stream        z;
+    byte            *zbuf;
+    size_t          zbufsize;
+    size_t          zlen;       // compressed size of the current frame
+    uLong           zadler;     // checksum of the current frame
+    size_t          zinlen;     // uncompressed size of the current frame
+    unsigned        zframes;    // frames since the last full flush
+    qboolean        zfull;      // joining is possible after this frame
+#endif
 } mvd_server_t;
 
 static mvd_server_t     mvd;
@@ -103,6 +140,7 @@ static cvar_t   *sv_mvd_capture_flags;
 static cvar_t   *sv_mvd_disconnect_time;
 static cvar_t   *sv_mvd_suspend_time;
 static cvar_t   *sv_mvd_allow_stufftext;
+static cvar_t   *sv_mvd_index;
 
 static qboolean mvd_enable(void);
 static void     mvd_disable(void);
@@ -110,13 +148,15 @@ static void     mvd_drop(gtv_serverop_t op);
 
 static void     write_stream(gtv_client_t *client, void *data, size_t len);
 static void     write_message(gtv_client_t *client, gtv_serverop_t op);
+static void     drop_client(gtv_client_t *client, const char *error);
 #if USE_ZLIB
-static void     flush_stream(gtv_client_t *client, int flush);
+static qboolean flush_stream(gtv_client_t *client, int flush);
 #endif
 
 static void     rec_stop(void);
 static qboolean rec_allowed(void);
-static void     rec_start(qhandle_t demofile);
+static void     rec_start(qhandle_t demofile, qboolean indexed);
+static void     rec_snapshot(void);
 static void     rec_write(void);
 
 
@@ -192,7 +232,7 @@ static void dummy_record_f(void)
 
     Com_Printf("Auto-recording local MVD to %s\n", buffer);
 
-    rec_start(f);
+    rec_start(f, qtrue);
 }
 
 static void dummy_stop_f(void)
@@ -644,6 +684,82 @@ static void emit_gamestate(void)
     MSG_WriteShort(0);
 }
 
+/*
+==================
+emit_snapshot
+
+Writes an uncompressed frame with the current delta compressor state,
+and configstrings changed since the last recorded gamestate. Demo
+player can jump to the recorded position after parsing it.
+==================
+*/
+static void emit_snapshot(void)
+{
+    char        *string;
+    int         i, j;
+    player_packed_t *ps;
+    entity_packed_t *es;
+    size_t      length;
+    int         flags, portalbytes;
+    byte        portalbits[MAX_MAP_PORTAL_BYTES];
+
+    MSG_WriteByte(mvd_frame);
+
+    portalbytes = CM_WritePortalBits(&sv.cm, portalbits);
+    MSG_WriteByte(portalbytes);
+    MSG_WriteData(portalbits, portalbytes);
+
+    // send player states
+    flags = 0;
+    if (sv_mvd_noblend->integer) {
+        flags |= MSG_PS_IGNORE_BLEND;
+    }
+    if (sv_mvd_nogun->integer) {
+        flags |= MSG_PS_IGNORE_GUNINDEX | MSG_PS_IGNORE_GUNFRAMES;
+    }
+    for (i = 0, ps = mvd.players; i < sv_maxclients->integer; i++, ps++) {
+        if (PPS_INUSE(ps)) {
+            MSG_WriteDeltaPlayerstate_Packet(NULL, ps, i, flags | MSG_PS_FORCE);
+        }
+    }
+    MSG_WriteByte(CLIENTNUM_NONE);
+
+    // send entity states
+    for (i = 1, es = mvd.entities + 1; i < ge->num_edicts; i++, es++) {
+        if ((j = es->number) == 0) {
+            continue;
+        }
+        flags = MSG_ES_UMASK | MSG_ES_FORCE | MSG_ES_NEWENTITY;
+        if (i <= sv_maxclients->integer) {
+            ps = &mvd.players[i - 1];
+            if (PPS_INUSE(ps) && ps->pmove.pm_type == PM_NORMAL) {
+                flags |= MSG_ES_FIRSTPERSON;
+            }
+        }
+        es->number = i;
+        MSG_WriteDeltaEntity(NULL, es, flags);
+        es->number = j;
+    }
+    MSG_WriteShort(0);
+
+    // send changed configstrings
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        if (!Q_IsBitSet(mvd.recdcs, i)) {
+            continue;
+        }
+        string = sv.configstrings[i];
+        length = strlen(string);
+        if (length > MAX_QPATH) {
+            length = MAX_QPATH;
+        }
+
+        MSG_WriteByte(mvd_configstring);
+        MSG_WriteShort(i);
+        MSG_WriteData(string, length);
+        MSG_WriteByte(0);
+    }
+}
+
 static void copy_entity_state(entity_packed_t *dst, const entity_packed_t *src, int flags)
 {
     if (!(flags & MSG_ES_FIRSTPERSON)) {
@@ -906,6 +1022,8 @@ static void rec_frame(size_t total)
     if (ret != mvd.datagram.cursize)
         goto fail;
 
+    mvd.recframes++;
+
     if (sv_mvd_maxsize->value > 0 &&
         FS_Tell(mvd.recording) > sv_mvd_maxsize->value * 1000) {
         Com_Printf("Stopping MVD recording, maximum size reached.\n");
@@ -927,6 +1045,132 @@ fail:
     rec_stop();
 }
 
+#if USE_ZLIB
+static qboolean deflate_shared(void *data, size_t len, int flush)
+{
+    z_streamp z = &mvd.z;
+    int ret;
+
+    if (!len && flush == Z_NO_FLUSH) {
+        return qtrue;
+    }
+
+    z->next_in = data;
+    z->avail_in = (uInt)len;
+    z->next_out = mvd.zbuf + mvd.zlen;
+    z->avail_out = (uInt)(mvd.zbufsize - mvd.zlen);
+
+    ret = deflate(z, flush);
+
+    mvd.zlen = mvd.zbufsize - z->avail_out;
+    if (ret != Z_OK || z->avail_in || !z->avail_out) {
+        return qfalse;
+    }
+
+    if (len) {
+        mvd.zadler = adler32(mvd.zadler, data, (uInt)len);
+        mvd.zinlen += len;
+    }
+    return qtrue;
+}
+
+static void deflate_frame(byte *header)
+{
+    gtv_client_t *client;
+    qboolean shared = qfalse, waiting = qfalse;
+    int flush;
+
+    if (!mvd.z.state) {
+        mvd.z.zalloc = SV_zalloc;
+        mvd.z.zfree = SV_zfree;
+        // raw deflate, clients already have zlib header
+        if (deflateInit2(&mvd.z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            mvd.zfull = qfalse;
+            return;
+        }
+        mvd.zbufsize = deflateBound(&mvd.z, MAX_MSGLEN) + 64;
+        mvd.zbuf = SV_Malloc(mvd.zbufsize);
+        mvd.zfull = qtrue;
+    }
+
+    FOR_EACH_ACTIVE_GTV(client) {
+        if (client->shared) {
+            shared = qtrue;
+        } else if (client->z.state) {
+            waiting = qtrue;
+        }
+    }
+
+    mvd.zlen = 0;
+    mvd.zinlen = 0;
+    mvd.zadler = adler32(0, Z_NULL, 0);
+
+    if (!shared) {
+        // nobody depends on the history, start it over
+        if (!mvd.zfull) {
+            deflateReset(&mvd.z);
+            mvd.zfull = qtrue;
+        }
+        mvd.zframes = 0;
+        return;
+    }
+
+    if (waiting && ++mvd.zframes >= GTV_JOIN_FRAMES) {
+        flush = Z_FULL_FLUSH;
+        mvd.zframes = 0;
+    } else {
+        flush = Z_SYNC_FLUSH;
+    }
+
+    if (deflate_shared(header, 3, Z_NO_FLUSH) &&
+        deflate_shared(mvd.message.data, mvd.message.cursize, Z_NO_FLUSH) &&
+        deflate_shared(msg_write.data, msg_write.cursize, Z_NO_FLUSH) &&
+        deflate_shared(mvd.datagram.data, mvd.datagram.cursize, flush)) {
+        mvd.zfull = flush == Z_FULL_FLUSH;
+        return;
+    }
+
+    FOR_EACH_ACTIVE_GTV(client) {
+        if (client->shared) {
+            drop_client(client, "deflate() failed");
+        }
+    }
+    deflateReset(&mvd.z);
+    mvd.zfull = qtrue;
+}
+
+static void write_shared(gtv_client_t *client)
+{
+    // sent directly from the shared buffer if client is keeping up
+    if (NET_WriteStream(&client->stream, mvd.zbuf, mvd.zlen) != mvd.zlen) {
+        drop_client(client, "overflowed");
+        return;
+    }
+
+    // keep zlib trailer valid for this client
+    client->z.adler = adler32_combine(client->z.adler, mvd.zadler, mvd.zinlen);
+}
+
+// switches client to the shared stream after a full flush point
+static void join_shared(gtv_client_t *client)
+{
+    if (flush_stream(client, Z_SYNC_FLUSH)) {
+        client->shared = qtrue;
+        client->bufcount = 0;
+    }
+}
+
+// own deflater must not refer to data it didn't compress
+static void leave_shared(gtv_client_t *client)
+{
+    client->shared = qfalse;
+    if (!flush_stream(client, Z_FULL_FLUSH)) {
+        drop_client(client, "overflowed");
+    }
+}
+#endif
+
 /*
 ==================
 SV_MvdEndFrame
@@ -988,14 +1232,28 @@ void SV_MvdEndFrame(void)
     header[1] = (total >> 8) & 255;
     header[2] = GTS_STREAM_DATA;
 
+#if USE_ZLIB
+    // compress frame once for clients on the shared stream
+    deflate_frame(header);
+#endif
+
     // send frame to clients
     FOR_EACH_ACTIVE_GTV(client) {
+#if USE_ZLIB
+        if (client->shared) {
+            write_shared(client);
+            NET_UpdateStream(&client->stream);
+            continue;
+        }
+#endif
         write_stream(client, header, sizeof(header));
         write_stream(client, mvd.message.data, mvd.message.cursize);
         write_stream(client, msg_write.data, msg_write.cursize);
         write_stream(client, mvd.datagram.data, mvd.datagram.cursize);
 #if USE_ZLIB
-        if (++client->bufcount > client->maxbuf) {
+        if (client->z.state && mvd.zfull) {
+            join_shared(client);
+        } else if (++client->bufcount > client->maxbuf) {
             flush_stream(client, Z_SYNC_FLUSH);
         }
 #endif
@@ -1010,6 +1268,10 @@ void SV_MvdEndFrame(void)
     // clear frame
     SZ_Clear(&msg_write);
 
+    if (mvd.recording) {
+        rec_snapshot();
+    }
+
     // clear datagrams
     SZ_Clear(&mvd.datagram);
     SZ_Clear(&mvd.message);
@@ -1134,6 +1396,9 @@ SV_MvdConfigstring
 */
 void SV_MvdConfigstring(int index, const char *string, size_t len)
 {
+    if (mvd.recording) {
+        Q_SetBit(mvd.recdcs, index);
+    }
     if (mvd.active) {
         SZ_WriteByte(&mvd.message, mvd_configstring);
         SZ_WriteShort(&mvd.message, index);
@@ -1220,7 +1485,7 @@ static void remove_client(gtv_client_t *client)
 }
 
 #if USE_ZLIB
-static void flush_stream(gtv_client_t *client, int flush)
+static qboolean flush_stream(gtv_client_t *client, int flush)
 {
     fifo_t *fifo = &client->stream.send;
     z_streamp z = &client->z;
@@ -1229,10 +1494,10 @@ static void flush_stream(gtv_client_t *client, int flush)
     int ret;
 
     if (client->state <= cs_zombie) {
-        return;
+        return qfalse;
     }
     if (!z->state) {
-        return;
+        return qfalse;
     }
 
     z->next_in = NULL;
@@ -1242,7 +1507,7 @@ static void flush_stream(gtv_client_t *client, int flush)
         data = FIFO_Reserve(fifo, &len);
         if (!len) {
             // FIXME: this is not an error when flushing
-            return;
+            return qfalse;
         }
 
         z->next_out = data;
@@ -1256,6 +1521,8 @@ static void flush_stream(gtv_client_t *client, int flush)
             client->bufcount = 0;
         }
     } while (ret == Z_OK);
+
+    return qtrue;
 }
 #endif
 
@@ -1274,6 +1541,7 @@ static void drop_client(gtv_client_t *client, const char *error)
 #if USE_ZLIB
     if (client->z.state) {
         // finish zlib stream
+        client->shared = qfalse;
         flush_stream(client, Z_FINISH);
         deflateEnd(&client->z);
     }
@@ -1301,6 +1569,13 @@ static void write_stream(gtv_client_t *client, void *data, size_t len)
     if (client->z.state) {
         z_streamp z = &client->z;
 
+        if (client->shared) {
+            leave_shared(client);
+            if (client->state <= cs_zombie) {
+                return;
+            }
+        }
+
         z->next_in = data;
         z->avail_in = (uInt)len;
 
@@ -1406,6 +1681,9 @@ static void parse_hello(gtv_client_t *client)
 #if !USE_ZLIB
     flags &= ~GTF_DEFLATE;
 #endif
+    if (!(flags & GTF_DEFLATE)) {
+        flags &= ~GTF_ZDICT;
+    }
 
     Cvar_ClampInteger(sv_mvd_bufsize, 1, 4);
 
@@ -1432,6 +1710,10 @@ static void parse_hello(gtv_client_t *client)
             drop_client(client, "deflateInit failed");
             return;
         }
+        // gamestate goes out first, this saves most on it
+        if (flags & GTF_ZDICT) {
+            deflateSetDictionary(&client->z, (const Bytef *)zdict_data, (uInt)zdict_size);
+        }
     }
 #endif
 
@@ -1754,6 +2036,12 @@ void SV_MvdRunClients(void)
     }
 }
 
+// number of GTV clients connected, for metrics
+int SV_MvdClientCount(void)
+{
+    return List_Count(&gtv_client_list);
+}
+
 static void dump_clients(void)
 {
     gtv_client_t    *client;
@@ -2030,6 +2318,12 @@ void SV_MvdShutdown(error_type_t type)
     // free static data
     Z_Free(mvd.message.data);
     Z_Free(mvd.clients);
+#if USE_ZLIB
+    if (mvd.z.state) {
+        deflateEnd(&mvd.z);
+    }
+    Z_Free(mvd.zbuf);
+#endif
 
     // close server TCP socket
     NET_Listen(qfalse);
@@ -2052,10 +2346,19 @@ static void rec_write(void)
 {
     uint16_t msglen;
     ssize_t ret;
+    off_t pos;
 
     if (!msg_write.cursize)
         return;
 
+    // gamestate starts a new level for the seek index, and counts
+    // as the first frame like on the player side
+    pos = FS_Tell(mvd.recording);
+    mvd.reclevel = pos;
+    mvd.recframes = 1;
+    mvd.recsnap = 1;
+    memset(mvd.recdcs, 0, sizeof(mvd.recdcs));
+
     msglen = LittleShort(msg_write.cursize);
     ret = FS_Write(&msglen, 2, mvd.recording);
     if (ret != 2)
@@ -2069,6 +2372,83 @@ fail:
     rec_stop();
 }
 
+/*
+==============
+rec_snapshot
+
+Saves a seek index snapshot every sv_mvd_index seconds.
+==============
+*/
+static void rec_snapshot(void)
+{
+    rec_snap_t *snap;
+    off_t pos;
+
+    if (!mvd.recindex || sv_mvd_index->integer <= 0) {
+        return;
+    }
+
+    if (mvd.recframes < mvd.recsnap + sv_mvd_index->integer * 10) {
+        return;
+    }
+
+    pos = FS_Tell(mvd.recording);
+    if (pos < 0 || pos > UINT32_MAX) {
+        return;
+    }
+
+    emit_snapshot();
+
+    snap = SV_Malloc(sizeof(*snap) + msg_write.cursize - 1);
+    snap->levelpos = mvd.reclevel;
+    snap->framenum = mvd.recframes;
+    snap->filepos = pos;
+    snap->msglen = msg_write.cursize;
+    memcpy(snap->data, msg_write.data, msg_write.cursize);
+    List_Append(&mvd.recsnaps, &snap->entry);
+
+    SZ_Clear(&msg_write);
+
+    mvd.recsnap = mvd.recframes;
+}
+
+static void rec_write_index(void)
+{
+    rec_snap_t *snap;
+    uint32_t header[3], footer[3];
+    uint16_t msglen;
+    off_t pos;
+    int count = 0;
+
+    pos = FS_Tell(mvd.recording);
+    if (pos < 0 || pos > UINT32_MAX) {
+        return;
+    }
+
+    LIST_FOR_EACH(rec_snap_t, snap, &mvd.recsnaps, entry) {
+        header[0] = LittleLong(snap->levelpos);
+        header[1] = LittleLong(snap->framenum);
+        header[2] = LittleLong(snap->filepos);
+        msglen = LittleShort(snap->msglen);
+        if (FS_Write(header, sizeof(header), mvd.recording) != sizeof(header))
+            return;
+        if (FS_Write(&msglen, 2, mvd.recording) != 2)
+            return;
+        if (FS_Write(snap->data, snap->msglen, mvd.recording) != snap->msglen)
+            return;
+        count++;
+    }
+
+    if (!count) {
+        return;
+    }
+
+    footer[0] = LittleLong(pos);
+    footer[1] = LittleLong(count);
+    footer[2] = MVD_INDEX_MAGIC;
+    FS_Write(footer, sizeof(footer), mvd.recording);
+}
+
 /*
 ==============
 rec_stop
@@ -2078,6 +2458,7 @@ Stops server local MVD recording.
 */
 static void rec_stop(void)
 {
+    rec_snap_t *snap, *next;
     uint16_t msglen;
 
     if (!mvd.recording) {
@@ -2088,6 +2469,16 @@ static void rec_stop(void)
     msglen = 0;
     FS_Write(&msglen, 2, mvd.recording);
 
+    // seek index goes after it, older players stop reading before
+    if (mvd.recindex) {
+        rec_write_index();
+    }
+
+    LIST_FOR_EACH_SAFE(rec_snap_t, snap, next, &mvd.recsnaps, entry) {
+        Z_Free(snap);
+    }
+    List_Init(&mvd.recsnaps);
+
     FS_FCloseFile(mvd.recording);
     mvd.recording = 0;
 }
@@ -2105,13 +2496,18 @@ static qboolean rec_allowed(void)
     return qtrue;
 }
 
-static void rec_start(qhandle_t demofile)
+static void rec_start(qhandle_t demofile, qboolean indexed)
 {
     uint32_t magic;
 
     mvd.recording = demofile;
     mvd.numlevels = 0;
     mvd.numframes = 0;
+    mvd.recindex = indexed;
+    mvd.reclevel = 0;
+    mvd.recframes = 0;
+    mvd.recsnap = 0;
+    List_Init(&mvd.recsnaps);
     mvd.clients_active = svs.realtime;
 
     magic = MVD_MAGIC;
@@ -2136,7 +2532,7 @@ void SV_MvdRecord_f(void)
 {
     char buffer[MAX_OSPATH];
     qhandle_t f;
-    unsigned mode = FS_MODE_WRITE;
+    unsigned mode = FS_MODE_WRITE | FS_FLAG_ASYNC;
     int c;
 
     if (sv.state != ss_game) {
@@ -2185,7 +2581,8 @@ void SV_MvdRecord_f(void)
 
     Com_Printf("Recording local MVD to %s\n", buffer);
 
-    rec_start(f);
+    // compressed files are not seekable enough to use the index
+    rec_start(f, !(mode & FS_FLAG_GZIP));
 }
 
 
@@ -2272,6 +2669,7 @@ void SV_MvdRegister(void)
     sv_mvd_scorecmd = Cvar_Get("sv_mvd_scorecmd",
                                "putaway; wait 10; help;", 0);
     sv_mvd_autorecord = Cvar_Get("sv_mvd_autorecord", "0", CVAR_LATCH);
+    sv_mvd_index = Cvar_Get("sv_mvd_index", "10", 0);
     sv_mvd_capture_flags = Cvar_Get("sv_mvd_capture_flags", "5", 0);
     sv_mvd_disconnect_time = Cvar_Get("sv_mvd_disconnect_time", "15", 0);
     sv_mvd_suspend_time = Cvar_Get("sv_mvd_suspend_time", "5", 0);
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "client.h"
 #include "server/mvd/protocol.h"
+#include "system/thread.h"
 #include <setjmp.h>
 
 #define FOR_EACH_GTV(gtv) \
@@ -79,6 +80,9 @@ typedef struct gtv_s {
     string_entry_t  *demohead, *demoentry;
     size_t          demosize, demopos;
     qboolean        demowait;
+    byte            *demoindex;     // seek index block of current file
+    size_t          demoindexlen;
+    off_t           demolevel;      // offset of the last gamestate
 } gtv_t;
 
 static const char *const gtv_states[GTV_NUM_STATES] = {
@@ -120,6 +124,8 @@ static cvar_t  *mvd_buffer_size;
 static cvar_t  *mvd_username;
 static cvar_t  *mvd_password;
 static cvar_t  *mvd_snaps;
+static cvar_t  *mvd_snaps_maxsize;
+static cvar_t  *mvd_inflate_threads;
 
 // ====================================================================
 
@@ -151,6 +157,9 @@ static void MVD_Free(mvd_t *mvd)
         MVD_StopRecord(mvd);
     }
 
+    // finish client demos
+    MVD_Dm2End(mvd);
+
     for (i = 0; i < mvd->maxclients; i++) {
         MVD_FreePlayer(&mvd->players[i]);
     }
@@ -316,14 +325,13 @@ gtv_destroyf(gtv_t *gtv, const char *fmt, ...)
     longjmp(mvd_jmpbuf, -1);
 }
 
-static mvd_t *create_channel(gtv_t *gtv)
+static mvd_t *alloc_channel(int id, const char *name)
 {
     mvd_t *mvd;
 
     mvd = MVD_Mallocz(sizeof(*mvd));
-    mvd->gtv = gtv;
-    mvd->id = gtv->id;
-    Q_strlcpy(mvd->name, gtv->name, sizeof(mvd->name));
+    mvd->id = id;
+    Q_strlcpy(mvd->name, name, sizeof(mvd->name));
     mvd->pool.edicts = mvd->edicts;
     mvd->pool.edict_size = sizeof(edict_t);
     mvd->pool.max_edicts = MAX_EDICTS;
@@ -336,6 +344,14 @@ static mvd_t *create_channel(gtv_t *gtv)
     return mvd;
 }
 
+static mvd_t *create_channel(gtv_t *gtv)
+{
+    mvd_t *mvd = alloc_channel(gtv->id, gtv->name);
+
+    mvd->gtv = gtv;
+    return mvd;
+}
+
 static gtv_t *gtv_set_conn(int arg)
 {
     char *s = Cmd_Argv(arg);
@@ -397,6 +413,11 @@ static void set_mvd_active(void)
     }
 }
 
+#if USE_ZLIB
+static qboolean MVD_InitInflateThreads(void);
+static int run_threaded(void);
+#endif
+
 /*
 ==============
 MVD_Frame
@@ -413,6 +434,12 @@ int MVD_Frame(void)
         set_mvd_active();
     }
 
+#if USE_ZLIB
+    if (MVD_InitInflateThreads() && !LIST_SINGLE(&mvd_gtv_list)) {
+        return run_threaded();
+    }
+#endif
+
     // run all GTV connections (but not demos)
     LIST_FOR_EACH_SAFE(gtv_t, gtv, next, &mvd_gtv_list, entry) {
         if (setjmp(mvd_jmpbuf)) {
@@ -527,12 +554,14 @@ static ssize_t demo_read_message(qhandle_t f)
     return msglen;
 }
 
-static ssize_t demo_read_first(qhandle_t f)
+static ssize_t demo_read_first(qhandle_t f, qboolean *gzip)
 {
     uint32_t magic;
     ssize_t read;
     qerror_t ret;
 
+    *gzip = qfalse;
+
     // read magic
     read = FS_Read(&magic, 4, f);
     if (read != 4) {
@@ -545,6 +574,7 @@ static ssize_t demo_read_first(qhandle_t f)
         if (ret) {
             return ret;
         }
+        *gzip = qtrue;
         read = FS_Read(&magic, 4, f);
         if (read != 4) {
             return read < 0 ? read : Q_ERR_UNEXPECTED_EOF;
@@ -561,9 +591,94 @@ static ssize_t demo_read_first(qhandle_t f)
 
 // periodically builds a fake demo packet used to reconstruct delta compression
 // state, configstrings and layouts at the given server frame.
-static void demo_emit_snapshot(mvd_t *mvd)
+static byte demo_snap_buffer[MAX_MSGLEN];
+
+static void demo_add_snapshot(mvd_t *mvd, int framenum, off_t filepos,
+                              const byte *data, size_t len)
 {
     mvd_snap_t *snap;
+    size_t datalen = len;
+#if USE_ZLIB
+    uLongf zlen = sizeof(demo_snap_buffer);
+
+    if (compress2(demo_snap_buffer, &zlen, data, len, Z_BEST_SPEED) == Z_OK && zlen < len) {
+        data = demo_snap_buffer;
+        datalen = zlen;
+    }
+#endif
+
+    snap = MVD_Malloc(sizeof(*snap) + datalen - 1);
+    snap->framenum = framenum;
+    snap->filepos = filepos;
+    snap->msglen = len;
+    snap->datalen = datalen;
+    memcpy(snap->data, data, datalen);
+    List_Append(&mvd->snapshots, &snap->entry);
+
+    mvd->snapshots_size += datalen;
+}
+
+// returns uncompressed snapshot data in msg_read_buffer, or in place
+static byte *demo_read_snapshot(mvd_snap_t *snap)
+{
+#if USE_ZLIB
+    uLongf len = snap->msglen;
+
+    if (snap->datalen == snap->msglen)
+        return snap->data;
+
+    if (uncompress(msg_read_buffer, &len, snap->data, snap->datalen) != Z_OK || len != snap->msglen)
+        return NULL;
+
+    return msg_read_buffer;
+#else
+    return snap->data;
+#endif
+}
+
+// drops snapshots far from the current frame until within mvd_snaps_maxsize
+static void demo_thin_snapshots(mvd_t *mvd)
+{
+    mvd_snap_t *snap, *prev, *next, *best;
+    size_t maxsize;
+    float score, best_score;
+    int dist;
+
+    if (mvd_snaps_maxsize->integer <= 0)
+        return;
+
+    maxsize = (size_t)mvd_snaps_maxsize->integer << 10;
+
+    while (mvd->snapshots_size > maxsize) {
+        best = NULL;
+        best_score = 0;
+        LIST_FOR_EACH(mvd_snap_t, snap, &mvd->snapshots, entry) {
+            if (snap->entry.prev == &mvd->snapshots)
+                continue;
+            if (snap->entry.next == &mvd->snapshots)
+                break;
+            prev = LIST_PREV(mvd_snap_t, snap, entry);
+            next = LIST_NEXT(mvd_snap_t, snap, entry);
+            dist = abs(snap->framenum - mvd->framenum);
+            score = (float)(next->framenum - prev->framenum) / (dist + 1);
+            if (!best || score < best_score) {
+                best = snap;
+                best_score = score;
+            }
+        }
+
+        if (!best)
+            break;
+
+        Com_DPrintf("[%d] dropping snap at %d\n", mvd->framenum, best->framenum);
+        mvd->snapshots_size -= best->datalen;
+        List_Remove(&best->entry);
+        Z_Free(best);
+    }
+}
+
+static void demo_emit_snapshot(mvd_t *mvd)
+{
     gtv_t *gtv;
     off_t pos;
     char *from, *to;
@@ -611,18 +726,95 @@ static void demo_emit_snapshot(mvd_t *mvd)
 
     // TODO: write private layouts/configstrings
 
-    snap = MVD_Malloc(sizeof(*snap) + msg_write.cursize - 1);
-    snap->framenum = mvd->framenum;
-    snap->filepos = pos;
-    snap->msglen = msg_write.cursize;
-    memcpy(snap->data, msg_write.data, msg_write.cursize);
-    List_Append(&mvd->snapshots, &snap->entry);
+    demo_add_snapshot(mvd, mvd->framenum, pos, msg_write.data, msg_write.cursize);
 
     Com_DPrintf("[%d] snaplen %"PRIz"\n", mvd->framenum, msg_write.cursize);
 
     SZ_Clear(&msg_write);
 
     mvd->last_snapshot = mvd->framenum;
+
+    demo_thin_snapshots(mvd);
+}
+
+// loads seek index written by the recorder past the demo EOF marker
+static void demo_load_index(gtv_t *gtv)
+{
+    qhandle_t f = gtv->demoplayback;
+    uint32_t footer[3];
+    ssize_t pos, len, start;
+
+    pos = FS_Tell(f);
+    len = FS_Length(f);
+    if (pos < 0 || len < pos + MVD_INDEX_FOOTER)
+        return;
+
+    if (FS_Seek(f, len - MVD_INDEX_FOOTER))
+        goto done;
+    if (FS_Read(footer, sizeof(footer), f) != sizeof(footer))
+        goto done;
+    if (footer[2] != MVD_INDEX_MAGIC)
+        goto done;
+
+    start = LittleLong(footer[0]);
+    if (start < pos || start > len - MVD_INDEX_FOOTER)
+        goto done;
+    if (FS_Seek(f, start))
+        goto done;
+
+    len -= MVD_INDEX_FOOTER + start;
+    gtv->demoindex = MVD_Malloc(len);
+    if (FS_Read(gtv->demoindex, len, f) != len) {
+        Z_Free(gtv->demoindex);
+        gtv->demoindex = NULL;
+        goto done;
+    }
+    gtv->demoindexlen = len;
+
+    Com_DPrintf("[%s] loaded %u index snapshots\n", gtv->name, LittleLong(footer[1]));
+
+done:
+    FS_Seek(f, pos);
+}
+
+static void demo_free_index(gtv_t *gtv)
+{
+    Z_Free(gtv->demoindex);
+    gtv->demoindex = NULL;
+    gtv->demoindexlen = 0;
+}
+
+// called after each gamestate, turns index entries for this level into
+// snapshots so that seeking forward doesn't need to parse the whole file
+static void demo_apply_index(gtv_t *gtv, off_t levelpos)
+{
+    mvd_t *mvd = gtv->mvd;
+    byte *data = gtv->demoindex;
+    byte *end = data + gtv->demoindexlen;
+    uint32_t header[3];
+    uint16_t msglen;
+
+    gtv->demolevel = levelpos;
+    mvd->last_snapshot = 0;
+
+    while (end - data >= sizeof(header) + 2) {
+        memcpy(header, data, sizeof(header));
+        memcpy(&msglen, data + sizeof(header), 2);
+        data += sizeof(header) + 2;
+        msglen = LittleShort(msglen);
+        if (msglen > end - data)
+            break;
+
+        if (LittleLong(header[0]) == levelpos) {
+            demo_add_snapshot(mvd, LittleLong(header[1]),
+                              LittleLong(header[2]), data, msglen);
+            mvd->last_snapshot = LittleLong(header[1]);
+        }
+
+        data += msglen;
+    }
+
+    demo_thin_snapshots(mvd);
 }
 
 static mvd_snap_t *demo_find_snapshot(mvd_t *mvd, int framenum)
@@ -698,7 +890,9 @@ static qboolean demo_read_frame(mvd_t *mvd)
 
     demo_update(gtv);
 
-    MVD_ParseMessage(mvd);
+    if (MVD_ParseMessage(mvd)) {
+        demo_apply_index(gtv, FS_Tell(gtv->demoplayback) - ret - 2);
+    }
     demo_emit_snapshot(mvd);
     return qtrue;
 
@@ -710,6 +904,7 @@ next:
 static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
 {
     ssize_t len, ret;
+    qboolean gzip;
 
     if (!entry) {
         if (gtv->demoloop) {
@@ -725,6 +920,7 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
         FS_FCloseFile(gtv->demoplayback);
         gtv->demoplayback = 0;
     }
+    demo_free_index(gtv);
 
     // open new file
     len = FS_FOpenFile(entry->string, &gtv->demoplayback, FS_MODE_READ);
@@ -733,7 +929,7 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
     }
 
     // read the first message
-    ret = demo_read_first(gtv->demoplayback);
+    ret = demo_read_first(gtv->demoplayback, &gzip);
     if (ret < 0) {
         gtv_destroyf(gtv, "Couldn't read %s: %s", entry->string, Q_ErrorString(ret));
     }
@@ -754,6 +950,14 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
         gtv_destroyf(gtv, "First message of %s does not contain gamestate", entry->string);
     }
 
+    if (!gzip) {
+        demo_load_index(gtv);
+    }
+
+    // keep disk latency out of game frames, after seeking for the index
+    FS_ReadAhead(gtv->demoplayback, entry->string);
+    demo_apply_index(gtv, FS_Tell(gtv->demoplayback) - ret - 2);
+
     gtv->mvd->state = MVD_READING;
 
     // reset state
@@ -801,6 +1005,7 @@ static void demo_destroy(gtv_t *gtv)
         gtv->demoplayback = 0;
     }
 
+    demo_free_index(gtv);
     demo_free_playlist(gtv);
 
     Z_Free(gtv);
@@ -1019,7 +1224,7 @@ static void send_hello(gtv_t *gtv)
     int flags = GTF_STRINGCMDS;
 
 #if USE_ZLIB
-    flags |= GTF_DEFLATE;
+    flags |= GTF_DEFLATE | GTF_ZDICT;
 #endif
 
     MSG_WriteShort(GTV_PROTOCOL_VERSION);
@@ -1379,6 +1584,15 @@ static void inflate_more(gtv_t *gtv)
         inflateReset(&gtv->z_str);
         gtv->z_act = qfalse;
         break;
+    case Z_NEED_DICT:
+        // zlib header names the dictionary, so servers that don't
+        // know about GTF_ZDICT never get here
+        if (inflateSetDictionary(&gtv->z_str, (const Bytef *)zdict_data,
+                                 (uInt)zdict_size) != Z_OK) {
+            gtv_destroyf(gtv, "inflateSetDictionary() failed: %s", gtv->z_str.msg);
+        }
+        inflate_more(gtv);
+        break;
     default:
         gtv_destroyf(gtv, "inflate() failed: %s", gtv->z_str.msg);
     }
@@ -1416,19 +1630,14 @@ static neterr_t run_connect(gtv_t *gtv)
     return NET_OK;
 }
 
-static neterr_t run_stream(gtv_t *gtv)
+// parses data received by NET_RunStream
+static void run_stream(gtv_t *gtv)
 {
-    neterr_t ret;
 #ifdef _DEBUG
     int count;
     size_t usage;
 #endif
 
-    // run network stream
-    if ((ret = NET_RunStream(&gtv->stream)) != NET_OK) {
-        return ret;
-    }
-
 #ifdef _DEBUG
     count = 0;
     usage = FIFO_Usage(&gtv->stream.recv);
@@ -1464,8 +1673,6 @@ static neterr_t run_stream(gtv_t *gtv)
                    gtv->name, total, count);
     }
 #endif
-
-    return NET_OK;
 }
 
 static void check_timeouts(gtv_t *gtv)
@@ -1524,31 +1731,41 @@ static qboolean check_reconnect(gtv_t *gtv)
     return qtrue;
 }
 
-static void gtv_run(gtv_t *gtv)
+// first half of gtv_run, does socket I/O only. Returns false if there is
+// nothing else to do with this connection this frame.
+static qboolean gtv_recv(gtv_t *gtv, neterr_t *ret)
 {
-    neterr_t ret = NET_AGAIN;
-
     // check if it is time to reconnect
     if (!gtv->state) {
         if (!check_reconnect(gtv)) {
-            return;
+            return qfalse;
         }
     }
 
     // run network stream
     switch (gtv->stream.state) {
     case NS_CONNECTING:
-        ret = run_connect(gtv);
-        if (ret == NET_AGAIN) {
-            return;
+        *ret = run_connect(gtv);
+        if (*ret == NET_AGAIN) {
+            return qfalse;
         }
-        if (ret == NET_OK) {
-        case NS_CONNECTED:
-            ret = run_stream(gtv);
+        if (*ret != NET_OK) {
+            return qtrue;
         }
-        break;
+        // fall through
+    case NS_CONNECTED:
+        *ret = NET_RunStream(&gtv->stream);
+        return qtrue;
     default:
-        return;
+        return qfalse;
+    }
+}
+
+// second half of gtv_run, parses received data
+static void gtv_process(gtv_t *gtv, neterr_t ret)
+{
+    if (ret == NET_OK) {
+        run_stream(gtv);
     }
 
     switch (ret) {
@@ -1567,6 +1784,208 @@ static void gtv_run(gtv_t *gtv)
     }
 }
 
+static void gtv_run(gtv_t *gtv)
+{
+    neterr_t ret;
+
+    if (gtv_recv(gtv, &ret)) {
+        gtv_process(gtv, ret);
+    }
+}
+
+/*
+====================================================================
+
+THREADED INFLATE
+
+With many GTV connections, decompressing the streams is the part of
+MVD_Frame that grows with the number of channels. Sockets are still read
+and messages still parsed on the main thread, in connection order, but
+inflating received data into z_buf is spread over worker threads.
+
+====================================================================
+*/
+
+#if USE_ZLIB
+
+#define MAX_INFLATE_THREADS 8
+
+typedef struct {
+    gtv_t       *gtv;
+    neterr_t    ret;
+} gtvjob_t;
+
+static struct {
+    qthread_t   *threads[MAX_INFLATE_THREADS];
+    int         numthreads;
+    qmutex_t    *lock;
+    qcond_t     *wake;
+    qcond_t     *done;
+    qboolean    quit;
+
+    gtvjob_t    *jobs;
+    int         maxjobs;
+    int         numjobs;
+    int         nextjob;
+    int         finished;
+} it;
+
+// inflate window is allocated by zlib on first output, and zalloc uses
+// the zone allocator, so that first call must be made by the main thread
+static qboolean can_inflate_async(gtvjob_t *job)
+{
+    gtv_t *gtv = job->gtv;
+
+    return job->ret == NET_OK && gtv->z_act && gtv->z_str.total_out &&
+        FIFO_Usage(&gtv->stream.recv) && FIFO_Usage(&gtv->z_buf) < gtv->z_buf.size;
+}
+
+// called with the lock held, returns with it held
+static void MVD_RunInflateJobs(void)
+{
+    gtvjob_t *job;
+
+    while (it.nextjob < it.numjobs) {
+        job = &it.jobs[it.nextjob++];
+        Sys_UnlockMutex(it.lock);
+
+        // errors and stream end are picked up again by inflate_more()
+        if (can_inflate_async(job)) {
+            inflate_stream(&job->gtv->z_buf, &job->gtv->stream.recv, &job->gtv->z_str);
+        }
+
+        Sys_LockMutex(it.lock);
+        if (++it.finished == it.numjobs) {
+            Sys_SignalCond(it.done);
+        }
+    }
+}
+
+static void MVD_InflateThread(void *arg)
+{
+    Sys_LockMutex(it.lock);
+    while (1) {
+        while (!it.quit && it.nextjob >= it.numjobs) {
+            Sys_WaitCond(it.wake, it.lock);
+        }
+        if (it.quit) {
+            break;
+        }
+        MVD_RunInflateJobs();
+    }
+    Sys_UnlockMutex(it.lock);
+}
+
+static void MVD_ShutdownInflateThreads(void)
+{
+    int i;
+
+    if (it.numthreads) {
+        Sys_LockMutex(it.lock);
+        it.quit = qtrue;
+        Sys_BroadcastCond(it.wake);
+        Sys_UnlockMutex(it.lock);
+
+        for (i = 0; i < it.numthreads; i++) {
+            Sys_JoinThread(it.threads[i]);
+        }
+
+        Sys_DestroyCond(it.done);
+        Sys_DestroyCond(it.wake);
+        Sys_DestroyMutex(it.lock);
+    }
+
+    Z_Free(it.jobs);
+    memset(&it, 0, sizeof(it));
+
+    mvd_inflate_threads->modified = qtrue;
+}
+
+static qboolean MVD_InitInflateThreads(void)
+{
+    int i, count;
+
+    if (mvd_inflate_threads->modified) {
+        MVD_ShutdownInflateThreads();
+        mvd_inflate_threads->modified = qfalse;
+
+        count = Cvar_ClampInteger(mvd_inflate_threads, 0, MAX_INFLATE_THREADS);
+        if (count) {
+            it.lock = Sys_CreateMutex();
+            it.wake = Sys_CreateCond();
+            it.done = Sys_CreateCond();
+            for (i = 0; i < count; i++) {
+                it.threads[i] = Sys_CreateThread(MVD_InflateThread, NULL);
+            }
+            it.numthreads = count;
+        }
+    }
+
+    return it.numthreads > 0;
+}
+
+static int run_threaded(void)
+{
+    gtv_t *gtv, *next;
+    gtvjob_t *job;
+    int i, count, numjobs, async;
+
+    count = List_Count(&mvd_gtv_list);
+    if (count > it.maxjobs) {
+        Z_Free(it.jobs);
+        it.jobs = MVD_Malloc(sizeof(*it.jobs) * count);
+        it.maxjobs = count;
+    }
+
+    // read sockets
+    numjobs = 0;
+    LIST_FOR_EACH_SAFE(gtv_t, gtv, next, &mvd_gtv_list, entry) {
+        if (setjmp(mvd_jmpbuf)) {
+            SZ_Clear(&msg_write);
+            continue;
+        }
+
+        job = &it.jobs[numjobs];
+        job->gtv = gtv;
+        job->ret = NET_AGAIN;
+        if (gtv_recv(gtv, &job->ret)) {
+            numjobs++;
+        }
+    }
+
+    // decompress in parallel, helping the workers
+    async = 0;
+    for (i = 0; i < numjobs; i++) {
+        async += can_inflate_async(&it.jobs[i]);
+    }
+    if (async > 1) {
+        Sys_LockMutex(it.lock);
+        it.numjobs = numjobs;
+        it.nextjob = it.finished = 0;
+        Sys_BroadcastCond(it.wake);
+        MVD_RunInflateJobs();
+        while (it.finished < it.numjobs) {
+            Sys_WaitCond(it.done, it.lock);
+        }
+        it.numjobs = it.nextjob = 0;
+        Sys_UnlockMutex(it.lock);
+    }
+
+    // parse messages
+    for (i = 0; i < numjobs; i++) {
+        if (setjmp(mvd_jmpbuf)) {
+            SZ_Clear(&msg_write);
+            continue;
+        }
+
+        gtv_process(it.jobs[i].gtv, it.jobs[i].ret);
+    }
+
+    return count;
+}
+
+#endif // USE_ZLIB
+
 static void gtv_destroy(gtv_t *gtv)
 {
     mvd_t *mvd = gtv->mvd;
@@ -1899,7 +2318,7 @@ void MVD_StreamedRecord_f(void)
     mvd_t *mvd;
     uint32_t magic;
     uint16_t msglen;
-    unsigned mode = FS_MODE_WRITE;
+    unsigned mode = FS_MODE_WRITE | FS_FLAG_ASYNC;
     ssize_t ret;
     int c;
 
@@ -2163,6 +2582,7 @@ static void MVD_Seek_f(void)
     char *from, *to;
     edict_t *ent;
     qboolean gamestate;
+    byte *data;
 
     if (Cmd_Argc() < 2) {
         Com_Printf("Usage: %s [+-]<timespec> [chanid]\n", Cmd_Argv(0));
@@ -2225,8 +2645,15 @@ static void MVD_Seek_f(void)
     if (frames < 0 || mvd->last_snapshot > mvd->framenum) {
         snap = demo_find_snapshot(mvd, dest);
 
-        if (snap) {
+        // going forward, only jump if that skips some frames
+        if (snap && (frames < 0 || snap->framenum > mvd->framenum)) {
             Com_DPrintf("found snap at %d\n", snap->framenum);
+            data = demo_read_snapshot(snap);
+            if (!data) {
+                Com_EPrintf("[%s] Couldn't decompress demo snapshot\n", mvd->name);
+                goto done;
+            }
+
             ret = FS_Seek(gtv->demoplayback, snap->filepos);
             if (ret < 0) {
                 Com_EPrintf("[%s] Couldn't seek demo: %s\n", mvd->name, Q_ErrorString(ret));
@@ -2251,7 +2678,7 @@ static void MVD_Seek_f(void)
             // set player names
             MVD_SetPlayerNames(mvd);
 
-            SZ_Init(&msg_read, snap->data, snap->msglen);
+            SZ_Init(&msg_read, data, snap->msglen);
             msg_read.cursize = snap->msglen;
 
             MVD_ParseMessage(mvd);
@@ -2277,6 +2704,7 @@ static void MVD_Seek_f(void)
         if (gamestate) {
             // got a gamestate, abort seek
             Com_DPrintf("got gamestate while seeking!\n");
+            demo_apply_index(gtv, FS_Tell(gtv->demoplayback) - ret - 2);
             goto done;
         }
     }
@@ -2329,6 +2757,127 @@ done:
     mvd->demoseeking = qfalse;
 }
 
+static const cmd_option_t o_mvdtranscode[] = {
+    { "h", "help", "display this message" },
+    { "b", "bench", "measure encoding, don't write demos" },
+    { "e", "extended", "use extended message size" },
+    { "o:string", "output", "name output files after <string>" },
+    { "p:player", "player", "write demo of <player> only" },
+    { NULL }
+};
+
+static void MVD_Transcode_f(void)
+{
+    char buffer[MAX_OSPATH];
+    char base[MAX_QPATH], temp[MAX_QPATH];
+    char *output = NULL, *player = NULL;
+    size_t maxmsglen = MAX_PACKETLEN_WRITABLE_DEFAULT;
+    qboolean bench = qfalse;
+    unsigned start, count, files;
+    qboolean gzip;
+    qhandle_t f;
+    ssize_t ret;
+    mvd_t *mvd;
+    int c;
+
+    while ((c = Cmd_ParseOptions(o_mvdtranscode)) != -1) {
+        switch (c) {
+        case 'h':
+            Cmd_PrintUsage(o_mvdtranscode, "[/]<filename>");
+            Com_Printf("Convert MVD into client demos as fast as possible.\n");
+            Cmd_PrintHelp(o_mvdtranscode);
+            Com_Printf("Writes demos of all players unless player is given by name or\n"
+                       "number. Output files are named <output>_<number>_<name>.dm2.\n"
+                       "In benchmark mode, frames are delta encoded with each protocol\n"
+                       "and parsed back, reporting encoded size and time per entity.\n");
+            return;
+        case 'b':
+            bench = qtrue;
+            break;
+        case 'e':
+            maxmsglen = MAX_PACKETLEN_WRITABLE;
+            break;
+        case 'o':
+            output = cmd_optarg;
+            break;
+        case 'p':
+            player = cmd_optarg;
+            break;
+        default:
+            return;
+        }
+    }
+
+    if (cmd_optind == Cmd_Argc()) {
+        Com_Printf("Missing filename argument.\n");
+        Cmd_PrintHint();
+        return;
+    }
+
+    f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_READ,
+                        "demos/", Cmd_Argv(cmd_optind), ".mvd2");
+    if (!f) {
+        return;
+    }
+
+    ret = demo_read_first(f, &gzip);
+    if (ret < 0) {
+        Com_EPrintf("Couldn't read %s: %s\n", buffer, Q_ErrorString(ret));
+        FS_FCloseFile(f);
+        return;
+    }
+
+    if (output) {
+        Q_strlcpy(base, output, sizeof(base));
+    } else {
+        // strip both extensions of .mvd2.gz
+        COM_StripExtension(COM_SkipPath(buffer), temp, sizeof(temp));
+        if (!COM_CompareExtension(temp, ".mvd2")) {
+            COM_StripExtension(temp, base, sizeof(base));
+        } else {
+            Q_strlcpy(base, temp, sizeof(base));
+        }
+    }
+
+    // this channel is never put on the channel list, so spectators
+    // can't join it and the game is not spawned for it
+    mvd = alloc_channel(-1, "dm2");
+    mvd->state = MVD_READING;
+    MVD_Dm2Begin(mvd, base, player, maxmsglen, bench);
+
+    Com_Printf("%s %s...\n", bench ? "Benchmarking" : "Transcoding", buffer);
+    start = Sys_Milliseconds();
+    count = 0;
+
+    if (setjmp(mvd_jmpbuf)) {
+        // the channel is already freed
+        FS_FCloseFile(f);
+        return;
+    }
+
+    do {
+        MVD_ParseMessage(mvd);
+        count++;
+    } while ((ret = demo_read_message(f)) > 0);
+
+    if (ret < 0) {
+        Com_EPrintf("Couldn't read %s: %s\n", buffer, Q_ErrorString(ret));
+    }
+
+    FS_FCloseFile(f);
+
+    files = MVD_Dm2End(mvd);
+    MVD_Free(mvd);
+
+    if (bench) {
+        Com_Printf("Parsed %u messages in %u ms.\n", count, Sys_Milliseconds() - start);
+        return;
+    }
+
+    Com_Printf("Transcoded %u messages into %u demo%s in %u ms.\n",
+               count, files, files == 1 ? "" : "s", Sys_Milliseconds() - start);
+}
+
 static void MVD_Control_f(void)
 {
     static const cmd_option_t options[] = {
@@ -2544,6 +3093,10 @@ void MVD_Shutdown(void)
     List_Init(&mvd_gtv_list);
     List_Init(&mvd_channel_list);
 
+#if USE_ZLIB
+    MVD_ShutdownInflateThreads();
+#endif
+
     Z_Free(mvd_clients);
     mvd_clients = NULL;
 
@@ -2566,6 +3119,7 @@ static const cmdreg_t c_mvd[] = {
     { "mvdpause", MVD_Pause_f },
     { "mvdskip", MVD_Skip_f },
     { "mvdseek", MVD_Seek_f },
+    { "mvdtranscode", MVD_Transcode_f, MVD_Play_c },
 
     { NULL }
 };
@@ -2589,6 +3143,9 @@ void MVD_Register(void)
     mvd_username = Cvar_Get("mvd_username", "unnamed", 0);
     mvd_password = Cvar_Get("mvd_password", "", CVAR_PRIVATE);
     mvd_snaps = Cvar_Get("mvd_snaps", "10", 0);
+    mvd_snaps_maxsize = Cvar_Get("mvd_snaps_maxsize", "65536", 0);
+    mvd_inflate_threads = Cvar_Get("mvd_inflate_threads", "0", 0);
+    mvd_inflate_threads->modified = qtrue;
 
     Cmd_Register(c_mvd);
 }
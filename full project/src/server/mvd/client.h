@@ -111,11 +111,14 @@ typedef struct {
     int framenum;
     off_t filepos;
     size_t msglen;
+    size_t datalen;     // less than msglen if compressed
     byte data[1];
 } mvd_snap_t;
 
 struct gtv_s;
 
+typedef struct mvd_dm2_s mvd_dm2_t;
+
 // FIXME: entire struct is > 500 kB in size!
 // need to eliminate those large static arrays below...
 typedef struct mvd_s {
@@ -134,6 +137,8 @@ typedef struct mvd_s {
     qboolean    demoseeking;
     int         last_snapshot;
     list_t      snapshots;
+    size_t      snapshots_size;
+    mvd_dm2_t   *dm2;   // transcoding into client demos
 
     // delay buffer
     fifo_t      delay;
@@ -156,6 +161,7 @@ typedef struct mvd_s {
     char            baseconfigstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
     char            configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
     edict_t         edicts[MAX_EDICTS];
+    edict_vis_t     entvis[MAX_EDICTS];
     mvd_player_t    *players; // [maxclients]
     mvd_player_t    *dummy; // &players[clientNum]
     int             numplayers; // number of active players in frame
@@ -230,3 +236,18 @@ void MVD_UpdateConfigstring(mvd_t *mvd, int index);
 void MVD_SetPlayerNames(mvd_t *mvd);
 void MVD_LinkEdict(mvd_t *mvd, edict_t *ent);
 
+//
+// mvd_transcode.c
+//
+
+void MVD_Dm2Begin(mvd_t *mvd, const char *base, const char *player,
+                  size_t maxmsglen, qboolean bench);
+unsigned MVD_Dm2End(mvd_t *mvd);
+void MVD_Dm2Gamestate(mvd_t *mvd);
+void MVD_Dm2Frame(mvd_t *mvd);
+void MVD_Dm2Broadcast(mvd_t *mvd, const byte *data, size_t length);
+void MVD_Dm2Unicast(mvd_t *mvd, mvd_player_t *player, const byte *data, size_t length);
+void MVD_Dm2Multicast(mvd_t *mvd, mleaf_t *leaf, const byte *mask,
+                      const byte *data, size_t length);
+void MVD_Dm2Sound(mvd_t *mvd, edict_t *entity, qboolean cull);
+
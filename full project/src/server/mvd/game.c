@@ -741,6 +741,7 @@ static void MVD_SetServerState(client_t *cl, mvd_t *mvd)
     cl->slot = mvd->clientNum;
     cl->cm = &mvd->cm;
     cl->pool = &mvd->pool;
+    cl->entvis = mvd->entvis;
     cl->spawncount = mvd->servercount;
     cl->maxclients = mvd->maxclients;
 }
@@ -1428,6 +1429,10 @@ void MVD_UpdateConfigstring(mvd_t *mvd, int index)
     MSG_WriteShort(index);
     MSG_WriteString(s);
 
+    if (mvd->dm2) {
+        MVD_Dm2Broadcast(mvd, msg_write.data, msg_write.cursize);
+    }
+
     // broadcast configstring change
     FOR_EACH_MVDCL(client, mvd) {
         if (client->cl->state < cs_primed) {
@@ -1477,7 +1482,7 @@ void MVD_LinkEdict(mvd_t *mvd, edict_t *ent)
         ent->solid = SOLID_NOT;
     }
 
-    SV_LinkEdict(&mvd->cm, ent);
+    SV_LinkEdict(&mvd->cm, ent, &mvd->entvis[ent - mvd->edicts]);
 }
 
 void MVD_RemoveClient(client_t *client)
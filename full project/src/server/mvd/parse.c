@@ -209,6 +209,10 @@ static void MVD_ParseMulticast(mvd_t *mvd, mvd_ops_t op, int extrabits)
     if (mvd->demoseeking)
         return;
 
+    if (mvd->dm2) {
+        MVD_Dm2Multicast(mvd, leaf1, mask, data, length);
+    }
+
     // send the data to all relevent clients
     FOR_EACH_MVDCL(client, mvd) {
         cl = client->cl;
@@ -250,6 +254,10 @@ static void MVD_UnicastSend(mvd_t *mvd, qboolean reliable, byte *data, size_t le
     mvd_client_t *client;
     client_t *cl;
 
+    if (mvd->dm2) {
+        MVD_Dm2Unicast(mvd, player, data, length);
+    }
+
     // send to all relevant clients
     FOR_EACH_MVDCL(client, mvd) {
         cl = client->cl;
@@ -266,10 +274,17 @@ static void MVD_UnicastSend(mvd_t *mvd, qboolean reliable, byte *data, size_t le
 static void MVD_UnicastLayout(mvd_t *mvd, mvd_player_t *player)
 {
     mvd_client_t *client;
+    size_t readcount;
 
     if (player != mvd->dummy) {
+        readcount = msg_read.readcount - 1;
         MSG_ReadString(NULL, 0);
-        return; // we don't care about others
+        // only client demos of this player care about it
+        if (mvd->dm2 && !mvd->demoseeking) {
+            MVD_Dm2Unicast(mvd, player, msg_read.data + readcount,
+                           msg_read.readcount - readcount);
+        }
+        return;
     }
 
     MSG_ReadString(mvd->layout, sizeof(mvd->layout));
@@ -360,6 +375,10 @@ static void MVD_UnicastPrint(mvd_t *mvd, qboolean reliable, mvd_player_t *player
 
     length = msg_read.readcount - readcount;
 
+    if (mvd->dm2) {
+        MVD_Dm2Unicast(mvd, player, data, length);
+    }
+
     // send to all relevant clients
     FOR_EACH_MVDCL(client, mvd) {
         cl = client->cl;
@@ -475,6 +494,25 @@ static void MVD_ParseUnicast(mvd_t *mvd, mvd_ops_t op, int extrabits)
     }
 }
 
+// reliable sounds and client demos always have position explicitly set
+static void MVD_WritePosSound(int flags, int index, int volume, int attenuation,
+                              int offset, int sendchan, const vec3_t origin)
+{
+    MSG_WriteByte(svc_sound);
+    MSG_WriteByte(flags | SND_POS);
+    MSG_WriteByte(index);
+
+    if (flags & SND_VOLUME)
+        MSG_WriteByte(volume);
+    if (flags & SND_ATTENUATION)
+        MSG_WriteByte(attenuation);
+    if (flags & SND_OFFSET)
+        MSG_WriteByte(offset);
+
+    MSG_WriteShort(sendchan);
+    MSG_WritePos(origin);
+}
+
 /*
 MVD_ParseSound
 
@@ -489,7 +527,7 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
     int         flags, index;
     int         volume, attenuation, offset, sendchan;
     int         entnum;
-    vec3_t      origin;
+    vec3_t      origin, pos;
     mvd_client_t        *client;
     client_t    *cl;
     byte        mask[VIS_MAX_BYTES];
@@ -527,6 +565,20 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
     if (mvd->demoseeking)
         return;
 
+    // use the entity origin unless it is a bmodel
+    if (entity->solid == SOLID_BSP) {
+        VectorAvg(entity->mins, entity->maxs, pos);
+        VectorAdd(entity->s.origin, pos, pos);
+    } else {
+        VectorCopy(entity->s.origin, pos);
+    }
+
+    if (mvd->dm2) {
+        MVD_WritePosSound(flags, index, volume, attenuation, offset, sendchan, pos);
+        MVD_Dm2Sound(mvd, entity, !(extrabits & 1));
+        SZ_Clear(&msg_write);
+    }
+
     FOR_EACH_MVDCL(client, mvd) {
         cl = client->cl;
 
@@ -550,41 +602,21 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
                 }
             }
             BSP_ClusterVis(mvd->cm.cache, mask, leaf->cluster, DVIS_PHS);
-            if (!SV_EdictIsVisible(&mvd->cm, entity, mask)) {
+            if (!SV_EdictIsVisible(&mvd->cm, entity, &mvd->entvis[entity - mvd->edicts], mask)) {
                 continue; // not in PHS
             }
         }
 
-        // use the entity origin unless it is a bmodel
-        if (entity->solid == SOLID_BSP) {
-            VectorAvg(entity->mins, entity->maxs, origin);
-            VectorAdd(entity->s.origin, origin, origin);
-        } else {
-            VectorCopy(entity->s.origin, origin);
-        }
-
         // reliable sounds will always have position explicitly set,
         // as no one gurantees reliables to be delivered in time
         if (extrabits & 2) {
-            MSG_WriteByte(svc_sound);
-            MSG_WriteByte(flags | SND_POS);
-            MSG_WriteByte(index);
-
-            if (flags & SND_VOLUME)
-                MSG_WriteByte(volume);
-            if (flags & SND_ATTENUATION)
-                MSG_WriteByte(attenuation);
-            if (flags & SND_OFFSET)
-                MSG_WriteByte(offset);
-
-            MSG_WriteShort(sendchan);
-            MSG_WritePos(origin);
-
+            MVD_WritePosSound(flags, index, volume, attenuation, offset, sendchan, pos);
             SV_ClientAddMessage(cl, MSG_RELIABLE | MSG_CLEAR);
             continue;
         }
 
-        if (LIST_EMPTY(&cl->msg_free_list)) {
+        msg = SV_AllocSoundPacket(cl);
+        if (!msg) {
             Com_WPrintf("%s: %s: out of message slots\n",
                         __func__, cl->name);
             continue;
@@ -595,8 +627,6 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
             flags |= SND_POS;
         }
 
-        msg = LIST_FIRST(message_packet_t, &cl->msg_free_list, entry);
-
         msg->cursize = 0;
         msg->flags = flags;
         msg->index = index;
@@ -605,10 +635,9 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
         msg->timeofs = offset;
         msg->sendchan = sendchan;
         for (i = 0; i < 3; i++) {
-            msg->pos[i] = origin[i] * 8;
+            msg->pos[i] = pos[i] * 8;
         }
 
-        List_Remove(&msg->entry);
         List_Append(&cl->msg_unreliable_list, &msg->entry);
         cl->msg_unreliable_bytes += MAX_SOUND_PACKET;
 
@@ -657,6 +686,14 @@ static void MVD_ParsePrint(mvd_t *mvd)
     if (mvd->demoseeking)
         return;
 
+    if (mvd->dm2) {
+        MSG_WriteByte(svc_print);
+        MSG_WriteByte(level);
+        MSG_WriteString(string);
+        MVD_Dm2Broadcast(mvd, msg_write.data, msg_write.cursize);
+        SZ_Clear(&msg_write);
+    }
+
     MVD_BroadcastPrintf(mvd, level, level == PRINT_CHAT ?
                         UF_MUTE_PLAYERS : 0, "%s", string);
 }
@@ -839,7 +876,7 @@ static void MVD_ParseFrame(mvd_t *mvd)
 
     // update clients now so that effects datagram that
     // follows can reference current view positions
-    if (mvd->state && !mvd->demoseeking) {
+    if (mvd->state && !mvd->demoseeking && !mvd->dm2) {
         MVD_UpdateClients(mvd);
     }
 
@@ -875,6 +912,7 @@ void MVD_ClearState(mvd_t *mvd, qboolean full)
     }
 
     List_Init(&mvd->snapshots);
+    mvd->snapshots_size = 0;
 
     // free current map
     CM_FreeMap(&mvd->cm);
@@ -1075,6 +1113,12 @@ static void MVD_ParseServerData(mvd_t *mvd, int extrabits)
         mvd->state = MVD_WAITING;
     }
 
+    // transcoding channels have no clients and don't spawn the game
+    if (mvd->dm2) {
+        MVD_Dm2Gamestate(mvd);
+        return;
+    }
+
     // case all UDP clients to reconnect
     MVD_ChangeLevel(mvd);
 }
@@ -1137,6 +1181,9 @@ qboolean MVD_ParseMessage(mvd_t *mvd)
             break;
         case mvd_frame:
             MVD_ParseFrame(mvd);
+            if (mvd->dm2) {
+                MVD_Dm2Frame(mvd);
+            }
             break;
         case mvd_sound:
             MVD_ParseSound(mvd, extrabits);
@@ -0,0 +1,827 @@
+/*
+Copyright (C) 2003-2012 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// mvd_transcode.c -- converting MVD demos into client demos
+//
+// The MVD is parsed once, without a frame clock, and each chosen player
+// gets a writer that sees the game from that player's eyes: it receives
+// whatever a spectator chasing the player would, and writes it into a
+// protocol 34 demo file.
+//
+// In benchmark mode nothing is written. Instead, each frame a writer would
+// produce is delta encoded with every protocol and parsed back, measuring
+// encoded size and time spent per entity.
+//
+
+#include "client.h"
+
+typedef struct dm2writer_s {
+    struct dm2writer_s  *next;
+    int             number;         // index into mvd->players
+    qhandle_t       file;
+    char            path[MAX_OSPATH];
+
+    // current demo message
+    sizebuf_t       block;
+    byte            data[MAX_PACKETLEN_WRITABLE];
+
+    // delta compression state of the last written frame
+    int             framenum, lastframe;
+    unsigned        frames_written, frames_dropped;
+    player_packed_t ps;
+    int             num_entities;
+    entity_packed_t entities[MAX_PACKET_ENTITIES];
+    entity_packed_t baselines[MAX_EDICTS];
+} dm2writer_t;
+
+typedef struct {
+    const char      *name;
+    int             protocol;       // 0 for MVD
+    msgEsFlags_t    esflags;
+} dm2proto_t;
+
+static const dm2proto_t dm2_protos[] = {
+    { "default", PROTOCOL_VERSION_DEFAULT, 0 },
+    { "r1q2", PROTOCOL_VERSION_R1Q2, MSG_ES_BEAMORIGIN | MSG_ES_LONGSOLID },
+    { "q2pro", PROTOCOL_VERSION_Q2PRO, MSG_ES_UMASK | MSG_ES_BEAMORIGIN | MSG_ES_LONGSOLID },
+    { "mvd", 0, MSG_ES_UMASK }
+};
+
+#define DM2_NUM_PROTOS  q_countof(dm2_protos)
+
+typedef struct {
+    unsigned        bytes;
+    unsigned        encode;         // usec
+    unsigned        decode;         // usec, zero if not supported by build
+} dm2bench_t;
+
+struct mvd_dm2_s {
+    char            base[MAX_QPATH];
+    char            player[MAX_CLIENT_NAME];    // empty for all players
+    size_t          maxmsglen;
+    int             level;
+    unsigned        files_written;
+    dm2writer_t     *writers;
+
+    // benchmark mode
+    qboolean        bench;
+    unsigned        bench_frames;
+    unsigned        bench_entities;
+    dm2bench_t      bench_stats[DM2_NUM_PROTOS];
+};
+
+static qboolean dm2_flush(dm2writer_t *w)
+{
+    uint32_t msglen;
+    ssize_t ret;
+
+    if (!w->block.cursize) {
+        return qtrue;
+    }
+
+    msglen = LittleLong(w->block.cursize);
+    ret = FS_Write(&msglen, 4, w->file);
+    if (ret != 4) {
+        goto fail;
+    }
+    ret = FS_Write(w->block.data, w->block.cursize, w->file);
+    if (ret != w->block.cursize) {
+        goto fail;
+    }
+
+    SZ_Clear(&w->block);
+    return qtrue;
+
+fail:
+    Com_EPrintf("Couldn't write %s: %s\n", w->path, Q_ErrorString(ret));
+    FS_FCloseFile(w->file);
+    w->file = 0;
+    return qfalse;
+}
+
+// appends data to the current demo message, starting a new one if it
+// doesn't fit. data larger than a single message is dropped.
+static void dm2_append(dm2writer_t *w, const void *data, size_t len)
+{
+    if (!w->file) {
+        return;
+    }
+
+    if (w->block.cursize + len > w->block.maxsize && !dm2_flush(w)) {
+        return;
+    }
+
+    if (len > w->block.maxsize) {
+        Com_DPrintf("%s: dropped %"PRIz" bytes\n", w->path, len);
+        return;
+    }
+
+    SZ_Write(&w->block, data, len);
+}
+
+static void dm2_append_msg(dm2writer_t *w)
+{
+    dm2_append(w, msg_write.data, msg_write.cursize);
+    SZ_Clear(&msg_write);
+}
+
+static const char *player_configstring(mvd_t *mvd, mvd_player_t *player, int index)
+{
+    mvd_cs_t *cs;
+
+    for (cs = player->configstrings; cs; cs = cs->next) {
+        if (cs->index == index) {
+            return cs->string;
+        }
+    }
+
+    return mvd->configstrings[index];
+}
+
+// current state of the channel becomes the gamestate of the demo
+static void dm2_gamestate(mvd_t *mvd, dm2writer_t *w)
+{
+    mvd_player_t *player = &mvd->players[w->number];
+    const char *s;
+    edict_t *ent;
+    size_t len;
+    int i;
+
+    if (mvd->dm2->bench) {
+        memset(w->baselines, 0, sizeof(w->baselines));
+        for (i = 1; i < mvd->pool.num_edicts; i++) {
+            ent = &mvd->edicts[i];
+            if (ent->inuse && ES_INUSE(&ent->s)) {
+                MSG_PackEntity(&w->baselines[i], &ent->s, qfalse);
+            }
+        }
+        w->lastframe = -1;
+        return;
+    }
+
+    MSG_WriteByte(svc_serverdata);
+    MSG_WriteLong(PROTOCOL_VERSION_DEFAULT);
+    MSG_WriteLong(0x10000 + mvd->servercount);
+    MSG_WriteByte(1);      // demos are always attract loops
+    MSG_WriteString(mvd->gamedir);
+    MSG_WriteShort(w->number);
+    MSG_WriteString(mvd->configstrings[CS_NAME]);
+    dm2_append_msg(w);
+
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        s = player_configstring(mvd, player, i);
+        if (!*s) {
+            continue;
+        }
+
+        len = strlen(s);
+        if (len > MAX_QPATH) {
+            len = MAX_QPATH;
+        }
+
+        MSG_WriteByte(svc_configstring);
+        MSG_WriteShort(i);
+        MSG_WriteData(s, len);
+        MSG_WriteByte(0);
+        dm2_append_msg(w);
+    }
+
+    memset(w->baselines, 0, sizeof(w->baselines));
+    for (i = 1; i < mvd->pool.num_edicts; i++) {
+        ent = &mvd->edicts[i];
+        if (!ent->inuse || !ES_INUSE(&ent->s)) {
+            continue;
+        }
+
+        MSG_PackEntity(&w->baselines[i], &ent->s, qfalse);
+        MSG_WriteByte(svc_spawnbaseline);
+        MSG_WriteDeltaEntity(NULL, &w->baselines[i], MSG_ES_FORCE);
+        dm2_append_msg(w);
+    }
+
+    MSG_WriteByte(svc_stufftext);
+    MSG_WriteString("precache\n");
+    dm2_append_msg(w);
+
+    dm2_flush(w);
+
+    // the first frame is delta uncompressed
+    w->lastframe = -1;
+}
+
+static dm2writer_t *dm2_open(mvd_t *mvd, int number)
+{
+    mvd_dm2_t *dm2 = mvd->dm2;
+    mvd_player_t *player = &mvd->players[number];
+    char name[MAX_QPATH], clean[MAX_CLIENT_NAME];
+    dm2writer_t *w;
+    qhandle_t f;
+    int i;
+
+    for (i = 0; player->name[i] && i < sizeof(clean) - 1; i++) {
+        clean[i] = Q_ispath(player->name[i]) ? player->name[i] : '_';
+    }
+    clean[i] = 0;
+
+    if (dm2->level > 1) {
+        Q_snprintf(name, sizeof(name), "%s_%d_%s_%d", dm2->base, number, clean, dm2->level);
+    } else {
+        Q_snprintf(name, sizeof(name), "%s_%d_%s", dm2->base, number, clean);
+    }
+
+    w = MVD_Mallocz(sizeof(*w));
+    if (dm2->bench) {
+        f = 0;
+    } else {
+        f = FS_EasyOpenFile(w->path, sizeof(w->path), FS_MODE_WRITE,
+                            "demos/", name, ".dm2");
+        if (!f) {
+            Z_Free(w);
+            return NULL;
+        }
+    }
+
+    w->number = number;
+    w->file = f;
+    SZ_Init(&w->block, w->data, dm2->maxmsglen);
+
+    dm2_gamestate(mvd, w);
+
+    w->next = dm2->writers;
+    dm2->writers = w;
+    return w;
+}
+
+static void dm2_close(dm2writer_t *w)
+{
+    uint32_t msglen;
+
+    if (w->file) {
+        dm2_flush(w);
+    }
+
+    if (w->file) {
+        // end of demo
+        msglen = (uint32_t)-1;
+        FS_Write(&msglen, 4, w->file);
+        FS_FCloseFile(w->file);
+
+        Com_Printf("Wrote %s, %u frames", w->path, w->frames_written);
+        if (w->frames_dropped) {
+            Com_Printf(" (%u dropped)", w->frames_dropped);
+        }
+        Com_Printf(".\n");
+    }
+
+    Z_Free(w);
+}
+
+static void dm2_close_all(mvd_dm2_t *dm2)
+{
+    dm2writer_t *w, *next;
+
+    for (w = dm2->writers; w; w = next) {
+        next = w->next;
+        if (w->file) {
+            dm2->files_written++;
+        }
+        dm2_close(w);
+    }
+
+    dm2->writers = NULL;
+}
+
+static qboolean dm2_wanted(mvd_t *mvd, int number)
+{
+    mvd_dm2_t *dm2 = mvd->dm2;
+    mvd_player_t *player = &mvd->players[number];
+    dm2writer_t *w;
+
+    if (!player->inuse || player == mvd->dummy) {
+        return qfalse;
+    }
+
+    for (w = dm2->writers; w; w = w->next) {
+        if (w->number == number) {
+            return qfalse;
+        }
+    }
+
+    if (!dm2->player[0]) {
+        return qtrue;
+    }
+
+    if (COM_IsUint(dm2->player)) {
+        return atoi(dm2->player) == number;
+    }
+
+    return !Q_stricmp(dm2->player, player->name);
+}
+
+static void dm2_open_wanted(mvd_t *mvd)
+{
+    int i;
+
+    for (i = 0; i < mvd->maxclients; i++) {
+        if (dm2_wanted(mvd, i)) {
+            dm2_open(mvd, i);
+        }
+    }
+}
+
+/*
+==================
+MVD_Dm2Begin
+
+Attaches client demo writers to a channel used for transcoding. Writers
+for the chosen player, or all players if player is NULL, are opened as
+soon as they appear in the game. If bench is set, frames are measured
+instead of written.
+==================
+*/
+void MVD_Dm2Begin(mvd_t *mvd, const char *base, const char *player,
+                  size_t maxmsglen, qboolean bench)
+{
+    mvd_dm2_t *dm2 = MVD_Mallocz(sizeof(*dm2));
+
+    Q_strlcpy(dm2->base, base, sizeof(dm2->base));
+    if (player) {
+        Q_strlcpy(dm2->player, player, sizeof(dm2->player));
+    }
+    dm2->maxmsglen = maxmsglen;
+    dm2->bench = bench;
+
+    mvd->dm2 = dm2;
+}
+
+static void dm2_bench_report(mvd_dm2_t *dm2)
+{
+    const dm2bench_t *b;
+    char decode[16];
+    unsigned frames = max(dm2->bench_frames, 1);
+    unsigned entities = max(dm2->bench_entities, 1);
+    int i;
+
+    Com_Printf("%u frames, %.1f entities per frame\n"
+               "protocol  bytes/frame  encode ns/ent  decode ns/ent\n"
+               "--------  -----------  -------------  -------------\n",
+               dm2->bench_frames, (float)dm2->bench_entities / frames);
+
+    for (i = 0; i < DM2_NUM_PROTOS; i++) {
+        b = &dm2->bench_stats[i];
+        if (b->decode) {
+            Q_snprintf(decode, sizeof(decode), "%.1f", b->decode * 1000.0f / entities);
+        } else {
+            strcpy(decode, "-");
+        }
+        Com_Printf("%-8s  %11.1f  %13.1f  %13s\n", dm2_protos[i].name,
+                   (float)b->bytes / frames, b->encode * 1000.0f / entities, decode);
+    }
+}
+
+/*
+==================
+MVD_Dm2End
+
+Finishes all client demos. Returns the number of files written.
+==================
+*/
+unsigned MVD_Dm2End(mvd_t *mvd)
+{
+    mvd_dm2_t *dm2 = mvd->dm2;
+    unsigned count;
+
+    if (!dm2) {
+        return 0;
+    }
+
+    dm2_close_all(dm2);
+    count = dm2->files_written;
+
+    if (dm2->bench) {
+        dm2_bench_report(dm2);
+    }
+
+    Z_Free(dm2);
+    mvd->dm2 = NULL;
+    return count;
+}
+
+// each level goes into a separate set of files
+void MVD_Dm2Gamestate(mvd_t *mvd)
+{
+    mvd_dm2_t *dm2 = mvd->dm2;
+
+    dm2_close_all(dm2);
+    dm2->level++;
+    dm2_open_wanted(mvd);
+}
+
+static void emit_packet_entities(dm2writer_t *w, mvd_t *mvd,
+                                 const entity_packed_t *to, int to_num_entities,
+                                 msgEsFlags_t esflags)
+{
+    const entity_packed_t *oldent, *newent;
+    int oldindex, newindex;
+    int oldnum, newnum;
+
+    newindex = 0;
+    oldindex = 0;
+    oldent = newent = NULL;
+    while (newindex < to_num_entities || oldindex < w->num_entities) {
+        if (newindex >= to_num_entities) {
+            newnum = 9999;
+        } else {
+            newent = &to[newindex];
+            newnum = newent->number;
+        }
+
+        if (oldindex >= w->num_entities) {
+            oldnum = 9999;
+        } else {
+            oldent = &w->entities[oldindex];
+            oldnum = oldent->number;
+        }
+
+        if (newnum == oldnum) {
+            // players are always 'newentities', this updates their
+            // oldorigin always and prevents warping
+            MSG_WriteDeltaEntity(oldent, newent, esflags |
+                                 (newnum <= mvd->maxclients ? MSG_ES_NEWENTITY : 0));
+            oldindex++;
+            newindex++;
+            continue;
+        }
+
+        if (newnum < oldnum) {
+            // this is a new entity, send it from the baseline
+            MSG_WriteDeltaEntity(&w->baselines[newnum], newent,
+                                 esflags | MSG_ES_FORCE | MSG_ES_NEWENTITY);
+            newindex++;
+            continue;
+        }
+
+        // the old entity isn't present in the new message
+        MSG_WriteDeltaEntity(oldent, NULL, esflags | MSG_ES_FORCE);
+        oldindex++;
+    }
+
+    MSG_WriteShort(0);      // end of packetentities
+}
+
+// same visibility rules as SV_BuildClientFrame uses for spectators
+static int build_entities(mvd_t *mvd, int number, const vec3_t org,
+                          int area, int cluster, entity_packed_t *list)
+{
+    byte        pvs[VIS_MAX_BYTES];
+    byte        phs[VIS_MAX_BYTES];
+    qboolean    novis = !mvd->cm.cache;
+    edict_t     *ent;
+    entity_packed_t *state;
+    vec3_t      delta;
+    int         e, count;
+
+    if (!novis) {
+        CM_FatPVS(&mvd->cm, pvs, org);
+        BSP_ClusterVis(mvd->cm.cache, phs, cluster, DVIS_PHS);
+    }
+
+    count = 0;
+    for (e = 1; e < mvd->pool.num_edicts; e++) {
+        ent = &mvd->edicts[e];
+
+        if (!ent->inuse || !ES_INUSE(&ent->s)) {
+            continue;
+        }
+
+        // player's own entity is always visible
+        if (e != number + 1 && !novis) {
+            // check area
+            if (!CM_AreasConnected(&mvd->cm, area, ent->areanum)) {
+                // doors can legally straddle two areas, so
+                // we may need to check another one
+                if (!CM_AreasConnected(&mvd->cm, area, ent->areanum2)) {
+                    continue;        // blocked by a door
+                }
+            }
+
+            // beams just check one point for PHS
+            if (ent->s.renderfx & RF_BEAM) {
+                if (!Q_IsBitSet(phs, ent->clusternums[0]))
+                    continue;
+            } else {
+                if (!SV_EdictIsVisible(&mvd->cm, ent, &mvd->entvis[e], pvs))
+                    continue;
+            }
+
+            // don't send sounds if they will be attenuated away
+            if (!ent->s.modelindex && !(ent->s.renderfx & RF_BEAM)) {
+                VectorSubtract(org, ent->s.origin, delta);
+                if (VectorLength(delta) > 400)
+                    continue;
+            }
+        }
+
+        state = &list[count];
+        ent->s.number = e;
+        MSG_PackEntity(state, &ent->s, qfalse);
+
+        // spectators only need to know about inline BSP models
+        if (state->solid != PACKED_BSP)
+            state->solid = 0;
+
+        if (++count == MAX_PACKET_ENTITIES) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+// parses back what dm2_bench_encode wrote, the way clients do
+static qboolean dm2_bench_decode(const dm2proto_t *p, int extraflags)
+{
+    static const entity_state_t nullstate;
+    entity_state_t es;
+    player_state_t ps;
+    int bits, number;
+
+    if (p->protocol) {
+#if USE_CLIENT
+        bits = MSG_ReadShort();
+        if (p->protocol > PROTOCOL_VERSION_DEFAULT) {
+            MSG_ParseDeltaPlayerstate_Enhanced(NULL, &ps, bits, extraflags);
+        } else {
+            MSG_ParseDeltaPlayerstate_Default(NULL, &ps, bits);
+        }
+#else
+        return qfalse;
+#endif
+    } else {
+        MSG_ReadByte();
+        bits = MSG_ReadShort();
+        MSG_ParseDeltaPlayerstate_Packet(NULL, &ps, bits);
+    }
+
+    while (1) {
+        number = MSG_ParseEntityBits(&bits);
+        if (number < 1 || number >= MAX_EDICTS) {
+            break;
+        }
+        if (bits & U_REMOVE) {
+            continue;
+        }
+        MSG_ParseDeltaEntity(&nullstate, &es, number, bits, p->esflags);
+    }
+
+    return qtrue;
+}
+
+static void dm2_bench_encode(mvd_t *mvd, dm2writer_t *w, const dm2proto_t *p,
+                             dm2bench_t *b, player_packed_t *oldps,
+                             player_packed_t *newps, const entity_packed_t *list,
+                             int count)
+{
+    byte buffer[MAX_MSGLEN];
+    sizebuf_t oldread;
+    unsigned start;
+    size_t len;
+    int extraflags = 0;
+
+    start = Sys_Microseconds();
+    if (p->protocol > PROTOCOL_VERSION_DEFAULT) {
+        extraflags = MSG_WriteDeltaPlayerstate_Enhanced(oldps, newps, 0);
+    } else if (p->protocol) {
+        MSG_WriteDeltaPlayerstate_Default(oldps, newps);
+    } else {
+        MSG_WriteDeltaPlayerstate_Packet(oldps, newps, w->number, 0);
+    }
+    emit_packet_entities(w, mvd, list, count, p->esflags);
+    b->encode += Sys_Microseconds() - start;
+
+    len = msg_write.cursize;
+    b->bytes += len;
+    if (msg_write.overflowed) {
+        SZ_Clear(&msg_write);
+        return;
+    }
+
+    // parse from a copy, msg_read holds the MVD message being parsed
+    memcpy(buffer, msg_write.data, len);
+    SZ_Clear(&msg_write);
+
+    oldread = msg_read;
+    SZ_Init(&msg_read, buffer, len);
+    msg_read.cursize = len;
+
+    start = Sys_Microseconds();
+    if (dm2_bench_decode(p, extraflags)) {
+        b->decode += Sys_Microseconds() - start;
+    }
+
+    msg_read = oldread;
+}
+
+static void dm2_bench_frame(mvd_t *mvd, dm2writer_t *w, player_packed_t *oldps,
+                            player_packed_t *newps, const entity_packed_t *list,
+                            int count)
+{
+    mvd_dm2_t *dm2 = mvd->dm2;
+    player_packed_t ps;
+    int i;
+
+    for (i = 0; i < DM2_NUM_PROTOS; i++) {
+        ps = *newps;    // enhanced encoder may modify it
+        dm2_bench_encode(mvd, w, &dm2_protos[i], &dm2->bench_stats[i],
+                         oldps, &ps, list, count);
+    }
+
+    dm2->bench_frames++;
+    dm2->bench_entities += count;
+}
+
+static void dm2_frame(mvd_t *mvd, dm2writer_t *w)
+{
+    entity_packed_t list[MAX_PACKET_ENTITIES];
+    byte        areabits[MAX_MAP_AREA_BYTES];
+    player_state_t *ps = &mvd->players[w->number].ps;
+    player_packed_t newps;
+    int         areabytes, count, lastframe;
+    vec3_t      org;
+    mleaf_t     *leaf;
+
+    // finish effects of the previous frame
+    if (!dm2_flush(w)) {
+        return;
+    }
+
+    w->framenum++;
+
+    VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, org);
+    leaf = CM_PointLeaf(&mvd->cm, org);
+
+    areabytes = CM_WriteAreaBits(&mvd->cm, areabits, leaf->area);
+    if (!areabytes) {
+        areabits[0] = 255;
+        areabytes = 1;
+    }
+
+    count = build_entities(mvd, w->number, org, leaf->area, leaf->cluster, list);
+
+    // delta from the last frame written, if the client still has it
+    lastframe = w->lastframe;
+    if (lastframe != -1 && w->framenum - lastframe >= UPDATE_BACKUP) {
+        lastframe = -1;
+    }
+    if (lastframe == -1) {
+        w->num_entities = 0;
+    }
+
+    MSG_PackPlayer(&newps, ps);
+
+    if (mvd->dm2->bench) {
+        dm2_bench_frame(mvd, w, lastframe == -1 ? NULL : &w->ps, &newps, list, count);
+        goto done;
+    }
+
+    MSG_WriteByte(svc_frame);
+    MSG_WriteLong(w->framenum);
+    MSG_WriteLong(lastframe);   // what we are delta'ing from
+    MSG_WriteByte(0);   // rate dropped packets
+
+    MSG_WriteByte(areabytes);
+    MSG_WriteData(areabits, areabytes);
+
+    MSG_WriteByte(svc_playerinfo);
+    MSG_WriteDeltaPlayerstate_Default(lastframe == -1 ? NULL : &w->ps, &newps);
+
+    MSG_WriteByte(svc_packetentities);
+    emit_packet_entities(w, mvd, list, count, 0);
+
+    if (msg_write.overflowed || msg_write.cursize > w->block.maxsize) {
+        // leave delta state alone, next frame is encoded against the last one
+        w->frames_dropped++;
+        SZ_Clear(&msg_write);
+        return;
+    }
+
+    SZ_Write(&w->block, msg_write.data, msg_write.cursize);
+    SZ_Clear(&msg_write);
+
+done:
+    w->lastframe = w->framenum;
+    w->frames_written++;
+    w->ps = newps;
+    w->num_entities = count;
+    memcpy(w->entities, list, sizeof(list[0]) * count);
+}
+
+// called after each frame, before effects that follow it
+void MVD_Dm2Frame(mvd_t *mvd)
+{
+    dm2writer_t *w;
+
+    dm2_open_wanted(mvd);
+
+    for (w = mvd->dm2->writers; w; w = w->next) {
+        if ((w->file || mvd->dm2->bench) && mvd->players[w->number].inuse) {
+            dm2_frame(mvd, w);
+        }
+    }
+}
+
+// sent to everyone, e.g. configstrings and prints
+void MVD_Dm2Broadcast(mvd_t *mvd, const byte *data, size_t length)
+{
+    dm2writer_t *w;
+
+    for (w = mvd->dm2->writers; w; w = w->next) {
+        dm2_append(w, data, length);
+    }
+}
+
+void MVD_Dm2Unicast(mvd_t *mvd, mvd_player_t *player, const byte *data, size_t length)
+{
+    dm2writer_t *w;
+
+    for (w = mvd->dm2->writers; w; w = w->next) {
+        if (&mvd->players[w->number] == player) {
+            dm2_append(w, data, length);
+        }
+    }
+}
+
+// leaf is NULL for messages sent to everyone
+void MVD_Dm2Multicast(mvd_t *mvd, mleaf_t *leaf, const byte *mask,
+                      const byte *data, size_t length)
+{
+    player_state_t *ps;
+    dm2writer_t *w;
+    mleaf_t *leaf2;
+    vec3_t org;
+
+    for (w = mvd->dm2->writers; w; w = w->next) {
+        if (leaf) {
+            // game code uses entity origin for PVS/PHS culling
+            ps = &mvd->players[w->number].ps;
+            VectorScale(ps->pmove.origin, 0.125f, org);
+            leaf2 = CM_PointLeaf(&mvd->cm, org);
+            if (!CM_AreasConnected(&mvd->cm, leaf->area, leaf2->area))
+                continue;
+            if (leaf2->cluster == -1)
+                continue;
+            if (!Q_IsBitSet(mask, leaf2->cluster))
+                continue;
+        }
+
+        dm2_append(w, data, length);
+    }
+}
+
+// sound message with explicit position is in msg_write
+void MVD_Dm2Sound(mvd_t *mvd, edict_t *entity, qboolean cull)
+{
+    byte mask[VIS_MAX_BYTES];
+    player_state_t *ps;
+    dm2writer_t *w;
+    mleaf_t *leaf;
+    vec3_t org;
+
+    for (w = mvd->dm2->writers; w; w = w->next) {
+        // PHS cull this sound
+        if (cull && mvd->cm.cache) {
+            ps = &mvd->players[w->number].ps;
+            VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, org);
+            leaf = CM_PointLeaf(&mvd->cm, org);
+            if (!CM_AreasConnected(&mvd->cm, leaf->area, entity->areanum)) {
+                // doors can legally straddle two areas, so
+                // we may need to check another one
+                if (!entity->areanum2 || !CM_AreasConnected(&mvd->cm, leaf->area, entity->areanum2)) {
+                    continue;        // blocked by a door
+                }
+            }
+            BSP_ClusterVis(mvd->cm.cache, mask, leaf->cluster, DVIS_PHS);
+            if (!SV_EdictIsVisible(&mvd->cm, entity, &mvd->entvis[entity - mvd->edicts], mask)) {
+                continue; // not in PHS
+            }
+        }
+
+        dm2_append(w, msg_write.data, msg_write.cursize);
+    }
+}
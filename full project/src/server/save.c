@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "server.h"
+#include "system/thread.h"
 
 #define SAVE_MAGIC1 (('1'<<24)|('V'<<16)|('A'<<8)|'S')
 #define SAVE_MAGIC2 (('2'<<24)|('V'<<16)|('A'<<8)|'S')
@@ -28,6 +29,197 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /*
 ===============================================================================
 
+BACKGROUND WRITER
+
+Server state and level files are snapshotted into memory and written out by
+a worker thread while the game keeps running. Handles are opened and closed
+on the main thread, the worker only writes to them. Files are renamed into
+the destination directory once all writes have completed.
+
+===============================================================================
+*/
+
+typedef struct {
+    qhandle_t   f;
+    byte        *data;
+    size_t      len;
+    qerror_t    ret;
+} savefile_t;
+
+enum {
+    SAVE_STATE,
+    SAVE_LEVEL,
+
+    SAVE_NUM_FILES
+};
+
+static struct {
+    qthread_t   *thread;
+    qmutex_t    *lock;
+    qboolean    done;
+    char        dir[MAX_QPATH];
+    savefile_t  files[SAVE_NUM_FILES];
+} save;
+
+static void save_thread(void *arg)
+{
+    savefile_t *s;
+    ssize_t write;
+    int i;
+
+    for (i = 0; i < SAVE_NUM_FILES; i++) {
+        s = &save.files[i];
+        write = FS_Write(s->data, s->len, s->f);
+        s->ret = write == s->len ? Q_ERR_SUCCESS : write < 0 ? write : Q_ERR_FAILURE;
+    }
+
+    Sys_LockMutex(save.lock);
+    save.done = qtrue;
+    Sys_UnlockMutex(save.lock);
+}
+
+// snapshot current contents of msg_write for writing into the given file
+static qerror_t queue_file(int index, const char *name)
+{
+    savefile_t *s = &save.files[index];
+    ssize_t ret;
+
+    ret = FS_FOpenFile(name, &s->f, FS_MODE_WRITE);
+    if (!s->f) {
+        return ret;
+    }
+
+    s->data = Z_Malloc(msg_write.cursize);
+    s->len = msg_write.cursize;
+    memcpy(s->data, msg_write.data, s->len);
+    return Q_ERR_SUCCESS;
+}
+
+static qerror_t release_files(void)
+{
+    savefile_t *s;
+    qerror_t ret = Q_ERR_SUCCESS;
+    int i;
+
+    for (i = 0; i < SAVE_NUM_FILES; i++) {
+        s = &save.files[i];
+        if (s->f) {
+            FS_FCloseFile(s->f);
+        }
+        if (s->ret && !ret) {
+            ret = s->ret;
+        }
+        Z_Free(s->data);
+        memset(s, 0, sizeof(*s));
+    }
+
+    return ret;
+}
+
+static qerror_t rename_file(const char *dir, const char *base, const char *suf)
+{
+    char from[MAX_QPATH];
+    char to[MAX_QPATH];
+    size_t len;
+
+    len = Q_snprintf(from, sizeof(from), "save/%s/%s%s", SAVE_CURRENT, base, suf);
+    if (len >= sizeof(from))
+        return Q_ERR_NAMETOOLONG;
+
+    len = Q_snprintf(to, sizeof(to), "save/%s/%s%s", dir, base, suf);
+    if (len >= sizeof(to))
+        return Q_ERR_NAMETOOLONG;
+
+    return FS_RenameFile(from, to);
+}
+
+static qerror_t move_files(const char *dir)
+{
+    char name[MAX_OSPATH];
+    size_t len;
+    qerror_t ret;
+
+    len = Q_snprintf(name, sizeof(name), "%s/save/%s/", fs_gamedir, dir);
+    if (len >= sizeof(name))
+        return Q_ERR_NAMETOOLONG;
+
+    ret = FS_CreatePath(name);
+    if (ret)
+        return ret;
+
+    ret = rename_file(dir, "game", ".level");
+    if (ret)
+        return ret;
+
+    ret = rename_file(dir, "server", ".level");
+    if (ret)
+        return ret;
+
+    ret = rename_file(dir, "game", ".state");
+    if (ret)
+        return ret;
+
+    ret = rename_file(dir, "server", ".state");
+    if (ret)
+        return ret;
+
+    return Q_ERR_SUCCESS;
+}
+
+/*
+==============
+SV_FinishSavegame
+
+Completes the savegame being written in background, if any. Unless `wait'
+is set, returns immediately if the worker is still busy.
+==============
+*/
+void SV_FinishSavegame(qboolean wait)
+{
+    qboolean done;
+    qerror_t ret;
+
+    if (!save.thread) {
+        return;
+    }
+
+    if (!wait) {
+        Sys_LockMutex(save.lock);
+        done = save.done;
+        Sys_UnlockMutex(save.lock);
+        if (!done) {
+            return;
+        }
+    }
+
+    Sys_JoinThread(save.thread);
+    Sys_DestroyMutex(save.lock);
+    save.thread = NULL;
+    save.lock = NULL;
+
+    ret = release_files();
+    if (!ret) {
+        ret = move_files(save.dir);
+    }
+
+    if (ret) {
+        Com_EPrintf("Couldn't write %s: %s\n", save.dir, Q_ErrorString(ret));
+    } else {
+        Com_Printf("Game saved.\n");
+    }
+}
+
+static void submit_savegame(const char *dir)
+{
+    Q_strlcpy(save.dir, dir, sizeof(save.dir));
+    save.done = qfalse;
+    save.lock = Sys_CreateMutex();
+    save.thread = Sys_CreateThread(save_thread, NULL);
+}
+
+/*
+===============================================================================
+
 SAVEGAME FILES
 
 ===============================================================================
@@ -63,9 +255,8 @@ static qerror_t write_server_file(qboolean autosave)
     }
     MSG_WriteString(NULL);
 
-    // write server state
-    ret = FS_WriteFile("save/" SAVE_CURRENT "/server.state",
-                       msg_write.data, msg_write.cursize);
+    // snapshot server state
+    ret = queue_file(SAVE_STATE, "save/" SAVE_CURRENT "/server.state");
 
     SZ_Clear(&msg_write);
 
@@ -118,8 +309,8 @@ static qerror_t write_level_file(void)
     MSG_WriteByte(len);
     MSG_WriteData(portalbits, len);
 
-    ret = FS_WriteFile("save/" SAVE_CURRENT "/server.level",
-                       msg_write.data, msg_write.cursize);
+    // snapshot server level
+    ret = queue_file(SAVE_LEVEL, "save/" SAVE_CURRENT "/server.level");
 
     SZ_Clear(&msg_write);
 
@@ -138,56 +329,6 @@ static qerror_t write_level_file(void)
     return Q_ERR_SUCCESS;
 }
 
-static qerror_t rename_file(const char *dir, const char *base, const char *suf)
-{
-    char from[MAX_QPATH];
-    char to[MAX_QPATH];
-    size_t len;
-
-    len = Q_snprintf(from, sizeof(from), "save/%s/%s%s", SAVE_CURRENT, base, suf);
-    if (len >= sizeof(from))
-        return Q_ERR_NAMETOOLONG;
-
-    len = Q_snprintf(to, sizeof(to), "save/%s/%s%s", dir, base, suf);
-    if (len >= sizeof(to))
-        return Q_ERR_NAMETOOLONG;
-
-    return FS_RenameFile(from, to);
-}
-
-static qerror_t move_files(const char *dir)
-{
-    char name[MAX_OSPATH];
-    size_t len;
-    qerror_t ret;
-
-    len = Q_snprintf(name, sizeof(name), "%s/save/%s/", fs_gamedir, dir);
-    if (len >= sizeof(name))
-        return Q_ERR_NAMETOOLONG;
-
-    ret = FS_CreatePath(name);
-    if (ret)
-        return ret;
-
-    ret = rename_file(dir, "game", ".level");
-    if (ret)
-        return ret;
-
-    ret = rename_file(dir, "server", ".level");
-    if (ret)
-        return ret;
-
-    ret = rename_file(dir, "game", ".state");
-    if (ret)
-        return ret;
-
-    ret = rename_file(dir, "server", ".state");
-    if (ret)
-        return ret;
-
-    return Q_ERR_SUCCESS;
-}
-
 static qerror_t read_binary_file(const char *name)
 {
     qhandle_t f;
@@ -447,6 +588,9 @@ void SV_Loadgame_f(void)
         return;
     }
 
+    // make sure previous save is on disk
+    SV_FinishSavegame(qtrue);
+
     ret = read_server_file(dir);
     if (ret) {
         Com_Printf("Couldn't load %s: %s\n", dir, Q_ErrorString(ret));
@@ -505,6 +649,9 @@ void SV_Savegame_f(void)
         return;
     }
 
+    // previous save still uses the temporary dir
+    SV_FinishSavegame(qtrue);
+
     // archive current level, including all client edicts.
     // when the level is reloaded, they will be shells awaiting
     // a connecting client
@@ -517,15 +664,12 @@ void SV_Savegame_f(void)
     if (ret)
         goto fail;
 
-    // rename all stuff
-    ret = move_files(dir);
-    if (ret)
-        goto fail;
-
-    Com_Printf("Game saved.\n");
+    // write out and rename all stuff in background
+    submit_savegame(dir);
     return;
 
 fail:
+    release_files();
     Com_EPrintf("Couldn't write %s: %s\n", dir, Q_ErrorString(ret));
 }
 
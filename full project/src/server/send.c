@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // sv_send.c
 
 #include "server.h"
+#include "system/thread.h"
 
 /*
 =============================================================================
@@ -46,6 +47,96 @@ void SV_FlushRedirect(int redirected, char *outputbuf, size_t len)
     }
 }
 
+/*
+=======================
+SV_UpdateRateControl
+
+With sv_adaptive_rate set, the send budget starts at the client rate and is
+adjusted once a second from frame loss and round trip time. Loss over 5% or
+RTT well above the best seen cuts the budget by a quarter, a clean second
+grows it back by a tenth of the client rate. Below half the client rate
+frames are also thinned out evenly, so the client gets fewer frames at a
+steady pace instead of bursts followed by choke.
+=======================
+*/
+#define CC_MIN_RATE     1000
+
+static void SV_UpdateRateControl(client_t *client)
+{
+    ratecontrol_t *cc = &client->cc;
+    unsigned sent, acked;
+    size_t floor;
+
+    if (!sv_adaptive_rate->integer || !client->rate) {
+        cc->rate = client->rate;
+        cc->interval = 1;
+        cc->time = 0;
+        return;
+    }
+
+    if (!cc->time || cc->rate > client->rate) {
+        cc->rate = client->rate;
+        cc->interval = 1;
+        cc->time = svs.realtime;
+        cc->frames_sent = client->frames_sent;
+        cc->frames_acked = client->frames_acked;
+        return;
+    }
+
+    if (svs.realtime - cc->time < 1000)
+        return;
+
+    sent = client->frames_sent - cc->frames_sent;
+    acked = client->frames_acked - cc->frames_acked;
+
+    if (client->ping && (!cc->min_rtt || client->ping < cc->min_rtt))
+        cc->min_rtt = client->ping;
+
+    floor = min(client->rate, CC_MIN_RATE);
+    if ((sent > 0 && acked * 20 < sent * 19) ||
+        (cc->min_rtt && client->ping > cc->min_rtt * 2 + 50)) {
+        // congested, back off
+        cc->rate = max(cc->rate * 3 / 4, floor);
+        cc->backoffs++;
+    } else if (cc->rate < client->rate) {
+        cc->rate = min(cc->rate + client->rate / 10, client->rate);
+    }
+
+    // thin out frames when the budget can't keep up with the frame rate
+    cc->interval = 1;
+    if (cc->rate < client->rate / 2)
+        cc->interval = min(client->rate / cc->rate, 4);
+
+    cc->time = svs.realtime;
+    cc->frames_sent = client->frames_sent;
+    cc->frames_acked = client->frames_acked;
+}
+
+/*
+=======================
+SV_SnapshotDivisor
+
+Spectators, including everyone watching an MVD channel, can be sent only every
+Nth frame. Frame numbers keep advancing for skipped frames, so client time
+stays in step, acks still name frames that were really sent, and
+SV_GetLastFrame finds them by number like after a rate drop.
+=======================
+*/
+static int SV_SnapshotDivisor(client_t *client)
+{
+    int div = sv_spectator_snapdiv->integer;
+
+    if (div <= 1)
+        return 1;
+
+    if (sv.state != ss_broadcast &&
+        client->edict->client->ps.pmove.pm_type != PM_SPECTATOR)
+        return 1;
+
+    // keep enough frames in flight to delta from
+    return min(div, UPDATE_BACKUP / 4);
+}
+
 /*
 =======================
 SV_RateDrop
@@ -56,7 +147,7 @@ bandwidth estimation and should not be sent another packet
 */
 static qboolean SV_RateDrop(client_t *client)
 {
-    size_t  total;
+    size_t  total, rate;
     int     i;
 
     // never drop over the loopback
@@ -64,6 +155,16 @@ static qboolean SV_RateDrop(client_t *client)
         return qfalse;
     }
 
+    // skip frames evenly on poor links
+    if (client->cc.interval > 1 && client->framenum % client->cc.interval) {
+        client->frameflags |= FF_SUPPRESSED;
+        client->suppress_count++;
+        client->message_size[client->framenum % RATE_MESSAGES] = 0;
+        return qtrue;
+    }
+
+    rate = SV_ClientRate(client);
+
     total = 0;
     for (i = 0; i < RATE_MESSAGES; i++) {
         total += client->message_size[i];
@@ -73,11 +174,12 @@ static qboolean SV_RateDrop(client_t *client)
     total = total * sv.framediv / client->framediv;
 #endif
 
-    if (total > client->rate) {
+    if (total > rate) {
         SV_DPrintf(0, "Frame %d suppressed for %s (total = %"PRIz")\n",
                    client->framenum, client->name, total);
         client->frameflags |= FF_SUPPRESSED;
         client->suppress_count++;
+        client->total_suppressed++;
         client->message_size[client->framenum % RATE_MESSAGES] = 0;
         return qtrue;
     }
@@ -98,7 +200,7 @@ static void SV_CalcSendTime(client_t *client, size_t size)
         client->message_size[client->framenum % RATE_MESSAGES] = size;
 
     client->send_time = svs.realtime;
-    client->send_delta = size * 1000 / client->rate;
+    client->send_delta = size * 1000 / SV_ClientRate(client);
 }
 
 /*
@@ -252,14 +354,113 @@ MULTICAST_PVS    send to clients potentially visible from org
 MULTICAST_PHS    send to clients potentially hearable from org
 =================
 */
+/*
+=================
+MULTICAST CLIENT BUCKETS
+
+Clients are grouped by the cluster they stand in, so PVS and PHS
+multicasts test each occupied cluster once instead of looking up the
+leaf of every client. Rebuilt once a frame, and whenever a client is
+relinked or joins or leaves the client list.
+=================
+*/
+
+#define MCAST_HASH  (MAX_CLIENTS * 2)   // power of two
+
+typedef struct {
+    int         cluster;
+    client_t    *clients;   // linked through mcast_next
+} mcastbucket_t;
+
+static struct {
+    qboolean        dirty;
+    int             framenum;
+    int             numbuckets;
+    mcastbucket_t   buckets[MAX_CLIENTS];
+    short           hash[MCAST_HASH];   // bucket index + 1
+} mcast;
+
+void SV_InvalidateMulticast(void)
+{
+    mcast.dirty = qtrue;
+}
+
+static mleaf_t *SV_ClientLeaf(client_t *client)
+{
+    edict_t *ent = client->edict;
+
+    // FIXME: for some strange reason, game code assumes the server
+    // uses entity origin for PVS/PHS culling, not the view origin
+    if (!client->mcast_leaf || client->mcast_spawncount != sv.spawncount ||
+        !VectorCompare(ent->s.origin, client->mcast_origin)) {
+        VectorCopy(ent->s.origin, client->mcast_origin);
+        client->mcast_leaf = CM_PointLeaf(&sv.cm, client->mcast_origin);
+        client->mcast_spawncount = sv.spawncount;
+    }
+
+    return client->mcast_leaf;
+}
+
+static void SV_BuildMulticastBuckets(void)
+{
+    client_t        *client;
+    mcastbucket_t   *b;
+    mleaf_t         *leaf;
+    int             h;
+
+    memset(mcast.hash, 0, sizeof(mcast.hash));
+    mcast.numbuckets = 0;
+
+    FOR_EACH_CLIENT(client) {
+        leaf = SV_ClientLeaf(client);
+        if (leaf->cluster == -1)
+            continue;   // never receives these
+
+        h = leaf->cluster & (MCAST_HASH - 1);
+        while (mcast.hash[h]) {
+            if (mcast.buckets[mcast.hash[h] - 1].cluster == leaf->cluster)
+                break;
+            h = (h + 1) & (MCAST_HASH - 1);
+        }
+
+        if (mcast.hash[h]) {
+            b = &mcast.buckets[mcast.hash[h] - 1];
+        } else {
+            b = &mcast.buckets[mcast.numbuckets++];
+            b->cluster = leaf->cluster;
+            b->clients = NULL;
+            mcast.hash[h] = mcast.numbuckets;
+        }
+
+        client->mcast_next = b->clients;
+        b->clients = client;
+    }
+
+    mcast.dirty = qfalse;
+    mcast.framenum = sv.framenum;
+}
+
+static qboolean SV_MulticastWanted(client_t *client, int flags)
+{
+    if (client->state < cs_primed) {
+        return qfalse;
+    }
+    // do not send unreliables to connecting clients
+    if (!(flags & MSG_RELIABLE) && (client->state != cs_spawned ||
+                                    client->download || client->nodata)) {
+        return qfalse;
+    }
+    return qtrue;
+}
+
 void SV_Multicast(vec3_t origin, multicast_t to)
 {
-    client_t    *client;
-    byte        mask[VIS_MAX_BYTES];
-    mleaf_t     *leaf1, *leaf2;
-    int         leafnum q_unused;
-    int         flags;
-    vec3_t      org;
+    client_t        *client;
+    byte            mask[VIS_MAX_BYTES];
+    mleaf_t         *leaf1, *leaf2;
+    mcastbucket_t   *b;
+    int             leafnum q_unused;
+    int             i, flags;
 
     flags = 0;
 
@@ -291,39 +492,48 @@ void SV_Multicast(vec3_t origin, multicast_t to)
         Com_Error(ERR_DROP, "SV_Multicast: bad to: %i", to);
     }
 
+    // reliable game messages may refer to configstrings set this frame
+    if (flags & MSG_RELIABLE)
+        SV_FlushConfigstrings();
+
     // send the data to all relevent clients
-    FOR_EACH_CLIENT(client) {
-        if (client->state < cs_primed) {
-            continue;
+    if (!leaf1) {
+        FOR_EACH_CLIENT(client) {
+            if (SV_MulticastWanted(client, flags))
+                SV_ClientAddMessage(client, flags);
         }
-        // do not send unreliables to connecting clients
-        if (!(flags & MSG_RELIABLE) && (client->state != cs_spawned ||
-                                        client->download || client->nodata)) {
+        goto done;
+    }
+
+    if (mcast.dirty || mcast.framenum != sv.framenum)
+        SV_BuildMulticastBuckets();
+
+    for (i = 0, b = mcast.buckets; i < mcast.numbuckets; i++, b++) {
+        if (!Q_IsBitSet(mask, b->cluster))
             continue;
-        }
 
-        if (leaf1) {
-            // find the client's PVS
-#if 0
-            player_state_t *ps = &client->edict->client->ps;
-            VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, org);
-#else
-            // FIXME: for some strange reason, game code assumes the server
-            // uses entity origin for PVS/PHS culling, not the view origin
-            VectorCopy(client->edict->s.origin, org);
-#endif
-            leaf2 = CM_PointLeaf(&sv.cm, org);
-            if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
-                continue;
-            if (leaf2->cluster == -1)
+        for (client = b->clients; client; client = client->mcast_next) {
+            if (!SV_MulticastWanted(client, flags))
                 continue;
-            if (!Q_IsBitSet(mask, leaf2->cluster))
+
+            // moved without being relinked, test it where it is now
+            leaf2 = SV_ClientLeaf(client);
+            if (leaf2->cluster != b->cluster) {
+                mcast.dirty = qtrue;
+                if (leaf2->cluster == -1)
+                    continue;
+                if (!Q_IsBitSet(mask, leaf2->cluster))
+                    continue;
+            }
+
+            if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
                 continue;
-        }
 
-        SV_ClientAddMessage(client, flags);
+            SV_ClientAddMessage(client, flags);
+        }
     }
 
+done:
     // add to MVD datagram
     SV_MvdMulticast(leafnum, to);
 
@@ -365,19 +575,176 @@ FRAME UPDATES - COMMON
 ===============================================================================
 */
 
+/*
+Queued messages come from server wide slabs, one free list per size class.
+Class 0 holds small messages and sounds, each following class doubles the
+payload up to MAX_MSGLEN. Slabs are carved on first use and kept until the
+server shuts down, so a server under steady load never touches the heap.
+*/
+#define MSG_SLAB_SIZE       0x10000
+#define MSG_NUM_CLASSES     10
+
+#define MSG_HEADER_SIZE     (sizeof(message_packet_t) - MSG_TRESHOLD)
+
+typedef struct {
+    list_t      entry;
+    size_t      size;
+} msg_slab_t;
+
+static struct {
+    list_t      free[MSG_NUM_CLASSES];
+    unsigned    total[MSG_NUM_CLASSES];     // blocks carved
+    unsigned    inuse[MSG_NUM_CLASSES];
+    unsigned    allocs[MSG_NUM_CLASSES];
+    list_t      slabs;
+    unsigned    numslabs;
+    size_t      slabbytes;
+    qboolean    initialized;
+} mp;
+
+static size_t msg_class_size(int c)
+{
+    size_t size = c ? MSG_HEADER_SIZE + (64 << c) : sizeof(message_packet_t);
+
+    return (size + 15) & ~15;
+}
+
+static int msg_class_for(size_t len)
+{
+    int c;
+
+    if (len <= MSG_TRESHOLD) {
+        return 0;
+    }
+    for (c = 1; (64 << c) < len; c++)
+        ;
+    return c;
+}
+
+static void carve_msg_slab(int c)
+{
+    size_t blocksize = msg_class_size(c);
+    size_t size = max(MSG_SLAB_SIZE, sizeof(msg_slab_t) + blocksize);
+    msg_slab_t *slab = SV_Malloc(size);
+    byte *p = (byte *)(slab + 1);
+    size_t i, count = (size - sizeof(*slab)) / blocksize;
+
+    slab->size = size;
+    List_Append(&mp.slabs, &slab->entry);
+    mp.numslabs++;
+    mp.slabbytes += size;
+
+    for (i = 0; i < count; i++, p += blocksize) {
+        List_Append(&mp.free[c], &((message_packet_t *)p)->entry);
+    }
+    mp.total[c] += count;
+}
+
+static void init_msg_pool(void)
+{
+    int c;
+
+    for (c = 0; c < MSG_NUM_CLASSES; c++) {
+        List_Init(&mp.free[c]);
+    }
+    List_Init(&mp.slabs);
+    mp.initialized = qtrue;
+}
+
+static message_packet_t *alloc_msg_packet(size_t len)
+{
+    int c = msg_class_for(len);
+    message_packet_t *msg;
+
+    if (!mp.initialized) {
+        init_msg_pool();
+    }
+
+    if (LIST_EMPTY(&mp.free[c])) {
+        carve_msg_slab(c);
+    }
+
+    msg = LIST_FIRST(message_packet_t, &mp.free[c], entry);
+    List_Remove(&msg->entry);
+    mp.inuse[c]++;
+    mp.allocs[c]++;
+    return msg;
+}
+
 static inline void free_msg_packet(client_t *client, message_packet_t *msg)
 {
+    int c = msg_class_for(msg->cursize);
+
     List_Remove(&msg->entry);
 
-    if (msg->cursize > MSG_TRESHOLD) {
+    if (c) {
         if (msg->cursize > client->msg_dynamic_bytes) {
             Com_Error(ERR_FATAL, "%s: bad packet size", __func__);
         }
         client->msg_dynamic_bytes -= msg->cursize;
-        Z_Free(msg);
     } else {
-        List_Insert(&client->msg_free_list, &msg->entry);
+        client->msg_free_slots++;
     }
+
+    List_Insert(&mp.free[c], &msg->entry);
+    mp.inuse[c]--;
+}
+
+/*
+==================
+SV_AllocSoundPacket
+
+Returns a sound packet that the caller fills and appends to the unreliable
+list, or NULL if the client has run out of message slots.
+==================
+*/
+message_packet_t *SV_AllocSoundPacket(client_t *client)
+{
+    if (!client->msg_free_slots) {
+        return NULL;
+    }
+
+    client->msg_free_slots--;
+    return alloc_msg_packet(0);
+}
+
+/*
+==================
+SV_ShutdownMessagePool
+
+Frees all slabs. Called after every client has been removed.
+==================
+*/
+void SV_ShutdownMessagePool(void)
+{
+    msg_slab_t *slab, *next;
+
+    if (!mp.initialized) {
+        return;
+    }
+
+    LIST_FOR_EACH_SAFE(msg_slab_t, slab, next, &mp.slabs, entry) {
+        Z_Free(slab);
+    }
+
+    memset(&mp, 0, sizeof(mp));
+}
+
+void SV_MessagePoolStatus(void)
+{
+    int c;
+
+    Com_Printf(
+        "class  size  blocks  in use     allocs\n"
+        "----- ----- ------- ------- ----------\n");
+
+    for (c = 0; c < MSG_NUM_CLASSES; c++) {
+        Com_Printf("%5d %5d %7u %7u %10u\n", c,
+                   c ? 64 << c : MSG_TRESHOLD,
+                   mp.total[c], mp.inuse[c], mp.allocs[c]);
+    }
+
+    Com_Printf("%u slabs, %"PRIz" bytes\n", mp.numslabs, mp.slabbytes);
 }
 
 #define FOR_EACH_MSG_SAFE(list) \
@@ -406,7 +773,7 @@ static void add_msg_packet(client_t    *client,
 {
     message_packet_t    *msg;
 
-    if (!client->msg_pool) {
+    if (!client->msg_active) {
         return; // already dropped
     }
 
@@ -419,18 +786,18 @@ static void add_msg_packet(client_t    *client,
                         __func__, client->name);
             goto overflowed;
         }
-        msg = SV_Malloc(sizeof(*msg) + len - MSG_TRESHOLD);
         client->msg_dynamic_bytes += len;
     } else {
-        if (LIST_EMPTY(&client->msg_free_list)) {
+        if (!client->msg_free_slots) {
             Com_WPrintf("%s: %s: out of message slots\n",
                         __func__, client->name);
             goto overflowed;
         }
-        msg = MSG_FIRST(&client->msg_free_list);
-        List_Remove(&msg->entry);
+        client->msg_free_slots--;
     }
 
+    msg = alloc_msg_packet(len);
+
     memcpy(msg->data, data, len);
     msg->cursize = (uint16_t)len;
 
@@ -510,8 +877,7 @@ static inline void write_snd(client_t *client, message_packet_t *msg, size_t max
     if (msg_write.cursize + MAX_SOUND_PACKET <= maxsize) {
         emit_snd(client, msg);
     }
-    List_Remove(&msg->entry);
-    List_Insert(&client->msg_free_list, &msg->entry);
+    free_msg_packet(client, msg);
 }
 
 static inline void write_msg(client_t *client, message_packet_t *msg, size_t maxsize)
@@ -649,12 +1015,12 @@ static void repack_unreliables(client_t *client, size_t maxsize)
     }
 }
 
-static void write_datagram_old(client_t *client)
+// determine how much space is left for unreliable data
+static size_t datagram_space_old(client_t *client)
 {
     message_packet_t *msg;
-    size_t maxsize, cursize;
+    size_t maxsize;
 
-    // determine how much space is left for unreliable data
     maxsize = client->netchan->maxpacketlen;
     if (client->netchan->reliable_length) {
         // there is still unacked reliable message pending
@@ -668,9 +1034,50 @@ static void write_datagram_old(client_t *client)
         }
     }
 
-    // send over all the relevant entity_state_t
+    return maxsize;
+}
+
+/*
+=======================
+SV_FrameBudget
+
+Returns how large a frame can get before the old netchan drops it, or with
+sv_entity_priority 2, before the new netchan has to fragment it. Entities
+past that are deferred by SV_EmitPacketEntities. 0 means no limit.
+=======================
+*/
+size_t SV_FrameBudget(client_t *client)
+{
+    netchan_t *netchan = client->netchan;
+
+    if (sv_entity_priority->integer <= 0) {
+        return 0;
+    }
+
+    if (netchan->type == NETCHAN_OLD) {
+        return datagram_space_old(client);
+    }
+
+    if (sv_entity_priority->integer < 2) {
+        return 0;
+    }
+
+    // pending reliable data goes out first
+    if (!netchan->reliable_length && netchan->message.cursize < netchan->maxpacketlen) {
+        return netchan->maxpacketlen - netchan->message.cursize;
+    }
+
+    return netchan->maxpacketlen;
+}
+
+static void write_datagram_old(client_t *client)
+{
+    size_t maxsize, cursize;
+
+    maxsize = datagram_space_old(client);
+
+    // msg_write already holds all the relevant entity_state_t
     // and the player_state_t
-    client->WriteFrame(client);
     if (msg_write.cursize > maxsize) {
         SV_DPrintf(0, "Frame %d overflowed for %s: %"PRIz" > %"PRIz"\n",
                    client->framenum, client->name, msg_write.cursize, maxsize);
@@ -728,10 +1135,8 @@ static void write_datagram_new(client_t *client)
 {
     size_t cursize;
 
-    // send over all the relevant entity_state_t
+    // msg_write already holds all the relevant entity_state_t
     // and the player_state_t
-    client->WriteFrame(client);
-
     if (msg_write.overflowed) {
         // should never really happen
         Com_WPrintf("Frame overflowed for %s\n", client->name);
@@ -791,6 +1196,11 @@ static void finish_frame(client_t *client)
         free_msg_packet(client, msg);
     }
     client->msg_unreliable_bytes = 0;
+
+    // fragments pending, download started, etc
+    if (LIST_EMPTY(&client->async_entry)) {
+        SV_ScheduleAsync(client);
+    }
 }
 
 #if (defined _DEBUG) && USE_FPS
@@ -808,6 +1218,195 @@ static void check_key_sync(client_t *client)
 }
 #endif
 
+/*
+===============================================================================
+
+SEND WORKERS
+
+Frames for spawned clients are built and delta encoded in parallel, each
+into a private buffer. Unreliables, reliables and the socket send are then
+done serially, in client order, exactly as for the single threaded path.
+
+===============================================================================
+*/
+
+#define MAX_SEND_THREADS    8
+
+typedef struct {
+    client_t        *client;
+    client_frame_t  *oldframe;
+    unsigned        first_entity;
+    byte            *data;      // [MAX_MSGLEN]
+    size_t          cursize;
+} sendjob_t;
+
+static struct {
+    qthread_t   *threads[MAX_SEND_THREADS];
+    int         numthreads;
+    deltacache_t    *caches[MAX_SEND_THREADS + 1];   // main thread last
+    qmutex_t    *lock;
+    qcond_t     *wake;
+    qcond_t     *done;
+    qboolean    quit;
+
+    sendjob_t   jobs[MAX_CLIENTS];
+    int         numjobs;
+    int         nextjob;
+    int         finished;
+} st;
+
+static void run_send_job(sendjob_t *job)
+{
+    client_t *client = job->client;
+
+    // msg_write is per thread, point it at the job buffer
+    SZ_TagInit(&msg_write, job->data, MAX_MSGLEN, SZ_MSG_WRITE);
+
+    SV_BuildClientFrame(client, job->first_entity);
+    client->WriteFrame(client, job->oldframe);
+
+    job->cursize = msg_write.cursize;
+}
+
+// called with the lock held, returns with it held
+static void SV_RunSendJobs(void)
+{
+    sendjob_t *job;
+
+    while (st.nextjob < st.numjobs) {
+        job = &st.jobs[st.nextjob++];
+        Sys_UnlockMutex(st.lock);
+
+        run_send_job(job);
+
+        Sys_LockMutex(st.lock);
+        if (++st.finished == st.numjobs) {
+            Sys_SignalCond(st.done);
+        }
+    }
+}
+
+static void SV_SendThread(void *arg)
+{
+    SV_SetDeltaCache(arg);
+
+    Sys_LockMutex(st.lock);
+    while (1) {
+        while (!st.quit && st.nextjob >= st.numjobs) {
+            Sys_WaitCond(st.wake, st.lock);
+        }
+        if (st.quit) {
+            break;
+        }
+        SV_RunSendJobs();
+    }
+    Sys_UnlockMutex(st.lock);
+}
+
+void SV_ShutdownSendThreads(void)
+{
+    int i;
+
+    SV_SetDeltaCache(NULL);
+    Z_Free(st.caches[MAX_SEND_THREADS]);
+    st.caches[MAX_SEND_THREADS] = NULL;
+
+    if (!st.numthreads) {
+        return;
+    }
+
+    Sys_LockMutex(st.lock);
+    st.quit = qtrue;
+    Sys_BroadcastCond(st.wake);
+    Sys_UnlockMutex(st.lock);
+
+    for (i = 0; i < st.numthreads; i++) {
+        Sys_JoinThread(st.threads[i]);
+    }
+
+    Sys_DestroyCond(st.done);
+    Sys_DestroyCond(st.wake);
+    Sys_DestroyMutex(st.lock);
+
+    for (i = 0; i < st.numthreads; i++) {
+        Z_Free(st.caches[i]);
+    }
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        Z_Free(st.jobs[i].data);
+    }
+    memset(&st, 0, sizeof(st));
+
+    sv_send_threads->modified = qtrue;
+}
+
+static qboolean SV_InitSendThreads(void)
+{
+    int i, count;
+
+    if (sv_send_threads->modified) {
+        SV_ShutdownSendThreads();
+        sv_send_threads->modified = qfalse;
+
+        count = Cvar_ClampInteger(sv_send_threads, 0, MAX_SEND_THREADS);
+        if (count) {
+            st.lock = Sys_CreateMutex();
+            st.wake = Sys_CreateCond();
+            st.done = Sys_CreateCond();
+            st.quit = qfalse;
+            st.numjobs = st.nextjob = st.finished = 0;
+            for (i = 0; i < count; i++) {
+                st.caches[i] = SV_CreateDeltaCache();
+                st.threads[i] = Sys_CreateThread(SV_SendThread, st.caches[i]);
+            }
+            st.numthreads = count;
+        }
+    }
+
+    return st.numthreads > 0;
+}
+
+static void write_threaded_frames(int numjobs)
+{
+    sendjob_t   *job;
+    client_t    *client;
+    sizebuf_t   saved;
+    int         i;
+
+    // workers can't print, do it for them
+    SV_FixEntityNumbers(st.jobs[0].client->pool);
+
+    // pick delta frames now that all entity states are reserved
+    for (i = 0, job = st.jobs; i < numjobs; i++, job++) {
+        job->oldframe = SV_GetLastFrame(job->client);
+        if (!job->data) {
+            job->data = SV_Malloc(MAX_MSGLEN);
+        }
+    }
+
+    // help the workers, then wait for stragglers
+    saved = msg_write;
+    Sys_LockMutex(st.lock);
+    st.numjobs = numjobs;
+    st.nextjob = st.finished = 0;
+    Sys_BroadcastCond(st.wake);
+    SV_RunSendJobs();
+    while (st.finished < st.numjobs) {
+        Sys_WaitCond(st.done, st.lock);
+    }
+    Sys_UnlockMutex(st.lock);
+    msg_write = saved;
+
+    for (i = 0, job = st.jobs; i < numjobs; i++, job++) {
+        client = job->client;
+
+        SZ_Write(&msg_write, job->data, job->cursize);
+        client->WriteDatagram(client);
+
+        client->framenum++;
+        finish_frame(client);
+    }
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -819,7 +1418,27 @@ Clients in earlier connection state are handled in SV_SendAsyncPackets.
 void SV_SendClientMessages(void)
 {
     client_t    *client;
+    sendjob_t   *job;
     size_t      cursize;
+    qboolean    threaded;
+    int         numjobs;
+
+    PROF_Begin(PROF_SEND_MESSAGES);
+
+    // MVD channels use their own edict pools, keep them serial
+    threaded = sv.state == ss_game && SV_InitSendThreads();
+    numjobs = 0;
+
+    SV_InvalidateVisMemo();
+    SV_InvalidateFrameCache();
+
+    if (!st.caches[MAX_SEND_THREADS]) {
+        st.caches[MAX_SEND_THREADS] = SV_CreateDeltaCache();
+    }
+    SV_SetDeltaCache(st.caches[MAX_SEND_THREADS]);
+
+    // hand datagrams to the kernel in as few calls as possible
+    NET_BatchPackets(NS_SERVER);
 
     // send a message to each connected client
     FOR_EACH_CLIENT(client) {
@@ -842,7 +1461,16 @@ void SV_SendClientMessages(void)
             goto finish;
         }
 
+        // spectators don't need every frame. unreliables are kept for
+        // the next frame that is sent, like for clients running at a
+        // lower frame rate.
+        if (client->framenum % SV_SnapshotDivisor(client)) {
+            client->framenum++;
+            continue;
+        }
+
         // don't overrun bandwidth
+        SV_UpdateRateControl(client);
         if (SV_RateDrop(client))
             goto advance;
 
@@ -854,8 +1482,24 @@ void SV_SendClientMessages(void)
             goto advance;
         }
 
+        // shared by all clients seeing the same edicts, done here while
+        // send threads are still waiting
+        SV_RefreshEdictVis(client);
+
+        if (threaded) {
+            // reserve the worst case, the rest is done after the loop
+            job = &st.jobs[numjobs++];
+            job->client = client;
+            job->first_entity = svs.next_entity;
+            svs.next_entity += MAX_PACKET_ENTITIES;
+            continue;
+        }
+
         // build the new frame and write it
-        SV_BuildClientFrame(client);
+        PROF_Begin(PROF_BUILD_FRAME);
+        svs.next_entity += SV_BuildClientFrame(client, svs.next_entity);
+        PROF_End(PROF_BUILD_FRAME);
+        client->WriteFrame(client, SV_GetLastFrame(client));
         client->WriteDatagram(client);
 
 advance:
@@ -866,6 +1510,158 @@ finish:
         // clear all unreliable messages still left
         finish_frame(client);
     }
+
+    if (numjobs) {
+        // frames are built on send threads, time the wait for all of them
+        PROF_Begin(PROF_BUILD_FRAME);
+        write_threaded_frames(numjobs);
+        PROF_End(PROF_BUILD_FRAME);
+    }
+
+    NET_FlushPackets(NS_SERVER);
+
+    PROF_End(PROF_SEND_MESSAGES);
+}
+
+/*
+===============================================================================
+
+ASYNC SCHEDULE
+
+SV_SendAsyncPackets only visits clients that need it: those still connecting,
+downloading or in nodata mode, and spawned ones with fragments pending. They
+sit on the ready list while they may send, and in a timer wheel slot for the
+millisecond their rate allows the next packet. Others are picked up again
+from finish_frame once they need async sends.
+
+===============================================================================
+*/
+
+#define ASYNC_WHEEL_SIZE    1024    // msec, must be a power of two
+#define ASYNC_WHEEL_MASK    (ASYNC_WHEEL_SIZE - 1)
+
+static struct {
+    list_t      ready;
+    list_t      wheel[ASYNC_WHEEL_SIZE];
+    unsigned    time;       // next slot to expire
+    qboolean    initialized;
+} as;
+
+#define ASYNC_DUE(client) \
+    (svs.realtime - (client)->send_time >= (client)->send_delta)
+
+static void init_async(void)
+{
+    int i;
+
+    List_Init(&as.ready);
+    for (i = 0; i < ASYNC_WHEEL_SIZE; i++) {
+        List_Init(&as.wheel[i]);
+    }
+    as.time = svs.realtime;
+    as.initialized = qtrue;
+}
+
+static inline qboolean async_wanted(client_t *client)
+{
+    return client->netchan->fragment_pending || client->state != cs_spawned ||
+        client->download || client->nodata;
+}
+
+static void park_async(client_t *client)
+{
+    unsigned due = client->send_time + client->send_delta;
+
+    List_Remove(&client->async_entry);
+    List_Append(&as.wheel[due & ASYNC_WHEEL_MASK], &client->async_entry);
+}
+
+/*
+==================
+SV_ScheduleAsync
+
+Puts the client where its current send time says, if it needs async sends.
+==================
+*/
+void SV_ScheduleAsync(client_t *client)
+{
+    if (!as.initialized) {
+        init_async();
+    }
+
+    List_Delete(&client->async_entry);
+
+    if (!client->msg_active || !async_wanted(client)) {
+        return;
+    }
+
+    List_Append(&as.ready, &client->async_entry);
+    if (!ASYNC_DUE(client)) {
+        park_async(client);
+    }
+}
+
+static void expire_async_slot(list_t *slot)
+{
+    client_t *client, *next;
+
+    LIST_FOR_EACH_SAFE(client_t, client, next, slot, async_entry) {
+        if (ASYNC_DUE(client)) {
+            List_Remove(&client->async_entry);
+            List_Append(&as.ready, &client->async_entry);
+        } else if (&as.wheel[(client->send_time + client->send_delta) &
+                             ASYNC_WHEEL_MASK] != slot) {
+            park_async(client);     // send time changed meanwhile
+        }
+    }
+}
+
+static void send_async_packet(client_t *client)
+{
+    qboolean    retransmit;
+    netchan_t   *netchan;
+    size_t      cursize;
+
+    netchan = client->netchan;
+
+    // make sure all fragments are transmitted first
+    if (netchan->fragment_pending) {
+        cursize = netchan->TransmitNextFragment(netchan);
+        SV_DPrintf(0, "%s: frag: %"PRIz"\n", client->name, cursize);
+        goto calctime;
+    }
+
+    // spawned clients are handled elsewhere
+    if (client->state == cs_spawned && !client->download && !client->nodata && !SV_PAUSED) {
+        return;
+    }
+
+    // see if it's time to resend a (possibly dropped) packet
+    retransmit = (com_localTime - netchan->last_sent > 1000);
+
+    // don't write new reliables if not yet acknowledged
+    if (netchan->reliable_length && !retransmit && client->state != cs_zombie) {
+        return;
+    }
+
+#if USE_ZLIB
+    // keep windowed downloads going as soon as the last window is acked
+    if (!netchan->reliable_length && !netchan->message.cursize) {
+        SV_StreamDownload(client);
+    }
+#endif
+
+    // just update reliable if needed
+    if (netchan->type == NETCHAN_OLD) {
+        write_reliables_old(client, netchan->maxpacketlen);
+    }
+    if (netchan->message.cursize || netchan->reliable_ack_pending ||
+        netchan->reliable_length || retransmit) {
+        cursize = netchan->Transmit(netchan, 0, NULL, 1);
+        SV_DPrintf(0, "%s: send: %"PRIz"\n", client->name, cursize);
+calctime:
+        SV_CalcSendTime(client, cursize);
+    }
 }
 
 /*
@@ -882,65 +1678,61 @@ packets synchronously with game DLL ticks.
 */
 void SV_SendAsyncPackets(void)
 {
-    qboolean    retransmit;
-    client_t    *client;
-    netchan_t   *netchan;
-    size_t      cursize;
+    client_t    *client, *next;
+    int         i, count;
 
-    FOR_EACH_CLIENT(client) {
-        // don't overrun bandwidth
-        if (svs.realtime - client->send_time < client->send_delta) {
-            continue;
-        }
+    if (!as.initialized) {
+        init_async();
+    }
 
-        netchan = client->netchan;
+    // move clients whose time has come to the ready list
+    count = (int)(svs.realtime - as.time) + 1;
+    if (count <= 0 || count > ASYNC_WHEEL_SIZE) {
+        count = ASYNC_WHEEL_SIZE;
+    }
+    for (i = 0; i < count; i++) {
+        expire_async_slot(&as.wheel[(as.time + i) & ASYNC_WHEEL_MASK]);
+    }
+    as.time = svs.realtime + 1;
 
-        // make sure all fragments are transmitted first
-        if (netchan->fragment_pending) {
-            cursize = netchan->TransmitNextFragment(netchan);
-            SV_DPrintf(0, "%s: frag: %"PRIz"\n", client->name, cursize);
-            goto calctime;
+    // paused spawned clients aren't scheduled, check everyone
+    if (SV_PAUSED) {
+        FOR_EACH_CLIENT(client) {
+            if (ASYNC_DUE(client)) {
+                send_async_packet(client);
+            }
         }
+        return;
+    }
 
-        // spawned clients are handled elsewhere
-        if (client->state == cs_spawned && !client->download && !client->nodata && !SV_PAUSED) {
+    LIST_FOR_EACH_SAFE(client_t, client, next, &as.ready, async_entry) {
+        if (!async_wanted(client)) {
+            List_Delete(&client->async_entry);
             continue;
         }
 
-        // see if it's time to resend a (possibly dropped) packet
-        retransmit = (com_localTime - netchan->last_sent > 1000);
-
-        // don't write new reliables if not yet acknowledged
-        if (netchan->reliable_length && !retransmit && client->state != cs_zombie) {
-            continue;
+        // frames may have been sent since this client was put here
+        if (ASYNC_DUE(client)) {
+            send_async_packet(client);
         }
 
-        // just update reliable if needed
-        if (netchan->type == NETCHAN_OLD) {
-            write_reliables_old(client, netchan->maxpacketlen);
-        }
-        if (netchan->message.cursize || netchan->reliable_ack_pending ||
-            netchan->reliable_length || retransmit) {
-            cursize = netchan->Transmit(netchan, 0, NULL, 1);
-            SV_DPrintf(0, "%s: send: %"PRIz"\n", client->name, cursize);
-calctime:
-            SV_CalcSendTime(client, cursize);
+        // don't overrun bandwidth
+        if (!ASYNC_DUE(client)) {
+            park_async(client);
         }
     }
 }
 
 void SV_InitClientSend(client_t *newcl)
 {
-    int i;
-
-    List_Init(&newcl->msg_free_list);
     List_Init(&newcl->msg_unreliable_list);
     List_Init(&newcl->msg_reliable_list);
 
-    newcl->msg_pool = SV_Malloc(sizeof(message_packet_t) * MSG_POOLSIZE);
-    for (i = 0; i < MSG_POOLSIZE; i++) {
-        List_Append(&newcl->msg_free_list, &newcl->msg_pool[i].entry);
-    }
+    newcl->msg_free_slots = MSG_POOLSIZE;
+    newcl->msg_active = qtrue;
+
+    List_Init(&newcl->async_entry);
+    SV_ScheduleAsync(newcl);
 
     // setup protocol
     if (newcl->netchan->type == NETCHAN_NEW) {
@@ -956,9 +1748,9 @@ void SV_ShutdownClientSend(client_t *client)
 {
     free_all_messages(client);
 
-    Z_Free(client->msg_pool);
-    client->msg_pool = NULL;
+    client->msg_free_slots = 0;
+    client->msg_active = qfalse;
 
-    List_Init(&client->msg_free_list);
+    List_Delete(&client->async_entry);
 }
 
@@ -32,9 +32,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/net.h"
 #include "common/net/chan.h"
 #include "common/pmove.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/x86/fpu.h"
+#include "common/zdict.h"
 #include "common/zone.h"
 
 #include "client/client.h"
@@ -88,6 +90,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // game features this server supports
 #define SV_FEATURES (GMF_CLIENTNUM | GMF_PROPERINUSE | GMF_MVDSPEC | \
                      GMF_WANT_ALL_DISCONNECTS | GMF_ENHANCED_SAVEGAMES | \
+                     GMF_BATCHED_TRACES | GMF_PREFETCH_TRACES | \
+                     GMF_PROFILE_ZONES | \
                      SV_GMF_VARIABLE_FPS)
 
 // ugly hack for SV_Shutdown
@@ -108,6 +112,26 @@ typedef struct {
     int         latency;
 } client_frame_t;
 
+// clusters touched by an edict, as a window of PVS bytes that can be tested
+// with a single vector AND, filled in by SV_LinkEdict. together with the
+// flags summarized by SV_RefreshEdictVis once per frame, this is all that
+// visible_entities needs to look at for entities that aren't sent.
+#define EDICT_VIS_BYTES     16
+
+#define EVIS_VALID      1   // flags are current, areas and clusters match edict
+#define EVIS_SENDABLE   2   // in use and has something to send
+#define EVIS_BEAM       4   // RF_BEAM, checked against PHS
+
+typedef struct {
+    int         base;       // first PVS byte, -1 if the window can't be used
+    int         num_clusters;
+    int         cluster;    // copy of clusternums[0]
+    byte        bits[EDICT_VIS_BYTES];
+    int         areanum, areanum2;
+    unsigned    flags;      // EVIS_* bits
+    unsigned    generation; // of the whole array, only kept in slot 0
+} edict_vis_t;
+
 typedef struct {
     int         solid32;
 
@@ -160,8 +184,11 @@ typedef struct {
     char        *entitystring;
 
     char        configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
+    byte        pendingcs[(MAX_CONFIGSTRINGS + 7) / 8];    // changed this frame
+    int         numpendingcs;
 
     server_entity_t entities[MAX_EDICTS];
+    edict_vis_t     entvis[MAX_EDICTS];
 
     unsigned    tracecount;
 } server_t;
@@ -233,6 +260,8 @@ typedef struct {
 
 #define RATE_MESSAGES   10
 
+#define MAX_PENDING_MOVES   64      // queued per client for sv_parallel_pmove
+
 #define FOR_EACH_CLIENT(client) \
     LIST_FOR_EACH(client_t, client, &sv_clientlist, entry)
 
@@ -250,6 +279,26 @@ typedef struct {
     unsigned    cost;
 } ratelimit_t;
 
+// frame round trip times, see SV_AddLatency
+#define LATENCY_BUCKETS 12
+
+typedef struct {
+    unsigned    time;                       // start of the current second
+    unsigned    cur[LATENCY_BUCKETS];
+    unsigned    last[LATENCY_BUCKETS];      // last full second
+    unsigned    total[LATENCY_BUCKETS];
+} latstats_t;
+
+// adaptive send budget, see SV_UpdateRateControl
+typedef struct {
+    size_t      rate;           // current budget, 0 when unlimited
+    int         interval;       // send every Nth frame
+    int         min_rtt;
+    unsigned    time;           // start of the current window
+    unsigned    frames_sent, frames_acked;
+    unsigned    backoffs;       // for statistics
+} ratecontrol_t;
+
 typedef struct client_s {
     list_t          entry;
 
@@ -292,6 +341,7 @@ typedef struct client_s {
 
     int             ping, min_ping, max_ping;
     int             avg_ping_time, avg_ping_count;
+    latstats_t      *latstats;      // allocated while sv_latency_stats is set
 
     // frame encoding
     client_frame_t  frames[UPDATE_BACKUP];    // updates can be delta'd from here
@@ -305,13 +355,21 @@ typedef struct client_s {
     // rate dropping
     size_t          message_size[RATE_MESSAGES];    // used to rate drop normal packets
     int             suppress_count;                 // number of messages rate suppressed
+    unsigned        total_suppressed;               // for statistics
+    ratecontrol_t   cc;
+
+    // entity priority
+    byte            entity_deferred[MAX_EDICTS];    // frames each entity was put off
+    unsigned        total_truncated, total_deferred;
     unsigned        send_time, send_delta;          // used to rate drop async packets
+    list_t          async_entry;                    // ready list or timer wheel slot
 
     // current download
     byte            *download;      // file being downloaded
     int             downloadsize;   // total bytes (can't use EOF because of paks)
     int             downloadcount;  // bytes sent
     char            *downloadname;  // name of the file
+    qboolean        downloadstream; // windowed, deflated, no nextdl
 
     // protocol stuff
     int             challenge;  // challenge of this user, randomly generated
@@ -322,11 +380,16 @@ typedef struct client_s {
     pmoveParams_t   pmp;        // spectator speed, etc
     msgEsFlags_t    esFlags;    // entity protocol flags
 
+    // moves waiting for SV_RunPendingMoves
+    usercmd_t       pending_moves[MAX_PENDING_MOVES];
+    int             num_pending_moves;
+    int             pmove_mask;     // the game traces with, 0 if unknown
+
     // packetized messages
-    list_t              msg_free_list;
     list_t              msg_unreliable_list;
     list_t              msg_reliable_list;
-    message_packet_t    *msg_pool;
+    unsigned            msg_free_slots;         // small packets left to queue
+    qboolean            msg_active;
     size_t              msg_unreliable_bytes;   // total size of unreliable datagram
     size_t              msg_dynamic_bytes;      // total size of dynamic memory allocated
 
@@ -337,6 +400,7 @@ typedef struct client_s {
     char            *configstrings;
     char            *gamedir, *mapname;
     edict_pool_t    *pool;
+    edict_vis_t     *entvis;
     cm_t            *cm;
     int             slot;
     int             spawncount;
@@ -344,7 +408,7 @@ typedef struct client_s {
 
     // netchan type dependent methods
     void            (*AddMessage)(struct client_s *, byte *, size_t, qboolean);
-    void            (*WriteFrame)(struct client_s *);
+    void            (*WriteFrame)(struct client_s *, client_frame_t *);
     void            (*WriteDatagram)(struct client_s *);
 
     // netchan
@@ -354,6 +418,12 @@ typedef struct client_s {
     // misc
     time_t          connect_time; // time of initial connect
 
+    // multicast leaf cache, see SV_Multicast
+    mleaf_t         *mcast_leaf;
+    vec3_t          mcast_origin;
+    int             mcast_spawncount;
+    struct client_s *mcast_next;    // in the same cluster bucket
+
 #if USE_AC_SERVER
     qboolean        ac_valid;
     ac_query_t      ac_query_sent;
@@ -488,8 +558,24 @@ extern cvar_t       *sv_debug;
 extern cvar_t       *sv_pad_packets;
 #endif
 extern cvar_t       *sv_novis;
+extern cvar_t       *sv_area_depth;
+extern cvar_t       *sv_trace_cache;
+extern cvar_t       *sv_send_threads;
+extern cvar_t       *sv_trace_threads;
+extern cvar_t       *sv_parallel_pmove;
+extern cvar_t       *sv_gameprof;
 extern cvar_t       *sv_lan_force_rate;
 extern cvar_t       *sv_calcpings_method;
+extern cvar_t       *sv_latency_stats;
+extern cvar_t       *sv_adaptive_rate;
+#if USE_ZLIB
+extern cvar_t       *sv_download_window;
+#endif
+extern cvar_t       *sv_spectator_snapdiv;
+extern cvar_t       *sv_entity_priority;
+#if USE_CLIENT
+extern cvar_t       *sv_loop_handoff;
+#endif
 extern cvar_t       *sv_changemapcmd;
 
 extern cvar_t       *sv_strafejump_hack;
@@ -529,6 +615,11 @@ void SV_DropClient(client_t *drop, const char *reason);
 void SV_RemoveClient(client_t *client);
 void SV_CleanClient(client_t *client);
 
+extern const unsigned sv_latency_bounds[LATENCY_BUCKETS - 1];
+
+void SV_AddLatency(client_t *client, unsigned latency);
+latstats_t *SV_LatencyStats(client_t *client);
+
 void SV_InitOperatorCommands(void);
 
 void SV_UserinfoChanged(client_t *cl);
@@ -538,6 +629,10 @@ void SV_RateRecharge(ratelimit_t *r);
 void SV_RateInit(ratelimit_t *r, const char *s);
 
 addrmatch_t *SV_MatchAddress(list_t *list, netadr_t *address);
+void SV_AddressListChanged(list_t *list);
+#if USE_TESTS
+void SV_MatchTest_f(void);
+#endif
 
 int SV_CountClients(void);
 
@@ -569,10 +664,17 @@ extern char sv_outputbuf[SV_OUTPUTBUF_LENGTH];
 
 void SV_FlushRedirect(int redirected, char *outputbuf, size_t len);
 
+// current send budget, bytes per second
+#define SV_ClientRate(cl) \
+    ((cl)->cc.rate ? (cl)->cc.rate : (cl)->rate)
+
 void SV_SendClientMessages(void);
+void SV_ShutdownSendThreads(void);
 void SV_SendAsyncPackets(void);
+size_t SV_FrameBudget(client_t *client);
 
 void SV_Multicast(vec3_t origin, multicast_t to);
+void SV_InvalidateMulticast(void);
 void SV_ClientPrintf(client_t *cl, int level, const char *fmt, ...) q_printf(3, 4);
 void SV_BroadcastPrintf(int level, const char *fmt, ...) q_printf(2, 3);
 void SV_ClientCommand(client_t *cl, const char *fmt, ...) q_printf(2, 3);
@@ -580,6 +682,17 @@ void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
 void SV_ClientAddMessage(client_t *client, int flags);
 void SV_ShutdownClientSend(client_t *client);
 void SV_InitClientSend(client_t *newcl);
+message_packet_t *SV_AllocSoundPacket(client_t *client);
+void SV_ScheduleAsync(client_t *client);
+void SV_ShutdownMessagePool(void);
+void SV_MessagePoolStatus(void);
+
+//
+// metrics.c
+//
+void SV_MetricsInit(void);
+void SV_MetricsRun(void);
+void SV_MetricsFrame(unsigned usec);
 
 //
 // sv_mvd.c
@@ -591,6 +704,7 @@ void SV_MvdShutdown(error_type_t type);
 void SV_MvdBeginFrame(void);
 void SV_MvdEndFrame(void);
 void SV_MvdRunClients(void);
+int SV_MvdClientCount(void);
 void SV_MvdStatus_f(void);
 void SV_MvdMapChanged(void);
 void SV_MvdClientDropped(client_t *client);
@@ -612,6 +726,7 @@ void SV_MvdStop_f(void);
 #define SV_MvdBeginFrame()          (void)0
 #define SV_MvdEndFrame()            (void)0
 #define SV_MvdRunClients()          (void)0
+#define SV_MvdClientCount()         0
 #define SV_MvdStatus_f()            (void)0
 #define SV_MvdMapChanged()          (void)0
 #define SV_MvdClientDropped(client) (void)0
@@ -667,10 +782,19 @@ void AC_Info_f(void);
 // sv_user.c
 //
 void SV_New_f(void);
+#if USE_ZLIB
+void SV_FreeGamestateCache(void);
+#endif
 void SV_Begin_f(void);
 void SV_Nextserver(void);
 void SV_ExecuteClientMessage(client_t *cl);
+void SV_RunPendingMoves(void);
+void SV_FlushPendingMoves(client_t *client);
+qboolean SV_ReplayPmove(pmove_t *pm, int contentmask);
 void SV_CloseDownload(client_t *client);
+#if USE_ZLIB
+void SV_StreamDownload(client_t *client);
+#endif
 
 //
 // sv_ccmds.c
@@ -692,10 +816,22 @@ void SV_PrintMiscInfo(void);
 #define ES_INUSE(s) \
     ((s)->modelindex || (s)->effects || (s)->sound || (s)->event)
 
+typedef struct deltacache_s deltacache_t;
+
 void SV_BuildProxyClientFrame(client_t *client);
-void SV_BuildClientFrame(client_t *client);
-void SV_WriteFrameToClient_Default(client_t *client);
-void SV_WriteFrameToClient_Enhanced(client_t *client);
+void SV_InvalidateVisMemo(void);
+void SV_RefreshEdictVis(client_t *client);
+void SV_InvalidateFrameCache(void);
+deltacache_t *SV_CreateDeltaCache(void);
+void SV_SetDeltaCache(deltacache_t *cache);
+unsigned SV_BuildClientFrame(client_t *client, unsigned first_entity);
+void SV_FixEntityNumbers(edict_pool_t *pool);
+client_frame_t *SV_GetLastFrame(client_t *client);
+void SV_WriteFrameToClient_Default(client_t *client, client_frame_t *oldframe);
+void SV_WriteFrameToClient_Enhanced(client_t *client, client_frame_t *oldframe);
+#if USE_CLIENT
+void SV_WriteFrameToClient_Loop(client_t *client, client_frame_t *oldframe);
+#endif
 
 //
 // sv_game.c
@@ -705,15 +841,22 @@ extern    game_export_t    *ge;
 void SV_InitGameProgs(void);
 void SV_ShutdownGameProgs(void);
 void SV_InitEdict(edict_t *e);
+void SV_FlushConfigstrings(void);
 
 void PF_Pmove(pmove_t *pm);
 
+void SV_ProfileBegin(const char *name);
+void SV_ProfileEnd(const char *name);
+void SV_ProfileFrame(void);
+void SV_GameProf_f(void);
+
 #if USE_CLIENT
 //
 // sv_save.c
 //
 void SV_Savegame_f(void);
 void SV_Loadgame_f(void);
+void SV_FinishSavegame(qboolean wait);
 #endif
 
 //============================================================
@@ -729,7 +872,7 @@ void PF_UnlinkEdict(edict_t *ent);
 // call before removing an entity, and before trying to move one,
 // so it doesn't clip against itself
 
-void SV_LinkEdict(cm_t *cm, edict_t *ent);
+void SV_LinkEdict(cm_t *cm, edict_t *ent, edict_vis_t *vis);
 void PF_LinkEdict(edict_t *ent);
 // Needs to be called any time an entity changes origin, mins, maxs,
 // or solid.  Automatically unlinks if needed.
@@ -745,7 +888,14 @@ int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int ar
 // returns the number of pointers filled in
 // ??? does this always return the world?
 
-qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, byte *mask);
+qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, const edict_vis_t *vis, byte *mask);
+qboolean SV_EdictWindowVisible(const edict_vis_t *vis, const byte *mask);
+void SV_AreaStats_f(void);
+#if USE_TESTS
+void SV_VisBench_f(void);
+void SV_TraceBench_f(void);
+void SV_AreaBench_f(void);
+#endif
 
 //===================================================================
 
@@ -758,6 +908,44 @@ int SV_PointContents(vec3_t p);
 
 trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
                            edict_t *passedict, int contentmask);
+void SV_BoxTraces(const trace_request_t *requests, trace_t *results, int count);
+void SV_PrefetchTraces(const trace_request_t *requests, int count);
+void SV_ShutdownTraceThreads(void);
+
+typedef void (*workerfunc_t)(void *arg, int index);
+
+void SV_RunWorkerJobs(workerfunc_t func, void *arg, int count, int batch);
+
+#define MAX_PROBE_TOUCH     32
+
+typedef struct {
+    edict_t     *ent, *owner;
+    int         linkcount;
+    solid_t     solid;
+    int         svflags;
+    int         modelindex;
+    vec3_t      origin, angles;
+    vec3_t      mins, maxs;
+} probetouch_t;
+
+// what queries of a move run ahead depended on, see world.c
+typedef struct {
+    edict_t     *passent, *passowner;
+    qboolean    passsolid;
+    int         contentmask;
+    vec3_t      origin, mins, maxs;     // where passent is assumed to be
+    vec3_t      absmin, absmax;         // of all queries
+    int         numtouch;
+    probetouch_t    touch[MAX_PROBE_TOUCH];
+    qboolean    overflowed;
+} worldprobe_t;
+
+void SV_InitProbe(worldprobe_t *probe, edict_t *ent, int contentmask);
+trace_t SV_ProbeTrace(worldprobe_t *probe, vec3_t start, vec3_t mins,
+                      vec3_t maxs, vec3_t end);
+int SV_ProbePointContents(worldprobe_t *probe, vec3_t p);
+qboolean SV_CheckProbe(const worldprobe_t *probe);
+void SV_LogRelinks(qboolean enable);
 // mins and maxs are relative
 
 // if the entire move stays in a solid volume, trace.allsolid will be set,
@@ -20,7 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server.h"
 
 #if USE_FPS
-static void align_key_frames(void);
+static void align_key_frames(client_t *client);
 #endif
 
 /*
@@ -161,6 +161,93 @@ static void write_plain_baselines(void)
 
 #if USE_ZLIB
 
+/*
+Clients connecting together, as they all do after a map change, usually get
+the same gamestate bytes. The last few compressed gamestates are kept along
+with the bytes they came from, so a repeat costs a compare and a copy
+instead of a deflate. Any change to a configstring or a baseline, or to
+protocol flags that affect encoding, simply misses.
+*/
+#define GAMESTATE_CACHE_SIZE    4
+
+typedef struct {
+    byte        *in;
+    size_t      inlen;
+    byte        *out;
+    size_t      outlen;
+    qboolean    zdict;
+    unsigned    used;
+} zgamestate_t;
+
+static zgamestate_t zgamestates[GAMESTATE_CACHE_SIZE];
+static unsigned     zgamestate_seq;
+
+// newer clients agree on a preset dictionary, see zdict.c
+static qboolean use_zdict(void)
+{
+    return sv_client->protocol == PROTOCOL_VERSION_Q2PRO &&
+        sv_client->version >= PROTOCOL_VERSION_Q2PRO_ZLIB_DICT;
+}
+
+static void z_start(qboolean zdict)
+{
+    deflateReset(&svs.z);
+    if (zdict) {
+        deflateSetDictionary(&svs.z, (const Bytef *)zdict_data, (uInt)zdict_size);
+    }
+}
+
+static zgamestate_t *find_zgamestate(const byte *data, size_t len, qboolean zdict)
+{
+    zgamestate_t *z;
+    int i;
+
+    for (i = 0, z = zgamestates; i < GAMESTATE_CACHE_SIZE; i++, z++) {
+        if (z->inlen == len && z->zdict == zdict && !memcmp(z->in, data, len)) {
+            z->used = ++zgamestate_seq;
+            return z;
+        }
+    }
+
+    return NULL;
+}
+
+static void add_zgamestate(const byte *in, size_t inlen,
+                           const byte *out, size_t outlen, qboolean zdict)
+{
+    zgamestate_t *z, *oldest = zgamestates;
+    int i;
+
+    for (i = 1, z = zgamestates + 1; i < GAMESTATE_CACHE_SIZE; i++, z++) {
+        if (z->used < oldest->used) {
+            oldest = z;
+        }
+    }
+
+    Z_Free(oldest->in);
+    Z_Free(oldest->out);
+    oldest->in = SV_Malloc(inlen);
+    oldest->out = SV_Malloc(outlen);
+    memcpy(oldest->in, in, inlen);
+    memcpy(oldest->out, out, outlen);
+    oldest->inlen = inlen;
+    oldest->outlen = outlen;
+    oldest->zdict = zdict;
+    oldest->used = ++zgamestate_seq;
+}
+
+void SV_FreeGamestateCache(void)
+{
+    int i;
+
+    for (i = 0; i < GAMESTATE_CACHE_SIZE; i++) {
+        Z_Free(zgamestates[i].in);
+        Z_Free(zgamestates[i].out);
+    }
+
+    memset(zgamestates, 0, sizeof(zgamestates));
+}
+
 static void write_compressed_gamestate(void)
 {
     sizebuf_t   *buf = &sv_client->netchan->message;
@@ -169,6 +256,8 @@ static void write_compressed_gamestate(void)
     size_t      length;
     uint8_t     *patch;
     char        *string;
+    zgamestate_t    *z;
+    qboolean    zdict = use_zdict();
 
     MSG_WriteByte(svc_gamestate);
 
@@ -208,18 +297,40 @@ static void write_compressed_gamestate(void)
     patch = SZ_GetSpace(buf, 2);
     SZ_WriteShort(buf, msg_write.cursize);
 
-    deflateReset(&svs.z);
+    z = find_zgamestate(msg_write.data, msg_write.cursize, zdict);
+    if (z) {
+        SZ_Clear(&msg_write);
+
+        if (z->outlen > buf->maxsize - buf->cursize) {
+            SV_DropClient(sv_client, "deflate() failed on gamestate");
+            return;
+        }
+
+        SV_DPrintf(0, "%s: comp: cached %"PRIz"\n", sv_client->name, z->outlen);
+
+        patch[0] = z->outlen & 255;
+        patch[1] = (z->outlen >> 8) & 255;
+        memcpy(buf->data + buf->cursize, z->out, z->outlen);
+        buf->cursize += z->outlen;
+        return;
+    }
+
+    z_start(zdict);
     svs.z.next_in = msg_write.data;
     svs.z.avail_in = (uInt)msg_write.cursize;
     svs.z.next_out = buf->data + buf->cursize;
     svs.z.avail_out = (uInt)(buf->maxsize - buf->cursize);
-    SZ_Clear(&msg_write);
 
     if (deflate(&svs.z, Z_FINISH) != Z_STREAM_END) {
+        SZ_Clear(&msg_write);
         SV_DropClient(sv_client, "deflate() failed on gamestate");
         return;
     }
 
+    add_zgamestate(msg_write.data, msg_write.cursize,
+                   buf->data + buf->cursize, svs.z.total_out, zdict);
+    SZ_Clear(&msg_write);
+
     SV_DPrintf(0, "%s: comp: %lu into %lu\n",
                sv_client->name, svs.z.total_in, svs.z.total_out);
 
@@ -252,7 +363,7 @@ static inline int z_flush(byte *buffer)
 
 static inline void z_reset(byte *buffer)
 {
-    deflateReset(&svs.z);
+    z_start(use_zdict());
     svs.z.next_out = buffer;
     svs.z.avail_out = (uInt)(sv_client->netchan->maxpacketlen - 5);
 }
@@ -520,7 +631,7 @@ void SV_Begin_f(void)
     sv_client->suppress_count = 0;
     sv_client->http_download = qfalse;
 #if USE_FPS
-    align_key_frames();
+    align_key_frames(sv_client);
 #endif
 
     stuff_cmds(&sv_cmdlist_begin);
@@ -534,6 +645,8 @@ void SV_Begin_f(void)
 //=============================================================================
 
 #define MAX_DOWNLOAD_CHUNK    1024
+#define MAX_STREAM_CHUNK      0x4000    // raw bytes deflated at once
+#define MAX_STREAM_WINDOW     (MAX_MSGLEN - 0x400)
 
 void SV_CloseDownload(client_t *client)
 {
@@ -547,8 +660,111 @@ void SV_CloseDownload(client_t *client)
     }
     client->downloadsize = 0;
     client->downloadcount = 0;
+    client->downloadstream = qfalse;
+}
+
+static int download_percent(client_t *client)
+{
+    int size = client->downloadsize;
+
+    if (!size)
+        size = 1;
+    return client->downloadcount * 100 / size;
 }
 
+static void finish_download(client_t *client)
+{
+    SV_CloseDownload(client);
+#if USE_FPS
+    if (client->state == cs_spawned)
+        align_key_frames(client);
+#endif
+}
+
+#if USE_ZLIB
+
+// Twice the bandwidth-delay product, so that the next window is usually
+// acknowledged before fragments of this one stop going out.
+static size_t download_window(client_t *client)
+{
+    size_t window, rate = SV_ClientRate(client);
+    int limit = Cvar_ClampInteger(sv_download_window, MAX_DOWNLOAD_CHUNK, MAX_STREAM_WINDOW);
+
+    if (!rate)
+        return limit;
+
+    window = rate * 2 * max(client->ping, 50) / 1000;
+    clamp(window, MAX_DOWNLOAD_CHUNK, limit);
+    return window;
+}
+
+/*
+==================
+SV_StreamDownload
+
+Called for streaming clients whenever their reliable message is acknowledged.
+Fills a new one with independently deflated chunks, which the netchan then
+fragments and paces by client rate. Chunks that don't compress go out as
+plain svc_download.
+==================
+*/
+void SV_StreamDownload(client_t *client)
+{
+    byte    buffer[MAX_STREAM_CHUNK];
+    size_t  window, space, raw;
+    byte    *data;
+
+    if (!client->download || !client->downloadstream)
+        return;
+
+    window = download_window(client);
+
+    while (client->downloadcount < client->downloadsize) {
+        space = window > msg_write.cursize + 6 ? window - msg_write.cursize - 6 : 0;
+        raw = client->downloadsize - client->downloadcount;
+        if (msg_write.cursize && space < min(raw, MAX_DOWNLOAD_CHUNK))
+            break;
+
+        raw = min(raw, MAX_STREAM_CHUNK);
+        raw = min(raw, max(space, MAX_DOWNLOAD_CHUNK));
+
+        data = client->download + client->downloadcount;
+        client->downloadcount += raw;
+
+        z_start(qfalse);
+        svs.z.next_in = data;
+        svs.z.avail_in = (uInt)raw;
+        svs.z.next_out = buffer;
+        svs.z.avail_out = (uInt)raw;
+
+        if (deflate(&svs.z, Z_FINISH) == Z_STREAM_END) {
+            MSG_WriteByte(svc_zdownload);
+            MSG_WriteShort(svs.z.total_out);
+            MSG_WriteByte(download_percent(client));
+            MSG_WriteShort(raw);
+            MSG_WriteData(buffer, svs.z.total_out);
+        } else {
+            MSG_WriteByte(svc_download);
+            MSG_WriteShort(raw);
+            MSG_WriteByte(download_percent(client));
+            MSG_WriteData(data, raw);
+        }
+    }
+
+    SV_DPrintf(1, "%s: window %"PRIz", sent %"PRIz" bytes\n",
+               client->name, window, msg_write.cursize);
+
+    SV_ClientAddMessage(client, MSG_RELIABLE | MSG_CLEAR);
+
+    if (client->downloadcount == client->downloadsize) {
+        Com_DPrintf("Finished streaming %s to %s\n",
+                    client->downloadname, client->name);
+        finish_download(client);
+    }
+}
+
+#endif
+
 /*
 ==================
 SV_NextDownload_f
@@ -557,10 +773,9 @@ SV_NextDownload_f
 static void SV_NextDownload_f(void)
 {
     int     r;
-    int     percent;
-    int     size;
 
-    if (!sv_client->download)
+    // streaming clients get data as soon as acknowledged
+    if (!sv_client->download || sv_client->downloadstream)
         return;
 
     r = sv_client->downloadsize - sv_client->downloadcount;
@@ -571,20 +786,11 @@ static void SV_NextDownload_f(void)
     MSG_WriteShort(r);
 
     sv_client->downloadcount += r;
-    size = sv_client->downloadsize;
-    if (!size)
-        size = 1;
-    percent = sv_client->downloadcount * 100 / size;
-    MSG_WriteByte(percent);
+    MSG_WriteByte(download_percent(sv_client));
     MSG_WriteData(sv_client->download + sv_client->downloadcount - r, r);
 
-    if (sv_client->downloadcount == sv_client->downloadsize) {
-        SV_CloseDownload(sv_client);
-#if USE_FPS
-        if (sv_client->state == cs_spawned)
-            align_key_frames();
-#endif
-    }
+    if (sv_client->downloadcount == sv_client->downloadsize)
+        finish_download(sv_client);
 
     SV_ClientAddMessage(sv_client, MSG_RELIABLE | MSG_CLEAR);
 }
@@ -727,6 +933,23 @@ static void SV_BeginDownload_f(void)
     sv_client->downloadcount = offset;
     sv_client->downloadname = SV_CopyString(name);
 
+#if USE_ZLIB
+    // new netchan fragments large reliables, so whole windows can be in flight
+    if (!strcmp(Cmd_Argv(3), "stream") && sv_download_window->integer &&
+        sv_client->netchan->type == NETCHAN_NEW) {
+        sv_client->downloadstream = qtrue;
+        Com_DPrintf("Streaming %s to %s\n", name, sv_client->name);
+
+        // an empty chunk tells the client to stop sending nextdl
+        MSG_WriteByte(svc_zdownload);
+        MSG_WriteShort(0);
+        MSG_WriteByte(download_percent(sv_client));
+        MSG_WriteShort(0);
+        SV_ClientAddMessage(sv_client, MSG_RELIABLE | MSG_CLEAR);
+        return;
+    }
+#endif
+
     Com_DPrintf("Downloading %s to %s\n", name, sv_client->name);
 
     SV_NextDownload_f();
@@ -769,7 +992,7 @@ static void SV_StopDownload_f(void)
 
 #if USE_FPS
     if (sv_client->state == cs_spawned)
-        align_key_frames();
+        align_key_frames(sv_client);
 #endif
 }
 
@@ -807,7 +1030,7 @@ static void SV_NoGameData_f(void)
     sv_client->nodata ^= 1;
 #if USE_FPS
     if (sv_client->state == cs_spawned)
-        align_key_frames();
+        align_key_frames(sv_client);
 #endif
 }
 
@@ -994,7 +1217,9 @@ static void SV_ExecuteUserCommand(const char *s)
             return;
         }
     }
+    SV_ProfileBegin("ClientCommand");
     ge->ClientCommand(sv_player);
+    SV_ProfileEnd("ClientCommand");
 }
 
 /*
@@ -1025,7 +1250,273 @@ static inline void SV_ClientThink(usercmd_t *cmd)
         return;
     }
 
+    if (sv_parallel_pmove->integer) {
+        if (sv_client->num_pending_moves == MAX_PENDING_MOVES)
+            SV_FlushPendingMoves(sv_client);
+        sv_client->pending_moves[sv_client->num_pending_moves++] = *cmd;
+        return;
+    }
+
+    SV_ProfileBegin("ClientThink");
     ge->ClientThink(sv_player, cmd);
+    SV_ProfileEnd("ClientThink");
+}
+
+/*
+===========================================================================
+
+PARALLEL PMOVE
+
+With sv_parallel_pmove, moves are queued until all packets of the frame
+are read. Player movement of every client is then run ahead on
+sv_trace_threads workers, against the world as it is at that point,
+chaining each result into the next move of the same client. Then the
+game is asked to think for real, client by client. When the game calls
+Pmove with the same input, and the world probe shows that nothing the
+move depended on was changed by the moves before it, the result from
+ahead is returned instead of moving the player again.
+
+===========================================================================
+*/
+
+typedef struct {
+    worldprobe_t    probe;
+    pmove_state_t   s;      // input
+    usercmd_t       cmd;
+    pmove_t         pm;     // result
+} aheadmove_t;
+
+typedef struct {
+    client_t        *client;
+    aheadmove_t     *moves;
+} aheadjob_t;
+
+// for the ClientThink being run
+static aheadmove_t  *sv_aheadmove;
+
+static q_threadlocal worldprobe_t   *ahead_probe;
+
+static trace_t q_gameabi ahead_trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+    return SV_ProbeTrace(ahead_probe, start, mins, maxs, end);
+}
+
+static int ahead_pointcontents(vec3_t p)
+{
+    return SV_ProbePointContents(ahead_probe, p);
+}
+
+static void run_ahead_job(void *arg, int index)
+{
+    aheadjob_t  *job = (aheadjob_t *)arg + index;
+    client_t    *client = job->client;
+    edict_t     *ent = client->edict;
+    pmove_state_t s = ent->client->ps.pmove;
+    aheadmove_t *m, *prev = NULL;
+    int         i;
+
+    X86_SINGLE_FPCW;
+
+    for (i = 0, m = job->moves; i < client->num_pending_moves; i++, m++) {
+        SV_InitProbe(&m->probe, ent, client->pmove_mask);
+        if (prev) {
+            // where the game links the player after the previous move
+            VectorScale(prev->pm.s.origin, 0.125f, m->probe.origin);
+            VectorCopy(prev->pm.mins, m->probe.mins);
+            VectorCopy(prev->pm.maxs, m->probe.maxs);
+        }
+
+        m->s = s;
+        m->cmd = client->pending_moves[i];
+
+        memset(&m->pm, 0, sizeof(m->pm));
+        m->pm.s = s;
+        m->pm.cmd = m->cmd;
+        m->pm.trace = ahead_trace;
+        m->pm.pointcontents = ahead_pointcontents;
+
+        ahead_probe = &m->probe;
+        Pmove(&m->pm, &client->pmp);
+        ahead_probe = NULL;
+
+        s = m->pm.s;
+        prev = m;
+    }
+}
+
+static qboolean pmove_states_equal(const pmove_state_t *a, const pmove_state_t *b)
+{
+    return a->pm_type == b->pm_type
+        && VectorCompare(a->origin, b->origin)
+        && VectorCompare(a->velocity, b->velocity)
+        && a->pm_flags == b->pm_flags
+        && a->pm_time == b->pm_time
+        && a->gravity == b->gravity
+        && VectorCompare(a->delta_angles, b->delta_angles);
+}
+
+static qboolean pmove_results_equal(const pmove_t *a, const pmove_t *b)
+{
+    return pmove_states_equal(&a->s, &b->s)
+        && a->numtouch == b->numtouch
+        && !memcmp(a->touchents, b->touchents, sizeof(a->touchents[0]) * a->numtouch)
+        && VectorCompare(a->viewangles, b->viewangles)
+        && a->viewheight == b->viewheight
+        && VectorCompare(a->mins, b->mins)
+        && VectorCompare(a->maxs, b->maxs)
+        && a->groundentity == b->groundentity
+        && a->watertype == b->watertype
+        && a->waterlevel == b->waterlevel;
+}
+
+/*
+==================
+SV_ReplayPmove
+
+Called by PF_Pmove for sv_client, with the mask the game traces with.
+Fills in the result from ahead and returns qtrue if it still holds.
+==================
+*/
+qboolean SV_ReplayPmove(pmove_t *pm, int contentmask)
+{
+    aheadmove_t *m = sv_aheadmove;
+    pmove_t     check;
+
+    // only the first Pmove of a ClientThink is run ahead
+    sv_aheadmove = NULL;
+
+    if (!m || !contentmask || m->probe.contentmask != contentmask)
+        return qfalse;
+    if (pm->snapinitial || !pmove_states_equal(&pm->s, &m->s)
+        || memcmp(&pm->cmd, &m->cmd, sizeof(m->cmd)))
+        return qfalse;
+    if (!SV_CheckProbe(&m->probe))
+        return qfalse;
+
+    if (sv_parallel_pmove->integer > 1) {
+        check = *pm;
+        Pmove(&check, &sv_client->pmp);
+        if (!pmove_results_equal(&check, &m->pm)) {
+            Com_WPrintf("Move of %s run ahead differs\n", sv_client->name);
+            *pm = check;
+            return qtrue;
+        }
+    }
+
+    pm->s = m->pm.s;
+    pm->cmd = m->pm.cmd;
+    pm->numtouch = m->pm.numtouch;
+    memcpy(pm->touchents, m->pm.touchents, sizeof(pm->touchents));
+    VectorCopy(m->pm.viewangles, pm->viewangles);
+    pm->viewheight = m->pm.viewheight;
+    VectorCopy(m->pm.mins, pm->mins);
+    VectorCopy(m->pm.maxs, pm->maxs);
+    pm->groundentity = m->pm.groundentity;
+    pm->watertype = m->pm.watertype;
+    pm->waterlevel = m->pm.waterlevel;
+    return qtrue;
+}
+
+static void run_pending_moves(client_t *client, aheadmove_t *moves)
+{
+    client_t    *oldclient = sv_client;
+    edict_t     *oldplayer = sv_player;
+    int         i;
+
+    sv_client = client;
+    sv_player = client->edict;
+
+    for (i = 0; i < client->num_pending_moves; i++) {
+        if (client->state != cs_spawned)
+            break;  // dropped by the game
+        sv_aheadmove = moves ? &moves[i] : NULL;
+        SV_ProfileBegin("ClientThink");
+        ge->ClientThink(sv_player, &client->pending_moves[i]);
+        SV_ProfileEnd("ClientThink");
+    }
+
+    sv_aheadmove = NULL;
+    client->num_pending_moves = 0;
+
+    sv_client = oldclient;
+    sv_player = oldplayer;
+}
+
+/*
+==================
+SV_FlushPendingMoves
+
+Runs queued moves of the client serially. Called before anything else
+from the client reaches the game, so that it sees it in order.
+==================
+*/
+void SV_FlushPendingMoves(client_t *client)
+{
+    if (client->num_pending_moves)
+        run_pending_moves(client, NULL);
+}
+
+/*
+==================
+SV_RunPendingMoves
+
+Runs queued moves of all clients, see above.
+==================
+*/
+void SV_RunPendingMoves(void)
+{
+    client_t    *client;
+    aheadjob_t  *jobs = NULL;
+    int         i, numjobs = 0;
+
+    FOR_EACH_CLIENT(client) {
+        if (client->state != cs_spawned)
+            client->num_pending_moves = 0;
+        if (client->num_pending_moves)
+            numjobs++;
+    }
+
+    if (!numjobs)
+        return;
+
+    X86_PUSH_FPCW;
+    X86_SINGLE_FPCW;
+
+    // nothing to gain without anyone to share the work with
+    if (sv_trace_threads->integer > 0 && numjobs > 1) {
+        jobs = Z_FrameAlloc(sizeof(*jobs) * numjobs);
+        numjobs = 0;
+        FOR_EACH_CLIENT(client) {
+            if (!client->num_pending_moves || !client->pmove_mask
+                || !client->edict->client)
+                continue;
+            jobs[numjobs].client = client;
+            jobs[numjobs].moves = Z_FrameAlloc(sizeof(aheadmove_t) *
+                                               client->num_pending_moves);
+            numjobs++;
+        }
+        SV_RunWorkerJobs(run_ahead_job, jobs, numjobs, 1);
+    } else {
+        numjobs = 0;
+    }
+
+    // queries from ahead are only good as long as relinks are known
+    SV_LogRelinks(qtrue);
+
+    i = 0;
+    FOR_EACH_CLIENT(client) {
+        if (!client->num_pending_moves)
+            continue;
+        if (i < numjobs && jobs[i].client == client) {
+            run_pending_moves(client, jobs[i++].moves);
+        } else {
+            run_pending_moves(client, NULL);
+        }
+    }
+
+    SV_LogRelinks(qfalse);
+
+    X86_POP_FPCW;
 }
 
 static void SV_SetLastFrame(int lastframe)
@@ -1044,8 +1535,10 @@ static void SV_SetLastFrame(int lastframe)
 
             if (frame->number == lastframe) {
                 // save time for ping calc
-                if (frame->sentTime <= com_eventTime)
+                if (frame->sentTime <= com_eventTime) {
                     frame->latency = com_eventTime - frame->sentTime;
+                    SV_AddLatency(sv_client, frame->latency);
+                }
             }
         }
 
@@ -1356,16 +1849,16 @@ static void SV_ParseDeltaUserinfo(void)
 }
 
 #if USE_FPS
-static void align_key_frames(void)
+static void align_key_frames(client_t *client)
 {
-    int framediv = sv.framediv / sv_client->framediv;
-    int framenum = sv.framenum / sv_client->framediv;
+    int framediv = sv.framediv / client->framediv;
+    int framenum = sv.framenum / client->framediv;
     int frameofs = framenum % framediv;
-    int newnum = frameofs + Q_align(sv_client->framenum, framediv);
+    int newnum = frameofs + Q_align(client->framenum, framediv);
 
     Com_DPrintf("[%d] align %d --> %d (num = %d, div = %d, ofs = %d)\n",
-                sv.framenum, sv_client->framenum, newnum, framenum, framediv, frameofs);
-    sv_client->framenum = newnum;
+                sv.framenum, client->framenum, newnum, framenum, framediv, frameofs);
+    client->framenum = newnum;
 }
 
 static void set_client_fps(int value)
@@ -1389,7 +1882,7 @@ static void set_client_fps(int value)
     sv_client->framediv = framediv;
 
     if (sv_client->state == cs_spawned)
-        align_key_frames();
+        align_key_frames(sv_client);
 
     // save for status inspection
     sv_client->settings[CLS_FPS] = framerate;
@@ -1486,6 +1979,7 @@ badbyte:
             break;
 
         case clc_userinfo:
+            SV_FlushPendingMoves(client);
             SV_ParseFullUserinfo();
             break;
 
@@ -1494,6 +1988,7 @@ badbyte:
             break;
 
         case clc_stringcmd:
+            SV_FlushPendingMoves(client);
             SV_ParseClientCommand();
             break;
 
@@ -1516,6 +2011,7 @@ badbyte:
             if (client->protocol != PROTOCOL_VERSION_Q2PRO)
                 goto badbyte;
 
+            SV_FlushPendingMoves(client);
             SV_ParseDeltaUserinfo();
             break;
         }
@@ -18,6 +18,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // world.c -- world query functions
 
 #include "server.h"
+#include "system/thread.h"
+
+// vector path used where the compiler targets it
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#elif (defined __ARM_NEON) || (defined __ARM_NEON__)
+#define USE_NEON    1
+#include <arm_neon.h>
+#endif
 
 /*
 ===============================================================================
@@ -36,16 +46,64 @@ typedef struct areanode_s {
     list_t  solid_edicts;
 } areanode_t;
 
-#define    AREA_DEPTH    4
-#define    AREA_NODES    32
+// tree depth is picked per map, see SV_AreaDepth
+#define    AREA_MIN_DEPTH   4
+#define    AREA_MAX_DEPTH   8
+#define    AREA_NODES       (2 << AREA_MAX_DEPTH)
+
+#define    AREA_LEAF_SIZE   1024    // split until leaves are no larger
+#define    AREA_LEAF_EDICTS 64      // or hold no more edicts on average
 
 static areanode_t   sv_areanodes[AREA_NODES];
 static int          sv_numareanodes;
+static int          sv_areadepth;
+
+// query statistics since the last SV_ClearWorld, of the main thread
+static q_threadlocal struct {
+    unsigned    queries;
+    unsigned    nodes;
+    unsigned    visited;
+    unsigned    found;
+    unsigned    trace_hits;
+    unsigned    trace_misses;
+} area_stats;
+
+// world clipping results for the current map. the world model never
+// moves, so an entry stays valid until SV_ClearWorld.
+#define TRACE_CACHE_SIZE    1024
+#define TRACE_CACHE_MASK    (TRACE_CACHE_SIZE - 1)
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    int         contentmask;
+} tracekey_t;
+
+typedef struct {
+    tracekey_t  key;
+    qboolean    used;
+    trace_t     trace;
+} tracememo_t;
+
+static tracememo_t  sv_tracecache[TRACE_CACHE_SIZE];
 
-static float    *area_mins, *area_maxs;
-static edict_t  **area_list;
-static int      area_count, area_maxcount;
-static int      area_type;
+// per thread, player movement may query the world on workers
+static q_threadlocal float      *area_mins, *area_maxs;
+static q_threadlocal edict_t    **area_list;
+static q_threadlocal int        area_count, area_maxcount;
+static q_threadlocal int        area_type;
+
+// solid area changes while moves run ahead are checked, see SV_CheckProbe
+#define MAX_RELINKS     1024
+
+static struct {
+    qboolean    active;
+    int         count;
+    struct {
+        edict_t     *ent;
+        vec3_t      absmin, absmax;
+    } boxes[MAX_RELINKS];
+} relinks;
 
 /*
 ===============
@@ -66,7 +124,7 @@ static areanode_t *SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
     List_Init(&anode->trigger_edicts);
     List_Init(&anode->solid_edicts);
 
-    if (depth == AREA_DEPTH) {
+    if (depth == sv_areadepth) {
         anode->axis = -1;
         anode->children[0] = anode->children[1] = NULL;
         return anode;
@@ -92,6 +150,39 @@ static areanode_t *SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
     return anode;
 }
 
+/*
+===============
+SV_AreaDepth
+
+Picks the tree depth from world size and edict count. Splits alternate
+between the two largest horizontal extents like SV_CreateAreaNode does.
+===============
+*/
+static int SV_AreaDepth(vec3_t mins, vec3_t maxs)
+{
+    float   size[2];
+    int     depth;
+
+    if (sv_area_depth->integer)
+        return Cvar_ClampInteger(sv_area_depth, 1, AREA_MAX_DEPTH);
+
+    size[0] = maxs[0] - mins[0];
+    size[1] = maxs[1] - mins[1];
+
+    for (depth = 0; depth < AREA_MAX_DEPTH; depth++) {
+        if (depth >= AREA_MIN_DEPTH
+            && max(size[0], size[1]) <= AREA_LEAF_SIZE
+            && (ge->max_edicts >> depth) <= AREA_LEAF_EDICTS)
+            break;
+        if (size[0] > size[1])
+            size[0] *= 0.5f;
+        else
+            size[1] *= 0.5f;
+    }
+
+    return depth;
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -105,10 +196,14 @@ void SV_ClearWorld(void)
     int i;
 
     memset(sv_areanodes, 0, sizeof(sv_areanodes));
+    memset(&area_stats, 0, sizeof(area_stats));
+    memset(sv_tracecache, 0, sizeof(sv_tracecache));
     sv_numareanodes = 0;
+    sv_areadepth = AREA_MIN_DEPTH;
 
     if (sv.cm.cache) {
         cm = &sv.cm.cache->models[0];
+        sv_areadepth = SV_AreaDepth(cm->mins, cm->maxs);
         SV_CreateAreaNode(0, cm->mins, cm->maxs);
     }
 
@@ -119,17 +214,50 @@ void SV_ClearWorld(void)
     }
 }
 
+static qboolean window_visible(const edict_vis_t *vis, const byte *mask)
+{
+    mask += vis->base;
+
+#if USE_SSE2
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)mask),
+                              _mm_loadu_si128((const __m128i *)vis->bits));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff;
+#elif USE_NEON
+    uint8x16_t v = vandq_u8(vld1q_u8(mask), vld1q_u8(vis->bits));
+    uint64x2_t w = vreinterpretq_u64_u8(v);
+    return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) != 0;
+#else
+    uint32_t a[EDICT_VIS_BYTES / 4], b[EDICT_VIS_BYTES / 4];
+
+    memcpy(a, mask, sizeof(a));
+    memcpy(b, vis->bits, sizeof(b));
+    return ((a[0] & b[0]) | (a[1] & b[1]) | (a[2] & b[2]) | (a[3] & b[3])) != 0;
+#endif
+}
+
+qboolean SV_EdictWindowVisible(const edict_vis_t *vis, const byte *mask)
+{
+    return window_visible(vis, mask);
+}
+
 /*
 ===============
 SV_EdictIsVisible
 
 Checks if edict is potentially visible from the given PVS row.
+Mask must be VIS_MAX_BYTES long.
 ===============
 */
-qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, byte *mask)
+qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, const edict_vis_t *vis, byte *mask)
 {
     int i;
 
+    // the window is only good if the game didn't touch clusters since linking
+    if (vis->base != -1 && vis->num_clusters == ent->num_clusters &&
+        vis->cluster == ent->clusternums[0]) {
+        return window_visible(vis, mask);
+    }
+
     if (ent->num_clusters == -1) {
         // too many leafs for individual check, go by headnode
         return CM_HeadnodeVisible(CM_NodeNum(cm, ent->headnode), mask);
@@ -145,6 +273,46 @@ qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, byte *mask)
     return qfalse;  // not visible
 }
 
+// pack clusters into a window of PVS bytes if they are close enough
+static void set_edict_vis(edict_t *ent, edict_vis_t *vis)
+{
+    int i, c, lo, hi;
+
+    memset(vis, 0, sizeof(*vis));
+    vis->num_clusters = ent->num_clusters;
+    vis->cluster = ent->clusternums[0];
+    vis->areanum = ent->areanum;
+    vis->areanum2 = ent->areanum2;
+
+    if (ent->num_clusters == -1) {
+        vis->base = -1;
+        return;
+    }
+
+    if (!ent->num_clusters) {
+        return;     // all zero bits, never visible
+    }
+
+    lo = hi = ent->clusternums[0] >> 3;
+    for (i = 1; i < ent->num_clusters; i++) {
+        c = ent->clusternums[i] >> 3;
+        lo = min(lo, c);
+        hi = max(hi, c);
+    }
+
+    if (hi - lo >= EDICT_VIS_BYTES) {
+        vis->base = -1;
+        return;
+    }
+
+    // keep the window inside the mask
+    vis->base = min(lo, VIS_MAX_BYTES - EDICT_VIS_BYTES);
+    for (i = 0; i < ent->num_clusters; i++) {
+        c = ent->clusternums[i] - (vis->base << 3);
+        Q_SetBit(vis->bits, c);
+    }
+}
+
 /*
 ===============
 SV_LinkEdict
@@ -153,7 +321,7 @@ General purpose routine shared between game DLL and MVD code.
 Links entity to PVS leafs.
 ===============
 */
-void SV_LinkEdict(cm_t *cm, edict_t *ent)
+void SV_LinkEdict(cm_t *cm, edict_t *ent, edict_vis_t *vis)
 {
     mleaf_t     *leafs[MAX_TOTAL_ENT_LEAFS];
     int         clusters[MAX_TOTAL_ENT_LEAFS];
@@ -251,12 +419,27 @@ void SV_LinkEdict(cm_t *cm, edict_t *ent)
             }
         }
     }
+
+    set_edict_vis(ent, vis);
+}
+
+static void log_relink(edict_t *ent)
+{
+    if (!relinks.active)
+        return;
+    if (relinks.count < MAX_RELINKS) {
+        relinks.boxes[relinks.count].ent = ent;
+        VectorCopy(ent->absmin, relinks.boxes[relinks.count].absmin);
+        VectorCopy(ent->absmax, relinks.boxes[relinks.count].absmax);
+    }
+    relinks.count++;
 }
 
 void PF_UnlinkEdict(edict_t *ent)
 {
     if (!ent->area.prev)
         return;        // not linked in anywhere
+    log_relink(ent);
     List_Remove(&ent->area);
     ent->area.prev = ent->area.next = NULL;
 }
@@ -309,7 +492,7 @@ void PF_LinkEdict(edict_t *ent)
         break;
     }
 
-    SV_LinkEdict(&sv.cm, ent);
+    SV_LinkEdict(&sv.cm, ent, &sv.entvis[entnum]);
 
     // if first time, make sure old_origin is valid
     if (!ent->linkcount) {
@@ -321,6 +504,10 @@ void PF_LinkEdict(edict_t *ent)
     }
     ent->linkcount++;
 
+    // player moved, regroup clients for multicasts
+    if (ent->client)
+        SV_InvalidateMulticast();
+
 #if USE_FPS
     // save origin for later recovery
     i = sv.framenum & ENT_HISTORY_MASK;
@@ -349,6 +536,21 @@ void PF_LinkEdict(edict_t *ent)
         List_Append(&node->trigger_edicts, &ent->area);
     else
         List_Append(&node->solid_edicts, &ent->area);
+    log_relink(ent);
+}
+
+/*
+===============
+SV_LogRelinks
+
+Starts or stops recording boxes entities are linked or unlinked at,
+clearing the log.
+===============
+*/
+void SV_LogRelinks(qboolean enable)
+{
+    relinks.active = enable;
+    relinks.count = 0;
 }
 
 
@@ -369,7 +571,10 @@ static void SV_AreaEdicts_r(areanode_t *node)
     else
         start = &node->trigger_edicts;
 
+    area_stats.nodes++;
+
     LIST_FOR_EACH(edict_t, check, start, area) {
+        area_stats.visited++;
         if (check->solid == SOLID_NOT)
             continue;        // deactivated
         if (check->absmin[0] > area_maxs[0]
@@ -416,9 +621,37 @@ int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list,
 
     SV_AreaEdicts_r(sv_areanodes);
 
+    area_stats.queries++;
+    area_stats.found += area_count;
+
     return area_count;
 }
 
+/*
+================
+SV_AreaStats_f
+================
+*/
+void SV_AreaStats_f(void)
+{
+    unsigned q = max(area_stats.queries, 1);
+
+    if (!sv.cm.cache) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    Com_Printf("Area tree depth %d, %d nodes.\n", sv_areadepth, sv_numareanodes);
+    Com_Printf("%u queries, per query: %.1f nodes, %.1f edicts visited, %.1f returned.\n",
+               area_stats.queries, (float)area_stats.nodes / q,
+               (float)area_stats.visited / q, (float)area_stats.found / q);
+    Com_Printf("World trace cache: %u hits, %u misses.\n",
+               area_stats.trace_hits, area_stats.trace_misses);
+
+    if (!strcmp(Cmd_Argv(1), "reset"))
+        memset(&area_stats, 0, sizeof(area_stats));
+}
+
 
 //===========================================================================
 
@@ -478,6 +711,50 @@ int SV_PointContents(vec3_t p)
     return contents;
 }
 
+/*
+=============
+SV_ProbeTouch
+
+Remembers the query box and the state of the edicts it returned.
+=============
+*/
+static void SV_ProbeTouch(worldprobe_t *probe, const vec3_t mins, const vec3_t maxs,
+                          edict_t **list, int num)
+{
+    probetouch_t *t;
+    edict_t *ent;
+    int i, j;
+
+    AddPointToBounds(mins, probe->absmin, probe->absmax);
+    AddPointToBounds(maxs, probe->absmin, probe->absmax);
+
+    for (i = 0; i < num; i++) {
+        ent = list[i];
+        if (ent == probe->passent)
+            continue;   // checked against the position in the probe
+        for (j = 0; j < probe->numtouch; j++)
+            if (probe->touch[j].ent == ent)
+                break;
+        if (j < probe->numtouch)
+            continue;
+        if (j == MAX_PROBE_TOUCH) {
+            probe->overflowed = qtrue;
+            return;
+        }
+        t = &probe->touch[probe->numtouch++];
+        t->ent = ent;
+        t->owner = ent->owner;
+        t->linkcount = ent->linkcount;
+        t->solid = ent->solid;
+        t->svflags = ent->svflags;
+        t->modelindex = ent->s.modelindex;
+        VectorCopy(ent->s.origin, t->origin);
+        VectorCopy(ent->s.angles, t->angles);
+        VectorCopy(ent->mins, t->mins);
+        VectorCopy(ent->maxs, t->maxs);
+    }
+}
+
 /*
 ====================
 SV_ClipMoveToEntities
@@ -485,7 +762,8 @@ SV_ClipMoveToEntities
 ====================
 */
 static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
-                                  edict_t *passedict, int contentmask, trace_t *tr)
+                                  edict_t *passedict, int contentmask, trace_t *tr,
+                                  worldprobe_t *probe)
 {
     vec3_t      boxmins, boxmaxs;
     int         i, num;
@@ -504,6 +782,8 @@ static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
     }
 
     num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+    if (probe)
+        SV_ProbeTouch(probe, boxmins, boxmaxs, touchlist, num);
 
     // be careful, it is possible to have an entity in this
     // list removed before we get to it (killtriggered)
@@ -535,6 +815,75 @@ static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
     }
 }
 
+// finds the cache slot for the given world trace, fills in the key
+static tracememo_t *SV_TraceMemo(tracekey_t *key, const vec3_t start,
+                                 const vec3_t mins, const vec3_t maxs,
+                                 const vec3_t end, int contentmask)
+{
+    const byte  *p;
+    unsigned    i, hash;
+
+    memset(key, 0, sizeof(*key));
+    VectorCopy(start, key->start);
+    VectorCopy(end, key->end);
+    VectorCopy(mins, key->mins);
+    VectorCopy(maxs, key->maxs);
+    key->contentmask = contentmask;
+
+    hash = 2166136261u;
+    for (i = 0, p = (const byte *)key; i < sizeof(*key); i++)
+        hash = (hash ^ p[i]) * 16777619u;
+    return &sv_tracecache[(hash ^ (hash >> 16)) & TRACE_CACHE_MASK];
+}
+
+/*
+==================
+SV_WorldTrace
+
+Clips against the world model only, reusing a previous identical trace
+when sv_trace_cache is enabled.
+==================
+*/
+static void SV_WorldTrace(trace_t *tr, vec3_t start, vec3_t mins, vec3_t maxs,
+                          vec3_t end, int contentmask)
+{
+    tracekey_t  key;
+    tracememo_t *memo;
+
+    if (!sv_trace_cache->integer) {
+        CM_BoxTrace(tr, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
+        return;
+    }
+
+    memo = SV_TraceMemo(&key, start, mins, maxs, end, contentmask);
+    if (memo->used && !memcmp(&memo->key, &key, sizeof(key))) {
+        *tr = memo->trace;
+        area_stats.trace_hits++;
+        return;
+    }
+
+    CM_BoxTrace(tr, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
+    memo->key = key;
+    memo->used = qtrue;
+    memo->trace = *tr;
+    area_stats.trace_misses++;
+}
+
+// work around game bugs
+static qboolean SV_RunawayTrace(trace_t *trace, vec3_t end)
+{
+    if (++sv.tracecount <= 10000)
+        return qfalse;
+
+    Com_EPrintf("SV_Trace: runaway loop avoided\n");
+    memset(trace, 0, sizeof(*trace));
+    trace->fraction = 1;
+    trace->ent = ge->edicts;
+    VectorCopy(end, trace->endpos);
+    sv.tracecount = 0;
+    return qtrue;
+}
+
 /*
 ==================
 SV_Trace
@@ -552,14 +901,7 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
         Com_Error(ERR_DROP, "%s: no map loaded", __func__);
     }
 
-    // work around game bugs
-    if (++sv.tracecount > 10000) {
-        Com_EPrintf("%s: runaway loop avoided\n", __func__);
-        memset(&trace, 0, sizeof(trace));
-        trace.fraction = 1;
-        trace.ent = ge->edicts;
-        VectorCopy(end, trace.endpos);
-        sv.tracecount = 0;
+    if (SV_RunawayTrace(&trace, end)) {
         return trace;
     }
 
@@ -569,14 +911,772 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
         maxs = vec3_origin;
 
     // clip to world
-    CM_BoxTrace(&trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
+    SV_WorldTrace(&trace, start, mins, maxs, end, contentmask);
     trace.ent = ge->edicts;
     if (trace.fraction == 0) {
         return trace;   // blocked by the world
     }
 
     // clip to other solid entities
-    SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, &trace);
+    SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, &trace, NULL);
     return trace;
 }
 
+/*
+==================
+SV_BoxTraces
+
+Batched version of SV_Trace. All requests are clipped to the world
+before any of them is clipped to entities, so that BSP nodes touched by
+neighbouring rays are still in cache.
+==================
+*/
+void SV_BoxTraces(const trace_request_t *requests, trace_t *results, int count)
+{
+    trace_request_t req;
+    int i, num;
+
+    if (!sv.cm.cache) {
+        Com_Error(ERR_DROP, "%s: no map loaded", __func__);
+    }
+
+    // clip to world
+    for (num = 0; num < count; num++) {
+        req = requests[num];
+        if (SV_RunawayTrace(&results[num], req.end))
+            break;
+        SV_WorldTrace(&results[num], req.start, req.mins, req.maxs, req.end,
+                      req.contentmask);
+        results[num].ent = ge->edicts;
+    }
+
+    // clip to other solid entities
+    for (i = 0; i < num; i++) {
+        if (results[i].fraction == 0)
+            continue;   // blocked by the world
+        req = requests[i];
+        SV_ClipMoveToEntities(req.start, req.mins, req.maxs, req.end,
+                              req.passent, req.contentmask, &results[i], NULL);
+    }
+
+    // fill in whatever was cut off by a runaway loop
+    for (i = num + 1; i < count; i++) {
+        memcpy(&results[i], &results[num], sizeof(results[i]));
+        VectorCopy(requests[i].end, results[i].endpos);
+    }
+}
+
+
+/*
+===============================================================================
+
+WORLD PROBES
+
+Player movement can be run ahead of the game on worker threads, against
+the world as it is at that moment. The queries made for it record what
+they looked at in a probe. When the game gets to the move for real, and
+nothing recorded has changed since, the early result is what it would
+have got now. The moving entity itself is assumed to be at the position
+set in the probe, since the game would have relinked it there after the
+previous move.
+
+===============================================================================
+*/
+
+static qboolean probe_solid(edict_t *ent)
+{
+    return ent->area.prev && ent->solid != SOLID_NOT && ent->solid != SOLID_TRIGGER;
+}
+
+/*
+==================
+SV_InitProbe
+
+Starts a probe for moving the given entity with the mask, at its
+current position.
+==================
+*/
+void SV_InitProbe(worldprobe_t *probe, edict_t *ent, int contentmask)
+{
+    probe->passent = ent;
+    probe->passowner = ent->owner;
+    probe->passsolid = probe_solid(ent);
+    probe->contentmask = contentmask;
+    VectorCopy(ent->s.origin, probe->origin);
+    VectorCopy(ent->mins, probe->mins);
+    VectorCopy(ent->maxs, probe->maxs);
+    ClearBounds(probe->absmin, probe->absmax);
+    probe->numtouch = 0;
+    // only a box can be put somewhere else
+    probe->overflowed = probe->passsolid && ent->solid == SOLID_BSP;
+}
+
+/*
+==================
+SV_ProbeTrace
+
+SV_Trace for the probe entity and mask. Doesn't use the world trace
+cache, so that it can run on any thread while the main one waits.
+==================
+*/
+trace_t SV_ProbeTrace(worldprobe_t *probe, vec3_t start, vec3_t mins,
+                      vec3_t maxs, vec3_t end)
+{
+    trace_t     trace;
+
+    if (!mins)
+        mins = vec3_origin;
+    if (!maxs)
+        maxs = vec3_origin;
+
+    CM_BoxTrace(&trace, start, end, mins, maxs, sv.cm.cache->nodes,
+                probe->contentmask);
+    trace.ent = ge->edicts;
+    if (trace.fraction == 0) {
+        return trace;   // blocked by the world
+    }
+
+    SV_ClipMoveToEntities(start, mins, maxs, end, probe->passent,
+                          probe->contentmask, &trace, probe);
+    return trace;
+}
+
+/*
+==================
+SV_ProbePointContents
+
+SV_PointContents with the probe entity at the position in the probe.
+==================
+*/
+int SV_ProbePointContents(worldprobe_t *probe, vec3_t p)
+{
+    edict_t     *touch[MAX_EDICTS], *hit;
+    int         i, num;
+    int         contents;
+
+    contents = CM_PointContents(p, sv.cm.cache->nodes);
+
+    num = SV_AreaEdicts(p, p, touch, MAX_EDICTS, AREA_SOLID);
+    SV_ProbeTouch(probe, p, p, touch, num);
+
+    for (i = 0; i < num; i++) {
+        hit = touch[i];
+        if (hit == probe->passent)
+            continue;
+        contents |= CM_TransformedPointContents(p, SV_HullForEntity(hit),
+                                                hit->s.origin, hit->s.angles);
+    }
+
+    if (probe->passsolid) {
+        contents |= CM_TransformedPointContents(p,
+                        CM_HeadnodeForBox(probe->mins, probe->maxs),
+                        probe->origin, vec3_origin);
+    }
+
+    return contents;
+}
+
+static qboolean boxes_touch(const vec3_t mins1, const vec3_t maxs1,
+                            const vec3_t mins2, const vec3_t maxs2)
+{
+    return mins1[0] <= maxs2[0] && mins1[1] <= maxs2[1] && mins1[2] <= maxs2[2]
+        && maxs1[0] >= mins2[0] && maxs1[1] >= mins2[1] && maxs1[2] >= mins2[2];
+}
+
+/*
+==================
+SV_CheckProbe
+
+Returns qtrue if the queries recorded in the probe would return the
+same now. Relinks are only known while SV_LogRelinks is enabled, so it
+has to be from before the probe was used.
+==================
+*/
+qboolean SV_CheckProbe(const worldprobe_t *probe)
+{
+    const probetouch_t *t;
+    edict_t *ent = probe->passent;
+    vec3_t absmin, absmax;
+    int i;
+
+    if (probe->overflowed || !relinks.active || relinks.count > MAX_RELINKS)
+        return qfalse;
+
+    // the mover must be linked where the probe puts it
+    if (ent->owner != probe->passowner || probe_solid(ent) != probe->passsolid)
+        return qfalse;
+    if (probe->passsolid) {
+        if (!VectorCompare(ent->s.origin, probe->origin)
+            || !VectorCompare(ent->mins, probe->mins)
+            || !VectorCompare(ent->maxs, probe->maxs))
+            return qfalse;
+        for (i = 0; i < 3; i++) {
+            absmin[i] = probe->origin[i] + probe->mins[i] - 1;
+            absmax[i] = probe->origin[i] + probe->maxs[i] + 1;
+        }
+        if (!VectorCompare(ent->absmin, absmin) || !VectorCompare(ent->absmax, absmax))
+            return qfalse;
+    }
+
+    // everything touched is as it was
+    for (i = 0, t = probe->touch; i < probe->numtouch; i++, t++) {
+        ent = t->ent;
+        if (ent->linkcount != t->linkcount || ent->solid != t->solid
+            || ent->owner != t->owner || ent->svflags != t->svflags
+            || ent->s.modelindex != t->modelindex
+            || !VectorCompare(ent->s.origin, t->origin)
+            || !VectorCompare(ent->s.angles, t->angles)
+            || !VectorCompare(ent->mins, t->mins)
+            || !VectorCompare(ent->maxs, t->maxs))
+            return qfalse;
+    }
+
+    // and nothing else came or went
+    for (i = 0; i < relinks.count; i++) {
+        if (relinks.boxes[i].ent == probe->passent)
+            continue;
+        if (boxes_touch(relinks.boxes[i].absmin, relinks.boxes[i].absmax,
+                        probe->absmin, probe->absmax))
+            return qfalse;
+    }
+
+    return qtrue;
+}
+
+
+/*
+===============================================================================
+
+TRACE PREFETCH
+
+The game may announce traces it is likely to request soon. Those that
+are not in the world trace cache yet are clipped to the world on
+sv_trace_threads workers, together with the main thread, and put into
+the cache. When the game then asks for them, only clipping against
+entities is left, which is cheap and has to see entities where they are
+at that moment anyway. Results don't depend on whether, or on which
+thread, a trace was prefetched.
+
+===============================================================================
+*/
+
+#define MAX_TRACE_THREADS   8
+#define TRACE_BATCH         16      // requests taken by a thread at once
+
+typedef struct {
+    tracekey_t  key;
+    tracememo_t *memo;
+    trace_t     trace;
+} tracejob_t;
+
+static struct {
+    qthread_t   *threads[MAX_TRACE_THREADS];
+    int         numthreads;
+    qmutex_t    *lock;
+    qcond_t     *wake;
+    qcond_t     *done;
+    qboolean    quit;
+
+    workerfunc_t    func;
+    void        *arg;
+    int         batch;
+    int         numjobs;
+    int         nextjob;
+    int         finished;
+} tt;
+
+static void run_trace_job(void *arg, int index)
+{
+    tracekey_t *key = &((tracejob_t *)arg)[index].key;
+
+    CM_BoxTrace(&((tracejob_t *)arg)[index].trace, key->start, key->end,
+                key->mins, key->maxs, sv.cm.cache->nodes, key->contentmask);
+}
+
+// called with the lock held, returns with it held
+static void SV_RunTraceJobs(void)
+{
+    int i, first, last;
+
+    while (tt.nextjob < tt.numjobs) {
+        first = tt.nextjob;
+        last = min(first + tt.batch, tt.numjobs);
+        tt.nextjob = last;
+        Sys_UnlockMutex(tt.lock);
+
+        for (i = first; i < last; i++) {
+            tt.func(tt.arg, i);
+        }
+
+        Sys_LockMutex(tt.lock);
+        tt.finished += last - first;
+        if (tt.finished == tt.numjobs) {
+            Sys_SignalCond(tt.done);
+        }
+    }
+}
+
+static void SV_TraceThread(void *arg)
+{
+    Sys_LockMutex(tt.lock);
+    while (1) {
+        while (!tt.quit && tt.nextjob >= tt.numjobs) {
+            Sys_WaitCond(tt.wake, tt.lock);
+        }
+        if (tt.quit) {
+            break;
+        }
+        SV_RunTraceJobs();
+    }
+    Sys_UnlockMutex(tt.lock);
+}
+
+void SV_ShutdownTraceThreads(void)
+{
+    int i;
+
+    if (!tt.numthreads) {
+        return;
+    }
+
+    Sys_LockMutex(tt.lock);
+    tt.quit = qtrue;
+    Sys_BroadcastCond(tt.wake);
+    Sys_UnlockMutex(tt.lock);
+
+    for (i = 0; i < tt.numthreads; i++) {
+        Sys_JoinThread(tt.threads[i]);
+    }
+
+    Sys_DestroyCond(tt.done);
+    Sys_DestroyCond(tt.wake);
+    Sys_DestroyMutex(tt.lock);
+    memset(&tt, 0, sizeof(tt));
+
+    sv_trace_threads->modified = qtrue;
+}
+
+static void SV_InitTraceThreads(void)
+{
+    int i, count;
+
+    if (!sv_trace_threads->modified) {
+        return;
+    }
+
+    SV_ShutdownTraceThreads();
+    sv_trace_threads->modified = qfalse;
+
+    count = Cvar_ClampInteger(sv_trace_threads, 0, MAX_TRACE_THREADS);
+    if (count) {
+        tt.lock = Sys_CreateMutex();
+        tt.wake = Sys_CreateCond();
+        tt.done = Sys_CreateCond();
+        for (i = 0; i < count; i++) {
+            tt.threads[i] = Sys_CreateThread(SV_TraceThread, NULL);
+        }
+        tt.numthreads = count;
+    }
+}
+
+/*
+==================
+SV_RunWorkerJobs
+
+Calls func for every index below count, handing out batches of indices
+to sv_trace_threads workers and the main thread. Returns once all calls
+have finished. Runs everything on the main thread if there are no
+workers, or not more than a single batch.
+==================
+*/
+void SV_RunWorkerJobs(workerfunc_t func, void *arg, int count, int batch)
+{
+    int i;
+
+    SV_InitTraceThreads();
+
+    if (!tt.numthreads || count <= batch) {
+        for (i = 0; i < count; i++) {
+            func(arg, i);
+        }
+        return;
+    }
+
+    Sys_LockMutex(tt.lock);
+    tt.func = func;
+    tt.arg = arg;
+    tt.batch = batch;
+    tt.numjobs = count;
+    tt.nextjob = tt.finished = 0;
+    Sys_BroadcastCond(tt.wake);
+
+    // main thread does its share, then waits for the stragglers
+    SV_RunTraceJobs();
+    while (tt.finished < tt.numjobs) {
+        Sys_WaitCond(tt.done, tt.lock);
+    }
+    tt.func = NULL;
+    tt.arg = NULL;
+    tt.numjobs = tt.nextjob = tt.finished = 0;
+    Sys_UnlockMutex(tt.lock);
+}
+
+/*
+==================
+SV_PrefetchTraces
+
+Clips requests to the world ahead of time, see above. Entity fields of
+the requests are ignored.
+==================
+*/
+void SV_PrefetchTraces(const trace_request_t *requests, int count)
+{
+    const trace_request_t *req;
+    tracejob_t  *jobs, *job;
+    tracememo_t *memo;
+    tracekey_t  key;
+    int         i, numjobs;
+
+    if (!sv.cm.cache || !sv_trace_cache->integer || count <= 0) {
+        return;
+    }
+
+    jobs = Z_FrameAlloc(sizeof(*jobs) * count);
+    numjobs = 0;
+
+    for (i = 0, req = requests; i < count; i++, req++) {
+        memo = SV_TraceMemo(&key, req->start, req->mins, req->maxs, req->end,
+                            req->contentmask);
+        if (memo->used && !memcmp(&memo->key, &key, sizeof(key))) {
+            continue;
+        }
+        job = &jobs[numjobs++];
+        job->key = key;
+        job->memo = memo;
+    }
+
+    if (!numjobs) {
+        return;
+    }
+
+    SV_RunWorkerJobs(run_trace_job, jobs, numjobs, TRACE_BATCH);
+
+    // fill the cache in request order, so that colliding slots end up
+    // the same regardless of threading
+    for (i = 0, job = jobs; i < numjobs; i++, job++) {
+        job->memo->key = job->key;
+        job->memo->used = qtrue;
+        job->memo->trace = job->trace;
+        area_stats.trace_misses++;
+    }
+}
+
+
+#if USE_TESTS
+
+#define VISBENCH_PASSES     20
+
+static qboolean edict_visible_scalar(edict_t *ent, byte *mask)
+{
+    int i;
+
+    if (ent->num_clusters == -1) {
+        return CM_HeadnodeVisible(CM_NodeNum(&sv.cm, ent->headnode), mask);
+    }
+
+    for (i = 0; i < ent->num_clusters; i++) {
+        if (Q_IsBitSet(mask, ent->clusternums[i])) {
+            return qtrue;
+        }
+    }
+
+    return qfalse;
+}
+
+/*
+===============
+SV_VisBench_f
+
+Times visible set building from every cluster of the current map with
+cluster windows against plain per-cluster bit tests, and checks that
+both agree.
+===============
+*/
+void SV_VisBench_f(void)
+{
+    byte mask[VIS_MAX_BYTES];
+    bsp_t *bsp = sv.cm.cache;
+    edict_t *ent;
+    int j, c, e, numclusters, passes, visible[2], errors;
+    unsigned start, decompress, window, scalar;
+
+    if (sv.state != ss_game || !bsp || !bsp->vis) {
+        Com_Printf("No map loaded\n");
+        return;
+    }
+
+    passes = VISBENCH_PASSES;
+    if (Cmd_Argc() > 1) {
+        passes = atoi(Cmd_Argv(1));
+        clamp(passes, 1, 10000);
+    }
+
+    numclusters = bsp->vis->numclusters;
+
+    start = Sys_Milliseconds();
+    for (c = 0; c < numclusters; c++) {
+        for (j = 0; j < passes; j++) {
+            BSP_ClusterVis(bsp, mask, c, DVIS_PVS);
+        }
+    }
+    decompress = Sys_Milliseconds() - start;
+
+    visible[0] = 0;
+    start = Sys_Milliseconds();
+    for (c = 0; c < numclusters; c++) {
+        for (j = 0; j < passes; j++) {
+            BSP_ClusterVis(bsp, mask, c, DVIS_PVS);
+            for (e = 1; e < ge->num_edicts; e++) {
+                ent = EDICT_NUM(e);
+                visible[0] += SV_EdictIsVisible(&sv.cm, ent, &sv.entvis[e], mask);
+            }
+        }
+    }
+    window = Sys_Milliseconds() - start;
+
+    visible[1] = 0;
+    start = Sys_Milliseconds();
+    for (c = 0; c < numclusters; c++) {
+        for (j = 0; j < passes; j++) {
+            BSP_ClusterVis(bsp, mask, c, DVIS_PVS);
+            for (e = 1; e < ge->num_edicts; e++) {
+                visible[1] += edict_visible_scalar(EDICT_NUM(e), mask);
+            }
+        }
+    }
+    scalar = Sys_Milliseconds() - start;
+
+    errors = 0;
+    for (c = 0; c < numclusters; c++) {
+        BSP_ClusterVis(bsp, mask, c, DVIS_PVS);
+        for (e = 1; e < ge->num_edicts; e++) {
+            ent = EDICT_NUM(e);
+            if (SV_EdictIsVisible(&sv.cm, ent, &sv.entvis[e], mask) !=
+                edict_visible_scalar(ent, mask)) {
+                errors++;
+            }
+        }
+    }
+
+    Com_Printf("%d clusters, %d edicts, %d passes\n",
+               numclusters, ge->num_edicts - 1, passes);
+    Com_Printf("%u msec window, %u msec scalar, %u msec decompression\n",
+               window - decompress, scalar - decompress, decompress);
+    Com_Printf("%d/%d visible, %d failures\n", visible[0], visible[1], errors);
+}
+
+#define TRACEBENCH_RAYS     4096
+
+static qboolean traces_equal(const trace_t *a, const trace_t *b)
+{
+    return a->fraction == b->fraction && VectorCompare(a->endpos, b->endpos)
+        && a->allsolid == b->allsolid && a->startsolid == b->startsolid
+        && a->contents == b->contents && a->surface == b->surface
+        && VectorCompare(a->plane.normal, b->plane.normal);
+}
+
+/*
+===============
+SV_TraceBench_f
+
+Times clipping random rays between entities to the world serially and
+through SV_PrefetchTraces, then checks that cached results match.
+===============
+*/
+void SV_TraceBench_f(void)
+{
+    trace_request_t *requests, *req;
+    trace_t tr, *results;
+    edict_t *e1, *e2;
+    int i, count, errors;
+    unsigned start, serial, prefetch;
+
+    if (sv.state != ss_game || !sv.cm.cache || ge->num_edicts < 3) {
+        Com_Printf("No map loaded\n");
+        return;
+    }
+
+    count = TRACEBENCH_RAYS;
+    if (Cmd_Argc() > 1) {
+        count = atoi(Cmd_Argv(1));
+        clamp(count, 1, 65536);
+    }
+
+    requests = Z_Mallocz(sizeof(*requests) * count);
+    results = Z_Malloc(sizeof(*results) * count);
+    for (i = 0, req = requests; i < count; i++, req++) {
+        e1 = EDICT_NUM(1 + rand() % (ge->num_edicts - 1));
+        e2 = EDICT_NUM(1 + rand() % (ge->num_edicts - 1));
+        VectorCopy(e1->s.origin, req->start);
+        VectorCopy(e2->s.origin, req->end);
+        req->start[2] += 8;
+        req->contentmask = MASK_OPAQUE;
+    }
+
+    start = Sys_Milliseconds();
+    for (i = 0, req = requests; i < count; i++, req++) {
+        CM_BoxTrace(&results[i], req->start, req->end, req->mins, req->maxs,
+                    sv.cm.cache->nodes, req->contentmask);
+    }
+    serial = Sys_Milliseconds() - start;
+
+    memset(sv_tracecache, 0, sizeof(sv_tracecache));
+    start = Sys_Milliseconds();
+    SV_PrefetchTraces(requests, count);
+    prefetch = Sys_Milliseconds() - start;
+
+    // colliding slots keep only one of the rays, check all of them anyway
+    errors = 0;
+    for (i = 0, req = requests; i < count; i++, req++) {
+        SV_WorldTrace(&tr, req->start, req->mins, req->maxs, req->end,
+                      req->contentmask);
+        if (!traces_equal(&tr, &results[i])) {
+            errors++;
+        }
+    }
+
+    Com_Printf("%d rays, %d threads\n", count, tt.numthreads);
+    Com_Printf("%u msec serial, %u msec prefetch\n", serial, prefetch);
+    Com_Printf("%d failures\n", errors);
+
+    Z_Free(requests);
+    Z_Free(results);
+}
+
+
+#define AREABENCH_QUERIES   65536
+#define AREABENCH_BATCH     64
+
+typedef struct {
+    vec3_t      mins, maxs;
+    vec3_t      start, end;
+} areaquery_t;
+
+static int areabench_cmp(const void *p1, const void *p2)
+{
+    unsigned a = *(const unsigned *)p1;
+    unsigned b = *(const unsigned *)p2;
+
+    return a < b ? -1 : a > b;
+}
+
+static void areabench_report(const char *name, unsigned *times, int batches)
+{
+    unsigned total = 0;
+    int i;
+
+    for (i = 0; i < batches; i++) {
+        total += times[i];
+    }
+
+    qsort(times, batches, sizeof(times[0]), areabench_cmp);
+
+#define NS(t)   ((t) * 1000 / AREABENCH_BATCH)
+    Com_Printf("%-20s %7u %7u %7u %7u\n", name,
+               NS(total / batches), NS(times[batches / 2]),
+               NS(times[batches * 9 / 10]), NS(times[batches * 99 / 100]));
+#undef NS
+}
+
+/*
+===============
+SV_AreaBench_f
+
+Times area queries and full entity traces around random entities of the
+current map, reporting per query cost and its percentiles.
+===============
+*/
+void SV_AreaBench_f(void)
+{
+    static const vec3_t pmins = { -16, -16, -24 };
+    static const vec3_t pmaxs = { 16, 16, 32 };
+    edict_t *list[MAX_EDICTS];
+    areaquery_t *queries, *q;
+    unsigned *times, start;
+    edict_t *e1, *e2;
+    float size;
+    int i, j, count, batches, found;
+    trace_t tr;
+
+    if (sv.state != ss_game || !sv.cm.cache || ge->num_edicts < 3) {
+        Com_Printf("No map loaded\n");
+        return;
+    }
+
+    count = AREABENCH_QUERIES;
+    if (Cmd_Argc() > 1) {
+        count = atoi(Cmd_Argv(1));
+        clamp(count, AREABENCH_BATCH, 1024 * 1024);
+    }
+    batches = count / AREABENCH_BATCH;
+    count = batches * AREABENCH_BATCH;
+
+    queries = Z_Malloc(sizeof(*queries) * count);
+    times = Z_Malloc(sizeof(*times) * batches);
+
+    // boxes from player touch size up to splash damage radius
+    for (i = 0, q = queries; i < count; i++, q++) {
+        e1 = EDICT_NUM(1 + rand() % (ge->num_edicts - 1));
+        e2 = EDICT_NUM(1 + rand() % (ge->num_edicts - 1));
+        size = 32 + frand() * 224;
+        for (j = 0; j < 3; j++) {
+            q->mins[j] = e1->s.origin[j] - size;
+            q->maxs[j] = e1->s.origin[j] + size;
+        }
+        VectorCopy(e1->s.origin, q->start);
+        VectorCopy(e2->s.origin, q->end);
+    }
+
+    Com_Printf("%d queries, %d edicts\n"
+               "test                 avg ns  p50 ns  p90 ns  p99 ns\n"
+               "-------------------- ------- ------- ------- -------\n",
+               count, ge->num_edicts);
+
+    found = 0;
+    for (i = 0; i < batches; i++) {
+        start = Sys_Microseconds();
+        for (j = 0, q = &queries[i * AREABENCH_BATCH]; j < AREABENCH_BATCH; j++, q++) {
+            found += SV_AreaEdicts(q->mins, q->maxs, list, MAX_EDICTS, AREA_SOLID);
+        }
+        times[i] = Sys_Microseconds() - start;
+    }
+    areabench_report("area solid", times, batches);
+
+    for (i = 0; i < batches; i++) {
+        start = Sys_Microseconds();
+        for (j = 0, q = &queries[i * AREABENCH_BATCH]; j < AREABENCH_BATCH; j++, q++) {
+            found += SV_AreaEdicts(q->mins, q->maxs, list, MAX_EDICTS, AREA_TRIGGERS);
+        }
+        times[i] = Sys_Microseconds() - start;
+    }
+    areabench_report("area triggers", times, batches);
+
+    for (i = 0; i < batches; i++) {
+        sv.tracecount = 0;  // not a runaway loop
+        start = Sys_Microseconds();
+        for (j = 0, q = &queries[i * AREABENCH_BATCH]; j < AREABENCH_BATCH; j++, q++) {
+            tr = SV_Trace(q->start, (float *)pmins, (float *)pmaxs, q->end,
+                          NULL, MASK_PLAYERSOLID);
+            found += tr.ent != NULL;
+        }
+        times[i] = Sys_Microseconds() - start;
+    }
+    areabench_report("entity trace", times, batches);
+
+    Com_Printf("%d edicts found\n", found);
+
+    Z_Free(queries);
+    Z_Free(times);
+}
+
+#endif // USE_TESTS
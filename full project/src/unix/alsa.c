@@ -0,0 +1,338 @@
+/*
+Copyright (C) 2003-2012 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// alsa.c -- ALSA mmap sound driver
+//
+// The DMA buffer is the ring buffer of the device itself. Mixing goes
+// straight into it, up to where the device is playing, and Submit
+// commits what was painted. The ring offset ALSA writes at is kept in
+// step with paintedtime, so that both agree on where a sample goes.
+// With a few short periods and the mixer thread enabled, sound gets out
+// within a few milliseconds of being mixed. Sound servers like PipeWire
+// and PulseAudio are reached through their ALSA plugins.
+//
+
+#include "shared/shared.h"
+#include "common/cvar.h"
+#include "client/sound/dma.h"
+
+#include <alsa/asoundlib.h>
+
+static cvar_t *s_alsa_device;
+static cvar_t *s_alsa_period;
+static cvar_t *s_alsa_periods;
+
+static struct {
+    snd_pcm_t           *pcm;
+    snd_pcm_uframes_t   frames;     // ring buffer size
+    snd_pcm_uframes_t   period;
+    int                 committed;  // paintedtime handed to ALSA
+    qboolean            active;
+} alsa;
+
+// commits silence until the ring offset matches paintedtime again, after
+// ALSA reset its pointers
+static void ALSA_Align(void)
+{
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames;
+    snd_pcm_sframes_t ret;
+    int count;
+
+    alsa.committed = paintedtime;
+
+    count = paintedtime % alsa.frames;
+    if (!count) {
+        return;
+    }
+
+    memset(dma.buffer, 0, count * dma.channels * (dma.samplebits >> 3));
+
+    snd_pcm_avail_update(alsa.pcm);
+    frames = count;
+    ret = snd_pcm_mmap_begin(alsa.pcm, &areas, &offset, &frames);
+    if (ret < 0) {
+        return;
+    }
+    snd_pcm_mmap_commit(alsa.pcm, offset, frames);
+}
+
+static void ALSA_Restart(void)
+{
+    snd_pcm_drop(alsa.pcm);
+    snd_pcm_prepare(alsa.pcm);
+    ALSA_Align();
+}
+
+static void ALSA_Shutdown(void)
+{
+    if (!alsa.pcm) {
+        return;
+    }
+
+    Com_Printf("Shutting down ALSA\n");
+
+    snd_pcm_drop(alsa.pcm);
+    snd_pcm_close(alsa.pcm);
+    memset(&alsa, 0, sizeof(alsa));
+    dma.buffer = NULL;
+}
+
+static sndinitstat_t ALSA_Init(void)
+{
+    snd_pcm_hw_params_t *hw = NULL;
+    snd_pcm_sw_params_t *sw = NULL;
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames;
+    const char *what;
+    unsigned rate;
+    int ret, msec, periods;
+
+    if (alsa.pcm) {
+        return SIS_SUCCESS;
+    }
+
+    s_alsa_device = Cvar_Get("s_alsa_device", "default", CVAR_SOUND);
+    s_alsa_period = Cvar_Get("s_alsa_period", "5", CVAR_SOUND);
+    s_alsa_periods = Cvar_Get("s_alsa_periods", "3", CVAR_SOUND);
+
+    ret = snd_pcm_open(&alsa.pcm, s_alsa_device->string,
+                       SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+    if (ret < 0) {
+        Com_WPrintf("Couldn't open ALSA device %s: %s\n",
+                    s_alsa_device->string, snd_strerror(ret));
+        alsa.pcm = NULL;
+        return SIS_FAILURE;
+    }
+
+    switch (s_khz->integer) {
+    case 48:
+        rate = 48000;
+        break;
+    case 44:
+        rate = 44100;
+        break;
+    case 11:
+        rate = 11025;
+        break;
+    default:
+        rate = 22050;
+        break;
+    }
+
+    msec = Cvar_ClampInteger(s_alsa_period, 1, 100);
+    periods = Cvar_ClampInteger(s_alsa_periods, 2, 16);
+    alsa.period = rate * msec / 1000;
+
+    what = "allocate parameters";
+    if ((ret = snd_pcm_hw_params_malloc(&hw)) < 0)
+        goto fail;
+    if ((ret = snd_pcm_sw_params_malloc(&sw)) < 0)
+        goto fail;
+
+    what = "get hardware parameters";
+    if ((ret = snd_pcm_hw_params_any(alsa.pcm, hw)) < 0)
+        goto fail;
+
+    what = "set mmap access";
+    if ((ret = snd_pcm_hw_params_set_access(alsa.pcm, hw,
+                                            SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0)
+        goto fail;
+
+    what = "set 16-bit format";
+    if ((ret = snd_pcm_hw_params_set_format(alsa.pcm, hw, SND_PCM_FORMAT_S16)) < 0)
+        goto fail;
+
+    what = "set stereo";
+    if ((ret = snd_pcm_hw_params_set_channels(alsa.pcm, hw, 2)) < 0)
+        goto fail;
+
+    what = "set rate";
+    if ((ret = snd_pcm_hw_params_set_rate_near(alsa.pcm, hw, &rate, NULL)) < 0)
+        goto fail;
+
+    what = "set period size";
+    if ((ret = snd_pcm_hw_params_set_period_size_near(alsa.pcm, hw,
+                                                      &alsa.period, NULL)) < 0)
+        goto fail;
+
+    // the mixer wraps ring positions with a mask, so ask for a power of
+    // two buffer and let the period count follow from it
+    alsa.frames = npot32(alsa.period * periods);
+    what = "set buffer size";
+    if ((ret = snd_pcm_hw_params_set_buffer_size_near(alsa.pcm, hw, &alsa.frames)) < 0)
+        goto fail;
+
+    what = "apply hardware parameters";
+    if ((ret = snd_pcm_hw_params(alsa.pcm, hw)) < 0)
+        goto fail;
+
+    snd_pcm_hw_params_get_buffer_size(hw, &alsa.frames);
+    snd_pcm_hw_params_get_period_size(hw, &alsa.period, NULL);
+
+    if (alsa.frames & (alsa.frames - 1)) {
+        Com_WPrintf("ALSA device %s has %lu frame buffer, which is not "
+                    "a power of two\n", s_alsa_device->string,
+                    (unsigned long)alsa.frames);
+        goto fail2;
+    }
+
+    // don't wake up before a period is free, start once one is queued
+    what = "set software parameters";
+    if ((ret = snd_pcm_sw_params_current(alsa.pcm, sw)) < 0)
+        goto fail;
+    if ((ret = snd_pcm_sw_params_set_start_threshold(alsa.pcm, sw, alsa.period)) < 0)
+        goto fail;
+    if ((ret = snd_pcm_sw_params_set_avail_min(alsa.pcm, sw, alsa.period)) < 0)
+        goto fail;
+    if ((ret = snd_pcm_sw_params(alsa.pcm, sw)) < 0)
+        goto fail;
+
+    // find the ring buffer
+    what = "map buffer";
+    snd_pcm_avail_update(alsa.pcm);
+    frames = alsa.frames;
+    if ((ret = snd_pcm_mmap_begin(alsa.pcm, &areas, &offset, &frames)) < 0)
+        goto fail;
+    snd_pcm_mmap_commit(alsa.pcm, offset, 0);
+
+    if (offset || areas[0].first || areas[0].step != 32) {
+        Com_WPrintf("ALSA device %s has unsupported buffer layout\n",
+                    s_alsa_device->string);
+        goto fail2;
+    }
+
+    snd_pcm_hw_params_free(hw);
+    snd_pcm_sw_params_free(sw);
+
+    dma.speed = rate;
+    dma.channels = 2;
+    dma.samplebits = 16;
+    dma.samples = alsa.frames * 2;
+    dma.submission_chunk = 1;
+    dma.samplepos = 0;
+    dma.buffer = areas[0].addr;
+    memset(dma.buffer, 0, dma.samples * 2);
+
+    alsa.active = qtrue;
+    ALSA_Align();
+
+    Com_Printf("ALSA initialization succeeded: %u Hz, %lu frames in %lu "
+               "frame periods\n", rate, (unsigned long)alsa.frames,
+               (unsigned long)alsa.period);
+
+    return SIS_SUCCESS;
+
+fail:
+    Com_WPrintf("Couldn't %s of ALSA device %s: %s\n", what,
+                s_alsa_device->string, snd_strerror(ret));
+fail2:
+    if (hw)
+        snd_pcm_hw_params_free(hw);
+    if (sw)
+        snd_pcm_sw_params_free(sw);
+    snd_pcm_close(alsa.pcm);
+    memset(&alsa, 0, sizeof(alsa));
+    return SIS_FAILURE;
+}
+
+static void ALSA_BeginPainting(void)
+{
+    snd_pcm_sframes_t avail;
+    int playing;
+
+    if (!alsa.pcm || !alsa.active)
+        return;
+
+    avail = snd_pcm_avail_update(alsa.pcm);
+    if (avail < 0 || avail > alsa.frames) {
+        // underrun, or device was suspended
+        if (avail == -ESTRPIPE) {
+            if (snd_pcm_resume(alsa.pcm) == -EAGAIN)
+                return;
+        }
+        ALSA_Restart();
+        avail = snd_pcm_avail_update(alsa.pcm);
+        if (avail < 0)
+            return;
+    }
+
+    // whatever was committed and isn't free again is still queued
+    playing = alsa.committed - (int)(alsa.frames - avail);
+    dma.samplepos = (playing % (int)alsa.frames) * dma.channels;
+    if (dma.samplepos < 0)
+        dma.samplepos += dma.samples;
+}
+
+static void ALSA_Submit(void)
+{
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames;
+    snd_pcm_sframes_t ret;
+    int count;
+
+    if (!alsa.pcm || !alsa.active)
+        return;
+
+    count = paintedtime - alsa.committed;
+    if (count < 0 || count > alsa.frames) {
+        // painting jumped ahead after an overflow
+        ALSA_Restart();
+        return;
+    }
+
+    while (count > 0) {
+        frames = count;
+        if (snd_pcm_mmap_begin(alsa.pcm, &areas, &offset, &frames) < 0 || !frames)
+            break;
+        ret = snd_pcm_mmap_commit(alsa.pcm, offset, frames);
+        if (ret < 0) {
+            ALSA_Restart();
+            return;
+        }
+        alsa.committed += ret;
+        count -= ret;
+    }
+
+    if (snd_pcm_state(alsa.pcm) == SND_PCM_STATE_PREPARED)
+        snd_pcm_start(alsa.pcm);
+}
+
+static void ALSA_Activate(qboolean active)
+{
+    if (!alsa.pcm || alsa.active == active)
+        return;
+
+    alsa.active = active;
+    if (active) {
+        snd_pcm_prepare(alsa.pcm);
+        ALSA_Align();
+    } else {
+        snd_pcm_drop(alsa.pcm);
+    }
+}
+
+void ALSA_FillAPI(snddmaAPI_t *api)
+{
+    api->Init = ALSA_Init;
+    api->Shutdown = ALSA_Shutdown;
+    api->BeginPainting = ALSA_BeginPainting;
+    api->Submit = ALSA_Submit;
+    api->Activate = ALSA_Activate;
+}
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "client/keys.h"
 #include "client/input.h"
 #include "client/client.h"
+#include "system/thread.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -31,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <linux/input.h>
 
@@ -47,23 +49,50 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FOR_EACH_EVDEV_SAFE(dev, next) \
     LIST_FOR_EACH_SAFE(evdev_t, dev, next, &evdev.devices, entry)
 
+//
+// Devices are read by a separate thread as soon as events arrive. Motion is
+// accumulated and button events are queued until the main thread picks them
+// up, so usercmds see all motion up to the moment they are built rather than
+// up to the last IN_Frame.
+//
+
 typedef struct {
     list_t      entry;
     char        *path;
     char        *name;
     int         fd;
+    int         error;      // set by input thread on read failure
 } evdev_t;
 
+typedef struct {
+    unsigned    key;
+    qboolean    down;
+    unsigned    time;
+} evkey_t;
+
+#define MAX_EVENTS      64
+#define MAX_KEYS        64  // must be power of two
+#define EVENT_SIZE      sizeof(struct input_event)
+
 static struct {
     qboolean    initialized;
     grab_t      grabbed;
     list_t      devices;
+
+    qthread_t       *thread;
+    int             pipefd[2];  // wakes input thread up for exit
+    struct pollfd   *pollfds;
+    evdev_t         **polldevs;
+    int             numpolls;
+
+    // protected by lock while input thread is running
+    qmutex_t    *lock;
     int         dx, dy;
+    evkey_t     keys[MAX_KEYS];
+    unsigned    keyhead, keytail;
+    qboolean    failed;
 } evdev;
 
-#define MAX_EVENTS    64
-#define EVENT_SIZE    sizeof(struct input_event)
-
 static void evdev_remove(evdev_t *dev)
 {
     Com_DPrintf("Removing %s [%s]\n", dev->path, dev->name);
@@ -75,6 +104,22 @@ static void evdev_remove(evdev_t *dev)
     Z_Free(dev);
 }
 
+// called with lock held
+static void queue_key(unsigned key, qboolean down, unsigned time)
+{
+    evkey_t *k;
+
+    if (evdev.keyhead - evdev.keytail >= MAX_KEYS) {
+        return; // main thread stalled, drop it
+    }
+
+    k = &evdev.keys[evdev.keyhead++ & (MAX_KEYS - 1)];
+    k->key = key;
+    k->down = down;
+    k->time = time;
+}
+
+// runs on input thread
 static void evdev_read(evdev_t *dev)
 {
     struct input_event ev[MAX_EVENTS];
@@ -87,8 +132,10 @@ static void evdev_read(evdev_t *dev)
         if (errno == EAGAIN || errno == EINTR) {
             return;
         }
-        Com_EPrintf("Couldn't read %s: %s\n", dev->path, strerror(errno));
-        evdev_remove(dev);
+        dev->error = errno;
+        Sys_LockMutex(evdev.lock);
+        evdev.failed = qtrue;
+        Sys_UnlockMutex(evdev.lock);
         return;
     }
 
@@ -96,6 +143,7 @@ static void evdev_read(evdev_t *dev)
         return; // should not happen
     }
 
+    Sys_LockMutex(evdev.lock);
     count = bytes / EVENT_SIZE;
     for (i = 0; i < count; i++) {
         time = ev[i].time.tv_sec * 1000 + ev[i].time.tv_usec / 1000;
@@ -103,7 +151,7 @@ static void evdev_read(evdev_t *dev)
         case EV_KEY:
             if (ev[i].code >= BTN_MOUSE && ev[i].code < BTN_MOUSE + 8) {
                 button = K_MOUSE1 + ev[i].code - BTN_MOUSE;
-                Key_Event(button, !!ev[i].value, time);
+                queue_key(button, !!ev[i].value, time);
             }
             break;
         case EV_REL:
@@ -116,20 +164,20 @@ static void evdev_read(evdev_t *dev)
                 break;
             case REL_WHEEL:
                 if ((int)ev[i].value == 1) {
-                    Key_Event(K_MWHEELUP, qtrue, time);
-                    Key_Event(K_MWHEELUP, qfalse, time);
+                    queue_key(K_MWHEELUP, qtrue, time);
+                    queue_key(K_MWHEELUP, qfalse, time);
                 } else if ((int)ev[i].value == -1) {
-                    Key_Event(K_MWHEELDOWN, qtrue, time);
-                    Key_Event(K_MWHEELDOWN, qfalse, time);
+                    queue_key(K_MWHEELDOWN, qtrue, time);
+                    queue_key(K_MWHEELDOWN, qfalse, time);
                 }
                 break;
             case REL_HWHEEL:
                 if ((int)ev[i].value == 1) {
-                    Key_Event(K_MWHEELRIGHT, qtrue, time);
-                    Key_Event(K_MWHEELRIGHT, qfalse, time);
+                    queue_key(K_MWHEELRIGHT, qtrue, time);
+                    queue_key(K_MWHEELRIGHT, qfalse, time);
                 } else if ((int)ev[i].value == -1) {
-                    Key_Event(K_MWHEELLEFT, qtrue, time);
-                    Key_Event(K_MWHEELLEFT, qfalse, time);
+                    queue_key(K_MWHEELLEFT, qtrue, time);
+                    queue_key(K_MWHEELLEFT, qfalse, time);
                 }
                 break;
             default:
@@ -140,18 +188,142 @@ static void evdev_read(evdev_t *dev)
             break;
         }
     }
+    Sys_UnlockMutex(evdev.lock);
 }
 
-static void GetMouseEvents(void)
+static void input_thread(void *arg)
 {
-    evdev_t *dev, *next;
+    struct pollfd *p;
+    int i, ret;
+
+    while (1) {
+        ret = poll(evdev.pollfds, evdev.numpolls, -1);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
 
-    if (!evdev.initialized || !evdev.grabbed) {
+        // asked to exit
+        if (evdev.pollfds[0].revents) {
+            break;
+        }
+
+        for (i = 1; i < evdev.numpolls; i++) {
+            p = &evdev.pollfds[i];
+            if (!p->revents) {
+                continue;
+            }
+            evdev_read(evdev.polldevs[i]);
+            if (evdev.polldevs[i]->error) {
+                p->fd = -1; // stop polling it
+            }
+        }
+    }
+}
+
+static void start_thread(void)
+{
+    evdev_t *dev;
+    int i;
+
+    if (LIST_EMPTY(&evdev.devices)) {
+        return;
+    }
+
+    if (pipe(evdev.pipefd) == -1) {
+        Com_EPrintf("Couldn't create pipe: %s\n", strerror(errno));
+        return;
+    }
+
+    evdev.numpolls = 1 + List_Count(&evdev.devices);
+    evdev.pollfds = Z_Mallocz(sizeof(*evdev.pollfds) * evdev.numpolls);
+    evdev.polldevs = Z_Mallocz(sizeof(*evdev.polldevs) * evdev.numpolls);
+
+    evdev.pollfds[0].fd = evdev.pipefd[0];
+    evdev.pollfds[0].events = POLLIN;
+
+    i = 1;
+    FOR_EACH_EVDEV(dev) {
+        evdev.pollfds[i].fd = dev->fd;
+        evdev.pollfds[i].events = POLLIN;
+        evdev.polldevs[i] = dev;
+        i++;
+    }
+
+    evdev.failed = qfalse;
+    evdev.thread = Sys_CreateThread(input_thread, NULL);
+}
+
+static void stop_thread(void)
+{
+    if (!evdev.thread) {
         return;
     }
 
+    if (write(evdev.pipefd[1], "", 1) == -1) {
+        Com_EPrintf("Couldn't wake input thread: %s\n", strerror(errno));
+    }
+
+    Sys_JoinThread(evdev.thread);
+    evdev.thread = NULL;
+
+    close(evdev.pipefd[0]);
+    close(evdev.pipefd[1]);
+
+    Z_Free(evdev.pollfds);
+    Z_Free(evdev.polldevs);
+    evdev.pollfds = NULL;
+    evdev.polldevs = NULL;
+    evdev.numpolls = 0;
+}
+
+// removes devices input thread couldn't read from
+static void remove_failed(void)
+{
+    evdev_t *dev, *next;
+
+    stop_thread();
+
     FOR_EACH_EVDEV_SAFE(dev, next) {
-        evdev_read(dev);
+        if (dev->error) {
+            Com_EPrintf("Couldn't read %s: %s\n", dev->path, strerror(dev->error));
+            evdev_remove(dev);
+        }
+    }
+
+    start_thread();
+}
+
+static void GetMouseEvents(void)
+{
+    evkey_t keys[MAX_KEYS];
+    qboolean failed;
+    int i, count;
+
+    if (!evdev.initialized) {
+        return;
+    }
+
+    Sys_LockMutex(evdev.lock);
+    failed = evdev.failed;
+    count = evdev.keyhead - evdev.keytail;
+    for (i = 0; i < count; i++) {
+        keys[i] = evdev.keys[evdev.keytail++ & (MAX_KEYS - 1)];
+    }
+    Sys_UnlockMutex(evdev.lock);
+
+    if (failed) {
+        remove_failed();
+    }
+
+    if (!evdev.grabbed) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        Key_Event(keys[i].key, keys[i].down, keys[i].time);
     }
 }
 
@@ -161,13 +333,25 @@ static qboolean GetMouseMotion(int *dx, int *dy)
         return qfalse;
     }
 
+    Sys_LockMutex(evdev.lock);
     *dx = evdev.dx;
     *dy = evdev.dy;
     evdev.dx = 0;
     evdev.dy = 0;
+    Sys_UnlockMutex(evdev.lock);
     return qtrue;
 }
 
+// discards motion and events accumulated so far
+static void flush_events(void)
+{
+    Sys_LockMutex(evdev.lock);
+    evdev.dx = 0;
+    evdev.dy = 0;
+    evdev.keytail = evdev.keyhead;
+    Sys_UnlockMutex(evdev.lock);
+}
+
 static void ShutdownMouse(void)
 {
     evdev_t *dev, *next;
@@ -176,6 +360,9 @@ static void ShutdownMouse(void)
         return;
     }
 
+    stop_thread();
+    Sys_DestroyMutex(evdev.lock);
+
     FOR_EACH_EVDEV_SAFE(dev, next) {
         evdev_remove(dev);
     }
@@ -312,6 +499,9 @@ static qboolean InitMouse(void)
 
     Cmd_AddCommand("evdevlist", ListDevices_f);
 
+    evdev.lock = Sys_CreateMutex();
+    start_thread();
+
     Com_Printf("Evdev mouse initialized.\n");
     evdev.initialized = qtrue;
 
@@ -320,16 +510,12 @@ static qboolean InitMouse(void)
 
 static void GrabMouse(grab_t grab)
 {
-    struct input_event ev;
-    evdev_t *dev;
-
     if (!evdev.initialized) {
         return;
     }
 
     if (evdev.grabbed == grab) {
-        evdev.dx = 0;
-        evdev.dy = 0;
+        flush_events();
         return;
     }
 
@@ -351,16 +537,8 @@ static void GrabMouse(grab_t grab)
     }
 #endif
 
-    if (grab) {
-        // pump pending events
-        FOR_EACH_EVDEV(dev) {
-            while (read(dev->fd, &ev, EVENT_SIZE) == EVENT_SIZE)
-                ;
-        }
-    }
-
-    evdev.dx = 0;
-    evdev.dy = 0;
+    // drop events from before the grab
+    flush_events();
     evdev.grabbed = grab;
 }
 
@@ -17,9 +17,24 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "common/common.h"
 #include "system/hunk.h"
+#include "system/system.h"
 #include <sys/mman.h>
 #include <errno.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define HUGE_PAGE_SIZE  0x200000
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED  1
+#endif
+
+cvar_t  *sys_hugepages;
+cvar_t  *sys_numalocal;
 
 void Hunk_Begin(memhunk_t *hunk, size_t maxsize)
 {
@@ -31,6 +46,7 @@ void Hunk_Begin(memhunk_t *hunk, size_t maxsize)
     // reserve a huge chunk of memory, but don't commit any yet
     hunk->cursize = 0;
     hunk->maxsize = (maxsize + 4095) & ~4095;
+    hunk->hugetlb = qfalse;
     buf = mmap(NULL, hunk->maxsize, PROT_READ | PROT_WRITE,
                MAP_PRIVATE | MAP_ANON, -1, 0);
     if (buf == NULL || buf == (void *)-1)
@@ -40,6 +56,105 @@ void Hunk_Begin(memhunk_t *hunk, size_t maxsize)
     hunk->mapped = hunk->maxsize;
 }
 
+// prefer the memory node of the calling CPU for pages not yet touched
+static void bind_local_node(void *base, size_t size)
+{
+#if (defined __linux__) && (defined SYS_mbind) && (defined SYS_getcpu)
+    unsigned cpu, node;
+    unsigned long mask;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL))
+        return;
+    if (node >= sizeof(mask) * 8)
+        return;
+
+    mask = 1UL << node;
+    if (syscall(SYS_mbind, base, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0))
+        Com_DPrintf("%s: mbind failed: %s\n", __func__, strerror(errno));
+#endif
+}
+
+// reserves address space aligned to huge page boundary and asks for
+// transparent huge pages to back it
+static void *reserve_aligned(size_t size)
+{
+    byte *buf, *base;
+    size_t head, tail;
+
+    buf = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (buf == NULL || buf == (void *)-1)
+        return NULL;
+
+    base = (byte *)(((uintptr_t)buf + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    head = base - buf;
+    tail = HUGE_PAGE_SIZE - head;
+    if (head)
+        munmap(buf, head);
+    if (tail)
+        munmap(base + size, tail);
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(base, size, MADV_HUGEPAGE))
+        Com_DPrintf("%s: madvise failed: %s\n", __func__, strerror(errno));
+#endif
+    return base;
+}
+
+/*
+Like Hunk_Begin, for large hunks that are accessed randomly, such as map
+data walked by traces and the renderer. Depending on sys_hugepages, they
+get backed by huge pages to save TLB misses. Explicit huge pages fall back
+to transparent ones when the system has none reserved.
+*/
+void Hunk_BeginHuge(memhunk_t *hunk, size_t maxsize)
+{
+    int mode = sys_hugepages ? sys_hugepages->integer : 0;
+    size_t size;
+    void *buf = NULL;
+
+    if (mode <= 0 || maxsize < HUGE_PAGE_SIZE) {
+        Hunk_Begin(hunk, maxsize);
+        goto bind;
+    }
+
+    if (maxsize > SIZE_MAX - HUGE_PAGE_SIZE * 2)
+        Com_Error(ERR_FATAL, "%s: size > SIZE_MAX", __func__);
+
+    size = (maxsize + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    hunk->hugetlb = qfalse;
+
+#ifdef MAP_HUGETLB
+    if (mode > 1) {
+        buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+        if (buf == (void *)-1) {
+            Com_DPrintf("%s: MAP_HUGETLB failed: %s\n", __func__, strerror(errno));
+            buf = NULL;
+        } else if (buf) {
+            hunk->hugetlb = qtrue;
+        }
+    }
+#endif
+
+    if (!buf)
+        buf = reserve_aligned(size);
+
+    if (!buf) {
+        Hunk_Begin(hunk, maxsize);
+        goto bind;
+    }
+
+    hunk->base = buf;
+    hunk->cursize = 0;
+    hunk->maxsize = size;
+    hunk->mapped = size;
+
+bind:
+    if (sys_numalocal && sys_numalocal->integer)
+        bind_local_node(hunk->base, hunk->maxsize);
+}
+
 void *Hunk_Alloc(memhunk_t *hunk, size_t size)
 {
     void *buf;
@@ -68,16 +183,22 @@ void Hunk_End(memhunk_t *hunk)
     if (hunk->cursize > hunk->maxsize)
         Com_Error(ERR_FATAL, "%s: cursize > maxsize", __func__);
 
-    newsize = (hunk->cursize + 4095) & ~4095;
+    if (hunk->hugetlb)
+        newsize = (hunk->cursize + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    else
+        newsize = (hunk->cursize + 4095) & ~4095;
 
     if (newsize < hunk->maxsize) {
-#if (defined __linux__) && (defined _GNU_SOURCE)
-        void *buf = mremap(hunk->base, hunk->maxsize, newsize, 0);
-#else
         void *unmap_base = (byte *)hunk->base + newsize;
         size_t unmap_len = hunk->maxsize - newsize;
-        void *buf = munmap(unmap_base, unmap_len) + (byte *)hunk->base;
+        void *buf;
+#if (defined __linux__) && (defined _GNU_SOURCE)
+        // not every kernel can remap explicit huge pages
+        if (!hunk->hugetlb)
+            buf = mremap(hunk->base, hunk->maxsize, newsize, 0);
+        else
 #endif
+            buf = munmap(unmap_base, unmap_len) + (byte *)hunk->base;
         if (buf != hunk->base)
             Com_Error(ERR_FATAL, "%s: could not remap virtual block: %s",
                       __func__, strerror(errno));
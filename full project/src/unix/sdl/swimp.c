@@ -18,8 +18,34 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "video.h"
 
+/*
+The renderer writes 32 bit B, G, R, X pixels straight into the video
+surface. When the display can't take that layout SDL hands out a shadow
+surface instead and converts all of it on every flip, which is worth
+knowing about when the frames are post processed or encoded.
+*/
 void VID_SDL_SurfaceChanged(void)
 {
+    const SDL_VideoInfo *info = SDL_GetVideoInfo();
+    SDL_PixelFormat *fmt = sdl.surface->format;
+
+    if (fmt->BytesPerPixel != 4 || fmt->Rmask != 0xff0000 ||
+        fmt->Gmask != 0x00ff00 || fmt->Bmask != 0x0000ff) {
+        Com_EPrintf("Video surface is %d bpp with unexpected channel masks, "
+                    "colors will be wrong\n", fmt->BitsPerPixel);
+        return;
+    }
+
+    if (info && info->vfmt && (info->vfmt->BitsPerPixel != fmt->BitsPerPixel ||
+                               info->vfmt->Rmask != fmt->Rmask ||
+                               info->vfmt->Bmask != fmt->Bmask)) {
+        Com_WPrintf("Display is %d bpp, SDL converts each frame from 32 bpp. "
+                    "Use a 32 bpp display for direct output.\n",
+                    info->vfmt->BitsPerPixel);
+        return;
+    }
+
+    Com_DPrintf("...rendering directly into a 32 bpp video surface\n");
 }
 
 qboolean VID_Init(void)
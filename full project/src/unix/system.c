@@ -17,10 +17,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/files.h"
+#include "common/net/net.h"
 #if USE_REF
 #include "client/video.h"
 #endif
@@ -31,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -45,7 +48,11 @@ cvar_t  *sys_forcegamelib;
 
 cvar_t  *sys_parachute;
 
+static cvar_t   *sys_instances;
+static cvar_t   *sys_instance_maps;
+
 static qboolean terminate;
+static volatile sig_atomic_t flush_logs;
 
 /*
 ===============================================================================
@@ -62,12 +69,19 @@ void Sys_DebugBreak(void)
 
 unsigned Sys_Milliseconds(void)
 {
-    struct timeval tp;
-    unsigned time;
+    struct timespec ts;
+
+    // monotonic, so that frame deadlines survive wall clock adjustments
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+unsigned Sys_Microseconds(void)
+{
+    struct timespec ts;
 
-    gettimeofday(&tp, NULL);
-    time = tp.tv_sec * 1000 + tp.tv_usec / 1000;
-    return time;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 /*
@@ -135,7 +149,8 @@ qboolean Sys_GetAntiCheatAPI(void)
 
 static void hup_handler(int signum)
 {
-    Com_FlushLogs();
+    // logs are written by the async thread, reopen them from main loop
+    flush_logs = qtrue;
 }
 
 static void term_handler(int signum)
@@ -179,6 +194,7 @@ void Sys_Init(void)
     signal(SIGINT, term_handler);
     signal(SIGTTIN, SIG_IGN);
     signal(SIGTTOU, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);   // closed pipes and sockets fail with EPIPE instead
     signal(SIGUSR1, hup_handler);
 
     // basedir <path>
@@ -200,6 +216,10 @@ void Sys_Init(void)
     sys_homedir = Cvar_Get("homedir", homedir, CVAR_NOSET);
     sys_libdir = Cvar_Get("libdir", LIBDIR, CVAR_NOSET);
     sys_forcegamelib = Cvar_Get("sys_forcegamelib", "", CVAR_NOSET);
+    sys_hugepages = Cvar_Get("sys_hugepages", "1", 0);
+    sys_numalocal = Cvar_Get("sys_numalocal", "0", 0);
+    sys_instances = Cvar_Get("sys_instances", "0", CVAR_NOSET);
+    sys_instance_maps = Cvar_Get("sys_instance_maps", "", CVAR_NOSET);
 
     if (tty_init_input()) {
         signal(SIGHUP, term_handler);
@@ -218,6 +238,157 @@ void Sys_Init(void)
     }
 }
 
+/*
+===============================================================================
+
+HOST MODE
+
+A dedicated server started with sys_instances above 1 becomes a host process
+that forks that many server instances and then just waits for them. Whatever
+was loaded before the fork (pack directories and the file index, plus any
+maps preloaded into the BSP cache) stays shared between the instances
+copy-on-write, since nothing writes to it afterwards. Each instance listens
+on its own port and is otherwise independent.
+
+===============================================================================
+*/
+
+#define MAX_INSTANCES   64
+
+static pid_t    instance_pids[MAX_INSTANCES];
+static int      num_instances;
+
+static void host_handler(int signum)
+{
+    int i;
+
+    // pass termination and log reopening on to the instances
+    for (i = 0; i < num_instances; i++) {
+        if (instance_pids[i] > 0) {
+            kill(instance_pids[i], signum);
+        }
+    }
+}
+
+static void preload_maps(const char *list)
+{
+    char *s, *tok;
+    bsp_t *bsp;
+    qerror_t ret;
+
+    s = Z_CopyString(list);
+    for (tok = strtok(s, " ,"); tok; tok = strtok(NULL, " ,")) {
+        // the reference is never released, keeping the map in cache
+        ret = BSP_Load(va("maps/%s.bsp", tok), &bsp);
+        if (ret) {
+            Com_WPrintf("Couldn't preload %s: %s\n", tok, Q_ErrorString(ret));
+        }
+    }
+    Z_Free(s);
+}
+
+static int wait_instances(void)
+{
+    int i, status, running, failed;
+    pid_t pid;
+
+    running = num_instances;
+    failed = 0;
+    while (running) {
+        pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (i = 0; i < num_instances; i++) {
+            if (instance_pids[i] == pid)
+                break;
+        }
+        if (i == num_instances)
+            continue;
+
+        instance_pids[i] = 0;
+        running--;
+
+        if (WIFSIGNALED(status)) {
+            Com_WPrintf("Instance %d killed by signal %d\n", i, WTERMSIG(status));
+            failed++;
+        } else if (WEXITSTATUS(status)) {
+            Com_WPrintf("Instance %d exited with status %d\n", i, WEXITSTATUS(status));
+            failed++;
+        } else {
+            Com_Printf("Instance %d exited\n", i);
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+=================
+Sys_SpawnInstances
+
+Returns in each forked instance, never returns in the host process.
+=================
+*/
+void Sys_SpawnInstances(void)
+{
+    cvar_t *sys_instance, *net_port, *net_tcp_port;
+    int i, count, port;
+    pid_t pid;
+
+    sys_instance = Cvar_Get("sys_instance", "0", CVAR_ROM);
+
+    count = Cvar_ClampInteger(sys_instances, 0, MAX_INSTANCES);
+    if (count < 2)
+        return;
+
+    preload_maps(sys_instance_maps->string);
+
+    // only the host keeps the console, instances just print
+    tty_shutdown_input();
+    Com_FlushLogs();
+    FS_SuspendAsync();
+
+    for (i = 0; i < count; i++) {
+        pid = fork();
+        if (pid == -1) {
+            Com_EPrintf("Couldn't fork instance %d: %s\n", i, strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            num_instances = 0;
+
+            net_port = Cvar_Get("net_port", PORT_SERVER_STRING, 0);
+            net_tcp_port = Cvar_Get("net_tcp_port", net_port->string, 0);
+            port = net_port->integer + i;
+            if (net_tcp_port->integer == net_port->integer) {
+                Cvar_SetInteger(net_tcp_port, port, FROM_CODE);
+            }
+            Cvar_SetInteger(net_port, port, FROM_CODE);
+            Cvar_SetInteger(sys_instance, i, FROM_CODE);
+
+            Com_Printf("Instance %d listening on port %d\n", i, port);
+            Com_AddConfigFile(va("instance%d.cfg", i), FS_TYPE_REAL | FS_PATH_GAME);
+            FS_ResumeAsync();
+            return;
+        }
+        instance_pids[num_instances++] = pid;
+    }
+
+    FS_ResumeAsync();
+
+    signal(SIGTERM, host_handler);
+    signal(SIGINT, host_handler);
+    signal(SIGHUP, host_handler);
+    signal(SIGUSR1, host_handler);
+
+    Com_Printf("Host process running %d instances\n", num_instances);
+    exit(wait_instances());
+}
+
 /*
 =================
 Sys_Error
@@ -463,6 +634,10 @@ int main(int argc, char **argv)
 
     Qcommon_Init(argc, argv);
     while (!terminate) {
+        if (flush_logs) {
+            flush_logs = qfalse;
+            Com_FlushLogs();
+        }
         Qcommon_Frame();
     }
 
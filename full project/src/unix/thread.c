@@ -0,0 +1,130 @@
+/*
+Copyright (C) 2003-2012 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "system/thread.h"
+#include <pthread.h>
+#include <errno.h>
+
+struct qthread_s {
+    pthread_t   thread;
+    void        (*func)(void *);
+    void        *arg;
+};
+
+struct qmutex_s {
+    pthread_mutex_t mutex;
+};
+
+struct qcond_s {
+    pthread_cond_t  cond;
+};
+
+static void *thread_func(void *arg)
+{
+    qthread_t *t = arg;
+
+    t->func(t->arg);
+    return NULL;
+}
+
+qthread_t *Sys_CreateThread(void (*func)(void *), void *arg)
+{
+    qthread_t *t;
+    int ret;
+
+    t = malloc(sizeof(*t));
+    if (!t)
+        Com_Error(ERR_FATAL, "%s: out of memory", __func__);
+
+    t->func = func;
+    t->arg = arg;
+
+    ret = pthread_create(&t->thread, NULL, thread_func, t);
+    if (ret)
+        Com_Error(ERR_FATAL, "%s: %s", __func__, strerror(ret));
+
+    return t;
+}
+
+void Sys_JoinThread(qthread_t *t)
+{
+    pthread_join(t->thread, NULL);
+    free(t);
+}
+
+qmutex_t *Sys_CreateMutex(void)
+{
+    qmutex_t *m;
+
+    m = malloc(sizeof(*m));
+    if (!m)
+        Com_Error(ERR_FATAL, "%s: out of memory", __func__);
+
+    pthread_mutex_init(&m->mutex, NULL);
+    return m;
+}
+
+void Sys_DestroyMutex(qmutex_t *m)
+{
+    pthread_mutex_destroy(&m->mutex);
+    free(m);
+}
+
+void Sys_LockMutex(qmutex_t *m)
+{
+    pthread_mutex_lock(&m->mutex);
+}
+
+void Sys_UnlockMutex(qmutex_t *m)
+{
+    pthread_mutex_unlock(&m->mutex);
+}
+
+qcond_t *Sys_CreateCond(void)
+{
+    qcond_t *c;
+
+    c = malloc(sizeof(*c));
+    if (!c)
+        Com_Error(ERR_FATAL, "%s: out of memory", __func__);
+
+    pthread_cond_init(&c->cond, NULL);
+    return c;
+}
+
+void Sys_DestroyCond(qcond_t *c)
+{
+    pthread_cond_destroy(&c->cond);
+    free(c);
+}
+
+void Sys_WaitCond(qcond_t *c, qmutex_t *m)
+{
+    pthread_cond_wait(&c->cond, &m->mutex);
+}
+
+void Sys_SignalCond(qcond_t *c)
+{
+    pthread_cond_signal(&c->cond);
+}
+
+void Sys_BroadcastCond(qcond_t *c)
+{
+    pthread_cond_broadcast(&c->cond);
+}
@@ -35,6 +35,12 @@ void Hunk_Begin(memhunk_t *hunk, size_t maxsize)
                   hunk->maxsize, GetLastError());
 }
 
+// large pages need a privilege normal users don't have
+void Hunk_BeginHuge(memhunk_t *hunk, size_t maxsize)
+{
+    Hunk_Begin(hunk, maxsize);
+}
+
 void *Hunk_Alloc(memhunk_t *hunk, size_t size)
 {
     void *buf;
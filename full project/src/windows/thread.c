@@ -0,0 +1,134 @@
+/*
+Copyright (C) 2003-2012 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// condition variables need Vista
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+
+#include "shared/shared.h"
+#include "system/thread.h"
+#include <windows.h>
+
+struct qthread_s {
+    HANDLE      handle;
+    void        (*func)(void *);
+    void        *arg;
+};
+
+struct qmutex_s {
+    CRITICAL_SECTION    cs;
+};
+
+struct qcond_s {
+    CONDITION_VARIABLE  cv;
+};
+
+static DWORD WINAPI thread_func(LPVOID arg)
+{
+    qthread_t *t = arg;
+
+    t->func(t->arg);
+    return 0;
+}
+
+qthread_t *Sys_CreateThread(void (*func)(void *), void *arg)
+{
+    qthread_t *t;
+
+    t = malloc(sizeof(*t));
+    if (!t)
+        Com_Error(ERR_FATAL, "%s: out of memory", __func__);
+
+    t->func = func;
+    t->arg = arg;
+
+    t->handle = CreateThread(NULL, 0, thread_func, t, 0, NULL);
+    if (!t->handle)
+        Com_Error(ERR_FATAL, "%s: CreateThread failed with error %lu",
+                  __func__, GetLastError());
+
+    return t;
+}
+
+void Sys_JoinThread(qthread_t *t)
+{
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    free(t);
+}
+
+qmutex_t *Sys_CreateMutex(void)
+{
+    qmutex_t *m;
+
+    m = malloc(sizeof(*m));
+    if (!m)
+        Com_Error(ERR_FATAL, "%s: out of memory", __func__);
+
+    InitializeCriticalSection(&m->cs);
+    return m;
+}
+
+void Sys_DestroyMutex(qmutex_t *m)
+{
+    DeleteCriticalSection(&m->cs);
+    free(m);
+}
+
+void Sys_LockMutex(qmutex_t *m)
+{
+    EnterCriticalSection(&m->cs);
+}
+
+void Sys_UnlockMutex(qmutex_t *m)
+{
+    LeaveCriticalSection(&m->cs);
+}
+
+qcond_t *Sys_CreateCond(void)
+{
+    qcond_t *c;
+
+    c = malloc(sizeof(*c));
+    if (!c)
+        Com_Error(ERR_FATAL, "%s: out of memory", __func__);
+
+    InitializeConditionVariable(&c->cv);
+    return c;
+}
+
+void Sys_DestroyCond(qcond_t *c)
+{
+    free(c);
+}
+
+void Sys_WaitCond(qcond_t *c, qmutex_t *m)
+{
+    SleepConditionVariableCS(&c->cv, &m->cs, INFINITE);
+}
+
+void Sys_SignalCond(qcond_t *c)
+{
+    WakeConditionVariable(&c->cv);
+}
+
+void Sys_BroadcastCond(qcond_t *c)
+{
+    WakeAllConditionVariable(&c->cv);
+}